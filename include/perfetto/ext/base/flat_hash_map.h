@@ -25,6 +25,13 @@
 #include <algorithm>
 #include <functional>
 #include <limits>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace perfetto {
 namespace base {
@@ -80,6 +87,69 @@ struct QuadraticHalfProbe {
   }
 };
 
+// SwissTable-style probing: rather than one slot at a time, it probes groups
+// of kGroupSize consecutive slots, comparing all their tags against the key's
+// tag at once (with SSE2 or NEON where available). Groups are visited with the
+// same sequence as QuadraticHalfProbe. A lookup stops at the first group
+// with a free slot, so probe chains are at most a few groups long even at
+// high load or when the hash function clusters badly, and the first group
+// usually answers the lookup with a single tag comparison.
+// It pays off for large maps close to their load limit and lookups that miss
+// (~15% faster than QuadraticProbe in flat_hash_map_benchmark.cc), but it's
+// slower than the per-slot probes when most keys sit in their first slot.
+// Calc() returns the index of the first slot of the |step|-th group.
+struct GroupProbe {
+  static constexpr size_t kGroupSize = 16;
+
+  static inline size_t Calc(size_t key_hash, size_t step, size_t capacity) {
+    return ((key_hash & ~(kGroupSize - 1)) +
+            (step * step + step) / 2 * kGroupSize) &
+           (capacity - 1);
+  }
+
+  // Returns a bitmask with one bit set for each of the kGroupSize tags
+  // starting at |tags| that is equal to |tag|. Use SlotOf() to convert the
+  // bits into slot offsets within the group.
+  static inline uint64_t Match(const uint8_t* tags, uint8_t tag) {
+#if defined(__SSE2__)
+    const __m128i group =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags));
+    const __m128i eq =
+        _mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(tag)));
+    return static_cast<uint16_t>(_mm_movemask_epi8(eq));
+#elif defined(__ARM_NEON)
+    // NEON has no movemask: narrow each 0x00/0xff byte to a nibble and keep
+    // one bit per nibble.
+    const uint8x16_t eq = vceqq_u8(vld1q_u8(tags), vdupq_n_u8(tag));
+    const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+           0x8888888888888888ull;
+#else
+    uint64_t mask = 0;
+    for (size_t i = 0; i < kGroupSize; i++)
+      mask |= static_cast<uint64_t>(tags[i] == tag) << i;
+    return mask;
+#endif
+  }
+
+  // Returns the offset within the group of the slot of the lowest bit set in
+  // |mask|, which must be != 0.
+  static inline size_t SlotOf(uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    const size_t bit = static_cast<size_t>(__builtin_ctzll(mask));
+#else
+    size_t bit = 0;
+    for (; !(mask & 1); mask >>= 1)
+      bit++;
+#endif
+#if !defined(__SSE2__) && defined(__ARM_NEON)
+    return bit / 4;
+#else
+    return bit;
+#endif
+  }
+};
+
 template <typename Key,
           typename Value,
           typename Hasher = base::Hash<Key>,
@@ -179,6 +249,38 @@ class FlatHashMap {
     for (;;) {
       PERFETTO_DCHECK((capacity_ & (capacity_ - 1)) == 0);  // Must be a pow2.
       insertion_slot = kSlotNotFound;
+      if (kGroupProbing) {
+        // Same as the per-slot loop below, but |probe_len| counts groups.
+        const size_t num_groups = capacity_ / GroupProbe::kGroupSize;
+        for (probe_len = 0; probe_len < num_groups;) {
+          const size_t group = Probe::Calc(key_hash, probe_len, capacity_);
+          const uint8_t* group_tags = &tags_[group];
+          ++probe_len;
+          for (uint64_t m = GroupProbe::Match(group_tags, tag); m; m &= m - 1) {
+            const size_t idx = group + GroupProbe::SlotOf(m);
+            if (keys_[idx] == key)
+              return std::make_pair(&values_[idx], false);
+          }
+          if (!AppendOnly && insertion_slot == kSlotNotFound) {
+            uint64_t m = GroupProbe::Match(group_tags, kTombstone);
+            if (m)
+              insertion_slot = group + GroupProbe::SlotOf(m);
+          }
+          uint64_t m = GroupProbe::Match(group_tags, kFreeSlot);
+          if (m) {
+            if (AppendOnly || insertion_slot == kSlotNotFound)
+              insertion_slot = group + GroupProbe::SlotOf(m);
+            break;
+          }
+        }
+        if (PERFETTO_UNLIKELY(size_ >= load_limit_)) {
+          MaybeGrowAndRehash(/*grow=*/true);
+          continue;
+        }
+        PERFETTO_DCHECK(insertion_slot != kSlotNotFound);
+        break;
+      }
+
       // Start the iteration at the desired slot (key_hash % capacity_)
       // searching either for a free slot or a tombstone. In the worst case we
       // might end up scanning the whole array of slots. The Probe functions are
@@ -231,7 +333,7 @@ class FlatHashMap {
     new (&keys_[insertion_slot]) Key(std::move(key));
     new (value_idx) Value(std::move(value));
     tags_[insertion_slot] = tag;
-    PERFETTO_DCHECK(probe_len > 0 && probe_len <= capacity_);
+    PERFETTO_DCHECK(probe_len > 0 && probe_len <= MaxProbeLength());
     max_probe_length_ = std::max(max_probe_length_, probe_len);
     size_++;
 
@@ -285,12 +387,27 @@ class FlatHashMap {
  protected:
   enum ReservedTags : uint8_t { kFreeSlot = 0, kTombstone = 1 };
   static constexpr size_t kNotFound = std::numeric_limits<size_t>::max();
+  static constexpr bool kGroupProbing = std::is_same<Probe, GroupProbe>::value;
 
   size_t FindInternal(const Key& key) const {
     const size_t key_hash = Hasher{}(key);
     const uint8_t tag = HashToTag(key_hash);
     PERFETTO_DCHECK((capacity_ & (capacity_ - 1)) == 0);  // Must be a pow2.
-    PERFETTO_DCHECK(max_probe_length_ <= capacity_);
+    PERFETTO_DCHECK(max_probe_length_ <= MaxProbeLength());
+    if (kGroupProbing) {
+      for (size_t i = 0; i < max_probe_length_; ++i) {
+        const size_t group = Probe::Calc(key_hash, i, capacity_);
+        const uint8_t* group_tags = &tags_[group];
+        for (uint64_t m = GroupProbe::Match(group_tags, tag); m; m &= m - 1) {
+          const size_t idx = group + GroupProbe::SlotOf(m);
+          if (keys_[idx] == key)
+            return idx;
+        }
+        if (GroupProbe::Match(group_tags, kFreeSlot))
+          return kNotFound;
+      }
+      return kNotFound;
+    }
     for (size_t i = 0; i < max_probe_length_; ++i) {
       const size_t idx = Probe::Calc(key_hash, i, capacity_);
       const uint8_t tag_idx = tags_[idx];
@@ -354,6 +471,8 @@ class FlatHashMap {
   // Doesn't call destructors. Use Clear() for that.
   PERFETTO_NO_INLINE void Reset(size_t n) {
     PERFETTO_DCHECK((n & (n - 1)) == 0);  // Must be a pow2.
+    if (kGroupProbing)
+      n = std::max(n, GroupProbe::kGroupSize);
 
     capacity_ = n;
     max_probe_length_ = 0;
@@ -367,8 +486,22 @@ class FlatHashMap {
     values_ = AlignedAllocTyped<Value[]>(n);  // Deliberately not 0-initialized.
   }
 
+  // The upper bound of |max_probe_length_|: the number of slots or, with
+  // GroupProbe, the number of groups.
+  size_t MaxProbeLength() const {
+    return kGroupProbing ? capacity_ / GroupProbe::kGroupSize : capacity_;
+  }
+
   static inline uint8_t HashToTag(size_t full_hash) {
     uint8_t tag = full_hash >> (sizeof(full_hash) * 8 - 8);
+    if (kGroupProbing) {
+      // The keys that start probing from the same group share the hash bits
+      // that select the group, but usually differ in the lowest 4 bits, which
+      // select their slot in per-slot probing. Use those bits in the tag:
+      // unlike the top bits, they tell apart also small integers hashed with
+      // an identity hash function (e.g. tids).
+      tag = static_cast<uint8_t>((tag & 0xf0) | (full_hash & 0x0f));
+    }
     // Ensure the hash is always >= 2. We use 0, 1 for kFreeSlot and kTombstone.
     tag += (tag <= kTombstone) << 1;
     PERFETTO_DCHECK(tag > kTombstone);
@@ -162,8 +162,10 @@ class HttpServer : public UnixSocket::EventListener {
   void AddAllowedOrigin(const std::string&);
 
  private:
-  size_t ParseOneHttpRequest(HttpServerConnection*);
-  size_t ParseOneWebsocketFrame(HttpServerConnection*);
+  size_t ParseOneHttpRequest(HttpServerConnection*, char* data, size_t size);
+  size_t ParseOneWebsocketFrame(HttpServerConnection*,
+                                char* data,
+                                size_t size);
   void HandleCorsPreflightRequest(const HttpRequest&);
   bool IsOriginAllowed(StringView);
 
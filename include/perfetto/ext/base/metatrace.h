@@ -84,6 +84,11 @@ inline uint64_t TraceTimeNowNs() {
   return static_cast<uint64_t>(base::GetBootTimeNs().count());
 }
 
+// Returns base::GetThreadId() truncated to 32 bits, cached per thread. On
+// Linux GetThreadId() is a syscall, which would dominate the cost of recording
+// an event.
+uint32_t GetCachedThreadId();
+
 // Returns a relaxed view of whether metatracing is enabled for the given tag.
 // Useful for skipping unnecessary argument computation if metatracing is off.
 inline bool IsEnabled(uint32_t tag) {
@@ -264,7 +269,7 @@ inline void TraceCounter(uint32_t tag, uint16_t id, int32_t value) {
   if (PERFETTO_LIKELY((enabled_tags & tag) == 0))
     return;
   Record* record = RingBuffer::AppendNewRecord();
-  record->thread_id = static_cast<uint32_t>(base::GetThreadId());
+  record->thread_id = GetCachedThreadId();
   record->set_timestamp(TraceTimeNowNs());
   record->counter_value = value;
   record->type_and_id.store(Record::kTypeCounter | id,
@@ -279,7 +284,7 @@ class ScopedEvent {
       return;
     event_id_ = event_id;
     record_ = RingBuffer::AppendNewRecord();
-    record_->thread_id = static_cast<uint32_t>(base::GetThreadId());
+    record_->thread_id = GetCachedThreadId();
     record_->set_timestamp(TraceTimeNowNs());
   }
 
@@ -70,7 +70,11 @@ enum Tags : uint32_t {
   F(PROFILER_UNWIND_ATTEMPT), \
   F(PROFILER_MAPS_PARSE), \
   F(PROFILER_MAPS_REPARSE), \
-  F(PROFILER_UNWIND_CACHE_CLEAR)
+  F(PROFILER_UNWIND_CACHE_CLEAR), \
+  F(TRACE_SERVICE_COMMIT), \
+  F(TRACE_SERVICE_READ_BUFFERS), \
+  F(TRACE_SERVICE_FILTER_PACKETS), \
+  F(TRACE_SERVICE_COMPRESS_PACKETS)
 
 // Append only, see above.
 //
@@ -54,6 +54,13 @@ class PagedMemory {
     // reserved and the user should call EnsureCommitted() before writing to
     // memory addresses.
     kDontCommit = 1 << 1,
+
+    // Asks the kernel to back the allocation with transparent huge pages
+    // (MADV_HUGEPAGE), to reduce TLB misses on large buffers. The usable region
+    // is aligned to the huge page size. This is only a hint: if the allocation
+    // is smaller than a huge page, the platform isn't Linux/Android, or THP
+    // is disabled, regular pages are used. See GetHugePageBytes().
+    kHugePages = 1 << 2,
   };
 
   // Allocates |size| bytes using mmap(MAP_ANONYMOUS). The returned memory is
@@ -67,6 +74,12 @@ class PagedMemory {
   // if implemented.
   bool AdviseDontNeed(void* p, size_t size);
 
+  // Returns how many bytes of the allocated memory region are currently
+  // backed by transparent huge pages. This parses /proc/self/smaps, so it's
+  // meant for stats and tests, not hot paths. Returns 0 on platforms other
+  // than Linux/Android.
+  size_t GetHugePageBytes() const;
+
   // Ensures that at least the first |committed_size| bytes of the allocated
   // memory region are committed. The implementation may commit memory in larger
   // chunks above |committed_size|. Crashes if the memory couldn't be committed.
@@ -17,9 +17,11 @@
 #ifndef INCLUDE_PERFETTO_EXT_BASE_THREADING_THREAD_POOL_H_
 #define INCLUDE_PERFETTO_EXT_BASE_THREADING_THREAD_POOL_H_
 
+#include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <functional>
-#include <list>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <thread>
@@ -43,9 +45,15 @@ namespace base {
 // When the ThreadPool is destroyed, any active tasks are completed and every
 // thread joined before returning from the destructor.
 //
-// Tasks are executed in a FIFO order without any notion of priority. If a
-// thread in the pool is free, it will be used to execute the task immediately.
-// Otherwise, it will be queued for execution when any thread becomes available.
+// Tasks are executed without any notion of priority. If a thread in the pool
+// is free, it will be used to execute the task immediately. Otherwise, it will
+// be queued for execution when any thread becomes available.
+//
+// Each thread has its own queue of tasks, which PostTask() fills in a
+// round-robin fashion. A thread runs the tasks of its own queue in FIFO order
+// and, when that is empty, steals the oldest tasks from the queues of the other
+// threads. This avoids all the threads contending on a single lock when tasks
+// are small.
 class ThreadPool {
  public:
   // Initializes this thread_pool |thread_count| threads.
@@ -58,18 +66,31 @@ class ThreadPool {
   void PostTask(std::function<void()>);
 
  private:
-  void RunThreadLoop();
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;  // Protected by |mutex|.
+  };
+
+  void RunThreadLoop(size_t worker_index);
+  bool TakeTask(size_t worker_index, std::function<void()>* task);
 
   ThreadPool(ThreadPool&&) = delete;
   ThreadPool& operator=(ThreadPool&&) = delete;
 
-  // Start of mutex protected members.
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<size_t> next_worker_{0};
+
+  // Number of tasks in all the |workers_| queues.
+  std::atomic<size_t> pending_count_{0};
+
+  // Number of threads waiting (or about to wait) on |thread_waiter_|. It's
+  // only incremented with |mutex_| held, PostTask() takes |mutex_| only if
+  // it's non zero.
+  std::atomic<uint32_t> thread_waiting_count_{0};
+  std::atomic<bool> quit_{false};
+
   std::mutex mutex_;
-  std::list<std::function<void()>> pending_tasks_;
   std::condition_variable thread_waiter_;
-  uint32_t thread_waiting_count_ = 0;
-  bool quit_ = false;
-  // End of mutex protected members.
 
   std::vector<std::thread> threads_;
 };
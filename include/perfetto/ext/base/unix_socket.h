@@ -160,6 +160,15 @@ class UnixSocketRaw {
                const int* send_fds = nullptr,
                size_t num_fds = 0);
 
+  // Like Send(), but waits for space in the tx buffer (up to the tx timeout,
+  // if set) even if the socket is in non-blocking mode. Unlike toggling
+  // SetBlocking() around Send(), this doesn't cost any extra syscall on
+  // platforms other than Windows and Mac.
+  ssize_t SendBlocking(const void* msg,
+                       size_t len,
+                       const int* send_fds = nullptr,
+                       size_t num_fds = 0);
+
   ssize_t SendStr(const std::string& str) {
     return Send(str.data(), str.size());
   }
@@ -189,6 +198,16 @@ class UnixSocketRaw {
   UnixSocketRaw(const UnixSocketRaw&) = delete;
   UnixSocketRaw& operator=(const UnixSocketRaw&) = delete;
 
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  // |blocking| overrides the O_NONBLOCK state of the socket.
+  ssize_t Send(const void* msg,
+               size_t len,
+               const int* send_fds,
+               size_t num_fds,
+               bool blocking);
+  ssize_t SendMsgAllPosix(struct msghdr* msg, bool blocking);
+#endif
+
   ScopedSocketHandle fd_;
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
   ScopedPlatformHandle event_handle_;
@@ -196,6 +215,7 @@ class UnixSocketRaw {
   SockFamily family_ = SockFamily::kUnix;
   SockType type_ = SockType::kStream;
   uint32_t tx_timeout_ms_ = 0;
+  bool is_blocking_ = true;  // Mirrors O_NONBLOCK, see SetBlocking().
 };
 
 // A non-blocking UNIX domain socket. Allows also to transfer file descriptors.
@@ -21,17 +21,32 @@
 #include "perfetto/base/task_runner.h"
 #include "perfetto/base/thread_utils.h"
 #include "perfetto/base/time.h"
+#include "perfetto/ext/base/circular_queue.h"
 #include "perfetto/ext/base/event_fd.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/thread_checker.h"
 
 #include <chrono>
-#include <deque>
+#include <functional>
 #include <map>
 #include <mutex>
+#include <tuple>
 #include <vector>
 
-#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+// On Linux and Android the watched fds are multiplexed with epoll(7), so that
+// the cost of each wake-up doesn't grow with the number of watched fds (e.g.
+// one socket per producer in the tracing service). Other UNIX systems use
+// poll(2).
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+#define PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL 1
+#else
+#define PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL 0
+#endif
+
+#if PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
+#include <sys/epoll.h>
+#elif !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
 #include <poll.h>
 #endif
 
@@ -82,6 +97,19 @@ class UnixTaskRunner : public TaskRunner {
   bool QuitCalled();
 
  private:
+  // An entry of the |delayed_tasks_| heap. Tasks due at the same time run in
+  // the order they were posted, sorted by |seq|.
+  struct DelayedTask {
+    TimeMillis time;
+    uint64_t seq;
+    std::function<void()> task;
+
+    // Comparator for the min-heap: the next task to run is at the front.
+    bool operator<(const DelayedTask& other) const {
+      return std::tie(time, seq) > std::tie(other.time, other.seq);
+    }
+  };
+
   void WakeUp();
   void UpdateWatchTasksLocked();
   int GetDelayMsToNextTaskLocked() const;
@@ -97,6 +125,12 @@ class UnixTaskRunner : public TaskRunner {
 // The array of fds/handles passed to poll(2) / WaitForMultipleObjects().
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
   std::vector<PlatformHandle> poll_fds_;
+#elif PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
+  // The epoll instance, in which the fds are added and removed directly by
+  // Add/RemoveFileDescriptorWatch(), and the events returned by epoll_wait().
+  ScopedFile epoll_fd_;
+  std::vector<struct epoll_event> epoll_events_;
+  size_t num_epoll_events_ = 0;
 #else
   std::vector<struct pollfd> poll_fds_;
 #endif
@@ -105,8 +139,13 @@ class UnixTaskRunner : public TaskRunner {
 
   std::mutex lock_;
 
-  std::deque<std::function<void()>> immediate_tasks_;
-  std::multimap<TimeMillis, std::function<void()>> delayed_tasks_;
+  // Both queues are flat and reuse their storage, so that posting a task
+  // doesn't allocate a container node (only the std::function might, for
+  // large callables).
+  static constexpr size_t kInitialQueueCapacity = 64;
+  CircularQueue<std::function<void()>> immediate_tasks_{kInitialQueueCapacity};
+  std::vector<DelayedTask> delayed_tasks_;  // A heap, see DelayedTask.
+  uint64_t next_delayed_task_seq_ = 0;
   bool quit_ = false;
 
   struct WatchTask {
@@ -116,6 +155,11 @@ class UnixTaskRunner : public TaskRunner {
     // polling it again until the queued task runs. On Windows we can't do that.
     // Instead we keep track of its state here.
     bool pending = false;
+#elif PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
+    // Set for the fds that epoll doesn't support (i.e. regular files). As
+    // poll(2) always reports them as readable, their task is re-posted every
+    // time it runs.
+    bool always_ready = false;
 #else
     size_t poll_fd_index;  // Index into |poll_fds_|.
 #endif
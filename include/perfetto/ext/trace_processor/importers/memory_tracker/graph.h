@@ -107,7 +107,11 @@ class PERFETTO_EXPORT_COMPONENT GlobalNodeGraph {
       const uint64_t value_uint64;
     };
 
-    explicit Node(GlobalNodeGraph::Process* node_graph, Node* parent);
+    // |index| is the position of the node in the arena of its graph, which
+    // lets the traversals track the visited nodes in a bitmap.
+    explicit Node(GlobalNodeGraph::Process* node_graph,
+                  Node* parent,
+                  uint32_t index = 0);
     ~Node();
 
     // Gets the direct child of a node for the given |subpath|.
@@ -171,6 +175,7 @@ class PERFETTO_EXPORT_COMPONENT GlobalNodeGraph {
         double cumulative_owning_coefficient) {
       cumulative_owning_coefficient_ = cumulative_owning_coefficient;
     }
+    uint32_t index() const { return index_; }
     MemoryAllocatorNodeId id() const { return id_; }
     void set_id(MemoryAllocatorNodeId id) { id_ = id; }
     GlobalNodeGraph::Edge* owns_edge() const { return owns_edge_; }
@@ -191,6 +196,7 @@ class PERFETTO_EXPORT_COMPONENT GlobalNodeGraph {
    private:
     GlobalNodeGraph::Process* node_graph_;
     Node* const parent_;
+    const uint32_t index_;
     MemoryAllocatorNodeId id_;
     std::map<std::string, Entry> entries_;
     std::map<std::string, Node*> children_;
@@ -231,7 +237,7 @@ class PERFETTO_EXPORT_COMPONENT GlobalNodeGraph {
   // An iterator-esque class which yields nodes in a depth-first pre order.
   class PERFETTO_EXPORT_COMPONENT PreOrderIterator {
    public:
-    explicit PreOrderIterator(std::vector<Node*>&& root_nodes);
+    PreOrderIterator(std::vector<Node*>&& root_nodes, uint32_t node_count);
     PreOrderIterator(PreOrderIterator&& other);
     ~PreOrderIterator();
 
@@ -240,13 +246,14 @@ class PERFETTO_EXPORT_COMPONENT GlobalNodeGraph {
 
    private:
     std::vector<Node*> to_visit_;
-    std::set<const Node*> visited_;
+    // Indexed by Node::index().
+    std::vector<bool> visited_;
   };
 
   // An iterator-esque class which yields nodes in a depth-first post order.
   class PERFETTO_EXPORT_COMPONENT PostOrderIterator {
    public:
-    explicit PostOrderIterator(std::vector<Node*>&& root_nodes);
+    PostOrderIterator(std::vector<Node*>&& root_nodes, uint32_t node_count);
     PostOrderIterator(PostOrderIterator&& other);
     ~PostOrderIterator();
 
@@ -255,7 +262,8 @@ class PERFETTO_EXPORT_COMPONENT GlobalNodeGraph {
 
    private:
     std::vector<Node*> to_visit_;
-    std::set<Node*> visited_;
+    // Indexed by Node::index().
+    std::vector<bool> visited_;
     std::vector<Node*> path_;
   };
 
@@ -295,6 +303,9 @@ class PERFETTO_EXPORT_COMPONENT GlobalNodeGraph {
   }
   const std::forward_list<Edge>& edges() const { return all_edges_; }
 
+  // Number of nodes in the arena, i.e. upper bound of Node::index().
+  uint32_t node_count() const { return node_count_; }
+
  private:
   // Creates a node in the arena which is associated with the given
   // |process_graph| and for the given |parent|.
@@ -302,6 +313,7 @@ class PERFETTO_EXPORT_COMPONENT GlobalNodeGraph {
                    GlobalNodeGraph::Node* parent);
 
   std::forward_list<Node> all_nodes_;
+  uint32_t node_count_ = 0;
   std::forward_list<Edge> all_edges_;
   IdNodeMap nodes_by_id_;
   std::unique_ptr<GlobalNodeGraph::Process> shared_memory_graph_;
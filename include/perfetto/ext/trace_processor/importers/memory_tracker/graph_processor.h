@@ -23,6 +23,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "perfetto/base/proc_utils.h"
 #include "perfetto/ext/trace_processor/importers/memory_tracker/graph.h"
@@ -63,7 +64,7 @@ class PERFETTO_EXPORT_COMPONENT GraphProcessor {
 
   static void MarkWeakOwnersAndChildrenRecursively(
       GlobalNodeGraph::Node* node,
-      std::set<const GlobalNodeGraph::Node*>* nodes);
+      std::vector<bool>* visited);
 
   static void RemoveWeakNodesRecursively(GlobalNodeGraph::Node* parent);
 
@@ -269,6 +269,28 @@ struct PERFETTO_EXPORT_COMPONENT TracingServiceInitOpts {
   // compressed ones.
   using CompressorFn = void (*)(std::vector<TracePacket>*);
   CompressorFn compressor_fn = nullptr;
+
+  // Same as |compressor_fn|, favouring speed over compression ratio. Used for
+  // COMPRESSION_TYPE_DEFLATE_FAST. If not set, |compressor_fn| is used.
+  CompressorFn fast_compressor_fn = nullptr;
+
+  // If greater than 1, compressed sessions writing into a file read up to
+  // this many chunks of their buffers at a time and compress them on as many
+  // threads, instead of compressing one chunk at a time on the service
+  // thread. The compressor functions must be thread-safe.
+  uint32_t compression_thread_count = 0;
+
+  // If true, sessions writing into a file write on a dedicated thread, so
+  // that slow storage doesn't block the service thread (and, through it, the
+  // producers' commits). The file is still fully written before the consumer
+  // is notified that tracing is disabled.
+  bool async_write_into_file = false;
+
+  // If greater than 1, sessions with several buffers read up to this many of
+  // them concurrently when writing into a file, instead of one after the
+  // other on the service thread. The packets of each buffer are still written
+  // in buffer order.
+  uint32_t read_buffers_thread_count = 0;
 };
 
 // The public API of the tracing Service business logic.
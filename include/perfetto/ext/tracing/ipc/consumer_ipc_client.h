@@ -42,8 +42,18 @@ class PERFETTO_EXPORT_COMPONENT ConsumerIPCClient {
   // callbacks invoked on the Consumer interface: no more Consumer callbacks are
   // invoked immediately after its destruction and any pending callback will be
   // dropped.
-  static std::unique_ptr<TracingService::ConsumerEndpoint>
-  Connect(const char* service_sock_name, Consumer*, base::TaskRunner*);
+  // If |read_buffers_via_shared_memory| is true, ReadBuffers() asks the service
+  // to hand the trace data over through shared memory (a memfd passed over the
+  // socket) rather than copying it into the IPC messages. This is cheaper for
+  // large traces but requires the consumer to be allowed to receive and map
+  // file descriptors from the service. The TracePacket(s) passed to
+  // Consumer::OnTraceData() then point into the shared memory and are valid
+  // only for the duration of the call.
+  static std::unique_ptr<TracingService::ConsumerEndpoint> Connect(
+      const char* service_sock_name,
+      Consumer*,
+      base::TaskRunner*,
+      bool read_buffers_via_shared_memory = false);
 
  protected:
   ConsumerIPCClient() = delete;
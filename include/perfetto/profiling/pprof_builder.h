@@ -17,6 +17,7 @@
 #ifndef INCLUDE_PERFETTO_PROFILING_PPROF_BUILDER_H_
 #define INCLUDE_PERFETTO_PROFILING_PPROF_BUILDER_H_
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -56,6 +57,15 @@ enum class ConversionFlags : uint64_t {
   kAnnotateFrames = 1
 };
 
+// Passes each profile to |callback| as soon as it is complete, so that only
+// one serialized profile needs to be held in memory at a time.
+bool TraceToPprof(trace_processor::TraceProcessor* tp,
+                  std::function<void(SerializedProfile)> callback,
+                  ConversionMode mode = ConversionMode::kHeapProfile,
+                  uint64_t flags = 0,
+                  uint64_t pid = 0,
+                  const std::vector<uint64_t>& timestamps = {});
+
 bool TraceToPprof(trace_processor::TraceProcessor* tp,
                   std::vector<SerializedProfile>* output,
                   ConversionMode mode = ConversionMode::kHeapProfile,
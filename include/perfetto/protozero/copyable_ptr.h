@@ -33,40 +33,66 @@ namespace protozero {
 // to see the actual definition of T. If the generated classes were move-only we
 // could just use a unique_ptr there. But they aren't, hence this wrapper.
 // Converesely to unique_ptr, this wrapper:
-// - Default constructs the T instance in its constructor.
+// - Behaves as if it default constructed the T instance in its constructor.
 // - Implements deep comparison in operator== instead of pointer comparison.
+//
+// The T instance is allocated lazily, on the first non-const access. Until
+// then (and after being moved from) const accessors return a shared default
+// instance. This matters for the generated classes, which have many nested
+// message fields that are never set (e.g. the per-data-source configs in
+// DataSourceConfig): constructing, moving and parsing them doesn't allocate
+// all the unset sub-messages recursively.
+// As T is incomplete in the generated headers, the function creating T is
+// captured by the constructor, which is instantiated in the .gen.cc file.
 template <typename T>
 class CopyablePtr {
  public:
-  CopyablePtr() : ptr_(new T()) {}
-  ~CopyablePtr() = default;
+  CopyablePtr() : create_(&Create) {}
+  ~CopyablePtr() { delete ptr_; }
 
   // Copy operators.
-  CopyablePtr(const CopyablePtr& other) : ptr_(new T(*other.ptr_)) {}
+  CopyablePtr(const CopyablePtr& other)
+      : ptr_(other.ptr_ ? new T(*other.ptr_) : nullptr),
+        create_(other.create_) {}
   CopyablePtr& operator=(const CopyablePtr& other) {
-    *ptr_ = *other.ptr_;
+    if (!other.ptr_) {
+      delete ptr_;
+      ptr_ = nullptr;
+    } else if (ptr_) {
+      *ptr_ = *other.ptr_;
+    } else {
+      ptr_ = new T(*other.ptr_);
+    }
     return *this;
   }
 
-  // Move operators.
-  CopyablePtr(CopyablePtr&& other) noexcept : ptr_(std::move(other.ptr_)) {
-    other.ptr_.reset(new T());
+  // Move operators. The moved-from object is left equal to a default T.
+  CopyablePtr(CopyablePtr&& other) noexcept
+      : ptr_(other.ptr_), create_(other.create_) {
+    other.ptr_ = nullptr;
   }
 
   CopyablePtr& operator=(CopyablePtr&& other) {
-    ptr_ = std::move(other.ptr_);
-    other.ptr_.reset(new T());
+    if (this != &other) {
+      delete ptr_;
+      ptr_ = other.ptr_;
+      other.ptr_ = nullptr;
+    }
     return *this;
   }
 
-  T* get() { return ptr_.get(); }
-  const T* get() const { return ptr_.get(); }
+  T* get() {
+    if (!ptr_)
+      ptr_ = create_();
+    return ptr_;
+  }
+  const T* get() const { return ptr_ ? ptr_ : DefaultInstance(); }
 
-  T* operator->() { return ptr_.get(); }
-  const T* operator->() const { return ptr_.get(); }
+  T* operator->() { return get(); }
+  const T* operator->() const { return get(); }
 
-  T& operator*() { return *ptr_; }
-  const T& operator*() const { return *ptr_; }
+  T& operator*() { return *get(); }
+  const T& operator*() const { return *get(); }
 
   friend bool operator==(const CopyablePtr& lhs, const CopyablePtr& rhs) {
     return *lhs == *rhs;
@@ -79,7 +105,17 @@ class CopyablePtr {
   }
 
  private:
-  std::unique_ptr<T> ptr_;
+  static T* Create() { return new T(); }
+
+  const T* DefaultInstance() const {
+    // Intentionally leaked, like the default instances of libprotobuf.
+    static const T* instance = create_();
+    return instance;
+  }
+
+  // Owned. Null until the first non-const access.
+  T* ptr_ = nullptr;
+  T* (*create_)();
 };
 
 }  // namespace protozero
@@ -170,7 +170,11 @@ class Field {
   void get(int64_t* val) const { *val = as_int64(); }
   void get(float* val) const { *val = as_float(); }
   void get(double* val) const { *val = as_double(); }
-  void get(std::string* val) const { *val = as_std_string(); }
+  // Reuses the capacity of |val| rather than assigning a new std::string.
+  void get(std::string* val) const {
+    ConstChars str = as_string();
+    val->assign(str.data, str.size);
+  }
   void get(ConstChars* val) const { *val = as_string(); }
   void get(ConstBytes* val) const { *val = as_bytes(); }
   void get_signed(int32_t* val) const { *val = as_sint32(); }
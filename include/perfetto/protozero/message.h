@@ -24,6 +24,7 @@
 #include <string>
 #include <type_traits>
 
+#include "perfetto/base/compiler.h"
 #include "perfetto/base/export.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/contiguous_memory_range.h"
@@ -75,6 +76,16 @@ class PERFETTO_EXPORT_COMPONENT Message {
   uint8_t* size_field() const { return size_field_; }
   void set_size_field(uint8_t* size_field) { size_field_ = size_field; }
 
+  // Opts a nested message into having its size field shrunk to the minimal
+  // varint encoding when the parent ends it, instead of keeping the
+  // kMessageLengthFieldSize bytes redundant varint. This happens only if the
+  // whole message lies within the stream writer's current range (i.e. it
+  // didn't span chunks or require patching) and is < 16KB, and costs a
+  // memmove() of its payload. Meant for small messages which are written in
+  // large numbers, e.g. debug annotations and interned entries, where the
+  // 2-3 wasted bytes are a significant fraction of the message.
+  void set_compact_size_field(bool compact) { compact_size_field_ = compact; }
+
   // This is to deal with case of backfilling the size of a root (non-nested)
   // message which is split into multiple chunks. Upon finalization only the
   // partial size that lies in the last chunk has to be backfilled.
@@ -94,13 +105,11 @@ class PERFETTO_EXPORT_COMPONENT Message {
     if (nested_message_)
       EndNestedMessage();
 
-    uint8_t buffer[proto_utils::kMaxSimpleFieldEncodedSize];
-    uint8_t* pos = buffer;
-
-    pos = proto_utils::WriteVarInt(proto_utils::MakeTagVarInt(field_id), pos);
-    // WriteVarInt encodes signed values in two's complement form.
-    pos = proto_utils::WriteVarInt(value, pos);
-    WriteToStream(buffer, pos);
+    WriteSimpleField([field_id, value](uint8_t* pos) {
+      pos = proto_utils::WriteVarInt(proto_utils::MakeTagVarInt(field_id), pos);
+      // WriteVarInt encodes signed values in two's complement form.
+      return proto_utils::WriteVarInt(value, pos);
+    });
   }
 
   // Proto types: sint64, sint32.
@@ -116,12 +125,12 @@ class PERFETTO_EXPORT_COMPONENT Message {
     if (nested_message_)
       EndNestedMessage();
 
-    uint8_t buffer[proto_utils::kMaxSimpleFieldEncodedSize];
-    uint8_t* pos = buffer;
-    // MakeTagVarInt gets super optimized here for constexpr.
-    pos = proto_utils::WriteVarInt(proto_utils::MakeTagVarInt(field_id), pos);
-    *pos++ = static_cast<uint8_t>(value);
-    WriteToStream(buffer, pos);
+    WriteSimpleField([field_id, value](uint8_t* pos) {
+      // MakeTagVarInt gets super optimized here for constexpr.
+      pos = proto_utils::WriteVarInt(proto_utils::MakeTagVarInt(field_id), pos);
+      *pos++ = static_cast<uint8_t>(value);
+      return pos;
+    });
   }
 
   // Proto types: fixed64, sfixed64, fixed32, sfixed32, double, float.
@@ -130,14 +139,12 @@ class PERFETTO_EXPORT_COMPONENT Message {
     if (nested_message_)
       EndNestedMessage();
 
-    uint8_t buffer[proto_utils::kMaxSimpleFieldEncodedSize];
-    uint8_t* pos = buffer;
-
-    pos = proto_utils::WriteVarInt(proto_utils::MakeTagFixed<T>(field_id), pos);
-    memcpy(pos, &value, sizeof(T));
-    pos += sizeof(T);
-    // TODO: Optimize memcpy performance, see http://crbug.com/624311 .
-    WriteToStream(buffer, pos);
+    WriteSimpleField([field_id, value](uint8_t* pos) {
+      pos = proto_utils::WriteVarInt(proto_utils::MakeTagFixed<T>(field_id),
+                                     pos);
+      memcpy(pos, &value, sizeof(T));
+      return pos + sizeof(T);
+    });
   }
 
   void AppendString(uint32_t field_id, const char* str);
@@ -194,6 +201,31 @@ class PERFETTO_EXPORT_COMPONENT Message {
   // Called by Finalize and Append* methods.
   void EndNestedMessage();
 
+  // Rewrites the |size_field| of a just finalized nested message of |size|
+  // bytes as a minimal varint, moving its payload back. Returns the number of
+  // bytes saved, 0 if the message can't be compacted.
+  uint32_t CompactNestedSizeField(uint8_t* size_field, uint32_t size);
+
+  // Writes a field of at most kMaxSimpleFieldEncodedSize bytes, encoded by
+  // |encode| (uint8_t*(uint8_t* dst), returning the end of the encoded bytes).
+  // If the current range has enough headroom (the common case) the field is
+  // encoded straight into it, without a copy and without the per-write bounds
+  // check, otherwise it goes through a temporary buffer and WriteToStream().
+  template <typename Encoder>
+  PERFETTO_ALWAYS_INLINE void WriteSimpleField(Encoder encode) {
+    PERFETTO_DCHECK(!finalized_);
+    if (PERFETTO_LIKELY(stream_writer_->bytes_available() >=
+                        proto_utils::kMaxSimpleFieldEncodedSize)) {
+      uint8_t* const begin = stream_writer_->write_ptr();
+      uint8_t* const end = encode(begin);
+      stream_writer_->CommitBytesUnsafe(end);
+      size_ += static_cast<uint32_t>(end - begin);
+      return;
+    }
+    uint8_t buffer[proto_utils::kMaxSimpleFieldEncodedSize];
+    WriteToStream(buffer, encode(buffer));
+  }
+
   void WriteToStream(const uint8_t* src_begin, const uint8_t* src_end) {
     PERFETTO_DCHECK(!finalized_);
     PERFETTO_DCHECK(src_begin <= src_end);
@@ -236,6 +268,9 @@ class PERFETTO_EXPORT_COMPONENT Message {
   // attempts of writing to a message which has been Finalize()-d.
   bool finalized_;
 
+  // See set_compact_size_field().
+  bool compact_size_field_;
+
 #if PERFETTO_DCHECK_IS_ON()
   // Current generation of message. Incremented on Reset.
   // Used to detect stale handles.
@@ -366,12 +366,13 @@ class PERFETTO_EXPORT_COMPONENT TypedProtoDecoderBase : public ProtoDecoder {
     // The reason why Field needs to be trivially de/constructible is to avoid
     // implicit initializers on all the ~1000 entries. We need it to initialize
     // only on the first |max_field_id| fields, the remaining capacity doesn't
-    // require initialization.
+    // require initialization, as the repeated fields are written linearly
+    // before incrementing |size_| (see also ExpandHeapStorage()).
     static_assert(std::is_trivially_constructible<Field>::value &&
                       std::is_trivially_destructible<Field>::value &&
                       std::is_trivial<Field>::value,
                   "Field must be a trivial aggregate type");
-    memset(fields_, 0, sizeof(Field) * capacity_);
+    memset(fields_, 0, sizeof(Field) * std::min(num_fields, capacity));
     PERFETTO_DCHECK(capacity > 0);
   }
 
@@ -426,10 +427,21 @@ class PERFETTO_EXPORT_COMPONENT TypedProtoDecoderBase : public ProtoDecoder {
 template <int MAX_FIELD_ID, bool HAS_NONPACKED_REPEATED_FIELDS>
 class TypedProtoDecoder : public TypedProtoDecoderBase {
  public:
+  // Messages without non-packed repeated fields only need a slot for each
+  // field id (+1, see the |size_| initialization in TypedProtoDecoderBase), so
+  // their on-stack storage is sized to that rather than to the full
+  // INITIAL_STACK_CAPACITY. Repeated occurrences of non-repeated fields are
+  // still handled, by falling back on the heap.
+  static constexpr uint32_t kStackCapacity =
+      HAS_NONPACKED_REPEATED_FIELDS ||
+              MAX_FIELD_ID + 2 > PROTOZERO_DECODER_INITIAL_STACK_CAPACITY
+          ? PROTOZERO_DECODER_INITIAL_STACK_CAPACITY
+          : MAX_FIELD_ID + 2;
+
   TypedProtoDecoder(const uint8_t* buffer, size_t length)
       : TypedProtoDecoderBase(on_stack_storage_,
                               /*num_fields=*/MAX_FIELD_ID + 1,
-                              PROTOZERO_DECODER_INITIAL_STACK_CAPACITY,
+                              kStackCapacity,
                               buffer,
                               length) {
     TypedProtoDecoderBase::ParseAllFields();
@@ -441,8 +453,8 @@ class TypedProtoDecoder : public TypedProtoDecoderBase {
     // If the field id is < the on-stack capacity, it's safe to always
     // dereference |fields_|, whether it's still using the stack or it fell
     // back on the heap. Because both terms of the if () are known at compile
-    // time, the compiler elides the branch for ids < INITIAL_STACK_CAPACITY.
-    if (FIELD_ID < PROTOZERO_DECODER_INITIAL_STACK_CAPACITY) {
+    // time, the compiler elides the branch for ids < kStackCapacity.
+    if (FIELD_ID < kStackCapacity) {
       return fields_[FIELD_ID];
     } else {
       // Otherwise use the slowpath Get() which will do a runtime check.
@@ -462,7 +474,57 @@ class TypedProtoDecoder : public TypedProtoDecoderBase {
   }
 
  private:
-  Field on_stack_storage_[PROTOZERO_DECODER_INITIAL_STACK_CAPACITY];
+  Field on_stack_storage_[kStackCapacity];
+};
+
+// Decodes only the fields whose ids are listed in |FIELD_IDS|, in a single
+// pass which skips over all the other fields (including nested messages)
+// without storing them. This is cheaper than a TypedProtoDecoder when only a
+// couple of fields of a large message are needed, e.g. to route a packet.
+// As for TypedProtoDecoder, if a field is repeated at<>() returns its last
+// occurrence. Example:
+//   using TracePacketRouting =
+//       SelectedFieldsDecoder<TracePacket::kTrackEventFieldNumber,
+//                             TracePacket::kCompressedPacketsFieldNumber>;
+//   TracePacketRouting packet(data, size);
+//   if (packet.at<TracePacket::kTrackEventFieldNumber>().valid()) ...
+template <uint32_t... FIELD_IDS>
+class SelectedFieldsDecoder {
+ public:
+  SelectedFieldsDecoder(const uint8_t* buffer, size_t length) {
+    ProtoDecoder decoder(buffer, length);
+    for (Field field = decoder.ReadField(); field.valid();
+         field = decoder.ReadField()) {
+      size_t index = IndexOf(field.id());
+      if (index < kNumFields)
+        fields_[index] = field;
+    }
+  }
+  explicit SelectedFieldsDecoder(const ConstBytes& raw)
+      : SelectedFieldsDecoder(raw.data, raw.size) {}
+
+  template <uint32_t FIELD_ID>
+  const Field& at() const {
+    constexpr size_t kIndex = IndexOf(FIELD_ID);
+    static_assert(kIndex < kNumFields, "FIELD_ID is not in FIELD_IDS");
+    return fields_[kIndex];
+  }
+
+ private:
+  static constexpr size_t kNumFields = sizeof...(FIELD_IDS);
+
+  // Returns kNumFields if |id| is not one of the selected ids. For a handful
+  // of ids the compiler unrolls this into a few comparisons.
+  static constexpr size_t IndexOf(uint32_t id) {
+    constexpr uint32_t kIds[] = {FIELD_IDS...};
+    for (size_t i = 0; i < kNumFields; i++) {
+      if (kIds[i] == id)
+        return i;
+    }
+    return kNumFields;
+  }
+
+  Field fields_[kNumFields] = {};
 };
 
 }  // namespace protozero
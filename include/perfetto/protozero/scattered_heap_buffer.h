@@ -97,8 +97,10 @@ class PERFETTO_EXPORT_COMPONENT ScatteredHeapBuffer
   // Returns the total size the slices occupy in heap memory (including unused).
   size_t GetTotalSize();
 
-  // Reset the contents of this buffer but retain one slice allocation (if it
-  // exists) to be reused for future writes.
+  // Reset the contents of this buffer but retain the slice allocations (up to
+  // |maximum_slice_size_bytes| in total, and at least one) to be reused for
+  // future writes. A buffer which is reset after each message doesn't need to
+  // allocate once it has seen a message as large as the next ones.
   void Reset();
 
  private:
@@ -107,8 +109,9 @@ class PERFETTO_EXPORT_COMPONENT ScatteredHeapBuffer
   protozero::ScatteredStreamWriter* writer_ = nullptr;
   std::vector<Slice> slices_;
 
-  // Used to keep an allocated slice around after this buffer is reset.
-  Slice cached_slice_;
+  // Used to keep allocated slices around after this buffer is reset. This is
+  // a stack: the slice at the back is the next one handed out.
+  std::vector<Slice> cached_slices_;
 };
 
 // Helper function to create heap-based protozero messages in one line.
@@ -153,8 +156,26 @@ class HeapBuffered {
   }
 
   std::string SerializeAsString() {
-    auto vec = SerializeAsArray();
-    return std::string(reinterpret_cast<const char*>(vec.data()), vec.size());
+    std::string str;
+    AppendSerializedTo(&str);
+    return str;
+  }
+
+  // Appends the serialized message to |out|, which can be e.g. a std::string
+  // or a std::vector<uint8_t>. This avoids the temporary copy of
+  // SerializeAsArray() when the bytes are to be added to another buffer.
+  template <typename Container>
+  void AppendSerializedTo(Container* out) {
+    msg_.Finalize();
+    const std::vector<ScatteredHeapBuffer::Slice>& slices = shb_.GetSlices();
+    size_t size = 0;
+    for (const auto& slice : slices)
+      size += slice.size() - slice.unused_bytes();
+    out->reserve(out->size() + size);
+    for (const auto& slice : slices) {
+      ContiguousMemoryRange used = slice.GetUsedRange();
+      out->insert(out->end(), used.begin, used.end);
+    }
   }
 
   std::vector<protozero::ContiguousMemoryRange> GetRanges() {
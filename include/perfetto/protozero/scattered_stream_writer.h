@@ -114,6 +114,15 @@ class PERFETTO_EXPORT_COMPONENT ScatteredStreamWriter {
     return begin;
   }
 
+  // Completes a write done directly into the buffer: the caller has written
+  // the bytes in [write_ptr(), end) after checking bytes_available(). This is
+  // for the callers that encode small values of variable size in place,
+  // avoiding the copy from a temporary buffer that WriteBytes() requires.
+  void CommitBytesUnsafe(uint8_t* end) {
+    assert(write_ptr_ <= end && end <= cur_range_.end);
+    write_ptr_ = end;
+  }
+
   // Resets the buffer boundaries and the write pointer to the given |range|.
   // Subsequent WriteByte(s) will write into |range|.
   void Reset(ContiguousMemoryRange range);
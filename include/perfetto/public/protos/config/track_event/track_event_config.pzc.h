@@ -22,6 +22,8 @@
 
 #include "perfetto/public/pb_macros.h"
 
+PERFETTO_PB_MSG_DECL(perfetto_protos_TrackEventConfig_CategorySampling);
+
 PERFETTO_PB_MSG(perfetto_protos_TrackEventConfig);
 PERFETTO_PB_FIELD(perfetto_protos_TrackEventConfig,
                   STRING,
@@ -68,5 +70,27 @@ PERFETTO_PB_FIELD(perfetto_protos_TrackEventConfig,
                   bool,
                   filter_dynamic_event_names,
                   9);
+PERFETTO_PB_FIELD(perfetto_protos_TrackEventConfig,
+                  MSG,
+                  perfetto_protos_TrackEventConfig_CategorySampling,
+                  category_sampling,
+                  10);
+PERFETTO_PB_FIELD(perfetto_protos_TrackEventConfig,
+                  VARINT,
+                  uint32_t,
+                  max_events_per_second_per_thread,
+                  11);
+
+PERFETTO_PB_MSG(perfetto_protos_TrackEventConfig_CategorySampling);
+PERFETTO_PB_FIELD(perfetto_protos_TrackEventConfig_CategorySampling,
+                  STRING,
+                  const char*,
+                  category,
+                  1);
+PERFETTO_PB_FIELD(perfetto_protos_TrackEventConfig_CategorySampling,
+                  FIXED64,
+                  double,
+                  rate,
+                  2);
 
 #endif  // INCLUDE_PERFETTO_PUBLIC_PROTOS_CONFIG_TRACK_EVENT_TRACK_EVENT_CONFIG_PZC_H_
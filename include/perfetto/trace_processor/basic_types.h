@@ -109,12 +109,148 @@ enum class DropTrackEventDataBefore {
   kTrackEventRangeOfInterest = 1,
 };
 
+// Limits on the resources used by a single query. Queries exceeding any of
+// them are aborted with an error. Zero means no limit.
+struct PERFETTO_EXPORT_COMPONENT QueryBudget {
+  // Maximum wall time, measured from the moment the query is passed to
+  // ExecuteQuery. This includes the time spent iterating over the results.
+  uint64_t max_wall_time_ms = 0;
+
+  // Maximum memory that SQLite can allocate on top of what it was using when
+  // the query started: this covers e.g. sorting, temporary b-trees and
+  // materialized CTEs but not the memory allocated by table functions.
+  uint64_t max_sqlite_memory_bytes = 0;
+};
+
+// Per table statistics of a query, similar to the output of EXPLAIN ANALYZE in
+// other databases. Collected by TraceProcessor::ExecuteQueryWithProfile.
+struct PERFETTO_EXPORT_COMPONENT QueryProfile {
+  // All the scans of a table with the same constraints and sort order chosen
+  // by SQLite (e.g. the inner side of a join) are aggregated in one entry.
+  struct TableScan {
+    std::string table_name;
+
+    // The constraints and sort order pushed down to the table by SQLite e.g.
+    // "ts >=,utid = order by ts". Empty for a full, unsorted scan.
+    std::string plan;
+
+    uint64_t filter_count = 0;
+    uint64_t filter_ns = 0;
+    uint64_t next_count = 0;
+    uint64_t next_ns = 0;
+    uint64_t column_count = 0;
+    uint64_t column_ns = 0;
+
+    // The number of rows the constraints were applied to. Zero for tables
+    // which don't report it.
+    uint64_t rows_examined = 0;
+
+    // The number of rows returned to SQLite.
+    uint64_t rows_returned = 0;
+  };
+  std::vector<TableScan> table_scans;
+};
+
 // Struct for configuring a TraceProcessor instance (see trace_processor.h).
 struct PERFETTO_EXPORT_COMPONENT Config {
   // Indicates the sortinng mode that trace processor should use on the passed
   // trace packets. See the enum documentation for more details.
   SortingMode sorting_mode = SortingMode::kDefaultHeuristics;
 
+  // Number of worker threads which the trace sorter can use to sort its
+  // per-CPU queues in parallel. Sorting of the queues is pipelined with
+  // parsing: events are pushed to the parsers as soon as the queue they belong
+  // to is sorted, while the remaining queues keep being sorted in the
+  // background. Parsing itself always happens on the calling thread.
+  //
+  // When set to zero (the default), all sorting happens on the calling thread.
+  // This option is ignored on platforms without thread support (e.g. the
+  // single-threaded WASM build).
+  uint32_t sorting_thread_count = 0;
+
+  // When non-empty, the events buffered by the trace sorter are stored in a
+  // (deleted) file created in this directory rather than in anonymous memory.
+  // The kernel can then write them back to disk and drop them from memory
+  // when it runs low, so that e.g. fully sorting a large trace doesn't need
+  // memory for all its events. The trace data itself is not spilled, but
+  // traces read from a file are already mmaped from it.
+  //
+  // Only supported on Linux and Android. Events are kept in memory if the file
+  // can't be created.
+  std::string sorter_spill_dir;
+
+  // If set, path to a string pool snapshot written by
+  // TraceProcessor::WriteStringPoolSnapshot(). The snapshot is memory mapped
+  // and its strings are used in place rather than being interned again, so
+  // that instances loading traces with many strings in common (e.g. traces of
+  // the same build) share a single copy of them, even across processes.
+  //
+  // Only supported on platforms with mmap. Strings are interned as usual if
+  // the snapshot can't be loaded.
+  std::string shared_string_pool_path;
+
+  // When non-zero, TraceProcessorStorage::Flush only pushes to the tables the
+  // events which are older than the newest event seen so far by more than
+  // this window, instead of all the buffered events. Events which arrive late
+  // (e.g. because the tracing service read the buffer of their CPU later) can
+  // then still be sorted with the ones still buffered.
+  //
+  // This is useful to query traces which are still being written (e.g. with
+  // write_into_file) by calling Parse and Flush as data is appended.
+  // NotifyEndOfFile always pushes all the remaining events.
+  int64_t incremental_flush_window_ns = 0;
+
+  // Number of worker threads which can be used to decompress the compressed
+  // packets of proto traces in parallel with tokenization. Each chunk of the
+  // trace is split at packet boundaries into shards which are decompressed
+  // concurrently and then tokenized in order on the calling thread.
+  //
+  // The same threads are also used to inflate gzip compressed traces while
+  // the decompressed data is parsed and to decompress the logcat files of
+  // bugreports in parallel.
+  //
+  // When set to zero (the default), all tokenization happens on the calling
+  // thread. This option is ignored on platforms without thread support (e.g.
+  // the single-threaded WASM build).
+  uint32_t tokenization_thread_count = 0;
+
+  // Number of worker threads which can be used to filter large table columns
+  // in parallel. Columns which are scanned linearly are split into chunks of
+  // rows which are searched concurrently and the results stitched together.
+  //
+  // The same threads are also used to join the partitions of SPAN_JOINs
+  // between trace processor tables in parallel, and to shrink the tables and
+  // compute the bounds of the trace table by table at the end of the trace.
+  //
+  // When set to zero (the default), filtering happens on the calling thread.
+  // This option is ignored on platforms without thread support (e.g. the
+  // single-threaded WASM build).
+  uint32_t filter_thread_count = 0;
+
+  // Number of worker threads which can be used to finalize Java heap graphs.
+  // Building the object graph, marking the objects reachable from the GC
+  // roots and resolving the superclasses are split between the threads.
+  //
+  // When set to zero (the default), heap graphs are processed on the calling
+  // thread. This option is ignored on platforms without thread support (e.g.
+  // the single-threaded WASM build).
+  uint32_t heap_graph_thread_count = 0;
+
+  // Number of worker threads which can be used to compute the memory graphs
+  // of Chrome memory-infra snapshots. The snapshots are independent, so the
+  // graphs of up to a few snapshots per thread are computed at the same time
+  // and their rows are added to the tables in timestamp order once they are
+  // all done.
+  //
+  // When set to zero (the default), each snapshot is processed on the calling
+  // thread as soon as it is complete. This option is ignored on platforms
+  // without thread support (e.g. the single-threaded WASM build).
+  uint32_t memory_graph_thread_count = 0;
+
+  // Resource limits of each query executed by this instance, unless
+  // overridden when calling TraceProcessor::ExecuteQuery. See QueryBudget.
+  QueryBudget query_budget;
+
   // When set to false, this option makes the trace processor not include ftrace
   // events in the raw table; this makes converting events back to the systrace
   // text format impossible. On the other hand, it also saves ~50% of memory
@@ -125,6 +261,26 @@ struct PERFETTO_EXPORT_COMPONENT Config {
   // unaffected by this flag.
   bool ingest_ftrace_in_raw_table = true;
 
+  // When set to true, the args of the ftrace events in the raw table are not
+  // decoded while the trace is loaded. Instead, the raw table only keeps a
+  // reference to the proto of each event (and so keeps the chunks of the
+  // trace containing ftrace events in memory) and all the args are decoded
+  // the first time the raw, ftrace_event or args tables are queried.
+  //
+  // This makes loading traces with a lot of ftrace events faster and saves
+  // the memory used by their args for as long as the queries don't need them,
+  // e.g. when only looking at the scheduling data.
+  bool lazy_ftrace_args = false;
+
+  // When set to true, the long strings interned by trace processor (e.g. log
+  // messages, JSON args or URLs) are stored compressed and decompressed when
+  // read, with a small cache of the most recently read ones. This makes
+  // traces containing a lot of such strings use much less memory, at the
+  // cost of slower loading and queries on these strings.
+  //
+  // Has no effect if trace processor is built without zlib.
+  bool compress_strings = false;
+
   // Indicates the event which should be used as a marker to drop ftrace data in
   // the trace before that event. See the ennu documenetation for more details.
   DropFtraceDataBefore drop_ftrace_data_before =
@@ -148,6 +304,19 @@ struct PERFETTO_EXPORT_COMPONENT Config {
   // The flag has no impact on non-proto traces.
   bool analyze_trace_proto_content = false;
 
+  // When analyzing trace proto content, only decodes one in every N packets
+  // of each packet type (the first one of each type is always decoded). The
+  // sizes and counts in the resulting table are scaled up to estimate the
+  // whole trace. When set to zero or one (the default), every packet is
+  // decoded.
+  uint32_t proto_content_sampling_interval = 0;
+
+  // When analyzing trace proto content, the maximum depth of nested messages
+  // which are decoded: deeper messages are accounted as a whole to their
+  // field, as if they were a leaf. When set to zero (the default), messages
+  // are decoded at any depth.
+  uint32_t proto_content_max_depth = 0;
+
   // When set to true, trace processor will be augmented with a bunch of helpful
   // features for local development such as extra SQL fuctions.
   //
@@ -20,6 +20,7 @@
 #include <stdint.h>
 
 #include <memory>
+#include <optional>
 
 #include "perfetto/base/export.h"
 #include "perfetto/trace_processor/basic_types.h"
@@ -87,6 +88,10 @@ class PERFETTO_EXPORT_COMPONENT Iterator {
   // statement which is iterated using this iterator).
   std::string LastStatementSql();
 
+  // Returns the profile of the query so far if it was executed with
+  // TraceProcessor::ExecuteQueryWithProfile or std::nullopt otherwise.
+  std::optional<QueryProfile> Profile();
+
   // Returns the status of the iterator.
   util::Status Status();
 
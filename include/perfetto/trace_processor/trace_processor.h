@@ -55,6 +55,18 @@ class PERFETTO_EXPORT_COMPONENT TraceProcessor : public TraceProcessorStorage {
   // the returned iterator.
   virtual Iterator ExecuteQuery(const std::string& sql) = 0;
 
+  // Like the above but limits the resources used by the query with |budget|
+  // instead of Config::query_budget.
+  virtual Iterator ExecuteQuery(const std::string& sql,
+                                const QueryBudget& budget) = 0;
+
+  // Like the above but also records how much time the query spends in each
+  // table and how many rows it reads from them. The profile can be read with
+  // Iterator::Profile() at any point: it covers all the statements of |sql|
+  // and the rows iterated so far. Profiling slows down the query.
+  virtual Iterator ExecuteQueryWithProfile(const std::string& sql,
+                                           const QueryBudget& budget) = 0;
+
   // Registers SQL files with the associated path under the module named
   // |sql_module.name|. These modules can be run by using the |IMPORT| SQL
   // function.
@@ -137,6 +149,11 @@ class PERFETTO_EXPORT_COMPONENT TraceProcessor : public TraceProcessorStorage {
   // loaded by trace processor shell at runtime. The message is encoded as
   // DescriptorSet, defined in perfetto/trace_processor/trace_processor.proto.
   virtual std::vector<uint8_t> GetMetricDescriptors() = 0;
+
+  // Writes the strings interned so far to |path|, in the format expected by
+  // Config::shared_string_pool_path. Typically called after loading a
+  // representative trace so that other instances can share its strings.
+  virtual base::Status WriteStringPoolSnapshot(const std::string& path) = 0;
 };
 
 // When set, logs SQLite actions on the console.
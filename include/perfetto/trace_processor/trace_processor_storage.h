@@ -55,6 +55,11 @@ class PERFETTO_EXPORT_COMPONENT TraceProcessorStorage {
   // in sorting queues. This is useful if queries need to be performed to
   // compute post-processing data (e.g. deobfuscation, symbolization etc) which
   // will be appended to the trace in a future call to Parse.
+  //
+  // If Config::incremental_flush_window_ns is set, only the events older than
+  // the newest event by more than the window are pushed: this allows querying
+  // traces which are still being written without breaking the sorting of
+  // events which arrive late.
   virtual void Flush() = 0;
 
   // Calls Flush and finishes all of the actions required for parsing the trace.
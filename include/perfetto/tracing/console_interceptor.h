@@ -26,6 +26,7 @@
 
 #include <functional>
 #include <map>
+#include <memory>
 #include <vector>
 
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
@@ -55,6 +56,7 @@ class TrackEvent_Decoder;
 }  // namespace pbzero
 }  // namespace protos
 
+class AsyncFileWriter;
 struct ConsoleColor;
 
 class PERFETTO_EXPORT_COMPONENT ConsoleInterceptor
@@ -80,6 +82,10 @@ class PERFETTO_EXPORT_COMPONENT ConsoleInterceptor
     int fd{};
     bool use_colors{};
 
+    // If set, messages are written to |fd| through this instead of directly.
+    // See ConsoleConfig.async_output.
+    std::shared_ptr<AsyncFileWriter> async_writer;
+
     // Messages up to this length are buffered and written atomically. If a
     // message is longer, it will be printed with multiple writes.
     std::array<char, 1024> message_buffer{};
@@ -116,6 +122,7 @@ class PERFETTO_EXPORT_COMPONENT ConsoleInterceptor
 
   int fd_ = STDOUT_FILENO;
   bool use_colors_ = true;
+  std::shared_ptr<AsyncFileWriter> async_writer_;
 
   TrackEventStateTracker::SessionState session_state_;
   uint64_t start_time_ns_{};
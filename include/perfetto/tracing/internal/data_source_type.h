@@ -233,6 +233,11 @@ class PERFETTO_EXPORT_COMPONENT DataSourceType {
       typename TracePointTraits::TracePointData trace_point_data) {
     iterator->instance = nullptr;
     for (; iterator->i < kMaxDataSourceInstances; iterator->i++) {
+      // Stop as soon as there are no active instances left past |i|, so that
+      // trace points of data sources with a single active instance (by far the
+      // most common case) don't check all the other slots.
+      if (!(iterator->cached_instances >> iterator->i))
+        break;
       DataSourceState* instance_state =
           state_.TryGetCached(iterator->cached_instances, iterator->i);
       if (!instance_state)
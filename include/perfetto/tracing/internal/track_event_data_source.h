@@ -247,6 +247,7 @@ class TrackEventDataSource
     bool ok = config_.ParseFromArray(config_raw.data(), config_raw.size());
     PERFETTO_DCHECK(ok);
     TrackEventInternal::EnableTracing(*Registry, config_, args);
+    GetDynamicCategoryCache()->Invalidate();
   }
 
   void OnStart(const DataSourceBase::StartArgs& args) override {
@@ -349,9 +350,10 @@ class TrackEventDataSource
   static bool IsDynamicCategoryEnabled(
       const DynamicCategory& dynamic_category) {
     bool enabled = false;
-    Base::template Trace([&](typename Base::TraceContext ctx) {
-      enabled = enabled || IsDynamicCategoryEnabled(&ctx, dynamic_category);
-    });
+    TraceForDynamicCategory(dynamic_category,
+                            [&](typename Base::TraceContext) {
+                              enabled = true;
+                            });
     return enabled;
   }
 
@@ -994,16 +996,10 @@ class TrackEventDataSource
       const TrackType& track,
       const TimestampType& timestamp,
       Arguments&&... args) PERFETTO_ALWAYS_INLINE {
-    using CatTraits = CategoryTraits<CategoryType>;
     TraceWithInstances(
         instances, category, [&](typename Base::TraceContext ctx) {
-          // If this category is dynamic, first check whether it's enabled.
-          if (CatTraits::kIsDynamic &&
-              !IsDynamicCategoryEnabled(
-                  &ctx, CatTraits::GetDynamicCategory(category))) {
+          if (!ShouldRecordEvent(ctx, category, type, track))
             return;
-          }
-
           auto event_ctx = WriteTrackEvent(ctx, category, event_name, type,
                                            track, timestamp);
           WriteTrackEventArgs(std::move(event_ctx),
@@ -1024,16 +1020,10 @@ class TrackEventDataSource
       perfetto::protos::pbzero::TrackEvent::Type type,
       const TrackType& track,
       Arguments&&... args) PERFETTO_ALWAYS_INLINE {
-    using CatTraits = CategoryTraits<CategoryType>;
     TraceWithInstances(
         instances, category, [&](typename Base::TraceContext ctx) {
-          // If this category is dynamic, first check whether it's enabled.
-          if (CatTraits::kIsDynamic &&
-              !IsDynamicCategoryEnabled(
-                  &ctx, CatTraits::GetDynamicCategory(category))) {
+          if (!ShouldRecordEvent(ctx, category, type, track))
             return;
-          }
-
           auto event_ctx =
               WriteTrackEvent(ctx, category, event_name, type, track);
           WriteTrackEventArgs(std::move(event_ctx),
@@ -1041,13 +1031,53 @@ class TrackEventDataSource
         });
   }
 
+  // Applies TrackEventConfig.category_sampling and
+  // max_events_per_second_per_thread, if set.
+  template <typename CategoryType, typename TrackType>
+  static bool ShouldRecordEvent(
+      typename Base::TraceContext& ctx,
+      const CategoryType& category,
+      perfetto::protos::pbzero::TrackEvent::Type type,
+      const TrackType& track) PERFETTO_ALWAYS_INLINE {
+    TrackEventSamplingState* sampling =
+        ctx.GetCustomTlsState()->sampling.get();
+    if (PERFETTO_LIKELY(!sampling))
+      return true;
+    bool on_current_thread_track =
+        (&track == &TrackEventInternal::kDefaultTrack);
+    return ShouldRecordSampledEvent(sampling, category, type,
+                                    on_current_thread_track);
+  }
+
+  template <typename CategoryType>
+  static bool ShouldRecordSampledEvent(
+      TrackEventSamplingState* sampling,
+      const CategoryType& category,
+      perfetto::protos::pbzero::TrackEvent::Type type,
+      bool on_current_thread_track) PERFETTO_NO_INLINE {
+    using CatTraits = CategoryTraits<CategoryType>;
+    if (CatTraits::kIsDynamic) {
+      DynamicCategory dynamic_category =
+          CatTraits::GetDynamicCategory(category);
+      return TrackEventInternal::ShouldRecordEvent(
+          sampling, Category::FromDynamicCategory(dynamic_category),
+          TrackEventCategoryRegistry::kDynamicCategoryIndex, type,
+          on_current_thread_track);
+    }
+    return TrackEventInternal::ShouldRecordEvent(
+        sampling, *CatTraits::GetStaticCategory(Registry, category),
+        CatTraits::GetStaticIndex(category), type, on_current_thread_track);
+  }
+
   template <typename CategoryType, typename Lambda>
   static void TraceWithInstances(uint32_t instances,
                                  const CategoryType& category,
                                  Lambda lambda) PERFETTO_ALWAYS_INLINE {
     using CatTraits = CategoryTraits<CategoryType>;
     if (CatTraits::kIsDynamic) {
-      Base::template TraceWithInstances(instances, std::move(lambda));
+      // |instances| isn't used here, see TraceForDynamicCategory().
+      TraceForDynamicCategory(CatTraits::GetDynamicCategory(category),
+                              std::move(lambda));
     } else {
       Base::template TraceWithInstances<CategoryTracePointTraits>(
           instances, std::move(lambda), {CatTraits::GetStaticIndex(category)});
@@ -1068,6 +1098,44 @@ class TrackEventDataSource
     });
   }
 
+  // Calls |lambda| for each instance on which |dynamic_category| is enabled.
+  template <typename Lambda>
+  static void TraceForDynamicCategory(const DynamicCategory& dynamic_category,
+                                      Lambda lambda) {
+    TrackEventDynamicCategoryCache* cache = GetDynamicCategoryCache();
+    // The generation must be read before the active instances, so that the
+    // category isn't marked as disabled if a new instance is set up meanwhile.
+    uint32_t generation = cache->generation();
+    if (cache->IsDisabled(dynamic_category.name, generation))
+      return;
+
+    bool enabled = false;
+    uint32_t num_checked_instances = 0;
+    uint32_t num_active_instances = 0;
+    Base::template CallIfEnabled([&](uint32_t instances) {
+      for (uint32_t i = instances; i; i &= i - 1)
+        num_active_instances++;
+      Base::template TraceWithInstances(
+          instances, [&](typename Base::TraceContext ctx) {
+            num_checked_instances++;
+            if (!IsDynamicCategoryEnabled(&ctx, dynamic_category))
+              return;
+            enabled = true;
+            lambda(std::move(ctx));
+          });
+    });
+
+    // Only remember that the category is disabled if it was checked on all
+    // instances (e.g., reentrant trace points don't visit any).
+    if (!enabled && num_checked_instances == num_active_instances)
+      cache->SetDisabled(dynamic_category.name, generation);
+  }
+
+  static TrackEventDynamicCategoryCache* GetDynamicCategoryCache() {
+    static TrackEventDynamicCategoryCache cache;
+    return &cache;
+  }
+
   // Determines if the given dynamic category is enabled, first by checking the
   // per-trace writer cache or by falling back to computing it based on the
   // trace config for the given session.
@@ -29,7 +29,15 @@
 #include "protos/perfetto/trace/interned_data/interned_data.pbzero.h"
 #include "protos/perfetto/trace/track_event/track_event.pbzero.h"
 
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace perfetto {
 
@@ -96,6 +104,27 @@ class PERFETTO_EXPORT_COMPONENT BaseTrackEventInternedDataIndex {
 #endif  // PERFETTO_DCHECK_IS_ON()
 };
 
+// Per-thread state of the sampling configured by
+// TrackEventConfig.category_sampling and max_events_per_second_per_thread.
+struct TrackEventSamplingState {
+  // The (category pattern, rate) of each TrackEventConfig.category_sampling.
+  std::vector<std::pair<std::string, double>> category_rates;
+
+  // Cache of the rates of the static categories, by category index. Negative
+  // for the categories whose rate hasn't been looked up yet.
+  std::vector<double> static_category_rates;
+
+  uint32_t max_events_per_second = 0;
+  uint64_t rate_limit_window_start_ns = 0;
+  uint32_t rate_limit_window_events = 0;
+
+  // For each slice open on the track of the current thread, innermost last,
+  // whether its begin was recorded.
+  std::vector<bool> recorded_slices;
+
+  std::minstd_rand rnd_engine;
+};
+
 struct TrackEventTlsState {
   template <typename TraceContext>
   explicit TrackEventTlsState(const TraceContext& trace_context);
@@ -104,6 +133,8 @@ struct TrackEventTlsState {
   bool filter_dynamic_event_names = false;
   uint64_t timestamp_unit_multiplier = 1;
   uint32_t default_clock;
+  // Only set if the config samples the events.
+  std::unique_ptr<TrackEventSamplingState> sampling;
 };
 
 struct TrackEventIncrementalState {
@@ -142,6 +173,20 @@ struct TrackEventIncrementalState {
   std::array<InternedDataIndex, kMaxInternedDataFields> interned_data_indices =
       {};
 
+  // A direct-mapped cache of the encoded TrackEvent.category_iids fields of
+  // static categories (see TrackEventInternal::WriteEvent()), so that the
+  // category names don't have to be looked up in the interning index for each
+  // event.
+  static constexpr size_t kNumEncodedCategoryIids = 16;
+  struct EncodedCategoryIids {
+    const Category* category = nullptr;
+    uint8_t size = 0;
+    // Up to 4 category group members, each as a tag + varint.
+    uint8_t data[4 * protozero::proto_utils::kMaxSimpleFieldEncodedSize];
+  };
+  std::array<EncodedCategoryIids, kNumEncodedCategoryIids>
+      encoded_category_iids = {};
+
   // Track uuids for which we have written descriptors into the trace. If a
   // trace event uses a track which is not in this set, we'll write out a
   // descriptor for it.
@@ -164,6 +209,58 @@ struct TrackEventIncrementalState {
   int64_t last_thread_time_ns = 0;
 };
 
+// Remembers which dynamic categories were found to be disabled on all the
+// instances of a track event data source, so that trace points using them can
+// bail out without visiting each instance (and looking up the category in its
+// incremental state). Entries are tagged with a generation, which is bumped
+// whenever a new instance is set up, which invalidates all of them.
+//
+// Like HashedInternedDataTraits, this assumes that there are no collisions of
+// the hashes of category names.
+class TrackEventDynamicCategoryCache {
+ public:
+  constexpr TrackEventDynamicCategoryCache() = default;
+
+  // Must be called after setting up a new data source instance.
+  void Invalidate() { generation_.fetch_add(1, std::memory_order_acq_rel); }
+
+  // The generation must be read before reading the active instances used to
+  // determine that a category is disabled.
+  uint32_t generation() const {
+    return generation_.load(std::memory_order_acquire);
+  }
+
+  bool IsDisabled(const std::string& name, uint32_t generation) const {
+    uint64_t hash = Hash(name);
+    return entries_[hash % kNumEntries].load(std::memory_order_relaxed) ==
+           MakeEntry(hash, generation);
+  }
+
+  void SetDisabled(const std::string& name, uint32_t generation) {
+    uint64_t hash = Hash(name);
+    entries_[hash % kNumEntries].store(MakeEntry(hash, generation),
+                                       std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr size_t kNumEntries = 64;
+
+  static uint64_t Hash(const std::string& name) {
+    return static_cast<uint64_t>(std::hash<std::string>()(name)) *
+           0x9e3779b97f4a7c15ull;
+  }
+
+  // The upper 32 bits of the hash (the lower ones select the entry) and the
+  // generation.
+  static uint64_t MakeEntry(uint64_t hash, uint32_t generation) {
+    return (hash & ~uint64_t{0xffffffff}) | generation;
+  }
+
+  // Starts from 1, so that zero-initialized entries are never valid.
+  std::atomic<uint32_t> generation_{1};
+  std::array<std::atomic<uint64_t>, kNumEntries> entries_{};
+};
+
 // The backend portion of the track event trace point implemention. Outlined to
 // a separate .cc file so it can be shared by different track event category
 // namespaces.
@@ -203,6 +300,15 @@ class PERFETTO_EXPORT_COMPONENT TrackEventInternal {
                              perfetto::EventContext& event_ctx,
                              const TrackEventTlsState&);
 
+  // Returns whether to record an event of |category| (whose index is
+  // |category_index| for static categories), according to the sampling
+  // configured in |sampling|. Must be called exactly once for each event.
+  static bool ShouldRecordEvent(TrackEventSamplingState* sampling,
+                                const Category& category,
+                                size_t category_index,
+                                perfetto::protos::pbzero::TrackEvent::Type,
+                                bool on_current_thread_track);
+
   static perfetto::EventContext WriteEvent(
       TraceWriterBase*,
       TrackEventIncrementalState*,
@@ -329,6 +435,17 @@ TrackEventTlsState::TrackEventTlsState(const TraceContext& trace_context) {
     if (config.has_timestamp_unit_multiplier()) {
       timestamp_unit_multiplier = config.timestamp_unit_multiplier();
     }
+    if (!config.category_sampling().empty() ||
+        config.max_events_per_second_per_thread() > 0) {
+      sampling.reset(new TrackEventSamplingState());
+      for (const auto& rule : config.category_sampling())
+        sampling->category_rates.emplace_back(rule.category(), rule.rate());
+      sampling->max_events_per_second =
+          config.max_events_per_second_per_thread();
+      sampling->rnd_engine.seed(static_cast<uint32_t>(
+          reinterpret_cast<uintptr_t>(sampling.get()) ^
+          TrackEventInternal::GetTimeNs()));
+    }
   }
   if (disable_incremental_timestamps) {
     if (timestamp_unit_multiplier == 1) {
@@ -27,6 +27,7 @@
 #include "perfetto/tracing/traced_value_forward.h"
 
 #include <memory>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 
@@ -507,6 +508,22 @@ WriteIntoTracedValueWithFallback(TracedValue context,
   std::move(context).WriteString(fallback);
 }
 
+// Overloads for string literal fallbacks, which avoid constructing a
+// std::string for every call.
+template <typename T>
+typename std::enable_if<internal::has_traced_value_support<T>::value>::type
+WriteIntoTracedValueWithFallback(TracedValue context, T&& value, const char*) {
+  WriteIntoTracedValue(std::move(context), std::forward<T>(value));
+}
+
+template <typename T>
+typename std::enable_if<!internal::has_traced_value_support<T>::value>::type
+WriteIntoTracedValueWithFallback(TracedValue context,
+                                 T&&,
+                                 const char* fallback) {
+  std::move(context).WriteString(fallback);
+}
+
 // TraceFormatTraits implementations for primitive types.
 
 // Specialisation for signed integer types (note: it excludes enums, which have
@@ -627,6 +644,16 @@ struct TraceFormatTraits<std::string> {
   }
 };
 
+// Specialisation for std::string_view, which doesn't need to be null
+// terminated.
+template <>
+struct TraceFormatTraits<std::string_view> {
+  inline static void WriteIntoTrace(TracedValue context,
+                                    std::string_view value) {
+    std::move(context).WriteString(value.data(), value.size());
+  }
+};
+
 // Specialisation for (const) void*, which writes the pointer value.
 template <>
 struct TraceFormatTraits<void*> {
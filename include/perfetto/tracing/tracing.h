@@ -106,6 +106,10 @@ struct TracingInitArgs {
   //
   // Note: With the default value of 0ms, batching still happens but with a zero
   // delay, i.e. commits will be sent to the service at the next opportunity.
+  // The in-process backend instead uses a 10ms period when this is 0: its
+  // service lives in the same process, so commits held back can't be lost if
+  // the process crashes, and batching saves a wakeup of the service thread
+  // for every commit.
   uint32_t shmem_batch_commits_duration_ms = 0;
 
   // [Optional] If set, the policy object is notified when certain SDK events
@@ -282,6 +286,15 @@ class PERFETTO_EXPORT_COMPONENT Tracing {
     BackendType backend = kUnspecifiedBackend;
     uint32_t timeout_ms = 10000;
 
+    // Size of the shared memory buffer, if one has to be created for startup
+    // tracing (i.e. the backend isn't already connected with a shared memory
+    // buffer). Overrides TracingInitArgs::shmem_size_hint_kb for it when
+    // non-zero. Startup trace data stays in that buffer until the service
+    // starts the session and adopts it, and is dropped if the buffer fills up
+    // before that, so it should be large enough for the data written
+    // until then. The service rejects buffers larger than 32 MB.
+    uint32_t shmem_size_hint_kb = 0;
+
     // If set, this callback is executed (on an internal Perfetto thread) when
     // startup tracing was set up.
     std::function<void(OnStartupTracingSetupCallbackArgs)> on_setup;
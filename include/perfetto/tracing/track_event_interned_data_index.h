@@ -22,7 +22,10 @@
 #include "perfetto/base/compiler.h"
 #include "perfetto/tracing/event_context.h"
 
+#include <stdint.h>
+
 #include <map>
+#include <memory>
 #include <type_traits>
 #include <unordered_map>
 
@@ -71,8 +74,8 @@ namespace perfetto {
 // consider using HashedInternedDataTraits if that may be an issue.
 //
 // This type of index also performs hashing on the stored data for lookups; for
-// types where this isn't necessary (e.g., raw const char*), use
-// SmallInternedDataTraits.
+// types where this isn't necessary, use SmallInternedDataTraits (or
+// PointerInternedDataTraits for raw pointers, e.g. const char*).
 struct BigInternedDataTraits {
   template <typename ValueType>
   class Index {
@@ -116,6 +119,80 @@ struct SmallInternedDataTraits {
   };
 };
 
+// This type of interning index is specialized for pointers (e.g., the const
+// char* of event names and categories, which are usually string literals). The
+// pointers are used directly as keys of an open-addressed hash table with
+// linear probing, which avoids the pointer chasing of a tree-based map for the
+// (by far more common) lookups of already interned values.
+struct PointerInternedDataTraits {
+  template <typename ValueType>
+  class Index {
+   public:
+    static_assert(std::is_pointer<ValueType>::value,
+                  "PointerInternedDataTraits only supports pointer types");
+
+    bool LookUpOrInsert(size_t* iid, const ValueType& value) {
+      if (PERFETTO_UNLIKELY(!capacity_))
+        Grow();
+      const size_t mask = capacity_ - 1;
+      for (size_t i = Hash(value) & mask;; i = (i + 1) & mask) {
+        Entry& entry = entries_[i];
+        if (PERFETTO_LIKELY(entry.iid && entry.key == value)) {
+          *iid = entry.iid;
+          return true;
+        }
+        if (entry.iid)
+          continue;
+        // Not found. Keep the load factor <= 1/2 to keep the probes short.
+        if ((size_ + 1) * 2 > capacity_) {
+          Grow();
+          return LookUpOrInsert(iid, value);
+        }
+        entry.key = value;
+        entry.iid = ++size_;
+        *iid = entry.iid;
+        return false;
+      }
+    }
+
+   private:
+    static constexpr size_t kInitialCapacity = 32;
+
+    struct Entry {
+      ValueType key;
+      size_t iid;  // 0 if the entry is empty (interning ids start from 1).
+    };
+
+    static size_t Hash(ValueType value) {
+      // Fibonacci hashing, to spread the (often adjacent) pointers.
+      uint64_t hash = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value));
+      hash *= 0x9e3779b97f4a7c15ull;
+      return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+
+    void Grow() {
+      size_t old_capacity = capacity_;
+      std::unique_ptr<Entry[]> old_entries = std::move(entries_);
+      capacity_ = old_capacity ? old_capacity * 2 : kInitialCapacity;
+      entries_.reset(new Entry[capacity_]());
+      const size_t mask = capacity_ - 1;
+      for (size_t i = 0; i < old_capacity; i++) {
+        const Entry& entry = old_entries[i];
+        if (!entry.iid)
+          continue;
+        size_t j = Hash(entry.key) & mask;
+        while (entries_[j].iid)
+          j = (j + 1) & mask;
+        entries_[j] = entry;
+      }
+    }
+
+    std::unique_ptr<Entry[]> entries_;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+  };
+};
+
 // This type of interning index only stores the hash of the interned values
 // instead of the values themselves. This is more efficient in terms of memory
 // usage, but assumes that there are no hash collisions. If a hash collision
@@ -161,10 +238,10 @@ struct HashedInternedDataTraits {
 template <typename InternedDataType,
           size_t FieldNumber,
           typename ValueType,
-          // Avoid unnecessary hashing for pointers by default.
+          // Avoid hashing the pointed-to data for pointers by default.
           typename Traits =
               typename std::conditional<(std::is_pointer<ValueType>::value),
-                                        SmallInternedDataTraits,
+                                        PointerInternedDataTraits,
                                         BigInternedDataTraits>::type>
 class TrackEventInternedDataIndex
     : public internal::BaseTrackEventInternedDataIndex {
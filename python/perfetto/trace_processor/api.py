@@ -12,7 +12,9 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import array
 import dataclasses as dc
+import sys
 from urllib.parse import urlparse
 from typing import List, Optional
 
@@ -48,6 +50,7 @@ class TraceProcessorConfig:
   ingest_ftrace_in_raw: bool
   enable_dev_features: bool
   resolver_registry: Optional[ResolverRegistry]
+  shared_string_pool: Optional[str]
 
   def __init__(self,
                bin_path: Optional[str] = None,
@@ -55,13 +58,17 @@ class TraceProcessorConfig:
                verbose: bool = False,
                ingest_ftrace_in_raw: bool = False,
                enable_dev_features=False,
-               resolver_registry: Optional[ResolverRegistry] = None):
+               resolver_registry: Optional[ResolverRegistry] = None,
+               shared_string_pool: Optional[str] = None):
     self.bin_path = bin_path
     self.unique_port = unique_port
     self.verbose = verbose
     self.ingest_ftrace_in_raw = ingest_ftrace_in_raw
     self.enable_dev_features = enable_dev_features
     self.resolver_registry = resolver_registry
+    # Path to a string pool written by trace_processor_shell
+    # --write-string-pool: shared by all the instances using this config.
+    self.shared_string_pool = shared_string_pool
 
 
 class TraceProcessor:
@@ -100,6 +107,21 @@ class TraceProcessor:
       self.__data_lists_index = [0, 0, 0, 0, 0, 0]
       self.__current_index = 0
 
+      # Set if the batches are in the columnar layout (see
+      # QueryArgs.columnar_result): the cells are then only decoded when
+      # needed, column by column.
+      self.__columnar_batches = None
+      self.__columnar_cells = None
+      if batches[0].HasField('row_count'):
+        self.__columnar_batches = []
+        for batch in batches:
+          self.__columnar_batches.append(batch)
+          self.__count += batch.row_count
+          if batch.is_last_batch:
+            break
+        self.__column_count = len(self.__column_names)
+        return
+
       # Iterate over all the batches and collect their
       # contents into lists based on the type of the batch
       batch_index = 0
@@ -158,8 +180,18 @@ class TraceProcessor:
     # TraceProcesor.
     def as_pandas_dataframe(self):
       try:
+        import numpy as np
         import pandas as pd
 
+        if self.__columnar_batches is not None:
+          df = pd.DataFrame({
+              num: self.__columnar_numpy_column(np, num)
+              for num in range(len(self.__column_names))
+          })
+          df.columns = self.__column_names
+          return df.astype(object).where(df.notnull(),
+                                         None).reset_index(drop=True)
+
         # Populate the dataframe with the query results
         rows = []
         for i in range(0, self.__count):
@@ -186,6 +218,76 @@ class TraceProcessor:
         raise TraceProcessorException(
             'Python dependencies missing. Please pip3 install pandas numpy')
 
+    # Returns the cells of a column of a columnar result as a list of Python
+    # values.
+    def __columnar_column_cells(self, col_index):
+      cells = []
+      for batch in self.__columnar_batches:
+        col = batch.columns[col_index]
+        if col.type == TraceProcessor.QUERY_CELL_INVALID_FIELD_ID:
+          cell_types = col.cell_types
+        else:
+          cell_types = bytes([col.type]) * batch.row_count
+        null_bitmap = col.null_bitmap
+        varints = array.array('q', col.fixed64_values)
+        doubles = array.array('d', col.fixed64_values)
+        if sys.byteorder != 'little':
+          varints.byteswap()
+          doubles.byteswap()
+        strings = col.string_values.split(b'\0')
+
+        for row in range(batch.row_count):
+          if null_bitmap and (null_bitmap[row >> 3] >> (row & 7)) & 1:
+            cells.append(None)
+            continue
+          cell_type = cell_types[row]
+          if cell_type == TraceProcessor.QUERY_CELL_VARINT_FIELD_ID:
+            cells.append(varints[row])
+          elif cell_type == TraceProcessor.QUERY_CELL_FLOAT64_FIELD_ID:
+            cells.append(doubles[row])
+          elif cell_type == TraceProcessor.QUERY_CELL_STRING_FIELD_ID:
+            cells.append(strings[row].decode('utf-8', 'ignore'))
+          elif cell_type == TraceProcessor.QUERY_CELL_BLOB_FIELD_ID:
+            cells.append(col.blob_values[row])
+          else:
+            raise TraceProcessorException('Invalid cell type')
+      return cells
+
+    # Returns a column of a columnar result as a numpy array. Columns of
+    # integers or doubles are loaded straight from the serialized values.
+    def __columnar_numpy_column(self, np, col_index):
+      cols = [batch.columns[col_index] for batch in self.__columnar_batches]
+      row_counts = [batch.row_count for batch in self.__columnar_batches]
+      types = {col.type for col in cols}
+      types.discard(TraceProcessor.QUERY_CELL_NULL_FIELD_ID)
+
+      if types == {TraceProcessor.QUERY_CELL_VARINT_FIELD_ID} or \
+          types == {TraceProcessor.QUERY_CELL_FLOAT64_FIELD_ID}:
+        dtype = '<i8' if TraceProcessor.QUERY_CELL_VARINT_FIELD_ID in types \
+            else '<f8'
+        values = np.frombuffer(
+            b''.join(col.fixed64_values or bytes(8 * row_count)
+                     for col, row_count in zip(cols, row_counts)),
+            dtype=dtype)
+        if any(col.null_bitmap for col in cols):
+          nulls = np.concatenate([
+              np.unpackbits(
+                  np.frombuffer(col.null_bitmap, dtype=np.uint8),
+                  bitorder='little')[:row_count].astype(bool)
+              if col.null_bitmap else np.zeros(row_count, dtype=bool)
+              for col, row_count in zip(cols, row_counts)
+          ])
+          values = values.astype(object)
+          values[nulls] = None
+        return values
+
+      # Strings, blobs and columns mixing several types are Python objects
+      # anyway.
+      cells = self.__columnar_column_cells(col_index)
+      values = np.empty(len(cells), dtype=object)
+      values[:] = cells
+      return values
+
     def __len__(self):
       return self.__count
 
@@ -196,6 +298,18 @@ class TraceProcessor:
       if self.__current_index == self.__count:
         raise StopIteration
       result = TraceProcessor.Row()
+      if self.__columnar_batches is not None:
+        if self.__columnar_cells is None:
+          self.__columnar_cells = [
+              self.__columnar_column_cells(num)
+              for num in range(len(self.__column_names))
+          ]
+        for num, column_name in enumerate(self.__column_names):
+          setattr(result, column_name,
+                  self.__columnar_cells[num][self.__current_index])
+        self.__current_index += 1
+        return result
+
       base_cell_index = self.__current_index * self.__column_count
       for num, column_name in enumerate(self.__column_names):
         col_type = self.__cells[base_cell_index + num]
@@ -279,7 +393,7 @@ class TraceProcessor:
       can also be converted to a pandas dataframe by calling the
       as_pandas_dataframe() function after calling query.
     """
-    response = self.http.execute_query(sql)
+    response = self.http.execute_query(sql, columnar=True)
     if response.error:
       raise TraceProcessorException(response.error)
 
@@ -332,7 +446,8 @@ class TraceProcessor:
                                       self.config.verbose,
                                       self.config.ingest_ftrace_in_raw,
                                       self.config.enable_dev_features,
-                                      self.platform_delegate)
+                                      self.platform_delegate,
+                                      self.config.shared_string_pool)
     return TraceProcessorHttp(url, protos=self.protos)
 
   def _parse_trace(self, trace: TraceReference):
@@ -17,6 +17,7 @@ import os
 import subprocess
 import sys
 import time
+from typing import Optional
 from urllib import request, error
 
 from perfetto.trace_processor.platform import PlatformDelegate
@@ -27,7 +28,8 @@ TP_PORT = 9001
 
 def load_shell(bin_path: str, unique_port: bool, verbose: bool,
                ingest_ftrace_in_raw: bool, enable_dev_features: bool,
-               platform_delegate: PlatformDelegate):
+               platform_delegate: PlatformDelegate,
+               shared_string_pool: Optional[str] = None):
   addr, port = platform_delegate.get_bind_addr(
       port=0 if unique_port else TP_PORT)
   url = f'{addr}:{str(port)}'
@@ -45,6 +47,9 @@ def load_shell(bin_path: str, unique_port: bool, verbose: bool,
   if enable_dev_features:
     args.append('--dev')
 
+  if shared_string_pool:
+    args.extend(['--shared-string-pool', shared_string_pool])
+
   p = subprocess.Popen(
       tp_exec + args,
       stdin=subprocess.DEVNULL,
@@ -61,6 +61,7 @@ namespace {
 using namespace perfetto;
 using benchmark::Counter;
 using perfetto::base::AlreadyHashed;
+using perfetto::base::GroupProbe;
 using perfetto::base::LinearProbe;
 using perfetto::base::QuadraticHalfProbe;
 using perfetto::base::QuadraticProbe;
@@ -299,6 +300,65 @@ void BM_HashMap_LookupRandInts(benchmark::State& state) {
                                       Counter::kIsIterationInvariantRate);
 }
 
+// Looks up tid-like keys: small integers that are dense in a range, hashed
+// with the identity std::hash<int> of libstdc++/libc++ (like the tid -> utid
+// maps of the trace processor). Half of the lookups are misses.
+template <typename MapType>
+void BM_HashMap_LookupTidLikeInts(benchmark::State& state) {
+  std::minstd_rand0 rng(0);
+  const int kNumTids = static_cast<int>(std::min(num_samples(), size_t(32768)));
+  MapType mapz;
+  for (int tid = 0; tid < kNumTids; tid += 2)
+    mapz.insert({tid, static_cast<uint64_t>(tid)});
+
+  std::vector<int> lookups(num_samples());
+  for (int& tid : lookups)
+    tid = static_cast<int>(rng() % static_cast<uint32_t>(kNumTids));
+
+  for (auto _ : state) {
+    uint64_t total = 0;
+    for (const int tid : lookups) {
+      auto it = mapz.find(tid);
+      if (it != mapz.end())
+        total += it->second;
+    }
+    benchmark::DoNotOptimize(total);
+    benchmark::ClobberMemory();
+  }
+  state.counters["lookups"] = Counter(static_cast<double>(lookups.size()),
+                                      Counter::kIsIterationInvariantRate);
+}
+
+// Looks up random 64-bit hashes (like the string ids interned by the trace
+// processor's StringPool) in a map that is just below the load limit, where
+// probe chains are longest. Half of the lookups are misses.
+template <typename MapType>
+void BM_HashMap_LookupHighLoad(benchmark::State& state) {
+  std::mt19937_64 rng(0);
+  // 74% of 1M slots, just below the 75% default load limit.
+  const size_t kNumKeys = IsBenchmarkFunctionalOnly() ? 100 : 776000;
+  std::vector<uint64_t> keys(kNumKeys * 2);
+  for (uint64_t& key : keys)
+    key = rng();
+  MapType mapz;
+  for (size_t i = 0; i < kNumKeys; i++)
+    mapz.insert({keys[i], keys[i]});
+  std::shuffle(keys.begin(), keys.end(), rng);
+
+  for (auto _ : state) {
+    uint64_t total = 0;
+    for (const uint64_t key : keys) {
+      auto it = mapz.find(key);
+      if (it != mapz.end())
+        total += it->second;
+    }
+    benchmark::DoNotOptimize(total);
+    benchmark::ClobberMemory();
+  }
+  state.counters["lookups"] = Counter(static_cast<double>(keys.size()),
+                                      Counter::kIsIterationInvariantRate);
+}
+
 }  // namespace
 
 using Ours_LinearProbing =
@@ -307,6 +367,8 @@ using Ours_QuadProbing =
     Ours<uint64_t, uint64_t, AlreadyHashed<uint64_t>, QuadraticProbe>;
 using Ours_QuadCompProbing =
     Ours<uint64_t, uint64_t, AlreadyHashed<uint64_t>, QuadraticHalfProbe>;
+using Ours_GroupProbing =
+    Ours<uint64_t, uint64_t, AlreadyHashed<uint64_t>, GroupProbe>;
 using StdUnorderedMap =
     std::unordered_map<uint64_t, uint64_t, AlreadyHashed<uint64_t>>;
 
@@ -321,6 +383,7 @@ using FollyF14FastMap =
 BENCHMARK(BM_HashMap_InsertTraceStrings_AppendOnly);
 BENCHMARK_TEMPLATE(BM_HashMap_InsertTraceStrings, Ours_LinearProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_InsertTraceStrings, Ours_QuadProbing);
+BENCHMARK_TEMPLATE(BM_HashMap_InsertTraceStrings, Ours_GroupProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_InsertTraceStrings, StdUnorderedMap);
 #if defined(PERFETTO_HASH_MAP_COMPARE_THIRD_PARTY_LIBS)
 BENCHMARK_TEMPLATE(BM_HashMap_InsertTraceStrings, RobinMap);
@@ -332,6 +395,7 @@ BENCHMARK_TEMPLATE(BM_HashMap_InsertTraceStrings, FollyF14FastMap);
 BENCHMARK_TEMPLATE(BM_HashMap_TraceTids, Ours<TID_ARGS, LinearProbe>);
 BENCHMARK_TEMPLATE(BM_HashMap_TraceTids, Ours<TID_ARGS, QuadraticProbe>);
 BENCHMARK_TEMPLATE(BM_HashMap_TraceTids, Ours<TID_ARGS, QuadraticHalfProbe>);
+BENCHMARK_TEMPLATE(BM_HashMap_TraceTids, Ours<TID_ARGS, GroupProbe>);
 BENCHMARK_TEMPLATE(BM_HashMap_TraceTids, std::unordered_map<TID_ARGS>);
 #if defined(PERFETTO_HASH_MAP_COMPARE_THIRD_PARTY_LIBS)
 BENCHMARK_TEMPLATE(BM_HashMap_TraceTids, tsl::robin_map<TID_ARGS>);
@@ -341,6 +405,7 @@ BENCHMARK_TEMPLATE(BM_HashMap_TraceTids, folly::F14FastMap<TID_ARGS>);
 
 BENCHMARK_TEMPLATE(BM_HashMap_InsertRandInts, Ours_LinearProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_InsertRandInts, Ours_QuadProbing);
+BENCHMARK_TEMPLATE(BM_HashMap_InsertRandInts, Ours_GroupProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_InsertRandInts, StdUnorderedMap);
 #if defined(PERFETTO_HASH_MAP_COMPARE_THIRD_PARTY_LIBS)
 BENCHMARK_TEMPLATE(BM_HashMap_InsertRandInts, RobinMap);
@@ -350,6 +415,7 @@ BENCHMARK_TEMPLATE(BM_HashMap_InsertRandInts, FollyF14FastMap);
 
 BENCHMARK_TEMPLATE(BM_HashMap_InsertCollidingInts, Ours_LinearProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_InsertCollidingInts, Ours_QuadProbing);
+BENCHMARK_TEMPLATE(BM_HashMap_InsertCollidingInts, Ours_GroupProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_InsertCollidingInts, Ours_QuadCompProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_InsertCollidingInts, StdUnorderedMap);
 #if defined(PERFETTO_HASH_MAP_COMPARE_THIRD_PARTY_LIBS)
@@ -360,6 +426,7 @@ BENCHMARK_TEMPLATE(BM_HashMap_InsertCollidingInts, FollyF14FastMap);
 
 BENCHMARK_TEMPLATE(BM_HashMap_InsertDupeInts, Ours_LinearProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_InsertDupeInts, Ours_QuadProbing);
+BENCHMARK_TEMPLATE(BM_HashMap_InsertDupeInts, Ours_GroupProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_InsertDupeInts, Ours_QuadCompProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_InsertDupeInts, StdUnorderedMap);
 #if defined(PERFETTO_HASH_MAP_COMPARE_THIRD_PARTY_LIBS)
@@ -370,9 +437,31 @@ BENCHMARK_TEMPLATE(BM_HashMap_InsertDupeInts, FollyF14FastMap);
 
 BENCHMARK_TEMPLATE(BM_HashMap_LookupRandInts, Ours_LinearProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_LookupRandInts, Ours_QuadProbing);
+BENCHMARK_TEMPLATE(BM_HashMap_LookupRandInts, Ours_GroupProbing);
 BENCHMARK_TEMPLATE(BM_HashMap_LookupRandInts, StdUnorderedMap);
 #if defined(PERFETTO_HASH_MAP_COMPARE_THIRD_PARTY_LIBS)
 BENCHMARK_TEMPLATE(BM_HashMap_LookupRandInts, RobinMap);
 BENCHMARK_TEMPLATE(BM_HashMap_LookupRandInts, AbslFlatHashMap);
 BENCHMARK_TEMPLATE(BM_HashMap_LookupRandInts, FollyF14FastMap);
 #endif
+
+BENCHMARK_TEMPLATE(BM_HashMap_LookupTidLikeInts, Ours<TID_ARGS, LinearProbe>);
+BENCHMARK_TEMPLATE(BM_HashMap_LookupTidLikeInts,
+                   Ours<TID_ARGS, QuadraticProbe>);
+BENCHMARK_TEMPLATE(BM_HashMap_LookupTidLikeInts, Ours<TID_ARGS, GroupProbe>);
+BENCHMARK_TEMPLATE(BM_HashMap_LookupTidLikeInts, std::unordered_map<TID_ARGS>);
+#if defined(PERFETTO_HASH_MAP_COMPARE_THIRD_PARTY_LIBS)
+BENCHMARK_TEMPLATE(BM_HashMap_LookupTidLikeInts, tsl::robin_map<TID_ARGS>);
+BENCHMARK_TEMPLATE(BM_HashMap_LookupTidLikeInts, absl::flat_hash_map<TID_ARGS>);
+BENCHMARK_TEMPLATE(BM_HashMap_LookupTidLikeInts, folly::F14FastMap<TID_ARGS>);
+#endif
+
+BENCHMARK_TEMPLATE(BM_HashMap_LookupHighLoad, Ours_LinearProbing);
+BENCHMARK_TEMPLATE(BM_HashMap_LookupHighLoad, Ours_QuadProbing);
+BENCHMARK_TEMPLATE(BM_HashMap_LookupHighLoad, Ours_GroupProbing);
+BENCHMARK_TEMPLATE(BM_HashMap_LookupHighLoad, StdUnorderedMap);
+#if defined(PERFETTO_HASH_MAP_COMPARE_THIRD_PARTY_LIBS)
+BENCHMARK_TEMPLATE(BM_HashMap_LookupHighLoad, RobinMap);
+BENCHMARK_TEMPLATE(BM_HashMap_LookupHighLoad, AbslFlatHashMap);
+BENCHMARK_TEMPLATE(BM_HashMap_LookupHighLoad, FollyF14FastMap);
+#endif
@@ -41,7 +41,8 @@ class FlatHashMapTest : public testing::Test {
   using Probe = T;
 };
 
-using ProbeTypes = Types<LinearProbe, QuadraticHalfProbe, QuadraticProbe>;
+using ProbeTypes =
+    Types<LinearProbe, QuadraticHalfProbe, QuadraticProbe, GroupProbe>;
 TYPED_TEST_SUITE(FlatHashMapTest, ProbeTypes, /* trailing ',' for GCC*/);
 
 struct Key {
@@ -383,6 +384,18 @@ TYPED_TEST(FlatHashMapTest, VsUnorderedMap) {
   }
 }
 
+TEST(FlatHashMapGroupProbeTest, CapacityIsAtLeastOneGroup) {
+  FlatHashMap<int, int, base::AlreadyHashed<int>, GroupProbe> fmap(
+      /*initial_capacity=*/4, /*load_limit_pct=*/100);
+  ASSERT_EQ(fmap.capacity(), GroupProbe::kGroupSize);
+  for (int i = 0; i < static_cast<int>(GroupProbe::kGroupSize); i++)
+    ASSERT_TRUE(fmap.Insert(i, i).second);
+  EXPECT_EQ(fmap.capacity(), GroupProbe::kGroupSize);
+  for (int i = 0; i < static_cast<int>(GroupProbe::kGroupSize); i++)
+    ASSERT_EQ(*fmap.Find(i), i);
+  EXPECT_EQ(fmap.Find(100), nullptr);
+}
+
 }  // namespace
 }  // namespace base
 }  // namespace perfetto
@@ -18,6 +18,7 @@
 
 #include <initializer_list>
 #include <string>
+#include <vector>
 
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/unix_socket.h"
@@ -284,6 +285,64 @@ TEST_F(HttpServerTest, Websocket) {
   }
 }
 
+TEST_F(HttpServerTest, Websocket_BackToBackFrames) {
+  srv_.AddAllowedOrigin("http://websocket.com");
+  HttpCli cli(&task_runner_);
+  EXPECT_CALL(handler_, OnHttpRequest(_))
+      .WillOnce(Invoke(
+          [](const HttpRequest& req) { req.conn->UpgradeToWebsocket(req); }));
+  cli.SendHttpReq({
+      "GET /websocket HTTP/1.1",                      //
+      "Origin: http://websocket.com",                 //
+      "Connection: upgrade",                          //
+      "Upgrade: websocket",                           //
+      "Sec-WebSocket-Version: 13",                    //
+      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==",  //
+  });
+  cli.Recv(1);
+
+  // Masked binary frames of various sizes, including ones that use the 16-bit
+  // extended length, sent all at once so they are parsed from the same read.
+  std::vector<std::string> payloads;
+  std::string frames;
+  const char kMask[] = {'\x12', '\x34', '\x56', '\x78'};
+  for (size_t len : {1u, 12u, 125u, 300u, 1027u}) {
+    std::string payload;
+    for (size_t i = 0; i < len; i++)
+      payload.push_back(static_cast<char>('a' + (i + len) % 26));
+    frames.push_back('\x82');
+    if (len < 126) {
+      frames.push_back(static_cast<char>(0x80 | len));
+    } else {
+      frames.push_back('\xfe');
+      frames.push_back(static_cast<char>(len >> 8));
+      frames.push_back(static_cast<char>(len & 0xff));
+    }
+    frames.append(kMask, sizeof(kMask));
+    for (size_t i = 0; i < len; i++)
+      frames.push_back(payload[i] ^ kMask[i % sizeof(kMask)]);
+    payloads.push_back(std::move(payload));
+  }
+
+  std::vector<std::string> received;
+  auto checkpoint = task_runner_.CreateCheckpoint("all_frames");
+  EXPECT_CALL(handler_, OnWebsocketMessage(_))
+      .Times(static_cast<int>(payloads.size()))
+      .WillRepeatedly(Invoke([&](const WebsocketMessage& msg) {
+        EXPECT_FALSE(msg.is_text);
+        received.push_back(msg.data.ToStdString());
+        if (received.size() == payloads.size())
+          checkpoint();
+      }));
+  cli.sock.SendStr(frames);
+  task_runner_.RunUntilCheckpoint("all_frames");
+  EXPECT_EQ(received, payloads);
+
+  EXPECT_CALL(handler_, OnHttpConnectionClosed(_));
+  cli.sock.Shutdown();
+  task_runner_.RunUntilIdle();
+}
+
 TEST_F(HttpServerTest, Websocket_OriginNotAllowed) {
   srv_.AddAllowedOrigin("http://websocket.com");
   srv_.AddAllowedOrigin("http://notallowed.commando");
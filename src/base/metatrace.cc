@@ -52,6 +52,12 @@ struct Delegate {
 
 }  // namespace
 
+uint32_t GetCachedThreadId() {
+  thread_local static uint32_t thread_id =
+      static_cast<uint32_t>(base::GetThreadId());
+  return thread_id;
+}
+
 bool Enable(std::function<void()> read_task,
             base::TaskRunner* task_runner,
             uint32_t tags) {
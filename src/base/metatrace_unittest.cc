@@ -129,6 +129,29 @@ TEST_F(MetatraceTest, TagEnablingLogic) {
   }
 }
 
+TEST_F(MetatraceTest, RecordsThreadId) {
+  Enable(m::TAG_ANY);
+  m::TraceCounter(m::TAG_ANY, /*id=*/1, /*value=*/1);
+  uint32_t other_tid = 0;
+  std::thread thread([&other_tid] {
+    other_tid = static_cast<uint32_t>(base::GetThreadId());
+    { m::ScopedEvent evt(m::TAG_ANY, /*id=*/2); }
+  });
+  thread.join();
+  m::TraceCounter(m::TAG_ANY, /*id=*/3, /*value=*/3);
+
+  auto it = m::RingBuffer::GetReadIterator();
+  ASSERT_TRUE(it);
+  const auto main_tid = static_cast<uint32_t>(base::GetThreadId());
+  EXPECT_EQ(it->thread_id, main_tid);
+  ASSERT_TRUE(++it);
+  EXPECT_EQ(it->thread_id, other_tid);
+  EXPECT_NE(it->thread_id, main_tid);
+  ASSERT_TRUE(++it);
+  EXPECT_EQ(it->thread_id, main_tid);
+  EXPECT_FALSE(++it);
+}
+
 // Test that overruns are handled properly and that the writer re-synchronizes
 // after the reader catches up.
 TEST_F(MetatraceTest, HandleOverruns) {
@@ -19,6 +19,10 @@
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
 #include <Windows.h>
@@ -28,8 +32,18 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/container_annotations.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/utils.h"
 
+#if (PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+     PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)) && \
+    defined(MADV_HUGEPAGE)
+#define PERFETTO_HAS_THP() 1
+#else
+#define PERFETTO_HAS_THP() 0
+#endif
+
 namespace perfetto {
 namespace base {
 
@@ -48,6 +62,15 @@ size_t GuardSize() {
   return GetSysPageSize();
 }
 
+#if PERFETTO_HAS_THP()
+// The size of a PMD-mapped huge page: a page table page holds page_size / 8
+// entries, each mapping a page. That's 2MB with 4KB pages, 32MB with 16KB.
+size_t HugePageSize() {
+  const size_t page_size = GetSysPageSize();
+  return page_size * (page_size / sizeof(uint64_t));
+}
+#endif
+
 }  // namespace
 
 // static
@@ -62,12 +85,38 @@ PagedMemory PagedMemory::Allocate(size_t req_size, int flags) {
   PERFETTO_CHECK(ptr);
   char* usable_region = reinterpret_cast<char*>(ptr) + GuardSize();
 #else   // PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
-  void* ptr = mmap(nullptr, outer_size, PROT_READ | PROT_WRITE,
+  size_t align_slack = 0;
+#if PERFETTO_HAS_THP()
+  // Huge pages can only back huge page aligned ranges. Over-reserve by one
+  // huge page so the usable region can be aligned, then unmap the excess.
+  if ((flags & kHugePages) && rounded_up_size >= HugePageSize())
+    align_slack = HugePageSize();
+#endif
+  void* ptr = mmap(nullptr, outer_size + align_slack, PROT_READ | PROT_WRITE,
                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
   if (ptr == MAP_FAILED && (flags & kMayFail))
     return PagedMemory();
   PERFETTO_CHECK(ptr && ptr != MAP_FAILED);
   char* usable_region = reinterpret_cast<char*>(ptr) + GuardSize();
+#if PERFETTO_HAS_THP()
+  if (align_slack) {
+    const uintptr_t huge_page_mask = HugePageSize() - 1;
+    usable_region = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(usable_region) + huge_page_mask) &
+        ~huge_page_mask);
+    char* start = usable_region - GuardSize();
+    const size_t head = static_cast<size_t>(start - static_cast<char*>(ptr));
+    const size_t tail = align_slack - head;
+    if (head)
+      PERFETTO_CHECK(munmap(ptr, head) == 0);
+    if (tail)
+      PERFETTO_CHECK(munmap(start + outer_size, tail) == 0);
+    ptr = start;
+    // This fails with EINVAL if the kernel is built without THP. In that case,
+    // or if THP is disabled at runtime, the region keeps using regular pages.
+    madvise(usable_region, rounded_up_size, MADV_HUGEPAGE);
+  }
+#endif
   int res = mprotect(ptr, GuardSize(), PROT_NONE);
   res |= mprotect(usable_region + rounded_up_size, GuardSize(), PROT_NONE);
   PERFETTO_CHECK(res == 0);
@@ -136,6 +185,44 @@ bool PagedMemory::AdviseDontNeed(void* p, size_t size) {
         // PERFETTO_BUILDFLAG(PERFETTO_OS_NACL)
 }
 
+size_t PagedMemory::GetHugePageBytes() const {
+#if PERFETTO_HAS_THP()
+  if (!p_)
+    return 0;
+  std::string smaps;
+  if (!ReadFile("/proc/self/smaps", &smaps))
+    return 0;
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(p_);
+  const uintptr_t end = begin + RoundUpToSysPageSize(size_);
+  // Each mapping starts with a "7f12a0000000-7f12a0400000 rw-p ..." line and is
+  // followed by its counters, e.g. "AnonHugePages:      2048 kB".
+  static constexpr char kAnonHugePages[] = "AnonHugePages:";
+  static constexpr size_t kAnonHugePagesLen = sizeof(kAnonHugePages) - 1;
+  bool in_region = false;
+  size_t huge_kb = 0;
+  for (StringSplitter lines(std::move(smaps), '\n'); lines.Next();) {
+    const char* line = lines.cur_token();
+    if (strncmp(line, kAnonHugePages, kAnonHugePagesLen) == 0) {
+      if (in_region)
+        huge_kb += static_cast<size_t>(
+            strtoull(line + kAnonHugePagesLen, nullptr, 10));
+      continue;
+    }
+    char* sep = nullptr;
+    auto vma_begin = static_cast<uintptr_t>(strtoull(line, &sep, 16));
+    if (*sep != '-')
+      continue;
+    auto vma_end = static_cast<uintptr_t>(strtoull(sep + 1, &sep, 16));
+    if (*sep != ' ')
+      continue;
+    in_region = vma_begin < end && vma_end > begin;
+  }
+  return huge_kb * 1024;
+#else   // PERFETTO_HAS_THP()
+  return 0;
+#endif  // PERFETTO_HAS_THP()
+}
+
 #if TRACK_COMMITTED_SIZE()
 void PagedMemory::EnsureCommitted(size_t committed_size) {
   PERFETTO_DCHECK(committed_size > 0u);
@@ -17,6 +17,7 @@
 #include "perfetto/ext/base/paged_memory.h"
 
 #include <stdint.h>
+#include <string.h>
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/utils.h"
@@ -180,6 +181,40 @@ TEST(PagedMemoryTest, GuardRegions) {
   EXPECT_DEATH_IF_SUPPORTED({ raw[kSize] = 'x'; }, ".*");
 }
 
+TEST(PagedMemoryTest, HugePages) {
+  const size_t kHugePageSize = GetSysPageSize() * (GetSysPageSize() / 8);
+  const size_t kSize = kHugePageSize * 2;
+  PagedMemory mem = PagedMemory::Allocate(
+      kSize, PagedMemory::kHugePages | PagedMemory::kDontCommit);
+  ASSERT_TRUE(mem.IsValid());
+  mem.EnsureCommitted(kSize);
+  char* raw = reinterpret_cast<char*>(mem.Get());
+  for (size_t i = 0; i < kSize; i += GetSysPageSize())
+    raw[i] = 'x';
+
+  // THP might be disabled on the host, so huge pages can't be expected here.
+  EXPECT_LE(mem.GetHugePageBytes(), kSize);
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(raw) % kHugePageSize, 0u);
+#else
+  EXPECT_EQ(mem.GetHugePageBytes(), 0u);
+#endif
+
+  volatile char* guarded = raw;
+  EXPECT_DEATH_IF_SUPPORTED({ guarded[-1] = 'x'; }, ".*");
+  EXPECT_DEATH_IF_SUPPORTED({ guarded[kSize] = 'x'; }, ".*");
+}
+
+TEST(PagedMemoryTest, HugePagesSmallAllocation) {
+  // Allocations smaller than a huge page silently use regular pages.
+  PagedMemory mem = PagedMemory::Allocate(GetSysPageSize() * 3,
+                                          PagedMemory::kHugePages);
+  ASSERT_TRUE(mem.IsValid());
+  memset(mem.Get(), 'x', mem.size());
+  EXPECT_EQ(mem.GetHugePageBytes(), 0u);
+}
+
 // Disable this on:
 // MacOS: because it doesn't seem to have an equivalent rlimit to bound mmap().
 // Fuchsia: doesn't support rlimit.
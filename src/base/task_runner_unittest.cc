@@ -24,6 +24,7 @@
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/pipe.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/temp_file.h"
 #include "perfetto/ext/base/utils.h"
 #include "src/base/test/gtest_test_suite.h"
 #include "test/gtest_and_gmock.h"
@@ -384,6 +385,50 @@ TEST_F(TaskRunnerTest, FileDescriptorClosedEvent) {
   task_runner.Run();
 }
 
+// Regular files can't be watched with epoll on Linux, but poll(2) reports them
+// as always readable. The watch must behave the same on all platforms.
+TEST_F(TaskRunnerTest, RegularFileWatch) {
+  auto& task_runner = this->task_runner;
+  TempFile file = TempFile::Create();
+  int num_calls = 0;
+  task_runner.AddFileDescriptorWatch(file.fd(), [&] {
+    if (++num_calls == 3) {
+      task_runner.RemoveFileDescriptorWatch(file.fd());
+      task_runner.PostTask([&task_runner] { task_runner.Quit(); });
+    }
+  });
+  task_runner.Run();
+  EXPECT_EQ(num_calls, 3);
+}
+
+// Many fds, of which only a few are ready at any time.
+TEST_F(TaskRunnerTest, ManyFileDescriptorWatches) {
+  auto& task_runner = this->task_runner;
+  static constexpr size_t kNumPipes = 200;
+  std::vector<Pipe> pipes(kNumPipes);
+  std::vector<int> num_calls(kNumPipes);
+  size_t next = 0;
+  for (size_t i = 0; i < kNumPipes; i++) {
+    pipes[i] = Pipe::Create();
+    task_runner.AddFileDescriptorWatch(*pipes[i].rd, [&, i] {
+      char c;
+      PERFETTO_CHECK(read(*pipes[i].rd, &c, 1) == 1);
+      num_calls[i]++;
+      // Make the next pipe readable, in a pseudo-random order.
+      next = (next + 37) % kNumPipes;
+      if (next == 0) {
+        task_runner.Quit();
+        return;
+      }
+      PERFETTO_CHECK(write(*pipes[next].wr, "x", 1) == 1);
+    });
+  }
+  PERFETTO_CHECK(write(*pipes[0].wr, "x", 1) == 1);
+  task_runner.Run();
+  for (int calls : num_calls)
+    EXPECT_EQ(calls, 1);
+}
+
 #endif
 
 }  // namespace
@@ -22,8 +22,10 @@ namespace perfetto {
 namespace base {
 
 ThreadPool::ThreadPool(uint32_t thread_count) {
+  for (uint32_t i = 0; i < thread_count; ++i)
+    workers_.emplace_back(new Worker());
   for (uint32_t i = 0; i < thread_count; ++i) {
-    threads_.emplace_back(std::bind(&ThreadPool::RunThreadLoop, this));
+    threads_.emplace_back(std::bind(&ThreadPool::RunThreadLoop, this, i));
   }
 }
 
@@ -39,33 +41,52 @@ ThreadPool::~ThreadPool() {
 }
 
 void ThreadPool::PostTask(std::function<void()> fn) {
-  std::lock_guard<std::mutex> guard(mutex_);
-  pending_tasks_.emplace_back(std::move(fn));
+  // This pairs with RunThreadLoop(), which increments |thread_waiting_count_|
+  // before checking |pending_count_|: either this sees the thread waiting, or
+  // the thread sees the new task (both are sequentially consistent).
+  pending_count_++;
+  Worker& worker = *workers_[next_worker_++ % workers_.size()];
+  {
+    std::lock_guard<std::mutex> guard(worker.mutex);
+    worker.tasks.emplace_back(std::move(fn));
+  }
   if (thread_waiting_count_ == 0) {
     return;
   }
+  std::lock_guard<std::mutex> guard(mutex_);
   thread_waiter_.notify_one();
 }
 
-void ThreadPool::RunThreadLoop() {
+bool ThreadPool::TakeTask(size_t worker_index, std::function<void()>* task) {
+  // Start from the queue of this thread, then steal from the others.
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    Worker& worker = *workers_[(worker_index + i) % workers_.size()];
+    std::lock_guard<std::mutex> guard(worker.mutex);
+    if (worker.tasks.empty())
+      continue;
+    *task = std::move(worker.tasks.front());
+    worker.tasks.pop_front();
+    pending_count_--;
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::RunThreadLoop(size_t worker_index) {
   for (;;) {
+    if (quit_) {
+      return;
+    }
     std::function<void()> fn;
-    {
-      std::unique_lock<std::mutex> guard(mutex_);
-      if (quit_) {
-        return;
-      }
-      if (pending_tasks_.empty()) {
-        thread_waiting_count_++;
-        thread_waiter_.wait(
-            guard, [this]() { return quit_ || !pending_tasks_.empty(); });
-        thread_waiting_count_--;
-        continue;
-      }
-      fn = std::move(pending_tasks_.front());
-      pending_tasks_.pop_front();
+    if (TakeTask(worker_index, &fn)) {
+      fn();
+      continue;
     }
-    fn();
+    std::unique_lock<std::mutex> guard(mutex_);
+    thread_waiting_count_++;
+    thread_waiter_.wait(guard,
+                        [this]() { return quit_ || pending_count_ > 0; });
+    thread_waiting_count_--;
   }
 }
 
@@ -85,6 +85,37 @@ TEST(ThreadPoolTest, ParallelSecondFinishFirst) {
   ASSERT_TRUE(first.task_started);
 }
 
+// Tasks queued behind a long running task are stolen by the other threads.
+TEST(ThreadPoolTest, WorkStealing) {
+  base::ThreadPool pool(2);
+
+  ThreadLatch blocking;
+  pool.PostTask([&blocking] {
+    blocking.task_started = true;
+    blocking.notify.Notify();
+    blocking.wait.Wait();
+  });
+  blocking.notify.Wait();
+
+  std::mutex mu;
+  std::condition_variable cv;
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < 16; ++i) {
+    pool.PostTask([&mu, &count, &cv] {
+      std::lock_guard<std::mutex> guard(mu);
+      if (++count == 16) {
+        cv.notify_one();
+      }
+    });
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mu);
+    cv.wait(lock, [&count]() { return count == 16u; });
+  }
+  blocking.wait.Notify();
+}
+
 TEST(ThreadPoolTest, StressTest) {
   std::mutex mu;
   std::condition_variable cv;
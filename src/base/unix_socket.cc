@@ -368,11 +368,13 @@ UnixSocketRaw::UnixSocketRaw(ScopedSocketHandle fd,
   // There is no reason why a socket should outlive the process in case of
   // exec() by default, this is just working around a broken unix design.
   SetRetainOnExec(false);
+  is_blocking_ = (fcntl(*fd_, F_GETFL, 0) & O_NONBLOCK) == 0;
 #endif
 }
 
 void UnixSocketRaw::SetBlocking(bool is_blocking) {
   PERFETTO_DCHECK(fd_);
+  is_blocking_ = is_blocking;
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
   unsigned long flag = is_blocking ? 0 : 1;  // FIONBIO has reverse logic.
   if (is_blocking) {
@@ -484,6 +486,19 @@ ssize_t UnixSocketRaw::Send(const void* msg,
                 nullptr, 0);
 }
 
+ssize_t UnixSocketRaw::SendBlocking(const void* msg,
+                                    size_t len,
+                                    const int* send_fds,
+                                    size_t num_fds) {
+  const bool was_blocking = is_blocking_;
+  if (!was_blocking)
+    SetBlocking(true);
+  const ssize_t res = Send(msg, len, send_fds, num_fds);
+  if (!was_blocking)
+    SetBlocking(false);
+  return res;
+}
+
 ssize_t UnixSocketRaw::Receive(void* msg,
                                size_t len,
                                ScopedFile* /*fd_vec*/,
@@ -501,51 +516,61 @@ ssize_t UnixSocketRaw::Receive(void* msg,
 // https://elixir.bootlin.com/linux/v4.18.10/source/net/unix/af_unix.c#L1872
 // [2]: https://elixir.bootlin.com/linux/v4.18.10/source/net/core/sock.c#L2101
 ssize_t UnixSocketRaw::SendMsgAllPosix(struct msghdr* msg) {
+  return SendMsgAllPosix(msg, is_blocking_);
+}
+
+ssize_t UnixSocketRaw::SendMsgAllPosix(struct msghdr* msg, bool blocking) {
   // This does not make sense on non-blocking sockets.
   PERFETTO_DCHECK(fd_);
 
-  const bool is_blocking_with_timeout =
-      tx_timeout_ms_ > 0 && ((fcntl(*fd_, F_GETFL, 0) & O_NONBLOCK) == 0);
   const int64_t start_ms = GetWallTimeMs().count();
 
   // Waits until some space is available in the tx buffer.
   // Returns true if some buffer space is available, false if times out.
   auto poll_or_timeout = [&] {
-    PERFETTO_DCHECK(is_blocking_with_timeout);
-    const int64_t deadline = start_ms + tx_timeout_ms_;
-    const int64_t now_ms = GetWallTimeMs().count();
-    if (now_ms >= deadline)
-      return false;  // Timed out
-    const int timeout_ms = static_cast<int>(deadline - now_ms);
+    PERFETTO_DCHECK(blocking);
+    int timeout_ms = -1;
+    if (tx_timeout_ms_ > 0) {
+      const int64_t deadline = start_ms + tx_timeout_ms_;
+      const int64_t now_ms = GetWallTimeMs().count();
+      if (now_ms >= deadline)
+        return false;  // Timed out
+      timeout_ms = static_cast<int>(deadline - now_ms);
+    }
     pollfd pfd{*fd_, POLLOUT, 0};
     return PERFETTO_EINTR(poll(&pfd, 1, timeout_ms)) > 0;
   };
 
-// We implement blocking sends that require a timeout as non-blocking + poll.
-// This is because SO_SNDTIMEO doesn't work as expected (b/193234818). On linux
-// we can just pass MSG_DONTWAIT to force the send to be non-blocking. On Mac,
-// instead we need to flip the O_NONBLOCK flag back and forth.
+// We implement blocking sends as non-blocking + poll. This is because
+// SO_SNDTIMEO doesn't work as expected (b/193234818). On linux we can just pass
+// MSG_DONTWAIT to force the send to be non-blocking, regardless of O_NONBLOCK,
+// which also allows blocking sends on non-blocking sockets (see
+// SendBlocking()). On Mac, instead we need to flip the O_NONBLOCK flag back
+// and forth, and rely on the kernel blocking when there is no timeout.
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
   // MSG_NOSIGNAL is not supported on Mac OS X, but in that case the socket is
   // created with SO_NOSIGPIPE (See InitializeSocket()).
   int send_flags = 0;
+  const bool poll_when_full = blocking && tx_timeout_ms_ > 0;
+  PERFETTO_DCHECK(blocking == is_blocking_);
 
-  if (is_blocking_with_timeout)
+  if (poll_when_full)
     SetBlocking(false);
 
   auto reset_nonblock_on_exit = OnScopeExit([&] {
-    if (is_blocking_with_timeout)
+    if (poll_when_full)
       SetBlocking(true);
   });
 #else
-  int send_flags = MSG_NOSIGNAL | (is_blocking_with_timeout ? MSG_DONTWAIT : 0);
+  int send_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+  const bool poll_when_full = blocking;
 #endif
 
   ssize_t total_sent = 0;
   while (msg->msg_iov) {
     ssize_t send_res = PERFETTO_EINTR(sendmsg(*fd_, msg, send_flags));
     if (send_res == -1 && IsAgain(errno)) {
-      if (is_blocking_with_timeout && poll_or_timeout()) {
+      if (poll_when_full && poll_or_timeout()) {
         continue;  // Tx buffer unblocked, repeat the loop.
       }
       return total_sent;
@@ -566,6 +591,31 @@ ssize_t UnixSocketRaw::Send(const void* msg,
                             size_t len,
                             const int* send_fds,
                             size_t num_fds) {
+  return Send(msg, len, send_fds, num_fds, is_blocking_);
+}
+
+ssize_t UnixSocketRaw::SendBlocking(const void* msg,
+                                    size_t len,
+                                    const int* send_fds,
+                                    size_t num_fds) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_APPLE)
+  const bool was_blocking = is_blocking_;
+  if (!was_blocking)
+    SetBlocking(true);
+  const ssize_t res = Send(msg, len, send_fds, num_fds, /*blocking=*/true);
+  if (!was_blocking)
+    SetBlocking(false);
+  return res;
+#else
+  return Send(msg, len, send_fds, num_fds, /*blocking=*/true);
+#endif
+}
+
+ssize_t UnixSocketRaw::Send(const void* msg,
+                            size_t len,
+                            const int* send_fds,
+                            size_t num_fds,
+                            bool blocking) {
   PERFETTO_DCHECK(fd_);
   msghdr msg_hdr = {};
   iovec iov = {const_cast<void*>(msg), len};
@@ -590,7 +640,7 @@ ssize_t UnixSocketRaw::Send(const void* msg,
     // msg_hdr.msg_controllen would need to be adjusted, see "man 3 cmsg".
   }
 
-  return SendMsgAllPosix(&msg_hdr);
+  return SendMsgAllPosix(&msg_hdr, blocking);
 }
 
 ssize_t UnixSocketRaw::Receive(void* msg,
@@ -1072,9 +1122,7 @@ bool UnixSocket::Send(const void* msg,
     return false;
   }
 
-  sock_raw_.SetBlocking(true);
-  const ssize_t sz = sock_raw_.Send(msg, len, send_fds, num_fds);
-  sock_raw_.SetBlocking(false);
+  const ssize_t sz = sock_raw_.SendBlocking(msg, len, send_fds, num_fds);
 
   if (sz == static_cast<ssize_t>(len)) {
     return true;
@@ -1036,6 +1036,46 @@ TEST_F(UnixSocketTest, BlockingSendTimeout) {
   tx_thread.join();
 }
 
+// SendBlocking() waits for the tx buffer to drain also when the socket is in
+// non-blocking mode, and leaves it in non-blocking mode.
+TEST_F(UnixSocketTest, SendBlockingOnNonBlockingSocket) {
+  UnixSocketRaw send_sock;
+  UnixSocketRaw recv_sock;
+  std::tie(send_sock, recv_sock) =
+      UnixSocketRaw::CreatePairPosix(kTestSocket.family(), SockType::kStream);
+  send_sock.SetBlocking(false);
+
+  // Larger than the default socket buffers, so that the send has to wait for
+  // the reader several times.
+  std::string send_buf(4 * 1024 * 1024, '\0');
+  for (size_t i = 0; i < send_buf.size(); i++)
+    send_buf[i] = static_cast<char>(i * 7);
+  std::string recv_buf(send_buf.size(), '\0');
+
+  std::thread rx_thread([&recv_sock, &recv_buf] {
+    size_t offset = 0;
+    while (offset < recv_buf.size()) {
+      ssize_t rd = recv_sock.Receive(&recv_buf[offset],
+                                     recv_buf.size() - offset);
+      ASSERT_GT(rd, 0);
+      offset += static_cast<size_t>(rd);
+    }
+  });
+
+  EXPECT_EQ(send_sock.SendBlocking(send_buf.data(), send_buf.size()),
+            static_cast<ssize_t>(send_buf.size()));
+  rx_thread.join();
+  EXPECT_EQ(send_buf, recv_buf);
+  send_sock.DcheckIsBlocking(false);
+
+  // A plain Send() on the non-blocking socket doesn't wait.
+  ssize_t sent = 0;
+  while ((sent = send_sock.Send(send_buf.data(), send_buf.size())) ==
+         static_cast<ssize_t>(send_buf.size())) {
+  }
+  EXPECT_LT(sent, static_cast<ssize_t>(send_buf.size()));
+}
+
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_FUCHSIA)
 TEST_F(UnixSocketTest, SetsCloexec) {
   // CLOEXEC set when constructing sockets through helper:
@@ -37,7 +37,32 @@
 namespace perfetto {
 namespace base {
 
+namespace {
+
+#if PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
+// Max number of fd events handled per wake-up. More events are returned by
+// the next epoll_wait().
+constexpr size_t kMaxEpollEvents = 64;
+
+// The watched fds are registered as one-shot: once an fd has been reported,
+// epoll ignores it until its watch task has run and re-armed it. This mirrors
+// the negative fds in the poll(2) array on other platforms.
+bool UpdateEpollWatch(int epoll_fd, int op, int fd, bool one_shot) {
+  struct epoll_event event {};
+  event.events = EPOLLIN | EPOLLHUP | (one_shot ? EPOLLONESHOT : 0u);
+  event.data.fd = fd;
+  return epoll_ctl(epoll_fd, op, fd, &event) == 0;
+}
+#endif
+
+}  // namespace
+
 UnixTaskRunner::UnixTaskRunner() {
+#if PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
+  epoll_fd_.reset(epoll_create1(EPOLL_CLOEXEC));
+  PERFETTO_CHECK(epoll_fd_);
+  epoll_events_.resize(kMaxEpollEvents);
+#endif
   AddFileDescriptorWatch(event_.fd(), [] {
     // Not reached -- see PostFileDescriptorWatches().
     PERFETTO_DFATAL("Should be unreachable.");
@@ -77,6 +102,15 @@ void UnixTaskRunner::Run() {
     // WaitForSingleObject() for the one handle that WaitForMultipleObject()
     // returned.
     PostFileDescriptorWatches(ret);
+#elif PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
+    platform::BeforeMaybeBlockingSyscall();
+    int ret = PERFETTO_EINTR(epoll_wait(*epoll_fd_, &epoll_events_[0],
+                                        static_cast<int>(epoll_events_.size()),
+                                        poll_timeout_ms));
+    platform::AfterMaybeBlockingSyscall();
+    PERFETTO_CHECK(ret >= 0);
+    num_epoll_events_ = static_cast<size_t>(ret);
+    PostFileDescriptorWatches(0 /*ignored*/);
 #else
     platform::BeforeMaybeBlockingSyscall();
     int ret = PERFETTO_EINTR(poll(
@@ -110,6 +144,9 @@ bool UnixTaskRunner::IsIdleForTesting() {
 
 void UnixTaskRunner::UpdateWatchTasksLocked() {
   PERFETTO_DCHECK_THREAD(thread_checker_);
+#if PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
+  // Nothing to do, the epoll set is kept up to date by the fd watch methods.
+#else
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
   if (!watch_tasks_changed_)
     return;
@@ -127,6 +164,7 @@ void UnixTaskRunner::UpdateWatchTasksLocked() {
     poll_fds_.push_back({handle, POLLIN | POLLHUP, 0});
 #endif
   }
+#endif  // !PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
 }
 
 void UnixTaskRunner::RunImmediateAndDelayedTask() {
@@ -140,12 +178,10 @@ void UnixTaskRunner::RunImmediateAndDelayedTask() {
       immediate_task = std::move(immediate_tasks_.front());
       immediate_tasks_.pop_front();
     }
-    if (!delayed_tasks_.empty()) {
-      auto it = delayed_tasks_.begin();
-      if (now >= it->first) {
-        delayed_task = std::move(it->second);
-        delayed_tasks_.erase(it);
-      }
+    if (!delayed_tasks_.empty() && now >= delayed_tasks_.front().time) {
+      std::pop_heap(delayed_tasks_.begin(), delayed_tasks_.end());
+      delayed_task = std::move(delayed_tasks_.back().task);
+      delayed_tasks_.pop_back();
     }
   }
 
@@ -159,6 +195,20 @@ void UnixTaskRunner::RunImmediateAndDelayedTask() {
 
 void UnixTaskRunner::PostFileDescriptorWatches(uint64_t windows_wait_result) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
+#if PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
+  base::ignore_result(windows_wait_result);
+  for (size_t i = 0; i < num_epoll_events_; i++) {
+    const PlatformHandle handle = epoll_events_[i].data.fd;
+    if (handle == event_.fd()) {
+      event_.Clear();
+      continue;
+    }
+    // Also post the task for EPOLLERR alone: the one-shot fd stays disarmed
+    // until the task runs.
+    PostTask(std::bind(&UnixTaskRunner::RunFileDescriptorWatch, this, handle));
+  }
+  num_epoll_events_ = 0;
+#else
   for (size_t i = 0; i < poll_fds_.size(); i++) {
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
     const PlatformHandle handle = poll_fds_[i];
@@ -204,10 +254,12 @@ void UnixTaskRunner::PostFileDescriptorWatches(uint64_t windows_wait_result) {
     poll_fds_[i].fd = -poll_fds_[i].fd;
 #endif
   }
+#endif  // !PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
 }
 
 void UnixTaskRunner::RunFileDescriptorWatch(PlatformHandle fd) {
   std::function<void()> task;
+  bool repost = false;
   {
     std::lock_guard<std::mutex> lock(lock_);
     auto it = watch_tasks_.find(fd);
@@ -215,6 +267,16 @@ void UnixTaskRunner::RunFileDescriptorWatch(PlatformHandle fd) {
       return;
     WatchTask& watch_task = it->second;
 
+#if PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
+    // Make epoll report the fd again. This fails only if the fd has been
+    // closed without removing its watch first, which drops it from the epoll
+    // set (poll(2) would ignore it as well).
+    if (watch_task.always_ready) {
+      repost = true;
+    } else {
+      UpdateEpollWatch(*epoll_fd_, EPOLL_CTL_MOD, fd, /*one_shot=*/true);
+    }
+#else
     // Make poll(2) pay attention to the fd again. Since another thread may have
     // updated this watch we need to refresh the set first.
     UpdateWatchTasksLocked();
@@ -231,8 +293,11 @@ void UnixTaskRunner::RunFileDescriptorWatch(PlatformHandle fd) {
     PERFETTO_DCHECK(::abs(poll_fds_[fd_index].fd) == fd);
     poll_fds_[fd_index].fd = fd;
 #endif
+#endif  // !PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
     task = watch_task.callback;
   }
+  if (repost)
+    PostTask(std::bind(&UnixTaskRunner::RunFileDescriptorWatch, this, fd));
   errno = 0;
   RunTaskWithWatchdogGuard(task);
 }
@@ -242,7 +307,7 @@ int UnixTaskRunner::GetDelayMsToNextTaskLocked() const {
   if (!immediate_tasks_.empty())
     return 0;
   if (!delayed_tasks_.empty()) {
-    TimeMillis diff = delayed_tasks_.begin()->first - GetWallTimeMs();
+    TimeMillis diff = delayed_tasks_.front().time - GetWallTimeMs();
     return std::max(0, static_cast<int>(diff.count()));
   }
   return -1;
@@ -253,7 +318,7 @@ void UnixTaskRunner::PostTask(std::function<void()> task) {
   {
     std::lock_guard<std::mutex> lock(lock_);
     was_empty = immediate_tasks_.empty();
-    immediate_tasks_.push_back(std::move(task));
+    immediate_tasks_.emplace_back(std::move(task));
   }
   if (was_empty)
     WakeUp();
@@ -264,7 +329,9 @@ void UnixTaskRunner::PostDelayedTask(std::function<void()> task,
   TimeMillis runtime = GetWallTimeMs() + TimeMillis(delay_ms);
   {
     std::lock_guard<std::mutex> lock(lock_);
-    delayed_tasks_.insert(std::make_pair(runtime, std::move(task)));
+    delayed_tasks_.push_back(
+        DelayedTask{runtime, next_delayed_task_seq_++, std::move(task)});
+    std::push_heap(delayed_tasks_.begin(), delayed_tasks_.end());
   }
   WakeUp();
 }
@@ -272,6 +339,7 @@ void UnixTaskRunner::PostDelayedTask(std::function<void()> task,
 void UnixTaskRunner::AddFileDescriptorWatch(PlatformHandle fd,
                                             std::function<void()> task) {
   PERFETTO_DCHECK(PlatformHandleChecker::IsValid(fd));
+  bool always_ready = false;
   {
     std::lock_guard<std::mutex> lock(lock_);
     PERFETTO_DCHECK(!watch_tasks_.count(fd));
@@ -279,11 +347,21 @@ void UnixTaskRunner::AddFileDescriptorWatch(PlatformHandle fd,
     watch_task.callback = std::move(task);
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
     watch_task.pending = false;
+#elif PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
+    // The wake-up event is level-triggered, it's cleared by the Run() loop.
+    const bool one_shot = fd != event_.fd();
+    if (!UpdateEpollWatch(*epoll_fd_, EPOLL_CTL_ADD, fd, one_shot)) {
+      // EPERM means that the fd doesn't support epoll, e.g. a regular file.
+      PERFETTO_CHECK(errno == EPERM);
+      watch_task.always_ready = always_ready = true;
+    }
 #else
     watch_task.poll_fd_index = SIZE_MAX;
 #endif
     watch_tasks_changed_ = true;
   }
+  if (always_ready)
+    PostTask(std::bind(&UnixTaskRunner::RunFileDescriptorWatch, this, fd));
   WakeUp();
 }
 
@@ -291,7 +369,14 @@ void UnixTaskRunner::RemoveFileDescriptorWatch(PlatformHandle fd) {
   PERFETTO_DCHECK(PlatformHandleChecker::IsValid(fd));
   {
     std::lock_guard<std::mutex> lock(lock_);
-    PERFETTO_DCHECK(watch_tasks_.count(fd));
+    auto it = watch_tasks_.find(fd);
+    PERFETTO_DCHECK(it != watch_tasks_.end());
+#if PERFETTO_UNIX_TASK_RUNNER_USES_EPOLL
+    // The fd might have been closed already, in which case the kernel has
+    // already dropped it from the epoll set.
+    if (it != watch_tasks_.end() && !it->second.always_ready)
+      epoll_ctl(*epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#endif
     watch_tasks_.erase(fd);
     watch_tasks_changed_ = true;
   }
@@ -0,0 +1,54 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/ext/base/unix_task_runner.h"
+
+namespace {
+
+// Number of tasks posted in each iteration, before running them.
+constexpr int kNumTasks = 1000;
+
+}  // namespace
+
+static void BM_UnixTaskRunner_PostTask(benchmark::State& state) {
+  perfetto::base::UnixTaskRunner task_runner;
+  uint64_t counter = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < kNumTasks; i++)
+      task_runner.PostTask([&counter] { counter++; });
+    task_runner.PostTask([&task_runner] { task_runner.Quit(); });
+    task_runner.Run();
+  }
+  benchmark::DoNotOptimize(counter);
+  state.SetItemsProcessed(state.iterations() * kNumTasks);
+}
+BENCHMARK(BM_UnixTaskRunner_PostTask);
+
+static void BM_UnixTaskRunner_PostDelayedTask(benchmark::State& state) {
+  perfetto::base::UnixTaskRunner task_runner;
+  uint64_t counter = 0;
+  for (auto _ : state) {
+    // All the tasks are due straight away, but they still go through the
+    // delayed tasks queue.
+    for (int i = 0; i < kNumTasks; i++)
+      task_runner.PostDelayedTask([&counter] { counter++; }, 0);
+    task_runner.PostDelayedTask([&task_runner] { task_runner.Quit(); }, 0);
+    task_runner.Run();
+  }
+  benchmark::DoNotOptimize(counter);
+  state.SetItemsProcessed(state.iterations() * kNumTasks);
+}
+BENCHMARK(BM_UnixTaskRunner_PostDelayedTask);
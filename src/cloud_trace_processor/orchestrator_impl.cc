@@ -16,7 +16,9 @@
 
 #include "src/cloud_trace_processor/orchestrator_impl.h"
 
+#include <deque>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -30,6 +32,7 @@
 #include "protos/perfetto/cloud_trace_processor/common.pb.h"
 #include "protos/perfetto/cloud_trace_processor/orchestrator.pb.h"
 #include "protos/perfetto/cloud_trace_processor/worker.pb.h"
+#include "src/cloud_trace_processor/partial_aggregate_merger.h"
 #include "src/trace_processor/util/status_macros.h"
 
 namespace perfetto {
@@ -56,21 +59,75 @@ RpcResponseToPoolResponse(
   return ret;
 }
 
-base::StatusOrStream<protos::TracePoolShardSetTracesResponse>
-RoundRobinSetTraces(const std::vector<std::unique_ptr<Worker>>& workers,
-                    const std::vector<std::string>& traces) {
-  uint32_t worker_idx = 0;
-  std::vector<protos::TracePoolShardSetTracesArgs> protos;
-  protos.resize(workers.size());
-  for (const auto& trace : traces) {
-    protos[worker_idx].add_traces(trace);
-    worker_idx = (worker_idx + 1) % workers.size();
+// Number of traces each worker is asked to load at the same time. Parsing a
+// single trace is mostly sequential so this bounds how many threads of the
+// worker are kept busy loading the pool.
+constexpr uint32_t kMaxLoadsInFlightPerWorker = 4;
+
+using SetTracesResponse = protos::TracePoolShardSetTracesResponse;
+
+// Traces of a TracePoolSetTraces call which have not yet been sent to a
+// worker. Shared by all the streams created by |DispatchSetTraces|.
+struct PendingTraces {
+  std::string pool_id;
+  std::deque<std::string> traces;
+};
+
+// Loads traces from |pending| on |worker| one at a time, taking the next
+// trace from the shared queue only after the previous one finished loading.
+//
+// Because traces are only handed out when a worker has capacity, workers
+// which are given large traces (or which are slower or more loaded) end up
+// loading fewer of them, while the others pick up the remaining ones.
+class PullTracesStreamImpl
+    : public base::StreamPollable<base::StatusOr<SetTracesResponse>> {
+ public:
+  PullTracesStreamImpl(Worker* worker, std::shared_ptr<PendingTraces> pending)
+      : worker_(worker), pending_(std::move(pending)) {}
+
+  base::StreamPollResult<base::StatusOr<SetTracesResponse>> PollNext(
+      base::PollContext* ctx) override {
+    for (;;) {
+      if (!inflight_) {
+        if (pending_->traces.empty()) {
+          return base::DonePollResult();
+        }
+        protos::TracePoolShardSetTracesArgs args;
+        args.set_pool_id(pending_->pool_id);
+        args.add_traces(std::move(pending_->traces.front()));
+        pending_->traces.pop_front();
+        inflight_ = worker_->TracePoolShardSetTraces(args);
+      }
+      ASSIGN_OR_RETURN_IF_PENDING_STREAM(res, inflight_->PollNext(ctx));
+      if (!res.IsDone()) {
+        return res.item();
+      }
+      inflight_ = std::nullopt;
+    }
   }
 
-  using ShardResponse = protos::TracePoolShardSetTracesResponse;
-  std::vector<base::StatusOrStream<ShardResponse>> streams;
-  for (uint32_t i = 0; i < protos.size(); ++i) {
-    streams.emplace_back(workers[i]->TracePoolShardSetTraces(protos[i]));
+ private:
+  Worker* worker_;
+  std::shared_ptr<PendingTraces> pending_;
+  std::optional<base::StatusOrStream<SetTracesResponse>> inflight_;
+};
+
+// Distributes |traces| across |workers|, handing out each trace to the first
+// worker with a free load slot rather than statically partitioning them.
+base::StatusOrStream<SetTracesResponse> DispatchSetTraces(
+    const std::vector<std::unique_ptr<Worker>>& workers,
+    const std::string& pool_id,
+    const std::vector<std::string>& traces) {
+  auto pending = std::make_shared<PendingTraces>();
+  pending->pool_id = pool_id;
+  pending->traces.assign(traces.begin(), traces.end());
+
+  std::vector<base::StatusOrStream<SetTracesResponse>> streams;
+  for (uint32_t slot = 0; slot < kMaxLoadsInFlightPerWorker; ++slot) {
+    for (const auto& worker : workers) {
+      streams.emplace_back(
+          base::MakeStream<PullTracesStreamImpl>(worker.get(), pending));
+    }
   }
   return base::FlattenStreams(std::move(streams));
 }
@@ -118,9 +175,9 @@ OrchestratorImpl::TracePoolCreate(const protos::TracePoolCreateArgs& args) {
       .MapFuture(&CreateResponseToStatus)
       .Collect(base::AllOkCollector())
       .ContinueWith(
-          [this, id](base::StatusOr<ShardResponse> resp)
+          [this, id](base::Status status)
               -> base::StatusOrFuture<protos::TracePoolCreateResponse> {
-            RETURN_IF_ERROR(resp.status());
+            RETURN_IF_ERROR(status);
             auto it_and_inserted = pools_.Insert(id, TracePool());
             if (!it_and_inserted.second) {
               return base::ErrStatus("Unable to insert pool %s", id.c_str());
@@ -143,7 +200,7 @@ OrchestratorImpl::TracePoolSetTraces(
         "Incrementally adding/removing items to pool not currently supported"));
   }
   pool->loaded_traces.assign(args.traces().begin(), args.traces().end());
-  return RoundRobinSetTraces(workers_, pool->loaded_traces)
+  return DispatchSetTraces(workers_, id, pool->loaded_traces)
       .MapFuture(&SetTracesResponseToStatus)
       .Collect(base::AllOkCollector())
       .ContinueWith(
@@ -170,8 +227,18 @@ OrchestratorImpl::TracePoolQuery(const protos::TracePoolQueryArgs& args) {
   for (uint32_t i = 0; i < workers_.size(); ++i) {
     streams.emplace_back(workers_[i]->TracePoolShardQuery(shard_args));
   }
-  return base::FlattenStreams(std::move(streams))
-      .MapFuture(&RpcResponseToPoolResponse);
+  auto responses = base::FlattenStreams(std::move(streams));
+  if (args.merge_columns_size() == 0)
+    return std::move(responses).MapFuture(&RpcResponseToPoolResponse);
+
+  // Fold the rows of all the traces into a single response while they are
+  // streamed back, rather than forwarding each of them to the client.
+  using PoolResponse = base::StatusOr<protos::TracePoolQueryResponse>;
+  std::unique_ptr<base::Collector<base::StatusOr<ShardResponse>, PoolResponse>>
+      merger(new PartialAggregateMerger(
+          {args.merge_columns().begin(), args.merge_columns().end()}));
+  return base::StreamFromFuture(
+      std::move(responses).Collect(std::move(merger)));
 }
 
 base::StatusOrFuture<protos::TracePoolDestroyResponse>
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/cloud_trace_processor/partial_aggregate_merger.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "perfetto/base/logging.h"
+#include "src/trace_processor/util/status_macros.h"
+
+namespace perfetto {
+namespace cloud_trace_processor {
+namespace {
+
+using CellsBatch = protos::QueryResult::CellsBatch;
+using MergeColumn = protos::TracePoolQueryArgs::MergeColumn;
+
+bool IsNumeric(CellsBatch::CellType type) {
+  return type == CellsBatch::CELL_VARINT || type == CellsBatch::CELL_FLOAT64;
+}
+
+// Orders cells of different types like SQLite does: numbers sort before
+// strings, which sort before blobs.
+int TypeRank(CellsBatch::CellType type) {
+  switch (type) {
+    case CellsBatch::CELL_VARINT:
+    case CellsBatch::CELL_FLOAT64:
+      return 1;
+    case CellsBatch::CELL_STRING:
+      return 2;
+    case CellsBatch::CELL_BLOB:
+      return 3;
+    case CellsBatch::CELL_NULL:
+    case CellsBatch::CELL_INVALID:
+      break;
+  }
+  return 0;
+}
+
+template <typename T>
+void AppendPod(std::string* out, T value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}  // namespace
+
+PartialAggregateMerger::PartialAggregateMerger(
+    std::vector<MergeColumn> merge_columns)
+    : merge_columns_(std::move(merge_columns)) {}
+
+PartialAggregateMerger::~PartialAggregateMerger() = default;
+
+base::Status PartialAggregateMerger::AddResult(
+    const protos::QueryResult& result) {
+  if (!result.error().empty())
+    return base::ErrStatus("%s", result.error().c_str());
+
+  // Only the first result for each trace contains the column names.
+  if (result.column_names_size() > 0)
+    RETURN_IF_ERROR(SetColumns(result));
+  if (result.batch_size() > 0 && column_names_.empty())
+    return base::ErrStatus("Received rows before the column names");
+
+  for (const auto& batch : result.batch())
+    RETURN_IF_ERROR(AddBatch(batch));
+  return base::OkStatus();
+}
+
+base::Status PartialAggregateMerger::SetColumns(
+    const protos::QueryResult& result) {
+  std::vector<std::string> names(result.column_names().begin(),
+                                 result.column_names().end());
+  if (!column_names_.empty()) {
+    if (names != column_names_)
+      return base::ErrStatus("Traces returned different columns");
+    return base::OkStatus();
+  }
+
+  std::vector<MergeOp> ops(names.size(), MergeColumn::MERGE_OP_UNSPECIFIED);
+  for (const MergeColumn& merge_column : merge_columns_) {
+    if (merge_column.op() == MergeColumn::MERGE_OP_UNSPECIFIED) {
+      return base::ErrStatus("No merge op specified for column %s",
+                             merge_column.column_name().c_str());
+    }
+    auto it = std::find(names.begin(), names.end(), merge_column.column_name());
+    if (it == names.end()) {
+      return base::ErrStatus("Merge column %s not found in the query result",
+                             merge_column.column_name().c_str());
+    }
+    ops[static_cast<size_t>(it - names.begin())] = merge_column.op();
+  }
+  column_names_ = std::move(names);
+  ops_ = std::move(ops);
+  return base::OkStatus();
+}
+
+base::Status PartialAggregateMerger::AddBatch(const CellsBatch& batch) {
+  const size_t num_cols = column_names_.size();
+  const auto num_cells = static_cast<size_t>(batch.cells_size());
+  if (num_cells % num_cols != 0)
+    return base::ErrStatus("Batch doesn't contain whole rows");
+
+  const std::string& strings = batch.string_cells();
+  int varint_idx = 0;
+  int float64_idx = 0;
+  int blob_idx = 0;
+  size_t string_off = 0;
+  for (size_t row_start = 0; row_start < num_cells; row_start += num_cols) {
+    Row row(num_cols);
+    for (size_t col = 0; col < num_cols; col++) {
+      Cell& cell = row[col];
+      cell.type = batch.cells(static_cast<int>(row_start + col));
+      switch (cell.type) {
+        case CellsBatch::CELL_NULL:
+          break;
+        case CellsBatch::CELL_VARINT:
+          if (varint_idx >= batch.varint_cells_size())
+            return base::ErrStatus("Truncated varint cells");
+          cell.long_value = batch.varint_cells(varint_idx++);
+          break;
+        case CellsBatch::CELL_FLOAT64:
+          if (float64_idx >= batch.float64_cells_size())
+            return base::ErrStatus("Truncated float64 cells");
+          cell.double_value = batch.float64_cells(float64_idx++);
+          break;
+        case CellsBatch::CELL_STRING: {
+          size_t end = strings.find('\0', string_off);
+          if (end == std::string::npos)
+            return base::ErrStatus("Truncated string cells");
+          cell.bytes_value = strings.substr(string_off, end - string_off);
+          string_off = end + 1;
+          break;
+        }
+        case CellsBatch::CELL_BLOB:
+          if (blob_idx >= batch.blob_cells_size())
+            return base::ErrStatus("Truncated blob cells");
+          cell.bytes_value = batch.blob_cells(blob_idx++);
+          break;
+        case CellsBatch::CELL_INVALID:
+          return base::ErrStatus("Invalid cell type");
+      }
+    }
+    RETURN_IF_ERROR(AddRow(std::move(row)));
+  }
+  return base::OkStatus();
+}
+
+base::Status PartialAggregateMerger::AddRow(Row row) {
+  std::string key;
+  for (size_t col = 0; col < row.size(); col++) {
+    if (ops_[col] != MergeColumn::MERGE_OP_UNSPECIFIED)
+      continue;
+    const Cell& cell = row[col];
+    key.push_back(static_cast<char>(cell.type));
+    if (cell.type == CellsBatch::CELL_VARINT) {
+      AppendPod(&key, cell.long_value);
+    } else if (cell.type == CellsBatch::CELL_FLOAT64) {
+      AppendPod(&key, cell.double_value);
+    } else if (cell.type != CellsBatch::CELL_NULL) {
+      AppendPod(&key, cell.bytes_value.size());
+      key.append(cell.bytes_value);
+    }
+  }
+
+  auto it_and_inserted = row_by_key_.Insert(std::move(key), rows_.size());
+  if (it_and_inserted.second) {
+    rows_.emplace_back(std::move(row));
+    return base::OkStatus();
+  }
+
+  auto as_double = [](const Cell& c) {
+    return c.type == CellsBatch::CELL_VARINT ? static_cast<double>(c.long_value)
+                                             : c.double_value;
+  };
+  Row& merged = rows_[*it_and_inserted.first];
+  for (size_t col = 0; col < row.size(); col++) {
+    const MergeOp op = ops_[col];
+    Cell& in = row[col];
+    Cell& acc = merged[col];
+    if (op == MergeColumn::MERGE_OP_UNSPECIFIED ||
+        in.type == CellsBatch::CELL_NULL) {
+      continue;
+    }
+    if (acc.type == CellsBatch::CELL_NULL) {
+      acc = std::move(in);
+      continue;
+    }
+
+    if (op == MergeColumn::MERGE_OP_SUM) {
+      if (!IsNumeric(in.type) || !IsNumeric(acc.type)) {
+        return base::ErrStatus("Cannot SUM non-numeric values of column %s",
+                               column_names_[col].c_str());
+      }
+      constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+      constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+      const int64_t a = acc.long_value;
+      const int64_t b = in.long_value;
+      const bool both_varint = in.type == CellsBatch::CELL_VARINT &&
+                               acc.type == CellsBatch::CELL_VARINT;
+      if (both_varint && !(b > 0 && a > kMax - b) && !(b < 0 && a < kMin - b)) {
+        acc.long_value = a + b;
+        continue;
+      }
+      // Like SQLite's SUM(), fall back to floating point on overflow.
+      acc.double_value = as_double(acc) + as_double(in);
+      acc.type = CellsBatch::CELL_FLOAT64;
+      continue;
+    }
+
+    // MIN or MAX.
+    int cmp = TypeRank(in.type) - TypeRank(acc.type);
+    if (cmp == 0 && in.type == CellsBatch::CELL_VARINT &&
+        acc.type == CellsBatch::CELL_VARINT) {
+      cmp = (in.long_value > acc.long_value) - (in.long_value < acc.long_value);
+    } else if (cmp == 0 && IsNumeric(in.type)) {
+      double in_d = as_double(in);
+      double acc_d = as_double(acc);
+      cmp = (in_d > acc_d) - (in_d < acc_d);
+    } else if (cmp == 0) {
+      cmp = in.bytes_value.compare(acc.bytes_value);
+    }
+    if (op == MergeColumn::MERGE_OP_MIN ? cmp < 0 : cmp > 0)
+      acc = std::move(in);
+  }
+  return base::OkStatus();
+}
+
+protos::QueryResult PartialAggregateMerger::BuildResult() const {
+  protos::QueryResult result;
+  for (const std::string& name : column_names_)
+    result.add_column_names(name);
+  CellsBatch* batch = result.add_batch();
+  std::string strings;
+  for (const Row& row : rows_) {
+    for (const Cell& cell : row) {
+      batch->add_cells(cell.type);
+      switch (cell.type) {
+        case CellsBatch::CELL_VARINT:
+          batch->add_varint_cells(cell.long_value);
+          break;
+        case CellsBatch::CELL_FLOAT64:
+          batch->add_float64_cells(cell.double_value);
+          break;
+        case CellsBatch::CELL_STRING:
+          strings.append(cell.bytes_value);
+          strings.push_back('\0');
+          break;
+        case CellsBatch::CELL_BLOB:
+          batch->add_blob_cells(cell.bytes_value);
+          break;
+        case CellsBatch::CELL_NULL:
+        case CellsBatch::CELL_INVALID:
+          break;
+      }
+    }
+  }
+  batch->set_string_cells(std::move(strings));
+  batch->set_is_last_batch(true);
+  return result;
+}
+
+std::optional<base::StatusOr<protos::TracePoolQueryResponse>>
+PartialAggregateMerger::OnNext(
+    base::StatusOr<protos::TracePoolShardQueryResponse> resp) {
+  using StatusOrResponse = base::StatusOr<protos::TracePoolQueryResponse>;
+  if (!resp.ok())
+    return StatusOrResponse(resp.status());
+  base::Status status = AddResult(resp->result());
+  if (!status.ok()) {
+    return StatusOrResponse(base::ErrStatus("Query on %s failed: %s",
+                                            resp->trace().c_str(),
+                                            status.c_message()));
+  }
+  return std::nullopt;
+}
+
+base::StatusOr<protos::TracePoolQueryResponse>
+PartialAggregateMerger::OnDone() {
+  protos::TracePoolQueryResponse resp;
+  *resp.mutable_result() = BuildResult();
+  return resp;
+}
+
+}  // namespace cloud_trace_processor
+}  // namespace perfetto
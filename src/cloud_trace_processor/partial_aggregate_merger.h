@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_CLOUD_TRACE_PROCESSOR_PARTIAL_AGGREGATE_MERGER_H_
+#define SRC_CLOUD_TRACE_PROCESSOR_PARTIAL_AGGREGATE_MERGER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/status.h"
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/status_or.h"
+#include "perfetto/ext/base/threading/stream_combinators.h"
+#include "protos/perfetto/cloud_trace_processor/orchestrator.pb.h"
+#include "protos/perfetto/cloud_trace_processor/worker.pb.h"
+#include "protos/perfetto/trace_processor/trace_processor.pb.h"
+
+namespace perfetto {
+namespace cloud_trace_processor {
+
+// Merges the rows returned by all the traces of a TracePoolQuery into a
+// single result, for queries which specify |merge_columns| (see
+// orchestrator.proto).
+//
+// Rows are merged as they stream in from the workers, so the memory and CPU
+// used by the orchestrator is proportional to the number of distinct groups
+// rather than to the number of rows returned by the traces.
+class PartialAggregateMerger
+    : public base::Collector<
+          base::StatusOr<protos::TracePoolShardQueryResponse>,
+          base::StatusOr<protos::TracePoolQueryResponse>> {
+ public:
+  using MergeColumn = protos::TracePoolQueryArgs::MergeColumn;
+
+  explicit PartialAggregateMerger(std::vector<MergeColumn> merge_columns);
+  ~PartialAggregateMerger() override;
+
+  // Merges all the rows in |result| into the rows seen so far. Fails if the
+  // result has an error, if its columns are different from the ones of
+  // previous results or if a column can't be merged.
+  base::Status AddResult(const protos::QueryResult& result);
+
+  // Returns all the merged rows in a single batch, in the order in which each
+  // group was first seen.
+  protos::QueryResult BuildResult() const;
+
+  // base::Collector implementation.
+  std::optional<base::StatusOr<protos::TracePoolQueryResponse>> OnNext(
+      base::StatusOr<protos::TracePoolShardQueryResponse>) override;
+  base::StatusOr<protos::TracePoolQueryResponse> OnDone() override;
+
+ private:
+  using CellType = protos::QueryResult::CellsBatch::CellType;
+  using MergeOp = MergeColumn::MergeOp;
+
+  struct Cell {
+    CellType type = protos::QueryResult::CellsBatch::CELL_NULL;
+    int64_t long_value = 0;
+    double double_value = 0;
+    std::string bytes_value;  // For both CELL_STRING and CELL_BLOB.
+  };
+  using Row = std::vector<Cell>;
+
+  base::Status SetColumns(const protos::QueryResult&);
+  base::Status AddBatch(const protos::QueryResult::CellsBatch&);
+  base::Status AddRow(Row);
+
+  std::vector<MergeColumn> merge_columns_;
+
+  // Set by the first result seen. |ops_| contains the merge operation for
+  // each column, MERGE_OP_UNSPECIFIED for the columns which form the key.
+  std::vector<std::string> column_names_;
+  std::vector<MergeOp> ops_;
+
+  std::vector<Row> rows_;
+  base::FlatHashMap<std::string, size_t> row_by_key_;
+};
+
+}  // namespace cloud_trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_CLOUD_TRACE_PROCESSOR_PARTIAL_AGGREGATE_MERGER_H_
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/cloud_trace_processor/partial_aggregate_merger.h"
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/status.h"
+#include "protos/perfetto/cloud_trace_processor/orchestrator.pb.h"
+#include "protos/perfetto/trace_processor/trace_processor.pb.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace cloud_trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+using CellsBatch = protos::QueryResult::CellsBatch;
+using MergeColumn = protos::TracePoolQueryArgs::MergeColumn;
+
+MergeColumn Merge(const std::string& name, MergeColumn::MergeOp op) {
+  MergeColumn col;
+  col.set_column_name(name);
+  col.set_op(op);
+  return col;
+}
+
+void AddLong(CellsBatch* batch, int64_t value) {
+  batch->add_cells(CellsBatch::CELL_VARINT);
+  batch->add_varint_cells(value);
+}
+
+void AddDouble(CellsBatch* batch, double value) {
+  batch->add_cells(CellsBatch::CELL_FLOAT64);
+  batch->add_float64_cells(value);
+}
+
+void AddString(CellsBatch* batch, const std::string& value) {
+  batch->add_cells(CellsBatch::CELL_STRING);
+  batch->mutable_string_cells()->append(value).push_back('\0');
+}
+
+void AddNull(CellsBatch* batch) {
+  batch->add_cells(CellsBatch::CELL_NULL);
+}
+
+protos::QueryResult WithColumns(std::vector<std::string> names) {
+  protos::QueryResult result;
+  for (const std::string& name : names)
+    result.add_column_names(name);
+  return result;
+}
+
+// Renders each row of |result| as comma separated values.
+std::vector<std::string> ToRows(const protos::QueryResult& result) {
+  std::vector<std::string> rows;
+  const auto num_cols = static_cast<size_t>(result.column_names_size());
+  for (const CellsBatch& batch : result.batch()) {
+    int varint_idx = 0;
+    int float64_idx = 0;
+    size_t string_off = 0;
+    std::string row;
+    for (int i = 0; i < batch.cells_size(); i++) {
+      if (!row.empty())
+        row += ",";
+      switch (batch.cells(i)) {
+        case CellsBatch::CELL_VARINT:
+          row += std::to_string(batch.varint_cells(varint_idx++));
+          break;
+        case CellsBatch::CELL_FLOAT64:
+          row += "f" + std::to_string(batch.float64_cells(float64_idx++));
+          break;
+        case CellsBatch::CELL_STRING: {
+          size_t end = batch.string_cells().find('\0', string_off);
+          row += batch.string_cells().substr(string_off, end - string_off);
+          string_off = end + 1;
+          break;
+        }
+        default:
+          row += "null";
+          break;
+      }
+      if (static_cast<size_t>(i + 1) % num_cols == 0) {
+        rows.push_back(row);
+        row.clear();
+      }
+    }
+  }
+  return rows;
+}
+
+TEST(PartialAggregateMergerTest, MergesRowsWithSameKey) {
+  PartialAggregateMerger merger({Merge("cnt", MergeColumn::MERGE_OP_SUM),
+                                 Merge("min_dur", MergeColumn::MERGE_OP_MIN),
+                                 Merge("max_dur", MergeColumn::MERGE_OP_MAX)});
+
+  protos::QueryResult trace_a =
+      WithColumns({"name", "cnt", "min_dur", "max_dur"});
+  CellsBatch* batch = trace_a.add_batch();
+  AddString(batch, "foo");
+  AddLong(batch, 3);
+  AddLong(batch, 10);
+  AddLong(batch, 50);
+  AddString(batch, "bar");
+  AddLong(batch, 1);
+  AddLong(batch, 7);
+  AddLong(batch, 7);
+  ASSERT_TRUE(merger.AddResult(trace_a).ok());
+
+  protos::QueryResult trace_b =
+      WithColumns({"name", "cnt", "min_dur", "max_dur"});
+  batch = trace_b.add_batch();
+  AddString(batch, "baz");
+  AddLong(batch, 2);
+  AddNull(batch);
+  AddNull(batch);
+  AddString(batch, "foo");
+  AddLong(batch, 4);
+  AddLong(batch, 5);
+  AddLong(batch, 20);
+  ASSERT_TRUE(merger.AddResult(trace_b).ok());
+
+  // Later results of a trace don't repeat the column names.
+  protos::QueryResult trace_b_more;
+  batch = trace_b_more.add_batch();
+  AddString(batch, "baz");
+  AddLong(batch, 1);
+  AddLong(batch, 100);
+  AddLong(batch, 200);
+  ASSERT_TRUE(merger.AddResult(trace_b_more).ok());
+
+  protos::QueryResult result = merger.BuildResult();
+  EXPECT_THAT(result.column_names(),
+              ElementsAre("name", "cnt", "min_dur", "max_dur"));
+  ASSERT_EQ(result.batch_size(), 1);
+  EXPECT_TRUE(result.batch(0).is_last_batch());
+  EXPECT_THAT(ToRows(result),
+              ElementsAre("foo,7,5,50", "bar,1,7,7", "baz,3,100,200"));
+}
+
+TEST(PartialAggregateMergerTest, MultiColumnKey) {
+  PartialAggregateMerger merger({Merge("dur", MergeColumn::MERGE_OP_SUM)});
+  protos::QueryResult trace = WithColumns({"cpu", "state", "dur"});
+  CellsBatch* batch = trace.add_batch();
+  for (int i = 0; i < 2; i++) {
+    AddLong(batch, 0);
+    AddString(batch, "R");
+    AddLong(batch, 10);
+    AddLong(batch, 0);
+    AddString(batch, "S");
+    AddLong(batch, 20);
+    AddLong(batch, 1);
+    AddString(batch, "R");
+    AddLong(batch, 30);
+    AddNull(batch);
+    AddString(batch, "R");
+    AddLong(batch, 40);
+  }
+  ASSERT_TRUE(merger.AddResult(trace).ok());
+  EXPECT_THAT(ToRows(merger.BuildResult()),
+              ElementsAre("0,R,20", "0,S,40", "1,R,60", "null,R,80"));
+}
+
+TEST(PartialAggregateMergerTest, SumMixedAndOverflowingValues) {
+  PartialAggregateMerger merger({Merge("a", MergeColumn::MERGE_OP_SUM),
+                                 Merge("b", MergeColumn::MERGE_OP_SUM)});
+  protos::QueryResult trace = WithColumns({"a", "b"});
+  CellsBatch* batch = trace.add_batch();
+  AddLong(batch, 1);
+  AddLong(batch, std::numeric_limits<int64_t>::max());
+  AddDouble(batch, 0.5);
+  AddLong(batch, 1);
+  ASSERT_TRUE(merger.AddResult(trace).ok());
+  EXPECT_THAT(ToRows(merger.BuildResult()),
+              ElementsAre("f1.500000,f9223372036854775808.000000"));
+}
+
+TEST(PartialAggregateMergerTest, Errors) {
+  {
+    PartialAggregateMerger merger({Merge("cnt", MergeColumn::MERGE_OP_SUM)});
+    base::Status status = merger.AddResult(WithColumns({"name", "count"}));
+    EXPECT_THAT(status.message(), HasSubstr("cnt not found"));
+  }
+  {
+    PartialAggregateMerger merger({Merge("cnt", MergeColumn::MERGE_OP_SUM)});
+    ASSERT_TRUE(merger.AddResult(WithColumns({"name", "cnt"})).ok());
+    base::Status status = merger.AddResult(WithColumns({"cnt", "name"}));
+    EXPECT_THAT(status.message(), HasSubstr("different columns"));
+  }
+  {
+    PartialAggregateMerger merger({Merge("cnt", MergeColumn::MERGE_OP_SUM)});
+    protos::QueryResult result;
+    result.set_error("no such table: foo");
+    EXPECT_THAT(merger.AddResult(result).message(),
+                HasSubstr("no such table"));
+  }
+  {
+    PartialAggregateMerger merger({Merge("cnt", MergeColumn::MERGE_OP_SUM)});
+    protos::QueryResult result = WithColumns({"cnt"});
+    AddString(result.add_batch(), "a");
+    AddString(result.mutable_batch(0), "b");
+    EXPECT_THAT(merger.AddResult(result).message(), HasSubstr("non-numeric"));
+  }
+}
+
+TEST(PartialAggregateMergerTest, CollectorStopsOnFirstError) {
+  PartialAggregateMerger merger({Merge("cnt", MergeColumn::MERGE_OP_SUM)});
+  protos::TracePoolShardQueryResponse ok;
+  ok.set_trace("ok_trace");
+  *ok.mutable_result() = WithColumns({"cnt"});
+  AddLong(ok.mutable_result()->add_batch(), 1);
+  EXPECT_FALSE(merger.OnNext(ok).has_value());
+
+  protos::TracePoolShardQueryResponse failed;
+  failed.set_trace("bad_trace");
+  failed.mutable_result()->set_error("boom");
+  auto res = merger.OnNext(failed);
+  ASSERT_TRUE(res.has_value());
+  ASSERT_FALSE(res->ok());
+  EXPECT_THAT(res->status().message(), HasSubstr("bad_trace"));
+
+  auto done = merger.OnDone();
+  ASSERT_TRUE(done.ok());
+  EXPECT_FALSE(done->has_trace());
+  EXPECT_THAT(ToRows(done->result()), ElementsAre("1"));
+}
+
+}  // namespace
+}  // namespace cloud_trace_processor
+}  // namespace perfetto
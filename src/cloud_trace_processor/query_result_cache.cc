@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/cloud_trace_processor/query_result_cache.h"
+
+#include <iterator>
+#include <utility>
+
+namespace perfetto {
+namespace cloud_trace_processor {
+namespace {
+
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Collapses runs of whitespace outside of quoted literals into a single space
+// and drops leading/trailing whitespace and semicolons, so that queries which
+// differ only in formatting share a cache entry.
+std::string NormalizeSql(const std::string& sql) {
+  std::string out;
+  out.reserve(sql.size());
+  char quote = 0;
+  bool pending_space = false;
+  for (char c : sql) {
+    if (quote) {
+      out.push_back(c);
+      if (c == quote)
+        quote = 0;
+      continue;
+    }
+    if (IsSpace(c)) {
+      pending_space = !out.empty();
+      continue;
+    }
+    if (pending_space) {
+      out.push_back(' ');
+      pending_space = false;
+    }
+    if (c == '\'' || c == '"')
+      quote = c;
+    out.push_back(c);
+  }
+  while (!quote && !out.empty() && (out.back() == ';' || out.back() == ' '))
+    out.pop_back();
+  return out;
+}
+
+std::string MakeKey(const std::string& trace, const std::string& sql) {
+  std::string key = trace;
+  key.push_back('\0');
+  key.append(NormalizeSql(sql));
+  return key;
+}
+
+}  // namespace
+
+QueryResultCache::QueryResultCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+QueryResultCache::~QueryResultCache() = default;
+
+const QueryResultCache::Responses* QueryResultCache::Find(
+    const std::string& trace,
+    const std::string& sql) {
+  EntryList::iterator* it = entries_by_key_.Find(MakeKey(trace, sql));
+  if (!it)
+    return nullptr;
+  entries_.splice(entries_.begin(), entries_, *it);
+  return &(*it)->responses;
+}
+
+void QueryResultCache::Insert(const std::string& trace,
+                              const std::string& sql,
+                              Responses responses) {
+  size_t size_bytes = 0;
+  for (const auto& response : responses)
+    size_bytes += response.ByteSizeLong();
+  if (size_bytes > max_bytes_)
+    return;
+
+  std::string key = MakeKey(trace, sql);
+  if (EntryList::iterator* existing = entries_by_key_.Find(key))
+    Erase(*existing);
+  while (size_bytes_ + size_bytes > max_bytes_)
+    Erase(std::prev(entries_.end()));
+
+  entries_.push_front(Entry{key, trace, std::move(responses), size_bytes});
+  entries_by_key_.Insert(std::move(key), entries_.begin());
+  size_bytes_ += size_bytes;
+}
+
+void QueryResultCache::InvalidateTrace(const std::string& trace) {
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    auto next = std::next(it);
+    if (it->trace == trace)
+      Erase(it);
+    it = next;
+  }
+}
+
+void QueryResultCache::Erase(EntryList::iterator it) {
+  size_bytes_ -= it->size_bytes;
+  entries_by_key_.Erase(it->key);
+  entries_.erase(it);
+}
+
+}  // namespace cloud_trace_processor
+}  // namespace perfetto
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_CLOUD_TRACE_PROCESSOR_QUERY_RESULT_CACHE_H_
+#define SRC_CLOUD_TRACE_PROCESSOR_QUERY_RESULT_CACHE_H_
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "protos/perfetto/cloud_trace_processor/worker.pb.h"
+
+namespace perfetto {
+namespace cloud_trace_processor {
+
+// Caches the responses of queries on a trace so that running the same query
+// again on the same trace doesn't need to go through TraceProcessor.
+//
+// Entries are keyed on the trace path and the query, after collapsing
+// whitespace. The cache only lives in the memory of a worker so the version
+// of TraceProcessor (and of its stdlib) is the same for all the entries.
+//
+// Entries are evicted in least recently used order once the total size of
+// the cached responses goes over |max_bytes|. Not thread safe: must only be
+// used from the thread polling the worker's futures.
+class QueryResultCache {
+ public:
+  using Responses = std::vector<protos::TracePoolShardQueryResponse>;
+
+  explicit QueryResultCache(size_t max_bytes);
+  ~QueryResultCache();
+
+  // Returns the cached responses for |sql| on |trace| or nullptr if there are
+  // none. The returned pointer is invalidated by any other call on the cache.
+  const Responses* Find(const std::string& trace, const std::string& sql);
+
+  // Caches |responses| for |sql| on |trace|, evicting the least recently used
+  // entries if needed. Responses larger than the whole budget are not cached.
+  void Insert(const std::string& trace,
+              const std::string& sql,
+              Responses responses);
+
+  // Removes all the entries for |trace|. Must be called whenever the trace is
+  // (re)loaded.
+  void InvalidateTrace(const std::string& trace);
+
+  size_t max_bytes() const { return max_bytes_; }
+  size_t size_bytes() const { return size_bytes_; }
+  size_t entry_count() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    std::string key;
+    std::string trace;
+    Responses responses;
+    size_t size_bytes = 0;
+  };
+  using EntryList = std::list<Entry>;
+
+  void Erase(EntryList::iterator);
+
+  const size_t max_bytes_;
+  size_t size_bytes_ = 0;
+
+  // Most recently used entries are at the front.
+  EntryList entries_;
+  base::FlatHashMap<std::string, EntryList::iterator> entries_by_key_;
+};
+
+}  // namespace cloud_trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_CLOUD_TRACE_PROCESSOR_QUERY_RESULT_CACHE_H_
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/cloud_trace_processor/query_result_cache.h"
+
+#include <string>
+
+#include "protos/perfetto/cloud_trace_processor/worker.pb.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace cloud_trace_processor {
+namespace {
+
+// Returns a single response whose serialized size is roughly |size| bytes.
+QueryResultCache::Responses ResponsesOfSize(const std::string& trace,
+                                            size_t size) {
+  protos::TracePoolShardQueryResponse resp;
+  resp.set_trace(trace);
+  resp.mutable_result()->add_batch()->set_string_cells(std::string(size, 'x'));
+  return {resp};
+}
+
+TEST(QueryResultCacheTest, FindAfterInsert) {
+  QueryResultCache cache(1024);
+  EXPECT_EQ(cache.Find("a", "SELECT 1"), nullptr);
+
+  cache.Insert("a", "SELECT 1", ResponsesOfSize("a", 10));
+  const auto* responses = cache.Find("a", "SELECT 1");
+  ASSERT_NE(responses, nullptr);
+  ASSERT_EQ(responses->size(), 1u);
+  EXPECT_EQ((*responses)[0].trace(), "a");
+
+  EXPECT_EQ(cache.Find("b", "SELECT 1"), nullptr);
+  EXPECT_EQ(cache.Find("a", "SELECT 2"), nullptr);
+}
+
+TEST(QueryResultCacheTest, NormalizesWhitespace) {
+  QueryResultCache cache(1024);
+  cache.Insert("a", "SELECT ts\n  FROM slice;", ResponsesOfSize("a", 10));
+  EXPECT_NE(cache.Find("a", "  SELECT ts FROM\tslice  "), nullptr);
+  EXPECT_EQ(cache.Find("a", "SELECT tsFROM slice"), nullptr);
+
+  // Whitespace inside literals is significant.
+  cache.Insert("a", "SELECT 'a  b'", ResponsesOfSize("a", 10));
+  EXPECT_NE(cache.Find("a", "SELECT  'a  b'"), nullptr);
+  EXPECT_EQ(cache.Find("a", "SELECT 'a b'"), nullptr);
+}
+
+TEST(QueryResultCacheTest, EvictsLeastRecentlyUsed) {
+  QueryResultCache cache(1000);
+  cache.Insert("a", "q1", ResponsesOfSize("a", 400));
+  cache.Insert("a", "q2", ResponsesOfSize("a", 400));
+  ASSERT_EQ(cache.entry_count(), 2u);
+
+  // Touching q1 makes q2 the least recently used entry.
+  ASSERT_NE(cache.Find("a", "q1"), nullptr);
+  cache.Insert("a", "q3", ResponsesOfSize("a", 400));
+  EXPECT_EQ(cache.entry_count(), 2u);
+  EXPECT_LE(cache.size_bytes(), 1000u);
+  EXPECT_NE(cache.Find("a", "q1"), nullptr);
+  EXPECT_EQ(cache.Find("a", "q2"), nullptr);
+  EXPECT_NE(cache.Find("a", "q3"), nullptr);
+
+  // Results larger than the whole budget are never cached.
+  cache.Insert("a", "q4", ResponsesOfSize("a", 2000));
+  EXPECT_EQ(cache.Find("a", "q4"), nullptr);
+  EXPECT_EQ(cache.entry_count(), 2u);
+}
+
+TEST(QueryResultCacheTest, InvalidateTrace) {
+  QueryResultCache cache(1024);
+  cache.Insert("a", "q1", ResponsesOfSize("a", 10));
+  cache.Insert("a", "q2", ResponsesOfSize("a", 10));
+  cache.Insert("b", "q1", ResponsesOfSize("b", 10));
+
+  cache.InvalidateTrace("a");
+  EXPECT_EQ(cache.Find("a", "q1"), nullptr);
+  EXPECT_EQ(cache.Find("a", "q2"), nullptr);
+  EXPECT_NE(cache.Find("b", "q1"), nullptr);
+  EXPECT_EQ(cache.entry_count(), 1u);
+}
+
+}  // namespace
+}  // namespace cloud_trace_processor
+}  // namespace perfetto
@@ -17,6 +17,7 @@
 #include "src/cloud_trace_processor/trace_processor_wrapper.h"
 
 #include <atomic>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -101,35 +102,147 @@ struct QueryRunner {
   bool has_more = true;
 };
 
+// Parses the chunks of |file_stream| in order, one at a time, on the thread
+// pool. While a chunk is being parsed, up to |max_read_ahead| further chunks
+// are pulled from |file_stream|: this overlaps fetching the trace (e.g. from
+// remote storage) with parsing it instead of serializing the two.
+class ParseChunksImpl : public base::FuturePollable<base::Status> {
+ public:
+  ParseChunksImpl(base::StatusOrStream<std::vector<uint8_t>> file_stream,
+                  base::ThreadPool* thread_pool,
+                  std::shared_ptr<TraceProcessor> tp,
+                  uint32_t max_read_ahead)
+      : file_stream_(std::move(file_stream)),
+        thread_pool_(thread_pool),
+        tp_(std::move(tp)),
+        max_read_ahead_(max_read_ahead) {}
+
+  base::FuturePollResult<base::Status> Poll(base::PollContext* ctx) override {
+    for (;;) {
+      if (!parse_ && !chunks_.empty()) {
+        parse_ = base::RunOnceOnThreadPool<base::Status>(
+            thread_pool_, [chunk = std::move(chunks_.front()), tp = tp_] {
+              return tp->Parse(TraceBlobView(
+                  TraceBlob::CopyFrom(chunk.data(), chunk.size())));
+            });
+        chunks_.pop_front();
+      }
+      while (file_stream_ && chunks_.size() < max_read_ahead_ + !parse_) {
+        auto res = file_stream_->PollNext(ctx);
+        if (res.IsPending()) {
+          break;
+        }
+        if (res.IsDone()) {
+          file_stream_ = std::nullopt;
+          break;
+        }
+        RETURN_IF_ERROR(res.item().status());
+        chunks_.emplace_back(std::move(*res.item()));
+      }
+      if (!parse_) {
+        if (!chunks_.empty()) {
+          continue;
+        }
+        // Either the file stream is pending (and registered interest in
+        // |ctx|) or all the chunks have been parsed.
+        if (file_stream_) {
+          return base::PendingPollResult();
+        }
+        return base::OkStatus();
+      }
+      ASSIGN_OR_RETURN_IF_PENDING_FUTURE(status, parse_->Poll(ctx));
+      parse_ = std::nullopt;
+      RETURN_IF_ERROR(status);
+    }
+  }
+
+ private:
+  std::optional<base::StatusOrStream<std::vector<uint8_t>>> file_stream_;
+  base::ThreadPool* thread_pool_ = nullptr;
+  std::shared_ptr<TraceProcessor> tp_;
+  const uint32_t max_read_ahead_;
+
+  std::deque<std::vector<uint8_t>> chunks_;
+  std::optional<base::StatusFuture> parse_;
+};
+
+// Forwards the responses of |stream| and adds them to |cache| once the stream
+// completes. Queries which fail, or whose responses don't fit in the cache,
+// are not cached.
+class CacheResponsesImpl
+    : public base::StreamPollable<
+          base::StatusOr<protos::TracePoolShardQueryResponse>> {
+ public:
+  using StatusOrResponse = base::StatusOr<protos::TracePoolShardQueryResponse>;
+
+  CacheResponsesImpl(base::StatusOrStream<protos::TracePoolShardQueryResponse>
+                         stream,
+                     QueryResultCache* cache,
+                     std::string trace_path,
+                     std::string query)
+      : stream_(std::move(stream)),
+        cache_(cache),
+        trace_path_(std::move(trace_path)),
+        query_(std::move(query)) {}
+
+  base::StreamPollResult<StatusOrResponse> PollNext(
+      base::PollContext* ctx) override {
+    ASSIGN_OR_RETURN_IF_PENDING_STREAM(res, stream_.PollNext(ctx));
+    if (res.IsDone()) {
+      if (cacheable_) {
+        cache_->Insert(trace_path_, query_, std::move(responses_));
+        cacheable_ = false;
+      }
+      return base::DonePollResult();
+    }
+    const StatusOrResponse& resp = res.item();
+    if (cacheable_ && resp.ok() && !resp->result().has_error()) {
+      size_bytes_ += resp->ByteSizeLong();
+      responses_.emplace_back(*resp);
+    }
+    if (!resp.ok() || resp->result().has_error() ||
+        size_bytes_ > cache_->max_bytes()) {
+      cacheable_ = false;
+      responses_.clear();
+    }
+    return res;
+  }
+
+ private:
+  base::StatusOrStream<protos::TracePoolShardQueryResponse> stream_;
+  QueryResultCache* cache_ = nullptr;
+  std::string trace_path_;
+  std::string query_;
+
+  bool cacheable_ = true;
+  size_t size_bytes_ = 0;
+  QueryResultCache::Responses responses_;
+};
+
 }  // namespace
 
 TraceProcessorWrapper::TraceProcessorWrapper(std::string trace_path,
                                              base::ThreadPool* thread_pool,
-                                             Statefulness statefulness)
+                                             Statefulness statefulness,
+                                             QueryResultCache* cache)
     : trace_path_(std::move(trace_path)),
       thread_pool_(thread_pool),
-      statefulness_(statefulness) {
+      statefulness_(statefulness),
+      cache_(cache) {
   trace_processor::Config config;
   config.ingest_ftrace_in_raw_table = false;
   trace_processor_ = TraceProcessor::CreateInstance(config);
 }
 
 base::StatusFuture TraceProcessorWrapper::LoadTrace(
-    base::StatusOrStream<std::vector<uint8_t>> file_stream) {
+    base::StatusOrStream<std::vector<uint8_t>> file_stream,
+    uint32_t max_read_ahead_chunks) {
   if (trace_processor_.use_count() != 1) {
     return base::ErrStatus("Request is already in flight");
   }
-  return std::move(file_stream)
-      .MapFuture(
-          [this](base::StatusOr<std::vector<uint8_t>> d) -> base::StatusFuture {
-            RETURN_IF_ERROR(d.status());
-            return base::RunOnceOnThreadPool<base::Status>(
-                thread_pool_, [res = std::move(*d), tp = trace_processor_] {
-                  return tp->Parse(TraceBlobView(
-                      TraceBlob::CopyFrom(res.data(), res.size())));
-                });
-          })
-      .Collect(base::AllOkCollector())
+  return base::MakeFuture<ParseChunksImpl>(std::move(file_stream),
+                                           thread_pool_, trace_processor_,
+                                           max_read_ahead_chunks)
       .ContinueWith([this](base::Status status) -> base::StatusFuture {
         RETURN_IF_ERROR(status);
         return base::RunOnceOnThreadPool<base::Status>(
@@ -147,9 +260,24 @@ TraceProcessorWrapper::Query(const std::string& query) {
     return base::StreamOf<StatusOrResponse>(
         base::ErrStatus("Request is already in flight"));
   }
-  return base::RunOnThreadPool<StatusOrResponse>(
+  // Queries on a stateless instance always run against the same tables so
+  // their results only depend on the trace and the query.
+  QueryResultCache* cache =
+      statefulness_ == Statefulness::kStateless ? cache_ : nullptr;
+  if (cache) {
+    if (const auto* responses = cache->Find(trace_path_, query)) {
+      return base::StreamFrom(
+          std::vector<StatusOrResponse>(responses->begin(), responses->end()));
+    }
+  }
+  auto stream = base::RunOnThreadPool<StatusOrResponse>(
       thread_pool_,
       QueryRunner(trace_processor_, query, trace_path_, statefulness_));
+  if (!cache) {
+    return stream;
+  }
+  return base::MakeStream<CacheResponsesImpl>(std::move(stream), cache,
+                                              trace_path_, query);
 }
 
 }  // namespace cloud_trace_processor
@@ -17,10 +17,16 @@
 #ifndef SRC_CLOUD_TRACE_PROCESSOR_TRACE_PROCESSOR_WRAPPER_H_
 #define SRC_CLOUD_TRACE_PROCESSOR_TRACE_PROCESSOR_WRAPPER_H_
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "perfetto/ext/base/threading/future.h"
 #include "perfetto/ext/base/threading/stream.h"
 #include "perfetto/ext/base/threading/thread_pool.h"
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/cloud_trace_processor/query_result_cache.h"
 #include "src/trace_processor/rpc/query_result_serializer.h"
 
 namespace perfetto {
@@ -48,19 +54,32 @@ class TraceProcessorWrapper {
     kStateful,
   };
 
+  // If |cache| is not null, the results of queries on a kStateless instance
+  // are looked up in and added to it. |cache| must outlive this object and
+  // any stream returned by Query().
   TraceProcessorWrapper(std::string trace_path,
                         base::ThreadPool*,
-                        Statefulness);
+                        Statefulness,
+                        QueryResultCache* cache = nullptr);
+
+  // Number of chunks of a trace which are read ahead of the chunk being
+  // parsed by default.
+  static constexpr uint32_t kDefaultMaxReadAheadChunks = 4;
 
-  // Loads the trace given a stream of chunks to parse.
+  // Loads the trace given a stream of chunks to parse. Up to
+  // |max_read_ahead_chunks| chunks are pulled from |file_stream| while the
+  // previous chunk is being parsed.
   base::StatusFuture LoadTrace(
-      base::StatusOrStream<std::vector<uint8_t>> file_stream);
+      base::StatusOrStream<std::vector<uint8_t>> file_stream,
+      uint32_t max_read_ahead_chunks = kDefaultMaxReadAheadChunks);
 
   // Executes the given query on the trace processor and returns the results
   // as a stream.
   base::StatusOrStream<protos::TracePoolShardQueryResponse> Query(
       const std::string& sql);
 
+  const std::string& trace_path() const { return trace_path_; }
+
  private:
   using TraceProcessor = trace_processor::TraceProcessor;
 
@@ -73,6 +92,7 @@ class TraceProcessorWrapper {
   const std::string trace_path_;
   base::ThreadPool* thread_pool_ = nullptr;
   const Statefulness statefulness_ = Statefulness::kStateless;
+  QueryResultCache* const cache_ = nullptr;
   std::shared_ptr<TraceProcessor> trace_processor_;
 };
 
@@ -16,6 +16,7 @@
 
 #include "src/cloud_trace_processor/trace_processor_wrapper.h"
 #include <cstdint>
+#include <future>
 #include <vector>
 
 #include "perfetto/base/flat_set.h"
@@ -200,6 +201,37 @@ TEST(TraceProcessorWrapperUnittest, Chunked) {
   }
 }
 
+TEST(TraceProcessorWrapperUnittest, ReadAhead) {
+  // Keep the only thread of the pool busy so that parsing the first chunk
+  // can't complete until the test allows it.
+  base::ThreadPool pool(1);
+  std::promise<void> unblock;
+  pool.PostTask([blocked = unblock.get_future().share()] { blocked.wait(); });
+
+  TraceProcessorWrapper wrapper("foobar", &pool, SF::kStateless);
+  uint32_t pulled = 0;
+  auto count_pulled = [&pulled](base::StatusOr<std::vector<uint8_t>> chunk)
+      -> base::StatusOrFuture<std::vector<uint8_t>> {
+    pulled++;
+    return chunk;
+  };
+  auto chunks = base::StreamFrom(SimpleSystraceChunked());
+  auto load = wrapper.LoadTrace(std::move(chunks).MapFuture(count_pulled), 1);
+  {
+    base::FlatSet<base::PlatformHandle> ready;
+    base::FlatSet<base::PlatformHandle> interested;
+    base::PollContext ctx(&interested, &ready);
+    ASSERT_TRUE(load.Poll(&ctx).IsPending());
+  }
+  // The first chunk is queued for parsing and one more was read ahead.
+  ASSERT_EQ(pulled, 2u);
+
+  unblock.set_value();
+  base::Status status = WaitForFutureReady(load);
+  ASSERT_TRUE(status.ok()) << status.message();
+  ASSERT_EQ(pulled, 3u);
+}
+
 }  // namespace
 }  // namespace cloud_trace_processor
 }  // namespace perfetto
@@ -70,8 +70,11 @@ WorkerImpl::TracePoolShardSetTraces(
   for (const std::string& trace : args.traces()) {
     // TODO(lalitm): add support for stateful trace processor in dedicated
     // pools.
+    // The trace might have changed since it was last loaded.
+    query_result_cache_.InvalidateTrace(trace);
     auto tp = std::make_unique<TraceProcessorWrapper>(
-        trace, thread_pool_, TraceProcessorWrapper::Statefulness::kStateless);
+        trace, thread_pool_, TraceProcessorWrapper::Statefulness::kStateless,
+        &query_result_cache_);
     auto load_trace_future =
         tp->LoadTrace(environment_->ReadFile(trace))
             .ContinueWith(
@@ -107,10 +110,15 @@ WorkerImpl::TracePoolShardQuery(const protos::TracePoolShardQueryArgs& args) {
 base::StatusOrFuture<protos::TracePoolShardDestroyResponse>
 WorkerImpl::TracePoolShardDestroy(
     const protos::TracePoolShardDestroyArgs& args) {
-  if (!shards_.Erase(args.pool_id())) {
+  TracePoolShard* shard = shards_.Find(args.pool_id());
+  if (!shard) {
     return base::ErrStatus("Unable to find shard for pool %s",
                            args.pool_id().c_str());
   }
+  for (const auto& tp : shard->tps) {
+    query_result_cache_.InvalidateTrace(tp->trace_path());
+  }
+  shards_.Erase(args.pool_id());
   return base::StatusOr(protos::TracePoolShardDestroyResponse());
 }
 
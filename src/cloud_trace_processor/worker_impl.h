@@ -23,6 +23,7 @@
 #include "perfetto/ext/base/threading/thread_pool.h"
 #include "perfetto/ext/cloud_trace_processor/environment.h"
 #include "perfetto/ext/cloud_trace_processor/worker.h"
+#include "src/cloud_trace_processor/query_result_cache.h"
 #include "src/cloud_trace_processor/trace_processor_wrapper.h"
 
 namespace perfetto {
@@ -53,11 +54,16 @@ class WorkerImpl : public Worker {
   TracePoolShardDestroy(const protos::TracePoolShardDestroyArgs&) override;
 
  private:
+  // Memory budget for the results of queries cached across all the traces
+  // loaded on this worker.
+  static constexpr size_t kQueryResultCacheBytes = 256 * 1024 * 1024;
+
   struct TracePoolShard {
     std::vector<std::unique_ptr<TraceProcessorWrapper>> tps;
   };
   CtpEnvironment* const environment_;
   base::ThreadPool* const thread_pool_;
+  QueryResultCache query_result_cache_{kQueryResultCacheBytes};
   base::FlatHashMap<std::string, TracePoolShard> shards_;
 };
 
@@ -23,6 +23,7 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/utils.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
 
 #include "protos/perfetto/ipc/wire_protocol.gen.h"
 
@@ -173,12 +174,17 @@ void BufferedFrameDeserializer::DecodeFrame(const char* data, size_t size) {
 
 // static
 std::string BufferedFrameDeserializer::Serialize(const Frame& frame) {
-  std::vector<uint8_t> payload = frame.SerializeAsArray();
-  const uint32_t payload_size = static_cast<uint32_t>(payload.size());
+  // Append the payload straight after the header, rather than going through
+  // Frame::SerializeAsArray() and copying it. Replies carrying trace data can
+  // be large.
+  protozero::HeapBuffered<protozero::Message> payload;
+  frame.Serialize(payload.get());
+  const uint32_t payload_size = payload->Finalize();
   std::string buf;
-  buf.resize(kHeaderSize + payload_size);
+  buf.resize(kHeaderSize);
   memcpy(&buf[0], base::AssumeLittleEndian(&payload_size), kHeaderSize);
-  memcpy(&buf[kHeaderSize], payload.data(), payload.size());
+  payload.AppendSerializedTo(&buf);
+  PERFETTO_DCHECK(buf.size() == kHeaderSize + payload_size);
   return buf;
 }
 
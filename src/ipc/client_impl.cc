@@ -208,8 +208,9 @@ void ClientImpl::OnDisconnect(base::UnixSocket*) {
 
 void ClientImpl::OnDataAvailable(base::UnixSocket*) {
   size_t rsize;
+  BufferedFrameDeserializer::ReceiveBuffer buf{};
   do {
-    auto buf = frame_deserializer_.BeginReceive();
+    buf = frame_deserializer_.BeginReceive();
     base::ScopedFile fd;
     rsize = sock_->Receive(buf.data, buf.size, &fd);
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
@@ -227,7 +228,8 @@ void ClientImpl::OnDataAvailable(base::UnixSocket*) {
       return sock_->Shutdown(true);  // In turn will trigger an OnDisconnect().
       // TODO(fmayer): check this.
     }
-  } while (rsize > 0);
+    // See HostImpl::OnDataAvailable() for why short reads end the loop.
+  } while (rsize == buf.size);
 
   while (std::unique_ptr<Frame> frame = frame_deserializer_.PopNextFrame())
     OnFrameReceived(*frame);
@@ -183,8 +183,9 @@ void HostImpl::OnDataAvailable(base::UnixSocket* sock) {
   auto scoped_key = g_crash_key_uid.SetScoped(static_cast<int64_t>(peer_uid));
 
   size_t rsize;
+  BufferedFrameDeserializer::ReceiveBuffer buf{};
   do {
-    auto buf = frame_deserializer.BeginReceive();
+    buf = frame_deserializer.BeginReceive();
     base::ScopedFile fd;
     rsize = client->sock->Receive(buf.data, buf.size, &fd);
     if (fd) {
@@ -193,7 +194,11 @@ void HostImpl::OnDataAvailable(base::UnixSocket* sock) {
     }
     if (!frame_deserializer.EndReceive(rsize))
       return OnDisconnect(client->sock.get());
-  } while (rsize > 0);
+    // A short read means that the socket has been drained (or that the
+    // kernel stopped at a message carrying a file descriptor). Don't pay for
+    // another recv() that would just fail with EAGAIN: the watch is
+    // level-triggered, anything left in the socket will wake us up again.
+  } while (rsize == buf.size);
 
   for (;;) {
     std::unique_ptr<Frame> frame = frame_deserializer.PopNextFrame();
@@ -17,6 +17,8 @@
 #include "src/ipc/host_impl.h"
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
@@ -40,6 +42,7 @@ namespace {
 using ::perfetto::ipc::gen::ReplyProto;
 using ::perfetto::ipc::gen::RequestProto;
 using ::testing::_;
+using ::testing::ElementsAre;
 using ::testing::Invoke;
 using ::testing::InvokeWithoutArgs;
 using ::testing::Return;
@@ -422,6 +425,42 @@ TEST_F(HostImplTest, ReceiveFileDescriptor) {
             PERFETTO_EINTR(read(*rx_fd, buf, sizeof(buf))));
   ASSERT_STREQ(kFileContent, buf);
 }
+
+// The kernel stops a recv() at a message carrying a file descriptor. The
+// frames sent after it must still be picked up by a later wakeup.
+TEST_F(HostImplTest, ReceiveFramesAfterFileDescriptor) {
+  FakeService* fake_service = new FakeService("FakeService");
+  ASSERT_TRUE(host_->ExposeService(std::unique_ptr<Service>(fake_service)));
+  auto on_bind = task_runner_->CreateCheckpoint("on_bind");
+  cli_->BindService("FakeService");
+  EXPECT_CALL(*cli_, OnServiceBound(_)).WillOnce(InvokeWithoutArgs(on_bind));
+  task_runner_->RunUntilCheckpoint("on_bind");
+
+  base::TempFile tx_file = base::TempFile::CreateUnlinked();
+  RequestProto req_args;
+  req_args.set_data("with_fd");
+  cli_->InvokeMethod(cli_->last_bound_service_id_, 1, req_args,
+                     true /*drop_reply*/, tx_file.fd());
+  req_args.set_data("after_fd");
+  cli_->InvokeMethod(cli_->last_bound_service_id_, 1, req_args,
+                     true /*drop_reply*/);
+
+  auto received = task_runner_->CreateCheckpoint("received");
+  std::vector<std::string> data;
+  base::ScopedFile rx_fd;
+  EXPECT_CALL(*fake_service, OnFakeMethod1(_, _))
+      .Times(2)
+      .WillRepeatedly(Invoke([&](const RequestProto& req, DeferredBase*) {
+        data.push_back(req.data());
+        if (data.size() == 1)
+          rx_fd = fake_service->TakeReceivedFD();
+        if (data.size() == 2)
+          received();
+      }));
+  task_runner_->RunUntilCheckpoint("received");
+  EXPECT_THAT(data, ElementsAre("with_fd", "after_fd"));
+  EXPECT_TRUE(rx_fd);
+}
 #endif  // !OS_WIN
 
 // Invoke a method and immediately after disconnect the client.
@@ -27,6 +27,7 @@
 #include "perfetto/protozero/proto_utils.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include <algorithm>
 #include <cinttypes>
@@ -48,6 +49,41 @@ using TokenId = KernelSymbolMap::TokenTable::TokenId;
 constexpr size_t kSymNameMaxLen = 128;
 constexpr size_t kSymMaxSizeBytes = 1024 * 1024;
 
+// Layout of the image created by KernelSymbolMap::Serialize(). The header is
+// followed by the symbol buffer, the symbol index (as pairs of uint32_t), the
+// token buffer and the token index.
+constexpr uint32_t kImageMagic = 0x4d59534b;  // "KSYM"
+struct ImageHeader {
+  uint32_t magic;
+  uint32_t sym_index_sampling;
+  uint32_t token_index_sampling;
+  uint32_t num_tokens;
+  uint64_t base_addr;
+  uint64_t num_syms;
+  uint64_t sym_buf_size;
+  uint64_t sym_index_size;
+  uint64_t token_buf_size;
+  uint64_t token_index_size;
+};
+
+template <typename T>
+void AppendToImage(const T* data, size_t count, std::string* image) {
+  image->append(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+// Copies |count| elements of type T from |*ptr| into |out|, advancing |*ptr|.
+template <typename T>
+bool ReadFromImage(const uint8_t** ptr,
+                   const uint8_t* end,
+                   uint64_t count,
+                   T* out) {
+  if (count > static_cast<uint64_t>(end - *ptr) / sizeof(T))
+    return false;
+  memcpy(out, *ptr, static_cast<size_t>(count) * sizeof(T));
+  *ptr += count * sizeof(T);
+  return true;
+}
+
 // Reads a kallsyms file in blocks of 4 pages each and decode its lines using
 // a simple FSM. Calls the passed lambda for each valid symbol.
 // It skips undefined symbols and other useless stuff.
@@ -379,6 +415,80 @@ size_t KernelSymbolMap::Parse(const std::string& kallsyms_path) {
   return num_syms_;
 }
 
+std::string KernelSymbolMap::Serialize() const {
+  ImageHeader header{};
+  header.magic = kImageMagic;
+  header.sym_index_sampling = static_cast<uint32_t>(kSymIndexSampling);
+  header.token_index_sampling = static_cast<uint32_t>(kTokenIndexSampling);
+  header.num_tokens = tokens_.num_tokens_;
+  header.base_addr = base_addr_;
+  header.num_syms = num_syms_;
+  header.sym_buf_size = buf_.size();
+  header.sym_index_size = index_.size();
+  header.token_buf_size = tokens_.buf_.size();
+  header.token_index_size = tokens_.index_.size();
+
+  std::string image;
+  image.reserve(sizeof(header) + buf_.size() + index_.size() * 8 +
+                tokens_.buf_.size() + tokens_.index_.size() * 4);
+  AppendToImage(&header, 1, &image);
+  AppendToImage(buf_.data(), buf_.size(), &image);
+  for (const auto& rel_addr_and_offset : index_) {
+    const uint32_t entry[2] = {rel_addr_and_offset.first,
+                               rel_addr_and_offset.second};
+    AppendToImage(entry, 2, &image);
+  }
+  AppendToImage(tokens_.buf_.data(), tokens_.buf_.size(), &image);
+  AppendToImage(tokens_.index_.data(), tokens_.index_.size(), &image);
+  return image;
+}
+
+bool KernelSymbolMap::Deserialize(const uint8_t* image, size_t size) {
+  *this = KernelSymbolMap();
+  const uint8_t* ptr = image;
+  const uint8_t* const end = image + size;
+
+  ImageHeader header{};
+  if (!ReadFromImage(&ptr, end, 1, &header) || header.magic != kImageMagic ||
+      header.sym_index_sampling != kSymIndexSampling ||
+      header.token_index_sampling != kTokenIndexSampling) {
+    return false;
+  }
+
+  bool ok = true;
+  buf_.resize(static_cast<size_t>(
+      std::min<uint64_t>(header.sym_buf_size, size)));
+  ok = ok && buf_.size() == header.sym_buf_size &&
+       ReadFromImage(&ptr, end, header.sym_buf_size, buf_.data());
+
+  uint32_t entry[2];
+  for (uint64_t i = 0; ok && i < header.sym_index_size; i++) {
+    ok = ReadFromImage(&ptr, end, 2, entry) && entry[1] < buf_.size();
+    index_.emplace_back(entry[0], entry[1]);
+  }
+
+  tokens_.buf_.resize(static_cast<size_t>(
+      std::min<uint64_t>(header.token_buf_size, size)));
+  ok = ok && tokens_.buf_.size() == header.token_buf_size &&
+       ReadFromImage(&ptr, end, header.token_buf_size, tokens_.buf_.data());
+  tokens_.index_.resize(static_cast<size_t>(
+      std::min<uint64_t>(header.token_index_size, size)));
+  ok = ok && tokens_.index_.size() == header.token_index_size &&
+       ReadFromImage(&ptr, end, header.token_index_size,
+                     tokens_.index_.data());
+  for (uint32_t offset : tokens_.index_)
+    ok = ok && offset < tokens_.buf_.size();
+
+  if (!ok || ptr != end) {
+    *this = KernelSymbolMap();
+    return false;
+  }
+  tokens_.num_tokens_ = header.num_tokens;
+  base_addr_ = header.base_addr;
+  num_syms_ = static_cast<size_t>(header.num_syms);
+  return true;
+}
+
 std::string KernelSymbolMap::Lookup(uint64_t sym_addr) {
   if (index_.empty() || sym_addr < base_addr_)
     return "";
@@ -141,6 +141,15 @@ class KernelSymbolMap {
   // Returns the total memory usage in bytes.
   size_t size_bytes() const { return addr_bytes() + tokens_.size_bytes(); }
 
+  // Returns a flat image of the symbol and token tables, from which the map
+  // can be restored with Deserialize() much faster than parsing kallsyms
+  // again. The image is valid only for the same build of perfetto.
+  std::string Serialize() const;
+
+  // Restores the map from an image created by Serialize(). Returns false, and
+  // leaves the map empty, if the image is not valid.
+  bool Deserialize(const uint8_t* image, size_t size);
+
   // Token table.
   class TokenTable {
    public:
@@ -157,6 +166,8 @@ class KernelSymbolMap {
     }
 
    private:
+    friend class KernelSymbolMap;  // For Serialize() and Deserialize().
+
     TokenId num_tokens_ = 0;
 
     std::vector<char> buf_;  // Token buffer.
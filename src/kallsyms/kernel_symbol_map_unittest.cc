@@ -160,5 +160,42 @@ TEST(KernelSymbolMapTest, GoldenTest) {
   }
 }
 
+TEST(KernelSymbolMapTest, SerializeDeserialize) {
+  std::string fake_kallsyms;
+  static std::minstd_rand rng(0);
+  std::map<uint64_t, std::string> symbols;
+  for (int rep = 0; rep < 1000; rep++) {
+    uint64_t addr = 0xffffff8000000000 + static_cast<uint64_t>(rng() % 100000);
+    std::string sym_name = "sym_" + std::to_string(rng() % 300) + "_" +
+                           std::to_string(rep);
+    base::StackString<128> line("%" PRIx64 " t %s\n", addr,
+                                sym_name.c_str());
+    symbols[addr] = sym_name;
+    fake_kallsyms += line.ToStdString();
+  }
+  base::TempFile tmp = base::TempFile::Create();
+  base::WriteAll(tmp.fd(), fake_kallsyms.data(), fake_kallsyms.size());
+  base::FlushFile(tmp.fd());
+
+  KernelSymbolMap parsed;
+  parsed.Parse(tmp.path().c_str());
+  std::string image = parsed.Serialize();
+
+  KernelSymbolMap restored;
+  ASSERT_TRUE(restored.Deserialize(
+      reinterpret_cast<const uint8_t*>(image.data()), image.size()));
+  ASSERT_EQ(restored.num_syms(), parsed.num_syms());
+  ASSERT_EQ(restored.size_bytes(), parsed.size_bytes());
+  for (const auto& kv : symbols)
+    ASSERT_EQ(restored.Lookup(kv.first), parsed.Lookup(kv.first));
+
+  // Truncated images are rejected.
+  KernelSymbolMap truncated;
+  ASSERT_FALSE(truncated.Deserialize(
+      reinterpret_cast<const uint8_t*>(image.data()), image.size() - 1));
+  ASSERT_EQ(truncated.num_syms(), 0u);
+  ASSERT_EQ(truncated.Lookup(symbols.begin()->first), "");
+}
+
 }  // namespace
 }  // namespace perfetto
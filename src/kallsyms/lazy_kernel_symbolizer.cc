@@ -18,14 +18,21 @@
 
 #include <string>
 
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include <mutex>
+
 #include "perfetto/base/build_config.h"
 #include "perfetto/base/compiler.h"
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/utils.h"
 #include "src/kallsyms/kernel_symbol_map.h"
+#include "src/tracing/ipc/memfd.h"
 
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
 #include <sys/system_properties.h>
@@ -36,6 +43,7 @@ namespace perfetto {
 namespace {
 
 const char kKallsymsPath[] = "/proc/kallsyms";
+const char kModulesPath[] = "/proc/modules";
 const char kPtrRestrictPath[] = "/proc/sys/kernel/kptr_restrict";
 const char kLowerPtrRestrictAndroidProp[] = "security.lower_kptr_restrict";
 
@@ -144,6 +152,79 @@ void ScopedKptrUnrestrict::WriteKptrRestrict(const std::string& value) {
     PERFETTO_PLOG("Failed to set %s to %s", kPtrRestrictPath, value.c_str());
 }
 
+// The image of the last symbol map parsed in this process, see the comment in
+// the header.
+struct SymbolMapImage {
+  std::mutex mutex;
+  base::ScopedFile fd;  // Sealed memfd.
+  size_t size = 0;
+  uint64_t modules_hash = 0;
+};
+
+SymbolMapImage* GetSymbolMapImage() {
+  static SymbolMapImage* image = new SymbolMapImage();
+  return image;
+}
+
+// Returns a hash of the names and load addresses of the kernel modules. It
+// changes when modules are loaded or unloaded, i.e. when their symbols are
+// added to or removed from kallsyms.
+uint64_t HashKernelModules() {
+  std::string modules;
+  if (!base::ReadFile(kModulesPath, &modules))
+    return 0;
+  base::Hasher hasher;
+  for (base::StringSplitter lines(std::move(modules), '\n'); lines.Next();) {
+    // Each line is "name size refcount deps state address". The other columns
+    // (e.g. the refcount) can change without the symbols changing.
+    base::StringSplitter columns(&lines, ' ');
+    for (size_t i = 0; columns.Next(); i++) {
+      if (i == 0 || i == 5)
+        hasher.Update(columns.cur_token(), columns.cur_token_size());
+    }
+  }
+  return hasher.digest();
+}
+
+bool LoadFromImage(const SymbolMapImage& image,
+                   uint64_t modules_hash,
+                   KernelSymbolMap* symbol_map) {
+  if (!image.fd || image.modules_hash != modules_hash)
+    return false;
+  void* mem = mmap(nullptr, image.size, PROT_READ, MAP_SHARED, *image.fd, 0);
+  if (mem == MAP_FAILED) {
+    PERFETTO_PLOG("mmap(kallsyms image) failed");
+    return false;
+  }
+  bool res =
+      symbol_map->Deserialize(static_cast<const uint8_t*>(mem), image.size);
+  munmap(mem, image.size);
+  return res;
+}
+
+void SaveToImage(const KernelSymbolMap& symbol_map,
+                 uint64_t modules_hash,
+                 SymbolMapImage* image) {
+  base::ScopedFile fd =
+      CreateMemfd("perfetto_kallsyms", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (!fd)
+    return;
+  std::string data = symbol_map.Serialize();
+  if (base::WriteAll(*fd, data.data(), data.size()) !=
+      static_cast<ssize_t>(data.size())) {
+    PERFETTO_PLOG("Failed to write the kallsyms image");
+    return;
+  }
+  if (fcntl(*fd, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+    PERFETTO_PLOG("Failed to seal the kallsyms image");
+    return;
+  }
+  image->fd = std::move(fd);
+  image->size = data.size();
+  image->modules_hash = modules_hash;
+}
+
 }  // namespace
 
 LazyKernelSymbolizer::LazyKernelSymbolizer() = default;
@@ -156,10 +237,20 @@ KernelSymbolMap* LazyKernelSymbolizer::GetOrCreateKernelSymbolMap() {
 
   symbol_map_.reset(new KernelSymbolMap());
 
-  // If kptr_restrict is set, try temporarily lifting it (it works only if
-  // traced_probes is run as a privileged user).
-  ScopedKptrUnrestrict kptr_unrestrict;
-  symbol_map_->Parse(kKallsymsPath);
+  SymbolMapImage* image = GetSymbolMapImage();
+  std::lock_guard<std::mutex> lock(image->mutex);
+  uint64_t modules_hash = HashKernelModules();
+  if (LoadFromImage(*image, modules_hash, symbol_map_.get()))
+    return symbol_map_.get();
+
+  {
+    // If kptr_restrict is set, try temporarily lifting it (it works only if
+    // traced_probes is run as a privileged user).
+    ScopedKptrUnrestrict kptr_unrestrict;
+    symbol_map_->Parse(kKallsymsPath);
+  }
+  if (symbol_map_->num_syms() > 0)
+    SaveToImage(*symbol_map_, modules_hash, image);
   return symbol_map_.get();
 }
 
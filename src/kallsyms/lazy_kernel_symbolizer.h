@@ -36,6 +36,12 @@ class KernelSymbolMap;
 // this way all CpuReader instances can share the same symbol map instance.
 // The object being shared is LazyKernelSymbolizer, which is cheap and always
 // valid. LazyKernelSymbolizer may or may not contain a valid symbol map.
+//
+// Parsing /proc/kallsyms is slow (hundreds of ms), so the image of the last
+// map parsed (see KernelSymbolMap::Serialize()) is kept in a sealed memfd,
+// shared by all the instances in the process (e.g. the ftrace and the perf
+// ones), and outliving Destroy(). The maps of later sessions are restored from
+// it, unless the kernel modules have changed in the meantime.
 class LazyKernelSymbolizer {
  public:
   // Constructs an empty instance. Does NOT load any symbols upon construction.
@@ -48,6 +54,11 @@ class LazyKernelSymbolizer {
 
   bool is_valid() const { return !!symbol_map_; }
 
+  // Returns the symbol map if already created, nullptr otherwise. Unlike
+  // GetOrCreateKernelSymbolMap(), this can be called from other threads, as
+  // long as the owner thread doesn't create or destroy the map meanwhile.
+  KernelSymbolMap* symbol_map() const { return symbol_map_.get(); }
+
   // Destroys the |symbol_map_| freeing up memory. A further call to
   // GetOrCreateKernelSymbolMap() will create it again.
   void Destroy();
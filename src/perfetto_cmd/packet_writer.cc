@@ -17,10 +17,15 @@
 #include "src/perfetto_cmd/packet_writer.h"
 
 #include <array>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 #include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #include "perfetto/base/build_config.h"
@@ -62,6 +67,10 @@ const size_t kPendingBytesLimit = 32 * 1024;
 
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
+// ThreadedPacketWriter blocks in WritePackets() while more than this many
+// bytes are queued, bounding the memory used when the writer can't keep up.
+constexpr size_t kMaxPendingBytes = 32 * 1024 * 1024;
+
 template <uint32_t id>
 size_t GetPreamble(size_t sz, Preamble* preamble) {
   uint8_t* ptr = reinterpret_cast<uint8_t*>(preamble->data());
@@ -250,6 +259,117 @@ void ZipPacketWriter::Deflate(const uint8_t* ptr, size_t size) {
 
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
+// Copies the packets and hands them to |writer_| on a dedicated thread, so that
+// compressing and writing the trace overlaps with reading the next batch of
+// packets from the service.
+class ThreadedPacketWriter : public PacketWriter {
+ public:
+  ThreadedPacketWriter(std::unique_ptr<PacketWriter>);
+  ~ThreadedPacketWriter() override;
+  bool WritePackets(const std::vector<TracePacket>& packets) override;
+  bool WritePacket(const TracePacket& packet) override;
+
+ private:
+  void RunThreadLoop();
+
+  std::unique_ptr<PacketWriter> writer_;
+
+  // Start of mutex protected members.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::vector<TracePacket>> pending_;
+  size_t pending_bytes_ = 0;
+  bool failed_ = false;
+  bool quit_ = false;
+  // End of mutex protected members.
+
+  std::thread thread_;
+};
+
+ThreadedPacketWriter::ThreadedPacketWriter(
+    std::unique_ptr<PacketWriter> writer)
+    : writer_(std::move(writer)),
+      thread_(&ThreadedPacketWriter::RunThreadLoop, this) {}
+
+ThreadedPacketWriter::~ThreadedPacketWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+bool ThreadedPacketWriter::WritePackets(
+    const std::vector<TracePacket>& packets) {
+  // The packets can point into memory owned by the caller (e.g. the shared
+  // memory buffer of ReadBuffers()), so they need to be copied before being
+  // queued.
+  std::vector<TracePacket> copies(packets.size());
+  size_t size = 0;
+  for (size_t i = 0; i < packets.size(); i++) {
+    Slice slice = Slice::Allocate(packets[i].size());
+    uint8_t* wptr = slice.own_data();
+    for (const Slice& src : packets[i].slices()) {
+      memcpy(wptr, src.start, src.size);
+      wptr += src.size;
+    }
+    copies[i].AddSlice(std::move(slice));
+    size += packets[i].size();
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock,
+           [this] { return failed_ || pending_bytes_ <= kMaxPendingBytes; });
+  if (failed_)
+    return false;
+  pending_bytes_ += size;
+  pending_.emplace_back(std::move(copies));
+  cv_.notify_all();
+  return true;
+}
+
+bool ThreadedPacketWriter::WritePacket(const TracePacket& packet) {
+  std::vector<TracePacket> packets(1);
+  for (const Slice& slice : packet.slices())
+    packets[0].AddSlice(slice.start, slice.size);
+  return WritePackets(packets);
+}
+
+void ThreadedPacketWriter::RunThreadLoop() {
+  for (;;) {
+    std::vector<TracePacket> packets;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return quit_ || !pending_.empty(); });
+      // Even when quitting, write everything which was queued.
+      if (pending_.empty())
+        break;
+      packets = std::move(pending_.front());
+      pending_.pop_front();
+    }
+
+    size_t size = 0;
+    for (const TracePacket& packet : packets)
+      size += packet.size();
+    bool ok = writer_->WritePackets(packets);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_bytes_ -= size;
+      if (!ok) {
+        failed_ = true;
+        pending_.clear();
+        pending_bytes_ = 0;
+      }
+    }
+    cv_.notify_all();
+  }
+  // Destroy the writer on this thread too, as destroying ZipPacketWriter
+  // compresses and writes the last packet.
+  writer_.reset();
+}
+
 }  // namespace
 
 PacketWriter::PacketWriter() {}
@@ -260,6 +380,12 @@ std::unique_ptr<PacketWriter> CreateFilePacketWriter(FILE* fd) {
   return std::unique_ptr<PacketWriter>(new FilePacketWriter(fd));
 }
 
+std::unique_ptr<PacketWriter> CreateThreadedPacketWriter(
+    std::unique_ptr<PacketWriter> writer) {
+  return std::unique_ptr<PacketWriter>(
+      new ThreadedPacketWriter(std::move(writer)));
+}
+
 #if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 std::unique_ptr<PacketWriter> CreateZipPacketWriter(
     std::unique_ptr<PacketWriter> writer) {
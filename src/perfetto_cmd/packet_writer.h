@@ -45,6 +45,13 @@ std::unique_ptr<PacketWriter> CreateFilePacketWriter(FILE*);
 std::unique_ptr<PacketWriter> CreateZipPacketWriter(
     std::unique_ptr<PacketWriter>);
 
+// Returns a writer which passes the packets to |writer| on a dedicated thread.
+// WritePackets() only copies the packets, blocking if too many bytes are
+// queued. A failure of |writer| is reported by the following calls. The queued
+// packets are all written before the destructor returns.
+std::unique_ptr<PacketWriter> CreateThreadedPacketWriter(
+    std::unique_ptr<PacketWriter>);
+
 }  // namespace perfetto
 
 #endif  // SRC_PERFETTO_CMD_PACKET_WRITER_H_
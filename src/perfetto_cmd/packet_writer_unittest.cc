@@ -18,7 +18,9 @@
 
 #include <string.h>
 
+#include <algorithm>
 #include <random>
+#include <thread>
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/file_utils.h"
@@ -117,6 +119,59 @@ TEST(PacketWriterTest, FilePacketWriter) {
   EXPECT_EQ(trace.packet()[0].for_testing().str(), "abc");
 }
 
+TEST(PacketWriterTest, ThreadedPacketWriter) {
+  base::TempFile tmp = base::TempFile::CreateUnlinked();
+  base::ScopedResource<FILE*, fclose, nullptr> f(
+      fdopen(tmp.ReleaseFD().release(), "wb"));
+
+  {
+    std::unique_ptr<PacketWriter> writer =
+        CreateThreadedPacketWriter(CreateFilePacketWriter(*f));
+    for (int i = 0; i < 100; i++) {
+      TracePacket owned = CreateTracePacket([i](TracePacketProto* msg) {
+        msg->mutable_for_testing()->set_str(std::to_string(i));
+      });
+      // Pass packets which don't own their memory and clobber it right after
+      // the call, like the shared memory buffer of ReadBuffers().
+      std::string buf = owned.GetRawBytesForTesting();
+      std::vector<TracePacket> packets(1);
+      packets[0].AddSlice(buf.data(), buf.size());
+      EXPECT_TRUE(writer->WritePackets(packets));
+      std::fill(buf.begin(), buf.end(), '\xff');
+    }
+  }
+
+  fseek(*f, 0, SEEK_SET);
+  std::string s;
+  EXPECT_TRUE(base::ReadFileStream(*f, &s));
+
+  protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(s));
+  ASSERT_EQ(trace.packet().size(), 100u);
+  for (int i = 0; i < 100; i++)
+    EXPECT_EQ(trace.packet()[static_cast<size_t>(i)].for_testing().str(),
+              std::to_string(i));
+}
+
+TEST(PacketWriterTest, ThreadedPacketWriter_Failure) {
+  class FailingPacketWriter : public PacketWriter {
+   public:
+    bool WritePacket(const TracePacket&) override { return false; }
+  };
+
+  std::unique_ptr<PacketWriter> writer = CreateThreadedPacketWriter(
+      std::unique_ptr<PacketWriter>(new FailingPacketWriter()));
+  TracePacket packet = CreateTracePacket([](TracePacketProto* msg) {
+    msg->mutable_for_testing()->set_str("abc");
+  });
+  // The failure is reported asynchronously, by one of the following calls.
+  // Once reported, it sticks.
+  while (writer->WritePacket(packet)) {
+    std::this_thread::yield();
+  }
+  EXPECT_FALSE(writer->WritePacket(packet));
+}
+
 #if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
 TEST(PacketWriterTest, ZipPacketWriter) {
@@ -816,6 +816,12 @@ std::optional<int> PerfettoCmd::ParseCmdlineAndMaybeDaemonize(int argc,
     }
   }
 
+  // Compress and write the trace on another thread, so that a slow output
+  // (deflate, storage or a pipe to another process) doesn't stall reading the
+  // trace from the service.
+  if (packet_writer_)
+    packet_writer_ = CreateThreadedPacketWriter(std::move(packet_writer_));
+
   bool will_trace_indefinitely =
       trace_config_->duration_ms() == 0 &&
       trace_config_->trigger_config().trigger_timeout_ms() == 0;
@@ -998,8 +1004,15 @@ int PerfettoCmd::ConnectToServiceAndRun() {
   }
 #endif
 
+  // OnTraceData() writes the packets out before returning, so they can point
+  // straight into the shared memory handed over by the service. On Android
+  // this is not enabled, as it requires the SELinux policy to allow using fds
+  // received from traced.
+  const bool read_buffers_via_shared_memory =
+      PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX);
   consumer_endpoint_ =
-      ConsumerIPCClient::Connect(GetConsumerSocket(), this, &task_runner_);
+      ConsumerIPCClient::Connect(GetConsumerSocket(), this, &task_runner_,
+                                 read_buffers_via_shared_memory);
   SetupCtrlCSignalHandler();
   task_runner_.Run();
 
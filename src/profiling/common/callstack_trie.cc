@@ -25,12 +25,97 @@
 namespace perfetto {
 namespace profiling {
 
+GlobalCallstackTrie::GlobalCallstackTrie() = default;
+
+GlobalCallstackTrie::~GlobalCallstackTrie() {
+  // The nodes hold references into the interners, so they need to be
+  // destroyed before them.
+  DeleteAllNodes();
+}
+
+GlobalCallstackTrie::NodeSlot* GlobalCallstackTrie::GetSlot(
+    uint32_t index) const {
+  PERFETTO_DCHECK(index != kRootIndex && index <= num_slots_);
+  uint32_t slot = index - 1;
+  return &chunks_[slot >> kNodesPerChunkLog2][slot & (kNodesPerChunk - 1)];
+}
+
+GlobalCallstackTrie::Node* GlobalCallstackTrie::GetNode(uint32_t index) const {
+  if (index == kRootIndex)
+    return const_cast<Node*>(&root_);
+  return &GetSlot(index)->node;
+}
+
+GlobalCallstackTrie::Node* GlobalCallstackTrie::AllocNode(
+    const Interned<Frame>& loc,
+    uint32_t parent) {
+  uint32_t index;
+  if (first_free_ != kInvalidIndex) {
+    index = first_free_;
+    first_free_ = GetSlot(index)->next_free;
+  } else {
+    // The last index is reserved for kInvalidIndex.
+    PERFETTO_CHECK(num_slots_ < kInvalidIndex - 1);
+    if (num_slots_ % kNodesPerChunk == 0)
+      chunks_.emplace_back(new NodeSlot[kNodesPerChunk]);
+    index = ++num_slots_;
+  }
+  return new (&GetSlot(index)->node)
+      Node(loc, ++next_callstack_id_, index, parent);
+}
+
+void GlobalCallstackTrie::DeleteNode(Node* node) {
+  PERFETTO_DCHECK(node != &root_);
+  if (node->num_children_ > 0) {
+    // Only nodes that were never referenced themselves can be left below a
+    // node whose last reference is gone, so this is rare. Find them with a
+    // scan, rather than paying for a list of children in every node.
+    std::vector<Node*> children;
+    for (auto it = children_.GetIterator(); it; ++it) {
+      Node* child = GetNode(it.value());
+      if (child->parent_ == node->index_)
+        children.push_back(child);
+    }
+    for (Node* child : children)
+      DeleteNode(child);
+  }
+  PERFETTO_DCHECK(node->num_children_ == 0);
+
+  uint32_t index = node->index_;
+  Node* parent = GetNode(node->parent_);
+  children_.Erase(MakeChildKey(node->parent_, node->location_));
+  parent->num_children_--;
+  node->~Node();
+  NodeSlot* slot = GetSlot(index);
+  slot->next_free = first_free_;
+  first_free_ = index;
+}
+
+void GlobalCallstackTrie::DeleteAllNodes() {
+  for (auto it = children_.GetIterator(); it; ++it)
+    GetNode(it.value())->~Node();
+  children_.Clear();
+  chunks_.clear();
+  num_slots_ = 0;
+  first_free_ = kInvalidIndex;
+  root_.num_children_ = 0;
+}
+
+void GlobalCallstackTrie::ClearTrie() {
+  PERFETTO_DLOG("Clearing trie");
+  DeleteAllNodes();
+}
+
 GlobalCallstackTrie::Node* GlobalCallstackTrie::GetOrCreateChild(
     Node* self,
     const Interned<Frame>& loc) {
-  Node* child = self->GetChild(loc);
-  if (!child)
-    child = self->AddChild(loc, ++next_callstack_id_, self);
+  uint64_t key = MakeChildKey(self->index_, loc);
+  uint32_t* child_index = children_.Find(key);
+  if (child_index)
+    return GetNode(*child_index);
+  Node* child = AllocNode(loc, self->index_);
+  children_.Insert(key, child->index_);
+  self->num_children_++;
   return child;
 }
 
@@ -39,7 +124,7 @@ std::vector<Interned<Frame>> GlobalCallstackTrie::BuildInverseCallstack(
   std::vector<Interned<Frame>> res;
   while (node != &root_) {
     res.emplace_back(node->location_);
-    node = node->parent_;
+    node = GetParent(node);
   }
   return res;
 }
@@ -77,22 +162,19 @@ GlobalCallstackTrie::Node* GlobalCallstackTrie::CreateCallsite(
 void GlobalCallstackTrie::IncrementNode(Node* node) {
   while (node != nullptr) {
     node->ref_count_ += 1;
-    node = node->parent_;
+    node = GetParent(node);
   }
 }
 
 void GlobalCallstackTrie::DecrementNode(Node* node) {
   PERFETTO_DCHECK(node->ref_count_ >= 1);
 
-  bool delete_prev = false;
-  Node* prev = nullptr;
   while (node != nullptr) {
-    if (delete_prev)
-      node->RemoveChild(prev);
+    Node* parent = GetParent(node);
     node->ref_count_ -= 1;
-    delete_prev = node->ref_count_ == 0;
-    prev = node;
-    node = node->parent_;
+    if (node->ref_count_ == 0 && parent != nullptr)
+      DeleteNode(node);
+    node = parent;
   }
 }
 
@@ -126,30 +208,5 @@ Interned<Frame> GlobalCallstackTrie::MakeRootFrame() {
   return frame_interner_.Intern(frame);
 }
 
-GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::AddChild(
-    const Interned<Frame>& loc,
-    uint64_t callstack_id,
-    Node* parent) {
-  auto it = children_.emplace(loc, callstack_id, parent);
-  return const_cast<Node*>(&(*it.first));
-}
-void GlobalCallstackTrie::Node::RemoveChild(Node* node) {
-  children_.erase(*node);
-}
-
-GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::GetChild(
-    const Interned<Frame>& loc) {
-  // This will be nicer with C++14 transparent comparators.
-  // Then we will be able to look up by just the key using a sutiable
-  // comparator.
-  //
-  // For now we need to allow to construct Node from the key.
-  Node node(loc);
-  auto it = children_.find(node);
-  if (it == children_.end())
-    return nullptr;
-  return const_cast<Node*>(&(*it));
-}
-
 }  // namespace profiling
 }  // namespace perfetto
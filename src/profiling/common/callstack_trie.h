@@ -17,13 +17,16 @@
 #ifndef SRC_PROFILING_COMMON_CALLSTACK_TRIE_H_
 #define SRC_PROFILING_COMMON_CALLSTACK_TRIE_H_
 
-#include <set>
+#include <limits>
+#include <memory>
 #include <string>
+#include <tuple>
 #include <typeindex>
 #include <vector>
 
 #include <unwindstack/Unwinder.h>
 
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "src/profiling/common/interner.h"
 #include "src/profiling/common/unwind_support.h"
 
@@ -77,10 +80,10 @@ struct Frame {
 
 // Graph of function callsites. A single instance can be used for callsites from
 // different processes. Each call site is represented by a
-// GlobalCallstackTrie::Node that is owned by the parent callsite. Each node has
-// a pointer to its parent, which means the function call-graph can be
-// reconstructed from a GlobalCallstackTrie::Node by walking down the parent
-// chain.
+// GlobalCallstackTrie::Node, identified within the trie by a 32-bit index.
+// Each node has the index of its parent, which means the function call-graph
+// can be reconstructed from a GlobalCallstackTrie::Node by walking down the
+// parent chain.
 //
 // For the following two callstacks:
 //  * libc_init -> main -> foo -> alloc_buf
@@ -95,6 +98,12 @@ struct Frame {
 //                   libc_init
 //                       |
 //                    [root_]
+//
+// Long running heapprofd sessions can accumulate millions of distinct
+// callstacks, so nodes are kept small: they are allocated in chunks (rather
+// than one heap allocation each), and the children of all nodes are looked up
+// in a single open-addressed hash map keyed on (parent index, frame), rather
+// than in a container per node.
 class GlobalCallstackTrie {
  public:
   // Optionally, Nodes can be externally refcounted via |IncrementNode| and
@@ -105,51 +114,34 @@ class GlobalCallstackTrie {
     // This is opaque except to GlobalCallstackTrie.
     friend class GlobalCallstackTrie;
 
-    // Allow building a node out of a frame for GetChild.
-    explicit Node(Interned<Frame> frame) : Node(frame, 0, nullptr) {}
-    Node(const Node&) = default;
-    Node(Node&&) = default;
-
-    Node(Interned<Frame> frame, uint64_t id)
-        : Node(std::move(frame), id, nullptr) {}
-    Node(Interned<Frame> frame, uint64_t id, Node* parent)
-        : id_(id), parent_(parent), location_(frame) {}
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
 
     ~Node() { PERFETTO_DCHECK(!ref_count_); }
 
     uint64_t id() const { return id_; }
 
    private:
-    Node* GetOrCreateChild(const Interned<Frame>& loc);
-    // Deletes all descendant nodes, regardless of |ref_count_|.
-    void DeleteChildren() { children_.clear(); }
+    Node(Interned<Frame> frame, uint64_t id, uint32_t index, uint32_t parent)
+        : id_(id),
+          location_(std::move(frame)),
+          index_(index),
+          parent_(parent) {}
 
-    uint64_t ref_count_ = 0;
     uint64_t id_;
-    Node* const parent_;
     const Interned<Frame> location_;
-
-    class NodeComparator {
-     public:
-      bool operator()(const Node& one, const Node& other) const {
-        return one.location_ < other.location_;
-      }
-    };
-    Node* AddChild(const Interned<Frame>& loc,
-                   uint64_t next_callstack_id_,
-                   Node* parent);
-    void RemoveChild(Node* node);
-    Node* GetChild(const Interned<Frame>& loc);
-
-    std::set<Node, NodeComparator> children_;
+    const uint32_t index_;
+    const uint32_t parent_;
+    uint32_t ref_count_ = 0;
+    uint32_t num_children_ = 0;
   };
 
-  GlobalCallstackTrie() = default;
-  ~GlobalCallstackTrie() = default;
+  GlobalCallstackTrie();
+  ~GlobalCallstackTrie();
   GlobalCallstackTrie(const GlobalCallstackTrie&) = delete;
   GlobalCallstackTrie& operator=(const GlobalCallstackTrie&) = delete;
 
-  // Moving this would invalidate the back pointers to the root_ node.
+  // Moving this would invalidate the pointers to the root_ node.
   GlobalCallstackTrie(GlobalCallstackTrie&&) = delete;
   GlobalCallstackTrie& operator=(GlobalCallstackTrie&&) = delete;
 
@@ -160,21 +152,48 @@ class GlobalCallstackTrie {
                        const std::vector<std::string>& build_ids);
   Node* CreateCallsite(const std::vector<Interned<Frame>>& callstack);
 
-  static void IncrementNode(Node* node);
-  static void DecrementNode(Node* node);
+  void IncrementNode(Node* node);
+  void DecrementNode(Node* node);
 
   std::vector<Interned<Frame>> BuildInverseCallstack(const Node* node) const;
 
   // Purges all interned callstacks (and the associated internings), without
   // restarting any interning sequences. Incompatible with external refcounting
   // of nodes (Node.ref_count_).
-  void ClearTrie() {
-    PERFETTO_DLOG("Clearing trie");
-    root_.DeleteChildren();
-  }
+  void ClearTrie();
+
+  size_t node_count_for_testing() const { return children_.size(); }
 
  private:
+  static constexpr uint32_t kRootIndex = 0;
+  static constexpr uint32_t kInvalidIndex =
+      std::numeric_limits<uint32_t>::max();
+  static constexpr uint32_t kNodesPerChunkLog2 = 10;
+  static constexpr uint32_t kNodesPerChunk = 1u << kNodesPerChunkLog2;
+
+  // Storage for one node in a chunk. Unused slots are chained in a free list.
+  union NodeSlot {
+    NodeSlot() {}
+    ~NodeSlot() {}
+
+    Node node;
+    uint32_t next_free;
+  };
+
+  static uint64_t MakeChildKey(uint32_t parent, const Interned<Frame>& loc) {
+    return (static_cast<uint64_t>(parent) << 32) | loc.id();
+  }
+
   Node* GetOrCreateChild(Node* self, const Interned<Frame>& loc);
+  Node* GetNode(uint32_t index) const;
+  Node* GetParent(const Node* node) const {
+    return node->parent_ == kInvalidIndex ? nullptr : GetNode(node->parent_);
+  }
+  NodeSlot* GetSlot(uint32_t index) const;
+  Node* AllocNode(const Interned<Frame>& loc, uint32_t parent);
+  // Deletes |node| and all its descendants, regardless of |ref_count_|.
+  void DeleteNode(Node* node);
+  void DeleteAllNodes();
 
   Interned<Frame> MakeRootFrame();
 
@@ -186,7 +205,16 @@ class GlobalCallstackTrie {
 
   // Note: profile_module in trace processor relies on the value of this root
   // callsite being exactly "1". See the perf_sample parsing code.
-  Node root_{MakeRootFrame(), ++next_callstack_id_};
+  Node root_{MakeRootFrame(), ++next_callstack_id_, kRootIndex, kInvalidIndex};
+
+  // Chunks of kNodesPerChunk nodes. The node with index i (i > 0, as the root
+  // is not part of any chunk) lives in slot (i - 1) of the chunks.
+  std::vector<std::unique_ptr<NodeSlot[]>> chunks_;
+  uint32_t num_slots_ = 0;  // Slots handed out so far, including freed ones.
+  uint32_t first_free_ = kInvalidIndex;
+
+  // (parent index, frame intern id) -> child index, for all nodes but root_.
+  base::FlatHashMap<uint64_t, uint32_t> children_;
 };
 
 }  // namespace profiling
@@ -16,13 +16,17 @@
 
 #include "src/profiling/common/unwind_support.h"
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <cinttypes>
+#include <vector>
 
 #include <procinfo/process_map.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
 
-#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/utils.h"
 
 namespace perfetto {
 namespace profiling {
@@ -57,19 +61,80 @@ size_t FDMemory::Read(uint64_t addr, void* dst, size_t size) {
 
 FDMaps::FDMaps(base::ScopedFile fd) : fd_(std::move(fd)) {}
 
-bool FDMaps::Parse() {
-  // If the process has already exited, lseek or ReadFileDescriptor will
-  // return false.
-  if (lseek(*fd_, 0, SEEK_SET) == -1)
-    return false;
+namespace {
+
+bool SameMapping(unwindstack::MapInfo& map_info,
+                 uint64_t start,
+                 uint64_t end,
+                 uint64_t offset,
+                 uint64_t flags,
+                 const std::string& name) {
+  return map_info.start() == start && map_info.end() == end &&
+         map_info.offset() == offset && map_info.flags() == flags &&
+         static_cast<const std::string&>(map_info.name()) == name;
+}
 
+// Returns the map of |old_maps| (sorted by start address) that is identical
+// to the given mapping, and that followed an identical mapping to |prev_map|,
+// or nullptr.
+std::shared_ptr<unwindstack::MapInfo> FindUnchangedMap(
+    const std::vector<std::shared_ptr<unwindstack::MapInfo>>& old_maps,
+    unwindstack::MapInfo* prev_map,
+    uint64_t flags,
+    const android::procinfo::MapInfo& mapinfo) {
+  auto it = std::lower_bound(
+      old_maps.begin(), old_maps.end(), mapinfo.start,
+      [](const std::shared_ptr<unwindstack::MapInfo>& map, uint64_t start) {
+        return map->start() < start;
+      });
+  if (it == old_maps.end() ||
+      !SameMapping(**it, mapinfo.start, mapinfo.end, mapinfo.pgoff, flags,
+                   mapinfo.name)) {
+    return nullptr;
+  }
+  // The ELF of a mapping can depend on the previous one (e.g. for libraries
+  // loaded from within an APK), so that has to be unchanged as well.
+  std::shared_ptr<unwindstack::MapInfo> old_prev = (*it)->prev_map();
+  if (!prev_map && !old_prev)
+    return *it;
+  if (!prev_map || !old_prev ||
+      !SameMapping(*old_prev, prev_map->start(), prev_map->end(),
+                   prev_map->offset(), prev_map->flags(), prev_map->name())) {
+    return nullptr;
+  }
+  return *it;
+}
+
+}  // namespace
+
+bool FDMaps::Parse() {
+  // Use pread rather than lseek + read, as heapprofd parses the maps of the
+  // same process from several threads through dup()-ed fds, which share the
+  // file offset. If the process has already exited, pread will fail.
   std::string content;
-  if (!base::ReadFileDescriptor(*fd_, &content))
-    return false;
+  char buf[4096];
+  for (off_t offset = 0;;) {
+    ssize_t rd = PERFETTO_EINTR(pread(*fd_, buf, sizeof(buf), offset));
+    if (rd == -1) {
+      maps_.clear();
+      return false;
+    }
+    if (rd == 0)
+      break;
+    content.append(buf, static_cast<size_t>(rd));
+    offset += rd;
+  }
+
+  // Mappings that did not change since the last parse keep their MapInfo,
+  // together with the ELF, build id and memory libunwindstack lazily set up
+  // for it. This way reparsing, e.g. after a dlopen, only does that work
+  // again for the new mappings, rather than for all mappings of the process.
+  std::vector<std::shared_ptr<unwindstack::MapInfo>> old_maps;
+  old_maps.swap(maps_);
 
   unwindstack::SharedString name("");
   std::shared_ptr<unwindstack::MapInfo> prev_map;
-  return android::procinfo::ReadMapFileContent(
+  bool parsed = android::procinfo::ReadMapFileContent(
       &content[0], [&](const android::procinfo::MapInfo& mapinfo) {
         // Mark a device map in /dev/ and not in /dev/ashmem/ specially.
         auto flags = mapinfo.flags;
@@ -77,6 +142,16 @@ bool FDMaps::Parse() {
             strncmp(mapinfo.name.c_str() + 5, "ashmem/", 7) != 0) {
           flags |= unwindstack::MAPS_FLAGS_DEVICE_MAP;
         }
+        std::shared_ptr<unwindstack::MapInfo> unchanged =
+            FindUnchangedMap(old_maps, prev_map.get(), flags, mapinfo);
+        if (unchanged) {
+          unchanged->set_prev_map(prev_map);
+          if (prev_map)
+            prev_map->set_next_map(unchanged);
+          maps_.emplace_back(std::move(unchanged));
+          prev_map = maps_.back();
+          return;
+        }
         // Share the string if it matches for consecutive maps.
         if (name != mapinfo.name) {
           name = unwindstack::SharedString(mapinfo.name);
@@ -85,6 +160,11 @@ bool FDMaps::Parse() {
             prev_map, mapinfo.start, mapinfo.end, mapinfo.pgoff, flags, name));
         prev_map = maps_.back();
       });
+  if (!maps_.empty()) {
+    std::shared_ptr<unwindstack::MapInfo> no_map;
+    maps_.back()->set_next_map(no_map);
+  }
+  return parsed;
 }
 
 void FDMaps::Reset() {
@@ -101,7 +181,6 @@ UnwindingMetadata::UnwindingMetadata(base::ScopedFile maps_fd,
 
 void UnwindingMetadata::ReparseMaps() {
   reparses++;
-  fd_maps.Reset();
   fd_maps.Parse();
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
   jit_debug.reset();
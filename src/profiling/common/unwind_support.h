@@ -56,7 +56,10 @@ class FDMaps : public unwindstack::Maps {
 
   virtual ~FDMaps() override = default;
 
+  // (Re)parses the maps. Mappings that are unchanged since the last Parse()
+  // keep their MapInfo, and with it the state libunwindstack cached for them.
   bool Parse() override;
+  // Drops all mappings, including their cached state.
   void Reset();
 
  private:
@@ -16,11 +16,13 @@
 
 #include "src/profiling/deobfuscator.h"
 
+#include <stdio.h>
+
 #include <optional>
 #include "perfetto/base/status.h"
-#include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_splitter.h"
+#include "perfetto/ext/base/string_view.h"
 
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "protos/perfetto/trace/profiling/deobfuscation.pbzero.h"
@@ -36,42 +38,53 @@ struct ProguardClass {
   std::string deobfuscated_name;
 };
 
-std::optional<ProguardClass> ParseClass(std::string line) {
-  base::StringSplitter ss(std::move(line), ' ');
+// Size of the chunks proguard map files are read in.
+constexpr size_t kReadChunkSize = 1024 * 1024;
+
+// Splits off the next space-separated word of |*line|. Like
+// base::StringSplitter, runs of spaces are skipped. Returns an empty view when
+// there are no more words.
+base::StringView NextWord(base::StringView* line) {
+  size_t begin = 0;
+  while (begin < line->size() && line->at(begin) == ' ')
+    begin++;
+  size_t end = line->find(' ', begin);
+  if (end == base::StringView::npos)
+    end = line->size();
+  base::StringView word = line->substr(begin, end - begin);
+  *line = line->substr(end);
+  return word;
+}
 
-  if (!ss.Next()) {
+std::optional<ProguardClass> ParseClass(base::StringView line) {
+  base::StringView deobfuscated_name = NextWord(&line);
+  if (deobfuscated_name.empty()) {
     PERFETTO_ELOG("Missing deobfuscated name.");
     return std::nullopt;
   }
-  std::string deobfuscated_name(ss.cur_token(), ss.cur_token_size());
 
-  if (!ss.Next() || ss.cur_token_size() != 2 ||
-      strncmp("->", ss.cur_token(), 2) != 0) {
+  if (NextWord(&line) != base::StringView("->")) {
     PERFETTO_ELOG("Missing ->");
     return std::nullopt;
   }
 
-  if (!ss.Next()) {
-    PERFETTO_ELOG("Missing obfuscated name.");
-    return std::nullopt;
-  }
-  std::string obfuscated_name(ss.cur_token(), ss.cur_token_size());
+  base::StringView obfuscated_name = NextWord(&line);
   if (obfuscated_name.empty()) {
-    PERFETTO_ELOG("Empty obfuscated name.");
+    PERFETTO_ELOG("Missing obfuscated name.");
     return std::nullopt;
   }
-  if (obfuscated_name.back() != ':') {
+  if (obfuscated_name.at(obfuscated_name.size() - 1) != ':') {
     PERFETTO_ELOG("Expected colon.");
     return std::nullopt;
   }
 
-  obfuscated_name.resize(obfuscated_name.size() - 1);
-  if (ss.Next()) {
+  obfuscated_name = obfuscated_name.substr(0, obfuscated_name.size() - 1);
+  if (!NextWord(&line).empty()) {
     PERFETTO_ELOG("Unexpected data.");
     return std::nullopt;
   }
-  return ProguardClass{std::move(obfuscated_name),
-                       std::move(deobfuscated_name)};
+  return ProguardClass{obfuscated_name.ToStdString(),
+                       deobfuscated_name.ToStdString()};
 }
 
 enum class ProguardMemberType {
@@ -85,52 +98,87 @@ struct ProguardMember {
   std::string deobfuscated_name;
 };
 
-std::optional<ProguardMember> ParseMember(std::string line) {
-  base::StringSplitter ss(std::move(line), ' ');
-
-  if (!ss.Next()) {
+std::optional<ProguardMember> ParseMember(base::StringView line) {
+  base::StringView type_name = NextWord(&line);
+  if (type_name.empty()) {
     PERFETTO_ELOG("Missing type name.");
     return std::nullopt;
   }
-  std::string type_name(ss.cur_token(), ss.cur_token_size());
 
-  if (!ss.Next()) {
+  base::StringView deobfuscated_name = NextWord(&line);
+  if (deobfuscated_name.empty()) {
     PERFETTO_ELOG("Missing deobfuscated name.");
     return std::nullopt;
   }
-  std::string deobfuscated_name(ss.cur_token(), ss.cur_token_size());
 
-  if (!ss.Next() || ss.cur_token_size() != 2 ||
-      strncmp("->", ss.cur_token(), 2) != 0) {
+  if (NextWord(&line) != base::StringView("->")) {
     PERFETTO_ELOG("Missing ->");
     return std::nullopt;
   }
 
-  if (!ss.Next()) {
+  base::StringView obfuscated_name = NextWord(&line);
+  if (obfuscated_name.empty()) {
     PERFETTO_ELOG("Missing obfuscated name.");
     return std::nullopt;
   }
-  std::string obfuscated_name(ss.cur_token(), ss.cur_token_size());
 
-  if (ss.Next()) {
+  if (!NextWord(&line).empty()) {
     PERFETTO_ELOG("Unexpected data.");
     return std::nullopt;
   }
 
   ProguardMemberType member_type;
   auto paren_idx = deobfuscated_name.find('(');
-  if (paren_idx != std::string::npos) {
+  if (paren_idx != base::StringView::npos) {
     member_type = ProguardMemberType::kMethod;
     deobfuscated_name = deobfuscated_name.substr(0, paren_idx);
-    auto colon_idx = type_name.find(':');
-    if (colon_idx != std::string::npos) {
-      type_name = type_name.substr(colon_idx + 1);
-    }
   } else {
     member_type = ProguardMemberType::kField;
   }
-  return ProguardMember{member_type, std::move(obfuscated_name),
-                        std::move(deobfuscated_name)};
+  return ProguardMember{member_type, obfuscated_name.ToStdString(),
+                        deobfuscated_name.ToStdString()};
+}
+
+// Feeds the proguard map in |f| to |parser| line by line, without holding
+// more than a chunk of the file in memory.
+bool ParseProguardMapFile(FILE* f, ProguardParser* parser) {
+  std::string buf;
+  size_t lineno = 1;
+  for (;;) {
+    size_t old_size = buf.size();
+    buf.resize(old_size + kReadChunkSize);
+    size_t rd = fread(&buf[old_size], 1, kReadChunkSize, f);
+    buf.resize(old_size + rd);
+    if (rd == 0 && ferror(f)) {
+      PERFETTO_PLOG("Failed to read proguard map");
+      return false;
+    }
+    bool eof = rd == 0;
+
+    // Only complete lines are parsed, the remainder is kept for the next
+    // chunk. At the end of the file, the remainder is the last line.
+    size_t line_start = 0;
+    while (line_start < buf.size()) {
+      size_t line_end = buf.find('\n', line_start);
+      if (line_end == std::string::npos) {
+        if (!eof)
+          break;
+        line_end = buf.size();
+      }
+      auto status = parser->AddLine(
+          base::StringView(buf.data() + line_start, line_end - line_start));
+      if (!status.ok()) {
+        PERFETTO_ELOG("Failed to parse proguard map (line %zu): %s", lineno,
+                      status.c_message());
+        return false;
+      }
+      lineno++;
+      line_start = line_end + 1;
+    }
+    if (eof)
+      return true;
+    buf.erase(0, line_start);
+  }
 }
 
 std::string FlattenMethods(const std::vector<std::string>& v) {
@@ -158,18 +206,22 @@ std::string FlattenClasses(
 
 // See https://www.guardsquare.com/en/products/proguard/manual/retrace for the
 // file format we are parsing.
-base::Status ProguardParser::AddLine(std::string line) {
-  auto first_ch_pos = line.find_first_not_of(" \t");
-  if (first_ch_pos == std::string::npos || line[first_ch_pos] == '#')
+base::Status ProguardParser::AddLine(base::StringView line) {
+  size_t first_ch_pos = 0;
+  while (first_ch_pos < line.size() &&
+         (line.at(first_ch_pos) == ' ' || line.at(first_ch_pos) == '\t')) {
+    first_ch_pos++;
+  }
+  if (first_ch_pos == line.size() || line.at(first_ch_pos) == '#')
     return base::Status();
 
-  bool is_member = line[0] == ' ';
+  bool is_member = line.at(0) == ' ';
   if (is_member && !current_class_) {
     return base::Status(
         "Failed to parse proguard map. Saw member before class.");
   }
   if (!is_member) {
-    auto opt_cls = ParseClass(std::move(line));
+    auto opt_cls = ParseClass(line);
     if (!opt_cls)
       return base::Status("Class not found.");
     auto p = mapping_.emplace(std::move(opt_cls->obfuscated_name),
@@ -179,7 +231,7 @@ base::Status ProguardParser::AddLine(std::string line) {
     }
     current_class_ = &p.first->second;
   } else {
-    auto opt_member = ParseMember(std::move(line));
+    auto opt_member = ParseMember(line);
     if (!opt_member)
       return base::Status("Failed to parse member.");
     switch (opt_member->type) {
@@ -206,7 +258,8 @@ base::Status ProguardParser::AddLine(std::string line) {
 bool ProguardParser::AddLines(std::string contents) {
   size_t lineno = 1;
   for (base::StringSplitter lines(std::move(contents), '\n'); lines.Next();) {
-    auto status = AddLine(lines.cur_token());
+    auto status =
+        AddLine(base::StringView(lines.cur_token(), lines.cur_token_size()));
     if (!status.ok()) {
       PERFETTO_ELOG("Failed to parse proguard map (line %zu): %s", lineno,
                     status.c_message());
@@ -263,9 +316,7 @@ bool ReadProguardMapsToDeobfuscationPackets(
       return false;
     }
     profiling::ProguardParser parser;
-    std::string contents;
-    PERFETTO_CHECK(base::ReadFileStream(*f, &contents));
-    if (!parser.AddLines(std::move(contents))) {
+    if (!ParseProguardMapFile(*f, &parser)) {
       PERFETTO_ELOG("Failed to parse %s", filename);
       return false;
     }
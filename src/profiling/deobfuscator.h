@@ -23,6 +23,7 @@
 #include <utility>
 #include <vector>
 #include "perfetto/base/status.h"
+#include "perfetto/ext/base/string_view.h"
 
 namespace perfetto {
 namespace profiling {
@@ -91,7 +92,7 @@ class ProguardParser {
  public:
   // A return value of false means this line failed to parse. This leaves the
   // parser in an undefined state and it should no longer be used.
-  base::Status AddLine(std::string line);
+  base::Status AddLine(base::StringView line);
   bool AddLines(std::string contents);
 
   std::map<std::string, ObfuscatedClass> ConsumeMapping() {
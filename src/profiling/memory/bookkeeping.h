@@ -117,9 +117,18 @@ class HeapTracker {
       CallstackTotalAllocations totals;
     } value = {};
 
+    // Holds a reference to |node|, released by the HeapTracker when this is
+    // destroyed.
     GlobalCallstackTrie::Node* const node;
 
-    ~CallstackAllocations() { GlobalCallstackTrie::DecrementNode(node); }
+    // Value of op_count() when this was last passed to the callback of
+    // GetCallstackAllocations. Only used if not in dump_at_max_mode.
+    uint64_t dumped_op_count = 0;
+
+    // Only grows, so this changes whenever |value.totals| does.
+    uint64_t op_count() const {
+      return value.totals.allocation_count + value.totals.free_count;
+    }
 
     bool operator<(const CallstackAllocations& other) const {
       return node < other.node;
@@ -129,6 +138,7 @@ class HeapTracker {
   // Caller needs to ensure that callsites outlives the HeapTracker.
   explicit HeapTracker(GlobalCallstackTrie* callsites, bool dump_at_max_mode)
       : callsites_(callsites), dump_at_max_mode_(dump_at_max_mode) {}
+  ~HeapTracker();
 
   void RecordMalloc(const std::vector<unwindstack::FrameData>& callstack,
                     const std::vector<std::string>& build_ids,
@@ -138,8 +148,11 @@ class HeapTracker {
                     uint64_t sequence_number,
                     uint64_t timestamp);
 
+  // Calls |fn| for the CallstackAllocations of all callstacks. If
+  // |only_changed| is true (and this is not in dump_at_max_mode), skips the
+  // ones whose totals have not changed since the previous call.
   template <typename F>
-  void GetCallstackAllocations(F fn) {
+  void GetCallstackAllocations(F fn, bool only_changed = false) {
     // There are two reasons we remove the unused callstack allocations on the
     // next iteration of Dump:
     // * We need to remove them after the callstacks were dumped, which
@@ -160,6 +173,7 @@ class HeapTracker {
         // TODO(fmayer): We could probably be smarter than throw away
         // our whole frames cache.
         ClearFrameCache();
+        callsites_->DecrementNode(alloc.node);
         callstack_allocations_.erase(it);
       }
     }
@@ -167,8 +181,13 @@ class HeapTracker {
 
     for (auto it = callstack_allocations_.begin();
          it != callstack_allocations_.end(); ++it) {
-      const CallstackAllocations& alloc = it->second;
-      fn(alloc);
+      CallstackAllocations& alloc = it->second;
+      if (dump_at_max_mode_) {
+        fn(alloc);
+      } else if (!only_changed || alloc.op_count() != alloc.dumped_op_count) {
+        fn(alloc);
+        alloc.dumped_op_count = alloc.op_count();
+      }
 
       if (alloc.allocs == 0)
         dead_callstack_allocations_.emplace_back(
@@ -258,7 +277,7 @@ class HeapTracker {
       GlobalCallstackTrie::Node* node) {
     auto callstack_allocations_it = callstack_allocations_.find(node);
     if (callstack_allocations_it == callstack_allocations_.end()) {
-      GlobalCallstackTrie::IncrementNode(node);
+      callsites_->IncrementNode(node);
       bool inserted;
       std::tie(callstack_allocations_it, inserted) =
           callstack_allocations_.emplace(node, node);
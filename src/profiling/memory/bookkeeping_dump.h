@@ -54,6 +54,9 @@ class DumpState {
   DumpState(DumpState&&) = delete;
   DumpState& operator=(DumpState&&) = delete;
 
+  // Writes the header of the process (as filled in by process_fill_header),
+  // even if no allocations get written for it.
+  void WriteProcessHeader() { GetCurrentProcessHeapSamples(); }
   void WriteAllocation(const HeapTracker::CallstackAllocations& alloc,
                        bool dump_at_max_mode);
   void DumpCallstacks(GlobalCallstackTrie* callsites);
@@ -306,6 +306,85 @@ TEST(BookkeepingTest, ArbitraryOrder) {
   } while (std::next_permutation(std::begin(operations), std::end(operations)));
 }
 
+TEST(BookkeepingTest, OnlyChangedCallstackAllocations) {
+  GlobalCallstackTrie c;
+  HeapTracker hd(&c, false);
+  auto count_changed = [&hd] {
+    size_t changed = 0;
+    hd.GetCallstackAllocations(
+        [&changed](const HeapTracker::CallstackAllocations&) { changed++; },
+        /*only_changed=*/true);
+    return changed;
+  };
+
+  hd.RecordMalloc(stack(), DummyBuildIds(stack().size()), 0x1, 5, 5, 1, 100);
+  hd.RecordMalloc(stack2(), DummyBuildIds(stack2().size()), 0x2, 2, 2, 2,
+                  200);
+  EXPECT_EQ(count_changed(), 2u);
+  EXPECT_EQ(count_changed(), 0u);
+
+  hd.RecordFree(0x2, 3, 300);
+  EXPECT_EQ(count_changed(), 1u);
+  EXPECT_EQ(count_changed(), 0u);
+
+  // Without only_changed, all callstacks are still reported.
+  size_t all = 0;
+  hd.GetCallstackAllocations(
+      [&all](const HeapTracker::CallstackAllocations&) { all++; });
+  EXPECT_EQ(all, 1u);
+}
+
+TEST(BookkeepingTest, CallsitesReleasedWithHeapTracker) {
+  GlobalCallstackTrie c;
+  {
+    HeapTracker hd(&c, false);
+    hd.RecordMalloc(stack(), DummyBuildIds(stack().size()), 0x1, 5, 5, 1, 1);
+    hd.RecordMalloc(stack2(), DummyBuildIds(stack2().size()), 0x2, 2, 2, 2,
+                    2);
+    // fun2 -> fun1 and fun3 -> fun1.
+    EXPECT_EQ(c.node_count_for_testing(), 4u);
+  }
+  EXPECT_EQ(c.node_count_for_testing(), 0u);
+}
+
+TEST(BookkeepingTest, UnreferencedCallsitesDeletedWithParent) {
+  GlobalCallstackTrie c;
+  std::vector<unwindstack::FrameData> s = stack();
+  GlobalCallstackTrie::Node* leaf =
+      c.CreateCallsite(s, DummyBuildIds(s.size()));
+  s.erase(s.begin());
+  GlobalCallstackTrie::Node* parent =
+      c.CreateCallsite(s, DummyBuildIds(s.size()));
+  EXPECT_EQ(c.node_count_for_testing(), 2u);
+  EXPECT_EQ(c.BuildInverseCallstack(leaf).size(), 2u);
+  EXPECT_EQ(c.BuildInverseCallstack(leaf)[0]->function_name.data(), "fun1");
+  EXPECT_EQ(c.BuildInverseCallstack(leaf)[1]->function_name.data(), "fun2");
+
+  c.IncrementNode(parent);
+  c.DecrementNode(parent);
+  EXPECT_EQ(c.node_count_for_testing(), 0u);
+}
+
+TEST(BookkeepingTest, CallsiteIdsNotReused) {
+  GlobalCallstackTrie c;
+  GlobalCallstackTrie::Node* node =
+      c.CreateCallsite(stack(), DummyBuildIds(stack().size()));
+  uint64_t id = node->id();
+  c.IncrementNode(node);
+  c.DecrementNode(node);
+
+  node = c.CreateCallsite(stack(), DummyBuildIds(stack().size()));
+  EXPECT_GT(node->id(), id);
+  id = node->id();
+
+  c.ClearTrie();
+  EXPECT_EQ(c.node_count_for_testing(), 0u);
+  node = c.CreateCallsite(stack(), DummyBuildIds(stack().size()));
+  EXPECT_GT(node->id(), id);
+  EXPECT_EQ(c.node_count_for_testing(), 2u);
+  c.ClearTrie();
+}
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
@@ -64,6 +64,75 @@ bool Contained(const StackRange& base, const char* ptr) {
   return (ptr >= base.begin && ptr < base.end);
 }
 
+// Maximum number of return addresses sent per sample when the client walks its
+// own callstack. Deeper callstacks get truncated.
+constexpr size_t kMaxClientFrames = 128;
+
+#if defined(__clang__) && defined(__aarch64__)
+#if __has_feature(shadow_call_stack)
+#define PERFETTO_HEAPPROFD_SHADOW_CALL_STACK
+#endif
+#endif
+
+// Walks the chain of frame records starting at |fp|. On x86, x86_64 and arm64
+// the frame pointer points to {caller's frame pointer, return address}. arm32
+// and riscv64 use different layouts depending on the compiler, so they are not
+// supported.
+__attribute__((no_sanitize("address", "hwaddress"))) size_t WalkFramePointers(
+    const char* fp,
+    const char* stackend,
+    uint64_t* pcs,
+    size_t max_pcs) {
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+  size_t num_pcs = 0;
+  while (num_pcs < max_pcs) {
+    if (reinterpret_cast<uintptr_t>(fp) % alignof(uintptr_t) != 0 ||
+        fp + 2 * sizeof(uintptr_t) > stackend) {
+      break;
+    }
+    const uintptr_t* record = reinterpret_cast<const uintptr_t*>(fp);
+    if (record[1] == 0)
+      break;
+    pcs[num_pcs++] = record[1];
+    // Callers' frames are at higher addresses. Anything else means the chain
+    // got broken by code that uses the frame pointer as a general register.
+    const char* next_fp = reinterpret_cast<const char*>(record[0]);
+    if (next_fp <= fp)
+      break;
+    fp = next_fp;
+  }
+  return num_pcs;
+#else
+  base::ignore_result(fp, stackend, pcs, max_pcs);
+  return 0;
+#endif
+}
+
+// Copies the return addresses from the shadow call stack, innermost first.
+// Only available if the client itself was built with -fsanitize=shadow-call-
+// stack, otherwise x18 is not guaranteed to point to it.
+size_t ReadShadowCallStack(uint64_t* pcs, size_t max_pcs) {
+#if defined(PERFETTO_HEAPPROFD_SHADOW_CALL_STACK)
+  // bionic allocates each thread's shadow call stack aligned to its size,
+  // which is at least this. Masking with a smaller alignment than the real one
+  // can only truncate the outermost frames, never read out of bounds.
+  constexpr uintptr_t kShadowCallStackAlignment = 8 * 1024;
+  uintptr_t scs;
+  asm volatile("mov %0, x18" : "=r"(scs));
+  const uintptr_t* base = reinterpret_cast<const uintptr_t*>(
+      scs & ~(kShadowCallStackAlignment - 1));
+  // x18 points to the next free slot.
+  const uintptr_t* top = reinterpret_cast<const uintptr_t*>(scs);
+  size_t num_pcs = 0;
+  while (top > base && num_pcs < max_pcs)
+    pcs[num_pcs++] = *--top;
+  return num_pcs;
+#else
+  base::ignore_result(pcs, max_pcs);
+  return 0;
+#endif
+}
+
 }  // namespace
 
 uint64_t GetMaxTries(const ClientConfiguration& client_config) {
@@ -383,6 +452,15 @@ bool Client::RecordMalloc(uint32_t heap_id,
       1 + sequence_number_[heap_id].fetch_add(1, std::memory_order_acq_rel);
   metadata.heap_id = heap_id;
 
+  // Send the buffered frees first, so heapprofd gets all the frees that
+  // happened before this allocation in order. This is best effort, heapprofd
+  // reorders operations by sequence number anyway.
+  if (client_config_.batch_frees) {
+    ScopedSpinlock s(&free_batch_lock_, ScopedSpinlock::Mode::Try);
+    if (s.locked() && !FlushFreeBatchLocked())
+      return false;
+  }
+
   struct timespec ts;
   if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0) {
     metadata.clock_monotonic_coarse_timestamp =
@@ -391,11 +469,38 @@ bool Client::RecordMalloc(uint32_t heap_id,
     metadata.clock_monotonic_coarse_timestamp = 0;
   }
 
+  // If the configured client-side unwinding is not available on this build,
+  // fall back to sending the stack.
+  uint64_t pcs[kMaxClientFrames];
+  size_t num_pcs = 0;
+  switch (client_config_.client_unwinding) {
+    case ClientUnwinding::kRawStack:
+    case ClientUnwinding::kRemoteStack:
+      break;
+    case ClientUnwinding::kFramePointers:
+      num_pcs = WalkFramePointers(stackptr, stackend, pcs, kMaxClientFrames);
+      break;
+    case ClientUnwinding::kShadowCallStack:
+      num_pcs = ReadShadowCallStack(pcs, kMaxClientFrames);
+      break;
+  }
+
   WireMessage msg{};
-  msg.record_type = RecordType::Malloc;
   msg.alloc_header = &metadata;
-  msg.payload = const_cast<char*>(stackptr);
-  msg.payload_size = static_cast<size_t>(stack_size);
+  if (num_pcs > 0) {
+    msg.record_type = RecordType::MallocPcs;
+    msg.payload = reinterpret_cast<char*>(pcs);
+    msg.payload_size = num_pcs * sizeof(uint64_t);
+  } else if (client_config_.client_unwinding == ClientUnwinding::kRemoteStack &&
+             stack_size > kRemoteStackCopySize) {
+    msg.record_type = RecordType::MallocRemoteStack;
+    msg.payload = const_cast<char*>(stackptr);
+    msg.payload_size = kRemoteStackCopySize;
+  } else {
+    msg.record_type = RecordType::Malloc;
+    msg.payload = const_cast<char*>(stackptr);
+    msg.payload_size = static_cast<size_t>(stack_size);
+  }
 
   if (SendWireMessageWithRetriesIfBlocking(msg) == -1)
     return false;
@@ -432,13 +537,56 @@ bool Client::RecordFree(uint32_t heap_id, const uint64_t alloc_address) {
   }
 
   FreeEntry current_entry;
-  current_entry.sequence_number =
-      1 + sequence_number_[heap_id].fetch_add(1, std::memory_order_acq_rel);
   current_entry.addr = alloc_address;
   current_entry.heap_id = heap_id;
+
+  if (!client_config_.batch_frees) {
+    current_entry.sequence_number =
+        1 + sequence_number_[heap_id].fetch_add(1, std::memory_order_acq_rel);
+    return SendFreeEntries(&current_entry, 1);
+  }
+
+  ScopedSpinlock s(&free_batch_lock_, ScopedSpinlock::Mode::Try);
+  // The sequence number is taken under the lock, so that a RecordMalloc that
+  // flushes the batch after taking its own sequence number also sends all the
+  // frees that precede it.
+  current_entry.sequence_number =
+      1 + sequence_number_[heap_id].fetch_add(1, std::memory_order_acq_rel);
+  if (PERFETTO_UNLIKELY(!s.locked()))
+    return SendFreeEntries(&current_entry, 1);
+
+  int64_t now_ms = 0;
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0)
+    now_ms = base::FromPosixTimespec(ts).count() / 1000000;
+  if (free_batch_size_ == 0)
+    free_batch_start_ms_ = now_ms;
+  free_batch_[free_batch_size_++] = current_entry;
+  if (free_batch_size_ == kFreeBatchSize ||
+      now_ms - free_batch_start_ms_ >= kFreeBatchMaxAgeMs) {
+    return FlushFreeBatchLocked();
+  }
+  return true;
+}
+
+bool Client::FlushFreeBatchLocked() {
+  if (free_batch_size_ == 0)
+    return true;
+  size_t num_entries = free_batch_size_;
+  free_batch_size_ = 0;
+  return SendFreeEntries(free_batch_, num_entries);
+}
+
+bool Client::SendFreeEntries(const FreeEntry* entries, size_t num_entries) {
   WireMessage msg = {};
-  msg.record_type = RecordType::Free;
-  msg.free_header = &current_entry;
+  if (num_entries == 1) {
+    msg.record_type = RecordType::Free;
+    msg.free_header = const_cast<FreeEntry*>(entries);
+  } else {
+    msg.record_type = RecordType::FreeBatch;
+    msg.payload = reinterpret_cast<char*>(const_cast<FreeEntry*>(entries));
+    msg.payload_size = num_entries * sizeof(FreeEntry);
+  }
   // Do not send control socket byte, as frees are very cheap to handle, so we
   // just delay to the next alloc. Sending the control socket byte is ~10x the
   // rest of the client overhead.
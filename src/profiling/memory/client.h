@@ -28,6 +28,7 @@
 #include "perfetto/base/compiler.h"
 #include "perfetto/ext/base/unix_socket.h"
 #include "src/profiling/memory/sampler.h"
+#include "src/profiling/memory/scoped_spinlock.h"
 #include "src/profiling/memory/shared_ring_buffer.h"
 #include "src/profiling/memory/unhooked_allocator.h"
 #include "src/profiling/memory/wire_protocol.h"
@@ -48,6 +49,17 @@ StackRange GetMainThreadStackRange();
 constexpr uint64_t kInfiniteTries = 0;
 constexpr uint32_t kClientSockTimeoutMs = 1000;
 
+// With ClientUnwinding::kRemoteStack, how many bytes of the top of the stack
+// are copied.
+constexpr size_t kRemoteStackCopySize = 4096;
+
+// If ClientConfiguration.batch_frees is set, frees are buffered in the client,
+// and sent to heapprofd in batches of up to this many entries. A batch is also
+// sent when its oldest entry is older than kFreeBatchMaxAgeMs, and before any
+// sampled allocation.
+constexpr size_t kFreeBatchSize = 64;
+constexpr int64_t kFreeBatchMaxAgeMs = 100;
+
 uint64_t GetMaxTries(const ClientConfiguration& client_config);
 
 // Profiling client, used to sample and record the malloc/free family of calls,
@@ -122,6 +134,11 @@ class Client {
 
   bool IsPostFork();
 
+  // Sends the frees buffered in |free_batch_|. Requires |free_batch_lock_|.
+  bool FlushFreeBatchLocked() PERFETTO_WARN_UNUSED_RESULT;
+  bool SendFreeEntries(const FreeEntry* entries,
+                       size_t num_entries) PERFETTO_WARN_UNUSED_RESULT;
+
   ClientConfiguration client_config_;
   uint64_t max_shmem_tries_;
   base::UnixSocketRaw sock_;
@@ -131,6 +148,11 @@ class Client {
       sequence_number_[base::ArraySize(ClientConfiguration{}.heaps)] = {};
   SharedRingBuffer shmem_;
 
+  Spinlock free_batch_lock_{};
+  FreeEntry free_batch_[kFreeBatchSize];
+  size_t free_batch_size_ = 0;
+  int64_t free_batch_start_ms_ = 0;
+
   // Used to detect (during the slow path) the situation where the process has
   // forked during profiling, and is performing malloc operations in the child.
   // In this scenario, we want to stop profiling in the child, as otherwise
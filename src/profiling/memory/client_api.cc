@@ -380,6 +380,10 @@ AHeapProfile_reportAllocation(uint32_t heap_id, uint64_t id, uint64_t size) {
   if (!heap.enabled.load(std::memory_order_acquire)) {
     return false;
   }
+  // Most allocations are not sampled, and can be accounted for without taking
+  // the lock.
+  if (PERFETTO_LIKELY(heap.sampler.SkipUnsampled(static_cast<size_t>(size))))
+    return false;
   size_t sampled_alloc_sz = 0;
   std::shared_ptr<perfetto::profiling::Client> client;
   {
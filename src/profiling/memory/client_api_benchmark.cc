@@ -131,6 +131,29 @@ static void BM_ClientApiAlmostNoAllocation(benchmark::State& state) {
 
 BENCHMARK(BM_ClientApiAlmostNoAllocation);
 
+// Same as above, but with allocation sizes closer to the real ones. Measures
+// the lock-free path taken by allocations that are not sampled.
+static void BM_ClientApiUnsampledAllocation(benchmark::State& state) {
+  const uint32_t heap_id = GetHeapId();
+
+  ClientConfiguration client_config{};
+  client_config.default_interval = 10000000000000000;
+  client_config.all_heaps = true;
+  g_client_config = client_config;
+  PERFETTO_CHECK(AHeapProfile_initSession(malloc, free));
+
+  PERFETTO_CHECK(g_shmem_fd);
+  auto ringbuf = SharedRingBuffer::Attach(base::ScopedFile(dup(g_shmem_fd)));
+
+  for (auto _ : state) {
+    AHeapProfile_reportAllocation(heap_id, 0x123, 64);
+  }
+  DisconnectGlobalServerSocket();
+  ringbuf->SetShuttingDown();
+}
+
+BENCHMARK(BM_ClientApiUnsampledAllocation);
+
 static void BM_ClientApiSample(benchmark::State& state) {
   const uint32_t heap_id = GetHeapId();
 
@@ -17,11 +17,15 @@
 #include "src/profiling/memory/client.h"
 
 #include <signal.h>
+#include <unistd.h>
 
 #include <thread>
+#include <tuple>
 
 #include "perfetto/base/thread_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/unix_socket.h"
+#include "src/profiling/memory/shared_ring_buffer.h"
 #include "src/profiling/memory/wire_protocol.h"
 #include "test/gtest_and_gmock.h"
 
@@ -142,6 +146,43 @@ TEST(ClientTest, GetMaxTriesNoBlock) {
   EXPECT_EQ(GetMaxTries(cfg), 1u);
 }
 
+TEST(ClientTest, BatchFrees) {
+  base::UnixSocketRaw cli_sock;
+  base::UnixSocketRaw srv_sock;
+  std::tie(cli_sock, srv_sock) = base::UnixSocketRaw::CreatePairPosix(
+      base::SockFamily::kUnix, base::SockType::kStream);
+  ASSERT_TRUE(cli_sock);
+  auto shmem = SharedRingBuffer::Create(8 * 4096);
+  ASSERT_TRUE(shmem);
+  auto reader = SharedRingBuffer::Attach(base::ScopedFile(dup(shmem->fd())));
+  ASSERT_TRUE(reader);
+
+  ClientConfiguration cfg = {};
+  cfg.batch_frees = true;
+  Client client(std::move(cli_sock), cfg, std::move(*shmem), getpid(),
+                GetMainThreadStackRange());
+
+  for (uint64_t i = 0; i < kFreeBatchSize - 1; ++i)
+    ASSERT_TRUE(client.RecordFree(0, 0x1000 + i));
+  // Buffered in the client.
+  EXPECT_FALSE(reader->BeginRead());
+
+  ASSERT_TRUE(client.RecordFree(0, 0x1000 + kFreeBatchSize - 1));
+  auto buf = reader->BeginRead();
+  ASSERT_TRUE(buf);
+  WireMessage msg;
+  ASSERT_TRUE(ReceiveWireMessage(reinterpret_cast<char*>(buf.data), buf.size,
+                                 &msg));
+  EXPECT_EQ(msg.record_type, RecordType::FreeBatch);
+  ASSERT_EQ(msg.payload_size, kFreeBatchSize * sizeof(FreeEntry));
+  const FreeEntry* entries = reinterpret_cast<const FreeEntry*>(msg.payload);
+  for (uint64_t i = 0; i < kFreeBatchSize; ++i) {
+    EXPECT_EQ(entries[i].sequence_number, i + 1);
+    EXPECT_EQ(entries[i].addr, 0x1000 + i);
+  }
+  reader->EndRead(std::move(buf));
+}
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
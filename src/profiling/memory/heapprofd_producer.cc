@@ -27,6 +27,8 @@
 #include <optional>
 #include <string>
 
+#include <unwindstack/Elf.h>
+
 #include "perfetto/base/compiler.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/file_utils.h"
@@ -113,6 +115,17 @@ bool IsFile(int fd, const char* fn) {
   return fdstat.st_ino == fnstat.st_ino;
 }
 
+// Libunwindstack's global Elf cache shares the parsed ELF files (including the
+// per-PC cache of CFI locations) between all the processes, and all the maps
+// reparses, that map the same library. The cache is only guarded against
+// concurrent lookups, not against being toggled, so this must only be called
+// while no unwinding worker is unwinding.
+void ResetAndEnableUnwindstackCache() {
+  PERFETTO_DLOG("Resetting unwindstack cache");
+  unwindstack::Elf::SetCachingEnabled(false);  // free any existing state
+  unwindstack::Elf::SetCachingEnabled(true);   // reallocate a fresh cache
+}
+
 protos::pbzero::ProfilePacket::ProcessHeapSamples::ClientError
 ErrorStateToProto(SharedRingBuffer::ErrorState state) {
   switch (state) {
@@ -141,6 +154,21 @@ bool HeapprofdConfigToClientConfiguration(
   cli_config->block_client_timeout_us =
       heapprofd_config.block_client_timeout_us();
   cli_config->all_heaps = heapprofd_config.all_heaps();
+  switch (heapprofd_config.client_unwinding()) {
+    case HeapprofdConfig::CLIENT_UNWINDING_UNSPECIFIED:
+      cli_config->client_unwinding = ClientUnwinding::kRawStack;
+      break;
+    case HeapprofdConfig::CLIENT_UNWINDING_FRAME_POINTERS:
+      cli_config->client_unwinding = ClientUnwinding::kFramePointers;
+      break;
+    case HeapprofdConfig::CLIENT_UNWINDING_SHADOW_CALL_STACK:
+      cli_config->client_unwinding = ClientUnwinding::kShadowCallStack;
+      break;
+    case HeapprofdConfig::CLIENT_UNWINDING_REMOTE_STACK:
+      cli_config->client_unwinding = ClientUnwinding::kRemoteStack;
+      break;
+  }
+  cli_config->batch_frees = heapprofd_config.batch_frees();
   cli_config->adaptive_sampling_shmem_threshold =
       heapprofd_config.adaptive_sampling_shmem_threshold();
   cli_config->adaptive_sampling_max_sampling_interval_bytes =
@@ -212,11 +240,28 @@ HeapprofdProducer::HeapprofdProducer(HeapprofdMode mode,
       socket_delegate_(this),
       weak_factory_(this),
       unwinding_workers_(MakeUnwindingWorkers(this, kUnwinderThreads)) {
+  // Each worker can spread the unwinding of a busy client over all the others.
+  for (size_t i = 0; i < unwinding_workers_.size(); ++i) {
+    std::vector<UnwindingWorker*> helpers;
+    for (size_t j = 0; j < unwinding_workers_.size(); ++j) {
+      if (j != i)
+        helpers.push_back(&unwinding_workers_[j]);
+    }
+    unwinding_workers_[i].SetHelperWorkers(std::move(helpers));
+  }
+  // No clients have been handed to the workers yet. Posting them later orders
+  // this before any use of the cache on the worker threads.
+  ResetAndEnableUnwindstackCache();
   CheckDataSourceCpuTask();
   CheckDataSourceMemoryTask();
 }
 
-HeapprofdProducer::~HeapprofdProducer() = default;
+HeapprofdProducer::~HeapprofdProducer() {
+  // Stop all workers from handing off work to each other before any of them
+  // gets destroyed.
+  for (UnwindingWorker& worker : unwinding_workers_)
+    worker.DisconnectAllClients();
+}
 
 void HeapprofdProducer::SetTargetProcess(pid_t target_pid,
                                          std::string target_cmdline) {
@@ -693,6 +738,8 @@ void HeapprofdProducer::SetStats(
   stats->set_heap_samples(process_state.heap_samples);
   stats->set_map_reparses(process_state.map_reparses);
   stats->set_total_unwinding_time_us(process_state.total_unwinding_time_us);
+  stats->set_remote_stack_samples(process_state.remote_stack_samples);
+  stats->set_remote_stack_changes(process_state.remote_stack_changes);
   stats->set_client_spinlock_blocked_us(
       process_state.client_spinlock_blocked_us);
   auto* unwinding_hist = stats->set_unwinding_time_us();
@@ -709,14 +756,17 @@ void HeapprofdProducer::SetStats(
 void HeapprofdProducer::DumpProcessState(DataSource* data_source,
                                          pid_t pid,
                                          ProcessState* process_state) {
+  bool incremental =
+      data_source->config.continuous_dump_config().incremental() &&
+      !data_source->config.dump_at_max();
   for (auto& heap_id_and_heap_info : process_state->heap_infos) {
     ProcessState::HeapInfo& heap_info = heap_id_and_heap_info.second;
 
     bool from_startup = data_source->signaled_pids.find(pid) ==
                         data_source->signaled_pids.cend();
 
-    auto new_heapsamples = [pid, from_startup, process_state, data_source,
-                            &heap_info](
+    auto new_heapsamples = [pid, from_startup, incremental, process_state,
+                            data_source, &heap_info](
                                ProfilePacket::ProcessHeapSamples* proto) {
       proto->set_pid(static_cast<uint64_t>(pid));
       proto->set_timestamp(heap_info.heap_tracker.dump_timestamp());
@@ -731,6 +781,8 @@ void HeapprofdProducer::DumpProcessState(DataSource* data_source,
         proto->set_heap_name(heap_info.heap_name.c_str());
       proto->set_sampling_interval_bytes(heap_info.sampling_interval);
       proto->set_orig_sampling_interval_bytes(heap_info.orig_sampling_interval);
+      if (incremental)
+        proto->set_incremental(true);
       auto* stats = proto->set_stats();
       SetStats(stats, *process_state);
     };
@@ -739,11 +791,16 @@ void HeapprofdProducer::DumpProcessState(DataSource* data_source,
                          std::move(new_heapsamples),
                          &data_source->intern_state);
 
+    // Incremental dumps can have no samples, but still need to report the
+    // state of the process.
+    if (incremental)
+      dump_state.WriteProcessHeader();
     heap_info.heap_tracker.GetCallstackAllocations(
         [&dump_state,
          &data_source](const HeapTracker::CallstackAllocations& alloc) {
           dump_state.WriteAllocation(alloc, data_source->config.dump_at_max());
-        });
+        },
+        incremental);
     dump_state.DumpCallstacks(&callsites_);
   }
 }
@@ -1090,6 +1147,10 @@ void HeapprofdProducer::HandleAllocRecord(AllocRecord* alloc_rec) {
     process_state.unwinding_errors++;
   if (alloc_rec->reparsed_map)
     process_state.map_reparses++;
+  if (alloc_rec->remote_stack)
+    process_state.remote_stack_samples++;
+  if (alloc_rec->remote_stack_changed)
+    process_state.remote_stack_changes++;
   process_state.heap_samples++;
   process_state.unwinding_time_us.Add(alloc_rec->unwinding_time_us);
   process_state.total_unwinding_time_us += alloc_rec->unwinding_time_us;
@@ -1196,6 +1257,11 @@ bool HeapprofdProducer::MaybeFinishDataSource(DataSource* ds) {
     if (was_stopped)
       weak_producer->endpoint_->NotifyDataSourceStopped(ds_id);
     weak_producer->data_sources_.erase(ds_id);
+    // Once the last data source is gone all its clients have been
+    // disconnected, so the workers are idle and the cache (which would
+    // otherwise grow with every library ever profiled) can be dropped.
+    if (weak_producer->data_sources_.empty())
+      ResetAndEnableUnwindstackCache();
 
     if (exit_when_done) {
       // Post this as a task to allow NotifyDataSourceStopped to post tasks.
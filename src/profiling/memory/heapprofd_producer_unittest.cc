@@ -218,5 +218,22 @@ TEST(HeapprofdConfigToClientConfigurationTest, AllHeapsAndDisabled) {
   EXPECT_EQ(cli_config.default_interval, 4096u);
 }
 
+TEST(HeapprofdConfigToClientConfigurationTest, ClientUnwinding) {
+  HeapprofdConfig cfg;
+  cfg.add_heaps("foo");
+  cfg.set_sampling_interval_bytes(4096);
+  ClientConfiguration cli_config;
+  ASSERT_TRUE(HeapprofdConfigToClientConfiguration(cfg, &cli_config));
+  EXPECT_EQ(cli_config.client_unwinding, ClientUnwinding::kRawStack);
+
+  cfg.set_client_unwinding(HeapprofdConfig::CLIENT_UNWINDING_FRAME_POINTERS);
+  ASSERT_TRUE(HeapprofdConfigToClientConfiguration(cfg, &cli_config));
+  EXPECT_EQ(cli_config.client_unwinding, ClientUnwinding::kFramePointers);
+
+  cfg.set_client_unwinding(HeapprofdConfig::CLIENT_UNWINDING_REMOTE_STACK);
+  ASSERT_TRUE(HeapprofdConfigToClientConfiguration(cfg, &cli_config));
+  EXPECT_EQ(cli_config.client_unwinding, ClientUnwinding::kRemoteStack);
+}
+
 }  // namespace profiling
 }  // namespace perfetto
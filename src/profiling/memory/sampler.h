@@ -39,13 +39,39 @@ std::default_random_engine& GetGlobalRandomEngineLocked();
 // https://cs.chromium.org/search/?q=f:cc+symbol:AllocatorShimLogAlloc+package:%5Echromium$&type=cs
 // Googlers: see go/chrome-shp for more details.
 //
-// NB: not thread-safe, requires external synchronization.
+// NB: not thread-safe, requires external synchronization. The only exception
+// is SkipUnsampled, see below.
 class Sampler {
  public:
   void SetSamplingInterval(uint64_t sampling_interval) {
-    sampling_interval_ = sampling_interval;
-    sampling_rate_ = 1.0 / static_cast<double>(sampling_interval_);
-    interval_to_next_sample_ = NextSampleInterval();
+    sampling_interval_.store(sampling_interval, std::memory_order_relaxed);
+    sampling_rate_ = 1.0 / static_cast<double>(sampling_interval);
+    interval_to_next_sample_.store(NextSampleInterval(),
+                                   std::memory_order_relaxed);
+  }
+
+  // Lock-free fast path for the allocations that do not contain any sampled
+  // byte, which are the vast majority. Unlike the other methods, this can be
+  // called without external synchronization.
+  //
+  // Returns true if |alloc_sz| has been accounted for and the allocation
+  // should not be sampled. Otherwise nothing has been accounted for, and the
+  // allocation needs to go through SampleSize.
+  bool SkipUnsampled(size_t alloc_sz) {
+    if (PERFETTO_UNLIKELY(alloc_sz >= sampling_interval_.load(
+                                          std::memory_order_relaxed)))
+      return false;
+    const int64_t sz = static_cast<int64_t>(alloc_sz);
+    int64_t interval = interval_to_next_sample_.load(std::memory_order_relaxed);
+    // Only ever moves the counter between two positive values, so this never
+    // crosses a sample, nor races with NumberOfSamples picking the next one.
+    while (PERFETTO_LIKELY(interval > sz)) {
+      if (interval_to_next_sample_.compare_exchange_weak(
+              interval, interval - sz, std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
   }
 
   // Returns number of bytes that should be be attributed to the sample.
@@ -54,12 +80,15 @@ class Sampler {
   // Due to how the poission sampling works, some samples should be accounted
   // multiple times.
   size_t SampleSize(size_t alloc_sz) {
-    if (PERFETTO_UNLIKELY(alloc_sz >= sampling_interval_))
+    const uint64_t sampling_interval = this->sampling_interval();
+    if (PERFETTO_UNLIKELY(alloc_sz >= sampling_interval))
       return alloc_sz;
-    return static_cast<size_t>(sampling_interval_ * NumberOfSamples(alloc_sz));
+    return static_cast<size_t>(sampling_interval * NumberOfSamples(alloc_sz));
   }
 
-  uint64_t sampling_interval() const { return sampling_interval_; }
+  uint64_t sampling_interval() const {
+    return sampling_interval_.load(std::memory_order_relaxed);
+  }
 
  private:
   int64_t NextSampleInterval() {
@@ -75,18 +104,27 @@ class Sampler {
   // Returns number of times a sample should be accounted. Due to how the
   // poission sampling works, some samples should be accounted multiple times.
   size_t NumberOfSamples(size_t alloc_sz) {
-    interval_to_next_sample_ -= alloc_sz;
+    // Atomic read-modify-writes, as SkipUnsampled can run concurrently.
+    int64_t interval =
+        interval_to_next_sample_.fetch_sub(static_cast<int64_t>(alloc_sz),
+                                           std::memory_order_relaxed) -
+        static_cast<int64_t>(alloc_sz);
     size_t num_samples = 0;
-    while (PERFETTO_UNLIKELY(interval_to_next_sample_ <= 0)) {
-      interval_to_next_sample_ += NextSampleInterval();
+    while (PERFETTO_UNLIKELY(interval <= 0)) {
+      int64_t next = NextSampleInterval();
+      interval = interval_to_next_sample_.fetch_add(
+                     next, std::memory_order_relaxed) +
+                 next;
       ++num_samples;
     }
     return num_samples;
   }
 
-  uint64_t sampling_interval_;
+  // No initializers, so that this stays trivially constructible and usable in
+  // statically allocated structs (see AHeapInfo in client_api.cc).
+  std::atomic<uint64_t> sampling_interval_;
   double sampling_rate_;
-  int64_t interval_to_next_sample_;
+  std::atomic<int64_t> interval_to_next_sample_;
 };
 
 }  // namespace profiling
@@ -17,6 +17,7 @@
 #include "src/profiling/memory/sampler.h"
 
 #include <thread>
+#include <vector>
 
 #include "test/gtest_and_gmock.h"
 
@@ -47,6 +48,45 @@ TEST(SamplerTest, TestSequence) {
   EXPECT_EQ(sampler.SampleSize(5), 5u);
 }
 
+TEST(SamplerTest, SkipUnsampledMatchesSampleSize) {
+  const size_t kSizes[] = {1, 8, 100, 511, 3, 4096, 250, 16, 64, 1000};
+
+  GetGlobalRandomEngineLocked().seed(1);
+  Sampler slow;
+  slow.SetSamplingInterval(512);
+  std::vector<size_t> expected;
+  for (int i = 0; i < 100; ++i) {
+    for (size_t sz : kSizes)
+      expected.push_back(slow.SampleSize(sz));
+  }
+
+  GetGlobalRandomEngineLocked().seed(1);
+  Sampler fast;
+  fast.SetSamplingInterval(512);
+  std::vector<size_t> actual;
+  size_t skipped = 0;
+  for (int i = 0; i < 100; ++i) {
+    for (size_t sz : kSizes) {
+      if (fast.SkipUnsampled(sz)) {
+        actual.push_back(0);
+        ++skipped;
+      } else {
+        actual.push_back(fast.SampleSize(sz));
+      }
+    }
+  }
+  EXPECT_EQ(actual, expected);
+  EXPECT_GT(skipped, 0u);
+}
+
+TEST(SamplerTest, SkipUnsampledNeverSkipsLarge) {
+  GetGlobalRandomEngineLocked().seed(1);
+  Sampler sampler;
+  sampler.SetSamplingInterval(512);
+  EXPECT_FALSE(sampler.SkipUnsampled(512));
+  EXPECT_FALSE(sampler.SkipUnsampled(1024));
+}
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
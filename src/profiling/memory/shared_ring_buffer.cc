@@ -24,6 +24,7 @@
 
 #include <atomic>
 #include <cinttypes>
+#include <cstring>
 #include <type_traits>
 
 #include "perfetto/base/build_config.h"
@@ -49,6 +50,12 @@ constexpr auto kGuardSize = base::kPageSize * 1024 * 16;  // 64 MB.
 constexpr auto kFDSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
 #endif
 
+// Stats written by lock-free writers can be updated concurrently.
+inline void AtomicAdd(uint64_t* stat, uint64_t value) {
+  reinterpret_cast<std::atomic<uint64_t>*>(stat)->fetch_add(
+      value, std::memory_order_relaxed);
+}
+
 }  // namespace
 
 SharedRingBuffer::SharedRingBuffer(CreateFlag, size_t size) {
@@ -92,6 +99,8 @@ SharedRingBuffer::SharedRingBuffer(CreateFlag, size_t size) {
     return;
 
   new (meta_) MetadataPage();
+  // The creator of the buffer is the reader, which zeroes what it consumes.
+  meta_->lock_free_writes.store(true, std::memory_order_relaxed);
 }
 
 SharedRingBuffer::~SharedRingBuffer() {
@@ -229,6 +238,54 @@ SharedRingBuffer::Buffer SharedRingBuffer::BeginWrite(
   return result;
 }
 
+SharedRingBuffer::Buffer SharedRingBuffer::BeginWriteLockFree(size_t size) {
+  PERFETTO_DCHECK(lock_free_writes());
+  Buffer result;
+
+  const uint64_t size_with_header =
+      base::AlignUp<kAlignment>(size + kHeaderSize);
+
+  // size_with_header < size is for catching overflow of size_with_header.
+  if (PERFETTO_UNLIKELY(size_with_header < size)) {
+    errno = EINVAL;
+    return result;
+  }
+
+  PointerPositions pos;
+  for (;;) {
+    // Load read_pos first: a stale read_pos only underestimates the free
+    // space, while a read_pos newer than write_pos would look corrupt.
+    pos.read_pos = meta_->read_pos.load(std::memory_order_acquire);
+    pos.write_pos = meta_->write_pos.load(std::memory_order_relaxed);
+    if (IsCorrupt(pos)) {
+      AtomicAdd(&meta_->stats.num_writes_corrupt, 1);
+      errno = EBADF;
+      return result;
+    }
+    if (size_with_header > write_avail(pos)) {
+      AtomicAdd(&meta_->stats.num_writes_overflow, 1);
+      errno = EAGAIN;
+      return result;
+    }
+    // The header of the reserved record is still zero from when the reader
+    // consumed that memory, so there is nothing to publish together with the
+    // new write_pos. The reader will not read past it until EndWrite.
+    uint64_t expected = pos.write_pos;
+    if (meta_->write_pos.compare_exchange_weak(
+            expected, pos.write_pos + size_with_header,
+            std::memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  result.size = size;
+  result.data = at(pos.write_pos) + kHeaderSize;
+  result.bytes_free = write_avail(pos);
+  AtomicAdd(&meta_->stats.bytes_written, size);
+  AtomicAdd(&meta_->stats.num_writes_succeeded, 1);
+  return result;
+}
+
 void SharedRingBuffer::EndWrite(Buffer buf) {
   if (!buf)
     return;
@@ -291,7 +348,12 @@ size_t SharedRingBuffer::EndRead(Buffer buf) {
   if (!buf)
     return 0;
   size_t size_with_header = base::AlignUp<kAlignment>(buf.size + kHeaderSize);
-  meta_->read_pos.fetch_add(size_with_header, std::memory_order_relaxed);
+  // Zero the record, so that any header a lock-free writer later reserves in
+  // this memory reads as not committed. This needs to be visible before the
+  // space is handed out, which is matched by the acquire load of read_pos in
+  // BeginWriteLockFree.
+  memset(buf.data - kHeaderSize, 0, size_with_header);
+  meta_->read_pos.fetch_add(size_with_header, std::memory_order_release);
   meta_->stats.num_reads_succeeded++;
   return size_with_header;
 }
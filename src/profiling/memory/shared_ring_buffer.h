@@ -123,8 +123,20 @@ class SharedRingBuffer {
   }
 
   Buffer BeginWrite(const ScopedSpinlock& spinlock, size_t size);
+  // Reserves space with a compare-and-swap on the write position instead of
+  // holding the spinlock. Only valid if lock_free_writes() is true, in which
+  // case all writers must use this instead of BeginWrite.
+  Buffer BeginWriteLockFree(size_t size);
   void EndWrite(Buffer buf);
 
+  // Whether the reader zeroes the records it consumed. This guarantees that
+  // the header of a record reserved by BeginWriteLockFree reads as "not yet
+  // committed" until EndWrite, without the writer having to clear it first
+  // under the spinlock.
+  bool lock_free_writes() const {
+    return meta_->lock_free_writes.load(std::memory_order_relaxed);
+  }
+
   Buffer BeginRead();
   // Returns the number bytes read from the shared memory buffer. This is
   // different than the number of bytes returned in the Buffer, because it
@@ -178,6 +190,10 @@ class SharedRingBuffer {
     return meta_->reader_paused.exchange(false, std::memory_order_relaxed);
   }
 
+  void SetLockFreeWritesForTesting(bool enabled) {
+    meta_->lock_free_writes.store(enabled, std::memory_order_relaxed);
+  }
+
   void InfiniteBufferForTesting() {
     // Pretend this buffer is really large, while keeping size_mask_ as
     // original so it keeps wrapping in circles.
@@ -205,9 +221,11 @@ class SharedRingBuffer {
     // When the user requests stats, the atomics above get copied into this
     // struct, which is then returned.
     alignas(sizeof(uint64_t)) Stats stats;
+    // Set by the reader on creation. See lock_free_writes().
+    alignas(sizeof(uint64_t)) std::atomic<bool> lock_free_writes;
   };
 
-  static_assert(sizeof(MetadataPage) == 144,
+  static_assert(sizeof(MetadataPage) == 152,
                 "metadata page size needs to be ABI independent");
 
  private:
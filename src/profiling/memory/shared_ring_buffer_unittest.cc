@@ -36,7 +36,9 @@ std::string ToString(const SharedRingBuffer::Buffer& buf_and_size) {
 
 bool TryWrite(SharedRingBuffer* wr, const char* src, size_t size) {
   SharedRingBuffer::Buffer buf;
-  {
+  if (wr->lock_free_writes()) {
+    buf = wr->BeginWriteLockFree(size);
+  } else {
     auto lock = wr->AcquireLock(ScopedSpinlock::Mode::Try);
     if (!lock.locked())
       return false;
@@ -186,11 +188,21 @@ TEST(SharedRingBufferTest, SingleThreadAttach) {
   StructuredTest(&*buf1, &*buf2);
 }
 
-TEST(SharedRingBufferTest, MultiThreadingTest) {
+TEST(SharedRingBufferTest, SingleThreadAttachSpinlock) {
+  constexpr auto kBufSize = base::kPageSize * 4;
+  std::optional<SharedRingBuffer> buf1 = SharedRingBuffer::Create(kBufSize);
+  std::optional<SharedRingBuffer> buf2 =
+      SharedRingBuffer::Attach(base::ScopedFile(dup(buf1->fd())));
+  buf1->SetLockFreeWritesForTesting(false);
+  StructuredTest(&*buf1, &*buf2);
+}
+
+void MultiThreadedTest(bool lock_free_writes) {
   constexpr auto kBufSize = base::kPageSize * 1024;  // 4 MB
   SharedRingBuffer rd = *SharedRingBuffer::Create(kBufSize);
   SharedRingBuffer wr =
       *SharedRingBuffer::Attach(base::ScopedFile(dup(rd.fd())));
+  wr.SetLockFreeWritesForTesting(lock_free_writes);
 
   std::mutex mutex;
   std::unordered_map<std::string, int64_t> expected_contents;
@@ -252,6 +264,17 @@ TEST(SharedRingBufferTest, MultiThreadingTest) {
   writers_enabled.store(false);
 
   reader_thread.join();
+
+  for (const auto& it : expected_contents)
+    EXPECT_EQ(it.second, 0);
+}
+
+TEST(SharedRingBufferTest, MultiThreadingTest) {
+  MultiThreadedTest(/*lock_free_writes=*/true);
+}
+
+TEST(SharedRingBufferTest, MultiThreadingTestSpinlock) {
+  MultiThreadedTest(/*lock_free_writes=*/false);
 }
 
 TEST(SharedRingBufferTest, InvalidSize) {
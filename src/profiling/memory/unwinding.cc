@@ -16,9 +16,11 @@
 
 #include "src/profiling/memory/unwinding.h"
 
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <condition_variable>
 #include <mutex>
 
@@ -49,6 +51,7 @@
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/thread_task_runner.h"
 
 #include "src/profiling/memory/unwound_messages.h"
@@ -63,6 +66,9 @@ constexpr uint32_t kRetryDelayMs = 100;
 
 constexpr size_t kMaxFrames = 500;
 
+// Userspace addresses on arm64 Linux are at most 48 bits wide.
+constexpr uint64_t kArm64AddressMask = (uint64_t{1} << 48) - 1;
+
 // We assume average ~300us per unwind. If we handle up to 1000 unwinds, this
 // makes sure other tasks get to be run at least every 300ms if the unwinding
 // saturates this thread.
@@ -70,6 +76,20 @@ constexpr size_t kUnwindBatchSize = 1000;
 constexpr size_t kRecordBatchSize = 1024;
 constexpr size_t kMaxAllocRecordArenaSize = 2 * kRecordBatchSize;
 
+// The records of a client are only handed off to the helper workers once its
+// shared memory buffer is at least 1/kHandOffMinFillDivisor full, i.e. when
+// its worker is falling behind. Below that, copying the records out is not
+// worth it, and the helpers are left alone for their own clients.
+constexpr size_t kHandOffMinFillDivisor = 8;
+// Bounds the memory used by records copied out of the buffer.
+constexpr size_t kMaxHandOffInFlight = 2 * kUnwindBatchSize;
+// How often to check whether handed off records are done, before finishing a
+// disconnect or a drain.
+constexpr uint32_t kHandOffPollMs = 5;
+// How many bytes at the end of the stack copied by a MallocRemoteStack record
+// are compared against the memory of the process.
+constexpr size_t kRemoteStackCheckSize = 64;
+
 #pragma GCC diagnostic push
 // We do not care about deterministic destructor order.
 #pragma GCC diagnostic ignored "-Wglobal-constructors"
@@ -88,6 +108,55 @@ void ReadFromRawData(unwindstack::Regs* regs, void* raw_data) {
   memcpy(regs->RawData(), raw_data, GetRegsSize(regs));
 }
 
+// Matches what unwindstack::Unwinder does for its initial_map_names_to_skip.
+bool IsSkippedMap(const std::string& map_name) {
+  size_t slash = map_name.rfind('/');
+  base::StringView basename(map_name);
+  if (slash != std::string::npos)
+    basename = basename.substr(slash + 1);
+  for (const std::string& skip : kSkipMaps) {
+    if (basename == base::StringView(skip))
+      return true;
+  }
+  return false;
+}
+
+// For MallocRemoteStack records, the stack below the copy sent by the client
+// is read from the memory of the process, which kept running after the
+// allocation. Compares the end of the copy with the memory of the process: if
+// that changed, the frames that were not copied might have been overwritten
+// too. This is a heuristic, as it also catches changes to the local variables
+// of frames that are still live.
+bool RemoteStackChanged(const WireMessage& msg, UnwindingMetadata* metadata) {
+  size_t check_size = std::min(msg.payload_size, kRemoteStackCheckSize);
+  if (check_size == 0)
+    return false;
+  size_t offset = msg.payload_size - check_size;
+  uint8_t live[kRemoteStackCheckSize];
+  if (metadata->fd_mem->Read(msg.alloc_header->stack_pointer + offset, live,
+                             check_size) != check_size) {
+    return true;
+  }
+  return memcmp(live, msg.payload + offset, check_size) != 0;
+}
+
+void UnwindAllocRecord(WireMessage* msg,
+                       UnwindingMetadata* metadata,
+                       AllocRecord* rec) {
+  auto start_time_us = base::GetWallTimeNs() / 1000;
+  if (msg->record_type == RecordType::MallocPcs) {
+    BuildFramesFromPcs(msg, metadata, rec);
+  } else {
+    DoUnwind(msg, metadata, rec);
+    if (msg->record_type == RecordType::MallocRemoteStack) {
+      rec->remote_stack = true;
+      rec->remote_stack_changed = RemoteStackChanged(*msg, metadata);
+    }
+  }
+  rec->unwinding_time_us = static_cast<uint64_t>(
+      ((base::GetWallTimeNs() / 1000) - start_time_us).count());
+}
+
 }  // namespace
 
 std::unique_ptr<unwindstack::Regs> CreateRegsFromRawData(
@@ -195,10 +264,69 @@ bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
   return true;
 }
 
+bool BuildFramesFromPcs(WireMessage* msg,
+                        UnwindingMetadata* metadata,
+                        AllocRecord* out) {
+  unwindstack::ArchEnum arch = msg->alloc_header->arch;
+  unwindstack::JitDebug* jit_debug = nullptr;
+#if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
+  jit_debug = metadata->GetJitDebug(arch);
+#endif
+  size_t num_pcs = msg->payload_size / sizeof(uint64_t);
+  bool skipping = true;
+  bool reparsed = false;
+  out->frames.clear();
+  for (size_t i = 0; i < num_pcs && out->frames.size() < kMaxFrames; ++i) {
+    uint64_t pc;
+    memcpy(&pc, msg->payload + i * sizeof(pc), sizeof(pc));
+    // Return addresses saved in arm64 frame records can carry a pointer
+    // authentication code in their upper bits.
+    if (arch == unwindstack::ARCH_ARM64)
+      pc &= kArm64AddressMask;
+    // BuildFrameFromPcOnly takes care of adjusting the return address to
+    // point into the call instruction.
+    unwindstack::FrameData frame = unwindstack::Unwinder::BuildFrameFromPcOnly(
+        pc, arch, &metadata->fd_maps, jit_debug, metadata->fd_mem,
+        /*resolve_names=*/true);
+    if (frame.map_info == nullptr && !reparsed &&
+        metadata->last_maps_reparse_time + kMapsReparseInterval <=
+            base::GetWallTimeMs()) {
+      // Most likely a library that was loaded after we last parsed the maps.
+      PERFETTO_DLOG("Reparsing maps");
+      metadata->ReparseMaps();
+      metadata->last_maps_reparse_time = base::GetWallTimeMs();
+      reparsed = true;
+      out->reparsed_map = true;
+#if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
+      jit_debug = metadata->GetJitDebug(arch);
+#endif
+      frame = unwindstack::Unwinder::BuildFrameFromPcOnly(
+          pc, arch, &metadata->fd_maps, jit_debug, metadata->fd_mem,
+          /*resolve_names=*/true);
+    }
+    if (skipping && frame.map_info != nullptr &&
+        IsSkippedMap(frame.map_info->name())) {
+      continue;
+    }
+    skipping = false;
+    frame.num = out->frames.size();
+    out->frames.emplace_back(std::move(frame));
+  }
+  out->build_ids.resize(out->frames.size());
+  for (size_t i = 0; i < out->frames.size(); ++i) {
+    out->build_ids[i] = metadata->GetBuildId(out->frames[i]);
+  }
+  return true;
+}
+
 UnwindingWorker::~UnwindingWorker() {
   if (thread_task_runner_.get() == nullptr) {
     return;
   }
+  DisconnectAllClients();
+}
+
+void UnwindingWorker::DisconnectAllClients() {
   std::mutex mutex;
   std::condition_variable cv;
 
@@ -254,6 +382,20 @@ void UnwindingWorker::FinishDisconnect(
   ClientData& client_data = client_data_iterator->second;
   SharedRingBuffer& shmem = client_data.shmem;
 
+  // The delegate must not learn about the disconnect before it got all the
+  // records of this client. Pairs with the release in UnwindHandedOff.
+  if (client_data.hand_off &&
+      client_data.hand_off->in_flight.load(std::memory_order_acquire) > 0) {
+    thread_task_runner_.get()->PostDelayedTask(
+        [this, peer_pid] {
+          auto it = client_data_.find(peer_pid);
+          if (it != client_data_.end())
+            FinishDisconnect(it);
+        },
+        kHandOffPollMs);
+    return;
+  }
+
   if (!client_data.free_records.empty()) {
     delegate_->PostFreeRecord(this, std::move(client_data.free_records));
   }
@@ -285,24 +427,46 @@ UnwindingWorker::ReadAndUnwindBatchResult UnwindingWorker::ReadAndUnwindBatch(
   SharedRingBuffer::Buffer buf;
   ReadAndUnwindBatchResult res;
 
+  // The records of a client that is falling behind are spread round-robin
+  // across this worker (slot 0) and its helpers (slot i + 1 for helper i).
+  std::vector<std::vector<HandedOffRecord>> handed_off;
+  if (ShouldHandOff(client_data))
+    handed_off.resize(helpers_.size());
+  size_t next_slot = 0;
+
+  bool reparsed = false;
   size_t i;
   for (i = 0; i < kUnwindBatchSize; ++i) {
     uint64_t reparses_before = client_data->metadata.reparses;
     buf = shmem.BeginRead();
     if (!buf)
       break;
-    HandleBuffer(this, &alloc_record_arena_, buf, client_data,
-                 client_data->sock->peer_pid_linux(), delegate_);
+    size_t slot = 0;
+    if (!handed_off.empty()) {
+      slot = next_slot;
+      next_slot = (next_slot + 1) % (handed_off.size() + 1);
+    }
+    if (slot == 0 || !TryHandOff(buf, &handed_off[slot - 1])) {
+      HandleBuffer(this, &alloc_record_arena_, buf, client_data,
+                   client_data->sock->peer_pid_linux(), delegate_);
+    }
     res.bytes_read += shmem.EndRead(std::move(buf));
     // Reparsing takes time, so process the rest in a new batch to avoid timing
     // out.
     if (reparses_before < client_data->metadata.reparses) {
-      res.status = ReadAndUnwindBatchResult::Status::kHasMore;
-      return res;
+      reparsed = true;
+      break;
     }
   }
 
-  if (i == kUnwindBatchSize) {
+  for (size_t h = 0; h < handed_off.size(); ++h) {
+    if (!handed_off[h].empty()) {
+      helpers_[h]->PostUnwindHandedOff(client_data->hand_off, h,
+                                       std::move(handed_off[h]));
+    }
+  }
+
+  if (reparsed || i == kUnwindBatchSize) {
     res.status = ReadAndUnwindBatchResult::Status::kHasMore;
   } else if (i > 0) {
     res.status = ReadAndUnwindBatchResult::Status::kReadSome;
@@ -312,6 +476,86 @@ UnwindingWorker::ReadAndUnwindBatchResult UnwindingWorker::ReadAndUnwindBatch(
   return res;
 }
 
+bool UnwindingWorker::ShouldHandOff(ClientData* client_data) {
+  HandOffState* state = client_data->hand_off.get();
+  // Streamed allocations are not unwound, there is nothing to spread.
+  if (!state || client_data->stream_allocations)
+    return false;
+  SharedRingBuffer& shmem = client_data->shmem;
+  if (shmem.read_avail() < shmem.size() / kHandOffMinFillDivisor)
+    return false;
+  if (state->in_flight.load(std::memory_order_relaxed) >= kMaxHandOffInFlight)
+    return false;
+  if (state->helper_metadata.empty()) {
+    // Each helper needs its own copy, as UnwindingMetadata is not thread-safe.
+    for (size_t i = 0; i < helpers_.size(); ++i) {
+      state->helper_metadata.emplace_back(new UnwindingMetadata(
+          base::ScopedFile(dup(*state->maps_fd)),
+          base::ScopedFile(dup(*state->mem_fd))));
+    }
+  }
+  return true;
+}
+
+// static
+bool UnwindingWorker::TryHandOff(const SharedRingBuffer::Buffer& buf,
+                                 std::vector<HandedOffRecord>* out) {
+  // Everything but allocations is cheap and handled by the owning worker.
+  RecordType record_type;
+  if (buf.size < sizeof(record_type))
+    return false;
+  memcpy(&record_type, buf.data, sizeof(record_type));
+  if (record_type != RecordType::Malloc &&
+      record_type != RecordType::MallocPcs &&
+      record_type != RecordType::MallocRemoteStack) {
+    return false;
+  }
+  WireMessage msg;
+  if (!ReceiveWireMessage(reinterpret_cast<char*>(buf.data), buf.size, &msg))
+    return false;
+  out->emplace_back();
+  HandedOffRecord& rec = out->back();
+  rec.record_type = msg.record_type;
+  rec.alloc_metadata = *msg.alloc_header;
+  rec.payload.assign(msg.payload, msg.payload + msg.payload_size);
+  return true;
+}
+
+void UnwindingWorker::PostUnwindHandedOff(
+    std::shared_ptr<HandOffState> state,
+    size_t helper_idx,
+    std::vector<HandedOffRecord> records) {
+  state->in_flight.fetch_add(records.size(), std::memory_order_relaxed);
+  // We do not need to use a WeakPtr here because the task runner will not
+  // outlive its UnwindingWorker.
+  thread_task_runner_.get()->PostTask(
+      [this, state, helper_idx, records = std::move(records)]() mutable {
+        UnwindHandedOff(state.get(), helper_idx, &records);
+      });
+}
+
+void UnwindingWorker::UnwindHandedOff(HandOffState* state,
+                                      size_t helper_idx,
+                                      std::vector<HandedOffRecord>* records) {
+  UnwindingMetadata* metadata = state->helper_metadata[helper_idx].get();
+  for (HandedOffRecord& handed_off : *records) {
+    std::unique_ptr<AllocRecord> rec = alloc_record_arena_.BorrowAllocRecord();
+    rec->alloc_metadata = handed_off.alloc_metadata;
+    rec->pid = state->pid;
+    rec->data_source_instance_id = state->data_source_instance_id;
+    WireMessage msg{};
+    msg.record_type = handed_off.record_type;
+    msg.alloc_header = &handed_off.alloc_metadata;
+    msg.payload = handed_off.payload.data();
+    msg.payload_size = handed_off.payload.size();
+    UnwindAllocRecord(&msg, metadata, rec.get());
+    delegate_->PostAllocRecord(this, std::move(rec));
+  }
+  // Pairs with the acquire loads in FinishDisconnect and HandleDrainFree, so
+  // that the records above are posted before the disconnect or drain.
+  state->in_flight.fetch_sub(records->size(), std::memory_order_release);
+}
+
 void UnwindingWorker::BatchUnwindJob(pid_t peer_pid) {
   auto it = client_data_.find(peer_pid);
   if (it == client_data_.end()) {
@@ -404,28 +648,39 @@ void UnwindingWorker::HandleBuffer(UnwindingWorker* self,
     return;
   }
 
-  if (msg.record_type == RecordType::Malloc) {
+  if (msg.record_type == RecordType::Malloc ||
+      msg.record_type == RecordType::MallocPcs ||
+      msg.record_type == RecordType::MallocRemoteStack) {
     std::unique_ptr<AllocRecord> rec = alloc_record_arena->BorrowAllocRecord();
     rec->alloc_metadata = *msg.alloc_header;
     rec->pid = peer_pid;
     rec->data_source_instance_id = data_source_instance_id;
-    auto start_time_us = base::GetWallTimeNs() / 1000;
-    if (!client_data->stream_allocations)
-      DoUnwind(&msg, unwinding_metadata, rec.get());
-    rec->unwinding_time_us = static_cast<uint64_t>(
-        ((base::GetWallTimeNs() / 1000) - start_time_us).count());
+    if (client_data->stream_allocations)
+      rec->unwinding_time_us = 0;
+    else
+      UnwindAllocRecord(&msg, unwinding_metadata, rec.get());
     delegate->PostAllocRecord(self, std::move(rec));
-  } else if (msg.record_type == RecordType::Free) {
-    FreeRecord rec;
-    rec.pid = peer_pid;
-    rec.data_source_instance_id = data_source_instance_id;
-    // We need to copy this, so we can return the memory to the shmem buffer.
-    memcpy(&rec.entry, msg.free_header, sizeof(*msg.free_header));
-    client_data->free_records.emplace_back(std::move(rec));
-    if (client_data->free_records.size() == kRecordBatchSize) {
-      delegate->PostFreeRecord(self, std::move(client_data->free_records));
-      client_data->free_records.clear();
-      client_data->free_records.reserve(kRecordBatchSize);
+  } else if (msg.record_type == RecordType::Free ||
+             msg.record_type == RecordType::FreeBatch) {
+    const FreeEntry* entries = msg.free_header;
+    size_t num_entries = 1;
+    if (msg.record_type == RecordType::FreeBatch) {
+      entries = reinterpret_cast<const FreeEntry*>(msg.payload);
+      num_entries = msg.payload_size / sizeof(FreeEntry);
+    }
+    for (size_t i = 0; i < num_entries; ++i) {
+      FreeRecord rec;
+      rec.pid = peer_pid;
+      rec.data_source_instance_id = data_source_instance_id;
+      // We need to copy this, so we can return the memory to the shmem
+      // buffer.
+      memcpy(&rec.entry, &entries[i], sizeof(rec.entry));
+      client_data->free_records.emplace_back(std::move(rec));
+      if (client_data->free_records.size() == kRecordBatchSize) {
+        delegate->PostFreeRecord(self, std::move(client_data->free_records));
+        client_data->free_records.clear();
+        client_data->free_records.reserve(kRecordBatchSize);
+      }
     }
   } else if (msg.record_type == RecordType::HeapName) {
     HeapNameRecord rec;
@@ -458,6 +713,20 @@ void UnwindingWorker::HandleHandoffSocket(HandoffData handoff_data) {
       base::SockFamily::kUnix, base::SockType::kStream);
   pid_t peer_pid = sock->peer_pid_linux();
 
+  std::shared_ptr<HandOffState> hand_off;
+  if (!helpers_.empty()) {
+    base::ScopedFile maps_fd(dup(*handoff_data.maps_fd));
+    base::ScopedFile mem_fd(dup(*handoff_data.mem_fd));
+    if (maps_fd && mem_fd) {
+      hand_off = std::make_shared<HandOffState>(
+          peer_pid, handoff_data.data_source_instance_id, std::move(maps_fd),
+          std::move(mem_fd));
+    } else {
+      PERFETTO_PLOG("Failed to dup fds, not handing off unwinding of %d",
+                    peer_pid);
+    }
+  }
+
   UnwindingMetadata metadata(std::move(handoff_data.maps_fd),
                              std::move(handoff_data.mem_fd));
   ClientData client_data{
@@ -469,6 +738,7 @@ void UnwindingWorker::HandleHandoffSocket(HandoffData handoff_data) {
       handoff_data.stream_allocations,
       /*drain_bytes=*/0,
       /*free_records=*/{},
+      std::move(hand_off),
   };
   client_data.free_records.reserve(kRecordBatchSize);
   client_data.shmem.SetReaderPaused();
@@ -481,6 +751,14 @@ void UnwindingWorker::HandleDrainFree(DataSourceInstanceID ds_id, pid_t pid) {
   if (it != client_data_.end()) {
     ClientData& client_data = it->second;
 
+    // Pairs with the release in UnwindHandedOff.
+    if (client_data.hand_off &&
+        client_data.hand_off->in_flight.load(std::memory_order_acquire) > 0) {
+      thread_task_runner_.get()->PostDelayedTask(
+          [this, ds_id, pid] { HandleDrainFree(ds_id, pid); }, kHandOffPollMs);
+      return;
+    }
+
     if (!client_data.free_records.empty()) {
       delegate_->PostFreeRecord(this, std::move(client_data.free_records));
       client_data.free_records.clear();
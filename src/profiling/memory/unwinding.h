@@ -17,6 +17,11 @@
 #ifndef SRC_PROFILING_MEMORY_UNWINDING_H_
 #define SRC_PROFILING_MEMORY_UNWINDING_H_
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <vector>
+
 #include <unwindstack/Regs.h>
 
 #include "perfetto/base/time.h"
@@ -37,6 +42,12 @@ std::unique_ptr<unwindstack::Regs> CreateRegsFromRawData(
 
 bool DoUnwind(WireMessage*, UnwindingMetadata* metadata, AllocRecord* out);
 
+// Symbolizes the return addresses of a MallocPcs record, for clients that
+// walked their own callstack (see ClientUnwinding).
+bool BuildFramesFromPcs(WireMessage*,
+                        UnwindingMetadata* metadata,
+                        AllocRecord* out);
+
 // AllocRecords are expensive to construct and destruct. We have seen up to
 // 10 % of total CPU of heapprofd being used to destruct them. That is why
 // we re-use them to cut CPU usage significantly.
@@ -89,6 +100,18 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
   ~UnwindingWorker() override;
   UnwindingWorker(UnwindingWorker&&) = default;
 
+  // Other workers this one can hand off the unwinding of a client's records
+  // to, when that client produces more than one thread can unwind. Must be
+  // called before any client is handed off.
+  void SetHelperWorkers(std::vector<UnwindingWorker*> helpers) {
+    helpers_ = std::move(helpers);
+  }
+
+  // Disconnects all clients and waits for that to happen on the worker
+  // thread. After this returns, this worker no longer hands off records to
+  // its helpers.
+  void DisconnectAllClients();
+
   // Public API safe to call from other threads.
   void PostDisconnectSocket(pid_t pid);
   void PostPurgeProcess(pid_t pid);
@@ -108,6 +131,37 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
   void OnDataAvailable(base::UnixSocket* self) override;
 
  public:
+  // A sampled allocation, copied out of the shared memory buffer to be
+  // unwound by a helper worker.
+  struct HandedOffRecord {
+    RecordType record_type;
+    AllocMetadata alloc_metadata;
+    std::vector<char> payload;
+  };
+
+  // State of a client shared between the worker that owns it and its helpers.
+  struct HandOffState {
+    HandOffState(pid_t p,
+                 DataSourceInstanceID id,
+                 base::ScopedFile maps,
+                 base::ScopedFile mem)
+        : pid(p),
+          data_source_instance_id(id),
+          maps_fd(std::move(maps)),
+          mem_fd(std::move(mem)) {}
+
+    const pid_t pid;
+    const DataSourceInstanceID data_source_instance_id;
+    // Used to create |helper_metadata|.
+    base::ScopedFile maps_fd;
+    base::ScopedFile mem_fd;
+    // One per helper worker, created on first hand off. Each one is only ever
+    // used on the thread of its helper.
+    std::vector<std::unique_ptr<UnwindingMetadata>> helper_metadata;
+    // Number of records handed off, but not yet posted to the delegate.
+    std::atomic<size_t> in_flight{0};
+  };
+
   // public for testing/fuzzer
   struct ClientData {
     DataSourceInstanceID data_source_instance_id;
@@ -118,6 +172,8 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
     bool stream_allocations = false;
     size_t drain_bytes = 0;
     std::vector<FreeRecord> free_records;
+    // Only set if there are helper workers.
+    std::shared_ptr<HandOffState> hand_off;
   };
 
   // public for testing/fuzzing
@@ -151,9 +207,20 @@ class UnwindingWorker : public base::UnixSocket::EventListener {
   void BatchUnwindJob(pid_t);
   void DrainJob(pid_t);
 
+  bool ShouldHandOff(ClientData* client_data);
+  static bool TryHandOff(const SharedRingBuffer::Buffer& buf,
+                         std::vector<HandedOffRecord>* out);
+  void PostUnwindHandedOff(std::shared_ptr<HandOffState> state,
+                           size_t helper_idx,
+                           std::vector<HandedOffRecord> records);
+  void UnwindHandedOff(HandOffState* state,
+                       size_t helper_idx,
+                       std::vector<HandedOffRecord>* records);
+
   AllocRecordArena alloc_record_arena_;
   std::map<pid_t, ClientData> client_data_;
   Delegate* delegate_;
+  std::vector<UnwindingWorker*> helpers_;
 
   // Task runner with a dedicated thread. Keep last. By destroying this task
   // runner first, we ensure that the UnwindingWorker is not active while the
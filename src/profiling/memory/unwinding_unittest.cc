@@ -91,6 +91,25 @@ TEST(UnwindingTest, TestFunctionOffset) {
   AssertFunctionOffset();
 }
 
+TEST(UnwindingTest, FDMapsReparseKeepsUnchangedMaps) {
+  base::ScopedFile proc_maps(base::OpenFile("/proc/self/maps", O_RDONLY));
+  ASSERT_TRUE(proc_maps);
+  FDMaps maps(std::move(proc_maps));
+  ASSERT_TRUE(maps.Parse());
+  uint64_t code_addr = reinterpret_cast<uint64_t>(&AssertFunctionOffset);
+  std::shared_ptr<unwindstack::MapInfo> map_info = maps.Find(code_addr);
+  ASSERT_NE(map_info, nullptr);
+
+  ASSERT_TRUE(maps.Parse());
+  EXPECT_EQ(maps.Find(code_addr), map_info);
+
+  maps.Reset();
+  ASSERT_TRUE(maps.Parse());
+  std::shared_ptr<unwindstack::MapInfo> new_map_info = maps.Find(code_addr);
+  ASSERT_NE(new_map_info, nullptr);
+  EXPECT_NE(new_map_info, map_info);
+}
+
 // This is needed because ASAN thinks copying the whole stack is a buffer
 // underrun.
 void __attribute__((noinline))
@@ -182,6 +201,33 @@ TEST(UnwindingTest, DoUnwindReparse) {
                "namespace)::GetRecord(perfetto::profiling::WireMessage*)");
 }
 
+TEST(UnwindingTest, BuildFramesFromPcs) {
+  base::ScopedFile proc_maps(base::OpenFile("/proc/self/maps", O_RDONLY));
+  base::ScopedFile proc_mem(base::OpenFile("/proc/self/mem", O_RDONLY));
+  UnwindingMetadata metadata(std::move(proc_maps), std::move(proc_mem));
+  AllocMetadata alloc_metadata = {};
+  alloc_metadata.arch = unwindstack::Regs::CurrentArch();
+  // Pretend AssertFunctionOffset is the caller: the return address points
+  // after the call instruction, so it is adjusted back into the function.
+  uint64_t pcs[] = {reinterpret_cast<uint64_t>(&AssertFunctionOffset) + 4};
+  WireMessage msg = {};
+  msg.record_type = RecordType::MallocPcs;
+  msg.alloc_header = &alloc_metadata;
+  msg.payload = reinterpret_cast<char*>(pcs);
+  msg.payload_size = sizeof(pcs);
+  AllocRecord out;
+  ASSERT_TRUE(BuildFramesFromPcs(&msg, &metadata, &out));
+  ASSERT_EQ(out.frames.size(), 1u);
+  ASSERT_EQ(out.build_ids.size(), 1u);
+  int st;
+  std::unique_ptr<char, base::FreeDeleter> demangled(abi::__cxa_demangle(
+      out.frames[0].function_name.c_str(), nullptr, nullptr, &st));
+  ASSERT_EQ(st, 0) << "mangled: " << out.frames[0].function_name;
+  ASSERT_STREQ(demangled.get(),
+               "perfetto::profiling::(anonymous "
+               "namespace)::AssertFunctionOffset()");
+}
+
 TEST(AllocRecordArenaTest, Smoke) {
   AllocRecordArena a;
   auto borrowed = a.BorrowAllocRecord();
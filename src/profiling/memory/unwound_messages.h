@@ -31,6 +31,10 @@ struct AllocRecord {
   pid_t pid;
   bool error = false;
   bool reparsed_map = false;
+  // Set for MallocRemoteStack records.
+  bool remote_stack = false;
+  // Whether the stack changed before it was unwound. See RemoteStackChanged.
+  bool remote_stack_changed = false;
   uint64_t unwinding_time_us = 0;
   uint64_t data_source_instance_id;
   uint64_t timestamp;
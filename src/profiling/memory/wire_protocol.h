@@ -53,7 +53,13 @@ constexpr size_t kMaxRegisterDataSize =
 // and heapprofd. The basic format of a record sent by the client is
 // record size (uint64_t) | record type (RecordType = uint64_t) | record
 // If record type is Malloc, the record format is AllocMetdata | raw stack.
+// If record type is MallocPcs, the record format is AllocMetdata | return
+// addresses (uint64_t each), innermost frame first.
+// If record type is MallocRemoteStack, the record format is the same as for
+// Malloc, but only the top of the stack is copied. The rest is read from the
+// memory of the process.
 // If the record type is Free, the record is a FreeEntry.
+// If the record type is FreeBatch, the record is one or more FreeEntry.
 // If record type is HeapName, the record is a HeapName.
 // On connect, heapprofd sends one ClientConfiguration struct over the control
 // socket.
@@ -66,6 +72,20 @@ struct ClientConfigurationHeap {
   PERFETTO_CROSS_ABI_ALIGNED(uint64_t) interval;
 };
 
+// How the client collects the callstack of a sampled allocation. Keep in sync
+// with HeapprofdConfig.ClientUnwinding.
+enum class ClientUnwinding : uint32_t {
+  // Send a copy of the stack, which heapprofd unwinds with libunwindstack.
+  kRawStack = 0,
+  // Walk the frame pointer chain in the client, send return addresses only.
+  kFramePointers = 1,
+  // Read the return addresses from the shadow call stack (arm64 only).
+  kShadowCallStack = 2,
+  // Only copy the top of the stack, heapprofd reads the rest from the memory
+  // of the process.
+  kRemoteStack = 3,
+};
+
 struct ClientConfiguration {
   // On average, sample one allocation every interval bytes,
   // If interval == 1, sample every allocation.
@@ -81,6 +101,9 @@ struct ClientConfiguration {
   PERFETTO_CROSS_ABI_ALIGNED(bool) disable_fork_teardown;
   PERFETTO_CROSS_ABI_ALIGNED(bool) disable_vfork_detection;
   PERFETTO_CROSS_ABI_ALIGNED(bool) all_heaps;
+  PERFETTO_CROSS_ABI_ALIGNED(ClientUnwinding) client_unwinding;
+  // Buffer frees and send them as FreeBatch records.
+  PERFETTO_CROSS_ABI_ALIGNED(bool) batch_frees;
   // Just double check that the array sizes are in correct order.
 };
 
@@ -88,6 +111,9 @@ enum class RecordType : uint64_t {
   Free = 0,
   Malloc = 1,
   HeapName = 2,
+  MallocPcs = 3,
+  FreeBatch = 4,
+  MallocRemoteStack = 5,
 };
 
 // Make the whole struct 8-aligned. This is to make sizeof(AllocMetdata)
@@ -129,7 +155,7 @@ static_assert(sizeof(FreeEntry) == 24,
               "FreeEntry needs to be the same size across ABIs.");
 static_assert(sizeof(HeapName) == 80,
               "HeapName needs to be the same size across ABIs.");
-static_assert(sizeof(ClientConfiguration) == 4656,
+static_assert(sizeof(ClientConfiguration) == 4664,
               "ClientConfiguration needs to be the same size across ABIs.");
 
 enum HandshakeFDs : size_t {
@@ -145,6 +171,7 @@ struct WireMessage {
   FreeEntry* free_header;
   HeapName* heap_name_header;
 
+  // For FreeBatch, the FreeEntry array.
   char* payload;
   size_t payload_size;
 };
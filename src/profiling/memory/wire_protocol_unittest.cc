@@ -22,6 +22,7 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/unix_socket.h"
+#include "perfetto/ext/base/utils.h"
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -104,6 +105,39 @@ TEST(WireProtocolTest, AllocMessage) {
   shmem_server->EndRead(std::move(buf));
 }
 
+TEST(WireProtocolTest, AllocPcsMessage) {
+  uint64_t pcs[] = {0x1000, 0x2000, 0x3000};
+  WireMessage msg = {};
+  msg.record_type = RecordType::MallocPcs;
+  AllocMetadata metadata = {};
+  metadata.sequence_number = 0xA1A2A3A4A5A6A7A8;
+  metadata.alloc_size = 0xB1B2B3B4B5B6B7B8;
+  metadata.arch = unwindstack::ARCH_ARM64;
+  msg.alloc_header = &metadata;
+  msg.payload = reinterpret_cast<char*>(pcs);
+  msg.payload_size = sizeof(pcs);
+
+  auto shmem_client = SharedRingBuffer::Create(kShmemSize);
+  ASSERT_TRUE(shmem_client);
+  ASSERT_TRUE(shmem_client->is_valid());
+  auto shmem_server = SharedRingBuffer::Attach(CopyFD(shmem_client->fd()));
+
+  ASSERT_GE(SendWireMessage(&shmem_client.value(), msg), 0);
+
+  auto buf = shmem_server->BeginRead();
+  ASSERT_TRUE(buf);
+  WireMessage recv_msg;
+  ASSERT_TRUE(ReceiveWireMessage(reinterpret_cast<char*>(buf.data), buf.size,
+                                 &recv_msg));
+
+  ASSERT_EQ(recv_msg.record_type, msg.record_type);
+  ASSERT_EQ(*recv_msg.alloc_header, *msg.alloc_header);
+  ASSERT_EQ(recv_msg.payload_size, sizeof(pcs));
+  ASSERT_EQ(memcmp(recv_msg.payload, pcs, sizeof(pcs)), 0);
+
+  shmem_server->EndRead(std::move(buf));
+}
+
 TEST(WireProtocolTest, FreeMessage) {
   WireMessage msg = {};
   msg.record_type = RecordType::Free;
@@ -132,6 +166,41 @@ TEST(WireProtocolTest, FreeMessage) {
   shmem_server->EndRead(std::move(buf));
 }
 
+TEST(WireProtocolTest, FreeBatchMessage) {
+  FreeEntry entries[3] = {};
+  for (size_t i = 0; i < base::ArraySize(entries); ++i) {
+    entries[i].sequence_number = i + 1;
+    entries[i].addr = 0x1000 * (i + 1);
+    entries[i].heap_id = 1;
+  }
+  WireMessage msg = {};
+  msg.record_type = RecordType::FreeBatch;
+  msg.payload = reinterpret_cast<char*>(entries);
+  msg.payload_size = sizeof(entries);
+
+  auto shmem_client = SharedRingBuffer::Create(kShmemSize);
+  ASSERT_TRUE(shmem_client);
+  ASSERT_TRUE(shmem_client->is_valid());
+  auto shmem_server = SharedRingBuffer::Attach(CopyFD(shmem_client->fd()));
+
+  ASSERT_GE(SendWireMessage(&shmem_client.value(), msg), 0);
+
+  auto buf = shmem_server->BeginRead();
+  ASSERT_TRUE(buf);
+  WireMessage recv_msg;
+  ASSERT_TRUE(ReceiveWireMessage(reinterpret_cast<char*>(buf.data), buf.size,
+                                 &recv_msg));
+
+  ASSERT_EQ(recv_msg.record_type, msg.record_type);
+  ASSERT_EQ(recv_msg.payload_size, sizeof(entries));
+  const FreeEntry* recv_entries =
+      reinterpret_cast<const FreeEntry*>(recv_msg.payload);
+  for (size_t i = 0; i < base::ArraySize(entries); ++i)
+    ASSERT_EQ(recv_entries[i], entries[i]);
+
+  shmem_server->EndRead(std::move(buf));
+}
+
 TEST(GetHeapSamplingInterval, Default) {
   ClientConfiguration cli_config{};
   cli_config.all_heaps = true;
@@ -56,6 +56,10 @@ struct ParsedSample {
   std::vector<char> stack;
   bool stack_maxed = false;
   std::vector<uint64_t> kernel_ips;
+  // Userspace callchain that was already unwound by the kernel or the cpu
+  // (frame pointer and LBR modes), leaf first. In such modes there are no
+  // |regs| or |stack| to unwind from.
+  std::vector<uint64_t> user_ips;
 };
 
 // Entry in an unwinding queue. Either a sample that requires unwinding, or a
@@ -20,6 +20,7 @@
 #include <time.h>
 
 #include <unwindstack/Regs.h>
+#include <algorithm>
 #include <optional>
 #include <vector>
 
@@ -38,6 +39,7 @@ constexpr uint64_t kDefaultSamplingFrequencyHz = 10;
 constexpr uint32_t kDefaultDataPagesPerRingBuffer = 256;  // 1 MB: 256x 4k pages
 constexpr uint32_t kDefaultReadTickPeriodMs = 100;
 constexpr uint32_t kDefaultRemoteDescriptorTimeoutMs = 100;
+constexpr uint32_t kMaxUnwinderThreadCount = 16;
 
 // Acceptable forms: "sched/sched_switch" or "sched:sched_switch".
 std::pair<std::string, std::string> SplitTracepointString(
@@ -345,26 +347,30 @@ std::optional<EventConfig> EventConfig::Create(
   }
 
   // Callstack sampling.
-  bool user_frames = false;
+  UserFramesMode user_frames_mode = UserFramesMode::kNone;
   bool kernel_frames = false;
   TargetFilter target_filter;
   bool legacy_config = pb_config.all_cpus();  // all_cpus was mandatory before
   if (pb_config.has_callstack_sampling() || legacy_config) {
-    user_frames = true;
-
     // Userspace callstacks.
     using protos::gen::PerfEventConfig;
     switch (static_cast<int>(pb_config.callstack_sampling().user_frames())) {
       case PerfEventConfig::UNWIND_UNKNOWN:
         // default to true, both for backwards compatibility and because it's
         // almost always what the user wants.
-        user_frames = true;
+        user_frames_mode = UserFramesMode::kDwarf;
         break;
       case PerfEventConfig::UNWIND_SKIP:
-        user_frames = false;
+        user_frames_mode = UserFramesMode::kNone;
         break;
       case PerfEventConfig::UNWIND_DWARF:
-        user_frames = true;
+        user_frames_mode = UserFramesMode::kDwarf;
+        break;
+      case PerfEventConfig::UNWIND_FRAME_POINTER:
+        user_frames_mode = UserFramesMode::kFramePointer;
+        break;
+      case PerfEventConfig::UNWIND_LBR:
+        user_frames_mode = UserFramesMode::kLbr;
         break;
       default:
         // enum value from the future that we don't yet know, refuse the config
@@ -427,6 +433,11 @@ std::optional<EventConfig> EventConfig::Create(
   uint64_t max_enqueued_footprint_bytes =
       pb_config.max_enqueued_footprint_kb() * 1024;
 
+  // Unwinder threads, clamped to a sane range.
+  uint32_t unwinder_thread_count =
+      std::min(std::max(pb_config.unwinder_thread_count(), 1u),
+               kMaxUnwinderThreadCount);
+
   // Android-specific options.
   uint32_t remote_descriptor_timeout_ms =
       pb_config.remote_descriptor_timeout_ms()
@@ -456,7 +467,7 @@ std::optional<EventConfig> EventConfig::Create(
   pe.clockid = ToClockId(pb_config.timebase().timestamp_clock());
   pe.use_clockid = true;
 
-  if (user_frames) {
+  if (user_frames_mode == UserFramesMode::kDwarf) {
     pe.sample_type |= PERF_SAMPLE_STACK_USER | PERF_SAMPLE_REGS_USER;
     // PERF_SAMPLE_STACK_USER:
     // Needs to be < ((u16)(~0u)), and have bottom 8 bits clear.
@@ -468,23 +479,39 @@ std::optional<EventConfig> EventConfig::Create(
     pe.sample_regs_user =
         PerfUserRegsMaskForArch(unwindstack::Regs::CurrentArch());
   }
+  if (user_frames_mode == UserFramesMode::kFramePointer) {
+    // The kernel unwinds the userspace part of the callchain, no need to copy
+    // the stack.
+    pe.sample_type |= PERF_SAMPLE_CALLCHAIN;
+    if (!kernel_frames)
+      pe.exclude_callchain_kernel = true;
+  }
+  if (user_frames_mode == UserFramesMode::kLbr) {
+    // The instruction pointer is used as the leaf frame, with the rest of the
+    // callstack coming from the LBR call stack.
+    pe.sample_type |= PERF_SAMPLE_IP | PERF_SAMPLE_BRANCH_STACK;
+    pe.branch_sample_type =
+        PERF_SAMPLE_BRANCH_USER | PERF_SAMPLE_BRANCH_CALL_STACK;
+  }
   if (kernel_frames) {
     pe.sample_type |= PERF_SAMPLE_CALLCHAIN;
-    pe.exclude_callchain_user = true;
+    if (user_frames_mode != UserFramesMode::kFramePointer)
+      pe.exclude_callchain_user = true;
   }
 
   return EventConfig(
-      raw_ds_config, pe, timebase_event, user_frames, kernel_frames,
+      raw_ds_config, pe, timebase_event, user_frames_mode, kernel_frames,
       std::move(target_filter), ring_buffer_pages.value(), read_tick_period_ms,
       samples_per_tick_limit, remote_descriptor_timeout_ms,
       pb_config.unwind_state_clear_period_ms(), max_enqueued_footprint_bytes,
+      unwinder_thread_count, pb_config.sample_aggregation_period_ms(),
       pb_config.target_installed_by());
 }
 
 EventConfig::EventConfig(const DataSourceConfig& raw_ds_config,
                          const perf_event_attr& pe,
                          const PerfCounter& timebase_event,
-                         bool user_frames,
+                         UserFramesMode user_frames_mode,
                          bool kernel_frames,
                          TargetFilter target_filter,
                          uint32_t ring_buffer_pages,
@@ -493,10 +520,12 @@ EventConfig::EventConfig(const DataSourceConfig& raw_ds_config,
                          uint32_t remote_descriptor_timeout_ms,
                          uint32_t unwind_state_clear_period_ms,
                          uint64_t max_enqueued_footprint_bytes,
+                         uint32_t unwinder_thread_count,
+                         uint32_t sample_aggregation_period_ms,
                          std::vector<std::string> target_installed_by)
     : perf_event_attr_(pe),
       timebase_event_(timebase_event),
-      user_frames_(user_frames),
+      user_frames_mode_(user_frames_mode),
       kernel_frames_(kernel_frames),
       target_filter_(std::move(target_filter)),
       ring_buffer_pages_(ring_buffer_pages),
@@ -505,6 +534,8 @@ EventConfig::EventConfig(const DataSourceConfig& raw_ds_config,
       remote_descriptor_timeout_ms_(remote_descriptor_timeout_ms),
       unwind_state_clear_period_ms_(unwind_state_clear_period_ms),
       max_enqueued_footprint_bytes_(max_enqueued_footprint_bytes),
+      unwinder_thread_count_(unwinder_thread_count),
+      sample_aggregation_period_ms_(sample_aggregation_period_ms),
       target_installed_by_(std::move(target_installed_by)),
       raw_ds_config_(raw_ds_config) /* full copy */ {}
 
@@ -48,6 +48,14 @@ struct ProcessSharding {
   uint32_t chosen_shard = 0;
 };
 
+// How the userspace part of the sampled callstacks is obtained.
+enum class UserFramesMode {
+  kNone = 0,      // not recorded
+  kDwarf,         // stack and registers copied into samples, unwound by us
+  kFramePointer,  // frame pointer based callchain unwound by the kernel
+  kLbr,           // callstack from the cpu's last branch records
+};
+
 // Parsed allow/deny-list for filtering samples.
 // An empty allow-list means that all targets are allowed unless explicitly
 // denied.
@@ -136,8 +144,15 @@ class EventConfig {
   uint64_t max_enqueued_footprint_bytes() const {
     return max_enqueued_footprint_bytes_;
   }
-  bool sample_callstacks() const { return user_frames_ || kernel_frames_; }
-  bool user_frames() const { return user_frames_; }
+  uint32_t unwinder_thread_count() const { return unwinder_thread_count_; }
+  uint32_t sample_aggregation_period_ms() const {
+    return sample_aggregation_period_ms_;
+  }
+  bool sample_callstacks() const { return user_frames() || kernel_frames_; }
+  bool user_frames() const {
+    return user_frames_mode_ != UserFramesMode::kNone;
+  }
+  UserFramesMode user_frames_mode() const { return user_frames_mode_; }
   bool kernel_frames() const { return kernel_frames_; }
   const TargetFilter& filter() const { return target_filter_; }
   perf_event_attr* perf_attr() const {
@@ -153,7 +168,7 @@ class EventConfig {
   EventConfig(const DataSourceConfig& raw_ds_config,
               const perf_event_attr& pe,
               const PerfCounter& timebase_event,
-              bool user_frames,
+              UserFramesMode user_frames_mode,
               bool kernel_frames,
               TargetFilter target_filter,
               uint32_t ring_buffer_pages,
@@ -162,6 +177,8 @@ class EventConfig {
               uint32_t remote_descriptor_timeout_ms,
               uint32_t unwind_state_clear_period_ms,
               uint64_t max_enqueued_footprint_bytes,
+              uint32_t unwinder_thread_count,
+              uint32_t sample_aggregation_period_ms,
               std::vector<std::string> target_installed_by);
 
   // Parameter struct for the leader (timebase) perf_event_open syscall.
@@ -172,8 +189,8 @@ class EventConfig {
   // ioctl after creating the event.
   const PerfCounter timebase_event_;
 
-  // If true, include userspace frames in sampled callstacks.
-  const bool user_frames_;
+  // Whether (and how) to include userspace frames in sampled callstacks.
+  const UserFramesMode user_frames_mode_;
 
   // If true, include kernel frames in sampled callstacks.
   const bool kernel_frames_;
@@ -200,6 +217,14 @@ class EventConfig {
 
   const uint64_t max_enqueued_footprint_bytes_;
 
+  // Number of unwinder threads that the sampled processes are sharded across.
+  // Always at least one.
+  const uint32_t unwinder_thread_count_;
+
+  // If non-zero, samples are aggregated by the producer and written with this
+  // period, instead of individually.
+  const uint32_t sample_aggregation_period_ms_;
+
   // Only profile target if it was installed by one of the packages given.
   // Special values are:
   // * "@system": installed on the system partition
@@ -122,6 +122,32 @@ TEST(EventConfigTest, RemotePeriodTimeoutDefaultedIfUnset) {
   }
 }
 
+TEST(EventConfigTest, UnwinderThreadCountClamped) {
+  {  // if unset, a single thread is used
+    protos::gen::PerfEventConfig cfg;
+    std::optional<EventConfig> event_config = CreateEventConfig(cfg);
+
+    ASSERT_TRUE(event_config.has_value());
+    ASSERT_EQ(event_config->unwinder_thread_count(), 1u);
+  }
+  {  // otherwise, given value used
+    protos::gen::PerfEventConfig cfg;
+    cfg.set_unwinder_thread_count(4);
+    std::optional<EventConfig> event_config = CreateEventConfig(cfg);
+
+    ASSERT_TRUE(event_config.has_value());
+    ASSERT_EQ(event_config->unwinder_thread_count(), 4u);
+  }
+  {  // large values are clamped
+    protos::gen::PerfEventConfig cfg;
+    cfg.set_unwinder_thread_count(1000);
+    std::optional<EventConfig> event_config = CreateEventConfig(cfg);
+
+    ASSERT_TRUE(event_config.has_value());
+    ASSERT_EQ(event_config->unwinder_thread_count(), 16u);
+  }
+}
+
 TEST(EventConfigTest, SelectSamplingInterval) {
   {  // period:
     protos::gen::PerfEventConfig cfg;
@@ -306,6 +332,51 @@ TEST(EventConfigTest, CallstackSamplingModeDetection) {
     EXPECT_EQ(event_config->perf_attr()->sample_regs_user, 0u);
     EXPECT_EQ(event_config->perf_attr()->sample_stack_user, 0u);
 
+    EXPECT_NE(event_config->perf_attr()->exclude_callchain_user, 0u);
+  }
+  {  // frame pointer callchains unwound by the kernel
+    protos::gen::PerfEventConfig cfg;
+    cfg.mutable_callstack_sampling()->set_user_frames(
+        protos::gen::PerfEventConfig::UNWIND_FRAME_POINTER);
+
+    std::optional<EventConfig> event_config = CreateEventConfig(cfg);
+
+    ASSERT_TRUE(event_config.has_value());
+    EXPECT_TRUE(event_config->sample_callstacks());
+    EXPECT_TRUE(event_config->user_frames());
+    EXPECT_EQ(event_config->user_frames_mode(), UserFramesMode::kFramePointer);
+    EXPECT_FALSE(event_config->kernel_frames());
+    EXPECT_EQ(event_config->perf_attr()->sample_type &
+                  (PERF_SAMPLE_STACK_USER | PERF_SAMPLE_REGS_USER),
+              0u);
+    EXPECT_EQ(event_config->perf_attr()->sample_type & (PERF_SAMPLE_CALLCHAIN),
+              static_cast<uint64_t>(PERF_SAMPLE_CALLCHAIN));
+
+    EXPECT_EQ(event_config->perf_attr()->exclude_callchain_user, 0u);
+    EXPECT_NE(event_config->perf_attr()->exclude_callchain_kernel, 0u);
+  }
+  {  // LBR callstacks
+    protos::gen::PerfEventConfig cfg;
+    cfg.mutable_callstack_sampling()->set_kernel_frames(true);
+    cfg.mutable_callstack_sampling()->set_user_frames(
+        protos::gen::PerfEventConfig::UNWIND_LBR);
+
+    std::optional<EventConfig> event_config = CreateEventConfig(cfg);
+
+    ASSERT_TRUE(event_config.has_value());
+    EXPECT_TRUE(event_config->user_frames());
+    EXPECT_EQ(event_config->user_frames_mode(), UserFramesMode::kLbr);
+    EXPECT_TRUE(event_config->kernel_frames());
+    EXPECT_EQ(event_config->perf_attr()->sample_type &
+                  (PERF_SAMPLE_STACK_USER | PERF_SAMPLE_REGS_USER),
+              0u);
+    EXPECT_EQ(event_config->perf_attr()->sample_type &
+                  (PERF_SAMPLE_IP | PERF_SAMPLE_BRANCH_STACK),
+              static_cast<uint64_t>(PERF_SAMPLE_IP | PERF_SAMPLE_BRANCH_STACK));
+    EXPECT_EQ(event_config->perf_attr()->branch_sample_type,
+              static_cast<uint64_t>(PERF_SAMPLE_BRANCH_USER |
+                                    PERF_SAMPLE_BRANCH_CALL_STACK));
+
     EXPECT_NE(event_config->perf_attr()->exclude_callchain_user, 0u);
   }
 }
@@ -16,6 +16,7 @@
 
 #include "src/profiling/perf/event_reader.h"
 
+#include <algorithm>
 #include <linux/perf_event.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -178,6 +179,9 @@ char* PerfRingBuffer::ReadRecordNonconsuming() {
   uint16_t evt_size = evt_header->size;
 
   // event wrapped - reconstruct it, and return a pointer to the buffer
+  // Note: the kernel only allows mapping the whole ring buffer (at offset 0),
+  // so it can't be mirrored in memory to avoid this copy. It is only needed
+  // once per pass over the buffer though.
   if (read_pos + evt_size > data_buf_sz_) {
     PERFETTO_DLOG("PerfRingBuffer: returning reconstructed event");
 
@@ -294,9 +298,10 @@ std::optional<ParsedSample> EventReader::ReadUntilSample(
 ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
                                             const char* record_start) {
   if (event_attr_.sample_type &
-      (~uint64_t(PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_STACK_USER |
-                 PERF_SAMPLE_REGS_USER | PERF_SAMPLE_CALLCHAIN |
-                 PERF_SAMPLE_READ))) {
+      (~uint64_t(PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME |
+                 PERF_SAMPLE_STACK_USER | PERF_SAMPLE_REGS_USER |
+                 PERF_SAMPLE_CALLCHAIN | PERF_SAMPLE_READ |
+                 PERF_SAMPLE_BRANCH_STACK))) {
     PERFETTO_FATAL("Unsupported sampling option");
   }
 
@@ -311,6 +316,11 @@ ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
   // |attr.sample_type| flag.
   const char* parse_pos = record_start + sizeof(perf_event_header);
 
+  uint64_t ip = 0;
+  if (event_attr_.sample_type & PERF_SAMPLE_IP) {
+    parse_pos = ReadValue(&ip, parse_pos);
+  }
+
   if (event_attr_.sample_type & PERF_SAMPLE_TID) {
     uint32_t pid = 0;
     uint32_t tid = 0;
@@ -334,6 +344,36 @@ ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
     sample.kernel_ips.resize(static_cast<size_t>(chain_len));
     parse_pos = ReadValues<uint64_t>(sample.kernel_ips.data(), parse_pos,
                                      static_cast<size_t>(chain_len));
+
+    // If the kernel also unwound the userspace callchain (frame pointer mode),
+    // it follows a PERF_CONTEXT_USER marker.
+    auto user_it = std::find(sample.kernel_ips.begin(),
+                             sample.kernel_ips.end(), PERF_CONTEXT_USER);
+    if (user_it != sample.kernel_ips.end()) {
+      sample.user_ips.assign(user_it + 1, sample.kernel_ips.end());
+      sample.kernel_ips.erase(user_it, sample.kernel_ips.end());
+    }
+  }
+
+  if (event_attr_.sample_type & PERF_SAMPLE_BRANCH_STACK) {
+    // LBR call stack, the |from| of each entry is a call site, with the most
+    // recent call first. The sampled ip is the leaf frame, unless the sample
+    // was taken in the kernel. In which case, the closest approximation is the
+    // entry point of the innermost function (target of the most recent call).
+    uint64_t branch_count = 0;
+    parse_pos = ReadValue(&branch_count, parse_pos);
+    std::vector<perf_branch_entry> branches(static_cast<size_t>(branch_count));
+    parse_pos = ReadValues<perf_branch_entry>(branches.data(), parse_pos,
+                                              branches.size());
+
+    sample.user_ips.reserve(branches.size() + 1);
+    if (sample.common.cpu_mode == PERF_RECORD_MISC_USER) {
+      sample.user_ips.push_back(ip);
+    } else if (!branches.empty()) {
+      sample.user_ips.push_back(branches[0].to);
+    }
+    for (const perf_branch_entry& branch : branches)
+      sample.user_ips.push_back(branch.from);
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_REGS_USER) {
@@ -357,10 +397,11 @@ ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
       uint64_t filled_stack_size;
       parse_pos = ReadValue(&filled_stack_size, parse_pos);
 
-      // copy stack bytes into a vector
+      // Copy the stack bytes into a vector, as the sample outlives the record
+      // (it is unwound asynchronously). Assigning the range directly avoids
+      // zero-filling the vector before the copy.
       size_t payload_sz = static_cast<size_t>(filled_stack_size);
-      sample.stack.resize(payload_sz);
-      memcpy(sample.stack.data(), stack_start, payload_sz);
+      sample.stack.assign(stack_start, stack_start + payload_sz);
 
       // remember whether the stack sample is (most likely) truncated
       sample.stack_maxed = (filled_stack_size == max_stack_size);
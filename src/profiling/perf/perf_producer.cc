@@ -16,6 +16,7 @@
 
 #include "src/profiling/perf/perf_producer.h"
 
+#include <algorithm>
 #include <optional>
 #include <random>
 #include <utility>
@@ -369,9 +370,9 @@ PerfProducer::PerfProducer(ProcDescriptorGetter* proc_fd_getter,
                            base::TaskRunner* task_runner)
     : task_runner_(task_runner),
       proc_fd_getter_(proc_fd_getter),
-      unwinding_worker_(this),
       weak_factory_(this) {
   proc_fd_getter->SetDelegate(this);
+  unwinding_workers_.emplace_back(new UnwinderHandle(this));
 }
 
 void PerfProducer::SetupDataSource(DataSourceInstanceID,
@@ -470,13 +471,19 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
       ds_it->second.trace_writer.get(),
       protos::pbzero::TracePacket::SEQ_NEEDS_INCREMENTAL_STATE);
 
-  // Inform unwinder of the new data source instance, and optionally start a
-  // periodic task to clear its cached state.
-  unwinding_worker_->PostStartDataSource(ds_id,
-                                         ds.event_config.kernel_frames());
-  if (ds.event_config.unwind_state_clear_period_ms()) {
-    unwinding_worker_->PostClearCachedStatePeriodic(
-        ds_id, ds.event_config.unwind_state_clear_period_ms());
+  // Inform the unwinders of the new data source instance (starting more
+  // unwinder threads if necessary), and optionally start a periodic task to
+  // clear their cached state.
+  uint32_t unwinder_count = ds.event_config.unwinder_thread_count();
+  while (unwinding_workers_.size() < unwinder_count)
+    unwinding_workers_.emplace_back(new UnwinderHandle(this));
+  for (uint32_t i = 0; i < unwinder_count; i++) {
+    Unwinder* unwinder = unwinding_workers_[i]->get();
+    unwinder->PostStartDataSource(ds_id, ds.event_config.kernel_frames());
+    if (ds.event_config.unwind_state_clear_period_ms()) {
+      unwinder->PostClearCachedStatePeriodic(
+          ds_id, ds.event_config.unwind_state_clear_period_ms());
+    }
   }
 
   // Kick off periodic read task.
@@ -489,6 +496,16 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
       },
       TimeToNextReadTickMs(ds_id, tick_period_ms));
 
+  // Optionally kick off periodic writing of aggregated samples.
+  if (ds.event_config.sample_aggregation_period_ms()) {
+    task_runner_->PostDelayedTask(
+        [weak_this, ds_id] {
+          if (weak_this)
+            weak_this->EmitAggregatedSamplesPeriodic(ds_id);
+        },
+        ds.event_config.sample_aggregation_period_ms());
+  }
+
   // Optionally kick off periodic memory footprint limit check.
   uint32_t max_daemon_memory_kb = event_config_pb.max_daemon_memory_kb();
   if (max_daemon_memory_kb > 0) {
@@ -580,6 +597,11 @@ void PerfProducer::Flush(FlushRequestID flush_id,
 void PerfProducer::ClearIncrementalState(
     const DataSourceInstanceID* data_source_ids,
     size_t num_data_sources) {
+  // Aggregated samples refer to nodes of the callstack trie, which is shared by
+  // all data sources and dropped below.
+  for (auto& id_and_ds : data_sources_)
+    EmitAggregatedSamples(&id_and_ds.second);
+
   for (size_t i = 0; i < num_data_sources; i++) {
     auto ds_id = data_source_ids[i];
     PERFETTO_DLOG("ClearIncrementalState(%zu)", static_cast<size_t>(ds_id));
@@ -635,12 +657,16 @@ void PerfProducer::TickDataSourceRead(DataSourceInstanceID ds_id) {
     }
   }
 
-  // Wake up the unwinder as we've (likely) pushed samples into its queue.
-  unwinding_worker_->PostProcessQueue();
+  // Wake up the unwinders as we've (likely) pushed samples into their queues.
+  uint32_t unwinder_count = ds.event_config.unwinder_thread_count();
+  for (uint32_t i = 0; i < unwinder_count; i++)
+    unwinding_workers_[i]->get()->PostProcessQueue();
 
   if (PERFETTO_UNLIKELY(ds.status == DataSourceState::Status::kShuttingDown) &&
       !more_records_available) {
-    unwinding_worker_->PostInitiateDataSourceStop(ds_id);
+    ds.pending_unwinder_stops = unwinder_count;
+    for (uint32_t i = 0; i < unwinder_count; i++)
+      unwinding_workers_[i]->get()->PostInitiateDataSourceStop(ds_id);
   } else {
     // otherwise, keep reading
     auto tick_period_ms = it->second.event_config.read_tick_period_ms();
@@ -725,6 +751,13 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
       // Kernel threads (which have no userspace state) are never relevant if
       // we're not recording kernel callchains.
       bool is_kthread = !sample->regs;  // no userspace regs
+      // Userspace registers are not sampled if the kernel (or the cpu) unwinds
+      // the userspace callchain, only user threads have such a callchain.
+      UserFramesMode user_frames_mode = event_config.user_frames_mode();
+      if (user_frames_mode == UserFramesMode::kFramePointer ||
+          user_frames_mode == UserFramesMode::kLbr) {
+        is_kthread = sample->user_ips.empty();
+      }
       if (is_kthread && !event_config.kernel_frames()) {
         process_state = ProcessTrackingStatus::kRejected;
         continue;
@@ -753,7 +786,7 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
         // Either a kernel thread (no need to obtain proc-fds), or a userspace
         // process but we're not recording userspace callstacks.
         process_state = ProcessTrackingStatus::kAccepted;
-        unwinding_worker_->PostRecordNoUserspaceProcess(ds_id, pid);
+        UnwinderForPid(*ds, pid)->PostRecordNoUserspaceProcess(ds_id, pid);
         // note: fallthrough
       }
     }
@@ -775,7 +808,7 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
     uint64_t max_footprint_bytes = event_config.max_enqueued_footprint_bytes();
     uint64_t sample_stack_size = sample->stack.size();
     if (max_footprint_bytes) {
-      uint64_t footprint_bytes = unwinding_worker_->GetEnqueuedFootprint();
+      uint64_t footprint_bytes = GetEnqueuedFootprint();
       if (footprint_bytes + sample_stack_size >= max_footprint_bytes) {
         PERFETTO_DLOG("Skipping sample enqueueing due to footprint limit.");
         EmitSkippedSample(ds_id, std::move(sample.value()),
@@ -784,14 +817,15 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
       }
     }
 
-    // Push the sample into the unwinding queue if there is room.
-    auto& queue = unwinding_worker_->unwind_queue();
+    // Push the sample into the process' unwinding queue if there is room.
+    Unwinder* unwinder = UnwinderForPid(*ds, pid);
+    auto& queue = unwinder->unwind_queue();
     WriteView write_view = queue.BeginWrite();
     if (write_view.valid) {
       queue.at(write_view.write_pos) =
           UnwindEntry{ds_id, std::move(sample.value())};
       queue.CommitWrite();
-      unwinding_worker_->IncrementEnqueuedFootprint(sample_stack_size);
+      unwinder->IncrementEnqueuedFootprint(sample_stack_size);
     } else {
       PERFETTO_DLOG("Unwinder queue full, skipping sample");
       EmitSkippedSample(ds_id, std::move(sample.value()),
@@ -837,7 +871,7 @@ void PerfProducer::OnProcDescriptors(pid_t pid,
                     static_cast<int>(pid), static_cast<size_t>(it.first));
 
       proc_status_it->second = ProcessTrackingStatus::kAccepted;
-      unwinding_worker_->PostAdoptProcDescriptors(
+      UnwinderForPid(ds, pid)->PostAdoptProcDescriptors(
           it.first, pid, std::move(maps_fd), std::move(mem_fd));
       return;  // done
     }
@@ -900,7 +934,7 @@ void PerfProducer::EvaluateDescriptorLookupTimeout(DataSourceInstanceID ds_id,
     proc_status_it->second = ProcessTrackingStatus::kFdsTimedOut;
     // Also inform the unwinder of the state change (so that it can discard any
     // of the already-enqueued samples).
-    unwinding_worker_->PostRecordTimedOutProcDescriptors(ds_id, pid);
+    UnwinderForPid(ds, pid)->PostRecordTimedOutProcDescriptors(ds_id, pid);
   }
 }
 
@@ -931,6 +965,18 @@ void PerfProducer::EmitSample(DataSourceInstanceID ds_id,
       callstack_trie_.CreateCallsite(sample.frames, sample.build_ids);
   uint64_t callstack_iid = callstack_root->id();
 
+  if (ds.event_config.sample_aggregation_period_ms()) {
+    AggregatedSampleKey key{sample.common.cpu,   sample.common.pid,
+                            sample.common.tid,   sample.common.cpu_mode,
+                            sample.unwind_error, callstack_iid};
+    AggregatedSampleCount& aggregated = ds.aggregated_samples[key];
+    aggregated.callstack = callstack_root;
+    aggregated.count++;
+    aggregated.last_timestamp =
+        std::max(aggregated.last_timestamp, sample.common.timestamp);
+    return;
+  }
+
   // start packet, timestamp domain defaults to monotonic_raw
   auto packet = StartTracePacket(ds.trace_writer.get());
   packet->set_timestamp(sample.common.timestamp);
@@ -953,6 +999,49 @@ void PerfProducer::EmitSample(DataSourceInstanceID ds_id,
   }
 }
 
+void PerfProducer::EmitAggregatedSamples(DataSourceState* ds) {
+  for (const auto& key_and_count : ds->aggregated_samples) {
+    const AggregatedSampleKey& key = key_and_count.first;
+    const AggregatedSampleCount& aggregated = key_and_count.second;
+
+    auto packet = StartTracePacket(ds->trace_writer.get());
+    packet->set_timestamp(aggregated.last_timestamp);
+
+    protos::pbzero::InternedData* interned_out = packet->set_interned_data();
+    ds->interning_output.WriteCallstack(aggregated.callstack, &callstack_trie_,
+                                        interned_out);
+
+    auto* perf_sample = packet->set_perf_sample();
+    perf_sample->set_cpu(key.cpu);
+    perf_sample->set_pid(static_cast<uint32_t>(key.pid));
+    perf_sample->set_tid(static_cast<uint32_t>(key.tid));
+    perf_sample->set_cpu_mode(ToCpuModeEnum(key.cpu_mode));
+    perf_sample->set_callstack_iid(key.callstack_iid);
+    if (key.unwind_error != unwindstack::ERROR_NONE) {
+      perf_sample->set_unwind_error(ToProtoEnum(key.unwind_error));
+    }
+    perf_sample->set_sample_count(aggregated.count);
+  }
+  ds->aggregated_samples.clear();
+}
+
+void PerfProducer::EmitAggregatedSamplesPeriodic(DataSourceInstanceID ds_id) {
+  auto ds_it = data_sources_.find(ds_id);
+  if (ds_it == data_sources_.end())
+    return;  // stop recurring
+  DataSourceState& ds = ds_it->second;
+  EmitAggregatedSamples(&ds);
+
+  // repost
+  auto weak_this = weak_factory_.GetWeakPtr();
+  task_runner_->PostDelayedTask(
+      [weak_this, ds_id] {
+        if (weak_this)
+          weak_this->EmitAggregatedSamplesPeriodic(ds_id);
+      },
+      ds.event_config.sample_aggregation_period_ms());
+}
+
 void PerfProducer::EmitRingBufferLoss(DataSourceInstanceID ds_id,
                                       size_t cpu,
                                       uint64_t records_lost) {
@@ -1062,6 +1151,12 @@ void PerfProducer::FinishDataSourceStop(DataSourceInstanceID ds_id) {
   DataSourceState& ds = ds_it->second;
   PERFETTO_CHECK(ds.status == DataSourceState::Status::kShuttingDown);
 
+  // Wait until all of the source's unwinders are done with it.
+  PERFETTO_CHECK(ds.pending_unwinder_stops > 0);
+  if (--ds.pending_unwinder_stops > 0)
+    return;
+
+  EmitAggregatedSamples(&ds);
   ds.trace_writer->Flush();
   data_sources_.erase(ds_it);
 
@@ -1092,7 +1187,9 @@ void PerfProducer::PurgeDataSource(DataSourceInstanceID ds_id) {
   PERFETTO_LOG("Stopping DataSource(%zu) prematurely",
                static_cast<size_t>(ds_id));
 
-  unwinding_worker_->PostPurgeDataSource(ds_id);
+  uint32_t unwinder_count = ds.event_config.unwinder_thread_count();
+  for (uint32_t i = 0; i < unwinder_count; i++)
+    unwinding_workers_[i]->get()->PostPurgeDataSource(ds_id);
 
   // Write a packet indicating the abrupt stop.
   {
@@ -1167,6 +1264,19 @@ void PerfProducer::StartMetatraceSource(DataSourceInstanceID ds_id,
                                    metatrace::TAG_ANY);
 }
 
+Unwinder* PerfProducer::UnwinderForPid(const DataSourceState& ds, pid_t pid) {
+  uint32_t shard = static_cast<uint32_t>(pid) %
+                   ds.event_config.unwinder_thread_count();
+  return unwinding_workers_[shard]->get();
+}
+
+uint64_t PerfProducer::GetEnqueuedFootprint() {
+  uint64_t footprint_bytes = 0;
+  for (auto& worker : unwinding_workers_)
+    footprint_bytes += worker->get()->GetEnqueuedFootprint();
+  return footprint_bytes;
+}
+
 void PerfProducer::ConnectWithRetries(const char* socket_name) {
   PERFETTO_DCHECK(state_ == kNotStarted);
   state_ = kNotConnected;
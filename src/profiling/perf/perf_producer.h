@@ -21,6 +21,8 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <tuple>
+#include <vector>
 
 #include <unwindstack/Error.h>
 #include <unwindstack/Regs.h>
@@ -52,7 +54,8 @@ namespace profiling {
 // summary in the mean time: three stages: (1) kernel buffer reader that parses
 // the samples -> (2) callstack unwinder -> (3) interning and serialization of
 // samples. This class handles stages (1) and (3) on the main thread. Unwinding
-// is done by |Unwinder| on a dedicated thread.
+// is done by a pool of |Unwinder|s, each on a dedicated thread, with the
+// sampled processes sharded across them by pid.
 class PerfProducer : public Producer,
                      public ProcDescriptorDelegate,
                      public Unwinder::Delegate {
@@ -140,6 +143,29 @@ class PerfProducer : public Producer,
     kRejected       // process not considered relevant for the data source
   };
 
+  // Samples that are counted together when the data source aggregates samples
+  // (EventConfig.sample_aggregation_period_ms).
+  struct AggregatedSampleKey {
+    uint32_t cpu;
+    pid_t pid;
+    pid_t tid;
+    uint16_t cpu_mode;
+    unwindstack::ErrorCode unwind_error;
+    uint64_t callstack_iid;
+
+    bool operator<(const AggregatedSampleKey& other) const {
+      return std::tie(cpu, pid, tid, cpu_mode, unwind_error, callstack_iid) <
+             std::tie(other.cpu, other.pid, other.tid, other.cpu_mode,
+                      other.unwind_error, other.callstack_iid);
+    }
+  };
+
+  struct AggregatedSampleCount {
+    GlobalCallstackTrie::Node* callstack = nullptr;
+    uint64_t count = 0;
+    uint64_t last_timestamp = 0;
+  };
+
   struct DataSourceState {
     enum class Status { kActive, kShuttingDown };
 
@@ -168,6 +194,13 @@ class PerfProducer : public Producer,
     // Additional state for EventConfig.TargetFilter: command lines we have
     // decided to unwind, up to a total of additional_cmdline_count values.
     base::FlatSet<std::string> additional_cmdlines;
+    // Number of unwinders that have yet to finish stopping this source, the
+    // source is only destroyed once all of them are done.
+    uint32_t pending_unwinder_stops = 0;
+    // Samples counted since they were last written, if the source aggregates
+    // samples. The callstack nodes are owned by |callstack_trie_|, so these
+    // must be written out before the trie is cleared.
+    std::map<AggregatedSampleKey, AggregatedSampleCount> aggregated_samples;
   };
 
   // For |EmitSkippedSample|.
@@ -205,6 +238,9 @@ class PerfProducer : public Producer,
   void EvaluateDescriptorLookupTimeout(DataSourceInstanceID ds_id, pid_t pid);
 
   void EmitSample(DataSourceInstanceID ds_id, CompletedSample sample);
+  // Writes out (and forgets) the samples aggregated by the data source.
+  void EmitAggregatedSamples(DataSourceState* ds);
+  void EmitAggregatedSamplesPeriodic(DataSourceInstanceID ds_id);
   void EmitRingBufferLoss(DataSourceInstanceID ds_id,
                           size_t cpu,
                           uint64_t records_lost);
@@ -246,6 +282,12 @@ class PerfProducer : public Producer,
 
   void StartMetatraceSource(DataSourceInstanceID ds_id, BufferID target_buffer);
 
+  // Returns the unwinder that handles the samples of |pid| for the given data
+  // source. Uses the first |unwinder_thread_count| unwinders of the pool.
+  Unwinder* UnwinderForPid(const DataSourceState& ds, pid_t pid);
+  // Sum of the enqueued footprints of all unwinders.
+  uint64_t GetEnqueuedFootprint();
+
   // Task runner owned by the main thread.
   base::TaskRunner* const task_runner_;
   State state_ = kNotStarted;
@@ -275,8 +317,11 @@ class PerfProducer : public Producer,
   // State associated with perf-sampling data sources.
   std::map<DataSourceInstanceID, DataSourceState> data_sources_;
 
-  // Unwinding stage, running on a dedicated thread.
-  UnwinderHandle unwinding_worker_;
+  // Unwinding stage, running on dedicated threads. Grown on demand when
+  // starting data sources (see |EventConfig::unwinder_thread_count|), but never
+  // shrunk, as concurrent data sources might be relying on the existing
+  // sharding. Always has at least one unwinder.
+  std::vector<std::unique_ptr<UnwinderHandle>> unwinding_workers_;
 
   // Used for tracepoint name -> id lookups. Initialized lazily, and in general
   // best effort - can be null if tracefs isn't accessible.
@@ -18,9 +18,11 @@
 
 #include <cinttypes>
 #include <mutex>
+#include <shared_mutex>
 
 #include <unwindstack/Unwinder.h>
 
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/metatrace.h"
 #include "perfetto/ext/base/no_destructor.h"
 #include "perfetto/ext/base/thread_utils.h"
@@ -29,6 +31,32 @@
 namespace {
 constexpr size_t kUnwindingMaxFrames = 1000;
 constexpr uint32_t kDataSourceShutdownRetryDelayMs = 400;
+
+// Guards libunwindstack's process-wide Elf cache, which is shared by all
+// |Unwinder| instances. Held in shared mode while unwinding, and exclusively
+// while resetting the cache or changing |UnwindstackCacheState|.
+std::shared_mutex* UnwindstackCacheLock() {
+  static std::shared_mutex* lock = new std::shared_mutex{};
+  return lock;
+}
+
+// Bookkeeping for sharing the Elf cache between |Unwinder| instances, guarded
+// by UnwindstackCacheLock().
+struct UnwindstackCacheState {
+  // Number of unwinders with at least one data source. The cache is only
+  // dropped when none are left, so that the parsed Elf files of the libraries
+  // common to most processes (libc, libart, boot.oat, ...) stay shared by the
+  // data sources and unwinder threads that are still running.
+  uint32_t active_unwinders = 0;
+  // When the cache was last reset, to coalesce the periodic clears of
+  // several unwinders.
+  perfetto::base::TimeMillis last_reset{0};
+};
+
+UnwindstackCacheState* GetUnwindstackCacheState() {
+  static UnwindstackCacheState* state = new UnwindstackCacheState{};
+  return state;
+}
 }  // namespace
 
 namespace perfetto {
@@ -38,10 +66,23 @@ Unwinder::Delegate::~Delegate() = default;
 
 Unwinder::Unwinder(Delegate* delegate, base::UnixTaskRunner* task_runner)
     : task_runner_(task_runner), delegate_(delegate) {
-  ResetAndEnableUnwindstackCache();
+  {
+    // Unwinders can be created while others are unwinding (e.g. when growing
+    // the pool of unwinder threads), don't pull the cache from under them.
+    std::unique_lock<std::shared_mutex> guard(*UnwindstackCacheLock());
+    if (GetUnwindstackCacheState()->active_unwinders == 0)
+      ResetAndEnableUnwindstackCacheLocked();
+  }
   base::MaybeSetThreadName("stack-unwinding");
 }
 
+Unwinder::~Unwinder() {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+  // E.g. when the producer is torn down on a disconnect from traced.
+  if (!data_sources_.empty())
+    ReleaseUnwindstackCache();
+}
+
 void Unwinder::PostStartDataSource(DataSourceInstanceID ds_id,
                                    bool kernel_frames) {
   // No need for a weak pointer as the associated task runner quits (stops
@@ -54,6 +95,10 @@ void Unwinder::StartDataSource(DataSourceInstanceID ds_id, bool kernel_frames) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
   PERFETTO_DLOG("Unwinder::StartDataSource(%zu)", static_cast<size_t>(ds_id));
 
+  if (data_sources_.empty()) {
+    std::unique_lock<std::shared_mutex> guard(*UnwindstackCacheLock());
+    GetUnwindstackCacheState()->active_unwinders++;
+  }
   auto it_and_inserted = data_sources_.emplace(ds_id, DataSourceState{});
   PERFETTO_DCHECK(it_and_inserted.second);
 
@@ -330,8 +375,25 @@ CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
   if (!opt_user_state)
     return ret;
 
-  // Overlay the stack bytes over /proc/<pid>/mem.
+  // Other unwinder threads must not reset the Elf cache while it's in use.
+  std::shared_lock<std::shared_mutex> cache_guard(*UnwindstackCacheLock());
+
+  // Frame pointer and LBR modes: the callchain is already unwound, we only
+  // need to symbolize it.
   UnwindingMetadata* unwind_state = opt_user_state;
+  if (!sample.regs) {
+    std::vector<unwindstack::FrameData> user_frames =
+        SymbolizeUserCallchain(sample, unwind_state);
+    ret.build_ids.reserve(kernel_frames_size + user_frames.size());
+    ret.frames.reserve(kernel_frames_size + user_frames.size());
+    for (unwindstack::FrameData& frame : user_frames) {
+      ret.build_ids.emplace_back(unwind_state->GetBuildId(frame));
+      ret.frames.emplace_back(std::move(frame));
+    }
+    return ret;
+  }
+
+  // Overlay the stack bytes over /proc/<pid>/mem.
   std::shared_ptr<unwindstack::Memory> overlay_memory =
       std::make_shared<StackOverlayMemory>(
           unwind_state->fd_mem, sample.regs->sp(),
@@ -462,6 +524,46 @@ std::vector<unwindstack::FrameData> Unwinder::SymbolizeKernelCallchain(
   return ret;
 }
 
+std::vector<unwindstack::FrameData> Unwinder::SymbolizeUserCallchain(
+    const ParsedSample& sample,
+    UnwindingMetadata* unwind_state) {
+  unwindstack::ArchEnum arch = unwindstack::Regs::CurrentArch();
+  unwindstack::JitDebug* jit_debug = nullptr;
+#if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
+  jit_debug = unwind_state->GetJitDebug(arch);
+#endif
+  std::vector<unwindstack::FrameData> ret;
+  ret.reserve(sample.user_ips.size());
+  bool reparsed = false;
+  for (uint64_t pc : sample.user_ips) {
+    if (pc >= PERF_CONTEXT_MAX)
+      continue;  // context marker, not an address
+    // BuildFrameFromPcOnly takes care of adjusting the return address to
+    // point into the call instruction.
+    unwindstack::FrameData frame = unwindstack::Unwinder::BuildFrameFromPcOnly(
+        pc, arch, &unwind_state->fd_maps, jit_debug, unwind_state->fd_mem,
+        /*resolve_names=*/true);
+    // The parsed maps might be outdated (e.g. a library was loaded since).
+    // Reparse at most once per sample.
+    if (frame.map_info == nullptr && !reparsed) {
+      PERFETTO_METATRACE_SCOPED(TAG_PRODUCER, PROFILER_MAPS_REPARSE);
+      PERFETTO_DLOG("Reparsing maps for pid [%d]",
+                    static_cast<int>(sample.common.pid));
+      unwind_state->ReparseMaps();
+      reparsed = true;
+#if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
+      jit_debug = unwind_state->GetJitDebug(arch);
+#endif
+      frame = unwindstack::Unwinder::BuildFrameFromPcOnly(
+          pc, arch, &unwind_state->fd_maps, jit_debug, unwind_state->fd_mem,
+          /*resolve_names=*/true);
+    }
+    frame.num = ret.size();
+    ret.emplace_back(std::move(frame));
+  }
+  return ret;
+}
+
 void Unwinder::PostInitiateDataSourceStop(DataSourceInstanceID ds_id) {
   task_runner_->PostTask([this, ds_id] { InitiateDataSourceStop(ds_id); });
 }
@@ -501,7 +603,7 @@ void Unwinder::FinishDataSourceStop(DataSourceInstanceID ds_id) {
   // Clean up state if there are no more active sources.
   if (data_sources_.empty()) {
     kernel_symbolizer_.Destroy();
-    ResetAndEnableUnwindstackCache();
+    ReleaseUnwindstackCache();
   }
 
   // Inform service thread that the unwinder is done with the source.
@@ -525,7 +627,7 @@ void Unwinder::PurgeDataSource(DataSourceInstanceID ds_id) {
   // Clean up state if there are no more active sources.
   if (data_sources_.empty()) {
     kernel_symbolizer_.Destroy();
-    ResetAndEnableUnwindstackCache();
+    ReleaseUnwindstackCache();
     // Also purge scudo on Android, which would normally be done by the service
     // thread in |FinishDataSourceStop|. This is important as most of the scudo
     // overhead comes from libunwindstack.
@@ -558,24 +660,42 @@ void Unwinder::ClearCachedStatePeriodic(DataSourceInstanceID ds_id,
     if (pid_and_process.second.status == ProcessState::Status::kFdsResolved)
       pid_and_process.second.unwind_state->fd_maps.Reset();
   }
-  ResetAndEnableUnwindstackCache();
+  {
+    // With several unwinder threads, each of them runs this periodic task.
+    // The cache is process-wide, reset it once per period rather than once
+    // per unwinder.
+    std::unique_lock<std::shared_mutex> guard(*UnwindstackCacheLock());
+    base::TimeMillis now = base::GetWallTimeMs();
+    if (now - GetUnwindstackCacheState()->last_reset >=
+        base::TimeMillis(period_ms / 2)) {
+      ResetAndEnableUnwindstackCacheLocked();
+    }
+  }
   base::MaybeReleaseAllocatorMemToOS();
 
   PostClearCachedStatePeriodic(ds_id, period_ms);  // repost
 }
 
-void Unwinder::ResetAndEnableUnwindstackCache() {
+void Unwinder::ReleaseUnwindstackCache() {
+  std::unique_lock<std::shared_mutex> guard(*UnwindstackCacheLock());
+  UnwindstackCacheState* state = GetUnwindstackCacheState();
+  PERFETTO_DCHECK(state->active_unwinders > 0);
+  if (--state->active_unwinders == 0)
+    ResetAndEnableUnwindstackCacheLocked();
+}
+
+void Unwinder::ResetAndEnableUnwindstackCacheLocked() {
   PERFETTO_DLOG("Resetting unwindstack cache");
   // Libunwindstack uses an unsynchronized variable for setting/checking whether
-  // the cache is enabled. Therefore unwinding and cache toggling should stay on
-  // the same thread, but we might be moving unwinding across threads if we're
-  // recreating |Unwinder| instances (during a reconnect to traced). Therefore,
-  // use our own static lock to synchronize the cache toggling.
+  // the cache is enabled, and the cache itself is process-wide. As there can be
+  // several unwinder threads (and we might be moving unwinding across threads
+  // if we're recreating |Unwinder| instances during a reconnect to traced), the
+  // caller holds our own static lock to exclude any concurrent unwinds while
+  // toggling.
   // TODO(rsavitski): consider fixing this in libunwindstack itself.
-  static std::mutex* lock = new std::mutex{};
-  std::lock_guard<std::mutex> guard{*lock};
   unwindstack::Elf::SetCachingEnabled(false);  // free any existing state
   unwindstack::Elf::SetCachingEnabled(true);   // reallocate a fresh cache
+  GetUnwindstackCacheState()->last_reset = base::GetWallTimeMs();
 }
 
 }  // namespace profiling
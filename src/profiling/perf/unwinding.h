@@ -46,7 +46,11 @@ constexpr static uint32_t kUnwindQueueCapacity = 1024;
 // and register state (see |ParsedSample|). For kernelspace, the kernel itself
 // unwinds the stack (recording a list of instruction pointers), so only
 // symbolisation using /proc/kallsyms is necessary. Has a single unwinding ring
-// queue, shared across all data sources.
+// queue, shared across all data sources. The producer can run several
+// unwinders (each on its own thread), sharding the sampled processes across
+// them by pid. The per-process unwinding state is therefore owned by exactly
+// one unwinder, while libunwindstack's Elf cache is shared by all of them (and
+// by all data sources), and is only dropped once none of them is active.
 //
 // Userspace samples cannot be unwound without having /proc/<pid>/{maps,mem}
 // file descriptors for that process. This lookup can be asynchronous (e.g. on
@@ -87,7 +91,7 @@ class Unwinder {
     virtual ~Delegate();
   };
 
-  ~Unwinder() { PERFETTO_DCHECK_THREAD(thread_checker_); }
+  ~Unwinder();
 
   void PostStartDataSource(DataSourceInstanceID ds_id, bool kernel_frames);
   void PostAdoptProcDescriptors(DataSourceInstanceID ds_id,
@@ -190,6 +194,12 @@ class Unwinder {
   std::vector<unwindstack::FrameData> SymbolizeKernelCallchain(
       const ParsedSample& sample);
 
+  // Returns a list of symbolized userspace frames for samples whose callchain
+  // was already unwound by the kernel or the cpu (see |ParsedSample.user_ips|).
+  std::vector<unwindstack::FrameData> SymbolizeUserCallchain(
+      const ParsedSample& sample,
+      UnwindingMetadata* unwind_state);
+
   // Marks the data source as shutting down at the unwinding stage. It is known
   // that no new samples for this source will be pushed into the queue, but we
   // need to delay the unwinder state teardown until all previously-enqueued
@@ -210,8 +220,9 @@ class Unwinder {
   }
 
   // Clears the parsed maps for all previously-sampled processes, and resets the
-  // libunwindstack cache. This has the effect of deallocating the cached Elf
-  // objects within libunwindstack, which take up non-trivial amounts of memory.
+  // libunwindstack cache (at most once per period across all unwinders). This
+  // has the effect of deallocating the cached Elf objects within
+  // libunwindstack, which take up non-trivial amounts of memory.
   //
   // There are two reasons for having this operation:
   // * over a longer trace, it's desireable to drop heavy state for processes
@@ -239,7 +250,12 @@ class Unwinder {
   // worth having at the moment to speed up unwinds across map reparses).
   void ClearCachedStatePeriodic(DataSourceInstanceID ds_id, uint32_t period_ms);
 
-  void ResetAndEnableUnwindstackCache();
+  // Called when the last data source of this unwinder goes away. Resets the
+  // libunwindstack cache if no other unwinder has data sources left.
+  void ReleaseUnwindstackCache();
+
+  // Must be called with UnwindstackCacheLock() held exclusively.
+  void ResetAndEnableUnwindstackCacheLocked();
 
   base::UnixTaskRunner* const task_runner_;
   Delegate* const delegate_;
@@ -293,6 +309,7 @@ class UnwinderHandle {
   }
 
   Unwinder* operator->() { return unwinder_; }
+  Unwinder* get() { return unwinder_; }
 
  private:
   void RunTaskThread(
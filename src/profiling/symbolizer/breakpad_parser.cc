@@ -13,47 +13,48 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-#include <memory>
-
 #include "src/profiling/symbolizer/breakpad_parser.h"
 
+#include <algorithm>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/file_utils.h"
-#include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
-#include "perfetto/ext/base/string_writer.h"
+#include "src/profiling/symbolizer/filesystem.h"
+#include "src/profiling/symbolizer/scoped_read_mmap.h"
 
 namespace perfetto {
 namespace profiling {
 
 namespace {
 
-bool SymbolComparator(const uint64_t i, const BreakpadParser::Symbol& sym) {
-  return i < sym.start_address;
+// Splits off the next space-separated word of |*line|. Consecutive spaces are
+// skipped. Returns an empty view when there are no more words.
+base::StringView NextWord(base::StringView* line) {
+  size_t begin = 0;
+  while (begin < line->size() && line->at(begin) == ' ')
+    begin++;
+  size_t end = line->find(' ', begin);
+  if (end == base::StringView::npos)
+    end = line->size();
+  base::StringView word = line->substr(begin, end - begin);
+  *line = line->substr(end);
+  return word;
 }
 
-std::optional<std::string> GetFileContents(const std::string& file_path) {
-  std::string file_contents;
-  base::ScopedFile fd = base::OpenFile(file_path, O_RDONLY);
-  // Read the contents of the file into |file_contents|.
-  if (!fd) {
+std::optional<uint64_t> ParseHex(base::StringView word) {
+  if (word.empty())
     return std::nullopt;
-  }
-  if (!base::ReadFileDescriptor(fd.get(), &file_contents)) {
-    return std::nullopt;
-  }
-
-  return std::make_optional(std::move(file_contents));
+  return base::StringToUInt64(word.ToStdString(), 16);
 }
 
 // Parses the given string and determines if it begins with the label
 // 'MODULE'. Returns an ok status if it does begin with this label and a fail
 // status otherwise.
 base::Status ParseIfModuleRecord(base::StringView first_line) {
-  // Split the given line by spaces.
   const char kModuleLabel[] = "MODULE";
   // Check to see if the line starts with 'MODULE'.
-  if (!base::StartsWith(first_line.ToStdString(), kModuleLabel)) {
+  if (!first_line.StartsWith(kModuleLabel)) {
     return base::Status("Breakpad file not formatted correctly.");
   }
   return base::OkStatus();
@@ -65,49 +66,81 @@ BreakpadParser::BreakpadParser(const std::string& file_path)
     : file_path_(file_path) {}
 
 bool BreakpadParser::ParseFile() {
-  std::optional<std::string> file_contents = GetFileContents(file_path_);
-  if (!file_contents) {
+  // TODO(uwemwilson): Extract a build id and store it in the Symbol object.
+  size_t size = GetFileSize(file_path_);
+  if (size > 0) {
+    ScopedReadMmap map(file_path_.c_str(), size);
+    if (map.IsValid()) {
+      if (!ParseFromString(
+              base::StringView(static_cast<const char*>(*map), size))) {
+        PERFETTO_ELOG("Could not parse file contents.");
+        return false;
+      }
+      return true;
+    }
+  }
+
+  // Empty files, or platforms where the file can't be mapped.
+  std::string file_contents;
+  if (!base::ReadFile(file_path_, &file_contents)) {
     PERFETTO_ELOG("Could not get file contents of %s.", file_path_.c_str());
     return false;
   }
-
-  // TODO(uwemwilson): Extract a build id and store it in the Symbol object.
-
-  if (!ParseFromString(*file_contents)) {
+  if (!ParseFromString(base::StringView(file_contents))) {
     PERFETTO_ELOG("Could not parse file contents.");
     return false;
   }
-
   return true;
 }
 
-bool BreakpadParser::ParseFromString(const std::string& file_contents) {
-  // Create StringSplitter objects for each line so that specific lines can be
-  // used to create StringSplitter objects for words on that line.
-  base::StringSplitter lines(file_contents, '\n');
-  if (!lines.Next()) {
-    // File must be empty, so just return true and continue.
-    return true;
-  }
-
-  // TODO(crbug/1239750): Extract a build id and store it in the Symbol object.
-  base::StringView first_line(lines.cur_token(), lines.cur_token_size());
-  base::Status parse_record_status = ParseIfModuleRecord(first_line);
-  if (!parse_record_status.ok()) {
-    PERFETTO_ELOG("%s Breakpad files should begin with a MODULE record",
-                  parse_record_status.message().c_str());
-    return false;
-  }
+bool BreakpadParser::ParseFromString(base::StringView file_contents) {
+  // Lines are views into |file_contents|, only the names of functions are
+  // copied out.
+  size_t line_start = 0;
+  bool first_line = true;
+  while (line_start < file_contents.size()) {
+    size_t line_end = file_contents.find('\n', line_start);
+    if (line_end == base::StringView::npos)
+      line_end = file_contents.size();
+    base::StringView line =
+        file_contents.substr(line_start, line_end - line_start);
+    line_start = line_end + 1;
+    if (line.empty())
+      continue;
+
+    if (first_line) {
+      first_line = false;
+      // TODO(crbug/1239750): Extract a build id and store it in the Symbol
+      // object.
+      base::Status parse_record_status = ParseIfModuleRecord(line);
+      if (!parse_record_status.ok()) {
+        PERFETTO_ELOG("%s Breakpad files should begin with a MODULE record",
+                      parse_record_status.message().c_str());
+        return false;
+      }
+      continue;
+    }
 
-  // Parse each line.
-  while (lines.Next()) {
-    parse_record_status = ParseIfFuncRecord(lines.cur_token());
+    base::Status parse_record_status = ParseIfFuncRecord(line);
     if (!parse_record_status.ok()) {
       PERFETTO_ELOG("%s", parse_record_status.message().c_str());
       return false;
     }
   }
 
+  // FUNC records are normally in address order already, in which case this
+  // is linear.
+  if (!std::is_sorted(symbols_.begin(), symbols_.end(),
+                      [](const FuncRange& a, const FuncRange& b) {
+                        return a.start_address < b.start_address;
+                      })) {
+    std::stable_sort(symbols_.begin(), symbols_.end(),
+                     [](const FuncRange& a, const FuncRange& b) {
+                       return a.start_address < b.start_address;
+                     });
+  }
+  symbols_.shrink_to_fit();
+  names_.shrink_to_fit();
   return true;
 }
 
@@ -115,7 +148,9 @@ std::optional<std::string> BreakpadParser::GetSymbol(uint64_t address) const {
   // Returns an iterator pointing to the first element where the symbol's start
   // address is greater than |address|.
   auto it = std::upper_bound(symbols_.begin(), symbols_.end(), address,
-                             &SymbolComparator);
+                             [](uint64_t addr, const FuncRange& sym) {
+                               return addr < sym.start_address;
+                             });
   // If the first symbol's address is greater than |address| then |address| is
   // too low to appear in |symbols_|.
   if (it == symbols_.begin()) {
@@ -128,11 +163,24 @@ std::optional<std::string> BreakpadParser::GetSymbol(uint64_t address) const {
   // Check to see if the address is in the function's range.
   if (address >= it->start_address &&
       address < it->start_address + it->function_size) {
-    return it->symbol_name;
+    return names_.substr(it->name_offset, it->name_size);
   }
   return std::nullopt;
 }
 
+std::vector<BreakpadParser::Symbol> BreakpadParser::symbols_for_testing()
+    const {
+  std::vector<Symbol> symbols;
+  for (const FuncRange& range : symbols_) {
+    Symbol symbol;
+    symbol.start_address = range.start_address;
+    symbol.function_size = range.function_size;
+    symbol.symbol_name = names_.substr(range.name_offset, range.name_size);
+    symbols.push_back(std::move(symbol));
+  }
+  return symbols;
+}
+
 base::Status BreakpadParser::ParseIfFuncRecord(base::StringView current_line) {
   // Parses a FUNC record from a file. Structure of a FUNC record:
   // FUNC [m] address size parameter_size name
@@ -149,64 +197,56 @@ base::Status BreakpadParser::ParseIfFuncRecord(base::StringView current_line) {
   // https://chromium.googlesource.com/breakpad/breakpad/+/HEAD/docs/symbol_files.md
 
   const char kFuncLabel[] = "FUNC";
-  base::StringSplitter words(current_line.ToStdString(), ' ');
-  // Check to see if the first word indicates a FUNC record. If it is, create a
-  // Symbol struct and add tokens from words. If it isn't the function can just
-  // return true and resume parsing file.
-  if (!words.Next() || strcmp(words.cur_token(), kFuncLabel) != 0) {
+  base::StringView words = current_line;
+  // Check to see if the first word indicates a FUNC record. If it isn't the
+  // function can just return true and resume parsing file.
+  if (NextWord(&words) != base::StringView(kFuncLabel)) {
     return base::OkStatus();
   }
 
-  Symbol new_symbol;
+  FuncRange new_symbol;
   // There can be either 4 or 5 FUNC record tokens. The second token, 'm' is
   // optional.
   const char kOptionalArg[] = "m";
-  // Get the first argument on the line.
-  words.Next();
+  base::StringView word = NextWord(&words);
 
   // If the optional argument is present, skip to the next token.
-  if (strcmp(words.cur_token(), kOptionalArg) == 0) {
-    words.Next();
+  if (word == base::StringView(kOptionalArg)) {
+    word = NextWord(&words);
   }
 
   // Get the start address.
-  std::optional<uint64_t> optional_address =
-      base::CStringToUInt64(words.cur_token(), 16);
+  std::optional<uint64_t> optional_address = ParseHex(word);
   if (!optional_address) {
     return base::Status("Address should be hexadecimal.");
   }
   new_symbol.start_address = *optional_address;
 
   // Get the function size.
-  words.Next();
-  std::optional<size_t> optional_func_size =
-      base::CStringToUInt32(words.cur_token(), 16);
-  if (!optional_func_size) {
+  std::optional<uint64_t> optional_func_size = ParseHex(NextWord(&words));
+  if (!optional_func_size || *optional_func_size > UINT32_MAX) {
     return base::Status("Function size should be hexadecimal.");
   }
-  new_symbol.function_size = *optional_func_size;
+  new_symbol.function_size = static_cast<uint32_t>(*optional_func_size);
 
   // Skip the parameter size.
-  words.Next();
-
-  // Get the function name. Function names can have spaces, so any token is now
-  // considered a part of the function name and will be appended to the buffer
-  // in |func_name_writer|.
-  std::unique_ptr<char[]> joined_string(new char[current_line.size()]);
-  base::StringWriter func_name_writer(joined_string.get(), current_line.size());
-  bool first_token = true;
-  while (words.Next()) {
-    if (!first_token) {
-      func_name_writer.AppendChar(' ');
-    } else {
-      first_token = false;
-    }
-    func_name_writer.AppendString(words.cur_token(), strlen(words.cur_token()));
+  NextWord(&words);
+
+  // Get the function name. Function names can have spaces, so the rest of the
+  // line (with its surrounding spaces trimmed) is the function name.
+  size_t name_start = 0;
+  while (name_start < words.size() && words.at(name_start) == ' ')
+    name_start++;
+  size_t name_end = words.size();
+  while (name_end > name_start && (words.at(name_end - 1) == ' ' ||
+                                   words.at(name_end - 1) == '\r')) {
+    name_end--;
   }
+  new_symbol.name_offset = names_.size();
+  new_symbol.name_size = static_cast<uint32_t>(name_end - name_start);
+  names_.append(words.data() + name_start, name_end - name_start);
 
-  new_symbol.symbol_name = func_name_writer.GetStringView().ToStdString();
-
-  symbols_.push_back(std::move(new_symbol));
+  symbols_.push_back(new_symbol);
 
   return base::OkStatus();
 }
@@ -17,6 +17,8 @@
 #ifndef SRC_PROFILING_SYMBOLIZER_BREAKPAD_PARSER_H_
 #define SRC_PROFILING_SYMBOLIZER_BREAKPAD_PARSER_H_
 
+#include <stdint.h>
+
 #include <optional>
 #include <string>
 #include <vector>
@@ -53,29 +55,41 @@ class BreakpadParser {
   BreakpadParser(const BreakpadParser& other) = delete;
   BreakpadParser& operator=(const BreakpadParser& other) = delete;
 
-  // Fills in |symbols_| by parsing the breakpad file given.
+  // Fills in |symbols_| by parsing the breakpad file given. The file is
+  // memory-mapped rather than read, as symbol files can be hundreds of MB.
   // Returns true if it is able to parse the entire file specified by
   // |file_path_|. Returns false if the parsing fails.
   bool ParseFile();
 
   // Parses from  a string instead of a file.
-  bool ParseFromString(const std::string& file_contents);
+  bool ParseFromString(base::StringView file_contents);
 
   // Returns the function name corresponding to |address| as a string. The
   // search is log(N) on the number of functions in the binary. |address| is the
   // relative offset from the start of the binary.
   std::optional<std::string> GetSymbol(uint64_t address) const;
 
-  const std::vector<Symbol>& symbols_for_testing() const { return symbols_; }
+  std::vector<Symbol> symbols_for_testing() const;
 
  private:
-  // Parses the given string and creates a new Symbol object if it is a FUNC
+  // Compact form of a Symbol. The names of all functions are stored back to
+  // back in |names_|, which avoids one heap allocation per function.
+  struct FuncRange {
+    uint64_t start_address;
+    uint64_t name_offset;
+    uint32_t function_size;
+    uint32_t name_size;
+  };
+
+  // Parses the given string and creates a new FuncRange if it is a FUNC
   // record. Returns an ok status if it was successfully able to add to the
   // |symbols_| or if the string is not a FUNC record. Return a fail status on
   // parsing errors on FUNC record.
   base::Status ParseIfFuncRecord(base::StringView current_line);
 
-  std::vector<Symbol> symbols_;
+  // Sorted by |start_address| once parsing is done.
+  std::vector<FuncRange> symbols_;
+  std::string names_;
   const std::string file_path_;
 };
 
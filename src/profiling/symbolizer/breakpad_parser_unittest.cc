@@ -132,6 +132,38 @@ TEST(BreakpadParserTest, FuncNameWithSpaces) {
             static_cast<uint64_t>(0x10d0));
 }
 
+TEST(BreakpadParserTest, ParseFile) {
+  base::TempFile file = base::TempFile::Create();
+  constexpr char kTestFileContents[] =
+      "MODULE mac x86_64 E3A0F28FBCB43C15986D8608AF1DD2380 exif.so\n"
+      "FUNC 1010 23 0 foo foo\n"
+      "1031 2 39 4\n"
+      "FUNC 1040 84 0 bar\n";
+  ASSERT_TRUE(base::WriteAll(file.fd(), kTestFileContents,
+                             sizeof(kTestFileContents) - 1));
+  BreakpadParser parser(file.path());
+  ASSERT_TRUE(parser.ParseFile());
+  ASSERT_EQ(parser.symbols_for_testing().size(), 2u);
+  EXPECT_EQ(*parser.GetSymbol(0x1020U), "foo foo");
+  EXPECT_EQ(*parser.GetSymbol(0x1040U), "bar");
+}
+
+TEST(BreakpadParserTest, UnsortedFuncRecords) {
+  BreakpadParser parser(kFakeFilePath);
+  constexpr char kTestFileContents[] =
+      "MODULE mac x86_64 E3A0F28FBCB43C15986D8608AF1DD2380 exif.so\n"
+      "FUNC 10d0 6b 0 baz\n"
+      "FUNC 1010 23 0 foo\n"
+      "FUNC 1040 84 0 bar\n";
+  ASSERT_TRUE(parser.ParseFromString(kTestFileContents));
+  ASSERT_EQ(parser.symbols_for_testing().size(), 3u);
+  EXPECT_EQ(parser.symbols_for_testing()[0].start_address,
+            static_cast<uint64_t>(0x1010));
+  EXPECT_EQ(*parser.GetSymbol(0x1030U), "foo");
+  EXPECT_EQ(*parser.GetSymbol(0x1050U), "bar");
+  EXPECT_EQ(*parser.GetSymbol(0x10d0U), "baz");
+}
+
 TEST(BreakpadParserTest, NonHexAddress) {
   BreakpadParser parser(kFakeFilePath);
   constexpr char kTestFileContents[] =
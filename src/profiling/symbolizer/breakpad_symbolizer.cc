@@ -22,7 +22,6 @@
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/string_writer.h"
-#include "src/profiling/symbolizer/breakpad_parser.h"
 
 namespace perfetto {
 namespace profiling {
@@ -55,14 +54,12 @@ std::string MakeFilePath(const std::string& build_id,
 BreakpadSymbolizer::BreakpadSymbolizer(const std::string& symbol_dir_path)
     : symbol_dir_path_(symbol_dir_path) {}
 
-std::vector<std::vector<SymbolizedFrame>> BreakpadSymbolizer::Symbolize(
-    const std::string&,
-    const std::string& build_id,
-    uint64_t,
-    const std::vector<uint64_t>& address) {
-  std::vector<std::vector<SymbolizedFrame>> result;
-  size_t num_symbolized_frames = 0;
-  result.reserve(address.size());
+const BreakpadParser* BreakpadSymbolizer::GetParser(
+    const std::string& build_id) {
+  auto it = parsers_.find(build_id);
+  if (it != parsers_.end())
+    return it->second.get();
+
   std::string file_path;
   std::string raw_build_id = base::ToHex(build_id.c_str(), build_id.length());
 
@@ -74,9 +71,25 @@ std::vector<std::vector<SymbolizedFrame>> BreakpadSymbolizer::Symbolize(
     file_path = file_path_for_testing_;
   }
 
-  BreakpadParser parser(file_path);
-  if (!parser.ParseFile()) {
+  std::unique_ptr<BreakpadParser> parser(new BreakpadParser(file_path));
+  if (!parser->ParseFile()) {
     PERFETTO_ELOG("Failed to parse file %s.", file_path.c_str());
+    parser.reset();
+  }
+  return (parsers_[build_id] = std::move(parser)).get();
+}
+
+std::vector<std::vector<SymbolizedFrame>> BreakpadSymbolizer::Symbolize(
+    const std::string&,
+    const std::string& build_id,
+    uint64_t,
+    const std::vector<uint64_t>& address) {
+  std::vector<std::vector<SymbolizedFrame>> result;
+  size_t num_symbolized_frames = 0;
+  result.reserve(address.size());
+
+  const BreakpadParser* parser = GetParser(build_id);
+  if (!parser) {
     PERFETTO_PLOG("Symbolized %zu of %zu frames.", num_symbolized_frames,
                   address.size());
     return result;
@@ -85,7 +98,7 @@ std::vector<std::vector<SymbolizedFrame>> BreakpadSymbolizer::Symbolize(
   // Add each address's function name to the |result| vector in the same order.
   for (uint64_t addr : address) {
     SymbolizedFrame frame;
-    std::optional<std::string> opt_func_name = parser.GetSymbol(addr);
+    std::optional<std::string> opt_func_name = parser->GetSymbol(addr);
     if (opt_func_name) {
       frame.function_name = *opt_func_name;
       num_symbolized_frames++;
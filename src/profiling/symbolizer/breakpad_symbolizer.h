@@ -17,7 +17,11 @@
 #ifndef SRC_PROFILING_SYMBOLIZER_BREAKPAD_SYMBOLIZER_H_
 #define SRC_PROFILING_SYMBOLIZER_BREAKPAD_SYMBOLIZER_H_
 
+#include <map>
+#include <memory>
+
 #include "perfetto/ext/base/string_view.h"
+#include "src/profiling/symbolizer/breakpad_parser.h"
 #include "src/profiling/symbolizer/symbolizer.h"
 
 namespace perfetto {
@@ -48,8 +52,16 @@ class BreakpadSymbolizer : public Symbolizer {
   }
 
  private:
+  // Returns the parser for the symbol file of |build_id|, parsing it the
+  // first time. Returns nullptr if the file could not be parsed.
+  const BreakpadParser* GetParser(const std::string& build_id);
+
   std::string symbol_dir_path_;
   std::string file_path_for_testing_;
+  // Keyed by build id. Several mappings usually share a build id, parsed
+  // symbol files are kept so that they are only parsed once. Failed files
+  // are kept as nullptr.
+  std::map<std::string, std::unique_ptr<BreakpadParser>> parsers_;
 };
 
 }  // namespace profiling
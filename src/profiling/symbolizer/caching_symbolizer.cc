@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/symbolizer/caching_symbolizer.h"
+
+#include <fcntl.h>
+
+#include <cinttypes>
+#include <optional>
+#include <utility>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_splitter.h"
+#include "perfetto/ext/base/string_utils.h"
+
+namespace perfetto {
+namespace profiling {
+
+namespace {
+
+// Field values must not break the line-based format.
+bool IsCacheable(const SymbolizedFrame& frame) {
+  for (const std::string* str : {&frame.function_name, &frame.file_name}) {
+    if (str->find_first_of("\t\n") != std::string::npos)
+      return false;
+  }
+  return true;
+}
+
+void AppendCacheLine(uint64_t address,
+                     const SymbolizedFrame& frame,
+                     std::string* out) {
+  base::StackString<64> prefix("%" PRIx64 "\t%" PRIu32 "\t", address,
+                               frame.line);
+  out->append(prefix.c_str(), prefix.len());
+  out->append(frame.file_name);
+  out->push_back('\t');
+  out->append(frame.function_name);
+  out->push_back('\n');
+}
+
+}  // namespace
+
+std::map<uint64_t, std::vector<SymbolizedFrame>> ParseSymbolCache(
+    const std::string& contents) {
+  std::map<uint64_t, std::vector<SymbolizedFrame>> result;
+  for (base::StringSplitter lines(contents, '\n'); lines.Next();) {
+    std::string line(lines.cur_token(), lines.cur_token_size());
+    size_t addr_end = line.find('\t');
+    size_t line_end = line.find('\t', addr_end + 1);
+    size_t file_end = line.find('\t', line_end + 1);
+    if (addr_end == std::string::npos || line_end == std::string::npos ||
+        file_end == std::string::npos) {
+      continue;
+    }
+    std::optional<uint64_t> address =
+        base::StringToUInt64(line.substr(0, addr_end), 16);
+    std::optional<uint32_t> line_no = base::StringToUInt32(
+        line.substr(addr_end + 1, line_end - addr_end - 1));
+    if (!address || !line_no)
+      continue;
+    SymbolizedFrame frame;
+    frame.file_name = line.substr(line_end + 1, file_end - line_end - 1);
+    frame.function_name = line.substr(file_end + 1);
+    frame.line = *line_no;
+    result[*address].emplace_back(std::move(frame));
+  }
+  return result;
+}
+
+CachingSymbolizer::CachingSymbolizer(std::unique_ptr<Symbolizer> symbolizer,
+                                     std::string cache_dir)
+    : symbolizer_(std::move(symbolizer)), cache_dir_(std::move(cache_dir)) {
+  // Fails if the directory already exists, which is fine.
+  base::Mkdir(cache_dir_);
+}
+
+CachingSymbolizer::~CachingSymbolizer() = default;
+
+std::string CachingSymbolizer::CacheFilePath(const std::string& build_id,
+                                             uint64_t load_bias) {
+  return cache_dir_ + "/" + base::ToHex(build_id) + "-" +
+         base::Uint64ToHexStringNoPrefix(load_bias) + ".sym";
+}
+
+std::vector<std::vector<SymbolizedFrame>> CachingSymbolizer::Symbolize(
+    const std::string& mapping_name,
+    const std::string& build_id,
+    uint64_t load_bias,
+    const std::vector<uint64_t>& addresses) {
+  if (build_id.empty())
+    return symbolizer_->Symbolize(mapping_name, build_id, load_bias, addresses);
+
+  std::string path = CacheFilePath(build_id, load_bias);
+  std::string contents;
+  std::map<uint64_t, std::vector<SymbolizedFrame>> cached;
+  if (base::ReadFile(path, &contents))
+    cached = ParseSymbolCache(contents);
+
+  std::vector<uint64_t> missing;
+  for (uint64_t address : addresses) {
+    if (cached.find(address) == cached.end())
+      missing.push_back(address);
+  }
+
+  if (!missing.empty()) {
+    std::vector<std::vector<SymbolizedFrame>> res =
+        symbolizer_->Symbolize(mapping_name, build_id, load_bias, missing);
+    // An empty result means that the symbolizer failed (e.g. the binary was
+    // not found), nothing to remember in that case.
+    if (res.size() == missing.size()) {
+      std::string new_lines;
+      for (size_t i = 0; i < missing.size(); ++i) {
+        const std::vector<SymbolizedFrame>& frames = res[i];
+        bool cacheable = !frames.empty();
+        for (const SymbolizedFrame& frame : frames)
+          cacheable = cacheable && IsCacheable(frame);
+        if (cacheable) {
+          for (const SymbolizedFrame& frame : frames)
+            AppendCacheLine(missing[i], frame, &new_lines);
+        }
+        if (!frames.empty())
+          cached[missing[i]] = std::move(res[i]);
+      }
+      // Appended in a single write, so that concurrent runs sharing the
+      // directory don't interleave partial lines.
+      if (!new_lines.empty()) {
+        base::ScopedFile fd =
+            base::OpenFile(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (!fd || base::WriteAll(*fd, new_lines.data(), new_lines.size()) !=
+                       static_cast<ssize_t>(new_lines.size())) {
+          PERFETTO_PLOG("Failed to write symbol cache %s", path.c_str());
+        }
+      }
+    } else {
+      PERFETTO_DCHECK(res.empty());
+    }
+  }
+
+  std::vector<std::vector<SymbolizedFrame>> result;
+  result.reserve(addresses.size());
+  bool any_symbolized = false;
+  for (uint64_t address : addresses) {
+    auto it = cached.find(address);
+    if (it == cached.end()) {
+      result.emplace_back();
+    } else {
+      any_symbolized = true;
+      result.emplace_back(it->second);
+    }
+  }
+  if (!any_symbolized)
+    return {};
+  return result;
+}
+
+std::unique_ptr<Symbolizer> MaybeAddSymbolCache(
+    std::unique_ptr<Symbolizer> symbolizer,
+    const std::string& cache_dir) {
+  if (!symbolizer || cache_dir.empty())
+    return symbolizer;
+  return std::unique_ptr<Symbolizer>(
+      new CachingSymbolizer(std::move(symbolizer), cache_dir));
+}
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_SYMBOLIZER_CACHING_SYMBOLIZER_H_
+#define SRC_PROFILING_SYMBOLIZER_CACHING_SYMBOLIZER_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/profiling/symbolizer/symbolizer.h"
+
+namespace perfetto {
+namespace profiling {
+
+// A Symbolizer that remembers the results of another Symbolizer in a
+// persistent on-disk cache, so that symbolizing traces from the same builds
+// again does not need to look up the binaries or run llvm-symbolizer.
+//
+// The cache directory holds one file per (build id, load bias) pair, named
+// "<hex build id>-<hex load bias>.sym". Each line of a file is one symbolized
+// frame for an address, in the form "<hex address>\t<line>\t<file>\t<function>"
+// (inlined frames of the same address are on consecutive lines). New results
+// are appended, so the directory can be shared by concurrent runs.
+//
+// Mappings without a build id are passed through uncached.
+class CachingSymbolizer : public Symbolizer {
+ public:
+  CachingSymbolizer(std::unique_ptr<Symbolizer> symbolizer,
+                    std::string cache_dir);
+
+  std::vector<std::vector<SymbolizedFrame>> Symbolize(
+      const std::string& mapping_name,
+      const std::string& build_id,
+      uint64_t load_bias,
+      const std::vector<uint64_t>& addresses) override;
+
+  ~CachingSymbolizer() override;
+
+ private:
+  std::string CacheFilePath(const std::string& build_id, uint64_t load_bias);
+
+  std::unique_ptr<Symbolizer> symbolizer_;
+  const std::string cache_dir_;
+};
+
+// Parses the contents of a cache file. Malformed lines are skipped.
+std::map<uint64_t, std::vector<SymbolizedFrame>> ParseSymbolCache(
+    const std::string& contents);
+
+// Returns |symbolizer| wrapped in a CachingSymbolizer using |cache_dir|, or
+// |symbolizer| itself if either is empty.
+std::unique_ptr<Symbolizer> MaybeAddSymbolCache(
+    std::unique_ptr<Symbolizer> symbolizer,
+    const std::string& cache_dir);
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_SYMBOLIZER_CACHING_SYMBOLIZER_H_
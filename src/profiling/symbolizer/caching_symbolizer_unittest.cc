@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/symbolizer/caching_symbolizer.h"
+
+#include <stdio.h>
+
+#include "test/gtest_and_gmock.h"
+
+#include "perfetto/ext/base/temp_file.h"
+
+namespace perfetto {
+namespace profiling {
+
+bool operator==(const SymbolizedFrame& a, const SymbolizedFrame& b) {
+  return a.function_name == b.function_name && a.file_name == b.file_name &&
+         a.line == b.line;
+}
+
+namespace {
+
+// Symbolizes every address into an inlined frame and its caller, and records
+// which addresses it was asked about.
+class FakeSymbolizer : public Symbolizer {
+ public:
+  explicit FakeSymbolizer(std::vector<uint64_t>* requested)
+      : requested_(requested) {}
+
+  std::vector<std::vector<SymbolizedFrame>> Symbolize(
+      const std::string&,
+      const std::string&,
+      uint64_t,
+      const std::vector<uint64_t>& addresses) override {
+    std::vector<std::vector<SymbolizedFrame>> result;
+    for (uint64_t address : addresses) {
+      requested_->push_back(address);
+      result.push_back(FramesFor(address));
+    }
+    return result;
+  }
+
+  static std::vector<SymbolizedFrame> FramesFor(uint64_t address) {
+    std::string suffix = std::to_string(address);
+    return {{"inlined" + suffix, "inlined.h", static_cast<uint32_t>(address)},
+            {"caller" + suffix + "(int, char)", "caller.cc", 1}};
+  }
+
+ private:
+  std::vector<uint64_t>* requested_;
+};
+
+class CachingSymbolizerTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    for (const char* file : {"/6275696c64-0.sym", "/6275696c64-1000.sym"})
+      remove((cache_dir_.path() + file).c_str());
+  }
+
+  std::unique_ptr<Symbolizer> CreateSymbolizer() {
+    return MaybeAddSymbolCache(
+        std::unique_ptr<Symbolizer>(new FakeSymbolizer(&requested_)),
+        cache_dir_.path());
+  }
+
+  base::TempDir cache_dir_ = base::TempDir::Create();
+  std::vector<uint64_t> requested_;
+};
+
+TEST_F(CachingSymbolizerTest, ResultsPersistAcrossInstances) {
+  std::vector<std::vector<SymbolizedFrame>> first =
+      CreateSymbolizer()->Symbolize("mapping", "build", 0, {0x10, 0x20});
+  ASSERT_EQ(first.size(), 2u);
+  EXPECT_EQ(first[0], FakeSymbolizer::FramesFor(0x10));
+  EXPECT_EQ(first[1], FakeSymbolizer::FramesFor(0x20));
+  EXPECT_THAT(requested_, testing::ElementsAre(0x10, 0x20));
+
+  requested_.clear();
+  std::vector<std::vector<SymbolizedFrame>> second =
+      CreateSymbolizer()->Symbolize("mapping", "build", 0, {0x20, 0x30, 0x10});
+  ASSERT_EQ(second.size(), 3u);
+  EXPECT_EQ(second[0], FakeSymbolizer::FramesFor(0x20));
+  EXPECT_EQ(second[1], FakeSymbolizer::FramesFor(0x30));
+  EXPECT_EQ(second[2], FakeSymbolizer::FramesFor(0x10));
+  // Only the address that wasn't symbolized before is looked up.
+  EXPECT_THAT(requested_, testing::ElementsAre(0x30));
+}
+
+TEST_F(CachingSymbolizerTest, KeyedByLoadBias) {
+  CreateSymbolizer()->Symbolize("mapping", "build", 0, {0x10});
+  requested_.clear();
+  CreateSymbolizer()->Symbolize("mapping", "build", 0x1000, {0x10});
+  EXPECT_THAT(requested_, testing::ElementsAre(0x10));
+}
+
+TEST_F(CachingSymbolizerTest, NoBuildIdNotCached) {
+  CreateSymbolizer()->Symbolize("mapping", "", 0, {0x10});
+  CreateSymbolizer()->Symbolize("mapping", "", 0, {0x10});
+  EXPECT_THAT(requested_, testing::ElementsAre(0x10, 0x10));
+}
+
+TEST(ParseSymbolCacheTest, SkipsMalformedLines) {
+  auto parsed = ParseSymbolCache(
+      "10\t3\tfoo.cc\tfoo(int)\n"
+      "garbage\n"
+      "zz\t1\tbar.cc\tbar()\n"
+      "10\t4\tfoo.cc\tfoo_caller()\n");
+  ASSERT_EQ(parsed.size(), 1u);
+  std::vector<SymbolizedFrame> expected = {{"foo(int)", "foo.cc", 3},
+                                           {"foo_caller()", "foo.cc", 4}};
+  EXPECT_EQ(parsed[0x10], expected);
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
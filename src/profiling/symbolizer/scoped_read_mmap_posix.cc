@@ -27,7 +27,9 @@ namespace perfetto {
 namespace profiling {
 
 ScopedReadMmap::ScopedReadMmap(const char* fname, size_t length)
-    : length_(length), fd_(base::OpenFile(fname, O_RDONLY)) {
+    : length_(length),
+      ptr_(MAP_FAILED),
+      fd_(base::OpenFile(fname, O_RDONLY)) {
   if (!fd_) {
     PERFETTO_PLOG("Failed to open %s", fname);
     return;
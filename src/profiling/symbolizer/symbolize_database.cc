@@ -133,6 +133,10 @@ void SymbolizeDatabase(trace_processor::TraceProcessor* tp,
     module_symbols->set_build_id(unsymbolized_mapping.build_id);
     PERFETTO_DCHECK(res.size() == rel_pcs.size());
     for (size_t i = 0; i < res.size(); ++i) {
+      // Leave the frame unsymbolized, rather than attaching an empty symbol
+      // set to it.
+      if (res[i].empty())
+        continue;
       auto* address_symbols = module_symbols->add_address_symbols();
       address_symbols->set_address(rel_pcs[i]);
       for (const SymbolizedFrame& frame : res[i]) {
@@ -153,5 +157,10 @@ std::vector<std::string> GetPerfettoBinaryPath() {
   return {};
 }
 
+std::string GetPerfettoSymbolCachePath() {
+  const char* path = getenv("PERFETTO_SYMBOL_CACHE_PATH");
+  return path ? path : "";
+}
+
 }  // namespace profiling
 }  // namespace perfetto
@@ -29,6 +29,9 @@ class TraceProcessor;
 }
 namespace profiling {
 std::vector<std::string> GetPerfettoBinaryPath();
+// Directory for the persistent symbol cache (see |CachingSymbolizer|), empty
+// if unset.
+std::string GetPerfettoSymbolCachePath();
 // Generate ModuleSymbol protos for all unsymbolized frames in the database.
 // Wrap them in proto-encoded TracePackets messages and call callback.
 void SymbolizeDatabase(trace_processor::TraceProcessor* tp,
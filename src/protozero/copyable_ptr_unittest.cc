@@ -22,10 +22,13 @@ namespace protozero {
 namespace {
 
 struct X {
-  X() = default;
-  X(const X&) = default;
+  X() { num_instances++; }
+  X(const X& other) : val(other.val) { num_instances++; }
   X& operator=(const X&) = default;
-  ~X() { val = -1; }
+  ~X() {
+    val = -1;
+    num_instances--;
+  }
 
   friend bool operator==(const X& lhs, const X& rhs) {
     return lhs.val == rhs.val;
@@ -37,8 +40,11 @@ struct X {
   }
 
   int val = 0;
+  static int num_instances;
 };
 
+int X::num_instances = 0;
+
 TEST(CopyablePtrTest, CopyOperators) {
   CopyablePtr<X> p1;
   p1->val = 1;
@@ -114,5 +120,32 @@ TEST(CopyablePtrTest, DeepCompare) {
   EXPECT_FALSE(p1 == p2);
 }
 
+TEST(CopyablePtrTest, LazyAllocation) {
+  const int initial_instances = X::num_instances;
+  CopyablePtr<X> p1;
+  const CopyablePtr<X>& const_p1 = p1;
+  EXPECT_EQ(const_p1->val, 0);
+
+  // Copying and moving unset pointers doesn't allocate either.
+  CopyablePtr<X> p2(p1);
+  CopyablePtr<X> p3(std::move(p2));
+  p2 = p3;
+  EXPECT_TRUE(p2 == p3);
+  // Only the shared default instance has been created.
+  EXPECT_LE(X::num_instances, initial_instances + 1);
+  const int default_instances = X::num_instances;
+
+  p1->val = 1;
+  EXPECT_EQ(X::num_instances, default_instances + 1);
+  EXPECT_EQ(const_p1->val, 1);
+  EXPECT_FALSE(p1 == p3);
+
+  // Moving a set pointer doesn't allocate and leaves a default value behind.
+  p3 = std::move(p1);
+  EXPECT_EQ(X::num_instances, default_instances + 1);
+  EXPECT_EQ(p3->val, 1);
+  EXPECT_EQ(const_p1->val, 0);
+}
+
 }  // namespace
 }  // namespace protozero
@@ -16,6 +16,10 @@
 
 #include "src/protozero/filtering/message_filter.h"
 
+#include <string.h>
+
+#include <algorithm>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "src/protozero/filtering/string_filter.h"
@@ -126,8 +130,30 @@ MessageFilter::FilteredMessage MessageFilter::FilterMessageFragments(
   for (size_t slice_idx = 0; slice_idx < num_slices; ++slice_idx) {
     const InputSlice& slice = slices[slice_idx];
     const uint8_t* data = static_cast<const uint8_t*>(slice.data);
-    for (size_t i = 0; i < slice.len; ++i)
-      FilterOneByte(data[i]);
+    const uint8_t* const data_end = data + slice.len;
+    while (data < data_end) {
+      // Fastpath: the payload of strings, bytes and of submessages that are
+      // not allowed doesn't need to be parsed. Copy or skip it in one go
+      // rather than byte by byte. The last byte is left to FilterOneByte(), as
+      // it might complete a string that needs filtering or a submessage.
+      // Note that |eat_next_bytes| never exceeds the bytes left in the current
+      // message, so this can't cross the end of it.
+      StackState* state = &stack_.back();
+      if (state->eat_next_bytes > 1) {
+        const uint32_t len = static_cast<uint32_t>(
+            std::min(static_cast<size_t>(state->eat_next_bytes - 1),
+                     static_cast<size_t>(data_end - data)));
+        if (state->action != StackState::kDrop) {
+          memcpy(out_, data, len);
+          out_ += len;
+        }
+        state->eat_next_bytes -= len;
+        state->in_bytes += len;
+        data += len;
+        continue;
+      }
+      FilterOneByte(*(data++));
+    }
   }
 
   // Construct the output object.
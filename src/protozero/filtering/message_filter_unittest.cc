@@ -397,6 +397,70 @@ TEST(MessageFilterTest, MalformedInput) {
   }
 }
 
+// Checks that the payload of long strings and of the submessages that are not
+// allowed is copied or skipped correctly when split across slices.
+TEST(MessageFilterTest, LongFieldsAcrossSlices) {
+  auto schema = perfetto::base::TempFile::Create();
+  static const char kSchema[] = R"(
+  syntax = "proto2";
+  message FilterSchema {
+    message Nested {
+      optional fixed32 f32 = 4;
+      repeated string ss = 5;
+    }
+    optional int32 i32 = 1;
+    optional string str = 2;
+    repeated Nested nest = 3;
+  };
+  )";
+  perfetto::base::WriteAll(*schema, kSchema, strlen(kSchema));
+  perfetto::base::FlushFile(*schema);
+  FilterUtil filter;
+  ASSERT_TRUE(filter.LoadMessageDefinition(schema.path(), "", ""));
+  std::string bytecode = filter.GenerateFilterBytecode();
+  MessageFilter flt;
+  ASSERT_TRUE(flt.LoadFilterBytecode(bytecode.data(), bytecode.size()));
+
+  auto append_len_delim = [](uint32_t field_id, const std::string& payload,
+                             std::string* out) {
+    uint8_t buf[proto_utils::kMaxSimpleFieldEncodedSize];
+    uint8_t* wptr = proto_utils::WriteVarInt(
+        proto_utils::MakeTagLengthDelimited(field_id), buf);
+    wptr = proto_utils::WriteVarInt(payload.size(), wptr);
+    out->append(reinterpret_cast<char*>(buf), static_cast<size_t>(wptr - buf));
+    out->append(payload);
+  };
+  std::string nested;
+  append_len_delim(5, std::string(500, 'c'), &nested);
+  append_len_delim(9, std::string(300, 'd'), &nested);  // Not allowed.
+  std::string msg;
+  append_len_delim(2, std::string(1000, 'a'), &msg);
+  append_len_delim(6, std::string(1000, 'b'), &msg);  // Not allowed.
+  append_len_delim(3, nested, &msg);
+
+  auto expected = flt.FilterMessage(msg.data(), msg.size());
+  ASSERT_FALSE(expected.error);
+  std::string expected_str(reinterpret_cast<char*>(expected.data.get()),
+                           expected.size);
+  EXPECT_NE(expected_str.find(std::string(1000, 'a')), std::string::npos);
+  EXPECT_NE(expected_str.find(std::string(500, 'c')), std::string::npos);
+  EXPECT_EQ(expected_str.find('b'), std::string::npos);
+  EXPECT_EQ(expected_str.find('d'), std::string::npos);
+
+  const size_t kSliceSizes[] = {1, 7, 333};
+  for (size_t slice_size : kSliceSizes) {
+    std::vector<MessageFilter::InputSlice> slices;
+    for (size_t i = 0; i < msg.size(); i += slice_size) {
+      slices.emplace_back(MessageFilter::InputSlice{
+          msg.data() + i, std::min(slice_size, msg.size() - i)});
+    }
+    auto res = flt.FilterMessageFragments(slices.data(), slices.size());
+    ASSERT_FALSE(res.error);
+    EXPECT_EQ(std::string(reinterpret_cast<char*>(res.data.get()), res.size),
+              expected_str);
+  }
+}
+
 // It processes a real test trace with a real filter. The filter has been
 // obtained from the full upstream perfetto proto (+ re-adding the for_testing
 // field which got removed after adding most test traces). This covers the most
@@ -16,9 +16,11 @@
 
 #include "src/protozero/filtering/string_filter.h"
 
+#include <cctype>
 #include <cstring>
 #include <regex>
 #include <string_view>
+#include <vector>
 
 #include "perfetto/base/compiler.h"
 #include "perfetto/base/logging.h"
@@ -90,16 +92,139 @@ void RedactMatches(const Matches& matches) {
   }
 }
 
+struct PatternLiterals {
+  std::string prefix;
+  std::string required;
+};
+
+// Conservatively extracts, from an ECMAScript |pattern|, the literal prefix
+// and the longest other run of literal characters that every string fully
+// matching the pattern has to contain. Anything which is not understood ends
+// the current run, so the results can only be shorter than optimal, never
+// wrong.
+//
+// Example: B\|[^|]+\|VerifyClass (.*)\n -> prefix "B|", required
+// "VerifyClass ".
+PatternLiterals ExtractPatternLiterals(std::string_view pattern) {
+  std::vector<std::string> runs;
+  bool first_run_is_prefix = true;
+  std::string run;
+  auto end_run = [&] {
+    if (run.empty() && runs.empty())
+      first_run_is_prefix = false;
+    runs.push_back(std::move(run));
+    run.clear();
+  };
+
+  uint32_t depth = 0;
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    char c = pattern[i];
+    bool is_literal = false;
+    switch (c) {
+      case '\\': {
+        if (i + 1 >= pattern.size())
+          return {};
+        char next = pattern[++i];
+        if (!isalnum(static_cast<unsigned char>(next))) {
+          c = next;
+          is_literal = depth == 0;
+        } else if (!strchr("dDsSwWbBfnrtv", next)) {
+          // Escapes with arguments (\x41, \cJ, backreferences...): give up
+          // on the rest of the pattern but keep what was found so far.
+          i = pattern.size();
+        }
+        break;
+      }
+      case '[':
+        // Skip the whole character class. A ']' right after the opening
+        // bracket (or its negation) is part of the class.
+        if (i + 1 < pattern.size() && pattern[i + 1] == '^')
+          ++i;
+        if (i + 1 < pattern.size() && pattern[i + 1] == ']')
+          ++i;
+        for (++i; i < pattern.size() && pattern[i] != ']'; ++i) {
+          if (pattern[i] == '\\')
+            ++i;
+        }
+        break;
+      case '(':
+        ++depth;
+        break;
+      case ')':
+        if (depth > 0)
+          --depth;
+        break;
+      case '|':
+        // A top-level alternation means that no literal is mandatory.
+        if (depth == 0)
+          return {};
+        break;
+      case '{':
+        // Skip the bounds of the quantifier: the preceding character is
+        // optional.
+        for (++i; i < pattern.size() && pattern[i] != '}'; ++i) {
+        }
+        if (!run.empty())
+          run.pop_back();
+        break;
+      case '?':
+      case '*':
+        if (!run.empty())
+          run.pop_back();
+        break;
+      case '^':
+      case '$':
+      case '.':
+      case '+':
+      case '}':
+      case ']':
+        break;
+      default:
+        is_literal = depth == 0;
+        break;
+    }
+    if (!is_literal)
+      end_run();
+    else
+      run.push_back(c);
+  }
+  end_run();
+
+  PatternLiterals literals;
+  size_t first_other = 0;
+  if (first_run_is_prefix) {
+    literals.prefix = std::move(runs[0]);
+    first_other = 1;
+  }
+  for (size_t i = first_other; i < runs.size(); ++i) {
+    if (runs[i].size() > literals.required.size())
+      literals.required = std::move(runs[i]);
+  }
+  return literals;
+}
+
 }  // namespace
 
 void StringFilter::AddRule(Policy policy,
                            std::string_view pattern_str,
                            std::string atrace_payload_starts_with) {
+  PatternLiterals literals = ExtractPatternLiterals(pattern_str);
   rules_.emplace_back(StringFilter::Rule{
       policy,
       std::regex(pattern_str.begin(), pattern_str.end(),
                  std::regex::ECMAScript | std::regex_constants::optimize),
-      std::move(atrace_payload_starts_with)});
+      std::move(atrace_payload_starts_with), std::move(literals.prefix),
+      std::move(literals.required)});
+}
+
+bool StringFilter::Rule::MayMatch(const char* ptr, const char* end) const {
+  if (!StartsWith(ptr, end, literal_prefix))
+    return false;
+  if (required_literal.empty())
+    return true;
+  std::string_view str(ptr + literal_prefix.size(),
+                       static_cast<size_t>(end - ptr) - literal_prefix.size());
+  return str.find(required_literal) != std::string_view::npos;
 }
 
 bool StringFilter::MaybeFilterInternal(char* ptr, size_t len) const {
@@ -110,7 +235,8 @@ bool StringFilter::MaybeFilterInternal(char* ptr, size_t len) const {
     switch (rule.policy) {
       case Policy::kMatchRedactGroups:
       case Policy::kMatchBreak:
-        if (std::regex_match(ptr, ptr + len, matches, rule.pattern)) {
+        if (rule.MayMatch(ptr, ptr + len) &&
+            std::regex_match(ptr, ptr + len, matches, rule.pattern)) {
           if (rule.policy == Policy::kMatchBreak) {
             return false;
           }
@@ -127,6 +253,7 @@ bool StringFilter::MaybeFilterInternal(char* ptr, size_t len) const {
         if (atrace_payload_ptr &&
             StartsWith(atrace_payload_ptr, ptr + len,
                        rule.atrace_payload_starts_with) &&
+            rule.MayMatch(ptr, ptr + len) &&
             std::regex_match(ptr, ptr + len, matches, rule.pattern)) {
           if (rule.policy == Policy::kAtraceMatchBreak) {
             return false;
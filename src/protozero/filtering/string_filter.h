@@ -20,6 +20,7 @@
 #include <regex>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace protozero {
 
@@ -53,6 +54,15 @@ class StringFilter {
     Policy policy;
     std::regex pattern;
     std::string atrace_payload_starts_with;
+
+    // Literals derived from |pattern| which any matching string must contain,
+    // used to reject most strings without running the regex. Empty if they
+    // could not be derived.
+    std::string literal_prefix;
+    std::string required_literal;
+
+    // Returns false if [ptr, end) cannot possibly match |pattern|.
+    bool MayMatch(const char* ptr, const char* end) const;
   };
 
   bool MaybeFilterInternal(char* ptr, size_t len) const;
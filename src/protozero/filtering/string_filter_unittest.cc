@@ -180,6 +180,47 @@ TEST(StringFilterTest, AtraceBreak) {
   ASSERT_EQ(res, "B|1234|foo 1234");
 }
 
+TEST(StringFilterTest, RegexOptionalLiterals) {
+  // The literals in front of quantifiers are optional and must not be
+  // required when prefiltering strings.
+  StringFilter filter;
+  filter.AddRule(StringFilter::Policy::kMatchRedactGroups,
+                 R"(X?B\|\d+\|fo{0,2}x*y? (.*))", "");
+
+  std::string res = "B|1234|f 1234 bar";
+  ASSERT_TRUE(filter.MaybeFilter(res.data(), res.size()));
+  ASSERT_EQ(res, "B|1234|f P60REDAC");
+
+  res = "XB|1|foo 1";
+  ASSERT_TRUE(filter.MaybeFilter(res.data(), res.size()));
+  ASSERT_EQ(res, "XB|1|foo P");
+}
+
+TEST(StringFilterTest, RegexLiteralsInGroups) {
+  StringFilter filter;
+  filter.AddRule(StringFilter::Policy::kMatchRedactGroups,
+                 R"((?:B|C)\|\d+\|(?:foo|bar)[|]baz\x20(.*))", "");
+
+  std::string res = "C|1|bar|baz 1234";
+  ASSERT_TRUE(filter.MaybeFilter(res.data(), res.size()));
+  ASSERT_EQ(res, "C|1|bar|baz P60R");
+
+  res = "C|1|bar|bax 1234";
+  ASSERT_FALSE(filter.MaybeFilter(res.data(), res.size()));
+}
+
+TEST(StringFilterTest, RegexRequiredLiteralMismatch) {
+  StringFilter filter;
+  filter.AddRule(StringFilter::Policy::kMatchRedactGroups,
+                 R"(B\|[^|]+\|VerifyClass (.*))", "");
+  filter.AddRule(StringFilter::Policy::kMatchRedactGroups,
+                 R"(B\|[^|]+\|Verify(.*))", "");
+
+  std::string res = "B|1|VerifyClas foo";
+  ASSERT_TRUE(filter.MaybeFilter(res.data(), res.size()));
+  ASSERT_EQ(res, "B|1|VerifyP60REDAC");
+}
+
 TEST(StringFilterTest, RegexRedactionNonUtf) {
   StringFilter filter;
   filter.AddRule(StringFilter::Policy::kMatchRedactGroups,
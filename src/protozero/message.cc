@@ -60,6 +60,7 @@ void Message::Reset(ScatteredStreamWriter* stream_writer, MessageArena* arena) {
   size_already_written_ = 0;
   nested_message_ = nullptr;
   finalized_ = false;
+  compact_size_field_ = false;
 #if PERFETTO_DCHECK_IS_ON()
   handle_ = nullptr;
   generation_ = g_generation.fetch_add(1, std::memory_order_relaxed);
@@ -163,9 +164,35 @@ Message* Message::BeginNestedMessageInternal(uint32_t field_id) {
 }
 
 void Message::EndNestedMessage() {
-  size_ += nested_message_->Finalize();
+  // Finalize() clears the size field, so look at it beforehand.
+  uint8_t* size_field = nested_message_->size_field();
+  const bool compact = nested_message_->compact_size_field_ && size_field &&
+                       !nested_message_->finalized_;
+  uint32_t nested_size = nested_message_->Finalize();
+  size_ += nested_size;
+  if (compact)
+    size_ -= CompactNestedSizeField(size_field, nested_size);
   arena_->DeleteLastMessage(nested_message_);
   nested_message_ = nullptr;
 }
 
+uint32_t Message::CompactNestedSizeField(uint8_t* size_field, uint32_t size) {
+  // Past 16KB the varint takes 3 bytes, saving one isn't worth the memmove().
+  if (size >= (1u << 14))
+    return 0;
+
+  // The whole message must be in the current range: if it isn't, the size
+  // field has been moved to the patch list or the range before it has
+  // already been committed.
+  uint8_t* payload = size_field + proto_utils::kMessageLengthFieldSize;
+  const ContiguousMemoryRange range = stream_writer_->cur_range();
+  if (size_field < range.begin || payload + size != stream_writer_->write_ptr())
+    return 0;
+
+  uint8_t* new_payload = proto_utils::WriteVarInt(size, size_field);
+  memmove(new_payload, payload, size);
+  stream_writer_->set_write_ptr(new_payload + size);
+  return static_cast<uint32_t>(payload - new_payload);
+}
+
 }  // namespace protozero
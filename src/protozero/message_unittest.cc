@@ -281,6 +281,31 @@ TEST_F(MessageTest, BackfillSizeOnFinalization) {
   EXPECT_EQ("CB818000", GetNextSerializedBytes(4));
 }
 
+TEST_F(MessageTest, CompactSizeField) {
+  Message* root_msg = NewMessage();
+  root_msg->AppendVarInt(1, 1);
+
+  // Entirely within the first chunk: the size field is shrunk to 1 byte.
+  FakeChildMessage* nested_msg =
+      root_msg->BeginNestedMessage<FakeChildMessage>(2);
+  nested_msg->set_compact_size_field(true);
+  nested_msg->AppendVarInt(3, 3);
+  root_msg->AppendVarInt(4, 4);
+
+  // Spans two chunks: the redundant varint encoding is kept.
+  nested_msg = root_msg->BeginNestedMessage<FakeChildMessage>(5);
+  nested_msg->set_compact_size_field(true);
+  nested_msg->AppendBytes(6, kTestBytes, sizeof(kTestBytes));
+
+  EXPECT_EQ(25u, root_msg->Finalize());
+  EXPECT_EQ(25u, GetNumSerializedBytes());
+
+  EXPECT_EQ("0801", GetNextSerializedBytes(2));
+  EXPECT_EQ("12021803", GetNextSerializedBytes(4));
+  EXPECT_EQ("2004", GetNextSerializedBytes(2));
+  EXPECT_EQ("2A8C808000320A", GetNextSerializedBytes(7));
+}
+
 TEST_F(MessageTest, StressTest) {
   std::vector<Message*> nested_msgs;
 
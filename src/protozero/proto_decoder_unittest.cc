@@ -105,6 +105,29 @@ TEST(ProtoDecoderTest, SingleRepeatedField) {
   EXPECT_FALSE(++it);
 }
 
+// Decoders of messages without non-packed repeated fields have a smaller
+// on-stack storage, but must still handle a field being repeated in the
+// encoded message (e.g. for a field that was repeated in an older version of
+// the .proto).
+TEST(ProtoDecoderTest, RepeatedFieldWithoutRepeatedStorage) {
+  static_assert(TypedProtoDecoder<2, false>::kStackCapacity <
+                    TypedProtoDecoder<2, true>::kStackCapacity,
+                "Unexpected on-stack storage size");
+  HeapBuffered<Message> message;
+  for (int32_t i = 0; i < 300; i++)
+    message->AppendVarInt(/*field_id=*/2, i);
+  message->AppendVarInt(/*field_id=*/1, 42);
+  auto data = message.SerializeAsArray();
+
+  TypedProtoDecoder<2, false> tpd(data.data(), data.size());
+  EXPECT_EQ(tpd.at<1>().as_int32(), 42);
+  EXPECT_EQ(tpd.at<2>().as_int32(), 299);
+  int32_t expected = 0;
+  for (auto it = tpd.GetRepeated<int32_t>(/*field_id=*/2); it; ++it)
+    EXPECT_EQ(*it, expected++);
+  EXPECT_EQ(expected, 300);
+}
+
 TEST(ProtoDecoderTest, RepeatedVariableLengthField) {
   HeapBuffered<Message> message;
 
@@ -624,5 +647,23 @@ TEST(ProtoDecoderTest, PacketRepeatedWireTypeMismatch) {
   EXPECT_FALSE(it);
 }
 
+TEST(ProtoDecoderTest, SelectedFieldsDecoder) {
+  HeapBuffered<Message> message;
+  message->AppendVarInt(/*field_id=*/1, 10);
+  message->AppendString(/*field_id=*/2, "skipped");
+  message->BeginNestedMessage<Message>(/*field_id=*/3)->AppendVarInt(1, 42);
+  message->AppendVarInt(/*field_id=*/500, 20);
+  message->AppendVarInt(/*field_id=*/1, 11);
+  auto data = message.SerializeAsArray();
+
+  SelectedFieldsDecoder<500, 1, 3, 4> decoder(data.data(), data.size());
+  EXPECT_EQ(decoder.at<1>().as_int32(), 11);
+  EXPECT_EQ(decoder.at<500>().as_int32(), 20);
+  EXPECT_FALSE(decoder.at<4>().valid());
+  ASSERT_TRUE(decoder.at<3>().valid());
+  ProtoDecoder nested(decoder.at<3>().as_bytes());
+  EXPECT_EQ(nested.FindField(1).as_int32(), 42);
+}
+
 }  // namespace
 }  // namespace protozero
@@ -16,8 +16,11 @@
 
 #include "src/protozero/proto_ring_buffer.h"
 
+#include <algorithm>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/paged_memory.h"
+#include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/proto_utils.h"
 
 namespace protozero {
@@ -104,44 +107,41 @@ void RingBufferMessageReader::Append(const void* data_void, size_t data_len) {
     }
   }
 
-  size_t avail = buf_.size() - wr_;
-  if (data_len > avail) {
+  if (data_len > buf_.size() - wr_) {
     // This whole section should be hit extremely rarely.
-
-    // Try first just recompacting the buffer by moving everything to the left.
-    // This can happen if we received "a message and a bit" on each Append call
-    // so we ended pup in a situation like:
-    // buf_: [unused space] [msg1 incomplete]
-    //                      ^rd_             ^wr_
-    //
-    // After recompaction:
-    // buf_: [msg1 incomplete]
-    //       ^rd_             ^wr_
     uint8_t* buf = static_cast<uint8_t*>(buf_.Get());
-    memmove(&buf[0], &buf[rd_], wr_ - rd_);
-    avail += rd_;
-    wr_ -= rd_;
-    rd_ = 0;
-    if (data_len > avail) {
-      // The compaction didn't free up enough space and we need to expand the
-      // ring buffer. Yes, we could have detected this earlier and split the
-      // code paths, rather than first compacting and then realizing it wasn't
-      // sufficient. However, that would make the code harder to reason about,
-      // creating code paths that are nearly never hit, hence making it more
-      // likely to accumulate bugs in future. All this is very rare.
-      size_t new_size = buf_.size();
-      while (data_len > new_size - wr_)
-        new_size += kGrowBytes;
-      if (new_size > kMaxMsgSize * 2) {
+    const size_t used = wr_ - rd_;
+    if (data_len <= buf_.size() - used) {
+      // Recompacting the buffer by moving everything to the left is enough.
+      // This can happen if we received "a message and a bit" on each Append
+      // call so we ended pup in a situation like:
+      // buf_: [unused space] [msg1 incomplete]
+      //                      ^rd_             ^wr_
+      //
+      // After recompaction:
+      // buf_: [msg1 incomplete]
+      //       ^rd_             ^wr_
+      memmove(&buf[0], &buf[rd_], used);
+    } else {
+      // The compaction wouldn't free up enough space and we need to expand
+      // the ring buffer. This happens when a large message is received in
+      // many small fragments. The buffer is (at least) doubled, so that the
+      // incomplete message is copied O(log(size)) times rather than once per
+      // kGrowBytes, which was quadratic for messages of several MB. Only the
+      // unread bytes are copied, straight to the start of the new buffer.
+      if (used + data_len > kMaxMsgSize * 2) {
         failed_ = true;
         return;
       }
+      size_t new_size = std::max(buf_.size() * 2, used + data_len);
+      new_size = perfetto::base::AlignUp<kGrowBytes>(new_size);
+      new_size = std::min(new_size, kMaxMsgSize * 2);
       auto new_buf = perfetto::base::PagedMemory::Allocate(new_size);
-      memcpy(new_buf.Get(), buf_.Get(), buf_.size());
+      memcpy(new_buf.Get(), &buf[rd_], used);
       buf_ = std::move(new_buf);
-      avail = new_size - wr_;
-      // No need to touch rd_ / wr_ cursors.
     }
+    wr_ = used;
+    rd_ = 0;
   }
 
   // Append the received data at the end of the ring buffer.
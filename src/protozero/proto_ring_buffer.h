@@ -89,8 +89,10 @@ namespace protozero {
 // In the next ReadMessage() the R cursor will chase the W cursor. When this
 // happens (very frequent) we can just reset both cursors to 0 and restart.
 // If we are unlucky and get to the end of the buffer, two things happen:
-// 1. We try first to recompact the buffer, moving everything left by R.
-// 2. If still there isn't enough space, we expand the buffer.
+// 1. If that frees up enough space, we recompact the buffer, moving
+//    everything left by R.
+// 2. Otherwise, we expand the buffer (at least doubling it) and copy only
+//    the bytes between R and W into it.
 // Given that each message is expected to be at most kMaxMsgSize (64 MB), the
 // expansion is bound at 2 * kMaxMsgSize.
 
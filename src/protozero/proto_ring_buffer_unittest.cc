@@ -199,6 +199,36 @@ TEST_F(ProtoRingBufferTest, RandomSizes) {
   EXPECT_TRUE(expected.empty());
 }
 
+// A message much larger than the initial capacity, received in small
+// fragments, makes the buffer grow a few times (by doubling) and is still
+// returned in one piece.
+TEST_F(ProtoRingBufferTest, LargeMessageInSmallFragments) {
+  ProtoRingBuffer buf;
+  const size_t initial_capacity = buf.capacity();
+
+  // Start with a small message followed by the beginning of the large one,
+  // so that the ring buffer has to carry the partial message around.
+  last_msg_.reserve(16 * 1024 * 1024);
+  auto small_msg = MakeProtoMessage(/*field_id=*/1, /*len=*/100);
+  auto large_msg = MakeProtoMessage(/*field_id=*/2, /*len=*/8 * 1024 * 1024,
+                                    /*append=*/true);
+  const size_t total = last_msg_.size();
+  std::vector<ProtoRingBuffer::Message> msgs;
+  for (size_t off = 0; off < total;) {
+    size_t frag_len = std::min<size_t>(4000, total - off);
+    buf.Append(&last_msg_[off], frag_len);
+    off += frag_len;
+    for (auto msg = buf.ReadMessage(); msg.valid(); msg = buf.ReadMessage())
+      msgs.push_back(msg);
+  }
+
+  ASSERT_EQ(msgs.size(), 2u);
+  EXPECT_EQ(msgs[0].field_id, small_msg.field_id);
+  EXPECT_EQ(msgs[1], large_msg);
+  EXPECT_GT(buf.capacity(), initial_capacity);
+  EXPECT_LE(buf.capacity(), 2 * total);
+}
+
 TEST_F(ProtoRingBufferTest, HandleProtoErrorsGracefully) {
   ProtoRingBuffer buf;
 
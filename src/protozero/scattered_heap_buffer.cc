@@ -59,9 +59,9 @@ protozero::ContiguousMemoryRange ScatteredHeapBuffer::GetNewBuffer() {
   PERFETTO_CHECK(writer_);
   AdjustUsedSizeOfCurrentSlice();
 
-  if (cached_slice_.start()) {
-    slices_.push_back(std::move(cached_slice_));
-    PERFETTO_DCHECK(!cached_slice_.start());
+  if (!cached_slices_.empty()) {
+    slices_.push_back(std::move(cached_slices_.back()));
+    cached_slices_.pop_back();
   } else {
     slices_.emplace_back(next_slice_size_);
   }
@@ -111,10 +111,24 @@ size_t ScatteredHeapBuffer::GetTotalSize() {
 }
 
 void ScatteredHeapBuffer::Reset() {
-  if (slices_.empty())
-    return;
-  cached_slice_ = std::move(slices_.front());
-  cached_slice_.Clear();
+  size_t cached_size = 0;
+  for (const Slice& slice : cached_slices_)
+    cached_size += slice.size();
+
+  size_t num_kept = 0;
+  for (; num_kept < slices_.size(); num_kept++) {
+    size_t size = slices_[num_kept].size();
+    if (num_kept > 0 && cached_size + size > maximum_slice_size_)
+      break;
+    cached_size += size;
+  }
+
+  // Push them in reverse order, so that they are handed out again in the same
+  // order (and before the ones which were left over from the previous use).
+  for (size_t i = num_kept; i-- > 0;) {
+    slices_[i].Clear();
+    cached_slices_.push_back(std::move(slices_[i]));
+  }
   slices_.clear();
 }
 
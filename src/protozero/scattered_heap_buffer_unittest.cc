@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/protozero/scattered_heap_buffer.h"
+
+#include <string>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace protozero {
+namespace {
+
+std::vector<const uint8_t*> SliceStarts(HeapBuffered<Message>* msg) {
+  std::vector<const uint8_t*> starts;
+  for (const auto& slice : msg->GetSlices())
+    starts.push_back(slice.start());
+  return starts;
+}
+
+void AppendFields(Message* msg, uint32_t count) {
+  for (uint32_t i = 1; i <= count; i++)
+    msg->AppendVarInt(i, i);
+}
+
+TEST(HeapBufferedTest, ResetReusesSlices) {
+  HeapBuffered<Message> msg(16, 64);
+  AppendFields(msg.get(), 20);
+  std::vector<uint8_t> first = msg.SerializeAsArray();
+  std::vector<const uint8_t*> slices = SliceStarts(&msg);
+  ASSERT_EQ(slices.size(), 2u);
+
+  msg.Reset();
+  AppendFields(msg.get(), 20);
+  EXPECT_EQ(msg.SerializeAsArray(), first);
+  EXPECT_EQ(SliceStarts(&msg), slices);
+
+  // A smaller message uses only the first slice, the second one is kept.
+  msg.Reset();
+  AppendFields(msg.get(), 2);
+  EXPECT_THAT(SliceStarts(&msg), testing::ElementsAre(slices[0]));
+  msg.Reset();
+  AppendFields(msg.get(), 20);
+  EXPECT_EQ(SliceStarts(&msg), slices);
+}
+
+TEST(HeapBufferedTest, ResetKeepsUpToMaximumSliceSize) {
+  HeapBuffered<Message> msg(16, 64);
+  // Slices of 16, 32 and 64 bytes: only the first two fit in 64 bytes.
+  AppendFields(msg.get(), 25);
+  std::vector<const uint8_t*> slices = SliceStarts(&msg);
+  ASSERT_EQ(slices.size(), 3u);
+
+  msg.Reset();
+  AppendFields(msg.get(), 25);
+  std::vector<const uint8_t*> reused = SliceStarts(&msg);
+  ASSERT_EQ(reused.size(), 3u);
+  EXPECT_EQ(reused[0], slices[0]);
+  EXPECT_EQ(reused[1], slices[1]);
+}
+
+TEST(HeapBufferedTest, AppendSerializedTo) {
+  HeapBuffered<Message> msg(16, 16);
+  AppendFields(msg.get(), 30);
+  std::vector<uint8_t> expected = msg.SerializeAsArray();
+
+  std::string str = "prefix";
+  msg.AppendSerializedTo(&str);
+  EXPECT_EQ(str, "prefix" + std::string(expected.begin(), expected.end()));
+  EXPECT_EQ(msg.SerializeAsString(), str.substr(6));
+
+  std::vector<uint8_t> vec = {1, 2};
+  msg.AppendSerializedTo(&vec);
+  expected.insert(expected.begin(), {1, 2});
+  EXPECT_EQ(vec, expected);
+}
+
+}  // namespace
+}  // namespace protozero
@@ -0,0 +1,72 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "perfetto/protozero/message.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/protozero/static_buffer.h"
+
+namespace {
+
+// Number of fields of each kind appended per iteration.
+constexpr uint32_t kNumFields = 64;
+
+// Appends a mix of the field types emitted by typical trace points (e.g.
+// ftrace events, track events): small varints, enums/bools, 64 bit varints
+// (timestamps) and fixed64.
+void AppendFields(protozero::Message* msg, uint64_t seed) {
+  for (uint32_t i = 1; i <= kNumFields; i++) {
+    msg->AppendTinyVarInt(1, static_cast<int32_t>(i & 1));
+    msg->AppendVarInt(2, i);
+    msg->AppendVarInt(3, seed + i);
+    msg->AppendFixed(4, seed ^ i);
+  }
+}
+
+void SetItemsProcessed(benchmark::State& state) {
+  state.SetItemsProcessed(
+      static_cast<int64_t>(state.iterations() * kNumFields * 4));
+}
+
+}  // namespace
+
+static void BM_MessageAppend_StaticBuffer(benchmark::State& state) {
+  std::vector<uint8_t> buf(64 * 1024);
+  uint64_t seed = 0x1234567890ull;
+  for (auto _ : state) {
+    protozero::StaticBuffered<protozero::Message> msg(buf.data(), buf.size());
+    AppendFields(msg.get(), seed++);
+    benchmark::DoNotOptimize(msg.Finalize());
+    benchmark::ClobberMemory();
+  }
+  SetItemsProcessed(state);
+}
+BENCHMARK(BM_MessageAppend_StaticBuffer);
+
+static void BM_MessageAppend_HeapBuffered(benchmark::State& state) {
+  // Small slices, so that the benchmark also covers the chunk boundaries.
+  protozero::HeapBuffered<protozero::Message> msg(512, 512);
+  uint64_t seed = 0x1234567890ull;
+  for (auto _ : state) {
+    AppendFields(msg.get(), seed++);
+    benchmark::DoNotOptimize(msg->Finalize());
+    benchmark::ClobberMemory();
+    msg.Reset();
+  }
+  SetItemsProcessed(state);
+}
+BENCHMARK(BM_MessageAppend_HeapBuffered);
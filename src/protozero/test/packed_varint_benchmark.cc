@@ -0,0 +1,68 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/protozero/packed_repeated_fields.h"
+#include "perfetto/protozero/proto_decoder.h"
+#include "perfetto/protozero/proto_utils.h"
+
+namespace {
+
+constexpr size_t kNumValues = 4096;
+
+// The argument is the max number of bits of the encoded values: 7 bits gives
+// single-byte varints only (e.g. compact_sched prios and comm indexes), 24
+// bits resembles compact_sched timestamp deltas, 64 bits is the worst case.
+void VarIntBenchmarkArgs(benchmark::internal::Benchmark* b) {
+  b->Arg(7);
+  b->Arg(24);
+  b->Arg(64);
+}
+
+void EncodeRandomValues(const benchmark::State& state,
+                        protozero::PackedVarInt* buf) {
+  std::minstd_rand0 rnd(0);
+  const auto bits = static_cast<uint32_t>(state.range(0));
+  for (size_t i = 0; i < kNumValues; i++) {
+    uint64_t value = (static_cast<uint64_t>(rnd()) << 32) | rnd();
+    if (bits < 64)
+      value &= (1ull << bits) - 1;
+    buf->Append(value);
+  }
+}
+
+}  // namespace
+
+static void BM_PackedVarIntIterator(benchmark::State& state) {
+  protozero::PackedVarInt buf;
+  EncodeRandomValues(state, &buf);
+  using Iterator = protozero::PackedRepeatedFieldIterator<
+      protozero::proto_utils::ProtoWireType::kVarInt, uint64_t>;
+
+  for (auto _ : state) {
+    bool parse_error = false;
+    uint64_t sum = 0;
+    for (Iterator it(buf.data(), buf.size(), &parse_error); it; ++it)
+      sum += *it;
+    PERFETTO_CHECK(!parse_error);
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(
+      static_cast<int64_t>(state.iterations() * kNumValues));
+}
+BENCHMARK(BM_PackedVarIntIterator)->Apply(VarIntBenchmarkArgs);
@@ -185,6 +185,33 @@ void BM_Shlib_TeDebugAnnotations(benchmark::State& state) {
   }
 }
 
+void BM_Shlib_TeManyExtras(benchmark::State& state) {
+  EnsureInitialized();
+  TracingSession tracing_session =
+      TracingSession::Builder().set_data_source_name("track_event").Build();
+
+  while (state.KeepRunning()) {
+    PERFETTO_TE(benchmark_cat, PERFETTO_TE_SLICE_BEGIN("Event"),
+                PERFETTO_TE_ARG_UINT64("value", 42),
+                PERFETTO_TE_ARG_STRING("string", "value"),
+                PERFETTO_TE_ARG_DOUBLE("double", 4.2),
+                PERFETTO_TE_FLOW(PerfettoTeProcessScopedFlow(1)));
+    benchmark::ClobberMemory();
+  }
+}
+
+void BM_Shlib_TeDynamicCategory(benchmark::State& state) {
+  EnsureInitialized();
+  TracingSession tracing_session =
+      TracingSession::Builder().set_data_source_name("track_event").Build();
+
+  while (state.KeepRunning()) {
+    PERFETTO_TE(PERFETTO_TE_DYNAMIC_CATEGORY, PERFETTO_TE_SLICE_BEGIN("Event"),
+                PERFETTO_TE_DYNAMIC_CATEGORY_STRING("dynamic"));
+    benchmark::ClobberMemory();
+  }
+}
+
 void BM_Shlib_TeLlBasic(benchmark::State& state) {
   EnsureInitialized();
   TracingSession tracing_session =
@@ -357,6 +384,8 @@ BENCHMARK(BM_Shlib_TeDisabled);
 BENCHMARK(BM_Shlib_TeBasic);
 BENCHMARK(BM_Shlib_TeBasicNoIntern);
 BENCHMARK(BM_Shlib_TeDebugAnnotations);
+BENCHMARK(BM_Shlib_TeManyExtras);
+BENCHMARK(BM_Shlib_TeDynamicCategory);
 BENCHMARK(BM_Shlib_TeLlBasic);
 BENCHMARK(BM_Shlib_TeLlBasicNoIntern);
 BENCHMARK(BM_Shlib_TeLlDebugAnnotations);
@@ -214,6 +214,11 @@ struct TrackEventIncrementalState {
   // Map from serialized representation of a dynamic category to its enabled
   // state.
   base::FlatHashMap<std::string, bool> dynamic_categories;
+  // Scratch buffers used to serialize a dynamic category to look it up in
+  // `dynamic_categories`. They're kept here to reuse their allocations.
+  protozero::HeapBuffered<protos::pbzero::TrackEventDescriptor>
+      serialized_dynamic_category;
+  std::string dynamic_category_key;
   InternMap iids;
 };
 
@@ -633,15 +638,95 @@ void ResetIncrementalStateIfRequired(
   }
 }
 
+// The extra arguments of a PerfettoTeHlEmitImpl() call, sorted out in a single
+// pass over the `PerfettoTeHlExtra` list. The list is walked again only for
+// the kinds of arguments which can be repeated (debug args and flows), and only
+// if there are any.
+struct ParsedExtras {
+  explicit ParsedExtras(const PerfettoTeHlExtra* extra_data);
+
+  const PerfettoTeHlExtra* extra_data;
+  const PerfettoTeRegisteredTrackImpl* registered_track = nullptr;
+  const PerfettoTeHlExtraNamedTrack* named_track = nullptr;
+  const PerfettoTeHlExtraTimestamp* custom_timestamp = nullptr;
+  const PerfettoTeCategoryDescriptor* dynamic_cat = nullptr;
+  const PerfettoTeHlExtraCounterInt64* int_counter = nullptr;
+  const PerfettoTeHlExtraCounterDouble* double_counter = nullptr;
+  bool use_interning = true;
+  bool flush = false;
+  bool has_debug_args = false;
+  bool has_flows = false;
+  bool has_terminating_flows = false;
+};
+
+ParsedExtras::ParsedExtras(const PerfettoTeHlExtra* extras)
+    : extra_data(extras) {
+  for (const auto* it = extra_data; it; it = it->next) {
+    switch (it->type) {
+      case PERFETTO_TE_HL_EXTRA_TYPE_REGISTERED_TRACK:
+        registered_track =
+            reinterpret_cast<const struct PerfettoTeHlExtraRegisteredTrack*>(
+                it)
+                ->track;
+        named_track = nullptr;
+        break;
+      case PERFETTO_TE_HL_EXTRA_TYPE_NAMED_TRACK:
+        registered_track = nullptr;
+        named_track =
+            reinterpret_cast<const struct PerfettoTeHlExtraNamedTrack*>(it);
+        break;
+      case PERFETTO_TE_HL_EXTRA_TYPE_TIMESTAMP:
+        custom_timestamp =
+            reinterpret_cast<const struct PerfettoTeHlExtraTimestamp*>(it);
+        break;
+      case PERFETTO_TE_HL_EXTRA_TYPE_DYNAMIC_CATEGORY:
+        dynamic_cat =
+            reinterpret_cast<const struct PerfettoTeHlExtraDynamicCategory*>(
+                it)
+                ->desc;
+        break;
+      case PERFETTO_TE_HL_EXTRA_TYPE_COUNTER_INT64:
+        int_counter =
+            reinterpret_cast<const struct PerfettoTeHlExtraCounterInt64*>(it);
+        break;
+      case PERFETTO_TE_HL_EXTRA_TYPE_COUNTER_DOUBLE:
+        double_counter =
+            reinterpret_cast<const struct PerfettoTeHlExtraCounterDouble*>(it);
+        break;
+      case PERFETTO_TE_HL_EXTRA_TYPE_DEBUG_ARG_BOOL:
+      case PERFETTO_TE_HL_EXTRA_TYPE_DEBUG_ARG_UINT64:
+      case PERFETTO_TE_HL_EXTRA_TYPE_DEBUG_ARG_INT64:
+      case PERFETTO_TE_HL_EXTRA_TYPE_DEBUG_ARG_DOUBLE:
+      case PERFETTO_TE_HL_EXTRA_TYPE_DEBUG_ARG_STRING:
+      case PERFETTO_TE_HL_EXTRA_TYPE_DEBUG_ARG_POINTER:
+        has_debug_args = true;
+        break;
+      case PERFETTO_TE_HL_EXTRA_TYPE_FLOW:
+        has_flows = true;
+        break;
+      case PERFETTO_TE_HL_EXTRA_TYPE_TERMINATING_FLOW:
+        has_terminating_flows = true;
+        break;
+      case PERFETTO_TE_HL_EXTRA_TYPE_FLUSH:
+        flush = true;
+        break;
+      case PERFETTO_TE_HL_EXTRA_TYPE_NO_INTERN:
+        use_interning = false;
+        break;
+      default:
+        break;
+    }
+  }
+}
+
 void WriteTrackEvent(perfetto::shlib::TrackEventIncrementalState* incr,
                      perfetto::protos::pbzero::TrackEvent* event,
                      PerfettoTeCategoryImpl* cat,
                      perfetto::protos::pbzero::TrackEvent::Type type,
                      const char* name,
-                     const PerfettoTeHlExtra* extra_data,
-                     std::optional<uint64_t> track_uuid,
-                     const PerfettoTeCategoryDescriptor* dynamic_cat,
-                     bool use_interning) {
+                     const ParsedExtras& extras,
+                     std::optional<uint64_t> track_uuid) {
+  const PerfettoTeCategoryDescriptor* dynamic_cat = extras.dynamic_cat;
   if (type != perfetto::protos::pbzero::TrackEvent::TYPE_UNSPECIFIED) {
     event->set_type(type);
   }
@@ -663,7 +748,7 @@ void WriteTrackEvent(perfetto::shlib::TrackEventIncrementalState* incr,
 
   if (type != perfetto::protos::pbzero::TrackEvent::TYPE_SLICE_END) {
     if (name) {
-      if (use_interning) {
+      if (extras.use_interning) {
         const void* str = name;
         size_t len = strlen(name);
         auto res = incr->iids.FindOrAssign(
@@ -691,20 +776,16 @@ void WriteTrackEvent(perfetto::shlib::TrackEventIncrementalState* incr,
     event->set_track_uuid(*track_uuid);
   }
 
-  for (const auto* it = extra_data; it; it = it->next) {
-    if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_COUNTER_INT64 &&
-        type == perfetto::protos::pbzero::TrackEvent::TYPE_COUNTER) {
-      event->set_counter_value(
-          reinterpret_cast<const struct PerfettoTeHlExtraCounterInt64*>(it)
-              ->value);
-    } else if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_COUNTER_DOUBLE) {
-      event->set_double_counter_value(
-          reinterpret_cast<const struct PerfettoTeHlExtraCounterDouble*>(it)
-              ->value);
-    }
+  if (extras.int_counter &&
+      type == perfetto::protos::pbzero::TrackEvent::TYPE_COUNTER) {
+    event->set_counter_value(extras.int_counter->value);
+  }
+  if (extras.double_counter) {
+    event->set_double_counter_value(extras.double_counter->value);
   }
 
-  for (const auto* it = extra_data; it; it = it->next) {
+  for (const auto* it = extras.extra_data; it && extras.has_debug_args;
+       it = it->next) {
     if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_DEBUG_ARG_BOOL ||
         it->type == PERFETTO_TE_HL_EXTRA_TYPE_DEBUG_ARG_UINT64 ||
         it->type == PERFETTO_TE_HL_EXTRA_TYPE_DEBUG_ARG_INT64 ||
@@ -764,14 +845,16 @@ void WriteTrackEvent(perfetto::shlib::TrackEventIncrementalState* incr,
     }
   }
 
-  for (const auto* it = extra_data; it; it = it->next) {
+  for (const auto* it = extras.extra_data; it && extras.has_flows;
+       it = it->next) {
     if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_FLOW) {
       event->add_flow_ids(
           reinterpret_cast<const struct PerfettoTeHlExtraFlow*>(it)->id);
     }
   }
 
-  for (const auto* it = extra_data; it; it = it->next) {
+  for (const auto* it = extras.extra_data;
+       it && extras.has_terminating_flows; it = it->next) {
     if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_TERMINATING_FLOW) {
       event->add_terminating_flow_ids(
           reinterpret_cast<const struct PerfettoTeHlExtraFlow*>(it)->id);
@@ -834,9 +917,16 @@ static bool IsDynamicCategoryEnabled(
   perfetto::internal::DataSourceType* ds =
       perfetto::shlib::TrackEvent::GetType();
   auto& cache = incr_state->dynamic_categories;
-  protozero::HeapBuffered<perfetto::protos::pbzero::TrackEventDescriptor> ted;
+  auto& ted = incr_state->serialized_dynamic_category;
+  ted.Reset();
   SerializeCategory(desc, ted.get());
-  std::string serialized = ted.SerializeAsString();
+  std::string& serialized = incr_state->dynamic_category_key;
+  serialized.clear();
+  for (const auto& slice : ted.GetSlices()) {
+    auto range = slice.GetUsedRange();
+    serialized.append(reinterpret_cast<const char*>(range.begin),
+                      range.size());
+  }
   auto* cached = cache.Find(serialized);
   if (cached) {
     return *cached;
@@ -880,55 +970,20 @@ static void InstanceOp(
     struct PerfettoTeCategoryImpl* cat,
     perfetto::protos::pbzero::TrackEvent::Type type,
     const char* name,
-    const struct PerfettoTeHlExtra* extra_data) {
+    const ParsedExtras& extras) {
   if (!ii->instance) {
     return;
   }
 
-  const PerfettoTeRegisteredTrackImpl* registered_track = nullptr;
-  const PerfettoTeHlExtraNamedTrack* named_track = nullptr;
+  const PerfettoTeRegisteredTrackImpl* registered_track =
+      extras.registered_track;
+  const PerfettoTeHlExtraNamedTrack* named_track = extras.named_track;
   std::optional<uint64_t> track_uuid;
 
-  const struct PerfettoTeHlExtraTimestamp* custom_timestamp = nullptr;
-  const struct PerfettoTeCategoryDescriptor* dynamic_cat = nullptr;
-  std::optional<int64_t> int_counter;
-  std::optional<double> double_counter;
-  bool use_interning = true;
-
-  for (const auto* it = extra_data; it; it = it->next) {
-    if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_REGISTERED_TRACK) {
-      auto* cast =
-          reinterpret_cast<const struct PerfettoTeHlExtraRegisteredTrack*>(it);
-      registered_track = cast->track;
-      named_track = nullptr;
-    } else if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_NAMED_TRACK) {
-      registered_track = nullptr;
-      named_track =
-          reinterpret_cast<const struct PerfettoTeHlExtraNamedTrack*>(it);
-    } else if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_TIMESTAMP) {
-      custom_timestamp =
-          reinterpret_cast<const struct PerfettoTeHlExtraTimestamp*>(it);
-    } else if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_DYNAMIC_CATEGORY) {
-      dynamic_cat =
-          reinterpret_cast<const struct PerfettoTeHlExtraDynamicCategory*>(it)
-              ->desc;
-    } else if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_COUNTER_INT64) {
-      int_counter =
-          reinterpret_cast<const struct PerfettoTeHlExtraCounterInt64*>(it)
-              ->value;
-    } else if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_COUNTER_DOUBLE) {
-      double_counter =
-          reinterpret_cast<const struct PerfettoTeHlExtraCounterInt64*>(it)
-              ->value;
-    } else if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_NO_INTERN) {
-      use_interning = false;
-    }
-  }
-
   perfetto::TraceTimestamp ts;
-  if (custom_timestamp) {
-    ts.clock_id = custom_timestamp->timestamp.clock_id;
-    ts.value = custom_timestamp->timestamp.value;
+  if (extras.custom_timestamp) {
+    ts.clock_id = extras.custom_timestamp->timestamp.clock_id;
+    ts.value = extras.custom_timestamp->timestamp.value;
   } else {
     ts = TrackEventInternal::GetTraceTime();
   }
@@ -942,9 +997,9 @@ static void InstanceOp(
   ResetIncrementalStateIfRequired(ii->instance->trace_writer.get(), incr_state,
                                   track_event_tls, ts);
 
-  if (PERFETTO_UNLIKELY(dynamic_cat)) {
+  if (PERFETTO_UNLIKELY(extras.dynamic_cat)) {
     AdvanceToFirstEnabledDynamicCategory(ii, tls_state, incr_state, cat,
-                                         *dynamic_cat);
+                                         *extras.dynamic_cat);
     if (!ii->instance) {
       return;
     }
@@ -979,8 +1034,8 @@ static void InstanceOp(
         ii->instance->trace_writer.get(), incr_state, track_event_tls, ts,
         perfetto::protos::pbzero::TracePacket::SEQ_NEEDS_INCREMENTAL_STATE);
     auto* track_event = packet->set_track_event();
-    WriteTrackEvent(incr_state, track_event, cat, type, name, extra_data,
-                    track_uuid, dynamic_cat, use_interning);
+    WriteTrackEvent(incr_state, track_event, cat, type, name, extras,
+                    track_uuid);
     track_event->Finalize();
 
     if (!incr_state->serialized_interned_data.empty()) {
@@ -992,13 +1047,7 @@ static void InstanceOp(
     }
   }
 
-  bool flush = false;
-  for (const auto* it = extra_data; it; it = it->next) {
-    if (it->type == PERFETTO_TE_HL_EXTRA_TYPE_FLUSH) {
-      flush = true;
-    }
-  }
-  if (PERFETTO_UNLIKELY(flush)) {
+  if (PERFETTO_UNLIKELY(extras.flush)) {
     ii->instance->trace_writer->Flush();
   }
 }
@@ -1026,13 +1075,14 @@ void PerfettoTeHlEmitImpl(struct PerfettoTeCategoryImpl* cat,
     return;
   }
 
+  const ParsedExtras extras(extra_data);
   for (perfetto::internal::DataSourceType::InstancesIterator ii =
            ds->BeginIteration<perfetto::shlib::TracePointTraits>(
                cached_instances, tls_state, {cat});
        ii.instance;
        ds->NextIteration</*Traits=*/perfetto::shlib::TracePointTraits>(
            &ii, tls_state, {cat})) {
-    InstanceOp(ds, &ii, tls_state, cat, EventType(type), name, extra_data);
+    InstanceOp(ds, &ii, tls_state, cat, EventType(type), name, extras);
   }
   ds->TraceEpilogue(tls_state);
 }
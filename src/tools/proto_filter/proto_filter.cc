@@ -14,11 +14,23 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <cinttypes>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/getopt.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/threading/thread_pool.h"
 #include "perfetto/ext/base/version.h"
+#include "perfetto/protozero/proto_utils.h"
 #include "protos/perfetto/config/trace_config.gen.h"
 #include "src/perfetto_cmd/pbtxt_to_pb.h"
 #include "src/protozero/filtering/filter_util.h"
@@ -44,6 +56,7 @@ const char kUsage[] =
 -d --dedupe:         Minimize filter size by deduping leaf messages with same field ids.
 -x --passthrough:    Passthrough a nested message as an opaque bytes field.
 -g --filter_string:  Filter the string using separately specified rules before passing it through.
+-j --jobs:           Number of threads used to filter --msg_in (default: number of CPUs).
 
 Example usage:
 
@@ -144,6 +157,176 @@ std::optional<protozero::StringFilter::Policy> ConvertPolicy(
   return std::nullopt;
 }
 
+// The input message is read in chunks of this size, and its top-level fields
+// (e.g. the TracePackets of a trace) are filtered in batches of about
+// kBatchSize bytes, so memory usage doesn't depend on the input size.
+constexpr size_t kReadSize = 1024 * 1024;
+constexpr size_t kBatchSize = 4 * 1024 * 1024;
+
+// Returns the size of the proto field at the start of [data, end), 0 if it
+// isn't entirely in [data, end) yet or std::nullopt if it's malformed.
+std::optional<size_t> GetFieldSize(const uint8_t* data, const uint8_t* end) {
+  namespace pu = protozero::proto_utils;
+  const uint8_t* pos = data;
+  auto parse_varint = [&pos, end](uint64_t* value) {
+    const uint8_t* next = pu::ParseVarInt(pos, end, value);
+    bool parsed = next != pos;
+    pos = next;
+    return parsed;
+  };
+  // A varint fails to parse either if it's truncated or if it's too long.
+  auto truncated_or_malformed = [&pos, end]() -> std::optional<size_t> {
+    if (end - pos >= PERFETTO_PB_VARINT_MAX_SIZE_64)
+      return std::nullopt;
+    return 0;
+  };
+
+  uint64_t tag = 0;
+  if (!parse_varint(&tag))
+    return truncated_or_malformed();
+  uint64_t payload_size = 0;
+  switch (static_cast<pu::ProtoWireType>(tag & 7)) {
+    case pu::ProtoWireType::kVarInt: {
+      uint64_t value = 0;
+      if (!parse_varint(&value))
+        return truncated_or_malformed();
+      break;
+    }
+    case pu::ProtoWireType::kFixed64:
+      payload_size = 8;
+      break;
+    case pu::ProtoWireType::kFixed32:
+      payload_size = 4;
+      break;
+    case pu::ProtoWireType::kLengthDelimited:
+      if (!parse_varint(&payload_size))
+        return truncated_or_malformed();
+      break;
+    default:
+      return std::nullopt;
+  }
+  if (payload_size > static_cast<uint64_t>(end - pos))
+    return 0;
+  return static_cast<size_t>(pos - data) + static_cast<size_t>(payload_size);
+}
+
+struct FilterBatch {
+  std::string input;
+
+  // Set on the thread pool.
+  bool done = false;
+  bool error = false;
+  std::unique_ptr<uint8_t[]> output;
+  size_t output_size = 0;
+  std::unordered_map<std::string, int32_t> field_usage;
+};
+
+// Filters the proto message read from |in_fd|, writing the result into
+// |out_fd| (if valid) and merging the usage counters of its fields into
+// |field_usage|. Batches of top-level fields are filtered in parallel on
+// |num_threads| threads and written out in order. At most 2 * |num_threads|
+// batches are in flight at any time. Returns false if the input is malformed.
+bool FilterMessageStreaming(
+    const protozero::MessageFilter::Config& config,
+    int in_fd,
+    int out_fd,
+    uint32_t num_threads,
+    std::unordered_map<std::string, int32_t>* field_usage,
+    uint64_t* bytes_written) {
+  std::mutex mutex;
+  std::condition_variable batch_done;
+  std::deque<std::unique_ptr<FilterBatch>> batches;
+  base::ThreadPool pool(num_threads);
+  bool success = true;
+
+  auto write_oldest_batch = [&] {
+    std::unique_ptr<FilterBatch> batch = std::move(batches.front());
+    batches.pop_front();
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      batch_done.wait(lock, [&batch] { return batch->done; });
+    }
+    if (batch->error) {
+      success = false;
+      return;
+    }
+    for (const auto& it : batch->field_usage)
+      (*field_usage)[it.first] += it.second;
+    if (out_fd >= 0 && success)
+      base::WriteAll(out_fd, batch->output.get(), batch->output_size);
+    *bytes_written += batch->output_size;
+  };
+
+  auto submit_batch = [&](std::string input) {
+    if (batches.size() >= 2 * num_threads)
+      write_oldest_batch();
+    batches.emplace_back(new FilterBatch());
+    FilterBatch* batch = batches.back().get();
+    batch->input = std::move(input);
+    pool.PostTask([&config, &mutex, &batch_done, batch] {
+      protozero::MessageFilter filter(config);
+      filter.enable_field_usage_tracking(true);
+      auto res = filter.FilterMessage(batch->input.data(), batch->input.size());
+      std::string().swap(batch->input);
+      std::unordered_map<std::string, int32_t> usage = filter.field_usage();
+      std::lock_guard<std::mutex> lock(mutex);
+      batch->error = res.error;
+      batch->output = std::move(res.data);
+      batch->output_size = res.size;
+      batch->field_usage = std::move(usage);
+      batch->done = true;
+      batch_done.notify_all();
+    });
+  };
+
+  std::unique_ptr<uint8_t[]> read_buf(new uint8_t[kReadSize]);
+  std::string pending;  // Read bytes which don't form a whole field yet.
+  std::string batch;
+  while (success) {
+    ssize_t rsize = base::Read(in_fd, read_buf.get(), kReadSize);
+    if (rsize < 0) {
+      PERFETTO_PLOG("Failed to read the input message");
+      success = false;
+      break;
+    }
+    if (rsize == 0)
+      break;
+    pending.append(reinterpret_cast<const char*>(read_buf.get()),
+                   static_cast<size_t>(rsize));
+
+    // Move all the complete fields read so far into the current batch.
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(pending.data());
+    const uint8_t* end = begin + pending.size();
+    const uint8_t* pos = begin;
+    for (;;) {
+      std::optional<size_t> field_size = GetFieldSize(pos, end);
+      if (!field_size) {
+        success = false;
+        break;
+      }
+      if (*field_size == 0)
+        break;
+      pos += *field_size;
+    }
+    if (!success)
+      break;
+    size_t consumed = static_cast<size_t>(pos - begin);
+    batch.append(pending, 0, consumed);
+    pending.erase(0, consumed);
+    if (batch.size() >= kBatchSize) {
+      submit_batch(std::move(batch));
+      batch.clear();
+    }
+  }
+  if (!pending.empty())
+    success = false;  // Truncated input.
+  if (success && !batch.empty())
+    submit_batch(std::move(batch));
+  while (!batches.empty())
+    write_oldest_batch();
+  return success;
+}
+
 int Main(int argc, char** argv) {
   static const option long_options[] = {
       {"help", no_argument, nullptr, 'h'},
@@ -160,6 +343,7 @@ int Main(int argc, char** argv) {
       {"filter_oct_out", required_argument, nullptr, 'T'},
       {"passthrough", required_argument, nullptr, 'x'},
       {"filter_string", required_argument, nullptr, 'g'},
+      {"jobs", required_argument, nullptr, 'j'},
       {nullptr, 0, nullptr, 0}};
 
   std::string msg_in;
@@ -174,10 +358,11 @@ int Main(int argc, char** argv) {
   std::set<std::string> passthrough_fields;
   std::set<std::string> filter_string_fields;
   bool dedupe = false;
+  uint32_t num_threads = std::max(1u, std::thread::hardware_concurrency());
 
   for (;;) {
     int option = getopt_long(
-        argc, argv, "hvdI:s:r:i:o:f:F:T:x:g:c:", long_options, nullptr);
+        argc, argv, "hvdI:s:r:i:o:f:F:T:x:g:c:j:", long_options, nullptr);
 
     if (option == -1)
       break;  // EOF.
@@ -247,6 +432,16 @@ int Main(int argc, char** argv) {
       continue;
     }
 
+    if (option == 'j') {
+      std::optional<uint32_t> jobs = base::CStringToUInt32(optarg);
+      if (!jobs || *jobs == 0) {
+        PERFETTO_ELOG("Invalid --jobs value %s", optarg);
+        return 1;
+      }
+      num_threads = *jobs;
+      continue;
+    }
+
     if (option == 'h') {
       fprintf(stdout, kUsage);
       exit(0);
@@ -266,10 +461,10 @@ int Main(int argc, char** argv) {
     return 1;
   }
 
-  std::string msg_in_data;
+  base::ScopedFile msg_in_fd;
   if (!msg_in.empty()) {
-    PERFETTO_LOG("Loading proto-encoded message from %s", msg_in.c_str());
-    if (!base::ReadFile(msg_in, &msg_in_data)) {
+    msg_in_fd = base::OpenFile(msg_in, O_RDONLY);
+    if (!msg_in_fd) {
       PERFETTO_ELOG("Could not open message file %s", msg_in.c_str());
       return 1;
     }
@@ -382,29 +577,33 @@ int Main(int argc, char** argv) {
     base::WriteAll(*fd, oct_str.data(), oct_str.size());
   }
 
-  // Apply the filter to the input message (if any).
-  std::vector<uint8_t> msg_filtered_data;
+  // Apply the filter to the input message (if any), writing out the filtered
+  // message as it's produced.
+  std::unordered_map<std::string, int32_t> field_usage_map;
   if (!msg_in.empty()) {
-    PERFETTO_LOG("Applying filter %s to proto message %s",
-                 filter_data_src.c_str(), msg_in.c_str());
-    msg_filter.enable_field_usage_tracking(true);
-    auto res = msg_filter.FilterMessage(msg_in_data.data(), msg_in_data.size());
-    if (res.error)
+    base::ScopedFile msg_out_fd;
+    if (!msg_out.empty()) {
+      msg_out_fd = base::OpenFile(msg_out, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+      if (!msg_out_fd) {
+        PERFETTO_ELOG("Could not open message out path %s", msg_out.c_str());
+        return 1;
+      }
+    }
+    PERFETTO_LOG("Applying filter %s to proto message %s (%u threads)",
+                 filter_data_src.c_str(), msg_in.c_str(), num_threads);
+    uint64_t filtered_size = 0;
+    if (!FilterMessageStreaming(msg_filter.config(), *msg_in_fd,
+                                msg_out_fd ? *msg_out_fd : -1, num_threads,
+                                &field_usage_map, &filtered_size)) {
       PERFETTO_FATAL("Filtering failed");
-    msg_filtered_data.insert(msg_filtered_data.end(), res.data.get(),
-                             res.data.get() + res.size);
-  }
-
-  // Write out the filtered message.
-  if (!msg_out.empty()) {
-    PERFETTO_LOG("Writing filtered proto bytes (%zu bytes) into %s",
-                 msg_filtered_data.size(), msg_out.c_str());
-    auto fd = base::OpenFile(msg_out, O_WRONLY | O_TRUNC | O_CREAT, 0644);
-    base::WriteAll(*fd, msg_filtered_data.data(), msg_filtered_data.size());
+    }
+    if (msg_out_fd) {
+      PERFETTO_LOG("Wrote filtered proto bytes (%" PRIu64 " bytes) into %s",
+                   filtered_size, msg_out.c_str());
+    }
   }
 
   if (!msg_in.empty()) {
-    const auto& field_usage_map = msg_filter.field_usage();
     for (const auto& it : field_usage_map) {
       const std::string& field_path_varint = it.first;
       int32_t num_occurrences = it.second;
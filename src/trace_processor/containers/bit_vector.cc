@@ -90,6 +90,7 @@ void BitVector::Resize(uint32_t new_size, bool filler) {
   uint32_t old_size = size_;
   if (new_size == old_size)
     return;
+  select_index_.clear();
 
   // Empty bitvectors should be memory efficient so we don't keep any data
   // around in the bitvector.
@@ -169,6 +170,7 @@ BitVector::SetBitsIterator BitVector::IterateSetBits() const {
 }
 
 void BitVector::Not() {
+  select_index_.clear();
   for (uint32_t i = 0; i < words_.size(); ++i) {
     BitWord(&words_[i]).Not();
   }
@@ -180,6 +182,7 @@ void BitVector::Not() {
 
 void BitVector::Or(const BitVector& sec) {
   PERFETTO_CHECK(size_ == sec.size());
+  select_index_.clear();
   for (uint32_t i = 0; i < words_.size(); ++i) {
     BitWord(&words_[i]).Or(sec.words_[i]);
   }
@@ -192,6 +195,7 @@ void BitVector::Or(const BitVector& sec) {
 
 void BitVector::And(const BitVector& sec) {
   Resize(std::min(size_, sec.size_));
+  select_index_.clear();
   for (uint32_t i = 0; i < words_.size(); ++i) {
     BitWord(&words_[i]).And(sec.words_[i]);
   }
@@ -208,6 +212,7 @@ void BitVector::UpdateSetBits(const BitVector& update) {
     return;
   }
   PERFETTO_DCHECK(update.size() <= CountSetBits());
+  select_index_.clear();
 
   // Get the start and end ptrs for the current bitvector.
   // Safe because of the static_assert above.
@@ -296,6 +301,23 @@ void BitVector::UpdateSetBits(const BitVector& update) {
   PERFETTO_DCHECK(update.CountSetBits() == CountSetBits());
 }
 
+void BitVector::BuildSelectIndex() {
+  // Binary searching a few blocks is as fast as going through the index.
+  static constexpr uint32_t kMinBlocks = 16;
+  select_index_.clear();
+  uint32_t block_count = static_cast<uint32_t>(counts_.size());
+  if (block_count < kMinBlocks)
+    return;
+
+  uint32_t set_bits = CountSetBits();
+  select_index_.reserve(set_bits / kSetBitsPerSelectSample + 1);
+  for (uint32_t i = 0; i < block_count; ++i) {
+    uint32_t block_end = i + 1 < block_count ? counts_[i + 1] : set_bits;
+    while (select_index_.size() * kSetBitsPerSelectSample < block_end)
+      select_index_.push_back(i);
+  }
+}
+
 BitVector BitVector::IntersectRange(uint32_t range_start,
                                     uint32_t range_end) const {
   // We should skip all bits until the index of first set bit bigger than
@@ -27,6 +27,7 @@
 #include <vector>
 
 #include "perfetto/base/logging.h"
+#include "src/trace_processor/containers/memory_usage.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -196,10 +197,23 @@ class BitVector {
     // First search for the block which, up until the start of it, has more than
     // n bits set. Note that this should never return |counts.begin()| as
     // that should always be 0.
-    // TODO(lalitm): investigate whether we can make this faster with small
-    // binary search followed by a linear search instead of binary searching the
-    // full way.
-    auto it = std::upper_bound(counts_.begin(), counts_.end(), n);
+    //
+    // If we have a select index, it bounds the search to the blocks between
+    // the samples around |n|: only one or two blocks unless the BitVector is
+    // sparse. Set bits appended after the index was built are past the last
+    // sample so they fall back to searching from it to the end.
+    auto begin = counts_.begin();
+    auto end = counts_.end();
+    uint32_t sample = n / kSetBitsPerSelectSample;
+    if (sample < select_index_.size()) {
+      begin += select_index_[sample];
+      if (sample + 1 < select_index_.size()) {
+        end = counts_.begin() +
+              std::min(static_cast<uint32_t>(counts_.size()),
+                       select_index_[sample + 1] + 2);
+      }
+    }
+    auto it = std::upper_bound(begin, end, n);
     PERFETTO_DCHECK(it != counts_.begin());
 
     // Go back one block to find the block which has the bit we are looking for.
@@ -228,6 +242,7 @@ class BitVector {
     // If the old value was unset, set the bit and add one to the count.
     if (PERFETTO_LIKELY(!old_value)) {
       BlockFromIndex(addr.block_idx).Set(addr.block_offset);
+      select_index_.clear();
 
       uint32_t size = static_cast<uint32_t>(counts_.size());
       for (uint32_t i = addr.block_idx + 1; i < size; ++i) {
@@ -249,6 +264,7 @@ class BitVector {
     // counts.
     if (PERFETTO_LIKELY(old_value)) {
       BlockFromIndex(addr.block_idx).Clear(addr.block_offset);
+      select_index_.clear();
 
       uint32_t size = static_cast<uint32_t>(counts_.size());
       for (uint32_t i = addr.block_idx + 1; i < size; ++i) {
@@ -353,6 +369,19 @@ class BitVector {
     counts_.shrink_to_fit();
   }
 
+  // Returns the memory used by the words and the indices of this BitVector.
+  MemoryUsage GetMemoryUsage() const {
+    return GetVectorMemoryUsage(words_) + GetVectorMemoryUsage(counts_) +
+           GetVectorMemoryUsage(select_index_);
+  }
+
+  // Builds an index of the block holding every |kSetBitsPerSelectSample|th set
+  // bit, making IndexOfNthSet() constant time (instead of a binary search over
+  // all the blocks) on all but very sparse BitVectors. Meant to be called once
+  // the BitVector stops changing: any modification other than appending
+  // drops the index. Does nothing on small BitVectors.
+  void BuildSelectIndex();
+
   // Updates the ith set bit of this BitVector with the value of
   // |other.IsSet(i)|.
   //
@@ -906,8 +935,14 @@ class BitVector {
   // See class documentation for how these constants are chosen.
   static constexpr uint16_t kWordsInBlock = Block::kWords;
   static constexpr uint32_t kBitsInBlock = kWordsInBlock * BitWord::kBits;
+  // Number of set bits between two consecutive entries of |select_index_|.
+  static constexpr uint32_t kSetBitsPerSelectSample = kBitsInBlock;
+
   std::vector<uint32_t> counts_;
   std::vector<uint64_t> words_;
+  // See BuildSelectIndex(): the i-th entry is the index of the block holding
+  // the (i * kSetBitsPerSelectSample)-th set bit. Empty if not built.
+  std::vector<uint32_t> select_index_;
 };
 
 }  // namespace trace_processor
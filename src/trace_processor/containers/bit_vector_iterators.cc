@@ -38,6 +38,8 @@ BaseIterator::~BaseIterator() {
 void BaseIterator::OnBlockChange(uint32_t old_block_idx,
                                  uint32_t new_block_idx) {
   if (set_bit_count_diff_ != 0) {
+    bv_->select_index_.clear();
+
     // If the count of set bits has changed, go through all the counts between
     // the old and new blocks and modify them.
     // We only need to go to new_block and not to the end of the bitvector as
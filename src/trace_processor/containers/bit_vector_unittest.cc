@@ -172,6 +172,46 @@ TEST(BitVectorUnittest, IndexOfNthSet) {
   ASSERT_EQ(bv.IndexOfNthSet(5), 2048u);
 }
 
+TEST(BitVectorUnittest, IndexOfNthSetWithSelectIndex) {
+  static constexpr uint32_t kSize = 100000;
+  BitVector bv;
+  std::vector<uint32_t> set_bits;
+  std::minstd_rand0 rand;
+  for (uint32_t i = 0; i < kSize; ++i) {
+    // Alternate dense and sparse regions so samples span varying numbers of
+    // blocks.
+    bool dense = (i / 20000) % 2 == 0;
+    bool res = dense ? rand() % 2u : rand() % 1000u == 0;
+    if (res) {
+      bv.AppendTrue();
+      set_bits.push_back(i);
+    } else {
+      bv.AppendFalse();
+    }
+  }
+
+  bv.BuildSelectIndex();
+  for (uint32_t i = 0; i < set_bits.size(); ++i)
+    ASSERT_EQ(bv.IndexOfNthSet(i), set_bits[i]);
+
+  // Changing the set bits must not leave a stale index behind.
+  uint32_t unset = 0;
+  while (bv.IsSet(unset))
+    ++unset;
+  bv.Set(unset);
+  bv.Clear(set_bits.back());
+  bv.AppendTrue();
+  set_bits.back() = kSize;
+  set_bits.insert(
+      std::lower_bound(set_bits.begin(), set_bits.end(), unset), unset);
+  for (uint32_t i = 0; i < set_bits.size(); ++i)
+    ASSERT_EQ(bv.IndexOfNthSet(i), set_bits[i]);
+
+  bv.BuildSelectIndex();
+  for (uint32_t i = 0; i < set_bits.size(); ++i)
+    ASSERT_EQ(bv.IndexOfNthSet(i), set_bits[i]);
+}
+
 TEST(BitVectorUnittest, Resize) {
   BitVector bv(1, false);
 
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/interval_index.h"
+
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+namespace perfetto {
+namespace trace_processor {
+
+IntervalIndex::IntervalIndex() = default;
+
+IntervalIndex::IntervalIndex(std::vector<Interval> intervals)
+    : intervals_(std::move(intervals)) {
+  std::sort(intervals_.begin(), intervals_.end(),
+            [](const Interval& a, const Interval& b) {
+              return std::tie(a.start, a.id) < std::tie(b.start, b.id);
+            });
+  max_end_.resize(intervals_.size());
+  BuildMaxEnd(0, size());
+}
+
+IntervalIndex::~IntervalIndex() = default;
+
+IntervalIndex::IntervalIndex(IntervalIndex&&) noexcept = default;
+IntervalIndex& IntervalIndex::operator=(IntervalIndex&&) noexcept = default;
+
+int64_t IntervalIndex::BuildMaxEnd(uint32_t lo, uint32_t hi) {
+  if (lo >= hi)
+    return std::numeric_limits<int64_t>::min();
+  uint32_t mid = lo + (hi - lo) / 2;
+  int64_t max_end = std::max(
+      {intervals_[mid].end, BuildMaxEnd(lo, mid), BuildMaxEnd(mid + 1, hi)});
+  max_end_[mid] = max_end;
+  return max_end;
+}
+
+void IntervalIndex::FindOverlaps(int64_t start,
+                                 int64_t end,
+                                 std::vector<uint32_t>& out) const {
+  FindOverlaps(0, size(), start, end, out);
+}
+
+void IntervalIndex::FindOverlaps(uint32_t lo,
+                                 uint32_t hi,
+                                 int64_t start,
+                                 int64_t end,
+                                 std::vector<uint32_t>& out) const {
+  if (lo >= hi)
+    return;
+  uint32_t mid = lo + (hi - lo) / 2;
+
+  // Nothing in this subtree reaches |start|.
+  if (max_end_[mid] < start)
+    return;
+
+  FindOverlaps(lo, mid, start, end, out);
+
+  // Everything at or after |mid| starts after |end|.
+  const Interval& interval = intervals_[mid];
+  if (interval.start > end)
+    return;
+  if (interval.end >= start)
+    out.push_back(interval.id);
+
+  FindOverlaps(mid + 1, hi, start, end, out);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_INTERVAL_INDEX_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_INTERVAL_INDEX_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace perfetto {
+namespace trace_processor {
+
+// Static index over a set of closed intervals which answers "which intervals
+// intersect [start, end]" in O(log(n) + k) time, where k is the number of
+// results.
+//
+// The intervals are sorted by start and viewed as an implicit balanced binary
+// tree (the root of the range [lo, hi) is at (lo + hi) / 2); each node stores
+// the maximum end of its subtree so that subtrees which end before the query
+// can be skipped.
+class IntervalIndex {
+ public:
+  struct Interval {
+    int64_t start;
+    int64_t end;
+    uint32_t id;
+  };
+
+  IntervalIndex();
+  explicit IntervalIndex(std::vector<Interval> intervals);
+  ~IntervalIndex();
+
+  IntervalIndex(IntervalIndex&&) noexcept;
+  IntervalIndex& operator=(IntervalIndex&&) noexcept;
+
+  // Appends to |out| the ids of all the intervals with start <= |end| and
+  // end >= |start|, in order of (start, id).
+  void FindOverlaps(int64_t start,
+                    int64_t end,
+                    std::vector<uint32_t>& out) const;
+
+  uint32_t size() const { return static_cast<uint32_t>(intervals_.size()); }
+
+ private:
+  IntervalIndex(const IntervalIndex&) = delete;
+  IntervalIndex& operator=(const IntervalIndex&) = delete;
+
+  int64_t BuildMaxEnd(uint32_t lo, uint32_t hi);
+  void FindOverlaps(uint32_t lo,
+                    uint32_t hi,
+                    int64_t start,
+                    int64_t end,
+                    std::vector<uint32_t>& out) const;
+
+  std::vector<Interval> intervals_;
+
+  // |max_end_[i]| is the maximum end of the subtree rooted at |intervals_[i]|.
+  std::vector<int64_t> max_end_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_INTERVAL_INDEX_H_
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/interval_index.h"
+
+#include <random>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+TEST(IntervalIndex, Empty) {
+  IntervalIndex index;
+  std::vector<uint32_t> out;
+  index.FindOverlaps(0, 100, out);
+  ASSERT_THAT(out, IsEmpty());
+}
+
+TEST(IntervalIndex, Simple) {
+  IntervalIndex index({{10, 20, 0}, {0, 5, 1}, {15, 15, 2}, {30, 50, 3}});
+
+  std::vector<uint32_t> out;
+  index.FindOverlaps(5, 10, out);
+  ASSERT_THAT(out, ElementsAre(1u, 0u));
+
+  out.clear();
+  index.FindOverlaps(15, 15, out);
+  ASSERT_THAT(out, ElementsAre(0u, 2u));
+
+  out.clear();
+  index.FindOverlaps(21, 29, out);
+  ASSERT_THAT(out, IsEmpty());
+
+  out.clear();
+  index.FindOverlaps(40, 1000, out);
+  ASSERT_THAT(out, ElementsAre(3u));
+}
+
+TEST(IntervalIndex, MatchesLinearScan) {
+  std::minstd_rand0 rnd(0);
+  std::vector<IntervalIndex::Interval> intervals;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    int64_t start = static_cast<int64_t>(rnd() % 10000);
+    int64_t len = static_cast<int64_t>(rnd() % (i % 10 == 0 ? 5000 : 50));
+    intervals.push_back({start, start + len, i});
+  }
+  IntervalIndex index(intervals);
+  ASSERT_EQ(index.size(), 1000u);
+
+  std::sort(intervals.begin(), intervals.end(),
+            [](const IntervalIndex::Interval& a,
+               const IntervalIndex::Interval& b) {
+              return a.start < b.start || (a.start == b.start && a.id < b.id);
+            });
+  for (uint32_t q = 0; q < 200; ++q) {
+    int64_t start = static_cast<int64_t>(rnd() % 11000);
+    int64_t end = start + static_cast<int64_t>(rnd() % 500);
+
+    std::vector<uint32_t> expected;
+    for (const auto& interval : intervals) {
+      if (interval.start <= end && interval.end >= start)
+        expected.push_back(interval.id);
+    }
+    std::vector<uint32_t> out;
+    index.FindOverlaps(start, end, out);
+    ASSERT_EQ(out, expected);
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
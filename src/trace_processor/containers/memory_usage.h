@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_MEMORY_USAGE_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_MEMORY_USAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace perfetto {
+namespace trace_processor {
+
+// Approximate amount of heap memory owned by a container.
+//
+// |used_bytes| is the memory taken by the elements which are actually stored
+// while |reserved_bytes| also includes any capacity allocated for future
+// elements (i.e. used_bytes <= reserved_bytes). Neither include the size of
+// the container object itself, only the memory it points to.
+struct MemoryUsage {
+  uint64_t used_bytes = 0;
+  uint64_t reserved_bytes = 0;
+
+  MemoryUsage& operator+=(const MemoryUsage& other) {
+    used_bytes += other.used_bytes;
+    reserved_bytes += other.reserved_bytes;
+    return *this;
+  }
+  MemoryUsage operator+(const MemoryUsage& other) const {
+    MemoryUsage res = *this;
+    res += other;
+    return res;
+  }
+};
+
+template <typename T>
+MemoryUsage GetVectorMemoryUsage(const std::vector<T>& vector) {
+  return MemoryUsage{vector.size() * sizeof(T), vector.capacity() * sizeof(T)};
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_MEMORY_USAGE_H_
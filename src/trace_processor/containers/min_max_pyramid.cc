@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/min_max_pyramid.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace perfetto {
+namespace trace_processor {
+
+MinMaxPyramid::MinMaxPyramid() = default;
+
+MinMaxPyramid::MinMaxPyramid(std::vector<double> values)
+    : values_(std::move(values)) {
+  std::vector<Node> level;
+  level.reserve(values_.size() / kBlockSize);
+  for (size_t i = 0; i + kBlockSize <= values_.size(); i += kBlockSize) {
+    Node node{values_[i], values_[i], 0};
+    for (size_t j = i; j < i + kBlockSize; ++j) {
+      node.min = std::min(node.min, values_[j]);
+      node.max = std::max(node.max, values_[j]);
+      node.sum += values_[j];
+    }
+    level.push_back(node);
+  }
+  while (level.size() > 1) {
+    std::vector<Node> parent;
+    parent.reserve((level.size() + 1) / 2);
+    for (size_t i = 0; i < level.size(); i += 2) {
+      Node node = level[i];
+      if (i + 1 < level.size()) {
+        node.min = std::min(node.min, level[i + 1].min);
+        node.max = std::max(node.max, level[i + 1].max);
+        node.sum += level[i + 1].sum;
+      }
+      parent.push_back(node);
+    }
+    levels_.push_back(std::move(level));
+    level = std::move(parent);
+  }
+  if (!level.empty())
+    levels_.push_back(std::move(level));
+}
+
+MinMaxPyramid::~MinMaxPyramid() = default;
+
+MinMaxPyramid::MinMaxPyramid(MinMaxPyramid&&) noexcept = default;
+MinMaxPyramid& MinMaxPyramid::operator=(MinMaxPyramid&&) noexcept = default;
+
+MinMaxPyramid::Summary MinMaxPyramid::Summarize(uint32_t start,
+                                                uint32_t end) const {
+  Summary res;
+  end = std::min(end, size());
+  if (start >= end)
+    return res;
+
+  res.count = end - start;
+  res.min = std::numeric_limits<double>::infinity();
+  res.max = -std::numeric_limits<double>::infinity();
+  res.last = values_[end - 1];
+  auto add_values = [this, &res](uint32_t lo, uint32_t hi) {
+    for (uint32_t i = lo; i < hi; ++i) {
+      res.min = std::min(res.min, values_[i]);
+      res.max = std::max(res.max, values_[i]);
+      res.sum += values_[i];
+    }
+  };
+  auto add_node = [&res](const Node& node) {
+    res.min = std::min(res.min, node.min);
+    res.max = std::max(res.max, node.max);
+    res.sum += node.sum;
+  };
+
+  // Blocks fully contained in the range.
+  uint32_t lo = (start + kBlockSize - 1) / kBlockSize;
+  uint32_t hi = end / kBlockSize;
+  if (lo >= hi) {
+    add_values(start, end);
+    return res;
+  }
+  add_values(start, lo * kBlockSize);
+  add_values(hi * kBlockSize, end);
+  for (size_t k = 0; lo < hi; ++k) {
+    const std::vector<Node>& level = levels_[k];
+    if (lo % 2)
+      add_node(level[lo++]);
+    if (hi % 2)
+      add_node(level[--hi]);
+    lo /= 2;
+    hi /= 2;
+  }
+  return res;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
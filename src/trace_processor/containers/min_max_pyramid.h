@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_MIN_MAX_PYRAMID_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_MIN_MAX_PYRAMID_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace perfetto {
+namespace trace_processor {
+
+// Static index over a sequence of values which computes the min, max, sum and
+// last value of any contiguous range of the sequence in O(log(n)) time.
+//
+// The first level of the pyramid summarizes blocks of |kBlockSize| values and
+// every following level summarizes pairs of nodes of the level below. A range
+// is answered by scanning the (at most 2 * kBlockSize) values at its edges
+// which don't fill a whole block and combining the fewest nodes covering the
+// rest, at most two per level.
+class MinMaxPyramid {
+ public:
+  // Number of values summarized by each node of the first level. Trades the
+  // memory of the pyramid (~3 * 8 / kBlockSize bytes per value) for the
+  // number of values scanned at the edges of each range.
+  static constexpr uint32_t kBlockSize = 8;
+
+  struct Summary {
+    uint32_t count = 0;
+    double min = 0;
+    double max = 0;
+    double sum = 0;
+    // Value at the end of the range.
+    double last = 0;
+  };
+
+  MinMaxPyramid();
+  explicit MinMaxPyramid(std::vector<double> values);
+  ~MinMaxPyramid();
+
+  MinMaxPyramid(MinMaxPyramid&&) noexcept;
+  MinMaxPyramid& operator=(MinMaxPyramid&&) noexcept;
+
+  // Summarizes the values with index in [start, end). Returns a summary with
+  // count = 0 if the range is empty.
+  Summary Summarize(uint32_t start, uint32_t end) const;
+
+  uint32_t size() const { return static_cast<uint32_t>(values_.size()); }
+
+ private:
+  struct Node {
+    double min;
+    double max;
+    double sum;
+  };
+
+  MinMaxPyramid(const MinMaxPyramid&) = delete;
+  MinMaxPyramid& operator=(const MinMaxPyramid&) = delete;
+
+  std::vector<double> values_;
+
+  // |levels_[0][i]| summarizes the values in
+  // [i * kBlockSize, (i + 1) * kBlockSize) and |levels_[k + 1][i]| the nodes
+  // 2 * i and 2 * i + 1 (if it exists) of |levels_[k]|. Trailing values which
+  // don't fill a whole block are not part of any node.
+  std::vector<std::vector<Node>> levels_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_MIN_MAX_PYRAMID_H_
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/min_max_pyramid.h"
+
+#include <algorithm>
+#include <random>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(MinMaxPyramid, Empty) {
+  MinMaxPyramid pyramid;
+  ASSERT_EQ(pyramid.Summarize(0, 10).count, 0u);
+}
+
+TEST(MinMaxPyramid, Simple) {
+  MinMaxPyramid pyramid({3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5, 8, 9, 7, 9, 3, 2});
+
+  MinMaxPyramid::Summary all = pyramid.Summarize(0, 17);
+  ASSERT_EQ(all.count, 17u);
+  ASSERT_EQ(all.min, 1);
+  ASSERT_EQ(all.max, 9);
+  ASSERT_EQ(all.sum, 82);
+  ASSERT_EQ(all.last, 2);
+
+  MinMaxPyramid::Summary mid = pyramid.Summarize(5, 12);
+  ASSERT_EQ(mid.count, 7u);
+  ASSERT_EQ(mid.min, 2);
+  ASSERT_EQ(mid.max, 9);
+  ASSERT_EQ(mid.sum, 38);
+  ASSERT_EQ(mid.last, 8);
+
+  ASSERT_EQ(pyramid.Summarize(4, 4).count, 0u);
+  ASSERT_EQ(pyramid.Summarize(16, 100).count, 1u);
+}
+
+TEST(MinMaxPyramid, MatchesLinearScan) {
+  std::minstd_rand0 rnd(0);
+  std::vector<double> values;
+  for (uint32_t i = 0; i < 1000; ++i)
+    values.push_back(static_cast<double>(rnd() % 1000));
+  MinMaxPyramid pyramid(values);
+
+  for (uint32_t i = 0; i < 1000; ++i) {
+    uint32_t start = static_cast<uint32_t>(rnd() % 1000);
+    uint32_t end = start + static_cast<uint32_t>(rnd() % (1001 - start));
+    MinMaxPyramid::Summary summary = pyramid.Summarize(start, end);
+    ASSERT_EQ(summary.count, end - start);
+    if (start == end)
+      continue;
+    auto begin_it = values.begin() + start;
+    auto end_it = values.begin() + end;
+    ASSERT_EQ(summary.min, *std::min_element(begin_it, end_it));
+    ASSERT_EQ(summary.max, *std::max_element(begin_it, end_it));
+    double sum = 0;
+    for (auto it = begin_it; it != end_it; ++it)
+      sum += *it;
+    ASSERT_EQ(summary.sum, sum);
+    ASSERT_EQ(summary.last, values[end - 1]);
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
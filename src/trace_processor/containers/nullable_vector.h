@@ -23,6 +23,7 @@
 #include <optional>
 
 #include "perfetto/base/logging.h"
+#include "src/trace_processor/containers/memory_usage.h"
 #include "src/trace_processor/containers/row_map.h"
 
 namespace perfetto {
@@ -117,6 +118,12 @@ class NullableVector {
     valid_.ShrinkToFit();
   }
 
+  // Returns the memory used by both the non-null values and the validity
+  // BitVector.
+  MemoryUsage GetMemoryUsage() const {
+    return GetVectorMemoryUsage(data_) + valid_.GetMemoryUsage();
+  }
+
   // Returns the size of the NullableVector; this includes any null values.
   uint32_t size() const { return valid_.size(); }
 
@@ -225,7 +225,10 @@ RowMap::RowMap(Variant def) : data_(std::move(def)) {}
 RowMap::RowMap(Range r) : data_(r) {}
 
 // Creates a RowMap backed by a BitVector.
-RowMap::RowMap(BitVector bit_vector) : data_(std::move(bit_vector)) {}
+RowMap::RowMap(BitVector bit_vector) : data_(std::move(bit_vector)) {
+  // RowMaps are mostly read after creation so speed up Get().
+  std::get<BitVector>(data_).BuildSelectIndex();
+}
 
 // Creates a RowMap backed by an std::vector<uint32_t>.
 RowMap::RowMap(IndexVector vec) : data_(vec) {}
@@ -270,6 +273,8 @@ void RowMap::Intersect(const RowMap& second) {
         return IntersectInternal(def, selector_def);
       },
       data_, second.data_);
+  if (auto* bv = std::get_if<BitVector>(&data_))
+    bv->BuildSelectIndex();
 }
 
 RowMap::Iterator::Iterator(const RowMap* rm) : rm_(rm) {
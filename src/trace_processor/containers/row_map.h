@@ -28,6 +28,7 @@
 #include "perfetto/base/logging.h"
 #include "src/trace_processor/containers/bit_vector.h"
 #include "src/trace_processor/containers/bit_vector_iterators.h"
+#include "src/trace_processor/containers/memory_usage.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -233,6 +234,18 @@ class RowMap {
   // Returns whether this rowmap is empty.
   bool empty() const { return size() == 0; }
 
+  // Returns the memory used to store the indices of this RowMap. Ranges don't
+  // own any memory.
+  MemoryUsage GetMemoryUsage() const {
+    if (auto* bv = std::get_if<BitVector>(&data_)) {
+      return bv->GetMemoryUsage();
+    }
+    if (auto* vec = std::get_if<IndexVector>(&data_)) {
+      return GetVectorMemoryUsage(*vec);
+    }
+    return MemoryUsage();
+  }
+
   // Returns the index at the given |row|.
   OutputIndex Get(InputRow row) const {
     if (auto* range = std::get_if<Range>(&data_)) {
@@ -16,21 +16,111 @@
 
 #include "src/trace_processor/containers/string_pool.h"
 
+#include <string.h>
+
 #include <limits>
+#include <mutex>
 #include <tuple>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
+#include "perfetto/base/thread_utils.h"
 #include "perfetto/ext/base/utils.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+#include <zlib.h>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 
-StringPool::StringPool() {
+namespace {
+
+std::atomic<uint64_t> g_next_pool_uid{1};
+
+// The block owned by the current thread in the pool it last interned a
+// string into concurrently. Saves a lookup in ConcurrentState::thread_blocks
+// for the common case of a thread interning into a single pool.
+struct ThreadBlock {
+  uint64_t pool_uid = 0;
+  uint32_t block_index = 0;
+};
+thread_local ThreadBlock g_thread_block;
+
+}  // namespace
+
+struct StringPool::ConcurrentState {
+  static constexpr size_t kNumShards = 64;
+
+  // Index of the strings interned while concurrent interning is enabled,
+  // sharded by hash to reduce contention. Merged into |string_index_| when
+  // concurrent interning is disabled.
+  struct Shard {
+    std::mutex mutex;
+    base::FlatHashMap<StringHash,
+                      Id,
+                      base::AlreadyHashed<StringHash>,
+                      base::LinearProbe,
+                      /*AppendOnly=*/true>
+        index;
+  };
+  Shard shards[kNumShards];
+
+  Shard& ShardFor(StringHash hash) {
+    // The low bits of the hash are used by the index itself.
+    return shards[hash >> 58];
+  }
+
+  // Protects |blocks_| growth and |thread_blocks|.
+  std::mutex blocks_mutex;
+  base::FlatHashMap<base::PlatformThreadId, uint32_t> thread_blocks;
+
+  // Protects |large_strings_|.
+  std::mutex large_strings_mutex;
+};
+
+// Compressed strings are stored as their uncompressed size (host-endian
+// uint32_t) followed by the zlib stream of their contents.
+struct StringPool::CompressionState {
+  struct CacheEntry {
+    size_t index = std::numeric_limits<size_t>::max();
+    uint64_t last_use = 0;
+    std::string str;
+  };
+
+  CompressionState() {
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+    PERFETTO_CHECK(deflateInit(&deflate_stream, Z_BEST_SPEED) == Z_OK);
+    PERFETTO_CHECK(inflateInit(&inflate_stream) == Z_OK);
+#endif
+  }
+  ~CompressionState() {
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+    deflateEnd(&deflate_stream);
+    inflateEnd(&inflate_stream);
+#endif
+  }
+
+  // Protects the inflate stream and the cache, as Get() can be called from
+  // several threads.
+  std::mutex mutex;
+  CacheEntry cache[kCompressedStringCacheSize];
+  uint64_t use_count = 0;
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+  // Reused across strings to avoid reallocating the state of zlib each time.
+  z_stream deflate_stream{};
+  z_stream inflate_stream{};
+#endif
+};
+
+StringPool::StringPool() : uid_(g_next_pool_uid++) {
   static_assert(
       StringPool::kMinLargeStringSizeBytes <= StringPool::kBlockSizeBytes + 1,
       "minimum size of large strings must be small enough to support any "
       "string that doesn't fit in a Block.");
 
+  blocks_.reserve(kMaxBlocks);
   blocks_.emplace_back(kBlockSizeBytes);
 
   // Reserve a slot for the null string.
@@ -43,6 +133,12 @@ StringPool::StringPool(StringPool&&) noexcept = default;
 StringPool& StringPool::operator=(StringPool&&) noexcept = default;
 
 StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
+  if (PERFETTO_UNLIKELY(compress_strings_) &&
+      str.size() >= kMinCompressedStringSizeBytes) {
+    if (std::optional<Id> id = InsertCompressedString(str); id)
+      return *id;
+  }
+
   // Try and find enough space in the current block for the string and the
   // metadata (varint-encoded size + the string data + the null terminator).
   bool success;
@@ -57,6 +153,7 @@ StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
     if (str.size() + kMaxMetadataSize >= kMinLargeStringSizeBytes) {
       return InsertLargeString(str, hash);
     }
+    PERFETTO_CHECK(blocks_.size() < kMaxBlocks);
     blocks_.emplace_back(kBlockSizeBytes);
 
     // Try and reserve space again - this time we should definitely succeed.
@@ -88,10 +185,239 @@ StringPool::Id StringPool::InsertLargeString(base::StringView str,
   return string_id;
 }
 
+std::optional<StringPool::Id> StringPool::InsertCompressedString(
+    base::StringView str) {
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+  if (!compression_state_)
+    compression_state_.reset(new CompressionState());
+  z_stream* stream = &compression_state_->deflate_stream;
+  PERFETTO_CHECK(deflateReset(stream) == Z_OK);
+
+  uLong bound = deflateBound(stream, static_cast<uLong>(str.size()));
+  std::unique_ptr<std::string> compressed(
+      new std::string(sizeof(uint32_t) + bound, '\0'));
+  stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(str.data()));
+  stream->avail_in = static_cast<uInt>(str.size());
+  stream->next_out = reinterpret_cast<Bytef*>(&(*compressed)[sizeof(uint32_t)]);
+  stream->avail_out = static_cast<uInt>(bound);
+  PERFETTO_CHECK(deflate(stream, Z_FINISH) == Z_STREAM_END);
+
+  // Not worth it for the strings which don't compress well, given the
+  // overhead of large strings and of inflating them.
+  if (stream->total_out > str.size() * 3 / 4)
+    return std::nullopt;
+
+  uint32_t size = static_cast<uint32_t>(str.size());
+  memcpy(&(*compressed)[0], &size, sizeof(size));
+  compressed->resize(sizeof(uint32_t) + stream->total_out);
+  compressed->shrink_to_fit();
+
+  large_strings_.emplace_back(std::move(compressed));
+  compressed_large_strings_.resize(large_strings_.size());
+  compressed_large_strings_.back() = true;
+  return Id::LargeString(large_strings_.size() - 1);
+#else
+  base::ignore_result(str);
+  return std::nullopt;
+#endif
+}
+
+NullTermStringView StringPool::GetCompressedString(
+    size_t index,
+    const std::string* compressed) const {
+  CompressionState* state = compression_state_.get();
+  std::lock_guard<std::mutex> lock(state->mutex);
+
+  // Look for the string in the cache, or else for the least recently used
+  // entry to inflate it into.
+  CompressionState::CacheEntry* lru = &state->cache[0];
+  for (CompressionState::CacheEntry& entry : state->cache) {
+    if (entry.index == index) {
+      entry.last_use = ++state->use_count;
+      return NullTermStringView(entry.str.c_str(), entry.str.size());
+    }
+    if (entry.last_use < lru->last_use)
+      lru = &entry;
+  }
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+  uint32_t size = 0;
+  memcpy(&size, compressed->data(), sizeof(size));
+  lru->index = index;
+  lru->last_use = ++state->use_count;
+  lru->str.resize(size);
+
+  z_stream* stream = &state->inflate_stream;
+  PERFETTO_CHECK(inflateReset(stream) == Z_OK);
+  stream->next_in = reinterpret_cast<Bytef*>(
+      const_cast<char*>(compressed->data() + sizeof(uint32_t)));
+  stream->avail_in = static_cast<uInt>(compressed->size() - sizeof(uint32_t));
+  stream->next_out = reinterpret_cast<Bytef*>(&lru->str[0]);
+  stream->avail_out = size;
+  PERFETTO_CHECK(inflate(stream, Z_FINISH) == Z_STREAM_END &&
+                 stream->total_out == size);
+  return NullTermStringView(lru->str.c_str(), lru->str.size());
+#else
+  base::ignore_result(compressed);
+  PERFETTO_FATAL("Compressed strings require zlib");
+#endif
+}
+
+void StringPool::SetStringCompression(bool enabled) {
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+  compress_strings_ = enabled;
+#else
+  base::ignore_result(enabled);
+#endif
+}
+
+void StringPool::SetConcurrentInterning(bool enabled) {
+  if (enabled == concurrent_interning_)
+    return;
+  concurrent_interning_ = enabled;
+  if (enabled) {
+    if (!concurrent_state_)
+      concurrent_state_.reset(new ConcurrentState());
+    return;
+  }
+  for (auto& shard : concurrent_state_->shards) {
+    for (auto it = shard.index.GetIterator(); it; ++it)
+      string_index_.Insert(it.key(), it.value());
+    shard.index.Clear();
+  }
+}
+
+MemoryUsage StringPool::GetMemoryUsage() const {
+  PERFETTO_DCHECK(!concurrent_interning_);
+  MemoryUsage usage;
+  const uint64_t page_size = base::GetSysPageSize();
+  for (const Block& block : blocks_) {
+    // Shared blocks are accounted by whoever owns the snapshot.
+    if (!block.is_owned())
+      continue;
+    usage.used_bytes += block.pos();
+    uint64_t pages = (block.pos() + page_size - 1) / page_size;
+    usage.reserved_bytes += pages * page_size;
+  }
+  for (const auto& str : large_strings_) {
+    usage.used_bytes += str->size();
+    usage.reserved_bytes += str->capacity();
+  }
+  usage += GetVectorMemoryUsage(large_strings_);
+  usage.reserved_bytes += compressed_large_strings_.capacity() / 8;
+  if (compression_state_) {
+    std::lock_guard<std::mutex> lock(compression_state_->mutex);
+    for (const auto& entry : compression_state_->cache)
+      usage.reserved_bytes += entry.str.capacity();
+  }
+
+  // Each slot of the index stores a key, a value and a one byte tag.
+  constexpr size_t kIndexSlotSize = sizeof(StringHash) + sizeof(Id) + 1;
+  usage.used_bytes += string_index_.size() * kIndexSlotSize;
+  usage.reserved_bytes += string_index_.capacity() * kIndexSlotSize;
+  if (concurrent_state_) {
+    for (const auto& shard : concurrent_state_->shards)
+      usage.reserved_bytes += shard.index.capacity() * kIndexSlotSize;
+  }
+  return usage;
+}
+
+StringPool::Id StringPool::InternStringConcurrent(base::StringView str,
+                                                  uint64_t hash) {
+  // |string_index_| is not modified while interning concurrently, so it can
+  // be read without locks.
+  if (Id* id = string_index_.Find(hash)) {
+    PERFETTO_DCHECK(Get(*id) == str);
+    return *id;
+  }
+  if (std::optional<Id> shared_id = GetIdShared(hash); shared_id)
+    return *shared_id;
+
+  auto& shard = concurrent_state_->ShardFor(hash);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it_and_inserted = shard.index.Insert(hash, Id());
+  Id* id = it_and_inserted.first;
+  if (!it_and_inserted.second) {
+    PERFETTO_DCHECK(Get(*id) == str);
+    return *id;
+  }
+
+  uint32_t block_index = GetThreadBlock(/*full=*/false);
+  bool success;
+  uint32_t offset;
+  std::tie(success, offset) = blocks_[block_index].TryInsert(str);
+  if (PERFETTO_UNLIKELY(!success)) {
+    // Same policy as InsertString().
+    if (str.size() + kMaxMetadataSize >= kMinLargeStringSizeBytes) {
+      std::lock_guard<std::mutex> large_lock(
+          concurrent_state_->large_strings_mutex);
+      large_strings_.emplace_back(new std::string(str.begin(), str.size()));
+      *id = Id::LargeString(large_strings_.size() - 1);
+      return *id;
+    }
+    block_index = GetThreadBlock(/*full=*/true);
+    std::tie(success, offset) = blocks_[block_index].TryInsert(str);
+    PERFETTO_CHECK(success);
+  }
+  *id = Id::BlockString(block_index, offset);
+  return *id;
+}
+
+std::optional<StringPool::Id> StringPool::GetIdConcurrent(
+    uint64_t hash) const {
+  auto& shard = concurrent_state_->ShardFor(hash);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  Id* id = shard.index.Find(hash);
+  if (id)
+    return *id;
+  return std::nullopt;
+}
+
+size_t StringPool::ConcurrentSize() const {
+  size_t size = 0;
+  for (auto& shard : concurrent_state_->shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size += shard.index.size();
+  }
+  return size;
+}
+
+uint32_t StringPool::GetThreadBlock(bool full) {
+  if (!full && g_thread_block.pool_uid == uid_)
+    return g_thread_block.block_index;
+
+  base::PlatformThreadId tid = base::GetThreadId();
+  std::lock_guard<std::mutex> lock(concurrent_state_->blocks_mutex);
+  uint32_t* block_index = concurrent_state_->thread_blocks.Find(tid);
+  if (full || !block_index) {
+    PERFETTO_CHECK(blocks_.size() < kMaxBlocks);
+    // |blocks_| was reserved to kMaxBlocks so this never reallocates and
+    // existing blocks can keep being read by other threads.
+    blocks_.emplace_back(kBlockSizeBytes);
+    block_index = &concurrent_state_->thread_blocks[tid];
+    *block_index = static_cast<uint32_t>(blocks_.size() - 1);
+  }
+  g_thread_block.pool_uid = uid_;
+  g_thread_block.block_index = *block_index;
+  return *block_index;
+}
+
+NullTermStringView StringPool::GetLargeStringConcurrent(Id id) const {
+  std::lock_guard<std::mutex> lock(concurrent_state_->large_strings_mutex);
+  size_t index = id.large_string_index();
+  PERFETTO_DCHECK(index < large_strings_.size());
+  // The string itself is heap allocated, so it stays valid after the lock is
+  // released even if |large_strings_| reallocates.
+  const std::string* str = large_strings_[index].get();
+  if (PERFETTO_UNLIKELY(IsCompressed(index)))
+    return GetCompressedString(index, str);
+  return NullTermStringView(str->c_str(), str->size());
+}
+
 std::pair<bool /*success*/, uint32_t /*offset*/> StringPool::Block::TryInsert(
     base::StringView str) {
   auto str_size = str.size();
-  size_t max_pos = static_cast<size_t>(pos_) + str_size + kMaxMetadataSize;
+  size_t max_pos = static_cast<size_t>(pos()) + str_size + kMaxMetadataSize;
   if (max_pos > size_)
     return std::make_pair(false, 0u);
 
@@ -99,7 +425,7 @@ std::pair<bool /*success*/, uint32_t /*offset*/> StringPool::Block::TryInsert(
   mem_.EnsureCommitted(max_pos);
 
   // Get where we should start writing this string.
-  uint32_t offset = pos_;
+  uint32_t offset = pos();
   uint8_t* begin = Get(offset);
 
   // First write the size of the string using varint encoding.
@@ -115,11 +441,275 @@ std::pair<bool /*success*/, uint32_t /*offset*/> StringPool::Block::TryInsert(
   *(end++) = '\0';
 
   // Update the end of the block and return the pointer to the string.
-  pos_ = OffsetOf(end);
+  pos_.store(OffsetOf(end), std::memory_order_relaxed);
 
   return std::make_pair(true, offset);
 }
 
+void StringPool::Block::Restore(const uint8_t* data, uint32_t size) {
+  PERFETTO_CHECK(size <= size_);
+  mem_.EnsureCommitted(size);
+  if (size > 0)
+    memcpy(Get(0), data, size);
+  pos_.store(size, std::memory_order_relaxed);
+}
+
+namespace {
+
+// Helpers for the (host-endian) snapshot encoding.
+void AppendBytes(std::vector<uint8_t>* out, const void* data, size_t size) {
+  const uint8_t* ptr = static_cast<const uint8_t*>(data);
+  out->insert(out->end(), ptr, ptr + size);
+}
+
+template <typename T>
+void AppendPod(std::vector<uint8_t>* out, T value) {
+  AppendBytes(out, &value, sizeof(T));
+}
+
+class SnapshotReader {
+ public:
+  SnapshotReader(const uint8_t* data, size_t size)
+      : start_(data), ptr_(data), end_(data + size) {}
+
+  template <typename T>
+  bool ReadPod(T* value) {
+    if (static_cast<size_t>(end_ - ptr_) < sizeof(T))
+      return false;
+    memcpy(value, ptr_, sizeof(T));
+    ptr_ += sizeof(T);
+    return true;
+  }
+
+  const uint8_t* ReadBytes(size_t size) {
+    if (static_cast<size_t>(end_ - ptr_) < size)
+      return nullptr;
+    const uint8_t* res = ptr_;
+    ptr_ += size;
+    return res;
+  }
+
+  bool at_end() const { return ptr_ == end_; }
+  size_t offset() const { return static_cast<size_t>(ptr_ - start_); }
+
+ private:
+  const uint8_t* start_;
+  const uint8_t* ptr_;
+  const uint8_t* end_;
+};
+
+}  // namespace
+
+void StringPool::SerializeSnapshot(std::vector<uint8_t>* out) const {
+  const size_t snapshot_start = out->size();
+  AppendPod(out, kSnapshotMagic);
+  AppendPod(out, kSnapshotVersion);
+  AppendPod(out, static_cast<uint32_t>(blocks_.size()));
+  for (const Block& block : blocks_) {
+    AppendPod(out, block.pos());
+    AppendBytes(out, block.Get(0), block.pos());
+  }
+  // Compressed strings are written uncompressed, so that they can be read in
+  // place by FromSharedSnapshot().
+  AppendPod(out, static_cast<uint32_t>(large_strings_.size()));
+  for (size_t i = 0; i < large_strings_.size(); ++i) {
+    NullTermStringView str = Get(Id::LargeString(i));
+    AppendPod(out, static_cast<uint64_t>(str.size()));
+    AppendBytes(out, str.data(), str.size());
+  }
+
+  // Build the index with at most 50% of the slots used, which guarantees that
+  // lookups of missing strings hit an empty slot quickly.
+  std::vector<std::pair<StringHash, Id>> strings;
+  for (auto it = CreateIterator(); it; ++it) {
+    Id id = it.StringId();
+    if (!id.is_null())
+      strings.emplace_back(it.StringView().Hash(), id);
+  }
+  uint64_t capacity = 16;
+  while (capacity < strings.size() * 2)
+    capacity *= 2;
+  std::vector<SharedIndexSlot> index(static_cast<size_t>(capacity),
+                                     SharedIndexSlot{0, 0, 0});
+  for (const auto& hash_and_id : strings) {
+    uint64_t i = hash_and_id.first & (capacity - 1);
+    while (index[static_cast<size_t>(i)].id != 0)
+      i = (i + 1) & (capacity - 1);
+    index[static_cast<size_t>(i)] =
+        SharedIndexSlot{hash_and_id.first, hash_and_id.second.raw_id(), 0};
+  }
+
+  // The index is 8 byte aligned so that it can be read in place.
+  AppendPod(out, capacity);
+  while ((out->size() - snapshot_start) % alignof(SharedIndexSlot) != 0)
+    out->push_back(0);
+  AppendBytes(out, index.data(), index.size() * sizeof(SharedIndexSlot));
+}
+
+// static
+base::StatusOr<StringPool> StringPool::FromSnapshot(const uint8_t* data,
+                                                    size_t size) {
+  StringPool pool;
+  base::Status status = ParseSnapshot(data, size, /*shared=*/false, &pool);
+  if (!status.ok())
+    return status;
+
+  // Rebuild the hash index. The null string is never indexed.
+  for (auto it = pool.CreateIterator(); it; ++it) {
+    Id id = it.StringId();
+    if (id.is_null())
+      continue;
+    pool.string_index_.Insert(it.StringView().Hash(), id);
+  }
+  return pool;
+}
+
+// static
+base::StatusOr<StringPool> StringPool::FromSharedSnapshot(
+    const uint8_t* data,
+    size_t size,
+    std::shared_ptr<const void> keep_alive) {
+  if (reinterpret_cast<uintptr_t>(data) % alignof(SharedIndexSlot) != 0)
+    return base::ErrStatus("StringPool snapshot: misaligned shared snapshot");
+  StringPool pool;
+  base::Status status = ParseSnapshot(data, size, /*shared=*/true, &pool);
+  if (!status.ok())
+    return status;
+  if (pool.blocks_.size() >= kMaxBlocks)
+    return base::ErrStatus("StringPool snapshot: too many blocks to share");
+
+  // New strings never go to the shared blocks.
+  pool.blocks_.emplace_back(kBlockSizeBytes);
+  pool.shared_snapshot_ = std::move(keep_alive);
+  return pool;
+}
+
+// static
+base::Status StringPool::ParseSnapshot(const uint8_t* data,
+                                       size_t size,
+                                       bool shared,
+                                       StringPool* pool) {
+  SnapshotReader reader(data, size);
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  if (!reader.ReadPod(&magic) || magic != kSnapshotMagic)
+    return base::ErrStatus("StringPool snapshot: bad magic");
+  if (!reader.ReadPod(&version) || version != kSnapshotVersion) {
+    return base::ErrStatus(
+        "StringPool snapshot: unsupported version %u (expected %u)", version,
+        kSnapshotVersion);
+  }
+
+  uint32_t num_blocks = 0;
+  if (!reader.ReadPod(&num_blocks) || num_blocks == 0 ||
+      num_blocks > kMaxBlocks) {
+    return base::ErrStatus("StringPool snapshot: invalid block count");
+  }
+
+  pool->blocks_.clear();
+  for (uint32_t i = 0; i < num_blocks; ++i) {
+    uint32_t pos = 0;
+    if (!reader.ReadPod(&pos) || pos > kBlockSizeBytes)
+      return base::ErrStatus("StringPool snapshot: invalid block %u", i);
+    const uint8_t* bytes = reader.ReadBytes(pos);
+    if (!bytes)
+      return base::ErrStatus("StringPool snapshot: truncated block %u", i);
+
+    // Walk the strings in the block before trusting it: every string must be
+    // a valid varint size followed by the string and a null terminator.
+    for (uint32_t off = 0; off < pos;) {
+      uint64_t str_size = 0;
+      const uint8_t* str = protozero::proto_utils::ParseVarInt(
+          bytes + off, bytes + pos, &str_size);
+      size_t str_off = static_cast<size_t>(str - bytes);
+      if (str == bytes + off || str_size >= pos - str_off ||
+          bytes[str_off + str_size] != '\0') {
+        return base::ErrStatus("StringPool snapshot: corrupted block %u", i);
+      }
+      off = static_cast<uint32_t>(str_off + str_size + 1);
+    }
+    if (shared) {
+      pool->blocks_.emplace_back(bytes, pos);
+    } else {
+      pool->blocks_.emplace_back(kBlockSizeBytes);
+      pool->blocks_.back().Restore(bytes, pos);
+    }
+  }
+  if (pool->blocks_[0].pos() == 0)
+    return base::ErrStatus("StringPool snapshot: missing null string");
+
+  uint32_t num_large_strings = 0;
+  if (!reader.ReadPod(&num_large_strings))
+    return base::ErrStatus("StringPool snapshot: truncated");
+  for (uint32_t i = 0; i < num_large_strings; ++i) {
+    uint64_t str_size = 0;
+    const uint8_t* bytes = nullptr;
+    if (!reader.ReadPod(&str_size) ||
+        !(bytes = reader.ReadBytes(static_cast<size_t>(str_size)))) {
+      return base::ErrStatus("StringPool snapshot: truncated large string %u",
+                             i);
+    }
+    pool->large_strings_.emplace_back(new std::string(
+        reinterpret_cast<const char*>(bytes), static_cast<size_t>(str_size)));
+  }
+
+  uint64_t capacity = 0;
+  if (!reader.ReadPod(&capacity) || capacity == 0 ||
+      (capacity & (capacity - 1)) != 0 ||
+      capacity > size / sizeof(SharedIndexSlot)) {
+    return base::ErrStatus("StringPool snapshot: invalid index");
+  }
+  while (reader.offset() % alignof(SharedIndexSlot) != 0) {
+    if (!reader.ReadBytes(1))
+      return base::ErrStatus("StringPool snapshot: truncated index");
+  }
+  const uint8_t* index_bytes =
+      reader.ReadBytes(static_cast<size_t>(capacity) * sizeof(SharedIndexSlot));
+  if (!index_bytes)
+    return base::ErrStatus("StringPool snapshot: truncated index");
+  if (!reader.at_end())
+    return base::ErrStatus("StringPool snapshot: trailing data");
+
+  // The index is only used, and so only checked, when sharing the snapshot:
+  // every slot must point to a string of the snapshot and at least one slot
+  // must be empty for lookups to terminate.
+  if (!shared)
+    return base::OkStatus();
+  const auto* index = reinterpret_cast<const SharedIndexSlot*>(index_bytes);
+  size_t count = 0;
+  for (uint64_t i = 0; i < capacity; ++i) {
+    Id id = Id::Raw(index[i].id);
+    if (id.is_null())
+      continue;
+    bool valid = id.is_large_string()
+                     ? id.large_string_index() < num_large_strings
+                     : id.block_index() < num_blocks &&
+                           id.block_offset() <
+                               pool->blocks_[id.block_index()].pos();
+    if (!valid)
+      return base::ErrStatus("StringPool snapshot: corrupted index");
+    count++;
+  }
+  if (count >= capacity)
+    return base::ErrStatus("StringPool snapshot: full index");
+  pool->shared_index_ = index;
+  pool->shared_index_capacity_ = capacity;
+  pool->shared_string_count_ = count;
+  return base::OkStatus();
+}
+
+std::optional<StringPool::Id> StringPool::GetIdSharedSlow(
+    uint64_t hash) const {
+  const uint64_t mask = shared_index_capacity_ - 1;
+  for (uint64_t i = hash & mask;; i = (i + 1) & mask) {
+    const SharedIndexSlot& slot = shared_index_[i];
+    if (slot.id == 0)
+      return std::nullopt;
+    if (slot.hash == hash)
+      return Id::Raw(slot.id);
+  }
+}
+
 StringPool::Iterator::Iterator(const StringPool* pool) : pool_(pool) {}
 
 StringPool::Iterator& StringPool::Iterator::operator++() {
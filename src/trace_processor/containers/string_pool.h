@@ -20,14 +20,18 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <limits>
+#include <memory>
 #include <optional>
 #include <vector>
 
 #include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/paged_memory.h"
+#include "perfetto/ext/base/status_or.h"
 #include "perfetto/protozero/proto_utils.h"
+#include "src/trace_processor/containers/memory_usage.h"
 #include "src/trace_processor/containers/null_term_string_view.h"
 
 namespace perfetto {
@@ -35,6 +39,9 @@ namespace trace_processor {
 
 // Interns strings in a string pool and hands out compact StringIds which can
 // be used to retrieve the string in O(1).
+//
+// By default the pool must only be used from one thread at a time. See
+// SetConcurrentInterning() for interning from several threads at once.
 class StringPool {
  public:
   struct Id {
@@ -119,6 +126,8 @@ class StringPool {
       return Id::Null();
 
     auto hash = str.Hash();
+    if (PERFETTO_UNLIKELY(concurrent_interning_))
+      return InternStringConcurrent(str, hash);
 
     // Perform a hashtable insertion with a null ID just to check if the string
     // is already inserted. If it's not, overwrite 0 with the actual Id.
@@ -128,6 +137,12 @@ class StringPool {
       PERFETTO_DCHECK(Get(*id) == str);
       return *id;
     }
+    if (std::optional<Id> shared_id = GetIdShared(hash); shared_id) {
+      PERFETTO_DCHECK(Get(*shared_id) == str);
+      shared_strings_in_index_++;
+      *id = *shared_id;
+      return *id;
+    }
     *id = InsertString(str, hash);
     return *id;
   }
@@ -142,6 +157,10 @@ class StringPool {
       PERFETTO_DCHECK(Get(*id) == str);
       return *id;
     }
+    if (std::optional<Id> shared_id = GetIdShared(hash); shared_id)
+      return shared_id;
+    if (PERFETTO_UNLIKELY(concurrent_interning_))
+      return GetIdConcurrent(hash);
     return std::nullopt;
   }
 
@@ -155,7 +174,11 @@ class StringPool {
 
   Iterator CreateIterator() const { return Iterator(this); }
 
-  size_t size() const { return string_index_.size(); }
+  size_t size() const {
+    return string_index_.size() - shared_strings_in_index_ +
+           shared_string_count_ +
+           (PERFETTO_UNLIKELY(concurrent_interning_) ? ConcurrentSize() : 0);
+  }
 
   // Maximum Id of a small (not large) string in the string pool.
   StringPool::Id MaxSmallStringId() const {
@@ -165,45 +188,136 @@ class StringPool {
   // Returns whether there is at least one large string in a string pool
   bool HasLargeString() const { return !large_strings_.empty(); }
 
+  // Enables or disables the compression of long strings. While enabled, the
+  // strings of at least kMinCompressedStringSizeBytes added by InternString()
+  // are deflated and stored with the large strings, rather than in a block,
+  // if this saves at least a quarter of their size. Ids and GetId() are
+  // unaffected.
+  //
+  // Get() inflates compressed strings into a small LRU cache: unlike the views
+  // of other strings, which are valid for the lifetime of the pool, the view
+  // of a compressed string is only valid until kCompressedStringCacheSize
+  // other compressed strings have been read.
+  //
+  // Strings interned concurrently are never compressed. Does nothing if
+  // trace processor is built without zlib.
+  void SetStringCompression(bool enabled);
+  bool string_compression() const { return compress_strings_; }
+
+  // Returns the memory used by the strings and the index of the pool. Blocks
+  // are only backed by memory as they are filled so they are accounted up to
+  // their last used page rather than by their full size. Not allowed while
+  // interning concurrently.
+  MemoryUsage GetMemoryUsage() const;
+
+  // Enables or disables concurrent interning. While enabled, InternString(),
+  // GetId() and Get() can be called from several threads at the same time:
+  // each thread appends new strings to a block of its own and the strings
+  // interned while enabled are indexed in hash-sharded, mutex-protected maps,
+  // so Get() of a string stored in a block never takes a lock. Ids handed out
+  // stay valid after concurrent interning is disabled.
+  //
+  // Must not be called while other threads are using the pool. Iteration,
+  // MaxSmallStringId() and snapshots are only allowed while disabled.
+  void SetConcurrentInterning(bool enabled);
+
+  // Appends a snapshot of the pool to |out|. Blocks are written byte-for-byte
+  // so every Id handed out by this pool stays valid in a pool restored with
+  // FromSnapshot().
+  void SerializeSnapshot(std::vector<uint8_t>* out) const;
+
+  // Restores a pool from a buffer produced by SerializeSnapshot(). Fails if
+  // the buffer is truncated, corrupted or was written by a different version
+  // of the snapshot format.
+  static base::StatusOr<StringPool> FromSnapshot(const uint8_t* data,
+                                                 size_t size);
+
+  // Like FromSnapshot() but, rather than being copied, the strings of the
+  // snapshot and their index are read in place from |data|, which must be 8
+  // byte aligned and stay valid for as long as |keep_alive| is. Strings added
+  // later go to blocks owned by the pool.
+  //
+  // This allows many pools, possibly in different processes mapping the same
+  // snapshot file, to share the strings they have in common (e.g. the thread
+  // and slice names of traces of the same build) instead of each storing its
+  // own copy.
+  static base::StatusOr<StringPool> FromSharedSnapshot(
+      const uint8_t* data,
+      size_t size,
+      std::shared_ptr<const void> keep_alive);
+
  private:
   using StringHash = uint64_t;
 
   struct Block {
     explicit Block(size_t size)
-        : mem_(base::PagedMemory::Allocate(size,
-                                           base::PagedMemory::kDontCommit)),
+        : mem_(base::PagedMemory::Allocate(
+              size,
+              base::PagedMemory::kDontCommit | base::PagedMemory::kHugePages)),
+          data_(static_cast<uint8_t*>(mem_.Get())),
           size_(size) {}
+
+    // Creates a full, read-only, block over |size| bytes of memory which is
+    // not owned by the pool (see FromSharedSnapshot()).
+    Block(const uint8_t* data, uint32_t size)
+        : data_(const_cast<uint8_t*>(data)), pos_(size), size_(size) {}
+
     ~Block() = default;
 
     // Allow std::move().
-    Block(Block&&) noexcept = default;
-    Block& operator=(Block&&) = default;
+    Block(Block&& other) noexcept
+        : mem_(std::move(other.mem_)),
+          data_(other.data_),
+          pos_(other.pos()),
+          size_(other.size_) {}
+    Block& operator=(Block&& other) noexcept {
+      mem_ = std::move(other.mem_);
+      data_ = other.data_;
+      pos_.store(other.pos(), std::memory_order_relaxed);
+      size_ = other.size_;
+      return *this;
+    }
 
     // Disable implicit copy.
     Block(const Block&) = delete;
     Block& operator=(const Block&) = delete;
 
-    uint8_t* Get(uint32_t offset) const {
-      return static_cast<uint8_t*>(mem_.Get()) + offset;
-    }
+    uint8_t* Get(uint32_t offset) const { return data_ + offset; }
+
+    // Whether the memory of the block is owned by the pool, as opposed to
+    // being shared with other pools.
+    bool is_owned() const { return mem_.IsValid(); }
 
     std::pair<bool /*success*/, uint32_t /*offset*/> TryInsert(
         base::StringView str);
 
+    // Replaces the contents of the block with |size| bytes from |data|, as
+    // previously returned by Get(0) on a block with pos() == |size|.
+    void Restore(const uint8_t* data, uint32_t size);
+
     uint32_t OffsetOf(const uint8_t* ptr) const {
       PERFETTO_DCHECK(Get(0) < ptr &&
-                      ptr <= Get(static_cast<uint32_t>(size_ - 1)));
+                      ptr <= Get(static_cast<uint32_t>(size_)));
       return static_cast<uint32_t>(ptr - Get(0));
     }
 
-    uint32_t pos() const { return pos_; }
+    // Atomic as, with concurrent interning, the thread owning the block
+    // appends to it while other threads read strings from it.
+    uint32_t pos() const { return pos_.load(std::memory_order_relaxed); }
 
    private:
     base::PagedMemory mem_;
-    uint32_t pos_ = 0;
+    uint8_t* data_ = nullptr;
+    std::atomic<uint32_t> pos_{0};
     size_t size_ = 0;
   };
 
+  // State only used when interning concurrently, defined in the .cc file.
+  struct ConcurrentState;
+
+  // Cache of the inflated compressed strings, defined in the .cc file.
+  struct CompressionState;
+
   friend class Iterator;
   friend class StringPoolTest;
 
@@ -227,12 +341,26 @@ class StringPool {
 
   static constexpr size_t kBlockSizeBytes = kBlockOffsetBitMask + 1;  // 32 MB
 
+  // Maximum number of blocks which can be addressed by an Id. |blocks_| is
+  // reserved to this size so that it never reallocates, which allows Get() to
+  // run while other threads add blocks.
+  static constexpr size_t kMaxBlocks =
+      (kBlockIndexBitMask >> kNumBlockOffsetBits) + 1;
+
   // If a string doesn't fit into the current block, we can either start a new
   // block or insert the string into the |large_strings_| vector. To maximize
   // the used proportion of each block's memory, we only start a new block if
   // the string isn't very large.
   static constexpr size_t kMinLargeStringSizeBytes = kBlockSizeBytes / 8;
 
+  // With string compression, shorter strings don't compress well enough on
+  // their own to make up for being stored outside of a block.
+  static constexpr size_t kMinCompressedStringSizeBytes = 512;
+
+  // Number of inflated strings cached by Get(). Large enough for the string
+  // columns of a row, or the two sides of a comparison, to be read at once.
+  static constexpr size_t kCompressedStringCacheSize = 64;
+
   // Number of bytes to reserve for size and null terminator.
   // This is the upper limit on metadata size: 5 bytes for max uint32,
   // plus 1 byte for null terminator. The actual size may be lower.
@@ -244,6 +372,60 @@ class StringPool {
   // Insert a large string into the pool and return its Id.
   Id InsertLargeString(base::StringView, uint64_t hash);
 
+  // Deflates the string into |large_strings_| and returns its Id, or returns
+  // std::nullopt if it doesn't compress well.
+  std::optional<Id> InsertCompressedString(base::StringView);
+
+  bool IsCompressed(size_t large_string_index) const {
+    return large_string_index < compressed_large_strings_.size() &&
+           compressed_large_strings_[large_string_index];
+  }
+
+  // Returns the view of the large string |index|, whose contents are the
+  // deflated string |compressed|, inflating it if it isn't cached.
+  NullTermStringView GetCompressedString(size_t index,
+                                         const std::string* compressed) const;
+
+  // Slow paths of InternString(), GetId() and size() used when interning
+  // concurrently.
+  Id InternStringConcurrent(base::StringView, uint64_t hash);
+  std::optional<Id> GetIdConcurrent(uint64_t hash) const;
+  size_t ConcurrentSize() const;
+
+  // Looks up |hash| in the index of the shared snapshot, if any.
+  std::optional<Id> GetIdShared(uint64_t hash) const {
+    if (PERFETTO_LIKELY(!shared_index_))
+      return std::nullopt;
+    return GetIdSharedSlow(hash);
+  }
+  std::optional<Id> GetIdSharedSlow(uint64_t hash) const;
+
+  // Parses a snapshot written by SerializeSnapshot() into |pool|, copying it
+  // unless |shared|.
+  static base::Status ParseSnapshot(const uint8_t* data,
+                                    size_t size,
+                                    bool shared,
+                                    StringPool* pool);
+
+  // Returns the index of the block owned by the calling thread, allocating a
+  // new one if |full| or if the thread doesn't own one yet.
+  uint32_t GetThreadBlock(bool full);
+
+  // Magic and version of the format written by SerializeSnapshot(). The
+  // version must be bumped on any change to the layout of the snapshot or of
+  // the encoding of strings inside blocks.
+  static constexpr uint32_t kSnapshotMagic = 0x50535054;  // "TPSP"
+  static constexpr uint32_t kSnapshotVersion = 2;
+
+  // Slot of the open addressing hash table written at the end of snapshots,
+  // so that pools sharing the snapshot don't each have to index its strings.
+  // Empty slots have a null |id|.
+  struct SharedIndexSlot {
+    StringHash hash;
+    uint32_t id;
+    uint32_t reserved;
+  };
+
   // The returned pointer points to the start of the string metadata (i.e. the
   // first byte of the size).
   const uint8_t* IdToPtr(Id id) const {
@@ -254,7 +436,9 @@ class StringPool {
     size_t block_index = id.block_index();
     uint32_t block_offset = id.block_offset();
 
-    PERFETTO_DCHECK(block_index < blocks_.size());
+    // The size of |blocks_| can change under our feet while interning
+    // concurrently.
+    PERFETTO_DCHECK(concurrent_interning_ || block_index < blocks_.size());
     PERFETTO_DCHECK(block_offset < blocks_[block_index].pos());
 
     return blocks_[block_index].Get(block_offset);
@@ -285,12 +469,21 @@ class StringPool {
   // set.
   NullTermStringView GetLargeString(Id id) const {
     PERFETTO_DCHECK(id.is_large_string());
+    if (PERFETTO_UNLIKELY(concurrent_interning_))
+      return GetLargeStringConcurrent(id);
     size_t index = id.large_string_index();
     PERFETTO_DCHECK(index < large_strings_.size());
     const std::string* str = large_strings_[index].get();
+    if (PERFETTO_UNLIKELY(IsCompressed(index)))
+      return GetCompressedString(index, str);
     return NullTermStringView(str->c_str(), str->size());
   }
 
+  // As |large_strings_| can reallocate, reading it while interning
+  // concurrently requires a lock. Large strings are rare enough for this not
+  // to matter.
+  NullTermStringView GetLargeStringConcurrent(Id id) const;
+
   // The actual memory storing the strings.
   std::vector<Block> blocks_;
 
@@ -299,6 +492,22 @@ class StringPool {
   // |large_strings_| is resized).
   std::vector<std::unique_ptr<std::string>> large_strings_;
 
+  // Whether each large string is compressed, up to the last compressed one.
+  // Only written while not interning concurrently.
+  std::vector<bool> compressed_large_strings_;
+
+  // Keeps the memory of the shared snapshot, if any, alive.
+  std::shared_ptr<const void> shared_snapshot_;
+
+  // The index of the shared snapshot and its capacity (a power of two).
+  const SharedIndexSlot* shared_index_ = nullptr;
+  uint64_t shared_index_capacity_ = 0;
+
+  // Number of strings in the shared snapshot and, out of them, the number
+  // which were also added to |string_index_| when they were first interned.
+  size_t shared_string_count_ = 0;
+  size_t shared_strings_in_index_ = 0;
+
   // Maps hashes of strings to the Id in the string pool.
   base::FlatHashMap<StringHash,
                     Id,
@@ -306,6 +515,19 @@ class StringPool {
                     base::LinearProbe,
                     /*AppendOnly=*/true>
       string_index_{/*initial_capacity=*/4096u};
+
+  // Unique among all the pools created by the process, to identify the pool in
+  // the per-thread block cache.
+  uint64_t uid_ = 0;
+
+  bool concurrent_interning_ = false;
+  // Created the first time concurrent interning is enabled and kept afterwards
+  // so that threads keep using the same block.
+  std::unique_ptr<ConcurrentState> concurrent_state_;
+
+  bool compress_strings_ = false;
+  // Created the first time a string is compressed.
+  std::unique_ptr<CompressionState> compression_state_;
 };
 
 }  // namespace trace_processor
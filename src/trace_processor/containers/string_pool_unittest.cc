@@ -16,9 +16,14 @@
 
 #include "src/trace_processor/containers/string_pool.h"
 
+#include <string.h>
+
 #include <array>
+#include <memory>
 #include <random>
+#include <thread>
 
+#include "perfetto/base/build_config.h"
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -31,6 +36,10 @@ class StringPoolTest : public testing::Test {
   static constexpr size_t kBlockSizeBytes = StringPool::kBlockSizeBytes;
   static constexpr size_t kMinLargeStringSizeBytes =
       StringPool::kMinLargeStringSizeBytes;
+  static constexpr size_t kMinCompressedStringSizeBytes =
+      StringPool::kMinCompressedStringSizeBytes;
+  static constexpr size_t kCompressedStringCacheSize =
+      StringPool::kCompressedStringCacheSize;
 
   StringPool pool_;
 };
@@ -197,6 +206,225 @@ TEST_F(StringPoolTest, BigString) {
   }
 }
 
+TEST_F(StringPoolTest, ConcurrentInterning) {
+  auto before = pool_.InternString("before");
+  pool_.SetConcurrentInterning(true);
+
+  // All the threads intern the same strings, in a different order.
+  constexpr uint32_t kThreads = 4;
+  constexpr uint32_t kStrings = 10000;
+  std::array<std::vector<StringPool::Id>, kThreads> ids;
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([this, t, &ids] {
+      ids[t].resize(kStrings);
+      for (uint32_t i = 0; i < kStrings; ++i) {
+        uint32_t n = (i * (6 * t + 1) + t) % kStrings;
+        std::string str = "str" + std::to_string(n);
+        ids[t][n] = pool_.InternString(base::StringView(str));
+        ASSERT_EQ(pool_.Get(ids[t][n]), base::StringView(str));
+      }
+      ASSERT_EQ(pool_.InternString("before"), pool_.InternString("before"));
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  for (uint32_t t = 1; t < kThreads; ++t)
+    ASSERT_EQ(ids[t], ids[0]);
+  ASSERT_EQ(pool_.size(), kStrings + 1);
+
+  // Ids stay valid and are found by the single threaded path afterwards.
+  pool_.SetConcurrentInterning(false);
+  ASSERT_EQ(pool_.size(), kStrings + 1);
+  ASSERT_EQ(pool_.InternString("before"), before);
+  ASSERT_EQ(pool_.InternString("str42"), ids[0][42]);
+  ASSERT_EQ(pool_.Get(ids[0][42]), "str42");
+  ASSERT_EQ(pool_.GetId("str43"), ids[0][43]);
+
+  size_t iterated = 0;
+  for (auto it = pool_.CreateIterator(); it; ++it)
+    iterated += !it.StringId().is_null();
+  ASSERT_EQ(iterated, kStrings + 1);
+}
+
+TEST_F(StringPoolTest, SnapshotRoundTrip) {
+  std::array<StringPool::Id, 3> ids = {pool_.InternString("foo"),
+                                       pool_.InternString(""),
+                                       pool_.InternString("bar")};
+  std::string large(kMinLargeStringSizeBytes, 'x');
+  StringPool::Id large_id = pool_.InternString(base::StringView(large));
+
+  std::vector<uint8_t> snapshot;
+  pool_.SerializeSnapshot(&snapshot);
+  base::StatusOr<StringPool> restored =
+      StringPool::FromSnapshot(snapshot.data(), snapshot.size());
+  ASSERT_TRUE(restored.ok()) << restored.status().message();
+
+  ASSERT_EQ(restored->size(), pool_.size());
+  ASSERT_EQ(restored->Get(ids[0]), "foo");
+  ASSERT_EQ(restored->Get(ids[1]), "");
+  ASSERT_EQ(restored->Get(ids[2]), "bar");
+  ASSERT_EQ(restored->Get(large_id), base::StringView(large));
+  ASSERT_EQ(restored->GetId("bar"), ids[2]);
+  ASSERT_EQ(restored->InternString("foo"), ids[0]);
+  ASSERT_FALSE(restored->GetId("baz").has_value());
+
+  // New strings must not clobber the restored ones.
+  StringPool::Id baz = restored->InternString("baz");
+  ASSERT_EQ(restored->Get(baz), "baz");
+  ASSERT_EQ(restored->Get(ids[2]), "bar");
+}
+
+TEST_F(StringPoolTest, SharedSnapshot) {
+  StringPool::Id foo = pool_.InternString("foo");
+  StringPool::Id bar = pool_.InternString("bar");
+  std::string large(kMinLargeStringSizeBytes, 'x');
+  StringPool::Id large_id = pool_.InternString(base::StringView(large));
+
+  std::vector<uint8_t> bytes;
+  pool_.SerializeSnapshot(&bytes);
+  // Copied to 8 byte aligned memory, as a mapped file would be.
+  auto snapshot = std::make_shared<std::vector<uint64_t>>(
+      (bytes.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  memcpy(snapshot->data(), bytes.data(), bytes.size());
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(snapshot->data());
+
+  base::StatusOr<StringPool> shared =
+      StringPool::FromSharedSnapshot(data, bytes.size(), snapshot);
+  ASSERT_TRUE(shared.ok()) << shared.status().message();
+  ASSERT_EQ(shared->size(), pool_.size());
+  ASSERT_EQ(shared->Get(foo), "foo");
+  ASSERT_EQ(shared->Get(large_id), base::StringView(large));
+  ASSERT_EQ(shared->GetId("bar"), bar);
+  ASSERT_EQ(shared->GetId("baz"), std::nullopt);
+
+  // Strings of the snapshot keep their id, new strings are added to a block
+  // owned by the pool.
+  ASSERT_EQ(shared->InternString("foo"), foo);
+  ASSERT_EQ(shared->size(), pool_.size());
+  StringPool::Id baz = shared->InternString("baz");
+  ASSERT_NE(baz.block_index(), foo.block_index());
+  ASSERT_EQ(shared->Get(baz), "baz");
+  ASSERT_EQ(shared->size(), pool_.size() + 1);
+
+  shared->SetConcurrentInterning(true);
+  ASSERT_EQ(shared->InternString("bar"), bar);
+  ASSERT_EQ(shared->InternString("baz"), baz);
+  shared->SetConcurrentInterning(false);
+
+  // The shared strings are not accounted to the pool.
+  ASSERT_LT(shared->GetMemoryUsage().used_bytes,
+            pool_.GetMemoryUsage().used_bytes);
+
+  // Misaligned snapshots can't be read in place.
+  ASSERT_FALSE(
+      StringPool::FromSharedSnapshot(data + 1, bytes.size() - 1, snapshot)
+          .ok());
+}
+
+TEST_F(StringPoolTest, SnapshotRejectsBadInput) {
+  pool_.InternString("foo");
+  std::vector<uint8_t> snapshot;
+  pool_.SerializeSnapshot(&snapshot);
+
+  // Truncated.
+  ASSERT_FALSE(
+      StringPool::FromSnapshot(snapshot.data(), snapshot.size() - 1).ok());
+
+  // Stale version.
+  std::vector<uint8_t> stale = snapshot;
+  stale[4]++;
+  ASSERT_FALSE(StringPool::FromSnapshot(stale.data(), stale.size()).ok());
+
+  // Corrupted string size inside the first block.
+  std::vector<uint8_t> corrupted = snapshot;
+  corrupted[16 + 1] = 0x7f;
+  ASSERT_FALSE(
+      StringPool::FromSnapshot(corrupted.data(), corrupted.size()).ok());
+}
+
+TEST_F(StringPoolTest, MemoryUsage) {
+  MemoryUsage initial = pool_.GetMemoryUsage();
+  ASSERT_LE(initial.used_bytes, initial.reserved_bytes);
+
+  pool_.InternString("foo");
+  MemoryUsage small = pool_.GetMemoryUsage();
+  ASSERT_GT(small.used_bytes, initial.used_bytes);
+  ASSERT_LE(small.used_bytes, small.reserved_bytes);
+
+  // Interning the same string again doesn't use any more memory.
+  pool_.InternString("foo");
+  ASSERT_EQ(pool_.GetMemoryUsage().used_bytes, small.used_bytes);
+
+  std::string large(kMinLargeStringSizeBytes, 'a');
+  pool_.InternString(base::StringView(large));
+  ASSERT_GE(pool_.GetMemoryUsage().used_bytes,
+            small.used_bytes + kMinLargeStringSizeBytes);
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+TEST_F(StringPoolTest, StringCompression) {
+  pool_.SetStringCompression(true);
+
+  // Short strings and strings which don't compress well stay in the blocks.
+  StringPool::Id short_id = pool_.InternString("foo");
+  std::minstd_rand0 rnd(42);
+  std::string random(kMinCompressedStringSizeBytes, '\0');
+  for (char& c : random)
+    c = static_cast<char>(rnd());
+  StringPool::Id random_id = pool_.InternString(base::StringView(random));
+  ASSERT_FALSE(short_id.is_large_string());
+  ASSERT_FALSE(random_id.is_large_string());
+  ASSERT_EQ(pool_.Get(random_id), base::StringView(random));
+
+  // Intern more compressed strings than fit in the cache, so that reading
+  // them back has to evict some.
+  std::vector<std::string> strs;
+  std::vector<StringPool::Id> ids;
+  for (size_t i = 0; i < kCompressedStringCacheSize * 2; ++i) {
+    std::string str = "{\"args\": [";
+    while (str.size() < kMinCompressedStringSizeBytes)
+      str += "\"arg" + std::to_string(i) + "\", ";
+    str += "]}";
+    ids.push_back(pool_.InternString(base::StringView(str)));
+    strs.push_back(std::move(str));
+  }
+  MemoryUsage usage = pool_.GetMemoryUsage();
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t i = 0; i < strs.size(); ++i) {
+      ASSERT_TRUE(ids[i].is_large_string());
+      ASSERT_EQ(pool_.Get(ids[i]), base::StringView(strs[i]));
+      ASSERT_EQ(pool_.Get(ids[i]).c_str()[strs[i].size()], '\0');
+      ASSERT_EQ(pool_.InternString(base::StringView(strs[i])), ids[i]);
+      ASSERT_EQ(pool_.GetId(base::StringView(strs[i])), ids[i]);
+    }
+  }
+  ASSERT_LT(usage.used_bytes, strs.size() * kMinCompressedStringSizeBytes);
+
+  // The views of the strings read most recently are still valid.
+  NullTermStringView first = pool_.Get(ids[0]);
+  NullTermStringView second = pool_.Get(ids[1]);
+  ASSERT_EQ(first, base::StringView(strs[0]));
+  ASSERT_EQ(second, base::StringView(strs[1]));
+
+  // Snapshots store the strings uncompressed.
+  std::vector<uint8_t> snapshot;
+  pool_.SerializeSnapshot(&snapshot);
+  base::StatusOr<StringPool> restored =
+      StringPool::FromSnapshot(snapshot.data(), snapshot.size());
+  ASSERT_TRUE(restored.ok());
+  for (size_t i = 0; i < strs.size(); ++i)
+    ASSERT_EQ(restored->Get(ids[i]), base::StringView(strs[i]));
+
+  // Disabling compression only affects the strings interned afterwards.
+  pool_.SetStringCompression(false);
+  std::string str(kMinCompressedStringSizeBytes, 'a');
+  ASSERT_FALSE(pool_.InternString(base::StringView(str)).is_large_string());
+  ASSERT_EQ(pool_.Get(ids[0]), base::StringView(strs[0]));
+}
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -161,23 +161,29 @@ void Column::FilterIntoNumericSlow(FilterOp op,
   PERFETTO_DCHECK(type_ == ColumnTypeHelper<T>::ToColumnType());
   PERFETTO_DCHECK(std::is_arithmetic<T>::value);
 
-  if (op == FilterOp::kIsNull) {
+  if (op == FilterOp::kIsNull || op == FilterOp::kIsNotNull) {
     PERFETTO_DCHECK(value.is_null());
-    if (is_nullable) {
-      overlay().FilterInto(rm, [this](uint32_t row) {
-        return !storage<std::optional<T>>().Get(row).has_value();
-      });
-    } else {
-      rm->Clear();
+    bool keep_null = op == FilterOp::kIsNull;
+    if (!is_nullable) {
+      if (keep_null)
+        rm->Clear();
+      return;
     }
-    return;
-  } else if (op == FilterOp::kIsNotNull) {
-    PERFETTO_DCHECK(value.is_null());
-    if (is_nullable) {
-      overlay().FilterInto(rm, [this](uint32_t row) {
-        return storage<std::optional<T>>().Get(row).has_value();
-      });
+
+    // Columns which never or always contain nulls don't need to look at the
+    // rows. Otherwise, the non-null BitVector answers for both dense and
+    // sparse storage without looking up the values.
+    const BitVector& non_null =
+        storage<std::optional<T>>().non_null_bit_vector();
+    uint32_t non_null_count = non_null.CountSetBits();
+    if (non_null_count == non_null.size() || non_null_count == 0) {
+      if (keep_null == (non_null_count != 0))
+        rm->Clear();
+      return;
     }
+    overlay().FilterInto(rm, [&non_null, keep_null](uint32_t row) {
+      return non_null.IsSet(row) != keep_null;
+    });
     return;
   }
 
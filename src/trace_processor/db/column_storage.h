@@ -18,6 +18,7 @@
 #define SRC_TRACE_PROCESSOR_DB_COLUMN_STORAGE_H_
 
 #include "src/trace_processor/containers/bit_vector.h"
+#include "src/trace_processor/containers/memory_usage.h"
 #include "src/trace_processor/containers/nullable_vector.h"
 
 namespace perfetto {
@@ -40,6 +41,7 @@ class ColumnStorageBase {
   virtual const BitVector* bv() const = 0;
   virtual uint32_t size() const = 0;
   virtual uint32_t non_null_size() const = 0;
+  virtual MemoryUsage GetMemoryUsage() const = 0;
 };
 
 // Class used for implementing storage for non-null columns.
@@ -64,6 +66,9 @@ class ColumnStorage final : public ColumnStorageBase {
   const BitVector* bv() const final { return nullptr; }
   uint32_t size() const final { return static_cast<uint32_t>(vector_.size()); }
   uint32_t non_null_size() const final { return size(); }
+  MemoryUsage GetMemoryUsage() const final {
+    return GetVectorMemoryUsage(vector_);
+  }
 
   template <bool IsDense>
   static ColumnStorage<T> Create() {
@@ -108,6 +113,7 @@ class ColumnStorage<std::optional<T>> final : public ColumnStorageBase {
   uint32_t non_null_size() const final {
     return static_cast<uint32_t>(nv_.non_null_vector().size());
   }
+  MemoryUsage GetMemoryUsage() const final { return nv_.GetMemoryUsage(); }
 
   template <bool IsDense>
   static ColumnStorage<std::optional<T>> Create() {
@@ -25,7 +25,23 @@ namespace overlays {
 
 using Range = RowMap::Range;
 
+NullOverlay::NullOverlay(const BitVector* null) : non_null_(null) {
+  uint32_t non_null_count = non_null_->CountSetBits();
+  if (non_null_count == non_null_->size()) {
+    layout_ = Layout::kNoNulls;
+  } else if (non_null_count == 0) {
+    layout_ = Layout::kAllNulls;
+  } else {
+    layout_ = Layout::kMixed;
+  }
+}
+
 StorageRange NullOverlay::MapToStorageRange(TableRange t_range) const {
+  if (layout_ == Layout::kNoNulls)
+    return StorageRange(t_range.range);
+  if (layout_ == Layout::kAllNulls)
+    return StorageRange(0, 0);
+
   uint32_t start = non_null_->CountSetBits(t_range.range.start);
   uint32_t end = non_null_->CountSetBits(t_range.range.end);
 
@@ -37,6 +53,14 @@ TableRangeOrBitVector NullOverlay::MapToTableRangeOrBitVector(
     OverlayOp op) const {
   PERFETTO_DCHECK(s_range.range.end <= non_null_->CountSetBits());
 
+  if (layout_ == Layout::kNoNulls)
+    return TableRangeOrBitVector(s_range.range);
+  if (layout_ == Layout::kAllNulls) {
+    return TableRangeOrBitVector(op == OverlayOp::kIsNull
+                                     ? Range(0, non_null_->size())
+                                     : Range());
+  }
+
   BitVector range_to_bv(s_range.range.start, false);
   range_to_bv.Resize(s_range.range.end, true);
 
@@ -46,6 +70,13 @@ TableRangeOrBitVector NullOverlay::MapToTableRangeOrBitVector(
 
 TableBitVector NullOverlay::MapToTableBitVector(StorageBitVector s_bv,
                                                 OverlayOp op) const {
+  if (layout_ == Layout::kNoNulls) {
+    s_bv.bv.Resize(non_null_->size(), false);
+    return {std::move(s_bv.bv)};
+  }
+  if (layout_ == Layout::kAllNulls)
+    return {BitVector(non_null_->size(), op == OverlayOp::kIsNull)};
+
   BitVector res = non_null_->Copy();
   res.UpdateSetBits(s_bv.bv);
 
@@ -70,6 +101,9 @@ BitVector NullOverlay::IsStorageLookupRequired(
   if (op != OverlayOp::kOther)
     return BitVector(t_iv.size(), false);
 
+  if (layout_ != Layout::kMixed)
+    return BitVector(t_iv.size(), layout_ == Layout::kNoNulls);
+
   BitVector in_storage(static_cast<uint32_t>(t_iv.indices.size()), false);
 
   // For each index in TableIndexVector check whether this index is in storage.
@@ -86,6 +120,9 @@ StorageIndexVector NullOverlay::MapToStorageIndexVector(
   PERFETTO_DCHECK(t_iv_with_idx_in_storage.indices.size() <=
                   non_null_->CountSetBits());
 
+  if (layout_ == Layout::kNoNulls)
+    return StorageIndexVector({std::move(t_iv_with_idx_in_storage.indices)});
+
   std::vector<uint32_t> storage_index_vector;
   storage_index_vector.reserve(t_iv_with_idx_in_storage.indices.size());
   for (auto t_idx : t_iv_with_idx_in_storage.indices) {
@@ -101,6 +138,12 @@ BitVector NullOverlay::IndexSearch(
   if (op == OverlayOp::kOther)
     return BitVector(t_iv_overlay_idx.size(), false);
 
+  if (layout_ != Layout::kMixed) {
+    bool is_null = layout_ == Layout::kAllNulls;
+    return BitVector(t_iv_overlay_idx.size(),
+                     is_null == (op == OverlayOp::kIsNull));
+  }
+
   BitVector res(static_cast<uint32_t>(t_iv_overlay_idx.indices.size()), false);
   if (op == OverlayOp::kIsNull) {
     for (uint32_t i = 0; i < res.size(); ++i) {
@@ -26,9 +26,13 @@ namespace overlays {
 
 // Introduces the layer of nullability - spreads out the storage with nulls
 // using BitVector.
+//
+// Columns which never contain nulls or only contain nulls are common (e.g.
+// args-derived columns). For those, the mapping between table and storage
+// indices is trivial so the overlay doesn't look at |non_null_| at all.
 class NullOverlay : public StorageOverlay {
  public:
-  explicit NullOverlay(const BitVector* null) : non_null_(std::move(null)) {}
+  explicit NullOverlay(const BitVector* null);
 
   StorageRange MapToStorageRange(TableRange) const override;
 
@@ -48,8 +52,18 @@ class NullOverlay : public StorageOverlay {
   CostEstimatePerRow EstimateCostPerRow(OverlayOp) const override;
 
  private:
+  enum class Layout {
+    // Every row is non-null: table and storage indices are the same.
+    kNoNulls,
+    // Every row is null: the storage is empty.
+    kAllNulls,
+    // Some rows are null: |non_null_| maps table and storage indices.
+    kMixed,
+  };
+
   // Non null data in the overlay.
   const BitVector* non_null_;
+  Layout layout_;
 };
 
 }  // namespace overlays
@@ -158,6 +158,71 @@ TEST(NullOverlay, IndexSearchIsNotNullOp) {
   ASSERT_EQ(idx_search_bv.CountSetBits(), 0u);
 }
 
+TEST(NullOverlay, NoNullsMapsIndicesAsIs) {
+  BitVector bv{1, 1, 1, 1, 1, 1};
+  NullOverlay overlay(&bv);
+
+  StorageRange r = overlay.MapToStorageRange(TableRange(1, 4));
+  ASSERT_EQ(r.range.start, 1u);
+  ASSERT_EQ(r.range.end, 4u);
+
+  auto t_range =
+      overlay.MapToTableRangeOrBitVector(StorageRange(2, 5), OverlayOp::kOther);
+  ASSERT_TRUE(t_range.IsRange());
+  Range range = std::move(t_range).TakeIfRange();
+  ASSERT_EQ(range.start, 2u);
+  ASSERT_EQ(range.end, 5u);
+
+  TableBitVector table_bv = overlay.MapToTableBitVector(
+      {BitVector{0, 1, 0, 1}}, OverlayOp::kOther);
+  ASSERT_EQ(table_bv.bv.size(), 6u);
+  ASSERT_EQ(table_bv.bv.CountSetBits(), 2u);
+  ASSERT_TRUE(table_bv.bv.IsSet(1));
+  ASSERT_TRUE(table_bv.bv.IsSet(3));
+
+  std::vector<uint32_t> table_idx{0, 3, 5};
+  ASSERT_EQ(overlay.IsStorageLookupRequired(OverlayOp::kOther, {table_idx})
+                .CountSetBits(),
+            3u);
+  StorageIndexVector s_iv = overlay.MapToStorageIndexVector({table_idx});
+  ASSERT_THAT(s_iv.indices, testing::ElementsAre(0u, 3u, 5u));
+  ASSERT_EQ(overlay.IndexSearch(OverlayOp::kIsNull, {table_idx}).CountSetBits(),
+            0u);
+  ASSERT_EQ(
+      overlay.IndexSearch(OverlayOp::kIsNotNull, {table_idx}).CountSetBits(),
+      3u);
+}
+
+TEST(NullOverlay, AllNullsSkipsStorage) {
+  BitVector bv(6, false);
+  NullOverlay overlay(&bv);
+
+  StorageRange r = overlay.MapToStorageRange(TableRange(1, 4));
+  ASSERT_EQ(r.range.size(), 0u);
+
+  auto is_null = overlay.MapToTableRangeOrBitVector(StorageRange(0, 0),
+                                                    OverlayOp::kIsNull);
+  ASSERT_EQ(std::move(is_null).TakeIfRange().size(), 6u);
+  auto other =
+      overlay.MapToTableRangeOrBitVector(StorageRange(0, 0), OverlayOp::kOther);
+  ASSERT_EQ(std::move(other).TakeIfRange().size(), 0u);
+
+  TableBitVector table_bv =
+      overlay.MapToTableBitVector({BitVector()}, OverlayOp::kIsNull);
+  ASSERT_EQ(table_bv.bv.size(), 6u);
+  ASSERT_EQ(table_bv.bv.CountSetBits(), 6u);
+
+  std::vector<uint32_t> table_idx{0, 3, 5};
+  ASSERT_EQ(overlay.IsStorageLookupRequired(OverlayOp::kOther, {table_idx})
+                .CountSetBits(),
+            0u);
+  ASSERT_EQ(overlay.IndexSearch(OverlayOp::kIsNull, {table_idx}).CountSetBits(),
+            3u);
+  ASSERT_EQ(
+      overlay.IndexSearch(OverlayOp::kIsNotNull, {table_idx}).CountSetBits(),
+      0u);
+}
+
 }  // namespace
 }  // namespace overlays
 }  // namespace trace_processor
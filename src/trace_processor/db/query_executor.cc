@@ -14,14 +14,20 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/status_or.h"
+#include "perfetto/ext/base/threading/thread_pool.h"
+#include "perfetto/ext/base/utils.h"
 #include "src/trace_processor/db/overlays/arrangement_overlay.h"
 #include "src/trace_processor/db/overlays/null_overlay.h"
 #include "src/trace_processor/db/overlays/selector_overlay.h"
@@ -33,6 +39,8 @@
 #include "src/trace_processor/db/storage/string_storage.h"
 #include "src/trace_processor/db/storage/types.h"
 #include "src/trace_processor/db/table.h"
+#include "src/trace_processor/tp_metatrace.h"
+#include "src/trace_processor/util/threading.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -52,6 +60,86 @@ using StorageBitVector = overlays::StorageBitVector;
 using OverlaysVec = base::SmallVector<const overlays::StorageOverlay*,
                                       QueryExecutor::kMaxOverlayCount>;
 
+#if PERFETTO_TP_HAS_THREADS()
+// Used by LinearSearch to search large storages in parallel. Only set when
+// QueryExecutor::SetSearchThreadCount was called with a non-zero count.
+base::ThreadPool* g_search_pool = nullptr;
+uint32_t g_search_thread_count = 0;
+
+// Searches |range| of |storage| in one chunk per thread of |pool| plus one
+// chunk on the calling thread and merges the results.
+RangeOrBitVector ParallelSearch(base::ThreadPool* pool,
+                                uint32_t thread_count,
+                                const Storage& storage,
+                                const Constraint& c,
+                                Range range) {
+  // Every chunk's result is as big as the storage up to the end of the
+  // chunk: we use as few chunks as possible to keep merging them cheap.
+  uint32_t chunk_count = thread_count + 1;
+  uint32_t chunk_size = (range.size() + chunk_count - 1) / chunk_count;
+  std::vector<Range> chunks;
+  std::vector<RangeOrBitVector> results;
+  for (uint32_t start = range.start; start < range.end; start += chunk_size) {
+    chunks.emplace_back(start, std::min(start + chunk_size, range.end));
+    results.emplace_back(Range());
+  }
+
+  std::mutex mutex;
+  std::condition_variable chunk_done;
+  size_t pending_chunks = chunks.size() - 1;
+  for (size_t i = 1; i < chunks.size(); ++i) {
+    pool->PostTask([&, i] {
+      RangeOrBitVector res = storage.Search(c.op, c.value, chunks[i]);
+      std::lock_guard<std::mutex> lock(mutex);
+      results[i] = std::move(res);
+      --pending_chunks;
+      chunk_done.notify_all();
+    });
+  }
+  results[0] = storage.Search(c.op, c.value, chunks[0]);
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    chunk_done.wait(lock, [&pending_chunks] { return pending_chunks == 0; });
+  }
+
+  // Searching sorted storages gives a range per chunk: if they are adjacent,
+  // they can be merged into a single range.
+  bool all_adjacent_ranges = true;
+  Range merged;
+  for (const RangeOrBitVector& res : results) {
+    if (!res.IsRange()) {
+      all_adjacent_ranges = false;
+      break;
+    }
+    Range r = *std::get_if<Range>(&res.val);
+    if (r.size() == 0)
+      continue;
+    if (merged.size() != 0 && merged.end != r.start) {
+      all_adjacent_ranges = false;
+      break;
+    }
+    merged = merged.size() == 0 ? r : Range(merged.start, r.end);
+  }
+  if (all_adjacent_ranges)
+    return RangeOrBitVector(merged);
+
+  BitVector bv(range.end);
+  for (RangeOrBitVector& res : results) {
+    BitVector chunk_bv;
+    if (res.IsRange()) {
+      Range r = std::move(res).TakeIfRange();
+      chunk_bv =
+          BitVector::Range(r.start, r.end, [](uint32_t) { return true; });
+    } else {
+      chunk_bv = std::move(res).TakeIfBitVector();
+    }
+    chunk_bv.Resize(range.end);
+    bv.Or(chunk_bv);
+  }
+  return RangeOrBitVector(std::move(bv));
+}
+#endif
+
 // Helper struct to simplify operations on |global| and |current| sets of
 // indices. Having this coupling enables efficient implementation of
 // IndexedColumnFilter.
@@ -122,6 +210,89 @@ struct IndexFilterHelper {
   std::vector<uint32_t> current_;
   std::vector<uint32_t> global_;
 };
+
+// Owns the storage and overlays equivalent to a legacy Column.
+struct LegacyColumn {
+  QueryExecutor::SimpleColumn AsSimpleColumn() const {
+    QueryExecutor::SimpleColumn s_col{OverlaysVec(), storage.get()};
+    if (selector_overlay)
+      s_col.overlays.emplace_back(selector_overlay.get());
+    if (arrangement_overlay)
+      s_col.overlays.emplace_back(arrangement_overlay.get());
+    if (null_overlay)
+      s_col.overlays.emplace_back(null_overlay.get());
+    return s_col;
+  }
+
+  std::unique_ptr<Storage> storage;
+  std::unique_ptr<overlays::SelectorOverlay> selector_overlay;
+  std::unique_ptr<overlays::ArrangementOverlay> arrangement_overlay;
+  std::unique_ptr<overlays::NullOverlay> null_overlay;
+};
+
+// Number of elements in the storage backing |col|.
+uint32_t LegacyColumnSize(const Column& col) {
+  return col.IsId() ? col.overlay().row_map().Max()
+                    : col.storage_base().size();
+}
+
+// Returns whether |col| can't be represented by a LegacyColumn.
+bool RequiresLegacyColumn(const Column& col) {
+  // Rare cases where we have a range which doesn't match the size of the
+  // column.
+  bool use_legacy = col.overlay().size() != LegacyColumnSize(col) &&
+                    col.overlay().row_map().IsRange();
+
+  // Column types
+  use_legacy = use_legacy || col.col_type() == ColumnType::kDummy;
+
+  // Dense columns store values for null rows too so can't use NullOverlay.
+  use_legacy = use_legacy || col.IsDense();
+  return use_legacy;
+}
+
+LegacyColumn CreateLegacyColumn(const Table* table, const Column& col) {
+  // String columns are inherently nullable: null values are signified with
+  // Id::Null().
+  PERFETTO_CHECK(!(col.col_type() == ColumnType::kString && col.IsNullable()));
+
+  LegacyColumn legacy;
+  uint32_t column_size = LegacyColumnSize(col);
+
+  // Create storage
+  if (col.IsId()) {
+    legacy.storage.reset(new storage::IdStorage(column_size));
+  } else if (col.col_type() == ColumnType::kString) {
+    legacy.storage.reset(new storage::StringStorage(
+        table->string_pool(),
+        static_cast<const StringPool::Id*>(col.storage_base().data()),
+        col.storage_base().non_null_size()));
+  } else {
+    legacy.storage.reset(new storage::NumericStorage(
+        col.storage_base().data(), col.storage_base().non_null_size(),
+        col.col_type(), col.IsSorted()));
+  }
+
+  // Create cDBv2 overlays based on col.overlay()
+  if (col.overlay().size() != column_size &&
+      col.overlay().row_map().IsBitVector()) {
+    legacy.selector_overlay.reset(new overlays::SelectorOverlay(
+        col.overlay().row_map().GetIfBitVector()));
+  }
+
+  if (col.overlay().row_map().IsIndexVector()) {
+    legacy.arrangement_overlay.reset(new overlays::ArrangementOverlay(
+        col.overlay().row_map().GetIfIndexVector()));
+  }
+
+  // Add nullability
+  if (col.IsNullable()) {
+    legacy.null_overlay.reset(
+        new overlays::NullOverlay(col.storage_base().bv()));
+  }
+  return legacy;
+}
+
 }  // namespace
 
 void QueryExecutor::FilterColumn(const Constraint& c,
@@ -160,8 +331,7 @@ void QueryExecutor::LinearSearch(const Constraint& c,
   }
 
   // Search the storage.
-  overlays::TableRangeOrBitVector res(
-      col.storage->Search(c.op, c.value, bounds.range));
+  overlays::TableRangeOrBitVector res(SearchStorage(c, col, bounds.range));
 
   // Translate the result to global level.
   OverlayOp op = overlays::FilterOpToOverlayOp(c.op);
@@ -198,6 +368,70 @@ void QueryExecutor::LinearSearch(const Constraint& c,
   rm->Intersect(RowMap(std::move(res).TakeIfBitVector()));
 }
 
+RangeOrBitVector QueryExecutor::SearchStorage(const Constraint& c,
+                                             const SimpleColumn& col,
+                                             Range range) {
+#if PERFETTO_TP_HAS_THREADS()
+  // Metatracing is not thread-safe so parallel searches are only done when
+  // storages don't emit metatrace events.
+  bool metatrace_db = (metatrace::Category::DB &
+                       metatrace::g_enabled_categories) != 0;
+  if (g_search_pool && !metatrace_db &&
+      range.size() >= kMinRowsForParallelSearch) {
+    return ParallelSearch(g_search_pool, g_search_thread_count, *col.storage,
+                          c, range);
+  }
+#endif
+  return col.storage->Search(c.op, c.value, range);
+}
+
+void QueryExecutor::SetSearchThreadCount(uint32_t thread_count) {
+#if !PERFETTO_TP_HAS_THREADS()
+  base::ignore_result(thread_count);
+#else
+  if (thread_count == g_search_thread_count)
+    return;
+  delete g_search_pool;
+  g_search_pool = thread_count > 0 ? new base::ThreadPool(thread_count)
+                                   : nullptr;
+  g_search_thread_count = thread_count;
+#endif
+}
+
+void QueryExecutor::ParallelFor(uint32_t task_count,
+                                const std::function<void(uint32_t)>& fn) {
+#if PERFETTO_TP_HAS_THREADS()
+  if (g_search_pool && task_count > 1) {
+    std::atomic<uint32_t> next_task{0};
+    auto run_tasks = [&next_task, task_count, &fn] {
+      for (uint32_t i = next_task++; i < task_count; i = next_task++) {
+        fn(i);
+      }
+    };
+
+    std::mutex mutex;
+    std::condition_variable worker_done;
+    uint32_t pending_workers = std::min(g_search_thread_count, task_count - 1);
+    for (uint32_t i = 0, workers = pending_workers; i < workers; ++i) {
+      g_search_pool->PostTask([&] {
+        run_tasks();
+        std::lock_guard<std::mutex> lock(mutex);
+        --pending_workers;
+        worker_done.notify_all();
+      });
+    }
+    run_tasks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    worker_done.wait(lock, [&pending_workers] { return pending_workers == 0; });
+    return;
+  }
+#endif
+  for (uint32_t i = 0; i < task_count; ++i) {
+    fn(i);
+  }
+}
+
 RowMap QueryExecutor::IndexSearch(const Constraint& c,
                                   const SimpleColumn& col,
                                   RowMap* rm) {
@@ -262,36 +496,108 @@ RowMap QueryExecutor::IndexSearch(const Constraint& c,
   return RowMap(std::move(matched));
 }
 
+void QueryExecutor::StableSortColumn(const SimpleColumn& col,
+                                     bool desc,
+                                     std::vector<uint32_t>* rows) {
+  // Stably sorting in descending order is equivalent to stably sorting the
+  // reversed rows in ascending order and reversing the result.
+  if (desc)
+    std::reverse(rows->begin(), rows->end());
+
+  // Without overlays, table indices are storage indices.
+  if (col.overlays.empty()) {
+    col.storage->StableSort(rows->data(), static_cast<uint32_t>(rows->size()));
+    if (desc)
+      std::reverse(rows->begin(), rows->end());
+    return;
+  }
+
+  // Map the rows through the overlays to the storage, keeping for each
+  // remaining row its position in |rows|. Rows which don't reach the storage
+  // are null.
+  std::vector<uint32_t> current = *rows;
+  std::vector<uint32_t> positions(current.size());
+  std::iota(positions.begin(), positions.end(), 0);
+  std::vector<uint32_t> null_positions;
+  for (const auto& overlay : col.overlays) {
+    BitVector lookup =
+        overlay->IsStorageLookupRequired(OverlayOp::kOther, {current});
+    if (lookup.CountSetBits() != lookup.size()) {
+      uint32_t kept = 0;
+      for (uint32_t i = 0; i < current.size(); ++i) {
+        if (lookup.IsSet(i)) {
+          current[kept] = current[i];
+          positions[kept++] = positions[i];
+        } else {
+          null_positions.push_back(positions[i]);
+        }
+      }
+      current.resize(kept);
+      positions.resize(kept);
+    }
+    current = overlay->MapToStorageIndexVector({std::move(current)}).indices;
+  }
+
+  // Sort the storage indices. Several rows can map to the same storage index:
+  // they compare equal, so mapping them back to their positions in the order
+  // they appeared keeps the sort stable.
+  std::vector<uint32_t> sorted = current;
+  col.storage->StableSort(sorted.data(), static_cast<uint32_t>(sorted.size()));
+
+  // Bucket the positions by storage index, preserving their relative order.
+  std::vector<uint32_t> offsets(col.storage->size() + 1);
+  for (uint32_t storage_idx : current) {
+    PERFETTO_DCHECK(storage_idx < col.storage->size());
+    offsets[storage_idx + 1]++;
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  std::vector<uint32_t> bucketed(current.size());
+  {
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < current.size(); ++i) {
+      bucketed[cursor[current[i]]++] = positions[i];
+    }
+  }
+
+  // Nulls are smaller than any value and come first, in their original order.
+  std::sort(null_positions.begin(), null_positions.end());
+  std::vector<uint32_t> res;
+  res.reserve(rows->size());
+  for (uint32_t pos : null_positions) {
+    res.push_back((*rows)[pos]);
+  }
+  for (uint32_t storage_idx : sorted) {
+    res.push_back((*rows)[bucketed[offsets[storage_idx]++]]);
+  }
+  PERFETTO_DCHECK(res.size() == rows->size());
+
+  if (desc)
+    std::reverse(res.begin(), res.end());
+  *rows = std::move(res);
+}
+
 RowMap QueryExecutor::FilterLegacy(const Table* table,
                                    const std::vector<Constraint>& c_vec) {
   RowMap rm(0, table->row_count());
   for (const auto& c : c_vec) {
     const Column& col = table->columns()[c.col_idx];
-    uint32_t column_size =
-        col.IsId() ? col.overlay().row_map().Max() : col.storage_base().size();
 
     // RowMap size
     bool use_legacy = rm.size() <= 1;
 
-    // Rare cases where we have a range which doesn't match the size of the
-    // column.
-    use_legacy = use_legacy || (col.overlay().size() != column_size &&
-                                col.overlay().row_map().IsRange());
+    use_legacy = use_legacy || RequiresLegacyColumn(col);
 
     // Rare cases where string columns can be sorted.
     use_legacy =
         use_legacy || (col.IsSorted() && col.col_type() == ColumnType::kString);
 
-    // Column types
-    use_legacy = use_legacy || col.col_type() == ColumnType::kDummy;
-
     // Mismatched types
     use_legacy = use_legacy || (overlays::FilterOpToOverlayOp(c.op) ==
                                     overlays::OverlayOp::kOther &&
                                 col.type() != c.value.type);
 
     // Specific column flags.
-    use_legacy = use_legacy || col.IsDense() || col.IsSetId();
+    use_legacy = use_legacy || col.IsSetId();
 
     // Extrinsically sorted columns
     use_legacy = use_legacy ||
@@ -302,54 +608,31 @@ RowMap QueryExecutor::FilterLegacy(const Table* table,
       continue;
     }
 
-    // String columns are inherently nullable: null values are signified with
-    // Id::Null().
-    PERFETTO_CHECK(
-        !(col.col_type() == ColumnType::kString && col.IsNullable()));
-
-    SimpleColumn s_col{OverlaysVec(), nullptr};
-
-    // Create storage
-    std::unique_ptr<Storage> storage;
-    if (col.IsId()) {
-      storage.reset(new storage::IdStorage(column_size));
-    } else if (col.col_type() == ColumnType::kString) {
-      storage.reset(new storage::StringStorage(
-          table->string_pool(),
-          static_cast<const StringPool::Id*>(col.storage_base().data()),
-          col.storage_base().non_null_size()));
-    } else {
-      storage.reset(new storage::NumericStorage(
-          col.storage_base().data(), col.storage_base().non_null_size(),
-          col.col_type(), col.IsSorted()));
-    }
-    s_col.storage = storage.get();
-
-    // Create cDBv2 overlays based on col.overlay()
-    overlays::SelectorOverlay selector_overlay(
-        col.overlay().row_map().GetIfBitVector());
-    if (col.overlay().size() != column_size &&
-        col.overlay().row_map().IsBitVector())
-      s_col.overlays.emplace_back(&selector_overlay);
-
-    overlays::ArrangementOverlay arrangement_overlay(
-        col.overlay().row_map().GetIfIndexVector());
-    if (col.overlay().row_map().IsIndexVector())
-      s_col.overlays.emplace_back(&arrangement_overlay);
-
-    // Add nullability
-    BitVector null_bv;
-    overlays::NullOverlay null_overlay(
-        col.IsNullable() ? col.storage_base().bv() : &null_bv);
-    if (col.IsNullable())
-      s_col.overlays.emplace_back(&null_overlay);
-
+    LegacyColumn legacy = CreateLegacyColumn(table, col);
     uint32_t pre_count = rm.size();
-    FilterColumn(c, s_col, &rm);
+    FilterColumn(c, legacy.AsSimpleColumn(), &rm);
     PERFETTO_DCHECK(rm.size() <= pre_count);
   }
   return rm;
 }
 
+RowMap QueryExecutor::SortLegacy(const Table* table,
+                                 const std::vector<Order>& ob) {
+  std::vector<uint32_t> rows(table->row_count());
+  std::iota(rows.begin(), rows.end(), 0);
+  // Stably sorting on each column in *reverse* order gives the
+  // lexicographical order: see Table::Sort for details.
+  for (auto it = ob.rbegin(); it != ob.rend(); ++it) {
+    const Column& col = table->columns()[it->col_idx];
+    if (RequiresLegacyColumn(col)) {
+      col.StableSort(it->desc, &rows);
+      continue;
+    }
+    LegacyColumn legacy = CreateLegacyColumn(table, col);
+    StableSortColumn(legacy.AsSimpleColumn(), it->desc, &rows);
+  }
+  return RowMap(std::move(rows));
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
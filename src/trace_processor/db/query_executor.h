@@ -17,6 +17,7 @@
 #define SRC_TRACE_PROCESSOR_DB_QUERY_EXECUTOR_H_
 
 #include <array>
+#include <functional>
 #include <numeric>
 #include <vector>
 
@@ -32,7 +33,6 @@ namespace perfetto {
 namespace trace_processor {
 
 // Responsible for executing filtering/sorting operations on a single Table.
-// TODO(b/283763282): Introduce sorting.
 class QueryExecutor {
  public:
   static constexpr uint32_t kMaxOverlayCount = 8;
@@ -57,18 +57,42 @@ class QueryExecutor {
     return rm;
   }
 
-  // Sorts using vector of Order.
-  // TODO(b/283763282): Implement.
-  RowMap Sort(const std::vector<Order>&) { PERFETTO_FATAL("Not implemented."); }
+  // Sorts using vector of Order and returns the RowMap of the sorted rows.
+  RowMap Sort(const std::vector<Order>& ob) {
+    std::vector<uint32_t> rows(row_count_);
+    std::iota(rows.begin(), rows.end(), 0);
+    // Stably sorting on each column in *reverse* order gives the
+    // lexicographical order: see Table::Sort for details.
+    for (auto it = ob.rbegin(); it != ob.rend(); ++it) {
+      StableSortColumn(columns_[it->col_idx], it->desc, &rows);
+    }
+    return RowMap(std::move(rows));
+  }
+
+  // Storages with at least this many rows in the searched range are searched
+  // in parallel if a thread count was set with SetSearchThreadCount.
+  static constexpr uint32_t kMinRowsForParallelSearch = 1u << 20;
+
+  // Sets the number of worker threads used to search large storages in
+  // parallel. Zero (the default) makes all searches run on the calling thread.
+  // This is a noop on platforms without thread support (e.g. WASM).
+  static void SetSearchThreadCount(uint32_t thread_count);
+
+  // Calls fn(0), ..., fn(task_count - 1) on the threads set with
+  // SetSearchThreadCount and on the calling thread. Tasks are handed out one
+  // at a time to whichever thread is free, so they don't need to be of equal
+  // size. Returns once all the calls have returned. Without threads, all the
+  // calls happen in order on the calling thread.
+  static void ParallelFor(uint32_t task_count,
+                          const std::function<void(uint32_t)>& fn);
 
   // Enables QueryExecutor::Filter on Table columns.
   static RowMap FilterLegacy(const Table*, const std::vector<Constraint>&);
 
-  // Enables QueryExecutor::Sort on Table columns.
-  // TODO(b/283763282): Implement.
-  static RowMap SortLegacy(const Table*, const std::vector<Order>&) {
-    PERFETTO_FATAL("Not implemented.");
-  }
+  // Enables QueryExecutor::Sort on Table columns. Columns which can't be
+  // represented with storages and overlays are sorted by the legacy
+  // Column::StableSort.
+  static RowMap SortLegacy(const Table*, const std::vector<Order>&);
 
   // Used only in unittests. Exposes private function.
   static void BoundedColumnFilterForTesting(const Constraint& c,
@@ -92,10 +116,22 @@ class QueryExecutor {
   // to filter the storage with.
   static void LinearSearch(const Constraint&, const SimpleColumn&, RowMap*);
 
+  // Searches |range| of the storage of the column, splitting it between
+  // threads if it's large enough.
+  static RangeOrBitVector SearchStorage(const Constraint&,
+                                        const SimpleColumn&,
+                                        RowMap::Range range);
+
   // Filters the column using Index algorithm - finds the indices to filter the
   // storage with.
   static RowMap IndexSearch(const Constraint&, const SimpleColumn&, RowMap*);
 
+  // Stably sorts |rows| (indices in table space) by the values of the column.
+  // Nulls compare smaller than any other value.
+  static void StableSortColumn(const SimpleColumn&,
+                               bool desc,
+                               std::vector<uint32_t>* rows);
+
   std::vector<SimpleColumn> columns_;
 
   // Number of rows in the outmost overlay.
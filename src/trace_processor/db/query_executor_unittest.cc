@@ -26,6 +26,8 @@ namespace perfetto {
 namespace trace_processor {
 namespace {
 
+using testing::ElementsAre;
+
 using OverlaysVec = base::SmallVector<const overlays::StorageOverlay*,
                                       QueryExecutor::kMaxOverlayCount>;
 using NumericStorage = storage::NumericStorage;
@@ -387,6 +389,41 @@ TEST(QueryExecutor, BinarySearch) {
   ASSERT_EQ(res.Get(1), 4u);
 }
 
+TEST(QueryExecutor, ParallelSearch) {
+  uint32_t size = QueryExecutor::kMinRowsForParallelSearch + 1000;
+  std::vector<int64_t> unsorted_data(size);
+  std::vector<int64_t> sorted_data(size);
+  for (uint32_t i = 0; i < size; ++i) {
+    unsorted_data[i] = (i * 7919) % 1000;
+    sorted_data[i] = i / 1000;
+  }
+  NumericStorage unsorted(unsorted_data.data(), size, ColumnType::kInt64);
+  NumericStorage sorted(sorted_data.data(), size, ColumnType::kInt64, true);
+  SimpleColumn unsorted_col{OverlaysVec(), &unsorted};
+  SimpleColumn sorted_col{OverlaysVec(), &sorted};
+
+  std::vector<std::pair<SimpleColumn, Constraint>> filters{
+      {unsorted_col, Constraint{0, FilterOp::kLt, SqlValue::Long(10)}},
+      {unsorted_col, Constraint{0, FilterOp::kEq, SqlValue::Long(5000)}},
+      {sorted_col, Constraint{0, FilterOp::kGe, SqlValue::Long(300)}},
+      {sorted_col, Constraint{0, FilterOp::kEq, SqlValue::Long(5000)}},
+  };
+  for (const auto& [col, c] : filters) {
+    RowMap expected(0, size);
+    QueryExecutor::BoundedColumnFilterForTesting(c, col, &expected);
+
+    QueryExecutor::SetSearchThreadCount(3);
+    RowMap rm(0, size);
+    QueryExecutor::BoundedColumnFilterForTesting(c, col, &rm);
+    QueryExecutor::SetSearchThreadCount(0);
+
+    ASSERT_EQ(rm.size(), expected.size());
+    for (uint32_t i = 0; i < rm.size(); ++i) {
+      ASSERT_EQ(rm.Get(i), expected.Get(i));
+    }
+  }
+}
+
 TEST(QueryExecutor, BinarySearchIsNull) {
   std::vector<int64_t> storage_data{0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
   NumericStorage storage(storage_data.data(), 10, ColumnType::kInt64, true);
@@ -445,6 +482,52 @@ TEST(QueryExecutor, StringBinarySearchIsNull) {
   ASSERT_EQ(res.Get(0), 2u);
 }
 
+TEST(QueryExecutor, SortWithNullAndArrangement) {
+  std::vector<int64_t> storage_data{0, 1, 2, 3, 0, 1, 2, 3};
+  NumericStorage storage(storage_data.data(), 8, ColumnType::kInt64);
+
+  // Current vector
+  // 0, 1, NULL, 2, 3, 0, NULL, NULL, 1, 2, 3, NULL
+  BitVector null_bv{1, 1, 0, 1, 1, 1, 0, 0, 1, 1, 1, 0};
+  NullOverlay null_overlay(&null_bv);
+
+  // Final vector
+  // 3, NULL, 0, 3, NULL, 1, 3
+  std::vector<uint32_t> arrangement{10, 2, 0, 4, 11, 1, 4};
+  ArrangementOverlay arrangement_overlay(&arrangement);
+
+  // Create the column.
+  OverlaysVec overlays_vec;
+  overlays_vec.emplace_back(&arrangement_overlay);
+  overlays_vec.emplace_back(&null_overlay);
+  SimpleColumn col{overlays_vec, &storage};
+  QueryExecutor exec({col}, 7);
+
+  RowMap asc = exec.Sort({Order{0, false}});
+  ASSERT_THAT(asc.GetAllIndices(), ElementsAre(1, 4, 2, 5, 0, 3, 6));
+
+  RowMap desc = exec.Sort({Order{0, true}});
+  ASSERT_THAT(desc.GetAllIndices(), ElementsAre(0, 3, 6, 5, 2, 1, 4));
+}
+
+TEST(QueryExecutor, SortMultipleColumns) {
+  std::vector<int64_t> numeric_data{1, 0, 1, 0, 1};
+  NumericStorage numeric_storage(numeric_data.data(), 5, ColumnType::kInt64);
+
+  StringPool pool;
+  std::vector<StringPool::Id> string_data{
+      pool.InternString("b"), pool.InternString("a"), StringPool::Id::Null(),
+      pool.InternString("c"), pool.InternString("a")};
+  StringStorage string_storage(&pool, string_data.data(), 5);
+
+  SimpleColumn numeric_col{OverlaysVec(), &numeric_storage};
+  SimpleColumn string_col{OverlaysVec(), &string_storage};
+  QueryExecutor exec({numeric_col, string_col}, 5);
+
+  RowMap res = exec.Sort({Order{0, false}, Order{1, true}});
+  ASSERT_THAT(res.GetAllIndices(), ElementsAre(3, 1, 0, 4, 2));
+}
+
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
 TEST(QueryExecutor, StringBinarySearchRegex) {
   StringPool pool;
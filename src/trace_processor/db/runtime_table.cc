@@ -32,15 +32,49 @@ T Fill(uint32_t leading_nulls, U value) {
   return res;
 }
 
+RuntimeTable::IntStorage ToNullable(
+    const RuntimeTable::NonNullIntStorage& ints) {
+  RuntimeTable::IntStorage res;
+  for (uint32_t i = 0; i < ints.size(); ++i) {
+    res.Append(ints.Get(i));
+  }
+  return res;
+}
+
 bool IsPerfectlyRepresentableAsDouble(int64_t res) {
   static constexpr int64_t kMaxDoubleRepresentible = 1ull << 53;
   return res >= -kMaxDoubleRepresentible && res <= kMaxDoubleRepresentible;
 }
 
+// Converts all the values of an integer column to doubles, failing if any of
+// them would lose precision.
+template <typename Ints>
+base::Status ToDoubles(const Ints& ints,
+                       const std::string& col_name,
+                       RuntimeTable::DoubleStorage* out) {
+  for (uint32_t i = 0; i < ints.size(); ++i) {
+    std::optional<int64_t> int_val = ints.Get(i);
+    if (!int_val) {
+      out->Append(std::nullopt);
+      continue;
+    }
+    if (!IsPerfectlyRepresentableAsDouble(*int_val)) {
+      return base::ErrStatus("Column %s contains %" PRId64
+                             " which cannot be represented as a double",
+                             col_name.c_str(), *int_val);
+    }
+    out->Append(static_cast<double>(*int_val));
+  }
+  return base::OkStatus();
+}
+
 }  // namespace
 
 RuntimeTable::RuntimeTable(StringPool* pool, std::vector<std::string> col_names)
-    : Table(pool), col_names_(col_names), storage_(col_names_.size()) {
+    : Table(pool),
+      col_names_(col_names),
+      storage_(col_names_.size()),
+      int_sorted_(col_names_.size(), true) {
   for (uint32_t i = 0; i < col_names.size(); i++)
     storage_[i] = std::make_unique<VariantStorage>();
 }
@@ -51,6 +85,10 @@ base::Status RuntimeTable::AddNull(uint32_t idx) {
   auto* col = storage_[idx].get();
   if (auto* leading_nulls = std::get_if<uint32_t>(col)) {
     (*leading_nulls)++;
+  } else if (auto* non_null_ints = std::get_if<NonNullIntStorage>(col)) {
+    IntStorage ints = ToNullable(*non_null_ints);
+    ints.Append(std::nullopt);
+    *col = std::move(ints);
   } else if (auto* ints = std::get_if<IntStorage>(col)) {
     ints->Append(std::nullopt);
   } else if (auto* strings = std::get_if<StringStorage>(col)) {
@@ -66,7 +104,18 @@ base::Status RuntimeTable::AddNull(uint32_t idx) {
 base::Status RuntimeTable::AddInteger(uint32_t idx, int64_t res) {
   auto* col = storage_[idx].get();
   if (auto* leading_nulls_ptr = std::get_if<uint32_t>(col)) {
-    *col = Fill<IntStorage>(*leading_nulls_ptr, std::nullopt);
+    if (*leading_nulls_ptr == 0) {
+      *col = NonNullIntStorage();
+    } else {
+      *col = Fill<IntStorage>(*leading_nulls_ptr, std::nullopt);
+    }
+  }
+  if (auto* non_null_ints = std::get_if<NonNullIntStorage>(col)) {
+    uint32_t size = non_null_ints->size();
+    if (size > 0 && non_null_ints->Get(size - 1) > res)
+      int_sorted_[idx] = false;
+    non_null_ints->Append(res);
+    return base::OkStatus();
   }
   if (auto* doubles = std::get_if<DoubleStorage>(col)) {
     if (!IsPerfectlyRepresentableAsDouble(res)) {
@@ -91,21 +140,13 @@ base::Status RuntimeTable::AddFloat(uint32_t idx, double res) {
   if (auto* leading_nulls_ptr = std::get_if<uint32_t>(col)) {
     *col = Fill<DoubleStorage>(*leading_nulls_ptr, std::nullopt);
   }
-  if (auto* ints = std::get_if<IntStorage>(col)) {
+  if (auto* non_null_ints = std::get_if<NonNullIntStorage>(col)) {
     DoubleStorage storage;
-    for (uint32_t i = 0; i < ints->size(); ++i) {
-      std::optional<int64_t> int_val = ints->Get(i);
-      if (!int_val) {
-        storage.Append(std::nullopt);
-        continue;
-      }
-      if (int_val && !IsPerfectlyRepresentableAsDouble(*int_val)) {
-        return base::ErrStatus("Column %s contains %" PRId64
-                               " which cannot be represented as a double",
-                               col_names_[idx].c_str(), *int_val);
-      }
-      storage.Append(static_cast<double>(*int_val));
-    }
+    RETURN_IF_ERROR(ToDoubles(*non_null_ints, col_names_[idx], &storage));
+    *col = std::move(storage);
+  } else if (auto* ints = std::get_if<IntStorage>(col)) {
+    DoubleStorage storage;
+    RETURN_IF_ERROR(ToDoubles(*ints, col_names_[idx], &storage));
     *col = std::move(storage);
   }
   auto* doubles = std::get_if<DoubleStorage>(col);
@@ -139,7 +180,14 @@ base::Status RuntimeTable::AddColumnsAndOverlays(uint32_t rows) {
       PERFETTO_CHECK(*leading_nulls == rows);
       *col = Fill<IntStorage>(*leading_nulls, std::nullopt);
     }
-    if (auto* ints = std::get_if<IntStorage>(col)) {
+    if (auto* non_null_ints = std::get_if<NonNullIntStorage>(col)) {
+      PERFETTO_CHECK(non_null_ints->size() == rows);
+      uint32_t flags = Column::Flag::kNonNull;
+      if (int_sorted_[i])
+        flags |= Column::Flag::kSorted;
+      columns_.push_back(
+          Column(col_names_[i].c_str(), non_null_ints, flags, this, i, 0));
+    } else if (auto* ints = std::get_if<IntStorage>(col)) {
       PERFETTO_CHECK(ints->size() == rows);
       columns_.push_back(Column(col_names_[i].c_str(), ints,
                                 Column::Flag::kNoFlag, this, i, 0));
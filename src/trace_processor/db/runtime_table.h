@@ -35,11 +35,17 @@ namespace trace_processor {
 // where the schema of the table is decided at runtime.
 class RuntimeTable : public Table {
  public:
+  // Integer columns start as NonNullIntStorage, which doesn't need a null
+  // bitvector, and are only moved to IntStorage when the first null is added.
+  using NonNullIntStorage = ColumnStorage<int64_t>;
   using IntStorage = ColumnStorage<std::optional<int64_t>>;
   using StringStorage = ColumnStorage<StringPool::Id>;
   using DoubleStorage = ColumnStorage<std::optional<double>>;
-  using VariantStorage =
-      std::variant<uint32_t, IntStorage, StringStorage, DoubleStorage>;
+  using VariantStorage = std::variant<uint32_t,
+                                      NonNullIntStorage,
+                                      IntStorage,
+                                      StringStorage,
+                                      DoubleStorage>;
 
   RuntimeTable(StringPool* pool, std::vector<std::string> col_names);
   ~RuntimeTable() override;
@@ -57,6 +63,11 @@ class RuntimeTable : public Table {
  private:
   std::vector<std::string> col_names_;
   std::vector<std::unique_ptr<VariantStorage>> storage_;
+
+  // Whether the values added so far to each NonNullIntStorage column are in
+  // ascending order. Such columns are marked as sorted, which allows filtering
+  // them with a binary search.
+  std::vector<bool> int_sorted_;
 };
 
 }  // namespace trace_processor
@@ -55,6 +55,43 @@ TEST_F(RuntimeTableTest, IntThenDouble) {
   ASSERT_EQ(col.Get(1).AsDouble(), 1.3);
 }
 
+TEST_F(RuntimeTableTest, SortedInts) {
+  ASSERT_TRUE(table_.AddInteger(0, 1).ok());
+  ASSERT_TRUE(table_.AddInteger(0, 1).ok());
+  ASSERT_TRUE(table_.AddInteger(0, 5).ok());
+  ASSERT_TRUE(table_.AddColumnsAndOverlays(3).ok());
+
+  const auto& col = table_.columns()[0];
+  ASSERT_TRUE(col.IsSorted());
+  ASSERT_FALSE(col.IsNullable());
+  ASSERT_EQ(col.Get(2).AsLong(), 5);
+}
+
+TEST_F(RuntimeTableTest, UnsortedInts) {
+  ASSERT_TRUE(table_.AddInteger(0, 5).ok());
+  ASSERT_TRUE(table_.AddInteger(0, 1).ok());
+  ASSERT_TRUE(table_.AddColumnsAndOverlays(2).ok());
+
+  const auto& col = table_.columns()[0];
+  ASSERT_FALSE(col.IsSorted());
+  ASSERT_FALSE(col.IsNullable());
+}
+
+TEST_F(RuntimeTableTest, IntThenNull) {
+  ASSERT_TRUE(table_.AddInteger(0, 1).ok());
+  ASSERT_TRUE(table_.AddInteger(0, 2).ok());
+  ASSERT_TRUE(table_.AddNull(0).ok());
+  ASSERT_TRUE(table_.AddInteger(0, 3).ok());
+  ASSERT_TRUE(table_.AddColumnsAndOverlays(4).ok());
+
+  const auto& col = table_.columns()[0];
+  ASSERT_FALSE(col.IsSorted());
+  ASSERT_TRUE(col.IsNullable());
+  ASSERT_EQ(col.Get(1).AsLong(), 2);
+  ASSERT_TRUE(col.Get(2).is_null());
+  ASSERT_EQ(col.Get(3).AsLong(), 3);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -0,0 +1,427 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/storage/bit_packed_storage.h"
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "perfetto/base/logging.h"
+#include "src/trace_processor/containers/bit_vector.h"
+#include "src/trace_processor/containers/row_map.h"
+#include "src/trace_processor/tp_metatrace.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace storage {
+namespace {
+
+static_assert(BitPackedStorage::kBlockSize % BitVector::kBitsInWord == 0,
+              "Blocks must be made of complete BitVector words");
+
+// Number of words a block takes for each bit of its bit width.
+constexpr uint32_t kWordsPerBlockBit =
+    BitPackedStorage::kBlockSize / BitVector::kBitsInWord;
+
+// Result of comparing a value with the bounds of a block.
+enum class BlockMatch {
+  kNone,
+  kAll,
+  kSome,
+};
+
+// Returns whether none, all or some of the elements in [min, max] match |op|
+// and |val|.
+BlockMatch MatchBlock(int64_t min, int64_t max, FilterOp op, int64_t val) {
+  switch (op) {
+    case FilterOp::kEq:
+      if (val < min || val > max)
+        return BlockMatch::kNone;
+      return min == max ? BlockMatch::kAll : BlockMatch::kSome;
+    case FilterOp::kNe:
+      if (val < min || val > max)
+        return BlockMatch::kAll;
+      return min == max ? BlockMatch::kNone : BlockMatch::kSome;
+    case FilterOp::kLt:
+      if (max < val)
+        return BlockMatch::kAll;
+      return min >= val ? BlockMatch::kNone : BlockMatch::kSome;
+    case FilterOp::kLe:
+      if (max <= val)
+        return BlockMatch::kAll;
+      return min > val ? BlockMatch::kNone : BlockMatch::kSome;
+    case FilterOp::kGt:
+      if (min > val)
+        return BlockMatch::kAll;
+      return max <= val ? BlockMatch::kNone : BlockMatch::kSome;
+    case FilterOp::kGe:
+      if (min >= val)
+        return BlockMatch::kAll;
+      return max < val ? BlockMatch::kNone : BlockMatch::kSome;
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+      PERFETTO_FATAL("Illegal argument");
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+// Calls |fn| with the std comparator matching |op|.
+template <typename Fn>
+void DispatchComparator(FilterOp op, Fn fn) {
+  switch (op) {
+    case FilterOp::kEq:
+      return fn(std::equal_to<int64_t>());
+    case FilterOp::kNe:
+      return fn(std::not_equal_to<int64_t>());
+    case FilterOp::kLt:
+      return fn(std::less<int64_t>());
+    case FilterOp::kLe:
+      return fn(std::less_equal<int64_t>());
+    case FilterOp::kGt:
+      return fn(std::greater<int64_t>());
+    case FilterOp::kGe:
+      return fn(std::greater_equal<int64_t>());
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+      PERFETTO_FATAL("Illegal argument");
+  }
+}
+
+// Returns the first position in [start, end) for which |is_after| is true,
+// assuming |is_after| is false up to some position and true afterwards.
+template <typename IsAfter>
+uint32_t PartitionPoint(uint32_t start, uint32_t end, IsAfter is_after) {
+  while (start < end) {
+    uint32_t mid = start + (end - start) / 2;
+    if (is_after(mid)) {
+      end = mid;
+    } else {
+      start = mid + 1;
+    }
+  }
+  return start;
+}
+
+}  // namespace
+
+BitPackedStorage::BitPackedStorage(const int64_t* data,
+                                   uint32_t size,
+                                   bool is_sorted)
+    : size_(size), is_sorted_(is_sorted) {
+  uint32_t block_count = (size + kBlockSize - 1) / kBlockSize;
+  blocks_.reserve(block_count);
+  for (uint32_t b = 0; b < block_count; ++b) {
+    const int64_t* start = data + b * kBlockSize;
+    uint32_t count = std::min(kBlockSize, size - b * kBlockSize);
+    auto min_max = std::minmax_element(start, start + count);
+
+    Block block;
+    block.min = *min_max.first;
+    block.max = *min_max.second;
+    block.word_offset = static_cast<uint32_t>(words_.size());
+
+    // Compute the differences as unsigned to avoid overflowing when the block
+    // spans most of the int64 range.
+    uint64_t max_delta = static_cast<uint64_t>(block.max) -
+                         static_cast<uint64_t>(block.min);
+    uint8_t width = 0;
+    while (width < 64 && (max_delta >> width) != 0)
+      width++;
+    block.bit_width = width;
+    blocks_.push_back(block);
+
+    // Elements past the end of the last block are left as zeros.
+    words_.resize(words_.size() + width * kWordsPerBlockBit);
+    if (width == 0)
+      continue;
+
+    uint64_t* words = &words_[block.word_offset];
+    for (uint32_t i = 0; i < count; ++i) {
+      uint64_t delta =
+          static_cast<uint64_t>(start[i]) - static_cast<uint64_t>(block.min);
+      uint32_t bit = i * width;
+      uint32_t word = bit / 64;
+      uint32_t shift = bit % 64;
+      words[word] |= delta << shift;
+      if (shift + width > 64)
+        words[word + 1] |= delta >> (64 - shift);
+    }
+  }
+  words_.shrink_to_fit();
+}
+
+BitPackedStorage::~BitPackedStorage() = default;
+
+BitPackedStorage::BitPackedStorage(BitPackedStorage&&) noexcept = default;
+BitPackedStorage& BitPackedStorage::operator=(BitPackedStorage&&) noexcept =
+    default;
+
+int64_t BitPackedStorage::Get(uint32_t idx) const {
+  PERFETTO_DCHECK(idx < size_);
+  const Block& block = blocks_[idx / kBlockSize];
+  uint32_t width = block.bit_width;
+  if (width == 0)
+    return block.min;
+
+  const uint64_t* words = &words_[block.word_offset];
+  uint32_t bit = (idx % kBlockSize) * width;
+  uint32_t word = bit / 64;
+  uint32_t shift = bit % 64;
+  uint64_t delta = words[word] >> shift;
+  if (shift + width > 64)
+    delta |= words[word + 1] << (64 - shift);
+  if (width < 64)
+    delta &= (1ull << width) - 1;
+  return static_cast<int64_t>(static_cast<uint64_t>(block.min) + delta);
+}
+
+void BitPackedStorage::DecodeBlock(uint32_t block_idx, int64_t* out) const {
+  const Block& block = blocks_[block_idx];
+  uint32_t width = block.bit_width;
+  if (width == 0) {
+    std::fill(out, out + kBlockSize, block.min);
+    return;
+  }
+
+  const uint64_t* words = &words_[block.word_offset];
+  uint64_t mask = width == 64 ? ~0ull : (1ull << width) - 1;
+  auto min = static_cast<uint64_t>(block.min);
+  for (uint32_t i = 0; i < kBlockSize; ++i) {
+    uint32_t bit = i * width;
+    uint32_t word = bit / 64;
+    uint32_t shift = bit % 64;
+    uint64_t delta = words[word] >> shift;
+    if (shift + width > 64)
+      delta |= words[word + 1] << (64 - shift);
+    out[i] = static_cast<int64_t>(min + (delta & mask));
+  }
+}
+
+size_t BitPackedStorage::size_bytes() const {
+  return blocks_.size() * sizeof(Block) + words_.size() * sizeof(uint64_t);
+}
+
+RangeOrBitVector BitPackedStorage::Search(FilterOp op,
+                                          SqlValue value,
+                                          RowMap::Range range) const {
+  if (op == FilterOp::kIsNotNull)
+    return RangeOrBitVector(range);
+
+  if (value.is_null() || op == FilterOp::kIsNull || op == FilterOp::kGlob ||
+      op == FilterOp::kRegex) {
+    return RangeOrBitVector(RowMap::Range());
+  }
+
+  int64_t val = value.AsLong();
+  if (is_sorted_ && op != FilterOp::kNe)
+    return RangeOrBitVector(BinarySearchIntrinsic(op, val, range));
+  return RangeOrBitVector(LinearSearch(op, val, range));
+}
+
+RangeOrBitVector BitPackedStorage::IndexSearch(FilterOp op,
+                                               SqlValue value,
+                                               uint32_t* indices,
+                                               uint32_t indices_count,
+                                               bool sorted) const {
+  if (op == FilterOp::kIsNotNull)
+    return RangeOrBitVector(RowMap::Range(0, indices_count));
+
+  if (value.is_null() || op == FilterOp::kIsNull || op == FilterOp::kGlob ||
+      op == FilterOp::kRegex) {
+    return RangeOrBitVector(RowMap::Range());
+  }
+
+  int64_t val = value.AsLong();
+  if (sorted && op != FilterOp::kNe) {
+    return RangeOrBitVector(
+        BinarySearchExtrinsic(op, val, indices, indices_count));
+  }
+  return RangeOrBitVector(IndexSearch(op, val, indices, indices_count));
+}
+
+BitVector BitPackedStorage::LinearSearch(FilterOp op,
+                                         int64_t val,
+                                         RowMap::Range range) const {
+  PERFETTO_TP_TRACE(metatrace::Category::DB, "BitPackedStorage::LinearSearch",
+                    [&range, op](metatrace::Record* r) {
+                      r->AddArg("Start", std::to_string(range.start));
+                      r->AddArg("End", std::to_string(range.end));
+                      r->AddArg("Op",
+                                std::to_string(static_cast<uint32_t>(op)));
+                    });
+
+  BitVector::Builder builder(range.end, range.start);
+  int64_t decoded[kBlockSize];
+  DispatchComparator(op, [&](auto comparator) {
+    uint32_t i = range.start;
+    while (i < range.end) {
+      uint32_t block_idx = i / kBlockSize;
+      uint32_t block_start = block_idx * kBlockSize;
+      uint32_t block_end = std::min(block_start + kBlockSize, range.end);
+      const Block& block = blocks_[block_idx];
+
+      BlockMatch match = MatchBlock(block.min, block.max, op, val);
+      if (match == BlockMatch::kSome)
+        DecodeBlock(block_idx, decoded);
+
+      // Blocks start on a word boundary so only the first and last blocks of
+      // the range can have partial words.
+      while (i < block_end) {
+        if (i % BitVector::kBitsInWord == 0 &&
+            i + BitVector::kBitsInWord <= block_end) {
+          uint64_t word;
+          if (match == BlockMatch::kSome) {
+            word = 0;
+            const int64_t* cur = &decoded[i - block_start];
+            for (uint32_t k = 0; k < BitVector::kBitsInWord; ++k) {
+              word |= static_cast<uint64_t>(comparator(cur[k], val)) << k;
+            }
+          } else {
+            word = match == BlockMatch::kAll ? ~0ull : 0ull;
+          }
+          builder.AppendWord(word);
+          i += BitVector::kBitsInWord;
+          continue;
+        }
+        builder.Append(match == BlockMatch::kSome
+                           ? comparator(decoded[i - block_start], val)
+                           : match == BlockMatch::kAll);
+        i++;
+      }
+    }
+  });
+  return std::move(builder).Build();
+}
+
+BitVector BitPackedStorage::IndexSearch(FilterOp op,
+                                        int64_t val,
+                                        const uint32_t* indices,
+                                        uint32_t indices_count) const {
+  PERFETTO_TP_TRACE(metatrace::Category::DB, "BitPackedStorage::IndexSearch",
+                    [indices_count, op](metatrace::Record* r) {
+                      r->AddArg("Count", std::to_string(indices_count));
+                      r->AddArg("Op",
+                                std::to_string(static_cast<uint32_t>(op)));
+                    });
+
+  BitVector::Builder builder(indices_count);
+  DispatchComparator(op, [&](auto comparator) {
+    for (uint32_t i = 0; i < indices_count; ++i) {
+      builder.Append(comparator(Get(indices[i]), val));
+    }
+  });
+  return std::move(builder).Build();
+}
+
+RowMap::Range BitPackedStorage::BinarySearchIntrinsic(
+    FilterOp op,
+    int64_t val,
+    RowMap::Range search_range) const {
+  auto lower = [&]() {
+    return PartitionPoint(search_range.start, search_range.end,
+                          [&](uint32_t i) { return Get(i) >= val; });
+  };
+  auto upper = [&]() {
+    return PartitionPoint(search_range.start, search_range.end,
+                          [&](uint32_t i) { return Get(i) > val; });
+  };
+  switch (op) {
+    case FilterOp::kEq:
+      return RowMap::Range(lower(), upper());
+    case FilterOp::kLe:
+      return RowMap::Range(search_range.start, upper());
+    case FilterOp::kLt:
+      return RowMap::Range(search_range.start, lower());
+    case FilterOp::kGe:
+      return RowMap::Range(lower(), search_range.end);
+    case FilterOp::kGt:
+      return RowMap::Range(upper(), search_range.end);
+    case FilterOp::kNe:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+      return RowMap::Range();
+  }
+  return RowMap::Range();
+}
+
+RowMap::Range BitPackedStorage::BinarySearchExtrinsic(
+    FilterOp op,
+    int64_t val,
+    const uint32_t* indices,
+    uint32_t indices_count) const {
+  auto lower = [&]() {
+    return PartitionPoint(0, indices_count,
+                          [&](uint32_t i) { return Get(indices[i]) >= val; });
+  };
+  auto upper = [&]() {
+    return PartitionPoint(0, indices_count,
+                          [&](uint32_t i) { return Get(indices[i]) > val; });
+  };
+  switch (op) {
+    case FilterOp::kEq:
+      return RowMap::Range(lower(), upper());
+    case FilterOp::kLe:
+      return RowMap::Range(0, upper());
+    case FilterOp::kLt:
+      return RowMap::Range(0, lower());
+    case FilterOp::kGe:
+      return RowMap::Range(lower(), indices_count);
+    case FilterOp::kGt:
+      return RowMap::Range(upper(), indices_count);
+    case FilterOp::kNe:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+      return RowMap::Range();
+  }
+  return RowMap::Range();
+}
+
+void BitPackedStorage::StableSort(uint32_t* rows, uint32_t rows_size) const {
+  // Decode every value once up front rather than in each comparison.
+  std::vector<std::pair<int64_t, uint32_t>> values(rows_size);
+  for (uint32_t i = 0; i < rows_size; ++i)
+    values[i] = std::make_pair(Get(rows[i]), rows[i]);
+  std::stable_sort(values.begin(), values.end(),
+                   [](const std::pair<int64_t, uint32_t>& a,
+                      const std::pair<int64_t, uint32_t>& b) {
+                     return a.first < b.first;
+                   });
+  for (uint32_t i = 0; i < rows_size; ++i)
+    rows[i] = values[i].second;
+}
+
+void BitPackedStorage::Sort(uint32_t* rows, uint32_t rows_size) const {
+  std::vector<std::pair<int64_t, uint32_t>> values(rows_size);
+  for (uint32_t i = 0; i < rows_size; ++i)
+    values[i] = std::make_pair(Get(rows[i]), rows[i]);
+  std::sort(values.begin(), values.end());
+  for (uint32_t i = 0; i < rows_size; ++i)
+    rows[i] = values[i].second;
+}
+
+}  // namespace storage
+}  // namespace trace_processor
+}  // namespace perfetto
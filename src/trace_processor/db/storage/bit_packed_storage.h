@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SRC_TRACE_PROCESSOR_DB_STORAGE_BIT_PACKED_STORAGE_H_
+#define SRC_TRACE_PROCESSOR_DB_STORAGE_BIT_PACKED_STORAGE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "src/trace_processor/db/storage/storage.h"
+#include "src/trace_processor/db/storage/types.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace storage {
+
+// Storage for int64 data compressed with frame of reference bit packing.
+//
+// Values are split in blocks of |kBlockSize| elements. Each block stores its
+// minimum and maximum and, for every element, the difference from the minimum
+// packed in just enough bits to represent the largest difference. Columns
+// whose values are close together (e.g. timestamps and durations) compress
+// very well: sorted timestamps typically only need 16-24 bits per element.
+//
+// Searches first compare the value with the bounds of each block: blocks where
+// all or none of the elements match are answered without decoding them.
+class BitPackedStorage final : public Storage {
+ public:
+  // Number of elements in a block. A multiple of the number of bits in a
+  // BitVector word so that blocks can be searched a word at a time.
+  static constexpr uint32_t kBlockSize = 128;
+
+  // Encodes the |size| elements pointed to by |data|. If |is_sorted| is true,
+  // |data| must be sorted in ascending order.
+  BitPackedStorage(const int64_t* data, uint32_t size, bool is_sorted = false);
+  ~BitPackedStorage() override;
+
+  BitPackedStorage(BitPackedStorage&&) noexcept;
+  BitPackedStorage& operator=(BitPackedStorage&&) noexcept;
+
+  RangeOrBitVector Search(FilterOp op,
+                          SqlValue value,
+                          RowMap::Range range) const override;
+
+  RangeOrBitVector IndexSearch(FilterOp op,
+                               SqlValue value,
+                               uint32_t* indices,
+                               uint32_t indices_count,
+                               bool sorted) const override;
+
+  void StableSort(uint32_t* rows, uint32_t rows_size) const override;
+
+  void Sort(uint32_t* rows, uint32_t rows_size) const override;
+
+  uint32_t size() const override { return size_; }
+
+  // Returns the element at |idx|.
+  int64_t Get(uint32_t idx) const;
+
+  // Returns the number of bytes used to store the encoded data.
+  size_t size_bytes() const;
+
+ private:
+  struct Block {
+    int64_t min;
+    int64_t max;
+
+    // Index of the first word of the block in |words_|. Each block takes
+    // |bit_width| * |kBlockSize| / 64 words.
+    uint32_t word_offset;
+    uint8_t bit_width;
+  };
+
+  // Decodes all the elements of the block |block_idx| into |out|, which must
+  // have space for |kBlockSize| elements.
+  void DecodeBlock(uint32_t block_idx, int64_t* out) const;
+
+  BitVector LinearSearch(FilterOp op, int64_t val, RowMap::Range) const;
+
+  BitVector IndexSearch(FilterOp op,
+                        int64_t val,
+                        const uint32_t* indices,
+                        uint32_t indices_count) const;
+
+  RowMap::Range BinarySearchIntrinsic(FilterOp op,
+                                      int64_t val,
+                                      RowMap::Range search_range) const;
+
+  RowMap::Range BinarySearchExtrinsic(FilterOp op,
+                                      int64_t val,
+                                      const uint32_t* indices,
+                                      uint32_t indices_count) const;
+
+  std::vector<Block> blocks_;
+  std::vector<uint64_t> words_;
+  uint32_t size_ = 0;
+  bool is_sorted_ = false;
+};
+
+}  // namespace storage
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_STORAGE_BIT_PACKED_STORAGE_H_
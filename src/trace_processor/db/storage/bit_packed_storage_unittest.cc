@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "src/trace_processor/db/storage/bit_packed_storage.h"
+
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "src/trace_processor/db/storage/numeric_storage.h"
+#include "src/trace_processor/db/storage/types.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace storage {
+namespace {
+
+using Range = RowMap::Range;
+
+// Returns the rows matched by |res| as a BitVector of |size| elements.
+BitVector ToBitVector(RangeOrBitVector res, uint32_t size) {
+  if (res.IsBitVector()) {
+    BitVector bv = std::move(res).TakeIfBitVector();
+    bv.Resize(size, false);
+    return bv;
+  }
+  Range range = std::move(res).TakeIfRange();
+  BitVector bv(size, false);
+  for (uint32_t i = range.start; i < range.end; ++i)
+    bv.Set(i);
+  return bv;
+}
+
+// Checks Search() and IndexSearch() with every comparison op against
+// NumericStorage on the same data.
+void CheckAgainstNumeric(const std::vector<int64_t>& data,
+                         bool is_sorted,
+                         int64_t val) {
+  const auto size = static_cast<uint32_t>(data.size());
+  BitPackedStorage packed(data.data(), size, is_sorted);
+  NumericStorage numeric(data.data(), size, ColumnType::kInt64, is_sorted);
+
+  std::vector<uint32_t> indices(size);
+  std::iota(indices.begin(), indices.end(), 0);
+  if (!is_sorted) {
+    std::shuffle(indices.begin(), indices.end(), std::minstd_rand0(42));
+  }
+
+  const Range range(5, size - 3);
+  for (FilterOp op : {FilterOp::kEq, FilterOp::kNe, FilterOp::kLt,
+                      FilterOp::kLe, FilterOp::kGt, FilterOp::kGe}) {
+    // NumericStorage doesn't support not equal constraints on sorted data.
+    if (is_sorted && op == FilterOp::kNe)
+      continue;
+
+    SqlValue sql_val = SqlValue::Long(val);
+    BitVector expected = ToBitVector(numeric.Search(op, sql_val, range), size);
+    BitVector actual = ToBitVector(packed.Search(op, sql_val, range), size);
+    for (uint32_t i = 0; i < size; ++i) {
+      ASSERT_EQ(actual.IsSet(i), expected.IsSet(i))
+          << "op: " << static_cast<int>(op) << " row: " << i;
+    }
+
+    BitVector expected_idx = ToBitVector(
+        numeric.IndexSearch(op, sql_val, indices.data(), size, is_sorted),
+        size);
+    BitVector actual_idx = ToBitVector(
+        packed.IndexSearch(op, sql_val, indices.data(), size, is_sorted), size);
+    for (uint32_t i = 0; i < size; ++i) {
+      ASSERT_EQ(actual_idx.IsSet(i), expected_idx.IsSet(i))
+          << "op: " << static_cast<int>(op) << " index: " << i;
+    }
+  }
+}
+
+TEST(BitPackedStorage, Get) {
+  std::vector<int64_t> data;
+  std::minstd_rand0 rnd(0);
+  for (uint32_t i = 0; i < 1000; ++i) {
+    // Mix blocks with different widths, including extreme values.
+    if (i < 128) {
+      data.push_back(7);
+    } else if (i < 256) {
+      data.push_back(i % 2 ? std::numeric_limits<int64_t>::max()
+                           : std::numeric_limits<int64_t>::min());
+    } else {
+      data.push_back(static_cast<int64_t>(rnd()) - (1ll << 30));
+    }
+  }
+  BitPackedStorage storage(data.data(), static_cast<uint32_t>(data.size()));
+  ASSERT_EQ(storage.size(), data.size());
+  for (uint32_t i = 0; i < data.size(); ++i) {
+    ASSERT_EQ(storage.Get(i), data[i]) << i;
+  }
+}
+
+TEST(BitPackedStorage, SearchUnsorted) {
+  std::vector<int64_t> data;
+  std::minstd_rand0 rnd(1);
+  for (uint32_t i = 0; i < 1000; ++i) {
+    // Make the first blocks constant so that they can be answered without
+    // decoding.
+    data.push_back(i < 256 ? 50 : static_cast<int64_t>(rnd() % 100));
+  }
+  for (int64_t val : {-1, 0, 50, 99, 100}) {
+    CheckAgainstNumeric(data, false, val);
+  }
+}
+
+TEST(BitPackedStorage, SearchSorted) {
+  std::vector<int64_t> data;
+  int64_t ts = 1000000;
+  std::minstd_rand0 rnd(2);
+  for (uint32_t i = 0; i < 1000; ++i) {
+    ts += static_cast<int64_t>(rnd() % 3);
+    data.push_back(ts);
+  }
+  for (int64_t val : {int64_t(0), data[0], data[500], data[999], ts + 1}) {
+    CheckAgainstNumeric(data, true, val);
+  }
+}
+
+TEST(BitPackedStorage, SearchNull) {
+  std::vector<int64_t> data(200, 1);
+  BitPackedStorage storage(data.data(), 200);
+
+  Range range = storage.Search(FilterOp::kIsNotNull, SqlValue(), Range(0, 200))
+                    .TakeIfRange();
+  ASSERT_EQ(range.size(), 200u);
+
+  range = storage.Search(FilterOp::kEq, SqlValue(), Range(0, 200))
+              .TakeIfRange();
+  ASSERT_EQ(range.size(), 0u);
+}
+
+TEST(BitPackedStorage, Sort) {
+  std::vector<int64_t> data;
+  std::minstd_rand0 rnd(3);
+  for (uint32_t i = 0; i < 1000; ++i) {
+    data.push_back(static_cast<int64_t>(rnd() % 50));
+  }
+  BitPackedStorage storage(data.data(), static_cast<uint32_t>(data.size()));
+
+  std::vector<uint32_t> rows(data.size());
+  std::iota(rows.begin(), rows.end(), 0);
+  std::vector<uint32_t> expected = rows;
+  std::stable_sort(
+      expected.begin(), expected.end(),
+      [&data](uint32_t a, uint32_t b) { return data[a] < data[b]; });
+
+  storage.StableSort(rows.data(), static_cast<uint32_t>(rows.size()));
+  ASSERT_EQ(rows, expected);
+
+  std::shuffle(rows.begin(), rows.end(), rnd);
+  storage.Sort(rows.data(), static_cast<uint32_t>(rows.size()));
+  for (uint32_t i = 1; i < rows.size(); ++i) {
+    ASSERT_LE(data[rows[i - 1]], data[rows[i]]);
+  }
+}
+
+TEST(BitPackedStorage, CompressesTimestamps) {
+  // Timestamps around a microsecond apart should need far fewer than 64 bits
+  // per element.
+  std::vector<int64_t> data;
+  int64_t ts = 1000000000000;
+  std::minstd_rand0 rnd(4);
+  for (uint32_t i = 0; i < 100000; ++i) {
+    ts += static_cast<int64_t>(rnd() % 1000);
+    data.push_back(ts);
+  }
+  BitPackedStorage storage(data.data(), static_cast<uint32_t>(data.size()),
+                           true);
+  ASSERT_LT(storage.size_bytes() * 3, data.size() * sizeof(int64_t));
+}
+
+}  // namespace
+}  // namespace storage
+}  // namespace trace_processor
+}  // namespace perfetto
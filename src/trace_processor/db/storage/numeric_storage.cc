@@ -16,13 +16,21 @@
  */
 
 #include "src/trace_processor/db/storage/numeric_storage.h"
+
+#include <limits>
 #include <string>
+
+#include "perfetto/base/build_config.h"
 #include "src/trace_processor/containers/bit_vector.h"
 #include "src/trace_processor/containers/row_map.h"
 #include "src/trace_processor/db/storage/types.h"
 #include "src/trace_processor/db/storage/utils.h"
 #include "src/trace_processor/tp_metatrace.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+#include <immintrin.h>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 namespace storage {
@@ -73,6 +81,14 @@ inline std::optional<NumericValue> GetNumericTypeVariant(ColumnType type,
   PERFETTO_FATAL("For GCC");
 }
 
+// Returns a NumericValue holding the C++ type backing |type|: can be used in
+// std::visit to dispatch on the type of the data.
+inline NumericValue GetNumericTypeTag(ColumnType type) {
+  SqlValue zero = type == ColumnType::kDouble ? SqlValue::Double(0)
+                                              : SqlValue::Long(0);
+  return *GetNumericTypeVariant(type, zero);
+}
+
 // Fetch std binary comparator class based on FilterOp. Can be used in
 // std::visit for comparison.
 template <typename T>
@@ -163,11 +179,209 @@ uint32_t UpperBoundExtrinsic(const void* data,
       val);
 }
 
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+// AVX2 kernels comparing 64 values at a time against a constant and packing
+// the results straight into a BitVector word. The CPU support for these is
+// checked at startup (see CheckCpuOptimizations() in base/utils.cc).
+namespace simd {
+
+// AVX2 only has "equal" and "greater than" comparisons for integers: the
+// remaining ops are computed by swapping the operands and/or negating the
+// resulting word.
+enum class IntOp { kEq, kGt, kLt };
+
+inline __m256i Splat(int64_t val) {
+  return _mm256_set1_epi64x(val);
+}
+inline __m256i Splat(int32_t val) {
+  return _mm256_set1_epi32(val);
+}
+inline __m256i Splat(uint32_t val) {
+  return _mm256_set1_epi32(static_cast<int32_t>(val));
+}
+
+inline __m256i Load(const void* ptr) {
+  return _mm256_loadu_si256(static_cast<const __m256i*>(ptr));
+}
+
+inline __m256i Gather(const int64_t* data, const uint32_t* idx) {
+  __m128i i = _mm_loadu_si128(reinterpret_cast<const __m128i*>(idx));
+  return _mm256_i32gather_epi64(reinterpret_cast<const long long*>(data), i,
+                                sizeof(int64_t));
+}
+inline __m256i Gather(const int32_t* data, const uint32_t* idx) {
+  return _mm256_i32gather_epi32(reinterpret_cast<const int*>(data), Load(idx),
+                                sizeof(int32_t));
+}
+inline __m256i Gather(const uint32_t* data, const uint32_t* idx) {
+  return _mm256_i32gather_epi32(reinterpret_cast<const int*>(data), Load(idx),
+                                sizeof(uint32_t));
+}
+
+template <IntOp kOp>
+inline __m256i Compare(__m256i a, __m256i b, int64_t) {
+  if (kOp == IntOp::kEq)
+    return _mm256_cmpeq_epi64(a, b);
+  return kOp == IntOp::kGt ? _mm256_cmpgt_epi64(a, b)
+                           : _mm256_cmpgt_epi64(b, a);
+}
+template <IntOp kOp>
+inline __m256i Compare(__m256i a, __m256i b, int32_t) {
+  if (kOp == IntOp::kEq)
+    return _mm256_cmpeq_epi32(a, b);
+  return kOp == IntOp::kGt ? _mm256_cmpgt_epi32(a, b)
+                           : _mm256_cmpgt_epi32(b, a);
+}
+template <IntOp kOp>
+inline __m256i Compare(__m256i a, __m256i b, uint32_t) {
+  if (kOp == IntOp::kEq)
+    return _mm256_cmpeq_epi32(a, b);
+  // Flipping the sign bit maps unsigned order onto signed order.
+  const __m256i bias = _mm256_set1_epi32(std::numeric_limits<int32_t>::min());
+  return Compare<kOp>(_mm256_xor_si256(a, bias), _mm256_xor_si256(b, bias),
+                      int32_t());
+}
+
+inline uint64_t MoveMask(__m256i mask, int64_t) {
+  return static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(mask)));
+}
+inline uint64_t MoveMask(__m256i mask, int32_t) {
+  return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(mask)));
+}
+inline uint64_t MoveMask(__m256i mask, uint32_t) {
+  return MoveMask(mask, int32_t());
+}
+
+template <typename T, IntOp kOp, bool kNegate>
+struct IntWordComparator {
+  static constexpr uint32_t kLanes = sizeof(__m256i) / sizeof(T);
+
+  uint64_t operator()(const T* data, T val) const {
+    const __m256i v = Splat(val);
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < BitVector::kBitsInWord; i += kLanes) {
+      __m256i mask = Compare<kOp>(Load(data + i), v, T());
+      word |= MoveMask(mask, T()) << i;
+    }
+    return kNegate ? ~word : word;
+  }
+
+  uint64_t operator()(const T* data, const uint32_t* indices, T val) const {
+    const __m256i v = Splat(val);
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < BitVector::kBitsInWord; i += kLanes) {
+      __m256i mask = Compare<kOp>(Gather(data, indices + i), v, T());
+      word |= MoveMask(mask, T()) << i;
+    }
+    return kNegate ? ~word : word;
+  }
+};
+
+// Doubles need the ordered (or, for kNe, unordered) predicates rather than
+// negation to match the std:: comparators on NaNs.
+template <int kPredicate>
+struct DoubleWordComparator {
+  static constexpr uint32_t kLanes = sizeof(__m256d) / sizeof(double);
+
+  uint64_t operator()(const double* data, double val) const {
+    const __m256d v = _mm256_set1_pd(val);
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < BitVector::kBitsInWord; i += kLanes) {
+      __m256d mask = _mm256_cmp_pd(_mm256_loadu_pd(data + i), v, kPredicate);
+      word |= static_cast<uint64_t>(static_cast<uint32_t>(
+                  _mm256_movemask_pd(mask)))
+              << i;
+    }
+    return word;
+  }
+
+  uint64_t operator()(const double* data,
+                      const uint32_t* indices,
+                      double val) const {
+    const __m256d v = _mm256_set1_pd(val);
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < BitVector::kBitsInWord; i += kLanes) {
+      __m128i idx =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i));
+      __m256d vals = _mm256_i32gather_pd(data, idx, sizeof(double));
+      __m256d mask = _mm256_cmp_pd(vals, v, kPredicate);
+      word |= static_cast<uint64_t>(static_cast<uint32_t>(
+                  _mm256_movemask_pd(mask)))
+              << i;
+    }
+    return word;
+  }
+};
+
+// Calls |fn| with the std:: comparator for |op| and the word comparator
+// computing the same comparison 64 values at a time.
+template <typename T, typename Fn>
+void DispatchWordComparator(T, FilterOp op, Fn fn) {
+  switch (op) {
+    case FilterOp::kEq:
+      return fn(std::equal_to<T>(), IntWordComparator<T, IntOp::kEq, false>());
+    case FilterOp::kNe:
+      return fn(std::not_equal_to<T>(),
+                IntWordComparator<T, IntOp::kEq, true>());
+    case FilterOp::kLe:
+      return fn(std::less_equal<T>(), IntWordComparator<T, IntOp::kGt, true>());
+    case FilterOp::kLt:
+      return fn(std::less<T>(), IntWordComparator<T, IntOp::kLt, false>());
+    case FilterOp::kGt:
+      return fn(std::greater<T>(), IntWordComparator<T, IntOp::kGt, false>());
+    case FilterOp::kGe:
+      return fn(std::greater_equal<T>(),
+                IntWordComparator<T, IntOp::kLt, true>());
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kIsNull:
+      PERFETTO_DFATAL("Illegal argument");
+  }
+}
+
+template <typename Fn>
+void DispatchWordComparator(double, FilterOp op, Fn fn) {
+  switch (op) {
+    case FilterOp::kEq:
+      return fn(std::equal_to<double>(),
+                DoubleWordComparator<_CMP_EQ_OQ>());
+    case FilterOp::kNe:
+      return fn(std::not_equal_to<double>(),
+                DoubleWordComparator<_CMP_NEQ_UQ>());
+    case FilterOp::kLe:
+      return fn(std::less_equal<double>(),
+                DoubleWordComparator<_CMP_LE_OQ>());
+    case FilterOp::kLt:
+      return fn(std::less<double>(), DoubleWordComparator<_CMP_LT_OQ>());
+    case FilterOp::kGt:
+      return fn(std::greater<double>(), DoubleWordComparator<_CMP_GT_OQ>());
+    case FilterOp::kGe:
+      return fn(std::greater_equal<double>(),
+                DoubleWordComparator<_CMP_GE_OQ>());
+    case FilterOp::kGlob:
+    case FilterOp::kRegex:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kIsNull:
+      PERFETTO_DFATAL("Illegal argument");
+  }
+}
+
+}  // namespace simd
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+
 template <typename T>
 void TypedLinearSearch(T typed_val,
                        const T* start,
                        FilterOp op,
                        BitVector::Builder& builder) {
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+  simd::DispatchWordComparator(
+      typed_val, op, [&](auto comparator, auto word_comparator) {
+        utils::LinearSearchWithWordComparator(typed_val, start, comparator,
+                                              word_comparator, builder);
+      });
+#else
   switch (op) {
     case FilterOp::kEq:
       return utils::LinearSearchWithComparator(typed_val, start,
@@ -193,6 +407,7 @@ void TypedLinearSearch(T typed_val,
     case FilterOp::kIsNull:
       PERFETTO_DFATAL("Illegal argument");
   }
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
 }
 
 }  // namespace
@@ -277,6 +492,20 @@ BitVector NumericStorage::IndexSearch(FilterOp op,
       [this, indices, op, &builder](auto val) {
         using T = decltype(val);
         auto* start = static_cast<const T*>(data_);
+#if PERFETTO_BUILDFLAG(PERFETTO_X64_CPU_OPT)
+        // AVX2 gathers take signed 32-bit indices.
+        constexpr auto kMaxGatherIndex =
+            static_cast<uint32_t>(std::numeric_limits<int32_t>::max());
+        if (size_ <= kMaxGatherIndex) {
+          simd::DispatchWordComparator(
+              val, op, [&](auto comparator, auto word_comparator) {
+                utils::IndexSearchWithWordComparator(val, start, indices,
+                                                     comparator,
+                                                     word_comparator, builder);
+              });
+          return;
+        }
+#endif
         std::visit(
             [start, indices, val, &builder](auto comparator) {
               utils::IndexSearchWithComparator(val, start, indices, comparator,
@@ -367,7 +596,7 @@ RowMap::Range NumericStorage::BinarySearchExtrinsic(
 }
 
 void NumericStorage::StableSort(uint32_t* rows, uint32_t rows_size) const {
-  NumericValue val = *GetNumericTypeVariant(type_, SqlValue::Long(0));
+  NumericValue val = GetNumericTypeTag(type_);
   std::visit(
       [this, &rows, rows_size](auto val_data) {
         using T = decltype(val_data);
@@ -382,7 +611,19 @@ void NumericStorage::StableSort(uint32_t* rows, uint32_t rows_size) const {
       val);
 }
 
-void NumericStorage::Sort(uint32_t*, uint32_t) const {}
+void NumericStorage::Sort(uint32_t* rows, uint32_t rows_size) const {
+  NumericValue val = GetNumericTypeTag(type_);
+  std::visit(
+      [this, &rows, rows_size](auto val_data) {
+        using T = decltype(val_data);
+        const T* typed_start = static_cast<const T*>(data_);
+        std::sort(rows, rows + rows_size,
+                  [typed_start](uint32_t a_idx, uint32_t b_idx) {
+                    return typed_start[a_idx] < typed_start[b_idx];
+                  });
+      },
+      val);
+}
 
 }  // namespace storage
 }  // namespace trace_processor
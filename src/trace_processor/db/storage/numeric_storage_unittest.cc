@@ -15,6 +15,11 @@
  */
 #include "src/trace_processor/db/storage/numeric_storage.h"
 
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
 #include "src/trace_processor/db/storage/types.h"
 #include "test/gtest_and_gmock.h"
 
@@ -25,6 +30,54 @@ namespace {
 
 using Range = RowMap::Range;
 
+// Checks Search() and IndexSearch() with every comparison op against a naive
+// evaluation. Uses enough rows that both the per-bit and the per-word paths
+// are exercised.
+template <typename T>
+void CheckAllOpsAgainstNaive(const std::vector<T>& data,
+                             ColumnType type,
+                             SqlValue sql_val,
+                             T val) {
+  const uint32_t size = static_cast<uint32_t>(data.size());
+  NumericStorage storage(data.data(), size, type);
+
+  std::vector<uint32_t> indices;
+  for (uint32_t i = 0; i < size; i += 3)
+    indices.push_back((i * 7) % size);
+
+  const Range range(5, size - 3);
+  std::vector<std::pair<FilterOp, std::function<bool(T)>>> ops = {
+      {FilterOp::kEq, [val](T x) { return x == val; }},
+      {FilterOp::kNe, [val](T x) { return x != val; }},
+      {FilterOp::kLt, [val](T x) { return x < val; }},
+      {FilterOp::kLe, [val](T x) { return x <= val; }},
+      {FilterOp::kGt, [val](T x) { return x > val; }},
+      {FilterOp::kGe, [val](T x) { return x >= val; }},
+  };
+  for (const auto& op_and_fn : ops) {
+    FilterOp op = op_and_fn.first;
+    const auto& fn = op_and_fn.second;
+
+    BitVector bv = storage.Search(op, sql_val, range).TakeIfBitVector();
+    for (uint32_t i = 0; i < size; ++i) {
+      bool expected = i >= range.start && i < range.end && fn(data[i]);
+      ASSERT_EQ(i < bv.size() && bv.IsSet(i), expected)
+          << "op: " << static_cast<int>(op) << " row: " << i;
+    }
+
+    BitVector index_bv =
+        storage
+            .IndexSearch(op, sql_val, indices.data(),
+                         static_cast<uint32_t>(indices.size()), false)
+            .TakeIfBitVector();
+    ASSERT_EQ(index_bv.size(), indices.size());
+    for (uint32_t i = 0; i < indices.size(); ++i) {
+      ASSERT_EQ(index_bv.IsSet(i), fn(data[indices[i]]))
+          << "op: " << static_cast<int>(op) << " index: " << i;
+    }
+  }
+}
+
 TEST(NumericStorageUnittest, StableSortTrivial) {
   std::vector<uint32_t> data_vec{0, 1, 2, 0, 1, 2, 0, 1, 2};
   std::vector<uint32_t> out = {0, 1, 2, 3, 4, 5, 6, 7, 8};
@@ -49,6 +102,23 @@ TEST(NumericStorageUnittest, StableSort) {
   ASSERT_EQ(out, stable_out);
 }
 
+TEST(NumericStorageUnittest, SortDouble) {
+  std::vector<double> data_vec{0.5, -1.5, 0.5, 2.0, -1.5};
+  NumericStorage storage(data_vec.data(), 5, ColumnType::kDouble);
+
+  std::vector<uint32_t> stable_out = {0, 1, 2, 3, 4};
+  storage.StableSort(stable_out.data(), 5);
+  ASSERT_EQ(stable_out, std::vector<uint32_t>({1, 4, 0, 2, 3}));
+
+  std::vector<uint32_t> out = {4, 3, 2, 1, 0};
+  storage.Sort(out.data(), 5);
+  ASSERT_EQ(data_vec[out[0]], -1.5);
+  ASSERT_EQ(data_vec[out[1]], -1.5);
+  ASSERT_EQ(data_vec[out[2]], 0.5);
+  ASSERT_EQ(data_vec[out[3]], 0.5);
+  ASSERT_EQ(out[4], 3u);
+}
+
 TEST(NumericStorageUnittest, CompareFast) {
   std::vector<uint32_t> data_vec(128);
   std::iota(data_vec.begin(), data_vec.end(), 0);
@@ -133,6 +203,42 @@ TEST(NumericStorageUnittest, CompareSortedIndexesEqual) {
   ASSERT_EQ(range.end, 7u);
 }
 
+TEST(NumericStorageUnittest, CompareAllOpsUint32) {
+  // Values above INT32_MAX check that unsigned ordering is preserved.
+  std::vector<uint32_t> data(300);
+  for (uint32_t i = 0; i < data.size(); ++i)
+    data[i] = (i % 7) * 0x30000000u;
+  CheckAllOpsAgainstNaive<uint32_t>(data, ColumnType::kUint32,
+                                    SqlValue::Long(0x90000000ll),
+                                    0x90000000u);
+}
+
+TEST(NumericStorageUnittest, CompareAllOpsInt32) {
+  std::vector<int32_t> data(300);
+  for (uint32_t i = 0; i < data.size(); ++i)
+    data[i] = static_cast<int32_t>(i % 11) - 5;
+  CheckAllOpsAgainstNaive<int32_t>(data, ColumnType::kInt32,
+                                   SqlValue::Long(-2), -2);
+}
+
+TEST(NumericStorageUnittest, CompareAllOpsInt64) {
+  std::vector<int64_t> data(300);
+  for (uint32_t i = 0; i < data.size(); ++i)
+    data[i] = (static_cast<int64_t>(i % 13) - 6) * (1ll << 40);
+  CheckAllOpsAgainstNaive<int64_t>(data, ColumnType::kInt64,
+                                   SqlValue::Long(1ll << 40), 1ll << 40);
+}
+
+TEST(NumericStorageUnittest, CompareAllOpsDouble) {
+  std::vector<double> data(300);
+  for (uint32_t i = 0; i < data.size(); ++i) {
+    data[i] = i % 17 == 0 ? std::numeric_limits<double>::quiet_NaN()
+                          : static_cast<double>(i % 5) - 1.5;
+  }
+  CheckAllOpsAgainstNaive<double>(data, ColumnType::kDouble,
+                                  SqlValue::Double(0.5), 0.5);
+}
+
 }  // namespace
 }  // namespace storage
 }  // namespace trace_processor
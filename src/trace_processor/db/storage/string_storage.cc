@@ -15,6 +15,9 @@
  */
 
 #include "src/trace_processor/db/storage/string_storage.h"
+
+#include <optional>
+
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/status_or.h"
 #include "perfetto/ext/base/string_utils.h"
@@ -79,22 +82,6 @@ struct Glob {
   const StringPool* pool_;
 };
 
-struct GlobFullStringPool {
-  GlobFullStringPool(StringPool* pool, util::GlobMatcher& matcher)
-      : pool_(pool), matches_(pool->MaxSmallStringId().raw_id()) {
-    PERFETTO_DCHECK(!pool->HasLargeString());
-    for (auto it = pool->CreateIterator(); it; ++it) {
-      auto id = it.StringId();
-      matches_[id.raw_id()] = matcher.Matches(pool->Get(id));
-    }
-  }
-  bool operator()(StringPool::Id rhs, StringPool::Id) {
-    return matches_[rhs.raw_id()];
-  }
-  StringPool* pool_;
-  std::vector<uint8_t> matches_;
-};
-
 struct Regex {
   bool operator()(StringPool::Id rhs, regex::Regex& pattern) const {
     return rhs != StringPool::Id::Null() &&
@@ -103,23 +90,85 @@ struct Regex {
   const StringPool* pool_;
 };
 
-struct RegexFullStringPool {
-  RegexFullStringPool(StringPool* pool, const regex::Regex& regex)
-      : pool_(pool), matches_(pool->MaxSmallStringId().raw_id()) {
-    PERFETTO_DCHECK(!pool->HasLargeString());
+// Evaluates |comparator| once for every distinct string in the pool and
+// stores the results in a bitmap keyed by StringPool::Id. Searching a column
+// then costs one lookup per row instead of fetching and comparing a string.
+class DictionaryMatches {
+ public:
+  template <typename Comparator, typename ValType>
+  DictionaryMatches(const StringPool* pool,
+                    Comparator comparator,
+                    ValType& val)
+      : small_matches_(pool->MaxSmallStringId().raw_id() / 64 + 1) {
     for (auto it = pool->CreateIterator(); it; ++it) {
-      auto id = it.StringId();
-      matches_[id.raw_id()] =
-          id != StringPool::Id::Null() && regex.Search(pool_->Get(id).c_str());
+      StringPool::Id id = it.StringId();
+      bool match = comparator(id, val);
+      if (id.is_large_string()) {
+        PERFETTO_DCHECK(id.large_string_index() == large_matches_.size());
+        large_matches_.push_back(match);
+        continue;
+      }
+      small_matches_[id.raw_id() / 64] |= static_cast<uint64_t>(match)
+                                          << (id.raw_id() % 64);
     }
   }
-  bool operator()(StringPool::Id rhs, StringPool::Id) {
-    return matches_[rhs.raw_id()];
+
+  bool operator()(StringPool::Id id, StringPool::Id) const {
+    if (PERFETTO_UNLIKELY(id.is_large_string()))
+      return large_matches_[id.large_string_index()];
+    return (small_matches_[id.raw_id() / 64] >> (id.raw_id() % 64)) & 1;
   }
-  StringPool* pool_;
-  std::vector<uint8_t> matches_;
+
+ private:
+  std::vector<uint64_t> small_matches_;
+  std::vector<uint8_t> large_matches_;
 };
 
+// Building the dictionary touches every string in the pool once so it only
+// pays off when at least as many rows as there are distinct strings are
+// going to be compared.
+bool ShouldUseDictionary(const StringPool* pool, uint32_t rows) {
+  return rows >= pool->size();
+}
+
+// Runs |comparator| against every row starting at |start|, going through a
+// DictionaryMatches if |use_dictionary| is true.
+template <typename Comparator, typename ValType>
+void LinearSearchString(const StringPool* pool,
+                        bool use_dictionary,
+                        ValType val,
+                        const StringPool::Id* start,
+                        Comparator comparator,
+                        BitVector::Builder& builder) {
+  if (use_dictionary) {
+    utils::LinearSearchWithComparator(StringPool::Id::Null(), start,
+                                      DictionaryMatches(pool, comparator, val),
+                                      builder);
+    return;
+  }
+  utils::LinearSearchWithComparator(std::move(val), start,
+                                    std::move(comparator), builder);
+}
+
+// Same as LinearSearchString but for the rows at |indices|.
+template <typename Comparator, typename ValType>
+void IndexSearchString(const StringPool* pool,
+                       bool use_dictionary,
+                       ValType val,
+                       const StringPool::Id* start,
+                       const uint32_t* indices,
+                       Comparator comparator,
+                       BitVector::Builder& builder) {
+  if (use_dictionary) {
+    utils::IndexSearchWithComparator(StringPool::Id::Null(), start, indices,
+                                     DictionaryMatches(pool, comparator, val),
+                                     builder);
+    return;
+  }
+  utils::IndexSearchWithComparator(std::move(val), start, indices,
+                                   std::move(comparator), builder);
+}
+
 struct IsNull {
   bool operator()(StringPool::Id rhs, StringPool::Id) const {
     return rhs == StringPool::Id::Null();
@@ -147,10 +196,23 @@ RangeOrBitVector StringStorage::Search(FilterOp op,
     return RangeOrBitVector(Range());
   }
 
-  StringPool::Id val =
+  // The value is only looked up in the pool, never interned: searches must
+  // not mutate the pool as they can run on several threads at once.
+  std::optional<StringPool::Id> id =
       (op == FilterOp::kIsNull || op == FilterOp::kIsNotNull)
           ? StringPool::Id::Null()
-          : string_pool_->InternString(base::StringView(sql_val.AsString()));
+          : string_pool_->GetId(base::StringView(sql_val.AsString()));
+
+  // No row is equal to a string missing from the pool. For the other
+  // operations, the null id gives the right results as it's never equal to a
+  // non-null row.
+  if (!id && op == FilterOp::kEq) {
+    return RangeOrBitVector(Range());
+  }
+  StringPool::Id val = id.value_or(StringPool::Id::Null());
+  NullTermStringView str_val = sql_val.type == SqlValue::kString
+                                   ? NullTermStringView(sql_val.AsString())
+                                   : NullTermStringView();
   const StringPool::Id* start = data_ + range.start;
   PERFETTO_TP_TRACE(
       metatrace::Category::DB, "StringStorage::Search",
@@ -163,6 +225,9 @@ RangeOrBitVector StringStorage::Search(FilterOp op,
                                 : "NULL");
       });
 
+  // Comparisons which need the string contents are evaluated once per
+  // distinct string rather than once per row when the range is large.
+  bool use_dictionary = ShouldUseDictionary(string_pool_, range.size());
   BitVector::Builder builder(range.end, range.start);
   switch (op) {
     case FilterOp::kEq:
@@ -173,20 +238,20 @@ RangeOrBitVector StringStorage::Search(FilterOp op,
       utils::LinearSearchWithComparator(val, start, NotEqual(), builder);
       break;
     case FilterOp::kLe:
-      utils::LinearSearchWithComparator(string_pool_->Get(val), start,
-                                        LessEqual{string_pool_}, builder);
+      LinearSearchString(string_pool_, use_dictionary, str_val, start,
+                         LessEqual{string_pool_}, builder);
       break;
     case FilterOp::kLt:
-      utils::LinearSearchWithComparator(string_pool_->Get(val), start,
-                                        Less{string_pool_}, builder);
+      LinearSearchString(string_pool_, use_dictionary, str_val, start,
+                         Less{string_pool_}, builder);
       break;
     case FilterOp::kGt:
-      utils::LinearSearchWithComparator(string_pool_->Get(val), start,
-                                        Greater{string_pool_}, builder);
+      LinearSearchString(string_pool_, use_dictionary, str_val, start,
+                         Greater{string_pool_}, builder);
       break;
     case FilterOp::kGe:
-      utils::LinearSearchWithComparator(string_pool_->Get(val), start,
-                                        GreaterEqual{string_pool_}, builder);
+      LinearSearchString(string_pool_, use_dictionary, str_val, start,
+                         GreaterEqual{string_pool_}, builder);
       break;
     case FilterOp::kGlob: {
       util::GlobMatcher matcher =
@@ -195,23 +260,14 @@ RangeOrBitVector StringStorage::Search(FilterOp op,
       // If glob pattern doesn't involve any special characters, the function
       // called should be equality.
       if (matcher.IsEquality()) {
-        utils::LinearSearchWithComparator(
-            val, start, std::equal_to<StringPool::Id>(), builder);
+        if (id) {
+          utils::LinearSearchWithComparator(
+              val, start, std::equal_to<StringPool::Id>(), builder);
+        }
         break;
       }
-
-      // For very big string pools (or small ranges) or pools with large strings
-      // run a standard glob function.
-      if (range.size() < string_pool_->size() ||
-          string_pool_->HasLargeString()) {
-        utils::LinearSearchWithComparator(std::move(matcher), start,
-                                          Glob{string_pool_}, builder);
-        break;
-      }
-
-      utils::LinearSearchWithComparator(
-          StringPool::Id::Null(), start,
-          GlobFullStringPool{string_pool_, matcher}, builder);
+      LinearSearchString(string_pool_, use_dictionary, std::move(matcher),
+                         start, Glob{string_pool_}, builder);
       break;
     }
     case FilterOp::kRegex: {
@@ -219,18 +275,9 @@ RangeOrBitVector StringStorage::Search(FilterOp op,
       base::StatusOr<regex::Regex> regex =
           regex::Regex::Create(sql_val.AsString());
       PERFETTO_CHECK(regex.status().ok());
-
-      // For very big string pools (or small ranges) or pools with large
-      // strings run a standard regex function.
-      if (range.size() < string_pool_->size() ||
-          string_pool_->HasLargeString()) {
-        utils::LinearSearchWithComparator(std::move(regex.value()), start,
-                                          Regex{string_pool_}, builder);
-        break;
-      }
-      utils::LinearSearchWithComparator(
-          StringPool::Id::Null(), start,
-          RegexFullStringPool{string_pool_, regex.value()}, builder);
+      LinearSearchString(string_pool_, use_dictionary,
+                         std::move(regex.value()), start, Regex{string_pool_},
+                         builder);
       break;
     }
     case FilterOp::kIsNull:
@@ -252,10 +299,23 @@ RangeOrBitVector StringStorage::IndexSearch(FilterOp op,
       (op != FilterOp::kIsNotNull && op != FilterOp::kIsNull)) {
     return RangeOrBitVector(Range());
   }
-  StringPool::Id val =
+  // The value is only looked up in the pool, never interned: searches must
+  // not mutate the pool as they can run on several threads at once.
+  std::optional<StringPool::Id> id =
       (op == FilterOp::kIsNull || op == FilterOp::kIsNotNull)
           ? StringPool::Id::Null()
-          : string_pool_->InternString(base::StringView(sql_val.AsString()));
+          : string_pool_->GetId(base::StringView(sql_val.AsString()));
+
+  // No row is equal to a string missing from the pool. For the other
+  // operations, the null id gives the right results as it's never equal to a
+  // non-null row.
+  if (!id && op == FilterOp::kEq) {
+    return RangeOrBitVector(Range());
+  }
+  StringPool::Id val = id.value_or(StringPool::Id::Null());
+  NullTermStringView str_val = sql_val.type == SqlValue::kString
+                                   ? NullTermStringView(sql_val.AsString())
+                                   : NullTermStringView();
   const StringPool::Id* start = data_;
   PERFETTO_TP_TRACE(
       metatrace::Category::DB, "StringStorage::IndexSearch",
@@ -267,6 +327,7 @@ RangeOrBitVector StringStorage::IndexSearch(FilterOp op,
                                 : "NULL");
       });
 
+  bool use_dictionary = ShouldUseDictionary(string_pool_, indices_size);
   BitVector::Builder builder(indices_size);
 
   switch (op) {
@@ -279,38 +340,40 @@ RangeOrBitVector StringStorage::IndexSearch(FilterOp op,
                                        builder);
       break;
     case FilterOp::kLe:
-      utils::IndexSearchWithComparator(string_pool_->Get(val), start, indices,
-                                       LessEqual{string_pool_}, builder);
+      IndexSearchString(string_pool_, use_dictionary, str_val, start,
+                        indices, LessEqual{string_pool_}, builder);
       break;
     case FilterOp::kLt:
-      utils::IndexSearchWithComparator(string_pool_->Get(val), start, indices,
-                                       Less{string_pool_}, builder);
+      IndexSearchString(string_pool_, use_dictionary, str_val, start,
+                        indices, Less{string_pool_}, builder);
       break;
     case FilterOp::kGt:
-      utils::IndexSearchWithComparator(string_pool_->Get(val), start, indices,
-                                       Greater{string_pool_}, builder);
+      IndexSearchString(string_pool_, use_dictionary, str_val, start,
+                        indices, Greater{string_pool_}, builder);
       break;
     case FilterOp::kGe:
-      utils::IndexSearchWithComparator(string_pool_->Get(val), start, indices,
-                                       GreaterEqual{string_pool_}, builder);
+      IndexSearchString(string_pool_, use_dictionary, str_val, start,
+                        indices, GreaterEqual{string_pool_}, builder);
       break;
     case FilterOp::kGlob: {
       util::GlobMatcher matcher =
           util::GlobMatcher::FromPattern(sql_val.AsString());
       if (matcher.IsEquality()) {
-        utils::IndexSearchWithComparator(
-            val, start, indices, std::equal_to<StringPool::Id>(), builder);
+        if (id) {
+          utils::IndexSearchWithComparator(
+              val, start, indices, std::equal_to<StringPool::Id>(), builder);
+        }
         break;
       }
-      utils::IndexSearchWithComparator(std::move(matcher), start, indices,
-                                       Glob{string_pool_}, builder);
+      IndexSearchString(string_pool_, use_dictionary, std::move(matcher), start,
+                        indices, Glob{string_pool_}, builder);
       break;
     }
     case FilterOp::kRegex: {
       base::StatusOr<regex::Regex> regex =
           regex::Regex::Create(sql_val.AsString());
-      utils::IndexSearchWithComparator(std::move(regex.value()), start, indices,
-                                       Regex{string_pool_}, builder);
+      IndexSearchString(string_pool_, use_dictionary, std::move(regex.value()),
+                        start, indices, Regex{string_pool_}, builder);
       break;
     }
     case FilterOp::kIsNull:
@@ -334,16 +397,14 @@ RowMap::Range StringStorage::BinarySearchExtrinsic(FilterOp,
 void StringStorage::StableSort(uint32_t* indices, uint32_t indices_size) const {
   std::stable_sort(indices, indices + indices_size,
                    [this](uint32_t a_idx, uint32_t b_idx) {
-                     return string_pool_->Get(data_[a_idx]) <
-                            string_pool_->Get(data_[b_idx]);
+                     return IsLess(data_[a_idx], data_[b_idx]);
                    });
 }
 
 void StringStorage::Sort(uint32_t* indices, uint32_t indices_size) const {
   std::sort(indices, indices + indices_size,
             [this](uint32_t a_idx, uint32_t b_idx) {
-              return string_pool_->Get(data_[a_idx]) <
-                     string_pool_->Get(data_[b_idx]);
+              return IsLess(data_[a_idx], data_[b_idx]);
             });
 }
 
@@ -59,6 +59,14 @@ class StringStorage final : public Storage {
                                       uint32_t*,
                                       uint32_t) const;
 
+  // Orders strings as SQLite does: null before any other string (including
+  // the empty string).
+  bool IsLess(StringPool::Id a, StringPool::Id b) const {
+    if (a.is_null() || b.is_null())
+      return a.is_null() && !b.is_null();
+    return string_pool_->Get(a) < string_pool_->Get(b);
+  }
+
   const StringPool::Id* data_ = nullptr;
   const uint32_t size_ = 0;
 
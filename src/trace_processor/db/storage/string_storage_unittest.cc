@@ -253,6 +253,66 @@ TEST(StringStorageUnittest, IndexSearchEq) {
   ASSERT_EQ(bv.IndexOfNthSet(0), 5u);
 }
 
+TEST(StringStorageUnittest, SearchDictionaryMatchesPerRow) {
+  std::vector<std::string> strings{"cheese",  "pasta", "pizza",
+                                   "pierogi", "onion", "fries"};
+  std::vector<StringPool::Id> ids;
+  StringPool pool;
+  for (const auto& string : strings) {
+    ids.push_back(pool.InternString(base::StringView(string)));
+  }
+  ids.push_back(StringPool::Id::Null());
+  // Strings which don't fit in a string pool block are stored separately.
+  std::string large(32 * 1024 * 1024, 'z');
+  large[0] = 'p';
+  ids.push_back(pool.InternString(base::StringView(large)));
+  ASSERT_TRUE(pool.HasLargeString());
+
+  // Repeat the ids so that ranges cover more rows than there are strings in
+  // the pool.
+  std::vector<StringPool::Id> data;
+  for (uint32_t i = 0; i < 4; ++i) {
+    data.insert(data.end(), ids.begin(), ids.end() - 1);
+    data.insert(data.begin() + (i * 7) % data.size(), ids.back());
+  }
+  auto size = static_cast<uint32_t>(data.size());
+  StringStorage storage(&pool, data.data(), size);
+
+  std::vector<uint32_t> indices;
+  for (uint32_t i = size; i > 0; --i) {
+    indices.push_back(i - 1);
+  }
+
+  std::vector<std::pair<FilterOp, SqlValue>> filters{
+      {FilterOp::kLt, SqlValue::String("pasta")},
+      {FilterOp::kLe, SqlValue::String("pasta")},
+      {FilterOp::kGt, SqlValue::String("pasta")},
+      {FilterOp::kGe, SqlValue::String("pasta")},
+      {FilterOp::kGlob, SqlValue::String("p*")},
+      {FilterOp::kGlob, SqlValue::String("*i*")},
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+      {FilterOp::kRegex, SqlValue::String("^p.*[az]$")},
+#endif
+  };
+  for (const auto& [op, val] : filters) {
+    BitVector bv = storage.Search(op, val, Range(0, size)).TakeIfBitVector();
+    BitVector idx_bv =
+        storage.IndexSearch(op, val, indices.data(), size).TakeIfBitVector();
+    ASSERT_EQ(bv.size(), size);
+    ASSERT_EQ(idx_bv.size(), size);
+
+    // Single row ranges are smaller than the pool so take the per-row
+    // comparison path.
+    for (uint32_t i = 0; i < size; ++i) {
+      bool expected = storage.Search(op, val, Range(i, i + 1))
+                          .TakeIfBitVector()
+                          .CountSetBits() == 1;
+      ASSERT_EQ(bv.IsSet(i), expected) << i;
+      ASSERT_EQ(idx_bv.IsSet(size - 1 - i), expected) << i;
+    }
+  }
+}
+
 }  // namespace
 }  // namespace storage
 }  // namespace trace_processor
@@ -83,6 +83,64 @@ void IndexSearchWithComparator(ValType val,
   }
 }
 
+// Like LinearSearchWithComparator but the fast path is computed by
+// |word_comparator|, which compares the 64 consecutive elements starting at
+// its first argument against |val| and returns the results packed in a
+// BitVector word.
+template <typename Comparator,
+          typename WordComparator,
+          typename ValType,
+          typename DataType>
+void LinearSearchWithWordComparator(ValType val,
+                                    const DataType* data_ptr,
+                                    Comparator comparator,
+                                    WordComparator word_comparator,
+                                    BitVector::Builder& builder) {
+  const DataType* cur_val = data_ptr;
+  uint32_t front_elements = builder.BitsUntilWordBoundaryOrFull();
+  for (uint32_t i = 0; i < front_elements; ++i, ++cur_val) {
+    builder.Append(comparator(*cur_val, val));
+  }
+
+  uint32_t fast_path_elements = builder.BitsInCompleteWordsUntilFull();
+  for (uint32_t i = 0; i < fast_path_elements; i += BitVector::kBitsInWord) {
+    builder.AppendWord(word_comparator(cur_val, val));
+    cur_val += BitVector::kBitsInWord;
+  }
+
+  uint32_t back_elements = builder.BitsUntilFull();
+  for (uint32_t i = 0; i < back_elements; ++i, ++cur_val) {
+    builder.Append(comparator(*cur_val, val));
+  }
+}
+
+// Like IndexSearchWithComparator but the fast path is computed by
+// |word_comparator|, which is passed |data_ptr| and a pointer to the next 64
+// indices and returns the results of the comparisons packed in a BitVector
+// word.
+template <typename Comparator,
+          typename WordComparator,
+          typename ValType,
+          typename DataType>
+void IndexSearchWithWordComparator(ValType val,
+                                   const DataType* data_ptr,
+                                   const uint32_t* indices,
+                                   Comparator comparator,
+                                   WordComparator word_comparator,
+                                   BitVector::Builder& builder) {
+  const uint32_t* cur_idx = indices;
+  uint32_t fast_path_elements = builder.BitsInCompleteWordsUntilFull();
+  for (uint32_t i = 0; i < fast_path_elements; i += BitVector::kBitsInWord) {
+    builder.AppendWord(word_comparator(data_ptr, cur_idx, val));
+    cur_idx += BitVector::kBitsInWord;
+  }
+
+  uint32_t back_elements = builder.BitsUntilFull();
+  for (uint32_t i = 0; i < back_elements; ++i, ++cur_idx) {
+    builder.Append(comparator(*(data_ptr + *cur_idx), val));
+  }
+}
+
 }  // namespace utils
 
 }  // namespace storage
@@ -20,6 +20,7 @@ namespace perfetto {
 namespace trace_processor {
 
 bool Table::kUseFilterV2 = true;
+bool Table::kUseSortV2 = true;
 
 Table::Table() = default;
 Table::~Table() = default;
@@ -107,9 +108,13 @@ Table Table::Sort(const std::vector<Order>& od) const {
     // worthwhile. This also needs changes to the constraint modification logic
     // in DbSqliteTable which currently eliminates constraints on sorted
     // columns.
-    std::iota(idx.begin(), idx.end(), 0);
-    for (auto it = od.rbegin(); it != od.rend(); ++it) {
-      columns_[it->col_idx].StableSort(it->desc, &idx);
+    if (kUseSortV2) {
+      idx = QueryExecutor::SortLegacy(this, od).TakeAsIndexVector();
+    } else {
+      std::iota(idx.begin(), idx.end(), 0);
+      for (auto it = od.rbegin(); it != od.rend(); ++it) {
+        columns_[it->col_idx].StableSort(it->desc, &idx);
+      }
     }
   }
 
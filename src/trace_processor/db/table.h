@@ -93,11 +93,16 @@ class Table {
       bool is_sorted;
       bool is_hidden;
       bool is_set_id;
+
+      // Whether the column has an index created with CREATE PERFETTO INDEX.
+      // Only set by DbSqliteTable when planning queries.
+      bool is_indexed = false;
     };
     std::vector<Column> columns;
   };
 
   static bool kUseFilterV2;
+  static bool kUseSortV2;
 
   Table();
   virtual ~Table();
@@ -27,6 +27,7 @@
 #include <deque>
 #include <limits>
 #include <memory>
+#include <unordered_map>
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/string_splitter.h"
@@ -104,6 +105,8 @@ class JsonExporter {
         writer_(output, argument_filter, metadata_filter, label_filter) {}
 
   util::Status Export() {
+    storage_->DecodeLazyArgs();
+
     util::Status status = MapUniquePidsAndTids();
     if (!status.ok())
       return status;
@@ -182,21 +185,24 @@ class JsonExporter {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_begin_events_.push_back(event);
+      async_begin_events_.push_back(
+          {event["ts"].asInt64(), SerializeEvent(event)});
     }
 
     void AddAsyncInstantEvent(const Json::Value& event) {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_instant_events_.push_back(event);
+      async_instant_events_.push_back(
+          {event["ts"].asInt64(), SerializeEvent(event)});
     }
 
     void AddAsyncEndEvent(const Json::Value& event) {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_end_events_.push_back(event);
+      async_end_events_.push_back(
+          {event["ts"].asInt64(), SerializeEvent(event)});
     }
 
     void SortAndEmitAsyncEvents() {
@@ -212,8 +218,9 @@ class JsonExporter {
       // the same timestamp. To accomplish this, we perform a stable sort in
       // descending order and later iterate via reverse iterators.
       struct {
-        bool operator()(const Json::Value& a, const Json::Value& b) const {
-          return a["ts"].asInt64() > b["ts"].asInt64();
+        bool operator()(const SerializedEvent& a,
+                        const SerializedEvent& b) const {
+          return a.ts > b.ts;
         }
       } CompareEvents;
       std::stable_sort(async_end_events_.begin(), async_end_events_.end(),
@@ -232,25 +239,25 @@ class JsonExporter {
       auto has_begin_event = begin_event_it != async_begin_events_.end();
 
       auto emit_next_instant = [&instant_event_it, &has_instant_event, this]() {
-        DoWriteEvent(*instant_event_it);
+        WriteSerializedEvent(instant_event_it->json);
         instant_event_it++;
         has_instant_event = instant_event_it != async_instant_events_.end();
       };
       auto emit_next_end = [&end_event_it, &has_end_event, this]() {
-        DoWriteEvent(*end_event_it);
+        WriteSerializedEvent(end_event_it->json);
         end_event_it++;
         has_end_event = end_event_it != async_end_events_.rend();
       };
       auto emit_next_begin = [&begin_event_it, &has_begin_event, this]() {
-        DoWriteEvent(*begin_event_it);
+        WriteSerializedEvent(begin_event_it->json);
         begin_event_it++;
         has_begin_event = begin_event_it != async_begin_events_.end();
       };
 
       auto emit_next_instant_or_end = [&instant_event_it, &end_event_it,
                                        &emit_next_instant, &emit_next_end]() {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*end_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <=
+            end_event_it->ts) {
           emit_next_instant();
         } else {
           emit_next_end();
@@ -259,8 +266,8 @@ class JsonExporter {
       auto emit_next_instant_or_begin = [&instant_event_it, &begin_event_it,
                                          &emit_next_instant,
                                          &emit_next_begin]() {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*begin_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <=
+            begin_event_it->ts) {
           emit_next_instant();
         } else {
           emit_next_begin();
@@ -268,8 +275,8 @@ class JsonExporter {
       };
       auto emit_next_end_or_begin = [&end_event_it, &begin_event_it,
                                      &emit_next_end, &emit_next_begin]() {
-        if ((*end_event_it)["ts"].asInt64() <=
-            (*begin_event_it)["ts"].asInt64()) {
+        if (end_event_it->ts <=
+            begin_event_it->ts) {
           emit_next_end();
         } else {
           emit_next_begin();
@@ -278,8 +285,8 @@ class JsonExporter {
 
       // While we still have events in all iterators, consider each.
       while (has_instant_event && has_end_event && has_begin_event) {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*end_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <=
+            end_event_it->ts) {
           emit_next_instant_or_begin();
         } else {
           emit_next_end_or_begin();
@@ -461,11 +468,27 @@ class JsonExporter {
       output_->AppendString(ss.str());
     }
 
+    // An event which was serialized ahead of being written, e.g. while async
+    // events are buffered for sorting. Keeping the JSON text rather than the
+    // Json::Value tree keeps the buffered events several times smaller.
+    struct SerializedEvent {
+      int64_t ts;
+      std::string json;
+    };
+
     void DoWriteEvent(const Json::Value& event) {
-      std::ostringstream ss;
+      WriteSerializedEvent(SerializeEvent(event));
+    }
+
+    void WriteSerializedEvent(const std::string& json) {
       if (!first_event_)
-        ss << ",\n";
+        output_->AppendString(",\n");
+      first_event_ = false;
+      output_->AppendString(json);
+    }
 
+    std::string SerializeEvent(const Json::Value& event) {
+      std::ostringstream ss;
       ArgumentNameFilterPredicate argument_name_filter;
       bool strip_args =
           argument_filter_ &&
@@ -486,9 +509,7 @@ class JsonExporter {
       } else {
         writer_->write(event, &ss);
       }
-      first_event_ = false;
-
-      output_->AppendString(ss.str());
+      return ss.str();
     }
 
     OutputWriter* output_;
@@ -501,11 +522,15 @@ class JsonExporter {
     Json::Value metadata_;
     std::string system_trace_data_;
     std::string user_trace_data_;
-    std::vector<Json::Value> async_begin_events_;
-    std::vector<Json::Value> async_instant_events_;
-    std::vector<Json::Value> async_end_events_;
+    std::vector<SerializedEvent> async_begin_events_;
+    std::vector<SerializedEvent> async_instant_events_;
+    std::vector<SerializedEvent> async_end_events_;
   };
 
+  // Converts arg sets to JSON on demand, straight from the arg table, rather
+  // than materializing the JSON of every arg set of the trace upfront. Recently
+  // used arg sets (e.g. track and process args, which are looked up for many
+  // events) are cached up to |kMaxCachedArgSets|.
   class ArgsBuilder {
    public:
     explicit ArgsBuilder(const TraceStorage* storage)
@@ -514,29 +539,44 @@ class JsonExporter {
           nan_value_(Json::StaticString("NaN")),
           inf_value_(Json::StaticString("Infinity")),
           neg_inf_value_(Json::StaticString("-Infinity")) {
+      // The arg table is sorted by arg_set_id: record the first row of each
+      // arg set.
       const auto& arg_table = storage_->arg_table();
       uint32_t count = arg_table.row_count();
-      if (count == 0) {
-        args_sets_.resize(1, empty_value_);
-        return;
+      uint32_t set_count =
+          count == 0 ? 0 : arg_table.arg_set_id()[count - 1] + 1;
+      set_start_rows_.assign(set_count + 1, count);
+      for (uint32_t i = count; i > 0; --i)
+        set_start_rows_[arg_table.arg_set_id()[i - 1]] = i - 1;
+      for (uint32_t i = set_count; i > 0; --i) {
+        set_start_rows_[i - 1] =
+            std::min(set_start_rows_[i - 1], set_start_rows_[i]);
       }
-      args_sets_.resize(arg_table.arg_set_id()[count - 1] + 1, empty_value_);
-
-      for (uint32_t i = 0; i < count; ++i) {
-        ArgSetId set_id = arg_table.arg_set_id()[i];
-        const char* key = arg_table.key().GetString(i).c_str();
-        Variadic value = storage_->GetArgValue(i);
-        AppendArg(set_id, key, VariadicToJson(value));
-      }
-      PostprocessArgs();
     }
 
-    const Json::Value& GetArgs(ArgSetId set_id) const {
+    Json::Value GetArgs(ArgSetId set_id) {
       // If |set_id| was empty and added to the storage last, it may not be in
-      // args_sets_.
-      if (set_id > args_sets_.size())
+      // the arg table.
+      if (set_id + 1 >= set_start_rows_.size())
         return empty_value_;
-      return args_sets_[set_id];
+
+      auto it = cache_.find(set_id);
+      if (it != cache_.end())
+        return it->second;
+
+      const auto& arg_table = storage_->arg_table();
+      Json::Value args = empty_value_;
+      uint32_t end = set_start_rows_[set_id + 1];
+      for (uint32_t i = set_start_rows_[set_id]; i < end; ++i) {
+        const char* key = arg_table.key().GetString(i).c_str();
+        AppendArg(&args, key, VariadicToJson(storage_->GetArgValue(i)));
+      }
+      PostprocessArgs(args);
+
+      if (cache_.size() >= kMaxCachedArgSets)
+        cache_.clear();
+      cache_.emplace(set_id, args);
+      return args;
     }
 
    private:
@@ -578,15 +618,15 @@ class JsonExporter {
       PERFETTO_FATAL("Not reached");  // For gcc.
     }
 
-    void AppendArg(ArgSetId set_id,
+    void AppendArg(Json::Value* args,
                    const std::string& key,
                    const Json::Value& value) {
-      Json::Value* target = &args_sets_[set_id];
+      Json::Value* target = args;
       for (base::StringSplitter parts(key, '.'); parts.Next();) {
         if (PERFETTO_UNLIKELY(!target->isNull() && !target->isObject())) {
           PERFETTO_DLOG("Malformed arguments. Can't append %s to %s.",
                         key.c_str(),
-                        args_sets_[set_id].toStyledString().c_str());
+                        args->toStyledString().c_str());
           return;
         }
         std::string key_part = parts.cur_token();
@@ -605,7 +645,7 @@ class JsonExporter {
             if (PERFETTO_UNLIKELY(!target->isNull() && !target->isArray())) {
               PERFETTO_DLOG("Malformed arguments. Can't append %s to %s.",
                             key.c_str(),
-                            args_sets_[set_id].toStyledString().c_str());
+                            args->toStyledString().c_str());
               return;
             }
             std::optional<uint32_t> index = base::StringToUInt32(s);
@@ -622,45 +662,48 @@ class JsonExporter {
       *target = value;
     }
 
-    void PostprocessArgs() {
-      for (Json::Value& args : args_sets_) {
-        // Move all fields from "debug" key to upper level.
-        if (args.isMember("debug")) {
-          Json::Value debug = args["debug"];
-          args.removeMember("debug");
-          for (const auto& member : debug.getMemberNames()) {
-            args[member] = debug[member];
-          }
+    void PostprocessArgs(Json::Value& args) {
+      // Move all fields from "debug" key to upper level.
+      if (args.isMember("debug")) {
+        Json::Value debug = args["debug"];
+        args.removeMember("debug");
+        for (const auto& member : debug.getMemberNames()) {
+          args[member] = debug[member];
         }
+      }
 
-        // Rename source fields.
-        if (args.isMember("task")) {
-          if (args["task"].isMember("posted_from")) {
-            Json::Value posted_from = args["task"]["posted_from"];
-            args["task"].removeMember("posted_from");
-            if (posted_from.isMember("function_name")) {
-              args["src_func"] = posted_from["function_name"];
-              args["src_file"] = posted_from["file_name"];
-            } else if (posted_from.isMember("file_name")) {
-              args["src"] = posted_from["file_name"];
-            }
+      // Rename source fields.
+      if (args.isMember("task")) {
+        if (args["task"].isMember("posted_from")) {
+          Json::Value posted_from = args["task"]["posted_from"];
+          args["task"].removeMember("posted_from");
+          if (posted_from.isMember("function_name")) {
+            args["src_func"] = posted_from["function_name"];
+            args["src_file"] = posted_from["file_name"];
+          } else if (posted_from.isMember("file_name")) {
+            args["src"] = posted_from["file_name"];
           }
-          if (args["task"].empty())
-            args.removeMember("task");
         }
-        if (args.isMember("source")) {
-          Json::Value source = args["source"];
-          if (source.isObject() && source.isMember("function_name")) {
-            args["function_name"] = source["function_name"];
-            args["file_name"] = source["file_name"];
-            args.removeMember("source");
-          }
+        if (args["task"].empty())
+          args.removeMember("task");
+      }
+      if (args.isMember("source")) {
+        Json::Value source = args["source"];
+        if (source.isObject() && source.isMember("function_name")) {
+          args["function_name"] = source["function_name"];
+          args["file_name"] = source["file_name"];
+          args.removeMember("source");
         }
       }
     }
 
+    static constexpr size_t kMaxCachedArgSets = 4096;
+
     const TraceStorage* storage_;
-    std::vector<Json::Value> args_sets_;
+    // Row of the arg table where each arg set starts, followed by the row
+    // count.
+    std::vector<uint32_t> set_start_rows_;
+    std::unordered_map<ArgSetId, Json::Value> cache_;
     const Json::Value empty_value_;
     const Json::Value nan_value_;
     const Json::Value inf_value_;
@@ -798,7 +841,7 @@ class JsonExporter {
       std::optional<UniqueTid> legacy_utid;
       std::string legacy_phase;
 
-      event["args"] = args_builder_.GetArgs(it.arg_set_id());  // Makes a copy.
+      event["args"] = args_builder_.GetArgs(it.arg_set_id());
       if (event["args"].isMember(kLegacyEventArgsKey)) {
         const auto& legacy_args = event["args"][kLegacyEventArgsKey];
 
@@ -822,11 +865,13 @@ class JsonExporter {
 
       auto track_row_ref = *track_table.FindById(track_id);
       auto track_args_id = track_row_ref.source_arg_set_id();
+      Json::Value track_args_value;
       const Json::Value* track_args = nullptr;
       bool legacy_chrome_track = false;
       bool is_child_track = false;
       if (track_args_id) {
-        track_args = &args_builder_.GetArgs(*track_args_id);
+        track_args_value = args_builder_.GetArgs(*track_args_id);
+        track_args = &track_args_value;
         legacy_chrome_track = (*track_args)["source"].asString() == "chrome";
         is_child_track = track_args->isMember("is_root_in_scope") &&
                          !(*track_args)["is_root_in_scope"].asBool();
@@ -1605,11 +1650,11 @@ class JsonExporter {
 
         auto process_args_id = process_table.arg_set_id()[upid];
         if (process_args_id) {
-          const Json::Value* process_args =
-              &args_builder_.GetArgs(process_args_id);
-          if (process_args->isMember("is_peak_rss_resettable")) {
+          const Json::Value process_args =
+              args_builder_.GetArgs(process_args_id);
+          if (process_args.isMember("is_peak_rss_resettable")) {
             totals["is_peak_rss_resettable"] =
-                (*process_args)["is_peak_rss_resettable"];
+                process_args["is_peak_rss_resettable"];
           }
         }
 
@@ -1727,17 +1772,17 @@ class JsonExporter {
           auto node_args_id = snapshot_nodes.arg_set_id()[node_index];
           if (!node_args_id)
             continue;
-          const Json::Value* node_args =
-              &args_builder_.GetArgs(node_args_id.value());
-          for (const auto& arg_name : node_args->getMemberNames()) {
-            const Json::Value& arg_value = (*node_args)[arg_name]["value"];
+          const Json::Value node_args =
+              args_builder_.GetArgs(node_args_id.value());
+          for (const auto& arg_name : node_args.getMemberNames()) {
+            const Json::Value& arg_value = node_args[arg_name]["value"];
             if (arg_value.empty())
               continue;
             if (arg_value.isString()) {
               AddAttributeToMemoryNode(&event, path, arg_name,
                                        arg_value.asString());
             } else if (arg_value.isInt64()) {
-              Json::Value unit = (*node_args)[arg_name]["unit"];
+              Json::Value unit = node_args[arg_name]["unit"];
               if (unit.empty())
                 unit = "unknown";
               AddAttributeToMemoryNode(&event, path, arg_name,
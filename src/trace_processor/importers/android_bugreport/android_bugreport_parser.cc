@@ -17,10 +17,14 @@
 #include "src/trace_processor/importers/android_bugreport/android_bugreport_parser.h"
 
 #include <algorithm>
+#include <memory>
 #include <optional>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/threading/thread_pool.h"
+#include "perfetto/ext/base/waitable_event.h"
 #include "perfetto/trace_processor/trace_blob.h"
 #include "perfetto/trace_processor/trace_blob_view.h"
 #include "src/trace_processor/importers/android_bugreport/android_log_parser.h"
@@ -28,6 +32,8 @@
 #include "src/trace_processor/importers/common/process_tracker.h"
 #include "src/trace_processor/importers/common/track_tracker.h"
 #include "src/trace_processor/types/trace_processor_context.h"
+#include "src/trace_processor/util/streaming_line_reader.h"
+#include "src/trace_processor/util/threading.h"
 #include "src/trace_processor/util/zip_reader.h"
 
 #include "protos/perfetto/common/builtin_clock.pbzero.h"
@@ -35,6 +41,21 @@
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+// A logcat file which is decompressed in full on the thread pool.
+struct DecompressedLogFile {
+  const util::ZipFile* file = nullptr;
+
+  // The fields below are written by the thread pool and must be read only
+  // after |done| has been notified.
+  std::vector<uint8_t> data;
+  base::Status status;
+  base::WaitableEvent done;
+};
+
+}  // namespace
+
 AndroidBugreportParser::AndroidBugreportParser(TraceProcessorContext* ctx)
     : context_(ctx), zip_reader_(new util::ZipReader()) {}
 
@@ -191,13 +212,55 @@ void AndroidBugreportParser::ParsePersistentLogcat() {
   }
   std::sort(log_paths.begin(), log_paths.end());
 
+  uint32_t thread_count = context_->config.tokenization_thread_count;
+#if !PERFETTO_TP_HAS_THREADS()
+  thread_count = 0;
+#endif
+
   // Push all events into the AndroidLogParser. It will take care of string
   // interning into the pool. Appends entries into `log_events`.
-  for (const auto& kv : log_paths) {
-    util::ZipFile* zf = zip_reader_->Find(kv.second);
-    zf->DecompressLines([&](const std::vector<base::StringView>& lines) {
-      log_parser.ParseLogLines(lines, &log_events_);
-    });
+  auto parse_lines = [&](const std::vector<base::StringView>& lines) {
+    log_parser.ParseLogLines(lines, &log_events_);
+  };
+  if (thread_count == 0) {
+    for (const auto& kv : log_paths) {
+      util::ZipFile* zf = zip_reader_->Find(kv.second);
+      zf->DecompressLines(parse_lines);
+    }
+  } else {
+    // Decompress the files on the thread pool, one file per task, while the
+    // ones already decompressed are parsed in order on this thread. Only a
+    // few files are kept in flight to bound the memory used.
+    const size_t max_in_flight = 2 * thread_count;
+    std::vector<std::unique_ptr<DecompressedLogFile>> files;
+    for (const auto& kv : log_paths) {
+      files.emplace_back(new DecompressedLogFile());
+      files.back()->file = zip_reader_->Find(kv.second);
+    }
+    base::ThreadPool pool(thread_count);
+    auto post_decompress = [&pool, &files](size_t i) {
+      DecompressedLogFile* file = files[i].get();
+      pool.PostTask([file] {
+        file->status = file->file->Decompress(&file->data);
+        file->done.Notify();
+      });
+    };
+    for (size_t i = 0; i < std::min(max_in_flight, files.size()); ++i) {
+      post_decompress(i);
+    }
+    for (size_t i = 0; i < files.size(); ++i) {
+      DecompressedLogFile* file = files[i].get();
+      file->done.Wait();
+      if (i + max_in_flight < files.size())
+        post_decompress(i + max_in_flight);
+      if (file->status.ok()) {
+        util::StreamingLineReader line_reader(parse_lines);
+        line_reader.Tokenize(base::StringView(
+            reinterpret_cast<const char*>(file->data.data()),
+            file->data.size()));
+      }
+      std::vector<uint8_t>().swap(file->data);
+    }
   }
 
   // Do an initial sorting pass. This is not the final sorting because we
@@ -258,7 +321,14 @@ bool AndroidBugreportParser::DetectYearAndBrFilename() {
 }
 
 void AndroidBugreportParser::SortLogEvents() {
-  std::stable_sort(log_events_.begin(), log_events_.end());
+  // The events before |log_events_last_sorted_idx_| are sorted already. Sort
+  // only the ones appended since then and merge the two runs: this is
+  // equivalent to a std::stable_sort of the whole vector, as the merge keeps
+  // the events of the first run before the equal ones of the second.
+  auto mid = log_events_.begin() +
+             static_cast<ptrdiff_t>(log_events_last_sorted_idx_);
+  std::stable_sort(mid, log_events_.end());
+  std::inplace_merge(log_events_.begin(), mid, log_events_.end());
   log_events_last_sorted_idx_ = log_events_.size();
 }
 
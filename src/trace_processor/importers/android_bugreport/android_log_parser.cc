@@ -17,6 +17,7 @@
 #include "src/trace_processor/importers/android_bugreport/android_log_parser.h"
 
 #include <string.h>
+#include <array>
 #include <optional>
 
 #include "perfetto/base/logging.h"
@@ -96,22 +97,48 @@ enum class LogcatFormat {
   kBugreport
 };
 
+// Splits |line| on spaces, like base::SplitString() does, but without
+// allocating: only the first |kMaxTokens| tokens are returned in |tokens|.
+// Returns the number of tokens found, up to |kMaxTokens|.
+constexpr size_t kMaxTokens = 6;
+size_t SplitOnSpaces(base::StringView line,
+                     std::array<base::StringView, kMaxTokens>* tokens) {
+  size_t count = 0;
+  size_t pos = 0;
+  while (count < kMaxTokens && pos < line.size()) {
+    size_t end = line.find(' ', pos);
+    if (end == base::StringView::npos)
+      end = line.size();
+    if (end > pos)
+      (*tokens)[count++] = line.substr(pos, end - pos);
+    pos = end + 1;
+  }
+  return count;
+}
+
 LogcatFormat DetectFormat(base::StringView line) {
-  auto p = base::SplitString(line.ToStdString(), " ");
-  if (p.size() < 5)
+  // This runs at least once per ParseLogLines() call, which is once per line
+  // for the logcat sections of dumpstate, so it must not allocate.
+  std::array<base::StringView, kMaxTokens> p;
+  size_t num_tokens = SplitOnSpaces(line, &p);
+  if (num_tokens < 5)
     return LogcatFormat::kUnknown;
 
-  if (p[0].size() != 5 || p[0][2] != '-')
+  if (p[0].size() != 5 || p[0].at(2) != '-')
     return LogcatFormat::kUnknown;
 
-  if (p[1].size() < 10 || p[1][2] != ':' || p[1][5] != ':' || p[1][8] != '.')
+  if (p[1].size() < 10 || p[1].at(2) != ':' || p[1].at(5) != ':' ||
+      p[1].at(8) != '.') {
     return LogcatFormat::kUnknown;
+  }
 
-  if (p[4].size() == 1 && p[4][0] >= 'A' && p[4][0] <= 'Z')
+  if (p[4].size() == 1 && p[4].at(0) >= 'A' && p[4].at(0) <= 'Z')
     return LogcatFormat::kPersistentLog;
 
-  if (p[5].size() == 1 && p[5][0] >= 'A' && p[5][0] <= 'Z')
+  if (num_tokens > 5 && p[5].size() == 1 && p[5].at(0) >= 'A' &&
+      p[5].at(0) <= 'Z') {
     return LogcatFormat::kBugreport;
+  }
 
   return LogcatFormat::kUnknown;
 }
@@ -120,7 +147,7 @@ LogcatFormat DetectFormat(base::StringView line) {
 
 // Parses a bunch of logcat lines and appends broken down events into
 // `log_events`.
-void AndroidLogParser::ParseLogLines(std::vector<base::StringView> lines,
+void AndroidLogParser::ParseLogLines(const std::vector<base::StringView>& lines,
                                      std::vector<AndroidLogEvent>* log_events,
                                      size_t dedupe_idx) {
   int parse_failures = 0;
@@ -67,7 +67,7 @@ class AndroidLogParser {
   // `dedupe_idx` is the log_events.size() for the last std::sort() call.
   // The de-duping logic truncates timestamps to millisecond resolution, to
   // handle the mismatching resolution of dumpstate (ms) vs persistent log (us).
-  void ParseLogLines(std::vector<base::StringView> lines,
+  void ParseLogLines(const std::vector<base::StringView>& lines,
                      std::vector<AndroidLogEvent>* log_events,
                      size_t dedupe_idx = 0);
 
@@ -66,7 +66,26 @@ void ArgsTracker::Flush() {
       return f.row < s.row;
     return f.column < s.column;
   };
-  std::stable_sort(args_.begin(), args_.end(), comparator);
+  //
+  // std::stable_sort() allocates a temporary buffer on every call which shows
+  // up in profiles for arg-heavy traces given that we flush once per event.
+  // Almost all events have only a handful of args which fit in the inline
+  // storage of |args_| so do an (allocation free) insertion sort in that case
+  // instead.
+  if (args_.size() <= kInlineArgCount) {
+    for (size_t i = 1; i < args_.size(); ++i) {
+      if (!comparator(args_[i], args_[i - 1]))
+        continue;
+      Arg arg = args_[i];
+      size_t j = i;
+      for (; j > 0 && comparator(arg, args_[j - 1]); --j) {
+        args_[j] = args_[j - 1];
+      }
+      args_[j] = arg;
+    }
+  } else {
+    std::stable_sort(args_.begin(), args_.end(), comparator);
+  }
 
   for (uint32_t i = 0; i < args_.size();) {
     const GlobalArgsTracker::Arg& arg = args_[i];
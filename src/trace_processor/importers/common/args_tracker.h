@@ -17,6 +17,8 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_ARGS_TRACKER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_ARGS_TRACKER_H_
 
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/small_vector.h"
 #include "src/trace_processor/importers/common/global_args_tracker.h"
 #include "src/trace_processor/storage/trace_storage.h"
@@ -69,15 +71,15 @@ class ArgsTracker {
     // track the next array index for an array under a specific key.
     size_t GetNextArrayEntryIndex(StringId key) {
       // Zero-initializes |key| in the map if it doesn't exist yet.
-      return args_tracker_
-          ->array_indexes_[std::make_tuple(arg_set_id_column_, row_, key)];
+      return args_tracker_->array_indexes_[ArrayKey{arg_set_id_column_, row_,
+                                                    key}];
     }
 
     // Returns the next available array index after increment.
     size_t IncrementArrayEntryIndex(StringId key) {
       // Zero-initializes |key| in the map if it doesn't exist yet.
-      return ++args_tracker_->array_indexes_[std::make_tuple(arg_set_id_column_,
-                                                             row_, key)];
+      return ++args_tracker_->array_indexes_[ArrayKey{arg_set_id_column_,
+                                                      row_, key}];
     }
 
    protected:
@@ -198,12 +200,34 @@ class ArgsTracker {
               Variadic,
               UpdatePolicy);
 
-  base::SmallVector<GlobalArgsTracker::Arg, 16> args_;
+  // Identifies an array under |key| in the arg set of |row| in |column|.
+  struct ArrayKey {
+    bool operator==(const ArrayKey& o) const {
+      return column == o.column && row == o.row && key == o.key;
+    }
+
+    Column* column;
+    uint32_t row;
+    StringId key;
+  };
+  struct ArrayKeyHasher {
+    size_t operator()(const ArrayKey& k) const {
+      base::Hasher hash;
+      hash.Update(reinterpret_cast<uintptr_t>(k.column));
+      hash.Update(k.row);
+      hash.Update(k.key.raw_id());
+      return static_cast<size_t>(hash.digest());
+    }
+  };
+
+  // Number of args which can be added before |args_| has to go to the heap.
+  static constexpr size_t kInlineArgCount = 16;
+
+  base::SmallVector<GlobalArgsTracker::Arg, kInlineArgCount> args_;
   TraceProcessorContext* context_ = nullptr;
 
-  using ArrayKeyTuple =
-      std::tuple<Column* /*arg_set_id*/, uint32_t /*row*/, StringId /*key*/>;
-  std::map<ArrayKeyTuple, size_t /*next_index*/> array_indexes_;
+  base::FlatHashMap<ArrayKey, size_t /*next_index*/, ArrayKeyHasher>
+      array_indexes_;
 };
 
 }  // namespace trace_processor
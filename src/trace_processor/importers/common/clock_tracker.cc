@@ -229,6 +229,48 @@ std::optional<int64_t> ClockTracker::ToTraceTimeFromSnapshot(
   return maybe_found_trace_time_clock->timestamp;
 }
 
+base::Status ClockTracker::ToTraceTime(ClockId clock_id,
+                                       int64_t* timestamps,
+                                       size_t count,
+                                       size_t* converted_count) {
+  MarkTraceTimeClockUsedForConversion();
+  if (clock_id == trace_time_clock_id_) {
+    *converted_count = count;
+    return base::OkStatus();
+  }
+
+  // The single-path resolution used for the previous timestamp. As long as
+  // the following timestamps stay within its bounds, they are translated by
+  // the same offset. Incremental clocks are converted one by one as each
+  // timestamp depends on the previous one.
+  const CachedClockPath* run = nullptr;
+  for (size_t i = 0; i < count; ++i) {
+    if (run) {
+      int64_t ns = timestamps[i] * run->src_domain->unit_multiplier_ns;
+      if (ns >= run->min_ts_ns && ns < run->max_ts_ns) {
+        timestamps[i] = ns + run->translation_ns;
+        continue;
+      }
+    }
+    base::StatusOr<int64_t> trace_ts =
+        Convert(clock_id, timestamps[i], trace_time_clock_id_);
+    if (!trace_ts.ok()) {
+      *converted_count = i;
+      return trace_ts.status();
+    }
+
+    run = nullptr;
+    ClockDomain* domain = GetClock(clock_id);
+    if (!domain->is_incremental && !cache_lookups_disabled_for_testing_) {
+      run = FindCachedPath(clock_id, trace_time_clock_id_,
+                           timestamps[i] * domain->unit_multiplier_ns);
+    }
+    timestamps[i] = *trace_ts;
+  }
+  *converted_count = count;
+  return base::OkStatus();
+}
+
 base::StatusOr<int64_t> ClockTracker::ConvertSlowpath(ClockId src_clock_id,
                                                       int64_t src_timestamp,
                                                       ClockId target_clock_id) {
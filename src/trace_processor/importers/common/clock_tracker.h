@@ -52,6 +52,10 @@ class TraceProcessorContext;
 //   been snapshotted at the same time (within technical limits).
 // - ToTraceTime(src_clock_id, src_timestamp):
 //   converts a timestamp between clock domain and TraceTime.
+// - ToTraceTime(src_clock_id, timestamps, count, converted_count):
+//   same as above for a whole array of timestamps, e.g. the events of a
+//   bundle. Runs of timestamps which fall between the same two snapshots are
+//   shifted by the same offset without looking up the conversion again.
 //
 // Concepts:
 // - Snapshot hash:
@@ -165,18 +169,22 @@ class ClockTracker {
   base::StatusOr<uint32_t> AddSnapshot(const std::vector<ClockTimestamp>&);
 
   base::StatusOr<int64_t> ToTraceTime(ClockId clock_id, int64_t timestamp) {
-    if (PERFETTO_UNLIKELY(!trace_time_clock_id_used_for_conversion_)) {
-      context_->metadata_tracker->SetMetadata(
-          metadata::trace_time_clock_id,
-          Variadic::Integer(trace_time_clock_id_));
-      trace_time_clock_id_used_for_conversion_ = true;
-    }
-    trace_time_clock_id_used_for_conversion_ = true;
+    MarkTraceTimeClockUsedForConversion();
     if (clock_id == trace_time_clock_id_)
       return timestamp;
     return Convert(clock_id, timestamp, trace_time_clock_id_);
   }
 
+  // Converts, in place, the |count| timestamps of |clock_id| in |timestamps|
+  // to trace time. The results are the same as calling ToTraceTime() on each
+  // timestamp in order. Stops at the first timestamp which can't be converted
+  // and returns its error. |converted_count| is set to the number of
+  // timestamps converted, i.e. the index of the failing one on error.
+  base::Status ToTraceTime(ClockId clock_id,
+                           int64_t* timestamps,
+                           size_t count,
+                           size_t* converted_count);
+
   // If trace clock and source clock are available in the snapshot will return
   // the trace clock time in snapshot.
   std::optional<int64_t> ToTraceTimeFromSnapshot(
@@ -328,6 +336,30 @@ class ClockTracker {
 
   ClockPath FindPath(ClockId src, ClockId target);
 
+  // Returns the cached single-path resolution from |src| to |target| which
+  // covers |src_ns| or nullptr if there is none.
+  const CachedClockPath* FindCachedPath(ClockId src,
+                                        ClockId target,
+                                        int64_t src_ns) const {
+    for (const auto& cached_clock_path : cache_) {
+      if (cached_clock_path.src == src && cached_clock_path.target == target &&
+          src_ns >= cached_clock_path.min_ts_ns &&
+          src_ns < cached_clock_path.max_ts_ns) {
+        return &cached_clock_path;
+      }
+    }
+    return nullptr;
+  }
+
+  void MarkTraceTimeClockUsedForConversion() {
+    if (PERFETTO_UNLIKELY(!trace_time_clock_id_used_for_conversion_)) {
+      context_->metadata_tracker->SetMetadata(
+          metadata::trace_time_clock_id,
+          Variadic::Integer(trace_time_clock_id_));
+      trace_time_clock_id_used_for_conversion_ = true;
+    }
+  }
+
   ClockDomain* GetClock(ClockId clock_id) {
     auto it = clocks_.find(clock_id);
     PERFETTO_DCHECK(it != clocks_.end());
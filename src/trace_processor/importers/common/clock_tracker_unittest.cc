@@ -303,6 +303,41 @@ TEST_F(ClockTrackerTest, CacheDoesntAffectResults) {
   }
 }
 
+TEST_F(ClockTrackerTest, BatchedToTraceTime) {
+  size_t converted = 1;
+  int64_t ts[] = {0};
+  EXPECT_FALSE(ct_.ToTraceTime(MONOTONIC, ts, 1, &converted).ok());
+  EXPECT_EQ(converted, 0u);
+
+  std::minstd_rand rnd;
+  int64_t last_mono = 0;
+  int64_t last_boot = 0;
+  for (int i = 0; i < 100; i++) {
+    last_mono += 1 + static_cast<int64_t>(rnd() % 100);
+    last_boot += 1 + static_cast<int64_t>(rnd() % 100);
+    ct_.AddSnapshot({{MONOTONIC, last_mono}, {BOOTTIME, last_boot}});
+  }
+
+  // Sorted timestamps spanning all the snapshots, as in a bundle of events.
+  std::vector<int64_t> batch;
+  for (int64_t mono = -10; mono < last_mono + 10; mono += 1 + static_cast<int64_t>(rnd() % 7))
+    batch.push_back(mono);
+  std::vector<int64_t> expected;
+  for (int64_t mono : batch)
+    expected.push_back(*ct_.ToTraceTime(MONOTONIC, mono));
+
+  ASSERT_TRUE(
+      ct_.ToTraceTime(MONOTONIC, batch.data(), batch.size(), &converted).ok());
+  EXPECT_EQ(converted, batch.size());
+  EXPECT_EQ(batch, expected);
+
+  // Trace time timestamps are left untouched.
+  ts[0] = 42;
+  ASSERT_TRUE(ct_.ToTraceTime(BOOTTIME, ts, 1, &converted).ok());
+  EXPECT_EQ(converted, 1u);
+  EXPECT_EQ(ts[0], 42);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_PID_MAP_H_
+#define SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_PID_MAP_H_
+
+#include <stdint.h>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "perfetto/base/compiler.h"
+#include "perfetto/ext/base/flat_hash_map.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Maps a pid or tid to a T, which is default constructed when the id is first
+// accessed.
+//
+// Pids are bounded on Linux and Android (by pid_max, at most PID_MAX_LIMIT),
+// so ids below that are looked up in a two level table of pages of
+// consecutive ids, allocated when one of their ids is first accessed: a lookup
+// is two array loads and memory grows with the ranges of ids in use rather
+// than with the largest id. Larger ids (e.g. the synthetic pids of JSON or
+// Fuchsia traces) are stored in a hash map.
+//
+// References to the values of ids below kMaxDenseId stay valid until Clear().
+// As with FlatHashMap, the others are invalidated by the insertion of another
+// large id.
+template <typename T>
+class PidMap {
+ public:
+  // PID_MAX_LIMIT on 64 bit Linux.
+  static constexpr uint32_t kMaxDenseId = 1u << 22;
+
+  PidMap() = default;
+  PidMap(const PidMap&) = delete;
+  PidMap& operator=(const PidMap&) = delete;
+
+  // Returns the value of |id|, default constructing it if this is the first
+  // access to it.
+  T& operator[](uint32_t id) {
+    if (PERFETTO_UNLIKELY(id >= kMaxDenseId))
+      return sparse_[id];
+    uint32_t page_idx = id >> kPageBits;
+    if (PERFETTO_UNLIKELY(page_idx >= pages_.size()))
+      pages_.resize(page_idx + 1);
+    std::unique_ptr<Page>& page = pages_[page_idx];
+    if (PERFETTO_UNLIKELY(!page))
+      page.reset(new Page());
+    return (*page)[id & kPageMask];
+  }
+
+  // Returns the value of |id|, or nullptr if it has never been accessed. Note
+  // that ids sharing a page with an accessed one return their default
+  // constructed value instead, so callers must handle both the same way.
+  T* Find(uint32_t id) {
+    if (PERFETTO_UNLIKELY(id >= kMaxDenseId))
+      return sparse_.Find(id);
+    uint32_t page_idx = id >> kPageBits;
+    if (page_idx >= pages_.size() || !pages_[page_idx])
+      return nullptr;
+    return &(*pages_[page_idx])[id & kPageMask];
+  }
+
+  void Clear() {
+    pages_.clear();
+    pages_.shrink_to_fit();
+    sparse_.Clear();
+  }
+
+ private:
+  static constexpr uint32_t kPageBits = 10;
+  static constexpr uint32_t kPageMask = (1u << kPageBits) - 1;
+  using Page = std::array<T, 1u << kPageBits>;
+
+  std::vector<std::unique_ptr<Page>> pages_;
+  base::FlatHashMap<uint32_t, T> sparse_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_PID_MAP_H_
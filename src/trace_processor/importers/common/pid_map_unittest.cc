@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/common/pid_map.h"
+
+#include <optional>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(PidMapTest, FindBeforeAccess) {
+  PidMap<std::optional<uint32_t>> map;
+  ASSERT_EQ(map.Find(0), nullptr);
+  ASSERT_EQ(map.Find(1234), nullptr);
+  ASSERT_EQ(map.Find(PidMap<uint32_t>::kMaxDenseId + 1), nullptr);
+}
+
+TEST(PidMapTest, DenseIds) {
+  PidMap<std::optional<uint32_t>> map;
+  map[1] = 10;
+  map[32767] = 20;
+  map[PidMap<uint32_t>::kMaxDenseId - 1] = 30;
+
+  ASSERT_EQ(*map.Find(1), 10u);
+  ASSERT_EQ(*map.Find(32767), 20u);
+  ASSERT_EQ(*map.Find(PidMap<uint32_t>::kMaxDenseId - 1), 30u);
+
+  // Ids sharing a page with an accessed one have a default value.
+  ASSERT_NE(map.Find(2), nullptr);
+  ASSERT_FALSE(map.Find(2)->has_value());
+
+  // Ids in pages never accessed are not found.
+  ASSERT_EQ(map.Find(100000), nullptr);
+}
+
+TEST(PidMapTest, SparseIds) {
+  PidMap<std::optional<uint32_t>> map;
+  uint32_t large_id = PidMap<uint32_t>::kMaxDenseId;
+  map[large_id] = 10;
+  map[UINT32_MAX] = 20;
+
+  ASSERT_EQ(*map.Find(large_id), 10u);
+  ASSERT_EQ(*map.Find(UINT32_MAX), 20u);
+  ASSERT_EQ(map.Find(large_id + 1), nullptr);
+}
+
+TEST(PidMapTest, DenseReferencesStayValid) {
+  PidMap<uint32_t> map;
+  uint32_t& value = map[42];
+  for (uint32_t i = 0; i < 100000; i += 7)
+    map[i] = i;
+  value = 1;
+  ASSERT_EQ(*map.Find(42), 1u);
+}
+
+TEST(PidMapTest, Clear) {
+  PidMap<uint32_t> map;
+  map[1] = 1;
+  map[UINT32_MAX] = 2;
+  map.Clear();
+  ASSERT_EQ(map.Find(1), nullptr);
+  ASSERT_EQ(map.Find(UINT32_MAX), nullptr);
+  map[1] = 3;
+  ASSERT_EQ(*map.Find(1), 3u);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
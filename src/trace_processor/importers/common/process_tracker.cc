@@ -56,7 +56,7 @@ UniqueTid ProcessTracker::StartNewThread(std::optional<int64_t> timestamp,
 
   auto* thread_table = context_->storage->mutable_thread_table();
   UniqueTid new_utid = thread_table->Insert(row).row;
-  tids_[tid].emplace_back(new_utid);
+  tids_[tid].Append(new_utid);
   PERFETTO_DCHECK(thread_name_priorities_.size() == new_utid);
   thread_name_priorities_.push_back(ThreadNamePriority::kOther);
   return new_utid;
@@ -83,8 +83,7 @@ void ProcessTracker::EndThread(int64_t timestamp, uint32_t tid) {
 
   // Remove the thread from the list of threads being tracked as any event after
   // this one should be ignored.
-  auto& vector = tids_[tid];
-  vector.erase(std::remove(vector.begin(), vector.end(), utid));
+  tids_[tid].Remove(utid);
 
   auto opt_upid = thread_table->upid()[utid];
   if (!opt_upid.has_value() || process_table->pid()[*opt_upid] != tid)
@@ -94,7 +93,7 @@ void ProcessTracker::EndThread(int64_t timestamp, uint32_t tid) {
   // of the process, we should also finish the process itself.
   PERFETTO_DCHECK(thread_table->is_main_thread()[utid].value());
   process_table->mutable_end_ts()->Set(*opt_upid, timestamp);
-  pids_.Erase(tid);
+  pids_[tid] = std::nullopt;
 }
 
 std::optional<UniqueTid> ProcessTracker::GetThreadOrNull(uint32_t tid) {
@@ -161,8 +160,8 @@ bool ProcessTracker::IsThreadAlive(UniqueTid utid) {
 
   // If the process has been replaced in |pids_|, this thread is dead.
   uint32_t current_pid = processes->pid()[current_upid];
-  auto pid_it = pids_.Find(current_pid);
-  if (pid_it && *pid_it != current_upid)
+  std::optional<UniquePid>* pid_upid = pids_.Find(current_pid);
+  if (pid_upid && pid_upid->has_value() && **pid_upid != current_upid)
     return false;
 
   return true;
@@ -174,15 +173,14 @@ std::optional<UniqueTid> ProcessTracker::GetThreadOrNull(
   auto* threads = context_->storage->mutable_thread_table();
   auto* processes = context_->storage->mutable_process_table();
 
-  auto vector_it = tids_.Find(tid);
-  if (!vector_it)
+  const ThreadGenerations* generations = tids_.Find(tid);
+  if (!generations)
     return std::nullopt;
 
   // Iterate backwards through the threads so ones later in the trace are more
   // likely to be picked.
-  const auto& vector = *vector_it;
-  for (auto it = vector.rbegin(); it != vector.rend(); it++) {
-    UniqueTid current_utid = *it;
+  for (const UniqueTid* it = generations->end(); it != generations->begin();) {
+    UniqueTid current_utid = *--it;
 
     // If we finished this thread, we should have removed it from the vector
     // entirely.
@@ -272,7 +270,7 @@ UniquePid ProcessTracker::StartNewProcess(std::optional<int64_t> timestamp,
                                           uint32_t pid,
                                           StringId main_thread_name,
                                           ThreadNamePriority priority) {
-  pids_.Erase(pid);
+  pids_[pid] = std::nullopt;
   // TODO(eseckler): Consider erasing all old entries in |tids_| that match the
   // |pid| (those would be for an older process with the same pid). Right now,
   // we keep them in |tids_| (if they weren't erased by EndThread()), but ignore
@@ -373,19 +371,20 @@ void ProcessTracker::UpdateThreadNameAndMaybeProcessName(
 UniquePid ProcessTracker::GetOrCreateProcess(uint32_t pid) {
   auto* process_table = context_->storage->mutable_process_table();
 
-  // If the insertion succeeds, we'll fill the upid below.
-  auto it_and_ins = pids_.Insert(pid, UniquePid{0});
-  if (!it_and_ins.second) {
+  std::optional<UniquePid>& pid_upid = pids_[pid];
+  if (pid_upid) {
     // Ensure that the process has not ended.
-    PERFETTO_DCHECK(!process_table->end_ts()[*it_and_ins.first].has_value());
-    return *it_and_ins.first;
+    PERFETTO_DCHECK(!process_table->end_ts()[*pid_upid].has_value());
+    return *pid_upid;
   }
 
   tables::ProcessTable::Row row;
   row.pid = pid;
 
   UniquePid upid = process_table->Insert(row).row;
-  *it_and_ins.first = upid;  // Update the newly inserted hashmap entry.
+  // |pid_upid| must not be used after this, as UpdateThread() below can
+  // insert into |pids_|.
+  pid_upid = upid;
 
   // Create an entry for the main thread.
   // We cannot call StartNewThread() here, because threads for this process
@@ -508,8 +507,12 @@ void ProcessTracker::AssociateThreadToProcess(UniqueTid utid, UniquePid upid) {
 
 void ProcessTracker::SetPidZeroIsUpidZeroIdleProcess() {
   // Create a mapping from (t|p)id 0 -> u(t|p)id 0 for the idle process.
-  tids_.Insert(0, std::vector<UniqueTid>{0});
-  pids_.Insert(0, UniquePid{0});
+  ThreadGenerations& tid_zero = tids_[0];
+  if (tid_zero.begin() == tid_zero.end())
+    tid_zero.Append(0);
+  std::optional<UniquePid>& pid_zero = pids_[0];
+  if (!pid_zero)
+    pid_zero = 0;
 
   auto swapper_id = context_->storage->InternString("swapper");
   UpdateThreadName(0, swapper_id, ThreadNamePriority::kTraceProcessorConstant);
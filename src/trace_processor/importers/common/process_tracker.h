@@ -17,12 +17,17 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_PROCESS_TRACKER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_PROCESS_TRACKER_H_
 
+#include <algorithm>
+#include <memory>
+#include <optional>
 #include <tuple>
 #include <unordered_set>
+#include <vector>
 
 #include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/string_view.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
+#include "src/trace_processor/importers/common/pid_map.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 
@@ -52,7 +57,7 @@ class ProcessTracker {
   ProcessTracker& operator=(const ProcessTracker&) = delete;
   virtual ~ProcessTracker();
 
-  using UniqueThreadIterator = std::vector<UniqueTid>::const_iterator;
+  using UniqueThreadIterator = const UniqueTid*;
   using UniqueThreadBounds =
       std::pair<UniqueThreadIterator, UniqueThreadIterator>;
 
@@ -150,15 +155,15 @@ class ProcessTracker {
 
   // Returns the upid for a given pid.
   std::optional<UniquePid> UpidForPidForTesting(uint32_t pid) {
-    auto it = pids_.Find(pid);
-    return it ? std::make_optional(*it) : std::nullopt;
+    std::optional<UniquePid>* upid = pids_.Find(pid);
+    return upid ? *upid : std::nullopt;
   }
 
   // Returns the bounds of a range that includes all UniqueTids that have the
   // requested tid.
   UniqueThreadBounds UtidsForTidForTesting(uint32_t tid) {
-    const auto& deque = tids_[tid];
-    return std::make_pair(deque.begin(), deque.end());
+    const ThreadGenerations& generations = tids_[tid];
+    return std::make_pair(generations.begin(), generations.end());
   }
 
   // Marks the two threads as belonging to the same process, even if we don't
@@ -190,6 +195,56 @@ class ProcessTracker {
                               std::vector<uint32_t> nstid);
 
  private:
+  // The utids of the threads with a given tid which have not ended, in the
+  // order they were created. A tid is rarely reused before the end of its
+  // previous thread is seen, so the first few are stored inline and only
+  // longer histories are allocated.
+  class ThreadGenerations {
+   public:
+    const UniqueTid* begin() const {
+      return overflow_ ? overflow_->data() : inline_utids_;
+    }
+    const UniqueTid* end() const {
+      return overflow_ ? overflow_->data() + overflow_->size()
+                       : inline_utids_ + inline_size_;
+    }
+
+    void Append(UniqueTid utid) {
+      if (PERFETTO_LIKELY(!overflow_ && inline_size_ < kInlineSize)) {
+        inline_utids_[inline_size_++] = utid;
+        return;
+      }
+      if (!overflow_) {
+        overflow_.reset(new std::vector<UniqueTid>(
+            inline_utids_, inline_utids_ + inline_size_));
+      }
+      overflow_->push_back(utid);
+    }
+
+    void Remove(UniqueTid utid) {
+      if (overflow_) {
+        auto it = std::find(overflow_->begin(), overflow_->end(), utid);
+        if (it != overflow_->end())
+          overflow_->erase(it);
+        return;
+      }
+      UniqueTid* inline_end = inline_utids_ + inline_size_;
+      UniqueTid* it = std::find(inline_utids_, inline_end, utid);
+      if (it == inline_end)
+        return;
+      std::copy(it + 1, inline_end, it);
+      inline_size_--;
+    }
+
+   private:
+    static constexpr uint32_t kInlineSize = 3;
+
+    uint32_t inline_size_ = 0;
+    UniqueTid inline_utids_[kInlineSize];
+    // Holds all the utids once there are more than kInlineSize of them.
+    std::unique_ptr<std::vector<UniqueTid>> overflow_;
+  };
+
   // Returns the utid of a thread having |tid| and |pid| as the parent process.
   // pid == std::nullopt matches all processes.
   // Returns std::nullopt if such a thread doesn't exist.
@@ -215,10 +270,13 @@ class ProcessTracker {
   // simultaneously. This is no longer the case so this should be removed
   // (though it seems like there are subtle things which break in Chrome if this
   // changes).
-  base::FlatHashMap<uint32_t /* tid */, std::vector<UniqueTid>> tids_;
+  //
+  // This is looked up for nearly every ftrace event, so it is directly indexed
+  // by tid rather than hashed.
+  PidMap<ThreadGenerations> tids_;
 
   // Mapping of the most recently seen pid to the associated upid.
-  base::FlatHashMap<uint32_t /* pid (aka tgid) */, UniquePid> pids_;
+  PidMap<std::optional<UniquePid>> pids_;
 
   // Pending thread associations. The meaning of a pair<ThreadA, ThreadB> in
   // this vector is: we know that A and B belong to the same process, but we
@@ -122,6 +122,13 @@ constexpr auto kKernelFunctionFields = std::array<FtraceEventAndFieldId, 6>{
         protos::pbzero::FtraceEvent::kMmShrinkSlabStartFieldNumber,
         protos::pbzero::MmShrinkSlabStartFtraceEvent::kShrinkFieldNumber}};
 
+bool HasKernelFunctionFields(uint32_t ftrace_id) {
+  return std::any_of(kKernelFunctionFields.begin(), kKernelFunctionFields.end(),
+                     [ftrace_id](const FtraceEventAndFieldId& ev) {
+                       return ev.event_id == ftrace_id;
+                     });
+}
+
 std::string GetUfsCmdString(uint32_t ufsopcode, uint32_t gid) {
   std::string buffer;
   switch (ufsopcode) {
@@ -218,6 +225,48 @@ std::string GetUfsCmdString(uint32_t ufsopcode, uint32_t gid) {
 }
 }  // namespace
 
+class FtraceParser::LazyArgsDecoder {
+ public:
+  explicit LazyArgsDecoder(FtraceParser* parser)
+      : context_(parser->context_),
+        ftrace_message_strings_(parser->ftrace_message_strings_) {}
+
+  void Add(RawId id, uint32_t ftrace_id, TraceBlobView event) {
+    events_.push_back({id, ftrace_id, std::move(event)});
+  }
+
+  void Decode() {
+    if (events_.empty())
+      return;
+
+    // Uses its own ArgsTracker rather than the one of the context as this can
+    // be called after the end of the trace, when the parser and most of the
+    // context are gone.
+    ArgsTracker args_tracker(context_);
+    for (const Event& event : events_) {
+      auto inserter = args_tracker.AddArgsTo(event.id);
+      AddTypedFtraceArgs(context_, ftrace_message_strings_, inserter,
+                         event.ftrace_id,
+                         ConstBytes{event.proto.data(), event.proto.size()},
+                         nullptr);
+    }
+    // Releases the chunks of the trace which were kept alive by the events.
+    events_.clear();
+    events_.shrink_to_fit();
+  }
+
+ private:
+  struct Event {
+    RawId id;
+    uint32_t ftrace_id;
+    TraceBlobView proto;
+  };
+
+  TraceProcessorContext* const context_;
+  const std::vector<FtraceMessageStrings> ftrace_message_strings_;
+  std::vector<Event> events_;
+};
+
 FtraceParser::FtraceParser(TraceProcessorContext* context)
     : context_(context),
       rss_stat_tracker_(context),
@@ -386,6 +435,12 @@ FtraceParser::FtraceParser(TraceProcessorContext* context)
            context->storage->InternString("mem.mm.kern_alloc.count"),
            context->storage->InternString("mem.mm.kern_alloc.max_lat"),
            context->storage->InternString("mem.mm.kern_alloc.avg_lat"))}};
+
+  if (context_->config.lazy_ftrace_args) {
+    lazy_args_decoder_.reset(new LazyArgsDecoder(this));
+    std::shared_ptr<LazyArgsDecoder> decoder = lazy_args_decoder_;
+    context_->storage->AddLazyArgsDecoder([decoder] { decoder->Decode(); });
+  }
 }
 
 void FtraceParser::ParseFtraceStats(ConstBytes blob,
@@ -582,7 +637,7 @@ util::Status FtraceParser::ParseFtraceEvent(uint32_t cpu,
       ParseGenericFtrace(ts, cpu, pid, fld_bytes);
     } else if (fld.id() != FtraceEvent::kSchedSwitchFieldNumber) {
       // sched_switch parsing populates the raw table by itself
-      ParseTypedFtraceToRaw(fld.id(), ts, cpu, pid, fld_bytes, seq_state);
+      ParseTypedFtraceToRaw(fld.id(), ts, cpu, pid, fld_bytes, data);
     }
 
     if (PkvmHypervisorCpuTracker::IsPkvmHypervisorEvent(fld.id())) {
@@ -1145,26 +1200,47 @@ void FtraceParser::ParseTypedFtraceToRaw(
     uint32_t cpu,
     uint32_t tid,
     ConstBytes blob,
-    PacketSequenceStateGeneration* seq_state) {
+    const TracePacketData& data) {
   if (PERFETTO_UNLIKELY(!context_->config.ingest_ftrace_in_raw_table))
     return;
 
-  ProtoDecoder decoder(blob.data, blob.size);
   if (ftrace_id >= GetDescriptorsSize()) {
     PERFETTO_DLOG("Event with id: %d does not exist and cannot be parsed.",
                   ftrace_id);
     return;
   }
 
-  FtraceMessageDescriptor* m = GetMessageDescriptorForId(ftrace_id);
   const auto& message_strings = ftrace_message_strings_[ftrace_id];
   UniqueTid utid = context_->process_tracker->GetOrCreateThread(tid);
   RawId id =
       context_->storage->mutable_ftrace_event_table()
           ->Insert({timestamp, message_strings.message_name_id, cpu, utid})
           .id;
+
+  // Events with kernel function args are decoded right away as the interned
+  // kernel symbols are dropped with the sequence state at the end of the
+  // trace.
+  if (lazy_args_decoder_ && !HasKernelFunctionFields(ftrace_id)) {
+    lazy_args_decoder_->Add(id, ftrace_id,
+                            data.packet.slice(blob.data, blob.size));
+    return;
+  }
   auto inserter = context_->args_tracker->AddArgsTo(id);
+  AddTypedFtraceArgs(context_, ftrace_message_strings_, inserter, ftrace_id,
+                     blob, data.sequence_state.get());
+}
 
+// static
+void FtraceParser::AddTypedFtraceArgs(
+    TraceProcessorContext* context,
+    const std::vector<FtraceMessageStrings>& ftrace_message_strings,
+    ArgsTracker::BoundInserter& inserter,
+    uint32_t ftrace_id,
+    ConstBytes blob,
+    PacketSequenceStateGeneration* seq_state) {
+  ProtoDecoder decoder(blob.data, blob.size);
+  FtraceMessageDescriptor* m = GetMessageDescriptorForId(ftrace_id);
+  const auto& message_strings = ftrace_message_strings[ftrace_id];
   for (auto fld = decoder.ReadField(); fld.valid(); fld = decoder.ReadField()) {
     uint32_t field_id = fld.id();
     if (PERFETTO_UNLIKELY(field_id >= kMaxFtraceEventFields)) {
@@ -1183,7 +1259,7 @@ void FtraceParser::ParseTypedFtraceToRaw(
         [ftrace_id, field_id](const FtraceEventAndFieldId& ev) {
           return ev.event_id == ftrace_id && ev.field_id == field_id;
         });
-    if (it != kKernelFunctionFields.end()) {
+    if (seq_state && it != kKernelFunctionFields.end()) {
       PERFETTO_CHECK(type == ProtoSchemaType::kUint64);
 
       auto* interned_string = seq_state->LookupInternedMessage<
@@ -1195,7 +1271,7 @@ void FtraceParser::ParseTypedFtraceToRaw(
       // on legacy traces) then just add the field as a normal arg.
       if (interned_string) {
         protozero::ConstBytes str = interned_string->str();
-        StringId str_id = context_->storage->InternString(base::StringView(
+        StringId str_id = context->storage->InternString(base::StringView(
             reinterpret_cast<const char*>(str.data), str.size));
         inserter.AddArg(name_id, Variadic::String(str_id));
         continue;
@@ -1226,7 +1302,7 @@ void FtraceParser::ParseTypedFtraceToRaw(
       }
       case ProtoSchemaType::kString:
       case ProtoSchemaType::kBytes: {
-        StringId value = context_->storage->InternString(fld.as_string());
+        StringId value = context->storage->InternString(fld.as_string());
         inserter.AddArg(name_id, Variadic::String(value));
         break;
       }
@@ -18,6 +18,7 @@
 #define SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_PARSER_H_
 
 #include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/importers/common/args_tracker.h"
 #include "src/trace_processor/importers/common/event_tracker.h"
 #include "src/trace_processor/importers/common/parser_types.h"
 #include "src/trace_processor/importers/common/system_info_tracker.h"
@@ -32,6 +33,7 @@
 #include "src/trace_processor/importers/ftrace/virtio_gpu_tracker.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 
+#include <memory>
 #include <unordered_set>
 
 namespace perfetto {
@@ -63,7 +65,7 @@ class FtraceParser {
                              uint32_t cpu,
                              uint32_t pid,
                              protozero::ConstBytes,
-                             PacketSequenceStateGeneration*);
+                             const TracePacketData&);
   void ParseSchedSwitch(uint32_t cpu, int64_t timestamp, protozero::ConstBytes);
   void ParseSchedWaking(int64_t timestamp, uint32_t pid, protozero::ConstBytes);
   void ParseSchedProcessFree(int64_t timestamp, protozero::ConstBytes);
@@ -366,6 +368,23 @@ class FtraceParser {
   };
   std::vector<FtraceMessageStrings> ftrace_message_strings_;
 
+  // Adds the args of a typed ftrace event to |inserter|. |seq_state| is used
+  // to look up the names of kernel functions and can be null.
+  static void AddTypedFtraceArgs(
+      TraceProcessorContext* context,
+      const std::vector<FtraceMessageStrings>& ftrace_message_strings,
+      ArgsTracker::BoundInserter& inserter,
+      uint32_t ftrace_id,
+      protozero::ConstBytes,
+      PacketSequenceStateGeneration* seq_state);
+
+  // Keeps the events of the raw table whose args have not been decoded yet
+  // (see Config::lazy_ftrace_args). Shared with TraceStorage, which decodes
+  // them when needed, as this can happen after the parser is destroyed at the
+  // end of the trace.
+  class LazyArgsDecoder;
+  std::shared_ptr<LazyArgsDecoder> lazy_args_decoder_;
+
   struct MmEventCounterNames {
     MmEventCounterNames() = default;
     MmEventCounterNames(StringId _count, StringId _max_lat, StringId _avg_lat)
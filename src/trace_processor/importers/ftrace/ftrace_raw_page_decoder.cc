@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/ftrace/ftrace_raw_page_decoder.h"
+
+#include <string.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/string_splitter.h"
+#include "perfetto/ext/base/string_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// See the kernel's include/linux/ring_buffer.h and CpuReader in
+// src/traced/probes/ftrace, which parses the same layout.
+constexpr uint32_t kDataSizeMask = (1u << 27) - 1;
+constexpr uint32_t kTypeDataTypeLengthMax = 28;
+constexpr uint32_t kTypePadding = 29;
+constexpr uint32_t kTypeTimeExtend = 30;
+constexpr uint32_t kTypeTimeStamp = 31;
+
+struct FormatField {
+  std::string type_and_name;
+  uint16_t offset = 0;
+  uint16_t size = 0;
+  bool is_signed = false;
+};
+
+// Parses the value following |key| (e.g. "offset:") up to the next ';'.
+std::optional<uint32_t> ParseFieldAttribute(const std::string& line,
+                                            const char* key) {
+  size_t start = line.find(key);
+  if (start == std::string::npos)
+    return std::nullopt;
+  start += strlen(key);
+  size_t end = line.find(';', start);
+  if (end == std::string::npos)
+    return std::nullopt;
+  return base::StringToUInt32(
+      base::TrimWhitespace(line.substr(start, end - start)));
+}
+
+// Parses a line like:
+// "field:unsigned short common_type;	offset:0;	size:2;	signed:0;".
+std::optional<FormatField> ParseFieldLine(const std::string& line) {
+  size_t start = line.find("field:");
+  if (start == std::string::npos)
+    return std::nullopt;
+  start += strlen("field:");
+  size_t end = line.find(';', start);
+  if (end == std::string::npos)
+    return std::nullopt;
+
+  std::optional<uint32_t> offset = ParseFieldAttribute(line, "offset:");
+  std::optional<uint32_t> size = ParseFieldAttribute(line, "size:");
+  std::optional<uint32_t> is_signed = ParseFieldAttribute(line, "signed:");
+  if (!offset || !size || *offset > UINT16_MAX || *size > UINT16_MAX)
+    return std::nullopt;
+
+  FormatField field;
+  field.type_and_name = base::TrimWhitespace(line.substr(start, end - start));
+  field.offset = static_cast<uint16_t>(*offset);
+  field.size = static_cast<uint16_t>(*size);
+  field.is_signed = is_signed.value_or(0) != 0;
+  return field;
+}
+
+// Returns the name of the field from e.g. "char prev_comm[16]".
+std::string GetFieldName(const std::string& type_and_name) {
+  size_t name_start = type_and_name.rfind(' ');
+  std::string name = name_start == std::string::npos
+                         ? type_and_name
+                         : type_and_name.substr(name_start + 1);
+  size_t array_start = name.find('[');
+  return array_start == std::string::npos ? name : name.substr(0, array_start);
+}
+
+// Returns the decoded type of |field|, or std::nullopt if it isn't supported.
+std::optional<FtraceRawPageDecoder::Field::Type> GetFieldType(
+    const FormatField& field) {
+  using Type = FtraceRawPageDecoder::Field::Type;
+  const std::string& type_and_name = field.type_and_name;
+  if (base::StartsWith(type_and_name, "__data_loc")) {
+    if (type_and_name.find("char") == std::string::npos || field.size != 4)
+      return std::nullopt;
+    return Type::kDataLocString;
+  }
+  if (type_and_name.find('[') != std::string::npos) {
+    if (type_and_name.find("char") == std::string::npos)
+      return std::nullopt;
+    return Type::kString;
+  }
+  if (field.size != 1 && field.size != 2 && field.size != 4 && field.size != 8)
+    return std::nullopt;
+  return field.is_signed ? Type::kInt : Type::kUint;
+}
+
+template <typename T>
+bool ReadAndAdvance(const uint8_t** ptr, const uint8_t* end, T* out) {
+  if (static_cast<size_t>(end - *ptr) < sizeof(T))
+    return false;
+  memcpy(out, *ptr, sizeof(T));
+  *ptr += sizeof(T);
+  return true;
+}
+
+}  // namespace
+
+FtraceRawPageDecoder::FtraceRawPageDecoder() = default;
+FtraceRawPageDecoder::~FtraceRawPageDecoder() = default;
+
+bool FtraceRawPageDecoder::ParseHeaderPageFormat(const std::string& format) {
+  // The event data starts right after the header, at the "data" field.
+  for (base::StringSplitter lines(format, '\n'); lines.Next();) {
+    std::optional<FormatField> field = ParseFieldLine(lines.cur_token());
+    if (field && GetFieldName(field->type_and_name) == "data") {
+      page_header_size_ = field->offset;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FtraceRawPageDecoder::AddEventFormat(const std::string& format) {
+  EventFormat event;
+  std::optional<uint32_t> id;
+  for (base::StringSplitter lines(format, '\n'); lines.Next();) {
+    std::string line = lines.cur_token();
+    if (base::StartsWith(line, "name:")) {
+      event.name = base::TrimWhitespace(line.substr(strlen("name:")));
+      continue;
+    }
+    if (base::StartsWith(line, "ID:")) {
+      id = base::StringToUInt32(
+          base::TrimWhitespace(line.substr(strlen("ID:"))));
+      continue;
+    }
+    std::optional<FormatField> format_field = ParseFieldLine(line);
+    if (!format_field)
+      continue;
+    std::string name = GetFieldName(format_field->type_and_name);
+    if (base::StartsWith(name, "common_")) {
+      if (name == "common_pid" && format_field->size == 4) {
+        event.has_pid = true;
+        event.pid_offset = format_field->offset;
+      }
+      continue;
+    }
+    std::optional<Field::Type> type = GetFieldType(*format_field);
+    if (!type)
+      continue;
+    Field field;
+    field.name = std::move(name);
+    field.type = *type;
+    field.offset = format_field->offset;
+    field.size = format_field->size;
+    event.fields.push_back(std::move(field));
+  }
+  if (!id || *id > UINT16_MAX || event.name.empty())
+    return false;
+  formats_[static_cast<uint16_t>(*id)] = std::move(event);
+  return true;
+}
+
+bool FtraceRawPageDecoder::DecodePage(const uint8_t* page,
+                                      size_t size,
+                                      const EventCallback& on_event) const {
+  if (size < page_header_size_ || page_header_size_ < 12)
+    return false;
+  uint64_t timestamp = 0;
+  uint32_t commit = 0;
+  memcpy(&timestamp, page, sizeof(timestamp));
+  // Only the low 32 bits of the commit field matter (also on 64-bit kernels,
+  // which are little endian).
+  memcpy(&commit, page + sizeof(timestamp), sizeof(commit));
+
+  const uint8_t* ptr = page + page_header_size_;
+  const size_t data_size = commit & kDataSizeMask;
+  if (data_size > size - page_header_size_)
+    return false;
+  const uint8_t* const end = ptr + data_size;
+
+  while (ptr < end) {
+    uint32_t event_header = 0;
+    if (!ReadAndAdvance(&ptr, end, &event_header))
+      return false;
+    const uint32_t type_or_length = event_header & 0x1f;
+    const uint32_t time_delta = event_header >> 5;
+    timestamp += time_delta;
+
+    switch (type_or_length) {
+      case kTypePadding: {
+        // A padding event without delta fills the rest of the page.
+        if (time_delta == 0)
+          return true;
+        uint32_t length = 0;
+        if (!ReadAndAdvance(&ptr, end, &length) || length < 4 ||
+            length - 4 > static_cast<size_t>(end - ptr)) {
+          return false;
+        }
+        ptr += length - 4;
+        break;
+      }
+      case kTypeTimeExtend: {
+        uint32_t time_delta_ext = 0;
+        if (!ReadAndAdvance(&ptr, end, &time_delta_ext))
+          return false;
+        timestamp += static_cast<uint64_t>(time_delta_ext) << 27;
+        break;
+      }
+      case kTypeTimeStamp: {
+        uint32_t time_delta_ext = 0;
+        if (!ReadAndAdvance(&ptr, end, &time_delta_ext))
+          return false;
+        timestamp = time_delta + (static_cast<uint64_t>(time_delta_ext) << 27);
+        break;
+      }
+      default: {
+        PERFETTO_DCHECK(type_or_length <= kTypeDataTypeLengthMax);
+        uint32_t event_size = 4 * type_or_length;
+        if (type_or_length == 0) {
+          if (!ReadAndAdvance(&ptr, end, &event_size))
+            return false;
+          // Zero-filled page tail, see CpuReader::ParsePagePayload().
+          if (event_size == 0 && time_delta == 0)
+            return true;
+          if (event_size < 4)
+            return false;
+          event_size -= 4;
+        }
+        if (event_size < sizeof(uint16_t) ||
+            event_size > static_cast<size_t>(end - ptr)) {
+          return false;
+        }
+        uint16_t event_id = 0;
+        memcpy(&event_id, ptr, sizeof(event_id));
+        const EventFormat* format = formats_.Find(event_id);
+        if (format)
+          on_event(timestamp, *format, ptr, event_size);
+        ptr += event_size;
+      }
+    }
+  }
+  return true;
+}
+
+// static
+std::optional<FtraceRawPageDecoder::FieldValue> FtraceRawPageDecoder::ReadField(
+    const Field& field,
+    const uint8_t* data,
+    size_t size) {
+  if (static_cast<size_t>(field.offset) + field.size > size)
+    return std::nullopt;
+  const uint8_t* ptr = data + field.offset;
+  FieldValue value;
+  value.type = field.type;
+  switch (field.type) {
+    case Field::Type::kInt: {
+      uint64_t raw = 0;
+      memcpy(&raw, ptr, field.size);
+      // Sign-extend from the size of the field.
+      const uint32_t shift = 64 - 8 * field.size;
+      value.int_value = static_cast<int64_t>(raw << shift) >> shift;
+      break;
+    }
+    case Field::Type::kUint:
+      memcpy(&value.uint_value, ptr, field.size);
+      break;
+    case Field::Type::kString: {
+      const char* str = reinterpret_cast<const char*>(ptr);
+      value.str_value = base::StringView(str, strnlen(str, field.size));
+      break;
+    }
+    case Field::Type::kDataLocString: {
+      // The low 16 bits are the offset of the string within the event, the
+      // high 16 bits its length (including the terminator).
+      uint32_t data_loc = 0;
+      memcpy(&data_loc, ptr, sizeof(data_loc));
+      const size_t str_offset = data_loc & 0xffff;
+      const size_t str_size = data_loc >> 16;
+      if (str_offset + str_size > size)
+        return std::nullopt;
+      const char* str = reinterpret_cast<const char*>(data + str_offset);
+      value.str_value = base::StringView(str, strnlen(str, str_size));
+      break;
+    }
+  }
+  return value;
+}
+
+// static
+std::optional<int32_t> FtraceRawPageDecoder::ReadPid(const EventFormat& format,
+                                                     const uint8_t* data,
+                                                     size_t size) {
+  if (!format.has_pid ||
+      static_cast<size_t>(format.pid_offset) + sizeof(int32_t) > size) {
+    return std::nullopt;
+  }
+  int32_t pid = 0;
+  memcpy(&pid, data + format.pid_offset, sizeof(pid));
+  return pid;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_RAW_PAGE_DECODER_H_
+#define SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_RAW_PAGE_DECODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/string_view.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Decodes the binary kernel ring buffer pages recorded by traced_probes when
+// FtraceConfig.raw_pages is set. The layout of the pages and of the events is
+// described by the tracefs format files recorded in the same trace
+// (FtraceEventBundle.RawPagesFormat), which are fed to ParseHeaderPageFormat()
+// and AddEventFormat() before decoding the pages.
+class FtraceRawPageDecoder {
+ public:
+  struct Field {
+    enum class Type { kInt, kUint, kString, kDataLocString };
+    std::string name;
+    Type type = Type::kInt;
+    uint16_t offset = 0;
+    uint16_t size = 0;
+  };
+
+  struct EventFormat {
+    std::string name;
+    uint16_t pid_offset = 0;
+    bool has_pid = false;
+    // Fields with a type that can be decoded, in order. Excludes the common
+    // fields.
+    std::vector<Field> fields;
+  };
+
+  struct FieldValue {
+    Field::Type type = Field::Type::kInt;
+    int64_t int_value = 0;
+    uint64_t uint_value = 0;
+    base::StringView str_value;
+  };
+
+  using EventCallback = std::function<void(uint64_t timestamp,
+                                           const EventFormat&,
+                                           const uint8_t* data,
+                                           size_t size)>;
+
+  FtraceRawPageDecoder();
+  ~FtraceRawPageDecoder();
+
+  // Parses the contents of tracefs' events/header_page. If never called, the
+  // layout of 64-bit kernels is assumed.
+  bool ParseHeaderPageFormat(const std::string& format);
+
+  // Parses the contents of tracefs' events/<group>/<name>/format. Returns
+  // false if the format is malformed.
+  bool AddEventFormat(const std::string& format);
+
+  // Calls |on_event| for each event in |page| (of |size| bytes, possibly
+  // trimmed after the end of the committed data) with a known format. Events
+  // with an unknown format are skipped. Returns false if the page is
+  // malformed, in which case only the events before the error were reported.
+  bool DecodePage(const uint8_t* page,
+                  size_t size,
+                  const EventCallback& on_event) const;
+
+  // Reads the value of |field| (or of the common_pid field) from the |data| of
+  // an event reported by DecodePage(). Returns std::nullopt if the event is too
+  // short for the field.
+  static std::optional<FieldValue> ReadField(const Field& field,
+                                             const uint8_t* data,
+                                             size_t size);
+  static std::optional<int32_t> ReadPid(const EventFormat& format,
+                                        const uint8_t* data,
+                                        size_t size);
+
+ private:
+  size_t page_header_size_ = 16;
+  base::FlatHashMap<uint16_t, EventFormat> formats_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_RAW_PAGE_DECODER_H_
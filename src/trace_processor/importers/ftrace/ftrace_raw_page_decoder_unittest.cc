@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/ftrace/ftrace_raw_page_decoder.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr char kHeaderPage[] =
+    "\tfield: u64 timestamp;\toffset:0;\tsize:8;\tsigned:0;\n"
+    "\tfield: local_t commit;\toffset:8;\tsize:8;\tsigned:1;\n"
+    "\tfield: int overwrite;\toffset:8;\tsize:1;\tsigned:1;\n"
+    "\tfield: char data;\toffset:16;\tsize:4080;\tsigned:1;\n";
+
+constexpr char kTestEventFormat[] =
+    "name: test_event\n"
+    "ID: 42\n"
+    "format:\n"
+    "\tfield:unsigned short common_type;\toffset:0;\tsize:2;\tsigned:0;\n"
+    "\tfield:unsigned char common_flags;\toffset:2;\tsize:1;\tsigned:0;\n"
+    "\tfield:unsigned char common_preempt_count;\toffset:3;\tsize:1;\t"
+    "signed:0;\n"
+    "\tfield:int common_pid;\toffset:4;\tsize:4;\tsigned:1;\n"
+    "\n"
+    "\tfield:char comm[8];\toffset:8;\tsize:8;\tsigned:1;\n"
+    "\tfield:int value;\toffset:16;\tsize:4;\tsigned:1;\n"
+    "\tfield:u16 flags;\toffset:20;\tsize:2;\tsigned:0;\n"
+    "\tfield:__data_loc char[] msg;\toffset:24;\tsize:4;\tsigned:1;\n"
+    "\tfield:unsigned long stack[2];\toffset:28;\tsize:16;\tsigned:0;\n"
+    "\n"
+    "print fmt: \"comm=%s\", REC->comm\n";
+
+class PageBuilder {
+ public:
+  explicit PageBuilder(uint64_t timestamp) { Append(timestamp); }
+
+  // Appends a data record of |payload| (padded to 4 bytes) |delta| ns after
+  // the previous one.
+  void AddEvent(uint32_t delta, std::vector<uint8_t> payload) {
+    payload.resize((payload.size() + 3) / 4 * 4);
+    Append((delta << 5) | static_cast<uint32_t>(payload.size() / 4));
+    data_.insert(data_.end(), payload.begin(), payload.end());
+  }
+
+  void AddTimeExtend(uint32_t delta, uint32_t extend) {
+    Append((delta << 5) | 30u);
+    Append(extend);
+  }
+
+  std::vector<uint8_t> Build() {
+    std::vector<uint8_t> page = header_;
+    uint64_t commit = data_.size();
+    page.resize(16);
+    memcpy(page.data() + 8, &commit, sizeof(commit));
+    page.insert(page.end(), data_.begin(), data_.end());
+    return page;
+  }
+
+ private:
+  template <typename T>
+  void Append(T value) {
+    std::vector<uint8_t>& out = header_.empty() ? header_ : data_;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+  }
+
+  std::vector<uint8_t> header_;
+  std::vector<uint8_t> data_;
+};
+
+std::vector<uint8_t> TestEventPayload(int32_t pid,
+                                      const char* comm,
+                                      int32_t value,
+                                      const char* msg) {
+  std::vector<uint8_t> payload(44);
+  uint16_t id = 42;
+  memcpy(&payload[0], &id, sizeof(id));
+  memcpy(&payload[4], &pid, sizeof(pid));
+  strncpy(reinterpret_cast<char*>(&payload[8]), comm, 8);
+  memcpy(&payload[16], &value, sizeof(value));
+  uint16_t flags = 0xffff;
+  memcpy(&payload[20], &flags, sizeof(flags));
+  uint32_t msg_size = static_cast<uint32_t>(strlen(msg) + 1);
+  uint32_t data_loc = (msg_size << 16) | static_cast<uint32_t>(payload.size());
+  memcpy(&payload[24], &data_loc, sizeof(data_loc));
+  payload.insert(payload.end(), msg, msg + msg_size);
+  return payload;
+}
+
+struct DecodedEvent {
+  uint64_t timestamp;
+  std::string name;
+  const uint8_t* data;
+  size_t size;
+};
+
+std::vector<DecodedEvent> Decode(const FtraceRawPageDecoder& decoder,
+                                 const std::vector<uint8_t>& page,
+                                 bool* ok) {
+  std::vector<DecodedEvent> events;
+  *ok = decoder.DecodePage(
+      page.data(), page.size(),
+      [&events](uint64_t ts, const FtraceRawPageDecoder::EventFormat& format,
+                const uint8_t* data, size_t size) {
+        events.push_back({ts, format.name, data, size});
+      });
+  return events;
+}
+
+TEST(FtraceRawPageDecoderTest, ParsesEventFormat) {
+  FtraceRawPageDecoder decoder;
+  ASSERT_TRUE(decoder.ParseHeaderPageFormat(kHeaderPage));
+  ASSERT_TRUE(decoder.AddEventFormat(kTestEventFormat));
+  EXPECT_FALSE(decoder.AddEventFormat("name: no_id\n"));
+
+  PageBuilder builder(1000);
+  builder.AddEvent(10, TestEventPayload(123, "comm", -5, "hello"));
+  std::vector<uint8_t> page = builder.Build();
+
+  bool ok = false;
+  std::vector<DecodedEvent> events = Decode(decoder, page, &ok);
+  ASSERT_TRUE(ok);
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(events[0].timestamp, 1010u);
+  EXPECT_EQ(events[0].name, "test_event");
+}
+
+TEST(FtraceRawPageDecoderTest, ReadsFields) {
+  FtraceRawPageDecoder decoder;
+  ASSERT_TRUE(decoder.AddEventFormat(kTestEventFormat));
+  PageBuilder builder(0);
+  builder.AddEvent(0, TestEventPayload(123, "comm", -5, "hello"));
+  std::vector<uint8_t> page = builder.Build();
+
+  const FtraceRawPageDecoder::EventFormat* format = nullptr;
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  ASSERT_TRUE(decoder.DecodePage(
+      page.data(), page.size(),
+      [&](uint64_t, const FtraceRawPageDecoder::EventFormat& f,
+          const uint8_t* d, size_t s) {
+        format = &f;
+        data = d;
+        size = s;
+      }));
+  ASSERT_NE(format, nullptr);
+
+  EXPECT_EQ(FtraceRawPageDecoder::ReadPid(*format, data, size), 123);
+
+  // The array of longs can't be decoded and is skipped.
+  ASSERT_EQ(format->fields.size(), 4u);
+  using Type = FtraceRawPageDecoder::Field::Type;
+  auto comm = FtraceRawPageDecoder::ReadField(format->fields[0], data, size);
+  ASSERT_TRUE(comm);
+  EXPECT_EQ(format->fields[0].name, "comm");
+  EXPECT_EQ(comm->type, Type::kString);
+  EXPECT_EQ(comm->str_value.ToStdString(), "comm");
+
+  auto value = FtraceRawPageDecoder::ReadField(format->fields[1], data, size);
+  ASSERT_TRUE(value);
+  EXPECT_EQ(value->type, Type::kInt);
+  EXPECT_EQ(value->int_value, -5);
+
+  auto flags = FtraceRawPageDecoder::ReadField(format->fields[2], data, size);
+  ASSERT_TRUE(flags);
+  EXPECT_EQ(flags->type, Type::kUint);
+  EXPECT_EQ(flags->uint_value, 0xffffu);
+
+  auto msg = FtraceRawPageDecoder::ReadField(format->fields[3], data, size);
+  ASSERT_TRUE(msg);
+  EXPECT_EQ(format->fields[3].name, "msg");
+  EXPECT_EQ(msg->type, Type::kDataLocString);
+  EXPECT_EQ(msg->str_value.ToStdString(), "hello");
+}
+
+TEST(FtraceRawPageDecoderTest, TimestampsAndUnknownEvents) {
+  FtraceRawPageDecoder decoder;
+  ASSERT_TRUE(decoder.AddEventFormat(kTestEventFormat));
+
+  std::vector<uint8_t> unknown_event(8);
+  uint16_t unknown_id = 7;
+  memcpy(&unknown_event[0], &unknown_id, sizeof(unknown_id));
+
+  PageBuilder builder(100);
+  builder.AddEvent(1, TestEventPayload(1, "a", 0, ""));
+  builder.AddEvent(2, unknown_event);
+  builder.AddTimeExtend(3, 1);
+  builder.AddEvent(4, TestEventPayload(2, "b", 0, ""));
+  std::vector<uint8_t> page = builder.Build();
+
+  bool ok = false;
+  std::vector<DecodedEvent> events = Decode(decoder, page, &ok);
+  ASSERT_TRUE(ok);
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(events[0].timestamp, 101u);
+  EXPECT_EQ(events[1].timestamp, 101u + 2 + 3 + (1u << 27) + 4);
+}
+
+TEST(FtraceRawPageDecoderTest, RejectsTruncatedPages) {
+  FtraceRawPageDecoder decoder;
+  ASSERT_TRUE(decoder.AddEventFormat(kTestEventFormat));
+  PageBuilder builder(0);
+  builder.AddEvent(0, TestEventPayload(1, "a", 0, "msg"));
+  std::vector<uint8_t> page = builder.Build();
+  page.resize(page.size() - 4);
+
+  bool ok = true;
+  Decode(decoder, page, &ok);
+  EXPECT_FALSE(ok);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -19,6 +19,7 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
 #include "src/trace_processor/importers/proto/packet_sequence_state.h"
 #include "src/trace_processor/sorter/trace_sorter.h"
 #include "src/trace_processor/storage/stats.h"
@@ -27,6 +28,7 @@
 #include "protos/perfetto/common/builtin_clock.pbzero.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/ftrace/generic.pbzero.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -111,9 +113,179 @@ base::Status FtraceTokenizer::TokenizeFtraceBundle(
     TokenizeFtraceEvent(cpu, clock_id, bundle.slice(it->data(), it->size()),
                         state);
   }
+
+  if (decoder.has_compact_events()) {
+    TokenizeFtraceCompactEvents(cpu, clock_id, decoder.compact_events(), state);
+  }
+
+  if (decoder.has_raw_pages_format()) {
+    FtraceEventBundle::RawPagesFormat::Decoder format(
+        decoder.raw_pages_format());
+    if (format.has_header_page() &&
+        !raw_page_decoder_.ParseHeaderPageFormat(
+            format.header_page().ToStdString())) {
+      context_->storage->IncrementStats(stats::ftrace_bundle_tokenizer_errors);
+    }
+    for (auto it = format.event_format(); it; ++it) {
+      if (!raw_page_decoder_.AddEventFormat(it->ToStdString())) {
+        context_->storage->IncrementStats(
+            stats::ftrace_bundle_tokenizer_errors);
+      }
+    }
+  }
+  for (auto it = decoder.raw_pages(); it; ++it) {
+    TokenizeFtraceRawPage(cpu, clock_id, *it, state);
+  }
   return base::OkStatus();
 }
 
+// Converts the events of a raw kernel ring buffer page into generic ftrace
+// events, which are then tokenized like the ones of a regular bundle.
+void FtraceTokenizer::TokenizeFtraceRawPage(uint32_t cpu,
+                                            ClockTracker::ClockId clock_id,
+                                            protozero::ConstBytes page,
+                                            PacketSequenceState* state) {
+  using Field = FtraceRawPageDecoder::Field;
+  bool ok = raw_page_decoder_.DecodePage(
+      page.data, page.size,
+      [&](uint64_t timestamp, const FtraceRawPageDecoder::EventFormat& format,
+          const uint8_t* data, size_t size) {
+        protozero::HeapBuffered<protos::pbzero::FtraceEvent> event;
+        event->set_timestamp(timestamp);
+        std::optional<int32_t> pid =
+            FtraceRawPageDecoder::ReadPid(format, data, size);
+        if (pid)
+          event->set_pid(static_cast<uint32_t>(*pid));
+        auto* generic = event->set_generic();
+        generic->set_event_name(format.name);
+        for (const Field& field : format.fields) {
+          std::optional<FtraceRawPageDecoder::FieldValue> value =
+              FtraceRawPageDecoder::ReadField(field, data, size);
+          if (!value)
+            continue;
+          auto* generic_field = generic->add_field();
+          generic_field->set_name(field.name);
+          switch (value->type) {
+            case Field::Type::kInt:
+              generic_field->set_int_value(value->int_value);
+              break;
+            case Field::Type::kUint:
+              generic_field->set_uint_value(value->uint_value);
+              break;
+            case Field::Type::kString:
+            case Field::Type::kDataLocString:
+              generic_field->set_str_value(value->str_value.data(),
+                                           value->str_value.size());
+              break;
+          }
+        }
+        std::vector<uint8_t> serialized = event.SerializeAsArray();
+        TraceBlob blob =
+            TraceBlob::CopyFrom(serialized.data(), serialized.size());
+        TokenizeFtraceEvent(cpu, clock_id, TraceBlobView(std::move(blob)),
+                            state);
+      });
+  if (!ok)
+    context_->storage->IncrementStats(stats::ftrace_bundle_tokenizer_errors);
+}
+
+// Converts the columns of the compact_events encoding back into the FtraceEvent
+// protos that traced_probes would have written without it, which are then
+// tokenized like the ones of a regular bundle.
+void FtraceTokenizer::TokenizeFtraceCompactEvents(
+    uint32_t cpu,
+    ClockTracker::ClockId clock_id,
+    protozero::ConstBytes packet,
+    PacketSequenceState* state) {
+  using Field = FtraceEventBundle::CompactEvents::Field;
+  using VarIntIterator = protozero::PackedRepeatedFieldIterator<
+      protozero::proto_utils::ProtoWireType::kVarInt, uint64_t>;
+
+  FtraceEventBundle::CompactEvents::Decoder compact(packet);
+  std::vector<protozero::ConstChars>& string_table =
+      compact_events_string_table_;
+  string_table.clear();
+  for (auto it = compact.intern_table(); it; ++it)
+    string_table.push_back(*it);
+
+  bool parse_error = false;
+  protozero::HeapBuffered<protos::pbzero::FtraceEvent> event;
+  for (auto event_it = compact.event(); event_it; ++event_it) {
+    FtraceEventBundle::CompactEvents::Event::Decoder columns(*event_it);
+
+    // The fields are stored in a structure-of-arrays style, using packed
+    // repeated fields. Walk each repeated field in step to recover individual
+    // events.
+    struct FieldColumn {
+      uint32_t id;
+      bool is_string;
+      VarIntIterator it;
+    };
+    std::vector<FieldColumn> fields;
+    for (auto field_it = columns.field(); field_it; ++field_it) {
+      Field::Decoder field(*field_it);
+      bool is_string = field.has_string_index();
+      fields.push_back(FieldColumn{
+          field.id(), is_string,
+          is_string ? field.string_index(&parse_error)
+                    : field.varint(&parse_error)});
+    }
+
+    // Accumulator for timestamp deltas.
+    uint64_t timestamp_acc = 0;
+    auto timestamp_it = columns.timestamp(&parse_error);
+    auto pid_it = columns.pid(&parse_error);
+    const bool has_pid = static_cast<bool>(pid_it);
+    for (; timestamp_it; ++timestamp_it) {
+      timestamp_acc += *timestamp_it;
+      event.Reset();
+      event->set_timestamp(timestamp_acc);
+      if (has_pid) {
+        if (!pid_it) {
+          parse_error = true;
+          break;
+        }
+        event->set_pid(*pid_it);
+        ++pid_it;
+      }
+      auto* nested =
+          event->BeginNestedMessage<protozero::Message>(columns.id());
+      for (FieldColumn& field : fields) {
+        if (!field.it) {
+          parse_error = true;
+          break;
+        }
+        uint64_t value = *field.it;
+        ++field.it;
+        if (!field.is_string) {
+          nested->AppendVarInt(field.id, value);
+        } else if (value < string_table.size()) {
+          const protozero::ConstChars& str =
+              string_table[static_cast<size_t>(value)];
+          nested->AppendBytes(field.id, str.data, str.size);
+        } else {
+          parse_error = true;
+        }
+      }
+      if (parse_error)
+        break;
+      std::vector<uint8_t> serialized = event.SerializeAsArray();
+      TraceBlob blob = TraceBlob::CopyFrom(serialized.data(), serialized.size());
+      TokenizeFtraceEvent(cpu, clock_id, TraceBlobView(std::move(blob)), state);
+    }
+
+    // Check that all the columns were fully decoded.
+    if (has_pid && pid_it)
+      parse_error = true;
+    for (const FieldColumn& field : fields)
+      parse_error |= static_cast<bool>(field.it);
+    if (parse_error)
+      break;
+  }
+  if (parse_error)
+    context_->storage->IncrementStats(stats::ftrace_bundle_tokenizer_errors);
+}
+
 PERFETTO_ALWAYS_INLINE
 void FtraceTokenizer::TokenizeFtraceEvent(uint32_t cpu,
                                           ClockTracker::ClockId clock_id,
@@ -170,22 +342,70 @@ void FtraceTokenizer::TokenizeFtraceCompactSched(uint32_t cpu,
   FtraceEventBundle::CompactSched::Decoder compact_sched(packet);
 
   // Build the interning table for comm fields.
-  std::vector<StringId> string_table;
-  string_table.reserve(512);
+  std::vector<StringId>& string_table = compact_sched_string_table_;
+  string_table.clear();
   for (auto it = compact_sched.intern_table(); it; it++) {
     StringId value = context_->storage->InternString(*it);
     string_table.push_back(value);
   }
 
-  TokenizeFtraceCompactSchedSwitch(cpu, clock_id, compact_sched, string_table);
-  TokenizeFtraceCompactSchedWaking(cpu, clock_id, compact_sched, string_table);
+  // Each kind of event is stored column by column, with timestamps sorted
+  // within the kind. Decode both kinds in full and merge them so that the
+  // events of this cpu reach the sorter in order: pushing all the switches
+  // then all the wakings would force the sorter to sort the cpu queue.
+  DecodeFtraceCompactSchedSwitch(clock_id, compact_sched, string_table);
+  DecodeFtraceCompactSchedWaking(clock_id, compact_sched, string_table);
+
+  auto switch_it = compact_sched_switches_.begin();
+  auto waking_it = compact_sched_wakings_.begin();
+  while (switch_it != compact_sched_switches_.end() ||
+         waking_it != compact_sched_wakings_.end()) {
+    // On ties, switches go first as they did when they were pushed first.
+    bool take_switch = waking_it == compact_sched_wakings_.end() ||
+                       (switch_it != compact_sched_switches_.end() &&
+                        switch_it->first <= waking_it->first);
+    if (take_switch) {
+      context_->sorter->PushInlineFtraceEvent(cpu, switch_it->first,
+                                              switch_it->second);
+      ++switch_it;
+    } else {
+      context_->sorter->PushInlineFtraceEvent(cpu, waking_it->first,
+                                              waking_it->second);
+      ++waking_it;
+    }
+  }
 }
 
-void FtraceTokenizer::TokenizeFtraceCompactSchedSwitch(
-    uint32_t cpu,
+template <typename Event>
+void FtraceTokenizer::ResolveCompactSchedTimes(
+    ClockTracker::ClockId clock_id,
+    std::vector<std::pair<int64_t, Event>>* events) {
+  // On most traces (i.e. P+), the clock should be BOOTTIME.
+  if (PERFETTO_LIKELY(clock_id == BuiltinClock::BUILTIN_CLOCK_BOOTTIME))
+    return;
+
+  std::vector<int64_t>& timestamps = compact_sched_timestamps_;
+  timestamps.clear();
+  for (const auto& event : *events)
+    timestamps.push_back(event.first);
+
+  size_t converted = 0;
+  base::Status status = context_->clock_tracker->ToTraceTime(
+      clock_id, timestamps.data(), timestamps.size(), &converted);
+  if (!status.ok())
+    DlogWithLimit(status);
+  events->erase(events->begin() + static_cast<ptrdiff_t>(converted),
+                events->end());
+  for (size_t i = 0; i < converted; ++i)
+    (*events)[i].first = timestamps[i];
+}
+
+void FtraceTokenizer::DecodeFtraceCompactSchedSwitch(
     ClockTracker::ClockId clock_id,
     const FtraceEventBundle::CompactSched::Decoder& compact,
     const std::vector<StringId>& string_table) {
+  compact_sched_switches_.clear();
+
   // Accumulator for timestamp deltas.
   int64_t timestamp_acc = 0;
 
@@ -214,13 +434,7 @@ void FtraceTokenizer::TokenizeFtraceCompactSchedSwitch(
     event.next_pid = *npid_it;
     event.next_prio = *nprio_it;
 
-    base::StatusOr<int64_t> timestamp =
-        ResolveTraceTime(context_, clock_id, event_timestamp);
-    if (!timestamp.ok()) {
-      DlogWithLimit(timestamp.status());
-      return;
-    }
-    context_->sorter->PushInlineFtraceEvent(cpu, *timestamp, event);
+    compact_sched_switches_.emplace_back(event_timestamp, event);
   }
 
   // Check that all packed buffers were decoded correctly, and fully.
@@ -228,13 +442,16 @@ void FtraceTokenizer::TokenizeFtraceCompactSchedSwitch(
       !timestamp_it && !pstate_it && !npid_it && !nprio_it && !comm_it;
   if (parse_error || !sizes_match)
     context_->storage->IncrementStats(stats::compact_sched_has_parse_errors);
+
+  ResolveCompactSchedTimes(clock_id, &compact_sched_switches_);
 }
 
-void FtraceTokenizer::TokenizeFtraceCompactSchedWaking(
-    uint32_t cpu,
+void FtraceTokenizer::DecodeFtraceCompactSchedWaking(
     ClockTracker::ClockId clock_id,
     const FtraceEventBundle::CompactSched::Decoder& compact,
     const std::vector<StringId>& string_table) {
+  compact_sched_wakings_.clear();
+
   // Accumulator for timestamp deltas.
   int64_t timestamp_acc = 0;
 
@@ -270,13 +487,7 @@ void FtraceTokenizer::TokenizeFtraceCompactSchedWaking(
       common_flags_it++;
     }
 
-    base::StatusOr<int64_t> timestamp =
-        ResolveTraceTime(context_, clock_id, event_timestamp);
-    if (!timestamp.ok()) {
-      DlogWithLimit(timestamp.status());
-      return;
-    }
-    context_->sorter->PushInlineFtraceEvent(cpu, *timestamp, event);
+    compact_sched_wakings_.emplace_back(event_timestamp, event);
   }
 
   // Check that all packed buffers were decoded correctly, and fully.
@@ -284,6 +495,8 @@ void FtraceTokenizer::TokenizeFtraceCompactSchedWaking(
       !timestamp_it && !pid_it && !tcpu_it && !prio_it && !comm_it;
   if (parse_error || !sizes_match)
     context_->storage->IncrementStats(stats::compact_sched_has_parse_errors);
+
+  ResolveCompactSchedTimes(clock_id, &compact_sched_wakings_);
 }
 
 void FtraceTokenizer::HandleFtraceClockSnapshot(int64_t ftrace_ts,
@@ -17,8 +17,15 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_TOKENIZER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_TOKENIZER_H_
 
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
 #include "perfetto/trace_processor/trace_blob_view.h"
 #include "src/trace_processor/importers/common/clock_tracker.h"
+#include "src/trace_processor/importers/common/parser_types.h"
+#include "src/trace_processor/importers/ftrace/ftrace_raw_page_decoder.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 
@@ -43,19 +50,33 @@ class FtraceTokenizer {
                            ClockTracker::ClockId,
                            TraceBlobView event,
                            PacketSequenceState* state);
+  void TokenizeFtraceRawPage(uint32_t cpu,
+                             ClockTracker::ClockId,
+                             protozero::ConstBytes page,
+                             PacketSequenceState* state);
+  void TokenizeFtraceCompactEvents(uint32_t cpu,
+                                   ClockTracker::ClockId,
+                                   protozero::ConstBytes,
+                                   PacketSequenceState* state);
   void TokenizeFtraceCompactSched(uint32_t cpu,
                                   ClockTracker::ClockId,
                                   protozero::ConstBytes);
-  void TokenizeFtraceCompactSchedSwitch(
-      uint32_t cpu,
+  // Decode the compact_sched events of one kind into
+  // |compact_sched_switches_| or |compact_sched_wakings_|.
+  void DecodeFtraceCompactSchedSwitch(
       ClockTracker::ClockId,
       const protos::pbzero::FtraceEventBundle::CompactSched::Decoder& compact,
       const std::vector<StringId>& string_table);
-  void TokenizeFtraceCompactSchedWaking(
-      uint32_t cpu,
+  void DecodeFtraceCompactSchedWaking(
       ClockTracker::ClockId,
       const protos::pbzero::FtraceEventBundle::CompactSched::Decoder& compact,
       const std::vector<StringId>& string_table);
+  // Converts the timestamps of the decoded compact_sched |events| to trace
+  // time in one batch, dropping the events from the first one which can't be
+  // converted.
+  template <typename Event>
+  void ResolveCompactSchedTimes(ClockTracker::ClockId,
+                                std::vector<std::pair<int64_t, Event>>* events);
 
   void HandleFtraceClockSnapshot(int64_t ftrace_ts,
                                  int64_t boot_ts,
@@ -68,6 +89,22 @@ class FtraceTokenizer {
   }
 
   int64_t latest_ftrace_clock_snapshot_ts_ = 0;
+
+  // Interned comms of the compact_sched bundle being tokenized. Kept across
+  // bundles to avoid reallocating it for each of them.
+  std::vector<StringId> compact_sched_string_table_;
+  // Decoded (timestamp, event) pairs of the compact_sched bundle being
+  // tokenized, reused across bundles for the same reason.
+  std::vector<std::pair<int64_t, InlineSchedSwitch>> compact_sched_switches_;
+  std::vector<std::pair<int64_t, InlineSchedWaking>> compact_sched_wakings_;
+  // Scratch space for converting the timestamps of the above in one batch.
+  std::vector<int64_t> compact_sched_timestamps_;
+  // Interned strings of the compact_events bundle being tokenized, reused
+  // across bundles.
+  std::vector<protozero::ConstChars> compact_events_string_table_;
+  // Decodes the pages of FtraceConfig.raw_pages traces, using the formats
+  // recorded in the trace.
+  FtraceRawPageDecoder raw_page_decoder_;
   TraceProcessorContext* context_;
 };
 
@@ -310,10 +310,9 @@ uint32_t SchedEventTracker::AddRawEventAndStartSlice(uint32_t cpu,
   // just switched to. Set the duration to -1, to indicate that the event is not
   // finished. Duration will be updated later after event finish.
   auto* sched = context_->storage->mutable_sched_slice_table();
-  auto row_and_id = sched->Insert(
-      {ts, /* duration */ -1, cpu, next_utid, kNullStringId, next_prio});
-  SchedId sched_id = row_and_id.id;
-  return *sched->id().IndexOf(sched_id);
+  return sched
+      ->Insert({ts, /* duration */ -1, cpu, next_utid, kNullStringId, next_prio})
+      .row;
 }
 
 StringId SchedEventTracker::TaskStateToStringId(int64_t task_state_int) {
@@ -321,11 +320,23 @@ StringId SchedEventTracker::TaskStateToStringId(int64_t task_state_int) {
 
   std::optional<VersionNumber> kernel_version =
       SystemInfoTracker::GetOrCreate(context_)->GetKernelVersion();
-  TaskState task_state = TaskState::FromRawPrevState(
-      static_cast<uint16_t>(task_state_int), kernel_version);
-  return task_state.is_valid()
-             ? context_->storage->InternString(task_state.ToString().data())
-             : kNullStringId;
+  if (PERFETTO_UNLIKELY(!(kernel_version == task_state_kernel_version_))) {
+    task_state_ids_.clear();
+    task_state_kernel_version_ = kernel_version;
+  }
+
+  auto raw_state = static_cast<uint16_t>(task_state_int);
+  if (raw_state >= task_state_ids_.size())
+    task_state_ids_.resize(raw_state + 1u);
+  std::optional<StringId>& id = task_state_ids_[raw_state];
+  if (PERFETTO_LIKELY(id.has_value()))
+    return *id;
+
+  TaskState task_state = TaskState::FromRawPrevState(raw_state, kernel_version);
+  id = task_state.is_valid()
+           ? context_->storage->InternString(task_state.ToString().data())
+           : kNullStringId;
+  return *id;
 }
 
 PERFETTO_ALWAYS_INLINE
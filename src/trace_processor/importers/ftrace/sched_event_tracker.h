@@ -19,12 +19,15 @@
 
 #include <array>
 #include <limits>
+#include <optional>
+#include <vector>
 
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/utils.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/types/destructible.h"
 #include "src/trace_processor/types/trace_processor_context.h"
+#include "src/trace_processor/types/version_number.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -105,6 +108,8 @@ class SchedEventTracker : public Destructible {
                                     StringId next_comm_id,
                                     int32_t next_prio);
 
+  // Returns the interned string for the raw |task_state| of a sched_switch,
+  // kNullStringId if it is not valid.
   StringId TaskStateToStringId(int64_t task_state);
 
   void ClosePendingSlice(uint32_t slice_idx, int64_t ts, StringId prev_state);
@@ -130,6 +135,13 @@ class SchedEventTracker : public Destructible {
 
   StringId waker_utid_id_;
 
+  // Cache for TaskStateToStringId(), indexed by raw task state: decoding and
+  // interning the state on every sched_switch dominates parsing otherwise.
+  // Only valid for |task_state_kernel_version_| as the decoding depends on
+  // the kernel version.
+  std::vector<std::optional<StringId>> task_state_ids_;
+  std::optional<VersionNumber> task_state_kernel_version_;
+
   TraceProcessorContext* const context_;
 };
 
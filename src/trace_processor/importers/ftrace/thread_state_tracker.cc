@@ -31,10 +31,8 @@ void ThreadStateTracker::PushSchedSwitchEvent(int64_t event_ts,
                                               UniqueTid next_utid) {
   // Code related to previous utid. If the thread wasn't running before we know
   // we lost data and should close the slice accordingly.
-  bool data_loss_cond =
-      HasPreviousRowNumbersForUtid(prev_utid) &&
-      !IsRunning(RowNumToRef(prev_row_numbers_for_thread_[prev_utid]->last_row)
-                     .state());
+  bool data_loss_cond = HasPreviousRowNumbersForUtid(prev_utid) &&
+                        !IsRunning(thread_states_[prev_utid].last_state);
   ClosePendingState(event_ts, prev_utid, data_loss_cond);
   AddOpenState(event_ts, prev_utid, prev_state);
 
@@ -61,13 +59,13 @@ void ThreadStateTracker::PushWakingEvent(int64_t event_ts,
     return;
   }
 
-  auto last_row_ref = RowNumToRef(prev_row_numbers_for_thread_[utid]->last_row);
+  const ThreadState& thread_state = thread_states_[utid];
 
   // Occasionally, it is possible to get a waking event for a thread
   // which is already in a runnable state. When this happens (or if the thread
   // is running), we just ignore the waking event. See b/186509316 for details
   // and an example on when this happens. Only blocked events can be waken up.
-  if (!IsBlocked(last_row_ref.state())) {
+  if (!IsBlocked(thread_state.last_state)) {
     // If we receive a waking event while we are not blocked, we ignore this
     // in the |thread_state| table but we track in the |sched_wakeup| table.
     // The |thread_state_id| in |sched_wakeup| is the current running/runnable
@@ -77,8 +75,7 @@ void ThreadStateTracker::PushWakingEvent(int64_t event_ts,
             ? std::make_optional(CommonFlagsToIrqContext(*common_flags))
             : std::nullopt;
     storage_->mutable_spurious_sched_wakeup_table()->Insert(
-        {event_ts, prev_row_numbers_for_thread_[utid]->last_row.row_number(),
-         irq_context, utid, waker_utid});
+        {event_ts, thread_state.last_row, irq_context, utid, waker_utid});
     return;
   }
 
@@ -103,12 +100,11 @@ void ThreadStateTracker::PushBlockedReason(
     return;
 
   // Return if no previous bocked row exists.
-  auto blocked_row_number =
-      prev_row_numbers_for_thread_[utid]->last_blocked_row;
-  if (!blocked_row_number.has_value())
+  uint32_t blocked_row = thread_states_[utid].last_blocked_row;
+  if (blocked_row == ThreadState::kNoRow)
     return;
 
-  auto row_reference = RowNumToRef(blocked_row_number.value());
+  auto row_reference = RowNumToRef(blocked_row);
   if (io_wait.has_value()) {
     row_reference.set_io_wait(*io_wait);
   }
@@ -140,23 +136,21 @@ void ThreadStateTracker::AddOpenState(int64_t ts,
     row.irq_context = CommonFlagsToIrqContext(*common_flags);
   }
 
-  auto row_num = storage_->mutable_thread_state_table()->Insert(row).row_number;
+  uint32_t row_num = storage_->mutable_thread_state_table()->Insert(row).row;
 
-  if (utid >= prev_row_numbers_for_thread_.size()) {
-    prev_row_numbers_for_thread_.resize(utid + 1);
-  }
-
-  if (!prev_row_numbers_for_thread_[utid].has_value()) {
-    prev_row_numbers_for_thread_[utid] = RelatedRows{std::nullopt, row_num};
+  if (utid >= thread_states_.size()) {
+    thread_states_.resize(utid + 1);
   }
 
+  ThreadState& thread_state = thread_states_[utid];
   if (IsRunning(state)) {
-    prev_row_numbers_for_thread_[utid] = RelatedRows{std::nullopt, row_num};
+    thread_state.last_blocked_row = ThreadState::kNoRow;
   } else if (IsBlocked(state)) {
-    prev_row_numbers_for_thread_[utid] = RelatedRows{row_num, row_num};
-  } else /* if (IsRunnable(state)) */ {
-    prev_row_numbers_for_thread_[utid]->last_row = row_num;
+    thread_state.last_blocked_row = row_num;
   }
+  thread_state.last_row = row_num;
+  thread_state.last_ts = ts;
+  thread_state.last_state = state;
 }
 
 uint32_t ThreadStateTracker::CommonFlagsToIrqContext(uint32_t common_flags) {
@@ -174,11 +168,10 @@ void ThreadStateTracker::ClosePendingState(int64_t end_ts,
   if (!HasPreviousRowNumbersForUtid(utid))
     return;
 
-  auto row_ref = RowNumToRef(prev_row_numbers_for_thread_[utid]->last_row);
-
   // Update the duration only for states without data loss.
   if (!data_loss) {
-    row_ref.set_dur(end_ts - row_ref.ts());
+    const ThreadState& thread_state = thread_states_[utid];
+    RowNumToRef(thread_state.last_row).set_dur(end_ts - thread_state.last_ts);
   }
 }
 
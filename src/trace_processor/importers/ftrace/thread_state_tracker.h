@@ -16,6 +16,11 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_THREAD_STATE_TRACKER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_THREAD_STATE_TRACKER_H_
 
+#include <stdint.h>
+
+#include <limits>
+#include <vector>
+
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/types/destructible.h"
 #include "src/trace_processor/types/trace_processor_context.h"
@@ -78,14 +83,29 @@ class ThreadStateTracker : public Destructible {
   bool IsBlocked(StringId state);
   bool IsRunnable(StringId state);
 
+  // State of a thread as of its last row in the thread_state table. This is
+  // all the tracker needs to know about previous rows so keeping it here
+  // avoids going back to the table columns on every event.
+  struct ThreadState {
+    static constexpr uint32_t kNoRow = std::numeric_limits<uint32_t>::max();
+
+    // Row of the last state of the thread, kNoRow if there is none.
+    uint32_t last_row = kNoRow;
+    // Row of the last blocked state of the thread if the thread has not run
+    // since, kNoRow otherwise.
+    uint32_t last_blocked_row = kNoRow;
+    int64_t last_ts = 0;
+    StringId last_state = kNullStringId;
+  };
+
   bool HasPreviousRowNumbersForUtid(UniqueTid utid) {
-    return utid < prev_row_numbers_for_thread_.size() &&
-           prev_row_numbers_for_thread_[utid].has_value();
+    return utid < thread_states_.size() &&
+           thread_states_[utid].last_row != ThreadState::kNoRow;
   }
 
-  tables::ThreadStateTable::RowReference RowNumToRef(
-      tables::ThreadStateTable::RowNumber row_number) {
-    return row_number.ToRowReference(storage_->mutable_thread_state_table());
+  tables::ThreadStateTable::RowReference RowNumToRef(uint32_t row) {
+    return tables::ThreadStateTable::RowNumber(row).ToRowReference(
+        storage_->mutable_thread_state_table());
   }
 
   TraceStorage* const storage_;
@@ -94,12 +114,8 @@ class ThreadStateTracker : public Destructible {
   StringId running_string_id_;
   StringId runnable_string_id_;
 
-  struct RelatedRows {
-    std::optional<tables::ThreadStateTable::RowNumber> last_blocked_row;
-    tables::ThreadStateTable::RowNumber last_row;
-  };
-
-  std::vector<std::optional<RelatedRows>> prev_row_numbers_for_thread_;
+  // Indexed by utid.
+  std::vector<ThreadState> thread_states_;
 };
 }  // namespace trace_processor
 }  // namespace perfetto
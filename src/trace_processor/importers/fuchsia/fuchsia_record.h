@@ -49,6 +49,7 @@ class FuchsiaRecord {
     FuchsiaThreadInfo info;
   };
 
+  void ReserveStrings(size_t n) { string_entries_.reserve(n); }
   void InsertString(uint32_t, StringPool::Id);
   StringPool::Id GetString(uint32_t);
 
@@ -198,6 +198,10 @@ util::Status FuchsiaTraceTokenizer::Parse(TraceBlobView blob) {
                          full_view.data() + record_offset,
                          full_view.data() + size);
 
+  // Most chunks don't contain any perfetto blob record.
+  if (proto_trace_data_.empty())
+    return util::OkStatus();
+
   TraceBlob perfetto_blob =
       TraceBlob::CopyFrom(proto_trace_data_.data(), proto_trace_data_.size());
   proto_trace_data_.clear();
@@ -425,7 +429,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
         }
         StringId id = storage->InternString(s);
 
-        current_provider_->string_table[index] = id;
+        current_provider_->SetString(index, id);
       }
       break;
     }
@@ -438,7 +442,7 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
           return;
         }
 
-        current_provider_->thread_table[index] = tinfo;
+        current_provider_->SetThread(index, tinfo);
       }
       break;
     }
@@ -453,8 +457,14 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
       // Build the FuchsiaRecord for the event, i.e. extract the thread
       // information if not inline, and any non-inline strings (name, category
       // for now, arg names and string values in the future).
+      uint32_t n_args =
+          fuchsia_trace_utils::ReadField<uint32_t>(header, 20, 23);
+
       FuchsiaRecord record(std::move(tbv));
       record.set_ticks_per_second(current_provider_->ticks_per_second);
+      // Category, name and the name and value of each arg: an upper bound
+      // which avoids growing the vector one entry at a time.
+      record.ReserveStrings(2 + 2 * n_args);
 
       uint64_t ticks;
       if (!cursor.ReadUint64(&ticks)) {
@@ -490,8 +500,6 @@ void FuchsiaTraceTokenizer::ParseRecord(TraceBlobView tbv) {
         record.InsertString(name_ref, current_provider_->GetString(name_ref));
       }
 
-      uint32_t n_args =
-          fuchsia_trace_utils::ReadField<uint32_t>(header, 20, 23);
       for (uint32_t i = 0; i < n_args; i++) {
         const size_t arg_base = cursor.WordIndex();
         uint64_t arg_header;
@@ -17,6 +17,10 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_FUCHSIA_FUCHSIA_TRACE_TOKENIZER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_FUCHSIA_FUCHSIA_TRACE_TOKENIZER_H_
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "src/trace_processor/importers/common/chunked_trace_reader.h"
 #include "src/trace_processor/importers/fuchsia/fuchsia_trace_utils.h"
 #include "src/trace_processor/importers/proto/proto_trace_reader.h"
@@ -43,27 +47,38 @@ class FuchsiaTraceTokenizer : public ChunkedTraceReader {
   struct ProviderInfo {
     std::string name;
 
-    std::unordered_map<uint64_t, StringId> string_table;
-    std::unordered_map<uint64_t, FuchsiaThreadInfo> thread_table;
+    // The string and thread tables of the provider, indexed by FXT string
+    // ref (15 bits) and thread ref (8 bits). They are looked up for every
+    // event record, so they are flat vectors rather than hash maps.
+    std::vector<StringId> string_table;
+    std::vector<FuchsiaThreadInfo> thread_table;
 
     // Returns a StringId for the given FXT string ref id.
-    StringId GetString(uint64_t string_ref) {
-      auto search = string_table.find(string_ref);
-      if (search != string_table.end()) {
-        return search->second;
-      }
+    StringId GetString(uint64_t string_ref) const {
+      if (string_ref < string_table.size())
+        return string_table[string_ref];
       return kNullStringId;
     }
 
+    void SetString(uint32_t string_ref, StringId id) {
+      if (string_ref >= string_table.size())
+        string_table.resize(string_ref + 1, kNullStringId);
+      string_table[string_ref] = id;
+    }
+
     // Returns a FuchsiaThreadInfo for the given FXT thread ref id.
-    FuchsiaThreadInfo GetThread(uint64_t thread_ref) {
-      auto search = thread_table.find(thread_ref);
-      if (search != thread_table.end()) {
-        return search->second;
-      }
+    FuchsiaThreadInfo GetThread(uint64_t thread_ref) const {
+      if (thread_ref < thread_table.size())
+        return thread_table[thread_ref];
       return {0, 0};
     }
 
+    void SetThread(uint32_t thread_ref, FuchsiaThreadInfo info) {
+      if (thread_ref >= thread_table.size())
+        thread_table.resize(thread_ref + 1, FuchsiaThreadInfo{0, 0});
+      thread_table[thread_ref] = info;
+    }
+
     uint64_t ticks_per_second = 1000000000;
   };
 
@@ -16,6 +16,9 @@
 
 #include "src/trace_processor/importers/gzip/gzip_trace_parser.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
 
 #include "perfetto/base/logging.h"
@@ -23,8 +26,10 @@
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/trace_processor/trace_blob_view.h"
 #include "src/trace_processor/forwarding_trace_parser.h"
+#include "src/trace_processor/types/trace_processor_context.h"
 #include "src/trace_processor/util/gzip_utils.h"
 #include "src/trace_processor/util/status_macros.h"
+#include "src/trace_processor/util/threading.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -33,10 +38,39 @@ namespace {
 
 using ResultCode = util::GzipDecompressor::ResultCode;
 
+// Our default uncompressed buffer size is 32MB as it allows for good
+// throughput.
+constexpr size_t kUncompressedBufferSize = 32 * 1024 * 1024;
+
+// Maximum number of decompressed buffers which the decompression thread can
+// get ahead of parsing by. This bounds the memory used for decompressed data
+// which has not been parsed yet.
+constexpr size_t kMaxQueuedBuffers = 2;
+
+// Decompressed buffers handed off from the decompression thread to the
+// parsing one.
+struct DecompressedQueue {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<TraceBlob> buffers;
+
+  // Set by the parsing thread when parsing fails to stop decompression early.
+  bool cancelled = false;
+
+  // Set by the decompression thread once it has finished with its input.
+  bool done = false;
+  util::Status status;
+};
+
 }  // namespace
 
 GzipTraceParser::GzipTraceParser(TraceProcessorContext* context)
-    : context_(context) {}
+    : context_(context) {
+#if PERFETTO_TP_HAS_THREADS()
+  if (context->config.tokenization_thread_count > 0)
+    decompression_pool_.reset(new base::ThreadPool(1));
+#endif
+}
 
 GzipTraceParser::GzipTraceParser(std::unique_ptr<ChunkedTraceReader> reader)
     : context_(nullptr), inner_(std::move(reader)) {}
@@ -44,17 +78,82 @@ GzipTraceParser::GzipTraceParser(std::unique_ptr<ChunkedTraceReader> reader)
 GzipTraceParser::~GzipTraceParser() = default;
 
 util::Status GzipTraceParser::Parse(TraceBlobView blob) {
+  if (decompression_pool_)
+    return ParseWithThreadPool(std::move(blob));
   return ParseUnowned(blob.data(), blob.size());
 }
 
 util::Status GzipTraceParser::ParseUnowned(const uint8_t* data, size_t size) {
-  const uint8_t* start = data;
-  size_t len = size;
-
   if (!inner_) {
     PERFETTO_CHECK(context_);
     inner_.reset(new ForwardingTraceParser(context_));
   }
+  return Decompress(data, size, [this](TraceBlob blob) {
+    return inner_->Parse(TraceBlobView(std::move(blob)));
+  });
+}
+
+util::Status GzipTraceParser::ParseWithThreadPool(TraceBlobView blob) {
+  if (!inner_)
+    inner_.reset(new ForwardingTraceParser(context_));
+
+  // The decompression task only reads |blob| and writes to the decompressor
+  // state of this class, which is not touched by this thread until the task
+  // has set |queue.done|.
+  DecompressedQueue queue;
+  decompression_pool_->PostTask([this, &blob, &queue] {
+    util::Status status =
+        Decompress(blob.data(), blob.size(), [&queue](TraceBlob buffer) {
+          std::unique_lock<std::mutex> lock(queue.mutex);
+          queue.cv.wait(lock, [&queue] {
+            return queue.cancelled ||
+                   queue.buffers.size() < kMaxQueuedBuffers;
+          });
+          if (queue.cancelled)
+            return util::ErrStatus("Decompression cancelled");
+          queue.buffers.emplace_back(std::move(buffer));
+          queue.cv.notify_all();
+          return util::OkStatus();
+        });
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.status = std::move(status);
+    queue.done = true;
+    queue.cv.notify_all();
+  });
+
+  util::Status status;
+  std::unique_lock<std::mutex> lock(queue.mutex);
+  for (;;) {
+    queue.cv.wait(lock,
+                  [&queue] { return queue.done || !queue.buffers.empty(); });
+    if (queue.buffers.empty())
+      break;
+    TraceBlob buffer = std::move(queue.buffers.front());
+    queue.buffers.pop_front();
+    queue.cv.notify_all();
+
+    lock.unlock();
+    status = inner_->Parse(TraceBlobView(std::move(buffer)));
+    lock.lock();
+
+    if (!status.ok()) {
+      queue.cancelled = true;
+      queue.cv.notify_all();
+      break;
+    }
+  }
+
+  // Wait for the task to finish before |queue| and |blob| go out of scope.
+  queue.cv.wait(lock, [&queue] { return queue.done; });
+  RETURN_IF_ERROR(status);
+  return queue.status;
+}
+
+util::Status GzipTraceParser::Decompress(const uint8_t* data,
+                                         size_t size,
+                                         const BlobSink& sink) {
+  const uint8_t* start = data;
+  size_t len = size;
 
   if (!first_chunk_parsed_) {
     // .ctrace files begin with: "TRACE:\n" or "done. TRACE:\n" strip this if
@@ -70,10 +169,6 @@ util::Status GzipTraceParser::ParseUnowned(const uint8_t* data, size_t size) {
     first_chunk_parsed_ = true;
   }
 
-  // Our default uncompressed buffer size is 32MB as it allows for good
-  // throughput.
-  constexpr size_t kUncompressedBufferSize = 32 * 1024 * 1024;
-
   needs_more_input_ = false;
   decompressor_.Feed(start, len);
 
@@ -100,7 +195,7 @@ util::Status GzipTraceParser::ParseUnowned(const uint8_t* data, size_t size) {
     if (bytes_written_ == kUncompressedBufferSize || ret == ResultCode::kEof) {
       TraceBlob blob =
           TraceBlob::TakeOwnership(std::move(buffer_), bytes_written_);
-      RETURN_IF_ERROR(inner_->Parse(TraceBlobView(std::move(blob))));
+      RETURN_IF_ERROR(sink(std::move(blob)));
     }
   }
   return util::OkStatus();
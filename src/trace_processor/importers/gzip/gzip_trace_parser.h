@@ -17,6 +17,11 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_GZIP_GZIP_TRACE_PARSER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_GZIP_GZIP_TRACE_PARSER_H_
 
+#include <functional>
+#include <memory>
+
+#include "perfetto/ext/base/threading/thread_pool.h"
+#include "perfetto/trace_processor/trace_blob.h"
 #include "src/trace_processor/importers/common/chunked_trace_reader.h"
 #include "src/trace_processor/util/gzip_utils.h"
 
@@ -40,6 +45,16 @@ class GzipTraceParser : public ChunkedTraceReader {
   bool needs_more_input() const { return needs_more_input_; }
 
  private:
+  using BlobSink = std::function<util::Status(TraceBlob)>;
+
+  // Decompresses |size| bytes at |data| passing each full buffer of
+  // decompressed data to |sink|.
+  util::Status Decompress(const uint8_t* data, size_t size, const BlobSink&);
+
+  // Decompresses |blob| on |decompression_pool_| while the buffers already
+  // decompressed are parsed on the calling thread.
+  util::Status ParseWithThreadPool(TraceBlobView blob);
+
   TraceProcessorContext* const context_;
   util::GzipDecompressor decompressor_;
   std::unique_ptr<ChunkedTraceReader> inner_;
@@ -49,6 +64,10 @@ class GzipTraceParser : public ChunkedTraceReader {
 
   bool first_chunk_parsed_ = false;
   bool needs_more_input_ = false;
+
+  // Only created when Config::tokenization_thread_count > 0. Has a single
+  // thread as a gzip stream can only be inflated sequentially.
+  std::unique_ptr<base::ThreadPool> decompression_pool_;
 };
 
 }  // namespace trace_processor
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/importers/json/json_trace_tokenizer.h"
 
+#include <string.h>
+
 #include <memory>
 
 #include "perfetto/base/build_config.h"
@@ -32,50 +34,82 @@ namespace trace_processor {
 
 namespace {
 
+// Appends |c| to |key| (if not null) taking into account whether the
+// previous character started an escape sequence.
 base::Status AppendUnescapedCharacter(char c,
                                       bool is_escaping,
                                       std::string* key) {
+  char out = c;
   if (is_escaping) {
     switch (c) {
       case '"':
       case '\\':
       case '/':
-        key->push_back(c);
         break;
       case 'b':
-        key->push_back('\b');
+        out = '\b';
         break;
       case 'f':
-        key->push_back('\f');
+        out = '\f';
         break;
       case 'n':
-        key->push_back('\n');
+        out = '\n';
         break;
       case 'r':
-        key->push_back('\r');
+        out = '\r';
         break;
       case 't':
-        key->push_back('\t');
+        out = '\t';
         break;
       case 'u':
         // Just pass through \uxxxx escape sequences which JSON supports but is
         // not worth the effort to parse as we never use them here.
-        key->append("\\u");
-        break;
+        if (key)
+          key->append("\\u");
+        return base::OkStatus();
       default:
         return base::ErrStatus("Illegal character in JSON");
     }
-  } else if (c != '\\') {
-    key->push_back(c);
+  } else if (c == '\\') {
+    return base::OkStatus();
   }
+  if (key)
+    key->push_back(out);
   return base::OkStatus();
 }
 
+// Returns a pointer to the quote which terminates the JSON string whose
+// contents (i.e. after the opening quote) begin at |start| or nullptr if the
+// string does not finish before |end|.
+//
+// This is the hot loop when tokenizing JSON traces as most of the bytes of an
+// event are inside strings: we jump between quotes with memchr (which libc
+// vectorizes) instead of looking at every character.
+const char* FindJsonStringEnd(const char* start, const char* end) {
+  for (const char* s = start; s < end;) {
+    const char* quote = static_cast<const char*>(
+        memchr(s, '"', static_cast<size_t>(end - s)));
+    if (!quote)
+      return nullptr;
+
+    // A quote is escaped iff it is preceded by an odd number of backslashes.
+    const char* backslash = quote;
+    while (backslash > start && backslash[-1] == '\\')
+      backslash--;
+    if ((quote - backslash) % 2 == 0)
+      return quote;
+    s = quote + 1;
+  }
+  return nullptr;
+}
+
 enum class ReadStringRes {
   kEndOfString,
   kNeedsMoreData,
   kFatalError,
 };
+// Reads the JSON string at |start| unescaping it into |key|. |key| can be
+// null if the caller is only interested in skipping over the string.
 ReadStringRes ReadOneJsonString(const char* start,
                                 const char* end,
                                 std::string* key,
@@ -124,9 +158,8 @@ SkipValueRes SkipOneJsonValue(const char* start,
     if (*s == '"') {
       // Because strings can contain {}[] characters, handle them separately
       // before anything else.
-      std::string ignored;
       const char* str_next = nullptr;
-      switch (ReadOneJsonString(s, end, &ignored, &str_next)) {
+      switch (ReadOneJsonString(s, end, nullptr, &str_next)) {
         case ReadStringRes::kFatalError:
           return SkipValueRes::kFatalError;
         case ReadStringRes::kNeedsMoreData:
@@ -184,21 +217,14 @@ ReadDictRes ReadOneJsonDict(const char* start,
   int braces = 0;
   int square_brackets = 0;
   const char* dict_begin = nullptr;
-  bool in_string = false;
-  bool is_escaping = false;
   for (const char* s = start; s < end; s++) {
-    if (isspace(*s) || *s == ',')
-      continue;
-    if (*s == '"' && !is_escaping) {
-      in_string = !in_string;
-      continue;
-    }
-    if (in_string) {
-      // If we're in a string and we see a backslash and the last character was
-      // not a backslash the next character is escaped:
-      is_escaping = *s == '\\' && !is_escaping;
-      // If we're currently parsing a string we should ignore otherwise special
-      // characters:
+    if (*s == '"') {
+      // We're not interested in the contents of strings but they may contain
+      // otherwise special characters so skip straight to the end.
+      const char* str_end = FindJsonStringEnd(s + 1, end);
+      if (!str_end)
+        return ReadDictRes::kNeedsMoreData;
+      s = str_end;
       continue;
     }
     if (*s == '{') {
@@ -660,7 +686,8 @@ base::Status JsonTraceTokenizer::HandleSystemTraceEvent(const char* start,
       continue;
 
     SystraceLine line;
-    RETURN_IF_ERROR(systrace_line_tokenizer_.Tokenize(raw_line, &line));
+    RETURN_IF_ERROR(systrace_line_tokenizer_.Tokenize(
+        base::StringView(raw_line), &line));
     context_->sorter->PushSystraceLine(std::move(line));
   }
   return SetOutAndReturn(next, out);
@@ -53,6 +53,28 @@ TEST(JsonTraceTokenizerTest, ReadDictQuotedBraces) {
   ASSERT_EQ(parsed["foo"].asString(), "}\"bar{\\");
 }
 
+TEST(JsonTraceTokenizerTest, ReadDictEscapedBackslashes) {
+  const char* start = R"({"foo": "\\\\", "bar": "\\\"}"}, {})";
+  const char* end = start + strlen(start);
+  const char* next = nullptr;
+  base::StringView value;
+
+  ASSERT_EQ(ReadOneJsonDict(start, end, &value, &next),
+            ReadDictRes::kFoundDict);
+  ASSERT_EQ(value.ToStdString(), R"({"foo": "\\\\", "bar": "\\\"}"})");
+}
+
+TEST(JsonTraceTokenizerTest, ReadDictNeedMoreDataEscapedQuote) {
+  const char* start = R"({"foo": "bar\")";
+  const char* end = start + strlen(start);
+  const char* next = nullptr;
+  base::StringView value;
+
+  ASSERT_EQ(ReadOneJsonDict(start, end, &value, &next),
+            ReadDictRes::kNeedsMoreData);
+  ASSERT_EQ(next, nullptr);
+}
+
 TEST(JsonTraceTokenizerTest, ReadDictTwoDicts) {
   const char* start = R"({"foo": 1}, {"bar": 2})";
   const char* middle = start + strlen(R"({"foo": 1})");
@@ -52,7 +52,7 @@ void GlobalNodeGraph::AddNodeOwnershipEdge(Node* owner,
 }
 
 Node* GlobalNodeGraph::CreateNode(Process* process_graph, Node* parent) {
-  all_nodes_.emplace_front(process_graph, parent);
+  all_nodes_.emplace_front(process_graph, parent, node_count_++);
   return &*all_nodes_.begin();
 }
 
@@ -63,7 +63,7 @@ PreOrderIterator GlobalNodeGraph::VisitInDepthFirstPreOrder() {
     roots.push_back(it->second->root());
   }
   roots.push_back(shared_memory_graph_->root());
-  return PreOrderIterator{std::move(roots)};
+  return PreOrderIterator{std::move(roots), node_count_};
 }
 
 PostOrderIterator GlobalNodeGraph::VisitInDepthFirstPostOrder() {
@@ -73,7 +73,7 @@ PostOrderIterator GlobalNodeGraph::VisitInDepthFirstPostOrder() {
     roots.push_back(it->second->root());
   }
   roots.push_back(shared_memory_graph_->root());
-  return PostOrderIterator(std::move(roots));
+  return PostOrderIterator(std::move(roots), node_count_);
 }
 
 Process::Process(base::PlatformProcessId pid, GlobalNodeGraph* global_graph)
@@ -126,8 +126,11 @@ Node* Process::FindNode(const std::string& path) {
   return current;
 }
 
-Node::Node(Process* node_graph, Node* parent)
-    : node_graph_(node_graph), parent_(parent), owns_edge_(nullptr) {}
+Node::Node(Process* node_graph, Node* parent, uint32_t index)
+    : node_graph_(node_graph),
+      parent_(parent),
+      index_(index),
+      owns_edge_(nullptr) {}
 Node::~Node() {}
 
 Node* Node::GetChild(const std::string& name) const {
@@ -186,8 +189,9 @@ Node::Entry::Entry(const std::string& value)
 Edge::Edge(Node* source, Node* target, int priority)
     : source_(source), target_(target), priority_(priority) {}
 
-PreOrderIterator::PreOrderIterator(std::vector<Node*>&& roots)
-    : to_visit_(std::move(roots)) {}
+PreOrderIterator::PreOrderIterator(std::vector<Node*>&& roots,
+                                   uint32_t node_count)
+    : to_visit_(std::move(roots)), visited_(node_count) {}
 PreOrderIterator::PreOrderIterator(PreOrderIterator&& other) = default;
 PreOrderIterator::~PreOrderIterator() {}
 
@@ -199,15 +203,15 @@ Node* PreOrderIterator::next() {
     to_visit_.pop_back();
 
     // If the node has already been visited, don't visit it again.
-    if (visited_.count(node) != 0)
+    if (visited_[node->index()])
       continue;
 
     // If we haven't visited the node which this node owns then wait for that.
-    if (node->owns_edge() && visited_.count(node->owns_edge()->target()) == 0)
+    if (node->owns_edge() && !visited_[node->owns_edge()->target()->index()])
       continue;
 
     // If we haven't visited the node's parent then wait for that.
-    if (node->parent() && visited_.count(node->parent()) == 0)
+    if (node->parent() && !visited_[node->parent()->index()])
       continue;
 
     // Visit all children of this node.
@@ -223,14 +227,15 @@ Node* PreOrderIterator::next() {
     }
 
     // Add this node to the visited set.
-    visited_.insert(node);
+    visited_[node->index()] = true;
     return node;
   }
   return nullptr;
 }
 
-PostOrderIterator::PostOrderIterator(std::vector<Node*>&& roots)
-    : to_visit_(std::move(roots)) {}
+PostOrderIterator::PostOrderIterator(std::vector<Node*>&& roots,
+                                     uint32_t node_count)
+    : to_visit_(std::move(roots)), visited_(node_count) {}
 PostOrderIterator::PostOrderIterator(PostOrderIterator&& other) = default;
 PostOrderIterator::~PostOrderIterator() = default;
 
@@ -242,14 +247,14 @@ Node* PostOrderIterator::next() {
     to_visit_.pop_back();
 
     // If the node has already been visited, don't visit it again.
-    if (visited_.count(node) != 0)
+    if (visited_[node->index()])
       continue;
 
     // If the node is at the top of the path, we have already looked
     // at its children and owners.
     if (!path_.empty() && path_.back() == node) {
       // Mark the current node as visited so we don't visit again.
-      visited_.insert(node);
+      visited_[node->index()] = true;
 
       // The current node is no longer on the path.
       path_.pop_back();
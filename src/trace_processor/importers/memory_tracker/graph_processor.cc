@@ -96,7 +96,7 @@ void GraphProcessor::RemoveWeakNodesFromGraph(GlobalNodeGraph* global_graph) {
   // Fourth pass: recursively mark nodes as weak if they own a node which is
   // weak or if they have a parent who is weak.
   {
-    std::set<const Node*> visited;
+    std::vector<bool> visited(global_graph->node_count());
     MarkWeakOwnersAndChildrenRecursively(global_root, &visited);
     for (const auto& pid_to_process : global_graph->process_node_graphs()) {
       MarkWeakOwnersAndChildrenRecursively(pid_to_process.second->root(),
@@ -369,17 +369,17 @@ void GraphProcessor::MarkImplicitWeakParentsRecursively(Node* node) {
 // static
 void GraphProcessor::MarkWeakOwnersAndChildrenRecursively(
     Node* node,
-    std::set<const Node*>* visited) {
+    std::vector<bool>* visited) {
   // If we've already visited this node then nothing to do.
-  if (visited->count(node) != 0)
+  if ((*visited)[node->index()])
     return;
 
   // If we haven't visited the node which this node owns then wait for that.
-  if (node->owns_edge() && visited->count(node->owns_edge()->target()) == 0)
+  if (node->owns_edge() && !(*visited)[node->owns_edge()->target()->index()])
     return;
 
   // If we haven't visited the node's parent then wait for that.
-  if (node->parent() && visited->count(node->parent()) == 0)
+  if (node->parent() && !(*visited)[node->parent()->index()])
     return;
 
   // If either the node we own or our parent is weak, then mark this node
@@ -388,7 +388,7 @@ void GraphProcessor::MarkWeakOwnersAndChildrenRecursively(
       (node->parent() && node->parent()->is_weak())) {
     node->set_weak(true);
   }
-  visited->insert(node);
+  (*visited)[node->index()] = true;
 
   // Recurse into each owner node to mark any other nodes.
   for (auto* owned_by_edge : *node->owned_by_edges()) {
@@ -43,7 +43,7 @@ class GraphProcessorTest : public testing::Test {
   }
 
   void MarkWeakOwnersAndChildrenRecursively(Node* node) {
-    std::set<const Node*> visited;
+    std::vector<bool> visited(node->node_graph()->global_graph()->node_count());
     GraphProcessor::MarkWeakOwnersAndChildrenRecursively(node, &visited);
   }
 
@@ -16,6 +16,9 @@
 
 #include "src/trace_processor/importers/proto/content_analyzer.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "perfetto/ext/base/string_utils.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
 #include "src/trace_processor/importers/proto/content_analyzer.h"
@@ -38,14 +41,23 @@ ProtoContentAnalyzer::ProtoContentAnalyzer(TraceProcessorContext* context)
         }
         return pool;
       }()),
-      computer_(&pool_, ".perfetto.protos.TracePacket") {}
+      computer_(&pool_, ".perfetto.protos.TracePacket"),
+      sampling_interval_(
+          std::max(context->config.proto_content_sampling_interval, 1u)) {
+  computer_.set_max_depth(context->config.proto_content_max_depth);
+}
 
 ProtoContentAnalyzer::~ProtoContentAnalyzer() = default;
 
 void ProtoContentAnalyzer::ProcessPacket(
     const TraceBlobView& packet,
     const SampleAnnotation& packet_annotations) {
-  auto& map = aggregated_samples_[packet_annotations];
+  auto& annotated_samples = aggregated_samples_[packet_annotations];
+  if (annotated_samples.packets++ % sampling_interval_ != 0)
+    return;
+  ++annotated_samples.sampled_packets;
+
+  auto& map = annotated_samples.samples;
   computer_.Reset(packet.data(), packet.length());
   for (auto sample = computer_.GetNext(); sample.has_value();
        sample = computer_.GetNext()) {
@@ -68,7 +80,12 @@ void ProtoContentAnalyzer::NotifyEndOfFile() {
                       tables::ExperimentalProtoPathTable::Id,
                       util::SizeProfileComputer::FieldPathHasher>
         path_ids;
-    for (auto sample = annotated_map.value().GetIterator(); sample; ++sample) {
+    // When sampling, scale the samples up to estimate the whole trace.
+    const AnnotatedSamples& annotated_samples = annotated_map.value();
+    double scale = static_cast<double>(annotated_samples.packets) /
+                   static_cast<double>(annotated_samples.sampled_packets);
+    for (auto sample = annotated_samples.samples.GetIterator(); sample;
+         ++sample) {
       std::string path_string;
       std::optional<tables::ExperimentalProtoPathTable::Id> previous_path_id;
       util::SizeProfileComputer::FieldPath path;
@@ -125,9 +142,12 @@ void ProtoContentAnalyzer::NotifyEndOfFile() {
       content_row.path =
           context_->storage->InternString(base::StringView(path_string));
       content_row.path_id = *previous_path_id;
-      content_row.total_size = static_cast<int64_t>(sample.value().size);
-      content_row.size = static_cast<int64_t>(sample.value().size);
-      content_row.count = static_cast<int64_t>(sample.value().count);
+      auto size = static_cast<int64_t>(
+          std::round(static_cast<double>(sample.value().size) * scale));
+      content_row.total_size = size;
+      content_row.size = size;
+      content_row.count = static_cast<int64_t>(
+          std::round(static_cast<double>(sample.value().count) * scale));
       context_->storage->mutable_experimental_proto_content_table()->Insert(
           content_row);
     }
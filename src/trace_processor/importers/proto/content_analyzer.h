@@ -56,8 +56,15 @@ class ProtoContentAnalyzer : public PacketAnalyzer {
       return static_cast<size_t>(hash.digest());
     }
   };
+  // The samples of the packets with the same annotation. When sampling, only
+  // |sampled_packets| out of |packets| contributed to |samples|.
+  struct AnnotatedSamples {
+    PathToSamplesMap samples;
+    uint64_t packets = 0;
+    uint64_t sampled_packets = 0;
+  };
   using AnnotatedSamplesMap = base::
-      FlatHashMap<SampleAnnotation, PathToSamplesMap, SampleAnnotationHasher>;
+      FlatHashMap<SampleAnnotation, AnnotatedSamples, SampleAnnotationHasher>;
 
   ProtoContentAnalyzer(TraceProcessorContext* context);
   ~ProtoContentAnalyzer() override;
@@ -72,6 +79,10 @@ class ProtoContentAnalyzer : public PacketAnalyzer {
   DescriptorPool pool_;
   util::SizeProfileComputer computer_;
   AnnotatedSamplesMap aggregated_samples_;
+
+  // Only one in every |sampling_interval_| packets of each annotation is
+  // decoded. See Config::proto_content_sampling_interval.
+  uint32_t sampling_interval_ = 1;
 };
 
 }  // namespace trace_processor
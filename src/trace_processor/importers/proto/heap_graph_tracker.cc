@@ -16,6 +16,11 @@
 
 #include "src/trace_processor/importers/proto/heap_graph_tracker.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
 #include <optional>
 
 #include "perfetto/base/flat_set.h"
@@ -23,6 +28,7 @@
 #include "perfetto/ext/base/string_utils.h"
 #include "src/trace_processor/importers/proto/profiler_util.h"
 #include "src/trace_processor/tables/profiler_tables_py.h"
+#include "src/trace_processor/util/threading.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -33,6 +39,11 @@ using ClassTable = tables::HeapGraphClassTable;
 using ObjectTable = tables::HeapGraphObjectTable;
 using ReferenceTable = tables::HeapGraphReferenceTable;
 
+// Minimum number of objects (or references) processed by a single chunk when
+// the heap graph is processed on a thread pool. Smaller graphs are not worth
+// the synchronization.
+constexpr uint32_t kMinItemsPerChunk = 8192;
+
 // Iterates all the references owned by the object `id`.
 //
 // Calls bool(*fn)(ObjectTable::RowReference) with the each row
@@ -47,12 +58,14 @@ void ForReferenceSet(TraceStorage* storage,
   if (!reference_set_id)
     return;
 
+  // The references of a set are contiguous and start at the row equal to the
+  // id of the set, so there is no need to filter the table.
   auto* ref = storage->mutable_heap_graph_reference_table();
-  auto it =
-      ref->FilterToIterator({ref->reference_set_id().eq(*reference_set_id)});
-
-  for (; it; ++it) {
-    if (!fn(it.row_reference()))
+  for (uint32_t row = *reference_set_id;
+       row < ref->row_count() &&
+       ref->reference_set_id()[row] == *reference_set_id;
+       ++row) {
+    if (!fn(ReferenceTable::RowNumber(row).ToRowReference(ref)))
       break;
   }
 }
@@ -110,60 +123,19 @@ ClassDescriptor GetClassDescriptor(const TraceStorage& storage,
   return {type_row_ref.name(), type_row_ref.location()};
 }
 
-std::optional<ObjectTable::Id> GetReferredObj(const TraceStorage& storage,
+// Returns the object referred to by the |field_name| field of the objects
+// with reference set |ref_set_id|. This only reads |refs_tbl| so it can be
+// called from several threads at once.
+std::optional<ObjectTable::Id> GetReferredObj(const ReferenceTable& refs_tbl,
                                               uint32_t ref_set_id,
-                                              const std::string& field_name) {
-  const auto& refs_tbl = storage.heap_graph_reference_table();
-
-  auto refs_it = refs_tbl.FilterToIterator(
-      {refs_tbl.reference_set_id().eq(ref_set_id),
-       refs_tbl.field_name().eq(NullTermStringView(field_name))});
-  if (!refs_it) {
-    return std::nullopt;
+                                              StringId field_name) {
+  for (uint32_t row = ref_set_id; row < refs_tbl.row_count() &&
+                                  refs_tbl.reference_set_id()[row] == ref_set_id;
+       ++row) {
+    if (refs_tbl.field_name()[row] == field_name)
+      return refs_tbl.owned_id()[row];
   }
-  return refs_it.owned_id();
-}
-
-// Maps from normalized class name and location, to superclass.
-std::map<ClassDescriptor, ClassDescriptor>
-BuildSuperclassMap(UniquePid upid, int64_t ts, TraceStorage* storage) {
-  std::map<ClassDescriptor, ClassDescriptor> superclass_map;
-
-  // Resolve superclasses by iterating heap graph objects and identifying the
-  // superClass field.
-  const auto& objects_tbl = storage->heap_graph_object_table();
-  auto obj_it = objects_tbl.FilterToIterator(
-      {objects_tbl.upid().eq(upid), objects_tbl.graph_sample_ts().eq(ts)});
-  for (; obj_it; ++obj_it) {
-    auto obj_id = obj_it.id();
-    auto class_descriptor = GetClassDescriptor(*storage, obj_id);
-    auto normalized =
-        GetNormalizedType(storage->GetString(class_descriptor.name));
-    // superClass ptrs are stored on the static class objects
-    // ignore arrays (as they are generated objects)
-    if (!normalized.is_static_class || normalized.number_of_arrays > 0)
-      continue;
-
-    auto opt_ref_set_id = obj_it.reference_set_id();
-    if (!opt_ref_set_id)
-      continue;
-    auto super_obj_id =
-        GetReferredObj(*storage, *opt_ref_set_id, "java.lang.Class.superClass");
-    if (!super_obj_id) {
-      // This is expected to be missing for Object and primitive types
-      continue;
-    }
-
-    // Lookup the super obj type id
-    auto super_class_descriptor = GetClassDescriptor(*storage, *super_obj_id);
-    auto super_class_name =
-        NormalizeTypeName(storage->GetString(super_class_descriptor.name));
-    StringId super_class_id = storage->InternString(super_class_name);
-    StringId class_id = storage->InternString(normalized.name);
-    superclass_map[{class_id, class_descriptor.location}] = {
-        super_class_id, super_class_descriptor.location};
-  }
-  return superclass_map;
+  return std::nullopt;
 }
 
 // Extract the size from `nar_size`, which is the value of a
@@ -176,29 +148,6 @@ int64_t GetSizeFromNativeAllocationRegistry(int64_t nar_size) {
 
 }  // namespace
 
-void MarkRoot(TraceStorage* storage,
-              ObjectTable::RowReference row_ref,
-              StringId type) {
-  row_ref.set_root_type(type);
-
-  // DFS to mark reachability for all children
-  std::vector<ObjectTable::RowReference> stack({row_ref});
-  while (!stack.empty()) {
-    ObjectTable::RowReference cur_node = stack.back();
-    stack.pop_back();
-
-    if (cur_node.reachable())
-      continue;
-    cur_node.set_reachable(true);
-
-    for (ObjectTable::Id child_node : GetChildren(storage, cur_node)) {
-      auto child_ref =
-          *storage->mutable_heap_graph_object_table()->FindById(child_node);
-      stack.push_back(child_ref);
-    }
-  }
-}
-
 void UpdateShortestPaths(TraceStorage* storage,
                          ObjectTable::RowReference row_ref) {
   // Calculate shortest distance to a GC root.
@@ -274,7 +223,27 @@ std::string DenormalizeTypeName(NormalizedType normalized,
   return result;
 }
 
-HeapGraphTracker::HeapGraphTracker(TraceStorage* storage)
+// The references between the objects of a single heap graph, in compressed
+// sparse row format.
+//
+// The nodes are the rows [first_row, first_row + node_count) of the object
+// table. These contain all the objects of the graph but, if several graphs
+// were received at the same time, also objects of other graphs: those have
+// |in_graph| unset and no children. The children of the node i are
+// children[offsets[i]], ..., children[offsets[i + 1] - 1].
+//
+// As in GetChildren, weak, soft, finalizer and phantom references are not
+// followed.
+struct HeapGraphTracker::ObjectGraph {
+  uint32_t first_row = 0;
+  uint32_t node_count = 0;
+  std::vector<uint8_t> in_graph;
+  std::vector<uint32_t> offsets{0};
+  std::vector<uint32_t> children;
+};
+
+HeapGraphTracker::HeapGraphTracker(TraceStorage* storage,
+                                   uint32_t thread_count)
     : storage_(storage),
       cleaner_thunk_str_id_(storage_->InternString("sun.misc.Cleaner.thunk")),
       referent_str_id_(
@@ -283,7 +252,45 @@ HeapGraphTracker::HeapGraphTracker(TraceStorage* storage)
           "libcore.util.NativeAllocationRegistry$CleanerThunk.this$0")),
       native_size_str_id_(
           storage_->InternString("libcore.util.NativeAllocationRegistry.size")),
-      cleaner_next_str_id_(storage_->InternString("sun.misc.Cleaner.next")) {}
+      cleaner_next_str_id_(storage_->InternString("sun.misc.Cleaner.next")) {
+#if PERFETTO_TP_HAS_THREADS()
+  if (thread_count > 0) {
+    pool_.reset(new base::ThreadPool(thread_count));
+    thread_count_ = thread_count;
+  }
+#else
+  base::ignore_result(thread_count);
+#endif
+}
+
+template <typename F>
+void HeapGraphTracker::ForEachChunk(uint32_t size, const F& fn) {
+  uint32_t chunk_count = std::min(
+      thread_count_ + 1, (size + kMinItemsPerChunk - 1) / kMinItemsPerChunk);
+  if (chunk_count <= 1) {
+    fn(0u, 0u, size);
+    return;
+  }
+
+  uint32_t chunk_size = (size + chunk_count - 1) / chunk_count;
+  std::mutex mutex;
+  std::condition_variable chunk_done;
+  uint32_t pending_chunks = chunk_count - 1;
+  for (uint32_t i = 1; i < chunk_count; ++i) {
+    uint32_t begin = std::min(i * chunk_size, size);
+    uint32_t end = std::min(begin + chunk_size, size);
+    pool_->PostTask([&, i, begin, end] {
+      fn(i, begin, end);
+      std::lock_guard<std::mutex> lock(mutex);
+      --pending_chunks;
+      chunk_done.notify_all();
+    });
+  }
+  fn(0u, 0u, std::min(chunk_size, size));
+
+  std::unique_lock<std::mutex> lock(mutex);
+  chunk_done.wait(lock, [&pending_chunks] { return pending_chunks == 0; });
+}
 
 HeapGraphTracker::SequenceState& HeapGraphTracker::GetOrCreateSequence(
     uint32_t seq_id) {
@@ -655,6 +662,8 @@ void HeapGraphTracker::FinalizeProfile(uint32_t seq_id) {
         static_cast<int>(sequence_state.current_upid));
   }
 
+  ObjectGraph graph = BuildObjectGraph(sequence_state);
+  std::vector<uint32_t> new_roots;
   for (const SourceRoot& root : sequence_state.current_roots) {
     for (uint64_t obj_id : root.object_ids) {
       auto ptr = sequence_state.object_id_to_db_row.Find(obj_id);
@@ -668,16 +677,142 @@ void HeapGraphTracker::FinalizeProfile(uint32_t seq_id) {
       auto it_and_success = roots_[std::make_pair(sequence_state.current_upid,
                                                   sequence_state.current_ts)]
                                 .emplace(*ptr);
-      if (it_and_success.second)
-        MarkRoot(storage_, row_ref, root.root_type);
+      if (it_and_success.second) {
+        row_ref.set_root_type(root.root_type);
+        new_roots.push_back(ptr->row_number() - graph.first_row);
+      }
     }
   }
+  MarkReachable(graph, new_roots);
 
-  PopulateSuperClasses(sequence_state);
+  PopulateSuperClasses(graph);
   PopulateNativeSize(sequence_state);
   sequence_state_.erase(seq_id);
 }
 
+HeapGraphTracker::ObjectGraph HeapGraphTracker::BuildObjectGraph(
+    const SequenceState& seq) {
+  ObjectGraph graph;
+  if (seq.object_id_to_db_row.size() == 0)
+    return graph;
+
+  uint32_t first_row = std::numeric_limits<uint32_t>::max();
+  uint32_t last_row = 0;
+  for (auto it = seq.object_id_to_db_row.GetIterator(); it; ++it) {
+    first_row = std::min(first_row, it.value().row_number());
+    last_row = std::max(last_row, it.value().row_number());
+  }
+  graph.first_row = first_row;
+  graph.node_count = last_row - first_row + 1;
+  graph.in_graph.resize(graph.node_count);
+  for (auto it = seq.object_id_to_db_row.GetIterator(); it; ++it) {
+    graph.in_graph[it.value().row_number() - first_row] = 1;
+  }
+
+  const auto& class_tbl = storage_->heap_graph_class_table();
+  std::vector<uint8_t> follow_references(class_tbl.row_count(), 1);
+  for (const char* kind :
+       {"KIND_WEAK_REFERENCE", "KIND_SOFT_REFERENCE",
+        "KIND_FINALIZER_REFERENCE", "KIND_PHANTOM_REFERENCE"}) {
+    std::optional<StringId> kind_id = storage_->string_pool().GetId(kind);
+    if (!kind_id)
+      continue;
+    for (uint32_t i = 0; i < class_tbl.row_count(); ++i) {
+      if (class_tbl.kind()[i] == *kind_id)
+        follow_references[i] = 0;
+    }
+  }
+
+  // Every chunk counts the children of its nodes in |offsets| and appends
+  // them to its own vector. The vectors are then concatenated in order.
+  const auto& objects_tbl = storage_->heap_graph_object_table();
+  const auto& refs_tbl = storage_->heap_graph_reference_table();
+  graph.offsets.resize(graph.node_count + 1);
+  std::vector<std::vector<uint32_t>> chunk_children(thread_count_ + 1);
+  ForEachChunk(graph.node_count, [&](uint32_t chunk, uint32_t begin,
+                                     uint32_t end) {
+    std::vector<uint32_t>& children = chunk_children[chunk];
+    for (uint32_t i = begin; i < end; ++i) {
+      uint32_t row = first_row + i;
+      std::optional<uint32_t> ref_set_id = objects_tbl.reference_set_id()[row];
+      if (!graph.in_graph[i] || !ref_set_id ||
+          !follow_references[objects_tbl.type_id()[row].value]) {
+        continue;
+      }
+      uint32_t count = 0;
+      for (uint32_t ref_row = *ref_set_id;
+           ref_row < refs_tbl.row_count() &&
+           refs_tbl.reference_set_id()[ref_row] == *ref_set_id;
+           ++ref_row) {
+        std::optional<ObjectTable::Id> owned = refs_tbl.owned_id()[ref_row];
+        if (!owned)
+          continue;
+        // All the objects referred to by the graph are part of it.
+        children.push_back(owned->value - first_row);
+        ++count;
+      }
+      graph.offsets[i + 1] = count;
+    }
+  });
+
+  for (uint32_t i = 0; i < graph.node_count; ++i) {
+    graph.offsets[i + 1] += graph.offsets[i];
+  }
+  graph.children.reserve(graph.offsets.back());
+  for (const std::vector<uint32_t>& children : chunk_children) {
+    graph.children.insert(graph.children.end(), children.begin(),
+                          children.end());
+  }
+  return graph;
+}
+
+void HeapGraphTracker::MarkReachable(const ObjectGraph& graph,
+                                     const std::vector<uint32_t>& roots) {
+  // Breadth first search from all the roots at once. Each level is split
+  // between the chunks, which claim the nodes they discover by setting their
+  // |visited| flag: every node is enqueued exactly once.
+  std::vector<std::atomic<bool>> visited(graph.node_count);
+  std::vector<uint32_t> frontier;
+  for (uint32_t root : roots) {
+    if (!visited[root].exchange(true, std::memory_order_relaxed))
+      frontier.push_back(root);
+  }
+
+  std::vector<std::vector<uint32_t>> chunk_next(thread_count_ + 1);
+  while (!frontier.empty()) {
+    ForEachChunk(static_cast<uint32_t>(frontier.size()),
+                 [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+                   std::vector<uint32_t>& next = chunk_next[chunk];
+                   for (uint32_t i = begin; i < end; ++i) {
+                     uint32_t node = frontier[i];
+                     for (uint32_t j = graph.offsets[node];
+                          j < graph.offsets[node + 1]; ++j) {
+                       uint32_t child = graph.children[j];
+                       if (!visited[child].load(std::memory_order_relaxed) &&
+                           !visited[child].exchange(
+                               true, std::memory_order_relaxed)) {
+                         next.push_back(child);
+                       }
+                     }
+                   }
+                 });
+    frontier.clear();
+    for (std::vector<uint32_t>& next : chunk_next) {
+      frontier.insert(frontier.end(), next.begin(), next.end());
+      next.clear();
+    }
+  }
+
+  auto* objects_tbl = storage_->mutable_heap_graph_object_table();
+  for (uint32_t i = 0; i < graph.node_count; ++i) {
+    if (visited[i].load(std::memory_order_relaxed)) {
+      ObjectTable::RowNumber(graph.first_row + i)
+          .ToRowReference(objects_tbl)
+          .set_reachable(true);
+    }
+  }
+}
+
 std::optional<ObjectTable::Id> HeapGraphTracker::GetReferenceByFieldName(
     ObjectTable::Id obj,
     StringId field) {
@@ -774,12 +909,75 @@ void HeapGraphTracker::PopulateNativeSize(const SequenceState& seq) {
 }
 
 // TODO(fmayer): For Android S+ traces, use the superclass_id from the trace.
-void HeapGraphTracker::PopulateSuperClasses(const SequenceState& seq) {
+void HeapGraphTracker::PopulateSuperClasses(const ObjectGraph& graph) {
+  auto* classes_tbl = storage_->mutable_heap_graph_class_table();
+
   // Maps from normalized class name and location, to superclass.
-  std::map<ClassDescriptor, ClassDescriptor> superclass_map =
-      BuildSuperclassMap(seq.current_upid, seq.current_ts, storage_);
+  std::map<ClassDescriptor, ClassDescriptor> superclass_map;
+
+  // Resolve superclasses by identifying the superClass field of the heap
+  // graph objects. superClass ptrs are stored on the static class objects:
+  // work out once per class whether its objects can have one (arrays are
+  // ignored, as they are generated objects).
+  std::vector<uint8_t> has_superclass_field(classes_tbl->row_count());
+  for (uint32_t idx = 0; idx < classes_tbl->row_count(); ++idx) {
+    auto normalized =
+        GetNormalizedType(storage_->GetString(classes_tbl->name()[idx]));
+    has_superclass_field[idx] =
+        normalized.is_static_class && normalized.number_of_arrays == 0;
+  }
+
+  struct SuperclassRef {
+    ObjectTable::Id obj;
+    ObjectTable::Id super_obj;
+  };
+  std::vector<std::vector<SuperclassRef>> chunk_refs(thread_count_ + 1);
+  std::optional<StringId> superclass_field =
+      storage_->string_pool().GetId("java.lang.Class.superClass");
+  if (superclass_field) {
+    const auto& objects_tbl = storage_->heap_graph_object_table();
+    const auto& refs_tbl = storage_->heap_graph_reference_table();
+    ForEachChunk(graph.node_count, [&](uint32_t chunk, uint32_t begin,
+                                       uint32_t end) {
+      for (uint32_t i = begin; i < end; ++i) {
+        uint32_t row = graph.first_row + i;
+        if (!graph.in_graph[i] ||
+            !has_superclass_field[objects_tbl.type_id()[row].value]) {
+          continue;
+        }
+        std::optional<uint32_t> ref_set_id =
+            objects_tbl.reference_set_id()[row];
+        if (!ref_set_id)
+          continue;
+        std::optional<ObjectTable::Id> super_obj_id =
+            GetReferredObj(refs_tbl, *ref_set_id, *superclass_field);
+        // This is expected to be missing for Object and primitive types.
+        if (!super_obj_id)
+          continue;
+        chunk_refs[chunk].push_back({objects_tbl.id()[row], *super_obj_id});
+      }
+    });
+  }
+
+  // Interning strings is not thread-safe: the map is built on this thread.
+  for (const std::vector<SuperclassRef>& refs : chunk_refs) {
+    for (const SuperclassRef& ref : refs) {
+      auto class_descriptor = GetClassDescriptor(*storage_, ref.obj);
+      auto normalized =
+          GetNormalizedType(storage_->GetString(class_descriptor.name));
+
+      // Lookup the super obj type id
+      auto super_class_descriptor =
+          GetClassDescriptor(*storage_, ref.super_obj);
+      auto super_class_name =
+          NormalizeTypeName(storage_->GetString(super_class_descriptor.name));
+      StringId super_class_id = storage_->InternString(super_class_name);
+      StringId class_id = storage_->InternString(normalized.name);
+      superclass_map[{class_id, class_descriptor.location}] = {
+          super_class_id, super_class_descriptor.location};
+    }
+  }
 
-  auto* classes_tbl = storage_->mutable_heap_graph_class_table();
   std::map<ClassDescriptor, ClassTable::Id> class_to_id;
   for (uint32_t idx = 0; idx < classes_tbl->row_count(); ++idx) {
     class_to_id[{classes_tbl->name()[idx], classes_tbl->location()[idx]}] =
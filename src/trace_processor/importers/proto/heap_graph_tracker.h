@@ -18,12 +18,14 @@
 #define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_HEAP_GRAPH_TRACKER_H_
 
 #include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <utility>
 #include <vector>
 
 #include "perfetto/ext/base/string_view.h"
+#include "perfetto/ext/base/threading/thread_pool.h"
 
 #include "protos/perfetto/trace/profiling/heap_graph.pbzero.h"
 #include "src/trace_processor/storage/trace_storage.h"
@@ -55,9 +57,6 @@ struct PathFromRoot {
   std::set<tables::HeapGraphObjectTable::Id> visited;
 };
 
-void MarkRoot(TraceStorage*,
-              tables::HeapGraphObjectTable::RowReference,
-              StringId type);
 void UpdateShortestPaths(TraceStorage* s,
                          tables::HeapGraphObjectTable::RowReference row_ref);
 void FindPathFromRoot(TraceStorage* storage,
@@ -93,12 +92,14 @@ class HeapGraphTracker : public Destructible {
     std::vector<uint64_t> object_ids;
   };
 
-  explicit HeapGraphTracker(TraceStorage* storage);
+  // When |thread_count| is non-zero, FinalizeProfile splits the processing of
+  // the heap graph between |thread_count| worker threads.
+  explicit HeapGraphTracker(TraceStorage* storage, uint32_t thread_count = 0);
 
   static HeapGraphTracker* GetOrCreate(TraceProcessorContext* context) {
     if (!context->heap_graph_tracker) {
-      context->heap_graph_tracker.reset(
-          new HeapGraphTracker(context->storage.get()));
+      context->heap_graph_tracker.reset(new HeapGraphTracker(
+          context->storage.get(), context->config.heap_graph_thread_count));
     }
     return static_cast<HeapGraphTracker*>(context->heap_graph_tracker.get());
   }
@@ -150,6 +151,9 @@ class HeapGraphTracker : public Destructible {
   }
 
  private:
+  // Defined in the .cc file.
+  struct ObjectGraph;
+
   struct InternedField {
     StringId name;
     StringId type_name;
@@ -214,7 +218,16 @@ class HeapGraphTracker : public Destructible {
       SequenceState* sequence_state,
       uint64_t type_id);
   bool SetPidAndTimestamp(SequenceState* seq, UniquePid upid, int64_t ts);
-  void PopulateSuperClasses(const SequenceState& seq);
+  void PopulateSuperClasses(const ObjectGraph& graph);
+  ObjectGraph BuildObjectGraph(const SequenceState& seq);
+  void MarkReachable(const ObjectGraph& graph,
+                     const std::vector<uint32_t>& roots);
+
+  // Splits [0, size) in up to one chunk per thread of |pool_| plus one for
+  // the calling thread and calls fn(chunk_index, begin, end) for each chunk
+  // in parallel. Returns once all the calls have returned.
+  template <typename F>
+  void ForEachChunk(uint32_t size, const F& fn);
   InternedType* GetSuperClass(SequenceState* sequence_state,
                               const InternedType* current_type);
   bool IsTruncated(UniquePid upid, int64_t ts);
@@ -234,6 +247,10 @@ class HeapGraphTracker : public Destructible {
   TraceStorage* const storage_;
   std::map<uint32_t, SequenceState> sequence_state_;
 
+  // Only set when the tracker was created with a non-zero thread count.
+  std::unique_ptr<base::ThreadPool> pool_;
+  uint32_t thread_count_ = 0;
+
   std::map<std::pair<std::optional<StringId>, StringId>,
            std::vector<tables::HeapGraphClassTable::RowNumber>>
       class_to_rows_;
@@ -335,6 +335,79 @@ TEST(HeapGraphTrackerTest, BuildFlamegraph) {
   EXPECT_THAT(counts, UnorderedElementsAre(1, 2, 1, 1, 1));
 }
 
+TEST(HeapGraphTrackerTest, MarkReachableWithThreads) {
+  // A binary tree of kTreeSize objects, in which the children of object i are
+  // 2i and 2i + 1, plus kTreeSize garbage objects which refer to the tree.
+  // Object 2 is a weak reference, so its subtree is not reachable.
+  constexpr uint64_t kSeqId = 1;
+  constexpr UniquePid kPid = 1;
+  constexpr int64_t kTimestamp = 1;
+  constexpr uint64_t kTreeSize = 100000;
+
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  context.process_tracker.reset(new ProcessTracker(&context));
+  context.process_tracker->GetOrCreateProcess(kPid);
+
+  HeapGraphTracker tracker(context.storage.get(), /*thread_count=*/3);
+
+  constexpr uint64_t kField = 1;
+  constexpr uint64_t kLocation = 0;
+  constexpr uint64_t kNode = 1;
+  constexpr uint64_t kWeakRef = 2;
+
+  tracker.AddInternedFieldName(kSeqId, kField, "foo");
+  tracker.AddInternedLocationName(kSeqId, kLocation,
+                                  context.storage->InternString("location"));
+  tracker.AddInternedType(kSeqId, kNode, context.storage->InternString("Node"),
+                          kLocation, /*object_size=*/1,
+                          /*field_name_ids=*/{}, /*superclass_id=*/0,
+                          /*classloader_id=*/0, /*no_fields=*/false,
+                          context.storage->InternString("KIND_NORMAL"));
+  tracker.AddInternedType(
+      kSeqId, kWeakRef, context.storage->InternString("WeakReference"),
+      kLocation, /*object_size=*/1,
+      /*field_name_ids=*/{}, /*superclass_id=*/0,
+      /*classloader_id=*/0, /*no_fields=*/false,
+      context.storage->InternString("KIND_WEAK_REFERENCE"));
+
+  for (uint64_t id = 1; id <= 2 * kTreeSize; ++id) {
+    HeapGraphTracker::SourceObject obj;
+    obj.object_id = id;
+    obj.type_id = id == 2 ? kWeakRef : kNode;
+    if (id > kTreeSize) {
+      obj.field_name_ids = {kField};
+      obj.referred_objects = {id - kTreeSize};
+    } else {
+      for (uint64_t child = 2 * id; child <= 2 * id + 1; ++child) {
+        if (child <= kTreeSize) {
+          obj.field_name_ids.push_back(kField);
+          obj.referred_objects.push_back(child);
+        }
+      }
+    }
+    tracker.AddObject(kSeqId, kPid, kTimestamp, std::move(obj));
+  }
+
+  HeapGraphTracker::SourceRoot root;
+  root.root_type = context.storage->InternString("ROOT");
+  root.object_ids.emplace_back(1);
+  tracker.AddRoot(kSeqId, kPid, kTimestamp, root);
+  tracker.FinalizeProfile(kSeqId);
+
+  // Objects are inserted in id order, so object i is at row i - 1.
+  const auto& objects = context.storage->heap_graph_object_table();
+  ASSERT_EQ(objects.row_count(), 2 * kTreeSize);
+  for (uint32_t row = 0; row < objects.row_count(); ++row) {
+    uint64_t id = row + 1;
+    uint64_t ancestor = id;
+    while (ancestor > 3)
+      ancestor /= 2;
+    bool reachable = id <= kTreeSize && (ancestor != 2 || id == 2);
+    EXPECT_EQ(objects.reachable()[row] != 0, reachable) << "object " << id;
+  }
+}
+
 static const char kArray[] = "X[]";
 static const char kDoubleArray[] = "X[][]";
 static const char kNoArray[] = "X";
@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/importers/proto/heap_profile_tracker.h"
 
+#include "src/trace_processor/importers/common/process_tracker.h"
 #include "src/trace_processor/importers/proto/stack_profile_tracker.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 #include "test/gtest_and_gmock.h"
@@ -181,6 +182,47 @@ TEST_F(HeapProfileTrackerDupTest, Callstack) {
   EXPECT_EQ(frame_id[1], FrameId{0});
 }
 
+// Incremental dumps (HeapprofdConfig.ContinuousDumpConfig.incremental) only
+// contain the callstacks that changed since the previous dump. The ones left
+// out must keep their values, so they must not get any rows.
+TEST_F(HeapProfileTrackerDupTest, CallstackLeftOutOfDump) {
+  context.process_tracker.reset(new ProcessTracker(&context));
+  constexpr uint64_t kOtherCallstackId = kCallstackId + 1;
+
+  auto dump = [this](int64_t ts,
+                     std::vector<std::pair<uint64_t, uint64_t>> allocated) {
+    InsertCallsite(kFirstPacket);
+    sequence_stack_profile_tracker->AddCallstack(kOtherCallstackId,
+                                                 {kFirstPacket.frame_id});
+    for (const auto& callstack_and_allocated : allocated) {
+      HeapProfileTracker::SourceAllocation alloc;
+      alloc.pid = 1;
+      alloc.timestamp = ts;
+      alloc.callstack_id = callstack_and_allocated.first;
+      alloc.self_allocated = callstack_and_allocated.second;
+      alloc.alloc_count = 1;
+      context.heap_profile_tracker->StoreAllocation(kDefaultSequence, alloc);
+    }
+    context.heap_profile_tracker->FinalizeProfile(
+        kDefaultSequence, sequence_stack_profile_tracker.get(), nullptr);
+  };
+  dump(1, {{kCallstackId, 10}, {kOtherCallstackId, 20}});
+  dump(2, {{kOtherCallstackId, 30}});
+  dump(3, {{kCallstackId, 15}});
+
+  using TsAndSize = std::pair<int64_t, int64_t>;
+  const auto& allocs = context.storage->heap_profile_allocation_table();
+  std::vector<TsAndSize> first;
+  std::vector<TsAndSize> other;
+  for (uint32_t i = 0; i < allocs.row_count(); ++i) {
+    auto& out = allocs.callsite_id()[i] == allocs.callsite_id()[0] ? first
+                                                                   : other;
+    out.emplace_back(allocs.ts()[i], allocs.size()[i]);
+  }
+  EXPECT_THAT(first, ElementsAre(TsAndSize{1, 10}, TsAndSize{3, 5}));
+  EXPECT_THAT(other, ElementsAre(TsAndSize{1, 20}, TsAndSize{2, 10}));
+}
+
 std::optional<CallsiteId> FindCallstack(const TraceStorage& storage,
                                         int64_t depth,
                                         std::optional<CallsiteId> parent,
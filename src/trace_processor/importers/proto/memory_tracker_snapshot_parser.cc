@@ -16,15 +16,28 @@
 
 #include "src/trace_processor/importers/proto/memory_tracker_snapshot_parser.h"
 
+#include <condition_variable>
+#include <mutex>
+
 #include "perfetto/ext/base/string_view.h"
 #include "protos/perfetto/trace/memory_graph.pbzero.h"
 #include "src/trace_processor/containers/string_pool.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
 #include "src/trace_processor/tables/memory_tables_py.h"
+#include "src/trace_processor/util/threading.h"
 
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+// Number of complete snapshots queued per worker thread before their graphs
+// are computed. Keeps the threads busy without holding the raw nodes of too
+// many snapshots in memory.
+constexpr size_t kPendingSnapshotsPerThread = 4;
+
+}  // namespace
+
 MemoryTrackerSnapshotParser::MemoryTrackerSnapshotParser(
     TraceProcessorContext* context)
     : context_(context),
@@ -35,13 +48,21 @@ MemoryTrackerSnapshotParser::MemoryTrackerSnapshotParser(
                  context_->storage->InternString("bytes")}},
       aggregate_raw_nodes_(),
       last_snapshot_timestamp_(-1),
-      last_snapshot_level_of_detail_(LevelOfDetail::kFirst) {}
+      last_snapshot_level_of_detail_(LevelOfDetail::kFirst) {
+#if PERFETTO_TP_HAS_THREADS()
+  uint32_t thread_count = context_->config.memory_graph_thread_count;
+  if (thread_count > 0) {
+    pool_.reset(new base::ThreadPool(thread_count));
+    max_pending_snapshots_ = thread_count * kPendingSnapshotsPerThread;
+  }
+#endif
+}
 
 void MemoryTrackerSnapshotParser::ParseMemoryTrackerSnapshot(int64_t ts,
                                                              ConstBytes blob) {
   PERFETTO_DCHECK(last_snapshot_timestamp_ <= ts);
   if (!aggregate_raw_nodes_.empty() && ts != last_snapshot_timestamp_) {
-    GenerateGraphFromRawNodesAndEmitRows();
+    FinishLastSnapshot();
   }
   ReadProtoSnapshot(blob, aggregate_raw_nodes_, last_snapshot_level_of_detail_);
   last_snapshot_timestamp_ = ts;
@@ -49,8 +70,9 @@ void MemoryTrackerSnapshotParser::ParseMemoryTrackerSnapshot(int64_t ts,
 
 void MemoryTrackerSnapshotParser::NotifyEndOfFile() {
   if (!aggregate_raw_nodes_.empty()) {
-    GenerateGraphFromRawNodesAndEmitRows();
+    FinishLastSnapshot();
   }
+  EmitPendingSnapshots();
 }
 
 void MemoryTrackerSnapshotParser::ReadProtoSnapshot(
@@ -162,18 +184,13 @@ std::unique_ptr<GlobalNodeGraph> MemoryTrackerSnapshotParser::GenerateGraph(
   return graph;
 }
 
-void MemoryTrackerSnapshotParser::EmitRows(int64_t ts,
-                                           GlobalNodeGraph& graph,
-                                           LevelOfDetail level_of_detail) {
+void MemoryTrackerSnapshotParser::EmitRows(const PendingSnapshot& snapshot) {
   IdNodeMap id_node_map;
-
-  // For now, we use the existing global instant event track for chrome events,
-  // since memory dumps are global.
-  TrackId track_id =
-      context_->track_tracker->GetOrCreateLegacyChromeGlobalInstantTrack();
+  const GlobalNodeGraph& graph = *snapshot.graph;
 
   tables::MemorySnapshotTable::Row snapshot_row(
-      ts, track_id, level_of_detail_ids_[static_cast<size_t>(level_of_detail)]);
+      snapshot.ts, snapshot.track_id,
+      level_of_detail_ids_[static_cast<size_t>(snapshot.level_of_detail)]);
   tables::MemorySnapshotTable::Id snapshot_row_id =
       context_->storage->mutable_memory_snapshot_table()
           ->Insert(snapshot_row)
@@ -181,8 +198,9 @@ void MemoryTrackerSnapshotParser::EmitRows(int64_t ts,
 
   for (auto const& it_process : graph.process_node_graphs()) {
     tables::ProcessMemorySnapshotTable::Row process_row;
-    process_row.upid = context_->process_tracker->GetOrCreateProcess(
-        static_cast<uint32_t>(it_process.first));
+    auto upid_it = snapshot.upids.find(it_process.first);
+    PERFETTO_DCHECK(upid_it != snapshot.upids.end());
+    process_row.upid = upid_it->second;
     process_row.snapshot_id = snapshot_row_id;
     tables::ProcessMemorySnapshotTable::Id proc_snapshot_row_id =
         context_->storage->mutable_process_memory_snapshot_table()
@@ -197,7 +215,7 @@ void MemoryTrackerSnapshotParser::EmitRows(int64_t ts,
   // TODO(mobica-google-contributors@mobica.com): Track the shared memory graph
   // in a separate table.
   tables::ProcessMemorySnapshotTable::Row fake_process_row;
-  fake_process_row.upid = context_->process_tracker->GetOrCreateProcess(0u);
+  fake_process_row.upid = snapshot.shared_upid;
   fake_process_row.snapshot_id = snapshot_row_id;
   tables::ProcessMemorySnapshotTable::Id fake_proc_snapshot_row_id =
       context_->storage->mutable_process_memory_snapshot_table()
@@ -314,10 +332,61 @@ MemoryTrackerSnapshotParser::EmitNode(
   return node_row_id;
 }
 
-void MemoryTrackerSnapshotParser::GenerateGraphFromRawNodesAndEmitRows() {
-  std::unique_ptr<GlobalNodeGraph> graph = GenerateGraph(aggregate_raw_nodes_);
-  EmitRows(last_snapshot_timestamp_, *graph, last_snapshot_level_of_detail_);
+void MemoryTrackerSnapshotParser::FinishLastSnapshot() {
+  PendingSnapshot snapshot;
+  snapshot.ts = last_snapshot_timestamp_;
+  snapshot.level_of_detail = last_snapshot_level_of_detail_;
+
+  // For now, we use the existing global instant event track for chrome events,
+  // since memory dumps are global.
+  snapshot.track_id =
+      context_->track_tracker->GetOrCreateLegacyChromeGlobalInstantTrack();
+  for (const auto& pid_and_node : aggregate_raw_nodes_) {
+    snapshot.upids[pid_and_node.first] =
+        context_->process_tracker->GetOrCreateProcess(
+            static_cast<uint32_t>(pid_and_node.first));
+  }
+  snapshot.shared_upid = context_->process_tracker->GetOrCreateProcess(0u);
+
+  snapshot.raw_nodes = std::move(aggregate_raw_nodes_);
   aggregate_raw_nodes_.clear();
+  pending_snapshots_.emplace_back(std::move(snapshot));
+  if (pending_snapshots_.size() >= max_pending_snapshots_)
+    EmitPendingSnapshots();
+}
+
+void MemoryTrackerSnapshotParser::EmitPendingSnapshots() {
+#if PERFETTO_TP_HAS_THREADS()
+  // The graphs of the snapshots are independent from each other and from the
+  // storage, so they are all computed at the same time. The first one is
+  // computed on this thread.
+  if (pool_ && pending_snapshots_.size() > 1) {
+    std::mutex mutex;
+    std::condition_variable snapshot_done;
+    size_t remaining = pending_snapshots_.size() - 1;
+    for (size_t i = 1; i < pending_snapshots_.size(); ++i) {
+      PendingSnapshot* snapshot = &pending_snapshots_[i];
+      pool_->PostTask([&, snapshot] {
+        snapshot->graph = GenerateGraph(snapshot->raw_nodes);
+        std::lock_guard<std::mutex> lock(mutex);
+        --remaining;
+        snapshot_done.notify_all();
+      });
+    }
+    PendingSnapshot& first = pending_snapshots_.front();
+    first.graph = GenerateGraph(first.raw_nodes);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    snapshot_done.wait(lock, [&remaining] { return remaining == 0; });
+  }
+#endif
+
+  for (PendingSnapshot& snapshot : pending_snapshots_) {
+    if (!snapshot.graph)
+      snapshot.graph = GenerateGraph(snapshot.raw_nodes);
+    EmitRows(snapshot);
+  }
+  pending_snapshots_.clear();
 }
 
 }  // namespace trace_processor
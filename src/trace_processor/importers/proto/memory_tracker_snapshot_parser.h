@@ -17,6 +17,10 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_MEMORY_TRACKER_SNAPSHOT_PARSER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_MEMORY_TRACKER_SNAPSHOT_PARSER_H_
 
+#include <deque>
+#include <memory>
+
+#include "perfetto/ext/base/threading/thread_pool.h"
 #include "perfetto/ext/trace_processor/importers/memory_tracker/graph_processor.h"
 #include "protos/perfetto/trace/memory_graph.pbzero.h"
 #include "src/trace_processor/importers/common/process_tracker.h"
@@ -43,6 +47,22 @@ class MemoryTrackerSnapshotParser {
       std::map<MemoryAllocatorNodeId, tables::MemorySnapshotNodeTable::Id>;
   using ConstBytes = protozero::ConstBytes;
 
+  // A complete snapshot waiting for its graph to be computed and its rows to
+  // be emitted.
+  struct PendingSnapshot {
+    int64_t ts = 0;
+    LevelOfDetail level_of_detail = LevelOfDetail::kFirst;
+    RawMemoryNodeMap raw_nodes;
+    std::unique_ptr<GlobalNodeGraph> graph;
+
+    // Resolved when the snapshot is complete so that the processes and the
+    // track are created in the same order as the rest of the trace, even if
+    // the rows are emitted later.
+    TrackId track_id;
+    std::map<base::PlatformProcessId, UniquePid> upids;
+    UniquePid shared_upid = 0;
+  };
+
   class ChildNode {
    public:
     ChildNode() : table_index_(-1) {}
@@ -66,11 +86,8 @@ class MemoryTrackerSnapshotParser {
   std::unique_ptr<GlobalNodeGraph> GenerateGraph(RawMemoryNodeMap& raw_nodes);
 
   // Fills out MemorySnapshotTable, ProcessMemorySnapshotTable,
-  // MemorySnapshotNodeTable, MemorySnapshotEdgeTable with given
-  // timestamp |ts|, |graph|, |level_of_detail|.
-  void EmitRows(int64_t ts,
-                GlobalNodeGraph& graph,
-                LevelOfDetail level_of_detail);
+  // MemorySnapshotNodeTable, MemorySnapshotEdgeTable with given |snapshot|.
+  void EmitRows(const PendingSnapshot& snapshot);
 
   // Fills out MemorySnapshotNodeTable for given root node
   // |root_node_graph| and ProcessMemorySnapshotId |proc_snapshot_row_id|.
@@ -106,7 +123,13 @@ class MemoryTrackerSnapshotParser {
       ProcessMemorySnapshotId& proc_snapshot_row_id,
       IdNodeMap& id_node_map);
 
-  void GenerateGraphFromRawNodesAndEmitRows();
+  // Queues the aggregated raw nodes of the last snapshot, and emits the queued
+  // snapshots once there are enough of them to keep the threads busy.
+  void FinishLastSnapshot();
+
+  // Generates the graphs of the queued snapshots, in parallel if there is a
+  // |pool_|, then emits their rows in timestamp order.
+  void EmitPendingSnapshots();
 
   TraceProcessorContext* context_;
   std::array<StringId, 3> level_of_detail_ids_;
@@ -114,6 +137,11 @@ class MemoryTrackerSnapshotParser {
   RawMemoryNodeMap aggregate_raw_nodes_;
   int64_t last_snapshot_timestamp_;
   LevelOfDetail last_snapshot_level_of_detail_;
+  std::deque<PendingSnapshot> pending_snapshots_;
+
+  // Only created when Config::memory_graph_thread_count > 0.
+  std::unique_ptr<base::ThreadPool> pool_;
+  size_t max_pending_snapshots_ = 1;
 };
 
 }  // namespace trace_processor
@@ -20,7 +20,9 @@
 #include <optional>
 #include <unordered_map>
 
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/trace_processor/ref_counted.h"
+#include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/util/interned_message_view.h"
 
 #include "protos/perfetto/trace/trace_packet_defaults.pbzero.h"
@@ -79,6 +81,37 @@ class PacketSequenceStateGeneration : public RefCounted {
   PacketSequenceState* state() const { return state_; }
   size_t generation_index() const { return generation_index_; }
 
+  // The track that a TrackEvent |track_uuid| resolved to, together with the
+  // thread or process the track is associated with. Cached by TrackEventParser
+  // so that dense sequences don't look these up again for every event. The
+  // cache is dropped together with the generation, i.e. whenever the
+  // incremental state or the defaults of the sequence change.
+  struct TrackEventTrack {
+    enum class Kind { kThread, kProcess, kOther };
+
+    TrackId track_id;
+    Kind kind;
+
+    // Only valid if |kind| == |Kind::kThread|.
+    UniqueTid utid;
+
+    // Only valid if |kind| == |Kind::kProcess|.
+    UniquePid upid;
+
+    // Whether the name of the track can't change anymore (see
+    // TrackEventTracker::IsDescriptorTrackNameFinal()).
+    bool name_final;
+  };
+
+  // Returns |nullptr| if no track was cached for |uuid|.
+  const TrackEventTrack* GetTrackEventTrack(uint64_t uuid) {
+    return track_event_tracks_.Find(uuid);
+  }
+
+  void SetTrackEventTrack(uint64_t uuid, const TrackEventTrack& track) {
+    track_event_tracks_[uuid] = track;
+  }
+
  private:
   friend class PacketSequenceState;
 
@@ -107,6 +140,7 @@ class PacketSequenceStateGeneration : public RefCounted {
   size_t generation_index_;
   InternedFieldMap interned_data_;
   std::optional<InternedMessageView> trace_packet_defaults_;
+  base::FlatHashMap<uint64_t, TrackEventTrack> track_event_tracks_;
 };
 
 }  // namespace trace_processor
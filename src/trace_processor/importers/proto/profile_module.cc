@@ -242,10 +242,13 @@ void ProfileModule::ParsePerfSample(
   }
 
   // Proper sample, populate the |perf_sample| table with everything except the
-  // recorded counter values, which go to |counter|.
-  context_->event_tracker->PushCounter(
-      ts, static_cast<double>(sample.timebase_count()),
-      sampling_stream.timebase_track_id);
+  // recorded counter values, which go to |counter|. Samples aggregated by the
+  // producer don't carry counter values.
+  if (!sample.has_sample_count()) {
+    context_->event_tracker->PushCounter(
+        ts, static_cast<double>(sample.timebase_count()),
+        sampling_stream.timebase_track_id);
+  }
 
   SequenceStackProfileTracker& stack_tracker =
       sequence_state->state()->sequence_stack_profile_tracker();
@@ -295,7 +298,11 @@ void ProfileModule::ParsePerfSample(
   tables::PerfSampleTable::Row sample_row(ts, utid, sample.cpu(), cpu_mode_id,
                                           cs_id, unwind_error_id,
                                           sampling_stream.perf_session_id);
-  context_->storage->mutable_perf_sample_table()->Insert(sample_row);
+  // An aggregated sample stands for |sample_count| identical samples, all
+  // attributed to the timestamp of the last one.
+  uint64_t count = sample.has_sample_count() ? sample.sample_count() : 1;
+  for (uint64_t i = 0; i < count; i++)
+    context_->storage->mutable_perf_sample_table()->Insert(sample_row);
 }
 
 void ProfileModule::ParseProfilePacket(
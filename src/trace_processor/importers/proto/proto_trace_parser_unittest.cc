@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/importers/proto/proto_trace_reader.h"
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
@@ -72,6 +73,10 @@
 #include "protos/perfetto/trace/track_event/track_descriptor.pbzero.h"
 #include "protos/perfetto/trace/track_event/track_event.pbzero.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+#include <zlib.h>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 namespace {
@@ -353,6 +358,65 @@ TEST_F(ProtoTraceParserTest, LoadSingleEvent) {
   context_.sorter->ExtractEventsForced();
 }
 
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+TEST_F(ProtoTraceParserTest, LoadCompressedEventsWithTokenizationThreads) {
+  protozero::HeapBuffered<protos::pbzero::Trace> inner;
+  auto* bundle = inner->add_packet()->set_ftrace_events();
+  bundle->set_cpu(10);
+
+  auto* event = bundle->add_event();
+  event->set_timestamp(1000);
+  event->set_pid(12);
+
+  static const char kProc1Name[] = "proc1";
+  static const char kProc2Name[] = "proc2";
+  auto* sched_switch = event->set_sched_switch();
+  sched_switch->set_prev_pid(10);
+  sched_switch->set_prev_comm(kProc2Name);
+  sched_switch->set_prev_prio(256);
+  sched_switch->set_prev_state(32);
+  sched_switch->set_next_comm(kProc1Name);
+  sched_switch->set_next_pid(100);
+  sched_switch->set_next_prio(1024);
+
+  std::vector<uint8_t> raw = inner.SerializeAsArray();
+  uLongf compressed_size = compressBound(static_cast<uLong>(raw.size()));
+  std::vector<uint8_t> compressed(compressed_size);
+  ASSERT_EQ(compress(compressed.data(), &compressed_size, raw.data(),
+                     static_cast<uLong>(raw.size())),
+            Z_OK);
+  trace_->add_packet()->set_compressed_packets(compressed.data(),
+                                               compressed_size);
+
+  // A second, uncompressed packet checks that the two are merged in order.
+  bundle = trace_->add_packet()->set_ftrace_events();
+  bundle->set_cpu(10);
+  event = bundle->add_event();
+  event->set_timestamp(2000);
+  event->set_pid(12);
+  sched_switch = event->set_sched_switch();
+  sched_switch->set_prev_pid(100);
+  sched_switch->set_prev_comm(kProc1Name);
+  sched_switch->set_prev_prio(1024);
+  sched_switch->set_prev_state(0);
+  sched_switch->set_next_comm(kProc2Name);
+  sched_switch->set_next_pid(10);
+  sched_switch->set_next_prio(256);
+
+  InSequence in_sequence;
+  EXPECT_CALL(*sched_,
+              PushSchedSwitch(10, 1000, 10, base::StringView(kProc2Name), 256,
+                              32, 100, base::StringView(kProc1Name), 1024));
+  EXPECT_CALL(*sched_,
+              PushSchedSwitch(10, 2000, 100, base::StringView(kProc1Name),
+                              1024, 0, 10, base::StringView(kProc2Name), 256));
+
+  context_.config.tokenization_thread_count = 2;
+  ASSERT_TRUE(Tokenize().ok());
+  context_.sorter->ExtractEventsForced();
+}
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+
 TEST_F(ProtoTraceParserTest, LoadEventsIntoRaw) {
   auto* bundle = trace_->add_packet()->set_ftrace_events();
   bundle->set_cpu(10);
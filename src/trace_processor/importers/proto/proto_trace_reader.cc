@@ -18,11 +18,12 @@
 
 #include <optional>
 #include <string>
+#include <vector>
 
-#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/utils.h"
+#include "perfetto/ext/base/waitable_event.h"
 #include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/trace_processor/status.h"
@@ -39,6 +40,7 @@
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/util/descriptors.h"
 #include "src/trace_processor/util/gzip_utils.h"
+#include "src/trace_processor/util/threading.h"
 
 #include "protos/perfetto/common/builtin_clock.pbzero.h"
 #include "protos/perfetto/config/trace_config.pbzero.h"
@@ -51,20 +53,136 @@
 
 namespace perfetto {
 namespace trace_processor {
+namespace {
+
+// Number of bytes of top-level packets which are decompressed by a single
+// task on the thread pool. Big enough to amortize the cost of posting the
+// task, small enough to split the (up to 128MB when the trace file is mmaped)
+// chunks passed to Parse() into many shards.
+constexpr size_t kShardSizeBytes = 4 * 1024 * 1024;
+
+// A contiguous range of top-level packets which is decompressed as a unit on
+// the thread pool.
+struct PacketShard {
+  struct Decompressed {
+    // Index into |packets| of the packet containing the compressed packets.
+    size_t index;
+    std::vector<TraceBlobView> packets;
+  };
+
+  std::vector<TraceBlobView> packets;
+  size_t size_bytes = 0;
+
+  // The fields below are written by the thread pool and must be read only
+  // after |done| has been notified.
+  std::vector<Decompressed> decompressed;
+  util::Status status;
+  base::WaitableEvent done;
+};
+
+void DecompressShard(PacketShard* shard) {
+  // Note: TraceBlobView refcounts are not thread-safe. The packets in
+  // |shard->packets| point into the blob which is being tokenized on the
+  // calling thread, so this function must not copy nor destroy them. The
+  // decompressed views, instead, point into blobs only known to this thread
+  // until |shard->done| is notified.
+  util::GzipDecompressor decompressor;
+  for (size_t i = 0; i < shard->packets.size(); ++i) {
+    const TraceBlobView& packet = shard->packets[i];
+    ProtoTraceTokenizer::CompressedPacketsDecoder decoder(packet.data(),
+                                                          packet.length());
+    const protozero::Field& compressed =
+        decoder.at<ProtoTraceTokenizer::kCompressedPackets>();
+    if (!compressed.valid())
+      continue;
+    shard->decompressed.emplace_back();
+    PacketShard::Decompressed& out = shard->decompressed.back();
+    out.index = i;
+    shard->status = ProtoTraceTokenizer::DecompressPackets(
+        &decompressor, compressed.as_bytes(),
+        [&out](TraceBlobView expanded) {
+          out.packets.emplace_back(std::move(expanded));
+          return util::OkStatus();
+        });
+    if (!shard->status.ok())
+      break;
+  }
+  shard->done.Notify();
+}
+
+}  // namespace
 
 ProtoTraceReader::ProtoTraceReader(TraceProcessorContext* ctx)
     : context_(ctx),
       skipped_packet_key_id_(ctx->storage->InternString("skipped_packet")),
       invalid_incremental_state_key_id_(
-          ctx->storage->InternString("invalid_incremental_state")) {}
+          ctx->storage->InternString("invalid_incremental_state")) {
+#if PERFETTO_TP_HAS_THREADS()
+  uint32_t thread_count = ctx->config.tokenization_thread_count;
+  if (thread_count > 0)
+    tokenization_pool_.reset(new base::ThreadPool(thread_count));
+#endif
+}
 ProtoTraceReader::~ProtoTraceReader() = default;
 
 util::Status ProtoTraceReader::Parse(TraceBlobView blob) {
+  if (tokenization_pool_)
+    return ParseWithThreadPool(std::move(blob));
   return tokenizer_.Tokenize(std::move(blob), [this](TraceBlobView packet) {
     return ParsePacket(std::move(packet));
   });
 }
 
+util::Status ProtoTraceReader::ParseWithThreadPool(TraceBlobView blob) {
+  // Splitting the chunk into top-level packets only requires to read the
+  // preamble of each packet so is cheap compared to the rest of tokenization.
+  std::vector<std::unique_ptr<PacketShard>> shards;
+  RETURN_IF_ERROR(tokenizer_.TokenizeTopLevel(
+      std::move(blob), [&shards](TraceBlobView packet) {
+        if (shards.empty() || shards.back()->size_bytes >= kShardSizeBytes)
+          shards.emplace_back(new PacketShard());
+        shards.back()->size_bytes += packet.size();
+        shards.back()->packets.emplace_back(std::move(packet));
+        return util::OkStatus();
+      }));
+
+  for (auto& shard : shards) {
+    PacketShard* shard_ptr = shard.get();
+    tokenization_pool_->PostTask([shard_ptr] { DecompressShard(shard_ptr); });
+  }
+
+  // Tokenize the shards in order, as soon as each of them is decompressed.
+  // The sequence state (e.g. interned data, clock snapshots) depends on all
+  // the packets before it so this has to happen on this thread, in order.
+  util::Status status;
+  size_t i = 0;
+  for (; i < shards.size() && status.ok(); ++i) {
+    PacketShard* shard = shards[i].get();
+    shard->done.Wait();
+    status = shard->status;
+    auto decompressed_it = shard->decompressed.begin();
+    for (size_t j = 0; j < shard->packets.size() && status.ok(); ++j) {
+      if (decompressed_it != shard->decompressed.end() &&
+          decompressed_it->index == j) {
+        for (TraceBlobView& packet : decompressed_it->packets) {
+          status = ParsePacket(std::move(packet));
+          if (!status.ok())
+            break;
+        }
+        ++decompressed_it;
+        continue;
+      }
+      status = ParsePacket(std::move(shard->packets[j]));
+    }
+  }
+
+  // On error, wait for the outstanding tasks before destroying the shards.
+  for (; i < shards.size(); ++i) {
+    shards[i]->done.Wait();
+  }
+  return status;
+}
+
 util::Status ProtoTraceReader::ParseExtensionDescriptor(ConstBytes descriptor) {
   protos::pbzero::ExtensionDescriptor::Decoder decoder(descriptor.data,
                                                        descriptor.size);
@@ -21,6 +21,7 @@
 
 #include <memory>
 
+#include "perfetto/ext/base/threading/thread_pool.h"
 #include "src/trace_processor/importers/common/chunked_trace_reader.h"
 #include "src/trace_processor/importers/proto/proto_incremental_state.h"
 #include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
@@ -49,6 +50,12 @@ class TraceStorage;
 // trace into packets, handles parsing of any packets which need to be
 // handled in trace-order and passes the remainder to TraceSorter to sort
 // into timestamp order.
+//
+// When Config::tokenization_thread_count is non-zero, each chunk passed to
+// Parse() is first split into top-level packets, which are then grouped into
+// shards. The decompression of the compressed packets in each shard happens
+// on a thread pool while the calling thread tokenizes, in order, the shards
+// which are already done.
 class ProtoTraceReader : public ChunkedTraceReader {
  public:
   // |reader| is the abstract method of getting chunks of size |chunk_size_b|
@@ -62,6 +69,7 @@ class ProtoTraceReader : public ChunkedTraceReader {
 
  private:
   using ConstBytes = protozero::ConstBytes;
+  util::Status ParseWithThreadPool(TraceBlobView);
   util::Status ParsePacket(TraceBlobView);
   util::Status ParseServiceEvent(int64_t ts, ConstBytes);
   util::Status ParseClockSnapshot(ConstBytes blob, uint32_t seq_id);
@@ -99,6 +107,9 @@ class ProtoTraceReader : public ChunkedTraceReader {
 
   StringId skipped_packet_key_id_;
   StringId invalid_incremental_state_key_id_;
+
+  // Only created when Config::tokenization_thread_count > 0.
+  std::unique_ptr<base::ThreadPool> tokenization_pool_;
 };
 
 }  // namespace trace_processor
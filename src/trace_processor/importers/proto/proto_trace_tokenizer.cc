@@ -24,18 +24,21 @@ namespace trace_processor {
 
 ProtoTraceTokenizer::ProtoTraceTokenizer() = default;
 
-util::Status ProtoTraceTokenizer::Decompress(TraceBlobView input,
-                                             TraceBlobView* output) {
+// static
+util::Status ProtoTraceTokenizer::Decompress(
+    util::GzipDecompressor* decompressor,
+    protozero::ConstBytes input,
+    TraceBlobView* output) {
   PERFETTO_DCHECK(util::IsGzipSupported());
 
   std::vector<uint8_t> data;
-  data.reserve(input.length());
+  data.reserve(input.size);
 
   // Ensure that the decompressor is able to cope with a new stream of data.
-  decompressor_.Reset();
+  decompressor->Reset();
   using ResultCode = util::GzipDecompressor::ResultCode;
-  ResultCode ret = decompressor_.FeedAndExtract(
-      input.data(), input.length(),
+  ResultCode ret = decompressor->FeedAndExtract(
+      input.data, input.size,
       [&data](const uint8_t* buffer, size_t buffer_len) {
         data.insert(data.end(), buffer, buffer + buffer_len);
       });
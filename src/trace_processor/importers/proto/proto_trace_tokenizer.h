@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "perfetto/base/status.h"
+#include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/public/compiler.h"
 #include "perfetto/trace_processor/status.h"
@@ -43,6 +44,86 @@ class ProtoTraceTokenizer {
 
   template <typename Callback = util::Status(TraceBlobView)>
   util::Status Tokenize(TraceBlobView blob, Callback callback) {
+    return TokenizeInternal</*kExpandPackets=*/true>(std::move(blob),
+                                                      callback);
+  }
+
+  // Like Tokenize() but invokes |callback| with the top-level TracePackets
+  // found in the trace *without* expanding compressed packets. The caller is
+  // responsible for passing the |compressed_packets| of those to
+  // DecompressPackets(): this allows to offload the decompression to other
+  // threads.
+  template <typename Callback = util::Status(TraceBlobView)>
+  util::Status TokenizeTopLevel(TraceBlobView blob, Callback callback) {
+    return TokenizeInternal</*kExpandPackets=*/false>(std::move(blob),
+                                                       callback);
+  }
+
+  // Only looks at the compressed_packets field of a TracePacket, without
+  // indexing all the other fields as a TracePacket::Decoder would.
+  static constexpr uint32_t kCompressedPackets =
+      protos::pbzero::TracePacket::kCompressedPacketsFieldNumber;
+  using CompressedPacketsDecoder =
+      protozero::SelectedFieldsDecoder<kCompressedPackets>;
+
+  // Invokes |callback| with |packet| or, if |packet| contains
+  // compressed_packets, with each of the TracePackets obtained by
+  // decompressing it.
+  template <typename Callback = util::Status(TraceBlobView)>
+  static util::Status ExpandPacket(util::GzipDecompressor* decompressor,
+                                   TraceBlobView packet,
+                                   Callback callback) {
+    CompressedPacketsDecoder decoder(packet.data(), packet.length());
+    const protozero::Field& compressed = decoder.at<kCompressedPackets>();
+    if (compressed.valid())
+      return DecompressPackets(decompressor, compressed.as_bytes(), callback);
+    return callback(std::move(packet));
+  }
+
+  // Decompresses the |compressed_packets| field of a TracePacket and invokes
+  // |callback| with each of the (recursively expanded) TracePackets inside.
+  // All the views passed to |callback| point into a newly allocated blob and
+  // no other state than |decompressor| is touched: this function can be
+  // called on any thread as long as each thread uses its own decompressor.
+  template <typename Callback = util::Status(TraceBlobView)>
+  static util::Status DecompressPackets(util::GzipDecompressor* decompressor,
+                                        protozero::ConstBytes compressed,
+                                        Callback callback) {
+    if (!util::IsGzipSupported()) {
+      return util::Status("Cannot decode compressed packets. Zlib not enabled");
+    }
+
+    TraceBlobView packets;
+    RETURN_IF_ERROR(Decompress(decompressor, compressed, &packets));
+
+    const uint8_t* start = packets.data();
+    const uint8_t* end = packets.data() + packets.length();
+    const uint8_t* ptr = start;
+    while ((end - ptr) > 2) {
+      const uint8_t* packet_outer = ptr;
+      if (PERFETTO_UNLIKELY(*ptr != kTracePacketTag))
+        return util::ErrStatus("Expected TracePacket tag");
+      uint64_t packet_size = 0;
+      ptr = protozero::proto_utils::ParseVarInt(++ptr, end, &packet_size);
+      const uint8_t* packet_start = ptr;
+      ptr += packet_size;
+      if (PERFETTO_UNLIKELY((ptr - packet_outer) < 2 || ptr > end))
+        return util::ErrStatus("Invalid packet size");
+
+      TraceBlobView sliced =
+          packets.slice(packet_start, static_cast<size_t>(packet_size));
+      RETURN_IF_ERROR(ExpandPacket(decompressor, std::move(sliced), callback));
+    }
+    return util::OkStatus();
+  }
+
+ private:
+  static constexpr uint8_t kTracePacketTag =
+      protozero::proto_utils::MakeTagLengthDelimited(
+          protos::pbzero::Trace::kPacketFieldNumber);
+
+  template <bool kExpandPackets, typename Callback>
+  util::Status TokenizeInternal(TraceBlobView blob, Callback callback) {
     const uint8_t* data = blob.data();
     size_t size = blob.size();
     if (!partial_buf_.empty()) {
@@ -98,22 +179,17 @@ class ProtoTraceTokenizer {
         data += size_missing;
         size -= size_missing;
         partial_buf_.clear();
-        RETURN_IF_ERROR(
-            ParseInternal(TraceBlobView(std::move(glued)), callback));
+        RETURN_IF_ERROR(ParseInternal<kExpandPackets>(
+            TraceBlobView(std::move(glued)), callback));
       } else {
         partial_buf_.insert(partial_buf_.end(), data, &data[size]);
         return util::OkStatus();
       }
     }
-    return ParseInternal(blob.slice(data, size), callback);
+    return ParseInternal<kExpandPackets>(blob.slice(data, size), callback);
   }
 
- private:
-  static constexpr uint8_t kTracePacketTag =
-      protozero::proto_utils::MakeTagLengthDelimited(
-          protos::pbzero::Trace::kPacketFieldNumber);
-
-  template <typename Callback = util::Status(TraceBlobView)>
+  template <bool kExpandPackets, typename Callback>
   util::Status ParseInternal(TraceBlobView whole_buf, Callback callback) {
     static constexpr auto kLengthDelimited =
         protozero::proto_utils::ProtoWireType::kLengthDelimited;
@@ -125,7 +201,12 @@ class ProtoTraceTokenizer {
       }
       protozero::ConstBytes packet = *it;
       TraceBlobView sliced = whole_buf.slice(packet.data, packet.size);
-      RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback));
+      if (kExpandPackets) {
+        RETURN_IF_ERROR(
+            ExpandPacket(&decompressor_, std::move(sliced), callback));
+      } else {
+        RETURN_IF_ERROR(callback(std::move(sliced)));
+      }
     }
 
     const size_t bytes_left = decoder.bytes_left();
@@ -137,46 +218,9 @@ class ProtoTraceTokenizer {
     return util::OkStatus();
   }
 
-  template <typename Callback = util::Status(TraceBlobView)>
-  util::Status ParsePacket(TraceBlobView packet, Callback callback) {
-    protos::pbzero::TracePacket::Decoder decoder(packet.data(),
-                                                 packet.length());
-    if (decoder.has_compressed_packets()) {
-      if (!util::IsGzipSupported()) {
-        return util::Status(
-            "Cannot decode compressed packets. Zlib not enabled");
-      }
-
-      protozero::ConstBytes field = decoder.compressed_packets();
-      TraceBlobView compressed_packets = packet.slice(field.data, field.size);
-      TraceBlobView packets;
-
-      RETURN_IF_ERROR(Decompress(std::move(compressed_packets), &packets));
-
-      const uint8_t* start = packets.data();
-      const uint8_t* end = packets.data() + packets.length();
-      const uint8_t* ptr = start;
-      while ((end - ptr) > 2) {
-        const uint8_t* packet_outer = ptr;
-        if (PERFETTO_UNLIKELY(*ptr != kTracePacketTag))
-          return util::ErrStatus("Expected TracePacket tag");
-        uint64_t packet_size = 0;
-        ptr = protozero::proto_utils::ParseVarInt(++ptr, end, &packet_size);
-        const uint8_t* packet_start = ptr;
-        ptr += packet_size;
-        if (PERFETTO_UNLIKELY((ptr - packet_outer) < 2 || ptr > end))
-          return util::ErrStatus("Invalid packet size");
-
-        TraceBlobView sliced =
-            packets.slice(packet_start, static_cast<size_t>(packet_size));
-        RETURN_IF_ERROR(ParsePacket(std::move(sliced), callback));
-      }
-      return util::OkStatus();
-    }
-    return callback(std::move(packet));
-  }
-
-  util::Status Decompress(TraceBlobView input, TraceBlobView* output);
+  static util::Status Decompress(util::GzipDecompressor* decompressor,
+                                 protozero::ConstBytes input,
+                                 TraceBlobView* output);
 
   // Used to glue together trace packets that span across two (or more)
   // Parse() boundaries.
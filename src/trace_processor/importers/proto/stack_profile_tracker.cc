@@ -43,7 +43,7 @@ StringId SequenceStackProfileTracker::GetEmptyStringId() {
 
 void SequenceStackProfileTracker::AddString(SourceStringId id,
                                             base::StringView str) {
-  string_map_.emplace(id, str.ToStdString());
+  string_map_.Insert(id, str.ToStdString());
 }
 
 std::optional<MappingId> SequenceStackProfileTracker::AddMapping(
@@ -56,7 +56,8 @@ std::optional<MappingId> SequenceStackProfileTracker::AddMapping(
                                       InternedStringType::kMappingPath);
     if (!opt_str)
       break;
-    path += "/" + *opt_str;
+    path.push_back('/');
+    path.append(opt_str->data(), opt_str->size());
   }
   // When path strings just have single full path(like Chrome does), the mapping
   // path gets an extra '/' prepended, strip the extra '/'.
@@ -132,7 +133,7 @@ std::optional<MappingId> SequenceStackProfileTracker::AddMapping(
     }
     mapping_idx_.emplace(row, *cur_id);
   }
-  mapping_ids_.emplace(id, *cur_id);
+  mapping_ids_.Insert(id, *cur_id);
   return cur_id;
 }
 
@@ -140,16 +141,16 @@ std::optional<FrameId> SequenceStackProfileTracker::AddFrame(
     SourceFrameId id,
     const SourceFrame& frame,
     const InternLookup* intern_lookup) {
-  std::optional<std::string> opt_name = FindOrInsertString(
+  std::optional<base::StringView> opt_name = FindOrInsertString(
       frame.name_id, intern_lookup, InternedStringType::kFunctionName);
   if (!opt_name) {
     context_->storage->IncrementStats(stats::stackprofile_invalid_string_id);
     PERFETTO_DLOG("Invalid string.");
     return std::nullopt;
   }
-  const std::string& name = *opt_name;
-  const StringId str_id =
-      context_->storage->InternString(base::StringView(name));
+  // Java frames always contain a '.'
+  const bool is_java_frame = opt_name->find('.') != base::StringView::npos;
+  const StringId str_id = context_->storage->InternString(*opt_name);
 
   auto opt_mapping = FindOrInsertMapping(frame.mapping_id, intern_lookup);
   if (!opt_mapping) {
@@ -157,58 +158,36 @@ std::optional<FrameId> SequenceStackProfileTracker::AddFrame(
     return std::nullopt;
   }
   MappingId mapping_id = *opt_mapping;
-  const auto& mappings = context_->storage->stack_profile_mapping_table();
-  StringId mapping_name_id =
-      mappings.name()[*mappings.id().IndexOf(mapping_id)];
-  auto mapping_name = context_->storage->GetString(mapping_name_id);
 
-  tables::StackProfileFrameTable::Row row{str_id, mapping_id,
-                                          static_cast<int64_t>(frame.rel_pc)};
-
-  auto* frames = context_->storage->mutable_stack_profile_frame_table();
-
-  std::optional<FrameId> cur_id;
-  auto it = frame_idx_.find(row);
-  if (it != frame_idx_.end()) {
-    cur_id = it->second;
-  } else {
-    std::vector<FrameId> db_frames =
-        context_->global_stack_profile_tracker->FindFrameIds(mapping_id,
-                                                             frame.rel_pc);
-    for (const FrameId preexisting_frame : db_frames) {
-      uint32_t preexisting_row_id = *frames->id().IndexOf(preexisting_frame);
-      tables::StackProfileFrameTable::Row preexisting_row{
-          frames->name()[preexisting_row_id],
-          frames->mapping()[preexisting_row_id],
-          frames->rel_pc()[preexisting_row_id]};
-
-      if (row == preexisting_row) {
-        cur_id = preexisting_frame;
+  GlobalStackProfileTracker* global_tracker =
+      context_->global_stack_profile_tracker.get();
+  std::optional<FrameId> cur_id =
+      global_tracker->FindFrameId(str_id, mapping_id, frame.rel_pc);
+  if (!cur_id) {
+    tables::StackProfileFrameTable::Row row{str_id, mapping_id,
+                                            static_cast<int64_t>(frame.rel_pc)};
+    cur_id = context_->storage->mutable_stack_profile_frame_table()
+                 ->Insert(row)
+                 .id;
+    global_tracker->InsertFrameRow(str_id, mapping_id, frame.rel_pc, *cur_id);
+    if (is_java_frame) {
+      const auto& mappings = context_->storage->stack_profile_mapping_table();
+      StringId mapping_name_id =
+          mappings.name()[*mappings.id().IndexOf(mapping_id)];
+      auto mapping_name = context_->storage->GetString(mapping_name_id);
+      std::optional<std::string> package =
+          PackageFromLocation(context_->storage.get(), mapping_name);
+      if (package) {
+        NameInPackage nip{str_id, context_->storage->InternString(
+                                      base::StringView(*package))};
+        global_tracker->InsertJavaFrameForName(nip, *cur_id);
+      } else if (mapping_name.find("/memfd:") == 0) {
+        NameInPackage nip{str_id, context_->storage->InternString("memfd")};
+        global_tracker->InsertJavaFrameForName(nip, *cur_id);
       }
     }
-    if (!cur_id) {
-      cur_id = frames->Insert(row).id;
-      context_->global_stack_profile_tracker->InsertFrameRow(
-          mapping_id, static_cast<uint64_t>(row.rel_pc), *cur_id);
-      if (base::Contains(name, '.')) {
-        // Java frames always contain a '.'
-        std::optional<std::string> package =
-            PackageFromLocation(context_->storage.get(), mapping_name);
-        if (package) {
-          NameInPackage nip{str_id, context_->storage->InternString(
-                                        base::StringView(*package))};
-          context_->global_stack_profile_tracker->InsertJavaFrameForName(
-              nip, *cur_id);
-        } else if (mapping_name.find("/memfd:") == 0) {
-          NameInPackage nip{str_id, context_->storage->InternString("memfd")};
-          context_->global_stack_profile_tracker->InsertJavaFrameForName(
-              nip, *cur_id);
-        }
-      }
-    }
-    frame_idx_.emplace(row, *cur_id);
   }
-  frame_ids_.emplace(id, *cur_id);
+  frame_ids_.Insert(id, *cur_id);
   return cur_id;
 }
 
@@ -228,32 +207,33 @@ std::optional<CallsiteId> SequenceStackProfileTracker::AddCallstack(
     }
     FrameId frame_id = *opt_frame_id;
 
-    tables::StackProfileCallsiteTable::Row row{depth, parent_id, frame_id};
-    CallsiteId self_id;
-    auto callsite_it = callsite_idx_.find(row);
-    if (callsite_it != callsite_idx_.end()) {
-      self_id = callsite_it->second;
-    } else {
-      auto* callsite =
-          context_->storage->mutable_stack_profile_callsite_table();
-      self_id = callsite->Insert(row).id;
-      callsite_idx_.emplace(row, self_id);
+    uint64_t key =
+        (static_cast<uint64_t>(parent_id ? parent_id->value : kNoParentCallsite)
+         << 32) |
+        frame_id.value;
+    auto it_and_inserted = callsite_idx_.Insert(key, CallsiteId{0});
+    if (it_and_inserted.second) {
+      tables::StackProfileCallsiteTable::Row row{depth, parent_id, frame_id};
+      *it_and_inserted.first =
+          context_->storage->mutable_stack_profile_callsite_table()
+              ->Insert(row)
+              .id;
     }
-    parent_id = self_id;
+    parent_id = *it_and_inserted.first;
   }
   PERFETTO_DCHECK(parent_id);  // The loop ran at least once.
-  callstack_ids_.emplace(id, *parent_id);
+  callstack_ids_.Insert(id, *parent_id);
   return parent_id;
 }
 
 FrameId SequenceStackProfileTracker::GetDatabaseFrameIdForTesting(
     SourceFrameId frame_id) {
-  auto it = frame_ids_.find(frame_id);
-  if (it == frame_ids_.end()) {
+  FrameId* id = frame_ids_.Find(frame_id);
+  if (!id) {
     PERFETTO_DLOG("Invalid frame.");
     return {};
   }
-  return it->second;
+  return *id;
 }
 
 std::optional<StringId> SequenceStackProfileTracker::FindAndInternString(
@@ -267,18 +247,19 @@ std::optional<StringId> SequenceStackProfileTracker::FindAndInternString(
   if (!opt_str)
     return GetEmptyStringId();
 
-  return context_->storage->InternString(base::StringView(*opt_str));
+  return context_->storage->InternString(*opt_str);
 }
 
-std::optional<std::string> SequenceStackProfileTracker::FindOrInsertString(
+std::optional<base::StringView>
+SequenceStackProfileTracker::FindOrInsertString(
     SourceStringId id,
     const InternLookup* intern_lookup,
     SequenceStackProfileTracker::InternedStringType type) {
   if (id == 0)
-    return "";
+    return base::StringView();
 
-  auto it = string_map_.find(id);
-  if (it == string_map_.end()) {
+  std::string* str_ptr = string_map_.Find(id);
+  if (!str_ptr) {
     if (intern_lookup) {
       auto str = intern_lookup->GetString(id, type);
       if (!str) {
@@ -287,20 +268,20 @@ std::optional<std::string> SequenceStackProfileTracker::FindOrInsertString(
         PERFETTO_DLOG("Invalid string.");
         return std::nullopt;
       }
-      return str->ToStdString();
+      return *str;
     }
     return std::nullopt;
   }
 
-  return it->second;
+  return base::StringView(*str_ptr);
 }
 
 std::optional<MappingId> SequenceStackProfileTracker::FindOrInsertMapping(
     SourceMappingId mapping_id,
     const InternLookup* intern_lookup) {
   std::optional<MappingId> res;
-  auto it = mapping_ids_.find(mapping_id);
-  if (it == mapping_ids_.end()) {
+  MappingId* id = mapping_ids_.Find(mapping_id);
+  if (!id) {
     if (intern_lookup) {
       auto interned_mapping = intern_lookup->GetMapping(mapping_id);
       if (interned_mapping) {
@@ -311,7 +292,7 @@ std::optional<MappingId> SequenceStackProfileTracker::FindOrInsertMapping(
     context_->storage->IncrementStats(stats::stackprofile_invalid_mapping_id);
     return res;
   }
-  res = it->second;
+  res = *id;
   return res;
 }
 
@@ -319,8 +300,8 @@ std::optional<FrameId> SequenceStackProfileTracker::FindOrInsertFrame(
     SourceFrameId frame_id,
     const InternLookup* intern_lookup) {
   std::optional<FrameId> res;
-  auto it = frame_ids_.find(frame_id);
-  if (it == frame_ids_.end()) {
+  FrameId* id = frame_ids_.Find(frame_id);
+  if (!id) {
     if (intern_lookup) {
       auto interned_frame = intern_lookup->GetFrame(frame_id);
       if (interned_frame) {
@@ -333,7 +314,7 @@ std::optional<FrameId> SequenceStackProfileTracker::FindOrInsertFrame(
                   frame_ids_.size());
     return res;
   }
-  res = it->second;
+  res = *id;
   return res;
 }
 
@@ -341,8 +322,8 @@ std::optional<CallsiteId> SequenceStackProfileTracker::FindOrInsertCallstack(
     SourceCallstackId callstack_id,
     const InternLookup* intern_lookup) {
   std::optional<CallsiteId> res;
-  auto it = callstack_ids_.find(callstack_id);
-  if (it == callstack_ids_.end()) {
+  CallsiteId* id = callstack_ids_.Find(callstack_id);
+  if (!id) {
     auto interned_callstack = intern_lookup->GetCallstack(callstack_id);
     if (interned_callstack) {
       res = AddCallstack(callstack_id, *interned_callstack, intern_lookup);
@@ -353,15 +334,15 @@ std::optional<CallsiteId> SequenceStackProfileTracker::FindOrInsertCallstack(
                   callstack_ids_.size());
     return res;
   }
-  res = it->second;
+  res = *id;
   return res;
 }
 
 void SequenceStackProfileTracker::ClearIndices() {
-  string_map_.clear();
-  mapping_ids_.clear();
-  callstack_ids_.clear();
-  frame_ids_.clear();
+  string_map_.Clear();
+  mapping_ids_.Clear();
+  callstack_ids_.Clear();
+  frame_ids_.Clear();
 }
 
 }  // namespace trace_processor
@@ -18,9 +18,12 @@
 #define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_STACK_PROFILE_TRACKER_H_
 
 #include <deque>
+#include <limits>
 #include <optional>
 #include <unordered_map>
 
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/hash.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/tables/profiler_tables_py.h"
 
@@ -114,18 +117,33 @@ class GlobalStackProfileTracker {
     stack_profile_mapping_index_[pair].emplace_back(row);
   }
 
+  // Returns the frames at |rel_pc| in |mapping_row|, whatever their name.
   std::vector<FrameId> FindFrameIds(MappingId mapping_row,
                                     uint64_t rel_pc) const {
-    auto it =
-        stack_profile_frame_index_.find(std::make_pair(mapping_row, rel_pc));
-    if (it == stack_profile_frame_index_.end())
-      return {};
-    return it->second;
+    std::vector<FrameId> ids;
+    if (const FrameId* id = frames_by_pc_.Find({mapping_row, rel_pc}))
+      ids.push_back(*id);
+    if (const auto* more_ids = more_frames_by_pc_.Find({mapping_row, rel_pc}))
+      ids.insert(ids.end(), more_ids->begin(), more_ids->end());
+    return ids;
+  }
+
+  // Returns the frame |name| at |rel_pc| in |mapping_row|, if any.
+  std::optional<FrameId> FindFrameId(StringId name,
+                                     MappingId mapping_row,
+                                     uint64_t rel_pc) const {
+    const FrameId* id = frames_.Find({{mapping_row, rel_pc}, name});
+    return id ? std::make_optional(*id) : std::nullopt;
   }
 
-  void InsertFrameRow(MappingId mapping_row, uint64_t rel_pc, FrameId row) {
-    auto pair = std::make_pair(mapping_row, rel_pc);
-    stack_profile_frame_index_[pair].emplace_back(row);
+  void InsertFrameRow(StringId name,
+                      MappingId mapping_row,
+                      uint64_t rel_pc,
+                      FrameId row) {
+    frames_.Insert({{mapping_row, rel_pc}, name}, row);
+    // Most pcs only have a single frame, which is stored inline.
+    if (!frames_by_pc_.Insert({mapping_row, rel_pc}, row).second)
+      more_frames_by_pc_[{mapping_row, rel_pc}].push_back(row);
   }
 
   const std::vector<tables::StackProfileFrameTable::Id>* JavaFramesForName(
@@ -145,8 +163,40 @@ class GlobalStackProfileTracker {
   using MappingKey = std::pair<StringId /* name */, StringId /* build id */>;
   std::map<MappingKey, std::vector<MappingId>> stack_profile_mapping_index_;
 
-  using FrameKey = std::pair<MappingId, uint64_t /* rel_pc */>;
-  std::map<FrameKey, std::vector<FrameId>> stack_profile_frame_index_;
+  struct PcKey {
+    MappingId mapping;
+    uint64_t rel_pc;
+
+    bool operator==(const PcKey& o) const {
+      return mapping == o.mapping && rel_pc == o.rel_pc;
+    }
+    struct Hasher {
+      size_t operator()(const PcKey& k) const {
+        return static_cast<size_t>(
+            base::Hasher::Combine(k.mapping.value, k.rel_pc));
+      }
+    };
+  };
+  struct FrameKey {
+    PcKey pc;
+    StringId name;
+
+    bool operator==(const FrameKey& o) const {
+      return pc == o.pc && name == o.name;
+    }
+    struct Hasher {
+      size_t operator()(const FrameKey& k) const {
+        return static_cast<size_t>(base::Hasher::Combine(
+            k.pc.mapping.value, k.pc.rel_pc, k.name.raw_id()));
+      }
+    };
+  };
+  // Frames are interned across all the sequences: the same function at the
+  // same pc of the same mapping (i.e. build id) is a single frame.
+  base::FlatHashMap<FrameKey, FrameId, FrameKey::Hasher> frames_;
+  base::FlatHashMap<PcKey, FrameId, PcKey::Hasher> frames_by_pc_;
+  base::FlatHashMap<PcKey, std::vector<FrameId>, PcKey::Hasher>
+      more_frames_by_pc_;
 
   std::map<NameInPackage, std::vector<tables::StackProfileFrameTable::Id>>
       java_frames_for_name_;
@@ -241,7 +291,8 @@ class SequenceStackProfileTracker {
   std::optional<StringId> FindAndInternString(SourceStringId,
                                               const InternLookup* intern_lookup,
                                               InternedStringType type);
-  std::optional<std::string> FindOrInsertString(
+  // The returned view is only valid until the next AddString() call.
+  std::optional<base::StringView> FindOrInsertString(
       SourceStringId,
       const InternLookup* intern_lookup,
       InternedStringType type);
@@ -261,13 +312,13 @@ class SequenceStackProfileTracker {
  private:
   StringId GetEmptyStringId();
 
-  std::unordered_map<SourceStringId, std::string> string_map_;
+  base::FlatHashMap<SourceStringId, std::string> string_map_;
 
   // Mapping from ID of mapping / frame / callstack in original trace and the
   // index in the respective table it was inserted into.
-  std::unordered_map<SourceMappingId, MappingId> mapping_ids_;
-  std::unordered_map<SourceFrameId, FrameId> frame_ids_;
-  std::unordered_map<SourceCallstackId, CallsiteId> callstack_ids_;
+  base::FlatHashMap<SourceMappingId, MappingId> mapping_ids_;
+  base::FlatHashMap<SourceFrameId, FrameId> frame_ids_;
+  base::FlatHashMap<SourceCallstackId, CallsiteId> callstack_ids_;
 
   // TODO(oysteine): Share these indices between the StackProfileTrackers,
   // since they're not sequence-specific.
@@ -275,9 +326,12 @@ class SequenceStackProfileTracker {
   // Mapping from content of database row to the index of the raw.
   std::unordered_map<tables::StackProfileMappingTable::Row, MappingId>
       mapping_idx_;
-  std::unordered_map<tables::StackProfileFrameTable::Row, FrameId> frame_idx_;
-  std::unordered_map<tables::StackProfileCallsiteTable::Row, CallsiteId>
-      callsite_idx_;
+  // Callsites keyed by their parent callsite (or kNoParentCallsite) in the
+  // upper 32 bits and their frame in the lower ones. Their depth follows from
+  // the parent.
+  static constexpr uint32_t kNoParentCallsite =
+      std::numeric_limits<uint32_t>::max();
+  base::FlatHashMap<uint64_t, CallsiteId> callsite_idx_;
 
   TraceProcessorContext* const context_;
   StringId empty_;
@@ -430,6 +430,59 @@ class TrackEventParser::EventImporter {
     return kNullStringId;
   }
 
+  // Returns the track for |track_uuid_| and the thread/process it belongs to.
+  // Looking these up requires several map lookups and searches of the
+  // thread/process track tables, so the result is cached in the sequence
+  // state. The cache is bypassed while the track could still be named after
+  // |name_id_|.
+  PacketSequenceStateGeneration::TrackEventTrack GetOrResolveDescriptorTrack() {
+    using TrackEventTrack = PacketSequenceStateGeneration::TrackEventTrack;
+    const TrackEventTrack* cached =
+        sequence_state_->GetTrackEventTrack(track_uuid_);
+    if (cached && (cached->name_final || name_id_.is_null()))
+      return *cached;
+
+    std::optional<TrackId> opt_track_id =
+        track_event_tracker_->GetDescriptorTrack(track_uuid_, name_id_,
+                                                 packet_sequence_id_);
+    if (!opt_track_id) {
+      track_event_tracker_->ReserveDescriptorChildTrack(track_uuid_,
+                                                        /*parent_uuid=*/0,
+                                                        name_id_);
+      opt_track_id = track_event_tracker_->GetDescriptorTrack(
+          track_uuid_, name_id_, packet_sequence_id_);
+    }
+
+    TrackEventTrack track{};
+    track.track_id = *opt_track_id;
+    auto thread_track_row =
+        storage_->thread_track_table().id().IndexOf(track.track_id);
+    auto process_track_row =
+        thread_track_row
+            ? std::nullopt
+            : storage_->process_track_table().id().IndexOf(track.track_id);
+    if (thread_track_row) {
+      track.kind = TrackEventTrack::Kind::kThread;
+      track.utid = storage_->thread_track_table().utid()[*thread_track_row];
+    } else if (process_track_row) {
+      track.kind = TrackEventTrack::Kind::kProcess;
+      track.upid = storage_->process_track_table().upid()[*process_track_row];
+    } else {
+      track.kind = TrackEventTrack::Kind::kOther;
+      auto* tracks = context_->storage->mutable_track_table();
+      auto track_index = tracks->id().IndexOf(track.track_id);
+      if (track_index) {
+        const StringPool::Id& id = tracks->name()[*track_index];
+        if (id.is_null())
+          tracks->mutable_name()->Set(*track_index, name_id_);
+      }
+    }
+    track.name_final = track_event_tracker_->IsDescriptorTrackNameFinal(
+        track_uuid_, track.track_id);
+    sequence_state_->SetTrackEventTrack(track_uuid_, track);
+    return track;
+  }
+
   util::Status ParseTrackAssociation() {
     TrackTracker* track_tracker = context_->track_tracker.get();
     ProcessTracker* procs = context_->process_tracker.get();
@@ -450,28 +503,17 @@ class TrackEventParser::EventImporter {
     //      TrackEvent types), or
     //   b) a default track.
     if (track_uuid_) {
-      std::optional<TrackId> opt_track_id =
-          track_event_tracker_->GetDescriptorTrack(track_uuid_, name_id_,
-                                                   packet_sequence_id_);
-      if (!opt_track_id) {
-        track_event_tracker_->ReserveDescriptorChildTrack(track_uuid_,
-                                                          /*parent_uuid=*/0,
-                                                          name_id_);
-        opt_track_id = track_event_tracker_->GetDescriptorTrack(
-            track_uuid_, name_id_, packet_sequence_id_);
-      }
-      track_id_ = *opt_track_id;
-
-      auto thread_track_row =
-          storage_->thread_track_table().id().IndexOf(track_id_);
-      if (thread_track_row) {
-        utid_ = storage_->thread_track_table().utid()[*thread_track_row];
-        upid_ = storage_->thread_table().upid()[*utid_];
-      } else {
-        auto process_track_row =
-            storage_->process_track_table().id().IndexOf(track_id_);
-        if (process_track_row) {
-          upid_ = storage_->process_track_table().upid()[*process_track_row];
+      using Kind = PacketSequenceStateGeneration::TrackEventTrack::Kind;
+      PacketSequenceStateGeneration::TrackEventTrack track =
+          GetOrResolveDescriptorTrack();
+      track_id_ = track.track_id;
+      switch (track.kind) {
+        case Kind::kThread:
+          utid_ = track.utid;
+          upid_ = storage_->thread_table().upid()[*utid_];
+          break;
+        case Kind::kProcess:
+          upid_ = track.upid;
           if (sequence_state_->state()->pid_and_tid_valid()) {
             uint32_t pid =
                 static_cast<uint32_t>(sequence_state_->state()->pid());
@@ -481,15 +523,8 @@ class TrackEventParser::EventImporter {
             if (storage_->thread_table().upid()[utid_candidate] == upid_)
               legacy_passthrough_utid_ = utid_candidate;
           }
-        } else {
-          auto* tracks = context_->storage->mutable_track_table();
-          auto track_index = tracks->id().IndexOf(track_id_);
-          if (track_index) {
-            const StringPool::Id& id = tracks->name()[*track_index];
-            if (id.is_null())
-              tracks->mutable_name()->Set(*track_index, name_id_);
-          }
-
+          break;
+        case Kind::kOther:
           if (sequence_state_->state()->pid_and_tid_valid()) {
             uint32_t pid =
                 static_cast<uint32_t>(sequence_state_->state()->pid());
@@ -497,7 +532,7 @@ class TrackEventParser::EventImporter {
                 static_cast<uint32_t>(sequence_state_->state()->tid());
             legacy_passthrough_utid_ = procs->UpdateThread(tid, pid);
           }
-        }
+          break;
       }
     } else {
       bool pid_tid_state_valid = sequence_state_->state()->pid_and_tid_valid();
@@ -186,21 +186,24 @@ std::optional<TrackId> TrackEventTracker::GetDescriptorTrack(
 
   // Update the name of the track if unset and the track is not the primary
   // track of a process/thread or a counter track.
-  auto* tracks = context_->storage->mutable_track_table();
-  uint32_t row = *tracks->id().IndexOf(*track_id);
-  if (!tracks->name()[row].is_null())
+  if (IsDescriptorTrackNameFinal(uuid, *track_id))
     return track_id;
+  auto* tracks = context_->storage->mutable_track_table();
+  tracks->mutable_name()->Set(*tracks->id().IndexOf(*track_id), event_name);
+  return track_id;
+}
+
+bool TrackEventTracker::IsDescriptorTrackNameFinal(uint64_t uuid,
+                                                   TrackId track_id) {
+  const auto& tracks = context_->storage->track_table();
+  if (!tracks.name()[*tracks.id().IndexOf(track_id)].is_null())
+    return true;
 
   // Check reservation for track type.
   auto reservation_it = reserved_descriptor_tracks_.find(uuid);
   PERFETTO_CHECK(reservation_it != reserved_descriptor_tracks_.end());
-
-  if (reservation_it->second.pid || reservation_it->second.tid ||
-      reservation_it->second.is_counter) {
-    return track_id;
-  }
-  tracks->mutable_name()->Set(row, event_name);
-  return track_id;
+  const DescriptorTrackReservation& reservation = reservation_it->second;
+  return reservation.pid || reservation.tid || reservation.is_counter;
 }
 
 std::optional<TrackId> TrackEventTracker::GetDescriptorTrackImpl(
@@ -111,6 +111,13 @@ class TrackEventTracker {
       StringId event_name = kNullStringId,
       std::optional<uint32_t> packet_sequence_id = std::nullopt);
 
+  // Returns true if GetDescriptorTrack() will never update the name of the
+  // already resolved |track_id| for the given |uuid|: either the track already
+  // has a name or it's the primary track of a process/thread or a counter
+  // track. Callers can then cache |track_id| instead of calling
+  // GetDescriptorTrack() again.
+  bool IsDescriptorTrackNameFinal(uint64_t uuid, TrackId track_id);
+
   // Converts the given counter value to an absolute value in the unit of the
   // counter, applying incremental delta encoding or unit multipliers as
   // necessary. If the counter uses incremental encoding, |packet_sequence_id|
@@ -16,8 +16,6 @@
 
 #include "src/trace_processor/importers/systrace/systrace_line_parser.h"
 
-#include "perfetto/ext/base/flat_hash_map.h"
-#include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
 #include "src/trace_processor/importers/common/event_tracker.h"
@@ -37,6 +35,53 @@
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+using Args = std::vector<std::pair<base::StringView, base::StringView>>;
+
+// Splits |args_str| on spaces into key=value pairs, pointing into |args_str|.
+// Tokens without a '=' are given the key "name".
+void SplitArgs(base::StringView args_str, Args* out) {
+  out->clear();
+  size_t token_start = 0;
+  while (token_start < args_str.size()) {
+    size_t token_end = args_str.find(' ', token_start);
+    if (token_end == base::StringView::npos)
+      token_end = args_str.size();
+    base::StringView token =
+        args_str.substr(token_start, token_end - token_start);
+    token_start = token_end + 1;
+    if (token.empty())
+      continue;
+    if (token.find('=') == base::StringView::npos) {
+      out->emplace_back("name", token);
+      continue;
+    }
+    // The key is the first non-empty '=' separated part and the value the
+    // last one, e.g. "a=b=c" is parsed as a=c.
+    base::StringView key;
+    base::StringView value = "";
+    size_t pos = 0;
+    while (pos < token.size()) {
+      size_t end = token.find('=', pos);
+      if (end == base::StringView::npos)
+        end = token.size();
+      if (end > pos) {
+        base::StringView part = token.substr(pos, end - pos);
+        if (key.empty()) {
+          key = part;
+        } else {
+          value = part;
+        }
+      }
+      pos = end + 1;
+    }
+    out->emplace_back(key, value);
+  }
+}
+
+}  // namespace
+
 SystraceLineParser::SystraceLineParser(TraceProcessorContext* ctx)
     : context_(ctx),
       rss_stat_tracker_(context_),
@@ -70,37 +115,32 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
     }
   }
 
-  base::FlatHashMap<std::string, std::string> args;
-  for (base::StringSplitter ss(line.args_str, ' '); ss.Next();) {
-    std::string key;
-    std::string value;
-    if (!base::Contains(ss.cur_token(), "=")) {
-      key = "name";
-      value = ss.cur_token();
-      args.Insert(std::move(key), std::move(value));
-      continue;
-    }
-    for (base::StringSplitter inner(ss.cur_token(), '='); inner.Next();) {
-      if (key.empty()) {
-        key = inner.cur_token();
-      } else {
-        value = inner.cur_token();
-      }
-    }
-    args.Insert(std::move(key), std::move(value));
+  if (line.event_name == "tracing_mark_write" || line.event_name == "0" ||
+      line.event_name == "print") {
+    // By far the most common event in atrace traces. Its args are not
+    // key=value pairs, so don't bother splitting them.
+    SystraceParser::GetOrCreate(context_)->ParsePrintEvent(
+        line.ts, line.pid, line.args_str.c_str());
+    return util::OkStatus();
   }
+
+  // The args are views into |line.args_str|, looked up by linear search:
+  // events have a handful of args, so this is cheaper than building a map of
+  // strings for every line.
+  SplitArgs(base::StringView(line.args_str), &args_);
+
   if (line.event_name == "sched_switch") {
-    auto prev_state_str = args["prev_state"];
+    auto prev_state_str = GetArg("prev_state");
     int64_t prev_state =
         ftrace_utils::TaskState::FromSystrace(prev_state_str.c_str())
             .ToRawStateOnlyForSystraceConversions();
 
-    auto prev_pid = base::StringToUInt32(args["prev_pid"]);
-    auto prev_comm = base::StringView(args["prev_comm"]);
-    auto prev_prio = base::StringToInt32(args["prev_prio"]);
-    auto next_pid = base::StringToUInt32(args["next_pid"]);
-    auto next_comm = base::StringView(args["next_comm"]);
-    auto next_prio = base::StringToInt32(args["next_prio"]);
+    auto prev_pid = base::StringToUInt32(GetArg("prev_pid"));
+    auto prev_comm = FindArg("prev_comm");
+    auto prev_prio = base::StringToInt32(GetArg("prev_prio"));
+    auto next_pid = base::StringToUInt32(GetArg("next_pid"));
+    auto next_comm = FindArg("next_comm");
+    auto next_prio = base::StringToInt32(GetArg("next_prio"));
 
     if (!(prev_pid.has_value() && prev_prio.has_value() &&
           next_pid.has_value() && next_prio.has_value())) {
@@ -110,18 +150,14 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
     SchedEventTracker::GetOrCreate(context_)->PushSchedSwitch(
         line.cpu, line.ts, prev_pid.value(), prev_comm, prev_prio.value(),
         prev_state, next_pid.value(), next_comm, next_prio.value());
-  } else if (line.event_name == "tracing_mark_write" ||
-             line.event_name == "0" || line.event_name == "print") {
-    SystraceParser::GetOrCreate(context_)->ParsePrintEvent(
-        line.ts, line.pid, line.args_str.c_str());
   } else if (line.event_name == "sched_waking") {
-    auto comm = args["comm"];
-    std::optional<uint32_t> wakee_pid = base::StringToUInt32(args["pid"]);
+    auto comm = FindArg("comm");
+    std::optional<uint32_t> wakee_pid = base::StringToUInt32(GetArg("pid"));
     if (!wakee_pid.has_value()) {
       return util::Status("Could not convert wakee_pid");
     }
 
-    StringId name_id = context_->storage->InternString(base::StringView(comm));
+    StringId name_id = context_->storage->InternString(comm);
     auto wakee_utid = context_->process_tracker->UpdateThreadName(
         wakee_pid.value(), name_id, ThreadNamePriority::kFtrace);
 
@@ -129,8 +165,8 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
         line.ts, wakee_utid, utid);
 
   } else if (line.event_name == "cpu_frequency") {
-    std::optional<uint32_t> event_cpu = base::StringToUInt32(args["cpu_id"]);
-    std::optional<double> new_state = base::StringToDouble(args["state"]);
+    std::optional<uint32_t> event_cpu = base::StringToUInt32(GetArg("cpu_id"));
+    std::optional<double> new_state = base::StringToDouble(GetArg("state"));
     if (!event_cpu.has_value()) {
       return util::Status("Could not convert event cpu");
     }
@@ -142,8 +178,8 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
         cpufreq_name_id_, event_cpu.value());
     context_->event_tracker->PushCounter(line.ts, new_state.value(), track);
   } else if (line.event_name == "cpu_idle") {
-    std::optional<uint32_t> event_cpu = base::StringToUInt32(args["cpu_id"]);
-    std::optional<double> new_state = base::StringToDouble(args["state"]);
+    std::optional<uint32_t> event_cpu = base::StringToUInt32(GetArg("cpu_id"));
+    std::optional<double> new_state = base::StringToDouble(GetArg("state"));
     if (!event_cpu.has_value()) {
       return util::Status("Could not convert event cpu");
     }
@@ -155,15 +191,15 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
         cpuidle_name_id_, event_cpu.value());
     context_->event_tracker->PushCounter(line.ts, new_state.value(), track);
   } else if (line.event_name == "binder_transaction") {
-    auto id = base::StringToInt32(args["transaction"]);
-    auto dest_node = base::StringToInt32(args["dest_node"]);
-    auto dest_tgid = base::StringToUInt32(args["dest_proc"]);
-    auto dest_tid = base::StringToUInt32(args["dest_thread"]);
-    auto is_reply = base::StringToInt32(args["reply"]).value() == 1;
-    auto flags_str = args["flags"];
+    auto id = base::StringToInt32(GetArg("transaction"));
+    auto dest_node = base::StringToInt32(GetArg("dest_node"));
+    auto dest_tgid = base::StringToUInt32(GetArg("dest_proc"));
+    auto dest_tid = base::StringToUInt32(GetArg("dest_thread"));
+    auto is_reply = base::StringToInt32(GetArg("reply")).value() == 1;
+    auto flags_str = GetArg("flags");
     char* end;
     uint32_t flags = static_cast<uint32_t>(strtol(flags_str.c_str(), &end, 16));
-    std::string code_str = args["code"] + " Java Layer Dependent";
+    std::string code_str = GetArg("code") + " Java Layer Dependent";
     StringId code = context_->storage->InternString(base::StringView(code_str));
     if (!dest_tgid.has_value()) {
       return util::Status("Could not convert dest_tgid");
@@ -181,7 +217,7 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
         line.ts, line.pid, id.value(), dest_node.value(), dest_tgid.value(),
         dest_tid.value(), is_reply, flags, code);
   } else if (line.event_name == "binder_transaction_received") {
-    auto id = base::StringToInt32(args["transaction"]);
+    auto id = base::StringToInt32(GetArg("transaction"));
     if (!id.has_value()) {
       return util::Status("Could not convert transaction id");
     }
@@ -194,8 +230,8 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
   } else if (line.event_name == "binder_unlock") {
     BinderTracker::GetOrCreate(context_)->Unlock(line.ts, line.pid);
   } else if (line.event_name == "binder_transaction_alloc_buf") {
-    auto data_size = base::StringToUInt64(args["data_size"]);
-    auto offsets_size = base::StringToUInt64(args["offsets_size"]);
+    auto data_size = base::StringToUInt64(GetArg("data_size"));
+    auto offsets_size = base::StringToUInt64(GetArg("offsets_size"));
     if (!data_size.has_value()) {
       return util::Status("Could not convert data size");
     }
@@ -209,11 +245,11 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
              line.event_name == "clock_disable") {
     std::string subtitle =
         line.event_name == "clock_set_rate" ? " Frequency" : " State";
-    auto rate = base::StringToUInt32(args["state"]);
+    auto rate = base::StringToUInt32(GetArg("state"));
     if (!rate.has_value()) {
       return util::Status("Could not convert state");
     }
-    std::string clock_name_str = args["name"] + subtitle;
+    std::string clock_name_str = GetArg("name") + subtitle;
     StringId clock_name =
         context_->storage->InternString(base::StringView(clock_name_str));
     TrackId track = context_->track_tracker->InternGlobalCounterTrack(
@@ -229,34 +265,34 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
     TrackId track = context_->track_tracker->InternThreadTrack(utid);
     context_->slice_tracker->End(line.ts, track, workqueue_name_id_);
   } else if (line.event_name == "thermal_temperature") {
-    std::string thermal_zone = args["thermal_zone"] + " Temperature";
+    std::string thermal_zone = GetArg("thermal_zone") + " Temperature";
     StringId track_name =
         context_->storage->InternString(base::StringView(thermal_zone));
     TrackId track = context_->track_tracker->InternGlobalCounterTrack(
         TrackTracker::Group::kThermals, track_name);
-    auto temp = base::StringToInt32(args["temp"]);
+    auto temp = base::StringToInt32(GetArg("temp"));
     if (!temp.has_value()) {
       return util::Status("Could not convert temp");
     }
     context_->event_tracker->PushCounter(line.ts, temp.value(), track);
   } else if (line.event_name == "cdev_update") {
-    std::string type = args["type"] + " Cooling Device";
+    std::string type = GetArg("type") + " Cooling Device";
     StringId track_name =
         context_->storage->InternString(base::StringView(type));
     TrackId track = context_->track_tracker->InternGlobalCounterTrack(
         TrackTracker::Group::kThermals, track_name);
-    auto target = base::StringToDouble(args["target"]);
+    auto target = base::StringToDouble(GetArg("target"));
     if (!target.has_value()) {
       return util::Status("Could not convert target");
     }
     context_->event_tracker->PushCounter(line.ts, target.value(), track);
   } else if (line.event_name == "sched_blocked_reason") {
-    auto wakee_pid = base::StringToUInt32(args["pid"]);
+    auto wakee_pid = base::StringToUInt32(GetArg("pid"));
     if (!wakee_pid.has_value()) {
       return util::Status("sched_blocked_reason: could not parse wakee_pid");
     }
     auto wakee_utid = context_->process_tracker->GetOrCreateThread(*wakee_pid);
-    auto io_wait = base::StringToInt32(args["iowait"]);
+    auto io_wait = base::StringToInt32(GetArg("iowait"));
     if (!io_wait.has_value()) {
       return util::Status("sched_blocked_reason: could not parse io_wait");
     }
@@ -264,10 +300,10 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
         wakee_utid, static_cast<bool>(*io_wait), std::nullopt);
   } else if (line.event_name == "rss_stat") {
     // Format: rss_stat: size=8437760 member=1 curr=1 mm_id=2824390453
-    auto size = base::StringToInt64(args["size"]);
-    auto member = base::StringToUInt32(args["member"]);
-    auto mm_id = base::StringToInt64(args["mm_id"]);
-    auto opt_curr = base::StringToUInt32(args["curr"]);
+    auto size = base::StringToInt64(GetArg("size"));
+    auto member = base::StringToUInt32(GetArg("member"));
+    auto mm_id = base::StringToInt64(GetArg("mm_id"));
+    auto opt_curr = base::StringToUInt32(GetArg("curr"));
     if (!size.has_value()) {
       return util::Status("rss_stat: could not parse size");
     }
@@ -285,5 +321,18 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
   return util::OkStatus();
 }
 
+base::StringView SystraceLineParser::FindArg(base::StringView key) const {
+  for (const auto& key_and_value : args_) {
+    if (key_and_value.first == key)
+      return key_and_value.second;
+  }
+  // Not a null view: missing args are interned as empty strings.
+  return base::StringView("");
+}
+
+std::string SystraceLineParser::GetArg(base::StringView key) const {
+  return FindArg(key).ToStdString();
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
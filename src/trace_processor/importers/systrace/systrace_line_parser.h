@@ -17,6 +17,11 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_LINE_PARSER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_LINE_PARSER_H_
 
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "perfetto/ext/base/string_view.h"
 #include "perfetto/trace_processor/status.h"
 
 #include "src/trace_processor/importers/common/trace_parser.h"
@@ -34,6 +39,11 @@ class SystraceLineParser {
   util::Status ParseLine(const SystraceLine&);
 
  private:
+  // Returns the value of the |key| arg of the line being parsed, or an empty
+  // string if the line doesn't have it.
+  base::StringView FindArg(base::StringView key) const;
+  std::string GetArg(base::StringView key) const;
+
   TraceProcessorContext* const context_;
   RssStatTracker rss_stat_tracker_;
 
@@ -46,6 +56,9 @@ class SystraceLineParser {
   const StringId io_wait_id_ = kNullStringId;
   const StringId waker_utid_id_ = kNullStringId;
   const StringId unknown_thread_name_id_ = kNullStringId;
+
+  // The key=value args of the line being parsed. Reused across lines.
+  std::vector<std::pair<base::StringView, base::StringView>> args_;
 };
 
 }  // namespace trace_processor
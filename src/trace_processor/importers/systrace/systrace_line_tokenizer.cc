@@ -18,35 +18,144 @@
 
 #include "perfetto/ext/base/string_utils.h"
 
-// On windows std::isspace if overloaded in <locale>. MSBUILD via bazel
-// attempts to use that version instead of the intended one defined in
-// <cctype>
-#include <cctype>
-
 namespace perfetto {
 namespace trace_processor {
 
 namespace {
-std::string SubstrTrim(const std::string& input) {
-  std::string s = input;
-  s.erase(s.begin(), std::find_if(s.begin(), s.end(),
-                                  [](char ch) { return !std::isspace(ch); }));
-  s.erase(std::find_if(s.rbegin(), s.rend(),
-                       [](char ch) { return !std::isspace(ch); })
-              .base(),
-          s.end());
-  return s;
+
+// Matches the \s class of std::regex (ECMAScript grammar).
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+bool IsFlagChar(char c) {
+  return IsDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         c == '.';
 }
-}  // namespace
 
-SystraceLineTokenizer::SystraceLineTokenizer()
-    : line_matcher_(std::regex(R"(-(\d+)\s+\(?\s*(\d+|-+)?\)?\s?\[(\d+)\]\s*)"
-                               R"([a-zA-Z0-9.]{0,5}\s+(\d+\.\d+):\s+(\S+):)")) {
+base::StringView Trim(base::StringView s) {
+  size_t begin = 0;
+  size_t end = s.size();
+  while (begin < end && IsSpace(s.at(begin)))
+    begin++;
+  while (end > begin && IsSpace(s.at(end - 1)))
+    end--;
+  return s.substr(begin, end - begin);
 }
 
+// Tries to match the header of a systrace line at |*pos|, which must point to
+// the '-' between the task name and the pid. This is the equivalent of the
+// regex:
+//   -(\d+)\s+\(?\s*(\d+|-+)?\)?\s?\[(\d+)\]\s*[a-zA-Z0-9.]{0,5}\s+
+//   (\d+\.\d+):\s+(\S+):
+// On success, fills the out arguments with views into |s|, sets |*pos| to the
+// first char after the header and returns true.
+bool MatchHeader(base::StringView s,
+                 size_t* pos,
+                 base::StringView* pid,
+                 base::StringView* tgid,
+                 base::StringView* cpu,
+                 base::StringView* ts,
+                 base::StringView* event_name) {
+  const size_t size = s.size();
+  size_t i = *pos + 1;
+
+  auto consume_digits = [&]() {
+    size_t start = i;
+    while (i < size && IsDigit(s.at(i)))
+      i++;
+    return s.substr(start, i - start);
+  };
+  auto skip_spaces = [&]() {
+    size_t start = i;
+    while (i < size && IsSpace(s.at(i)))
+      i++;
+    return i - start;
+  };
+
+  // -(\d+)\s+
+  *pid = consume_digits();
+  if (pid->empty() || skip_spaces() == 0)
+    return false;
+
+  // \(?\s*(\d+|-+)?\)?\s?
+  if (i < size && s.at(i) == '(')
+    i++;
+  skip_spaces();
+  size_t tgid_start = i;
+  if (i < size && IsDigit(s.at(i))) {
+    consume_digits();
+  } else {
+    while (i < size && s.at(i) == '-')
+      i++;
+  }
+  *tgid = s.substr(tgid_start, i - tgid_start);
+  if (i < size && s.at(i) == ')')
+    i++;
+  if (i < size && IsSpace(s.at(i)))
+    i++;
+
+  // \[(\d+)\]
+  if (i >= size || s.at(i) != '[')
+    return false;
+  i++;
+  *cpu = consume_digits();
+  if (cpu->empty() || i >= size || s.at(i) != ']')
+    return false;
+  i++;
+
+  // \s*[a-zA-Z0-9.]{0,5}\s+
+  // The irq flags can be missing, in which case the next token is the
+  // timestamp, which is not followed by a space.
+  size_t spaces = skip_spaces();
+  size_t flags_end = i;
+  while (flags_end < size && IsFlagChar(s.at(flags_end)))
+    flags_end++;
+  if (flags_end - i <= 5 && flags_end < size && IsSpace(s.at(flags_end))) {
+    i = flags_end;
+    spaces = skip_spaces();
+  }
+  if (spaces == 0)
+    return false;
+
+  // (\d+\.\d+):\s+
+  size_t ts_start = i;
+  if (consume_digits().empty() || i >= size || s.at(i) != '.')
+    return false;
+  i++;
+  if (consume_digits().empty() || i >= size || s.at(i) != ':')
+    return false;
+  *ts = s.substr(ts_start, i - ts_start);
+  i++;
+  if (skip_spaces() == 0)
+    return false;
+
+  // (\S+): where the event name ends at the last ':' of the token.
+  size_t name_start = i;
+  size_t name_end = base::StringView::npos;
+  for (; i < size && !IsSpace(s.at(i)); i++) {
+    if (s.at(i) == ':')
+      name_end = i;
+  }
+  if (name_end == base::StringView::npos || name_end == name_start)
+    return false;
+  *event_name = s.substr(name_start, name_end - name_start);
+  *pos = name_end + 1;
+  return true;
+}
+
+}  // namespace
+
+SystraceLineTokenizer::SystraceLineTokenizer() = default;
+
 // TODO(hjd): This should be more robust to being passed random input.
 // This can happen if we mess up detecting a gzip trace for example.
-util::Status SystraceLineTokenizer::Tokenize(const std::string& buffer,
+util::Status SystraceLineTokenizer::Tokenize(base::StringView buffer,
                                              SystraceLine* line) {
   // An example line from buffer looks something like the following:
   // kworker/u16:1-77    (   77) [004] ....   316.196720: 0:
@@ -58,39 +167,54 @@ util::Status SystraceLineTokenizer::Tokenize(const std::string& buffer,
   // Also the irq fields can be missing (we don't parse these anyway)
   // <idle>-0     [000]  0.002188: task_newtask: pid=1 ...
   //
-  // The task name can contain any characters e.g -:[(/ and for this reason
-  // it is much easier to use a regex (even though it is slower than parsing
-  // manually)
-
-  std::smatch matches;
-  bool matched = std::regex_search(buffer, matches, line_matcher_);
-  if (!matched) {
-    return util::ErrStatus("Not a known systrace event format (line: %s)",
-                           buffer.c_str());
+  // The task name can contain any characters e.g -:[(/ so we look for the
+  // first '-' after which the rest of the header matches, like a regex search
+  // would, but without the cost of std::regex.
+  base::StringView pid_str;
+  base::StringView tgid_str;
+  base::StringView cpu_str;
+  base::StringView ts_str;
+  base::StringView event_name;
+  size_t dash = 0;
+  size_t header_end = 0;
+  for (;; dash++) {
+    dash = buffer.find('-', dash);
+    if (dash == base::StringView::npos) {
+      return util::ErrStatus("Not a known systrace event format (line: %s)",
+                             buffer.ToStdString().c_str());
+    }
+    header_end = dash;
+    if (MatchHeader(buffer, &header_end, &pid_str, &tgid_str, &cpu_str,
+                    &ts_str, &event_name)) {
+      break;
+    }
   }
 
-  std::string pid_str = matches[1].str();
-  std::string cpu_str = matches[3].str();
-  std::string ts_str = matches[4].str();
-
-  line->task = SubstrTrim(matches.prefix());
-  line->tgid_str = matches[2].str();
-  line->event_name = matches[5].str();
-  line->args_str = SubstrTrim(matches.suffix());
+  // Assign rather than construct the strings, so that a SystraceLine reused
+  // across lines doesn't reallocate them.
+  base::StringView task = Trim(buffer.substr(0, dash));
+  base::StringView args = Trim(buffer.substr(header_end));
+  line->task.assign(task.data(), task.size());
+  line->tgid_str.assign(tgid_str.data(), tgid_str.size());
+  line->event_name.assign(event_name.data(), event_name.size());
+  line->args_str.assign(args.data(), args.size());
 
-  std::optional<uint32_t> maybe_pid = base::StringToUInt32(pid_str);
+  std::optional<uint32_t> maybe_pid =
+      base::CStringToUInt32(pid_str.ToStdString().c_str());
   if (!maybe_pid.has_value()) {
-    return util::Status("Could not convert pid " + pid_str);
+    return util::Status("Could not convert pid " + pid_str.ToStdString());
   }
   line->pid = maybe_pid.value();
 
-  std::optional<uint32_t> maybe_cpu = base::StringToUInt32(cpu_str);
+  std::optional<uint32_t> maybe_cpu =
+      base::CStringToUInt32(cpu_str.ToStdString().c_str());
   if (!maybe_cpu.has_value()) {
-    return util::Status("Could not convert cpu " + cpu_str);
+    return util::Status("Could not convert cpu " + cpu_str.ToStdString());
   }
   line->cpu = maybe_cpu.value();
 
-  std::optional<double> maybe_ts = base::StringToDouble(ts_str);
+  std::optional<double> maybe_ts =
+      base::CStringToDouble(ts_str.ToStdString().c_str());
   if (!maybe_ts.has_value()) {
     return util::Status("Could not convert ts");
   }
@@ -17,8 +17,7 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_LINE_TOKENIZER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_LINE_TOKENIZER_H_
 
-#include <regex>
-
+#include "perfetto/ext/base/string_view.h"
 #include "perfetto/trace_processor/status.h"
 
 #include "src/trace_processor/importers/systrace/systrace_line.h"
@@ -30,10 +29,7 @@ class SystraceLineTokenizer {
  public:
   SystraceLineTokenizer();
 
-  util::Status Tokenize(const std::string& line, SystraceLine*);
-
- private:
-  const std::regex line_matcher_;
+  util::Status Tokenize(base::StringView line, SystraceLine*);
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/systrace/systrace_line_tokenizer.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(SystraceLineTokenizerTest, WithTgid) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("kworker/u16:1-77    (   77) [004] ....   "
+                            "316.196720: 0: B|77|__scm_call_armv8_64|0",
+                            &line)
+                  .ok());
+  EXPECT_EQ(line.task, "kworker/u16:1");
+  EXPECT_EQ(line.pid, 77u);
+  EXPECT_EQ(line.tgid_str, "77");
+  EXPECT_EQ(line.cpu, 4u);
+  EXPECT_EQ(line.ts, 316196720000);
+  EXPECT_EQ(line.event_name, "0");
+  EXPECT_EQ(line.args_str, "B|77|__scm_call_armv8_64|0");
+}
+
+TEST(SystraceLineTokenizerTest, WithoutTgid) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("<idle>-0     [000] ...2     0.002188: "
+                            "task_newtask: pid=1 comm=swapper/0",
+                            &line)
+                  .ok());
+  EXPECT_EQ(line.task, "<idle>");
+  EXPECT_EQ(line.pid, 0u);
+  EXPECT_EQ(line.tgid_str, "");
+  EXPECT_EQ(line.cpu, 0u);
+  EXPECT_EQ(line.ts, 2188000);
+  EXPECT_EQ(line.event_name, "task_newtask");
+  EXPECT_EQ(line.args_str, "pid=1 comm=swapper/0");
+}
+
+TEST(SystraceLineTokenizerTest, WithoutIrqFlags) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(
+      tokenizer.Tokenize("<idle>-0     [001]  0.002188: task_newtask: pid=1",
+                         &line)
+          .ok());
+  EXPECT_EQ(line.task, "<idle>");
+  EXPECT_EQ(line.cpu, 1u);
+  EXPECT_EQ(line.ts, 2188000);
+  EXPECT_EQ(line.event_name, "task_newtask");
+  EXPECT_EQ(line.args_str, "pid=1");
+}
+
+TEST(SystraceLineTokenizerTest, DashesInTaskName) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("Binder-Thread-1-1234 (-----) [002] d..3 "
+                            "12.500000: sched_waking: comm=foo pid=5",
+                            &line)
+                  .ok());
+  EXPECT_EQ(line.task, "Binder-Thread-1");
+  EXPECT_EQ(line.pid, 1234u);
+  EXPECT_EQ(line.tgid_str, "-----");
+  EXPECT_EQ(line.cpu, 2u);
+  EXPECT_EQ(line.ts, 12500000000);
+  EXPECT_EQ(line.event_name, "sched_waking");
+  EXPECT_EQ(line.args_str, "comm=foo pid=5");
+}
+
+TEST(SystraceLineTokenizerTest, ReusedLine) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("surfaceflinger-600 ( 600) [003] .... 1.000000: "
+                            "tracing_mark_write: B|600|composite",
+                            &line)
+                  .ok());
+  ASSERT_TRUE(
+      tokenizer.Tokenize("sh-7 [000] .... 2.000000: print: E", &line).ok());
+  EXPECT_EQ(line.task, "sh");
+  EXPECT_EQ(line.pid, 7u);
+  EXPECT_EQ(line.tgid_str, "");
+  EXPECT_EQ(line.event_name, "print");
+  EXPECT_EQ(line.args_str, "E");
+}
+
+TEST(SystraceLineTokenizerTest, Invalid) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  EXPECT_FALSE(tokenizer.Tokenize("", &line).ok());
+  EXPECT_FALSE(tokenizer.Tokenize("not-a systrace line", &line).ok());
+  EXPECT_FALSE(
+      tokenizer.Tokenize("sh-7 [000] .... 2.000000 print: E", &line).ok());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -25,6 +25,7 @@
 
 #include <cctype>
 #include <cinttypes>
+#include <cstring>
 #include <string>
 #include <unordered_map>
 
@@ -74,7 +75,7 @@ util::Status SystraceTraceParser::Parse(TraceBlobView blob) {
   if (state_ == ParseState::kBeforeParse) {
     // Remove anything before the TRACE:\n marker, which is emitted when
     // obtaining traces via  `adb shell "atrace -t 1 sched" > out.txt`.
-    std::array<uint8_t, 7> kAtraceMarker = {'T', 'R', 'A', 'C', 'E', ':', '\n'};
+    std::array<char, 7> kAtraceMarker = {'T', 'R', 'A', 'C', 'E', ':', '\n'};
     auto search_end = partial_buf_.begin() +
                       static_cast<int>(std::min(partial_buf_.size(),
                                                 kGuessTraceMaxLookahead));
@@ -93,48 +94,52 @@ util::Status SystraceTraceParser::Parse(TraceBlobView blob) {
   // good to also parse the process dump section.
   const char kTraceDataSection[] =
       R"(<script class="trace-data" type="application/text">)";
-  auto start_it = partial_buf_.begin();
-  for (;;) {
-    auto line_it = std::find(start_it, partial_buf_.end(), '\n');
-    if (line_it == partial_buf_.end())
+  // Lines are views into |partial_buf_|, which is not modified until the end
+  // of the loop.
+  const char* buf_end = partial_buf_.data() + partial_buf_.size();
+  const char* line_start = partial_buf_.data();
+  while (line_start < buf_end) {
+    const char* line_end = static_cast<const char*>(
+        memchr(line_start, '\n', static_cast<size_t>(buf_end - line_start)));
+    if (!line_end)
       break;
 
-    std::string buffer(start_it, line_it);
+    base::StringView buffer(line_start,
+                            static_cast<size_t>(line_end - line_start));
 
     if (state_ == ParseState::kHtmlBeforeSystrace) {
-      if (base::Contains(buffer, kTraceDataSection)) {
+      if (buffer.find(kTraceDataSection) != base::StringView::npos) {
         state_ = ParseState::kTraceDataSection;
       }
     } else if (state_ == ParseState::kTraceDataSection) {
-      if (base::StartsWith(buffer, "#") && base::Contains(buffer, "TASK-PID")) {
+      if (buffer.StartsWith("#") &&
+          buffer.find("TASK-PID") != base::StringView::npos) {
         state_ = ParseState::kSystrace;
-      } else if (base::StartsWith(buffer, "PROCESS DUMP")) {
+      } else if (buffer.StartsWith("PROCESS DUMP")) {
         state_ = ParseState::kProcessDumpLong;
-      } else if (base::StartsWith(buffer, "CGROUP DUMP")) {
+      } else if (buffer.StartsWith("CGROUP DUMP")) {
         state_ = ParseState::kCgroupDump;
-      } else if (base::Contains(buffer, R"(</script>)")) {
+      } else if (buffer.find(R"(</script>)") != base::StringView::npos) {
         state_ = ParseState::kHtmlBeforeSystrace;
       }
     } else if (state_ == ParseState::kSystrace) {
-      if (base::Contains(buffer, R"(</script>)")) {
+      if (buffer.find(R"(</script>)") != base::StringView::npos) {
         state_ = ParseState::kEndOfSystrace;
         break;
-      } else if (!base::StartsWith(buffer, "#") && !buffer.empty()) {
-        SystraceLine line;
-        util::Status status = line_tokenizer_.Tokenize(buffer, &line);
+      } else if (!buffer.StartsWith("#") && !buffer.empty()) {
+        util::Status status = line_tokenizer_.Tokenize(buffer, &line_);
         if (status.ok()) {
-          line_parser_.ParseLine(std::move(line));
+          line_parser_.ParseLine(line_);
         } else {
           ctx_->storage->IncrementStats(stats::systrace_parse_failure);
         }
       }
     } else if (state_ == ParseState::kProcessDumpLong ||
                state_ == ParseState::kProcessDumpShort) {
-      if (base::Contains(buffer, R"(</script>)")) {
+      if (buffer.find(R"(</script>)") != base::StringView::npos) {
         state_ = ParseState::kHtmlBeforeSystrace;
       } else {
-        std::vector<base::StringView> tokens =
-            SplitOnSpaces(base::StringView(buffer));
+        std::vector<base::StringView> tokens = SplitOnSpaces(buffer);
         if (IsProcessDumpShortHeader(tokens)) {
           state_ = ParseState::kProcessDumpShort;
         } else if (IsProcessDumpLongHeader(tokens)) {
@@ -152,9 +157,10 @@ util::Status SystraceTraceParser::Parse(TraceBlobView blob) {
           const char* cmd_start = tokens[9].data();
           base::StringView cmd(
               cmd_start,
-              static_cast<size_t>((buffer.data() + buffer.size()) - cmd_start));
+              static_cast<size_t>(buffer.end() - cmd_start));
           if (!pid || !ppid) {
-            PERFETTO_ELOG("Could not parse line '%s'", buffer.c_str());
+            PERFETTO_ELOG("Could not parse line '%s'",
+                          buffer.ToStdString().c_str());
             return util::ErrStatus("Could not parse PROCESS DUMP line");
           }
           ctx_->process_tracker->SetProcessMetadata(pid.value(), ppid, name,
@@ -171,11 +177,12 @@ util::Status SystraceTraceParser::Parse(TraceBlobView blob) {
           const char* cmd_start = tokens[3].data();
           base::StringView cmd(
               cmd_start,
-              static_cast<size_t>((buffer.data() + buffer.size()) - cmd_start));
+              static_cast<size_t>(buffer.end() - cmd_start));
           StringId cmd_id =
               ctx_->storage->mutable_string_pool()->InternString(cmd);
           if (!tid || !tgid) {
-            PERFETTO_ELOG("Could not parse line '%s'", buffer.c_str());
+            PERFETTO_ELOG("Could not parse line '%s'",
+                          buffer.ToStdString().c_str());
             return util::ErrStatus("Could not parse PROCESS DUMP line");
           }
           UniqueTid utid =
@@ -185,17 +192,18 @@ util::Status SystraceTraceParser::Parse(TraceBlobView blob) {
         }
       }
     } else if (state_ == ParseState::kCgroupDump) {
-      if (base::Contains(buffer, R"(</script>)")) {
+      if (buffer.find(R"(</script>)") != base::StringView::npos) {
         state_ = ParseState::kHtmlBeforeSystrace;
       }
       // TODO(lalitm): see if it is important to parse this.
     }
-    start_it = line_it + 1;
+    line_start = line_end + 1;
   }
   if (state_ == ParseState::kEndOfSystrace) {
     partial_buf_.clear();
   } else {
-    partial_buf_.erase(partial_buf_.begin(), start_it);
+    auto consumed = line_start - partial_buf_.data();
+    partial_buf_.erase(partial_buf_.begin(), partial_buf_.begin() + consumed);
   }
   return util::OkStatus();
 }
@@ -29,13 +29,19 @@ namespace trace_processor {
 IteratorImpl::IteratorImpl(
     TraceProcessorImpl* trace_processor,
     base::StatusOr<PerfettoSqlEngine::ExecutionResult> result,
-    uint32_t sql_stats_row)
+    uint32_t sql_stats_row,
+    std::unique_ptr<QueryProfiler> profiler)
     : trace_processor_(trace_processor),
       result_(std::move(result)),
-      sql_stats_row_(sql_stats_row) {}
+      sql_stats_row_(sql_stats_row),
+      profiler_(std::move(profiler)) {}
 
 IteratorImpl::~IteratorImpl() {
   if (trace_processor_) {
+    if (profiler_) {
+      trace_processor_.get()->engine_.sqlite_engine()->EndProfiling(
+          profiler_.get());
+    }
     base::TimeNanos t_end = base::GetWallTimeNs();
     auto* sql_stats =
         trace_processor_.get()->context_.storage->mutable_sql_stats();
@@ -89,5 +95,12 @@ std::string Iterator::LastStatementSql() {
   return iterator_->LastStatementSql();
 }
 
+std::optional<QueryProfile> Iterator::Profile() {
+  const QueryProfiler* profiler = iterator_->profiler();
+  if (!profiler)
+    return std::nullopt;
+  return profiler->profile();
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -31,6 +31,7 @@
 #include "perfetto/trace_processor/iterator.h"
 #include "perfetto/trace_processor/status.h"
 #include "src/trace_processor/perfetto_sql/engine/perfetto_sql_engine.h"
+#include "src/trace_processor/sqlite/query_profiler.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/sqlite/sqlite_engine.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
@@ -44,7 +45,8 @@ class IteratorImpl {
  public:
   IteratorImpl(TraceProcessorImpl* impl,
                base::StatusOr<PerfettoSqlEngine::ExecutionResult>,
-               uint32_t sql_stats_row);
+               uint32_t sql_stats_row,
+               std::unique_ptr<QueryProfiler> profiler);
   ~IteratorImpl();
 
   IteratorImpl(IteratorImpl&) noexcept = delete;
@@ -142,6 +144,8 @@ class IteratorImpl {
     return result_.ok() ? result_->stmt.sql() : "";
   }
 
+  const QueryProfiler* profiler() const { return profiler_.get(); }
+
  private:
   // Dummy function to pass to ScopedResource.
   static int DummyClose(TraceProcessorImpl*) { return 0; }
@@ -161,6 +165,9 @@ class IteratorImpl {
   base::StatusOr<PerfettoSqlEngine::ExecutionResult> result_;
   uint32_t sql_stats_row_ = 0;
   bool called_next_ = false;
+
+  // Only set if the query is being profiled.
+  std::unique_ptr<QueryProfiler> profiler_;
 };
 
 }  // namespace trace_processor
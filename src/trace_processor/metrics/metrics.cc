@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "perfetto/base/status.h"
+#include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
@@ -89,6 +90,27 @@ base::Status ValidateSingleNonEmptyMessage(const uint8_t* ptr,
   return base::OkStatus();
 }
 
+// Executes the metric file at |path| with the (substituted) |sql| unless the
+// same file was already executed during the current ComputeMetrics call.
+base::Status ExecuteMetricFile(RunMetric::Context* ctx,
+                               const std::string& path,
+                               const std::string& sql,
+                               bool is_root_metric) {
+  base::Hasher hasher;
+  hasher.Update(path);
+  hasher.Update(sql);
+  uint64_t hash = hasher.digest();
+  if (ctx->executed_files && ctx->executed_files->count(hash))
+    return base::OkStatus();
+
+  SqlSource source = is_root_metric ? SqlSource::FromMetric(sql, path)
+                                    : SqlSource::FromMetricFile(sql, path);
+  RETURN_IF_ERROR(ctx->engine->Execute(std::move(source)).status());
+  if (ctx->executed_files)
+    ctx->executed_files->insert(hash);
+  return base::OkStatus();
+}
+
 }  // namespace
 
 ProtoBuilder::ProtoBuilder(const DescriptorPool* pool,
@@ -654,8 +676,8 @@ base::Status RunMetric::Run(RunMetric::Context* ctx,
         metric_it->sql.c_str());
   }
 
-  auto res = ctx->engine->Execute(SqlSource::FromMetricFile(subbed_sql, path));
-  return res.status();
+  return ExecuteMetricFile(ctx, metric_it->path, subbed_sql,
+                           /*is_root_metric=*/false);
 }
 
 base::Status UnwrapMetricProto::Run(Context*,
@@ -704,12 +726,17 @@ base::Status UnwrapMetricProto::Run(Context*,
   return base::OkStatus();
 }
 
-base::Status ComputeMetrics(PerfettoSqlEngine* engine,
+base::Status ComputeMetrics(RunMetric::Context* ctx,
                             const std::vector<std::string> metrics_to_compute,
                             const std::vector<SqlMetricFile>& sql_metrics,
                             const DescriptorPool& pool,
                             const ProtoDescriptor& root_descriptor,
                             std::vector<uint8_t>* metrics_proto) {
+  PerfettoSqlEngine* engine = ctx->engine;
+  ctx->executed_files.emplace();
+  auto reset_executed_files =
+      base::OnScopeExit([ctx] { ctx->executed_files.reset(); });
+
   ProtoBuilder metric_builder(&pool, &root_descriptor);
   for (const auto& name : metrics_to_compute) {
     auto metric_it =
@@ -722,9 +749,8 @@ base::Status ComputeMetrics(PerfettoSqlEngine* engine,
       return base::ErrStatus("Unknown metric %s", name.c_str());
 
     const SqlMetricFile& sql_metric = *metric_it;
-    auto prep_it =
-        engine->Execute(SqlSource::FromMetric(sql_metric.sql, metric_it->path));
-    RETURN_IF_ERROR(prep_it.status());
+    RETURN_IF_ERROR(ExecuteMetricFile(ctx, sql_metric.path, sql_metric.sql,
+                                      /*is_root_metric=*/true));
 
     auto output_query =
         "SELECT * FROM " + sql_metric.output_table_name.value() + ";";
@@ -19,7 +19,9 @@
 
 #include <sqlite3.h>
 
+#include <optional>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "perfetto/ext/base/string_view.h"
@@ -178,6 +180,12 @@ struct RunMetric : public SqlFunction {
   struct Context {
     PerfettoSqlEngine* engine;
     std::vector<SqlMetricFile>* metrics;
+
+    // Hashes of the metric files (after substitution) already executed by
+    // the ComputeMetrics call in progress; unset outside of ComputeMetrics.
+    // Metrics often RUN_METRIC the same helper files with the same arguments
+    // so each of them only needs to run once per call.
+    std::optional<std::unordered_set<uint64_t>> executed_files;
   };
   static constexpr bool kVoidReturn = true;
   static base::Status Run(Context* ctx,
@@ -200,7 +208,7 @@ struct UnwrapMetricProto : public SqlFunction {
 void RepeatedFieldStep(sqlite3_context* ctx, int argc, sqlite3_value** argv);
 void RepeatedFieldFinal(sqlite3_context* ctx);
 
-base::Status ComputeMetrics(PerfettoSqlEngine*,
+base::Status ComputeMetrics(RunMetric::Context* ctx,
                             const std::vector<std::string> metrics_to_compute,
                             const std::vector<SqlMetricFile>& metrics,
                             const DescriptorPool& pool,
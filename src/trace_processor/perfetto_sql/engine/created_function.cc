@@ -16,15 +16,18 @@
 
 #include "src/trace_processor/perfetto_sql/engine/created_function.h"
 
+#include <cstring>
 #include <queue>
 #include <stack>
 
 #include "perfetto/base/status.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "src/trace_processor/perfetto_sql/engine/function_util.h"
 #include "src/trace_processor/perfetto_sql/engine/perfetto_sql_engine.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/sqlite/sql_source.h"
 #include "src/trace_processor/sqlite/sqlite_engine.h"
+#include "src/trace_processor/sqlite/sqlite_tokenizer.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 #include "src/trace_processor/tp_metatrace.h"
 #include "src/trace_processor/util/status_macros.h"
@@ -217,6 +220,130 @@ class Memoizer {
   base::FlatHashMap<MemoizedArgs, StoredSqlValue> memoized_values_;
 };
 
+// Caches the results of a function for the duration of a single statement
+// executed by PerfettoSqlEngine, keyed on the full tuple of arguments.
+//
+// Unlike Memoizer, this is enabled automatically for functions whose body
+// reads from tables: evaluating such a body for every row of a large table is
+// very expensive while the arguments (e.g. ids of a handful of threads) often
+// repeat. Scoping the cache to one statement ensures that changes made to the
+// tables by later statements are always picked up.
+class StatementResultCache {
+ public:
+  // Returns the key under which the result for |argv| is cached.
+  static std::string Key(size_t argc, sqlite3_value** argv) {
+    std::string key;
+    for (size_t i = 0; i < argc; ++i) {
+      SqlValue arg = sqlite_utils::SqliteValueToSqlValue(argv[i]);
+      key.push_back(static_cast<char>(arg.type));
+      switch (arg.type) {
+        case SqlValue::Type::kNull:
+          break;
+        case SqlValue::Type::kLong:
+          AppendRaw(&key, &arg.long_value, sizeof(arg.long_value));
+          break;
+        case SqlValue::Type::kDouble:
+          AppendRaw(&key, &arg.double_value, sizeof(arg.double_value));
+          break;
+        case SqlValue::Type::kString: {
+          size_t size = strlen(arg.string_value);
+          AppendRaw(&key, &size, sizeof(size));
+          key.append(arg.string_value, size);
+          break;
+        }
+        case SqlValue::Type::kBytes:
+          AppendRaw(&key, &arg.bytes_count, sizeof(arg.bytes_count));
+          AppendRaw(&key, arg.bytes_value, arg.bytes_count);
+          break;
+      }
+    }
+    return key;
+  }
+
+  // Returns the cached value for |key| if it was computed during the statement
+  // identified by |generation|.
+  std::optional<SqlValue> Find(uint64_t generation, const std::string& key) {
+    MaybeReset(generation);
+    StoredSqlValue* value = values_.Find(key);
+    if (!value) {
+      return std::nullopt;
+    }
+    return value->AsSqlValue();
+  }
+
+  void Insert(uint64_t generation, std::string key, SqlValue value) {
+    MaybeReset(generation);
+    // Functions called with mostly unique arguments would just waste memory
+    // so stop caching once the cache is large enough.
+    if (values_.size() >= kMaxEntries) {
+      return;
+    }
+    values_.Insert(std::move(key), StoredSqlValue(value));
+  }
+
+ private:
+  static constexpr size_t kMaxEntries = 64 * 1024;
+
+  static void AppendRaw(std::string* key, const void* data, size_t size) {
+    key->append(static_cast<const char*>(data), size);
+  }
+
+  void MaybeReset(uint64_t generation) {
+    if (generation == generation_) {
+      return;
+    }
+    generation_ = generation;
+    values_.Clear();
+  }
+
+  uint64_t generation_ = 0;
+  base::FlatHashMap<std::string, StoredSqlValue> values_;
+};
+
+// Properties of the SQL body of a function which allow to take shortcuts when
+// evaluating it.
+struct BodyTraits {
+  // Whether the body can return at most one row (e.g. SELECT $x + 1), in which
+  // case there is no need to check for extra rows after the first one.
+  bool at_most_one_row = true;
+
+  // Whether the body reads from tables and has no other non-deterministic
+  // parts, in which case its results can be cached for the duration of a
+  // statement.
+  bool cacheable = false;
+};
+
+BodyTraits ComputeBodyTraits(const SqlSource& sql, sqlite3_stmt* stmt) {
+  // Keywords which allow a SELECT to return more than one row.
+  static constexpr const char* kMultiRowKeywords[] = {
+      "from", "union", "intersect", "except", "values", "with"};
+  // Built-in functions whose result is not only a function of the arguments.
+  static constexpr const char* kNonDeterministicFunctions[] = {
+      "random", "randomblob", "changes", "total_changes", "last_insert_rowid"};
+
+  BodyTraits traits;
+  bool reads_tables = false;
+  bool deterministic = true;
+  SqliteTokenizer tokenizer(sql);
+  for (auto t = tokenizer.NextNonWhitespace(); !t.IsTerminal();
+       t = tokenizer.NextNonWhitespace()) {
+    std::string str(t.str);
+    if (t.token_type == SqliteTokenType::TK_GENERIC_KEYWORD) {
+      for (const char* keyword : kMultiRowKeywords) {
+        traits.at_most_one_row &= !base::CaseInsensitiveEqual(str, keyword);
+      }
+      reads_tables |= base::CaseInsensitiveEqual(str, "from");
+    } else if (t.token_type == SqliteTokenType::TK_ID) {
+      for (const char* fn : kNonDeterministicFunctions) {
+        deterministic &= !base::CaseInsensitiveEqual(str, fn);
+      }
+    }
+  }
+  traits.cacheable =
+      reads_tables && deterministic && sqlite3_stmt_readonly(stmt);
+  return traits;
+}
+
 // A helper to unroll recursive calls: to minimise the amount of stack space
 // used, memoized recursive calls are evaluated using an on-heap queue.
 //
@@ -432,6 +559,9 @@ class State : public CreatedFunction::Context {
     base::StatusOr<SqliteEngine::PreparedStatement> stmt =
         engine_->sqlite_engine()->PrepareStatement(*sql_);
     RETURN_IF_ERROR(stmt.status());
+    if (stmts_.empty()) {
+      body_traits_ = ComputeBodyTraits(*sql_, stmt->sqlite_stmt());
+    }
     is_valid_ = true;
     stmts_.push_back(std::move(stmt.value()));
     return base::OkStatus();
@@ -550,6 +680,12 @@ class State : public CreatedFunction::Context {
 
   Memoizer& memoizer() { return memoizer_; }
 
+  StatementResultCache& statement_result_cache() {
+    return statement_result_cache_;
+  }
+
+  const BodyTraits& body_traits() const { return body_traits_; }
+
  private:
   PerfettoSqlEngine* engine_;
   Prototype prototype_;
@@ -571,6 +707,8 @@ class State : public CreatedFunction::Context {
   // re-registration is not allowed).
   bool is_valid_ = false;
   Memoizer memoizer_;
+  BodyTraits body_traits_;
+  StatementResultCache statement_result_cache_;
   // Set if we are in a middle of unrolling a recursive call.
   std::unique_ptr<RecursiveCallUnroller> recursive_call_unroller_;
 };
@@ -638,6 +776,20 @@ base::Status CreatedFunction::Run(CreatedFunction::Context* ctx,
     }
   }
 
+  // Explicit memoization takes precedence: the statement cache must not see
+  // the placeholder results returned while unrolling recursive calls.
+  std::optional<std::string> cache_key;
+  uint64_t generation = state->engine()->statement_generation();
+  if (state->body_traits().cacheable && !state->memoizer().enabled()) {
+    cache_key = StatementResultCache::Key(argc, argv);
+    std::optional<SqlValue> cached =
+        state->statement_result_cache().Find(generation, *cache_key);
+    if (cached) {
+      out = *cached;
+      return base::OkStatus();
+    }
+  }
+
   PERFETTO_TP_TRACE(
       metatrace::Category::FUNCTION, "SQL_FUNCTION_CALL",
       [state, argv](metatrace::Record* r) {
@@ -658,11 +810,17 @@ base::Status CreatedFunction::Run(CreatedFunction::Context* ctx,
                                         state->prototype());
   RETURN_IF_ERROR(result.status());
   out = result.value();
-  state->ScheduleEmptyStatementValidation(state->CurrentStatement());
+  if (!state->body_traits().at_most_one_row) {
+    state->ScheduleEmptyStatementValidation(state->CurrentStatement());
+  }
 
   if (memoized_args) {
     state->memoizer().Memoize(*memoized_args, out);
   }
+  if (cache_key) {
+    state->statement_result_cache().Insert(generation, std::move(*cache_key),
+                                           out);
+  }
 
   return base::OkStatus();
 }
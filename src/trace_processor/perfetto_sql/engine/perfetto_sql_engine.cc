@@ -33,6 +33,7 @@
 #include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/sqlite/sql_source.h"
 #include "src/trace_processor/sqlite/sqlite_engine.h"
+#include "src/trace_processor/sqlite/sqlite_tokenizer.h"
 #include "src/trace_processor/tp_metatrace.h"
 #include "src/trace_processor/util/status_macros.h"
 
@@ -91,10 +92,35 @@ base::Status AddTracebackIfNeeded(base::Status status,
   return status;
 }
 
+// Returns whether |source| is a CREATE or DROP statement.
+bool IsCreateOrDropStatement(const SqlSource& source) {
+  SqliteTokenizer tokenizer(source);
+  SqliteTokenizer::Token token = tokenizer.NextNonWhitespace();
+  if (token.token_type != SqliteTokenType::TK_GENERIC_KEYWORD) {
+    return false;
+  }
+  std::string keyword(token.str);
+  return base::CaseInsensitiveEqual(keyword, "create") ||
+         base::CaseInsensitiveEqual(keyword, "drop");
+}
+
+base::Status StepUntilDone(SqliteEngine::PreparedStatement& stmt) {
+  PERFETTO_TP_TRACE(metatrace::Category::QUERY, "STMT_STEP_UNTIL_DONE",
+                    [&stmt](metatrace::Record* record) {
+                      record->AddArg("SQL", stmt.expanded_sql());
+                    });
+  while (stmt.Step()) {
+  }
+  return stmt.status();
+}
+
 }  // namespace
 
 PerfettoSqlEngine::PerfettoSqlEngine(StringPool* pool)
-    : query_cache_(new QueryCache()), pool_(pool), engine_(new SqliteEngine()) {
+    : query_cache_(new QueryCache()),
+      table_indexes_(new TableIndexes()),
+      pool_(pool),
+      engine_(new SqliteEngine()) {
   engine_->RegisterVirtualTableModule<RuntimeTableFunction>(
       "runtime_table_function", this, SqliteTable::TableType::kExplicitCreate,
       false);
@@ -106,9 +132,13 @@ PerfettoSqlEngine::PerfettoSqlEngine(StringPool* pool)
         return table->get();
       },
       [this](const std::string& name) {
-        bool res = runtime_tables_.Erase(name);
-        PERFETTO_CHECK(res);
+        auto* table = runtime_tables_.Find(name);
+        PERFETTO_CHECK(table);
+        table_indexes_->DropAllForTable(table->get());
+        query_cache_->Invalidate(table->get());
+        runtime_tables_.Erase(name);
       });
+  context->indexes = table_indexes_.get();
   engine_->RegisterVirtualTableModule<DbSqliteTable>(
       "runtime_table", std::move(context),
       SqliteTable::TableType::kExplicitCreate, false);
@@ -123,11 +153,18 @@ PerfettoSqlEngine::~PerfettoSqlEngine() {
 }
 
 void PerfettoSqlEngine::RegisterStaticTable(const Table& table,
-                                            const std::string& table_name) {
+                                            const std::string& table_name,
+                                            std::function<void()> prepare) {
   auto context =
       std::make_unique<DbSqliteTable::Context>(query_cache_.get(), &table);
+  context->indexes = table_indexes_.get();
+  if (prepare) {
+    context->prepare_static_table = prepare;
+    static_table_prepares_.Insert(table_name, std::move(prepare));
+  }
   engine_->RegisterVirtualTableModule<DbSqliteTable>(
       table_name, std::move(context), SqliteTable::kEponymousOnly, false);
+  static_tables_.Insert(table_name, &table);
 
   // Register virtual tables into an internal 'perfetto_tables' table.
   // This is used for iterating through all the tables during a database
@@ -189,6 +226,35 @@ PerfettoSqlEngine::ExecuteUntilLastStatement(SqlSource sql_source) {
   ExecutionStats stats;
   PerfettoSqlParser parser(std::move(sql_source));
   while (parser.Next()) {
+    // Caches scoped to a statement must not survive past it: the previous
+    // statement might have changed the tables they were computed from. This
+    // is done again whenever the previous statement is stepped to completion.
+    ++statement_generation_;
+
+    // Materialize any view the statement depends on before running it. This
+    // is skipped for CREATE and DROP statements so that e.g. views built on
+    // top of materialized views don't cause them to be computed until they
+    // are actually queried.
+    const SqlSource* deps = nullptr;
+    if (auto* cst = std::get_if<PerfettoSqlParser::CreateTable>(
+            &parser.statement())) {
+      deps = &cst->sql;
+    } else if (auto* sql = std::get_if<PerfettoSqlParser::SqliteSql>(
+                   &parser.statement());
+               sql && !IsCreateOrDropStatement(sql->sql)) {
+      deps = &sql->sql;
+    }
+    if (deps && materialized_views_.size() > 0) {
+      // Materializing replaces views so the previous statement needs to be
+      // finished first.
+      if (res && !res->IsDone()) {
+        RETURN_IF_ERROR(StepUntilDone(*res));
+        ++statement_generation_;
+      }
+      RETURN_IF_ERROR(
+          AddTracebackIfNeeded(MaterializeReferencedViews(*deps), *deps));
+    }
+
     std::optional<SqlSource> source;
     if (auto* cf = std::get_if<PerfettoSqlParser::CreateFunction>(
             &parser.statement())) {
@@ -203,6 +269,23 @@ PerfettoSqlEngine::ExecuteUntilLastStatement(SqlSource sql_source) {
       // dummy statement.
       source = cst->sql.FullRewrite(
           SqlSource::FromTraceProcessorImplementation("SELECT 0 WHERE 0"));
+    } else if (auto* cmv =
+                   std::get_if<PerfettoSqlParser::CreateMaterializedView>(
+                       &parser.statement())) {
+      RETURN_IF_ERROR(AddTracebackIfNeeded(
+          ExecuteCreateMaterializedView(*cmv), cmv->sql));
+      source = cmv->sql.FullRewrite(
+          SqlSource::FromTraceProcessorImplementation("SELECT 0 WHERE 0"));
+    } else if (auto* ci = std::get_if<PerfettoSqlParser::CreateIndex>(
+                   &parser.statement())) {
+      RETURN_IF_ERROR(AddTracebackIfNeeded(ExecuteCreateIndex(*ci), ci->sql));
+      source = ci->sql.FullRewrite(
+          SqlSource::FromTraceProcessorImplementation("SELECT 0 WHERE 0"));
+    } else if (auto* di = std::get_if<PerfettoSqlParser::DropIndex>(
+                   &parser.statement())) {
+      RETURN_IF_ERROR(AddTracebackIfNeeded(ExecuteDropIndex(*di), di->sql));
+      source = di->sql.FullRewrite(
+          SqlSource::FromTraceProcessorImplementation("SELECT 0 WHERE 0"));
     } else {
       // If none of the above matched, this must just be an SQL statement
       // directly executable by SQLite.
@@ -230,13 +313,8 @@ PerfettoSqlEngine::ExecuteUntilLastStatement(SqlSource sql_source) {
     // the previous statement so we don't have two clashing statements (e.g.
     // SELECT * FROM v and DROP VIEW v) partially stepped into.
     if (res && !res->IsDone()) {
-      PERFETTO_TP_TRACE(metatrace::Category::QUERY, "STMT_STEP_UNTIL_DONE",
-                        [&res](metatrace::Record* record) {
-                          record->AddArg("SQL", res->expanded_sql());
-                        });
-      while (res->Step()) {
-      }
-      RETURN_IF_ERROR(res->status());
+      RETURN_IF_ERROR(StepUntilDone(*res));
+      ++statement_generation_;
     }
 
     // Propogate the current statement to the next iteration.
@@ -387,6 +465,178 @@ base::Status PerfettoSqlEngine::RegisterRuntimeTable(std::string name,
       .status();
 }
 
+base::Status PerfettoSqlEngine::ExecuteCreateIndex(
+    const PerfettoSqlParser::CreateIndex& index) {
+  const Table* table = FindTable(index.table_name);
+  if (!table) {
+    return base::ErrStatus("CREATE PERFETTO INDEX: table %s does not exist",
+                           index.table_name.c_str());
+  }
+  // Filtering can only take advantage of a single sorted column so there's no
+  // point in supporting multi-column indexes for now.
+  if (index.col_names.size() != 1) {
+    return base::ErrStatus(
+        "CREATE PERFETTO INDEX: only indexes on a single column are supported");
+  }
+  const std::string& col_name = index.col_names.front();
+  std::optional<uint32_t> col_idx =
+      table->GetColumnIndexByName(col_name.c_str());
+  if (!col_idx) {
+    return base::ErrStatus(
+        "CREATE PERFETTO INDEX: column %s does not exist in table %s",
+        col_name.c_str(), index.table_name.c_str());
+  }
+  return table_indexes_->Create(index.name, table, *col_idx, index.replace);
+}
+
+base::Status PerfettoSqlEngine::ExecuteDropIndex(
+    const PerfettoSqlParser::DropIndex& index) {
+  const Table* table = FindTable(index.table_name);
+  if (!table) {
+    return base::ErrStatus("DROP PERFETTO INDEX: table %s does not exist",
+                           index.table_name.c_str());
+  }
+  return table_indexes_->Drop(index.name, table);
+}
+
+base::Status PerfettoSqlEngine::ExecuteCreateMaterializedView(
+    const PerfettoSqlParser::CreateMaterializedView& cmv) {
+  // The view starts out as a normal view: it's only materialized the first
+  // time it's referenced.
+  std::string create_view_sql =
+      "CREATE VIEW " + cmv.name + " AS " + cmv.sql.sql();
+  RETURN_IF_ERROR(ExecuteSqliteOnly(create_view_sql));
+  // Replaces any stale entry for a view with the same name which was dropped.
+  std::string lower_name = base::ToLower(cmv.name);
+  materialized_views_.Erase(lower_name);
+  materialized_views_.Insert(
+      std::move(lower_name),
+      MaterializedView{cmv.name, std::move(create_view_sql), cmv.sql,
+                       MaterializedView::State::kPending});
+  return base::OkStatus();
+}
+
+base::Status PerfettoSqlEngine::MaterializeReferencedViews(
+    const SqlSource& sql) {
+  SqliteTokenizer tokenizer(sql);
+  for (auto token = tokenizer.NextNonWhitespace(); !token.str.empty();
+       token = tokenizer.NextNonWhitespace()) {
+    if (token.token_type != SqliteTokenType::TK_ID) {
+      continue;
+    }
+    MaterializedView* view =
+        materialized_views_.Find(base::ToLower(std::string(token.str)));
+    if (view && view->state == MaterializedView::State::kPending) {
+      RETURN_IF_ERROR(MaterializeView(view));
+    }
+  }
+  return base::OkStatus();
+}
+
+base::Status PerfettoSqlEngine::MaterializeView(MaterializedView* view) {
+  // The view might have been dropped or redefined with plain SQL since it was
+  // created: in that case, forget about it.
+  auto stmt = engine_->PrepareStatement(
+      SqlSource::FromTraceProcessorImplementation(
+          "SELECT sql FROM sqlite_master WHERE type = 'view' AND name = ?"));
+  RETURN_IF_ERROR(stmt.status());
+  sqlite3_bind_text(stmt.sqlite_stmt(), 1, view->name.c_str(), -1,
+                    SQLITE_TRANSIENT);
+  bool still_exists =
+      stmt.Step() &&
+      sqlite3_column_type(stmt.sqlite_stmt(), 0) == SQLITE_TEXT &&
+      view->create_view_sql ==
+          reinterpret_cast<const char*>(
+              sqlite3_column_text(stmt.sqlite_stmt(), 0));
+  RETURN_IF_ERROR(stmt.status());
+  if (!still_exists) {
+    materialized_views_.Erase(base::ToLower(view->name));
+    return base::OkStatus();
+  }
+
+  // Views built on top of other materialized views should read from the
+  // materialized version of those.
+  view->state = MaterializedView::State::kMaterializing;
+  RETURN_IF_ERROR(MaterializeReferencedViews(view->sql));
+
+  PERFETTO_TP_TRACE(metatrace::Category::QUERY, "MATERIALIZE_VIEW",
+                    [view](metatrace::Record* record) {
+                      record->AddArg("name", view->name);
+                    });
+  base::Status status = ExecuteSqliteOnly("DROP VIEW " + view->name);
+  if (!status.ok()) {
+    view->state = MaterializedView::State::kPending;
+    return status;
+  }
+  status = RegisterRuntimeTable(view->name, view->sql);
+  if (!status.ok()) {
+    // Fall back to evaluating the view every time: this is slower but still
+    // gives the correct results.
+    PERFETTO_DLOG("Unable to materialize view %s: %s", view->name.c_str(),
+                  status.c_message());
+    view->state = MaterializedView::State::kFailed;
+    return ExecuteSqliteOnly(view->create_view_sql);
+  }
+  view->state = MaterializedView::State::kMaterialized;
+  return base::OkStatus();
+}
+
+void PerfettoSqlEngine::InvalidateMaterializedViews() {
+  std::vector<std::string> dropped;
+  for (auto it = materialized_views_.GetIterator(); it; ++it) {
+    MaterializedView& view = it.value();
+    if (view.state == MaterializedView::State::kFailed) {
+      view.state = MaterializedView::State::kPending;
+      continue;
+    }
+    if (view.state != MaterializedView::State::kMaterialized) {
+      continue;
+    }
+    // If the table was dropped by the user, the view is gone for good.
+    if (!runtime_tables_.Find(view.name) ||
+        !ExecuteSqliteOnly("DROP TABLE " + view.name).ok() ||
+        !ExecuteSqliteOnly(view.create_view_sql).ok()) {
+      dropped.push_back(it.key());
+      continue;
+    }
+    view.state = MaterializedView::State::kPending;
+  }
+  for (const std::string& name : dropped) {
+    materialized_views_.Erase(name);
+  }
+}
+
+base::Status PerfettoSqlEngine::ExecuteSqliteOnly(const std::string& sql) {
+  auto stmt = engine_->PrepareStatement(
+      SqlSource::FromTraceProcessorImplementation(sql));
+  RETURN_IF_ERROR(stmt.status());
+  return StepUntilDone(stmt);
+}
+
+const Table* PerfettoSqlEngine::FindTable(const std::string& name) {
+  if (auto* runtime = runtime_tables_.Find(name); runtime) {
+    return runtime->get();
+  }
+  if (auto* table = static_tables_.Find(name); table) {
+    if (auto* prepare = static_table_prepares_.Find(name); prepare)
+      (*prepare)();
+    return *table;
+  }
+  return nullptr;
+}
+
+std::vector<std::pair<std::string, const Table*>>
+PerfettoSqlEngine::GetAllTables() {
+  std::vector<std::pair<std::string, const Table*>> tables;
+  for (auto it = runtime_tables_.GetIterator(); it; ++it) {
+    tables.emplace_back(it.key(), it.value().get());
+  }
+  for (auto it = static_tables_.GetIterator(); it; ++it) {
+    tables.emplace_back(it.key(), it.value());
+  }
+  return tables;
+}
+
 base::Status PerfettoSqlEngine::EnableSqlFunctionMemoization(
     const std::string& name) {
   constexpr size_t kSupportedArgCount = 1;
@@ -411,7 +661,7 @@ base::StatusOr<SqlSource> PerfettoSqlEngine::ExecuteCreateFunction(
         SqlSource::FromTraceProcessorImplementation("SELECT 0 WHERE 0"));
   }
 
-  RuntimeTableFunction::State state{cf.prototype, cf.sql, {}, {}, std::nullopt};
+  RuntimeTableFunction::State state{cf.prototype, cf.sql, {}, {}, {}};
   base::StringView function_name;
   RETURN_IF_ERROR(
       ParseFunctionName(state.prototype_str.c_str(), function_name));
@@ -498,7 +748,7 @@ base::StatusOr<SqlSource> PerfettoSqlEngine::ExecuteCreateFunction(
           state.return_values[i].name().c_str());
     }
   }
-  state.reusable_stmt = std::move(stmt);
+  state.reusable_stmts.push_back(std::move(stmt));
 
   std::string fn_name = state.prototype.function_name;
   std::string lower_name = base::ToLower(state.prototype.function_name);
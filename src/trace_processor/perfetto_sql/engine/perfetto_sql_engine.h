@@ -17,8 +17,13 @@
 #ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_ENGINE_PERFETTO_SQL_ENGINE_H_
 #define SRC_TRACE_PROCESSOR_PERFETTO_SQL_ENGINE_PERFETTO_SQL_ENGINE_H_
 
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "perfetto/base/status.h"
 #include "perfetto/ext/base/flat_hash_map.h"
@@ -28,10 +33,12 @@
 #include "src/trace_processor/perfetto_sql/engine/runtime_table_function.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/functions/sql_function.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
+#include "src/trace_processor/sqlite/query_cache.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/sqlite/sql_source.h"
 #include "src/trace_processor/sqlite/sqlite_engine.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
+#include "src/trace_processor/sqlite/table_indexes.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -113,8 +120,10 @@ class PerfettoSqlEngine {
   base::Status EnableSqlFunctionMemoization(const std::string& name);
 
   // Registers a trace processor C++ table with SQLite with an SQL name of
-  // |name|.
-  void RegisterStaticTable(const Table& table, const std::string& name);
+  // |name|. If set, |prepare| is called before every read of the table.
+  void RegisterStaticTable(const Table& table,
+                           const std::string& name,
+                           std::function<void()> prepare = nullptr);
 
   // Registers a trace processor C++ table function with SQLite.
   void RegisterStaticTableFunction(std::unique_ptr<StaticTableFunction> fn);
@@ -128,18 +137,84 @@ class PerfettoSqlEngine {
 
   SqliteEngine* sqlite_engine() { return engine_.get(); }
 
+  const QueryCache* query_cache() const { return query_cache_.get(); }
+
+  // Returns a number which changes every time the engine starts executing a
+  // statement. Used to scope caches to the statement they were filled during.
+  uint64_t statement_generation() const { return statement_generation_; }
+
+  // Returns the static or runtime table called |name| or nullptr if there is
+  // no such table.
+  const Table* FindTable(const std::string& name);
+
+  // Returns the name and the table of all the static and runtime tables. Unlike
+  // FindTable(), the tables are returned as they are, without being prepared
+  // for reading.
+  std::vector<std::pair<std::string, const Table*>> GetAllTables();
+
+  // Throws away the cached contents of all materialized views: they will be
+  // recomputed the next time they are referenced. Should be called whenever
+  // the tables backing the views might have changed (e.g. after new trace data
+  // has been parsed).
+  void InvalidateMaterializedViews();
+
  private:
+  // State of a view created with CREATE PERFETTO MATERIALIZED VIEW.
+  //
+  // Such views start out as plain SQLite views. The first time a statement
+  // references one, the view is replaced by a runtime table containing its
+  // result so that any further reference doesn't have to evaluate the view
+  // again.
+  struct MaterializedView {
+    enum class State {
+      // Backed by a SQLite view: will be materialized on the next reference.
+      kPending,
+      // Currently being materialized.
+      kMaterializing,
+      // Backed by a runtime table.
+      kMaterialized,
+      // Materializing failed (e.g. because of an unsupported column type):
+      // the view stays a SQLite view.
+      kFailed,
+    };
+    std::string name;
+    std::string create_view_sql;
+    SqlSource sql;
+    State state = State::kPending;
+  };
+
   base::StatusOr<SqlSource> ExecuteCreateFunction(
       const PerfettoSqlParser::CreateFunction&);
 
+  base::Status ExecuteCreateIndex(const PerfettoSqlParser::CreateIndex&);
+
+  base::Status ExecuteDropIndex(const PerfettoSqlParser::DropIndex&);
+
+  base::Status ExecuteCreateMaterializedView(
+      const PerfettoSqlParser::CreateMaterializedView&);
+
+  // Materializes all the pending materialized views referenced by |sql|.
+  base::Status MaterializeReferencedViews(const SqlSource& sql);
+
+  base::Status MaterializeView(MaterializedView*);
+
+  // Executes |sql| directly with SQLite, bypassing all PerfettoSQL handling.
+  base::Status ExecuteSqliteOnly(const std::string& sql);
+
   // Registers a SQL-defined trace processor C++ table with SQLite.
   base::Status RegisterRuntimeTable(std::string name, SqlSource sql);
 
   std::unique_ptr<QueryCache> query_cache_;
+  std::unique_ptr<TableIndexes> table_indexes_;
   StringPool* pool_ = nullptr;
   base::FlatHashMap<std::string, std::unique_ptr<RuntimeTableFunction::State>>
       runtime_table_fn_states_;
   base::FlatHashMap<std::string, std::unique_ptr<RuntimeTable>> runtime_tables_;
+  base::FlatHashMap<std::string, const Table*> static_tables_;
+  base::FlatHashMap<std::string, std::function<void()>> static_table_prepares_;
+  // Keyed by the lowercased name of the view.
+  base::FlatHashMap<std::string, MaterializedView> materialized_views_;
+  uint64_t statement_generation_ = 0;
   std::unique_ptr<SqliteEngine> engine_;
 };
 
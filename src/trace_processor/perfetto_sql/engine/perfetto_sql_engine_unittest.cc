@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/perfetto_sql/engine/perfetto_sql_engine.h"
 
+#include "src/trace_processor/sqlite/query_profiler.h"
 #include "src/trace_processor/sqlite/sql_source.h"
 #include "test/gtest_and_gmock.h"
 
@@ -59,6 +60,45 @@ TEST_F(PerfettoSqlEngineTest, CreatePerfettoFunctionError) {
   ASSERT_FALSE(res.ok());
 }
 
+TEST_F(PerfettoSqlEngineTest, CreatePerfettoFunctionMultipleRows) {
+  auto res = engine_.ExecuteUntilLastStatement(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO FUNCTION foo(x INT) RETURNS INT AS "
+      "select $x UNION ALL select $x + 1;"
+      "SELECT foo(1)"));
+  ASSERT_FALSE(res.ok());
+  ASSERT_THAT(res.status().message(), testing::HasSubstr("multiple values"));
+}
+
+TEST_F(PerfettoSqlEngineTest, CreatePerfettoFunctionLookupCache) {
+  auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE TABLE t(k INT, v INT);"
+      "INSERT INTO t VALUES (1, 10), (2, 20);"
+      "CREATE PERFETTO FUNCTION lookup(k INT) RETURNS INT AS "
+      "select v FROM t WHERE k = $k"));
+  ASSERT_TRUE(res.ok());
+
+  // Results cached while running a statement must not leak into the following
+  // statements: the second query needs to see the updated table.
+  const char kQuery[] =
+      "WITH RECURSIVE c(k) AS (SELECT 0 UNION ALL SELECT k + 1 FROM c LIMIT "
+      "100) SELECT SUM(lookup(k % 2 + 1)) FROM c";
+  auto query =
+      engine_.ExecuteUntilLastStatement(SqlSource::FromExecuteQuery(kQuery));
+  ASSERT_TRUE(query.ok());
+  ASSERT_EQ(sqlite3_column_int64(query->stmt.sqlite_stmt(), 0), 1500);
+  ASSERT_FALSE(query->stmt.Step());
+
+  res = engine_.Execute(
+      SqlSource::FromExecuteQuery("UPDATE t SET v = v + 1"));
+  ASSERT_TRUE(res.ok());
+
+  query =
+      engine_.ExecuteUntilLastStatement(SqlSource::FromExecuteQuery(kQuery));
+  ASSERT_TRUE(query.ok());
+  ASSERT_EQ(sqlite3_column_int64(query->stmt.sqlite_stmt(), 0), 1600);
+  ASSERT_FALSE(query->stmt.Step());
+}
+
 TEST_F(PerfettoSqlEngineTest, CreatePerfettoTableSmoke) {
   auto res = engine_.Execute(SqlSource::FromExecuteQuery(
       "CREATE PERFETTO TABLE foo AS SELECT 42 AS bar"));
@@ -109,6 +149,202 @@ TEST_F(PerfettoSqlEngineTest, CreateTableFunctionDupe) {
   ASSERT_TRUE(res.ok());
 }
 
+TEST_F(PerfettoSqlEngineTest, CreateTableFunctionConcurrentCursors) {
+  auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO FUNCTION foo(x INT) RETURNS TABLE(y INT) AS "
+      "select $x + 1 AS y"));
+  ASSERT_TRUE(res.ok());
+
+  // Run the query several times so that the statements given back by the
+  // cursors of the previous runs are reused.
+  for (int i = 0; i < 3; ++i) {
+    auto query = engine_.ExecuteUntilLastStatement(SqlSource::FromExecuteQuery(
+        "SELECT a.y + b.y FROM foo(1) a JOIN foo(10) b"));
+    ASSERT_TRUE(query.ok());
+    ASSERT_FALSE(query->stmt.IsDone());
+    ASSERT_EQ(sqlite3_column_int64(query->stmt.sqlite_stmt(), 0), 13);
+    ASSERT_FALSE(query->stmt.Step());
+  }
+}
+
+TEST_F(PerfettoSqlEngineTest, CreatePerfettoIndex) {
+  auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS SELECT 3 AS x UNION ALL SELECT 1 "
+      "UNION ALL SELECT 2 UNION ALL SELECT 1"));
+  ASSERT_TRUE(res.ok());
+
+  res = engine_.Execute(
+      SqlSource::FromExecuteQuery("CREATE PERFETTO INDEX foo_x ON foo(x)"));
+  ASSERT_TRUE(res.ok()) << res.status().c_message();
+
+  auto query = engine_.ExecuteUntilLastStatement(
+      SqlSource::FromExecuteQuery("SELECT COUNT(*) FROM foo WHERE x = 1"));
+  ASSERT_TRUE(query.ok());
+  ASSERT_EQ(sqlite3_column_int64(query->stmt.sqlite_stmt(), 0), 2);
+
+  query = engine_.ExecuteUntilLastStatement(
+      SqlSource::FromExecuteQuery("SELECT x FROM foo WHERE x > 1 ORDER BY x"));
+  ASSERT_TRUE(query.ok());
+  ASSERT_EQ(sqlite3_column_int64(query->stmt.sqlite_stmt(), 0), 2);
+  ASSERT_TRUE(query->stmt.Step());
+  ASSERT_EQ(sqlite3_column_int64(query->stmt.sqlite_stmt(), 0), 3);
+  ASSERT_FALSE(query->stmt.Step());
+
+  res = engine_.Execute(
+      SqlSource::FromExecuteQuery("CREATE PERFETTO INDEX foo_x ON foo(x)"));
+  ASSERT_FALSE(res.ok());
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE OR REPLACE PERFETTO INDEX foo_x ON foo(x)"));
+  ASSERT_TRUE(res.ok());
+
+  res = engine_.Execute(
+      SqlSource::FromExecuteQuery("DROP PERFETTO INDEX foo_x ON foo"));
+  ASSERT_TRUE(res.ok());
+
+  res = engine_.Execute(
+      SqlSource::FromExecuteQuery("DROP PERFETTO INDEX foo_x ON foo"));
+  ASSERT_FALSE(res.ok());
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery("DROP TABLE foo"));
+  ASSERT_TRUE(res.ok());
+}
+
+TEST_F(PerfettoSqlEngineTest, CreatePerfettoIndexError) {
+  auto res = engine_.Execute(
+      SqlSource::FromExecuteQuery("CREATE PERFETTO INDEX foo_x ON foo(x)"));
+  ASSERT_FALSE(res.ok());
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS SELECT 1 AS x, 2 AS y"));
+  ASSERT_TRUE(res.ok());
+
+  res = engine_.Execute(
+      SqlSource::FromExecuteQuery("CREATE PERFETTO INDEX foo_z ON foo(z)"));
+  ASSERT_FALSE(res.ok());
+
+  res = engine_.Execute(
+      SqlSource::FromExecuteQuery("CREATE PERFETTO INDEX foo_xy ON foo(x, y)"));
+  ASSERT_FALSE(res.ok());
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery("DROP TABLE foo"));
+  ASSERT_TRUE(res.ok());
+}
+
+TEST_F(PerfettoSqlEngineTest, InterruptQuery) {
+  engine_.sqlite_engine()->BeginQuery(QueryBudget());
+  auto res = engine_.ExecuteUntilLastStatement(SqlSource::FromExecuteQuery(
+      "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) "
+      "SELECT x FROM c"));
+  ASSERT_TRUE(res.ok());
+  ASSERT_TRUE(res->stmt.Step());
+
+  engine_.sqlite_engine()->Interrupt();
+  ASSERT_FALSE(res->stmt.Step());
+  ASSERT_THAT(res->stmt.status().message(),
+              testing::HasSubstr("Query interrupted"));
+}
+
+TEST_F(PerfettoSqlEngineTest, QueryProfile) {
+  auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS "
+      "WITH RECURSIVE c(x) AS ("
+      "  SELECT 0 UNION ALL SELECT x + 1 FROM c LIMIT 10"
+      ") "
+      "SELECT x FROM c"));
+  ASSERT_TRUE(res.ok()) << res.status().c_message();
+
+  QueryProfiler profiler;
+  engine_.sqlite_engine()->BeginQuery(QueryBudget(), &profiler);
+  auto it = engine_.ExecuteUntilLastStatement(
+      SqlSource::FromExecuteQuery("SELECT x FROM foo WHERE x >= 6"));
+  ASSERT_TRUE(it.ok()) << it.status().c_message();
+  while (it->stmt.Step()) {
+  }
+  ASSERT_TRUE(it->stmt.status().ok());
+  engine_.sqlite_engine()->EndProfiling(&profiler);
+
+  const auto& scans = profiler.profile().table_scans;
+  ASSERT_EQ(scans.size(), 1u);
+  ASSERT_EQ(scans[0].table_name, "foo");
+  ASSERT_EQ(scans[0].plan, "x >=");
+  ASSERT_EQ(scans[0].filter_count, 1u);
+  ASSERT_EQ(scans[0].rows_examined, 10u);
+  ASSERT_EQ(scans[0].rows_returned, 4u);
+  ASSERT_EQ(scans[0].column_count, 4u);
+}
+
+TEST_F(PerfettoSqlEngineTest, QueryWallTimeBudget) {
+  QueryBudget budget;
+  budget.max_wall_time_ms = 10;
+  engine_.sqlite_engine()->BeginQuery(budget);
+  auto res = engine_.ExecuteUntilLastStatement(SqlSource::FromExecuteQuery(
+      "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) "
+      "SELECT COUNT(*) FROM c"));
+  ASSERT_FALSE(res.ok());
+  ASSERT_THAT(res.status().message(),
+              testing::HasSubstr("wall time budget (10 ms)"));
+
+  // The next query starts with a fresh budget.
+  engine_.sqlite_engine()->BeginQuery(QueryBudget());
+  res = engine_.ExecuteUntilLastStatement(
+      SqlSource::FromExecuteQuery("SELECT 1"));
+  ASSERT_TRUE(res.ok());
+}
+
+TEST_F(PerfettoSqlEngineTest, QueryMemoryBudget) {
+  QueryBudget budget;
+  budget.max_sqlite_memory_bytes = 1024 * 1024;
+  engine_.sqlite_engine()->BeginQuery(budget);
+
+  // Sorting requires SQLite to keep all the rows in memory.
+  auto res = engine_.ExecuteUntilLastStatement(SqlSource::FromExecuteQuery(
+      "WITH RECURSIVE c(x) AS ("
+      "  SELECT 1 UNION ALL SELECT x + 1 FROM c LIMIT 10000000"
+      ") "
+      "SELECT x FROM c ORDER BY x DESC"));
+  ASSERT_FALSE(res.ok());
+  ASSERT_THAT(res.status().message(), testing::HasSubstr("memory budget"));
+}
+
+TEST_F(PerfettoSqlEngineTest, CreatePerfettoMaterializedView) {
+  auto res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "CREATE PERFETTO TABLE foo AS SELECT 1 AS x;"
+      "CREATE PERFETTO MATERIALIZED VIEW bar AS SELECT x + 1 AS y FROM foo;"
+      "CREATE PERFETTO MATERIALIZED VIEW baz AS SELECT y * 2 AS z FROM bar"));
+  ASSERT_TRUE(res.ok());
+
+  // Nothing is computed until the views are referenced.
+  ASSERT_EQ(engine_.FindTable("bar"), nullptr);
+  ASSERT_EQ(engine_.FindTable("baz"), nullptr);
+
+  auto query = engine_.ExecuteUntilLastStatement(
+      SqlSource::FromExecuteQuery("SELECT z FROM baz"));
+  ASSERT_TRUE(query.ok());
+  ASSERT_FALSE(query->stmt.IsDone());
+  ASSERT_EQ(sqlite3_column_int64(query->stmt.sqlite_stmt(), 0), 4);
+  ASSERT_FALSE(query->stmt.Step());
+  ASSERT_NE(engine_.FindTable("bar"), nullptr);
+  ASSERT_NE(engine_.FindTable("baz"), nullptr);
+
+  // After invalidation, the views are computed again on the next reference.
+  engine_.InvalidateMaterializedViews();
+  ASSERT_EQ(engine_.FindTable("bar"), nullptr);
+  ASSERT_EQ(engine_.FindTable("baz"), nullptr);
+
+  query = engine_.ExecuteUntilLastStatement(
+      SqlSource::FromExecuteQuery("SELECT y FROM bar"));
+  ASSERT_TRUE(query.ok());
+  ASSERT_EQ(sqlite3_column_int64(query->stmt.sqlite_stmt(), 0), 2);
+  ASSERT_FALSE(query->stmt.Step());
+  ASSERT_NE(engine_.FindTable("bar"), nullptr);
+  ASSERT_EQ(engine_.FindTable("baz"), nullptr);
+
+  res = engine_.Execute(SqlSource::FromExecuteQuery(
+      "DROP VIEW baz; DROP TABLE bar; DROP TABLE foo"));
+  ASSERT_TRUE(res.ok());
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
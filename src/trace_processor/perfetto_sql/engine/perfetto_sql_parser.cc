@@ -41,6 +41,8 @@ enum class State {
   kCreateOrReplace,
   kCreateOrReplacePerfetto,
   kCreatePerfetto,
+  kDrop,
+  kDropPerfetto,
   kPassthrough,
 };
 
@@ -104,8 +106,13 @@ bool PerfettoSqlParser::Next() {
       case State::kPassthrough:
         break;
       case State::kStmtStart:
-        state = TokenIsSqliteKeyword("create", token) ? State::kCreate
-                                                      : State::kPassthrough;
+        if (TokenIsSqliteKeyword("create", token)) {
+          state = State::kCreate;
+        } else if (TokenIsSqliteKeyword("drop", token)) {
+          state = State::kDrop;
+        } else {
+          state = State::kPassthrough;
+        }
         break;
       case State::kCreate:
         if (TokenIsSqliteKeyword("trigger", token)) {
@@ -133,7 +140,7 @@ bool PerfettoSqlParser::Next() {
                     : State::kPassthrough;
         break;
       case State::kCreateOrReplacePerfetto:
-      case State::kCreatePerfetto:
+      case State::kCreatePerfetto: {
         if (TokenIsCustomKeyword("function", token)) {
           return ParseCreatePerfettoFunction(state ==
                                              State::kCreateOrReplacePerfetto);
@@ -141,11 +148,32 @@ bool PerfettoSqlParser::Next() {
         if (TokenIsSqliteKeyword("table", token)) {
           return ParseCreatePerfettoTable();
         }
+        if (TokenIsSqliteKeyword("index", token)) {
+          return ParseCreatePerfettoIndex(
+              state == State::kCreateOrReplacePerfetto, *first_non_space_token);
+        }
+        if (TokenIsSqliteKeyword("materialized", token)) {
+          return ParseCreatePerfettoMaterializedView();
+        }
+        base::StackString<1024> err(
+            "Expected 'FUNCTION', 'TABLE', 'INDEX' or 'MATERIALIZED VIEW' "
+            "after 'CREATE PERFETTO', received '%*s'.",
+            static_cast<int>(token.str.size()), token.str.data());
+        return ErrorAtToken(token, err.c_str());
+      }
+      case State::kDrop:
+        state = TokenIsCustomKeyword("perfetto", token) ? State::kDropPerfetto
+                                                        : State::kPassthrough;
+        break;
+      case State::kDropPerfetto: {
+        if (TokenIsSqliteKeyword("index", token)) {
+          return ParseDropPerfettoIndex(*first_non_space_token);
+        }
         base::StackString<1024> err(
-            "Expected 'FUNCTION' or 'TABLE' after 'CREATE PERFETTO', received "
-            "'%*s'.",
+            "Expected 'INDEX' after 'DROP PERFETTO', received '%.*s'.",
             static_cast<int>(token.str.size()), token.str.data());
         return ErrorAtToken(token, err.c_str());
+      }
     }
   }
 }
@@ -175,6 +203,138 @@ bool PerfettoSqlParser::ParseCreatePerfettoTable() {
   return true;
 }
 
+bool PerfettoSqlParser::ParseCreatePerfettoMaterializedView() {
+  if (Token view = tokenizer_.NextNonWhitespace();
+      !TokenIsSqliteKeyword("view", view)) {
+    base::StackString<1024> err(
+        "Expected 'VIEW' after 'MATERIALIZED', received '%.*s'.",
+        static_cast<int>(view.str.size()), view.str.data());
+    return ErrorAtToken(view, err.c_str());
+  }
+
+  Token view_name = tokenizer_.NextNonWhitespace();
+  if (view_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid view name %.*s",
+                                static_cast<int>(view_name.str.size()),
+                                view_name.str.data());
+    return ErrorAtToken(view_name, err.c_str());
+  }
+  std::string name(view_name.str);
+
+  if (Token as = tokenizer_.NextNonWhitespace();
+      !TokenIsSqliteKeyword("as", as)) {
+    base::StackString<1024> err(
+        "Expected 'AS' after view name, received '%.*s'.",
+        static_cast<int>(as.str.size()), as.str.data());
+    return ErrorAtToken(as, err.c_str());
+  }
+
+  Token first = tokenizer_.NextNonWhitespace();
+  statement_ = CreateMaterializedView{
+      std::move(name), tokenizer_.Substr(first, tokenizer_.NextTerminal())};
+  return true;
+}
+
+bool PerfettoSqlParser::ParseCreatePerfettoIndex(bool replace,
+                                                 const Token& first_token) {
+  Token index_name = tokenizer_.NextNonWhitespace();
+  if (index_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid index name %.*s",
+                                static_cast<int>(index_name.str.size()),
+                                index_name.str.data());
+    return ErrorAtToken(index_name, err.c_str());
+  }
+  std::string name(index_name.str);
+
+  if (Token on = tokenizer_.NextNonWhitespace();
+      !TokenIsSqliteKeyword("on", on)) {
+    base::StackString<1024> err(
+        "Expected 'ON' after index name, received '%.*s'.",
+        static_cast<int>(on.str.size()), on.str.data());
+    return ErrorAtToken(on, err.c_str());
+  }
+
+  Token table_name = tokenizer_.NextNonWhitespace();
+  if (table_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid table name %.*s",
+                                static_cast<int>(table_name.str.size()),
+                                table_name.str.data());
+    return ErrorAtToken(table_name, err.c_str());
+  }
+  std::string table(table_name.str);
+
+  // TK_LP == '(' (i.e. left parenthesis).
+  if (Token lp = tokenizer_.NextNonWhitespace();
+      lp.token_type != SqliteTokenType::TK_LP) {
+    return ErrorAtToken(lp, "Malformed index definition: '(' expected");
+  }
+
+  std::vector<std::string> cols;
+  for (;;) {
+    Token col = tokenizer_.NextNonWhitespace();
+    if (col.token_type != SqliteTokenType::TK_ID) {
+      base::StackString<1024> err("Invalid column name %.*s",
+                                  static_cast<int>(col.str.size()),
+                                  col.str.data());
+      return ErrorAtToken(col, err.c_str());
+    }
+    cols.emplace_back(col.str);
+
+    Token sep = tokenizer_.NextNonWhitespace();
+    if (sep.token_type == SqliteTokenType::TK_RP) {
+      break;
+    }
+    if (sep.token_type != SqliteTokenType::TK_COMMA) {
+      return ErrorAtToken(sep, "Malformed index definition: ')' expected");
+    }
+  }
+
+  Token terminal = tokenizer_.NextNonWhitespace();
+  if (!terminal.IsTerminal()) {
+    return ErrorAtToken(terminal, "Expected end of statement");
+  }
+  statement_ = CreateIndex{replace, std::move(name), std::move(table),
+                           std::move(cols),
+                           tokenizer_.Substr(first_token, terminal)};
+  return true;
+}
+
+bool PerfettoSqlParser::ParseDropPerfettoIndex(const Token& first_token) {
+  Token index_name = tokenizer_.NextNonWhitespace();
+  if (index_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid index name %.*s",
+                                static_cast<int>(index_name.str.size()),
+                                index_name.str.data());
+    return ErrorAtToken(index_name, err.c_str());
+  }
+  std::string name(index_name.str);
+
+  if (Token on = tokenizer_.NextNonWhitespace();
+      !TokenIsSqliteKeyword("on", on)) {
+    base::StackString<1024> err(
+        "Expected 'ON' after index name, received '%.*s'.",
+        static_cast<int>(on.str.size()), on.str.data());
+    return ErrorAtToken(on, err.c_str());
+  }
+
+  Token table_name = tokenizer_.NextNonWhitespace();
+  if (table_name.token_type != SqliteTokenType::TK_ID) {
+    base::StackString<1024> err("Invalid table name %.*s",
+                                static_cast<int>(table_name.str.size()),
+                                table_name.str.data());
+    return ErrorAtToken(table_name, err.c_str());
+  }
+  std::string table(table_name.str);
+
+  Token terminal = tokenizer_.NextNonWhitespace();
+  if (!terminal.IsTerminal()) {
+    return ErrorAtToken(terminal, "Expected end of statement");
+  }
+  statement_ = DropIndex{std::move(name), std::move(table),
+                         tokenizer_.Substr(first_token, terminal)};
+  return true;
+}
+
 bool PerfettoSqlParser::ParseCreatePerfettoFunction(bool replace) {
   std::string prototype;
   Token function_name = tokenizer_.NextNonWhitespace();
@@ -17,8 +17,10 @@
 #ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_ENGINE_PERFETTO_SQL_PARSER_H_
 #define SRC_TRACE_PROCESSOR_PERFETTO_SQL_ENGINE_PERFETTO_SQL_PARSER_H_
 
+#include <string>
 #include <string_view>
 #include <variant>
+#include <vector>
 
 #include "perfetto/ext/base/status_or.h"
 #include "src/trace_processor/sqlite/sql_source.h"
@@ -59,7 +61,34 @@ class PerfettoSqlParser {
     std::string name;
     SqlSource sql;
   };
-  using Statement = std::variant<SqliteSql, CreateFunction, CreateTable>;
+  // Indicates that the specified SQL was a CREATE PERFETTO MATERIALIZED VIEW
+  // statement with the following parameters.
+  struct CreateMaterializedView {
+    std::string name;
+    SqlSource sql;
+  };
+  // Indicates that the specified SQL was a CREATE PERFETTO INDEX statement
+  // with the following parameters.
+  struct CreateIndex {
+    bool replace;
+    std::string name;
+    std::string table_name;
+    std::vector<std::string> col_names;
+    SqlSource sql;
+  };
+  // Indicates that the specified SQL was a DROP PERFETTO INDEX statement with
+  // the following parameters.
+  struct DropIndex {
+    std::string name;
+    std::string table_name;
+    SqlSource sql;
+  };
+  using Statement = std::variant<SqliteSql,
+                                 CreateFunction,
+                                 CreateTable,
+                                 CreateMaterializedView,
+                                 CreateIndex,
+                                 DropIndex>;
 
   // Creates a new SQL parser with the a block of PerfettoSQL statements.
   // Concretely, the passed string can contain >1 statement.
@@ -93,6 +122,12 @@ class PerfettoSqlParser {
 
   bool ParseCreatePerfettoTable();
 
+  bool ParseCreatePerfettoMaterializedView();
+
+  bool ParseCreatePerfettoIndex(bool replace, const SqliteTokenizer::Token&);
+
+  bool ParseDropPerfettoIndex(const SqliteTokenizer::Token&);
+
   bool ParseArgumentDefinitions(std::string*);
 
   bool ErrorAtToken(const SqliteTokenizer::Token&, const char* error);
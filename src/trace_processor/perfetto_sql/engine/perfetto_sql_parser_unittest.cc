@@ -32,6 +32,9 @@ using Result = PerfettoSqlParser::Statement;
 using SqliteSql = PerfettoSqlParser::SqliteSql;
 using CreateFn = PerfettoSqlParser::CreateFunction;
 using CreateTable = PerfettoSqlParser::CreateTable;
+using CreateMaterializedView = PerfettoSqlParser::CreateMaterializedView;
+using CreateIndex = PerfettoSqlParser::CreateIndex;
+using DropIndex = PerfettoSqlParser::DropIndex;
 
 inline bool operator==(const SqlSource& a, const SqlSource& b) {
   return a.sql() == b.sql();
@@ -50,6 +53,21 @@ inline bool operator==(const CreateTable& a, const CreateTable& b) {
   return std::tie(a.name, a.sql) == std::tie(b.name, b.sql);
 }
 
+inline bool operator==(const CreateMaterializedView& a,
+                       const CreateMaterializedView& b) {
+  return std::tie(a.name, a.sql) == std::tie(b.name, b.sql);
+}
+
+inline bool operator==(const CreateIndex& a, const CreateIndex& b) {
+  return std::tie(a.replace, a.name, a.table_name, a.col_names, a.sql) ==
+         std::tie(b.replace, b.name, b.table_name, b.col_names, b.sql);
+}
+
+inline bool operator==(const DropIndex& a, const DropIndex& b) {
+  return std::tie(a.name, a.table_name, a.sql) ==
+         std::tie(b.name, b.table_name, b.sql);
+}
+
 namespace {
 
 SqlSource FindSubstr(const SqlSource& source, const std::string& needle) {
@@ -146,6 +164,67 @@ TEST_F(PerfettoSqlParserTest, CreatePerfettoFunctionAndOther) {
                                    SqliteSql{FindSubstr(res, "select foo()")}));
 }
 
+TEST_F(PerfettoSqlParserTest, CreatePerfettoMaterializedView) {
+  auto res = SqlSource::FromExecuteQuery(
+      "create perfetto materialized view foo as select * from slice; select 1");
+  ASSERT_THAT(*Parse(res),
+              testing::ElementsAre(
+                  CreateMaterializedView{
+                      "foo", FindSubstr(res, "select * from slice")},
+                  SqliteSql{FindSubstr(res, "select 1")}));
+
+  res = SqlSource::FromExecuteQuery(
+      "create perfetto materialized foo as select 1");
+  ASSERT_FALSE(Parse(res).status().ok());
+
+  res = SqlSource::FromExecuteQuery(
+      "create perfetto materialized view foo select 1");
+  ASSERT_FALSE(Parse(res).status().ok());
+}
+
+TEST_F(PerfettoSqlParserTest, CreatePerfettoIndex) {
+  auto res = SqlSource::FromExecuteQuery(
+      "create perfetto index foo_idx on foo(bar); select 1");
+  ASSERT_THAT(*Parse(res),
+              testing::ElementsAre(
+                  CreateIndex{false, "foo_idx", "foo", {"bar"},
+                              FindSubstr(res, "create perfetto index foo_idx "
+                                              "on foo(bar)")},
+                  SqliteSql{FindSubstr(res, "select 1")}));
+
+  res = SqlSource::FromExecuteQuery(
+      "CREATE OR REPLACE PERFETTO INDEX foo_idx ON foo(bar, baz)");
+  ASSERT_THAT(*Parse(res),
+              testing::ElementsAre(CreateIndex{
+                  true, "foo_idx", "foo", {"bar", "baz"}, res}));
+}
+
+TEST_F(PerfettoSqlParserTest, CreatePerfettoIndexError) {
+  auto res =
+      SqlSource::FromExecuteQuery("create perfetto index foo_idx foo(bar)");
+  ASSERT_FALSE(Parse(res).status().ok());
+
+  res = SqlSource::FromExecuteQuery("create perfetto index foo_idx on foo()");
+  ASSERT_FALSE(Parse(res).status().ok());
+
+  res = SqlSource::FromExecuteQuery("create perfetto index foo_idx on foo(bar");
+  ASSERT_FALSE(Parse(res).status().ok());
+}
+
+TEST_F(PerfettoSqlParserTest, DropPerfettoIndex) {
+  auto res = SqlSource::FromExecuteQuery(
+      "drop perfetto index foo_idx on foo; select 1");
+  ASSERT_THAT(*Parse(res),
+              testing::ElementsAre(
+                  DropIndex{"foo_idx", "foo",
+                            FindSubstr(res, "drop perfetto index foo_idx "
+                                            "on foo")},
+                  SqliteSql{FindSubstr(res, "select 1")}));
+
+  res = SqlSource::FromExecuteQuery("drop perfetto index foo_idx");
+  ASSERT_FALSE(Parse(res).status().ok());
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
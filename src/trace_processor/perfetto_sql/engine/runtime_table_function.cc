@@ -109,17 +109,16 @@ int RuntimeTableFunction::BestIndex(const QueryConstraints& qc,
 
 RuntimeTableFunction::Cursor::Cursor(RuntimeTableFunction* table, State* state)
     : SqliteTable::BaseCursor(table), table_(table), state_(state) {
-  if (state->reusable_stmt) {
-    stmt_ = std::move(state->reusable_stmt);
-    state->reusable_stmt = std::nullopt;
-    return_stmt_to_state_ = true;
+  if (!state->reusable_stmts.empty()) {
+    stmt_ = std::move(state->reusable_stmts.back());
+    state->reusable_stmts.pop_back();
   }
 }
 
 RuntimeTableFunction::Cursor::~Cursor() {
-  if (return_stmt_to_state_) {
+  if (stmt_) {
     ResetStatement(stmt_->sqlite_stmt());
-    state_->reusable_stmt = std::move(stmt_);
+    state_->reusable_stmts.push_back(std::move(*stmt_));
   }
 }
 
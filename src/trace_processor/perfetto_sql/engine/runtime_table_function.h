@@ -18,6 +18,7 @@
 #define SRC_TRACE_PROCESSOR_PERFETTO_SQL_ENGINE_RUNTIME_TABLE_FUNCTION_H_
 
 #include <optional>
+#include <vector>
 
 #include "src/trace_processor/perfetto_sql/engine/function_util.h"
 #include "src/trace_processor/sqlite/sqlite_engine.h"
@@ -42,7 +43,12 @@ class RuntimeTableFunction final
     Prototype prototype;
     std::vector<sql_argument::ArgumentDefinition> return_values;
 
-    std::optional<SqliteEngine::PreparedStatement> reusable_stmt;
+    // Statements for |sql_defn_str| which are not used by any cursor. Cursors
+    // take a statement from here when they are created and give it back when
+    // they are destroyed so the SQL definition is only prepared again when
+    // several cursors are open at the same time (e.g. when the function is
+    // called recursively or several times in the same query).
+    std::vector<SqliteEngine::PreparedStatement> reusable_stmts;
 
     bool IsReturnValueColumn(size_t i) const {
       PERFETTO_DCHECK(i < TotalColumnCount());
@@ -83,7 +89,6 @@ class RuntimeTableFunction final
     State* state_ = nullptr;
 
     std::optional<SqliteEngine::PreparedStatement> stmt_;
-    bool return_stmt_to_state_ = false;
 
     bool is_eof_ = false;
     int next_call_count_ = 0;
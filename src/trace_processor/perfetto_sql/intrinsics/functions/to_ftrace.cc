@@ -565,6 +565,7 @@ SystraceSerializer::SystraceSerializer(TraceProcessorContext* context)
 
 SystraceSerializer::ScopedCString SystraceSerializer::SerializeToString(
     uint32_t raw_row) {
+  storage_->DecodeLazyArgs();
   const auto& raw = storage_->raw_table();
 
   char line[4096];
@@ -21,6 +21,7 @@
 
 #include <algorithm>
 #include <set>
+#include <tuple>
 #include <utility>
 
 #include "perfetto/base/logging.h"
@@ -28,6 +29,8 @@
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/string_view.h"
+#include "src/trace_processor/db/query_executor.h"
+#include "src/trace_processor/db/table.h"
 #include "src/trace_processor/perfetto_sql/engine/perfetto_sql_engine.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 #include "src/trace_processor/tp_metatrace.h"
@@ -105,6 +108,67 @@ std::string EscapedSqliteValueAsString(sqlite3_value* value) {
   }
 }
 
+// A row of one of the tables of a natively computed span join.
+struct NativeSlice {
+  int64_t partition;
+  int64_t ts;
+  int64_t ts_end;
+  uint32_t row;
+};
+
+// Returns the end of the slice, adjusted like Query::AdjustedTsEnd.
+int64_t AdjustedTsEnd(const NativeSlice& slice) {
+  return slice.ts_end - slice.ts == -1 ? slice.ts : slice.ts_end;
+}
+
+// Reads the slices of |table| in the order in which the SQLite query created
+// by Query::CreateSqlQuery would return them: sorted by partition and ts.
+// Like in Query::CursorNext, rows with a null partition are skipped.
+std::vector<NativeSlice> ReadNativeSlices(
+    const Table& table,
+    const SpanJoinOperatorTable::TableDefinition& defn,
+    const std::vector<uint32_t>& col_idx) {
+  const Column& ts_col = table.columns()[col_idx[defn.ts_idx()]];
+  const Column& dur_col = table.columns()[col_idx[defn.dur_idx()]];
+  const Column* partition_col =
+      defn.IsPartitioned() ? &table.columns()[col_idx[defn.partition_idx()]]
+                           : nullptr;
+
+  std::vector<NativeSlice> slices;
+  slices.reserve(table.row_count());
+  for (uint32_t row = 0; row < table.row_count(); ++row) {
+    int64_t partition = 0;
+    if (partition_col) {
+      SqlValue value = partition_col->Get(row);
+      if (value.is_null())
+        continue;
+      partition = value.AsLong();
+    }
+    // sqlite3_column_int64 returns 0 for nulls.
+    SqlValue ts = ts_col.Get(row);
+    SqlValue dur = dur_col.Get(row);
+    int64_t ts_value = ts.is_null() ? 0 : ts.AsLong();
+    int64_t dur_value = dur.is_null() ? 0 : dur.AsLong();
+    slices.push_back({partition, ts_value, ts_value + dur_value, row});
+  }
+  std::sort(slices.begin(), slices.end(),
+            [](const NativeSlice& a, const NativeSlice& b) {
+              return std::tie(a.partition, a.ts, a.row) <
+                     std::tie(b.partition, b.ts, b.row);
+            });
+  return slices;
+}
+
+// Returns the end of the partition of |slices| starting at |begin|.
+size_t PartitionEnd(const std::vector<NativeSlice>& slices, size_t begin) {
+  size_t end = begin;
+  while (end < slices.size() &&
+         slices[end].partition == slices[begin].partition) {
+    ++end;
+  }
+  return end;
+}
+
 }  // namespace
 
 SpanJoinOperatorTable::SpanJoinOperatorTable(sqlite3*,
@@ -406,6 +470,11 @@ base::Status SpanJoinOperatorTable::Cursor::Filter(const QueryConstraints& qc,
                                                    FilterHistory) {
   PERFETTO_TP_TRACE(metatrace::Category::QUERY, "SPAN_JOIN_XFILTER");
 
+  native_ = false;
+  native_partitions_.clear();
+  if (FilterNative(qc, argv))
+    return base::OkStatus();
+
   bool t1_partitioned_mixed =
       t1_.definition()->IsPartitioned() &&
       table_->partitioning_ == PartitioningType::kMixedPartitioning;
@@ -426,10 +495,144 @@ base::Status SpanJoinOperatorTable::Cursor::Filter(const QueryConstraints& qc,
 }
 
 base::Status SpanJoinOperatorTable::Cursor::Next() {
+  if (native_) {
+    ++native_span_idx_;
+    SkipEmptyNativePartitions();
+    return base::OkStatus();
+  }
   RETURN_IF_ERROR(next_query_->Next());
   return FindOverlappingSpan();
 }
 
+bool SpanJoinOperatorTable::Cursor::PrepareNativeTable(
+    const TableDefinition& defn,
+    NativeTable* native) {
+  native->table = table_->engine_->FindTable(defn.name());
+  if (!native->table)
+    return false;
+
+  native->col_idx.clear();
+  for (const SqliteTable::Column& col : defn.columns()) {
+    std::optional<uint32_t> idx =
+        native->table->GetColumnIndexByName(col.name().c_str());
+    if (!idx)
+      return false;
+    native->col_idx.push_back(*idx);
+  }
+
+  // Anything else than integers makes the SQLite query fail or convert the
+  // values: leave these cases to it.
+  std::vector<uint32_t> int_cols = {defn.ts_idx(), defn.dur_idx()};
+  if (defn.IsPartitioned())
+    int_cols.push_back(defn.partition_idx());
+  for (uint32_t col : int_cols) {
+    const auto& table_col = native->table->columns()[native->col_idx[col]];
+    if (table_col.type() != SqlValue::Type::kLong)
+      return false;
+  }
+  return true;
+}
+
+bool SpanJoinOperatorTable::Cursor::FilterNative(const QueryConstraints& qc,
+                                                 sqlite3_value** argv) {
+  // Shadows and the rewinding of the unpartitioned table in the mixed case
+  // are only implemented by the SQLite queries.
+  if (table_->IsLeftJoin() || table_->IsOuterJoin() ||
+      table_->partitioning_ == PartitioningType::kMixedPartitioning) {
+    return false;
+  }
+  if (!table_->ComputeSqlConstraintsForDefinition(table_->t1_defn_, qc, argv)
+           .empty() ||
+      !table_->ComputeSqlConstraintsForDefinition(table_->t2_defn_, qc, argv)
+           .empty()) {
+    return false;
+  }
+  if (!PrepareNativeTable(table_->t1_defn_, &t1_native_) ||
+      !PrepareNativeTable(table_->t2_defn_, &t2_native_)) {
+    return false;
+  }
+
+  PERFETTO_TP_TRACE(metatrace::Category::QUERY, "SPAN_JOIN_NATIVE");
+
+  std::vector<NativeSlice> t1;
+  std::vector<NativeSlice> t2;
+  QueryExecutor::ParallelFor(2, [&](uint32_t i) {
+    if (i == 0) {
+      t1 = ReadNativeSlices(*t1_native_.table, table_->t1_defn_,
+                            t1_native_.col_idx);
+    } else {
+      t2 = ReadNativeSlices(*t2_native_.table, table_->t2_defn_,
+                            t2_native_.col_idx);
+    }
+  });
+
+  // Only the partitions present in both tables can have overlapping spans.
+  struct PartitionRanges {
+    size_t t1_begin;
+    size_t t1_end;
+    size_t t2_begin;
+    size_t t2_end;
+  };
+  std::vector<PartitionRanges> ranges;
+  for (size_t i = 0, j = 0; i < t1.size() && j < t2.size();) {
+    if (t1[i].partition < t2[j].partition) {
+      i = PartitionEnd(t1, i);
+    } else if (t2[j].partition < t1[i].partition) {
+      j = PartitionEnd(t2, j);
+    } else {
+      size_t i_end = PartitionEnd(t1, i);
+      size_t j_end = PartitionEnd(t2, j);
+      ranges.push_back({i, i_end, j, j_end});
+      native_partitions_.push_back({t1[i].partition, {}});
+      i = i_end;
+      j = j_end;
+    }
+  }
+
+  // This steps through the slices of each partition exactly like
+  // FindOverlappingSpan steps through the queries when they don't emit
+  // shadows: the slice which finishes first is the one moved forward.
+  QueryExecutor::ParallelFor(
+      static_cast<uint32_t>(ranges.size()), [&](uint32_t p) {
+        const PartitionRanges& r = ranges[p];
+        std::vector<NativeSpan>& spans = native_partitions_[p].spans;
+        size_t i = r.t1_begin;
+        size_t j = r.t2_begin;
+        while (i < r.t1_end && j < r.t2_end) {
+          const NativeSlice& s1 = t1[i];
+          const NativeSlice& s2 = t2[j];
+          int64_t s1_end = AdjustedTsEnd(s1);
+          int64_t s2_end = AdjustedTsEnd(s2);
+          if (s1.ts == s2.ts || (s1.ts >= s2.ts && s1.ts < s2_end) ||
+              (s2.ts >= s1.ts && s2.ts < s1_end)) {
+            int64_t ts = std::max(s1.ts, s2.ts);
+            spans.push_back({ts, std::min(s1.ts_end, s2.ts_end) - ts, s1.row,
+                             s2.row});
+          }
+          if (s1_end < s2_end) {
+            ++i;
+          } else {
+            ++j;
+          }
+        }
+      });
+
+  native_ = true;
+  native_partition_idx_ = 0;
+  native_span_idx_ = 0;
+  SkipEmptyNativePartitions();
+  return true;
+}
+
+void SpanJoinOperatorTable::Cursor::SkipEmptyNativePartitions() {
+  while (native_partition_idx_ < native_partitions_.size() &&
+         native_span_idx_ >=
+             native_partitions_[native_partition_idx_].spans.size()) {
+    ++native_partition_idx_;
+    native_span_idx_ = 0;
+  }
+}
+
 bool SpanJoinOperatorTable::Cursor::IsOverlappingSpan() {
   // If either of the tables are eof, then we cannot possibly have an
   // overlapping span.
@@ -547,11 +750,48 @@ SpanJoinOperatorTable::Cursor::FindEarliestFinishQuery() {
 }
 
 bool SpanJoinOperatorTable::Cursor::Eof() {
+  if (native_)
+    return native_partition_idx_ >= native_partitions_.size();
   return t1_.IsEof() || t2_.IsEof();
 }
 
 base::Status SpanJoinOperatorTable::Cursor::Column(sqlite3_context* context,
                                                    int N) {
+  if (native_) {
+    const NativePartition& partition =
+        native_partitions_[native_partition_idx_];
+    const NativeSpan& span = partition.spans[native_span_idx_];
+    switch (N) {
+      case Column::kTimestamp:
+        sqlite3_result_int64(context, static_cast<sqlite3_int64>(span.ts));
+        return base::OkStatus();
+      case Column::kDuration:
+        sqlite3_result_int64(context, static_cast<sqlite3_int64>(span.dur));
+        return base::OkStatus();
+      case Column::kPartition:
+        if (table_->partitioning_ != PartitioningType::kNoPartitioning) {
+          sqlite3_result_int64(
+              context, static_cast<sqlite3_int64>(partition.partition));
+          return base::OkStatus();
+        }
+        break;
+      default:
+        break;
+    }
+    const auto& locator =
+        table_->global_index_to_column_locator_[static_cast<size_t>(N)];
+    bool is_t1 = locator.defn == t1_.definition();
+    const NativeTable& native = is_t1 ? t1_native_ : t2_native_;
+    uint32_t row = is_t1 ? span.t1_row : span.t2_row;
+    uint32_t col_idx = native.col_idx[locator.col_index];
+    // Strings come from the string pool so they outlive the query.
+    sqlite_utils::ReportSqlValue(context,
+                                 native.table->columns()[col_idx].Get(row),
+                                 sqlite_utils::kSqliteStatic,
+                                 sqlite_utils::kSqliteStatic);
+    return base::OkStatus();
+  }
+
   PERFETTO_DCHECK(t1_.IsReal() || t2_.IsReal());
 
   switch (N) {
@@ -40,6 +40,7 @@ namespace perfetto {
 namespace trace_processor {
 
 class PerfettoSqlEngine;
+class Table;
 
 // Implements the SPAN JOIN operation between two tables on a particular column.
 //
@@ -342,10 +343,41 @@ class SpanJoinOperatorTable final
     Cursor(Cursor&&) noexcept = default;
     Cursor& operator=(Cursor&&) = default;
 
+    // A span of the output when the join is computed natively.
+    struct NativeSpan {
+      int64_t ts;
+      int64_t dur;
+      uint32_t t1_row;
+      uint32_t t2_row;
+    };
+
+    // The output spans of a single partition when the join is computed
+    // natively.
+    struct NativePartition {
+      int64_t partition;
+      std::vector<NativeSpan> spans;
+    };
+
+    // One of the two joined tables, when the join is computed natively.
+    struct NativeTable {
+      const Table* table = nullptr;
+
+      // Index in |table| of each of the columns of the TableDefinition.
+      std::vector<uint32_t> col_idx;
+    };
+
     bool IsOverlappingSpan();
     util::Status FindOverlappingSpan();
     Query* FindEarliestFinishQuery();
 
+    // Computes the whole join up front, reading the columns of the two tables
+    // directly instead of stepping through SQLite queries on them. Returns
+    // false (and does nothing) if the join is not an inner join between two
+    // trace processor tables without constraints to push down to them.
+    bool FilterNative(const QueryConstraints& qc, sqlite3_value** argv);
+    bool PrepareNativeTable(const TableDefinition& defn, NativeTable* native);
+    void SkipEmptyNativePartitions();
+
     Query t1_;
     Query t2_;
 
@@ -354,6 +386,14 @@ class SpanJoinOperatorTable final
     // Only valid for kMixedPartition.
     int64_t last_mixed_partition_ = std::numeric_limits<int64_t>::min();
 
+    // Only valid when |native_| is true.
+    bool native_ = false;
+    NativeTable t1_native_;
+    NativeTable t2_native_;
+    std::vector<NativePartition> native_partitions_;
+    size_t native_partition_idx_ = 0;
+    size_t native_span_idx_ = 0;
+
     SpanJoinOperatorTable* table_;
   };
 
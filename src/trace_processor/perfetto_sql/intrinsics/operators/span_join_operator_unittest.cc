@@ -16,6 +16,9 @@
 
 #include "src/trace_processor/perfetto_sql/intrinsics/operators/span_join_operator.h"
 
+#include <string>
+#include <vector>
+
 #include "src/trace_processor/perfetto_sql/engine/perfetto_sql_engine.h"
 #include "src/trace_processor/sqlite/sqlite_engine.h"
 #include "test/gtest_and_gmock.h"
@@ -378,6 +381,49 @@ TEST_F(SpanJoinOperatorTableTest, CapitalizedLeftJoin) {
   ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
 }
 
+TEST_F(SpanJoinOperatorTableTest, NativeJoinMatchesSqliteJoin) {
+  // The same data as SQLite tables, which are joined through SQLite queries,
+  // and as PerfettoSQL tables, which are joined natively.
+  RunStatement("CREATE TEMP TABLE f(ts BIGINT, dur BIGINT, cpu INT, x INT);");
+  RunStatement("CREATE TEMP TABLE s(ts BIGINT, dur BIGINT, cpu INT, y TEXT);");
+  RunStatement(
+      "INSERT INTO f VALUES"
+      "(100, 10, 5, 1), (110, 50, 5, 2), (120, 100, 2, 3), (160, 10, 5, 4), "
+      "(170, -1, 5, 5), (180, 0, 5, 6), (100, 30, NULL, 7), (10, 5, 9, 8);");
+  RunStatement(
+      "INSERT INTO s VALUES"
+      "(100, 5, 5, 'a'), (105, 100, 5, 'b'), (110, 50, 2, 'c'), "
+      "(160, 100, 2, 'd'), (170, 20, 5, 'e'), (180, 5, 5, 'f'), "
+      "(0, 1000, 3, 'g');");
+  ASSERT_TRUE(engine_
+                  .Execute(SqlSource::FromExecuteQuery(
+                      "CREATE PERFETTO TABLE nf AS SELECT * FROM f;"
+                      "CREATE PERFETTO TABLE ns AS SELECT * FROM s;"))
+                  .ok());
+
+  RunStatement(
+      "CREATE VIRTUAL TABLE sp USING span_join(f PARTITIONED cpu, "
+      "s PARTITIONED cpu);");
+  RunStatement(
+      "CREATE VIRTUAL TABLE nsp USING span_join(nf PARTITIONED cpu, "
+      "ns PARTITIONED cpu);");
+
+  std::vector<std::vector<std::string>> rows[2];
+  for (int i = 0; i < 2; ++i) {
+    PrepareValidStatement(i == 0 ? "SELECT * FROM sp" : "SELECT * FROM nsp");
+    while (sqlite3_step(stmt_.get()) == SQLITE_ROW) {
+      std::vector<std::string> row;
+      for (int col = 0; col < sqlite3_column_count(stmt_.get()); ++col) {
+        const unsigned char* text = sqlite3_column_text(stmt_.get(), col);
+        row.emplace_back(text ? reinterpret_cast<const char*>(text) : "NULL");
+      }
+      rows[i].push_back(std::move(row));
+    }
+  }
+  ASSERT_FALSE(rows[0].empty());
+  ASSERT_EQ(rows[0], rows[1]);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -32,6 +32,7 @@ AncestorSliceTable::~AncestorSliceTable() = default;
 AncestorStackProfileCallsiteTable::~AncestorStackProfileCallsiteTable() =
     default;
 AncestorSliceByStackTable::~AncestorSliceByStackTable() = default;
+AncestorSliceByIdsTable::~AncestorSliceByIdsTable() = default;
 
 }  // namespace tables
 
@@ -45,6 +46,8 @@ uint32_t GetConstraintColumnIndex(Ancestor::Type type) {
       return tables::AncestorStackProfileCallsiteTable::ColumnIndex::start_id;
     case Ancestor::Type::kSliceByStack:
       return tables::AncestorSliceByStackTable::ColumnIndex::start_stack_id;
+    case Ancestor::Type::kSliceByIds:
+      return tables::AncestorSliceByIdsTable::ColumnIndex::start_ids;
   }
   PERFETTO_FATAL("For GCC");
 }
@@ -99,8 +102,13 @@ base::Status BuildAncestorsTable(typename ParentTable::Id id,
 
 }  // namespace
 
-Ancestor::Ancestor(Type type, const TraceStorage* storage)
-    : type_(type), storage_(storage) {}
+Ancestor::Ancestor(Type type,
+                   TraceStorage* storage,
+                   std::shared_ptr<SliceTreeIndex> index)
+    : type_(type), storage_(storage), index_(std::move(index)) {
+  if (!index_)
+    index_ = std::make_shared<SliceTreeIndex>(&storage_->slice_table());
+}
 
 base::Status Ancestor::ValidateConstraints(const QueryConstraints& qc) {
   const auto& cs = qc.constraints();
@@ -142,7 +150,41 @@ base::Status Ancestor::ComputeTable(const std::vector<Constraint>& cs,
         table_return = tables::AncestorSliceByStackTable::SelectAndExtendParent(
             storage_->slice_table(), {}, {});
         break;
+      case Type::kSliceByIds:
+        table_return = tables::AncestorSliceByIdsTable::SelectAndExtendParent(
+            storage_->slice_table(), {}, {}, {});
+        break;
+    }
+    return base::OkStatus();
+  }
+
+  if (type_ == Type::kSliceByIds) {
+    if (constraint_it->value.type != SqlValue::Type::kString) {
+      return base::ErrStatus("start ids should be a string.");
+    }
+    const auto& slice_table = storage_->slice_table();
+    auto start_ids =
+        ParseSliceIds(slice_table, constraint_it->value.AsString());
+    if (!start_ids.ok())
+      return start_ids.status();
+    std::vector<tables::SliceTable::RowNumber> ancestors;
+    ColumnStorage<uint32_t> start_id_column;
+    for (SliceId start_id : *start_ids) {
+      size_t prev_size = ancestors.size();
+      RETURN_IF_ERROR(GetAncestors(slice_table, start_id, ancestors));
+      for (size_t i = prev_size; i < ancestors.size(); ++i)
+        start_id_column.Append(start_id.value);
     }
+    // The hidden column must be populated because as far as SQLite is
+    // concerned this is an equality constraint.
+    ColumnStorage<StringPool::Id> start_ids_column;
+    StringPool::Id start_ids_id = storage_->InternString(
+        base::StringView(constraint_it->value.AsString()));
+    for (size_t i = 0; i < ancestors.size(); ++i)
+      start_ids_column.Append(start_ids_id);
+    table_return = tables::AncestorSliceByIdsTable::SelectAndExtendParent(
+        slice_table, std::move(ancestors), std::move(start_id_column),
+        std::move(start_ids_column));
     return base::OkStatus();
   }
   if (constraint_it->value.type != SqlValue::Type::kLong) {
@@ -165,11 +207,9 @@ base::Status Ancestor::ComputeTable(const std::vector<Constraint>& cs,
       // Find the all slice ids that have the stack id and find all the
       // ancestors of the slice ids.
       const auto& slice_table = storage_->slice_table();
-      auto it =
-          slice_table.FilterToIterator({slice_table.stack_id().eq(start_id)});
       std::vector<tables::SliceTable::RowNumber> ancestors;
-      for (; it; ++it) {
-        RETURN_IF_ERROR(GetAncestors(slice_table, it.id(), ancestors));
+      for (uint32_t row : index_->GetRowsWithStackId(start_id)) {
+        RETURN_IF_ERROR(GetAncestors(slice_table, SliceId(row), ancestors));
       }
       // Sort to keep the slices in timestamp order.
       std::sort(ancestors.begin(), ancestors.end());
@@ -177,6 +217,8 @@ base::Status Ancestor::ComputeTable(const std::vector<Constraint>& cs,
           start_id, slice_table, std::move(ancestors));
       return base::OkStatus();
     }
+    case Type::kSliceByIds:
+      PERFETTO_FATAL("Handled above");
   }
   PERFETTO_FATAL("For GCC");
 }
@@ -189,6 +231,8 @@ Table::Schema Ancestor::CreateSchema() {
       return tables::AncestorStackProfileCallsiteTable::ComputeStaticSchema();
     case Type::kSliceByStack:
       return tables::AncestorSliceByStackTable::ComputeStaticSchema();
+    case Type::kSliceByIds:
+      return tables::AncestorSliceByIdsTable::ComputeStaticSchema();
   }
   PERFETTO_FATAL("For GCC");
 }
@@ -201,6 +245,8 @@ std::string Ancestor::TableName() {
       return tables::AncestorStackProfileCallsiteTable::Name();
     case Type::kSliceByStack:
       return tables::AncestorSliceByStackTable::Name();
+    case Type::kSliceByIds:
+      return tables::AncestorSliceByIdsTable::Name();
   }
   PERFETTO_FATAL("For GCC");
 }
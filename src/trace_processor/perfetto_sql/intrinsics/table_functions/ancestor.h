@@ -17,8 +17,10 @@
 #ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_ANCESTOR_H_
 #define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_ANCESTOR_H_
 
+#include <memory>
 #include <optional>
 
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/slice_tree_index.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
 #include "src/trace_processor/storage/trace_storage.h"
 
@@ -31,13 +33,23 @@ class TraceProcessorContext;
 // * ancestor_slice
 // * experimental_ancestor_stack_profile_callsite
 // * ancestor_slice_by_stack
+// * ancestor_slice_by_ids
 //
 // See docs/analysis/trace-processor for usage.
 class Ancestor : public StaticTableFunction {
  public:
-  enum class Type { kSlice = 1, kStackProfileCallsite = 2, kSliceByStack = 3 };
+  enum class Type {
+    kSlice = 1,
+    kStackProfileCallsite = 2,
+    kSliceByStack = 3,
+    kSliceByIds = 4
+  };
 
-  Ancestor(Type type, const TraceStorage* storage);
+  // |index| can be shared with the other table functions which look up
+  // relatives of slices; a new one is created if it is null.
+  Ancestor(Type type,
+           TraceStorage* storage,
+           std::shared_ptr<SliceTreeIndex> index = nullptr);
 
   Table::Schema CreateSchema() override;
   std::string TableName() override;
@@ -56,7 +68,8 @@ class Ancestor : public StaticTableFunction {
 
  private:
   Type type_;
-  const TraceStorage* storage_ = nullptr;
+  TraceStorage* storage_ = nullptr;
+  std::shared_ptr<SliceTreeIndex> index_;
 };
 
 }  // namespace trace_processor
@@ -18,10 +18,9 @@
 
 #include <memory>
 #include <queue>
-#include <set>
+#include <vector>
 
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/ancestor.h"
-#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/descendant.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 
@@ -33,8 +32,21 @@ ConnectedFlowTable::~ConnectedFlowTable() = default;
 
 }  // namespace tables
 
-ConnectedFlow::ConnectedFlow(Mode mode, const TraceStorage* storage)
-    : mode_(mode), storage_(storage) {}
+ConnectedFlow::ConnectedFlow(Mode mode,
+                             const TraceStorage* storage,
+                             std::shared_ptr<SliceTreeIndex> index,
+                             std::shared_ptr<FlowIndex> flow_index)
+    : mode_(mode),
+      storage_(storage),
+      index_(std::move(index)),
+      flow_index_(std::move(flow_index)) {
+  if (!index_)
+    index_ = std::make_shared<SliceTreeIndex>(&storage_->slice_table());
+  if (!flow_index_) {
+    flow_index_ = std::make_shared<FlowIndex>(&storage_->flow_table(),
+                                              &storage_->slice_table());
+  }
+}
 
 ConnectedFlow::~ConnectedFlow() = default;
 
@@ -71,7 +83,7 @@ enum RelativesVisitMode : uint8_t {
 
 // Searches through the slice table recursively to find connected flows.
 // Usage:
-//  BFS bfs = BFS(context);
+//  BFS bfs = BFS(storage, index, flow_index);
 //  bfs
 //    // Add list of slices to start with.
 //    .Start(start_id).Start(start_id2)
@@ -83,7 +95,13 @@ enum RelativesVisitMode : uint8_t {
 //  bfs.TakeResultingFlows();
 class BFS {
  public:
-  explicit BFS(const TraceStorage* storage) : storage_(storage) {}
+  BFS(const TraceStorage* storage,
+      SliceTreeIndex* index,
+      FlowIndex* flow_index)
+      : storage_(storage),
+        index_(index),
+        flow_index_(flow_index),
+        known_slices_(storage->slice_table().row_count()) {}
 
   std::vector<tables::FlowTable::RowNumber> TakeResultingFlows() && {
     return std::move(flow_rows_);
@@ -92,7 +110,7 @@ class BFS {
   // Includes a starting slice ID to search.
   BFS& Start(SliceId start_id) {
     slices_to_visit_.push({start_id, VisitType::START});
-    known_slices_.insert(start_id);
+    known_slices_[start_id.value] = true;
     return *this;
   }
 
@@ -131,10 +149,13 @@ class BFS {
         GoToRelativesImpl(*opt_ancestors);
     }
     if (visit_relatives & VISIT_DESCENDANTS) {
-      auto opt_descendants =
-          Descendant::GetDescendantSlices(slice_table, slice_id);
-      if (opt_descendants)
-        GoToRelativesImpl(*opt_descendants);
+      auto slice_ref = slice_table.FindById(slice_id);
+      if (slice_ref) {
+        std::vector<tables::SliceTable::RowNumber> descendants;
+        index_->GetDescendants(slice_ref->ToRowNumber().row_number(),
+                               descendants);
+        GoToRelativesImpl(descendants);
+      }
     }
     return *this;
   }
@@ -153,24 +174,23 @@ class BFS {
   };
 
   void GoByFlow(SliceId slice_id, FlowDirection flow_direction) {
-    PERFETTO_DCHECK(known_slices_.count(slice_id) != 0);
+    PERFETTO_DCHECK(known_slices_[slice_id.value]);
 
     const auto& flow = storage_->flow_table();
-
-    const TypedColumn<SliceId>& start_col =
-        flow_direction == FlowDirection::OUTGOING ? flow.slice_out()
-                                                  : flow.slice_in();
-    auto it = flow.FilterToIterator({start_col.eq(slice_id.value)});
-    for (; it; ++it) {
-      flow_rows_.push_back(it.row_number());
-
-      SliceId next_slice_id = flow_direction == FlowDirection::OUTGOING
-                                  ? it.slice_in()
-                                  : it.slice_out();
-      if (known_slices_.count(next_slice_id))
+    bool outgoing = flow_direction == FlowDirection::OUTGOING;
+    const TypedColumn<SliceId>& next_col =
+        outgoing ? flow.slice_in() : flow.slice_out();
+    FlowIndex::Range flow_rows = outgoing
+                                     ? flow_index_->GetOutgoing(slice_id.value)
+                                     : flow_index_->GetIncoming(slice_id.value);
+    for (uint32_t row : flow_rows) {
+      flow_rows_.emplace_back(row);
+
+      SliceId next_slice_id = next_col[row];
+      if (known_slices_[next_slice_id.value])
         continue;
 
-      known_slices_.insert(next_slice_id);
+      known_slices_[next_slice_id.value] = true;
       slices_to_visit_.push(
           {next_slice_id, flow_direction == FlowDirection::INCOMING
                               ? VisitType::VIA_INCOMING_FLOW
@@ -183,18 +203,21 @@ class BFS {
     const auto& slice = storage_->slice_table();
     for (tables::SliceTable::RowNumber row : rows) {
       auto relative_slice_id = row.ToRowReference(slice).id();
-      if (known_slices_.count(relative_slice_id))
+      if (known_slices_[relative_slice_id.value])
         continue;
-      known_slices_.insert(relative_slice_id);
+      known_slices_[relative_slice_id.value] = true;
       slices_to_visit_.push({relative_slice_id, VisitType::VIA_RELATIVE});
     }
   }
 
+  const TraceStorage* storage_;
+  SliceTreeIndex* index_;
+  FlowIndex* flow_index_;
+
   std::queue<std::pair<SliceId, VisitType>> slices_to_visit_;
-  std::set<SliceId> known_slices_;
+  // Indexed by slice id (i.e. row): whether the slice was queued.
+  std::vector<bool> known_slices_;
   std::vector<tables::FlowTable::RowNumber> flow_rows_;
-
-  const TraceStorage* storage_;
 };
 
 }  // namespace
@@ -230,7 +253,7 @@ base::Status ConnectedFlow::ComputeTable(const std::vector<Constraint>& cs,
                            static_cast<uint32_t>(start_id.value));
   }
 
-  BFS bfs(storage_);
+  BFS bfs(storage_, index_.get(), flow_index_.get());
 
   switch (mode_) {
     case Mode::kDirectlyConnectedFlow:
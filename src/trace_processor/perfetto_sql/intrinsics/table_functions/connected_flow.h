@@ -17,12 +17,13 @@
 #ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_CONNECTED_FLOW_H_
 #define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_CONNECTED_FLOW_H_
 
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/flow_index.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/slice_tree_index.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/tables_py.h"
 #include "src/trace_processor/storage/trace_storage.h"
 
-#include <queue>
-#include <set>
+#include <memory>
 
 namespace perfetto {
 namespace trace_processor {
@@ -47,7 +48,12 @@ class ConnectedFlow : public StaticTableFunction {
     kFollowingFlow,
   };
 
-  ConnectedFlow(Mode mode, const TraceStorage*);
+  // |index| is used to find the descendants of slices and |flow_index| the
+  // flows of slices; new ones are created if they are null.
+  ConnectedFlow(Mode mode,
+                const TraceStorage*,
+                std::shared_ptr<SliceTreeIndex> index = nullptr,
+                std::shared_ptr<FlowIndex> flow_index = nullptr);
   ~ConnectedFlow() override;
 
   Table::Schema CreateSchema() override;
@@ -62,6 +68,8 @@ class ConnectedFlow : public StaticTableFunction {
  private:
   Mode mode_;
   const TraceStorage* storage_ = nullptr;
+  std::shared_ptr<SliceTreeIndex> index_;
+  std::shared_ptr<FlowIndex> flow_index_;
 };
 
 }  // namespace trace_processor
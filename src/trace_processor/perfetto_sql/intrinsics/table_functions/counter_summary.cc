@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/counter_summary.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <limits>
+#include <memory>
+#include <utility>
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/tables_py.h"
+#include "src/trace_processor/sqlite/sqlite_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace tables {
+
+CounterSummaryTable::~CounterSummaryTable() = default;
+
+}  // namespace tables
+
+namespace {
+
+using CounterSummaryTable = tables::CounterSummaryTable;
+
+const Constraint* FindEqConstraint(const std::vector<Constraint>& cs,
+                                   uint32_t col) {
+  auto it = std::find_if(cs.begin(), cs.end(), [col](const Constraint& c) {
+    return c.col_idx == col && c.op == FilterOp::kEq;
+  });
+  return it == cs.end() ? nullptr : &*it;
+}
+
+}  // namespace
+
+CounterSummary::CounterSummary(StringPool* pool,
+                               const tables::CounterTable* table)
+    : pool_(pool), counter_table_(table) {}
+CounterSummary::~CounterSummary() = default;
+
+Table::Schema CounterSummary::CreateSchema() {
+  return CounterSummaryTable::ComputeStaticSchema();
+}
+
+std::string CounterSummary::TableName() {
+  return CounterSummaryTable::Name();
+}
+
+uint32_t CounterSummary::EstimateRowCount() {
+  // Usually about one bucket per pixel of the track.
+  return 1024;
+}
+
+base::Status CounterSummary::ValidateConstraints(const QueryConstraints& qc) {
+  const auto& cs = qc.constraints();
+  for (uint32_t col : {CounterSummaryTable::ColumnIndex::in_track_id,
+                       CounterSummaryTable::ColumnIndex::in_ts_start,
+                       CounterSummaryTable::ColumnIndex::in_ts_end,
+                       CounterSummaryTable::ColumnIndex::in_buckets}) {
+    auto fn = [col](const QueryConstraints::Constraint& c) {
+      return c.column == static_cast<int>(col) && sqlite_utils::IsOpEq(c.op);
+    };
+    if (std::find_if(cs.begin(), cs.end(), fn) == cs.end())
+      return base::ErrStatus("Failed to find required constraints");
+  }
+  return base::OkStatus();
+}
+
+base::Status CounterSummary::ComputeTable(
+    const std::vector<Constraint>& cs,
+    const std::vector<Order>&,
+    const BitVector&,
+    std::unique_ptr<Table>& table_return) {
+  const Constraint* track_c =
+      FindEqConstraint(cs, CounterSummaryTable::ColumnIndex::in_track_id);
+  const Constraint* start_c =
+      FindEqConstraint(cs, CounterSummaryTable::ColumnIndex::in_ts_start);
+  const Constraint* end_c =
+      FindEqConstraint(cs, CounterSummaryTable::ColumnIndex::in_ts_end);
+  const Constraint* buckets_c =
+      FindEqConstraint(cs, CounterSummaryTable::ColumnIndex::in_buckets);
+  if (!track_c || !start_c || !end_c || !buckets_c)
+    return base::ErrStatus("counter_summary: missing arguments");
+
+  std::unique_ptr<CounterSummaryTable> out(new CounterSummaryTable(pool_));
+  if (track_c->value.is_null() || start_c->value.is_null() ||
+      end_c->value.is_null() || buckets_c->value.is_null()) {
+    // Nothing to summarize in a null interval so return an empty table.
+    table_return = std::move(out);
+    return base::OkStatus();
+  }
+  if (track_c->value.type != SqlValue::Type::kLong ||
+      start_c->value.type != SqlValue::Type::kLong ||
+      end_c->value.type != SqlValue::Type::kLong ||
+      buckets_c->value.type != SqlValue::Type::kLong) {
+    return base::ErrStatus(
+        "counter_summary: track_id, ts_start, ts_end and buckets should be "
+        "integers");
+  }
+
+  int64_t track_id = track_c->value.AsLong();
+  int64_t ts_start = start_c->value.AsLong();
+  int64_t ts_end = end_c->value.AsLong();
+  int64_t buckets = buckets_c->value.AsLong();
+  if (buckets <= 0)
+    return base::ErrStatus("counter_summary: buckets should be positive");
+  if (track_id < 0 || track_id > std::numeric_limits<uint32_t>::max()) {
+    return base::ErrStatus("counter_summary: invalid track_id %" PRId64,
+                           track_id);
+  }
+  const TrackIndex* track =
+      GetOrCreateIndex(TrackId(static_cast<uint32_t>(track_id)));
+  if (!track || ts_end <= ts_start) {
+    table_return = std::move(out);
+    return base::OkStatus();
+  }
+  uint64_t span =
+      static_cast<uint64_t>(ts_end) - static_cast<uint64_t>(ts_start);
+  if (span > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+    return base::ErrStatus("counter_summary: [ts_start, ts_end) is too large");
+
+  // Buckets are ceil(span / buckets) long so that they cover the whole
+  // interval; the last one is truncated at |ts_end|.
+  int64_t bucket_dur =
+      static_cast<int64_t>((span - 1) / static_cast<uint64_t>(buckets) + 1);
+
+  // Only the buckets which contain samples are visited: each iteration jumps
+  // straight to the bucket of the next sample.
+  const std::vector<int64_t>& ts = track->ts;
+  auto lo = static_cast<uint32_t>(
+      std::lower_bound(ts.begin(), ts.end(), ts_start) - ts.begin());
+  while (lo < ts.size() && ts[lo] < ts_end) {
+    int64_t bucket_start =
+        ts_start + (ts[lo] - ts_start) / bucket_dur * bucket_dur;
+    int64_t bucket_end =
+        bucket_start + std::min(bucket_dur, ts_end - bucket_start);
+    auto hi = static_cast<uint32_t>(
+        std::lower_bound(ts.begin() + lo, ts.end(), bucket_end) - ts.begin());
+    MinMaxPyramid::Summary summary = track->pyramid->Summarize(lo, hi);
+
+    CounterSummaryTable::Row row;
+    row.ts = bucket_start;
+    row.dur = bucket_end - bucket_start;
+    row.sample_count = summary.count;
+    row.min_value = summary.min;
+    row.max_value = summary.max;
+    row.avg_value = summary.sum / summary.count;
+    row.last_value = summary.last;
+    row.in_track_id = TrackId(static_cast<uint32_t>(track_id));
+    row.in_ts_start = ts_start;
+    row.in_ts_end = ts_end;
+    row.in_buckets = buckets;
+    out->Insert(row);
+    lo = hi;
+  }
+  table_return = std::move(out);
+  return base::OkStatus();
+}
+
+const CounterSummary::TrackIndex* CounterSummary::GetOrCreateIndex(
+    TrackId track_id) {
+  if (counter_table_->row_count() != indexed_row_count_) {
+    // Rows were added since the last query: rebucket all the samples by track
+    // and drop the stale pyramids. Pyramids are only built for the tracks
+    // which are queried.
+    tracks_.clear();
+    const auto& track_col = counter_table_->track_id();
+    for (uint32_t i = 0; i < counter_table_->row_count(); ++i)
+      tracks_[track_col[i].value].rows.push_back(i);
+    indexed_row_count_ = counter_table_->row_count();
+  }
+
+  auto it = tracks_.find(track_id.value);
+  if (it == tracks_.end())
+    return nullptr;
+
+  TrackIndex& track = it->second;
+  if (!track.pyramid) {
+    // The counter table is sorted by timestamp so the rows of each track are
+    // too.
+    const auto& ts_col = counter_table_->ts();
+    const auto& value_col = counter_table_->value();
+    std::vector<double> values;
+    track.ts.reserve(track.rows.size());
+    values.reserve(track.rows.size());
+    for (uint32_t row : track.rows) {
+      track.ts.push_back(ts_col[row]);
+      values.push_back(value_col[row]);
+    }
+    track.pyramid = MinMaxPyramid(std::move(values));
+    track.rows = std::vector<uint32_t>();
+  }
+  return &track;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
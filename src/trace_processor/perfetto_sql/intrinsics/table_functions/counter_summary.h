@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_COUNTER_SUMMARY_H_
+#define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_COUNTER_SUMMARY_H_
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "src/trace_processor/containers/min_max_pyramid.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Implements the counter_summary table function which downsamples the values
+// of a counter track to at most |buckets| equally sized time buckets covering
+// [ts_start, ts_end):
+//
+//   SELECT ts, dur, min_value, max_value, avg_value, last_value
+//   FROM counter_summary(track_id, ts_start, ts_end, buckets)
+//
+// Each row summarizes the samples with a timestamp in one bucket; buckets
+// without samples are not returned. avg_value is the mean of the samples (not
+// weighted by how long each value lasted) and last_value the value of the
+// last sample of the bucket.
+//
+// A MinMaxPyramid is built for a track the first time it is queried so each
+// bucket takes logarithmic rather than linear time in the number of samples.
+// All the pyramids are dropped whenever rows are added to the counter table.
+class CounterSummary : public StaticTableFunction {
+ public:
+  CounterSummary(StringPool* pool, const tables::CounterTable* table);
+  ~CounterSummary() override;
+
+  Table::Schema CreateSchema() override;
+  std::string TableName() override;
+  uint32_t EstimateRowCount() override;
+  base::Status ValidateConstraints(const QueryConstraints&) override;
+  base::Status ComputeTable(const std::vector<Constraint>& cs,
+                            const std::vector<Order>& ob,
+                            const BitVector& cols_used,
+                            std::unique_ptr<Table>& table_return) override;
+
+ private:
+  struct TrackIndex {
+    // Rows of the track which have not been indexed yet.
+    std::vector<uint32_t> rows;
+    // Timestamps of the samples of the track, in the order of the pyramid.
+    std::vector<int64_t> ts;
+    std::optional<MinMaxPyramid> pyramid;
+  };
+
+  // Returns the index for |track_id|, building it if necessary, or nullptr if
+  // the track has no samples.
+  const TrackIndex* GetOrCreateIndex(TrackId track_id);
+
+  StringPool* pool_ = nullptr;
+  const tables::CounterTable* counter_table_ = nullptr;
+
+  // Number of counter table rows which were bucketed into |tracks_|.
+  uint32_t indexed_row_count_ = 0;
+  std::unordered_map<uint32_t, TrackIndex> tracks_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_COUNTER_SUMMARY_H_
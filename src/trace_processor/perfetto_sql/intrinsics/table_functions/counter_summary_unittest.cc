@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/counter_summary.h"
+
+#include "src/trace_processor/containers/bit_vector.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/tables_py.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+using CounterSummaryTable = tables::CounterSummaryTable;
+
+void Insert(tables::CounterTable* table,
+            int64_t ts,
+            double value,
+            uint32_t track_id) {
+  tables::CounterTable::Row row;
+  row.ts = ts;
+  row.value = value;
+  row.track_id = TrackId{track_id};
+  table->Insert(row);
+}
+
+base::Status Query(CounterSummary& gen,
+                   SqlValue track_id,
+                   SqlValue ts_start,
+                   SqlValue ts_end,
+                   SqlValue buckets,
+                   std::unique_ptr<Table>& table) {
+  return gen.ComputeTable(
+      {
+          Constraint{CounterSummaryTable::ColumnIndex::in_track_id,
+                     FilterOp::kEq, track_id},
+          Constraint{CounterSummaryTable::ColumnIndex::in_ts_start,
+                     FilterOp::kEq, ts_start},
+          Constraint{CounterSummaryTable::ColumnIndex::in_ts_end,
+                     FilterOp::kEq, ts_end},
+          Constraint{CounterSummaryTable::ColumnIndex::in_buckets,
+                     FilterOp::kEq, buckets},
+      },
+      {}, BitVector(), table);
+}
+
+// Returns the rows of the summary as "ts dur count min max avg last" strings.
+std::vector<std::string> Query(CounterSummary& gen,
+                               uint32_t track_id,
+                               int64_t ts_start,
+                               int64_t ts_end,
+                               int64_t buckets) {
+  std::unique_ptr<Table> table;
+  base::Status status =
+      Query(gen, SqlValue::Long(track_id), SqlValue::Long(ts_start),
+            SqlValue::Long(ts_end), SqlValue::Long(buckets), table);
+  EXPECT_TRUE(status.ok()) << status.message();
+
+  std::vector<std::string> rows;
+  for (uint32_t i = 0; i < table->row_count(); ++i) {
+    std::string row;
+    for (const char* col : {"ts", "dur", "sample_count", "min_value",
+                            "max_value", "avg_value", "last_value"}) {
+      SqlValue value = table->GetColumnByName(col)->Get(i);
+      if (!row.empty())
+        row += " ";
+      row += value.type == SqlValue::kLong
+                 ? std::to_string(value.long_value)
+                 : std::to_string(static_cast<int64_t>(value.double_value));
+    }
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+TEST(CounterSummary, SummarizesBuckets) {
+  StringPool pool;
+  tables::CounterTable counter_table(&pool);
+  Insert(&counter_table, 0 /*ts*/, 4 /*value*/, 1 /*track_id*/);
+  Insert(&counter_table, 10, 8, 1);
+  Insert(&counter_table, 15, 100, 2);
+  Insert(&counter_table, 20, 6, 1);
+  Insert(&counter_table, 60, 2, 1);
+  Insert(&counter_table, 99, 10, 1);
+
+  CounterSummary gen(&pool, &counter_table);
+  ASSERT_THAT(Query(gen, 1, 0, 100, 4),
+              ElementsAre("0 25 3 4 8 6 6", "50 25 1 2 2 2 2",
+                          "75 25 1 10 10 10 10"));
+  ASSERT_THAT(Query(gen, 1, 0, 100, 1), ElementsAre("0 100 5 2 10 6 10"));
+
+  // The last bucket is truncated at ts_end.
+  ASSERT_THAT(Query(gen, 1, 10, 70, 4),
+              ElementsAre("10 15 2 6 8 7 6", "55 15 1 2 2 2 2"));
+  ASSERT_THAT(Query(gen, 1, 10, 21, 2),
+              ElementsAre("10 6 1 8 8 8 8", "16 5 1 6 6 6 6"));
+
+  ASSERT_THAT(Query(gen, 2, 0, 100, 10),
+              ElementsAre("10 10 1 100 100 100 100"));
+  ASSERT_THAT(Query(gen, 1, 100, 1000, 10), IsEmpty());
+  ASSERT_THAT(Query(gen, 3, 0, 100, 10), IsEmpty());
+}
+
+TEST(CounterSummary, RowsAddedAfterQuery) {
+  StringPool pool;
+  tables::CounterTable counter_table(&pool);
+  Insert(&counter_table, 0 /*ts*/, 1 /*value*/, 1 /*track_id*/);
+
+  CounterSummary gen(&pool, &counter_table);
+  ASSERT_THAT(Query(gen, 1, 0, 10, 1), ElementsAre("0 10 1 1 1 1 1"));
+
+  Insert(&counter_table, 5, 3, 1);
+  ASSERT_THAT(Query(gen, 1, 0, 10, 1), ElementsAre("0 10 2 1 3 2 3"));
+}
+
+TEST(CounterSummary, InvalidArguments) {
+  StringPool pool;
+  tables::CounterTable counter_table(&pool);
+  Insert(&counter_table, 0 /*ts*/, 1 /*value*/, 1 /*track_id*/);
+
+  CounterSummary gen(&pool, &counter_table);
+  std::unique_ptr<Table> table;
+  ASSERT_TRUE(Query(gen, SqlValue::Long(1), SqlValue(), SqlValue::Long(10),
+                    SqlValue::Long(1), table)
+                  .ok());
+  ASSERT_EQ(table->row_count(), 0u);
+  ASSERT_FALSE(Query(gen, SqlValue::Long(1), SqlValue::Long(0),
+                     SqlValue::Long(10), SqlValue::Long(0), table)
+                   .ok());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
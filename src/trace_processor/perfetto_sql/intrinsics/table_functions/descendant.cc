@@ -17,7 +17,6 @@
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/descendant.h"
 
 #include <memory>
-#include <set>
 
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/tables_py.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
@@ -30,6 +29,7 @@ namespace tables {
 
 DescendantSliceTable::~DescendantSliceTable() = default;
 DescendantSliceByStackTable::~DescendantSliceByStackTable() = default;
+DescendantSliceByIdsTable::~DescendantSliceByIdsTable() = default;
 
 }  // namespace tables
 
@@ -49,6 +49,7 @@ std::unique_ptr<Table> ExtendWithStartId(
 
 base::Status GetDescendants(
     const tables::SliceTable& slices,
+    SliceTreeIndex& index,
     SliceId starting_id,
     std::vector<tables::SliceTable::RowNumber>& row_numbers_accumulator) {
   auto start_ref = slices.FindById(starting_id);
@@ -58,28 +59,11 @@ base::Status GetDescendants(
                            static_cast<uint32_t>(starting_id.value));
   }
 
-  // As an optimization, for any finished slices, we only need to consider
-  // slices which started before the end of this slice (because slices on a
-  // track are always perfectly stacked).
-  // For unfinshed slices (i.e. -1 dur), we need to consider until the end of
-  // the trace so we cannot add any similar constraint.
-  std::vector<Constraint> cs;
-  if (start_ref->dur() >= 0) {
-    cs.emplace_back(slices.ts().le(start_ref->ts() + start_ref->dur()));
-  }
-
-  // All nested descendents must be on the same track, with a ts greater than
-  // |start_ref.ts| and whose depth is larger than |start_ref|'s.
-  cs.emplace_back(slices.ts().ge(start_ref->ts()));
-  cs.emplace_back(slices.track_id().eq(start_ref->track_id().value));
-  cs.emplace_back(slices.depth().gt(start_ref->depth()));
-
   // It's important we insert directly into |row_numbers_accumulator| and not
   // overwrite it because we expect the existing elements in
   // |row_numbers_accumulator| to be preserved.
-  for (auto it = slices.FilterToIterator(cs); it; ++it) {
-    row_numbers_accumulator.emplace_back(it.row_number());
-  }
+  index.GetDescendants(start_ref->ToRowNumber().row_number(),
+                       row_numbers_accumulator);
   return base::OkStatus();
 }
 
@@ -89,14 +73,21 @@ uint32_t GetConstraintColumnIndex(Descendant::Type type) {
       return tables::DescendantSliceTable::ColumnIndex::start_id;
     case Descendant::Type::kSliceByStack:
       return tables::DescendantSliceByStackTable::ColumnIndex::start_stack_id;
+    case Descendant::Type::kSliceByIds:
+      return tables::DescendantSliceByIdsTable::ColumnIndex::start_ids;
   }
   PERFETTO_FATAL("For GCC");
 }
 
 }  // namespace
 
-Descendant::Descendant(Type type, const TraceStorage* storage)
-    : type_(type), storage_(storage) {}
+Descendant::Descendant(Type type,
+                       TraceStorage* storage,
+                       std::shared_ptr<SliceTreeIndex> index)
+    : type_(type), storage_(storage), index_(std::move(index)) {
+  if (!index_)
+    index_ = std::make_shared<SliceTreeIndex>(&storage_->slice_table());
+}
 
 base::Status Descendant::ValidateConstraints(const QueryConstraints& qc) {
   const auto& cs = qc.constraints();
@@ -136,9 +127,42 @@ base::Status Descendant::ComputeTable(const std::vector<Constraint>& cs,
             tables::DescendantSliceByStackTable::SelectAndExtendParent(
                 storage_->slice_table(), {}, {});
         break;
+      case Type::kSliceByIds:
+        table_return = tables::DescendantSliceByIdsTable::SelectAndExtendParent(
+            storage_->slice_table(), {}, {}, {});
+        break;
+    }
+    return base::OkStatus();
+  }
+
+  if (type_ == Type::kSliceByIds) {
+    if (constraint_it->value.type != SqlValue::Type::kString) {
+      return base::ErrStatus("start ids should be a string.");
+    }
+    auto start_ids = ParseSliceIds(slices, constraint_it->value.AsString());
+    if (!start_ids.ok())
+      return start_ids.status();
+    std::vector<tables::SliceTable::RowNumber> descendants;
+    ColumnStorage<uint32_t> start_id_column;
+    for (SliceId start_id : *start_ids) {
+      size_t prev_size = descendants.size();
+      RETURN_IF_ERROR(GetDescendants(slices, *index_, start_id, descendants));
+      for (size_t i = prev_size; i < descendants.size(); ++i)
+        start_id_column.Append(start_id.value);
     }
+    // The hidden column must be populated because as far as SQLite is
+    // concerned this is an equality constraint.
+    ColumnStorage<StringPool::Id> start_ids_column;
+    StringPool::Id start_ids_id = storage_->InternString(
+        base::StringView(constraint_it->value.AsString()));
+    for (size_t i = 0; i < descendants.size(); ++i)
+      start_ids_column.Append(start_ids_id);
+    table_return = tables::DescendantSliceByIdsTable::SelectAndExtendParent(
+        slices, std::move(descendants), std::move(start_id_column),
+        std::move(start_ids_column));
     return base::OkStatus();
   }
+
   if (constraint_it->value.type != SqlValue::Type::kLong) {
     return base::ErrStatus("start id should be an integer.");
   }
@@ -149,21 +173,24 @@ base::Status Descendant::ComputeTable(const std::vector<Constraint>& cs,
     case Type::kSlice: {
       // Build up all the children row ids.
       uint32_t start_id_uint = static_cast<uint32_t>(start_id);
-      RETURN_IF_ERROR(GetDescendants(
-          slices, tables::SliceTable::Id(start_id_uint), descendants));
+      RETURN_IF_ERROR(GetDescendants(slices, *index_,
+                                     tables::SliceTable::Id(start_id_uint),
+                                     descendants));
       table_return = ExtendWithStartId<tables::DescendantSliceTable>(
           start_id_uint, slices, std::move(descendants));
       break;
     }
     case Type::kSliceByStack: {
-      auto sbs_cs = {slices.stack_id().eq(start_id)};
-      for (auto it = slices.FilterToIterator(sbs_cs); it; ++it) {
-        RETURN_IF_ERROR(GetDescendants(slices, it.id(), descendants));
+      for (uint32_t row : index_->GetRowsWithStackId(start_id)) {
+        RETURN_IF_ERROR(
+            GetDescendants(slices, *index_, SliceId(row), descendants));
       }
       table_return = ExtendWithStartId<tables::DescendantSliceByStackTable>(
           start_id, slices, std::move(descendants));
       break;
     }
+    case Type::kSliceByIds:
+      PERFETTO_FATAL("Handled above");
   }
 
   return base::OkStatus();
@@ -175,6 +202,8 @@ Table::Schema Descendant::CreateSchema() {
       return tables::DescendantSliceTable::ComputeStaticSchema();
     case Type::kSliceByStack:
       return tables::DescendantSliceByStackTable::ComputeStaticSchema();
+    case Type::kSliceByIds:
+      return tables::DescendantSliceByIdsTable::ComputeStaticSchema();
   }
   PERFETTO_FATAL("For GCC");
 }
@@ -185,6 +214,8 @@ std::string Descendant::TableName() {
       return tables::DescendantSliceTable::Name();
     case Type::kSliceByStack:
       return tables::DescendantSliceByStackTable::Name();
+    case Type::kSliceByIds:
+      return tables::DescendantSliceByIdsTable::Name();
   }
   PERFETTO_FATAL("For GCC");
 }
@@ -193,16 +224,5 @@ uint32_t Descendant::EstimateRowCount() {
   return 1;
 }
 
-// static
-std::optional<std::vector<tables::SliceTable::RowNumber>>
-Descendant::GetDescendantSlices(const tables::SliceTable& slices,
-                                SliceId slice_id) {
-  std::vector<tables::SliceTable::RowNumber> ret;
-  auto status = GetDescendants(slices, slice_id, ret);
-  if (!status.ok())
-    return std::nullopt;
-  return std::move(ret);
-}
-
 }  // namespace trace_processor
 }  // namespace perfetto
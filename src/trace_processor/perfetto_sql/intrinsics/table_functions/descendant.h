@@ -17,8 +17,9 @@
 #ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_DESCENDANT_H_
 #define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_DESCENDANT_H_
 
-#include <optional>
+#include <memory>
 
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/slice_tree_index.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
 #include "src/trace_processor/storage/trace_storage.h"
 
@@ -30,13 +31,18 @@ class TraceProcessorContext;
 // Implements the following dynamic tables:
 // * descendant_slice
 // * descendant_slice_by_stack
+// * descendant_slice_by_ids
 //
 // See docs/analysis/trace-processor for usage.
 class Descendant : public StaticTableFunction {
  public:
-  enum class Type { kSlice = 1, kSliceByStack = 2 };
+  enum class Type { kSlice = 1, kSliceByStack = 2, kSliceByIds = 3 };
 
-  Descendant(Type type, const TraceStorage*);
+  // |index| can be shared with the other table functions which look up
+  // relatives of slices; a new one is created if it is null.
+  Descendant(Type type,
+             TraceStorage*,
+             std::shared_ptr<SliceTreeIndex> index = nullptr);
 
   Table::Schema CreateSchema() override;
   std::string TableName() override;
@@ -47,15 +53,10 @@ class Descendant : public StaticTableFunction {
                             const BitVector& cols_used,
                             std::unique_ptr<Table>& table_return) override;
 
-  // Returns a vector of slice rows which are descendants of |slice_id|. Returns
-  // std::nullopt if an invalid |slice_id| is given. This is used by
-  // ConnectedFlow to traverse flow indirectly connected flow events.
-  static std::optional<std::vector<tables::SliceTable::RowNumber>>
-  GetDescendantSlices(const tables::SliceTable& slices, SliceId slice_id);
-
  private:
   Type type_;
-  const TraceStorage* storage_ = nullptr;
+  TraceStorage* storage_ = nullptr;
+  std::shared_ptr<SliceTreeIndex> index_;
 };
 
 }  // namespace trace_processor
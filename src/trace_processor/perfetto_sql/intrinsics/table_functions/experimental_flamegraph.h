@@ -53,6 +53,7 @@ class ExperimentalFlamegraph : public StaticTableFunction {
 
  private:
   TraceProcessorContext* context_ = nullptr;
+  FlamegraphCache flamegraph_cache_;
 };
 
 }  // namespace trace_processor
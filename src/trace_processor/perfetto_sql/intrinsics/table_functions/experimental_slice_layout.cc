@@ -16,7 +16,12 @@
 
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/experimental_slice_layout.h"
 
+#include <algorithm>
+#include <limits>
 #include <optional>
+#include <set>
+#include <tuple>
+#include <utility>
 
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
@@ -32,18 +37,15 @@ ExperimentalSliceLayoutTable::~ExperimentalSliceLayoutTable() = default;
 
 namespace {
 
-struct GroupInfo {
-  GroupInfo(int64_t _start, int64_t _end, uint32_t _max_depth)
-      : start(_start), end(_end), layout_depth(0), max_depth(_max_depth) {}
-  int64_t start;
-  int64_t end;
-  uint32_t layout_depth;
-  uint32_t max_depth;
-};
-
 static constexpr uint32_t kFilterTrackIdsColumnIndex =
     tables::ExperimentalSliceLayoutTable::ColumnIndex::filter_track_ids;
 
+// Returns the end of a slice, treating incomplete slices (dur = -1) as
+// extending to the end of the trace.
+int64_t SliceEnd(int64_t ts, int64_t dur) {
+  return dur == -1 ? std::numeric_limits<int64_t>::max() : ts + dur;
+}
+
 }  // namespace
 
 ExperimentalSliceLayout::ExperimentalSliceLayout(
@@ -102,45 +104,91 @@ base::Status ExperimentalSliceLayout::ComputeTable(
   StringPool::Id filter_id =
       string_pool_->InternString(base::StringView(filter_string));
 
-  // Try and find the table in the cache.
-  auto cache_it = layout_table_cache_.find(filter_id);
-  if (cache_it != layout_table_cache_.end()) {
-    table_return.reset(new Table(cache_it->second->Copy()));
-    return base::OkStatus();
+  // Layouts are shared by all the filter strings listing the same tracks,
+  // whatever their order.
+  std::vector<TrackId> tracks(selected_tracks.begin(), selected_tracks.end());
+  Layout& layout = layouts_[tracks];
+  bool changed = UpdateLayout(tracks, layout);
+  if (changed || !layout.table || layout.table_filter_id != filter_id) {
+    layout.table = ComputeLayoutTable(layout, filter_id);
+    layout.table_filter_id = filter_id;
   }
+  table_return.reset(new Table(layout.table->Copy()));
+  return base::OkStatus();
+}
 
-  // Find all the slices for the tracks we want to filter and create a vector of
-  // row numbers out of them.
-  std::vector<tables::SliceTable::RowNumber> rows;
-  for (auto it = slice_table_->IterateRows(); it; ++it) {
-    if (selected_tracks.count(it.track_id())) {
-      rows.emplace_back(it.row_number());
+bool ExperimentalSliceLayout::UpdateLayout(const std::vector<TrackId>& tracks,
+                                           Layout& layout) {
+  const auto& ts_col = slice_table_->ts();
+  const auto& dur_col = slice_table_->dur();
+
+  // Slices which were incomplete may have ended since the layout was
+  // computed: the bounding boxes of their groups have to be recomputed.
+  bool reset = false;
+  auto ended_it = std::remove_if(
+      layout.incomplete_rows.begin(), layout.incomplete_rows.end(),
+      [&](uint32_t i) { return dur_col[layout.rows[i]] != -1; });
+  if (ended_it != layout.incomplete_rows.end()) {
+    layout.incomplete_rows.erase(ended_it, layout.incomplete_rows.end());
+    for (Group& group : layout.groups)
+      group.end = std::numeric_limits<int64_t>::min();
+    for (uint32_t i = 0; i < layout.rows.size(); ++i) {
+      uint32_t row = layout.rows[i];
+      Group& group = layout.groups[layout.row_groups[i]];
+      group.end = std::max(group.end, SliceEnd(ts_col[row], dur_col[row]));
     }
+    reset = true;
   }
 
-  // Compute the table and add it to the cache for future use.
-  std::unique_ptr<Table> layout_table =
-      ComputeLayoutTable(std::move(rows), filter_id);
-  auto res = layout_table_cache_.emplace(filter_id, std::move(layout_table));
-
-  table_return.reset(new Table(res.first->second->Copy()));
-  return base::OkStatus();
-}
-
-// Build up a table of slice id -> root slice id by observing each
-// (id, opt_parent_id) pair in order.
-tables::SliceTable::Id ExperimentalSliceLayout::InsertSlice(
-    std::map<tables::SliceTable::Id, tables::SliceTable::Id>& id_map,
-    tables::SliceTable::Id id,
-    std::optional<tables::SliceTable::Id> parent_id) {
-  if (parent_id) {
-    tables::SliceTable::Id root_id = id_map[parent_id.value()];
-    id_map[id] = root_id;
-    return root_id;
-  } else {
-    id_map[id] = id;
-    return id;
+  // Step 1:
+  // Add the new slices of the tracks to the bounding box (start ts, end ts and
+  // max depth) of their group.
+  const auto& id_col = slice_table_->id();
+  const auto& track_col = slice_table_->track_id();
+  const auto& depth_col = slice_table_->depth();
+  const auto& parent_col = slice_table_->parent_id();
+  size_t old_row_count = layout.rows.size();
+  auto old_group_count = static_cast<uint32_t>(layout.groups.size());
+  for (uint32_t row = layout.slice_count; row < slice_table_->row_count();
+       ++row) {
+    if (!std::binary_search(tracks.begin(), tracks.end(), track_col[row]))
+      continue;
+
+    int64_t start = ts_col[row];
+    int64_t end = SliceEnd(start, dur_col[row]);
+    uint32_t depth = depth_col[row];
+    std::optional<tables::SliceTable::Id> parent_id = parent_col[row];
+    uint32_t* parent_group =
+        parent_id ? layout.group_by_slice_id.Find(parent_id->value) : nullptr;
+    uint32_t group_idx;
+    if (parent_group) {
+      group_idx = *parent_group;
+      Group& group = layout.groups[group_idx];
+      // A group which was already placed grew: the groups placed after it may
+      // now collide with it.
+      if (group_idx < old_group_count &&
+          (depth > group.max_depth || end > group.end)) {
+        reset = true;
+      }
+      group.max_depth = std::max(group.max_depth, depth);
+      group.end = std::max(group.end, end);
+    } else {
+      group_idx = static_cast<uint32_t>(layout.groups.size());
+      layout.groups.push_back(Group{start, end, depth, 0});
+      layout.groups_by_start.push_back(group_idx);
+    }
+    layout.group_by_slice_id.Insert(id_col[row].value, group_idx);
+    if (dur_col[row] == -1) {
+      layout.incomplete_rows.push_back(
+          static_cast<uint32_t>(layout.rows.size()));
+    }
+    layout.rows.push_back(row);
+    layout.row_groups.push_back(group_idx);
   }
+  layout.slice_count = slice_table_->row_count();
+
+  PlaceGroups(layout, reset);
+  return reset || layout.rows.size() != old_row_count;
 }
 
 // The problem we're trying to solve is this: given a number of tracks each of
@@ -166,118 +214,93 @@ tables::SliceTable::Id ExperimentalSliceLayout::InsertSlice(
 //
 // The algorithm works in three passes:
 // 1. For each stalactite find the 'bounding box' (start, end, & max depth)
+//    (see UpdateLayout()).
 // 2. Considering each stalactite bounding box in start ts order pick a
 //    layout_depth for the root slice of stalactite to avoid collisions with
 //    all previous stalactite's we've considered.
 // 3. Go though each slice and give it a layout_depth by summing it's
-//    current depth and the root layout_depth of the stalactite it belongs to.
+//    current depth and the root layout_depth of the stalactite it belongs to
+//    (see ComputeLayoutTable()).
 //
-std::unique_ptr<Table> ExperimentalSliceLayout::ComputeLayoutTable(
-    std::vector<tables::SliceTable::RowNumber> rows,
-    StringPool::Id filter_id) {
-  std::map<tables::SliceTable::Id, GroupInfo> groups;
-  // Map of id -> root_id
-  std::map<tables::SliceTable::Id, tables::SliceTable::Id> id_map;
-
-  // Step 1:
-  // Find the bounding box (start ts, end ts, and max depth) for each group
-  // TODO(lalitm): Update this to use iterator (as this code will be slow after
-  // the event table is implemented)
-  for (tables::SliceTable::RowNumber i : rows) {
-    auto ref = i.ToRowReference(*slice_table_);
-
-    tables::SliceTable::Id id = ref.id();
-    uint32_t depth = ref.depth();
-    int64_t start = ref.ts();
-    int64_t dur = ref.dur();
-    int64_t end = dur == -1 ? std::numeric_limits<int64_t>::max() : start + dur;
-    InsertSlice(id_map, id, ref.parent_id());
-    std::map<tables::SliceTable::Id, GroupInfo>::iterator it;
-    bool inserted;
-    std::tie(it, inserted) = groups.emplace(
-        std::piecewise_construct, std::forward_as_tuple(id_map[id]),
-        std::forward_as_tuple(start, end, depth));
-    if (!inserted) {
-      it->second.max_depth = std::max(it->second.max_depth, depth);
-      it->second.end = std::max(it->second.end, end);
-    }
+// Step 2 is a sweep over the groups sorted by start so, as long as the new
+// groups start after the last placed one and the placed ones did not grow,
+// it can pick up where the previous call stopped.
+// static
+void ExperimentalSliceLayout::PlaceGroups(Layout& layout, bool reset) {
+  std::vector<Group>& groups = layout.groups;
+  std::vector<uint32_t>& order = layout.groups_by_start;
+  std::vector<uint32_t>& open = layout.open_groups;
+  auto by_start = [&groups](uint32_t a, uint32_t b) {
+    return std::tie(groups[a].start, a) < std::tie(groups[b].start, b);
+  };
+  uint32_t placed = layout.placed_group_count;
+  std::sort(order.begin() + placed, order.end(), by_start);
+  if (placed > 0 && placed < order.size() &&
+      by_start(order[placed], order[placed - 1])) {
+    reset = true;
   }
-
-  // Sort the groups by ts
-  std::vector<GroupInfo*> sorted_groups;
-  sorted_groups.resize(groups.size());
-  size_t idx = 0;
-  for (auto& group : groups) {
-    sorted_groups[idx++] = &group.second;
+  if (reset) {
+    std::sort(order.begin(), order.end(), by_start);
+    placed = 0;
+    open.clear();
   }
-  std::sort(std::begin(sorted_groups), std::end(sorted_groups),
-            [](const GroupInfo* group1, const GroupInfo* group2) {
-              return group1->start < group2->start;
-            });
 
   // Step 2:
-  // Go though each group and choose a depth for the root slice.
-  // We keep track of those groups where the start time has passed but the
-  // end time has not in this vector:
-  std::vector<GroupInfo*> still_open;
-  for (GroupInfo* group : sorted_groups) {
-    int64_t start = group->start;
-    uint32_t max_depth = group->max_depth;
-
-    // Discard all 'closed' groups where that groups end_ts is < our start_ts:
-    {
-      auto it = still_open.begin();
-      while (it != still_open.end()) {
-        if ((*it)->end <= start) {
-          it = still_open.erase(it);
-        } else {
-          ++it;
-        }
-      }
-    }
-
-    // Find a start layout depth for this group s.t. our start depth +
-    // our max depth will not intersect with the start depth + max depth for
-    // any of the open groups:
+  // Go though each group and choose a depth for the root slice. |open| holds
+  // the groups whose start time has passed but whose end time has not, sorted
+  // by layout depth: they never overlap each other so the lowest free depth is
+  // found by walking the gaps between them.
+  for (; placed < order.size(); ++placed) {
+    uint32_t group_idx = order[placed];
+    Group& group = groups[group_idx];
     uint32_t layout_depth = 0;
-    bool done = false;
-    while (!done) {
-      done = true;
-      uint32_t start_depth = layout_depth;
-      uint32_t end_depth = layout_depth + max_depth;
-      for (const auto& open : still_open) {
-        uint32_t open_start_depth = open->layout_depth;
-        uint32_t open_end_depth = open->layout_depth + open->max_depth;
-        bool fully_above_open = end_depth < open_start_depth;
-        bool fully_below_open = open_end_depth < start_depth;
-        if (!fully_above_open && !fully_below_open) {
-          // This is extremely dumb, we can make a much better guess for what
-          // depth to try next but it is a little complicated to get right.
-          layout_depth++;
-          done = false;
-          break;
-        }
+    bool found = false;
+    auto open_end = open.begin();
+    for (uint32_t open_idx : open) {
+      const Group& open_group = groups[open_idx];
+      // Discard all 'closed' groups where that groups end_ts is <= our
+      // start_ts.
+      if (open_group.end <= group.start)
+        continue;
+      *open_end++ = open_idx;
+      if (found)
+        continue;
+      uint32_t open_end_depth = open_group.layout_depth + open_group.max_depth;
+      if (layout_depth + group.max_depth < open_group.layout_depth) {
+        found = true;
+      } else if (open_end_depth >= layout_depth) {
+        layout_depth = open_end_depth + 1;
       }
     }
-
-    // Add this group to the open groups & re
-    still_open.push_back(group);
-
-    // Set our root layout depth:
-    group->layout_depth = layout_depth;
+    open.erase(open_end, open.end());
+
+    group.layout_depth = layout_depth;
+    open.insert(std::upper_bound(open.begin(), open.end(), layout_depth,
+                                 [&groups](uint32_t depth, uint32_t idx) {
+                                   return depth < groups[idx].layout_depth;
+                                 }),
+                group_idx);
   }
+  layout.placed_group_count = placed;
+}
 
+std::unique_ptr<Table> ExperimentalSliceLayout::ComputeLayoutTable(
+    const Layout& layout,
+    StringPool::Id filter_id) {
   // Step 3: Add the two new columns layout_depth and filter_track_ids:
+  const auto& depth_col = slice_table_->depth();
+  std::vector<tables::SliceTable::RowNumber> rows;
+  rows.reserve(layout.rows.size());
   ColumnStorage<uint32_t> layout_depth_column;
   ColumnStorage<StringPool::Id> filter_column;
-
-  for (tables::SliceTable::RowNumber i : rows) {
-    auto ref = i.ToRowReference(*slice_table_);
+  for (uint32_t i = 0; i < layout.rows.size(); ++i) {
+    uint32_t row = layout.rows[i];
+    rows.emplace_back(row);
 
     // Each slice depth is it's current slice depth + root slice depth of the
     // group:
-    uint32_t group_depth = groups.at(id_map[ref.id()]).layout_depth;
-    layout_depth_column.Append(ref.depth() + group_depth);
+    uint32_t group_depth = layout.groups[layout.row_groups[i]].layout_depth;
+    layout_depth_column.Append(depth_col[row] + group_depth);
     // We must set this to the value we got in the constraint to ensure our
     // rows are not filtered out:
     filter_column.Append(filter_id);
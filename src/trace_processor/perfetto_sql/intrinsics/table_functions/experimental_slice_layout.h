@@ -17,14 +17,25 @@
 #ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_EXPERIMENTAL_SLICE_LAYOUT_H_
 #define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_EXPERIMENTAL_SLICE_LAYOUT_H_
 
-#include <set>
+#include <map>
+#include <memory>
+#include <vector>
 
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
 #include "src/trace_processor/storage/trace_storage.h"
 
 namespace perfetto {
 namespace trace_processor {
 
+// Implements the experimental_slice_layout table function which packs the
+// slices of a set of tracks into as few rows as possible (see PlaceGroups()
+// in the .cc file for the algorithm).
+//
+// The layout of each set of tracks is cached and, when slices are added to
+// the slice table, extended with the new slices rather than recomputed: only
+// the new slices of the tracks are visited and the stalactites which were
+// already placed keep their rows unless the new slices make them grow.
 class ExperimentalSliceLayout : public StaticTableFunction {
  public:
   ExperimentalSliceLayout(StringPool* string_pool,
@@ -41,17 +52,55 @@ class ExperimentalSliceLayout : public StaticTableFunction {
                             std::unique_ptr<Table>& table_return) override;
 
  private:
-  std::unique_ptr<Table> ComputeLayoutTable(
-      std::vector<tables::SliceTable::RowNumber> rows,
-      StringPool::Id filter_id);
-  tables::SliceTable::Id InsertSlice(
-      std::map<tables::SliceTable::Id, tables::SliceTable::Id>& id_map,
-      tables::SliceTable::Id id,
-      std::optional<tables::SliceTable::Id> parent_id);
+  // Bounding box of a stalactite: a depth 0 slice and all its descendants.
+  struct Group {
+    int64_t start;
+    int64_t end;
+    uint32_t max_depth;
+    uint32_t layout_depth;
+  };
+
+  struct Layout {
+    // Rows of the slice table in the tracks of the layout and, for each of
+    // them, the index of its group in |groups|.
+    std::vector<uint32_t> rows;
+    std::vector<uint32_t> row_groups;
+    std::vector<Group> groups;
+    base::FlatHashMap<uint32_t, uint32_t> group_by_slice_id;
+
+    // Indices in |rows| of the slices which were incomplete (dur = -1) when
+    // they were added to the layout.
+    std::vector<uint32_t> incomplete_rows;
+
+    // State of the sweep which places the groups: the number of groups
+    // placed (in order of start) and the groups which were still open at the
+    // start of the last placed one, sorted by layout depth.
+    std::vector<uint32_t> groups_by_start;
+    uint32_t placed_group_count = 0;
+    std::vector<uint32_t> open_groups;
+
+    // Number of rows of the slice table which were added to the layout.
+    uint32_t slice_count = 0;
+
+    // Output for the last filter string, dropped whenever the layout changes.
+    std::unique_ptr<Table> table;
+    StringPool::Id table_filter_id;
+  };
+
+  // Adds the slices added to the slice table since the last call to |layout|
+  // and places the new groups. Returns whether the layout changed.
+  bool UpdateLayout(const std::vector<TrackId>& tracks, Layout& layout);
+
+  // Places the groups of |layout| which were not placed yet, starting from
+  // scratch if |reset| is true.
+  static void PlaceGroups(Layout& layout, bool reset);
+
+  std::unique_ptr<Table> ComputeLayoutTable(const Layout& layout,
+                                            StringPool::Id filter_id);
 
   // TODO(lalitm): remove this cache and move to having explicitly scoped
   // lifetimes of dynamic tables.
-  std::unordered_map<StringId, std::unique_ptr<Table>> layout_table_cache_;
+  std::map<std::vector<TrackId>, Layout> layouts_;
 
   StringPool* string_pool_;
   const tables::SliceTable* slice_table_;
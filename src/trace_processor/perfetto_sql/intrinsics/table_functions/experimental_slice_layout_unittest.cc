@@ -318,6 +318,78 @@ TEST(ExperimentalSliceLayoutTest, FilterOutTracks) {
 )");
 }
 
+std::unique_ptr<Table> ComputeLayout(ExperimentalSliceLayout& gen,
+                                     const char* filter_track_ids) {
+  std::unique_ptr<Table> table;
+  auto status = gen.ComputeTable(
+      {Constraint{kColumn, FilterOp::kEq, SqlValue::String(filter_track_ids)}},
+      {}, BitVector(), table);
+  EXPECT_TRUE(status.ok());
+  return table;
+}
+
+TEST(ExperimentalSliceLayoutTest, SlicesAddedAfterQuery) {
+  StringPool pool;
+  tables::SliceTable slice_table(&pool);
+  StringId name = pool.InternString("Slice");
+
+  auto a = Insert(&slice_table, 0 /*ts*/, 4 /*dur*/, 1 /*track_id*/, name,
+                  std::nullopt);
+
+  ExperimentalSliceLayout gen(&pool, &slice_table);
+  ExpectOutput(*ComputeLayout(gen, "1,2"), R"(
+####
+)");
+
+  // A new group is placed after the existing ones.
+  auto p = Insert(&slice_table, 2 /*ts*/, 4 /*dur*/, 2 /*track_id*/, name,
+                  std::nullopt);
+  base::ignore_result(p);
+  ExpectOutput(*ComputeLayout(gen, "1,2"), R"(
+####
+  ####
+)");
+
+  // A group which was already placed grows: the groups after it move down.
+  auto b = Insert(&slice_table, 1 /*ts*/, 2 /*dur*/, 1 /*track_id*/, name, a);
+  base::ignore_result(b);
+  ExpectOutput(*ComputeLayout(gen, "2,1"), R"(
+####
+ ##
+  ####
+)");
+
+  // A group starting before the last placed one.
+  Insert(&slice_table, 0 /*ts*/, 1 /*dur*/, 2 /*track_id*/, name,
+         std::nullopt);
+  ExperimentalSliceLayout fresh_gen(&pool, &slice_table);
+  ASSERT_EQ(ToVis(*ComputeLayout(gen, "1,2")),
+            ToVis(*ComputeLayout(fresh_gen, "1,2")));
+}
+
+TEST(ExperimentalSliceLayoutTest, IncompleteSliceEnds) {
+  StringPool pool;
+  tables::SliceTable slice_table(&pool);
+  StringId name = pool.InternString("Slice");
+
+  auto a = Insert(&slice_table, 0 /*ts*/, -1 /*dur*/, 1 /*track_id*/, name,
+                  std::nullopt);
+  Insert(&slice_table, 3 /*ts*/, 2 /*dur*/, 2 /*track_id*/, name,
+         std::nullopt);
+
+  ExperimentalSliceLayout gen(&pool, &slice_table);
+  ExpectOutput(*ComputeLayout(gen, "1,2"), R"(
+
+   ##
+)");
+
+  // Once the first slice ends, the second one fits on the same row.
+  slice_table.mutable_dur()->Set(a.value, 3);
+  ExpectOutput(*ComputeLayout(gen, "1,2"), R"(
+#####
+)");
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
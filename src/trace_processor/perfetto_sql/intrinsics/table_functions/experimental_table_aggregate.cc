@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/experimental_table_aggregate.h"
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "src/trace_processor/db/runtime_table.h"
+#include "src/trace_processor/perfetto_sql/engine/perfetto_sql_engine.h"
+#include "src/trace_processor/sqlite/sqlite_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr char kFunctionName[] = "experimental_table_aggregate";
+
+enum ColumnIndex : uint32_t {
+  kGroupKey = 0,
+  kCount,
+  kSum,
+  kMin,
+  kMax,
+  kSourceTable,
+  kGroupByColumn,
+  kValueColumn,
+};
+
+template <typename V>
+struct Group {
+  std::optional<int64_t> key;
+  int64_t count = 0;
+  bool has_value = false;
+  V sum = 0;
+  V min = 0;
+  V max = 0;
+};
+
+// Reads the values of |col| at the storage indices |idx| into |out|.
+template <typename S, typename O>
+void GatherTyped(const Column& col,
+                 const std::vector<uint32_t>& idx,
+                 std::vector<std::optional<O>>* out) {
+  if (col.IsNullable()) {
+    const auto& storage = col.storage<std::optional<S>>();
+    for (uint32_t i : idx) {
+      std::optional<S> v = storage.Get(i);
+      out->push_back(v ? std::make_optional(static_cast<O>(*v))
+                       : std::nullopt);
+    }
+    return;
+  }
+  const auto& storage = col.storage<S>();
+  for (uint32_t i : idx) {
+    out->push_back(static_cast<O>(storage.Get(i)));
+  }
+}
+
+// Reads the values of |col| at the storage indices |idx| into |out|. Strings
+// are read as their raw StringPool::Id.
+template <typename O>
+void Gather(const Column& col,
+            const std::vector<uint32_t>& idx,
+            std::vector<std::optional<O>>* out) {
+  out->clear();
+  switch (col.col_type()) {
+    case ColumnType::kInt32:
+      GatherTyped<int32_t>(col, idx, out);
+      return;
+    case ColumnType::kUint32:
+      GatherTyped<uint32_t>(col, idx, out);
+      return;
+    case ColumnType::kInt64:
+      GatherTyped<int64_t>(col, idx, out);
+      return;
+    case ColumnType::kDouble:
+      GatherTyped<double>(col, idx, out);
+      return;
+    case ColumnType::kId:
+      for (uint32_t i : idx) {
+        out->push_back(static_cast<O>(i));
+      }
+      return;
+    case ColumnType::kString: {
+      const auto& storage = col.storage<StringPool::Id>();
+      for (uint32_t i : idx) {
+        StringPool::Id id = storage.Get(i);
+        out->push_back(id.is_null() ? std::nullopt
+                                    : std::make_optional(
+                                          static_cast<O>(id.raw_id())));
+      }
+      return;
+    }
+    case ColumnType::kDummy:
+      PERFETTO_FATAL("Cannot read dummy column");
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+base::Status AddValue(RuntimeTable* table, uint32_t col, int64_t value) {
+  return table->AddInteger(col, value);
+}
+
+base::Status AddValue(RuntimeTable* table, uint32_t col, double value) {
+  return table->AddFloat(col, value);
+}
+
+// Folds the rows of the table into groups, reading |kBatchSize| rows of the key
+// and value columns at a time, and writes one row per group to |out|. Returns
+// the number of groups.
+template <typename V>
+base::StatusOr<uint32_t> Aggregate(const StringPool& pool,
+                                   const Column& key_col,
+                                   const Column& value_col,
+                                   RuntimeTable* out) {
+  std::vector<Group<V>> groups;
+  base::FlatHashMap<int64_t, uint32_t> groups_by_key;
+  std::optional<uint32_t> null_group;
+
+  std::vector<uint32_t> key_idx;
+  std::vector<uint32_t> value_idx;
+  std::vector<std::optional<int64_t>> keys;
+  std::vector<std::optional<V>> values;
+  key_idx.reserve(ExperimentalTableAggregate::kBatchSize);
+  value_idx.reserve(ExperimentalTableAggregate::kBatchSize);
+
+  auto key_it = key_col.overlay().IterateRows();
+  auto value_it = value_col.overlay().IterateRows();
+  while (key_it) {
+    // Resolve the storage indices of the whole batch first so that the
+    // columns are then read with tight loops over their storage.
+    key_idx.clear();
+    value_idx.clear();
+    for (; key_it && key_idx.size() < ExperimentalTableAggregate::kBatchSize;
+         key_it.Next(), value_it.Next()) {
+      key_idx.push_back(key_it.index());
+      value_idx.push_back(value_it.index());
+    }
+    Gather(key_col, key_idx, &keys);
+    Gather(value_col, value_idx, &values);
+
+    for (uint32_t i = 0; i < keys.size(); ++i) {
+      uint32_t group_idx;
+      if (!keys[i]) {
+        if (!null_group) {
+          null_group = static_cast<uint32_t>(groups.size());
+          groups.emplace_back();
+        }
+        group_idx = *null_group;
+      } else {
+        auto it_and_inserted = groups_by_key.Insert(
+            *keys[i], static_cast<uint32_t>(groups.size()));
+        if (it_and_inserted.second) {
+          groups.emplace_back();
+          groups.back().key = keys[i];
+        }
+        group_idx = *it_and_inserted.first;
+      }
+
+      Group<V>& group = groups[group_idx];
+      group.count++;
+      if (!values[i])
+        continue;
+      V value = *values[i];
+      if (!group.has_value) {
+        group.has_value = true;
+        group.min = value;
+        group.max = value;
+      }
+      group.sum += value;
+      group.min = std::min(group.min, value);
+      group.max = std::max(group.max, value);
+    }
+  }
+
+  bool is_string_key = key_col.col_type() == ColumnType::kString;
+  for (const Group<V>& group : groups) {
+    if (!group.key) {
+      RETURN_IF_ERROR(out->AddNull(kGroupKey));
+    } else if (is_string_key) {
+      auto id = StringPool::Id::Raw(static_cast<uint32_t>(*group.key));
+      RETURN_IF_ERROR(out->AddText(kGroupKey, pool.Get(id).c_str()));
+    } else {
+      RETURN_IF_ERROR(out->AddInteger(kGroupKey, *group.key));
+    }
+    RETURN_IF_ERROR(out->AddInteger(kCount, group.count));
+    if (group.has_value) {
+      RETURN_IF_ERROR(AddValue(out, kSum, group.sum));
+      RETURN_IF_ERROR(AddValue(out, kMin, group.min));
+      RETURN_IF_ERROR(AddValue(out, kMax, group.max));
+    } else {
+      RETURN_IF_ERROR(out->AddNull(kSum));
+      RETURN_IF_ERROR(out->AddNull(kMin));
+      RETURN_IF_ERROR(out->AddNull(kMax));
+    }
+  }
+  return static_cast<uint32_t>(groups.size());
+}
+
+const Column* FindColumn(const Table& table, const std::string& name) {
+  auto it = std::find_if(
+      table.columns().begin(), table.columns().end(),
+      [&name](const Column& col) { return name == col.name(); });
+  return it == table.columns().end() ? nullptr : &*it;
+}
+
+const char* FindStringArg(const std::vector<Constraint>& cs, uint32_t col) {
+  auto it = std::find_if(cs.begin(), cs.end(), [col](const Constraint& c) {
+    return c.col_idx == col && c.op == FilterOp::kEq;
+  });
+  if (it == cs.end() || it->value.type != SqlValue::kString)
+    return nullptr;
+  return it->value.AsString();
+}
+
+}  // namespace
+
+ExperimentalTableAggregate::ExperimentalTableAggregate(
+    StringPool* pool,
+    PerfettoSqlEngine* engine)
+    : pool_(pool), engine_(engine) {}
+ExperimentalTableAggregate::~ExperimentalTableAggregate() = default;
+
+Table::Schema ExperimentalTableAggregate::CreateSchema() {
+  // The types of the key and the aggregates depend on the arguments so they
+  // are left undeclared.
+  Table::Schema schema;
+  schema.columns.push_back({"group_key", SqlValue::kNull, false, false, false,
+                            false});
+  schema.columns.push_back({"count", SqlValue::kLong, false, false, false,
+                            false});
+  schema.columns.push_back({"sum", SqlValue::kNull, false, false, false,
+                            false});
+  schema.columns.push_back({"min", SqlValue::kNull, false, false, false,
+                            false});
+  schema.columns.push_back({"max", SqlValue::kNull, false, false, false,
+                            false});
+  schema.columns.push_back({"source_table", SqlValue::kString, false, false,
+                            true, false});
+  schema.columns.push_back({"group_by_column", SqlValue::kString, false,
+                            false, true, false});
+  schema.columns.push_back({"value_column", SqlValue::kString, false, false,
+                            true, false});
+  schema.columns.push_back({"_auto_id", SqlValue::kLong, true, true, true,
+                            false});
+  return schema;
+}
+
+std::string ExperimentalTableAggregate::TableName() {
+  return kFunctionName;
+}
+
+uint32_t ExperimentalTableAggregate::EstimateRowCount() {
+  // The number of groups is unknown until the table is computed.
+  return 1024;
+}
+
+base::Status ExperimentalTableAggregate::ValidateConstraints(
+    const QueryConstraints& qc) {
+  bool has_table = false;
+  bool has_group_by = false;
+  bool has_value = false;
+  for (const auto& c : qc.constraints()) {
+    if (!sqlite_utils::IsOpEq(c.op))
+      continue;
+    has_table |= c.column == static_cast<int>(kSourceTable);
+    has_group_by |= c.column == static_cast<int>(kGroupByColumn);
+    has_value |= c.column == static_cast<int>(kValueColumn);
+  }
+  return has_table && has_group_by && has_value
+             ? base::OkStatus()
+             : base::ErrStatus("Failed to find required constraints");
+}
+
+base::Status ExperimentalTableAggregate::ComputeTable(
+    const std::vector<Constraint>& cs,
+    const std::vector<Order>&,
+    const BitVector&,
+    std::unique_ptr<Table>& table_return) {
+  const char* table_name = FindStringArg(cs, kSourceTable);
+  const char* group_by = FindStringArg(cs, kGroupByColumn);
+  const char* value = FindStringArg(cs, kValueColumn);
+  if (!table_name || !group_by || !value) {
+    return base::ErrStatus("%s: all the arguments must be strings",
+                           kFunctionName);
+  }
+
+  const Table* table = engine_->FindTable(table_name);
+  if (!table) {
+    return base::ErrStatus("%s: table %s does not exist", kFunctionName,
+                           table_name);
+  }
+  auto aggregate =
+      ComputeAggregateTable(pool_, *table, table_name, group_by, value);
+  RETURN_IF_ERROR(aggregate.status());
+  table_return = std::move(*aggregate);
+  return base::OkStatus();
+}
+
+base::StatusOr<std::unique_ptr<Table>>
+ExperimentalTableAggregate::ComputeAggregateTable(
+    StringPool* pool,
+    const Table& table,
+    const std::string& table_name,
+    const std::string& group_by,
+    const std::string& value) {
+  const Column* key_col = FindColumn(table, group_by);
+  const Column* value_col = FindColumn(table, value);
+  if (!key_col || !value_col) {
+    return base::ErrStatus("%s: column %s does not exist in %s", kFunctionName,
+                           key_col ? value.c_str() : group_by.c_str(),
+                           table_name.c_str());
+  }
+  if (key_col->col_type() == ColumnType::kDouble ||
+      key_col->col_type() == ColumnType::kDummy) {
+    return base::ErrStatus("%s: cannot group by column %s", kFunctionName,
+                           group_by.c_str());
+  }
+  if (value_col->col_type() == ColumnType::kString ||
+      value_col->col_type() == ColumnType::kDummy) {
+    return base::ErrStatus("%s: column %s is not numeric", kFunctionName,
+                           value.c_str());
+  }
+
+  std::unique_ptr<RuntimeTable> out(new RuntimeTable(
+      pool, {"group_key", "count", "sum", "min", "max", "source_table",
+             "group_by_column", "value_column"}));
+  base::StatusOr<uint32_t> rows =
+      value_col->col_type() == ColumnType::kDouble
+          ? Aggregate<double>(*pool, *key_col, *value_col, out.get())
+          : Aggregate<int64_t>(*pool, *key_col, *value_col, out.get());
+  RETURN_IF_ERROR(rows.status());
+
+  // Fill the argument columns so that the constraints on them match.
+  for (uint32_t i = 0; i < *rows; ++i) {
+    RETURN_IF_ERROR(out->AddText(kSourceTable, table_name.c_str()));
+    RETURN_IF_ERROR(out->AddText(kGroupByColumn, group_by.c_str()));
+    RETURN_IF_ERROR(out->AddText(kValueColumn, value.c_str()));
+  }
+  RETURN_IF_ERROR(out->AddColumnsAndOverlays(*rows));
+  return std::unique_ptr<Table>(std::move(out));
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_EXPERIMENTAL_TABLE_AGGREGATE_H_
+#define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_EXPERIMENTAL_TABLE_AGGREGATE_H_
+
+#include <memory>
+#include <string>
+
+#include "perfetto/ext/base/status_or.h"
+#include "src/trace_processor/containers/string_pool.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class PerfettoSqlEngine;
+
+// Computes COUNT, SUM, MIN and MAX of a column of a table for each distinct
+// value of another column, i.e. the equivalent of
+//   SELECT group_by, COUNT(), SUM(value), MIN(value), MAX(value)
+//   FROM table GROUP BY group_by
+// but without going through SQLite one cell at a time: rows are read straight
+// from the column storage in batches of |kBatchSize| and folded into the
+// groups.
+//
+// Usage: SELECT * FROM experimental_table_aggregate('slice', 'name', 'dur').
+class ExperimentalTableAggregate : public StaticTableFunction {
+ public:
+  // Number of rows which are read from the columns at once.
+  static constexpr uint32_t kBatchSize = 4096;
+
+  ExperimentalTableAggregate(StringPool* pool, PerfettoSqlEngine* engine);
+  ~ExperimentalTableAggregate() override;
+
+  Table::Schema CreateSchema() override;
+  std::string TableName() override;
+  uint32_t EstimateRowCount() override;
+  base::Status ValidateConstraints(const QueryConstraints&) override;
+  base::Status ComputeTable(const std::vector<Constraint>& cs,
+                            const std::vector<Order>& ob,
+                            const BitVector& cols_used,
+                            std::unique_ptr<Table>& table_return) override;
+
+  // Aggregates the column |value| of |table| grouped by the column |group_by|.
+  // |pool| must be the string pool of |table|. |table_name| is only used to
+  // fill the hidden argument column.
+  static base::StatusOr<std::unique_ptr<Table>> ComputeAggregateTable(
+      StringPool* pool,
+      const Table& table,
+      const std::string& table_name,
+      const std::string& group_by,
+      const std::string& value);
+
+ private:
+  StringPool* pool_ = nullptr;
+  PerfettoSqlEngine* engine_ = nullptr;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_EXPERIMENTAL_TABLE_AGGREGATE_H_
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/experimental_table_aggregate.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+#include "src/trace_processor/db/runtime_table.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(ExperimentalTableAggregate, GroupByString) {
+  StringPool pool;
+  RuntimeTable table(&pool, {"name", "dur"});
+
+  // Span several batches to check that groups are carried across them.
+  const uint32_t kRows = ExperimentalTableAggregate::kBatchSize * 2 + 10;
+  for (uint32_t i = 0; i < kRows; ++i) {
+    if (i % 5 == 4) {
+      ASSERT_TRUE(table.AddNull(0).ok());
+    } else {
+      ASSERT_TRUE(table.AddText(0, i % 2 ? "odd" : "even").ok());
+    }
+    if (i % 7 == 0) {
+      ASSERT_TRUE(table.AddNull(1).ok());
+    } else {
+      ASSERT_TRUE(table.AddInteger(1, i).ok());
+    }
+  }
+  ASSERT_TRUE(table.AddColumnsAndOverlays(kRows).ok());
+
+  auto res = ExperimentalTableAggregate::ComputeAggregateTable(
+      &pool, table, "foo", "name", "dur");
+  ASSERT_TRUE(res.ok()) << res.status().message();
+  const Table& out = **res;
+  ASSERT_EQ(out.row_count(), 3u);
+
+  for (uint32_t row = 0; row < out.row_count(); ++row) {
+    SqlValue key = out.GetColumn(0).Get(row);
+    SqlValue sum = out.GetColumn(2).Get(row);
+    SqlValue min = out.GetColumn(3).Get(row);
+    SqlValue max = out.GetColumn(4).Get(row);
+
+    int64_t count = 0;
+    int64_t expected_sum = 0;
+    int64_t expected_min = std::numeric_limits<int64_t>::max();
+    int64_t expected_max = std::numeric_limits<int64_t>::min();
+    for (uint32_t i = 0; i < kRows; ++i) {
+      bool in_group =
+          key.is_null()
+              ? i % 5 == 4
+              : i % 5 != 4 && (i % 2 == 1) == (key.AsString() ==
+                                               std::string("odd"));
+      if (!in_group)
+        continue;
+      count++;
+      if (i % 7 == 0)
+        continue;
+      expected_sum += i;
+      expected_min = std::min<int64_t>(expected_min, i);
+      expected_max = std::max<int64_t>(expected_max, i);
+    }
+    ASSERT_EQ(out.GetColumn(1).Get(row).AsLong(), count);
+    ASSERT_EQ(sum.AsLong(), expected_sum);
+    ASSERT_EQ(min.AsLong(), expected_min);
+    ASSERT_EQ(max.AsLong(), expected_max);
+    ASSERT_STREQ(out.GetColumn(5).Get(row).AsString(), "foo");
+  }
+}
+
+TEST(ExperimentalTableAggregate, DoubleValues) {
+  StringPool pool;
+  RuntimeTable table(&pool, {"cpu", "value"});
+  for (uint32_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(table.AddInteger(0, i % 4).ok());
+    ASSERT_TRUE(table.AddFloat(1, i * 0.5).ok());
+  }
+  ASSERT_TRUE(table.AddColumnsAndOverlays(100).ok());
+
+  auto res = ExperimentalTableAggregate::ComputeAggregateTable(
+      &pool, table, "foo", "cpu", "value");
+  ASSERT_TRUE(res.ok()) << res.status().message();
+  const Table& out = **res;
+  ASSERT_EQ(out.row_count(), 4u);
+
+  // Groups are returned in the order in which they are first seen.
+  ASSERT_EQ(out.GetColumn(0).Get(1).AsLong(), 1);
+  ASSERT_EQ(out.GetColumn(1).Get(1).AsLong(), 25);
+  ASSERT_DOUBLE_EQ(out.GetColumn(3).Get(1).AsDouble(), 0.5);
+  ASSERT_DOUBLE_EQ(out.GetColumn(4).Get(1).AsDouble(), 48.5);
+}
+
+TEST(ExperimentalTableAggregate, BadColumns) {
+  StringPool pool;
+  RuntimeTable table(&pool, {"name", "value"});
+  ASSERT_TRUE(table.AddText(0, "a").ok());
+  ASSERT_TRUE(table.AddFloat(1, 1.5).ok());
+  ASSERT_TRUE(table.AddColumnsAndOverlays(1).ok());
+
+  ASSERT_FALSE(ExperimentalTableAggregate::ComputeAggregateTable(
+                   &pool, table, "foo", "missing", "value")
+                   .ok());
+  ASSERT_FALSE(ExperimentalTableAggregate::ComputeAggregateTable(
+                   &pool, table, "foo", "value", "value")
+                   .ok());
+  ASSERT_FALSE(ExperimentalTableAggregate::ComputeAggregateTable(
+                   &pool, table, "foo", "name", "name")
+                   .ok());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -16,8 +16,8 @@
 
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/flamegraph_construction_algorithms.h"
 
+#include <algorithm>
 #include <set>
-#include <unordered_set>
 
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
@@ -38,11 +38,6 @@ struct MergedCallsite {
   }
 };
 
-struct FlamegraphTableAndMergedCallsites {
-  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl;
-  std::vector<uint32_t> callsite_to_merged_callsite;
-};
-
 std::vector<MergedCallsite> GetMergedCallsites(TraceStorage* storage,
                                                uint32_t callstack_row) {
   const tables::StackProfileCallsiteTable& callsites_tbl =
@@ -86,24 +81,58 @@ std::vector<MergedCallsite> GetMergedCallsites(TraceStorage* storage,
   std::reverse(result.begin(), result.end());
   return result;
 }
+
+// Each cached profile keeps an entry per sample so only keep a handful of
+// them around.
+constexpr size_t kMaxCachedProfiles = 8;
+
+// Buckets |rows| by the node returned by |node_fn| with a counting sort.
+// Returns the offsets of the buckets: the rows of node i are written, in their
+// original order, to |bucketed_rows| at [offsets[i], offsets[i + 1]).
+template <typename NodeFn>
+std::vector<uint32_t> BucketRowsByNode(size_t node_count,
+                                       const std::vector<uint32_t>& rows,
+                                       const NodeFn& node_fn,
+                                       std::vector<uint32_t>& bucketed_rows) {
+  std::vector<uint32_t> offsets(node_count + 1, 0);
+  for (uint32_t row : rows) {
+    ++offsets[node_fn(row) + 1];
+  }
+  for (size_t i = 1; i < offsets.size(); ++i) {
+    offsets[i] += offsets[i - 1];
+  }
+  std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+  bucketed_rows.resize(rows.size());
+  for (uint32_t row : rows) {
+    bucketed_rows[next[node_fn(row)]++] = row;
+  }
+  return offsets;
+}
+
 }  // namespace
 
-static FlamegraphTableAndMergedCallsites BuildFlamegraphTableTreeStructure(
-    TraceStorage* storage,
-    std::optional<UniquePid> upid,
-    std::optional<std::string> upid_group,
-    int64_t default_timestamp,
-    StringId profile_type) {
+FlamegraphCache::FlamegraphCache(TraceStorage* storage) : storage_(storage) {}
+FlamegraphCache::~FlamegraphCache() = default;
+
+void FlamegraphCache::UpdateCallsiteTree() {
   const tables::StackProfileCallsiteTable& callsites_tbl =
-      storage->stack_profile_callsite_table();
+      storage_->stack_profile_callsite_table();
+  auto row_counts =
+      std::make_tuple(callsites_tbl.row_count(),
+                      storage_->stack_profile_frame_table().row_count(),
+                      storage_->symbol_table().row_count());
+  if (tree_row_counts_ == row_counts) {
+    return;
+  }
+  tree_row_counts_ = row_counts;
 
-  std::vector<uint32_t> callsite_to_merged_callsite(callsites_tbl.row_count(),
-                                                    0);
-  std::map<MergedCallsite, uint32_t> merged_callsites_to_table_idx;
+  // The cached profiles point into the old tree.
+  heap_profiles_.clear();
+  perf_profiles_.clear();
+  nodes_.clear();
+  callsite_to_node_.assign(callsites_tbl.row_count(), 0);
 
-  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl(
-      new tables::ExperimentalFlamegraphNodesTable(
-          storage->mutable_string_pool()));
+  std::map<MergedCallsite, uint32_t> merged_callsites_to_node;
 
   // FORWARD PASS:
   // Aggregate callstacks by frame name / mapping name. Use symbolization
@@ -116,55 +145,24 @@ static FlamegraphTableAndMergedCallsites BuildFlamegraphTableTreeStructure(
       parent_idx = callsites_tbl.id().IndexOf(*opt_parent_id);
       // Make sure what we index into has been populated already.
       PERFETTO_CHECK(*parent_idx < i);
-      parent_idx = callsite_to_merged_callsite[*parent_idx];
+      parent_idx = callsite_to_node_[*parent_idx];
     }
 
-    auto callsites = GetMergedCallsites(storage, i);
+    auto callsites = GetMergedCallsites(storage_, i);
     // Loop below needs to run at least once for parent_idx to get updated.
     PERFETTO_CHECK(!callsites.empty());
     std::map<MergedCallsite, uint32_t> callsites_to_rowid;
     for (MergedCallsite& merged_callsite : callsites) {
       merged_callsite.parent_idx = parent_idx;
-      auto it = merged_callsites_to_table_idx.find(merged_callsite);
-      if (it == merged_callsites_to_table_idx.end()) {
-        std::tie(it, std::ignore) = merged_callsites_to_table_idx.emplace(
-            merged_callsite, merged_callsites_to_table_idx.size());
-        tables::ExperimentalFlamegraphNodesTable::Row row{};
-        if (parent_idx) {
-          row.depth = tbl->depth()[*parent_idx] + 1;
-          row.parent_id = tbl->id()[*parent_idx];
-        } else {
-          row.depth = 0;
-          row.parent_id = std::nullopt;
-        }
-
-        // The 'ts' column is given a default value, taken from the query.
-        // So if the query is:
-        // `select * form experimental_flamegraph
-        //  where ts = 605908369259172
-        //  and upid = 1
-        //  and profile_type = 'native'`
-        // then row.ts == 605908369259172, for all rows
-        // This is not accurate. However, at present there is no other
-        // straightforward way of assigning timestamps to non-leaf nodes in the
-        // flamegraph tree. Non-leaf nodes would have to be assigned >= 1
-        // timestamps, which would increase data size without an advantage.
-        row.ts = default_timestamp;
-        if (upid) {
-          row.upid = *upid;
-        }
-        if (upid_group) {
-          row.upid_group = storage->InternString(base::StringView(*upid_group));
-        }
-        row.profile_type = profile_type;
-        row.name = merged_callsite.frame_name;
-        row.map_name = merged_callsite.mapping_name;
-        tbl->Insert(row);
-        callsites_to_rowid[merged_callsite] =
-            static_cast<uint32_t>(merged_callsites_to_table_idx.size() - 1);
-
-        PERFETTO_CHECK(merged_callsites_to_table_idx.size() ==
-                       tbl->row_count());
+      auto it = merged_callsites_to_node.find(merged_callsite);
+      if (it == merged_callsites_to_node.end()) {
+        std::tie(it, std::ignore) = merged_callsites_to_node.emplace(
+            merged_callsite, static_cast<uint32_t>(nodes_.size()));
+        uint32_t depth = parent_idx ? nodes_[*parent_idx].depth + 1 : 0;
+        nodes_.push_back(Node{merged_callsite.frame_name,
+                              merged_callsite.mapping_name, parent_idx, depth,
+                              std::nullopt, std::nullopt});
+        callsites_to_rowid[merged_callsite] = it->second;
       } else {
         MergedCallsite saved_callsite = it->first;
         callsites_to_rowid.erase(saved_callsite);
@@ -181,174 +179,235 @@ static FlamegraphTableAndMergedCallsites BuildFlamegraphTableTreeStructure(
 
     for (const auto& it : callsites_to_rowid) {
       if (it.first.source_file) {
-        tbl->mutable_source_file()->Set(it.second, *it.first.source_file);
+        nodes_[it.second].source_file = *it.first.source_file;
       }
       if (it.first.line_number) {
-        tbl->mutable_line_number()->Set(it.second, *it.first.line_number);
+        nodes_[it.second].line_number = *it.first.line_number;
       }
     }
 
     PERFETTO_CHECK(parent_idx);
-    callsite_to_merged_callsite[i] = *parent_idx;
+    callsite_to_node_[i] = *parent_idx;
   }
-
-  return {std::move(tbl), callsite_to_merged_callsite};
 }
 
-static std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildFlamegraphTableHeapSizeAndCount(
-    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl,
-    const std::vector<uint32_t>& callsite_to_merged_callsite,
-    const Table& filtered) {
-  for (auto it = filtered.IterateRows(); it; it.Next()) {
-    int64_t size =
-        it.Get(static_cast<uint32_t>(
-                   tables::HeapProfileAllocationTable::ColumnIndex::size))
-            .long_value;
-    int64_t count =
-        it.Get(static_cast<uint32_t>(
-                   tables::HeapProfileAllocationTable::ColumnIndex::count))
-            .long_value;
-    int64_t callsite_id =
-        it
-            .Get(static_cast<uint32_t>(
-                tables::HeapProfileAllocationTable::ColumnIndex::callsite_id))
-            .long_value;
-
-    PERFETTO_CHECK((size <= 0 && count <= 0) || (size >= 0 && count >= 0));
-    uint32_t merged_idx =
-        callsite_to_merged_callsite[static_cast<unsigned long>(callsite_id)];
-    // On old heapprofd producers, the count field is incorrectly set and we
-    // zero it in proto_trace_parser.cc.
-    // As such, we cannot depend on count == 0 to imply size == 0, so we check
-    // for both of them separately.
-    if (size > 0) {
-      tbl->mutable_alloc_size()->Set(merged_idx,
-                                     tbl->alloc_size()[merged_idx] + size);
-    }
-    if (count > 0) {
-      tbl->mutable_alloc_count()->Set(merged_idx,
-                                      tbl->alloc_count()[merged_idx] + count);
+const FlamegraphCache::HeapProfile& FlamegraphCache::GetOrCreateHeapProfile(
+    UniquePid upid) {
+  const tables::HeapProfileAllocationTable& allocation_tbl =
+      storage_->heap_profile_allocation_table();
+  auto it = heap_profiles_.find(upid);
+  if (it != heap_profiles_.end() &&
+      it->second.allocation_count == allocation_tbl.row_count()) {
+    return it->second;
+  }
+  if (it == heap_profiles_.end() &&
+      heap_profiles_.size() >= kMaxCachedProfiles) {
+    heap_profiles_.clear();
+  }
+  HeapProfile& profile = heap_profiles_[upid];
+  profile = HeapProfile();
+  profile.allocation_count = allocation_tbl.row_count();
+
+  std::vector<uint32_t> rows;
+  for (uint32_t i = 0; i < allocation_tbl.row_count(); ++i) {
+    if (allocation_tbl.upid()[i] == upid) {
+      rows.push_back(i);
     }
-
-    tbl->mutable_size()->Set(merged_idx, tbl->size()[merged_idx] + size);
-    tbl->mutable_count()->Set(merged_idx, tbl->count()[merged_idx] + count);
   }
+  std::vector<uint32_t> bucketed_rows;
+  profile.offsets = BucketRowsByNode(
+      nodes_.size(), rows,
+      [&](uint32_t row) {
+        return callsite_to_node_[allocation_tbl.callsite_id()[row].value];
+      },
+      bucketed_rows);
+
+  profile.ts.resize(bucketed_rows.size());
+  profile.sums.resize(bucketed_rows.size());
+  for (uint32_t node = 0; node < nodes_.size(); ++node) {
+    uint32_t begin = profile.offsets[node];
+    uint32_t end = profile.offsets[node + 1];
+    std::stable_sort(bucketed_rows.data() + begin, bucketed_rows.data() + end,
+                     [&allocation_tbl](uint32_t a, uint32_t b) {
+                       return allocation_tbl.ts()[a] < allocation_tbl.ts()[b];
+                     });
+    HeapSums sums;
+    for (uint32_t i = begin; i < end; ++i) {
+      uint32_t row = bucketed_rows[i];
+      int64_t size = allocation_tbl.size()[row];
+      int64_t count = allocation_tbl.count()[row];
+      PERFETTO_CHECK((size <= 0 && count <= 0) || (size >= 0 && count >= 0));
+      // On old heapprofd producers, the count field is incorrectly set and we
+      // zero it in proto_trace_parser.cc.
+      // As such, we cannot depend on count == 0 to imply size == 0, so we
+      // check for both of them separately.
+      if (size > 0) {
+        sums.alloc_size += size;
+      }
+      if (count > 0) {
+        sums.alloc_count += count;
+      }
+      sums.size += size;
+      sums.count += count;
 
-  // BACKWARD PASS:
-  // Propagate sizes to parents.
-  for (int64_t i = tbl->row_count() - 1; i >= 0; --i) {
-    auto idx = static_cast<uint32_t>(i);
-
-    tbl->mutable_cumulative_size()->Set(
-        idx, tbl->cumulative_size()[idx] + tbl->size()[idx]);
-    tbl->mutable_cumulative_count()->Set(
-        idx, tbl->cumulative_count()[idx] + tbl->count()[idx]);
-
-    tbl->mutable_cumulative_alloc_size()->Set(
-        idx, tbl->cumulative_alloc_size()[idx] + tbl->alloc_size()[idx]);
-    tbl->mutable_cumulative_alloc_count()->Set(
-        idx, tbl->cumulative_alloc_count()[idx] + tbl->alloc_count()[idx]);
+      profile.ts[i] = allocation_tbl.ts()[row];
+      profile.sums[i] = sums;
+    }
+  }
+  return profile;
+}
 
-    auto parent = tbl->parent_id()[idx];
-    if (parent) {
-      uint32_t parent_idx = *tbl->id().IndexOf(
-          tables::ExperimentalFlamegraphNodesTable::Id(*parent));
-      tbl->mutable_cumulative_size()->Set(
-          parent_idx,
-          tbl->cumulative_size()[parent_idx] + tbl->cumulative_size()[idx]);
-      tbl->mutable_cumulative_count()->Set(
-          parent_idx,
-          tbl->cumulative_count()[parent_idx] + tbl->cumulative_count()[idx]);
-
-      tbl->mutable_cumulative_alloc_size()->Set(
-          parent_idx, tbl->cumulative_alloc_size()[parent_idx] +
-                          tbl->cumulative_alloc_size()[idx]);
-      tbl->mutable_cumulative_alloc_count()->Set(
-          parent_idx, tbl->cumulative_alloc_count()[parent_idx] +
-                          tbl->cumulative_alloc_count()[idx]);
+const FlamegraphCache::PerfProfile& FlamegraphCache::GetOrCreatePerfProfile(
+    const std::vector<UniquePid>& upids) {
+  const tables::PerfSampleTable& sample_tbl = storage_->perf_sample_table();
+  const tables::ThreadTable& thread_tbl = storage_->thread_table();
+  auto it = perf_profiles_.find(upids);
+  if (it != perf_profiles_.end() &&
+      it->second.sample_count == sample_tbl.row_count() &&
+      it->second.thread_count == thread_tbl.row_count()) {
+    return it->second;
+  }
+  if (it == perf_profiles_.end() &&
+      perf_profiles_.size() >= kMaxCachedProfiles) {
+    perf_profiles_.clear();
+  }
+  PerfProfile& profile = perf_profiles_[upids];
+  profile = PerfProfile();
+  profile.sample_count = sample_tbl.row_count();
+  profile.thread_count = thread_tbl.row_count();
+
+  // Find all the utids of the given upids.
+  std::vector<bool> utid_selected(thread_tbl.row_count());
+  for (uint32_t i = 0; i < thread_tbl.row_count(); ++i) {
+    std::optional<uint32_t> row_upid = thread_tbl.upid()[i];
+    if (row_upid &&
+        std::binary_search(upids.begin(), upids.end(), *row_upid)) {
+      utid_selected[i] = true;
     }
   }
 
-  return tbl;
-}
+  // Get all the samples which have callstacks (some samples can have only
+  // counter values) and correspond to the selected utids.
+  std::vector<uint32_t> rows;
+  for (uint32_t i = 0; i < sample_tbl.row_count(); ++i) {
+    uint32_t utid = sample_tbl.utid()[i];
+    if (sample_tbl.callsite_id()[i].has_value() &&
+        utid < utid_selected.size() && utid_selected[utid]) {
+      rows.push_back(i);
+    }
+  }
 
-static std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildFlamegraphTableCallstackSizeAndCount(
-    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl,
-    const std::vector<uint32_t>& callsite_to_merged_callsite,
-    const Table& filtered) {
-  for (auto it = filtered.IterateRows(); it; it.Next()) {
-    int64_t callsite_id =
-        it.Get(static_cast<uint32_t>(
-                   tables::PerfSampleTable::ColumnIndex::callsite_id))
-            .long_value;
-    int64_t ts =
-        it.Get(static_cast<uint32_t>(tables::PerfSampleTable::ColumnIndex::ts))
-            .long_value;
-
-    uint32_t merged_idx =
-        callsite_to_merged_callsite[static_cast<unsigned long>(callsite_id)];
-    tbl->mutable_size()->Set(merged_idx, tbl->size()[merged_idx] + 1);
-    tbl->mutable_count()->Set(merged_idx, tbl->count()[merged_idx] + 1);
-    tbl->mutable_ts()->Set(merged_idx, ts);
+  // perf_sample is sorted by ts so each bucket is sorted too.
+  std::vector<uint32_t> bucketed_rows;
+  profile.offsets = BucketRowsByNode(
+      nodes_.size(), rows,
+      [&](uint32_t row) {
+        return callsite_to_node_[sample_tbl.callsite_id()[row]->value];
+      },
+      bucketed_rows);
+  profile.ts.resize(bucketed_rows.size());
+  for (uint32_t i = 0; i < bucketed_rows.size(); ++i) {
+    profile.ts[i] = sample_tbl.ts()[bucketed_rows[i]];
   }
+  return profile;
+}
 
+std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
+FlamegraphCache::BuildTable(const std::vector<NodeValues>& values,
+                            std::optional<UniquePid> upid,
+                            std::optional<StringId> upid_group,
+                            StringId profile_type) {
   // BACKWARD PASS:
   // Propagate sizes to parents.
-  for (int64_t i = tbl->row_count() - 1; i >= 0; --i) {
-    auto idx = static_cast<uint32_t>(i);
-
-    tbl->mutable_cumulative_size()->Set(
-        idx, tbl->cumulative_size()[idx] + tbl->size()[idx]);
-    tbl->mutable_cumulative_count()->Set(
-        idx, tbl->cumulative_count()[idx] + tbl->count()[idx]);
-
-    auto parent = tbl->parent_id()[idx];
+  std::vector<HeapSums> cumulative(values.size());
+  for (size_t i = values.size(); i > 0; --i) {
+    size_t idx = i - 1;
+    HeapSums& sums = cumulative[idx];
+    sums.size += values[idx].sums.size;
+    sums.count += values[idx].sums.count;
+    sums.alloc_size += values[idx].sums.alloc_size;
+    sums.alloc_count += values[idx].sums.alloc_count;
+
+    std::optional<uint32_t> parent = nodes_[idx].parent;
     if (parent) {
-      uint32_t parent_idx = *tbl->id().IndexOf(
-          tables::ExperimentalFlamegraphNodesTable::Id(*parent));
-      tbl->mutable_cumulative_size()->Set(
-          parent_idx,
-          tbl->cumulative_size()[parent_idx] + tbl->cumulative_size()[idx]);
-      tbl->mutable_cumulative_count()->Set(
-          parent_idx,
-          tbl->cumulative_count()[parent_idx] + tbl->cumulative_count()[idx]);
+      HeapSums& parent_sums = cumulative[*parent];
+      parent_sums.size += sums.size;
+      parent_sums.count += sums.count;
+      parent_sums.alloc_size += sums.alloc_size;
+      parent_sums.alloc_count += sums.alloc_count;
+    }
+  }
+
+  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl(
+      new tables::ExperimentalFlamegraphNodesTable(
+          storage_->mutable_string_pool()));
+  for (uint32_t i = 0; i < nodes_.size(); ++i) {
+    const Node& node = nodes_[i];
+    tables::ExperimentalFlamegraphNodesTable::Row row{};
+    row.ts = values[i].ts;
+    if (upid) {
+      row.upid = *upid;
+    }
+    row.upid_group = upid_group;
+    row.profile_type = profile_type;
+    row.depth = node.depth;
+    row.name = node.name;
+    row.map_name = node.map_name;
+    if (node.parent) {
+      row.parent_id = tables::ExperimentalFlamegraphNodesTable::Id(*node.parent);
     }
+    row.source_file = node.source_file;
+    row.line_number = node.line_number;
+    row.size = values[i].sums.size;
+    row.count = values[i].sums.count;
+    row.alloc_size = values[i].sums.alloc_size;
+    row.alloc_count = values[i].sums.alloc_count;
+    row.cumulative_size = cumulative[i].size;
+    row.cumulative_count = cumulative[i].count;
+    row.cumulative_alloc_size = cumulative[i].alloc_size;
+    row.cumulative_alloc_count = cumulative[i].alloc_count;
+    tbl->Insert(row);
   }
   return tbl;
 }
 
 std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildHeapProfileFlamegraph(TraceStorage* storage,
-                           UniquePid upid,
-                           int64_t timestamp) {
-  const tables::HeapProfileAllocationTable& allocation_tbl =
-      storage->heap_profile_allocation_table();
+FlamegraphCache::BuildHeapProfileFlamegraph(UniquePid upid,
+                                            int64_t timestamp) {
+  UpdateCallsiteTree();
+  const HeapProfile& profile = GetOrCreateHeapProfile(upid);
+
   // PASS OVER ALLOCATIONS:
-  // Aggregate allocations into the newly built tree.
-  auto filtered = allocation_tbl.Filter(
-      {allocation_tbl.ts().le(timestamp), allocation_tbl.upid().eq(upid)});
-  if (filtered.row_count() == 0) {
+  // The allocations of a node up to |timestamp| are given by the running sum
+  // at the last entry with ts <= |timestamp|.
+  std::vector<NodeValues> values(nodes_.size());
+  bool has_allocations = false;
+  const int64_t* ts = profile.ts.data();
+  for (uint32_t i = 0; i < nodes_.size(); ++i) {
+    values[i].ts = timestamp;
+    const int64_t* begin = ts + profile.offsets[i];
+    const int64_t* end =
+        std::upper_bound(begin, ts + profile.offsets[i + 1], timestamp);
+    if (end == begin) {
+      continue;
+    }
+    has_allocations = true;
+    values[i].sums = profile.sums[static_cast<size_t>(end - ts) - 1];
+  }
+  if (!has_allocations) {
     return nullptr;
   }
-  StringId profile_type = storage->InternString("native");
-  FlamegraphTableAndMergedCallsites table_and_callsites =
-      BuildFlamegraphTableTreeStructure(storage, upid, std::nullopt, timestamp,
-                                        profile_type);
-  return BuildFlamegraphTableHeapSizeAndCount(
-      std::move(table_and_callsites.tbl),
-      table_and_callsites.callsite_to_merged_callsite, filtered);
+  return BuildTable(values, upid, std::nullopt,
+                    storage_->InternString("native"));
 }
 
 std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildNativeCallStackSamplingFlamegraph(
-    TraceStorage* storage,
+FlamegraphCache::BuildNativeCallStackSamplingFlamegraph(
     std::optional<UniquePid> upid,
     std::optional<std::string> upid_group,
     const std::vector<TimeConstraints>& time_constraints) {
   // 1.Extract required upids from input.
-  std::unordered_set<UniquePid> upids;
+  std::set<UniquePid> upids;
   if (upid) {
     upids.insert(*upid);
   } else {
@@ -359,55 +418,19 @@ BuildNativeCallStackSamplingFlamegraph(
       }
     }
   }
-
-  // 2.Create set of all utids mapped to the given vector of upids
-  std::set<tables::ThreadTable::Id> utids;
-  RowMap threads_in_pid_rm;
-  for (uint32_t i = 0; i < storage->thread_table().row_count(); ++i) {
-    std::optional<uint32_t> row_upid = storage->thread_table().upid()[i];
-    if (row_upid && upids.count(*row_upid) > 0) {
-      threads_in_pid_rm.Insert(i);
-    }
-  }
-
-  for (auto it = threads_in_pid_rm.IterateRows(); it; it.Next()) {
-    utids.insert(storage->thread_table().id()[it.index()]);
-  }
-
-  // 3.Get all row indices in perf_sample that have callstacks (some samples
-  // can have only counter values) and correspond to the requested utids.
-  std::vector<uint32_t> cs_rows;
-  for (uint32_t i = 0; i < storage->perf_sample_table().row_count(); ++i) {
-    if (storage->perf_sample_table().callsite_id()[i].has_value() &&
-        utids.find(static_cast<tables::ThreadTable::Id>(
-            storage->perf_sample_table().utid()[i])) != utids.end()) {
-      cs_rows.push_back(i);
-    }
-  }
-
-  // 4.Filter rows that correspond to the selected utids
-  RowMap filtered_rm = RowMap(std::move(cs_rows));
-  Table filtered = storage->perf_sample_table().Apply(std::move(filtered_rm));
-
-  // 5.Filter rows by time constraints
   for (const auto& tc : time_constraints) {
     if (!(tc.op == FilterOp::kGt || tc.op == FilterOp::kLt ||
           tc.op == FilterOp::kGe || tc.op == FilterOp::kLe)) {
       PERFETTO_FATAL("Filter operation %d not permitted for perf.",
                      static_cast<int>(tc.op));
     }
-    Constraint cs = Constraint{
-        static_cast<uint32_t>(tables::PerfSampleTable::ColumnIndex::ts), tc.op,
-        SqlValue::Long(tc.value)};
-    filtered = filtered.Filter({cs});
-  }
-  if (filtered.row_count() == 0) {
-    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> empty_tbl(
-        new tables::ExperimentalFlamegraphNodesTable(
-            storage->mutable_string_pool()));
-    return empty_tbl;
   }
 
+  // 2.Get the samples of each node in the processes, sorted by ts.
+  UpdateCallsiteTree();
+  const PerfProfile& profile = GetOrCreatePerfProfile(
+      std::vector<UniquePid>(upids.begin(), upids.end()));
+
   // The logic underneath is selecting a default timestamp to be used by all
   // frames which do not have a timestamp. The timestamp is taken from the query
   // value and it's not meaningful for the row. It prevents however the rows
@@ -424,13 +447,60 @@ BuildNativeCallStackSamplingFlamegraph(
       default_timestamp = tc.value;
     }
   }
-  StringId profile_type = storage->InternString("perf");
-  FlamegraphTableAndMergedCallsites table_and_callsites =
-      BuildFlamegraphTableTreeStructure(storage, upid, upid_group,
-                                        default_timestamp, profile_type);
-  return BuildFlamegraphTableCallstackSizeAndCount(
-      std::move(table_and_callsites.tbl),
-      table_and_callsites.callsite_to_merged_callsite, filtered);
+
+  // 3.Count the samples of each node within the time constraints.
+  std::vector<NodeValues> values(nodes_.size());
+  bool has_samples = false;
+  const int64_t* ts = profile.ts.data();
+  for (uint32_t i = 0; i < nodes_.size(); ++i) {
+    const int64_t* begin = ts + profile.offsets[i];
+    const int64_t* end = ts + profile.offsets[i + 1];
+    for (const auto& tc : time_constraints) {
+      switch (tc.op) {
+        case FilterOp::kGt:
+          begin = std::upper_bound(begin, end, tc.value);
+          break;
+        case FilterOp::kGe:
+          begin = std::lower_bound(begin, end, tc.value);
+          break;
+        case FilterOp::kLt:
+          end = std::lower_bound(begin, end, tc.value);
+          break;
+        case FilterOp::kLe:
+          end = std::upper_bound(begin, end, tc.value);
+          break;
+        case FilterOp::kEq:
+        case FilterOp::kNe:
+        case FilterOp::kIsNull:
+        case FilterOp::kIsNotNull:
+        case FilterOp::kGlob:
+        case FilterOp::kRegex:
+          PERFETTO_FATAL("Checked above");
+      }
+    }
+    values[i].ts = default_timestamp;
+    if (end <= begin) {
+      continue;
+    }
+    has_samples = true;
+    int64_t samples = end - begin;
+    values[i].ts = *(end - 1);
+    values[i].sums.size = samples;
+    values[i].sums.count = samples;
+  }
+  if (!has_samples) {
+    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> empty_tbl(
+        new tables::ExperimentalFlamegraphNodesTable(
+            storage_->mutable_string_pool()));
+    return empty_tbl;
+  }
+
+  std::optional<StringId> upid_group_id;
+  if (upid_group) {
+    upid_group_id = storage_->InternString(base::StringView(*upid_group));
+  }
+  return BuildTable(values, upid, upid_group_id,
+                    storage_->InternString("perf"));
 }
 
 }  // namespace trace_processor
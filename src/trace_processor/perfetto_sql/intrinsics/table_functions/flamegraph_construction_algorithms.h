@@ -17,6 +17,12 @@
 #ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_FLAMEGRAPH_CONSTRUCTION_ALGORITHMS_H_
 #define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_FLAMEGRAPH_CONSTRUCTION_ALGORITHMS_H_
 
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
 #include "src/trace_processor/storage/trace_storage.h"
 
 namespace perfetto {
@@ -28,17 +34,90 @@ struct TimeConstraints {
   int64_t value;
 };
 
-std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildHeapProfileFlamegraph(TraceStorage* storage,
-                           UniquePid upid,
-                           int64_t timestamp);
-
-std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildNativeCallStackSamplingFlamegraph(
-    TraceStorage* storage,
-    std::optional<UniquePid> upid,
-    std::optional<std::string> upid_group,
-    const std::vector<TimeConstraints>& time_constraints);
+// Builds the flamegraphs of heap profiles and perf samples.
+//
+// The tree of merged callsites, which is shared by all the flamegraphs, and,
+// for each profile (i.e. upid or set of upids and profile type), the sorted
+// timestamps of the samples attributed to each node of the tree are cached
+// across calls. Changing the time range of a flamegraph then only needs a
+// binary search per node instead of rebuilding the tree and filtering all the
+// samples again. The caches are rebuilt when the tables they were computed
+// from grow.
+class FlamegraphCache {
+ public:
+  explicit FlamegraphCache(TraceStorage* storage);
+  ~FlamegraphCache();
+
+  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
+  BuildHeapProfileFlamegraph(UniquePid upid, int64_t timestamp);
+
+  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
+  BuildNativeCallStackSamplingFlamegraph(
+      std::optional<UniquePid> upid,
+      std::optional<std::string> upid_group,
+      const std::vector<TimeConstraints>& time_constraints);
+
+ private:
+  struct Node {
+    StringId name;
+    StringId map_name;
+    std::optional<uint32_t> parent;
+    uint32_t depth;
+    std::optional<StringId> source_file;
+    std::optional<uint32_t> line_number;
+  };
+
+  // Sums of the allocations attributed to a node.
+  struct HeapSums {
+    int64_t size = 0;
+    int64_t count = 0;
+    int64_t alloc_size = 0;
+    int64_t alloc_count = 0;
+  };
+
+  // The entries of node i are at [offsets[i], offsets[i + 1]), sorted by ts.
+  struct HeapProfile {
+    uint32_t allocation_count = 0;
+    std::vector<uint32_t> offsets;
+    std::vector<int64_t> ts;
+    // Running sums of the allocations of a node, up to and including each
+    // entry.
+    std::vector<HeapSums> sums;
+  };
+  struct PerfProfile {
+    uint32_t sample_count = 0;
+    uint32_t thread_count = 0;
+    std::vector<uint32_t> offsets;
+    std::vector<int64_t> ts;
+  };
+
+  // Self values of a node in a flamegraph.
+  struct NodeValues {
+    int64_t ts = 0;
+    HeapSums sums;
+  };
+
+  void UpdateCallsiteTree();
+  const HeapProfile& GetOrCreateHeapProfile(UniquePid upid);
+  const PerfProfile& GetOrCreatePerfProfile(const std::vector<UniquePid>& upids);
+  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> BuildTable(
+      const std::vector<NodeValues>& values,
+      std::optional<UniquePid> upid,
+      std::optional<StringId> upid_group,
+      StringId profile_type);
+
+  TraceStorage* const storage_;
+
+  // Merged callsites: parents always come before their children.
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> callsite_to_node_;
+  // Row counts of the tables |nodes_| was built from.
+  std::optional<std::tuple<uint32_t, uint32_t, uint32_t>> tree_row_counts_;
+
+  std::map<UniquePid, HeapProfile> heap_profiles_;
+  std::map<std::vector<UniquePid>, PerfProfile> perf_profiles_;
+};
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/flamegraph_construction_algorithms.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using testing::ElementsAre;
+
+class FlamegraphCacheTest : public ::testing::Test {
+ public:
+  FlamegraphCacheTest() {
+    tables::StackProfileMappingTable::Row mapping;
+    mapping.name = storage_.InternString("libfoo.so");
+    MappingId mapping_id =
+        storage_.mutable_stack_profile_mapping_table()->Insert(mapping).id;
+
+    // main -> foo, main -> bar.
+    FrameId main = InsertFrame(mapping_id, "main");
+    FrameId foo = InsertFrame(mapping_id, "foo");
+    FrameId bar = InsertFrame(mapping_id, "bar");
+    main_ = InsertCallsite(main, std::nullopt);
+    foo_ = InsertCallsite(foo, main_);
+    bar_ = InsertCallsite(bar, main_);
+
+    tables::ThreadTable::Row thread;
+    thread.upid = 1;
+    storage_.mutable_thread_table()->Insert(thread);
+  }
+
+ protected:
+  FrameId InsertFrame(MappingId mapping, const char* name) {
+    tables::StackProfileFrameTable::Row row;
+    row.name = storage_.InternString(name);
+    row.mapping = mapping;
+    return storage_.mutable_stack_profile_frame_table()->Insert(row).id;
+  }
+
+  CallsiteId InsertCallsite(FrameId frame, std::optional<CallsiteId> parent) {
+    tables::StackProfileCallsiteTable::Row row;
+    row.frame_id = frame;
+    row.parent_id = parent;
+    row.depth = parent ? 1 : 0;
+    return storage_.mutable_stack_profile_callsite_table()->Insert(row).id;
+  }
+
+  void InsertSample(int64_t ts, CallsiteId callsite) {
+    tables::PerfSampleTable::Row row;
+    row.ts = ts;
+    row.utid = 0;
+    row.callsite_id = callsite;
+    storage_.mutable_perf_sample_table()->Insert(row);
+  }
+
+  std::vector<int64_t> CumulativeCounts(
+      FlamegraphCache& cache,
+      const std::vector<TimeConstraints>& time_constraints) {
+    auto tbl = cache.BuildNativeCallStackSamplingFlamegraph(1, std::nullopt,
+                                                            time_constraints);
+    std::vector<int64_t> counts;
+    for (uint32_t i = 0; i < tbl->row_count(); ++i)
+      counts.push_back(tbl->cumulative_count()[i]);
+    return counts;
+  }
+
+  TraceStorage storage_;
+  CallsiteId main_{0};
+  CallsiteId foo_{0};
+  CallsiteId bar_{0};
+};
+
+TEST_F(FlamegraphCacheTest, PerfTimeRanges) {
+  InsertSample(10, foo_);
+  InsertSample(20, bar_);
+  InsertSample(30, foo_);
+  InsertSample(40, main_);
+
+  FlamegraphCache cache(&storage_);
+
+  // Rows are main, foo, bar.
+  ASSERT_THAT(CumulativeCounts(cache, {}), ElementsAre(4, 2, 1));
+  ASSERT_THAT(CumulativeCounts(cache, {{FilterOp::kGe, 20}}),
+              ElementsAre(3, 1, 1));
+  ASSERT_THAT(
+      CumulativeCounts(cache, {{FilterOp::kGt, 10}, {FilterOp::kLt, 40}}),
+      ElementsAre(2, 1, 1));
+  ASSERT_THAT(CumulativeCounts(cache, {{FilterOp::kLe, 30}}),
+              ElementsAre(3, 2, 1));
+
+  auto tbl = cache.BuildNativeCallStackSamplingFlamegraph(
+      1, std::nullopt, {{FilterOp::kGt, 100}});
+  ASSERT_EQ(tbl->row_count(), 0u);
+
+  // New samples must invalidate the cached profile.
+  InsertSample(50, bar_);
+  ASSERT_THAT(CumulativeCounts(cache, {{FilterOp::kGe, 20}}),
+              ElementsAre(4, 1, 2));
+}
+
+TEST_F(FlamegraphCacheTest, HeapProfile) {
+  auto* allocations = storage_.mutable_heap_profile_allocation_table();
+  tables::HeapProfileAllocationTable::Row row;
+  row.upid = 1;
+  row.ts = 10;
+  row.callsite_id = foo_;
+  row.size = 100;
+  row.count = 1;
+  allocations->Insert(row);
+  row.ts = 20;
+  row.size = -60;
+  row.count = -1;
+  allocations->Insert(row);
+  row.ts = 20;
+  row.callsite_id = bar_;
+  row.size = 10;
+  row.count = 1;
+  allocations->Insert(row);
+
+  FlamegraphCache cache(&storage_);
+  ASSERT_EQ(cache.BuildHeapProfileFlamegraph(1, 5), nullptr);
+
+  auto tbl = cache.BuildHeapProfileFlamegraph(1, 10);
+  ASSERT_EQ(tbl->cumulative_size()[0], 100);
+  ASSERT_EQ(tbl->cumulative_alloc_size()[0], 100);
+
+  tbl = cache.BuildHeapProfileFlamegraph(1, 20);
+  ASSERT_EQ(tbl->cumulative_size()[0], 50);
+  ASSERT_EQ(tbl->cumulative_alloc_size()[0], 110);
+  ASSERT_EQ(tbl->size()[1], 40);
+  ASSERT_EQ(tbl->alloc_count()[1], 1);
+  ASSERT_EQ(tbl->count()[2], 1);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/flow_index.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Groups the rows of |flows| by the slice in |slice_col| into
+// |flows_by_slice|, keeping them in row order within each group.
+void BuildCsr(const TypedColumn<SliceId>& slice_col,
+              uint32_t flow_count,
+              uint32_t slice_count,
+              std::vector<uint32_t>& offsets,
+              std::vector<uint32_t>& flows_by_slice) {
+  offsets.assign(slice_count + 1, 0);
+  for (uint32_t i = 0; i < flow_count; ++i) {
+    uint32_t slice = slice_col[i].value;
+    if (slice < slice_count)
+      ++offsets[slice + 1];
+  }
+  for (uint32_t i = 1; i <= slice_count; ++i)
+    offsets[i] += offsets[i - 1];
+
+  flows_by_slice.assign(offsets[slice_count], 0);
+  std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+  for (uint32_t i = 0; i < flow_count; ++i) {
+    uint32_t slice = slice_col[i].value;
+    if (slice < slice_count)
+      flows_by_slice[next[slice]++] = i;
+  }
+}
+
+}  // namespace
+
+FlowIndex::FlowIndex(const tables::FlowTable* flows,
+                     const tables::SliceTable* slices)
+    : flows_(flows), slices_(slices) {}
+FlowIndex::~FlowIndex() = default;
+
+void FlowIndex::MaybeRebuild() {
+  uint32_t flow_count = flows_->row_count();
+  uint32_t slice_count = slices_->row_count();
+  if (flow_count == indexed_flow_count_ && slice_count == indexed_slice_count_)
+    return;
+  indexed_flow_count_ = flow_count;
+  indexed_slice_count_ = slice_count;
+
+  // Slices are root table rows so the id of a slice is also its row.
+  BuildCsr(flows_->slice_out(), flow_count, slice_count, out_offsets_,
+           out_flows_);
+  BuildCsr(flows_->slice_in(), flow_count, slice_count, in_offsets_,
+           in_flows_);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_FLOW_INDEX_H_
+#define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_FLOW_INDEX_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Adjacency lists of the graph formed by the flow table over the slices,
+// shared by the connected flow table functions.
+//
+// The rows of the flows leaving and entering each slice are stored in CSR
+// form (an array of flow rows grouped by slice plus the offset of each
+// slice's group) so following the flows of a slice is an array walk rather
+// than a filter of the whole flow table.
+//
+// The index is built on first use and rebuilt whenever rows are added to the
+// flow or slice tables.
+class FlowIndex {
+ public:
+  struct Range {
+    const uint32_t* begin() const { return begin_; }
+    const uint32_t* end() const { return end_; }
+
+    const uint32_t* begin_;
+    const uint32_t* end_;
+  };
+
+  FlowIndex(const tables::FlowTable* flows, const tables::SliceTable* slices);
+  ~FlowIndex();
+
+  // Returns the rows of the flows with slice_out = |slice_row|, in row order.
+  Range GetOutgoing(uint32_t slice_row) {
+    MaybeRebuild();
+    return GetRange(out_offsets_, out_flows_, slice_row);
+  }
+
+  // Returns the rows of the flows with slice_in = |slice_row|, in row order.
+  Range GetIncoming(uint32_t slice_row) {
+    MaybeRebuild();
+    return GetRange(in_offsets_, in_flows_, slice_row);
+  }
+
+ private:
+  FlowIndex(const FlowIndex&) = delete;
+  FlowIndex& operator=(const FlowIndex&) = delete;
+
+  static Range GetRange(const std::vector<uint32_t>& offsets,
+                        const std::vector<uint32_t>& flows,
+                        uint32_t slice_row) {
+    if (slice_row + 1 >= offsets.size())
+      return Range{nullptr, nullptr};
+    return Range{flows.data() + offsets[slice_row],
+                 flows.data() + offsets[slice_row + 1]};
+  }
+
+  void MaybeRebuild();
+
+  const tables::FlowTable* flows_ = nullptr;
+  const tables::SliceTable* slices_ = nullptr;
+  uint32_t indexed_flow_count_ = 0;
+  uint32_t indexed_slice_count_ = 0;
+
+  // The flows leaving the slice at row i are
+  // out_flows_[out_offsets_[i]:out_offsets_[i + 1]], and similarly for the
+  // flows entering it.
+  std::vector<uint32_t> out_offsets_;
+  std::vector<uint32_t> out_flows_;
+  std::vector<uint32_t> in_offsets_;
+  std::vector<uint32_t> in_flows_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_FLOW_INDEX_H_
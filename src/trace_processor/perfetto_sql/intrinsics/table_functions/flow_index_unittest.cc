@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/flow_index.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+std::vector<uint32_t> ToVector(FlowIndex::Range range) {
+  return std::vector<uint32_t>(range.begin(), range.end());
+}
+
+void InsertFlow(tables::FlowTable* table, uint32_t out, uint32_t in) {
+  tables::FlowTable::Row row;
+  row.slice_out = SliceId(out);
+  row.slice_in = SliceId(in);
+  table->Insert(row);
+}
+
+TEST(FlowIndex, GroupsFlowsBySlice) {
+  StringPool pool;
+  tables::SliceTable slices(&pool);
+  tables::FlowTable flows(&pool);
+  for (uint32_t i = 0; i < 4; ++i)
+    slices.Insert({});
+  InsertFlow(&flows, 0 /*out*/, 1 /*in*/);
+  InsertFlow(&flows, 2, 1);
+  InsertFlow(&flows, 0, 3);
+
+  FlowIndex index(&flows, &slices);
+  ASSERT_THAT(ToVector(index.GetOutgoing(0)), ElementsAre(0u, 2u));
+  ASSERT_THAT(ToVector(index.GetOutgoing(1)), IsEmpty());
+  ASSERT_THAT(ToVector(index.GetOutgoing(2)), ElementsAre(1u));
+  ASSERT_THAT(ToVector(index.GetIncoming(1)), ElementsAre(0u, 1u));
+  ASSERT_THAT(ToVector(index.GetIncoming(3)), ElementsAre(2u));
+  ASSERT_THAT(ToVector(index.GetIncoming(100)), IsEmpty());
+}
+
+TEST(FlowIndex, RowsAddedAfterQuery) {
+  StringPool pool;
+  tables::SliceTable slices(&pool);
+  tables::FlowTable flows(&pool);
+  slices.Insert({});
+  slices.Insert({});
+  InsertFlow(&flows, 0 /*out*/, 1 /*in*/);
+
+  FlowIndex index(&flows, &slices);
+  ASSERT_THAT(ToVector(index.GetOutgoing(0)), ElementsAre(0u));
+  ASSERT_THAT(ToVector(index.GetOutgoing(1)), IsEmpty());
+
+  slices.Insert({});
+  InsertFlow(&flows, 1, 2);
+  ASSERT_THAT(ToVector(index.GetOutgoing(1)), ElementsAre(1u));
+  ASSERT_THAT(ToVector(index.GetIncoming(2)), ElementsAre(1u));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
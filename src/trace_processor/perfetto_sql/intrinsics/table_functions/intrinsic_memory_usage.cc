@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/intrinsic_memory_usage.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "src/trace_processor/db/runtime_table.h"
+#include "src/trace_processor/perfetto_sql/engine/perfetto_sql_engine.h"
+#include "src/trace_processor/sorter/trace_sorter.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr char kFunctionName[] = "__intrinsic_memory_usage";
+
+enum ColumnIndex : uint32_t {
+  kKind = 0,
+  kTableName,
+  kColumnName,
+  kUsedBytes,
+  kReservedBytes,
+};
+
+base::Status AddOptionalText(RuntimeTable* table,
+                             uint32_t col,
+                             const std::optional<std::string>& value) {
+  return value ? table->AddText(col, value->c_str()) : table->AddNull(col);
+}
+
+}  // namespace
+
+IntrinsicMemoryUsage::IntrinsicMemoryUsage(TraceProcessorContext* context,
+                                           PerfettoSqlEngine* engine)
+    : context_(context), engine_(engine) {}
+IntrinsicMemoryUsage::~IntrinsicMemoryUsage() = default;
+
+Table::Schema IntrinsicMemoryUsage::CreateSchema() {
+  Table::Schema schema;
+  schema.columns.push_back({"kind", SqlValue::kString, false, false, false,
+                            false});
+  schema.columns.push_back({"table_name", SqlValue::kString, false, false,
+                            false, false});
+  schema.columns.push_back({"column_name", SqlValue::kString, false, false,
+                            false, false});
+  schema.columns.push_back({"used_bytes", SqlValue::kLong, false, false, false,
+                            false});
+  schema.columns.push_back({"reserved_bytes", SqlValue::kLong, false, false,
+                            false, false});
+  return schema;
+}
+
+std::string IntrinsicMemoryUsage::TableName() {
+  return kFunctionName;
+}
+
+uint32_t IntrinsicMemoryUsage::EstimateRowCount() {
+  return 1024;
+}
+
+base::Status IntrinsicMemoryUsage::ValidateConstraints(
+    const QueryConstraints&) {
+  return base::OkStatus();
+}
+
+base::Status IntrinsicMemoryUsage::ComputeTable(
+    const std::vector<Constraint>&,
+    const std::vector<Order>&,
+    const BitVector&,
+    std::unique_ptr<Table>& table_return) {
+  // Measure everything before the output table starts interning strings.
+  std::vector<Entry> entries = ComputeEntries(context_, engine_);
+
+  std::unique_ptr<RuntimeTable> out(
+      new RuntimeTable(context_->storage->mutable_string_pool(),
+                       {"kind", "table_name", "column_name", "used_bytes",
+                        "reserved_bytes"}));
+  for (const Entry& entry : entries) {
+    RETURN_IF_ERROR(out->AddText(kKind, entry.kind));
+    RETURN_IF_ERROR(AddOptionalText(out.get(), kTableName, entry.table_name));
+    RETURN_IF_ERROR(
+        AddOptionalText(out.get(), kColumnName, entry.column_name));
+    RETURN_IF_ERROR(out->AddInteger(
+        kUsedBytes, static_cast<int64_t>(entry.usage.used_bytes)));
+    RETURN_IF_ERROR(out->AddInteger(
+        kReservedBytes, static_cast<int64_t>(entry.usage.reserved_bytes)));
+  }
+  RETURN_IF_ERROR(
+      out->AddColumnsAndOverlays(static_cast<uint32_t>(entries.size())));
+  table_return = std::move(out);
+  return base::OkStatus();
+}
+
+// static
+std::vector<IntrinsicMemoryUsage::Entry> IntrinsicMemoryUsage::ComputeEntries(
+    TraceProcessorContext* context,
+    PerfettoSqlEngine* engine) {
+  // Tables registered under several names are only reported once, under the
+  // first of their names.
+  std::vector<std::pair<std::string, const Table*>> all_tables =
+      engine->GetAllTables();
+  std::sort(all_tables.begin(), all_tables.end());
+  std::vector<std::pair<std::string, const Table*>> tables;
+  base::FlatHashMap<const Table*, bool> seen_tables;
+  for (auto& name_and_table : all_tables) {
+    if (seen_tables.Insert(name_and_table.second, true).second)
+      tables.emplace_back(std::move(name_and_table));
+  }
+
+  // Picks, for every column storage, the table it is reported under.
+  base::FlatHashMap<const ColumnStorageBase*, size_t> owners;
+  for (size_t i = 0; i < tables.size(); ++i) {
+    for (const Column& col : tables[i].second->columns()) {
+      if (col.IsId() || col.IsDummy())
+        continue;
+      auto it_and_inserted = owners.Insert(&col.storage_base(), i);
+      size_t& owner = *it_and_inserted.first;
+      if (tables[i].second->columns().size() <
+          tables[owner].second->columns().size()) {
+        owner = i;
+      }
+    }
+  }
+
+  std::vector<Entry> entries;
+  for (size_t i = 0; i < tables.size(); ++i) {
+    const std::string& name = tables[i].first;
+    const Table& table = *tables[i].second;
+    for (const Column& col : table.columns()) {
+      if (col.IsId() || col.IsDummy())
+        continue;
+      const ColumnStorageBase& storage = col.storage_base();
+      if (*owners.Find(&storage) != i)
+        continue;
+      entries.push_back(
+          Entry{"column", name, col.name(), storage.GetMemoryUsage()});
+    }
+    MemoryUsage overlays;
+    for (const ColumnStorageOverlay& overlay : table.overlays()) {
+      overlays += overlay.row_map().GetMemoryUsage();
+    }
+    entries.push_back(Entry{"overlays", name, std::nullopt, overlays});
+  }
+
+  entries.push_back(Entry{"string_pool", std::nullopt, std::nullopt,
+                          context->storage->string_pool().GetMemoryUsage()});
+  if (context->sorter) {
+    entries.push_back(Entry{"sorter", std::nullopt, std::nullopt,
+                            context->sorter->GetMemoryUsage()});
+  }
+  return entries;
+}
+
+// static
+MemoryUsage IntrinsicMemoryUsage::ComputeTotal(TraceProcessorContext* context,
+                                               PerfettoSqlEngine* engine) {
+  MemoryUsage total;
+  for (const Entry& entry : ComputeEntries(context, engine)) {
+    total += entry.usage;
+  }
+  return total;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
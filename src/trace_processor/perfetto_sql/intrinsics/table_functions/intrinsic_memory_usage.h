@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_INTRINSIC_MEMORY_USAGE_H_
+#define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_INTRINSIC_MEMORY_USAGE_H_
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "src/trace_processor/containers/memory_usage.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class PerfettoSqlEngine;
+class TraceProcessorContext;
+
+// Breaks down the memory held by trace processor: one row for the storage of
+// every column of every static and runtime table, one row for the overlays of
+// every table, one for the string pool and, while the trace is being parsed,
+// one for the events buffered in the sorter.
+//
+// Child tables share the storage of the columns they inherit with their
+// parent: such storage is only reported once, under the table with the fewest
+// columns (i.e. the root of the hierarchy).
+//
+// Usage: SELECT * FROM __intrinsic_memory_usage.
+class IntrinsicMemoryUsage : public StaticTableFunction {
+ public:
+  struct Entry {
+    // One of "column", "overlays", "string_pool" or "sorter".
+    const char* kind;
+    std::optional<std::string> table_name;
+    std::optional<std::string> column_name;
+    MemoryUsage usage;
+  };
+
+  IntrinsicMemoryUsage(TraceProcessorContext* context,
+                       PerfettoSqlEngine* engine);
+  ~IntrinsicMemoryUsage() override;
+
+  Table::Schema CreateSchema() override;
+  std::string TableName() override;
+  uint32_t EstimateRowCount() override;
+  base::Status ValidateConstraints(const QueryConstraints&) override;
+  base::Status ComputeTable(const std::vector<Constraint>& cs,
+                            const std::vector<Order>& ob,
+                            const BitVector& cols_used,
+                            std::unique_ptr<Table>& table_return) override;
+
+  // Returns the rows of the table.
+  static std::vector<Entry> ComputeEntries(TraceProcessorContext* context,
+                                           PerfettoSqlEngine* engine);
+
+  // Returns the sum of all the rows of the table.
+  static MemoryUsage ComputeTotal(TraceProcessorContext* context,
+                                  PerfettoSqlEngine* engine);
+
+ private:
+  TraceProcessorContext* context_ = nullptr;
+  PerfettoSqlEngine* engine_ = nullptr;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_INTRINSIC_MEMORY_USAGE_H_
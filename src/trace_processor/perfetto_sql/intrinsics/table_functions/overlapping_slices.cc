@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/overlapping_slices.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <limits>
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/tables_py.h"
+#include "src/trace_processor/sqlite/sqlite_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace tables {
+
+OverlappingSlicesTable::~OverlappingSlicesTable() = default;
+
+}  // namespace tables
+
+namespace {
+
+using OverlappingSlicesTable = tables::OverlappingSlicesTable;
+
+constexpr int64_t kMaxTs = std::numeric_limits<int64_t>::max();
+
+// Returns the end of a slice, treating incomplete slices (dur = -1) as
+// extending to the end of the trace.
+int64_t SliceEnd(int64_t ts, int64_t dur) {
+  if (dur < 0 || dur > kMaxTs - ts)
+    return kMaxTs;
+  return ts + dur;
+}
+
+const Constraint* FindEqConstraint(const std::vector<Constraint>& cs,
+                                   uint32_t col) {
+  auto it = std::find_if(cs.begin(), cs.end(), [col](const Constraint& c) {
+    return c.col_idx == col && c.op == FilterOp::kEq;
+  });
+  return it == cs.end() ? nullptr : &*it;
+}
+
+}  // namespace
+
+OverlappingSlices::OverlappingSlices(const tables::SliceTable* table)
+    : slice_table_(table) {}
+OverlappingSlices::~OverlappingSlices() = default;
+
+Table::Schema OverlappingSlices::CreateSchema() {
+  return OverlappingSlicesTable::ComputeStaticSchema();
+}
+
+std::string OverlappingSlices::TableName() {
+  return OverlappingSlicesTable::Name();
+}
+
+uint32_t OverlappingSlices::EstimateRowCount() {
+  // Usually only a small fraction of the slices of a single track match.
+  return 1;
+}
+
+base::Status OverlappingSlices::ValidateConstraints(
+    const QueryConstraints& qc) {
+  const auto& cs = qc.constraints();
+  for (uint32_t col : {OverlappingSlicesTable::ColumnIndex::in_track_id,
+                       OverlappingSlicesTable::ColumnIndex::in_ts,
+                       OverlappingSlicesTable::ColumnIndex::in_dur}) {
+    auto fn = [col](const QueryConstraints::Constraint& c) {
+      return c.column == static_cast<int>(col) && sqlite_utils::IsOpEq(c.op);
+    };
+    if (std::find_if(cs.begin(), cs.end(), fn) == cs.end())
+      return base::ErrStatus("Failed to find required constraints");
+  }
+  return base::OkStatus();
+}
+
+base::Status OverlappingSlices::ComputeTable(
+    const std::vector<Constraint>& cs,
+    const std::vector<Order>&,
+    const BitVector&,
+    std::unique_ptr<Table>& table_return) {
+  const Constraint* track_c = FindEqConstraint(
+      cs, OverlappingSlicesTable::ColumnIndex::in_track_id);
+  const Constraint* ts_c =
+      FindEqConstraint(cs, OverlappingSlicesTable::ColumnIndex::in_ts);
+  const Constraint* dur_c =
+      FindEqConstraint(cs, OverlappingSlicesTable::ColumnIndex::in_dur);
+  if (!track_c || !ts_c || !dur_c)
+    return base::ErrStatus("overlapping_slices: missing arguments");
+
+  if (track_c->value.is_null() || ts_c->value.is_null() ||
+      dur_c->value.is_null()) {
+    // Nothing overlaps a null interval so return an empty table.
+    table_return =
+        OverlappingSlicesTable::SelectAndExtendParent(*slice_table_, {}, {},
+                                                      {}, {});
+    return base::OkStatus();
+  }
+  if (track_c->value.type != SqlValue::Type::kLong ||
+      ts_c->value.type != SqlValue::Type::kLong ||
+      dur_c->value.type != SqlValue::Type::kLong) {
+    return base::ErrStatus(
+        "overlapping_slices: track_id, ts and dur should be integers");
+  }
+
+  int64_t track_id = track_c->value.AsLong();
+  int64_t ts = ts_c->value.AsLong();
+  int64_t dur = dur_c->value.AsLong();
+  if (dur < 0)
+    return base::ErrStatus("overlapping_slices: dur should not be negative");
+  if (track_id < 0 || track_id > std::numeric_limits<uint32_t>::max()) {
+    return base::ErrStatus("overlapping_slices: invalid track_id %" PRId64,
+                           track_id);
+  }
+  int64_t end = SliceEnd(ts, dur);
+
+  std::vector<uint32_t> rows;
+  const IntervalIndex* index =
+      GetOrCreateIndex(TrackId(static_cast<uint32_t>(track_id)));
+  if (index)
+    index->FindOverlaps(ts, end, rows);
+
+  // Incomplete slices are indexed as if they never end: now that they may
+  // have ended, check them against their current duration.
+  const auto& ts_col = slice_table_->ts();
+  const auto& dur_col = slice_table_->dur();
+  rows.erase(std::remove_if(rows.begin(), rows.end(),
+                            [&](uint32_t row) {
+                              return SliceEnd(ts_col[row], dur_col[row]) < ts;
+                            }),
+             rows.end());
+  std::sort(rows.begin(), rows.end());
+
+  std::vector<tables::SliceTable::RowNumber> row_numbers;
+  row_numbers.reserve(rows.size());
+  ColumnStorage<uint32_t> track_ids;
+  ColumnStorage<int64_t> in_ts;
+  ColumnStorage<int64_t> in_dur;
+  for (uint32_t row : rows) {
+    row_numbers.emplace_back(row);
+    track_ids.Append(static_cast<uint32_t>(track_id));
+    in_ts.Append(ts);
+    in_dur.Append(dur);
+  }
+  table_return = OverlappingSlicesTable::SelectAndExtendParent(
+      *slice_table_, std::move(row_numbers), std::move(track_ids),
+      std::move(in_ts), std::move(in_dur));
+  return base::OkStatus();
+}
+
+const IntervalIndex* OverlappingSlices::GetOrCreateIndex(TrackId track_id) {
+  if (slice_table_->row_count() != indexed_row_count_) {
+    // Rows were added since the last query: rebucket all the slices by track
+    // and drop the stale indexes. Indexes are only built for the tracks which
+    // are queried.
+    tracks_.clear();
+    const auto& track_col = slice_table_->track_id();
+    for (uint32_t i = 0; i < slice_table_->row_count(); ++i)
+      tracks_[track_col[i].value].rows.push_back(i);
+    indexed_row_count_ = slice_table_->row_count();
+  }
+
+  auto it = tracks_.find(track_id.value);
+  if (it == tracks_.end())
+    return nullptr;
+
+  TrackIndex& track = it->second;
+  if (!track.index) {
+    const auto& ts_col = slice_table_->ts();
+    const auto& dur_col = slice_table_->dur();
+    std::vector<IntervalIndex::Interval> intervals;
+    intervals.reserve(track.rows.size());
+    for (uint32_t row : track.rows) {
+      int64_t ts = ts_col[row];
+      intervals.push_back({ts, SliceEnd(ts, dur_col[row]), row});
+    }
+    track.index = IntervalIndex(std::move(intervals));
+    track.rows = std::vector<uint32_t>();
+  }
+  return &*track.index;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
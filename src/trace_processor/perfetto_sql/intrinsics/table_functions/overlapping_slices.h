@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_OVERLAPPING_SLICES_H_
+#define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_OVERLAPPING_SLICES_H_
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "src/trace_processor/containers/interval_index.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Implements the overlapping_slices table function which returns the slices
+// of a track which intersect the closed interval [ts, ts + dur]:
+//
+//   SELECT * FROM overlapping_slices(track_id, ts, dur)
+//
+// An IntervalIndex is built for a track the first time it is queried, so
+// repeated viewport-style queries take logarithmic rather than linear time.
+// All the indexes are dropped whenever rows are added to the slice table.
+class OverlappingSlices : public StaticTableFunction {
+ public:
+  explicit OverlappingSlices(const tables::SliceTable* table);
+  ~OverlappingSlices() override;
+
+  Table::Schema CreateSchema() override;
+  std::string TableName() override;
+  uint32_t EstimateRowCount() override;
+  base::Status ValidateConstraints(const QueryConstraints&) override;
+  base::Status ComputeTable(const std::vector<Constraint>& cs,
+                            const std::vector<Order>& ob,
+                            const BitVector& cols_used,
+                            std::unique_ptr<Table>& table_return) override;
+
+ private:
+  struct TrackIndex {
+    // Rows of the track which have not been indexed yet.
+    std::vector<uint32_t> rows;
+    std::optional<IntervalIndex> index;
+  };
+
+  // Returns the index for |track_id|, building it if necessary, or nullptr if
+  // the track has no slices.
+  const IntervalIndex* GetOrCreateIndex(TrackId track_id);
+
+  const tables::SliceTable* slice_table_ = nullptr;
+
+  // Number of slice table rows which were bucketed into |tracks_|.
+  uint32_t indexed_row_count_ = 0;
+  std::unordered_map<uint32_t, TrackIndex> tracks_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_OVERLAPPING_SLICES_H_
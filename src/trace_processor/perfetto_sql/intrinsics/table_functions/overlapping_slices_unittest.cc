@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/overlapping_slices.h"
+
+#include "src/trace_processor/containers/bit_vector.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/tables_py.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+using OverlappingSlicesTable = tables::OverlappingSlicesTable;
+
+void Insert(tables::SliceTable* table,
+            int64_t ts,
+            int64_t dur,
+            uint32_t track_id) {
+  tables::SliceTable::Row row;
+  row.ts = ts;
+  row.dur = dur;
+  row.track_id = TrackId{track_id};
+  table->Insert(row);
+}
+
+std::vector<int64_t> Query(OverlappingSlices& gen,
+                           SqlValue track_id,
+                           SqlValue ts,
+                           SqlValue dur) {
+  std::unique_ptr<Table> table;
+  base::Status status = gen.ComputeTable(
+      {
+          Constraint{OverlappingSlicesTable::ColumnIndex::in_track_id,
+                     FilterOp::kEq, track_id},
+          Constraint{OverlappingSlicesTable::ColumnIndex::in_ts, FilterOp::kEq,
+                     ts},
+          Constraint{OverlappingSlicesTable::ColumnIndex::in_dur,
+                     FilterOp::kEq, dur},
+      },
+      {}, BitVector(), table);
+  EXPECT_TRUE(status.ok()) << status.message();
+
+  std::vector<int64_t> ids;
+  const Column* id_column = table->GetColumnByName("id");
+  for (uint32_t i = 0; i < table->row_count(); ++i)
+    ids.push_back(id_column->Get(i).long_value);
+  return ids;
+}
+
+std::vector<int64_t> Query(OverlappingSlices& gen,
+                           uint32_t track_id,
+                           int64_t ts,
+                           int64_t dur) {
+  return Query(gen, SqlValue::Long(track_id), SqlValue::Long(ts),
+               SqlValue::Long(dur));
+}
+
+TEST(OverlappingSlices, FindsOverlapsOnTrack) {
+  StringPool pool;
+  tables::SliceTable slice_table(&pool);
+  Insert(&slice_table, 0 /*ts*/, 100 /*dur*/, 1 /*track_id*/);
+  Insert(&slice_table, 10, 5, 1);
+  Insert(&slice_table, 20, 5, 2);
+  Insert(&slice_table, 30, 0, 1);
+  Insert(&slice_table, 200, 10, 1);
+
+  OverlappingSlices gen(&slice_table);
+  ASSERT_THAT(Query(gen, 1, 12, 0), ElementsAre(0, 1));
+  ASSERT_THAT(Query(gen, 1, 15, 15), ElementsAre(0, 1, 3));
+  ASSERT_THAT(Query(gen, 1, 101, 98), IsEmpty());
+  ASSERT_THAT(Query(gen, 1, 150, 1000), ElementsAre(4));
+  ASSERT_THAT(Query(gen, 2, 0, 1000), ElementsAre(2));
+  ASSERT_THAT(Query(gen, 3, 0, 1000), IsEmpty());
+}
+
+TEST(OverlappingSlices, IncompleteSlices) {
+  StringPool pool;
+  tables::SliceTable slice_table(&pool);
+  Insert(&slice_table, 10 /*ts*/, -1 /*dur*/, 1 /*track_id*/);
+
+  OverlappingSlices gen(&slice_table);
+  ASSERT_THAT(Query(gen, 1, 1000, 10), ElementsAre(0));
+
+  // The slice ends after the index was built.
+  slice_table.mutable_dur()->Set(0, 5);
+  ASSERT_THAT(Query(gen, 1, 1000, 10), IsEmpty());
+  ASSERT_THAT(Query(gen, 1, 12, 0), ElementsAre(0));
+}
+
+TEST(OverlappingSlices, RowsAddedAfterQuery) {
+  StringPool pool;
+  tables::SliceTable slice_table(&pool);
+  Insert(&slice_table, 0 /*ts*/, 10 /*dur*/, 1 /*track_id*/);
+
+  OverlappingSlices gen(&slice_table);
+  ASSERT_THAT(Query(gen, 1, 5, 10), ElementsAre(0));
+
+  Insert(&slice_table, 12, 10, 1);
+  ASSERT_THAT(Query(gen, 1, 5, 10), ElementsAre(0, 1));
+}
+
+TEST(OverlappingSlices, NullConstraint) {
+  StringPool pool;
+  tables::SliceTable slice_table(&pool);
+  Insert(&slice_table, 0 /*ts*/, 10 /*dur*/, 1 /*track_id*/);
+
+  OverlappingSlices gen(&slice_table);
+  ASSERT_THAT(Query(gen, SqlValue::Long(1), SqlValue(), SqlValue::Long(10)),
+              IsEmpty());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
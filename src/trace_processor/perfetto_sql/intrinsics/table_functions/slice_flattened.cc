@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/slice_flattened.h"
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace perfetto {
+namespace trace_processor {
+namespace tables {
+
+SliceFlattenedTable::~SliceFlattenedTable() = default;
+
+}  // namespace tables
+
+namespace {
+
+using SliceFlattenedTable = tables::SliceFlattenedTable;
+using SliceTable = tables::SliceTable;
+
+// Start of an interval: either the start of a slice or the end of one of its
+// children (or the end of a root slice, when |slice_row| is nullopt).
+struct Event {
+  int64_t ts;
+  std::optional<uint32_t> slice_row;
+  uint32_t depth_plus_one;
+};
+
+// Turns the events of a track, in timestamp order, into intervals lasting
+// until the next event.
+class TrackFlattener {
+ public:
+  TrackFlattener(const SliceTable& slices, SliceFlattenedTable* out)
+      : slices_(slices), out_(out) {}
+
+  void Push(Event event) {
+    // Intervals when no slice is active are dropped.
+    if (pending_ && pending_->slice_row) {
+      uint32_t row = *pending_->slice_row;
+      SliceFlattenedTable::Row out_row;
+      out_row.slice_id = slices_.id()[row];
+      out_row.ts = pending_->ts;
+      out_row.dur = event.ts - pending_->ts;
+      out_row.depth = pending_->depth_plus_one - 1;
+      out_row.name = slices_.name()[row];
+      out_row.track_id = slices_.track_id()[row];
+      out_->Insert(out_row);
+    }
+    pending_ = event;
+  }
+
+ private:
+  const SliceTable& slices_;
+  SliceFlattenedTable* out_ = nullptr;
+  std::optional<Event> pending_;
+};
+
+}  // namespace
+
+SliceFlattened::SliceFlattened(StringPool* pool, const SliceTable* table)
+    : pool_(pool), slice_table_(table) {}
+SliceFlattened::~SliceFlattened() = default;
+
+Table::Schema SliceFlattened::CreateSchema() {
+  return SliceFlattenedTable::ComputeStaticSchema();
+}
+
+std::string SliceFlattened::TableName() {
+  return SliceFlattenedTable::Name();
+}
+
+uint32_t SliceFlattened::EstimateRowCount() {
+  // Every slice generates at most two intervals.
+  return slice_table_->row_count() * 2;
+}
+
+base::Status SliceFlattened::ValidateConstraints(const QueryConstraints&) {
+  return base::OkStatus();
+}
+
+base::Status SliceFlattened::ComputeTable(
+    const std::vector<Constraint>&,
+    const std::vector<Order>&,
+    const BitVector&,
+    std::unique_ptr<Table>& table_return) {
+  table_return = ComputeSliceFlattenedTable(*slice_table_, pool_);
+  return base::OkStatus();
+}
+
+// static
+std::unique_ptr<SliceFlattenedTable>
+SliceFlattened::ComputeSliceFlattenedTable(const SliceTable& slices,
+                                           StringPool* pool) {
+  const auto& ts = slices.ts();
+  const auto& dur = slices.dur();
+  const auto& depth = slices.depth();
+  const auto& parent_id = slices.parent_id();
+  const auto& track_id = slices.track_id();
+
+  // Bucket the slices by track. The slice table is sorted by timestamp so
+  // each bucket is too.
+  std::unordered_map<uint32_t, std::vector<uint32_t>> rows_by_track;
+  std::vector<uint32_t> track_order;
+  for (uint32_t i = 0; i < slices.row_count(); ++i) {
+    // Instants and incomplete slices don't cover any time.
+    if (dur[i] <= 0)
+      continue;
+    auto it_and_inserted = rows_by_track.emplace(track_id[i].value,
+                                                 std::vector<uint32_t>());
+    if (it_and_inserted.second)
+      track_order.push_back(track_id[i].value);
+    it_and_inserted.first->second.push_back(i);
+  }
+
+  auto out = std::make_unique<SliceFlattenedTable>(pool);
+  std::vector<uint32_t> stack;
+  for (uint32_t track : track_order) {
+    TrackFlattener flattener(slices, out.get());
+
+    // Ends the slice on the top of the stack: its parent becomes the most
+    // specific slice again.
+    auto pop = [&]() {
+      uint32_t row = stack.back();
+      stack.pop_back();
+      std::optional<SliceId> parent = parent_id[row];
+      std::optional<uint32_t> parent_row =
+          parent ? slices.id().IndexOf(*parent) : std::nullopt;
+      flattener.Push(Event{ts[row] + dur[row], parent_row, depth[row]});
+    };
+
+    for (uint32_t row : rows_by_track[track]) {
+      // Slices ending at the same time as this one starts are ended first, so
+      // that the slice which is actually active afterwards gets the interval.
+      while (!stack.empty() && ts[stack.back()] + dur[stack.back()] <= ts[row])
+        pop();
+      flattener.Push(Event{ts[row], row, depth[row] + 1});
+      stack.push_back(row);
+    }
+    while (!stack.empty())
+      pop();
+  }
+  return out;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_SLICE_FLATTENED_H_
+#define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_SLICE_FLATTENED_H_
+
+#include <memory>
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/tables_py.h"
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+// Implements the internal_slice_flattened table function which backs the
+// experimental.flat_slices stdlib module.
+//
+// For each track, it returns the "most specific" (i.e. deepest) slice active
+// at any point in time: every slice with a positive duration starts an
+// interval for itself when it begins and one for its parent when it ends. Each
+// interval lasts until the next one starts on the same track. Intervals when
+// no slice is active are not returned.
+//
+// This is computed with a single pass over the slice table (plus a stack of
+// open slices per track) rather than the window functions the SQL
+// implementation used to require.
+class SliceFlattened : public StaticTableFunction {
+ public:
+  SliceFlattened(StringPool* pool, const tables::SliceTable* table);
+  ~SliceFlattened() override;
+
+  Table::Schema CreateSchema() override;
+  std::string TableName() override;
+  uint32_t EstimateRowCount() override;
+  base::Status ValidateConstraints(const QueryConstraints&) override;
+  base::Status ComputeTable(const std::vector<Constraint>& cs,
+                            const std::vector<Order>& ob,
+                            const BitVector& cols_used,
+                            std::unique_ptr<Table>& table_return) override;
+
+  // Visible for testing.
+  static std::unique_ptr<tables::SliceFlattenedTable>
+  ComputeSliceFlattenedTable(const tables::SliceTable&, StringPool*);
+
+ private:
+  StringPool* pool_ = nullptr;
+  const tables::SliceTable* slice_table_ = nullptr;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_SLICE_FLATTENED_H_
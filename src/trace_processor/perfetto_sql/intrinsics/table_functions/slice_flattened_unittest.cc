@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/slice_flattened.h"
+
+#include <tuple>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+// (slice_id, ts, dur, depth) of a row of the output.
+using Interval = std::tuple<uint32_t, int64_t, int64_t, uint32_t>;
+
+class SliceFlattenedTest : public ::testing::Test {
+ protected:
+  SliceId Insert(int64_t ts,
+                 int64_t dur,
+                 uint32_t track_id,
+                 std::optional<SliceId> parent_id = std::nullopt) {
+    tables::SliceTable::Row row;
+    row.ts = ts;
+    row.dur = dur;
+    row.track_id = TrackId{track_id};
+    row.parent_id = parent_id;
+    row.depth = parent_id ? slice_table_.depth()[parent_id->value] + 1 : 0;
+    return slice_table_.Insert(row).id;
+  }
+
+  std::vector<Interval> Compute() {
+    auto table =
+        SliceFlattened::ComputeSliceFlattenedTable(slice_table_, &pool_);
+    std::vector<Interval> intervals;
+    for (auto it = table->IterateRows(); it; ++it) {
+      intervals.emplace_back(it.slice_id().value, it.ts(), it.dur(),
+                             it.depth());
+    }
+    return intervals;
+  }
+
+  StringPool pool_;
+  tables::SliceTable slice_table_{&pool_};
+};
+
+TEST_F(SliceFlattenedTest, Empty) {
+  ASSERT_THAT(Compute(), IsEmpty());
+}
+
+TEST_F(SliceFlattenedTest, Nested) {
+  // A---------------------
+  // ----B-----------  D----
+  // ---------C----
+  SliceId a = Insert(0 /*ts*/, 100 /*dur*/, 1 /*track_id*/);
+  SliceId b = Insert(10, 50, 1, a);
+  SliceId c = Insert(40, 10, 1, b);
+  SliceId d = Insert(60, 30, 1, a);
+
+  ASSERT_THAT(Compute(), ElementsAre(Interval{a.value, 0, 10, 0},
+                                     Interval{b.value, 10, 30, 1},
+                                     Interval{c.value, 40, 10, 2},
+                                     Interval{b.value, 50, 10, 1},
+                                     Interval{a.value, 60, 0, 0},
+                                     Interval{d.value, 60, 30, 1},
+                                     Interval{a.value, 90, 10, 0}));
+}
+
+TEST_F(SliceFlattenedTest, SameTimestamps) {
+  // Children starting and ending at the same time as their parent and
+  // back-to-back siblings.
+  SliceId a = Insert(0 /*ts*/, 100 /*dur*/, 1 /*track_id*/);
+  SliceId b = Insert(0, 50, 1, a);
+  SliceId c = Insert(50, 50, 1, a);
+  SliceId d = Insert(100, 10, 1);
+
+  ASSERT_THAT(Compute(), ElementsAre(Interval{a.value, 0, 0, 0},
+                                     Interval{b.value, 0, 50, 1},
+                                     Interval{a.value, 50, 0, 0},
+                                     Interval{c.value, 50, 50, 1},
+                                     Interval{a.value, 100, 0, 0},
+                                     Interval{d.value, 100, 10, 0}));
+}
+
+TEST_F(SliceFlattenedTest, TracksAndEmptySlices) {
+  SliceId a = Insert(0 /*ts*/, 10 /*dur*/, 1 /*track_id*/);
+  SliceId b = Insert(5, 10, 2);
+  Insert(6, 0, 2, b);
+  Insert(20, -1, 1);
+
+  ASSERT_THAT(Compute(), ElementsAre(Interval{a.value, 0, 10, 0},
+                                     Interval{b.value, 5, 10, 0}));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
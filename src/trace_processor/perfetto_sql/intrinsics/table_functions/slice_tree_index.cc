@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/slice_tree_index.h"
+
+#include <algorithm>
+
+#include "perfetto/ext/base/string_splitter.h"
+#include "perfetto/ext/base/string_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+SliceTreeIndex::SliceTreeIndex(const tables::SliceTable* slices)
+    : slices_(slices) {}
+SliceTreeIndex::~SliceTreeIndex() = default;
+
+void SliceTreeIndex::MaybeRebuild() {
+  uint32_t row_count = slices_->row_count();
+  if (row_count == indexed_row_count_)
+    return;
+  indexed_row_count_ = row_count;
+
+  // Children of each row, in row order, in CSR form. Slices are root table
+  // rows so the id of a slice is also its row.
+  const auto& parent_col = slices_->parent_id();
+  std::vector<uint32_t> child_offsets(row_count + 1, 0);
+  for (uint32_t i = 0; i < row_count; ++i) {
+    std::optional<SliceId> parent = parent_col[i];
+    if (parent) {
+      PERFETTO_DCHECK(parent->value < i);
+      ++child_offsets[parent->value + 1];
+    }
+  }
+  for (uint32_t i = 1; i <= row_count; ++i)
+    child_offsets[i] += child_offsets[i - 1];
+  std::vector<uint32_t> children(child_offsets[row_count]);
+  std::vector<uint32_t> next_child(child_offsets.begin(),
+                                   child_offsets.end() - 1);
+  for (uint32_t i = 0; i < row_count; ++i) {
+    std::optional<SliceId> parent = parent_col[i];
+    if (parent)
+      children[next_child[parent->value]++] = i;
+  }
+
+  pre_order_.clear();
+  pre_order_.reserve(row_count);
+  pre_order_pos_.assign(row_count, 0);
+  subtree_size_.assign(row_count, 0);
+
+  // Iterative depth-first traversal from each root: the stack holds the rows
+  // being visited and the next of their children to visit.
+  std::vector<std::pair<uint32_t, uint32_t>> stack;
+  auto enter = [&](uint32_t row) {
+    pre_order_pos_[row] = static_cast<uint32_t>(pre_order_.size());
+    pre_order_.push_back(row);
+    stack.emplace_back(row, child_offsets[row]);
+  };
+  for (uint32_t root = 0; root < row_count; ++root) {
+    if (parent_col[root])
+      continue;
+    enter(root);
+    while (!stack.empty()) {
+      auto& [row, next] = stack.back();
+      if (next < child_offsets[row + 1]) {
+        enter(children[next++]);
+        continue;
+      }
+      subtree_size_[row] = static_cast<uint32_t>(pre_order_.size()) -
+                           pre_order_pos_[row] - 1;
+      stack.pop_back();
+    }
+  }
+  PERFETTO_DCHECK(pre_order_.size() == row_count);
+
+  const auto& stack_id_col = slices_->stack_id();
+  stack_rows_.clear();
+  stack_rows_.reserve(row_count);
+  for (uint32_t i = 0; i < row_count; ++i)
+    stack_rows_.emplace_back(stack_id_col[i], i);
+  std::sort(stack_rows_.begin(), stack_rows_.end());
+}
+
+void SliceTreeIndex::GetDescendants(
+    uint32_t row,
+    std::vector<tables::SliceTable::RowNumber>& out) {
+  MaybeRebuild();
+  PERFETTO_DCHECK(row < indexed_row_count_);
+
+  uint32_t begin = pre_order_pos_[row] + 1;
+  uint32_t end = begin + subtree_size_[row];
+  std::vector<uint32_t> rows(pre_order_.begin() + begin,
+                             pre_order_.begin() + end);
+  std::sort(rows.begin(), rows.end());
+  for (uint32_t descendant : rows)
+    out.emplace_back(descendant);
+}
+
+std::vector<uint32_t> SliceTreeIndex::GetRowsWithStackId(int64_t stack_id) {
+  MaybeRebuild();
+  auto begin = std::lower_bound(stack_rows_.begin(), stack_rows_.end(),
+                                std::make_pair(stack_id, uint32_t(0)));
+  std::vector<uint32_t> rows;
+  for (auto it = begin; it != stack_rows_.end() && it->first == stack_id; ++it)
+    rows.push_back(it->second);
+  return rows;
+}
+
+base::StatusOr<std::vector<SliceId>> ParseSliceIds(
+    const tables::SliceTable& slices,
+    const char* ids) {
+  std::vector<SliceId> result;
+  for (base::StringSplitter sp(ids, ','); sp.Next();) {
+    std::string token = base::TrimWhitespace(sp.cur_token());
+    if (token.empty())
+      continue;
+    std::optional<uint32_t> id = base::StringToUInt32(token);
+    if (!id || !slices.FindById(SliceId(*id)))
+      return base::ErrStatus("invalid slice id '%s'", token.c_str());
+    result.emplace_back(*id);
+  }
+  return result;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
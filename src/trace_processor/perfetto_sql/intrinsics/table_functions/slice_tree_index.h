@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_SLICE_TREE_INDEX_H_
+#define SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_SLICE_TREE_INDEX_H_
+
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include "perfetto/ext/base/status_or.h"
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Index over the forest formed by the parent_id links of the slice table,
+// shared by the ancestor, descendant and connected flow table functions.
+//
+// Slices are numbered in the pre-order of a depth-first traversal, so the
+// descendants of a slice are exactly the slices numbered between it and the
+// end of its subtree: finding them is a range lookup rather than a filter of
+// the whole slice table. Slices are also indexed by stack_id.
+//
+// The index is built on first use and rebuilt whenever rows are added to the
+// slice table.
+class SliceTreeIndex {
+ public:
+  explicit SliceTreeIndex(const tables::SliceTable* slices);
+  ~SliceTreeIndex();
+
+  // Appends the rows of all the descendants of the slice at |row| to |out|, in
+  // row order.
+  void GetDescendants(uint32_t row,
+                      std::vector<tables::SliceTable::RowNumber>& out);
+
+  // Returns the rows of the slices with |stack_id|, in row order.
+  std::vector<uint32_t> GetRowsWithStackId(int64_t stack_id);
+
+ private:
+  SliceTreeIndex(const SliceTreeIndex&) = delete;
+  SliceTreeIndex& operator=(const SliceTreeIndex&) = delete;
+
+  void MaybeRebuild();
+
+  const tables::SliceTable* slices_ = nullptr;
+  uint32_t indexed_row_count_ = 0;
+
+  // Rows in pre-order.
+  std::vector<uint32_t> pre_order_;
+  // Position of each row in |pre_order_|.
+  std::vector<uint32_t> pre_order_pos_;
+  // Number of descendants of each row.
+  std::vector<uint32_t> subtree_size_;
+  // (stack_id, row) of all the slices, sorted.
+  std::vector<std::pair<int64_t, uint32_t>> stack_rows_;
+};
+
+// Parses the comma separated list of slice ids taken by the *_slice_by_ids
+// table functions. Returns an error if any of the ids is not in |slices|.
+base::StatusOr<std::vector<SliceId>> ParseSliceIds(
+    const tables::SliceTable& slices,
+    const char* ids);
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_PERFETTO_SQL_INTRINSICS_TABLE_FUNCTIONS_SLICE_TREE_INDEX_H_
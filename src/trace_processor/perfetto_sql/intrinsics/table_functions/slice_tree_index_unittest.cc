@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/slice_tree_index.h"
+
+#include "src/trace_processor/containers/bit_vector.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/descendant.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/tables_py.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+SliceId Insert(tables::SliceTable* table,
+               int64_t stack_id,
+               std::optional<SliceId> parent_id) {
+  tables::SliceTable::Row row;
+  row.stack_id = stack_id;
+  row.parent_id = parent_id;
+  return table->Insert(row).id;
+}
+
+std::vector<uint32_t> Descendants(SliceTreeIndex& index, SliceId id) {
+  std::vector<tables::SliceTable::RowNumber> rows;
+  index.GetDescendants(id.value, rows);
+  std::vector<uint32_t> result;
+  for (auto row : rows)
+    result.push_back(row.row_number());
+  return result;
+}
+
+TEST(SliceTreeIndex, Descendants) {
+  TraceStorage storage;
+  auto* slices = storage.mutable_slice_table();
+
+  // 0 -> 1 -> 3
+  //   -> 2
+  // 4 -> 5
+  SliceId s0 = Insert(slices, 10, std::nullopt);
+  SliceId s1 = Insert(slices, 11, s0);
+  SliceId s2 = Insert(slices, 12, s0);
+  Insert(slices, 11, s1);
+  SliceId s4 = Insert(slices, 10, std::nullopt);
+  Insert(slices, 15, s4);
+
+  SliceTreeIndex index(slices);
+  ASSERT_THAT(Descendants(index, s0), ElementsAre(1u, 2u, 3u));
+  ASSERT_THAT(Descendants(index, s1), ElementsAre(3u));
+  ASSERT_THAT(Descendants(index, s2), IsEmpty());
+  ASSERT_THAT(Descendants(index, s4), ElementsAre(5u));
+
+  ASSERT_THAT(index.GetRowsWithStackId(10), ElementsAre(0u, 4u));
+  ASSERT_THAT(index.GetRowsWithStackId(11), ElementsAre(1u, 3u));
+  ASSERT_THAT(index.GetRowsWithStackId(42), IsEmpty());
+
+  // Adding rows rebuilds the index.
+  Insert(slices, 11, s2);
+  ASSERT_THAT(Descendants(index, s0), ElementsAre(1u, 2u, 3u, 6u));
+  ASSERT_THAT(index.GetRowsWithStackId(11), ElementsAre(1u, 3u, 6u));
+}
+
+TEST(SliceTreeIndex, ParseSliceIds) {
+  TraceStorage storage;
+  auto* slices = storage.mutable_slice_table();
+  Insert(slices, 0, std::nullopt);
+  Insert(slices, 0, std::nullopt);
+
+  auto ids = ParseSliceIds(*slices, "1, 0");
+  ASSERT_TRUE(ids.ok());
+  ASSERT_THAT(*ids, ElementsAre(SliceId(1), SliceId(0)));
+
+  ASSERT_FALSE(ParseSliceIds(*slices, "0,2").ok());
+  ASSERT_FALSE(ParseSliceIds(*slices, "foo").ok());
+}
+
+TEST(SliceTreeIndex, DescendantSliceByIds) {
+  TraceStorage storage;
+  auto* slices = storage.mutable_slice_table();
+  SliceId s0 = Insert(slices, 0, std::nullopt);
+  SliceId s1 = Insert(slices, 0, s0);
+  Insert(slices, 0, s1);
+
+  Descendant generator{Descendant::Type::kSliceByIds, &storage};
+  std::unique_ptr<Table> res;
+  Constraint c{tables::DescendantSliceByIdsTable::ColumnIndex::start_ids,
+               FilterOp::kEq, SqlValue::String("1,0")};
+  base::Status status = generator.ComputeTable({c}, {}, BitVector(), res);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  const Column* id = res->GetColumnByName("id");
+  const Column* start_id = res->GetColumnByName("start_id");
+  std::vector<std::pair<int64_t, int64_t>> pairs;
+  for (uint32_t i = 0; i < res->row_count(); ++i)
+    pairs.emplace_back(start_id->Get(i).long_value, id->Get(i).long_value);
+  ASSERT_THAT(pairs, ElementsAre(std::make_pair(1, 2), std::make_pair(0, 1),
+                                 std::make_pair(0, 2)));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -29,6 +29,8 @@ from src.trace_processor.tables.metadata_tables import PROCESS_TABLE
 from src.trace_processor.tables.profiler_tables import STACK_PROFILE_CALLSITE_TABLE
 from src.trace_processor.tables.slice_tables import SLICE_TABLE
 from src.trace_processor.tables.sched_tables import SCHED_SLICE_TABLE
+from src.trace_processor.tables.track_tables import COUNTER_TRACK_TABLE
+from src.trace_processor.tables.track_tables import TRACK_TABLE
 
 ANCESTOR_SLICE_TABLE = Table(
     python_module=__file__,
@@ -48,6 +50,16 @@ ANCESTOR_SLICE_BY_STACK_TABLE = Table(
     ],
     parent=SLICE_TABLE)
 
+ANCESTOR_SLICE_BY_IDS_TABLE = Table(
+    python_module=__file__,
+    class_name="AncestorSliceByIdsTable",
+    sql_name="ancestor_slice_by_ids",
+    columns=[
+        C("start_id", CppTableId(SLICE_TABLE)),
+        C("start_ids", CppString(), flags=ColumnFlag.HIDDEN),
+    ],
+    parent=SLICE_TABLE)
+
 ANCESTOR_STACK_PROFILE_CALLSITE_TABLE = Table(
     python_module=__file__,
     class_name="AncestorStackProfileCallsiteTable",
@@ -68,6 +80,26 @@ CONNECTED_FLOW_TABLE = Table(
     ],
     parent=FLOW_TABLE)
 
+COUNTER_SUMMARY_TABLE = Table(
+    python_module=__file__,
+    class_name="CounterSummaryTable",
+    sql_name="counter_summary",
+    columns=[
+        C("ts", CppInt64(), flags=ColumnFlag.SORTED),
+        C("dur", CppInt64()),
+        C("sample_count", CppUint32()),
+        C("min_value", CppDouble()),
+        C("max_value", CppDouble()),
+        C("avg_value", CppDouble()),
+        C("last_value", CppDouble()),
+        C("in_track_id",
+          CppTableId(COUNTER_TRACK_TABLE),
+          flags=ColumnFlag.HIDDEN),
+        C("in_ts_start", CppInt64(), flags=ColumnFlag.HIDDEN),
+        C("in_ts_end", CppInt64(), flags=ColumnFlag.HIDDEN),
+        C("in_buckets", CppInt64(), flags=ColumnFlag.HIDDEN),
+    ])
+
 DESCENDANT_SLICE_TABLE = Table(
     python_module=__file__,
     class_name="DescendantSliceTable",
@@ -77,6 +109,16 @@ DESCENDANT_SLICE_TABLE = Table(
     ],
     parent=SLICE_TABLE)
 
+DESCENDANT_SLICE_BY_IDS_TABLE = Table(
+    python_module=__file__,
+    class_name="DescendantSliceByIdsTable",
+    sql_name="descendant_slice_by_ids",
+    columns=[
+        C("start_id", CppTableId(SLICE_TABLE)),
+        C("start_ids", CppString(), flags=ColumnFlag.HIDDEN),
+    ],
+    parent=SLICE_TABLE)
+
 DESCENDANT_SLICE_BY_STACK_TABLE = Table(
     python_module=__file__,
     class_name="DescendantSliceByStackTable",
@@ -151,16 +193,45 @@ EXPERIMENTAL_SLICE_LAYOUT_TABLE = Table(
     ],
     parent=SLICE_TABLE)
 
+OVERLAPPING_SLICES_TABLE = Table(
+    python_module=__file__,
+    class_name="OverlappingSlicesTable",
+    sql_name="overlapping_slices",
+    columns=[
+        C("in_track_id", CppTableId(TRACK_TABLE), flags=ColumnFlag.HIDDEN),
+        C("in_ts", CppInt64(), flags=ColumnFlag.HIDDEN),
+        C("in_dur", CppInt64(), flags=ColumnFlag.HIDDEN),
+    ],
+    parent=SLICE_TABLE)
+
+SLICE_FLATTENED_TABLE = Table(
+    python_module=__file__,
+    class_name="SliceFlattenedTable",
+    sql_name="internal_slice_flattened",
+    columns=[
+        C("slice_id", CppTableId(SLICE_TABLE)),
+        C("ts", CppInt64()),
+        C("dur", CppInt64()),
+        C("depth", CppUint32()),
+        C("name", CppOptional(CppString())),
+        C("track_id", CppTableId(TRACK_TABLE)),
+    ])
+
 # Keep this list sorted.
 ALL_TABLES = [
+    ANCESTOR_SLICE_BY_IDS_TABLE,
     ANCESTOR_SLICE_BY_STACK_TABLE,
     ANCESTOR_SLICE_TABLE,
     ANCESTOR_STACK_PROFILE_CALLSITE_TABLE,
     CONNECTED_FLOW_TABLE,
+    COUNTER_SUMMARY_TABLE,
+    DESCENDANT_SLICE_BY_IDS_TABLE,
     DESCENDANT_SLICE_BY_STACK_TABLE,
     DESCENDANT_SLICE_TABLE,
     EXPERIMENTAL_ANNOTATED_CALLSTACK_TABLE,
     EXPERIMENTAL_COUNTER_DUR_TABLE,
     EXPERIMENTAL_SCHED_UPID_TABLE,
     EXPERIMENTAL_SLICE_LAYOUT_TABLE,
+    OVERLAPPING_SLICES_TABLE,
+    SLICE_FLATTENED_TABLE,
 ]
@@ -47,54 +47,19 @@
 -- @column pid                Alias for `process.pid`.
 -- @column process_name       Alias for `process.name`.
 CREATE TABLE experimental_slice_flattened AS
--- The algorithm proceeds as follows:
+-- The flattening itself is done by the internal_slice_flattened table function
+-- in a single pass over the slice table:
 -- 1. Find the start and end timestamps of all slices.
--- 2. Iterate the generated timestamps within a stack in chronoligical order.
--- 3. Generate a slice for each timestamp pair (regardless of if it was a start or end)  .
+-- 2. Iterate the generated timestamps within a stack in chronological order.
+-- 3. Generate a slice for each timestamp pair (regardless of if it was a start or end).
 -- 4. If the first timestamp in the pair was originally a start, the slice is the 'current' slice,
 -- otherwise, the slice is the parent slice.
-WITH
-  begins AS (
-    SELECT id AS slice_id, ts, name, track_id, depth
-    FROM slice
-    WHERE dur > 0
-  ),
-  ends AS (
-    SELECT
-      parent.id AS slice_id,
-      current.ts + current.dur AS ts,
-      parent.name as name,
-      current.track_id,
-      current.depth - 1 AS depth
-    FROM slice current
-    LEFT JOIN slice parent
-      ON current.parent_id = parent.id
-    WHERE current.dur > 0
-  ),
-  events AS (
-    SELECT * FROM begins
-    UNION ALL
-    SELECT * FROM ends
-  ),
-  data AS (
-    SELECT
-      events.slice_id,
-      events.ts,
-      LEAD(events.ts) OVER (
-         PARTITION BY events.track_id
-         ORDER BY events.ts) - events.ts AS dur,
-      events.depth,
-      events.name,
-      events.track_id
-    FROM events
-  )
 SELECT data.slice_id, data.ts, data.dur, data.depth,
  data.name, data.track_id, thread.utid, thread.tid, thread.name as thread_name,
  process.upid, process.pid, process.name as process_name
- FROM data JOIN thread_track ON data.track_id = thread_track.id
+ FROM internal_slice_flattened data JOIN thread_track ON data.track_id = thread_track.id
 JOIN thread USING(utid)
-JOIN process USING(upid)
-WHERE depth != -1;
+JOIN process USING(upid);
 
 CREATE
   INDEX experimental_slice_flattened_id_idx
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/read_trace_internal.h"
 
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/compiler.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
@@ -72,6 +74,32 @@ util::Status ReadTraceUsingRead(
   }
   return util::OkStatus();
 }
+
+#if TRACE_PROCESSOR_HAS_MMAP()
+// Drops the resident pages of [*released_size, up_to) of a read-only file
+// mapping. Packets parsed from this range can still be buffered in the sorter
+// and be read later: this is fine as the mapping is PROT_READ + MAP_PRIVATE,
+// so the pages were never copied-on-write and are transparently faulted back
+// in from the page cache (or the file) on the next access. This keeps the RSS
+// of the process bounded by a couple of chunks rather than by the file size.
+void ReleaseMmapedPages(void* file_mm, size_t up_to, size_t* released_size) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  const size_t page_size = base::GetSysPageSize();
+  const size_t end = up_to - (up_to % page_size);
+  if (end <= *released_size)
+    return;
+  uint8_t* start = static_cast<uint8_t*>(file_mm) + *released_size;
+  if (madvise(start, end - *released_size, MADV_DONTNEED) == 0)
+    *released_size = end;
+#else
+  // On other POSIX systems MADV_DONTNEED is only a hint with looser
+  // semantics; let the kernel manage the pages.
+  base::ignore_result(file_mm, up_to, released_size);
+#endif
+}
+#endif  // TRACE_PROCESSOR_HAS_MMAP()
+
 }  // namespace
 
 util::Status ReadTraceUnfinalized(
@@ -96,9 +124,13 @@ util::Status ReadTraceUnfinalized(
     const size_t whole_size = static_cast<size_t>(whole_size_64);
     void* file_mm = mmap(nullptr, whole_size, PROT_READ, MAP_PRIVATE, *fd, 0);
     if (file_mm != MAP_FAILED) {
+      // The file is consumed front to back: let the kernel read ahead
+      // aggressively and reclaim pages behind us.
+      madvise(file_mm, whole_size, MADV_SEQUENTIAL);
       TraceBlobView whole_mmap(TraceBlob::FromMmap(file_mm, whole_size));
       // Parse the file in chunks so we get some status update on stdio.
       static constexpr size_t kMmapChunkSize = 128ul * 1024 * 1024;
+      size_t released_size = 0;
       while (bytes_read < whole_size_64) {
         progress_callback(bytes_read);
         const size_t bytes_read_z = static_cast<size_t>(bytes_read);
@@ -106,6 +138,7 @@ util::Status ReadTraceUnfinalized(
         TraceBlobView slice = whole_mmap.slice_off(bytes_read_z, slice_size);
         RETURN_IF_ERROR(tp->Parse(std::move(slice)));
         bytes_read += slice_size;
+        ReleaseMmapedPages(file_mm, bytes_read_z, &released_size);
       }  // while (slices)
     }    // if (!MAP_FAILED)
   }      // if (use_mmap)
@@ -57,6 +57,7 @@ class Httpd : public base::HttpRequestHandler {
   // HttpRequestHandler implementation.
   void OnHttpRequest(const base::HttpRequest&) override;
   void OnWebsocketMessage(const base::WebsocketMessage&) override;
+  void OnHttpConnectionClosed(base::HttpServerConnection*) override;
 
   void ServeHelpPage(const base::HttpRequest&);
 
@@ -67,6 +68,12 @@ class Httpd : public base::HttpRequestHandler {
 
 base::HttpServerConnection* g_cur_conn;
 
+// Each websocket connection is a separate RPC session, so that several UI tabs
+// (or users) can share the same loaded trace.
+Rpc::SessionId SessionIdForConn(base::HttpServerConnection* conn) {
+  return static_cast<Rpc::SessionId>(reinterpret_cast<uintptr_t>(conn));
+}
+
 base::StringView Vec2Sv(const std::vector<uint8_t>& v) {
   return base::StringView(reinterpret_cast<const char*>(v.data()), v.size());
 }
@@ -248,11 +255,16 @@ void Httpd::OnWebsocketMessage(const base::WebsocketMessage& msg) {
   g_cur_conn = msg.conn;
   trace_processor_rpc_.SetRpcResponseFunction(SendRpcChunk);
   // OnRpcRequest() will call SendRpcChunk() one or more times.
-  trace_processor_rpc_.OnRpcRequest(msg.data.data(), msg.data.size());
+  trace_processor_rpc_.OnRpcRequest(SessionIdForConn(msg.conn),
+                                    msg.data.data(), msg.data.size());
   trace_processor_rpc_.SetRpcResponseFunction(nullptr);
   g_cur_conn = nullptr;
 }
 
+void Httpd::OnHttpConnectionClosed(base::HttpServerConnection* conn) {
+  trace_processor_rpc_.CloseSession(SessionIdForConn(conn));
+}
+
 }  // namespace
 
 void RunHttpRPCServer(std::unique_ptr<TraceProcessor> preloaded_instance,
@@ -16,6 +16,9 @@
 
 #include "src/trace_processor/rpc/query_result_serializer.h"
 
+#include <string.h>
+
+#include <string>
 #include <vector>
 
 #include "perfetto/protozero/packed_repeated_fields.h"
@@ -43,10 +46,24 @@ uint8_t MakeLenDelimTag(uint32_t field_num) {
   return static_cast<uint8_t>(tag);
 }
 
+// The cells of one column of a batch, in the columnar layout. Each vector has
+// one entry per row, except |blob_values| which is only filled up to the last
+// blob.
+struct ColumnBuffer {
+  std::vector<uint8_t> cell_types;
+  std::vector<int64_t> fixed64_values;
+  std::string string_values;
+  std::vector<std::string> blob_values;
+  bool has_fixed64 = false;
+  bool has_strings = false;
+};
+
 }  // namespace
 
-QueryResultSerializer::QueryResultSerializer(Iterator iter)
-    : iter_(iter.take_impl()), num_cols_(iter_->ColumnCount()) {}
+QueryResultSerializer::QueryResultSerializer(Iterator iter, bool columnar)
+    : iter_(iter.take_impl()),
+      num_cols_(iter_->ColumnCount()),
+      columnar_(columnar) {}
 
 QueryResultSerializer::~QueryResultSerializer() = default;
 
@@ -54,8 +71,7 @@ bool QueryResultSerializer::Serialize(std::vector<uint8_t>* buf) {
   const size_t slice = batch_split_threshold_ + 4096;
   protozero::HeapBuffered<protos::pbzero::QueryResult> result(slice, slice);
   bool has_more = Serialize(result.get());
-  auto arr = result.SerializeAsArray();
-  buf->insert(buf->end(), arr.begin(), arr.end());
+  result.AppendSerializedTo(buf);
   return has_more;
 }
 
@@ -71,8 +87,14 @@ bool QueryResultSerializer::Serialize(protos::pbzero::QueryResult* res) {
   // write an empty batch with the EOF marker. Errors can happen also in the
   // middle of a query, not just before starting it.
 
-  SerializeBatch(res);
+  if (columnar_) {
+    SerializeColumnarBatch(res);
+  } else {
+    SerializeBatch(res);
+  }
   MaybeSerializeError(res);
+  if (eof_reached_)
+    MaybeSerializeProfile(res);
   return !eof_reached_;
 }
 
@@ -250,6 +272,135 @@ void QueryResultSerializer::SerializeBatch(protos::pbzero::QueryResult* res) {
   batch->Finalize();
 }
 
+void QueryResultSerializer::SerializeColumnarBatch(
+    protos::pbzero::QueryResult* res) {
+  // Unlike SerializeBatch(), nothing can be written before the whole batch has
+  // been iterated: all the cells are buffered, column by column.
+  auto* batch = res->add_batch();
+
+  const uint32_t max_rows = num_cols_ ? cells_per_batch_ / num_cols_ : 0;
+  std::vector<ColumnBuffer> columns(num_cols_);
+  for (ColumnBuffer& column : columns) {
+    column.cell_types.reserve(max_rows);
+    column.fixed64_values.reserve(max_rows);
+  }
+
+  uint32_t approx_batch_size = 16;
+  uint32_t num_rows = 0;
+  bool batch_full = false;
+
+  for (;; ++num_rows) {
+    // As in SerializeBatch(), col_ is 0 here if the iterator is on a row
+    // which didn't fit in the previous batch.
+    if (col_ >= num_cols_) {
+      col_ = 0;
+      if (!iter_->Next())
+        break;  // EOF or error.
+
+      PERFETTO_DCHECK(num_cols_ > 0);
+      if ((num_rows + 1) * num_cols_ > cells_per_batch_ ||
+          approx_batch_size > batch_split_threshold_) {
+        batch_full = true;
+        break;
+      }
+    }
+
+    for (; col_ < num_cols_; ++col_) {
+      ColumnBuffer& column = columns[col_];
+      auto value = iter_->Get(col_);
+      uint8_t cell_type = BatchProto::CELL_INVALID;
+      int64_t fixed64 = 0;
+      switch (value.type) {
+        case SqlValue::Type::kNull: {
+          cell_type = BatchProto::CELL_NULL;
+          break;
+        }
+        case SqlValue::Type::kLong: {
+          cell_type = BatchProto::CELL_VARINT;
+          fixed64 = value.long_value;
+          column.has_fixed64 = true;
+          break;
+        }
+        case SqlValue::Type::kDouble: {
+          cell_type = BatchProto::CELL_FLOAT64;
+          memcpy(&fixed64, &value.double_value, sizeof(fixed64));
+          column.has_fixed64 = true;
+          break;
+        }
+        case SqlValue::Type::kString: {
+          cell_type = BatchProto::CELL_STRING;
+          size_t len = strlen(value.string_value);
+          column.string_values.append(value.string_value, len);
+          column.has_strings = true;
+          approx_batch_size += static_cast<uint32_t>(len);
+          break;
+        }
+        case SqlValue::Type::kBytes: {
+          cell_type = BatchProto::CELL_BLOB;
+          column.blob_values.resize(num_rows);
+          column.blob_values.emplace_back(
+              static_cast<const char*>(value.bytes_value), value.bytes_count);
+          approx_batch_size += static_cast<uint32_t>(value.bytes_count) + 4;
+          break;
+        }
+      }
+      PERFETTO_DCHECK(cell_type != BatchProto::CELL_INVALID);
+      column.cell_types.push_back(cell_type);
+      column.fixed64_values.push_back(fixed64);
+      column.string_values.push_back('\0');
+      approx_batch_size += sizeof(fixed64) + 2;
+    }
+  }  // for (row)
+
+  for (ColumnBuffer& column : columns) {
+    auto* col = batch->add_columns();
+
+    uint8_t type = BatchProto::CELL_NULL;
+    bool has_nulls = false;
+    for (uint8_t cell_type : column.cell_types) {
+      if (cell_type == BatchProto::CELL_NULL) {
+        has_nulls = true;
+      } else if (type == BatchProto::CELL_NULL) {
+        type = cell_type;
+      } else if (type != cell_type) {
+        type = BatchProto::CELL_INVALID;
+      }
+    }
+    col->set_type(static_cast<BatchProto::CellType>(type));
+
+    if (has_nulls) {
+      std::vector<uint8_t> null_bitmap((num_rows + 7) / 8);
+      for (uint32_t row = 0; row < num_rows; ++row) {
+        if (column.cell_types[row] == BatchProto::CELL_NULL)
+          null_bitmap[row / 8] |= static_cast<uint8_t>(1u << (row % 8));
+      }
+      col->set_null_bitmap(null_bitmap.data(), null_bitmap.size());
+    }
+    if (type == BatchProto::CELL_INVALID)
+      col->set_cell_types(column.cell_types.data(), column.cell_types.size());
+    if (column.has_fixed64) {
+      // Trace processor only runs on little-endian architectures.
+      col->set_fixed64_values(
+          reinterpret_cast<const uint8_t*>(column.fixed64_values.data()),
+          column.fixed64_values.size() * sizeof(int64_t));
+    }
+    if (column.has_strings)
+      col->set_string_values(column.string_values);
+    if (!column.blob_values.empty()) {
+      column.blob_values.resize(num_rows);
+      for (const std::string& blob : column.blob_values)
+        col->add_blob_values(blob);
+    }
+  }
+  batch->set_row_count(num_rows);
+
+  if (!batch_full) {
+    eof_reached_ = true;
+    batch->set_is_last_batch(true);
+  }
+  batch->Finalize();
+}
+
 void QueryResultSerializer::MaybeSerializeError(
     protos::pbzero::QueryResult* res) {
   if (iter_->Status().ok())
@@ -262,6 +413,26 @@ void QueryResultSerializer::MaybeSerializeError(
   res->set_error(err);
 }
 
+void QueryResultSerializer::MaybeSerializeProfile(
+    protos::pbzero::QueryResult* res) {
+  const QueryProfiler* profiler = iter_->profiler();
+  if (!profiler)
+    return;
+  for (const QueryProfile::TableScan& scan : profiler->profile().table_scans) {
+    auto* scan_proto = res->add_table_scans();
+    scan_proto->set_table_name(scan.table_name);
+    scan_proto->set_plan(scan.plan);
+    scan_proto->set_filter_count(scan.filter_count);
+    scan_proto->set_filter_ns(scan.filter_ns);
+    scan_proto->set_next_count(scan.next_count);
+    scan_proto->set_next_ns(scan.next_ns);
+    scan_proto->set_column_count(scan.column_count);
+    scan_proto->set_column_ns(scan.column_ns);
+    scan_proto->set_rows_examined(scan.rows_examined);
+    scan_proto->set_rows_returned(scan.rows_returned);
+  }
+}
+
 void QueryResultSerializer::SerializeMetadata(
     protos::pbzero::QueryResult* res) {
   PERFETTO_DCHECK(!did_write_metadata_);
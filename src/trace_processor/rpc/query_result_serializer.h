@@ -51,10 +51,14 @@ class IteratorImpl;
 //   of a row).
 // The intended use case is streaaming these batches onto through a
 // chunked-encoded HTTP response, or through a repetition of Wasm calls.
+//
+// If |columnar| is true, the batches are written in the columnar layout (see
+// CellsBatch.columns) rather than cell by cell. The batches are split at the
+// same thresholds.
 class QueryResultSerializer {
  public:
   static constexpr uint32_t kDefaultBatchSplitThreshold = 128 * 1024;
-  explicit QueryResultSerializer(Iterator);
+  explicit QueryResultSerializer(Iterator, bool columnar = false);
   ~QueryResultSerializer();
 
   // No copy or move.
@@ -78,10 +82,13 @@ class QueryResultSerializer {
  private:
   void SerializeMetadata(protos::pbzero::QueryResult*);
   void SerializeBatch(protos::pbzero::QueryResult*);
+  void SerializeColumnarBatch(protos::pbzero::QueryResult*);
   void MaybeSerializeError(protos::pbzero::QueryResult*);
+  void MaybeSerializeProfile(protos::pbzero::QueryResult*);
 
   std::unique_ptr<IteratorImpl> iter_;
   const uint32_t num_cols_;
+  const bool columnar_;
   bool did_write_metadata_ = false;
   bool eof_reached_ = false;
   uint32_t col_ = UINT32_MAX;
@@ -84,6 +84,7 @@ class TestDeserializer {
  public:
   void SerializeAndDeserialize(QueryResultSerializer*);
   void DeserializeBuffer(const uint8_t* start, size_t size);
+  void DeserializeColumnarBatch(const BatchProto::Decoder& batch);
 
   std::vector<std::string> columns;
   std::vector<SqlValue> cells;
@@ -117,6 +118,11 @@ void TestDeserializer::DeserializeBuffer(const uint8_t* start, size_t size) {
 
     ResultProto::CellsBatch::Decoder batch(batch_bytes.data, batch_bytes.size);
     eof_reached = batch.is_last_batch();
+    if (batch.has_row_count()) {
+      EXPECT_FALSE(batch.has_cells());
+      DeserializeColumnarBatch(batch);
+      continue;
+    }
     std::deque<int64_t> varints;
     std::deque<double> doubles;
     std::deque<std::string> blobs;
@@ -193,6 +199,100 @@ void TestDeserializer::DeserializeBuffer(const uint8_t* start, size_t size) {
   }
 }
 
+void TestDeserializer::DeserializeColumnarBatch(
+    const BatchProto::Decoder& batch) {
+  const uint32_t num_rows = batch.row_count();
+  std::vector<std::vector<SqlValue>> column_cells;
+  for (auto col_it = batch.columns(); col_it; ++col_it) {
+    BatchProto::Column::Decoder col(*col_it);
+    protozero::ConstBytes null_bitmap = col.null_bitmap();
+    protozero::ConstBytes cell_types = col.cell_types();
+    protozero::ConstBytes fixed64_values = col.fixed64_values();
+    if (col.has_null_bitmap())
+      ASSERT_EQ(null_bitmap.size, (num_rows + 7) / 8);
+    if (col.has_cell_types())
+      ASSERT_EQ(cell_types.size, num_rows);
+    if (col.has_fixed64_values())
+      ASSERT_EQ(fixed64_values.size, num_rows * sizeof(int64_t));
+
+    std::vector<std::string> strings;
+    std::string merged_strings = col.string_values().ToStdString();
+    for (size_t pos = 0; pos < merged_strings.size();) {
+      size_t next_sep = merged_strings.find('\0', pos);
+      ASSERT_NE(next_sep, std::string::npos);
+      strings.emplace_back(merged_strings.substr(pos, next_sep - pos));
+      pos = next_sep + 1;
+    }
+    if (col.has_string_values())
+      ASSERT_EQ(strings.size(), num_rows);
+
+    std::vector<std::string> blobs;
+    for (auto it = col.blob_values(); it; ++it)
+      blobs.emplace_back((*it).ToStdString());
+    if (col.has_blob_values())
+      ASSERT_EQ(blobs.size(), num_rows);
+
+    std::vector<SqlValue> values;
+    for (uint32_t row = 0; row < num_rows; ++row) {
+      bool is_null = col.has_null_bitmap() &&
+                     ((null_bitmap.data[row / 8] >> (row % 8)) & 1);
+      uint8_t cell_type = static_cast<uint8_t>(col.type());
+      if (is_null) {
+        cell_type = BatchProto::CELL_NULL;
+      } else if (cell_type == BatchProto::CELL_INVALID) {
+        cell_type = cell_types.data[row];
+      }
+      int64_t fixed64 = 0;
+      if (cell_type == BatchProto::CELL_VARINT ||
+          cell_type == BatchProto::CELL_FLOAT64) {
+        ASSERT_TRUE(col.has_fixed64_values());
+        memcpy(&fixed64, fixed64_values.data + row * sizeof(int64_t),
+               sizeof(int64_t));
+      }
+      switch (cell_type) {
+        case BatchProto::CELL_NULL:
+          values.emplace_back(SqlValue());
+          break;
+        case BatchProto::CELL_VARINT:
+          values.emplace_back(SqlValue::Long(fixed64));
+          break;
+        case BatchProto::CELL_FLOAT64: {
+          double value;
+          memcpy(&value, &fixed64, sizeof(value));
+          values.emplace_back(SqlValue::Double(value));
+          break;
+        }
+        case BatchProto::CELL_STRING: {
+          ASSERT_LT(row, strings.size());
+          const std::string& str = strings[row];
+          copied_buf_.emplace_back(new char[str.size() + 1]);
+          memcpy(copied_buf_.back().get(), str.c_str(), str.size() + 1);
+          values.emplace_back(SqlValue::String(copied_buf_.back().get()));
+          break;
+        }
+        case BatchProto::CELL_BLOB: {
+          ASSERT_LT(row, blobs.size());
+          const std::string& bytes = blobs[row];
+          copied_buf_.emplace_back(new char[bytes.size()]);
+          memcpy(copied_buf_.back().get(), bytes.data(), bytes.size());
+          values.emplace_back(
+              SqlValue::Bytes(copied_buf_.back().get(), bytes.size()));
+          break;
+        }
+        default:
+          FAIL() << "Unexpected cell type " << cell_type;
+      }
+    }
+    column_cells.emplace_back(std::move(values));
+  }
+
+  ASSERT_EQ(column_cells.size(), columns.size());
+  for (uint32_t row = 0; row < num_rows; ++row) {
+    for (const auto& values : column_cells)
+      cells.push_back(values[row]);
+  }
+}
+
 TEST(QueryResultSerializerTest, ShortBatch) {
   auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
 
@@ -401,6 +501,71 @@ TEST(QueryResultSerializerTest, RandomSizes) {
   }
 }
 
+TEST(QueryResultSerializerTest, ColumnarShortBatch) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+
+  auto iter = tp->ExecuteQuery(
+      "select 1 as i8, 42001001001 as i64, 1e9 as f64, 'a_string' as str, "
+      "cast('a_blob' as blob) as blb, NULL as nul");
+  QueryResultSerializer ser(std::move(iter), /*columnar=*/true);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+
+  EXPECT_THAT(deser.columns,
+              ElementsAre("i8", "i64", "f64", "str", "blb", "nul"));
+  EXPECT_THAT(deser.cells,
+              ElementsAre(SqlValue::Long(1), SqlValue::Long(42001001001),
+                          SqlValue::Double(1e9), SqlValue::String("a_string"),
+                          SqlValue::Bytes("a_blob", 6), SqlValue()));
+}
+
+TEST(QueryResultSerializerTest, ColumnarNullsAndMixedTypes) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+  RunQueryChecked(tp.get(), "create table tab (x, y)");
+  RunQueryChecked(tp.get(),
+                  "insert into tab (x, y) values (1, NULL), (NULL, 'a'), "
+                  "(2.5, 'b'), ('c', NULL), (X'0102', 'd')");
+
+  auto iter = tp->ExecuteQuery("select x, y from tab");
+  QueryResultSerializer ser(std::move(iter), /*columnar=*/true);
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+
+  EXPECT_THAT(deser.columns, ElementsAre("x", "y"));
+  EXPECT_THAT(deser.cells,
+              ElementsAre(SqlValue::Long(1), SqlValue(), SqlValue(),
+                          SqlValue::String("a"), SqlValue::Double(2.5),
+                          SqlValue::String("b"), SqlValue::String("c"),
+                          SqlValue(), SqlValue::Bytes("\x01\x02", 2),
+                          SqlValue::String("d")));
+}
+
+TEST(QueryResultSerializerTest, ColumnarBatchSaturatingNumCells) {
+  auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
+
+  RunQueryChecked(tp.get(), "create virtual table win using window;");
+  RunQueryChecked(tp.get(),
+                  "update win set window_start=0, window_dur=1000, quantum=1 "
+                  "where rowid = 0");
+  auto iter = tp->ExecuteQuery(
+      "select 'x' as x, ts, dur * 1.0 as dur, quantum_ts from win");
+  QueryResultSerializer ser(std::move(iter), /*columnar=*/true);
+  ser.set_batch_size_for_testing(16, 4096);
+
+  TestDeserializer deser;
+  deser.SerializeAndDeserialize(&ser);
+
+  ASSERT_THAT(deser.columns, ElementsAre("x", "ts", "dur", "quantum_ts"));
+  ASSERT_EQ(deser.cells.size(), 4 * 1000u);
+  for (uint32_t row = 0; row < 1000; row++) {
+    uint32_t cell = row * 4;
+    ASSERT_EQ(deser.cells[cell], SqlValue::String("x"));
+    ASSERT_EQ(deser.cells[cell + 1], SqlValue::Long(row));
+    ASSERT_EQ(deser.cells[cell + 2], SqlValue::Double(1.0));
+    ASSERT_EQ(deser.cells[cell + 3], SqlValue::Long(row));
+  }
+}
+
 TEST(QueryResultSerializerTest, ErrorBeforeStartingQuery) {
   auto tp = TraceProcessor::CreateInstance(trace_processor::Config());
   auto iter = tp->ExecuteQuery("insert into incomplete_input");
@@ -95,23 +95,38 @@ Rpc::Rpc(std::unique_ptr<TraceProcessor> preloaded_instance)
 }
 
 Rpc::Rpc() : Rpc(nullptr) {}
+
+Rpc::Rpc(const Config& config) : base_config_(config) {
+  ResetTraceProcessorInternal(config);
+}
+
 Rpc::~Rpc() = default;
 
+Rpc::Session::Session() = default;
+Rpc::Session::~Session() = default;
+
 void Rpc::ResetTraceProcessorInternal(const Config& config) {
+  // The iterators of paused queries would outlive the instance they refer to.
+  InterruptPendingQueries();
   trace_processor_config_ = config;
   trace_processor_ = TraceProcessor::CreateInstance(config);
   bytes_parsed_ = bytes_last_progress_ = 0;
   t_parse_started_ = base::GetWallTimeNs().count();
-  // Deliberately not resetting the RPC channel state (rxbuf_, {tx,rx}_seq_id_).
+  // Deliberately not resetting the RPC channel state (|sessions_|).
   // This is invoked from the same client to clear the current trace state
   // before loading a new one. The IPC channel is orthogonal to that and the
   // message numbering continues regardless of the reset.
 }
 
 void Rpc::OnRpcRequest(const void* data, size_t len) {
-  rxbuf_.Append(data, len);
+  OnRpcRequest(kDefaultSessionId, data, len);
+}
+
+void Rpc::OnRpcRequest(SessionId session_id, const void* data, size_t len) {
+  Session* session = &sessions_[session_id];
+  session->rxbuf.Append(data, len);
   for (;;) {
-    auto msg = rxbuf_.ReadMessage();
+    auto msg = session->rxbuf.ReadMessage();
     if (!msg.valid()) {
       if (msg.fatal_framing_error) {
         protozero::HeapBuffered<TraceProcessorRpcStream> err_msg;
@@ -122,10 +137,14 @@ void Rpc::OnRpcRequest(const void* data, size_t len) {
       }
       break;
     }
-    ParseRpcRequest(msg.start, msg.len);
+    ParseRpcRequest(session, msg.start, msg.len);
   }
 }
 
+void Rpc::CloseSession(SessionId session_id) {
+  sessions_.erase(session_id);
+}
+
 namespace {
 
 using ProtoEnum = protos::pbzero::MetatraceCategories;
@@ -152,18 +171,21 @@ TraceProcessor::MetatraceCategories MetatraceCategoriesToPublicEnum(
 
 // [data, len] here is a tokenized TraceProcessorRpc proto message, without the
 // size header.
-void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
+void Rpc::ParseRpcRequest(Session* session,
+                          const uint8_t* data,
+                          size_t len) {
   RpcProto::Decoder req(data, len);
 
   // We allow restarting the sequence from 0. This happens when refreshing the
   // browser while using the external trace_processor_shell --httpd.
-  if (req.seq() != 0 && rx_seq_id_ != 0 && req.seq() != rx_seq_id_ + 1) {
+  int64_t& rx_seq_id = session->rx_seq_id;
+  if (req.seq() != 0 && rx_seq_id != 0 && req.seq() != rx_seq_id + 1) {
     char err_str[255];
     // "(ERR:rpc_seq)" is intercepted by error_dialog.ts in the UI.
     snprintf(err_str, sizeof(err_str),
              "RPC request out of order. Expected %" PRId64 ", got %" PRId64
              " (ERR:rpc_seq)",
-             rx_seq_id_ + 1, req.seq());
+             rx_seq_id + 1, req.seq());
     PERFETTO_ELOG("%s", err_str);
     protozero::HeapBuffered<TraceProcessorRpcStream> err_msg;
     err_msg->add_msg()->set_fatal_error(err_str);
@@ -172,14 +194,24 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
     rpc_response_fn_(nullptr, 0);  // Disconnect.
     return;
   }
-  rx_seq_id_ = req.seq();
+  rx_seq_id = req.seq();
 
   // The static cast is to prevent that the compiler breaks future proofness.
   const int req_type = static_cast<int>(req.request());
   static const char kErrFieldNotSet[] = "RPC error: request field not set";
+
+  // A paused query holds a live SQLite statement, which must not survive
+  // requests that can change (or destroy) the tables it iterates on. If the
+  // query was already interrupted, this also tells the client about it.
+  bool keeps_pending_query = req_type == RpcProto::TPM_QUERY_STREAMING_ACK ||
+                             req_type == RpcProto::TPM_QUERY_STREAMING_CANCEL ||
+                             req_type == RpcProto::TPM_GET_STATUS;
+  if (!keeps_pending_query || session->pending_query_interrupted)
+    CancelPendingQuery(session);
+
   switch (req_type) {
     case RpcProto::TPM_APPEND_TRACE_DATA: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(session->tx_seq_id++, req_type);
       auto* result = resp->set_append_result();
       if (!req.has_append_trace_data()) {
         result->set_error(kErrFieldNotSet);
@@ -194,31 +226,58 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
       break;
     }
     case RpcProto::TPM_FINALIZE_TRACE_DATA: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(session->tx_seq_id++, req_type);
       NotifyEndOfFile();
       resp.Send(rpc_response_fn_);
       break;
     }
     case RpcProto::TPM_QUERY_STREAMING: {
       if (!req.has_query_args()) {
-        Response resp(tx_seq_id_++, req_type);
+        Response resp(session->tx_seq_id++, req_type);
         auto* result = resp->set_query_result();
         result->set_error(kErrFieldNotSet);
         resp.Send(rpc_response_fn_);
       } else {
         protozero::ConstBytes args = req.query_args();
+        protos::pbzero::QueryArgs::Decoder query(args.data, args.size);
         auto it = QueryInternal(args.data, args.size);
-        QueryResultSerializer serializer(std::move(it));
+        if (query.max_inflight_batches() > 0) {
+          // Flow controlled query: send only as many batches as the client
+          // allowed and keep the iterator around for TPM_QUERY_STREAMING_ACK.
+          session->pending_query.reset(new QueryResultSerializer(
+              std::move(it), query.columnar_result()));
+          session->pending_query_window = query.max_inflight_batches();
+          SendPendingQueryBatches(session);
+          break;
+        }
+        QueryResultSerializer serializer(std::move(it),
+                                         query.columnar_result());
         for (bool has_more = true; has_more;) {
-          Response resp(tx_seq_id_++, req_type);
+          Response resp(session->tx_seq_id++, req_type);
           has_more = serializer.Serialize(resp->set_query_result());
           resp.Send(rpc_response_fn_);
         }
       }
       break;
     }
+    case RpcProto::TPM_QUERY_STREAMING_ACK: {
+      // The batches are sent as TPM_QUERY_STREAMING responses: there is no
+      // response of type TPM_QUERY_STREAMING_ACK. Acks racing with the end of
+      // the query are expected and ignored.
+      protos::pbzero::QueryStreamingAckArgs::Decoder ack(
+          req.query_streaming_ack_args());
+      if (session->pending_query) {
+        session->pending_query_window += ack.num_batches();
+        SendPendingQueryBatches(session);
+      }
+      break;
+    }
+    case RpcProto::TPM_QUERY_STREAMING_CANCEL: {
+      CancelPendingQuery(session);
+      break;
+    }
     case RpcProto::TPM_COMPUTE_METRIC: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(session->tx_seq_id++, req_type);
       auto* result = resp->set_metric_result();
       if (!req.has_compute_metric_args()) {
         result->set_error(kErrFieldNotSet);
@@ -230,7 +289,7 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
       break;
     }
     case RpcProto::TPM_GET_METRIC_DESCRIPTORS: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(session->tx_seq_id++, req_type);
       auto descriptor_set = trace_processor_->GetMetricDescriptors();
       auto* result = resp->set_metric_descriptors();
       result->AppendRawProtoBytes(descriptor_set.data(), descriptor_set.size());
@@ -238,8 +297,8 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
       break;
     }
     case RpcProto::TPM_RESTORE_INITIAL_TABLES: {
-      trace_processor_->RestoreInitialTables();
-      Response resp(tx_seq_id_++, req_type);
+      RestoreInitialTables();
+      Response resp(session->tx_seq_id++, req_type);
       resp.Send(rpc_response_fn_);
       break;
     }
@@ -248,25 +307,25 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
       protozero::ConstBytes args = req.enable_metatrace_args();
       EnableMetatrace(args.data, args.size);
 
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(session->tx_seq_id++, req_type);
       resp.Send(rpc_response_fn_);
       break;
     }
     case RpcProto::TPM_DISABLE_AND_READ_METATRACE: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(session->tx_seq_id++, req_type);
       DisableAndReadMetatraceInternal(resp->set_metatrace());
       resp.Send(rpc_response_fn_);
       break;
     }
     case RpcProto::TPM_GET_STATUS: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(session->tx_seq_id++, req_type);
       std::vector<uint8_t> status = GetStatus();
       resp->set_status()->AppendRawProtoBytes(status.data(), status.size());
       resp.Send(rpc_response_fn_);
       break;
     }
     case RpcProto::TPM_RESET_TRACE_PROCESSOR: {
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(session->tx_seq_id++, req_type);
       protozero::ConstBytes args = req.reset_trace_processor_args();
       ResetTraceProcessor(args.data, args.size);
       resp.Send(rpc_response_fn_);
@@ -277,7 +336,7 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
       // generic "unkown request" response, so the client can do feature
       // detection
       PERFETTO_DLOG("[RPC] Uknown request type (%d), size=%zu", req_type, len);
-      Response resp(tx_seq_id_++, req_type);
+      Response resp(session->tx_seq_id++, req_type);
       resp->set_invalid_request(
           static_cast<RpcProto::TraceProcessorMethod>(req_type));
       resp.Send(rpc_response_fn_);
@@ -286,6 +345,45 @@ void Rpc::ParseRpcRequest(const uint8_t* data, size_t len) {
   }  // switch(req_type)
 }
 
+void Rpc::SendPendingQueryBatches(Session* session) {
+  while (session->pending_query && session->pending_query_window > 0) {
+    Response resp(session->tx_seq_id++, RpcProto::TPM_QUERY_STREAMING);
+    bool has_more = session->pending_query->Serialize(resp->set_query_result());
+    resp.Send(rpc_response_fn_);
+    session->pending_query_window--;
+    if (!has_more)
+      session->pending_query.reset();
+  }
+}
+
+void Rpc::CancelPendingQuery(Session* session) {
+  if (!session->pending_query && !session->pending_query_interrupted)
+    return;
+  session->pending_query.reset();
+  session->pending_query_window = 0;
+  session->pending_query_interrupted = false;
+
+  // Terminate the stream so the client stops waiting for more batches.
+  Response resp(session->tx_seq_id++, RpcProto::TPM_QUERY_STREAMING);
+  auto* result = resp->set_query_result();
+  result->set_error("Query cancelled");
+  result->add_batch()->set_is_last_batch(true);
+  resp.Send(rpc_response_fn_);
+}
+
+void Rpc::InterruptPendingQueries() {
+  // Responses can only be sent to the session being served, so the other
+  // sessions are notified lazily by CancelPendingQuery().
+  for (auto& id_and_session : sessions_) {
+    Session& session = id_and_session.second;
+    if (!session.pending_query)
+      continue;
+    session.pending_query.reset();
+    session.pending_query_window = 0;
+    session.pending_query_interrupted = true;
+  }
+}
+
 util::Status Rpc::Parse(const uint8_t* data, size_t len) {
   PERFETTO_TP_TRACE(
       metatrace::Category::TOPLEVEL, "RPC_PARSE",
@@ -303,6 +401,9 @@ util::Status Rpc::Parse(const uint8_t* data, size_t len) {
   if (len == 0)
     return util::OkStatus();
 
+  // Adding data to the tables would invalidate the paused queries.
+  InterruptPendingQueries();
+
   // TraceProcessor needs take ownership of the memory chunk.
   std::unique_ptr<uint8_t[]> data_copy(new uint8_t[len]);
   memcpy(data_copy.get(), data, len);
@@ -312,6 +413,7 @@ util::Status Rpc::Parse(const uint8_t* data, size_t len) {
 void Rpc::NotifyEndOfFile() {
   PERFETTO_TP_TRACE(metatrace::Category::TOPLEVEL, "RPC_NOTIFY_END_OF_FILE");
 
+  InterruptPendingQueries();
   trace_processor_->NotifyEndOfFile();
   eof_ = true;
   MaybePrintProgress();
@@ -320,7 +422,7 @@ void Rpc::NotifyEndOfFile() {
 void Rpc::ResetTraceProcessor(const uint8_t* args, size_t len) {
   protos::pbzero::ResetTraceProcessorArgs::Decoder reset_trace_processor_args(
       args, len);
-  Config config;
+  Config config = base_config_;
   if (reset_trace_processor_args.has_drop_track_event_data_before()) {
     config.drop_track_event_data_before =
         reset_trace_processor_args.drop_track_event_data_before() ==
@@ -357,8 +459,9 @@ void Rpc::MaybePrintProgress() {
 void Rpc::Query(const uint8_t* args,
                 size_t len,
                 QueryResultBatchCallback result_callback) {
+  protos::pbzero::QueryArgs::Decoder query(args, len);
   auto it = QueryInternal(args, len);
-  QueryResultSerializer serializer(std::move(it));
+  QueryResultSerializer serializer(std::move(it), query.columnar_result());
 
   std::vector<uint8_t> res;
   for (bool has_more = true; has_more;) {
@@ -380,10 +483,26 @@ Iterator Rpc::QueryInternal(const uint8_t* args, size_t len) {
                       }
                     });
 
-  return trace_processor_->ExecuteQuery(sql.c_str());
+  if (!query.has_max_wall_time_ms() && !query.has_max_sqlite_memory_bytes() &&
+      !query.profile()) {
+    return trace_processor_->ExecuteQuery(sql.c_str());
+  }
+
+  // Fields which are not set keep the limit of the instance config. This is
+  // only known when the instance was created by us: preloaded instances can
+  // only have their limits overridden as a whole.
+  QueryBudget budget = trace_processor_config_.query_budget;
+  if (query.has_max_wall_time_ms())
+    budget.max_wall_time_ms = query.max_wall_time_ms();
+  if (query.has_max_sqlite_memory_bytes())
+    budget.max_sqlite_memory_bytes = query.max_sqlite_memory_bytes();
+  if (query.profile())
+    return trace_processor_->ExecuteQueryWithProfile(sql.c_str(), budget);
+  return trace_processor_->ExecuteQuery(sql.c_str(), budget);
 }
 
 void Rpc::RestoreInitialTables() {
+  InterruptPendingQueries();
   trace_processor_->RestoreInitialTables();
 }
 
@@ -483,6 +602,14 @@ std::vector<uint8_t> Rpc::GetStatus() {
   status->set_loaded_trace_name(trace_processor_->GetCurrentTraceName());
   status->set_human_readable_version(base::GetVersionString());
   status->set_api_version(protos::pbzero::TRACE_PROCESSOR_CURRENT_API_VERSION);
+  auto it = trace_processor_->ExecuteQuery(
+      "SELECT SUM(used_bytes), SUM(reserved_bytes) "
+      "FROM __intrinsic_memory_usage");
+  if (it.Next()) {
+    status->set_memory_used_bytes(static_cast<uint64_t>(it.Get(0).AsLong()));
+    status->set_memory_reserved_bytes(
+        static_cast<uint64_t>(it.Get(1).AsLong()));
+  }
   return status.SerializeAsArray();
 }
 
@@ -18,6 +18,7 @@
 #define SRC_TRACE_PROCESSOR_RPC_RPC_H_
 
 #include <functional>
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -40,6 +41,7 @@ class DisableAndReadMetatraceResult;
 namespace trace_processor {
 
 class Iterator;
+class QueryResultSerializer;
 class TraceProcessor;
 
 // This class handles the binary {,un}marshalling for the Trace Processor RPC
@@ -63,6 +65,12 @@ class Rpc {
   // created internally by calling Parse().
   explicit Rpc(std::unique_ptr<TraceProcessor>);
   Rpc();
+
+  // Creates the instance with |config|, which is also the base of the config
+  // of the instances created by ResetTraceProcessor(). This is for the options
+  // which are a property of the environment (e.g. thread counts) rather than
+  // something the client asks for.
+  explicit Rpc(const Config& config);
   ~Rpc();
 
   // 1. TraceProcessor byte-pipe RPC interface.
@@ -79,6 +87,19 @@ class Rpc {
   // Responses are sent throught the RpcResponseFunction (below).
   void OnRpcRequest(const void* data, size_t len);
 
+  // Like the above, but for one of several independent clients sharing this
+  // instance (e.g. one per websocket connection), identified by |session_id|.
+  // Each session has its own message framing, sequence numbers and paused
+  // query (see QueryArgs.max_inflight_batches), so that clients don't break
+  // each other's RPC streams and the batches of their queries can be
+  // interleaved. The overload above uses the session |kDefaultSessionId|.
+  using SessionId = uint64_t;
+  static constexpr SessionId kDefaultSessionId = 0;
+  void OnRpcRequest(SessionId session_id, const void* data, size_t len);
+
+  // Drops the state of |session_id|, e.g. when its connection is closed.
+  void CloseSession(SessionId session_id);
+
   // The size argument is a uint32_t and not size_t to avoid ABI mismatches
   // with Wasm, where size_t = uint32_t.
   // (nullptr, 0) has the semantic of "close the channel" and is issued when an
@@ -132,22 +153,43 @@ class Rpc {
   void Query(const uint8_t* args, size_t len, QueryResultBatchCallback);
 
  private:
-  void ParseRpcRequest(const uint8_t* data, size_t len);
+  // The state of a client of the byte-pipe interface. See OnRpcRequest().
+  struct Session {
+    Session();
+    ~Session();
+
+    protozero::ProtoRingBuffer rxbuf;
+    int64_t tx_seq_id = 0;
+    int64_t rx_seq_id = 0;
+
+    // The TPM_QUERY_STREAMING query which has been paused because it ran out
+    // of |pending_query_window|, if any.
+    std::unique_ptr<QueryResultSerializer> pending_query;
+    uint32_t pending_query_window = 0;
+
+    // Set when the paused query was dropped because the trace processor state
+    // changed under it. The client is told on its next request.
+    bool pending_query_interrupted = false;
+  };
+
+  void ParseRpcRequest(Session*, const uint8_t* data, size_t len);
   void ResetTraceProcessorInternal(const Config& config);
   void MaybePrintProgress();
   Iterator QueryInternal(const uint8_t* args, size_t len);
+  void SendPendingQueryBatches(Session*);
+  void CancelPendingQuery(Session*);
+  void InterruptPendingQueries();
   void ComputeMetricInternal(const uint8_t* args,
                              size_t len,
                              protos::pbzero::ComputeMetricResult*);
   void DisableAndReadMetatraceInternal(
       protos::pbzero::DisableAndReadMetatraceResult*);
 
+  Config base_config_;
   Config trace_processor_config_;
   std::unique_ptr<TraceProcessor> trace_processor_;
   RpcResponseFunction rpc_response_fn_;
-  protozero::ProtoRingBuffer rxbuf_;
-  int64_t tx_seq_id_ = 0;
-  int64_t rx_seq_id_ = 0;
+  std::map<SessionId, Session> sessions_;
   bool eof_ = false;
   int64_t t_parse_started_ = 0;
   size_t bytes_last_progress_ = 0;
@@ -16,10 +16,16 @@
 
 #include <emscripten/emscripten.h>
 
+#include <algorithm>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/trace_processor/trace_processor.h"
 #include "src/trace_processor/rpc/rpc.h"
 
+#if defined(__EMSCRIPTEN_PTHREADS__)
+#include <emscripten/threading.h>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 
@@ -29,6 +35,33 @@ Rpc* g_trace_processor_rpc;
 // The buffer used to pass the request arguments. The caller (JS) decides how
 // big this buffer should be in the Initialize() call.
 uint8_t* g_req_buf;
+
+#if defined(__EMSCRIPTEN_PTHREADS__)
+// The number of threads of each thread pool. Pthreads can only be started
+// from the pool of web workers created when the module is loaded, so the pools
+// which can be alive at the same time must fit in PTHREAD_POOL_SIZE (see
+// trace_processor_threads_wasm in src/trace_processor/BUILD.gn).
+constexpr uint32_t kMaxThreadsPerPool = 2;
+#endif
+
+Config CreateConfig() {
+  Config config;
+#if defined(__EMSCRIPTEN_PTHREADS__)
+  // Keep one core for the worker running the trace processor itself.
+  int cores = emscripten_num_logical_cores();
+  uint32_t threads = std::min(kMaxThreadsPerPool,
+                              static_cast<uint32_t>(std::max(cores - 1, 0)));
+  if (threads > 1) {
+    config.sorting_thread_count = threads;
+    config.tokenization_thread_count = threads;
+    config.filter_thread_count = threads;
+    config.heap_graph_thread_count = threads;
+    config.memory_graph_thread_count = threads;
+  }
+#endif
+  return config;
+}
+
 }  // namespace
 
 // +---------------------------------------------------------------------------+
@@ -41,7 +74,7 @@ uint8_t* EMSCRIPTEN_KEEPALIVE trace_processor_rpc_init(Rpc::RpcResponseFunction,
                                                        uint32_t);
 uint8_t* trace_processor_rpc_init(Rpc::RpcResponseFunction resp_function,
                                   uint32_t req_buffer_size) {
-  g_trace_processor_rpc = new Rpc();
+  g_trace_processor_rpc = new Rpc(CreateConfig());
 
   // |resp_function| is a JS-bound function passed by wasm_bridge.ts. It will
   // call back into JavaScript. There the JS code will copy the passed
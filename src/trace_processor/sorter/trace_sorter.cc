@@ -24,20 +24,41 @@
 #include "src/trace_processor/sorter/trace_sorter.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/util/bump_allocator.h"
+#include "src/trace_processor/util/threading.h"
 
 namespace perfetto {
 namespace trace_processor {
+namespace {
+
+// The sorting window is only used once this many read buffer events have been
+// seen, so that the out-of-orderness of a few full read cycles is known.
+constexpr uint32_t kMinReadBufferEventsForWindow = 2;
+
+// The sorting window is this many times the largest delay observed so far...
+constexpr int64_t kWindowLatenessMultiplier = 2;
+
+// ... but never shorter than this.
+constexpr int64_t kMinSortingWindowNs = 1000 * 1000 * 1000;
+
+}  // namespace
 
 TraceSorter::TraceSorter(TraceProcessorContext* context,
                          std::unique_ptr<TraceParser> parser,
                          SortingMode sorting_mode)
     : context_(context),
       parser_(std::move(parser)),
-      sorting_mode_(sorting_mode) {
+      sorting_mode_(sorting_mode),
+      token_buffer_(context->sorter_spill_file.get()) {
   const char* env = getenv("TRACE_PROCESSOR_SORT_ONLY");
   bypass_next_stage_for_testing_ = env && !strcmp(env, "1");
   if (bypass_next_stage_for_testing_)
     PERFETTO_ELOG("TEST MODE: bypassing protobuf parsing stage");
+
+#if PERFETTO_TP_HAS_THREADS()
+  uint32_t sorting_thread_count = context_->config.sorting_thread_count;
+  if (sorting_thread_count > 0)
+    sort_pool_.reset(new base::ThreadPool(sorting_thread_count));
+#endif
 }
 
 TraceSorter::~TraceSorter() {
@@ -95,8 +116,12 @@ void TraceSorter::Queue::Sort() {
 // With Android traces (that have 8 CPUs) this function accounts for ~1-3% cpu
 // time in a profiler.
 void TraceSorter::SortAndExtractEventsUntilAllocId(
-    BumpAllocator::AllocId limit_alloc_id) {
+    BumpAllocator::AllocId limit_alloc_id,
+    int64_t limit_ts) {
   constexpr int64_t kTsMax = std::numeric_limits<int64_t>::max();
+  if (sort_pool_)
+    SortQueuesOnThreadPool();
+
   for (;;) {
     size_t min_queue_idx = 0;  // The index of the queue with the min(ts).
 
@@ -127,16 +152,21 @@ void TraceSorter::SortAndExtractEventsUntilAllocId(
 
     Queue& queue = queues_[min_queue_idx];
     auto& events = queue.events_;
-    if (queue.needs_sorting())
+    if (sort_pool_)
+      WaitForQueueSorted(&queue);
+    if (queue.needs_sorting()) {
+      auto scoped_trace = context_->storage->TraceExecutionTimeIntoStats(
+          stats::sorter_sort_duration_ns);
       queue.Sort();
+    }
     PERFETTO_DCHECK(queue.min_ts_ == events.front().ts);
 
     // Now that we identified the min-queue, extract all events from it until
-    // we hit either: (1) the min-ts of the 2nd queue or (2) the packet index
-    // limit, whichever comes first.
+    // we hit either: (1) the min-ts of the 2nd queue, (2) the packet index
+    // limit or (3) the timestamp limit, whichever comes first.
     size_t num_extracted = 0;
     for (auto& event : events) {
-      if (event.alloc_id() >= limit_alloc_id) {
+      if (event.alloc_id() >= limit_alloc_id || event.ts > limit_ts) {
         break;
       }
 
@@ -172,6 +202,88 @@ void TraceSorter::SortAndExtractEventsUntilAllocId(
       queue.min_ts_ = queue.events_.front().ts;
     }
   }  // for(;;)
+
+  // Some of the queues might not have been reached by the loop above (e.g.
+  // because of |limit_alloc_id|): make sure no sorting is still in flight
+  // before returning as the queues will be appended to again.
+  if (sort_pool_)
+    WaitForAllQueuesSorted();
+}
+
+void TraceSorter::NotifyReadBufferEvent() {
+  if (sorting_mode_ == SortingMode::kFullSort)
+    return;
+
+  read_buffer_events_++;
+  UpdateBufferedBytesStats();
+  if (flushes_since_extraction_ >= 2) {
+    SortAndExtractEventsUntilAllocId(alloc_id_for_extraction_);
+    alloc_id_for_extraction_ = token_buffer_.PastTheEndAllocId();
+    flushes_since_extraction_ = 0;
+  }
+
+  // Whether or not the flushes allowed an extraction, events which are older
+  // than the sorting window can't be sorted with any event still to come
+  // (unless the trace is messier than it has been so far).
+  std::optional<int64_t> window = GetSortingWindowNs();
+  if (window && append_max_ts_ > *window)
+    ExtractEventsUntilTimestamp(append_max_ts_ - *window);
+  UpdateBufferedBytesStats();
+}
+
+std::optional<int64_t> TraceSorter::GetSortingWindowNs() const {
+  if (read_buffer_events_ < kMinReadBufferEventsForWindow)
+    return std::nullopt;
+  int64_t max_lateness = 0;
+  for (const Queue& queue : queues_) {
+    max_lateness = std::max(max_lateness, queue.max_lateness_);
+  }
+  return std::max(kMinSortingWindowNs,
+                  kWindowLatenessMultiplier * max_lateness);
+}
+
+void TraceSorter::UpdateBufferedBytesStats() {
+  auto buffered_bytes = static_cast<int64_t>(GetMemoryUsage().used_bytes);
+  TraceStorage* storage = context_->storage.get();
+  storage->SetStats(stats::sorter_buffered_bytes, buffered_bytes);
+  int64_t peak = storage->stats()[stats::sorter_peak_buffered_bytes].value;
+  if (buffered_bytes > peak)
+    storage->SetStats(stats::sorter_peak_buffered_bytes, buffered_bytes);
+}
+
+void TraceSorter::SortQueuesOnThreadPool() {
+  for (auto& queue : queues_) {
+    if (!queue.needs_sorting())
+      continue;
+    {
+      std::lock_guard<std::mutex> lock(sort_mutex_);
+      queue.sort_pending_ = true;
+      ++pending_sorts_;
+    }
+    Queue* queue_ptr = &queue;
+    sort_pool_->PostTask([this, queue_ptr] {
+      // Sort() only touches the events of the queue and its sorting state:
+      // the calling thread doesn't access either while |sort_pending_| is
+      // set. It can keep reading |min_ts_| and |events_.empty()| concurrently
+      // though, as neither are changed by sorting.
+      queue_ptr->Sort();
+
+      std::lock_guard<std::mutex> lock(sort_mutex_);
+      queue_ptr->sort_pending_ = false;
+      --pending_sorts_;
+      sort_done_.notify_all();
+    });
+  }
+}
+
+void TraceSorter::WaitForQueueSorted(Queue* queue) {
+  std::unique_lock<std::mutex> lock(sort_mutex_);
+  sort_done_.wait(lock, [queue] { return !queue->sort_pending_; });
+}
+
+void TraceSorter::WaitForAllQueuesSorted() {
+  std::unique_lock<std::mutex> lock(sort_mutex_);
+  sort_done_.wait(lock, [this] { return pending_sorts_ == 0; });
 }
 
 void TraceSorter::ParseTracePacket(const TimestampedEvent& event) {
@@ -18,14 +18,20 @@
 #define SRC_TRACE_PROCESSOR_SORTER_TRACE_SORTER_H_
 
 #include <algorithm>
+#include <condition_variable>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <utility>
 #include <vector>
 
 #include "perfetto/ext/base/circular_queue.h"
+#include "perfetto/ext/base/threading/thread_pool.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/trace_blob_view.h"
+#include "src/trace_processor/containers/memory_usage.h"
 #include "src/trace_processor/importers/common/parser_types.h"
 #include "src/trace_processor/importers/common/trace_parser.h"
 #include "src/trace_processor/importers/fuchsia/fuchsia_record.h"
@@ -58,6 +64,22 @@ namespace trace_processor {
 // The algorithm for incremental extraction is explained in detail at
 // go/trace-sorting-is-complicated.
 //
+// As flushes are usually far less frequent than buffer reads, on every read
+// buffer event the sorter also extracts the events older than the newest event
+// seen so far by more than an adaptive window. The window is sized after the
+// out-of-orderness observed so far: for each queue, the sorter tracks how late
+// its events were pushed compared to the newest event pushed before them (on
+// any queue). The window is then a multiple of the largest of these delays
+// (see GetSortingWindowNs()), so that well ordered traces only keep a small
+// amount of data buffered while messy ones keep enough of it to be sorted
+// correctly. The bytes held by the sorter are reported in the
+// sorter_buffered_bytes and sorter_peak_buffered_bytes stats.
+//
+// Events can also be extracted up to a timestamp (ExtractEventsUntilTimestamp)
+// to make the data of traces which are still being written queryable while
+// still leaving a window for late events (see
+// Config::incremental_flush_window_ns).
+//
 // Sorting algorithm
 //
 // The sorting algorithm is designed around the assumption that:
@@ -83,6 +105,16 @@ namespace trace_processor {
 // We use a logarithmic bound search operation to figure out what is the index
 // within the first partition where sorting should start, and sort all events
 // from there to the end.
+//
+// Parallel sorting
+//
+// When Config::sorting_thread_count is non-zero, the sorting of the queues
+// (the only part of the extraction which doesn't need to touch the rest of
+// trace processor) is offloaded to a thread pool. At the start of each
+// extraction, every queue which needs sorting is posted to the pool. The
+// global merge then proceeds on the calling thread and only blocks on a queue
+// when it actually needs to extract events from it, so that parsing of the
+// already sorted queues overlaps with the sorting of the rest.
 class TraceSorter {
  public:
   enum class SortingMode {
@@ -135,7 +167,7 @@ class TraceSorter {
         token_buffer_.Append(TracePacketData{std::move(tbv), std::move(state)});
     auto* queue = GetQueue(cpu + 1);
     queue->Append(timestamp, TimestampedEvent::Type::kFtraceEvent, id);
-    UpdateAppendMaxTs(queue);
+    UpdateAppendMaxTs(queue, timestamp);
   }
 
   inline void PushInlineFtraceEvent(uint32_t cpu,
@@ -152,7 +184,7 @@ class TraceSorter {
         token_buffer_.Append(std::move(inline_sched_switch));
     auto* queue = GetQueue(cpu + 1);
     queue->Append(timestamp, TimestampedEvent::Type::kInlineSchedSwitch, id);
-    UpdateAppendMaxTs(queue);
+    UpdateAppendMaxTs(queue, timestamp);
   }
 
   inline void PushInlineFtraceEvent(uint32_t cpu,
@@ -162,10 +194,11 @@ class TraceSorter {
         token_buffer_.Append(std::move(inline_sched_waking));
     auto* queue = GetQueue(cpu + 1);
     queue->Append(timestamp, TimestampedEvent::Type::kInlineSchedWaking, id);
-    UpdateAppendMaxTs(queue);
+    UpdateAppendMaxTs(queue, timestamp);
   }
 
   void ExtractEventsForced() {
+    UpdateBufferedBytesStats();
     BumpAllocator::AllocId end_id = token_buffer_.PastTheEndAllocId();
     SortAndExtractEventsUntilAllocId(end_id);
     for (const auto& queue : queues_) {
@@ -175,23 +208,33 @@ class TraceSorter {
 
     alloc_id_for_extraction_ = end_id;
     flushes_since_extraction_ = 0;
+    UpdateBufferedBytesStats();
   }
 
-  void NotifyFlushEvent() { flushes_since_extraction_++; }
+  // Extracts all the events with a timestamp not greater than |ts|. Newer
+  // events are kept in the queues so that events pushed later with older
+  // timestamps (e.g. the ones of a CPU whose buffer was read later by the
+  // tracing service) can still be sorted together with them.
+  void ExtractEventsUntilTimestamp(int64_t ts) {
+    SortAndExtractEventsUntilAllocId(token_buffer_.PastTheEndAllocId(), ts);
+  }
 
-  void NotifyReadBufferEvent() {
-    if (sorting_mode_ == SortingMode::kFullSort ||
-        flushes_since_extraction_ < 2) {
-      return;
-    }
+  void NotifyFlushEvent() { flushes_since_extraction_++; }
 
-    SortAndExtractEventsUntilAllocId(alloc_id_for_extraction_);
-    alloc_id_for_extraction_ = token_buffer_.PastTheEndAllocId();
-    flushes_since_extraction_ = 0;
-  }
+  void NotifyReadBufferEvent();
 
   int64_t max_timestamp() const { return append_max_ts_; }
 
+  // Returns the memory held by the events buffered in the sorter.
+  MemoryUsage GetMemoryUsage() const {
+    MemoryUsage usage = token_buffer_.GetMemoryUsage();
+    for (const Queue& queue : queues_) {
+      usage += MemoryUsage{queue.events_.size() * sizeof(TimestampedEvent),
+                           queue.events_.capacity() * sizeof(TimestampedEvent)};
+    }
+    return usage + GetVectorMemoryUsage(queues_);
+  }
+
  private:
   struct TimestampedEvent {
     enum class Type : uint8_t {
@@ -293,9 +336,30 @@ class TraceSorter {
     int64_t max_ts_ = 0;
     size_t sort_start_idx_ = 0;
     int64_t sort_min_ts_ = std::numeric_limits<int64_t>::max();
+
+    // The largest delay between the timestamp of an event of this queue and
+    // the newest event appended to the sorter (on any queue) before it.
+    int64_t max_lateness_ = 0;
+
+    // True while a Sort() for this queue is running on |sort_pool_|.
+    // Protected by |sort_mutex_|.
+    bool sort_pending_ = false;
   };
 
-  void SortAndExtractEventsUntilAllocId(BumpAllocator::AllocId alloc_id);
+  // Extracts, in timestamp order, the events allocated before |alloc_id| until
+  // hitting an event with a timestamp greater than |limit_ts|.
+  void SortAndExtractEventsUntilAllocId(
+      BumpAllocator::AllocId alloc_id,
+      int64_t limit_ts = std::numeric_limits<int64_t>::max());
+
+  // Posts a Sort() task on |sort_pool_| for every queue which needs sorting.
+  void SortQueuesOnThreadPool();
+
+  // Blocks until any Sort() task posted for |queue| has completed.
+  void WaitForQueueSorted(Queue* queue);
+
+  // Blocks until all the Sort() tasks posted on |sort_pool_| have completed.
+  void WaitForAllQueuesSorted();
 
   inline Queue* GetQueue(size_t index) {
     if (PERFETTO_UNLIKELY(index >= queues_.size()))
@@ -308,13 +372,24 @@ class TraceSorter {
                                    TraceTokenBuffer::Id id) {
     Queue* queue = GetQueue(0);
     queue->Append(ts, event_type, id);
-    UpdateAppendMaxTs(queue);
+    UpdateAppendMaxTs(queue, ts);
   }
 
-  inline void UpdateAppendMaxTs(Queue* queue) {
+  inline void UpdateAppendMaxTs(Queue* queue, int64_t ts) {
+    if (PERFETTO_UNLIKELY(ts < append_max_ts_)) {
+      queue->max_lateness_ =
+          std::max(queue->max_lateness_, append_max_ts_ - ts);
+    }
     append_max_ts_ = std::max(append_max_ts_, queue->max_ts_);
   }
 
+  // Returns the window used to extract events on read buffer events, or
+  // std::nullopt if not enough read buffer events have been seen to size it.
+  std::optional<int64_t> GetSortingWindowNs() const;
+
+  // Updates the sorter_buffered_bytes and sorter_peak_buffered_bytes stats.
+  void UpdateBufferedBytesStats();
+
   void ParseTracePacket(const TimestampedEvent&);
   void ParseFtracePacket(uint32_t cpu, const TimestampedEvent&);
 
@@ -345,6 +420,9 @@ class TraceSorter {
   // extraction.
   uint32_t flushes_since_extraction_ = 0;
 
+  // The number of read buffer events seen so far.
+  uint32_t read_buffer_events_ = 0;
+
   // queues_[0] is the general (non-ftrace) queue.
   // queues_[1] is the ftrace queue for CPU(0).
   // queues_[x] is the ftrace queue for CPU(x - 1).
@@ -359,6 +437,17 @@ class TraceSorter {
 
   // max(e.ts for e pushed to next stage)
   int64_t latest_pushed_event_ts_ = std::numeric_limits<int64_t>::min();
+
+  // Protects |Queue::sort_pending_| and |pending_sorts_| and is used together
+  // with |sort_done_| to hand off sorted queues back to the calling thread.
+  std::mutex sort_mutex_;
+  std::condition_variable sort_done_;
+  uint32_t pending_sorts_ = 0;
+
+  // Only created when Config::sorting_thread_count > 0. Used to sort the
+  // queues in parallel with parsing (see "Parallel sorting" above). Declared
+  // last so that its threads are joined before the members above go away.
+  std::unique_ptr<base::ThreadPool> sort_pool_;
 };
 
 }  // namespace trace_processor
@@ -90,6 +90,49 @@ class TraceSorterTest : public ::testing::Test {
         new TraceSorter(&context_, std::move(parser), sorting_mode));
   }
 
+  void PushRandomFtraceEventsAndCheckOrder() {
+    PacketSequenceState state(&context_);
+    std::minstd_rand0 rnd_engine(0);
+    std::map<int64_t /*ts*/, std::vector<uint32_t /*cpu*/>> expectations;
+
+    EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(_, _, _, _))
+        .WillRepeatedly(Invoke([&expectations](uint32_t cpu, int64_t timestamp,
+                                               const uint8_t*, size_t) {
+          EXPECT_EQ(expectations.begin()->first, timestamp);
+          auto& cpus = expectations.begin()->second;
+          bool cpu_found = false;
+          for (auto it = cpus.begin(); it < cpus.end(); it++) {
+            if (*it != cpu)
+              continue;
+            cpu_found = true;
+            cpus.erase(it);
+            break;
+          }
+          if (cpus.empty())
+            expectations.erase(expectations.begin());
+          EXPECT_TRUE(cpu_found);
+        }));
+
+    // Allocate a 1000 byte trace blob and push one byte chunks to be sorted
+    // with random timestamps. This will stress test the sorter with worst case
+    // scenarios and will (and has many times) expose any subtle bugs hiding
+    // in the sorter logic.
+    TraceBlobView tbv(TraceBlob::Allocate(1000));
+    for (uint16_t i = 0; i < 1000; i++) {
+      int64_t ts = abs(static_cast<int64_t>(rnd_engine()));
+      uint8_t num_cpus = rnd_engine() % 3;
+      for (uint8_t j = 0; j < num_cpus; j++) {
+        uint32_t cpu = static_cast<uint32_t>(rnd_engine() % 32);
+        expectations[ts].push_back(cpu);
+        context_.sorter->PushFtraceEvent(cpu, ts, tbv.slice_off(i, 1),
+                                         state.current_generation());
+      }
+    }
+
+    context_.sorter->ExtractEventsForced();
+    EXPECT_TRUE(expectations.empty());
+  }
+
  protected:
   TraceProcessorContext context_;
   MockTraceParser* parser_;
@@ -272,50 +315,102 @@ TEST_F(TraceSorterTest, OutOfOrder) {
       2);
 }
 
+// Without any flush, events should still be extracted on read buffer events
+// once they are older than a window sized after the observed out-of-orderness.
+TEST_F(TraceSorterTest, AdaptiveWindowExtraction) {
+  CreateSorter(false);
+
+  PacketSequenceState state(&context_);
+  constexpr int64_t kSecond = 1000 * 1000 * 1000;
+
+  // The window is only used after a couple of read buffer events.
+  context_.sorter->PushTracePacket(1 * kSecond, state.current_generation(),
+                                   test_buffer_.slice_off(0, 1));
+  context_.sorter->NotifyReadBufferEvent();
+
+  // No out-of-order events yet: the window is the minimum one (1s).
+  context_.sorter->PushTracePacket(2 * kSecond, state.current_generation(),
+                                   test_buffer_.slice_off(0, 2));
+  EXPECT_CALL(*parser_,
+              MOCK_ParseTracePacket(1 * kSecond, test_buffer_.data(), 1));
+  context_.sorter->NotifyReadBufferEvent();
+
+  // An event 1.5s late doubles to a 3s window: the event at 2s stays buffered
+  // and is sorted with the late one.
+  context_.sorter->PushTracePacket(6 * kSecond, state.current_generation(),
+                                   test_buffer_.slice_off(0, 3));
+  context_.sorter->PushTracePacket(4 * kSecond + kSecond / 2,
+                                   state.current_generation(),
+                                   test_buffer_.slice_off(0, 4));
+  EXPECT_CALL(*parser_,
+              MOCK_ParseTracePacket(2 * kSecond, test_buffer_.data(), 2));
+  context_.sorter->NotifyReadBufferEvent();
+
+  const auto& storage_stats = context_.storage->stats();
+  EXPECT_GT(storage_stats[stats::sorter_buffered_bytes].value, 0);
+  EXPECT_GE(storage_stats[stats::sorter_peak_buffered_bytes].value,
+            storage_stats[stats::sorter_buffered_bytes].value);
+
+  {
+    InSequence s;
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(4 * kSecond + kSecond / 2,
+                                                test_buffer_.data(), 4));
+    EXPECT_CALL(*parser_,
+                MOCK_ParseTracePacket(6 * kSecond, test_buffer_.data(), 3));
+  }
+  context_.sorter->ExtractEventsForced();
+  EXPECT_EQ(storage_stats[stats::sorter_push_event_out_of_order].value, 0);
+}
+
+TEST_F(TraceSorterTest, ExtractEventsUntilTimestamp) {
+  PacketSequenceState state(&context_);
+
+  TraceBlobView view_1 = test_buffer_.slice_off(0, 1);
+  TraceBlobView view_2 = test_buffer_.slice_off(0, 2);
+  TraceBlobView view_3 = test_buffer_.slice_off(0, 3);
+  TraceBlobView view_4 = test_buffer_.slice_off(0, 4);
+
+  context_.sorter->PushFtraceEvent(0, 1200, std::move(view_2),
+                                   state.current_generation());
+  context_.sorter->PushTracePacket(1100, state.current_generation(),
+                                   std::move(view_1));
+  context_.sorter->PushFtraceEvent(1, 1400, std::move(view_4),
+                                   state.current_generation());
+
+  // Only the events up to the limit should be extracted.
+  {
+    InSequence s;
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(1100, test_buffer_.data(), 1));
+    EXPECT_CALL(*parser_,
+                MOCK_ParseFtracePacket(0, 1200, test_buffer_.data(), 2));
+  }
+  context_.sorter->ExtractEventsUntilTimestamp(1250);
+
+  // A late event older than the buffered one should be sorted before it.
+  context_.sorter->PushFtraceEvent(0, 1300, std::move(view_3),
+                                   state.current_generation());
+  {
+    InSequence s;
+    EXPECT_CALL(*parser_,
+                MOCK_ParseFtracePacket(0, 1300, test_buffer_.data(), 3));
+    EXPECT_CALL(*parser_,
+                MOCK_ParseFtracePacket(1, 1400, test_buffer_.data(), 4));
+  }
+  context_.sorter->ExtractEventsForced();
+}
+
 // Simulates a random stream of ftrace events happening on random CPUs.
 // Tests that the output of the TraceSorter matches the timestamp order
 // (% events happening at the same time on different CPUs).
 TEST_F(TraceSorterTest, MultiQueueSorting) {
-  PacketSequenceState state(&context_);
-  std::minstd_rand0 rnd_engine(0);
-  std::map<int64_t /*ts*/, std::vector<uint32_t /*cpu*/>> expectations;
-
-  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(_, _, _, _))
-      .WillRepeatedly(Invoke([&expectations](uint32_t cpu, int64_t timestamp,
-                                             const uint8_t*, size_t) {
-        EXPECT_EQ(expectations.begin()->first, timestamp);
-        auto& cpus = expectations.begin()->second;
-        bool cpu_found = false;
-        for (auto it = cpus.begin(); it < cpus.end(); it++) {
-          if (*it != cpu)
-            continue;
-          cpu_found = true;
-          cpus.erase(it);
-          break;
-        }
-        if (cpus.empty())
-          expectations.erase(expectations.begin());
-        EXPECT_TRUE(cpu_found);
-      }));
-
-  // Allocate a 1000 byte trace blob and push one byte chunks to be sorted with
-  // random timestamps. This will stress test the sorter with worst case
-  // scenarios and will (and has many times) expose any subtle bugs hiding in
-  // the sorter logic.
-  TraceBlobView tbv(TraceBlob::Allocate(1000));
-  for (uint16_t i = 0; i < 1000; i++) {
-    int64_t ts = abs(static_cast<int64_t>(rnd_engine()));
-    uint8_t num_cpus = rnd_engine() % 3;
-    for (uint8_t j = 0; j < num_cpus; j++) {
-      uint32_t cpu = static_cast<uint32_t>(rnd_engine() % 32);
-      expectations[ts].push_back(cpu);
-      context_.sorter->PushFtraceEvent(cpu, ts, tbv.slice_off(i, 1),
-                                       state.current_generation());
-    }
-  }
+  PushRandomFtraceEventsAndCheckOrder();
+}
 
-  context_.sorter->ExtractEventsForced();
-  EXPECT_TRUE(expectations.empty());
+// Same as above but with the queues sorted on a thread pool.
+TEST_F(TraceSorterTest, MultiQueueSortingWithSortingThreads) {
+  context_.config.sorting_thread_count = 4;
+  CreateSorter();
+  PushRandomFtraceEventsAndCheckOrder();
 }
 
 }  // namespace
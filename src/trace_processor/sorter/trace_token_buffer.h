@@ -28,6 +28,7 @@
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/trace_processor/trace_blob.h"
 #include "perfetto/trace_processor/trace_blob_view.h"
+#include "src/trace_processor/containers/memory_usage.h"
 #include "src/trace_processor/importers/common/parser_types.h"
 #include "src/trace_processor/util/bump_allocator.h"
 
@@ -53,6 +54,11 @@ class TraceTokenBuffer {
     BumpAllocator::AllocId alloc_id;
   };
 
+  // If |spill_file| is not null, the objects are stored in it rather than in
+  // anonymous memory (see BumpAllocator).
+  explicit TraceTokenBuffer(SpillFile* spill_file = nullptr)
+      : allocator_(spill_file) {}
+
   // Appends an object of type |T| to the token buffer. Returns an id for
   // looking up the object later using |Extract|.
   template <typename T>
@@ -93,6 +99,11 @@ class TraceTokenBuffer {
     return allocator_.PastTheEndId();
   }
 
+  // Returns the memory held by the tokenized objects in this buffer. This
+  // doesn't include the TraceBlobs they point to, which are shared with the
+  // rest of trace processor.
+  MemoryUsage GetMemoryUsage() const { return allocator_.GetMemoryUsage(); }
+
   // Attempts to free any memory retained by this buffer and the underlying
   // allocator. The amount of memory free is implementation defined.
   void FreeMemory();
@@ -22,6 +22,7 @@
 #include "perfetto/ext/base/string_writer.h"
 #include "src/trace_processor/containers/bit_vector.h"
 #include "src/trace_processor/sqlite/query_cache.h"
+#include "src/trace_processor/sqlite/sqlite_engine.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 #include "src/trace_processor/tp_metatrace.h"
 #include "src/trace_processor/util/regex.h"
@@ -31,6 +32,14 @@ namespace trace_processor {
 
 namespace {
 
+// Returns whether a constraint with |sqlite_op| can be answered with a binary
+// search on a sorted column.
+bool IsBinarySearchableOp(int sqlite_op) {
+  return sqlite_utils::IsOpEq(sqlite_op) || sqlite_utils::IsOpLe(sqlite_op) ||
+         sqlite_utils::IsOpLt(sqlite_op) || sqlite_utils::IsOpGt(sqlite_op) ||
+         sqlite_utils::IsOpGe(sqlite_op);
+}
+
 std::optional<FilterOp> SqliteOpToFilterOp(int sqlite_op) {
   switch (sqlite_op) {
     case SQLITE_INDEX_CONSTRAINT_EQ:
@@ -186,10 +195,12 @@ SqliteTable::Schema DbSqliteTable::ComputeSchema(const Table::Schema& schema,
 int DbSqliteTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
   switch (context_->computation) {
     case TableComputation::kStatic:
-      BestIndex(schema_, context_->static_table->row_count(), qc, info);
+      BestIndex(SchemaWithIndexes(context_->static_table),
+                context_->static_table->row_count(), qc, info);
       break;
     case TableComputation::kRuntime:
-      BestIndex(schema_, runtime_table_->row_count(), qc, info);
+      BestIndex(SchemaWithIndexes(runtime_table_), runtime_table_->row_count(),
+                qc, info);
       break;
     case TableComputation::kTableFunction:
       base::Status status = context_->generator->ValidateConstraints(qc);
@@ -223,10 +234,30 @@ void DbSqliteTable::BestIndex(const Table::Schema& schema,
 }
 
 base::Status DbSqliteTable::ModifyConstraints(QueryConstraints* qc) {
-  ModifyConstraints(schema_, qc);
+  switch (context_->computation) {
+    case TableComputation::kStatic:
+      ModifyConstraints(SchemaWithIndexes(context_->static_table), qc);
+      break;
+    case TableComputation::kRuntime:
+      ModifyConstraints(SchemaWithIndexes(runtime_table_), qc);
+      break;
+    case TableComputation::kTableFunction:
+      ModifyConstraints(schema_, qc);
+      break;
+  }
   return base::OkStatus();
 }
 
+Table::Schema DbSqliteTable::SchemaWithIndexes(const Table* table) const {
+  Table::Schema schema = schema_;
+  if (!context_->indexes)
+    return schema;
+  for (uint32_t i = 0; i < schema.columns.size(); ++i) {
+    schema.columns[i].is_indexed = context_->indexes->Find(table, i) != nullptr;
+  }
+  return schema;
+}
+
 void DbSqliteTable::ModifyConstraints(const Table::Schema& schema,
                                       QueryConstraints* qc) {
   using C = QueryConstraints::Constraint;
@@ -255,6 +286,11 @@ void DbSqliteTable::ModifyConstraints(const Table::Schema& schema,
     if (a_col.is_sorted || b_col.is_sorted)
       return a_col.is_sorted && !b_col.is_sorted;
 
+    // Indexed columns can be filtered with a binary search on the sorted
+    // table of the index so order them after any sorted columns.
+    if (a_col.is_indexed || b_col.is_indexed)
+      return a_col.is_indexed && !b_col.is_indexed;
+
     // TODO(lalitm): introduce more orderings here based on empirical data.
     return false;
   });
@@ -272,10 +308,18 @@ void DbSqliteTable::ModifyConstraints(const Table::Schema& schema,
     ob->erase(remove_it, ob->end());
   }
 
+  // If a constraint will be filtered using an index, rows will come back in
+  // the order of the index rather than the table so we cannot eliminate any
+  // order by on sorted columns.
+  bool uses_index = std::any_of(cs->begin(), cs->end(), [&schema](const C& c) {
+    return schema.columns[static_cast<uint32_t>(c.column)].is_indexed &&
+           IsBinarySearchableOp(c.op);
+  });
+
   // Go through the order by constraints in reverse order and eliminate
   // constraints until the first non-sorted column or the first order by in
   // descending order.
-  {
+  if (!uses_index) {
     auto p = [&schema](const QueryConstraints::OrderBy& o) {
       const auto& col = schema.columns[static_cast<uint32_t>(o.iColumn)];
       return o.desc || !col.is_sorted;
@@ -332,24 +376,25 @@ DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
       // to sort by that column and then binary search if we see the constraint
       // set often. Model this by dividing by the log of the number of rows as
       // a good approximation. Otherwise, we'll need to do a full table scan.
-      // Alternatively, if the column is sorted, we can use the same binary
-      // search logic so we have the same low cost (even better because we don't
-      // have to sort at all).
-      filter_cost += cs.size() == 1 || col_schema.is_sorted
-                         ? log2(current_row_count)
-                         : current_row_count;
+      // Alternatively, if the column is sorted or indexed, we can use the same
+      // binary search logic so we have the same low cost (even better because
+      // we don't have to sort at all).
+      filter_cost +=
+          cs.size() == 1 || col_schema.is_sorted || col_schema.is_indexed
+              ? log2(current_row_count)
+              : current_row_count;
 
       // As an extremely rough heuristic, assume that an equalty constraint will
       // cut down the number of rows by approximately double log of the number
       // of rows.
       double estimated_rows = current_row_count / (2 * log2(current_row_count));
       current_row_count = std::max(static_cast<uint32_t>(estimated_rows), 1u);
-    } else if (col_schema.is_sorted &&
+    } else if ((col_schema.is_sorted || col_schema.is_indexed) &&
                (sqlite_utils::IsOpLe(c.op) || sqlite_utils::IsOpLt(c.op) ||
                 sqlite_utils::IsOpGt(c.op) || sqlite_utils::IsOpGe(c.op))) {
-      // On a sorted column, if we see any partition constraints, we can do this
-      // filter very efficiently. Model this using the log of the  number of
-      // rows as a good approximation.
+      // On a sorted or indexed column, if we see any partition constraints, we
+      // can do this filter very efficiently. Model this using the log of the
+      // number of rows as a good approximation.
       filter_cost += log2(current_row_count);
 
       // As an extremely rough heuristic, assume that an partition constraint
@@ -444,6 +489,25 @@ void DbSqliteTable::Cursor::TryCacheCreateSortedTable(
       });
 }
 
+std::shared_ptr<Table> DbSqliteTable::Cursor::FindIndexSortedTable(
+    const QueryConstraints& qc) {
+  const TableIndexes* indexes = db_sqlite_table_->context_->indexes;
+  if (!indexes)
+    return nullptr;
+
+  // Constraints are ordered by ModifyConstraints so the first indexed column is
+  // also the one whose index was taken into account when estimating the cost.
+  for (const auto& c : qc.constraints()) {
+    if (!IsBinarySearchableOp(c.op))
+      continue;
+    const TableIndexes::Index* index =
+        indexes->Find(upstream_table_, static_cast<uint32_t>(c.column));
+    if (index)
+      return index->sorted_table;
+  }
+  return nullptr;
+}
+
 base::Status DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
                                            sqlite3_value** argv,
                                            FilterHistory history) {
@@ -490,6 +554,9 @@ base::Status DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
   // Setup the upstream table based on the computation state.
   switch (db_sqlite_table_->context_->computation) {
     case TableComputation::kStatic:
+      if (db_sqlite_table_->context_->prepare_static_table)
+        db_sqlite_table_->context_->prepare_static_table();
+
       // If we have a static table, just set the upstream table to be the static
       // table.
       upstream_table_ = db_sqlite_table_->context_->static_table;
@@ -497,6 +564,7 @@ base::Status DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
       // Tries to create a sorted cached table which can be used to speed up
       // filters below.
       TryCacheCreateSortedTable(qc, history);
+      index_sorted_table_ = FindIndexSortedTable(qc);
       break;
     case TableComputation::kRuntime:
       upstream_table_ = db_sqlite_table_->runtime_table_;
@@ -504,6 +572,7 @@ base::Status DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
       // Tries to create a sorted cached table which can be used to speed up
       // filters below.
       TryCacheCreateSortedTable(qc, history);
+      index_sorted_table_ = FindIndexSortedTable(qc);
       break;
     case TableComputation::kTableFunction: {
       PERFETTO_TP_TRACE(metatrace::Category::QUERY, "DYNAMIC_TABLE_GENERATE",
@@ -518,6 +587,11 @@ base::Status DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
       auto status = db_sqlite_table_->context_->generator->ComputeTable(
           constraints_, orders_, cols_used_bv, computed_table);
 
+      // Table functions can run for a long time without SQLite getting a
+      // chance to notice that the query should be aborted: check it here so
+      // that e.g. a CTE calling the function for each row stops promptly.
+      if (status.ok() && db_sqlite_table_->engine())
+        status = db_sqlite_table_->engine()->QueryStatus();
       if (!status.ok()) {
         return base::ErrStatus("%s: %s", db_sqlite_table_->name().c_str(),
                                status.c_message());
@@ -604,6 +678,8 @@ base::Status DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
         }
       });
 
+  RecordRowsExamined(SourceTable()->row_count());
+
   // Attempt to filter into a RowMap first - weall figure out whether to apply
   // this to the table or we should use the RowMap directly. Also, if we are
   // going to sort on the RowMap, it makes sense that we optimize for lookup
@@ -17,6 +17,7 @@
 #ifndef SRC_TRACE_PROCESSOR_SQLITE_DB_SQLITE_TABLE_H_
 #define SRC_TRACE_PROCESSOR_SQLITE_DB_SQLITE_TABLE_H_
 
+#include <functional>
 #include <memory>
 #include "perfetto/base/status.h"
 #include "src/trace_processor/containers/bit_vector.h"
@@ -25,6 +26,7 @@
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
 #include "src/trace_processor/sqlite/query_cache.h"
 #include "src/trace_processor/sqlite/sqlite_table.h"
+#include "src/trace_processor/sqlite/table_indexes.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -50,9 +52,18 @@ struct DbSqliteTableContext {
   QueryCache* cache;
   Computation computation;
 
+  // Indexes created on static and runtime tables. Can be null if the tables
+  // using this context cannot have indexes.
+  const TableIndexes* indexes = nullptr;
+
   // Only valid when computation == TableComputation::kStatic.
   const Table* static_table = nullptr;
 
+  // Only valid when computation == TableComputation::kStatic. If set, called
+  // before every read of |static_table| so that data recorded lazily can be
+  // added to it.
+  std::function<void()> prepare_static_table;
+
   // Only valid when computation == TableComputation::kRuntime.
   // Those functions implement the interactions with
   // PerfettoSqlEngine::runtime_tables_ to get the |runtime_table_| and erase it
@@ -98,10 +109,17 @@ class DbSqliteTable final
     // constraint set matches the requirements.
     void TryCacheCreateSortedTable(const QueryConstraints&, FilterHistory);
 
+    // Returns the sorted table of an index which can be used to filter on
+    // one of the constraints in |qc| or nullptr if there is none.
+    std::shared_ptr<Table> FindIndexSortedTable(const QueryConstraints& qc);
+
     const Table* SourceTable() const {
-      // Try and use the sorted cache table (if it exists) to speed up the
-      // sorting. Otherwise, just use the original table.
-      return sorted_cache_table_ ? &*sorted_cache_table_ : upstream_table_;
+      // Try and use the sorted cache table or the table of an index (if either
+      // exists) to speed up the sorting. Otherwise, just use the original
+      // table.
+      if (sorted_cache_table_)
+        return &*sorted_cache_table_;
+      return index_sorted_table_ ? &*index_sorted_table_ : upstream_table_;
     }
 
     Cursor(const Cursor&) = delete;
@@ -130,6 +148,11 @@ class DbSqliteTable final
     // significantly.
     std::shared_ptr<Table> sorted_cache_table_;
 
+    // Only valid for Computation::k{Static, Runtime} tables.
+    // Stores the sorted table of the index used to speed up the current
+    // constraint set (if any).
+    std::shared_ptr<Table> index_sorted_table_;
+
     // Stores the count of repeated equality queries to decide whether it is
     // wortwhile to sort |db_table_| to create |sorted_cache_table_|.
     uint32_t repeated_cache_count_ = 0;
@@ -169,6 +192,10 @@ class DbSqliteTable final
                                 const QueryConstraints& qc);
 
  private:
+  // Returns |schema_| with the columns of |table| which have an index marked
+  // as indexed.
+  Table::Schema SchemaWithIndexes(const Table* table) const;
+
   Context* context_ = nullptr;
 
   // Only valid after Init has completed.
@@ -123,6 +123,23 @@ TEST(DbSqliteTable, MultiSortedEqCheaperThanMultiUnsortedEq) {
   ASSERT_EQ(sorted_cost.rows, unsorted_cost.rows);
 }
 
+TEST(DbSqliteTable, MultiIndexedConstraintCheaperThanMultiUnindexed) {
+  auto schema = CreateSchema();
+  constexpr uint32_t kRowCount = 1234;
+
+  QueryConstraints qc;
+  qc.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  qc.AddConstraint(4u, SQLITE_INDEX_CONSTRAINT_GT, 0u);
+
+  auto unindexed_cost = DbSqliteTable::EstimateCost(schema, kRowCount, qc);
+
+  schema.columns[3].is_indexed = true;
+  auto indexed_cost = DbSqliteTable::EstimateCost(schema, kRowCount, qc);
+
+  ASSERT_LT(indexed_cost.cost, unindexed_cost.cost);
+  ASSERT_EQ(indexed_cost.rows, unindexed_cost.rows);
+}
+
 TEST(DbSqliteTable, EmptyTableCosting) {
   auto schema = CreateSchema();
 
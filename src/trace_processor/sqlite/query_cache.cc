@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_cache.h"
+
+#include <algorithm>
+
+namespace perfetto {
+namespace trace_processor {
+
+QueryCache::QueryCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+QueryCache::~QueryCache() = default;
+
+std::shared_ptr<Table> QueryCache::GetIfCached(
+    const Table* source,
+    const std::vector<Constraint>& cs) {
+  auto p = [](const Constraint& a, const Constraint& b) {
+    return a.column == b.column && a.op == b.op;
+  };
+  for (auto it = cached_.begin(); it != cached_.end(); ++it) {
+    if (it->source != source || it->constraints.size() != cs.size() ||
+        !std::equal(cs.begin(), cs.end(), it->constraints.begin(), p)) {
+      continue;
+    }
+
+    // If rows were added to the source since the table was cached, the cached
+    // table is stale so just throw it away.
+    if (it->source_row_count != source->row_count()) {
+      size_bytes_ -= it->size_bytes;
+      cached_.erase(it);
+      return nullptr;
+    }
+
+    // Move the table to the front to mark it as the most recently used.
+    cached_.splice(cached_.begin(), cached_, it);
+    stats_.hits++;
+    return cached_.front().table;
+  }
+  return nullptr;
+}
+
+std::shared_ptr<Table> QueryCache::GetOrCache(
+    const Table* source,
+    const std::vector<Constraint>& cs,
+    std::function<Table()> fn) {
+  std::shared_ptr<Table> cached = GetIfCached(source, cs);
+  if (cached)
+    return cached;
+
+  stats_.misses++;
+
+  CachedTable entry;
+  entry.table.reset(new Table(fn()));
+  entry.size_bytes = EstimateSize(*entry.table);
+  entry.source = source;
+  entry.source_row_count = source->row_count();
+  entry.constraints = cs;
+
+  size_bytes_ += entry.size_bytes;
+  cached_.push_front(std::move(entry));
+  EvictIfNeeded();
+  return cached_.front().table;
+}
+
+void QueryCache::Invalidate(const Table* source) {
+  for (auto it = cached_.begin(); it != cached_.end();) {
+    if (it->source == source) {
+      size_bytes_ -= it->size_bytes;
+      it = cached_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+size_t QueryCache::EstimateSize(const Table& table) {
+  // Cached tables share the column storage with their source so the only
+  // memory they own is the overlays. In the common case of sorted tables,
+  // these are index vectors with one entry per row.
+  return table.overlays().size() * table.row_count() * sizeof(uint32_t);
+}
+
+void QueryCache::EvictIfNeeded() {
+  while (size_bytes_ > max_bytes_ && cached_.size() > 1) {
+    size_bytes_ -= cached_.back().size_bytes;
+    cached_.pop_back();
+    stats_.evictions++;
+  }
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
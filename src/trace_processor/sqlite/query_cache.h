@@ -17,7 +17,12 @@
 #ifndef SRC_TRACE_PROCESSOR_SQLITE_QUERY_CACHE_H_
 #define SRC_TRACE_PROCESSOR_SQLITE_QUERY_CACHE_H_
 
-#include <optional>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
 
 #include "src/trace_processor/db/table.h"
 #include "src/trace_processor/sqlite/query_constraints.h"
@@ -26,53 +31,67 @@ namespace perfetto {
 namespace trace_processor {
 
 // Implements a simple caching strategy for commonly executed queries.
-// TODO(lalitm): the design of this class is very experimental. It was mainly
-// introduced to solve a specific problem (slow process summary tracks in the
-// Perfetto UI) and should not be modified without a full design discussion.
+//
+// Tables are cached for a (source table, constraint set) pair. Several pairs
+// can be cached at once: when the total estimated size of the cached tables
+// goes above the byte budget, the least recently used tables are evicted.
 class QueryCache {
  public:
   using Constraint = QueryConstraints::Constraint;
 
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+  };
+
+  // By default, allow cached tables to take up to 256MB.
+  static constexpr size_t kDefaultMaxBytes = 256 * 1024 * 1024;
+
+  explicit QueryCache(size_t max_bytes = kDefaultMaxBytes);
+  ~QueryCache();
+
   // Returns a cached table if the passed query set are currenly cached or
   // nullptr otherwise.
   std::shared_ptr<Table> GetIfCached(const Table* source,
-                                     const std::vector<Constraint>& cs) const {
-    if (cached_.source != source || cs.size() != cached_.constraints.size())
-      return nullptr;
-
-    auto p = [](const Constraint& a, const Constraint& b) {
-      return a.column == b.column && a.op == b.op;
-    };
-    bool same_cs =
-        std::equal(cs.begin(), cs.end(), cached_.constraints.begin(), p);
-    return same_cs ? cached_.table : nullptr;
-  }
+                                     const std::vector<Constraint>& cs);
 
   // Caches the table with the given source, constraint and order set. Returns
   // a pointer to the newly cached table.
-  std::shared_ptr<Table> GetOrCache(
-      const Table* source,
-      const std::vector<QueryConstraints::Constraint>& cs,
-      std::function<Table()> fn) {
-    std::shared_ptr<Table> cached = GetIfCached(source, cs);
-    if (cached)
-      return cached;
-
-    cached_.source = source;
-    cached_.constraints = cs;
-    cached_.table.reset(new Table(fn()));
-    return cached_.table;
-  }
+  std::shared_ptr<Table> GetOrCache(const Table* source,
+                                    const std::vector<Constraint>& cs,
+                                    std::function<Table()> fn);
+
+  // Removes all the cached tables computed from |source|. Should be called
+  // when |source| is destroyed.
+  void Invalidate(const Table* source);
+
+  const Stats& stats() const { return stats_; }
+  size_t size_bytes() const { return size_bytes_; }
 
  private:
   struct CachedTable {
     std::shared_ptr<Table> table;
+    size_t size_bytes = 0;
 
     const Table* source = nullptr;
+    uint32_t source_row_count = 0;
     std::vector<Constraint> constraints;
   };
 
-  CachedTable cached_;
+  // Returns an estimate of the memory used by |table| on top of the memory of
+  // the table it was computed from.
+  static size_t EstimateSize(const Table& table);
+
+  // Evicts the least recently used tables until the cache fits in the byte
+  // budget. The most recently used table is never evicted.
+  void EvictIfNeeded();
+
+  // Cached tables, ordered from the most to the least recently used.
+  std::list<CachedTable> cached_;
+  size_t size_bytes_ = 0;
+  size_t max_bytes_ = 0;
+  Stats stats_;
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_cache.h"
+
+#include <sqlite3.h>
+
+#include "src/trace_processor/db/runtime_table.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using Constraint = QueryConstraints::Constraint;
+
+class QueryCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (int64_t i = 0; i < kRowCount; ++i) {
+      ASSERT_TRUE(table_.AddInteger(0, kRowCount - i).ok());
+      ASSERT_TRUE(table_.AddInteger(1, i % 3).ok());
+    }
+    ASSERT_TRUE(table_.AddColumnsAndOverlays(kRowCount).ok());
+  }
+
+  std::shared_ptr<Table> GetOrCache(QueryCache* cache, uint32_t col) {
+    return cache->GetOrCache(&table_, {Eq(col)}, [this, col]() {
+      return table_.Sort({Order{col, false}});
+    });
+  }
+
+  static Constraint Eq(uint32_t col) {
+    return Constraint{static_cast<int>(col), SQLITE_INDEX_CONSTRAINT_EQ, 0};
+  }
+
+  static constexpr uint32_t kRowCount = 1024;
+
+  StringPool pool_;
+  RuntimeTable table_{&pool_, {"a", "b"}};
+};
+
+TEST_F(QueryCacheTest, MultipleEntries) {
+  QueryCache cache;
+  std::shared_ptr<Table> a = GetOrCache(&cache, 0);
+  std::shared_ptr<Table> b = GetOrCache(&cache, 1);
+  ASSERT_NE(a, b);
+
+  ASSERT_EQ(cache.GetIfCached(&table_, {Eq(0)}), a);
+  ASSERT_EQ(cache.GetIfCached(&table_, {Eq(1)}), b);
+  ASSERT_EQ(GetOrCache(&cache, 0), a);
+
+  ASSERT_EQ(cache.stats().misses, 2u);
+  ASSERT_EQ(cache.stats().hits, 3u);
+  ASSERT_EQ(cache.stats().evictions, 0u);
+}
+
+TEST_F(QueryCacheTest, EvictsLeastRecentlyUsed) {
+  // Only leave enough space for a single sorted table.
+  QueryCache cache(kRowCount * sizeof(uint32_t));
+  std::shared_ptr<Table> a = GetOrCache(&cache, 0);
+  ASSERT_EQ(cache.GetIfCached(&table_, {Eq(0)}), a);
+
+  std::shared_ptr<Table> b = GetOrCache(&cache, 1);
+  ASSERT_EQ(cache.GetIfCached(&table_, {Eq(0)}), nullptr);
+  ASSERT_EQ(cache.GetIfCached(&table_, {Eq(1)}), b);
+  ASSERT_EQ(cache.stats().evictions, 1u);
+  ASSERT_EQ(cache.size_bytes(), kRowCount * sizeof(uint32_t));
+
+  // Evicted tables should still be usable by whoever holds a reference.
+  ASSERT_EQ(a->row_count(), kRowCount);
+}
+
+TEST_F(QueryCacheTest, Invalidate) {
+  QueryCache cache;
+  GetOrCache(&cache, 0);
+  GetOrCache(&cache, 1);
+
+  cache.Invalidate(&table_);
+  ASSERT_EQ(cache.GetIfCached(&table_, {Eq(0)}), nullptr);
+  ASSERT_EQ(cache.GetIfCached(&table_, {Eq(1)}), nullptr);
+  ASSERT_EQ(cache.size_bytes(), 0u);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
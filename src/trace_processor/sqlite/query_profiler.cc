@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_profiler.h"
+
+#include <atomic>
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+std::atomic<uint64_t> g_next_profiler_id{1};
+
+}  // namespace
+
+QueryProfiler::QueryProfiler() : id_(g_next_profiler_id.fetch_add(1)) {}
+QueryProfiler::~QueryProfiler() = default;
+
+uint32_t QueryProfiler::GetOrAddScan(const std::string& table_name,
+                                     const std::string& plan) {
+  std::string key = table_name;
+  key.push_back('\0');
+  key.append(plan);
+
+  auto next_index = static_cast<uint32_t>(profile_.table_scans.size());
+  auto it_and_inserted = scan_indices_.Insert(std::move(key), next_index);
+  if (it_and_inserted.second) {
+    QueryProfile::TableScan scan;
+    scan.table_name = table_name;
+    scan.plan = plan;
+    profile_.table_scans.emplace_back(std::move(scan));
+  }
+  return *it_and_inserted.first;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
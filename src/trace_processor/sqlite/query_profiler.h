@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_SQLITE_QUERY_PROFILER_H_
+#define SRC_TRACE_PROCESSOR_SQLITE_QUERY_PROFILER_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/trace_processor/basic_types.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Collects the QueryProfile of a query. Owned by the iterator of the query and
+// filled by the SqliteTable cursors while the query runs.
+class QueryProfiler {
+ public:
+  static constexpr uint32_t kNoScan = UINT32_MAX;
+
+  QueryProfiler();
+  ~QueryProfiler();
+
+  // Returns the index of the scan of |table_name| with |plan|, adding it to
+  // the profile if this is the first such scan.
+  uint32_t GetOrAddScan(const std::string& table_name, const std::string& plan);
+
+  QueryProfile::TableScan& scan(uint32_t index) {
+    return profile_.table_scans[index];
+  }
+
+  const QueryProfile& profile() const { return profile_; }
+
+  // Unique across all the profilers created by the process, unlike their
+  // addresses.
+  uint64_t id() const { return id_; }
+
+ private:
+  QueryProfiler(const QueryProfiler&) = delete;
+  QueryProfiler& operator=(const QueryProfiler&) = delete;
+
+  const uint64_t id_;
+  QueryProfile profile_;
+
+  // Maps "<table name>\0<plan>" to the index of the scan in |profile_|.
+  base::FlatHashMap<std::string, uint32_t> scan_indices_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SQLITE_QUERY_PROFILER_H_
@@ -21,6 +21,7 @@
 #include <utility>
 
 #include "perfetto/base/status.h"
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
 #include "src/trace_processor/sqlite/query_cache.h"
@@ -42,11 +43,20 @@ namespace perfetto {
 namespace trace_processor {
 namespace {
 
+// Number of SQLite virtual machine instructions between two checks of the
+// budget of the running query.
+constexpr int kBudgetCheckInstructions = 1000;
+
 void EnsureSqliteInitialized() {
   // sqlite3_initialize isn't actually thread-safe despite being documented
   // as such; we need to make sure multiple TraceProcessorImpl instances don't
   // call it concurrently and only gets called once per process, instead.
-  static bool init_once = [] { return sqlite3_initialize() == SQLITE_OK; }();
+  static bool init_once = [] {
+    // Needed by sqlite3_memory_used() for QueryBudget::max_sqlite_memory_bytes.
+    // This fails harmlessly if SQLite was already initialized by the embedder.
+    sqlite3_config(SQLITE_CONFIG_MEMSTATUS, 1);
+    return sqlite3_initialize() == SQLITE_OK;
+  }();
   PERFETTO_CHECK(init_once);
 }
 
@@ -135,7 +145,7 @@ SqliteEngine::PreparedStatement SqliteEngine::PrepareStatement(SqlSource sql) {
   sqlite3_stmt* raw_stmt = nullptr;
   int err =
       sqlite3_prepare_v2(db_.get(), sql.sql().c_str(), -1, &raw_stmt, nullptr);
-  PreparedStatement statement{ScopedStmt(raw_stmt), std::move(sql)};
+  PreparedStatement statement{ScopedStmt(raw_stmt), std::move(sql), this};
   if (err != SQLITE_OK) {
     const char* errmsg = sqlite3_errmsg(db_.get());
     std::string frame =
@@ -220,9 +230,83 @@ void SqliteEngine::OnSqliteTableDestroyed(const std::string& name) {
   PERFETTO_CHECK(sqlite_tables_.Erase(name));
 }
 
+void SqliteEngine::BeginQuery(const QueryBudget& budget,
+                              QueryProfiler* profiler) {
+  budget_ = budget;
+  query_profiler_ = profiler;
+  query_start_ns_ = base::GetWallTimeNs().count();
+  query_start_memory_ = sqlite3_memory_used();
+  abort_reason_.store(AbortReason::kNone);
+
+  // The progress handler is only needed (and only costs anything) when there
+  // is a budget to enforce.
+  bool has_budget = budget.max_wall_time_ms || budget.max_sqlite_memory_bytes;
+  sqlite3_progress_handler(db_.get(), has_budget ? kBudgetCheckInstructions : 0,
+                           has_budget ? &OnProgress : nullptr, this);
+}
+
+void SqliteEngine::Interrupt() {
+  abort_reason_.store(AbortReason::kInterrupted);
+  sqlite3_interrupt(db_.get());
+}
+
+base::Status SqliteEngine::QueryStatus() const {
+  AbortReason reason = abort_reason_.load();
+
+  // The progress handler does not run while C++ code called by SQLite is
+  // busy: check the time budget here too so that such code can bail out.
+  if (reason == AbortReason::kNone && IsOverWallTimeBudget())
+    reason = AbortReason::kWallTimeBudget;
+
+  switch (reason) {
+    case AbortReason::kNone:
+      return base::OkStatus();
+    case AbortReason::kInterrupted:
+      return base::ErrStatus("Query interrupted");
+    case AbortReason::kWallTimeBudget:
+      return base::ErrStatus("Query exceeded its wall time budget (%" PRIu64
+                             " ms)",
+                             budget_.max_wall_time_ms);
+    case AbortReason::kMemoryBudget:
+      return base::ErrStatus("Query exceeded its SQLite memory budget (%" PRIu64
+                             " bytes)",
+                             budget_.max_sqlite_memory_bytes);
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+bool SqliteEngine::IsOverWallTimeBudget() const {
+  if (!budget_.max_wall_time_ms)
+    return false;
+  int64_t elapsed_ns = base::GetWallTimeNs().count() - query_start_ns_;
+  return static_cast<uint64_t>(elapsed_ns / 1000000) >=
+         budget_.max_wall_time_ms;
+}
+
+// static
+int SqliteEngine::OnProgress(void* ctx) {
+  auto* engine = static_cast<SqliteEngine*>(ctx);
+  if (engine->abort_reason_.load() != AbortReason::kNone)
+    return 1;
+  if (engine->IsOverWallTimeBudget()) {
+    engine->abort_reason_.store(AbortReason::kWallTimeBudget);
+    return 1;
+  }
+  uint64_t max_memory = engine->budget_.max_sqlite_memory_bytes;
+  if (max_memory) {
+    int64_t used = sqlite3_memory_used() - engine->query_start_memory_;
+    if (used > 0 && static_cast<uint64_t>(used) > max_memory) {
+      engine->abort_reason_.store(AbortReason::kMemoryBudget);
+      return 1;
+    }
+  }
+  return 0;
+}
+
 SqliteEngine::PreparedStatement::PreparedStatement(ScopedStmt stmt,
-                                                   SqlSource source)
-    : stmt_(std::move(stmt)), sql_source_(std::move(source)) {}
+                                                   SqlSource source,
+                                                   const SqliteEngine* engine)
+    : stmt_(std::move(stmt)), engine_(engine), sql_source_(std::move(source)) {}
 
 bool SqliteEngine::PreparedStatement::Step() {
   PERFETTO_TP_TRACE(metatrace::Category::QUERY, "STMT_STEP",
@@ -242,8 +326,15 @@ bool SqliteEngine::PreparedStatement::Step() {
   sqlite3* db = sqlite3_db_handle(stmt_.get());
   std::string frame =
       sql_source_.AsTracebackForSqliteOffset(GetErrorOffsetDb(db));
-  const char* errmsg = sqlite3_errmsg(db);
-  status_ = base::ErrStatus("%s%s", frame.c_str(), errmsg);
+  std::string errmsg = sqlite3_errmsg(db);
+
+  // SQLite only says "interrupted": explain why if it was because of us.
+  if (err == SQLITE_INTERRUPT) {
+    base::Status query_status = engine_->QueryStatus();
+    if (!query_status.ok())
+      errmsg = query_status.message();
+  }
+  status_ = base::ErrStatus("%s%s", frame.c_str(), errmsg.c_str());
   return false;
 }
 
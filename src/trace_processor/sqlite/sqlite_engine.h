@@ -19,6 +19,7 @@
 
 #include <sqlite3.h>
 #include <stdint.h>
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <optional>
@@ -28,6 +29,7 @@
 #include "perfetto/base/status.h"
 #include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/hash.h"
+#include "perfetto/trace_processor/basic_types.h"
 #include "src/trace_processor/db/table.h"
 #include "src/trace_processor/sqlite/query_cache.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
@@ -39,6 +41,8 @@
 namespace perfetto {
 namespace trace_processor {
 
+class QueryProfiler;
+
 // Wrapper class around SQLite C API.
 //
 // The goal of this class is to provide a one-stop-shop mechanism to use SQLite.
@@ -67,9 +71,10 @@ class SqliteEngine {
    private:
     friend class SqliteEngine;
 
-    explicit PreparedStatement(ScopedStmt, SqlSource);
+    PreparedStatement(ScopedStmt, SqlSource, const SqliteEngine*);
 
     ScopedStmt stmt_;
+    const SqliteEngine* engine_ = nullptr;
     SqlSource sql_source_;
     ScopedSqliteString expanded_sql_;
     base::Status status_ = base::OkStatus();
@@ -116,6 +121,32 @@ class SqliteEngine {
   // Should be called when a SqliteTable instance is destroyed.
   void OnSqliteTableDestroyed(const std::string& name);
 
+  // Should be called before executing each query: clears the interruption of
+  // the previous query, if any, and starts enforcing |budget|. If |profiler|
+  // is not null, the tables record the statistics of the query into it until
+  // the next query begins or EndProfiling is called.
+  void BeginQuery(const QueryBudget& budget,
+                  QueryProfiler* profiler = nullptr);
+
+  // Stops recording statistics into |profiler| if it is the profiler of the
+  // current query.
+  void EndProfiling(QueryProfiler* profiler) {
+    if (query_profiler_ == profiler)
+      query_profiler_ = nullptr;
+  }
+
+  // The profiler of the current query or nullptr if it's not being profiled.
+  QueryProfiler* query_profiler() const { return query_profiler_; }
+
+  // Interrupts the statements which are running. Can be called from any
+  // thread.
+  void Interrupt();
+
+  // Returns an error if the current query was interrupted or exceeded its
+  // budget. Long running C++ code invoked by SQLite (e.g. table functions)
+  // should check this to abort the query as early as possible.
+  base::Status QueryStatus() const;
+
   sqlite3* db() const { return db_.get(); }
 
  private:
@@ -128,8 +159,20 @@ class SqliteEngine {
     }
   };
 
+  enum class AbortReason {
+    kNone,
+    kInterrupted,
+    kWallTimeBudget,
+    kMemoryBudget,
+  };
+
   std::optional<uint32_t> GetErrorOffset() const;
 
+  bool IsOverWallTimeBudget() const;
+
+  // Installed as the SQLite progress handler while a query has a budget.
+  static int OnProgress(void* ctx);
+
   SqliteEngine(SqliteEngine&&) noexcept = delete;
   SqliteEngine& operator=(SqliteEngine&&) = delete;
 
@@ -137,6 +180,12 @@ class SqliteEngine {
   base::FlatHashMap<std::string, std::unique_ptr<SqliteTable>> saved_tables_;
   base::FlatHashMap<std::pair<std::string, int>, void*, FnHasher> fn_ctx_;
 
+  QueryBudget budget_;
+  int64_t query_start_ns_ = 0;
+  int64_t query_start_memory_ = 0;
+  std::atomic<AbortReason> abort_reason_{AbortReason::kNone};
+  QueryProfiler* query_profiler_ = nullptr;
+
   ScopedDb db_;
 };
 
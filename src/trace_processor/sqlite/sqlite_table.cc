@@ -142,6 +142,27 @@ std::string QcDebugStr(const QueryConstraints& qc,
   return str_result;
 }
 
+// Returns a human readable description of the constraints and order by of
+// |qc| for query profiles e.g. "ts >=,utid = order by ts desc".
+std::string QcPlanStr(const QueryConstraints& qc,
+                      const SqliteTable::Schema& schema) {
+  std::string plan;
+  ConstraintsToString(qc, schema, plan);
+  bool is_first = true;
+  for (const auto& ob : qc.order_by()) {
+    if (is_first) {
+      plan.append(plan.empty() ? "order by " : " order by ");
+    } else {
+      plan.append(",");
+    }
+    plan.append(schema.columns()[static_cast<size_t>(ob.iColumn)].name());
+    if (ob.desc)
+      plan.append(" desc");
+    is_first = false;
+  }
+  return plan;
+}
+
 void WriteQueryConstraintsToMetatrace(metatrace::Record* r,
                                       const QueryConstraints& qc,
                                       const SqliteTable::Schema& schema) {
@@ -203,6 +224,17 @@ bool SqliteTable::ReadConstraints(int idxNum, const char* idxStr, int argc) {
   return cache_hit;
 }
 
+uint32_t SqliteTable::GetProfileScan(QueryProfiler* profiler) {
+  if (profiler->id() != profile_scan_profiler_id_ ||
+      qc_hash_ != profile_scan_qc_hash_) {
+    profile_scan_ =
+        profiler->GetOrAddScan(name_, QcPlanStr(qc_cache_, schema_));
+    profile_scan_profiler_id_ = profiler->id();
+    profile_scan_qc_hash_ = qc_hash_;
+  }
+  return profile_scan_;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // SqliteTable::BaseCursor implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -214,6 +246,12 @@ SqliteTable::BaseCursor::BaseCursor(SqliteTable* table) : table_(table) {
 }
 SqliteTable::BaseCursor::~BaseCursor() = default;
 
+void SqliteTable::BaseCursor::RecordRowsExamined(uint64_t rows) {
+  QueryProfiler* profiler = table_->engine_->query_profiler();
+  if (profiler && profile_scan_ != QueryProfiler::kNoScan)
+    profiler->scan(profile_scan_).rows_examined += rows;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // SqliteTable::Column implementation
 ////////////////////////////////////////////////////////////////////////////////
@@ -27,12 +27,14 @@
 #include <vector>
 
 #include "perfetto/base/status.h"
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/status_or.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "src/trace_processor/db/table.h"
 #include "src/trace_processor/sqlite/query_constraints.h"
+#include "src/trace_processor/sqlite/query_profiler.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -115,6 +117,11 @@ class SqliteTable : public sqlite3_vtab {
 
     SqliteTable* table() const { return table_; }
 
+    // Adds |rows| to the rows examined by the current scan of the query
+    // profile, if the query is being profiled. Should be called by Filter with
+    // the number of rows the constraints are applied to.
+    void RecordRowsExamined(uint64_t rows);
+
    protected:
     BaseCursor(BaseCursor&) = delete;
     BaseCursor& operator=(const BaseCursor&) = delete;
@@ -123,7 +130,14 @@ class SqliteTable : public sqlite3_vtab {
     BaseCursor& operator=(BaseCursor&&) = default;
 
    private:
+    template <typename, typename>
+    friend class TypedSqliteTable;
+
     SqliteTable* table_ = nullptr;
+
+    // The scan of the query profile which the cursor contributes to. Only
+    // valid while the query is being profiled.
+    uint32_t profile_scan_ = QueryProfiler::kNoScan;
   };
 
   // The schema of the table. Created by subclasses to allow the table class to
@@ -216,6 +230,7 @@ class SqliteTable : public sqlite3_vtab {
   const Schema& schema() const { return schema_; }
   const std::string& module_name() const { return module_name_; }
   const std::string& name() const { return name_; }
+  const SqliteEngine* engine() const { return engine_; }
 
  private:
   template <typename, typename>
@@ -225,6 +240,9 @@ class SqliteTable : public sqlite3_vtab {
   SqliteTable(const SqliteTable&) = delete;
   SqliteTable& operator=(const SqliteTable&) = delete;
 
+  // Returns the scan of |profiler| for the constraints in |qc_cache_|.
+  uint32_t GetProfileScan(QueryProfiler* profiler);
+
   // The engine class this table is registered with. Used for restoring/saving
   // the table.
   SqliteEngine* engine_ = nullptr;
@@ -244,6 +262,12 @@ class SqliteTable : public sqlite3_vtab {
   QueryConstraints qc_cache_;
   int qc_hash_ = 0;
   int best_index_num_ = 0;
+
+  // Caches the result of GetProfileScan for |qc_hash_|, as computing the plan
+  // of a scan is relatively expensive.
+  uint64_t profile_scan_profiler_id_ = 0;
+  int profile_scan_qc_hash_ = 0;
+  uint32_t profile_scan_ = QueryProfiler::kNoScan;
 };
 
 class TypedSqliteTableBase : public SqliteTable {
@@ -349,6 +373,13 @@ class TypedSqliteTable : public TypedSqliteTableBase {
     return module;
   }
 
+  // Returns the profiler of the query running on |table| or nullptr if the
+  // query is not being profiled.
+  static QueryProfiler* GetQueryProfiler(SubTable* table) {
+    // Qualified as subclasses can have an |engine_| member of their own.
+    return table->SqliteTable::engine_->query_profiler();
+  }
+
   static int xCreate(sqlite3* xdb,
                      void* arg,
                      int argc,
@@ -392,12 +423,36 @@ class TypedSqliteTable : public TypedSqliteTableBase {
     auto history = is_cached ? BaseCursor::FilterHistory::kSame
                              : BaseCursor::FilterHistory::kDifferent;
     auto* table = static_cast<SubTable*>(cursor->table());
+    QueryProfiler* profiler = GetQueryProfiler(table);
+    if (PERFETTO_UNLIKELY(profiler)) {
+      cursor->profile_scan_ = table->GetProfileScan(profiler);
+      int64_t start_ns = base::GetWallTimeNs().count();
+      base::Status status = cursor->Filter(table->qc_cache_, v, history);
+      QueryProfile::TableScan& scan = profiler->scan(cursor->profile_scan_);
+      scan.filter_count++;
+      scan.filter_ns +=
+          static_cast<uint64_t>(base::GetWallTimeNs().count() - start_ns);
+      scan.rows_returned += status.ok() && !cursor->Eof();
+      return table->SetStatusAndReturn(std::move(status));
+    }
     return table->SetStatusAndReturn(
         cursor->Filter(cursor->table()->qc_cache_, v, history));
   }
   static int xNext(sqlite3_vtab_cursor* c) {
     auto* cursor = static_cast<typename SubTable::Cursor*>(c);
     auto* table = static_cast<SubTable*>(cursor->table());
+    QueryProfiler* profiler = GetQueryProfiler(table);
+    if (PERFETTO_UNLIKELY(profiler) &&
+        cursor->profile_scan_ != QueryProfiler::kNoScan) {
+      int64_t start_ns = base::GetWallTimeNs().count();
+      base::Status status = cursor->Next();
+      QueryProfile::TableScan& scan = profiler->scan(cursor->profile_scan_);
+      scan.next_count++;
+      scan.next_ns +=
+          static_cast<uint64_t>(base::GetWallTimeNs().count() - start_ns);
+      scan.rows_returned += status.ok() && !cursor->Eof();
+      return table->SetStatusAndReturn(std::move(status));
+    }
     return table->SetStatusAndReturn(cursor->Next());
   }
   static int xEof(sqlite3_vtab_cursor* c) {
@@ -406,6 +461,17 @@ class TypedSqliteTable : public TypedSqliteTableBase {
   static int xColumn(sqlite3_vtab_cursor* c, sqlite3_context* a, int b) {
     auto* cursor = static_cast<typename SubTable::Cursor*>(c);
     auto* table = static_cast<SubTable*>(cursor->table());
+    QueryProfiler* profiler = GetQueryProfiler(table);
+    if (PERFETTO_UNLIKELY(profiler) &&
+        cursor->profile_scan_ != QueryProfiler::kNoScan) {
+      int64_t start_ns = base::GetWallTimeNs().count();
+      base::Status status = cursor->Column(a, b);
+      QueryProfile::TableScan& scan = profiler->scan(cursor->profile_scan_);
+      scan.column_count++;
+      scan.column_ns +=
+          static_cast<uint64_t>(base::GetWallTimeNs().count() - start_ns);
+      return table->SetStatusAndReturn(std::move(status));
+    }
     return table->SetStatusAndReturn(cursor->Column(a, b));
   }
   static int xRowid(sqlite3_vtab_cursor*, sqlite3_int64*) {
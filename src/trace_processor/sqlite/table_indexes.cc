@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/table_indexes.h"
+
+#include <algorithm>
+
+namespace perfetto {
+namespace trace_processor {
+
+base::Status TableIndexes::Create(const std::string& name,
+                                  const Table* table,
+                                  uint32_t col_idx,
+                                  bool replace) {
+  auto it = std::find_if(indexes_.begin(), indexes_.end(),
+                         [&name](const Index& i) { return i.name == name; });
+  if (it != indexes_.end()) {
+    if (!replace) {
+      return base::ErrStatus("CREATE PERFETTO INDEX: index %s already exists",
+                             name.c_str());
+    }
+    indexes_.erase(it);
+  }
+
+  // Sorting a sorted column would give back the table as is so there's no
+  // point in storing a copy.
+  std::shared_ptr<Table> sorted_table;
+  if (!table->GetColumn(col_idx).IsSorted()) {
+    sorted_table =
+        std::make_shared<Table>(table->Sort({Order{col_idx, false}}));
+  }
+  indexes_.push_back(Index{name, table, col_idx, table->row_count(),
+                           std::move(sorted_table)});
+  return base::OkStatus();
+}
+
+base::Status TableIndexes::Drop(const std::string& name, const Table* table) {
+  auto it = std::find_if(indexes_.begin(), indexes_.end(),
+                         [&name, table](const Index& i) {
+                           return i.name == name && i.table == table;
+                         });
+  if (it == indexes_.end()) {
+    return base::ErrStatus("DROP PERFETTO INDEX: index %s does not exist",
+                           name.c_str());
+  }
+  indexes_.erase(it);
+  return base::OkStatus();
+}
+
+void TableIndexes::DropAllForTable(const Table* table) {
+  indexes_.erase(
+      std::remove_if(indexes_.begin(), indexes_.end(),
+                     [table](const Index& i) { return i.table == table; }),
+      indexes_.end());
+}
+
+const TableIndexes::Index* TableIndexes::Find(const Table* table,
+                                              uint32_t col_idx) const {
+  for (const Index& index : indexes_) {
+    if (index.table == table && index.col_idx == col_idx &&
+        index.sorted_table && index.row_count == table->row_count()) {
+      return &index;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
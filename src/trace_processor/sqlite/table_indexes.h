@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_SQLITE_TABLE_INDEXES_H_
+#define SRC_TRACE_PROCESSOR_SQLITE_TABLE_INDEXES_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/status.h"
+#include "src/trace_processor/db/table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Stores the indexes created with CREATE PERFETTO INDEX.
+//
+// An index on a column is a copy of the table sorted by that column (i.e. the
+// sorted permutation of its rows). Filters on the column can then be
+// answered with a binary search on the sorted copy instead of a full scan of
+// the table.
+class TableIndexes {
+ public:
+  struct Index {
+    std::string name;
+    const Table* table;
+    uint32_t col_idx;
+
+    // Number of rows in |table| when the index was created. Indexes are not
+    // updated when rows are added to their table so they are ignored if this
+    // stops matching.
+    uint32_t row_count;
+
+    std::shared_ptr<Table> sorted_table;
+  };
+
+  // Creates the index |name| on the column |col_idx| of |table|. If an index
+  // with the same name exists, it is replaced if |replace| is true and an
+  // error is returned otherwise.
+  base::Status Create(const std::string& name,
+                      const Table* table,
+                      uint32_t col_idx,
+                      bool replace);
+
+  // Drops the index |name| on |table|.
+  base::Status Drop(const std::string& name, const Table* table);
+
+  // Drops all the indexes on |table|. Should be called when |table| is
+  // destroyed.
+  void DropAllForTable(const Table* table);
+
+  // Returns the index on column |col_idx| of |table| if there is one which can
+  // be used to speed up filters on the column and nullptr otherwise.
+  const Index* Find(const Table* table, uint32_t col_idx) const;
+
+ private:
+  std::vector<Index> indexes_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SQLITE_TABLE_INDEXES_H_
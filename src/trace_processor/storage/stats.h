@@ -243,6 +243,21 @@ namespace stats {
       "Trace events are out of order event after sorting. This can happen "    \
       "due to many factors including clock sync drift, producers emitting "    \
       "events out of order or a bug in trace processor's logic of sorting."),  \
+  F(sorter_buffered_bytes,                kSingle,  kInfo,     kTrace,         \
+      "Bytes held by the events buffered in the trace sorter, as of its "      \
+      "last extraction."),                                                     \
+  F(sorter_peak_buffered_bytes,           kSingle,  kInfo,     kTrace,         \
+      "Largest number of bytes held by the events buffered in the trace "      \
+      "sorter, measured before each extraction."),                             \
+  F(sorter_sort_duration_ns,              kSingle,  kInfo,     kAnalysis,      \
+      "Time spent sorting the events buffered in the trace sorter, "           \
+      "excluding the sorting done on its worker threads."),                    \
+  F(end_of_file_parse_duration_ns,        kSingle,  kInfo,     kAnalysis,      \
+      "Time spent at the end of the trace sorting and parsing the events "     \
+      "still buffered in the trace sorter."),                                  \
+  F(finalize_trace_duration_ns,           kSingle,  kInfo,     kAnalysis,      \
+      "Time spent at the end of the trace flushing the state of the "          \
+      "importers, after the last events were parsed."),                        \
   F(unknown_extension_fields,             kSingle,  kError,    kTrace,         \
       "TraceEvent had unknown extension fields, which might result in "        \
       "missing some arguments. You may need a newer version of trace "         \
@@ -262,7 +277,14 @@ namespace stats {
                                           kSingle,  kInfo,     kAnalysis,      \
       "SurfaceFlinger transactions packet has unknown fields, which results "  \
       "in some arguments missing. You may need a newer version of trace "      \
-      "processor to parse them.")
+      "processor to parse them."),                                             \
+  F(query_cache_hits,                     kSingle,  kInfo,     kAnalysis,      \
+      "Number of filters answered using a table from the query cache."),       \
+  F(query_cache_misses,                   kSingle,  kInfo,     kAnalysis,      \
+      "Number of tables computed and added to the query cache."),              \
+  F(query_cache_evictions,                kSingle,  kInfo,     kAnalysis,      \
+      "Number of tables evicted from the query cache to stay within its "      \
+      "memory budget.")
 // clang-format on
 
 enum Type {
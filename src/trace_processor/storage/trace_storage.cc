@@ -18,6 +18,7 @@
 
 #include <string.h>
 #include <algorithm>
+#include <functional>
 #include <limits>
 
 #include "perfetto/ext/base/no_destructor.h"
@@ -70,7 +71,16 @@ const std::vector<NullTermStringView>& GetRefTypeStringMap() {
   return map.ref();
 }
 
-TraceStorage::TraceStorage(const Config&) {
+TraceStorage::TraceStorage(const Config& config) {
+  string_pool_.SetStringCompression(config.compress_strings);
+  for (uint32_t i = 0; i < variadic_type_ids_.size(); ++i) {
+    variadic_type_ids_[i] = InternString(Variadic::kTypeNames[i]);
+  }
+}
+
+void TraceStorage::ResetStringPool(StringPool pool) {
+  pool.SetStringCompression(string_pool_.string_compression());
+  string_pool_ = std::move(pool);
   for (uint32_t i = 0; i < variadic_type_ids_.size(); ++i) {
     variadic_type_ids_[i] = InternString(Variadic::kTypeNames[i]);
   }
@@ -78,6 +88,45 @@ TraceStorage::TraceStorage(const Config&) {
 
 TraceStorage::~TraceStorage() {}
 
+util::Status TraceStorage::ExtractArg(uint32_t arg_set_id,
+                                      const char* key,
+                                      std::optional<Variadic>* result) {
+  DecodeLazyArgs();
+  *result = std::nullopt;
+
+  // Extend the index to the arg sets added since the last call.
+  const auto& arg_set_ids = arg_table_.arg_set_id();
+  for (uint32_t row = indexed_arg_rows_; row < arg_table_.row_count(); ++row) {
+    uint32_t id = arg_set_ids[row];
+    if (id >= arg_set_first_rows_.size())
+      arg_set_first_rows_.resize(id + 1, row);
+  }
+  indexed_arg_rows_ = arg_table_.row_count();
+  if (arg_set_id >= arg_set_first_rows_.size())
+    return util::OkStatus();
+
+  // A key which was never interned can't be in any arg set.
+  std::optional<StringId> key_id = string_pool_.GetId(key);
+  if (!key_id)
+    return util::OkStatus();
+
+  uint32_t begin = arg_set_first_rows_[arg_set_id];
+  uint32_t end = arg_set_id + 1 < arg_set_first_rows_.size()
+                     ? arg_set_first_rows_[arg_set_id + 1]
+                     : indexed_arg_rows_;
+  const auto& keys = arg_table_.key();
+  for (uint32_t row = begin; row < end; ++row) {
+    if (keys[row] != *key_id)
+      continue;
+    if (*result) {
+      return util::ErrStatus(
+          "EXTRACT_ARG: received multiple args matching arg set id and key");
+    }
+    *result = GetArgValue(row);
+  }
+  return util::OkStatus();
+}
+
 uint32_t TraceStorage::SqlStats::RecordQueryBegin(const std::string& query,
                                                   int64_t time_started) {
   if (queries_.size() >= kMaxLogEntries) {
@@ -115,23 +164,73 @@ void TraceStorage::SqlStats::RecordQueryEnd(uint32_t row, int64_t time_ended) {
   times_ended_[queue_row] = time_ended;
 }
 
-std::pair<int64_t, int64_t> TraceStorage::GetTraceTimestampBoundsNs() const {
+void TraceStorage::ShrinkToFitTables(const ParallelForFn& parallel_for) {
+  // At the moment, we only bother calling ShrinkToFit on a set group
+  // of tables. If we wanted to extend this to every table, we'd need to deal
+  // with tracking all the tables in the storage: this is not worth doing
+  // given most memory is used by these tables.
+  // Each table only owns the storage of its own columns so they can be shrunk
+  // concurrently.
+  const std::function<void()> shrink_table[] = {
+      [this] { thread_table_.ShrinkToFit(); },
+      [this] { process_table_.ShrinkToFit(); },
+      [this] { track_table_.ShrinkToFit(); },
+      [this] { counter_table_.ShrinkToFit(); },
+      [this] { slice_table_.ShrinkToFit(); },
+      [this] { raw_table_.ShrinkToFit(); },
+      [this] { sched_slice_table_.ShrinkToFit(); },
+      [this] { thread_state_table_.ShrinkToFit(); },
+      [this] { arg_table_.ShrinkToFit(); },
+  };
+  auto count = static_cast<uint32_t>(base::ArraySize(shrink_table));
+  auto shrink = [&shrink_table](uint32_t i) { shrink_table[i](); };
+  if (parallel_for) {
+    parallel_for(count, shrink);
+    return;
+  }
+  for (uint32_t i = 0; i < count; ++i)
+    shrink(i);
+}
+
+std::pair<int64_t, int64_t> TraceStorage::GetTraceTimestampBoundsNs(
+    const ParallelForFn& parallel_for) const {
+  using TsColumn = TypedColumn<int64_t>;
+  struct TableBounds {
+    const TsColumn* ts;
+    const TsColumn* dur;
+    int64_t start_ns = std::numeric_limits<int64_t>::max();
+    int64_t end_ns = std::numeric_limits<int64_t>::min();
+  };
+  TableBounds tables[] = {
+      {&raw_table_.ts(), nullptr},
+      {&sched_slice_table_.ts(), &sched_slice_table_.dur()},
+      {&counter_table_.ts(), nullptr},
+      {&slice_table_.ts(), &slice_table_.dur()},
+      {&heap_profile_allocation_table_.ts(), nullptr},
+      {&thread_state_table_.ts(), nullptr},
+      {&android_log_table_.ts(), nullptr},
+      {&heap_graph_object_table_.graph_sample_ts(), nullptr},
+      {&perf_sample_table_.ts(), nullptr},
+  };
+  auto count = static_cast<uint32_t>(base::ArraySize(tables));
+  auto update_bounds = [&tables](uint32_t i) {
+    TableBounds& table = tables[i];
+    DbTableMaybeUpdateMinMax(*table.ts, &table.start_ns, &table.end_ns,
+                             table.dur);
+  };
+  if (parallel_for) {
+    parallel_for(count, update_bounds);
+  } else {
+    for (uint32_t i = 0; i < count; ++i)
+      update_bounds(i);
+  }
+
   int64_t start_ns = std::numeric_limits<int64_t>::max();
   int64_t end_ns = std::numeric_limits<int64_t>::min();
-
-  DbTableMaybeUpdateMinMax(raw_table_.ts(), &start_ns, &end_ns);
-  DbTableMaybeUpdateMinMax(sched_slice_table_.ts(), &start_ns, &end_ns,
-                           &sched_slice_table_.dur());
-  DbTableMaybeUpdateMinMax(counter_table_.ts(), &start_ns, &end_ns);
-  DbTableMaybeUpdateMinMax(slice_table_.ts(), &start_ns, &end_ns,
-                           &slice_table_.dur());
-  DbTableMaybeUpdateMinMax(heap_profile_allocation_table_.ts(), &start_ns,
-                           &end_ns);
-  DbTableMaybeUpdateMinMax(thread_state_table_.ts(), &start_ns, &end_ns);
-  DbTableMaybeUpdateMinMax(android_log_table_.ts(), &start_ns, &end_ns);
-  DbTableMaybeUpdateMinMax(heap_graph_object_table_.graph_sample_ts(),
-                           &start_ns, &end_ns);
-  DbTableMaybeUpdateMinMax(perf_sample_table_.ts(), &start_ns, &end_ns);
+  for (const TableBounds& table : tables) {
+    start_ns = std::min(start_ns, table.start_ns);
+    end_ns = std::max(end_ns, table.end_ns);
+  }
 
   if (start_ns == std::numeric_limits<int64_t>::max()) {
     return std::make_pair(0, 0);
@@ -19,6 +19,7 @@
 
 #include <array>
 #include <deque>
+#include <functional>
 #include <map>
 #include <optional>
 #include <string>
@@ -308,23 +309,17 @@ class TraceStorage {
     return string_pool_.Get(id);
   }
 
+  // Runs fn(0), ..., fn(count - 1) and returns once all the calls have
+  // returned. The calls can happen concurrently (e.g. with
+  // QueryExecutor::ParallelFor).
+  using ParallelForFn = std::function<void(
+      uint32_t count, const std::function<void(uint32_t)>& fn)>;
+
   // Requests the removal of unused capacity.
   // Matches the semantics of std::vector::shrink_to_fit.
-  void ShrinkToFitTables() {
-    // At the moment, we only bother calling ShrinkToFit on a set group
-    // of tables. If we wanted to extend this to every table, we'd need to deal
-    // with tracking all the tables in the storage: this is not worth doing
-    // given most memory is used by these tables.
-    thread_table_.ShrinkToFit();
-    process_table_.ShrinkToFit();
-    track_table_.ShrinkToFit();
-    counter_table_.ShrinkToFit();
-    slice_table_.ShrinkToFit();
-    raw_table_.ShrinkToFit();
-    sched_slice_table_.ShrinkToFit();
-    thread_state_table_.ShrinkToFit();
-    arg_table_.ShrinkToFit();
-  }
+  // Each table is shrunk by a separate call of |parallel_for|, or in turn on
+  // the calling thread if it's null.
+  void ShrinkToFitTables(const ParallelForFn& parallel_for = nullptr);
 
   const tables::ThreadTable& thread_table() const { return thread_table_; }
   tables::ThreadTable* mutable_thread_table() { return &thread_table_; }
@@ -771,31 +766,42 @@ class TraceStorage {
   const StringPool& string_pool() const { return string_pool_; }
   StringPool* mutable_string_pool() { return &string_pool_; }
 
+  // Replaces the string pool with |pool|. Must be called before anything is
+  // added to the storage.
+  void ResetStringPool(StringPool pool);
+
   // Number of interned strings in the pool. Includes the empty string w/ ID=0.
   size_t string_count() const { return string_pool_.size(); }
 
   // Start / end ts (in nanoseconds) across the parsed trace events.
   // Returns (0, 0) if the trace is empty.
-  std::pair<int64_t, int64_t> GetTraceTimestampBoundsNs() const;
-
+  // Each table is scanned by a separate call of |parallel_for|, or in turn on
+  // the calling thread if it's null.
+  std::pair<int64_t, int64_t> GetTraceTimestampBoundsNs(
+      const ParallelForFn& parallel_for = nullptr) const;
+
+  // Registers a function which adds to the arg table the args which were
+  // recorded lazily during ingestion (see Config::lazy_ftrace_args).
+  void AddLazyArgsDecoder(std::function<void()> decoder) {
+    lazy_args_decoders_.emplace_back(std::move(decoder));
+  }
+
+  // Runs the functions registered with AddLazyArgsDecoder(). Must be called
+  // before reading the args of the raw and ftrace_event tables.
+  void DecodeLazyArgs() const {
+    for (const auto& decoder : lazy_args_decoders_)
+      decoder();
+  }
+
+  // Looks up the value of |key| in the arg set |arg_set_id|. Sets |result| to
+  // std::nullopt if there is no such arg.
+  //
+  // This is called for every row by queries using EXTRACT_ARG so, rather than
+  // filtering the arg table, it uses an index of the first row of every arg
+  // set (see |arg_set_first_rows_|) and only scans the rows of |arg_set_id|.
   util::Status ExtractArg(uint32_t arg_set_id,
                           const char* key,
-                          std::optional<Variadic>* result) {
-    const auto& args = arg_table();
-    RowMap filtered = args.FilterToRowMap(
-        {args.arg_set_id().eq(arg_set_id), args.key().eq(key)});
-    if (filtered.empty()) {
-      *result = std::nullopt;
-      return util::OkStatus();
-    }
-    if (filtered.size() > 1) {
-      return util::ErrStatus(
-          "EXTRACT_ARG: received multiple args matching arg set id and key");
-    }
-    uint32_t idx = filtered.Get(0);
-    *result = GetArgValue(idx);
-    return util::OkStatus();
-  }
+                          std::optional<Variadic>* result);
 
   Variadic GetArgValue(uint32_t row) const {
     Variadic v;
@@ -865,6 +871,17 @@ class TraceStorage {
   // Stats about parsing the trace.
   StatsMap stats_{};
 
+  // See AddLazyArgsDecoder().
+  std::vector<std::function<void()>> lazy_args_decoders_;
+
+  // The row of |arg_table_| where each arg set starts, indexed by arg set id.
+  // As arg sets are only ever appended to the table, with increasing ids, the
+  // rows of |arg_set_id| are [arg_set_first_rows_[arg_set_id],
+  // arg_set_first_rows_[arg_set_id + 1]). Built lazily by ExtractArg(), up to
+  // the first |indexed_arg_rows_| rows of the table.
+  std::vector<uint32_t> arg_set_first_rows_;
+  uint32_t indexed_arg_rows_ = 0;
+
   // Extra data extracted from the trace. Includes:
   // * metadata from chrome and benchmarking infrastructure
   // * descriptions of android packages
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// End-to-end benchmarks of trace processor: loading whole traces from
+// test/data and running standard library queries on them. Unlike the micro
+// benchmarks of the individual components, these catch regressions anywhere
+// in the import pipeline.
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/compiler.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/utils.h"
+#include "perfetto/trace_processor/basic_types.h"
+#include "perfetto/trace_processor/trace_blob.h"
+#include "perfetto/trace_processor/trace_blob_view.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/base/test/utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Traces covering the main importers. They are downloaded with the rest of
+// the test data by tools/install-build-deps.
+struct BenchmarkTrace {
+  const char* name;
+  const char* path;
+};
+constexpr BenchmarkTrace kTraces[] = {
+    {"ftrace", "test/data/example_android_trace_30s.pb"},
+    {"track_event", "test/data/chrome_rendering_desktop.pftrace"},
+    {"heap_graph", "test/data/system-server-heap-graph-new.pftrace"},
+    {"json", "test/data/sfgate.json"},
+};
+
+// Queries run on the ftrace trace by BM_TraceProcessorStdlibQuery. |module| is
+// included once before measuring the query.
+struct BenchmarkQuery {
+  const char* name;
+  const char* module;
+  const char* sql;
+};
+constexpr BenchmarkQuery kQueries[] = {
+    {"android_startups", "android.startup.startups",
+     "SELECT COUNT(*) FROM android_startups"},
+    {"android_process_metadata", "android.process_metadata",
+     "SELECT COUNT(*) FROM android_process_metadata"},
+    {"android_binder_txns", "android.binder",
+     "SELECT COUNT(*) FROM android_binder_txns"},
+    {"thread_state_by_thread", nullptr,
+     "SELECT utid, state, SUM(dur) FROM thread_state GROUP BY utid, state"},
+    {"slice_by_name", nullptr,
+     "SELECT name, COUNT(*), SUM(dur) FROM slice GROUP BY name"},
+};
+
+// Same chunk size as util::ReadTrace.
+constexpr size_t kChunkSize = 1024 * 1024;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Reads the trace in memory, so that the benchmarks don't measure disk IO.
+bool ReadBenchmarkTrace(const BenchmarkTrace& trace, std::string* out) {
+  return base::ReadFile(base::GetTestDataPath(trace.path), out) &&
+         !out->empty();
+}
+
+// Resets the peak RSS of the process reported by ReadPeakRssKb(), if the
+// platform supports it.
+void ResetPeakRss() {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  base::ScopedFile fd = base::OpenFile("/proc/self/clear_refs", O_WRONLY);
+  if (fd)
+    base::ignore_result(base::WriteAll(*fd, "5", 1));
+#endif
+}
+
+// Returns the peak RSS of the process since the last ResetPeakRss() call, or
+// zero if the platform doesn't support it.
+uint64_t ReadPeakRssKb() {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  std::string status;
+  if (!base::ReadFile("/proc/self/status", &status))
+    return 0;
+  for (const std::string& line : base::SplitString(status, "\n")) {
+    if (!base::StartsWith(line, "VmHWM:"))
+      continue;
+    std::string value = base::TrimWhitespace(line.substr(strlen("VmHWM:")));
+    return base::CStringToUInt64(value.c_str()).value_or(0);
+  }
+#endif
+  return 0;
+}
+
+base::Status LoadTrace(TraceProcessor* tp, const std::string& trace) {
+  for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+    size_t size = std::min(kChunkSize, trace.size() - off);
+    TraceBlob blob = TraceBlob::CopyFrom(trace.data() + off, size);
+    base::Status status = tp->Parse(TraceBlobView(std::move(blob)));
+    if (!status.ok())
+      return status;
+  }
+  tp->NotifyEndOfFile();
+  return base::OkStatus();
+}
+
+int64_t GetStat(TraceProcessor* tp, const char* name) {
+  auto it = tp->ExecuteQuery(
+      std::string("SELECT value FROM stats WHERE name = '") + name + "'");
+  PERFETTO_CHECK(it.Next());
+  return it.Get(0).AsLong();
+}
+
+// In functional test mode, only the first trace and query are run.
+void TraceArgs(benchmark::internal::Benchmark* b) {
+  auto last = static_cast<int>(base::ArraySize(kTraces)) - 1;
+  b->DenseRange(0, IsBenchmarkFunctionalOnly() ? 0 : last)
+      ->Unit(benchmark::kMillisecond);
+}
+
+void QueryArgs(benchmark::internal::Benchmark* b) {
+  auto last = static_cast<int>(base::ArraySize(kQueries)) - 1;
+  b->DenseRange(0, IsBenchmarkFunctionalOnly() ? 0 : last)
+      ->Unit(benchmark::kMillisecond);
+}
+
+}  // namespace
+
+// Measures the time to load a whole trace. The trace is fully sorted at the
+// end so that the time of each stage of the import can be told apart:
+// - tokenize_ms: splitting the trace into events and buffering them.
+// - sort_ms: sorting the buffered events.
+// - parse_ms: parsing the sorted events into the tables.
+// - finalize_ms: flushing the state of the importers at the end of the trace.
+static void BM_TraceProcessorLoad(benchmark::State& state) {
+  const BenchmarkTrace& trace = kTraces[static_cast<size_t>(state.range(0))];
+  state.SetLabel(trace.name);
+  std::string trace_data;
+  if (!ReadBenchmarkTrace(trace, &trace_data)) {
+    state.SkipWithError("Trace missing: run tools/install-build-deps");
+    return;
+  }
+
+  double tokenize_ns = 0;
+  double sort_ns = 0;
+  double parse_ns = 0;
+  double finalize_ns = 0;
+  uint64_t peak_rss_kb = 0;
+  for (auto _ : state) {
+    ResetPeakRss();
+    Config config;
+    config.sorting_mode = SortingMode::kForceFullSort;
+    std::unique_ptr<TraceProcessor> tp =
+        TraceProcessor::CreateInstance(config);
+    base::Status status = LoadTrace(tp.get(), trace_data);
+    if (!status.ok()) {
+      state.SkipWithError(status.c_message());
+      return;
+    }
+
+    state.PauseTiming();
+    peak_rss_kb = std::max(peak_rss_kb, ReadPeakRssKb());
+    int64_t sort = GetStat(tp.get(), "sorter_sort_duration_ns");
+    tokenize_ns +=
+        static_cast<double>(GetStat(tp.get(), "parse_trace_duration_ns"));
+    sort_ns += static_cast<double>(sort);
+    parse_ns += static_cast<double>(
+        GetStat(tp.get(), "end_of_file_parse_duration_ns") - sort);
+    finalize_ns +=
+        static_cast<double>(GetStat(tp.get(), "finalize_trace_duration_ns"));
+    tp.reset();
+    state.ResumeTiming();
+  }
+
+  using benchmark::Counter;
+  state.counters["tokenize_ms"] =
+      Counter(tokenize_ns / 1e6, Counter::kAvgIterations);
+  state.counters["sort_ms"] = Counter(sort_ns / 1e6, Counter::kAvgIterations);
+  state.counters["parse_ms"] =
+      Counter(parse_ns / 1e6, Counter::kAvgIterations);
+  state.counters["finalize_ms"] =
+      Counter(finalize_ns / 1e6, Counter::kAvgIterations);
+  state.counters["peak_rss_mb"] = static_cast<double>(peak_rss_kb) / 1024;
+  state.counters["trace_mb"] = static_cast<double>(trace_data.size()) / 1e6;
+}
+BENCHMARK(BM_TraceProcessorLoad)->Apply(TraceArgs);
+
+// Measures the latency of standard library queries on an already loaded
+// trace.
+static void BM_TraceProcessorStdlibQuery(benchmark::State& state) {
+  const BenchmarkQuery& query = kQueries[static_cast<size_t>(state.range(0))];
+  state.SetLabel(query.name);
+
+  // Loading the trace takes much longer than the queries so it's shared by all
+  // the queries.
+  static TraceProcessor* tp = [] {
+    std::string trace_data;
+    if (!ReadBenchmarkTrace(kTraces[0], &trace_data))
+      return static_cast<TraceProcessor*>(nullptr);
+    TraceProcessor* loaded =
+        TraceProcessor::CreateInstance(Config()).release();
+    PERFETTO_CHECK(LoadTrace(loaded, trace_data).ok());
+    return loaded;
+  }();
+  if (!tp) {
+    state.SkipWithError("Trace missing: run tools/install-build-deps");
+    return;
+  }
+
+  if (query.module) {
+    auto it = tp->ExecuteQuery(std::string("INCLUDE PERFETTO MODULE ") +
+                               query.module);
+    while (it.Next()) {
+    }
+    if (!it.Status().ok()) {
+      state.SkipWithError(it.Status().c_message());
+      return;
+    }
+  }
+
+  for (auto _ : state) {
+    auto it = tp->ExecuteQuery(query.sql);
+    uint32_t rows = 0;
+    while (it.Next())
+      rows++;
+    if (!it.Status().ok()) {
+      state.SkipWithError(it.Status().c_message());
+      return;
+    }
+    benchmark::DoNotOptimize(rows);
+  }
+}
+BENCHMARK(BM_TraceProcessorStdlibQuery)->Apply(QueryArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -41,6 +41,7 @@
 #include "src/trace_processor/importers/proto/track_event_module.h"
 #include "src/trace_processor/sorter/trace_sorter.h"
 #include "src/trace_processor/types/destructible.h"
+#include "src/trace_processor/util/spill_file.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/trace_processor_impl.h"
 
+#include <fcntl.h>
+
 #include <algorithm>
 #include <cstdint>
 #include <memory>
@@ -26,11 +28,13 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/base/status.h"
 #include "perfetto/base/time.h"
+#include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/trace_processor/basic_types.h"
+#include "src/trace_processor/db/query_executor.h"
 #include "src/trace_processor/importers/android_bugreport/android_bugreport_parser.h"
 #include "src/trace_processor/importers/common/clock_converter.h"
 #include "src/trace_processor/importers/common/clock_tracker.h"
@@ -67,6 +71,7 @@
 #include "src/trace_processor/perfetto_sql/intrinsics/operators/window_operator.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/ancestor.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/connected_flow.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/counter_summary.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/descendant.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/experimental_annotated_stack.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/experimental_counter_dur.h"
@@ -74,6 +79,12 @@
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/experimental_flat_slice.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/experimental_sched_upid.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/experimental_slice_layout.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/experimental_table_aggregate.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/flow_index.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/intrinsic_memory_usage.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/overlapping_slices.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/slice_flattened.h"
+#include "src/trace_processor/perfetto_sql/intrinsics/table_functions/slice_tree_index.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/static_table_function.h"
 #include "src/trace_processor/perfetto_sql/intrinsics/table_functions/view.h"
 #include "src/trace_processor/perfetto_sql/prelude/tables_views.h"
@@ -242,10 +253,11 @@ std::vector<std::string> SanitizeMetricMountPaths(
   return sanitized;
 }
 
-void SetupMetrics(TraceProcessor* tp,
-                  PerfettoSqlEngine* engine,
-                  std::vector<metrics::SqlMetricFile>* sql_metrics,
-                  const std::vector<std::string>& extension_paths) {
+metrics::RunMetric::Context* SetupMetrics(
+    TraceProcessor* tp,
+    PerfettoSqlEngine* engine,
+    std::vector<metrics::SqlMetricFile>* sql_metrics,
+    const std::vector<std::string>& extension_paths) {
   const std::vector<std::string> sanitized_extension_paths =
       SanitizeMetricMountPaths(extension_paths);
   std::vector<std::string> skip_prefixes;
@@ -276,10 +288,11 @@ void SetupMetrics(TraceProcessor* tp,
   RegisterFunction<metrics::NullIfEmpty>(engine, "NULL_IF_EMPTY", 1);
   RegisterFunction<metrics::UnwrapMetricProto>(engine, "UNWRAP_METRIC_PROTO",
                                                2);
-  RegisterFunction<metrics::RunMetric>(
-      engine, "RUN_METRIC", -1,
-      std::unique_ptr<metrics::RunMetric::Context>(
-          new metrics::RunMetric::Context{engine, sql_metrics}));
+  std::unique_ptr<metrics::RunMetric::Context> run_metric_ctx(
+      new metrics::RunMetric::Context{engine, sql_metrics, std::nullopt});
+  metrics::RunMetric::Context* run_metric_ctx_ptr = run_metric_ctx.get();
+  RegisterFunction<metrics::RunMetric>(engine, "RUN_METRIC", -1,
+                                       std::move(run_metric_ctx));
 
   // TODO(lalitm): migrate this over to using RegisterFunction once aggregate
   // functions are supported.
@@ -291,6 +304,7 @@ void SetupMetrics(TraceProcessor* tp,
     if (ret)
       PERFETTO_FATAL("Error initializing RepeatedField");
   }
+  return run_metric_ctx_ptr;
 }
 
 void InsertIntoTraceMetricsTable(sqlite3* db, const std::string& metric_name) {
@@ -365,7 +379,8 @@ void TraceProcessorImpl::RegisterView(const View& view) {
 
 TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
     : TraceProcessorStorageImpl(cfg),
-      engine_(context_.storage->mutable_string_pool()) {
+      engine_(context_.storage->mutable_string_pool()),
+      query_budget_(cfg.query_budget) {
   context_.fuchsia_trace_tokenizer.reset(new FuchsiaTraceTokenizer(&context_));
   context_.fuchsia_trace_parser.reset(new FuchsiaTraceParser(&context_));
 
@@ -400,6 +415,20 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
     }
   }
 
+  auto sort_v2 = context_.config.dev_flags.find("enable_db2_sorting");
+  if (sort_v2 != context_.config.dev_flags.end()) {
+    if (sort_v2->second == "true") {
+      Table::kUseSortV2 = true;
+    } else if (sort_v2->second == "false") {
+      Table::kUseSortV2 = false;
+    } else {
+      PERFETTO_ELOG("Unknown value for enable_db2_sorting %s",
+                    sort_v2->second.c_str());
+    }
+  }
+
+  QueryExecutor::SetSearchThreadCount(context_.config.filter_thread_count);
+
   sqlite3_str_split_init(engine_.sqlite_engine()->db());
   RegisterAdditionalModules(&context_);
 
@@ -493,7 +522,8 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
       PERFETTO_ELOG("%s", status.c_message());
   }
 
-  SetupMetrics(this, &engine_, &sql_metrics_, cfg.skip_builtin_metric_paths);
+  run_metric_ctx_ = SetupMetrics(this, &engine_, &sql_metrics_,
+                                 cfg.skip_builtin_metric_paths);
 
   // Legacy tables.
   engine_.sqlite_engine()->RegisterVirtualTableModule<SqlStatsTable>(
@@ -506,25 +536,49 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
       new ExperimentalFlamegraph(&context_)));
   RegisterStaticTableFunction(std::unique_ptr<ExperimentalCounterDur>(
       new ExperimentalCounterDur(storage->counter_table())));
+  RegisterStaticTableFunction(std::unique_ptr<CounterSummary>(
+      new CounterSummary(context_.storage->mutable_string_pool(),
+                         &storage->counter_table())));
   RegisterStaticTableFunction(std::unique_ptr<ExperimentalSliceLayout>(
       new ExperimentalSliceLayout(context_.storage.get()->mutable_string_pool(),
                                   &storage->slice_table())));
-  RegisterStaticTableFunction(std::unique_ptr<Ancestor>(
-      new Ancestor(Ancestor::Type::kSlice, context_.storage.get())));
+  // Shared by all the table functions which look up relatives of slices so
+  // the slice tree is only indexed once.
+  auto slice_tree_index =
+      std::make_shared<SliceTreeIndex>(&storage->slice_table());
+  RegisterStaticTableFunction(std::unique_ptr<Ancestor>(new Ancestor(
+      Ancestor::Type::kSlice, context_.storage.get(), slice_tree_index)));
   RegisterStaticTableFunction(std::unique_ptr<Ancestor>(new Ancestor(
       Ancestor::Type::kStackProfileCallsite, context_.storage.get())));
   RegisterStaticTableFunction(std::unique_ptr<Ancestor>(
-      new Ancestor(Ancestor::Type::kSliceByStack, context_.storage.get())));
+      new Ancestor(Ancestor::Type::kSliceByStack, context_.storage.get(),
+                   slice_tree_index)));
+  RegisterStaticTableFunction(std::unique_ptr<Ancestor>(new Ancestor(
+      Ancestor::Type::kSliceByIds, context_.storage.get(), slice_tree_index)));
+  RegisterStaticTableFunction(std::unique_ptr<OverlappingSlices>(
+      new OverlappingSlices(&storage->slice_table())));
+  RegisterStaticTableFunction(std::unique_ptr<SliceFlattened>(
+      new SliceFlattened(context_.storage->mutable_string_pool(),
+                         &storage->slice_table())));
+  RegisterStaticTableFunction(std::unique_ptr<Descendant>(new Descendant(
+      Descendant::Type::kSlice, context_.storage.get(), slice_tree_index)));
   RegisterStaticTableFunction(std::unique_ptr<Descendant>(
-      new Descendant(Descendant::Type::kSlice, context_.storage.get())));
+      new Descendant(Descendant::Type::kSliceByStack, context_.storage.get(),
+                     slice_tree_index)));
   RegisterStaticTableFunction(std::unique_ptr<Descendant>(
-      new Descendant(Descendant::Type::kSliceByStack, context_.storage.get())));
+      new Descendant(Descendant::Type::kSliceByIds, context_.storage.get(),
+                     slice_tree_index)));
+  auto flow_index = std::make_shared<FlowIndex>(&storage->flow_table(),
+                                                &storage->slice_table());
   RegisterStaticTableFunction(std::unique_ptr<ConnectedFlow>(new ConnectedFlow(
-      ConnectedFlow::Mode::kDirectlyConnectedFlow, context_.storage.get())));
-  RegisterStaticTableFunction(std::unique_ptr<ConnectedFlow>(new ConnectedFlow(
-      ConnectedFlow::Mode::kPrecedingFlow, context_.storage.get())));
-  RegisterStaticTableFunction(std::unique_ptr<ConnectedFlow>(new ConnectedFlow(
-      ConnectedFlow::Mode::kFollowingFlow, context_.storage.get())));
+      ConnectedFlow::Mode::kDirectlyConnectedFlow, context_.storage.get(),
+      slice_tree_index, flow_index)));
+  RegisterStaticTableFunction(std::unique_ptr<ConnectedFlow>(
+      new ConnectedFlow(ConnectedFlow::Mode::kPrecedingFlow,
+                        context_.storage.get(), slice_tree_index, flow_index)));
+  RegisterStaticTableFunction(std::unique_ptr<ConnectedFlow>(
+      new ConnectedFlow(ConnectedFlow::Mode::kFollowingFlow,
+                        context_.storage.get(), slice_tree_index, flow_index)));
   RegisterStaticTableFunction(
       std::unique_ptr<ExperimentalSchedUpid>(new ExperimentalSchedUpid(
           storage->sched_slice_table(), storage->thread_table())));
@@ -532,6 +586,11 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
       new ExperimentalAnnotatedStack(&context_)));
   RegisterStaticTableFunction(std::unique_ptr<ExperimentalFlatSlice>(
       new ExperimentalFlatSlice(&context_)));
+  RegisterStaticTableFunction(std::unique_ptr<ExperimentalTableAggregate>(
+      new ExperimentalTableAggregate(context_.storage->mutable_string_pool(),
+                                     &engine_)));
+  RegisterStaticTableFunction(std::unique_ptr<IntrinsicMemoryUsage>(
+      new IntrinsicMemoryUsage(&context_, &engine_)));
 
   // Views.
   RegisterView(storage->thread_slice_view());
@@ -540,9 +599,16 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   // Note: if adding a table here which might potentially contain many rows
   // (O(rows in sched/slice/counter)), then consider calling ShrinkToFit on
   // that table in TraceStorage::ShrinkToFitTables.
-  RegisterStaticTable(storage->arg_table());
-  RegisterStaticTable(storage->raw_table());
-  RegisterStaticTable(storage->ftrace_event_table());
+  // The args of these tables may be decoded lazily (see
+  // Config::lazy_ftrace_args).
+  auto decode_lazy_args = [storage] { storage->DecodeLazyArgs(); };
+  engine_.RegisterStaticTable(storage->arg_table(),
+                              tables::ArgTable::Name(), decode_lazy_args);
+  engine_.RegisterStaticTable(storage->raw_table(), tables::RawTable::Name(),
+                              decode_lazy_args);
+  engine_.RegisterStaticTable(storage->ftrace_event_table(),
+                              tables::FtraceEventTable::Name(),
+                              decode_lazy_args);
   RegisterStaticTable(storage->thread_table());
   RegisterStaticTable(storage->process_table());
   RegisterStaticTable(storage->filedescriptor_table());
@@ -624,6 +690,15 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
 TraceProcessorImpl::~TraceProcessorImpl() = default;
 
 base::Status TraceProcessorImpl::Parse(TraceBlobView blob) {
+  // Tracks how much memory is used as the trace is ingested.
+  PERFETTO_TP_TRACE(
+      metatrace::Category::TOPLEVEL, "PARSE_TRACE", [&](metatrace::Record* r) {
+        MemoryUsage usage =
+            IntrinsicMemoryUsage::ComputeTotal(&context_, &engine_);
+        r->AddArg("memory_used_bytes", std::to_string(usage.used_bytes));
+        r->AddArg("memory_reserved_bytes",
+                  std::to_string(usage.reserved_bytes));
+      });
   bytes_parsed_ += blob.size();
   return TraceProcessorStorageImpl::Parse(std::move(blob));
 }
@@ -649,8 +724,13 @@ void TraceProcessorImpl::Flush() {
       context_.storage->InternString(TraceTypeToString(context_.trace_type));
   context_.metadata_tracker->SetMetadata(metadata::trace_type,
                                          Variadic::String(trace_type_id));
-  BuildBoundsTable(engine_.sqlite_engine()->db(),
-                   context_.storage->GetTraceTimestampBoundsNs());
+  BuildBoundsTable(
+      engine_.sqlite_engine()->db(),
+      context_.storage->GetTraceTimestampBoundsNs(&QueryExecutor::ParallelFor));
+
+  // New data might have been parsed so anything computed from it so far is
+  // stale.
+  engine_.InvalidateMaterializedViews();
 }
 
 void TraceProcessorImpl::NotifyEndOfFile() {
@@ -681,15 +761,18 @@ void TraceProcessorImpl::NotifyEndOfFile() {
     initial_tables_.push_back(value.string_value);
   }
 
-  context_.storage->ShrinkToFitTables();
+  // The tables aren't changed anymore: the work left on each of them is
+  // spread over the filter threads, if any (see Config::filter_thread_count).
+  context_.storage->ShrinkToFitTables(&QueryExecutor::ParallelFor);
 
   // Rebuild the bounds table once everything has been completed: we do this
   // so that if any data was added to tables in
   // TraceProcessorStorageImpl::NotifyEndOfFile, this will be counted in
   // trace bounds: this is important for parsers like ninja which wait until
   // the end to flush all their data.
-  BuildBoundsTable(engine_.sqlite_engine()->db(),
-                   context_.storage->GetTraceTimestampBoundsNs());
+  BuildBoundsTable(
+      engine_.sqlite_engine()->db(),
+      context_.storage->GetTraceTimestampBoundsNs(&QueryExecutor::ParallelFor));
 
   TraceProcessorStorageImpl::DestroyContext();
 }
@@ -727,25 +810,54 @@ size_t TraceProcessorImpl::RestoreInitialTables() {
 }
 
 Iterator TraceProcessorImpl::ExecuteQuery(const std::string& sql) {
+  return ExecuteQuery(sql, query_budget_);
+}
+
+Iterator TraceProcessorImpl::ExecuteQuery(const std::string& sql,
+                                          const QueryBudget& budget) {
+  return ExecuteQueryInternal(sql, budget, nullptr);
+}
+
+Iterator TraceProcessorImpl::ExecuteQueryWithProfile(
+    const std::string& sql,
+    const QueryBudget& budget) {
+  return ExecuteQueryInternal(sql, budget, std::make_unique<QueryProfiler>());
+}
+
+Iterator TraceProcessorImpl::ExecuteQueryInternal(
+    const std::string& sql,
+    const QueryBudget& budget,
+    std::unique_ptr<QueryProfiler> profiler) {
   PERFETTO_TP_TRACE(metatrace::Category::TOPLEVEL, "QUERY_EXECUTE");
 
   uint32_t sql_stats_row =
       context_.storage->mutable_sql_stats()->RecordQueryBegin(
           sql, base::GetWallTimeNs().count());
+
+  // Expose the counters of the query cache so far in the stats table.
+  const QueryCache::Stats& cache_stats = engine_.query_cache()->stats();
+  context_.storage->SetStats(stats::query_cache_hits,
+                             static_cast<int64_t>(cache_stats.hits));
+  context_.storage->SetStats(stats::query_cache_misses,
+                             static_cast<int64_t>(cache_stats.misses));
+  context_.storage->SetStats(stats::query_cache_evictions,
+                             static_cast<int64_t>(cache_stats.evictions));
+
+  engine_.sqlite_engine()->BeginQuery(budget, profiler.get());
+
   std::string non_breaking_sql = base::ReplaceAll(sql, "\u00A0", " ");
   base::StatusOr<PerfettoSqlEngine::ExecutionResult> result =
       engine_.ExecuteUntilLastStatement(
           SqlSource::FromExecuteQuery(std::move(non_breaking_sql)));
-  std::unique_ptr<IteratorImpl> impl(
-      new IteratorImpl(this, std::move(result), sql_stats_row));
+  std::unique_ptr<IteratorImpl> impl(new IteratorImpl(
+      this, std::move(result), sql_stats_row, std::move(profiler)));
   return Iterator(std::move(impl));
 }
 
 void TraceProcessorImpl::InterruptQuery() {
   if (!engine_.sqlite_engine()->db())
     return;
-  query_interrupted_.store(true);
-  sqlite3_interrupt(engine_.sqlite_engine()->db());
+  engine_.sqlite_engine()->Interrupt();
 }
 
 bool TraceProcessorImpl::IsRootMetricField(const std::string& metric_name) {
@@ -872,8 +984,9 @@ base::Status TraceProcessorImpl::ComputeMetric(
     return base::Status("Root metrics proto descriptor not found");
 
   const auto& root_descriptor = pool_.descriptors()[opt_idx.value()];
-  return metrics::ComputeMetrics(&engine_, metric_names, sql_metrics_, pool_,
-                                 root_descriptor, metrics_proto);
+  engine_.sqlite_engine()->BeginQuery(query_budget_);
+  return metrics::ComputeMetrics(run_metric_ctx_, metric_names, sql_metrics_,
+                                 pool_, root_descriptor, metrics_proto);
 }
 
 base::Status TraceProcessorImpl::ComputeMetricText(
@@ -909,6 +1022,19 @@ void TraceProcessorImpl::EnableMetatrace(MetatraceConfig config) {
   metatrace::Enable(config);
 }
 
+base::Status TraceProcessorImpl::WriteStringPoolSnapshot(
+    const std::string& path) {
+  std::vector<uint8_t> snapshot;
+  context_.storage->string_pool().SerializeSnapshot(&snapshot);
+  base::ScopedFile fd(base::OpenFile(path, O_WRONLY | O_CREAT | O_TRUNC, 0644));
+  if (!fd)
+    return base::ErrStatus("Could not open %s for writing", path.c_str());
+  ssize_t written = base::WriteAll(*fd, snapshot.data(), snapshot.size());
+  if (written < 0 || static_cast<size_t>(written) != snapshot.size())
+    return base::ErrStatus("Failed to write string pool to %s", path.c_str());
+  return base::OkStatus();
+}
+
 namespace {
 
 class StringInterner {
@@ -19,7 +19,6 @@
 
 #include <sqlite3.h>
 
-#include <atomic>
 #include <functional>
 #include <map>
 #include <string>
@@ -36,6 +35,7 @@
 #include "src/trace_processor/perfetto_sql/intrinsics/functions/import.h"
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
 #include "src/trace_processor/sqlite/query_cache.h"
+#include "src/trace_processor/sqlite/query_profiler.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/sqlite/sqlite_engine.h"
 #include "src/trace_processor/trace_processor_storage_impl.h"
@@ -69,6 +69,10 @@ class TraceProcessorImpl : public TraceProcessor,
 
   // TraceProcessor implementation:
   Iterator ExecuteQuery(const std::string& sql) override;
+  Iterator ExecuteQuery(const std::string& sql,
+                        const QueryBudget& budget) override;
+  Iterator ExecuteQueryWithProfile(const std::string& sql,
+                                   const QueryBudget& budget) override;
 
   base::Status RegisterMetric(const std::string& path,
                               const std::string& sql) override;
@@ -103,6 +107,8 @@ class TraceProcessorImpl : public TraceProcessor,
   base::Status DisableAndReadMetatrace(
       std::vector<uint8_t>* trace_proto) override;
 
+  base::Status WriteStringPoolSnapshot(const std::string& path) override;
+
  private:
   // Needed for iterators to be able to access the context.
   friend class IteratorImpl;
@@ -121,6 +127,10 @@ class TraceProcessorImpl : public TraceProcessor,
 
   bool IsRootMetricField(const std::string& metric_name);
 
+  Iterator ExecuteQueryInternal(const std::string& sql,
+                                const QueryBudget& budget,
+                                std::unique_ptr<QueryProfiler> profiler);
+
   PerfettoSqlEngine engine_;
 
   DescriptorPool pool_;
@@ -128,11 +138,12 @@ class TraceProcessorImpl : public TraceProcessor,
   // Map from module name to module contents. Used for IMPORT function.
   base::FlatHashMap<std::string, sql_modules::RegisteredModule> sql_modules_;
   std::vector<metrics::SqlMetricFile> sql_metrics_;
+  // Owned by the RUN_METRIC function.
+  metrics::RunMetric::Context* run_metric_ctx_ = nullptr;
   std::unordered_map<std::string, std::string> proto_field_to_sql_metric_path_;
 
-  // This is atomic because it is set by the CTRL-C signal handler and we need
-  // to prevent single-flow compiler optimizations in ExecuteQuery().
-  std::atomic<bool> query_interrupted_{false};
+  // The budget of the queries which don't specify one.
+  QueryBudget query_budget_;
 
   // Keeps track of the tables created by the ingestion process. This is used
   // by RestoreInitialTables() to delete all the tables/view that have been
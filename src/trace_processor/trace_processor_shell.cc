@@ -17,13 +17,18 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <cinttypes>
 #include <functional>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -41,12 +46,15 @@
 #include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/getopt.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/status_or.h"
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/version.h"
 
 #include "perfetto/trace_processor/read_trace.h"
+#include "perfetto/trace_processor/trace_blob.h"
+#include "perfetto/trace_processor/trace_blob_view.h"
 #include "perfetto/trace_processor/trace_processor.h"
 #include "src/trace_processor/metrics/all_chrome_metrics.descriptor.h"
 #include "src/trace_processor/metrics/all_webview_metrics.descriptor.h"
@@ -63,6 +71,7 @@
 #include "src/trace_processor/rpc/httpd.h"
 #endif
 #include "src/profiling/deobfuscator.h"
+#include "src/profiling/symbolizer/caching_symbolizer.h"
 #include "src/profiling/symbolizer/local_symbolizer.h"
 #include "src/profiling/symbolizer/symbolize_database.h"
 #include "src/profiling/symbolizer/symbolizer.h"
@@ -103,6 +112,12 @@ namespace trace_processor {
 namespace {
 TraceProcessor* g_tp;
 
+// With --follow, only the events older than the newest event by more than
+// this window are parsed: the tracing service writes its buffers into the
+// file every 5s by default so events up to that much older than the newest
+// one can still show up.
+constexpr int64_t kFollowFlushWindowNs = 10ll * 1000 * 1000 * 1000;
+
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_LINENOISE)
 
 bool EnsureDir(const std::string& path) {
@@ -499,43 +514,117 @@ void PrintQueryResultInteractively(Iterator* it,
          static_cast<double>((t_end - t_start).count()) / 1E6);
 }
 
-base::Status PrintQueryResultAsCsv(Iterator* it, bool has_more, FILE* output) {
+void AppendCsvValue(const SqlValue& value, std::string* out) {
+  switch (value.type) {
+    case SqlValue::Type::kNull:
+      out->append("\"[NULL]\"");
+      break;
+    case SqlValue::Type::kDouble:
+      // Same formatting as "%f".
+      out->append(std::to_string(value.double_value));
+      break;
+    case SqlValue::Type::kLong:
+      out->append(std::to_string(value.long_value));
+      break;
+    case SqlValue::Type::kString:
+      out->append("\"").append(value.string_value).append("\"");
+      break;
+    case SqlValue::Type::kBytes:
+      out->append("\"<raw bytes>\"");
+      break;
+  }
+}
+
+void AppendCsvHeader(Iterator* it, std::string* out) {
   for (uint32_t c = 0; c < it->ColumnCount(); c++) {
     if (c > 0)
-      fprintf(output, ",");
-    fprintf(output, "\"%s\"", it->GetColumnName(c).c_str());
+      out->push_back(',');
+    out->append("\"").append(it->GetColumnName(c)).append("\"");
   }
-  fprintf(output, "\n");
+  out->push_back('\n');
+}
 
-  for (; has_more; has_more = it->Next()) {
-    for (uint32_t c = 0; c < it->ColumnCount(); c++) {
-      if (c > 0)
-        fprintf(output, ",");
+void AppendCsvRow(Iterator* it, std::string* out) {
+  for (uint32_t c = 0; c < it->ColumnCount(); c++) {
+    if (c > 0)
+      out->push_back(',');
+    AppendCsvValue(it->Get(c), out);
+  }
+  out->push_back('\n');
+}
 
-      auto value = it->Get(c);
-      switch (value.type) {
-        case SqlValue::Type::kNull:
-          fprintf(output, "\"%s\"", "[NULL]");
-          break;
-        case SqlValue::Type::kDouble:
-          fprintf(output, "%f", value.double_value);
-          break;
-        case SqlValue::Type::kLong:
-          fprintf(output, "%" PRIi64, value.long_value);
-          break;
-        case SqlValue::Type::kString:
-          fprintf(output, "\"%s\"", value.string_value);
-          break;
-        case SqlValue::Type::kBytes:
-          fprintf(output, "\"%s\"", "<raw bytes>");
-          break;
+// Appends |str| to |out| quoted with |quote|, doubling any |quote| in it as
+// SQL requires.
+void AppendSqlQuoted(const char* str, char quote, std::string* out) {
+  out->push_back(quote);
+  for (const char* c = str; *c; c++) {
+    if (*c == quote)
+      out->push_back(quote);
+    out->push_back(*c);
+  }
+  out->push_back(quote);
+}
+
+void AppendSqlLiteral(const SqlValue& value, std::string* out) {
+  switch (value.type) {
+    case SqlValue::Type::kNull:
+      out->append("NULL");
+      break;
+    case SqlValue::Type::kDouble: {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%.17g", value.double_value);
+      out->append(buf);
+      break;
+    }
+    case SqlValue::Type::kLong:
+      out->append(std::to_string(value.long_value));
+      break;
+    case SqlValue::Type::kString:
+      AppendSqlQuoted(value.string_value, '\'', out);
+      break;
+    case SqlValue::Type::kBytes: {
+      static const char kHex[] = "0123456789abcdef";
+      const auto* bytes = static_cast<const uint8_t*>(value.bytes_value);
+      out->append("X'");
+      for (size_t i = 0; i < value.bytes_count; i++) {
+        out->push_back(kHex[bytes[i] >> 4]);
+        out->push_back(kHex[bytes[i] & 0xf]);
       }
+      out->push_back('\'');
+      break;
     }
-    fprintf(output, "\n");
+  }
+}
+
+base::Status PrintQueryResultAsCsv(Iterator* it, bool has_more, FILE* output) {
+  std::string line;
+  AppendCsvHeader(it, &line);
+  fwrite(line.data(), 1, line.size(), output);
+
+  for (; has_more; has_more = it->Next()) {
+    line.clear();
+    AppendCsvRow(it, &line);
+    fwrite(line.data(), 1, line.size(), output);
   }
   return it->Status();
 }
 
+void PrintQueryProfile(const QueryProfile& profile) {
+  printf("%-32s %-32s %10s %10s %10s %10s %10s %10s\n", "table", "plan",
+         "filters", "filter ms", "next ms", "column ms", "examined",
+         "returned");
+  for (const QueryProfile::TableScan& scan : profile.table_scans) {
+    printf("%-32.32s %-32.32s %10" PRIu64 " %10.3f %10.3f %10.3f %10" PRIu64
+           " %10" PRIu64 "\n",
+           scan.table_name.c_str(), scan.plan.c_str(), scan.filter_count,
+           static_cast<double>(scan.filter_ns) / 1e6,
+           static_cast<double>(scan.next_ns) / 1e6,
+           static_cast<double>(scan.column_ns) / 1e6, scan.rows_examined,
+           scan.rows_returned);
+  }
+  printf("\n");
+}
+
 base::Status RunQueriesWithoutOutput(const std::string& sql_query) {
   auto it = g_tp->ExecuteQuery(sql_query);
   if (it.StatementWithOutputCount() > 0)
@@ -671,6 +760,9 @@ struct CommandLineOptions {
   std::string metric_names;
   std::string metric_output;
   std::string trace_file_path;
+  std::vector<std::string> multi_trace_paths;
+  uint32_t parallel_traces = 4;
+  std::string merge_query_file_path;
   std::string port_number;
   std::string override_stdlib_path;
   std::vector<std::string> override_sql_module_paths;
@@ -679,13 +771,28 @@ struct CommandLineOptions {
   bool enable_httpd = false;
   bool wide = false;
   bool force_full_sort = false;
+  bool follow = false;
+  uint32_t sorting_thread_count = 0;
+  std::string sorter_spill_dir;
+  std::string shared_string_pool_path;
+  std::string write_string_pool_path;
+  uint32_t tokenization_thread_count = 0;
+  uint32_t filter_thread_count = 0;
+  uint32_t heap_graph_thread_count = 0;
+  uint32_t memory_graph_thread_count = 0;
+  uint64_t query_time_budget_ms = 0;
+  uint64_t query_memory_budget_mb = 0;
   std::string metatrace_path;
   size_t metatrace_buffer_capacity = 0;
   metatrace::MetatraceCategories metatrace_categories =
       metatrace::MetatraceCategories::TOPLEVEL;
   bool dev = false;
   bool no_ftrace_raw = false;
+  bool lazy_ftrace_args = false;
+  bool compress_strings = false;
   bool analyze_trace_proto_content = false;
+  uint32_t proto_content_sampling_interval = 0;
+  uint32_t proto_content_max_depth = 0;
   bool crop_track_events = false;
   std::vector<std::string> dev_flags;
 };
@@ -693,7 +800,7 @@ struct CommandLineOptions {
 void PrintUsage(char** argv) {
   PERFETTO_ELOG(R"(
 Interactive trace processor shell.
-Usage: %s [FLAGS] trace_file.pb
+Usage: %s [FLAGS] trace_file.pb [trace_file.pb ...]
 
 Options:
  -h, --help                           Prints this guide.
@@ -718,18 +825,70 @@ Options:
  -e, --export FILE                    Export the contents of trace processor
                                       into an SQLite database after running any
                                       metrics or queries specified.
+ --trace-list FILE                    Reads the paths of the traces to process
+                                      from FILE, one per line (see "Multiple
+                                      traces" below).
+ --parallel-traces N                  Loads at most N traces at the same time
+                                      when processing multiple traces
+                                      (default: 4).
+ --merge-query FILE                   Collects the -q results of all the traces
+                                      into one table and runs the query in FILE
+                                      on it (see "Multiple traces" below).
+ --follow                             Keeps the trace file open and parses the
+                                      data appended to it (e.g. by a session
+                                      with write_into_file) before each query
+                                      of the interactive shell. Events newer
+                                      than 10s before the latest one are only
+                                      queryable once more data arrives.
 
 Feature flags:
  --full-sort                          Forces the trace processor into performing
                                       a full sort ignoring any windowing
                                       logic.
+ --sorting-threads N                  Uses N worker threads to sort the trace
+                                      events in parallel with parsing.
+ --sorter-spill-dir DIR               Keeps the events being sorted in a file
+                                      in DIR, which the kernel can write back
+                                      to disk when memory runs low, instead of
+                                      in anonymous memory.
+ --shared-string-pool FILE            Maps the string pool written to FILE by
+                                      --write-string-pool and shares its
+                                      strings instead of copying them.
+ --write-string-pool FILE             Writes the strings of the loaded trace
+                                      to FILE, for --shared-string-pool.
+ --tokenization-threads N             Uses N worker threads to decompress the
+                                      compressed packets of proto traces,
+                                      gzip traces and bugreport logs in
+                                      parallel with tokenization.
+ --filter-threads N                   Uses N worker threads to filter large
+                                      table columns and to join the
+                                      partitions of span joins in parallel.
+ --heap-graph-threads N               Uses N worker threads to process Java
+                                      heap graphs.
+ --memory-graph-threads N             Uses N worker threads to compute the
+                                      memory graphs of Chrome memory dumps.
+ --query-time-budget-ms N             Aborts queries which run for more than
+                                      N milliseconds.
+ --query-memory-budget-mb N           Aborts queries which make SQLite
+                                      allocate more than N MB.
  --no-ftrace-raw                      Prevents ingestion of typed ftrace events
                                       into the raw table. This significantly
                                       reduces the memory usage of trace
                                       processor when loading traces containing
                                       ftrace events.
+ --lazy-ftrace-args                   Defers decoding the args of the ftrace
+                                      events in the raw table until the
+                                      raw, ftrace_event or args tables are
+                                      first queried.
+ --compress-strings                   Stores long strings (e.g. log messages
+                                      or JSON args) compressed in memory.
  --analyze-trace-proto-content        Enables trace proto content analysis in
                                       trace processor.
+ --proto-content-sampling-interval N  Only analyzes the content of one in
+                                      every N packets of each type and scales
+                                      up the results.
+ --proto-content-max-depth N          Stops the content analysis at N levels
+                                      of nested messages.
  --crop-track-events                  Ignores track event outside of the
                                       range of interest in trace processor.
  --dev                                Enables features which are reserved for
@@ -773,6 +932,24 @@ Metrics:
                                       respectively, and mounts them onto
                                       VIRTUAL_PATH.
 
+Multiple traces:
+ When more than one trace file is passed (e.g. with a shell glob) or
+ --trace-list is used, the -q query and/or --run-metrics are run on each trace
+ separately, loading up to --parallel-traces traces at the same time. Each
+ trace is dropped as soon as its results are printed. Query results are
+ printed as a single CSV with an extra leading "trace" column, metrics are
+ printed for each trace after a "# <trace path>" line. Only works with -q,
+ --pre-metrics and --run-metrics (in text or JSON format).
+
+ With --merge-query, the -q results are not printed but inserted into the
+ trace_query_result table of a separate, initially empty, TraceProcessor,
+ with the extra leading columns machine_id and trace. The machine table has
+ one row per trace with its id, its path and the realtime_offset to add to
+ its timestamps to get the wall clock time (from its first REALTIME clock
+ snapshot). Once all the traces are done, the query in the --merge-query file
+ is run on these tables and its result is printed as CSV, e.g. to join events
+ across the traces of several devices on their wall clock time.
+
 Metatracing:
  -m, --metatrace FILE                 Enables metatracing of trace processor
                                       writing the resulting trace into FILE.
@@ -790,6 +967,17 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     OPT_PRE_METRICS,
     OPT_METRICS_OUTPUT,
     OPT_FORCE_FULL_SORT,
+    OPT_FOLLOW,
+    OPT_SORTING_THREADS,
+    OPT_SORTER_SPILL_DIR,
+    OPT_SHARED_STRING_POOL,
+    OPT_WRITE_STRING_POOL,
+    OPT_TOKENIZATION_THREADS,
+    OPT_FILTER_THREADS,
+    OPT_HEAP_GRAPH_THREADS,
+    OPT_MEMORY_GRAPH_THREADS,
+    OPT_QUERY_TIME_BUDGET,
+    OPT_QUERY_MEMORY_BUDGET,
     OPT_HTTP_PORT,
     OPT_ADD_SQL_MODULE,
     OPT_METRIC_EXTENSION,
@@ -797,11 +985,18 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     OPT_OVERRIDE_STDLIB,
     OPT_OVERRIDE_SQL_MODULE,
     OPT_NO_FTRACE_RAW,
+    OPT_LAZY_FTRACE_ARGS,
+    OPT_COMPRESS_STRINGS,
     OPT_METATRACE_BUFFER_CAPACITY,
     OPT_METATRACE_CATEGORIES,
     OPT_ANALYZE_TRACE_PROTO_CONTENT,
+    OPT_PROTO_CONTENT_SAMPLING_INTERVAL,
+    OPT_PROTO_CONTENT_MAX_DEPTH,
     OPT_CROP_TRACK_EVENTS,
     OPT_DEV_FLAG,
+    OPT_TRACE_LIST,
+    OPT_PARALLEL_TRACES,
+    OPT_MERGE_QUERY,
   };
 
   static const option long_options[] = {
@@ -815,15 +1010,38 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       {"http-port", required_argument, nullptr, OPT_HTTP_PORT},
       {"interactive", no_argument, nullptr, 'i'},
       {"export", required_argument, nullptr, 'e'},
+      {"follow", no_argument, nullptr, OPT_FOLLOW},
       {"metatrace", required_argument, nullptr, 'm'},
       {"metatrace-buffer-capacity", required_argument, nullptr,
        OPT_METATRACE_BUFFER_CAPACITY},
       {"metatrace-categories", required_argument, nullptr,
        OPT_METATRACE_CATEGORIES},
       {"full-sort", no_argument, nullptr, OPT_FORCE_FULL_SORT},
+      {"sorting-threads", required_argument, nullptr, OPT_SORTING_THREADS},
+      {"sorter-spill-dir", required_argument, nullptr, OPT_SORTER_SPILL_DIR},
+      {"shared-string-pool", required_argument, nullptr,
+       OPT_SHARED_STRING_POOL},
+      {"write-string-pool", required_argument, nullptr, OPT_WRITE_STRING_POOL},
+      {"tokenization-threads", required_argument, nullptr,
+       OPT_TOKENIZATION_THREADS},
+      {"filter-threads", required_argument, nullptr, OPT_FILTER_THREADS},
+      {"heap-graph-threads", required_argument, nullptr,
+       OPT_HEAP_GRAPH_THREADS},
+      {"memory-graph-threads", required_argument, nullptr,
+       OPT_MEMORY_GRAPH_THREADS},
+      {"query-time-budget-ms", required_argument, nullptr,
+       OPT_QUERY_TIME_BUDGET},
+      {"query-memory-budget-mb", required_argument, nullptr,
+       OPT_QUERY_MEMORY_BUDGET},
       {"no-ftrace-raw", no_argument, nullptr, OPT_NO_FTRACE_RAW},
+      {"lazy-ftrace-args", no_argument, nullptr, OPT_LAZY_FTRACE_ARGS},
+      {"compress-strings", no_argument, nullptr, OPT_COMPRESS_STRINGS},
       {"analyze-trace-proto-content", no_argument, nullptr,
        OPT_ANALYZE_TRACE_PROTO_CONTENT},
+      {"proto-content-sampling-interval", required_argument, nullptr,
+       OPT_PROTO_CONTENT_SAMPLING_INTERVAL},
+      {"proto-content-max-depth", required_argument, nullptr,
+       OPT_PROTO_CONTENT_MAX_DEPTH},
       {"crop-track-events", no_argument, nullptr, OPT_CROP_TRACK_EVENTS},
       {"dev", no_argument, nullptr, OPT_DEV},
       {"add-sql-module", required_argument, nullptr, OPT_ADD_SQL_MODULE},
@@ -835,9 +1053,13 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       {"metrics-output", required_argument, nullptr, OPT_METRICS_OUTPUT},
       {"metric-extension", required_argument, nullptr, OPT_METRIC_EXTENSION},
       {"dev-flag", required_argument, nullptr, OPT_DEV_FLAG},
+      {"trace-list", required_argument, nullptr, OPT_TRACE_LIST},
+      {"parallel-traces", required_argument, nullptr, OPT_PARALLEL_TRACES},
+      {"merge-query", required_argument, nullptr, OPT_MERGE_QUERY},
       {nullptr, 0, nullptr, 0}};
 
   bool explicit_interactive = false;
+  bool trace_list_used = false;
   for (;;) {
     int option =
         getopt_long(argc, argv, "hvWiDdm:p:q:e:", long_options, nullptr);
@@ -901,6 +1123,11 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       continue;
     }
 
+    if (option == OPT_FOLLOW) {
+      command_line_options.follow = true;
+      continue;
+    }
+
     if (option == OPT_METATRACE_BUFFER_CAPACITY) {
       command_line_options.metatrace_buffer_capacity =
           static_cast<size_t>(atoi(optarg));
@@ -918,16 +1145,95 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       continue;
     }
 
+    if (option == OPT_SORTING_THREADS) {
+      command_line_options.sorting_thread_count =
+          static_cast<uint32_t>(atoi(optarg));
+      continue;
+    }
+
+    if (option == OPT_SORTER_SPILL_DIR) {
+      command_line_options.sorter_spill_dir = optarg;
+      continue;
+    }
+
+    if (option == OPT_SHARED_STRING_POOL) {
+      command_line_options.shared_string_pool_path = optarg;
+      continue;
+    }
+
+    if (option == OPT_WRITE_STRING_POOL) {
+      command_line_options.write_string_pool_path = optarg;
+      continue;
+    }
+
+    if (option == OPT_TOKENIZATION_THREADS) {
+      command_line_options.tokenization_thread_count =
+          static_cast<uint32_t>(atoi(optarg));
+      continue;
+    }
+
+    if (option == OPT_FILTER_THREADS) {
+      command_line_options.filter_thread_count =
+          static_cast<uint32_t>(atoi(optarg));
+      continue;
+    }
+
+    if (option == OPT_HEAP_GRAPH_THREADS) {
+      command_line_options.heap_graph_thread_count =
+          static_cast<uint32_t>(atoi(optarg));
+      continue;
+    }
+
+    if (option == OPT_MEMORY_GRAPH_THREADS) {
+      command_line_options.memory_graph_thread_count =
+          static_cast<uint32_t>(atoi(optarg));
+      continue;
+    }
+
+    if (option == OPT_QUERY_TIME_BUDGET) {
+      command_line_options.query_time_budget_ms =
+          static_cast<uint64_t>(atoll(optarg));
+      continue;
+    }
+
+    if (option == OPT_QUERY_MEMORY_BUDGET) {
+      command_line_options.query_memory_budget_mb =
+          static_cast<uint64_t>(atoll(optarg));
+      continue;
+    }
+
     if (option == OPT_NO_FTRACE_RAW) {
       command_line_options.no_ftrace_raw = true;
       continue;
     }
 
+    if (option == OPT_LAZY_FTRACE_ARGS) {
+      command_line_options.lazy_ftrace_args = true;
+      continue;
+    }
+
+    if (option == OPT_COMPRESS_STRINGS) {
+      command_line_options.compress_strings = true;
+      continue;
+    }
+
     if (option == OPT_ANALYZE_TRACE_PROTO_CONTENT) {
       command_line_options.analyze_trace_proto_content = true;
       continue;
     }
 
+    if (option == OPT_PROTO_CONTENT_SAMPLING_INTERVAL) {
+      command_line_options.proto_content_sampling_interval =
+          static_cast<uint32_t>(atoi(optarg));
+      continue;
+    }
+
+    if (option == OPT_PROTO_CONTENT_MAX_DEPTH) {
+      command_line_options.proto_content_max_depth =
+          static_cast<uint32_t>(atoi(optarg));
+      continue;
+    }
+
     if (option == OPT_CROP_TRACK_EVENTS) {
       command_line_options.crop_track_events = true;
       continue;
@@ -978,6 +1284,34 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       continue;
     }
 
+    if (option == OPT_TRACE_LIST) {
+      std::string list;
+      if (!base::ReadFile(optarg, &list)) {
+        PERFETTO_ELOG("Unable to read trace list %s", optarg);
+        exit(1);
+      }
+      for (base::StringSplitter lines(list, '\n'); lines.Next();) {
+        std::string path = base::TrimWhitespace(lines.cur_token());
+        if (!path.empty())
+          command_line_options.multi_trace_paths.push_back(std::move(path));
+      }
+      // Even a list with a single trace uses the multiple traces output
+      // format, so scripts don't have to special case it.
+      trace_list_used = true;
+      continue;
+    }
+
+    if (option == OPT_PARALLEL_TRACES) {
+      command_line_options.parallel_traces =
+          static_cast<uint32_t>(atoi(optarg));
+      continue;
+    }
+
+    if (option == OPT_MERGE_QUERY) {
+      command_line_options.merge_query_file_path = optarg;
+      continue;
+    }
+
     PrintUsage(argv);
     exit(option == 'h' ? 0 : 1);
   }
@@ -988,6 +1322,14 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
                                command_line_options.query_file_path.empty() &&
                                command_line_options.sqlite_file_path.empty());
 
+  // Following a trace is only useful when queries can be typed as the trace
+  // grows.
+  if (command_line_options.follow && (!command_line_options.launch_shell ||
+                                      command_line_options.enable_httpd)) {
+    PrintUsage(argv);
+    exit(1);
+  }
+
   // Only allow non-interactive queries to emit perf data.
   if (!command_line_options.perf_file_path.empty() &&
       command_line_options.launch_shell) {
@@ -995,12 +1337,41 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     exit(1);
   }
 
+  for (int i = optind; i < argc; i++)
+    command_line_options.multi_trace_paths.push_back(argv[i]);
+
+  // With a single trace (and no --trace-list), process it as usual.
+  if (!trace_list_used && command_line_options.multi_trace_paths.size() == 1) {
+    command_line_options.trace_file_path =
+        command_line_options.multi_trace_paths[0];
+    command_line_options.multi_trace_paths.clear();
+  }
+
+  // Multiple traces can only be processed in batch mode.
+  bool multi_trace = !command_line_options.multi_trace_paths.empty();
+  if (multi_trace &&
+      (command_line_options.launch_shell ||
+       command_line_options.enable_httpd || command_line_options.follow ||
+       !command_line_options.sqlite_file_path.empty() ||
+       !command_line_options.perf_file_path.empty() ||
+       !command_line_options.metatrace_path.empty() ||
+       command_line_options.parallel_traces == 0)) {
+    PrintUsage(argv);
+    exit(1);
+  }
+
+  // Merging needs the per-trace query results.
+  if (!command_line_options.merge_query_file_path.empty() &&
+      (!multi_trace || command_line_options.query_file_path.empty())) {
+    PrintUsage(argv);
+    exit(1);
+  }
+
   // The only case where we allow omitting the trace file path is when running
   // in --http mode. In all other cases, the last argument must be the trace
   // file.
-  if (optind == argc - 1 && argv[optind]) {
-    command_line_options.trace_file_path = argv[optind];
-  } else if (!command_line_options.enable_httpd) {
+  if (command_line_options.trace_file_path.empty() && !multi_trace &&
+      !command_line_options.enable_httpd) {
     PrintUsage(argv);
     exit(1);
   }
@@ -1037,6 +1408,8 @@ base::Status LoadTrace(const std::string& trace_file_path, double* size_mb) {
   std::unique_ptr<profiling::Symbolizer> symbolizer =
       profiling::LocalSymbolizerOrDie(profiling::GetPerfettoBinaryPath(),
                                       getenv("PERFETTO_SYMBOLIZER_MODE"));
+  symbolizer = profiling::MaybeAddSymbolCache(
+      std::move(symbolizer), profiling::GetPerfettoSymbolCachePath());
 
   if (symbolizer) {
     profiling::SymbolizeDatabase(
@@ -1071,6 +1444,45 @@ base::Status LoadTrace(const std::string& trace_file_path, double* size_mb) {
   return base::OkStatus();
 }
 
+// Parses all the data which can be read from |fd| and flushes it to the
+// tables. With --follow, the trace file is kept open and this is called again
+// before each query to parse the data appended to the file in the meantime.
+base::Status ParseTraceFromFd(int fd, uint64_t* bytes_parsed) {
+  constexpr size_t kChunkSize = 1024 * 1024;
+  for (;;) {
+    TraceBlob blob = TraceBlob::Allocate(kChunkSize);
+    auto rsize = base::Read(fd, blob.data(), blob.size());
+    if (rsize < 0) {
+      return base::ErrStatus("Reading trace file failed (errno: %d, %s)",
+                             errno, strerror(errno));
+    }
+    if (rsize == 0)
+      break;
+    *bytes_parsed += static_cast<uint64_t>(rsize);
+    RETURN_IF_ERROR(g_tp->Parse(
+        TraceBlobView(std::move(blob), 0, static_cast<size_t>(rsize))));
+  }
+  g_tp->Flush();
+  return base::OkStatus();
+}
+
+// Loads the trace without finalizing it and keeps it open in |trace_file| so
+// that data appended to it can be parsed later (see --follow).
+base::Status FollowTrace(const std::string& trace_file_path,
+                         base::ScopedFile* trace_file,
+                         double* size_mb) {
+  *trace_file = base::OpenFile(trace_file_path, O_RDONLY);
+  if (!*trace_file) {
+    return base::ErrStatus("Could not open trace file (path: %s)",
+                           trace_file_path.c_str());
+  }
+  uint64_t bytes_parsed = 0;
+  RETURN_IF_ERROR(ParseTraceFromFd(**trace_file, &bytes_parsed));
+  g_tp->SetCurrentTraceName(trace_file_path);
+  *size_mb = static_cast<double>(bytes_parsed) / 1E6;
+  return base::OkStatus();
+}
+
 base::Status RunQueries(const std::string& query_file_path,
                         bool expect_output) {
   std::string queries;
@@ -1416,7 +1828,9 @@ void PrintShellUsage() {
       ".run-metrics      Runs metrics specified in command line args\n"
       "                  and prints the result.\n"
       ".width WIDTH      Changes the column width of interactive query\n"
-      "                  output.");
+      "                  output.\n"
+      ".profile QUERY    Runs QUERY and prints the time spent in and the rows\n"
+      "                  read from each table it scans.");
 }
 
 struct InteractiveOptions {
@@ -1425,6 +1839,11 @@ struct InteractiveOptions {
   std::vector<MetricExtension> extensions;
   std::vector<MetricNameAndPath> metrics;
   const google::protobuf::DescriptorPool* pool;
+
+  // The trace file when --follow is used or -1 otherwise.
+  int followed_trace_fd;
+
+  QueryBudget query_budget;
 };
 
 base::Status StartInteractiveShell(const InteractiveOptions& options) {
@@ -1435,6 +1854,14 @@ base::Status StartInteractiveShell(const InteractiveOptions& options) {
     ScopedLine line = GetLine("> ");
     if (!line)
       break;
+    if (options.followed_trace_fd >= 0) {
+      uint64_t bytes_parsed = 0;
+      base::Status status =
+          ParseTraceFromFd(options.followed_trace_fd, &bytes_parsed);
+      if (!status.ok()) {
+        PERFETTO_ELOG("%s", status.c_message());
+      }
+    }
     if (strcmp(line.get(), "") == 0) {
       printf("If you want to quit either type .q or press CTRL-D (EOF)\n");
       continue;
@@ -1464,6 +1891,16 @@ base::Status StartInteractiveShell(const InteractiveOptions& options) {
           continue;
         }
         column_width = *width;
+      } else if (strcmp(command, "profile") == 0 && strlen(arg)) {
+        // Unlike the arguments of the other commands, the query can contain
+        // spaces so take the whole rest of the line.
+        const char* sql = strstr(line.get(), "profile") + strlen("profile");
+        base::TimeNanos t_start = base::GetWallTimeNs();
+        auto it = g_tp->ExecuteQueryWithProfile(sql, options.query_budget);
+        PrintQueryResultInteractively(&it, t_start, column_width);
+        std::optional<QueryProfile> profile = it.Profile();
+        PERFETTO_CHECK(profile);
+        PrintQueryProfile(*profile);
       } else if (strcmp(command, "load-metrics-sql") == 0) {
         base::Status status =
             LoadMetricsAndExtensionsSql(options.metrics, options.extensions);
@@ -1542,6 +1979,256 @@ base::Status MaybeUpdateSqlModules(const CommandLineOptions& options) {
   return base::OkStatus();
 }
 
+// What to run on each trace when processing multiple traces.
+struct MultiTraceJob {
+  std::string pre_metrics;
+  std::vector<std::string> metric_names;
+  OutputFormat metric_format = OutputFormat::kNone;
+  std::string query;
+  // Whether the query results are merged (see --merge-query) instead of being
+  // printed.
+  bool merge = false;
+};
+
+base::Status RunQueryAndDrain(TraceProcessor* tp, const std::string& sql) {
+  auto it = tp->ExecuteQuery(sql);
+  while (it.Next()) {
+  }
+  return it.Status();
+}
+
+// Number of rows inserted by each statement when merging query results.
+constexpr size_t kMergeRowsPerInsert = 1000;
+
+// Returns the offset to add to the trace timestamps of |tp| to get the wall
+// clock time, or NULL if the trace has no REALTIME clock snapshot.
+base::StatusOr<SqlValue> QueryRealtimeOffset(TraceProcessor* tp) {
+  auto it = tp->ExecuteQuery(
+      "SELECT clock_value - ts FROM clock_snapshot "
+      "WHERE clock_name = 'REALTIME' ORDER BY ts LIMIT 1");
+  bool has_row = it.Next();
+  RETURN_IF_ERROR(it.Status());
+  return has_row ? it.Get(0) : SqlValue();
+}
+
+// Appends to |output| the statements inserting the rows of |it|, starting from
+// the current one, into the trace_query_result table of the merge instance.
+// The statement creating the table is set in |header|.
+void AppendMergeStatements(Iterator* it,
+                           bool has_more,
+                           size_t machine_id,
+                           const std::string& trace,
+                           std::string* header,
+                           std::string* output) {
+  header->append("CREATE TABLE trace_query_result(machine_id, trace");
+  for (uint32_t c = 0; c < it->ColumnCount(); c++) {
+    header->append(", ");
+    AppendSqlQuoted(it->GetColumnName(c).c_str(), '"', header);
+  }
+  header->append(");\n");
+
+  std::string prefix = "(" + std::to_string(machine_id) + ", ";
+  AppendSqlQuoted(trace.c_str(), '\'', &prefix);
+  for (size_t rows = 0; has_more; has_more = it->Next(), rows++) {
+    if (rows % kMergeRowsPerInsert != 0)
+      output->push_back(',');
+    else if (rows > 0)
+      output->append(";\nINSERT INTO trace_query_result VALUES");
+    else
+      output->append("INSERT INTO trace_query_result VALUES");
+    output->append(prefix);
+    for (uint32_t c = 0; c < it->ColumnCount(); c++) {
+      output->append(", ");
+      AppendSqlLiteral(it->Get(c), output);
+    }
+    output->push_back(')');
+  }
+  if (!output->empty())
+    output->append(";\n");
+}
+
+// Loads |trace| in a new TraceProcessor instance and runs |job| on it. Query
+// results are appended to |output| as CSV rows prefixed with the trace path
+// and their header to |csv_header|. Metrics are appended to |output|.
+//
+// If |job.merge| is set, |output| instead gets the SQL statements adding the
+// query results and the machine row of the trace to the merge instance and
+// |csv_header| the one creating the trace_query_result table. |machine_id| is
+// the id of the trace in there.
+base::Status RunOnTrace(const Config& config,
+                        const std::string& trace,
+                        size_t machine_id,
+                        const MultiTraceJob& job,
+                        std::string* csv_header,
+                        std::string* output) {
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
+  RETURN_IF_ERROR(ReadTrace(tp.get(), trace.c_str()));
+
+  if (!job.pre_metrics.empty())
+    RETURN_IF_ERROR(RunQueryAndDrain(tp.get(), job.pre_metrics));
+
+  if (!job.metric_names.empty()) {
+    std::string metrics;
+    RETURN_IF_ERROR(tp->ComputeMetricText(
+        job.metric_names,
+        job.metric_format == OutputFormat::kJson
+            ? TraceProcessor::MetricResultFormat::kJson
+            : TraceProcessor::MetricResultFormat::kProtoText,
+        &metrics));
+    if (job.metric_format != OutputFormat::kNone)
+      *output += "# " + trace + "\n" + metrics + "\n";
+  }
+
+  if (!job.query.empty()) {
+    auto it = tp->ExecuteQuery(job.query);
+    bool has_more = it.Next();
+    RETURN_IF_ERROR(it.Status());
+    if (job.merge) {
+      AppendMergeStatements(&it, has_more, machine_id, trace, csv_header,
+                            output);
+      RETURN_IF_ERROR(it.Status());
+
+      base::StatusOr<SqlValue> offset = QueryRealtimeOffset(tp.get());
+      RETURN_IF_ERROR(offset.status());
+      output->append("INSERT INTO machine VALUES(" +
+                     std::to_string(machine_id) + ", ");
+      AppendSqlQuoted(trace.c_str(), '\'', output);
+      output->append(", ");
+      AppendSqlLiteral(*offset, output);
+      output->append(");\n");
+      return base::OkStatus();
+    }
+    if (it.ColumnCount() == 0)
+      return base::OkStatus();
+
+    csv_header->append("\"trace\",");
+    AppendCsvHeader(&it, csv_header);
+    std::string prefix = "\"" + trace + "\",";
+    for (; has_more; has_more = it.Next()) {
+      output->append(prefix);
+      AppendCsvRow(&it, output);
+    }
+    RETURN_IF_ERROR(it.Status());
+  }
+  return base::OkStatus();
+}
+
+// Runs the queries and metrics in |options| on each of the traces in
+// |options.multi_trace_paths|, see "Multiple traces" in PrintUsage().
+base::Status RunOnMultipleTraces(const CommandLineOptions& options,
+                                 const Config& config) {
+  if (!options.sql_module_path.empty() ||
+      !options.override_sql_module_paths.empty() ||
+      !options.override_stdlib_path.empty() ||
+      !options.raw_metric_extensions.empty()) {
+    return base::ErrStatus(
+        "SQL modules and metric extensions are not supported with multiple "
+        "traces");
+  }
+
+  MultiTraceJob job;
+  if (!options.pre_metrics_path.empty() &&
+      !base::ReadFile(options.pre_metrics_path, &job.pre_metrics)) {
+    return base::ErrStatus("Unable to read file %s",
+                           options.pre_metrics_path.c_str());
+  }
+  if (!options.query_file_path.empty() &&
+      !base::ReadFile(options.query_file_path, &job.query)) {
+    return base::ErrStatus("Unable to read file %s",
+                           options.query_file_path.c_str());
+  }
+  if (!options.metric_names.empty())
+    job.metric_names = base::SplitString(options.metric_names, ",");
+  job.metric_format = ParseOutputFormat(options);
+  if (!job.metric_names.empty() &&
+      job.metric_format == OutputFormat::kBinaryProto) {
+    return base::ErrStatus(
+        "Binary metrics output is not supported with multiple traces");
+  }
+
+  // The results of all the traces are inserted in |merged| as they come, so
+  // that only the instances of the traces being processed are alive at the
+  // same time.
+  std::string merge_query;
+  std::unique_ptr<TraceProcessor> merged;
+  if (!options.merge_query_file_path.empty()) {
+    if (!base::ReadFile(options.merge_query_file_path, &merge_query)) {
+      return base::ErrStatus("Unable to read file %s",
+                             options.merge_query_file_path.c_str());
+    }
+    job.merge = true;
+    merged = TraceProcessor::CreateInstance(config);
+    RETURN_IF_ERROR(RunQueryAndDrain(
+        merged.get(),
+        "CREATE TABLE machine(id INT, trace STRING, realtime_offset INT)"));
+  }
+
+  const std::vector<std::string>& traces = options.multi_trace_paths;
+  std::atomic<size_t> next_trace{0};
+  std::mutex mutex;
+  std::string printed_csv_header;  // Guarded by |mutex|.
+  size_t failed_traces = 0;        // Guarded by |mutex|.
+
+  // Each thread processes one trace at a time, so at most |parallel_traces|
+  // traces (and their results) are held in memory.
+  auto process_traces = [&] {
+    for (size_t i = next_trace++; i < traces.size(); i = next_trace++) {
+      std::string csv_header;
+      std::string output;
+      base::Status status =
+          RunOnTrace(config, traces[i], i, job, &csv_header, &output);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (status.ok() && !csv_header.empty()) {
+        if (printed_csv_header.empty()) {
+          printed_csv_header = csv_header;
+          if (merged)
+            status = RunQueryAndDrain(merged.get(), csv_header);
+          else
+            fwrite(csv_header.data(), 1, csv_header.size(), stdout);
+        } else if (csv_header != printed_csv_header) {
+          status = base::ErrStatus(
+              "Query returned different columns than on previous traces");
+        }
+      }
+      if (status.ok() && merged)
+        status = RunQueryAndDrain(merged.get(), output);
+      if (!status.ok()) {
+        fprintf(stderr, "%s: %s\n", traces[i].c_str(), status.c_message());
+        failed_traces++;
+        continue;
+      }
+      if (merged)
+        continue;
+      fwrite(output.data(), 1, output.size(), stdout);
+      fflush(stdout);
+    }
+  };
+
+  size_t thread_count =
+      std::min(static_cast<size_t>(options.parallel_traces), traces.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; i++)
+    threads.emplace_back(process_traces);
+  process_traces();
+  for (std::thread& thread : threads)
+    thread.join();
+
+  if (failed_traces > 0) {
+    return base::ErrStatus("Failed to process %zu of %zu traces",
+                           failed_traces, traces.size());
+  }
+  if (merged) {
+    if (printed_csv_header.empty())
+      return base::ErrStatus("No query results to merge");
+    auto it = merged->ExecuteQuery(merge_query);
+    bool has_more = it.Next();
+    RETURN_IF_ERROR(it.Status());
+    return PrintQueryResultAsCsv(&it, has_more, stdout);
+  }
+  return base::OkStatus();
+}
+
 base::Status TraceProcessorMain(int argc, char** argv) {
   CommandLineOptions options = ParseCommandLineOptions(argc, argv);
 
@@ -1549,8 +2236,25 @@ base::Status TraceProcessorMain(int argc, char** argv) {
   config.sorting_mode = options.force_full_sort
                             ? SortingMode::kForceFullSort
                             : SortingMode::kDefaultHeuristics;
+  config.sorting_thread_count = options.sorting_thread_count;
+  config.sorter_spill_dir = options.sorter_spill_dir;
+  config.shared_string_pool_path = options.shared_string_pool_path;
+  config.incremental_flush_window_ns =
+      options.follow ? kFollowFlushWindowNs : 0;
+  config.tokenization_thread_count = options.tokenization_thread_count;
+  config.filter_thread_count = options.filter_thread_count;
+  config.heap_graph_thread_count = options.heap_graph_thread_count;
+  config.memory_graph_thread_count = options.memory_graph_thread_count;
+  config.query_budget.max_wall_time_ms = options.query_time_budget_ms;
+  config.query_budget.max_sqlite_memory_bytes =
+      options.query_memory_budget_mb * 1024 * 1024;
   config.ingest_ftrace_in_raw_table = !options.no_ftrace_raw;
+  config.lazy_ftrace_args = options.lazy_ftrace_args;
+  config.compress_strings = options.compress_strings;
   config.analyze_trace_proto_content = options.analyze_trace_proto_content;
+  config.proto_content_sampling_interval =
+      options.proto_content_sampling_interval;
+  config.proto_content_max_depth = options.proto_content_max_depth;
   config.drop_track_event_data_before =
       options.crop_track_events
           ? DropTrackEventDataBefore::kTrackEventRangeOfInterest
@@ -1576,6 +2280,9 @@ base::Status TraceProcessorMain(int argc, char** argv) {
     }
   }
 
+  if (!options.multi_trace_paths.empty())
+    return RunOnMultipleTraces(options, config);
+
   std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
   g_tp = tp.get();
 
@@ -1612,10 +2319,16 @@ base::Status TraceProcessorMain(int argc, char** argv) {
   }
 
   base::TimeNanos t_load{};
+  base::ScopedFile followed_trace;
   if (!options.trace_file_path.empty()) {
     base::TimeNanos t_load_start = base::GetWallTimeNs();
     double size_mb = 0;
-    RETURN_IF_ERROR(LoadTrace(options.trace_file_path, &size_mb));
+    if (options.follow) {
+      RETURN_IF_ERROR(
+          FollowTrace(options.trace_file_path, &followed_trace, &size_mb));
+    } else {
+      RETURN_IF_ERROR(LoadTrace(options.trace_file_path, &size_mb));
+    }
     t_load = base::GetWallTimeNs() - t_load_start;
 
     double t_load_s = static_cast<double>(t_load.count()) / 1E9;
@@ -1623,6 +2336,11 @@ base::Status TraceProcessorMain(int argc, char** argv) {
                   t_load_s, size_mb / t_load_s);
 
     RETURN_IF_ERROR(PrintStats());
+
+    if (!options.write_string_pool_path.empty()) {
+      RETURN_IF_ERROR(
+          tp->WriteStringPoolSnapshot(options.write_string_pool_path));
+    }
   }
 
 #if PERFETTO_HAS_SIGNAL_H()
@@ -1684,7 +2402,9 @@ base::Status TraceProcessorMain(int argc, char** argv) {
   if (options.launch_shell) {
     RETURN_IF_ERROR(StartInteractiveShell(
         InteractiveOptions{options.wide ? 40u : 20u, metric_format,
-                           metric_extensions, metrics, &pool}));
+                           metric_extensions, metrics, &pool,
+                           followed_trace ? *followed_trace : -1,
+                           config.query_budget}));
   } else if (!options.perf_file_path.empty()) {
     RETURN_IF_ERROR(PrintPerfFile(options.perf_file_path, t_load, t_query));
   }
@@ -16,8 +16,13 @@
 
 #include "src/trace_processor/trace_processor_storage_impl.h"
 
+#include <memory>
+
 #include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/uuid.h"
+#include "perfetto/trace_processor/trace_blob.h"
 #include "src/trace_processor/forwarding_trace_parser.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
 #include "src/trace_processor/importers/common/args_translation_table.h"
@@ -41,15 +46,64 @@
 #include "src/trace_processor/importers/proto/stack_profile_tracker.h"
 #include "src/trace_processor/importers/proto/track_event.descriptor.h"
 #include "src/trace_processor/sorter/trace_sorter.h"
+#include "src/trace_processor/util/bump_allocator.h"
 #include "src/trace_processor/util/descriptors.h"
+#include "src/trace_processor/util/spill_file.h"
+
+#if TRACE_PROCESSOR_HAS_MMAP()
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 namespace perfetto {
 namespace trace_processor {
+namespace {
+
+// Maps the string pool snapshot at |path| and creates a pool sharing it.
+base::StatusOr<StringPool> MapSharedStringPool(const std::string& path) {
+#if TRACE_PROCESSOR_HAS_MMAP()
+  base::ScopedFile fd(base::OpenFile(path, O_RDONLY));
+  if (!fd)
+    return base::ErrStatus("Could not open string pool %s", path.c_str());
+  off_t size = lseek(*fd, 0, SEEK_END);
+  if (size <= 0)
+    return base::ErrStatus("Empty string pool %s", path.c_str());
+  void* data = mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_SHARED,
+                    *fd, 0);
+  if (data == MAP_FAILED)
+    return base::ErrStatus("Could not map string pool %s", path.c_str());
+  auto blob = std::make_shared<TraceBlob>(
+      TraceBlob::FromMmap(data, static_cast<size_t>(size)));
+  return StringPool::FromSharedSnapshot(blob->data(), blob->size(), blob);
+#else
+  return base::ErrStatus("Shared string pools need mmap (%s)", path.c_str());
+#endif
+}
+
+}  // namespace
 
 TraceProcessorStorageImpl::TraceProcessorStorageImpl(const Config& cfg) {
   context_.config = cfg;
 
   context_.storage.reset(new TraceStorage(context_.config));
+  if (!cfg.shared_string_pool_path.empty()) {
+    auto pool = MapSharedStringPool(cfg.shared_string_pool_path);
+    if (pool.ok()) {
+      context_.storage->ResetStringPool(std::move(*pool));
+    } else {
+      PERFETTO_ELOG("%s, not sharing strings", pool.status().c_message());
+    }
+  }
+  if (!cfg.sorter_spill_dir.empty()) {
+    auto spill_file =
+        SpillFile::Create(cfg.sorter_spill_dir, BumpAllocator::kChunkSize);
+    if (spill_file.ok()) {
+      context_.sorter_spill_file = std::move(*spill_file);
+    } else {
+      PERFETTO_ELOG("%s, sorting in memory", spill_file.status().c_message());
+    }
+  }
   context_.track_tracker.reset(new TrackTracker(&context_));
   context_.async_track_set_tracker.reset(new AsyncTrackSetTracker(&context_));
   context_.args_tracker.reset(new ArgsTracker(&context_));
@@ -125,14 +179,28 @@ void TraceProcessorStorageImpl::Flush() {
   if (unrecoverable_parse_error_)
     return;
 
-  if (context_.sorter)
+  if (!context_.sorter)
+    return;
+
+  int64_t window = context_.config.incremental_flush_window_ns;
+  if (window > 0) {
+    context_.sorter->ExtractEventsUntilTimestamp(
+        context_.sorter->max_timestamp() - window);
+  } else {
     context_.sorter->ExtractEventsForced();
+  }
 }
 
 void TraceProcessorStorageImpl::NotifyEndOfFile() {
   if (unrecoverable_parse_error_ || !context_.chunk_reader)
     return;
-  Flush();
+  if (context_.sorter) {
+    auto scoped_trace = context_.storage->TraceExecutionTimeIntoStats(
+        stats::end_of_file_parse_duration_ns);
+    context_.sorter->ExtractEventsForced();
+  }
+  auto scoped_trace = context_.storage->TraceExecutionTimeIntoStats(
+      stats::finalize_trace_duration_ns);
   context_.chunk_reader->NotifyEndOfFile();
   for (std::unique_ptr<ProtoImporterModule>& module : context_.modules) {
     module->NotifyEndOfFile();
@@ -156,6 +224,11 @@ void TraceProcessorStorageImpl::DestroyContext() {
   // kernel version (inside system_info_tracker) to know how to textualise
   // sched_switch.prev_state bitflags.
   context.system_info_tracker = std::move(context_.system_info_tracker);
+  // The args of the ftrace events which are decoded lazily are added to the
+  // arg sets of the trace when first queried.
+  if (context_.config.lazy_ftrace_args) {
+    context.global_args_tracker = std::move(context_.global_args_tracker);
+  }
 
   context_ = std::move(context);
 }
@@ -61,6 +61,7 @@ class TrackEventModule;
 class ProcessTracker;
 class SliceTracker;
 class SliceTranslationTable;
+class SpillFile;
 class FlowTracker;
 class TraceParser;
 class TraceSorter;
@@ -81,6 +82,10 @@ class TraceProcessorContext {
   std::unique_ptr<TraceStorage> storage;
 
   std::unique_ptr<ChunkedTraceReader> chunk_reader;
+
+  // Backs the events buffered by |sorter| when Config::sorter_spill_dir is
+  // set. Must outlive |sorter|.
+  std::unique_ptr<SpillFile> sorter_spill_file;
   std::unique_ptr<TraceSorter> sorter;
 
   // Keep the global tracker before the args tracker as we access the global
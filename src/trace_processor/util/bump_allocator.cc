@@ -22,6 +22,7 @@
 #include "perfetto/base/compiler.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/utils.h"
+#include "src/trace_processor/util/spill_file.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -39,11 +40,17 @@ base::AlignedUniquePtr<uint8_t[]> Allocate(uint32_t size) {
 
 }  // namespace
 
-BumpAllocator::BumpAllocator() = default;
+BumpAllocator::BumpAllocator(SpillFile* spill_file) : spill_file_(spill_file) {
+  PERFETTO_CHECK(!spill_file_ || spill_file_->slot_size() == kChunkSize);
+}
 
 BumpAllocator::~BumpAllocator() {
   for (const auto& chunk : chunks_) {
     PERFETTO_CHECK(chunk.unfreed_allocations == 0);
+    if (chunk.spilled_allocation) {
+      PERFETTO_ASAN_UNPOISON(chunk.spilled_allocation, kChunkSize);
+      spill_file_->FreeSlot(chunk.spilled_allocation);
+    }
   }
 }
 
@@ -63,7 +70,12 @@ BumpAllocator::AllocId BumpAllocator::Alloc(uint32_t size) {
 
   // Slow path: we don't have enough space in the last chunk so we create one.
   Chunk chunk;
-  chunk.allocation = Allocate(kChunkSize);
+  if (spill_file_) {
+    chunk.spilled_allocation = spill_file_->AllocateSlot();
+    PERFETTO_ASAN_POISON(chunk.spilled_allocation, kChunkSize);
+  } else {
+    chunk.allocation = Allocate(kChunkSize);
+  }
   chunks_.emplace_back(std::move(chunk));
 
   // Ensure that we haven't exceeded the maximum number of chunks.
@@ -87,17 +99,22 @@ void BumpAllocator::Free(AllocId id) {
 void* BumpAllocator::GetPointer(AllocId id) {
   uint64_t queue_index = ChunkIndexToQueueIndex(id.chunk_index);
   PERFETTO_CHECK(queue_index <= std::numeric_limits<size_t>::max());
-  return chunks_.at(static_cast<size_t>(queue_index)).allocation.get() +
-         id.chunk_offset;
+  return chunks_.at(static_cast<size_t>(queue_index)).data() + id.chunk_offset;
 }
 
 uint64_t BumpAllocator::EraseFrontFreeChunks() {
   size_t to_erase_chunks = 0;
   for (; to_erase_chunks < chunks_.size(); ++to_erase_chunks) {
     // Break on the first chunk which still has unfreed allocations.
-    if (chunks_.at(to_erase_chunks).unfreed_allocations > 0) {
+    const Chunk& chunk = chunks_.at(to_erase_chunks);
+    if (chunk.unfreed_allocations > 0) {
       break;
     }
+    if (chunk.spilled_allocation) {
+      PERFETTO_ASAN_UNPOISON(chunk.spilled_allocation, kChunkSize);
+      spill_file_->FreeSlot(chunk.spilled_allocation);
+    }
+    bumped_bytes_ -= chunk.bump_offset;
   }
   chunks_.erase_front(to_erase_chunks);
   erased_front_chunks_count_ += to_erase_chunks;
@@ -127,7 +144,7 @@ std::optional<BumpAllocator::AllocId> BumpAllocator::TryAllocInLastChunk(
   // Verify some invariants:
   // 1) The allocation must exist
   // 2) The bump must be in the bounds of the chunk.
-  PERFETTO_DCHECK(chunk.allocation);
+  PERFETTO_DCHECK(chunk.data());
   PERFETTO_DCHECK(chunk.bump_offset <= kChunkSize);
 
   // If the end of the allocation ends up after this chunk, we cannot service it
@@ -142,9 +159,10 @@ std::optional<BumpAllocator::AllocId> BumpAllocator::TryAllocInLastChunk(
   // unfreed allocation counter.
   chunk.bump_offset = new_bump_offset;
   chunk.unfreed_allocations++;
+  bumped_bytes_ += size;
 
   // Unpoison the allocation range to allow access to it on ASAN builds.
-  PERFETTO_ASAN_UNPOISON(chunk.allocation.get() + alloc_offset, size);
+  PERFETTO_ASAN_UNPOISON(chunk.data() + alloc_offset, size);
 
   return AllocId{LastChunkIndex(), alloc_offset};
 }
@@ -27,10 +27,13 @@
 
 #include "perfetto/ext/base/circular_queue.h"
 #include "perfetto/ext/base/utils.h"
+#include "src/trace_processor/containers/memory_usage.h"
 
 namespace perfetto {
 namespace trace_processor {
 
+class SpillFile;
+
 // A simple memory allocator which "bumps" a pointer to service allocations.
 // See [1] for more details for an overview of bump allocators.
 //
@@ -49,6 +52,10 @@ namespace trace_processor {
 // object. The destructor will CHECK if it detects any allocation which is
 // unfreed.
 //
+// If a SpillFile is passed to the constructor, chunks are allocated from it
+// instead of from the system allocator so that their memory can be written
+// back to disk by the kernel (see SpillFile).
+//
 // [1] https://rust-hosted-langs.github.io/book/chapter-simple-bump.html
 class BumpAllocator {
  public:
@@ -102,7 +109,9 @@ class BumpAllocator {
       kChunkSize == (1 << kChunkOffsetAllocIdBits),
       "Chunk size must match the number of bits used for offset within chunk");
 
-  BumpAllocator();
+  // |spill_file|, if not null, must outlive this object and have slots of
+  // |kChunkSize| bytes.
+  explicit BumpAllocator(SpillFile* spill_file = nullptr);
 
   // Verifies that all calls to |Alloc| were paired with matching calls to
   // |Free|.
@@ -142,6 +151,13 @@ class BumpAllocator {
   // greater than all previously returned AllocIds.
   AllocId PastTheEndId();
 
+  // Returns the memory held by the chunks of this allocator, including the
+  // ones backed by the spill file. Allocations which were freed still count
+  // as used until their chunk is erased.
+  MemoryUsage GetMemoryUsage() const {
+    return MemoryUsage{bumped_bytes_, chunks_.size() * kChunkSize};
+  }
+
   // Returns the number of erased chunks from the start of this allocator.
   //
   // This value may change any time |EraseFrontFreeChunks| is called but is
@@ -157,6 +173,14 @@ class BumpAllocator {
     // base::AlignedUniquePtr ensures this is the case.
     base::AlignedUniquePtr<uint8_t[]> allocation;
 
+    // The slot of |spill_file_| backing this chunk, used instead of
+    // |allocation| when spilling.
+    uint8_t* spilled_allocation = nullptr;
+
+    uint8_t* data() const {
+      return spilled_allocation ? spilled_allocation : allocation.get();
+    }
+
     // The bump offset relative to |allocation.data|. Incremented to service
     // Alloc requests.
     uint32_t bump_offset = 0;
@@ -182,6 +206,9 @@ class BumpAllocator {
 
   base::CircularQueue<Chunk> chunks_;
   uint64_t erased_front_chunks_count_ = 0;
+  // Sum of |bump_offset| over |chunks_|.
+  uint64_t bumped_bytes_ = 0;
+  SpillFile* spill_file_ = nullptr;
 };
 
 }  // namespace trace_processor
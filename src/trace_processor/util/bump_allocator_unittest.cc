@@ -102,6 +102,25 @@ TEST_F(BumpAllocatorUnittest, EraseFrontFreeChunk) {
   allocator_.Free(id);
 }
 
+TEST_F(BumpAllocatorUnittest, MemoryUsage) {
+  BumpAllocator::AllocId a = allocator_.Alloc(8);
+  BumpAllocator::AllocId b = allocator_.Alloc(BumpAllocator::kChunkSize);
+  ASSERT_EQ(allocator_.GetMemoryUsage().used_bytes,
+            8u + BumpAllocator::kChunkSize);
+  ASSERT_EQ(allocator_.GetMemoryUsage().reserved_bytes,
+            2 * BumpAllocator::kChunkSize);
+
+  // Freed allocations are only given back once their chunk is erased.
+  allocator_.Free(a);
+  ASSERT_EQ(allocator_.GetMemoryUsage().used_bytes,
+            8u + BumpAllocator::kChunkSize);
+  allocator_.EraseFrontFreeChunks();
+  ASSERT_EQ(allocator_.GetMemoryUsage().used_bytes, BumpAllocator::kChunkSize);
+  ASSERT_EQ(allocator_.GetMemoryUsage().reserved_bytes,
+            BumpAllocator::kChunkSize);
+  allocator_.Free(b);
+}
+
 TEST_F(BumpAllocatorUnittest, StressTest) {
   std::minstd_rand0 rnd_engine;
   for (int i = 0; i < 1000; i++) {
@@ -91,6 +91,7 @@ util::Status DescriptorPool::AddExtensionField(
     return util::ErrStatus("Extendee does not exist %s", extendee_name.c_str());
   }
   descriptors_[extendee.value()].AddField(field);
+  generation_++;
   return util::OkStatus();
 }
 
@@ -247,6 +248,10 @@ util::Status DescriptorPool::AddFromFileDescriptorSet(
       return status;
   }
 
+  // Fields may have been added to existing messages and their types resolved
+  // below.
+  generation_++;
+
   // Third pass: resolve the types of all the fields to the correct indiices.
   using FieldDescriptorProto = protos::pbzero::FieldDescriptorProto;
   for (auto& descriptor : descriptors_) {
@@ -308,6 +313,7 @@ std::vector<uint8_t> DescriptorPool::SerializeAsDescriptorSet() {
 }
 
 uint32_t DescriptorPool::AddProtoDescriptor(ProtoDescriptor descriptor) {
+  generation_++;
   uint32_t idx = static_cast<uint32_t>(descriptors_.size());
   full_name_to_descriptor_index_[descriptor.full_name()] = idx;
   descriptors_.emplace_back(std::move(descriptor));
@@ -124,6 +124,14 @@ class ProtoDescriptor {
                                             : std::make_optional(it->second);
   }
 
+  // Same as FindEnumString() but without copying the string. Returns nullptr
+  // if |value| is not a known value of the enum.
+  const std::string* FindEnumStringPtr(const int32_t value) const {
+    PERFETTO_DCHECK(type_ == Type::kEnum);
+    auto it = enum_names_by_value_.find(value);
+    return it == enum_names_by_value_.end() ? nullptr : &it->second;
+  }
+
   std::optional<int32_t> FindEnumValue(const std::string& value) const {
     PERFETTO_DCHECK(type_ == Type::kEnum);
     auto it = enum_values_by_name_.find(value);
@@ -181,6 +189,11 @@ class DescriptorPool {
     return descriptors_;
   }
 
+  // Incremented every time descriptors or fields are added to the pool.
+  // Allows users to cache data derived from the descriptors and to detect
+  // when it becomes stale.
+  uint64_t generation() const { return generation_; }
+
  private:
   base::Status AddNestedProtoDescriptors(const std::string& file_name,
                                          const std::string& package_name,
@@ -210,6 +223,7 @@ class DescriptorPool {
   // full_name -> index in the descriptors_ vector.
   std::unordered_map<std::string, uint32_t> full_name_to_descriptor_index_;
   std::set<std::string> processed_files_;
+  uint64_t generation_ = 0;
 };
 
 }  // namespace trace_processor
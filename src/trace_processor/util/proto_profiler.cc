@@ -85,9 +85,14 @@ SizeProfileComputer::SizeProfileComputer(DescriptorPool* pool,
 void SizeProfileComputer::Reset(const uint8_t* ptr, size_t size) {
   state_stack_.clear();
   field_path_.clear();
+  if (pool_generation_ != pool_->generation()) {
+    field_message_idx_.Clear();
+    pool_generation_ = pool_->generation();
+  }
   protozero::ProtoDecoder decoder(ptr, size);
   const ProtoDescriptor* descriptor = &pool_->descriptors()[root_message_idx_];
-  state_stack_.push_back(State{descriptor, std::move(decoder), size, 0});
+  state_stack_.push_back(
+      State{root_message_idx_, descriptor, std::move(decoder), size, 0});
   field_path_.emplace_back(0, nullptr, root_message_idx_, descriptor);
 }
 
@@ -130,7 +135,7 @@ std::optional<size_t> SizeProfileComputer::GetNext() {
         field_descriptor->type() == FieldDescriptorProto::TYPE_MESSAGE;
     if (type == ProtoWireType::kLengthDelimited && is_message_type) {
       auto message_idx =
-          pool_->FindDescriptorIdx(field_descriptor->resolved_type_name());
+          FindFieldMessageIdx(state.message_idx, field.id(), *field_descriptor);
 
       if (!message_idx) {
         PERFETTO_ELOG("Cannot find descriptor for type %s",
@@ -138,12 +143,17 @@ std::optional<size_t> SizeProfileComputer::GetNext() {
         return result;
       }
 
-      protozero::ProtoDecoder decoder(field.data(), field.size());
       const ProtoDescriptor* descriptor = &pool_->descriptors()[*message_idx];
       field_path_.emplace_back(field.id(), field_descriptor, *message_idx,
                                descriptor);
-      state_stack_.push_back(
-          State{descriptor, std::move(decoder), field.size(), 0U});
+      if (max_depth_ && state_stack_.size() >= max_depth_) {
+        // Too deep: the whole message is a leaf.
+        result.emplace(field_size);
+        return result;
+      }
+      protozero::ProtoDecoder decoder(field.data(), field.size());
+      state_stack_.push_back(State{*message_idx, descriptor,
+                                   std::move(decoder), field.size(), 0U});
       return GetNext();
     } else {
       field_path_.emplace_back(field.id(), field_descriptor,
@@ -164,6 +174,19 @@ std::optional<size_t> SizeProfileComputer::GetNext() {
   return result;
 }
 
+std::optional<uint32_t> SizeProfileComputer::FindFieldMessageIdx(
+    uint32_t message_idx,
+    uint32_t field_id,
+    const FieldDescriptor& field_descriptor) {
+  uint64_t key = (static_cast<uint64_t>(message_idx) << 32) | field_id;
+  if (uint32_t* cached = field_message_idx_.Find(key))
+    return *cached;
+  auto idx = pool_->FindDescriptorIdx(field_descriptor.resolved_type_name());
+  if (idx)
+    field_message_idx_.Insert(key, *idx);
+  return idx;
+}
+
 size_t SizeProfileComputer::GetFieldSize(const protozero::Field& f) {
   uint8_t buf[10];
   switch (f.type()) {
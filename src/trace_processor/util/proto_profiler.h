@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <vector>
 
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/hash.h"
 #include "perfetto/protozero/field.h"
 #include "src/trace_processor/util/descriptors.h"
@@ -86,13 +87,31 @@ class SizeProfileComputer {
   // GetNext().
   const FieldPath& GetPath() const { return field_path_; }
 
+  // Sets the maximum number of nested messages (including the root message)
+  // which are decoded. Messages nested deeper are returned as a single sample
+  // of the size of the whole message. Zero (the default) means no limit.
+  void set_max_depth(uint32_t max_depth) { max_depth_ = max_depth; }
+
   operator bool() const;
 
  private:
   size_t GetFieldSize(const protozero::Field& f);
 
+  // Returns the index of the message type of the field |field_id| of the
+  // message |message_idx|, caching the lookup by name in the pool.
+  std::optional<uint32_t> FindFieldMessageIdx(
+      uint32_t message_idx,
+      uint32_t field_id,
+      const FieldDescriptor& field_descriptor);
+
   DescriptorPool* pool_;
   uint32_t root_message_idx_;
+  uint32_t max_depth_ = 0;
+
+  // Maps (message idx << 32 | field id) to the message idx of the field type.
+  // Cleared when the generation of |pool_| changes.
+  base::FlatHashMap<uint64_t, uint32_t> field_message_idx_;
+  uint64_t pool_generation_ = 0;
   // The current 'stack' we're considering as we parse the protobuf.
   // For example if we're currently looking at the varint field baz which is
   // nested inside message Bar which is in turn a field named bar on the message
@@ -104,6 +123,7 @@ class SizeProfileComputer {
 
   // Internal state used to iterate over field path.
   struct State {
+    uint32_t message_idx;
     const ProtoDescriptor* descriptor;
     protozero::ProtoDecoder decoder;
     size_t overhead;
@@ -74,6 +74,41 @@ TEST(ProtoProfiler, TestMessage) {
   EXPECT_THAT(got, UnorderedElementsAreArray(expected));
 }
 
+TEST(ProtoProfiler, MaxDepth) {
+  protozero::HeapBuffered<protozero::test::protos::pbzero::NestedA> message;
+  message->add_repeated_a()->set_value_b()->set_value_c(1);
+  message->add_repeated_a()->set_value_b()->set_value_c(2);
+  message->set_super_nested()->set_value_c(3);
+  const std::vector<uint8_t> bytes = message.SerializeAsArray();
+
+  DescriptorPool pool;
+  pool.AddFromFileDescriptorSet(kTestMessagesDescriptor.data(),
+                                kTestMessagesDescriptor.size());
+  SizeProfileComputer computer(&pool, ".protozero.test.protos.NestedA");
+  computer.set_max_depth(1);
+  computer.Reset(bytes.data(), bytes.size());
+
+  using Item = std::pair<std::vector<std::string>, size_t>;
+  std::vector<Item> got;
+  for (auto sample = computer.GetNext(); sample; sample = computer.GetNext()) {
+    std::vector<std::string> path;
+    for (const auto& field : computer.GetPath()) {
+      if (field.has_field_name())
+        path.push_back(field.field_name());
+      path.push_back(field.type_name());
+    }
+    got.emplace_back(path, *sample);
+  }
+  // The nested messages are not decoded: their whole size is attributed to
+  // their field.
+  std::vector<Item> expected{{{"NestedA"}, 15},
+                             {{"NestedA", "#repeated_a", "NestedB"}, 7},
+                             {{"NestedA", "#repeated_a", "NestedB"}, 7},
+                             {{"NestedA", "#super_nested", "NestedC"}, 2}};
+
+  EXPECT_THAT(got, UnorderedElementsAreArray(expected));
+}
+
 }  // namespace
 }  // namespace util
 }  // namespace trace_processor
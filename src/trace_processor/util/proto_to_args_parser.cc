@@ -18,6 +18,9 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <string>
+
 #include "perfetto/base/status.h"
 #include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
@@ -34,12 +37,21 @@ namespace {
 template <protozero::proto_utils::ProtoWireType wire_type, typename cpp_type>
 using PRFI = protozero::PackedRepeatedFieldIterator<wire_type, cpp_type>;
 
+// Fields with an id below this are looked up in a vector indexed by id when
+// parsing, the others in a hash map.
+constexpr uint32_t kMaxDenseFieldId = 512;
+
 void AppendProtoType(std::string& target, const std::string& value) {
   if (!target.empty())
     target += '.';
   target += value;
 }
 
+std::string LastPathComponent(const std::string& path) {
+  size_t pos = path.rfind('.');
+  return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
 }  // namespace
 
 ProtoToArgsParser::Key::Key() = default;
@@ -77,6 +89,9 @@ void ProtoToArgsParser::ScopedNestedKeyContext::RemoveFieldSuffix() {
 
 ProtoToArgsParser::Delegate::~Delegate() = default;
 
+ProtoToArgsParser::MessagePlan::MessagePlan() = default;
+ProtoToArgsParser::MessagePlan::~MessagePlan() = default;
+
 ProtoToArgsParser::ProtoToArgsParser(const DescriptorPool& pool) : pool_(pool) {
   constexpr int kDefaultSize = 64;
   key_prefix_.key.reserve(kDefaultSize);
@@ -90,43 +105,108 @@ base::Status ProtoToArgsParser::ParseMessage(
     Delegate& delegate,
     int* unknown_extensions) {
   ScopedNestedKeyContext key_context(key_prefix_);
-  return ParseMessageInternal(key_context, cb, type, allowed_fields, delegate,
+  auto idx = pool_.FindDescriptorIdx(type);
+  if (!idx) {
+    if (auto override_result =
+            MaybeApplyOverrideForType(type, key_context, cb, delegate)) {
+      return override_result.value();
+    }
+    return base::Status("Failed to find proto descriptor");
+  }
+  return ParseMessageInternal(key_context, cb, *idx, allowed_fields, delegate,
                               unknown_extensions);
 }
 
+const ProtoToArgsParser::MessagePlan& ProtoToArgsParser::GetOrCreatePlan(
+    uint32_t descriptor_idx) {
+  if (plans_pool_generation_ != pool_.generation()) {
+    plans_.clear();
+    plans_pool_generation_ = pool_.generation();
+  }
+  if (descriptor_idx >= plans_.size())
+    plans_.resize(pool_.descriptors().size());
+  std::unique_ptr<MessagePlan>& plan = plans_[descriptor_idx];
+  if (plan)
+    return *plan;
+
+  plan.reset(new MessagePlan());
+  const ProtoDescriptor& descriptor = pool_.descriptors()[descriptor_idx];
+  auto type_it = type_overrides_.find(descriptor.full_name());
+  if (type_it != type_overrides_.end())
+    plan->type_override = &type_it->second;
+
+  uint32_t max_dense_id = 0;
+  for (const auto& entry : descriptor.fields()) {
+    if (entry.first < kMaxDenseFieldId)
+      max_dense_id = std::max(max_dense_id, entry.first);
+  }
+  plan->dense_fields.resize(descriptor.fields().empty() ? 0
+                                                        : max_dense_id + 1);
+  for (const auto& entry : descriptor.fields()) {
+    FieldPlan field_plan = CreateFieldPlan(entry.second);
+    if (entry.first < kMaxDenseFieldId) {
+      plan->dense_fields[entry.first] = field_plan;
+    } else {
+      plan->sparse_fields[entry.first] = field_plan;
+    }
+  }
+  return *plan;
+}
+
+ProtoToArgsParser::FieldPlan ProtoToArgsParser::CreateFieldPlan(
+    const FieldDescriptor& descriptor) const {
+  using FieldDescriptorProto = protos::pbzero::FieldDescriptorProto;
+  FieldPlan plan;
+  plan.descriptor = &descriptor;
+  if (descriptor.type() == FieldDescriptorProto::TYPE_MESSAGE ||
+      descriptor.type() == FieldDescriptorProto::TYPE_ENUM) {
+    plan.type_idx = pool_.FindDescriptorIdx(descriptor.resolved_type_name());
+  }
+  plan.may_have_field_override =
+      field_override_names_.count(descriptor.name()) > 0;
+  return plan;
+}
+
+int& ProtoToArgsParser::GetRepeatedFieldIndex(RepeatedFieldIndex& index,
+                                              uint32_t id) {
+  for (auto& entry : index) {
+    if (entry.first == id)
+      return entry.second;
+  }
+  index.emplace_back(id, 0);
+  return index.back().second;
+}
+
 base::Status ProtoToArgsParser::ParseMessageInternal(
     ScopedNestedKeyContext& key_context,
     const protozero::ConstBytes& cb,
-    const std::string& type,
+    uint32_t descriptor_idx,
     const std::vector<uint32_t>* allowed_fields,
     Delegate& delegate,
     int* unknown_extensions) {
-  if (auto override_result =
-          MaybeApplyOverrideForType(type, key_context, cb, delegate)) {
-    return override_result.value();
-  }
-
-  auto idx = pool_.FindDescriptorIdx(type);
-  if (!idx) {
-    return base::Status("Failed to find proto descriptor");
+  const MessagePlan& plan = GetOrCreatePlan(descriptor_idx);
+  if (plan.type_override) {
+    if (auto override_result =
+            (*plan.type_override)(key_context, cb, delegate)) {
+      return override_result.value();
+    }
   }
 
-  auto& descriptor = pool_.descriptors()[*idx];
-
-  std::unordered_map<size_t, int> repeated_field_index;
+  RepeatedFieldIndex repeated_field_index;
   bool empty_message = true;
   protozero::ProtoDecoder decoder(cb);
   for (protozero::Field f = decoder.ReadField(); f.valid();
        f = decoder.ReadField()) {
     empty_message = false;
-    auto field = descriptor.FindFieldByTag(f.id());
-    if (!field) {
+    const FieldPlan* field_plan = plan.Find(f.id());
+    if (!field_plan) {
       if (unknown_extensions != nullptr) {
         (*unknown_extensions)++;
       }
       // Unknown field, possibly an unknown extension.
       continue;
     }
+    const FieldDescriptor* field = field_plan->descriptor;
 
     // If allowlist is not provided, reflect all fields. Otherwise, check if the
     // current field either an extension or is in allowlist.
@@ -142,16 +222,20 @@ base::Status ProtoToArgsParser::ParseMessageInternal(
 
     // Packed fields need to be handled specially because
     if (field->is_packed()) {
-      RETURN_IF_ERROR(ParsePackedField(*field, repeated_field_index, f,
+      RETURN_IF_ERROR(ParsePackedField(*field_plan, repeated_field_index, f,
                                        delegate, unknown_extensions));
       continue;
     }
 
-    RETURN_IF_ERROR(ParseField(*field, repeated_field_index[f.id()], f,
-                               delegate, unknown_extensions));
-    if (field->is_repeated()) {
-      repeated_field_index[f.id()]++;
+    if (!field->is_repeated()) {
+      RETURN_IF_ERROR(
+          ParseField(*field_plan, 0, f, delegate, unknown_extensions));
+      continue;
     }
+    int& index = GetRepeatedFieldIndex(repeated_field_index, f.id());
+    RETURN_IF_ERROR(
+        ParseField(*field_plan, index, f, delegate, unknown_extensions));
+    index++;
   }
 
   if (empty_message) {
@@ -161,33 +245,32 @@ base::Status ProtoToArgsParser::ParseMessageInternal(
   return base::OkStatus();
 }
 
-base::Status ProtoToArgsParser::ParseField(
-    const FieldDescriptor& field_descriptor,
-    int repeated_field_number,
-    protozero::Field field,
-    Delegate& delegate,
-    int* unknown_extensions) {
-  std::string prefix_part = field_descriptor.name();
-  if (field_descriptor.is_repeated()) {
-    std::string number = std::to_string(repeated_field_number);
-    prefix_part.reserve(prefix_part.length() + number.length() + 2);
-    prefix_part.append("[");
-    prefix_part.append(number);
-    prefix_part.append("]");
-  }
+base::Status ProtoToArgsParser::ParseField(const FieldPlan& field_plan,
+                                           int repeated_field_number,
+                                           protozero::Field field,
+                                           Delegate& delegate,
+                                           int* unknown_extensions) {
+  const FieldDescriptor& field_descriptor = *field_plan.descriptor;
 
   // In the args table we build up message1.message2.field1 as the column
   // name. This will append the ".field1" suffix to |key_prefix| and then
   // remove it when it goes out of scope.
   ScopedNestedKeyContext key_context(key_prefix_);
   AppendProtoType(key_prefix_.flat_key, field_descriptor.name());
-  AppendProtoType(key_prefix_.key, prefix_part);
+  AppendProtoType(key_prefix_.key, field_descriptor.name());
+  if (field_descriptor.is_repeated()) {
+    key_prefix_.key += '[';
+    key_prefix_.key += std::to_string(repeated_field_number);
+    key_prefix_.key += ']';
+  }
 
   // If we have an override parser then use that instead and move onto the
   // next loop.
-  if (std::optional<base::Status> status =
-          MaybeApplyOverrideForField(field, delegate)) {
-    return *status;
+  if (field_plan.may_have_field_override) {
+    if (std::optional<base::Status> status =
+            MaybeApplyOverrideForField(field, delegate)) {
+      return *status;
+    }
   }
 
   // If this is not a message we can just immediately add the column name and
@@ -195,21 +278,30 @@ base::Status ProtoToArgsParser::ParseField(
   // recurse into it.
   if (field_descriptor.type() ==
       protos::pbzero::FieldDescriptorProto::TYPE_MESSAGE) {
+    if (!field_plan.type_idx) {
+      if (auto override_result = MaybeApplyOverrideForType(
+              field_descriptor.resolved_type_name(), key_context,
+              field.as_bytes(), delegate)) {
+        return override_result.value();
+      }
+      return base::Status("Failed to find proto descriptor");
+    }
     return ParseMessageInternal(key_context, field.as_bytes(),
-                                field_descriptor.resolved_type_name(), nullptr,
-                                delegate, unknown_extensions);
+                                *field_plan.type_idx, nullptr, delegate,
+                                unknown_extensions);
   }
-  return ParseSimpleField(field_descriptor, field, delegate);
+  return ParseSimpleField(field_plan, field, delegate);
 }
 
 base::Status ProtoToArgsParser::ParsePackedField(
-    const FieldDescriptor& field_descriptor,
-    std::unordered_map<size_t, int>& repeated_field_index,
+    const FieldPlan& field_plan,
+    RepeatedFieldIndex& repeated_field_index,
     protozero::Field field,
     Delegate& delegate,
     int* unknown_extensions) {
   using FieldDescriptorProto = protos::pbzero::FieldDescriptorProto;
   using PWT = protozero::proto_utils::ProtoWireType;
+  const FieldDescriptor& field_descriptor = *field_plan.descriptor;
 
   if (!field_descriptor.is_repeated()) {
     return base::ErrStatus("Packed field %s must be repeated",
@@ -221,11 +313,11 @@ base::Status ProtoToArgsParser::ParsePackedField(
         field_descriptor.name().c_str());
   }
 
+  int& index = GetRepeatedFieldIndex(repeated_field_index, field.id());
   auto parse = [&](uint64_t new_value, PWT wire_type) {
     protozero::Field f;
     f.initialize(field.id(), static_cast<uint8_t>(wire_type), new_value, 0);
-    return ParseField(field_descriptor, repeated_field_index[field.id()]++, f,
-                      delegate, unknown_extensions);
+    return ParseField(field_plan, index++, f, delegate, unknown_extensions);
   };
 
   const uint8_t* data = field.as_bytes().data;
@@ -265,11 +357,14 @@ void ProtoToArgsParser::AddParsingOverrideForField(
     const std::string& field,
     ParsingOverrideForField func) {
   field_overrides_[field] = std::move(func);
+  field_override_names_.insert(LastPathComponent(field));
+  plans_.clear();
 }
 
 void ProtoToArgsParser::AddParsingOverrideForType(const std::string& type,
                                                   ParsingOverrideForType func) {
   type_overrides_[type] = std::move(func);
+  plans_.clear();
 }
 
 std::optional<base::Status> ProtoToArgsParser::MaybeApplyOverrideForField(
@@ -292,11 +387,11 @@ std::optional<base::Status> ProtoToArgsParser::MaybeApplyOverrideForType(
   return it->second(key, data, delegate);
 }
 
-base::Status ProtoToArgsParser::ParseSimpleField(
-    const FieldDescriptor& descriptor,
-    const protozero::Field& field,
-    Delegate& delegate) {
+base::Status ProtoToArgsParser::ParseSimpleField(const FieldPlan& field_plan,
+                                                 const protozero::Field& field,
+                                                 Delegate& delegate) {
   using FieldDescriptorProto = protos::pbzero::FieldDescriptorProto;
+  const FieldDescriptor& descriptor = *field_plan.descriptor;
   switch (descriptor.type()) {
     case FieldDescriptorProto::TYPE_INT32:
     case FieldDescriptorProto::TYPE_SFIXED32:
@@ -336,23 +431,21 @@ base::Status ProtoToArgsParser::ParseSimpleField(
       delegate.AddString(key_prefix_, field.as_string());
       return base::OkStatus();
     case FieldDescriptorProto::TYPE_ENUM: {
-      auto opt_enum_descriptor_idx =
-          pool_.FindDescriptorIdx(descriptor.resolved_type_name());
-      if (!opt_enum_descriptor_idx) {
+      if (!field_plan.type_idx) {
         delegate.AddInteger(key_prefix_, field.as_int32());
         return base::OkStatus();
       }
-      auto opt_enum_string =
-          pool_.descriptors()[*opt_enum_descriptor_idx].FindEnumString(
+      const std::string* enum_string =
+          pool_.descriptors()[*field_plan.type_idx].FindEnumStringPtr(
               field.as_int32());
-      if (!opt_enum_string) {
+      if (!enum_string) {
         // Fall back to the integer representation of the field.
         delegate.AddInteger(key_prefix_, field.as_int32());
         return base::OkStatus();
       }
-      delegate.AddString(key_prefix_,
-                         protozero::ConstChars{opt_enum_string->data(),
-                                               opt_enum_string->size()});
+      delegate.AddString(
+          key_prefix_,
+          protozero::ConstChars{enum_string->data(), enum_string->size()});
       return base::OkStatus();
     }
     default:
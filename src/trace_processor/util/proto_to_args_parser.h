@@ -18,8 +18,16 @@
 #define SRC_TRACE_PROCESSOR_UTIL_PROTO_TO_ARGS_PARSER_H_
 
 #include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "perfetto/base/status.h"
+#include "perfetto/ext/base/small_vector.h"
 #include "perfetto/protozero/field.h"
 #include "protos/perfetto/trace/interned_data/interned_data.pbzero.h"
 #include "src/trace_processor/util/descriptors.h"
@@ -245,18 +253,66 @@ class ProtoToArgsParser {
                                  ParsingOverrideForType parsing_override);
 
  private:
-  base::Status ParseField(const FieldDescriptor& field_descriptor,
+  // Everything ParseMessage needs to know about a field which can be derived
+  // from the descriptors alone, so that it's computed once per field rather
+  // than once per parsed value.
+  struct FieldPlan {
+    const FieldDescriptor* descriptor = nullptr;
+    // For message and enum fields: the index of the descriptor of the field's
+    // type in the pool, if known.
+    std::optional<uint32_t> type_idx;
+    // Whether an override might have been registered for this field. Only
+    // fields whose name is the last component of one of the override paths
+    // need to look up the full key in |field_overrides_|.
+    bool may_have_field_override = false;
+  };
+
+  // Parse plan of a message type, built lazily the first time a message of
+  // this type is parsed.
+  struct MessagePlan {
+    MessagePlan();
+    ~MessagePlan();
+
+    // Plans of the fields with small ids, indexed by field id. Fields with
+    // larger ids (e.g. extensions) are stored in |sparse_fields|.
+    std::vector<FieldPlan> dense_fields;
+    std::unordered_map<uint32_t, FieldPlan> sparse_fields;
+    const ParsingOverrideForType* type_override = nullptr;
+
+    const FieldPlan* Find(uint32_t id) const {
+      if (id < dense_fields.size()) {
+        const FieldPlan& plan = dense_fields[id];
+        return plan.descriptor ? &plan : nullptr;
+      }
+      auto it = sparse_fields.find(id);
+      return it == sparse_fields.end() ? nullptr : &it->second;
+    }
+  };
+
+  // Number of entries of the repeated fields seen so far in a message, as
+  // (field id, count) pairs. Messages rarely have more than a few repeated
+  // fields so a linear scan is cheaper than a hash map.
+  using RepeatedFieldIndex = base::SmallVector<std::pair<uint32_t, int>, 8>;
+
+  static int& GetRepeatedFieldIndex(RepeatedFieldIndex& index, uint32_t id);
+
+  // Returns the plan for the message at |descriptor_idx| in the pool, building
+  // it if necessary. The pool must not be modified while a message is being
+  // parsed.
+  const MessagePlan& GetOrCreatePlan(uint32_t descriptor_idx);
+  FieldPlan CreateFieldPlan(const FieldDescriptor& descriptor) const;
+
+  base::Status ParseField(const FieldPlan& field_plan,
                           int repeated_field_number,
                           protozero::Field field,
                           Delegate& delegate,
                           int* unknown_extensions);
 
-  base::Status ParsePackedField(
-      const FieldDescriptor& field_descriptor,
-      std::unordered_map<size_t, int>& repeated_field_index,
-      protozero::Field field,
-      Delegate& delegate,
-      int* unknown_extensions);
+  base::Status ParsePackedField(const FieldPlan& field_plan,
+                                RepeatedFieldIndex& repeated_field_index,
+                                protozero::Field field,
+                                Delegate& delegate,
+                                int* unknown_extensions);
 
   std::optional<base::Status> MaybeApplyOverrideForField(
       const protozero::Field&,
@@ -272,19 +328,26 @@ class ProtoToArgsParser {
   // the overriden field's name from the parsed args' keys.
   base::Status ParseMessageInternal(ScopedNestedKeyContext& key,
                                     const protozero::ConstBytes& cb,
-                                    const std::string& type,
+                                    uint32_t descriptor_idx,
                                     const std::vector<uint32_t>* fields,
                                     Delegate& delegate,
                                     int* unknown_extensions);
 
-  base::Status ParseSimpleField(const FieldDescriptor& desciptor,
+  base::Status ParseSimpleField(const FieldPlan& field_plan,
                                 const protozero::Field& field,
                                 Delegate& delegate);
 
   std::unordered_map<std::string, ParsingOverrideForField> field_overrides_;
+  // Last component of the paths in |field_overrides_|.
+  std::unordered_set<std::string> field_override_names_;
   std::unordered_map<std::string, ParsingOverrideForType> type_overrides_;
   const DescriptorPool& pool_;
   Key key_prefix_;
+
+  // Indexed by descriptor index in |pool_|. Plans are dropped when the pool or
+  // the overrides change.
+  std::vector<std::unique_ptr<MessagePlan>> plans_;
+  uint64_t plans_pool_generation_ = 0;
 };
 
 }  // namespace util
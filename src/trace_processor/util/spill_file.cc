@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/util/spill_file.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/utils.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define PERFETTO_SPILL_FILE_SUPPORTED 1
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+
+#if defined(PERFETTO_SPILL_FILE_SUPPORTED)
+
+// static
+base::StatusOr<std::unique_ptr<SpillFile>> SpillFile::Create(
+    const std::string& dir,
+    size_t slot_size) {
+  PERFETTO_CHECK(slot_size > 0 && slot_size % base::GetSysPageSize() == 0);
+  std::string path = dir + "/trace_processor_spill_XXXXXX";
+  base::ScopedFile fd(mkstemp(&path[0]));
+  if (!fd) {
+    return base::ErrStatus("Failed to create a spill file in %s: %s",
+                           dir.c_str(), strerror(errno));
+  }
+  // The file is only reachable through |fd| so that it's deleted however the
+  // process exits.
+  unlink(path.c_str());
+  return std::unique_ptr<SpillFile>(new SpillFile(std::move(fd), slot_size));
+}
+
+SpillFile::SpillFile(base::ScopedFile fd, size_t slot_size)
+    : fd_(std::move(fd)), slot_size_(slot_size) {}
+
+SpillFile::~SpillFile() {
+  PERFETTO_CHECK(allocated_slots_ == 0);
+  for (uint8_t* segment : segments_)
+    munmap(segment, kSlotsPerSegment * slot_size_);
+}
+
+uint8_t* SpillFile::AllocateSlot() {
+  if (free_slots_.empty())
+    AddSegment();
+  uint8_t* slot = free_slots_.back();
+  free_slots_.pop_back();
+
+  // Reserve the disk space now: writing to a hole of the mapping when the disk
+  // is full would otherwise kill the process with a SIGBUS.
+  off_t offset = static_cast<off_t>(SlotToFileOffset(slot));
+  if (PERFETTO_EINTR(fallocate(*fd_, 0, offset,
+                               static_cast<off_t>(slot_size_))) != 0) {
+    PERFETTO_FATAL("Failed to reserve %zu bytes in the spill file: %s",
+                   slot_size_, strerror(errno));
+  }
+  allocated_slots_++;
+  return slot;
+}
+
+void SpillFile::FreeSlot(uint8_t* slot) {
+  PERFETTO_DCHECK(allocated_slots_ > 0);
+  // Drops both the pages in memory and the blocks on disk. The slot reads as
+  // zeros afterwards, like a freshly allocated one.
+  if (madvise(slot, slot_size_, MADV_REMOVE) != 0)
+    PERFETTO_PLOG("Failed to free a spill file slot");
+  free_slots_.push_back(slot);
+  allocated_slots_--;
+}
+
+void SpillFile::AddSegment() {
+  size_t segment_size = kSlotsPerSegment * slot_size_;
+  off_t file_size = static_cast<off_t>((segments_.size() + 1) * segment_size);
+  // The file is sparse: growing it doesn't take any disk space.
+  if (ftruncate(*fd_, file_size) != 0)
+    PERFETTO_FATAL("Failed to grow the spill file: %s", strerror(errno));
+  void* segment =
+      mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd_,
+           static_cast<off_t>(segments_.size() * segment_size));
+  if (segment == MAP_FAILED)
+    PERFETTO_FATAL("Failed to map the spill file: %s", strerror(errno));
+  segments_.push_back(static_cast<uint8_t*>(segment));
+
+  // Pushed in reverse so that slots are allocated in address order.
+  for (size_t i = kSlotsPerSegment; i > 0; --i)
+    free_slots_.push_back(segments_.back() + (i - 1) * slot_size_);
+}
+
+uint64_t SpillFile::SlotToFileOffset(const uint8_t* slot) const {
+  size_t segment_size = kSlotsPerSegment * slot_size_;
+  for (size_t i = 0; i < segments_.size(); ++i) {
+    if (slot >= segments_[i] && slot < segments_[i] + segment_size)
+      return i * segment_size + static_cast<size_t>(slot - segments_[i]);
+  }
+  PERFETTO_FATAL("Slot not in the spill file");
+}
+
+#else  // defined(PERFETTO_SPILL_FILE_SUPPORTED)
+
+// static
+base::StatusOr<std::unique_ptr<SpillFile>> SpillFile::Create(
+    const std::string&,
+    size_t) {
+  return base::ErrStatus("Spill files are not supported on this platform");
+}
+
+SpillFile::SpillFile(base::ScopedFile fd, size_t slot_size)
+    : fd_(std::move(fd)), slot_size_(slot_size) {}
+
+SpillFile::~SpillFile() = default;
+
+uint8_t* SpillFile::AllocateSlot() {
+  PERFETTO_FATAL("Spill files are not supported on this platform");
+}
+
+void SpillFile::FreeSlot(uint8_t*) {
+  PERFETTO_FATAL("Spill files are not supported on this platform");
+}
+
+void SpillFile::AddSegment() {}
+
+uint64_t SpillFile::SlotToFileOffset(const uint8_t*) const {
+  return 0;
+}
+
+#endif  // defined(PERFETTO_SPILL_FILE_SUPPORTED)
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_UTIL_SPILL_FILE_H_
+#define SRC_TRACE_PROCESSOR_UTIL_SPILL_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/status.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/status_or.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Hands out fixed size slots of memory which are backed by an unlinked file on
+// disk rather than by anonymous memory.
+//
+// The slots are shared file mappings: the kernel is free to write their pages
+// back to the file and to drop them from memory when it's under pressure, and
+// reads them back when they are accessed again. This allows to buffer much
+// more data than fits in RAM, at the cost of disk I/O.
+//
+// Disk space is reserved when a slot is allocated, so running out of disk
+// space is reported there instead of as a SIGBUS on the first write. Freed
+// slots are punched out of the file, which drops both their pages and their
+// disk space, and are reused by later allocations.
+//
+// Only supported on Linux and Android. Not thread safe.
+class SpillFile {
+ public:
+  // Creates a spill file in |dir| whose slots are |slot_size| bytes.
+  // |slot_size| must be a multiple of the page size.
+  static base::StatusOr<std::unique_ptr<SpillFile>> Create(
+      const std::string& dir,
+      size_t slot_size);
+
+  ~SpillFile();
+
+  // Returns a page aligned, zero filled, slot of |slot_size()| bytes.
+  uint8_t* AllocateSlot();
+
+  // Gives back a slot previously returned by AllocateSlot().
+  void FreeSlot(uint8_t* slot);
+
+  size_t slot_size() const { return slot_size_; }
+
+  // Number of slots currently allocated.
+  size_t allocated_slots() const { return allocated_slots_; }
+
+ private:
+  // The file is mapped in segments of this many slots, so that the number of
+  // mappings stays small however much data is spilled.
+  static constexpr size_t kSlotsPerSegment = 4096;
+
+  SpillFile(base::ScopedFile fd, size_t slot_size);
+
+  void AddSegment();
+  uint64_t SlotToFileOffset(const uint8_t* slot) const;
+
+  base::ScopedFile fd_;
+  const size_t slot_size_;
+  size_t allocated_slots_ = 0;
+
+  // Base addresses of the segments. Segment i maps the file at offset
+  // i * kSlotsPerSegment * slot_size_.
+  std::vector<uint8_t*> segments_;
+
+  // Slots which are not allocated, the next one to be allocated is at the
+  // back.
+  std::vector<uint8_t*> free_slots_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_UTIL_SPILL_FILE_H_
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/util/spill_file.h"
+
+#include <string.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "src/trace_processor/util/bump_allocator.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+
+TEST(SpillFileTest, AllocateAndFree) {
+  base::TempDir dir = base::TempDir::Create();
+  auto spill_file = SpillFile::Create(dir.path(), BumpAllocator::kChunkSize);
+  ASSERT_TRUE(spill_file.ok());
+  SpillFile* file = spill_file->get();
+
+  uint8_t* a = file->AllocateSlot();
+  uint8_t* b = file->AllocateSlot();
+  ASSERT_NE(a, b);
+  EXPECT_EQ(file->allocated_slots(), 2u);
+
+  memset(a, 'a', file->slot_size());
+  memset(b, 'b', file->slot_size());
+  EXPECT_EQ(a[file->slot_size() - 1], 'a');
+  EXPECT_EQ(b[0], 'b');
+
+  // Freed slots are reused and read as zeros.
+  file->FreeSlot(b);
+  EXPECT_EQ(file->allocated_slots(), 1u);
+  uint8_t* c = file->AllocateSlot();
+  EXPECT_EQ(c, b);
+  EXPECT_EQ(c[0], 0);
+  EXPECT_EQ(a[0], 'a');
+
+  file->FreeSlot(a);
+  file->FreeSlot(c);
+  EXPECT_EQ(file->allocated_slots(), 0u);
+}
+
+TEST(SpillFileTest, BumpAllocatorChunks) {
+  base::TempDir dir = base::TempDir::Create();
+  auto spill_file = SpillFile::Create(dir.path(), BumpAllocator::kChunkSize);
+  ASSERT_TRUE(spill_file.ok());
+  SpillFile* file = spill_file->get();
+  {
+    BumpAllocator allocator(file);
+    BumpAllocator::AllocId first = allocator.Alloc(BumpAllocator::kChunkSize);
+    BumpAllocator::AllocId second = allocator.Alloc(8);
+    EXPECT_EQ(file->allocated_slots(), 2u);
+
+    memset(allocator.GetPointer(second), 'x', 8);
+    EXPECT_EQ(*static_cast<uint8_t*>(allocator.GetPointer(second)), 'x');
+
+    allocator.Free(first);
+    EXPECT_EQ(allocator.EraseFrontFreeChunks(), 1u);
+    EXPECT_EQ(file->allocated_slots(), 1u);
+    allocator.Free(second);
+  }
+  EXPECT_EQ(file->allocated_slots(), 0u);
+}
+
+TEST(SpillFileTest, InvalidDir) {
+  auto spill_file =
+      SpillFile::Create("/non-existent-dir", BumpAllocator::kChunkSize);
+  EXPECT_FALSE(spill_file.ok());
+}
+
+#endif
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/util/streaming_line_reader.h"
 
+#include <cstring>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/utils.h"
 
@@ -51,19 +53,20 @@ void StreamingLineReader::EndWrite(size_t size_written) {
 size_t StreamingLineReader::Tokenize(base::StringView input) {
   size_t chars_consumed = 0;
   const char* line_start = input.data();
-  std::vector<base::StringView> lines;
-  lines.reserve(1000);  // An educated guess to avoid silly expansions.
-  for (const char* c = input.data(); c < input.end(); ++c) {
-    if (*c != '\n')
-      continue;
-    lines.emplace_back(line_start, static_cast<size_t>(c - line_start));
-    line_start = c + 1;
-    chars_consumed = static_cast<size_t>(c + 1 - input.data());
-  }  // for(c : input)
+  lines_.clear();
+  while (line_start < input.end()) {
+    const char* line_end = static_cast<const char*>(memchr(
+        line_start, '\n', static_cast<size_t>(input.end() - line_start)));
+    if (!line_end)
+      break;
+    lines_.emplace_back(line_start, static_cast<size_t>(line_end - line_start));
+    line_start = line_end + 1;
+    chars_consumed = static_cast<size_t>(line_start - input.data());
+  }
 
-  PERFETTO_DCHECK(lines.empty() ^ (chars_consumed != 0));
-  if (!lines.empty())
-    lines_callback_(lines);
+  PERFETTO_DCHECK(lines_.empty() ^ (chars_consumed != 0));
+  if (!lines_.empty())
+    lines_callback_(lines_);
   return chars_consumed;
 }
 
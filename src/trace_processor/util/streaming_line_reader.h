@@ -81,6 +81,8 @@ class StreamingLineReader {
 
  private:
   std::vector<char> buf_;
+  // Reused across Tokenize() calls to avoid reallocating it every time.
+  std::vector<base::StringView> lines_;
   LinesCallback lines_callback_;
   size_t size_before_write_ = 0;
 };
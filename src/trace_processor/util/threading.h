@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_UTIL_THREADING_H_
+#define SRC_TRACE_PROCESSOR_UTIL_THREADING_H_
+
+#include "perfetto/base/build_config.h"
+
+// Whether trace processor can create thread pools. This is the case everywhere
+// but in the default WASM build: only the WASM build compiled with -pthread
+// (see trace_processor_threads_wasm in src/trace_processor/BUILD.gn) can start
+// threads.
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM) || defined(__EMSCRIPTEN_PTHREADS__)
+#define PERFETTO_TP_HAS_THREADS() 1
+#else
+#define PERFETTO_TP_HAS_THREADS() 0
+#endif
+
+#endif  // SRC_TRACE_PROCESSOR_UTIL_THREADING_H_
@@ -24,13 +24,14 @@
 
 #include <algorithm>
 #include <cinttypes>
-#include <map>
+#include <functional>
+#include <memory>
 #include <set>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "perfetto/base/logging.h"
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/utils.h"
@@ -143,22 +144,13 @@ namespace {
 
 using ::perfetto::trace_processor::Iterator;
 
+using ProfileCallback = std::function<void(SerializedProfile)>;
+
 uint64_t ToPprofId(int64_t id) {
   PERFETTO_DCHECK(id >= 0);
   return static_cast<uint64_t>(id) + 1;
 }
 
-std::string AsCsvString(std::vector<uint64_t> vals) {
-  std::string ret;
-  for (size_t i = 0; i < vals.size(); i++) {
-    if (i != 0) {
-      ret += ",";
-    }
-    ret += std::to_string(vals[i]);
-  }
-  return ret;
-}
-
 std::optional<int64_t> GetStatsEntry(
     trace_processor::TraceProcessor* tp,
     const std::string& name,
@@ -192,57 +184,66 @@ std::optional<int64_t> GetStatsEntry(
 class LocationTracker {
  public:
   int64_t InternLocation(Location loc) {
-    auto it = locations_.find(loc);
-    if (it == locations_.end()) {
-      bool inserted = false;
-      std::tie(it, inserted) = locations_.emplace(
-          std::move(loc), static_cast<int64_t>(locations_.size()));
-      PERFETTO_DCHECK(inserted);
-    }
-    return it->second;
+    auto it_and_inserted = location_ids_.Insert(
+        loc, static_cast<int64_t>(locations_.size()));
+    if (it_and_inserted.second)
+      locations_.emplace_back(std::move(loc));
+    return *it_and_inserted.first;
   }
 
   int64_t InternFunction(Function func) {
-    auto it = functions_.find(func);
-    if (it == functions_.end()) {
-      bool inserted = false;
-      std::tie(it, inserted) =
-          functions_.emplace(func, static_cast<int64_t>(functions_.size()));
-      PERFETTO_DCHECK(inserted);
-    }
-    return it->second;
+    auto it_and_inserted = function_ids_.Insert(
+        func, static_cast<int64_t>(functions_.size()));
+    if (it_and_inserted.second)
+      functions_.emplace_back(func);
+    return *it_and_inserted.first;
+  }
+
+  // Drops the lookup tables that are only needed while interning. The
+  // interned entities stay accessible by id.
+  void FinishInterning() {
+    location_ids_ = decltype(location_ids_)();
+    function_ids_ = decltype(function_ids_)();
   }
 
   bool IsCallsiteProcessed(int64_t callstack_id) const {
-    return callsite_to_locations_.find(callstack_id) !=
-           callsite_to_locations_.end();
+    return callsite_to_locations_.Find(callstack_id) != nullptr;
   }
 
   void MaybeSetCallsiteLocations(int64_t callstack_id,
                                  const std::vector<int64_t>& locs) {
     // nop if already set
-    callsite_to_locations_.emplace(callstack_id, locs);
+    callsite_to_locations_.Insert(callstack_id, locs);
   }
 
   const std::vector<int64_t>& LocationsForCallstack(
       int64_t callstack_id) const {
-    auto it = callsite_to_locations_.find(callstack_id);
-    PERFETTO_CHECK(callstack_id >= 0 && it != callsite_to_locations_.end());
-    return it->second;
+    const std::vector<int64_t>* locs =
+        callsite_to_locations_.Find(callstack_id);
+    PERFETTO_CHECK(callstack_id >= 0 && locs);
+    return *locs;
   }
 
-  const std::unordered_map<Location, int64_t>& AllLocations() const {
-    return locations_;
+  const Location& GetLocation(int64_t id) const {
+    return locations_[static_cast<size_t>(id)];
   }
-  const std::unordered_map<Function, int64_t>& AllFunctions() const {
-    return functions_;
+  const Function& GetFunction(int64_t id) const {
+    return functions_[static_cast<size_t>(id)];
   }
+  size_t num_locations() const { return locations_.size(); }
+  size_t num_functions() const { return functions_.size(); }
 
  private:
   // Root-first location ids for a given callsite id.
-  std::unordered_map<int64_t, std::vector<int64_t>> callsite_to_locations_;
-  std::unordered_map<Location, int64_t> locations_;
-  std::unordered_map<Function, int64_t> functions_;
+  base::FlatHashMap<int64_t, std::vector<int64_t>> callsite_to_locations_;
+
+  // Interned entities, indexed by their id.
+  std::vector<Location> locations_;
+  std::vector<Function> functions_;
+
+  // Entity to id lookups, only populated until FinishInterning().
+  base::FlatHashMap<Location, int64_t, std::hash<Location>> location_ids_;
+  base::FlatHashMap<Function, int64_t, std::hash<Function>> function_ids_;
 };
 
 struct PreprocessedInline {
@@ -255,10 +256,13 @@ struct PreprocessedInline {
       : name_id(s), filename_id(f), line_no(line) {}
 };
 
-std::unordered_map<int64_t, std::vector<PreprocessedInline>>
-PreprocessInliningInfo(trace_processor::TraceProcessor* tp,
-                       trace_processor::StringPool* interner) {
-  std::unordered_map<int64_t, std::vector<PreprocessedInline>> inlines;
+// Keyed by symbol_set_id.
+using InliningInfo =
+    base::FlatHashMap<int64_t, std::vector<PreprocessedInline>>;
+
+InliningInfo PreprocessInliningInfo(trace_processor::TraceProcessor* tp,
+                                    trace_processor::StringPool* interner) {
+  InliningInfo inlines;
 
   // Most-inlined function (leaf) has the lowest id within a symbol set. Query
   // such that the per-set line vectors are built up leaf-first.
@@ -279,7 +283,7 @@ PreprocessInliningInfo(trace_processor::TraceProcessor* tp,
   if (!it.Status().ok()) {
     PERFETTO_DFATAL_OR_ELOG("Invalid iterator: %s",
                             it.Status().message().c_str());
-    return {};
+    return InliningInfo();
   }
   return inlines;
 }
@@ -307,8 +311,7 @@ LocationTracker PreprocessLocations(trace_processor::TraceProcessor* tp,
 
   // Keyed by symbol_set_id, discarded once this function converts the inlines
   // into Line and Function entries.
-  std::unordered_map<int64_t, std::vector<PreprocessedInline>> inlining_info =
-      PreprocessInliningInfo(tp, interner);
+  InliningInfo inlining_info = PreprocessInliningInfo(tp, interner);
 
   // Higher callsite ids most likely correspond to the deepest stacks, so we'll
   // fill more of the overall callsite->location map by visiting the callsited
@@ -361,13 +364,14 @@ LocationTracker PreprocessLocations(trace_processor::TraceProcessor* tp,
 
       // Inlining information available
       if (symbol_set_id.has_value()) {
-        auto it = inlining_info.find(*symbol_set_id);
-        if (it == inlining_info.end()) {
+        const std::vector<PreprocessedInline>* inlines =
+            inlining_info.Find(*symbol_set_id);
+        if (!inlines) {
           PERFETTO_DFATAL_OR_ELOG(
               "Failed to find stack_profile_symbol entry for symbol_set_id "
               "%" PRIi64 "",
               *symbol_set_id);
-          return {};
+          return LocationTracker();
         }
 
         // N inlined functions
@@ -376,7 +380,7 @@ LocationTracker PreprocessLocations(trace_processor::TraceProcessor* tp,
         // each deinlined frame. Set the human-readable name for both fields. We
         // can change this, but there's no demand for accurate system names in
         // pprofs.
-        for (const auto& line : it->second) {
+        for (const auto& line : *inlines) {
           int64_t func_id = intern_function(line.name_id, line.name_id,
                                             line.filename_id, annotation);
 
@@ -402,16 +406,17 @@ LocationTracker PreprocessLocations(trace_processor::TraceProcessor* tp,
     if (!c_it.Status().ok()) {
       PERFETTO_DFATAL_OR_ELOG("Invalid iterator: %s",
                               c_it.Status().message().c_str());
-      return {};
+      return LocationTracker();
     }
   }
 
   if (!cid_it.Status().ok()) {
     PERFETTO_DFATAL_OR_ELOG("Invalid iterator: %s",
                             cid_it.Status().message().c_str());
-    return {};
+    return LocationTracker();
   }
 
+  tracker.FinishInterning();
   return tracker;
 }
 
@@ -420,7 +425,10 @@ class GProfileBuilder {
  public:
   GProfileBuilder(const LocationTracker& locations,
                   trace_processor::StringPool* interner)
-      : locations_(locations), interner_(interner) {
+      : locations_(locations),
+        interner_(interner),
+        location_seen_(locations.num_locations()),
+        function_seen_(locations.num_functions()) {
     // The pprof format requires the first entry in the string table to be the
     // empty string.
     int64_t empty_id = ToStringTableId(StringId::Null());
@@ -457,18 +465,20 @@ class GProfileBuilder {
     gsample->set_location_id(packed_locs);
 
     // Remember the locations s.t. we only serialize the referenced ones.
-    seen_locations_.insert(location_ids.cbegin(), location_ids.cend());
+    for (int64_t id : location_ids) {
+      if (!location_seen_[static_cast<size_t>(id)]) {
+        location_seen_[static_cast<size_t>(id)] = true;
+        seen_locations_.push_back(id);
+      }
+    }
     return true;
   }
 
   std::string CompleteProfile(trace_processor::TraceProcessor* tp) {
     std::set<int64_t> seen_mappings;
-    std::set<int64_t> seen_functions;
 
-    if (!WriteLocations(&seen_mappings, &seen_functions))
-      return {};
-    if (!WriteFunctions(seen_functions))
-      return {};
+    WriteLocations(&seen_mappings);
+    WriteFunctions();
     if (!WriteMappings(tp, seen_mappings))
       return {};
 
@@ -478,20 +488,9 @@ class GProfileBuilder {
 
  private:
   // Serializes the Profile.Location entries referenced by this profile.
-  bool WriteLocations(std::set<int64_t>* seen_mappings,
-                      std::set<int64_t>* seen_functions) {
-    const std::unordered_map<Location, int64_t>& locations =
-        locations_.AllLocations();
-
-    size_t written_locations = 0;
-    for (const auto& loc_and_id : locations) {
-      const auto& loc = loc_and_id.first;
-      int64_t id = loc_and_id.second;
-
-      if (seen_locations_.find(id) == seen_locations_.end())
-        continue;
-
-      written_locations += 1;
+  void WriteLocations(std::set<int64_t>* seen_mappings) {
+    for (int64_t id : seen_locations_) {
+      const Location& loc = locations_.GetLocation(id);
       seen_mappings->emplace(loc.mapping_id);
 
       auto* glocation = result_->add_location();
@@ -500,44 +499,32 @@ class GProfileBuilder {
 
       if (!loc.inlined_functions.empty()) {
         for (const auto& line : loc.inlined_functions) {
-          seen_functions->insert(line.function_id);
+          MarkFunctionSeen(line.function_id);
 
           auto* gline = glocation->add_line();
           gline->set_function_id(ToPprofId(line.function_id));
           gline->set_line(line.line_no);
         }
       } else {
-        seen_functions->insert(loc.single_function_id);
+        MarkFunctionSeen(loc.single_function_id);
 
         glocation->add_line()->set_function_id(
             ToPprofId(loc.single_function_id));
       }
     }
+  }
 
-    if (written_locations != seen_locations_.size()) {
-      PERFETTO_DFATAL_OR_ELOG(
-          "Found only %zu/%zu locations during serialization.",
-          written_locations, seen_locations_.size());
-      return false;
+  void MarkFunctionSeen(int64_t id) {
+    if (!function_seen_[static_cast<size_t>(id)]) {
+      function_seen_[static_cast<size_t>(id)] = true;
+      seen_functions_.push_back(id);
     }
-    return true;
   }
 
   // Serializes the Profile.Function entries referenced by this profile.
-  bool WriteFunctions(const std::set<int64_t>& seen_functions) {
-    const std::unordered_map<Function, int64_t>& functions =
-        locations_.AllFunctions();
-
-    size_t written_functions = 0;
-    for (const auto& func_and_id : functions) {
-      const auto& func = func_and_id.first;
-      int64_t id = func_and_id.second;
-
-      if (seen_functions.find(id) == seen_functions.end())
-        continue;
-
-      written_functions += 1;
-
+  void WriteFunctions() {
+    for (int64_t id : seen_functions_) {
+      const Function& func = locations_.GetFunction(id);
       auto* gfunction = result_->add_function();
       gfunction->set_id(ToPprofId(id));
       gfunction->set_name(ToStringTableId(func.name_id));
@@ -545,14 +532,6 @@ class GProfileBuilder {
       if (!func.filename_id.is_null())
         gfunction->set_filename(ToStringTableId(func.filename_id));
     }
-
-    if (written_functions != seen_functions.size()) {
-      PERFETTO_DFATAL_OR_ELOG(
-          "Found only %zu/%zu functions during serialization.",
-          written_functions, seen_functions.size());
-      return false;
-    }
-    return true;
   }
 
   // Serializes the Profile.Mapping entries referenced by this profile.
@@ -601,16 +580,11 @@ class GProfileBuilder {
   }
 
   int64_t ToStringTableId(StringId interned_id) {
-    auto it = interning_remapper_.find(interned_id);
-    if (it == interning_remapper_.end()) {
-      int64_t table_id = static_cast<int64_t>(string_table_.size());
+    auto it_and_inserted = interning_remapper_.Insert(
+        interned_id, static_cast<int64_t>(string_table_.size()));
+    if (it_and_inserted.second)
       string_table_.push_back(interned_id);
-      bool inserted = false;
-      std::tie(it, inserted) =
-          interning_remapper_.emplace(interned_id, table_id);
-      PERFETTO_DCHECK(inserted);
-    }
-    return it->second;
+    return *it_and_inserted.first;
   }
 
   // Contains all locations, lines, functions (in memory):
@@ -624,15 +598,20 @@ class GProfileBuilder {
   // implicit id, so these structures remap the interned strings into sequential
   // ids. Only the strings referenced by this GProfileBuilder instance will be
   // added to the table.
-  std::unordered_map<StringId, int64_t> interning_remapper_;
+  base::FlatHashMap<StringId, int64_t, std::hash<StringId>> interning_remapper_;
   std::vector<StringId> string_table_;
 
   // Profile proto being serialized.
   protozero::HeapBuffered<third_party::perftools::profiles::pbzero::Profile>
       result_;
 
-  // Set of locations referenced by the added samples.
-  std::set<int64_t> seen_locations_;
+  // Locations referenced by the added samples, and the functions referenced by
+  // those locations, in the order of first use. The bitmaps are indexed by the
+  // LocationTracker ids.
+  std::vector<int64_t> seen_locations_;
+  std::vector<bool> location_seen_;
+  std::vector<int64_t> seen_functions_;
+  std::vector<bool> function_seen_;
 };
 
 namespace heap_profile {
@@ -760,7 +739,7 @@ static bool WriteAllocations(GProfileBuilder* builder,
 }
 
 static bool TraceToHeapPprof(trace_processor::TraceProcessor* tp,
-                             std::vector<SerializedProfile>* output,
+                             const ProfileCallback& callback,
                              bool annotate_frames,
                              uint64_t target_pid,
                              const std::vector<uint64_t>& target_timestamps) {
@@ -810,9 +789,8 @@ static bool TraceToHeapPprof(trace_processor::TraceProcessor* tp,
     if (WriteAllocations(&builder, &view_its)) {
       profile_proto = builder.CompleteProfile(tp);
     }
-    output->emplace_back(
-        SerializedProfile{ProfileType::kHeapProfile, profile_pid,
-                          std::move(profile_proto), heap_name});
+    callback(SerializedProfile{ProfileType::kHeapProfile, profile_pid,
+                               std::move(profile_proto), heap_name});
   }
 
   if (!it.Status().ok()) {
@@ -831,34 +809,6 @@ static bool TraceToHeapPprof(trace_processor::TraceProcessor* tp,
 }  // namespace heap_profile
 
 namespace perf_profile {
-struct ProcessInfo {
-  uint64_t pid;
-  std::vector<uint64_t> utids;
-};
-
-// Returns a map of upid -> {pid, utids[]} for sampled processes.
-static std::map<uint64_t, ProcessInfo> GetProcessMap(
-    trace_processor::TraceProcessor* tp) {
-  Iterator it = tp->ExecuteQuery(
-      "select distinct process.upid, process.pid, thread.utid from perf_sample "
-      "join thread using (utid) join process using (upid) where callsite_id is "
-      "not null order by process.upid asc");
-  std::map<uint64_t, ProcessInfo> process_map;
-  while (it.Next()) {
-    uint64_t upid = static_cast<uint64_t>(it.Get(0).AsLong());
-    uint64_t pid = static_cast<uint64_t>(it.Get(1).AsLong());
-    uint64_t utid = static_cast<uint64_t>(it.Get(2).AsLong());
-    process_map[upid].pid = pid;
-    process_map[upid].utids.push_back(utid);
-  }
-  if (!it.Status().ok()) {
-    PERFETTO_DFATAL_OR_ELOG("Invalid iterator: %s",
-                            it.Status().message().c_str());
-    return {};
-  }
-  return process_map;
-}
-
 static void LogTracePerfEventIssues(trace_processor::TraceProcessor* tp) {
   std::optional<int64_t> stat = GetStatsEntry(tp, "perf_samples_skipped");
   if (!stat.has_value()) {
@@ -909,7 +859,7 @@ static void LogTracePerfEventIssues(trace_processor::TraceProcessor* tp) {
 // unsuccessful). Furthermore, clarify the return value's semantics for both
 // perf and heap profiles.
 static bool TraceToPerfPprof(trace_processor::TraceProcessor* tp,
-                             std::vector<SerializedProfile>* output,
+                             const ProfileCallback& callback,
                              bool annotate_frames,
                              uint64_t target_pid) {
   trace_processor::StringPool interner;
@@ -918,46 +868,60 @@ static bool TraceToPerfPprof(trace_processor::TraceProcessor* tp,
 
   LogTracePerfEventIssues(tp);
 
-  // Aggregate samples by upid when building profiles.
-  std::map<uint64_t, ProcessInfo> process_map = GetProcessMap(tp);
-  for (const auto& p : process_map) {
-    const ProcessInfo& process = p.second;
-
-    if (target_pid != 0 && process.pid != target_pid)
-      continue;
-
-    GProfileBuilder builder(locations, &interner);
-    builder.WriteSampleTypes({{"samples", "count"}});
+  // Aggregate samples by upid when building profiles. A single scan counts the
+  // samples of all processes per callsite, and the rows are ordered by upid so
+  // that each profile can be completed as soon as its last row is read.
+  Iterator it = tp->ExecuteQuery(
+      "select upid, process.pid, callsite_id, count(*) from perf_sample "
+      "join thread using (utid) join process using (upid) "
+      "where callsite_id is not null "
+      "group by upid, callsite_id order by upid asc");
+
+  std::unique_ptr<GProfileBuilder> builder;
+  uint64_t builder_upid = 0;
+  uint64_t builder_pid = 0;
+  auto complete_profile = [&] {
+    if (!builder)
+      return;
+    callback(SerializedProfile{ProfileType::kPerfProfile, builder_pid,
+                               builder->CompleteProfile(tp), ""});
+    builder.reset();
+  };
 
-    std::string query = "select callsite_id from perf_sample where utid in (" +
-                        AsCsvString(process.utids) +
-                        ") and callsite_id is not null order by ts asc;";
+  while (it.Next()) {
+    uint64_t upid = static_cast<uint64_t>(it.Get(0).AsLong());
+    uint64_t pid = static_cast<uint64_t>(it.Get(1).AsLong());
+    int64_t callsite_id = static_cast<int64_t>(it.Get(2).AsLong());
+    int64_t count = static_cast<int64_t>(it.Get(3).AsLong());
 
-    protozero::PackedVarInt single_count_value;
-    single_count_value.Append(1);
+    if (target_pid != 0 && pid != target_pid)
+      continue;
 
-    Iterator it = tp->ExecuteQuery(query);
-    while (it.Next()) {
-      int64_t callsite_id = static_cast<int64_t>(it.Get(0).AsLong());
-      builder.AddSample(single_count_value, callsite_id);
-    }
-    if (!it.Status().ok()) {
-      PERFETTO_DFATAL_OR_ELOG("Failed to iterate over samples: %s",
-                              it.Status().c_message());
-      return false;
+    if (!builder || upid != builder_upid) {
+      complete_profile();
+      builder.reset(new GProfileBuilder(locations, &interner));
+      builder->WriteSampleTypes({{"samples", "count"}});
+      builder_upid = upid;
+      builder_pid = pid;
     }
 
-    std::string profile_proto = builder.CompleteProfile(tp);
-    output->emplace_back(SerializedProfile{
-        ProfileType::kPerfProfile, process.pid, std::move(profile_proto), ""});
+    protozero::PackedVarInt count_value;
+    count_value.Append(count);
+    builder->AddSample(count_value, callsite_id);
+  }
+  if (!it.Status().ok()) {
+    PERFETTO_DFATAL_OR_ELOG("Failed to iterate over samples: %s",
+                            it.Status().c_message());
+    return false;
   }
+  complete_profile();
   return true;
 }
 }  // namespace perf_profile
 }  // namespace
 
 bool TraceToPprof(trace_processor::TraceProcessor* tp,
-                  std::vector<SerializedProfile>* output,
+                  std::function<void(SerializedProfile)> callback,
                   ConversionMode mode,
                   uint64_t flags,
                   uint64_t pid,
@@ -966,13 +930,28 @@ bool TraceToPprof(trace_processor::TraceProcessor* tp,
       flags & static_cast<uint64_t>(ConversionFlags::kAnnotateFrames);
   switch (mode) {
     case (ConversionMode::kHeapProfile):
-      return heap_profile::TraceToHeapPprof(tp, output, annotate_frames, pid,
+      return heap_profile::TraceToHeapPprof(tp, callback, annotate_frames, pid,
                                             timestamps);
     case (ConversionMode::kPerfProfile):
-      return perf_profile::TraceToPerfPprof(tp, output, annotate_frames, pid);
+      return perf_profile::TraceToPerfPprof(tp, callback, annotate_frames,
+                                            pid);
   }
   PERFETTO_FATAL("unknown conversion option");  // for gcc
 }
 
+bool TraceToPprof(trace_processor::TraceProcessor* tp,
+                  std::vector<SerializedProfile>* output,
+                  ConversionMode mode,
+                  uint64_t flags,
+                  uint64_t pid,
+                  const std::vector<uint64_t>& timestamps) {
+  return TraceToPprof(
+      tp,
+      [output](SerializedProfile profile) {
+        output->emplace_back(std::move(profile));
+      },
+      mode, flags, pid, timestamps);
+}
+
 }  // namespace trace_to_text
 }  // namespace perfetto
@@ -16,18 +16,27 @@
 
 #include "src/traceconv/trace_to_hprof.h"
 
-#include <algorithm>
-#include <limits>
-#include <optional>
+#include <functional>
+#include <memory>
 #include <string>
 #include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/endian.h"
 #include "perfetto/ext/base/string_utils.h"
-#include "src/traceconv/utils.h"
+#include "perfetto/ext/base/string_view.h"
+#include "perfetto/protozero/field.h"
+#include "src/protozero/proto_ring_buffer.h"
+#include "src/trace_processor/forwarding_trace_parser.h"
+#include "src/trace_processor/importers/proto/heap_graph_tracker.h"
+#include "src/trace_processor/util/gzip_utils.h"
+
+#include "protos/perfetto/trace/profiling/deobfuscation.pbzero.h"
+#include "protos/perfetto/trace/profiling/heap_graph.pbzero.h"
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
 
 // Spec
 // http://hg.openjdk.java.net/jdk6/jdk6/jdk/raw-file/tip/src/share/demo/jvmti/hprof/manual.html#Basic_Type
@@ -112,167 +121,160 @@ class HprofWriter {
   std::ostream* output_;
 };
 
-// A Class from the heap dump.
-class ClassData {
+// The classes of one heap dump, collected in a single pass over the trace.
+//
+// Only the types of the heap graph are kept. The objects, which make up almost
+// all of a heap graph, are skipped without being decoded, so the memory used
+// is proportional to the number of classes rather than to the size of the
+// heap.
+class StreamingHeapDump {
  public:
-  explicit ClassData(uint64_t class_name_string_id)
-      : class_name_string_id_(class_name_string_id) {}
-
-  // Writes a HPROF LOAD_CLASS record for this Class
-  void WriteHprofLoadClass(HprofWriter* writer,
-                           uint64_t class_object_id,
-                           uint32_t class_serial_number) const {
-    writer->WriteRecord(0x02, [class_object_id, class_serial_number,
-                               this](BigEndianBuffer* buf) {
-      buf->WriteU4(class_serial_number);
-      buf->WriteId(class_object_id);
-      buf->WriteU4(kStackTraceSerialNumber);
-      buf->WriteId(class_name_string_id_);
-    });
-  }
-
- private:
-  uint64_t class_name_string_id_;
-};
-
-// Ingested data from a Java Heap Profile for a name, location pair.
-// We need to support multiple class datas per pair as name, location is
-// not unique. Classloader should guarantee uniqueness but is not available
-// until S.
-class RawClassData {
- public:
-  void AddClass(uint64_t id, std::optional<uint64_t> superclass_id) {
-    ids_.push_back(std::make_pair(id, superclass_id));
-  }
-
-  void AddTemplate(uint64_t template_id) {
-    template_ids_.push_back(template_id);
-  }
-
-  // Transforms the raw data into one or more ClassData and adds them to the
-  // parameter map.
-  void ToClassData(std::unordered_map<uint64_t, ClassData>* id_to_class,
-                   uint64_t class_name_string_id) const {
-    // TODO(dinoderek) assert the two vectors have same length, iterate on both
-    for (auto it_ids = ids_.begin(); it_ids != ids_.end(); ++it_ids) {
-      // TODO(dinoderek) more data will be needed to write CLASS_DUMP
-      id_to_class->emplace(it_ids->first, ClassData(class_name_string_id));
+  StreamingHeapDump(uint64_t pid, uint64_t ts) : pid_(pid), ts_(ts) {}
+
+  void Feed(const uint8_t* data, size_t len) {
+    ring_buffer_.Append(data, len);
+    for (;;) {
+      auto token = ring_buffer_.ReadMessage();
+      if (token.fatal_framing_error) {
+        PERFETTO_ELOG("Failed to tokenize trace packet");
+        ok_ = false;
+        return;
+      }
+      if (!token.valid())
+        break;
+      if (token.field_id != protos::pbzero::Trace::kPacketFieldNumber)
+        continue;
+      ParsePacket(protozero::ConstBytes{token.start, token.len});
     }
   }
 
- private:
-  // Pair contains class ID and super class ID.
-  std::vector<std::pair<uint64_t, std::optional<uint64_t>>> ids_;
-  // Class id of the template
-  std::vector<uint64_t> template_ids_;
-};
+  bool ok() const { return ok_; }
 
-// The Heap Dump data
-class HeapDump {
- public:
-  explicit HeapDump(trace_processor::TraceProcessor* tp) : tp_(tp) {}
+  void Write(HprofWriter* writer) {
+    // The names are only resolved now, as deobfuscation mappings are usually
+    // appended to the trace after the heap graph.
+    std::vector<std::pair<uint64_t, uint64_t>> class_and_name_ids;
+    for (const RawClass& cls : classes_) {
+      static constexpr char kClassPrefix[] = "java.lang.Class<";
+      constexpr size_t kClassPrefixLen = sizeof(kClassPrefix) - 1;
+      std::string name = Deobfuscate(cls.name);
+      // Classes are also present as instances of java.lang.Class. Only the
+      // name of those is recorded.
+      if (base::StartsWith(name, kClassPrefix) && base::EndsWith(name, ">")) {
+        IngestString(
+            name.substr(kClassPrefixLen, name.size() - kClassPrefixLen - 1));
+        continue;
+      }
+      class_and_name_ids.emplace_back(cls.id, IngestString(name));
+    }
 
-  void Ingest() { IngestClasses(); }
+    for (size_t i = 0; i < strings_.size(); ++i) {
+      const std::string& str = strings_[i];
+      writer->WriteRecord(0x01, [i, &str](BigEndianBuffer* buf) {
+        buf->WriteId(i + 1);
+        // TODO(dinoderek): UTF-8 encoding
+        buf->Write(str.c_str(), static_cast<uint32_t>(str.length()));
+      });
+    }
 
-  void Write(HprofWriter* writer) {
-    WriteStrings(writer);
-    WriteLoadClass(writer);
+    uint32_t class_serial_number = 1;
+    for (const auto& class_and_name_id : class_and_name_ids) {
+      writer->WriteRecord(0x02, [&class_and_name_id,
+                                 class_serial_number](BigEndianBuffer* buf) {
+        buf->WriteU4(class_serial_number);
+        buf->WriteId(class_and_name_id.first);
+        buf->WriteU4(kStackTraceSerialNumber);
+        buf->WriteId(class_and_name_id.second);
+      });
+      class_serial_number++;
+    }
   }
 
  private:
-  trace_processor::TraceProcessor* tp_;
-
-  // String IDs start from 1 as 0 appears to be reserved.
-  uint64_t next_string_id_ = 1;
-  // Strings to corresponding String ID
-  std::unordered_map<std::string, uint64_t> string_to_id_;
-  // Type ID to corresponding Class
-  std::unordered_map<uint64_t, ClassData> id_to_class_;
-
-  // Ingests and processes the class data from the heap dump.
-  void IngestClasses() {
-    // TODO(dinoderek): heap_graph_class does not support pid or ts filtering
-
-    std::map<std::pair<uint64_t, std::string>, RawClassData> raw_classes;
-
-    auto it = tp_->ExecuteQuery(R"(SELECT
-          id,
-          IFNULL(deobfuscated_name, name),
-          superclass_id,
-          location
-        FROM heap_graph_class )");
-
-    while (it.Next()) {
-      uint64_t id = static_cast<uint64_t>(it.Get(0).AsLong());
-
-      std::string raw_dname(it.Get(1).AsString());
-      std::string dname;
-      bool is_template_class =
-          base::StartsWith(raw_dname, std::string("java.lang.Class<"));
-      if (is_template_class) {
-        dname = raw_dname.substr(17, raw_dname.size() - 18);
-      } else {
-        dname = raw_dname;
-      }
-      uint64_t name_id = IngestString(dname);
-
-      auto raw_super_id = it.Get(2);
-      std::optional<uint64_t> maybe_super_id =
-          raw_super_id.is_null()
-              ? std::nullopt
-              : std::optional<uint64_t>(
-                    static_cast<uint64_t>(raw_super_id.AsLong()));
-
-      std::string location(it.Get(3).AsString());
-
-      auto raw_classes_it =
-          raw_classes.emplace(std::make_pair(name_id, location), RawClassData())
-              .first;
-      if (is_template_class) {
-        raw_classes_it->second.AddTemplate(id);
-      } else {
-        raw_classes_it->second.AddClass(id, maybe_super_id);
+  struct RawClass {
+    uint64_t id;
+    std::string name;
+  };
+
+  void ParsePacket(protozero::ConstBytes blob) {
+    protos::pbzero::TracePacket::Decoder packet(blob.data, blob.size);
+    if (packet.has_compressed_packets()) {
+      if (!trace_processor::util::IsGzipSupported()) {
+        PERFETTO_ELOG("Cannot decode compressed packets, zlib not enabled.");
+        ok_ = false;
+        return;
       }
+      protozero::ConstBytes packets = packet.compressed_packets();
+      std::vector<uint8_t> decompressed =
+          trace_processor::util::GzipDecompressor::DecompressFully(
+              packets.data, packets.size);
+      protos::pbzero::Trace::Decoder trace(decompressed.data(),
+                                           decompressed.size());
+      for (auto it = trace.packet(); it; ++it)
+        ParsePacket(*it);
+      return;
     }
+    if (packet.has_heap_graph() && packet.timestamp() == ts_)
+      ParseHeapGraph(packet.heap_graph());
+    if (packet.has_deobfuscation_mapping())
+      ParseDeobfuscationMapping(packet.deobfuscation_mapping());
+  }
 
-    for (const auto& raw : raw_classes) {
-      auto class_name_string_id = raw.first.first;
-      raw.second.ToClassData(&id_to_class_, class_name_string_id);
+  void ParseHeapGraph(protozero::ConstBytes blob) {
+    protos::pbzero::HeapGraph::Decoder heap_graph(blob.data, blob.size);
+    if (static_cast<uint64_t>(heap_graph.pid()) != pid_)
+      return;
+    for (auto it = heap_graph.types(); it; ++it) {
+      protos::pbzero::HeapGraphType::Decoder type(*it);
+      classes_.push_back({type.id(), type.class_name().ToStdString()});
     }
   }
 
-  // Ingests the parameter string and returns the HPROF ID for the string.
-  uint64_t IngestString(const std::string& s) {
-    auto maybe_id = string_to_id_.find(s);
-    if (maybe_id != string_to_id_.end()) {
-      return maybe_id->second;
-    } else {
-      auto id = next_string_id_;
-      next_string_id_ += 1;
-      string_to_id_[s] = id;
-      return id;
+  void ParseDeobfuscationMapping(protozero::ConstBytes blob) {
+    protos::pbzero::DeobfuscationMapping::Decoder mapping(blob.data,
+                                                          blob.size);
+    for (auto it = mapping.obfuscated_classes(); it; ++it) {
+      protos::pbzero::ObfuscatedClass::Decoder cls(*it);
+      deobfuscated_names_[cls.obfuscated_name().ToStdString()] =
+          cls.deobfuscated_name().ToStdString();
     }
   }
 
-  // Writes STRING sections to the output
-  void WriteStrings(HprofWriter* writer) {
-    for (const auto& it : string_to_id_) {
-      writer->WriteRecord(0x01, [it](BigEndianBuffer* buf) {
-        buf->WriteId(it.second);
-        // TODO(dinoderek): UTF-8 encoding
-        buf->Write(it.first.c_str(), static_cast<uint32_t>(it.first.length()));
-      });
-    }
+  std::string Deobfuscate(const std::string& name) const {
+    trace_processor::NormalizedType type =
+        trace_processor::GetNormalizedType(base::StringView(name));
+    auto it = deobfuscated_names_.find(type.name.ToStdString());
+    if (it == deobfuscated_names_.end())
+      return name;
+    return trace_processor::DenormalizeTypeName(type,
+                                                base::StringView(it->second));
   }
 
-  // Writes LOAD CLASS sections to the output
-  void WriteLoadClass(HprofWriter* writer) {
-    uint32_t class_serial_number = 1;
-    for (const auto& it : id_to_class_) {
-      it.second.WriteHprofLoadClass(writer, it.first, class_serial_number);
-      class_serial_number += 1;
-    }
+  // Ingests the parameter string and returns the HPROF ID for the string.
+  // String IDs start from 1 as 0 appears to be reserved.
+  uint64_t IngestString(const std::string& s) {
+    auto it = string_to_id_.find(s);
+    if (it != string_to_id_.end())
+      return it->second;
+    strings_.push_back(s);
+    uint64_t id = strings_.size();
+    string_to_id_.emplace(s, id);
+    return id;
   }
+
+  const uint64_t pid_;
+  const uint64_t ts_;
+  bool ok_ = true;
+  protozero::ProtoRingBuffer ring_buffer_;
+
+  std::vector<RawClass> classes_;
+  // Unlike trace processor, this does not take the package of the mapping
+  // into account: a heap dump only contains the classes of one process.
+  std::unordered_map<std::string, std::string> deobfuscated_names_;
+
+  // The string with HPROF ID i is strings_[i - 1].
+  std::vector<std::string> strings_;
+  std::unordered_map<std::string, uint64_t> string_to_id_;
 };
 
 void WriteHeaderAndStack(HprofWriter* writer) {
@@ -295,22 +297,6 @@ void WriteHeaderAndStack(HprofWriter* writer) {
 }
 }  // namespace
 
-int TraceToHprof(trace_processor::TraceProcessor* tp,
-                 std::ostream* output,
-                 uint64_t pid,
-                 uint64_t ts) {
-  PERFETTO_DCHECK(tp != nullptr && pid != 0 && ts != 0);
-
-  HprofWriter writer(output);
-  HeapDump dump(tp);
-
-  dump.Ingest();
-  WriteHeaderAndStack(&writer);
-  dump.Write(&writer);
-
-  return 0;
-}
-
 int TraceToHprof(std::istream* input,
                  std::ostream* output,
                  uint64_t pid,
@@ -325,13 +311,47 @@ int TraceToHprof(std::istream* input,
     PERFETTO_ELOG("Must specify single timestamp");
     return -1;
   }
-  trace_processor::Config config;
-  std::unique_ptr<trace_processor::TraceProcessor> tp =
-      trace_processor::TraceProcessor::CreateInstance(config);
-  if (!ReadTraceUnfinalized(tp.get(), input))
-    return false;
-  tp->NotifyEndOfFile();
-  return TraceToHprof(tp.get(), output, pid, timestamps[0]);
+
+  StreamingHeapDump dump(pid, timestamps[0]);
+  auto feed = [&dump](const uint8_t* data, size_t len) {
+    dump.Feed(data, len);
+  };
+
+  constexpr size_t kChunkSize = 1024 * 1024;
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[kChunkSize]);
+  auto read_chunk = [&input, &buffer]() -> size_t {
+    input->read(reinterpret_cast<char*>(buffer.get()),
+                static_cast<std::streamsize>(kChunkSize));
+    return static_cast<size_t>(input->gcount());
+  };
+
+  size_t len = read_chunk();
+  bool is_gzip = trace_processor::GuessTraceType(buffer.get(), len) ==
+                 trace_processor::TraceType::kGzipTraceType;
+  trace_processor::util::GzipDecompressor decompressor;
+  for (; len > 0 && dump.ok(); len = read_chunk()) {
+    if (!is_gzip) {
+      feed(buffer.get(), len);
+      continue;
+    }
+    using ResultCode = trace_processor::util::GzipDecompressor::ResultCode;
+    if (decompressor.FeedAndExtract(buffer.get(), len, feed) ==
+        ResultCode::kError) {
+      PERFETTO_ELOG("Failed to decompress trace");
+      return -1;
+    }
+  }
+  if (input->bad()) {
+    PERFETTO_ELOG("Failed while reading trace");
+    return -1;
+  }
+  if (!dump.ok())
+    return -1;
+
+  HprofWriter writer(output);
+  WriteHeaderAndStack(&writer);
+  dump.Write(&writer);
+  return 0;
 }
 
 }  // namespace trace_to_text
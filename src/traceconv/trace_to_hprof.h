@@ -17,18 +17,17 @@
 #ifndef SRC_TRACECONV_TRACE_TO_HPROF_H_
 #define SRC_TRACECONV_TRACE_TO_HPROF_H_
 
+#include <stdint.h>
+
 #include <iostream>
 #include <vector>
-#include "perfetto/trace_processor/trace_processor.h"
 
 namespace perfetto {
 namespace trace_to_text {
 
-int TraceToHprof(trace_processor::TraceProcessor* tp,
-                 std::ostream* output,
-                 uint64_t pid,
-                 uint64_t timestamp);
-
+// Converts the java heap dump of |pid| at |timestamps| (which must contain a
+// single timestamp) to the hprof format. The trace is processed in a single
+// pass, without loading it into trace processor.
 int TraceToHprof(std::istream* input,
                  std::ostream* output,
                  uint64_t pid = 0,
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traceconv/trace_to_hprof.h"
+
+#include <sstream>
+#include <string>
+
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "protos/perfetto/trace/profiling/deobfuscation.pbzero.h"
+#include "protos/perfetto/trace/profiling/heap_graph.pbzero.h"
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_to_text {
+namespace {
+
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+constexpr uint64_t kPid = 1234;
+constexpr uint64_t kTs = 100;
+
+void AddHeapGraph(protos::pbzero::Trace* trace,
+                  uint64_t pid,
+                  uint64_t ts,
+                  const char* class_name) {
+  auto* packet = trace->add_packet();
+  packet->set_timestamp(ts);
+  auto* heap_graph = packet->set_heap_graph();
+  heap_graph->set_pid(static_cast<int32_t>(pid));
+  auto* type = heap_graph->add_types();
+  type->set_id(1);
+  type->set_class_name(class_name);
+  auto* object = heap_graph->add_objects();
+  object->set_id(0x10);
+  object->set_type_id(1);
+}
+
+std::string Convert(const std::string& trace) {
+  std::istringstream input(trace);
+  std::ostringstream output;
+  EXPECT_EQ(TraceToHprof(&input, &output, kPid, {kTs}), 0);
+  return output.str();
+}
+
+TEST(TraceToHprofTest, WritesClassesOfSelectedDump) {
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  AddHeapGraph(trace.get(), kPid, kTs, "com.example.Selected");
+  AddHeapGraph(trace.get(), kPid, kTs + 1, "com.example.OtherTimestamp");
+  AddHeapGraph(trace.get(), kPid + 1, kTs, "com.example.OtherProcess");
+
+  std::string hprof = Convert(trace.SerializeAsString());
+  EXPECT_THAT(hprof, HasSubstr("PERFETTO_JAVA_HEAP"));
+  EXPECT_THAT(hprof, HasSubstr("com.example.Selected"));
+  EXPECT_THAT(hprof, Not(HasSubstr("OtherTimestamp")));
+  EXPECT_THAT(hprof, Not(HasSubstr("OtherProcess")));
+}
+
+TEST(TraceToHprofTest, DeobfuscationMappingAfterHeapGraph) {
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  AddHeapGraph(trace.get(), kPid, kTs, "a.b[]");
+  auto* mapping = trace->add_packet()->set_deobfuscation_mapping();
+  auto* cls = mapping->add_obfuscated_classes();
+  cls->set_obfuscated_name("a.b");
+  cls->set_deobfuscated_name("com.example.Deobfuscated");
+
+  std::string hprof = Convert(trace.SerializeAsString());
+  EXPECT_THAT(hprof, HasSubstr("com.example.Deobfuscated[]"));
+  EXPECT_THAT(hprof, Not(HasSubstr("a.b[]")));
+}
+
+}  // namespace
+}  // namespace trace_to_text
+}  // namespace perfetto
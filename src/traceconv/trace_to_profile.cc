@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/profiling/symbolizer/caching_symbolizer.h"
 #include "src/profiling/symbolizer/local_symbolizer.h"
 #include "src/profiling/symbolizer/symbolize_database.h"
 #include "src/traceconv/utils.h"
@@ -72,6 +73,8 @@ void MaybeSymbolize(trace_processor::TraceProcessor* tp) {
                                       getenv("PERFETTO_SYMBOLIZER_MODE"));
   if (!symbolizer)
     return;
+  symbolizer = profiling::MaybeAddSymbolCache(
+      std::move(symbolizer), profiling::GetPerfettoSymbolCachePath());
   profiling::SymbolizeDatabase(tp, symbolizer.get(),
                                [tp](const std::string& trace_proto) {
                                  IngestTraceOrDie(tp, trace_proto);
@@ -100,7 +103,6 @@ int TraceToProfile(
     uint64_t conversion_flags,
     std::string dirname_prefix,
     std::function<std::string(const SerializedProfile&)> filename_fn) {
-  std::vector<SerializedProfile> profiles;
   trace_processor::Config config;
   std::unique_ptr<trace_processor::TraceProcessor> tp =
       trace_processor::TraceProcessor::CreateInstance(config);
@@ -111,17 +113,14 @@ int TraceToProfile(
   MaybeSymbolize(tp.get());
   MaybeDeobfuscate(tp.get());
 
-  TraceToPprof(tp.get(), &profiles, conversion_mode, conversion_flags, pid,
-               timestamps);
-  tp->NotifyEndOfFile();
-  if (profiles.empty()) {
-    return 0;
-  }
-
-  std::string temp_dir = GetTemp() + "/" + dirname_prefix +
-                         base::GetTimeFmt("%y%m%d%H%M%S") + GetRandomString(5);
-  PERFETTO_CHECK(base::Mkdir(temp_dir));
-  for (const auto& profile : profiles) {
+  // Profiles are written out as they are built, rather than all at the end.
+  std::string temp_dir;
+  auto write_profile = [&](SerializedProfile profile) {
+    if (temp_dir.empty()) {
+      temp_dir = GetTemp() + "/" + dirname_prefix +
+                 base::GetTimeFmt("%y%m%d%H%M%S") + GetRandomString(5);
+      PERFETTO_CHECK(base::Mkdir(temp_dir));
+    }
     std::string filename = temp_dir + "/" + filename_fn(profile);
     base::ScopedFile fd(base::OpenFile(filename, O_CREAT | O_WRONLY, 0700));
     if (!fd)
@@ -129,7 +128,14 @@ int TraceToProfile(
     PERFETTO_CHECK(base::WriteAll(*fd, profile.serialized.c_str(),
                                   profile.serialized.size()) ==
                    static_cast<ssize_t>(profile.serialized.size()));
+  };
+  TraceToPprof(tp.get(), write_profile, conversion_mode, conversion_flags, pid,
+               timestamps);
+  tp->NotifyEndOfFile();
+  if (temp_dir.empty()) {
+    return 0;
   }
+
   *output << "Wrote profiles to " << temp_dir << std::endl;
   return 0;
 }
@@ -16,9 +16,18 @@
 
 #include "src/traceconv/trace_to_text.h"
 
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/threading/thread_pool.h"
+#include "perfetto/ext/base/waitable_event.h"
 #include "src/protozero/proto_ring_buffer.h"
 #include "src/traceconv/trace.descriptor.h"
 #include "src/traceconv/utils.h"
@@ -40,29 +49,57 @@ using trace_processor::TraceType;
 using trace_processor::util::GzipDecompressor;
 
 template <size_t N>
-static void WriteToOutput(std::ostream* output, const char (&str)[N]) {
-  output->write(str, sizeof(str) - 1);
+static void AppendLiteral(std::string* output, const char (&str)[N]) {
+  output->append(str, sizeof(str) - 1);
 }
 
+// Packets per batch are chosen to be large enough for the cost of the thread
+// hops to be negligible, but small enough to keep all the threads busy.
+constexpr size_t kBatchBytes = 1024 * 1024;
+
+// A run of whole TracePackets which is converted to text as a unit.
+struct PacketBatch {
+  // The payloads of the packets, one after the other.
+  std::string packets;
+  std::vector<size_t> packet_sizes;
+
+  // Only valid after |done| has been notified.
+  std::string text;
+  base::WaitableEvent done;
+};
+
 // Online algorithm to covert trace binary to text format.
 // Usage:
 //  - Feed the trace-binary in a sequence of memblock, and it will continue to
 //    write the output in given std::ostream*.
+//  - Call Flush() once all the trace has been fed.
+//
+// Packets are converted to text in batches. With a non-zero |thread_count|
+// the batches are converted in parallel while the trace is being read, and
+// written out in the order they were read.
 class OnlineTraceToText {
  public:
-  OnlineTraceToText(std::ostream* output) : output_(output) {
+  OnlineTraceToText(std::ostream* output, uint32_t thread_count)
+      : output_(output), thread_count_(thread_count) {
     pool_.AddFromFileDescriptorSet(kTraceDescriptor.data(),
                                    kTraceDescriptor.size());
+    if (thread_count_ > 0)
+      thread_pool_.reset(new base::ThreadPool(thread_count_));
   }
   OnlineTraceToText(const OnlineTraceToText&) = delete;
   OnlineTraceToText& operator=(const OnlineTraceToText&) = delete;
   void Feed(const uint8_t* data, size_t len);
+  void Flush();
   bool ok() const { return ok_; }
 
  private:
   std::string TracePacketToText(protozero::ConstBytes packet,
-                                uint32_t indent_depth);
-  void PrintCompressedPackets(protozero::ConstBytes packets);
+                                uint32_t indent_depth) const;
+  void AppendCompressedPackets(protozero::ConstBytes packets,
+                               std::string* output) const;
+  void ConvertBatch(PacketBatch* batch) const;
+  void SubmitBatch();
+  void WriteOldestBatch();
 
   bool ok_ = true;
   std::ostream* output_;
@@ -70,41 +107,99 @@ class OnlineTraceToText {
   DescriptorPool pool_;
   size_t bytes_processed_ = 0;
   size_t packet_ = 0;
+  const uint32_t thread_count_;
+
+  // The batch being filled by Feed().
+  std::unique_ptr<PacketBatch> batch_;
+  // Batches being converted, in the order they have been read.
+  std::deque<std::unique_ptr<PacketBatch>> pending_batches_;
+  // Declared last so that the threads are joined before the batches they
+  // might be converting are destroyed.
+  std::unique_ptr<base::ThreadPool> thread_pool_;
 };
 
 std::string OnlineTraceToText::TracePacketToText(protozero::ConstBytes packet,
-                                                 uint32_t indent_depth) {
+                                                 uint32_t indent_depth) const {
   namespace pb0_to_text = trace_processor::protozero_to_text;
   return pb0_to_text::ProtozeroToText(pool_, ".perfetto.protos.TracePacket",
                                       packet, pb0_to_text::kIncludeNewLines,
                                       indent_depth);
 }
 
-void OnlineTraceToText::PrintCompressedPackets(protozero::ConstBytes packets) {
-  WriteToOutput(output_, "compressed_packets {\n");
+void OnlineTraceToText::AppendCompressedPackets(protozero::ConstBytes packets,
+                                                std::string* output) const {
+  AppendLiteral(output, "compressed_packets {\n");
   if (trace_processor::util::IsGzipSupported()) {
     std::vector<uint8_t> whole_data =
         GzipDecompressor::DecompressFully(packets.data, packets.size);
     protos::pbzero::Trace::Decoder decoder(whole_data.data(),
                                            whole_data.size());
     for (auto it = decoder.packet(); it; ++it) {
-      WriteToOutput(output_, "  packet {\n");
-      std::string text = TracePacketToText(*it, 2);
-      output_->write(text.data(), std::streamsize(text.size()));
-      WriteToOutput(output_, "\n  }\n");
+      AppendLiteral(output, "  packet {\n");
+      output->append(TracePacketToText(*it, 2));
+      AppendLiteral(output, "\n  }\n");
     }
   } else {
     static const char kErrMsg[] =
         "Cannot decode compressed packets. zlib not enabled in the build "
         "config";
-    WriteToOutput(output_, kErrMsg);
+    AppendLiteral(output, kErrMsg);
     static bool log_once = [] {
       PERFETTO_ELOG("%s", kErrMsg);
       return true;
     }();
     base::ignore_result(log_once);
   }
-  WriteToOutput(output_, "}\n");
+  AppendLiteral(output, "}\n");
+}
+
+// Can be called on any thread: only reads |pool_|.
+void OnlineTraceToText::ConvertBatch(PacketBatch* batch) const {
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(batch->packets.data());
+  for (size_t size : batch->packet_sizes) {
+    protozero::ConstBytes packet{ptr, size};
+    ptr += size;
+    protos::pbzero::TracePacket::Decoder decoder(packet.data, packet.size);
+    if (decoder.has_compressed_packets()) {
+      AppendCompressedPackets(decoder.compressed_packets(), &batch->text);
+    } else {
+      AppendLiteral(&batch->text, "packet {\n");
+      batch->text.append(TracePacketToText(packet, 1 /* indent_depth */));
+      AppendLiteral(&batch->text, "\n}\n");
+    }
+  }
+  std::string().swap(batch->packets);
+  batch->done.Notify();
+}
+
+void OnlineTraceToText::SubmitBatch() {
+  if (!batch_)
+    return;
+  PacketBatch* batch = batch_.get();
+  pending_batches_.emplace_back(std::move(batch_));
+  if (!thread_pool_) {
+    ConvertBatch(batch);
+    WriteOldestBatch();
+    return;
+  }
+  // Bound the memory used by the batches which are converted but can't be
+  // written yet.
+  if (pending_batches_.size() > 2 * thread_count_)
+    WriteOldestBatch();
+  thread_pool_->PostTask([this, batch] { ConvertBatch(batch); });
+}
+
+void OnlineTraceToText::WriteOldestBatch() {
+  std::unique_ptr<PacketBatch> batch = std::move(pending_batches_.front());
+  pending_batches_.pop_front();
+  batch->done.Wait();
+  output_->write(batch->text.data(), std::streamsize(batch->text.size()));
+}
+
+void OnlineTraceToText::Flush() {
+  SubmitBatch();
+  while (!pending_batches_.empty())
+    WriteOldestBatch();
 }
 
 void OnlineTraceToText::Feed(const uint8_t* data, size_t len) {
@@ -126,22 +221,21 @@ void OnlineTraceToText::Feed(const uint8_t* data, size_t len) {
       PERFETTO_ELOG("Skipping invalid field");
       continue;
     }
-    protos::pbzero::TracePacket::Decoder decoder(token.start, token.len);
     bytes_processed_ += token.len;
     if ((packet_++ & 0x3f) == 0) {
       fprintf(stderr, "Processing trace: %8zu KB%c", bytes_processed_ / 1024,
               kProgressChar);
       fflush(stderr);
     }
-    if (decoder.has_compressed_packets()) {
-      PrintCompressedPackets(decoder.compressed_packets());
-    } else {
-      WriteToOutput(output_, "packet {\n");
-      protozero::ConstBytes packet = {token.start, token.len};
-      std::string text = TracePacketToText(packet, 1 /* indent_depth */);
-      output_->write(text.data(), std::streamsize(text.size()));
-      WriteToOutput(output_, "\n}\n");
-    }
+    // The ring buffer memory is reused by the next Append(), so the packets
+    // are copied into the batch.
+    if (!batch_)
+      batch_.reset(new PacketBatch());
+    batch_->packets.append(reinterpret_cast<const char*>(token.start),
+                           token.len);
+    batch_->packet_sizes.push_back(token.len);
+    if (batch_->packets.size() >= kBatchBytes)
+      SubmitBatch();
   }
 }
 
@@ -173,17 +267,20 @@ class InputReader {
 
 }  // namespace
 
-bool TraceToText(std::istream* input, std::ostream* output) {
+bool TraceToText(std::istream* input,
+                 std::ostream* output,
+                 uint32_t thread_count) {
   constexpr size_t kMaxMsgSize = protozero::ProtoRingBuffer::kMaxMsgSize;
   std::unique_ptr<uint8_t[]> buffer(new uint8_t[kMaxMsgSize]);
   uint32_t buffer_len = 0;
 
   InputReader input_reader(input);
-  OnlineTraceToText online_trace_to_text(output);
+  OnlineTraceToText online_trace_to_text(output, thread_count);
 
   input_reader.Read(buffer.get(), &buffer_len, kMaxMsgSize);
   TraceType type = trace_processor::GuessTraceType(buffer.get(), buffer_len);
 
+  bool ok = true;
   if (type == TraceType::kGzipTraceType) {
     GzipDecompressor decompressor;
     auto consumer = [&](const uint8_t* data, size_t len) {
@@ -193,21 +290,35 @@ bool TraceToText(std::istream* input, std::ostream* output) {
     do {
       ResultCode code =
           decompressor.FeedAndExtract(buffer.get(), buffer_len, consumer);
-      if (code == ResultCode::kError || !online_trace_to_text.ok())
-        return false;
+      if (code == ResultCode::kError || !online_trace_to_text.ok()) {
+        ok = false;
+        break;
+      }
     } while (input_reader.Read(buffer.get(), &buffer_len, kMaxMsgSize));
-    return input_reader.ok();
   } else if (type == TraceType::kProtoTraceType) {
     do {
       online_trace_to_text.Feed(buffer.get(), buffer_len);
-      if (!online_trace_to_text.ok())
-        return false;
+      if (!online_trace_to_text.ok()) {
+        ok = false;
+        break;
+      }
     } while (input_reader.Read(buffer.get(), &buffer_len, kMaxMsgSize));
-    return input_reader.ok();
   } else {
     PERFETTO_ELOG("Unrecognised file.");
     return false;
   }
+
+  // Write out the text of all the packets read before any error.
+  online_trace_to_text.Flush();
+  return ok && input_reader.ok();
+}
+
+bool TraceToText(std::istream* input, std::ostream* output) {
+  uint32_t thread_count = std::thread::hardware_concurrency();
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  thread_count = 0;
+#endif
+  return TraceToText(input, output, thread_count);
 }
 
 }  // namespace trace_to_text
@@ -17,12 +17,21 @@
 #ifndef SRC_TRACECONV_TRACE_TO_TEXT_H_
 #define SRC_TRACECONV_TRACE_TO_TEXT_H_
 
+#include <stdint.h>
+
 #include <iostream>
 
 namespace perfetto {
 namespace trace_to_text {
 
-// Returns true in case of success.
+// Returns true in case of success. The packets are converted to text on
+// |thread_count| threads (on the calling thread if 0) and written out in the
+// same order as in the trace.
+bool TraceToText(std::istream* input,
+                 std::ostream* output,
+                 uint32_t thread_count);
+
+// Same as above, with one thread per CPU.
 bool TraceToText(std::istream* input, std::ostream* output);
 
 }  // namespace trace_to_text
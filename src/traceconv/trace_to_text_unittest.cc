@@ -18,9 +18,14 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/hash.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "protos/perfetto/trace/test_event.pbzero.h"
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
 #include "test/gtest_and_gmock.h"
 
 #include <fstream>
+#include <sstream>
 
 using std::string;
 
@@ -61,5 +66,27 @@ TEST(TraceToText, DISABLED_Basic) {
   }
 }
 
+TEST(TraceToText, ParallelOutputMatchesSerial) {
+  // Large enough to be split in several batches.
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  for (uint32_t i = 0; i < 100000; i++) {
+    auto* packet = trace->add_packet();
+    packet->set_timestamp(i);
+    packet->set_trusted_packet_sequence_id(1);
+    packet->set_for_testing()->set_str("packet " + std::to_string(i));
+  }
+  std::string serialized = trace.SerializeAsString();
+
+  auto convert = [&serialized](uint32_t thread_count) {
+    std::istringstream input(serialized);
+    std::ostringstream output;
+    EXPECT_TRUE(TraceToText(&input, &output, thread_count));
+    return output.str();
+  };
+  std::string serial = convert(0);
+  EXPECT_THAT(serial, testing::HasSubstr("timestamp: 99999"));
+  EXPECT_EQ(convert(4), serial);
+}
+
 }  // namespace trace_to_text
 }  // namespace perfetto
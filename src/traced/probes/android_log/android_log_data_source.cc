@@ -15,8 +15,14 @@
  */
 
 #include "src/traced/probes/android_log/android_log_data_source.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <array>
 #include <optional>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/base/task_runner.h"
 #include "perfetto/base/time.h"
@@ -25,6 +31,7 @@
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/unix_socket.h"
+#include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
 #include "perfetto/tracing/core/data_source_config.h"
@@ -42,6 +49,11 @@ using protos::pbzero::AndroidLogConfig;
 using protos::pbzero::AndroidLogId;
 
 constexpr size_t kBufSize = 4096;
+
+// Max number of log entries received with a single recvmmsg(). Each of them
+// gets its own kBufSize slice of |buf_|.
+constexpr size_t kMaxEntriesPerRead = 32;
+
 const char kLogTagsPath[] = "/system/etc/event-log-tags";
 const char kLogdrSocket[] = "/dev/socket/logdr";
 
@@ -83,6 +95,40 @@ inline bool ReadAndAdvance(const char** ptr, const char* end, T* out) {
   return true;
 }
 
+// Receives up to kMaxEntriesPerRead log entries, each into its own kBufSize
+// slice of |buf|, without blocking. Returns the number of entries received.
+size_t ReceiveLogEntries(base::UnixSocketRaw* sock,
+                         char* buf,
+                         std::array<size_t, kMaxEntriesPerRead>* sizes) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  // logdr sends one entry per packet. Receive them in batches, to save a
+  // syscall per entry on chatty devices.
+  std::array<struct iovec, kMaxEntriesPerRead> iovs;
+  std::array<struct mmsghdr, kMaxEntriesPerRead> msgs{};
+  for (size_t i = 0; i < kMaxEntriesPerRead; i++) {
+    iovs[i].iov_base = buf + i * kBufSize;
+    iovs[i].iov_len = kBufSize;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  int res = PERFETTO_EINTR(recvmmsg(sock->fd(), msgs.data(), kMaxEntriesPerRead,
+                                    MSG_DONTWAIT, nullptr));
+  if (res <= 0)
+    return 0;
+  size_t num_msgs = static_cast<size_t>(res);
+  for (size_t i = 0; i < num_msgs; i++)
+    (*sizes)[i] = msgs[i].msg_len;
+  return num_msgs;
+#else
+  ssize_t rsize = sock->Receive(buf, kBufSize);
+  if (rsize <= 0)
+    return 0;
+  (*sizes)[0] = static_cast<size_t>(rsize);
+  return 1;
+#endif
+}
+
 }  // namespace
 
 // static
@@ -144,7 +190,7 @@ AndroidLogDataSource::AndroidLogDataSource(DataSourceConfig ds_config,
     filter_tags_.emplace(&filter_tags_strbuf_[it.first], it.second);
 
   min_prio_ = cfg.min_prio();
-  buf_ = base::PagedMemory::Allocate(kBufSize);
+  buf_ = base::PagedMemory::Allocate(kBufSize * kMaxEntriesPerRead);
 }
 
 AndroidLogDataSource::~AndroidLogDataSource() {
@@ -226,10 +272,15 @@ void AndroidLogDataSource::ReadLogSocket() {
   protos::pbzero::AndroidLogPacket* log_packet = nullptr;
   size_t num_events = 0;
   bool stop = false;
-  ssize_t rsize;
-  while (!stop && (rsize = logdr_sock_.Receive(buf_.Get(), kBufSize)) > 0) {
-    num_events++;
-    stats_.num_total++;
+
+  std::array<size_t, kMaxEntriesPerRead> entry_sizes;
+  while (!stop) {
+    size_t num_msgs = ReceiveLogEntries(
+        &logdr_sock_, reinterpret_cast<char*>(buf_.Get()), &entry_sizes);
+    if (num_msgs == 0)
+      break;
+
+    num_events += num_msgs;
     // Don't hold the message loop for too long. If there are so many events
     // in the queue, stop at some point and parse the remaining ones in another
     // task (posted after this while loop).
@@ -241,66 +292,71 @@ void AndroidLogDataSource::ReadLogSocket() {
           weak_this->ReadLogSocket();
       });
     }
-    char* buf = reinterpret_cast<char*>(buf_.Get());
-    PERFETTO_DCHECK(reinterpret_cast<uintptr_t>(buf) % 16 == 0);
-    size_t payload_size = reinterpret_cast<logger_entry_v4*>(buf)->len;
-    size_t hdr_size = reinterpret_cast<logger_entry_v4*>(buf)->hdr_size;
-    if (payload_size + hdr_size > static_cast<size_t>(rsize)) {
-      PERFETTO_DLOG(
-          "Invalid Android log frame (hdr: %zu, payload: %zu, rsize: %zd)",
-          hdr_size, payload_size, rsize);
-      stats_.num_failed++;
-      continue;
-    }
-    char* const end = buf + hdr_size + payload_size;
-
-    // In older versions of Android the logger_entry struct can contain less
-    // fields. Copy that in a temporary struct, so that unset fields are
-    // always zero-initialized.
-    logger_entry_v4 entry{};
-    memcpy(&entry, buf, std::min(hdr_size, sizeof(entry)));
-    buf += hdr_size;
-
-    if (!packet) {
-      // Lazily add the packet on the first event. This is to avoid creating
-      // empty packets if there are no events in a task.
-      packet = writer_->NewTracePacket();
-      packet->set_timestamp(
-          static_cast<uint64_t>(base::GetBootTimeNs().count()));
-      log_packet = packet->set_android_log();
-    }
 
-    protos::pbzero::AndroidLogPacket::LogEvent* evt = nullptr;
-
-    if (entry.lid == AndroidLogId::LID_EVENTS) {
-      // Entries in the EVENTS buffer are special, they are binary encoded.
-      // See https://developer.android.com/reference/android/util/EventLog.
-      if (!ParseBinaryEvent(buf, end, log_packet, &evt)) {
-        PERFETTO_DLOG("Failed to parse Android log binary event");
+    for (size_t msg_idx = 0; msg_idx < num_msgs; msg_idx++) {
+      stats_.num_total++;
+      size_t rsize = entry_sizes[msg_idx];
+      char* buf = reinterpret_cast<char*>(buf_.Get()) + msg_idx * kBufSize;
+      PERFETTO_DCHECK(reinterpret_cast<uintptr_t>(buf) % 16 == 0);
+      size_t payload_size = reinterpret_cast<logger_entry_v4*>(buf)->len;
+      size_t hdr_size = reinterpret_cast<logger_entry_v4*>(buf)->hdr_size;
+      if (payload_size + hdr_size > rsize) {
+        PERFETTO_DLOG(
+            "Invalid Android log frame (hdr: %zu, payload: %zu, rsize: %zu)",
+            hdr_size, payload_size, rsize);
         stats_.num_failed++;
         continue;
       }
-    } else {
-      if (!ParseTextEvent(buf, end, log_packet, &evt)) {
-        PERFETTO_DLOG("Failed to parse Android log text event");
-        stats_.num_failed++;
+      char* const end = buf + hdr_size + payload_size;
+
+      // In older versions of Android the logger_entry struct can contain less
+      // fields. Copy that in a temporary struct, so that unset fields are
+      // always zero-initialized.
+      logger_entry_v4 entry{};
+      memcpy(&entry, buf, std::min(hdr_size, sizeof(entry)));
+      buf += hdr_size;
+
+      if (!packet) {
+        // Lazily add the packet on the first event. This is to avoid creating
+        // empty packets if there are no events in a task.
+        packet = writer_->NewTracePacket();
+        packet->set_timestamp(
+            static_cast<uint64_t>(base::GetBootTimeNs().count()));
+        log_packet = packet->set_android_log();
+      }
+
+      protos::pbzero::AndroidLogPacket::LogEvent* evt = nullptr;
+
+      if (entry.lid == AndroidLogId::LID_EVENTS) {
+        // Entries in the EVENTS buffer are special, they are binary encoded.
+        // See https://developer.android.com/reference/android/util/EventLog.
+        if (!ParseBinaryEvent(buf, end, log_packet, &evt)) {
+          PERFETTO_DLOG("Failed to parse Android log binary event");
+          stats_.num_failed++;
+          continue;
+        }
+      } else {
+        if (!ParseTextEvent(buf, end, log_packet, &evt)) {
+          PERFETTO_DLOG("Failed to parse Android log text event");
+          stats_.num_failed++;
+          continue;
+        }
+      }
+      if (!evt) {
+        // Parsing succeeded but the event was skipped due to filters.
+        stats_.num_skipped++;
         continue;
       }
-    }
-    if (!evt) {
-      // Parsing succeeded but the event was skipped due to filters.
-      stats_.num_skipped++;
-      continue;
-    }
 
-    // Add the common fields to the event.
-    uint64_t ts = entry.sec * 1000000000ULL + entry.nsec;
-    evt->set_timestamp(ts);
-    evt->set_log_id(static_cast<protos::pbzero::AndroidLogId>(entry.lid));
-    evt->set_pid(entry.pid);
-    evt->set_tid(static_cast<int32_t>(entry.tid));
-    evt->set_uid(static_cast<int32_t>(entry.uid));
-  }  // while(logdr_sock_.Receive())
+      // Add the common fields to the event.
+      uint64_t ts = entry.sec * 1000000000ULL + entry.nsec;
+      evt->set_timestamp(ts);
+      evt->set_log_id(static_cast<protos::pbzero::AndroidLogId>(entry.lid));
+      evt->set_pid(entry.pid);
+      evt->set_tid(static_cast<int32_t>(entry.tid));
+      evt->set_uid(static_cast<int32_t>(entry.uid));
+    }  // for (msg_idx)
+  }  // while (ReceiveLogEntries())
 
   // Only print the log message if we have seen a bunch of events. This is to
   // avoid that we keep re-triggering the log socket by writing into the log
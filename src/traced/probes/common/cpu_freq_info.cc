@@ -16,6 +16,7 @@
 
 #include "src/traced/probes/common/cpu_freq_info.h"
 
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <set>
@@ -42,6 +43,22 @@ void ReadAndAppendFreqs(std::set<CpuAndFreq>* freqs,
   }
 }
 
+// Re-reads a frequency from the start of the already open sysfs file |fd|.
+// Returns 0 and closes |fd| (so that it's reopened next time) on failure.
+uint32_t ReadFreqFromFd(base::ScopedFile* fd) {
+  char buf[32];
+  ssize_t res = pread(**fd, buf, sizeof(buf) - 1, 0);
+  if (res <= 0) {
+    fd->reset();
+    return 0;
+  }
+  size_t size = static_cast<size_t>(res);
+  if (buf[size - 1] == '\n')
+    size--;
+  buf[size] = '\0';
+  return base::CStringToUInt32(buf).value_or(0);
+}
+
 }  // namespace
 
 CpuFreqInfo::CpuFreqInfo(std::string sysfs_cpu_path)
@@ -124,23 +141,20 @@ std::string CpuFreqInfo::ReadFile(std::string path) {
 const std::vector<uint32_t>& CpuFreqInfo::ReadCpuCurrFreq() {
   // Check if capacity of cpu_curr_freq_ is enough for all CPUs
   auto num_cpus = static_cast<size_t>(sysconf(_SC_NPROCESSORS_CONF));
-  if (cpu_curr_freq_.size() < num_cpus)
+  if (cpu_curr_freq_.size() < num_cpus) {
     cpu_curr_freq_.resize(num_cpus);
+    cpu_curr_freq_fds_.resize(num_cpus);
+  }
 
   for (uint32_t i = 0; i < cpu_curr_freq_.size(); i++) {
     // Read CPU current frequency. Set 0 for offline/disabled cpus.
-    std::string buf(ReadFile(sysfs_cpu_path_ + "/cpu" + std::to_string(i) +
-                             "/cpufreq/scaling_cur_freq"));
-    if (buf.empty()) {
-      cpu_curr_freq_[i] = 0;
-      continue;
-    }
-    auto freq = base::StringToUInt32(base::StripSuffix(buf, "\n"));
-    if (!freq.has_value()) {
-      cpu_curr_freq_[i] = 0;
-      continue;
+    base::ScopedFile& fd = cpu_curr_freq_fds_[i];
+    if (!fd) {
+      fd = base::OpenFile(sysfs_cpu_path_ + "/cpu" + std::to_string(i) +
+                              "/cpufreq/scaling_cur_freq",
+                          O_RDONLY);
     }
-    cpu_curr_freq_[i] = freq.value();
+    cpu_curr_freq_[i] = fd ? ReadFreqFromFd(&fd) : 0;
   }
   return cpu_curr_freq_;
 }
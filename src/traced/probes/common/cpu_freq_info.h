@@ -48,6 +48,8 @@ class CpuFreqInfo {
   std::vector<size_t> frequencies_index_;
   // Placeholder for CPU current frequency, refresh in ReadCpuCurrFreq()
   std::vector<uint32_t> cpu_curr_freq_;
+  // The scaling_cur_freq file of each CPU, kept open across polls.
+  std::vector<base::ScopedFile> cpu_curr_freq_fds_;
 
   std::string ReadFile(std::string path);
 };
@@ -17,6 +17,8 @@
 #include "src/traced/probes/filesystem/file_scanner.h"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -119,24 +121,43 @@ void FileScanner::Step() {
     return;
   }
 
-  std::string filename = entry->d_name;
-  if (filename == "." || filename == "..")
+  const char* filename = entry->d_name;
+  if (strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0)
     return;
 
-  std::string filepath = JoinPaths(current_directory_, filename);
+  unsigned char d_type = entry->d_type;
+  if (d_type == DT_UNKNOWN) {
+    // Some filesystems don't fill d_type. Fall back to a stat of the entry
+    // relative to the open directory, so that we still descend into it.
+    struct stat buf;
+    if (fstatat(dirfd(current_dir_handle_.get()), filename, &buf,
+                AT_SYMLINK_NOFOLLOW) == 0) {
+      if (S_ISDIR(buf.st_mode))
+        d_type = DT_DIR;
+      else if (S_ISREG(buf.st_mode))
+        d_type = DT_REG;
+    }
+  }
 
   protos::pbzero::InodeFileMap_Entry_Type type =
       protos::pbzero::InodeFileMap::Entry::Type::UNKNOWN;
-  // Readdir and stat not guaranteed to have directory info for all systems
-  if (entry->d_type == DT_DIR) {
+  std::string filepath;
+  if (d_type == DT_DIR) {
     // Continue iterating through files if current entry is a directory
+    filepath = JoinPaths(current_directory_, filename);
     queue_.emplace_back(filepath);
     type = protos::pbzero::InodeFileMap::Entry::Type::DIRECTORY;
-  } else if (entry->d_type == DT_REG) {
+  } else if (d_type == DT_REG) {
     type = protos::pbzero::InodeFileMap::Entry::Type::FILE;
   }
 
-  if (!delegate_->OnInodeFound(current_block_device_id_, entry->d_ino, filepath,
+  Inode inode = entry->d_ino;
+  if (!delegate_->IsInodeWanted(current_block_device_id_, inode))
+    return;
+
+  if (filepath.empty())
+    filepath = JoinPaths(current_directory_, filename);
+  if (!delegate_->OnInodeFound(current_block_device_id_, inode, filepath,
                                type)) {
     queue_.clear();
     current_dir_handle_.reset();
@@ -152,6 +173,10 @@ bool FileScanner::Done() {
   return !current_dir_handle_ && queue_.empty();
 }
 
+bool FileScanner::Delegate::IsInodeWanted(BlockDeviceID, Inode) {
+  return true;
+}
+
 FileScanner::Delegate::~Delegate() = default;
 
 }  // namespace perfetto
@@ -31,6 +31,11 @@ class FileScanner {
  public:
   class Delegate {
    public:
+    // Called for every directory entry before its path is built. Returning
+    // false skips OnInodeFound for the entry, which avoids allocating the
+    // path of the (typically many) entries the delegate is not looking for.
+    // Directories are still descended into.
+    virtual bool IsInodeWanted(BlockDeviceID, Inode);
     virtual bool OnInodeFound(BlockDeviceID,
                               Inode,
                               const std::string&,
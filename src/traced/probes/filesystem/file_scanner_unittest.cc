@@ -51,7 +51,16 @@ class TestDelegate : public FileScanner::Delegate {
 
   void OnInodeScanDone() { return done_callback_(); }
 
+  bool IsInodeWanted(BlockDeviceID block_device_id, Inode inode) override {
+    return !wanted_callback_ || wanted_callback_(block_device_id, inode);
+  }
+
+  void set_wanted_callback(std::function<bool(BlockDeviceID, Inode)> cb) {
+    wanted_callback_ = std::move(cb);
+  }
+
  private:
+  std::function<bool(BlockDeviceID, Inode)> wanted_callback_;
   std::function<
       bool(BlockDeviceID, Inode, const std::string&, InodeFileMap_Entry_Type)>
       callback_;
@@ -197,5 +206,31 @@ TEST(FileScannerTest, TestAsynchronousFindFiles) {
               protos::pbzero::InodeFileMap::Entry::Type::DIRECTORY))));
 }
 
+TEST(FileScannerTest, TestOnlyWantedInodesReported) {
+  std::string file1 = base::GetTestDataPath(
+      "src/traced/probes/filesystem/testdata/dir1/file1");
+  Inode wanted = CheckStat(file1).st_ino;
+  std::vector<FileEntry> file_entries;
+  TestDelegate delegate(
+      [&file_entries](BlockDeviceID block_device_id, Inode inode,
+                      const std::string& path, InodeFileMap_Entry_Type type) {
+        file_entries.emplace_back(block_device_id, inode, path, type);
+        return true;
+      },
+      [] {});
+  delegate.set_wanted_callback(
+      [wanted](BlockDeviceID, Inode inode) { return inode == wanted; });
+
+  FileScanner fs(
+      {base::GetTestDataPath("src/traced/probes/filesystem/testdata")},
+      &delegate);
+  fs.Scan();
+
+  // dir1 itself is not reported but is still descended into.
+  EXPECT_THAT(file_entries,
+              UnorderedElementsAre(Eq(StatFileEntry(
+                  file1, protos::pbzero::InodeFileMap::Entry::Type::FILE))));
+}
+
 }  // namespace
 }  // namespace perfetto
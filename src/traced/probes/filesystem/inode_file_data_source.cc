@@ -298,6 +298,12 @@ void InodeFileDataSource::RemoveFromNextMissingInodes(
   it->second.erase(inode_number);
 }
 
+bool InodeFileDataSource::IsInodeWanted(BlockDeviceID block_device_id,
+                                        Inode inode_number) {
+  auto it = missing_inodes_.find(block_device_id);
+  return it != missing_inodes_.end() && it->second.count(inode_number) > 0;
+}
+
 bool InodeFileDataSource::OnInodeFound(BlockDeviceID block_device_id,
                                        Inode inode_number,
                                        const std::string& path,
@@ -96,6 +96,8 @@ class InodeFileDataSource : public ProbesDataSource,
   void FindMissingInodes();
 
   // Callbacks for dynamic filesystem scan.
+  bool IsInodeWanted(BlockDeviceID block_device_id,
+                     Inode inode_number) override;
   bool OnInodeFound(BlockDeviceID block_device_id,
                     Inode inode_number,
                     const std::string& path,
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/compact_events.h"
+
+#include "perfetto/base/logging.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+
+namespace perfetto {
+
+bool IsCompactEncodable(const Event& event) {
+  using protos::pbzero::FtraceEvent;
+
+  // These events are either not encoded field by field, or their parsing has
+  // side effects on the metadata which depend on the event type.
+  switch (event.proto_field_id) {
+    case 0:
+    case FtraceEvent::kGenericFieldNumber:
+    case FtraceEvent::kSysEnterFieldNumber:
+    case FtraceEvent::kSysExitFieldNumber:
+    case FtraceEvent::kTaskRenameFieldNumber:
+      return false;
+    default:
+      break;
+  }
+  for (const Field& field : event.fields) {
+    if (field.strategy == kInvalidTranslationStrategy)
+      return false;
+  }
+  return true;
+}
+
+bool IsCompactStringField(const Field& field) {
+  switch (field.strategy) {
+    case kFixedCStringToString:
+    case kCStringToString:
+    case kStringPtrToString:
+    case kDataLocToString:
+      return true;
+    default:
+      return false;
+  }
+}
+
+CompactEventColumns::CompactEventColumns(const Event& event)
+    : event_(event),
+      fields_(new protozero::PackedVarInt[event.fields.size()]) {}
+
+CompactEventColumns::~CompactEventColumns() = default;
+
+void CompactEventColumns::Write(
+    protos::pbzero::FtraceEventBundle::CompactEvents* compact_out) const {
+  auto* event_out = compact_out->add_event();
+  event_out->set_id(event_.proto_field_id);
+  event_out->set_timestamp(timestamp_);
+  if (pid_.size() > 0)
+    event_out->set_pid(pid_);
+  for (size_t i = 0; i < event_.fields.size(); i++) {
+    const Field& field = event_.fields[i];
+    auto* field_out = event_out->add_field();
+    field_out->set_id(field.proto_field_id);
+    if (IsCompactStringField(field)) {
+      field_out->set_string_index(fields_[i]);
+    } else {
+      field_out->set_varint(fields_[i]);
+    }
+  }
+}
+
+void CompactEventColumns::Reset() {
+  last_timestamp_ = 0;
+  timestamp_.Reset();
+  pid_.Reset();
+  for (size_t i = 0; i < event_.fields.size(); i++)
+    fields_[i].Reset();
+}
+
+CompactEventsInterner::CompactEventsInterner() = default;
+CompactEventsInterner::~CompactEventsInterner() = default;
+
+uint32_t CompactEventsInterner::InternString(base::StringView str) {
+  uint32_t* index = indices_.Find(str);
+  if (index)
+    return *index;
+  strings_.emplace_back(str.data(), str.size());
+  const std::string& interned = strings_.back();
+  uint32_t new_index = static_cast<uint32_t>(strings_.size() - 1);
+  indices_.Insert(base::StringView(interned), new_index);
+  return new_index;
+}
+
+void CompactEventsInterner::Write(
+    protos::pbzero::FtraceEventBundle::CompactEvents* compact_out) const {
+  for (const std::string& str : strings_)
+    compact_out->add_intern_table(str.data(), str.size());
+}
+
+void CompactEventsInterner::Reset() {
+  strings_.clear();
+  indices_.Clear();
+}
+
+CompactEventsBuffer::CompactEventsBuffer() = default;
+CompactEventsBuffer::~CompactEventsBuffer() = default;
+
+void CompactEventsBuffer::WriteAndReset(
+    protos::pbzero::FtraceEventBundle* bundle) {
+  protos::pbzero::FtraceEventBundle::CompactEvents* compact_out = nullptr;
+  for (const auto& columns : columns_) {
+    if (columns->empty())
+      continue;
+    if (!compact_out) {
+      compact_out = bundle->set_compact_events();
+      interner_.Write(compact_out);
+    }
+    columns->Write(compact_out);
+    columns->Reset();
+  }
+  interner_.Reset();
+}
+
+}  // namespace perfetto
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_FTRACE_COMPACT_EVENTS_H_
+#define SRC_TRACED_PROBES_FTRACE_COMPACT_EVENTS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/string_view.h"
+#include "perfetto/protozero/packed_repeated_fields.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "src/traced/probes/ftrace/event_info_constants.h"
+
+namespace perfetto {
+
+// Returns true if |event| can be recorded in the compact encoding of
+// FtraceEventBundle.compact_events (see FtraceConfig.compact_events), i.e. if
+// it's parsed field by field without any special-cased handling.
+bool IsCompactEncodable(const Event& event);
+
+// Returns true if the values of |field| are recorded as interned strings in the
+// compact encoding, rather than as varints.
+bool IsCompactStringField(const Field& field);
+
+// Collects the fields of all the events of one type, allowing them to be
+// written out in the compact encoding. Each field of the event is stored in its
+// own column, in the same order as |Event::fields|.
+class CompactEventColumns {
+ public:
+  explicit CompactEventColumns(const Event& event);
+  ~CompactEventColumns();
+
+  const Event& event() const { return event_; }
+
+  protozero::PackedVarInt& pid() { return pid_; }
+  protozero::PackedVarInt& field(size_t i) { return fields_[i]; }
+
+  bool empty() const { return timestamp_.size() == 0; }
+
+  inline void AppendTimestamp(uint64_t timestamp) {
+    timestamp_.Append(timestamp - last_timestamp_);
+    last_timestamp_ = timestamp;
+  }
+
+  void Write(
+      protos::pbzero::FtraceEventBundle::CompactEvents* compact_out) const;
+  void Reset();
+
+ private:
+  const Event& event_;
+
+  // First timestamp in a bundle is absolute. The rest are all delta-encoded,
+  // each relative to the preceding event of the same type.
+  uint64_t last_timestamp_ = 0;
+
+  protozero::PackedVarInt timestamp_;
+  protozero::PackedVarInt pid_;
+  // One column per entry of |event_.fields|. String fields hold the interning
+  // indices of the values. See |CompactEventsInterner|.
+  std::unique_ptr<protozero::PackedVarInt[]> fields_;
+};
+
+// Interns the values of the string fields of the compact events of a bundle.
+class CompactEventsInterner {
+ public:
+  CompactEventsInterner();
+  ~CompactEventsInterner();
+
+  uint32_t InternString(base::StringView str);
+
+  size_t size() const { return strings_.size(); }
+
+  void Write(
+      protos::pbzero::FtraceEventBundle::CompactEvents* compact_out) const;
+  void Reset();
+
+ private:
+  // A deque, as the keys of |indices_| point into its strings, which must not
+  // move when more are added.
+  std::deque<std::string> strings_;
+  base::FlatHashMap<base::StringView, uint32_t> indices_;
+};
+
+// Mutable state for buffering the events selected for the compact encoding,
+// that can later be written out with |WriteAndReset|. Used by the ftrace
+// reader.
+class CompactEventsBuffer {
+ public:
+  CompactEventsBuffer();
+  ~CompactEventsBuffer();
+
+  // Returns the columns of the events of the same type as |event|, creating
+  // them on first use. |event| must outlive this buffer.
+  CompactEventColumns* GetOrCreateColumns(const Event& event) {
+    // There are only a handful of compact event types, a linear scan is faster
+    // than a hash lookup.
+    for (const auto& columns : columns_) {
+      if (&columns->event() == &event)
+        return columns.get();
+    }
+    columns_.emplace_back(new CompactEventColumns(event));
+    return columns_.back().get();
+  }
+
+  CompactEventsInterner& interner() { return interner_; }
+  const CompactEventsInterner& interner() const { return interner_; }
+
+  // Writes out the currently buffered events, and starts the next batch
+  // internally.
+  void WriteAndReset(protos::pbzero::FtraceEventBundle* bundle);
+
+ private:
+  CompactEventsInterner interner_;
+  // Kept (and reused) across batches, even when empty.
+  std::vector<std::unique_ptr<CompactEventColumns>> columns_;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FTRACE_COMPACT_EVENTS_H_
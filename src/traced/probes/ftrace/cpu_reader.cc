@@ -54,6 +54,9 @@ namespace {
 // This is not an exact cap, since we check only at tracing page boundaries.
 constexpr size_t kCompactSchedInternerThreshold = 64;
 
+// As above, for the interned strings of the compact_events buffer.
+constexpr size_t kCompactEventsInternerThreshold = 256;
+
 // For further documentation of these constants see the kernel source:
 //   linux/include/linux/ring_buffer.h
 // Some of this is also available to userspace at runtime via:
@@ -155,6 +158,23 @@ void LogInvalidPage(const void* start, size_t size) {
   }
 }
 
+// Returns true if the event encoded from |start| to |end| was emitted by one of
+// the FtraceConfig.event_pids of |ds_config|. Events without a common_pid are
+// always kept.
+bool IsEventPidAllowed(const uint8_t* start,
+                       const uint8_t* end,
+                       const ProtoTranslationTable* table,
+                       const FtraceDataSourceConfig* ds_config) {
+  const Field* common_pid_field = table->common_pid();
+  if (!common_pid_field ||
+      common_pid_field->ftrace_offset + sizeof(int32_t) >
+          static_cast<size_t>(end - start)) {
+    return true;
+  }
+  int32_t pid = ReadValue<int32_t>(start + common_pid_field->ftrace_offset);
+  return ds_config->event_pids.count(pid) > 0;
+}
+
 }  // namespace
 
 using protos::pbzero::GenericFtraceEvent;
@@ -292,8 +312,13 @@ size_t CpuReader::ReadAndProcessBatch(
     return pages_read;
 
   for (FtraceDataSource* data_source : started_data_sources) {
+    if (data_source->parsing_config()->raw_pages) {
+      WriteRawPages(data_source, parsing_buf, pages_read);
+      continue;
+    }
     size_t pages_parsed_ok = ProcessPagesForDataSource(
-        data_source->trace_writer(), data_source->mutable_metadata(), cpu_,
+        data_source->trace_writer_for_cpu(cpu_),
+        data_source->metadata_for_cpu(cpu_), cpu_,
         data_source->parsing_config(), parsing_buf, pages_read, table_,
         symbolizer_, ftrace_clock_snapshot_, ftrace_clock_);
     // If this happens, it means that we did not know how to parse the kernel
@@ -312,6 +337,43 @@ size_t CpuReader::ReadAndProcessBatch(
   return pages_read;
 }
 
+void CpuReader::WriteRawPages(FtraceDataSource* data_source,
+                              const uint8_t* parsing_buf,
+                              size_t pages_read) {
+  auto packet = data_source->trace_writer_for_cpu(cpu_)->NewTracePacket();
+  auto* bundle = packet->set_ftrace_events();
+  bundle->set_cpu(static_cast<uint32_t>(cpu_));
+  if (ftrace_clock_) {
+    bundle->set_ftrace_clock(ftrace_clock_);
+    if (ftrace_clock_snapshot_ && ftrace_clock_snapshot_->ftrace_clock_ts) {
+      bundle->set_ftrace_timestamp(ftrace_clock_snapshot_->ftrace_clock_ts);
+      bundle->set_boot_timestamp(ftrace_clock_snapshot_->boot_clock_ts);
+    }
+  }
+  if (data_source->ShouldWriteRawPagesFormat(cpu_)) {
+    const std::string& format = data_source->raw_pages_format();
+    bundle->AppendBytes(
+        protos::pbzero::FtraceEventBundle::kRawPagesFormatFieldNumber,
+        format.data(), format.size());
+  }
+
+  // The pages are copied verbatim, only trimming the unused tail of each page
+  // after its committed data.
+  const size_t header_size = sizeof(uint64_t) + table_->page_header_size_len();
+  for (size_t i = 0; i < pages_read; i++) {
+    const uint8_t* page = parsing_buf + (i * base::kPageSize);
+    const uint8_t* ptr = page;
+    std::optional<PageHeader> page_header =
+        ParsePageHeader(&ptr, table_->page_header_size_len());
+    size_t size = base::kPageSize;
+    if (page_header) {
+      size = std::min(size,
+                      header_size + static_cast<size_t>(page_header->size));
+    }
+    bundle->add_raw_pages(page, size);
+  }
+}
+
 void CpuReader::Bundler::StartNewPacket(bool lost_events) {
   FinalizeAndRunSymbolizer();
   packet_ = trace_writer_->NewTracePacket();
@@ -339,13 +401,19 @@ void CpuReader::Bundler::FinalizeAndRunSymbolizer() {
   if (compact_sched_enabled_) {
     compact_sched_buffer_.WriteAndReset(bundle_);
   }
+  compact_events_buffer_.WriteAndReset(bundle_);
 
   bundle_->Finalize();
   bundle_ = nullptr;
   // Write the kernel symbol index (mangled address) -> name table.
-  // |metadata| is shared across all cpus, is distinct per |data_source| (i.e.
-  // tracing session) and is cleared after each FtraceController::ReadTick().
-  if (symbolizer_) {
+  // |metadata| is shared across all cpus (unless the cpus are read on
+  // multiple threads, see FtraceDataSource::metadata_for_cpu()), is distinct
+  // per |data_source| (i.e. tracing session) and is cleared after each
+  // FtraceController::ReadTick().
+  // The symbol map is created on the main thread when the data source starts.
+  // Use symbol_map() rather than GetOrCreateKernelSymbolMap(), as this can run
+  // on a reader thread.
+  if (symbolizer_ && symbolizer_->is_valid()) {
     // Symbol indexes are assigned mononically as |kernel_addrs.size()|,
     // starting from index 1 (no symbol has index 0). Here we remember the
     // size() (which is also == the highest value in |kernel_addrs|) at the
@@ -353,7 +421,7 @@ void CpuReader::Bundler::FinalizeAndRunSymbolizer() {
     uint32_t max_index_at_start = metadata_->last_kernel_addr_index_written;
     PERFETTO_DCHECK(max_index_at_start <= metadata_->kernel_addrs.size());
     protos::pbzero::InternedData* interned_data = nullptr;
-    auto* ksyms_map = symbolizer_->GetOrCreateKernelSymbolMap();
+    auto* ksyms_map = symbolizer_->symbol_map();
     bool wrote_at_least_one_symbol = false;
     for (const FtraceMetadata::KernelAddr& kaddr : metadata_->kernel_addrs) {
       if (kaddr.index <= max_index_at_start)
@@ -436,13 +504,15 @@ size_t CpuReader::ProcessPagesForDataSource(
     // * The page we're about to read indicates that there was a kernel ring
     //   buffer overrun since our last read from that per-cpu buffer. We have
     //   a single |lost_events| field per bundle, so start a new packet.
-    // * The compact_sched buffer is holding more unique interned strings than
-    //   a threshold. We need to flush the compact buffer to make the
-    //   interning lookups cheap again.
+    // * The compact_sched (or compact_events) buffer is holding more unique
+    //   interned strings than a threshold. We need to flush the compact buffer
+    //   to make the interning lookups cheap again.
     bool interner_past_threshold =
-        compact_sched_enabled &&
-        bundler.compact_sched_buffer()->interner().interned_comms_size() >
-            kCompactSchedInternerThreshold;
+        (compact_sched_enabled &&
+         bundler.compact_sched_buffer()->interner().interned_comms_size() >
+             kCompactSchedInternerThreshold) ||
+        bundler.compact_events_interner_size() >
+            kCompactEventsInternerThreshold;
 
     if (page_header->lost_events || interner_past_threshold) {
       bundler.StartNewPacket(page_header->lost_events);
@@ -611,7 +681,9 @@ size_t CpuReader::ParsePagePayload(const uint8_t* start_of_payload,
         if (!ReadAndAdvance<uint16_t>(&ptr, end, &ftrace_event_id))
           return 0;
 
-        if (ds_config->event_filter.IsEventEnabled(ftrace_event_id)) {
+        if (ds_config->event_filter.IsEventEnabled(ftrace_event_id) &&
+            (ds_config->event_pids.empty() ||
+             IsEventPidAllowed(start, next, table, ds_config))) {
           // Special-cased handling of some scheduler events when compact format
           // is enabled.
           bool compact_sched_enabled = ds_config->compact_sched.enabled;
@@ -651,6 +723,13 @@ size_t CpuReader::ParsePagePayload(const uint8_t* start_of_payload,
                               event, metadata))
                 return 0;
             }
+          } else if (ds_config->compact_events.IsEventEnabled(
+                         ftrace_event_id)) {
+            const Event& info = *table->GetEventById(ftrace_event_id);
+            if (!ParseEventCompact(info, start, next, timestamp, table,
+                                   bundler->compact_events_buffer(),
+                                   metadata))
+              return 0;
           } else {
             // Common case: parse all other types of enabled events.
             protos::pbzero::FtraceEvent* event =
@@ -720,6 +799,9 @@ bool CpuReader::ParseEvent(uint16_t ftrace_event_id,
                  info.proto_field_id ==
                  protos::pbzero::FtraceEvent::kSysExitFieldNumber)) {
     success &= ParseSysExit(info, start, end, ds_config, nested, metadata);
+  } else if (PERFETTO_LIKELY(info.specialized_layout !=
+                             SpecializedLayout::kNone)) {
+    success &= ParseFieldsWithLayout(info, start, end, table, nested, metadata);
   } else {  // Parse all other events.
     for (const Field& field : info.fields) {
       success &= ParseField(field, start, end, table, nested, metadata);
@@ -752,11 +834,26 @@ bool CpuReader::ParseField(const Field& field,
                            const ProtoTranslationTable* table,
                            protozero::Message* message,
                            FtraceMetadata* metadata) {
+  return ParseFieldWithStrategy(field.strategy, field, start, end, table,
+                                message, metadata);
+}
+
+// Always inlined so that the switch below is folded away when |strategy| is a
+// compile-time constant, as in ParseFieldsWithLayout().
+PERFETTO_ALWAYS_INLINE
+bool CpuReader::ParseFieldWithStrategy(TranslationStrategy strategy,
+                                       const Field& field,
+                                       const uint8_t* start,
+                                       const uint8_t* end,
+                                       const ProtoTranslationTable* table,
+                                       protozero::Message* message,
+                                       FtraceMetadata* metadata) {
+  PERFETTO_DCHECK(field.strategy == strategy);
   PERFETTO_DCHECK(start + field.ftrace_offset + field.ftrace_size <= end);
   const uint8_t* field_start = start + field.ftrace_offset;
   uint32_t field_id = field.proto_field_id;
 
-  switch (field.strategy) {
+  switch (strategy) {
     case kUint8ToUint32:
     case kUint8ToUint64:
       ReadIntoVarInt<uint8_t>(field_start, field_id, message);
@@ -846,6 +943,48 @@ bool CpuReader::ParseField(const Field& field,
   PERFETTO_FATAL("Unexpected translation strategy");
 }
 
+namespace {
+
+// The parser of the events with the layout |kStrategies|: a straight-line
+// sequence of inlined field parsers.
+template <TranslationStrategy... kStrategies>
+bool ParseFieldsWithStrategies(const Event& info,
+                               const uint8_t* start,
+                               const uint8_t* end,
+                               const ProtoTranslationTable* table,
+                               protozero::Message* message,
+                               FtraceMetadata* metadata) {
+  PERFETTO_DCHECK(info.fields.size() == sizeof...(kStrategies));
+  const Field* field = info.fields.data();
+  bool success = true;
+  ((success &= CpuReader::ParseFieldWithStrategy(
+        kStrategies, *field++, start, end, table, message, metadata)),
+   ...);
+  return success;
+}
+
+}  // namespace
+
+// static
+bool CpuReader::ParseFieldsWithLayout(const Event& info,
+                                      const uint8_t* start,
+                                      const uint8_t* end,
+                                      const ProtoTranslationTable* table,
+                                      protozero::Message* message,
+                                      FtraceMetadata* metadata) {
+  switch (info.specialized_layout) {
+#define PERFETTO_FTRACE_LAYOUT_CASE(name, ...)                              \
+  case SpecializedLayout::name:                                             \
+    return ParseFieldsWithStrategies<__VA_ARGS__>(info, start, end, table, \
+                                                  message, metadata);
+    PERFETTO_FTRACE_SPECIALIZED_LAYOUTS(PERFETTO_FTRACE_LAYOUT_CASE)
+#undef PERFETTO_FTRACE_LAYOUT_CASE
+    case SpecializedLayout::kNone:
+      break;
+  }
+  PERFETTO_FATAL("Unexpected specialized layout");
+}
+
 bool CpuReader::ParseSysEnter(const Event& info,
                               const uint8_t* start,
                               const uint8_t* end,
@@ -998,4 +1137,155 @@ void CpuReader::ParseSchedWakingCompact(const uint8_t* start,
   compact_buf->sched_waking().common_flags().Append(common_flags);
 }
 
+// Mirrors ParseEvent() and ParseFieldWithStrategy(), but appends the value of
+// each field to its column instead of writing it into a proto. Integer values
+// are varint-encoded exactly as ParseFieldWithStrategy() would, so that the
+// trace processor can rebuild the equivalent FtraceEvent.
+// static
+bool CpuReader::ParseEventCompact(const Event& info,
+                                  const uint8_t* start,
+                                  const uint8_t* end,
+                                  uint64_t timestamp,
+                                  const ProtoTranslationTable* table,
+                                  CompactEventsBuffer* compact_buf,
+                                  FtraceMetadata* metadata) {
+  PERFETTO_DCHECK(start < end);
+  if (info.size > static_cast<size_t>(end - start)) {
+    PERFETTO_DFATAL("Buffer overflowed.");
+    return false;
+  }
+
+  CompactEventColumns* columns = compact_buf->GetOrCreateColumns(info);
+  CompactEventsInterner& interner = compact_buf->interner();
+  columns->AppendTimestamp(timestamp);
+
+  const Field* common_pid_field = table->common_pid();
+  if (PERFETTO_LIKELY(common_pid_field)) {
+    int32_t pid = ReadValue<int32_t>(start + common_pid_field->ftrace_offset);
+    columns->pid().Append(pid);
+    metadata->AddCommonPid(pid);
+  }
+
+  for (size_t i = 0; i < info.fields.size(); i++) {
+    const Field& field = info.fields[i];
+    const uint8_t* field_start = start + field.ftrace_offset;
+    protozero::PackedVarInt& column = columns->field(i);
+    switch (field.strategy) {
+      case kUint8ToUint32:
+      case kUint8ToUint64:
+      case kBoolToUint32:
+      case kBoolToUint64:
+        column.Append(ReadValue<uint8_t>(field_start));
+        break;
+      case kUint16ToUint32:
+      case kUint16ToUint64:
+        column.Append(ReadValue<uint16_t>(field_start));
+        break;
+      case kUint32ToUint32:
+      case kUint32ToUint64:
+        column.Append(ReadValue<uint32_t>(field_start));
+        break;
+      case kUint64ToUint64:
+        column.Append(ReadValue<uint64_t>(field_start));
+        break;
+      case kInt8ToInt32:
+      case kInt8ToInt64:
+        column.Append(ReadValue<int8_t>(field_start));
+        break;
+      case kInt16ToInt32:
+      case kInt16ToInt64:
+        column.Append(ReadValue<int16_t>(field_start));
+        break;
+      case kInt32ToInt32:
+      case kInt32ToInt64:
+        column.Append(ReadValue<int32_t>(field_start));
+        break;
+      case kInt64ToInt64:
+        column.Append(ReadValue<int64_t>(field_start));
+        break;
+      case kFixedCStringToString: {
+        const char* str = reinterpret_cast<const char*>(field_start);
+        column.Append(interner.InternString(
+            base::StringView(str, strnlen(str, field.ftrace_size))));
+        break;
+      }
+      case kCStringToString: {
+        const char* str = reinterpret_cast<const char*>(field_start);
+        size_t max_len = static_cast<size_t>(end - field_start);
+        column.Append(interner.InternString(
+            base::StringView(str, strnlen(str, max_len))));
+        break;
+      }
+      case kStringPtrToString: {
+        uint64_t n = 0;
+        size_t size = std::min<size_t>(field.ftrace_size, sizeof(n));
+        memcpy(base::AssumeLittleEndian(&n),
+               reinterpret_cast<const void*>(field_start), size);
+        column.Append(interner.InternString(table->LookupTraceString(n)));
+        break;
+      }
+      case kDataLocToString: {
+        // See ReadDataLoc(). Unlike there, empty strings are recorded, as
+        // every event needs a value in each column.
+        uint32_t data = ReadValue<uint32_t>(field_start);
+        const uint16_t offset = data & 0xffff;
+        const uint16_t len = (data >> 16) & 0xffff;
+        const uint8_t* const string_start = start + offset;
+        if (PERFETTO_UNLIKELY(len > 0 && string_start + len > end)) {
+          PERFETTO_DFATAL("__data_loc points at invalid location");
+          return false;
+        }
+        const char* str = reinterpret_cast<const char*>(string_start);
+        column.Append(interner.InternString(
+            base::StringView(str, len > 0 ? strnlen(str, len) : 0)));
+        break;
+      }
+      case kInode32ToUint64:
+      case kInode64ToUint64: {
+        uint64_t inode = field.strategy == kInode32ToUint64
+                             ? ReadValue<uint32_t>(field_start)
+                             : ReadValue<uint64_t>(field_start);
+        column.Append(inode);
+        metadata->AddInode(static_cast<Inode>(inode));
+        break;
+      }
+      case kPid32ToInt32:
+      case kPid32ToInt64: {
+        int32_t pid = ReadValue<int32_t>(field_start);
+        column.Append(pid);
+        metadata->AddPid(pid);
+        break;
+      }
+      case kCommonPid32ToInt32:
+      case kCommonPid32ToInt64: {
+        int32_t pid = ReadValue<int32_t>(field_start);
+        column.Append(pid);
+        metadata->AddCommonPid(pid);
+        break;
+      }
+      case kDevId32ToUint64:
+      case kDevId64ToUint64: {
+        BlockDeviceID dev_id =
+            field.strategy == kDevId32ToUint64
+                ? TranslateBlockDeviceIDToUserspace<uint32_t>(
+                      ReadValue<uint32_t>(field_start))
+                : TranslateBlockDeviceIDToUserspace<uint64_t>(
+                      ReadValue<uint64_t>(field_start));
+        column.Append(dev_id);
+        metadata->AddDevice(dev_id);
+        break;
+      }
+      case kFtraceSymAddr64ToUint64:
+        column.Append(
+            metadata->AddSymbolAddr(ReadValue<uint64_t>(field_start)));
+        break;
+      case kInvalidTranslationStrategy:
+        PERFETTO_FATAL("Unexpected translation strategy");
+    }
+  }
+
+  metadata->FinishEvent();
+  return true;
+}
+
 }  // namespace perfetto
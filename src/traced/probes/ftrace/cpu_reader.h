@@ -28,6 +28,7 @@
 #include "perfetto/ext/tracing/core/trace_writer.h"
 #include "perfetto/protozero/message.h"
 #include "perfetto/protozero/message_handle.h"
+#include "src/traced/probes/ftrace/compact_events.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/ftrace_metadata.h"
 
@@ -92,6 +93,17 @@ class CpuReader {
       return &compact_sched_buffer_;
     }
 
+    CompactEventsBuffer* compact_events_buffer() {
+      // As above, the buffer is only written out if there is an open bundle.
+      GetOrCreateBundle();
+      return &compact_events_buffer_;
+    }
+
+    // Doesn't create a bundle, unlike compact_events_buffer().
+    size_t compact_events_interner_size() const {
+      return compact_events_buffer_.interner().size();
+    }
+
    private:
     TraceWriter* const trace_writer_;         // Never nullptr.
     FtraceMetadata* const metadata_;          // Never nullptr.
@@ -106,6 +118,9 @@ class CpuReader {
     // Allocate the buffer for compact scheduler events (which will be unused if
     // the compact option isn't enabled).
     CompactSchedBuffer compact_sched_buffer_;
+    // Buffer for the events selected by FtraceConfig.compact_events. Only
+    // allocates memory when such events are parsed.
+    CompactEventsBuffer compact_events_buffer_;
   };
 
   struct PageHeader {
@@ -122,6 +137,9 @@ class CpuReader {
             const FtraceClockSnapshot* ftrace_clock_snapshot);
   ~CpuReader();
 
+  // The trace_pipe_raw file of this cpu, which can be polled for readiness.
+  int trace_fd() const { return trace_fd_.get(); }
+
   // Reads and parses all ftrace data for this cpu (in batches), until we catch
   // up to the writer, or hit |max_pages|. Returns number of pages read.
   size_t ReadCycle(uint8_t* parsing_buf,
@@ -264,6 +282,25 @@ class CpuReader {
                          protozero::Message* message,
                          FtraceMetadata* metadata);
 
+  // Same as ParseField(), with the translation |strategy| passed separately
+  // so that the specialized parsers can pass it as a compile-time constant.
+  static bool ParseFieldWithStrategy(TranslationStrategy strategy,
+                                     const Field& field,
+                                     const uint8_t* start,
+                                     const uint8_t* end,
+                                     const ProtoTranslationTable* table,
+                                     protozero::Message* message,
+                                     FtraceMetadata* metadata);
+
+  // Parses the fields of an event with a specialized layout (see
+  // PERFETTO_FTRACE_SPECIALIZED_LAYOUTS) with the parser generated for it.
+  static bool ParseFieldsWithLayout(const Event& info,
+                                    const uint8_t* start,
+                                    const uint8_t* end,
+                                    const ProtoTranslationTable* table,
+                                    protozero::Message* message,
+                                    FtraceMetadata* metadata);
+
   // Parse a sys_enter event according to the pre-validated expected format
   static bool ParseSysEnter(const Event& info,
                             const uint8_t* start,
@@ -295,6 +332,17 @@ class CpuReader {
                                       CompactSchedBuffer* compact_buf,
                                       FtraceMetadata* metadata);
 
+  // Parse an event selected by FtraceConfig.compact_events (see
+  // IsCompactEncodable()), and buffer its fields in the given compact encoding
+  // batch. |end| is the end of the event.
+  static bool ParseEventCompact(const Event& info,
+                                const uint8_t* start,
+                                const uint8_t* end,
+                                uint64_t timestamp,
+                                const ProtoTranslationTable* table,
+                                CompactEventsBuffer* compact_buf,
+                                FtraceMetadata* metadata);
+
   // Parses & encodes the given range of contiguous tracing pages. Called by
   // |ReadAndProcessBatch| for each active data source.
   //
@@ -329,6 +377,12 @@ class CpuReader {
       bool first_batch_in_cycle,
       const std::set<FtraceDataSource*>& started_data_sources);
 
+  // Writes the |pages_read| pages of |parsing_buf| as they are into the trace,
+  // for data sources with FtraceConfig.raw_pages.
+  void WriteRawPages(FtraceDataSource* data_source,
+                     const uint8_t* parsing_buf,
+                     size_t pages_read);
+
   const size_t cpu_;
   const ProtoTranslationTable* const table_;
   LazyKernelSymbolizer* const symbolizer_;
@@ -14,18 +14,30 @@
 
 #include <benchmark/benchmark.h>
 
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <optional>
 
+#include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/utils.h"
+#include "perfetto/ext/tracing/core/commit_data_request.h"
+#include "perfetto/ext/tracing/core/shared_memory_abi.h"
+#include "perfetto/ext/tracing/core/shared_memory_arbiter.h"
+#include "perfetto/ext/tracing/core/trace_writer.h"
+#include "perfetto/ext/tracing/core/tracing_service.h"
 #include "perfetto/protozero/root_message.h"
 #include "perfetto/protozero/scattered_stream_null_delegate.h"
 #include "perfetto/protozero/scattered_stream_writer.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "src/base/test/test_task_runner.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
 #include "src/traced/probes/ftrace/ftrace_config_muxer.h"
 #include "src/traced/probes/ftrace/ftrace_print_filter.h"
 #include "src/traced/probes/ftrace/proto_translation_table.h"
 #include "src/traced/probes/ftrace/test/cpu_reader_support.h"
+#include "src/tracing/core/in_process_shared_memory.h"
 #include "src/tracing/core/null_trace_writer.h"
 
 namespace perfetto {
@@ -829,7 +841,8 @@ ExamplePage g_full_page_atrace_print{
 void DoParse(const ExamplePage& test_case,
              const std::vector<GroupAndName>& enabled_events,
              std::optional<FtraceConfig::PrintFilter> print_filter,
-             benchmark::State& state) {
+             benchmark::State& state,
+             bool specialized_layouts = true) {
   NullTraceWriter writer;
   FtraceMetadata metadata{};
   CpuReader::Bundler bundler(
@@ -838,7 +851,9 @@ void DoParse(const ExamplePage& test_case,
       /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
       /*compact_sched_enabled=*/false);
 
-  ProtoTranslationTable* table = GetTable(test_case.name);
+  ProtoTranslationTable* table =
+      specialized_layouts ? GetTable(test_case.name)
+                          : GetTableWithoutSpecializedLayouts(test_case.name);
   auto page = PageFromXxd(test_case.data);
 
   FtraceDataSourceConfig ds_config{EventFilter{},
@@ -884,6 +899,13 @@ void BM_ParsePageFullOfSchedSwitch(benchmark::State& state) {
 }
 BENCHMARK(BM_ParsePageFullOfSchedSwitch);
 
+// Same as above, without the parser specialized for the sched_switch layout.
+void BM_ParsePageFullOfSchedSwitchGeneric(benchmark::State& state) {
+  DoParse(g_full_page_sched_switch, {GroupAndName("sched", "sched_switch")},
+          std::nullopt, state, /*specialized_layouts=*/false);
+}
+BENCHMARK(BM_ParsePageFullOfSchedSwitchGeneric);
+
 void BM_ParsePageFullOfPrint(benchmark::State& state) {
   DoParse(g_full_page_print, {GroupAndName("ftrace", "print")}, std::nullopt,
           state);
@@ -984,5 +1006,260 @@ void BM_ProcessPagesFullOfPrint(benchmark::State& state) {
 }
 BENCHMARK(BM_ProcessPagesFullOfPrint)->Range(1, 64);
 
+// End-to-end benchmark of the ftrace ingestion path of traced_probes: batches
+// of pages of several cpus are processed as CpuReader::ReadAndProcessBatch()
+// does, and written through a real TraceWriterImpl into a shared memory buffer,
+// whose chunks are consumed as the tracing service would do.
+
+// Same sizes as the ones requested by traced_probes.
+constexpr size_t kIngestShmSize = 1024 * 1024;
+constexpr size_t kIngestShmPageSize = 32 * 1024;
+
+// Same as kParsingBufferSizePages in ftrace_controller.cc.
+constexpr size_t kIngestBatchPages = 32;
+
+// Stands in for the tracing service: the committed chunks are released as free
+// right away, so the writer never stalls for long.
+class DrainingProducerEndpoint : public TracingService::ProducerEndpoint {
+ public:
+  explicit DrainingProducerEndpoint(SharedMemory* shm)
+      : abi_(static_cast<uint8_t*>(shm->start()),
+             shm->size(),
+             kIngestShmPageSize,
+             SharedMemoryABI::ShmemMode::kDefault) {}
+
+  void CommitData(const CommitDataRequest& req,
+                  CommitDataCallback callback) override {
+    for (const auto& chunk : req.chunks_to_move()) {
+      SharedMemoryABI::Chunk acquired =
+          abi_.TryAcquireChunkForReading(chunk.page(), chunk.chunk());
+      if (acquired.is_valid())
+        abi_.ReleaseChunkAsFree(std::move(acquired));
+    }
+    if (callback)
+      callback();
+  }
+
+  void Disconnect() override {}
+  void RegisterDataSource(const DataSourceDescriptor&) override {}
+  void UpdateDataSource(const DataSourceDescriptor&) override {}
+  void UnregisterDataSource(const std::string&) override {}
+  void RegisterTraceWriter(uint32_t, uint32_t) override {}
+  void UnregisterTraceWriter(uint32_t) override {}
+  SharedMemory* shared_memory() const override { return nullptr; }
+  size_t shared_buffer_page_size_kb() const override { return 0; }
+  std::unique_ptr<TraceWriter> CreateTraceWriter(
+      BufferID,
+      BufferExhaustedPolicy) override {
+    return nullptr;
+  }
+  SharedMemoryArbiter* MaybeSharedMemoryArbiter() override { return nullptr; }
+  bool IsShmemProvidedByProducer() const override { return false; }
+  void NotifyFlushComplete(FlushRequestID) override {}
+  void NotifyDataSourceStarted(DataSourceInstanceID) override {}
+  void NotifyDataSourceStopped(DataSourceInstanceID) override {}
+  void ActivateTriggers(const std::vector<std::string>&) override {}
+  void Sync(std::function<void()> callback) override { callback(); }
+
+ private:
+  SharedMemoryABI abi_;
+};
+
+// Counts the cpu cycles spent in userspace by the calling thread. Not valid if
+// perf events are not available (e.g. in VMs, or restricted by
+// perf_event_paranoid).
+class ThreadCycleCounter {
+ public:
+  ThreadCycleCounter() {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_.reset(static_cast<int>(syscall(__NR_perf_event_open, &attr,
+                                       /*pid=*/0, /*cpu=*/-1,
+                                       /*group_fd=*/-1, /*flags=*/0)));
+  }
+
+  bool is_valid() const { return !!fd_; }
+
+  uint64_t Read() const {
+    uint64_t cycles = 0;
+    if (read(*fd_, &cycles, sizeof(cycles)) !=
+        static_cast<ssize_t>(sizeof(cycles))) {
+      return 0;
+    }
+    return cycles;
+  }
+
+ private:
+  base::ScopedFile fd_;
+};
+
+// Returns the number of events in |page|, i.e. the data records that CpuReader
+// parses.
+size_t CountEventsInPage(const uint8_t* page,
+                         const ProtoTranslationTable* table) {
+  const uint8_t* ptr = page;
+  std::optional<CpuReader::PageHeader> page_header =
+      CpuReader::ParsePageHeader(&ptr, table->page_header_size_len());
+  PERFETTO_CHECK(page_header.has_value());
+  const uint8_t* const end = ptr + page_header->size;
+  size_t events = 0;
+  while (ptr < end) {
+    uint32_t event_header = 0;
+    uint32_t length = 0;
+    if (!CpuReader::ReadAndAdvance(&ptr, end, &event_header))
+      break;
+    uint32_t type_or_length = event_header & 0x1f;
+    if (type_or_length == 29) {  // Padding.
+      if (!CpuReader::ReadAndAdvance(&ptr, end, &length) || length < 4)
+        break;
+      ptr += length - 4;
+    } else if (type_or_length >= 30) {  // Time extend or absolute timestamp.
+      ptr += 4;
+    } else if (type_or_length == 0) {  // Data record with explicit length.
+      if (!CpuReader::ReadAndAdvance(&ptr, end, &length) || length < 4)
+        break;
+      ptr += length - 4;
+      events++;
+    } else {
+      ptr += 4 * type_or_length;
+      events++;
+    }
+  }
+  return events;
+}
+
+struct IngestEventMix {
+  // The pages of each cpu cycle through these.
+  std::vector<const ExamplePage*> pages;
+  std::vector<GroupAndName> enabled_events;
+  // Events recorded in the FtraceEventBundle.compact_events encoding.
+  std::vector<GroupAndName> compact_events;
+};
+
+void DoIngest(const IngestEventMix& mix, benchmark::State& state) {
+  const size_t num_cpus = static_cast<size_t>(state.range(0));
+  // All the pages of a mix share the same format files.
+  ProtoTranslationTable* table = GetTable(mix.pages[0]->name);
+
+  FtraceDataSourceConfig ds_config{EventFilter{},
+                                   EventFilter{},
+                                   DisabledCompactSchedConfigForTesting(),
+                                   std::nullopt,
+                                   {},
+                                   {},
+                                   false /*symbolize_ksyms*/,
+                                   false /*preserve_ftrace_buffer*/,
+                                   {}};
+  for (const GroupAndName& event : mix.enabled_events)
+    ds_config.event_filter.AddEnabledEvent(table->EventToFtraceId(event));
+  for (const GroupAndName& event : mix.compact_events)
+    ds_config.compact_events.AddEnabledEvent(table->EventToFtraceId(event));
+
+  // One batch of pages per cpu, each cpu starting at a different page of the
+  // mix.
+  std::vector<std::unique_ptr<uint8_t[]>> batches;
+  size_t events_per_iteration = 0;
+  for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+    std::unique_ptr<uint8_t[]> batch(
+        new uint8_t[base::kPageSize * kIngestBatchPages]);
+    for (size_t i = 0; i < kIngestBatchPages; i++) {
+      const ExamplePage* example = mix.pages[(cpu + i) % mix.pages.size()];
+      auto page = PageFromXxd(example->data);
+      memcpy(&batch[i * base::kPageSize], page.get(), base::kPageSize);
+      events_per_iteration += CountEventsInPage(page.get(), table);
+    }
+    batches.push_back(std::move(batch));
+  }
+
+  base::TestTaskRunner task_runner;
+  auto shm = InProcessSharedMemory::Create(kIngestShmSize);
+  DrainingProducerEndpoint endpoint(shm.get());
+  std::unique_ptr<SharedMemoryArbiter> arbiter =
+      SharedMemoryArbiter::CreateInstance(
+          shm.get(), kIngestShmPageSize, SharedMemoryABI::ShmemMode::kDefault,
+          &endpoint, &task_runner);
+  std::unique_ptr<TraceWriter> writer =
+      arbiter->CreateTraceWriter(/*target_buffer=*/1);
+
+  std::vector<FtraceMetadata> metadata(num_cpus);
+  ThreadCycleCounter cycle_counter;
+  uint64_t start_cycles = cycle_counter.is_valid() ? cycle_counter.Read() : 0;
+  for (auto _ : state) {
+    for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+      CpuReader::ProcessPagesForDataSource(
+          writer.get(), &metadata[cpu], cpu, &ds_config, batches[cpu].get(),
+          kIngestBatchPages, table,
+          /*symbolizer=*/nullptr, /*ftrace_clock_snapshot=*/nullptr,
+          /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED);
+      metadata[cpu].Clear();
+    }
+    writer->Flush();
+    task_runner.RunUntilIdle();
+  }
+  uint64_t cycles =
+      cycle_counter.is_valid() ? cycle_counter.Read() - start_cycles : 0;
+
+  double events = static_cast<double>(events_per_iteration);
+  double total_events = events * static_cast<double>(state.iterations());
+  state.counters["events/s"] =
+      benchmark::Counter(events, benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["bytes/s"] = benchmark::Counter(
+      static_cast<double>(num_cpus * kIngestBatchPages * base::kPageSize),
+      benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["trace_bytes/event"] =
+      benchmark::Counter(static_cast<double>(writer->written()) / total_events);
+  if (cycles > 0) {
+    state.counters["cycles/event"] =
+        benchmark::Counter(static_cast<double>(cycles) / total_events);
+  }
+
+  writer.reset();
+  task_runner.RunUntilIdle();
+}
+
+void BM_IngestSchedSwitch(benchmark::State& state) {
+  DoIngest({{&g_full_page_sched_switch},
+            {GroupAndName("sched", "sched_switch")},
+            {}},
+           state);
+}
+BENCHMARK(BM_IngestSchedSwitch)->Arg(1)->Arg(4)->Arg(8);
+
+void BM_IngestSchedSwitchCompactEvents(benchmark::State& state) {
+  DoIngest({{&g_full_page_sched_switch},
+            {GroupAndName("sched", "sched_switch")},
+            {GroupAndName("sched", "sched_switch")}},
+           state);
+}
+BENCHMARK(BM_IngestSchedSwitchCompactEvents)->Arg(1)->Arg(4)->Arg(8);
+
+void BM_IngestPrint(benchmark::State& state) {
+  DoIngest({{&g_full_page_print}, {GroupAndName("ftrace", "print")}, {}},
+           state);
+}
+BENCHMARK(BM_IngestPrint)->Arg(1)->Arg(4)->Arg(8);
+
+void BM_IngestAtracePrint(benchmark::State& state) {
+  DoIngest({{&g_full_page_atrace_print}, {GroupAndName("ftrace", "print")}, {}},
+           state);
+}
+BENCHMARK(BM_IngestAtracePrint)->Arg(1)->Arg(4)->Arg(8);
+
+// A scheduling heavy mix with userspace annotations, as in a typical Android
+// trace.
+void BM_IngestMixed(benchmark::State& state) {
+  DoIngest({{&g_full_page_sched_switch, &g_full_page_sched_switch,
+             &g_full_page_atrace_print, &g_full_page_print},
+            {GroupAndName("sched", "sched_switch"),
+             GroupAndName("ftrace", "print")},
+            {}},
+           state);
+}
+BENCHMARK(BM_IngestMixed)->Arg(1)->Arg(4)->Arg(8);
+
 }  // namespace
 }  // namespace perfetto
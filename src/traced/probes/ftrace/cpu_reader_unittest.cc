@@ -43,6 +43,7 @@
 #include "protos/perfetto/trace/ftrace/power.gen.h"
 #include "protos/perfetto/trace/ftrace/raw_syscalls.gen.h"
 #include "protos/perfetto/trace/ftrace/sched.gen.h"
+#include "protos/perfetto/trace/ftrace/sched.pbzero.h"
 #include "protos/perfetto/trace/ftrace/task.gen.h"
 #include "protos/perfetto/trace/trace_packet.gen.h"
 #include "src/traced/probes/ftrace/test/test_messages.gen.h"
@@ -852,6 +853,48 @@ TEST_F(CpuReaderParsePagePayloadTest, ParsePrintWithAndWithoutFilter) {
   }
 }
 
+TEST_F(CpuReaderParsePagePayloadTest, FilterByEventPids) {
+  const ExamplePage* test_case = &g_three_prints;
+
+  ProtoTranslationTable* table = GetTable(test_case->name);
+  auto page = PageFromXxd(test_case->data);
+
+  const uint8_t* parse_pos = page.get();
+  std::optional<CpuReader::PageHeader> page_header =
+      CpuReader::ParsePageHeader(&parse_pos, table->page_header_size_len());
+  ASSERT_TRUE(page_header.has_value());
+
+  {
+    FtraceDataSourceConfig ds_config = EmptyConfig();
+    ds_config.event_filter.AddEnabledEvent(
+        table->EventToFtraceId(GroupAndName("ftrace", "print")));
+    ds_config.event_pids = {1, 30693};
+
+    CpuReader::ParsePagePayload(parse_pos, &page_header.value(), table,
+                                &ds_config, CreateBundler(ds_config),
+                                &metadata_);
+
+    auto bundle = GetBundle();
+    EXPECT_EQ(bundle.event().size(), 3u);
+  }
+
+  {
+    FtraceDataSourceConfig ds_config = EmptyConfig();
+    ds_config.event_filter.AddEnabledEvent(
+        table->EventToFtraceId(GroupAndName("ftrace", "print")));
+    ds_config.event_pids = {1};
+
+    CpuReader::ParsePagePayload(parse_pos, &page_header.value(), table,
+                                &ds_config, CreateBundler(ds_config),
+                                &metadata_);
+
+    size_t events = 0;
+    for (const auto& packet : AllTracePackets())
+      events += packet.ftrace_events().event().size();
+    EXPECT_EQ(events, 0u);
+  }
+}
+
 TEST(CpuReaderTest, ProcessPagesForDataSourceNoEmptyPackets) {
   const ExamplePage* test_case = &g_three_prints;
 
@@ -1196,6 +1239,126 @@ TEST_F(CpuReaderParsePagePayloadTest, ParseCompactSchedSwitchAndWaking) {
   EXPECT_EQ("kworker/u16:17", comm);
 }
 
+TEST_F(CpuReaderParsePagePayloadTest, ParseCompactEvents) {
+  const ExamplePage* test_case = &g_sched_page;
+
+  ProtoTranslationTable* table = GetTable(test_case->name);
+  auto page = PageFromXxd(test_case->data);
+
+  FtraceDataSourceConfig ds_config = EmptyConfig();
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_waking")));
+  // Only sched_waking is recorded in the compact encoding.
+  const Event* waking = table->GetEvent(GroupAndName("sched", "sched_waking"));
+  ASSERT_TRUE(IsCompactEncodable(*waking));
+  ds_config.compact_events.AddEnabledEvent(waking->ftrace_event_id);
+
+  const uint8_t* parse_pos = page.get();
+  std::optional<CpuReader::PageHeader> page_header =
+      CpuReader::ParsePageHeader(&parse_pos, table->page_header_size_len());
+  ASSERT_TRUE(page_header.has_value());
+
+  size_t evt_bytes = CpuReader::ParsePagePayload(
+      parse_pos, &page_header.value(), table, &ds_config,
+      CreateBundler(ds_config), &metadata_);
+  EXPECT_LT(0u, evt_bytes);
+
+  auto bundle = GetBundle();
+  // 2 sched_switch events, encoded normally:
+  ASSERT_EQ(2u, bundle.event().size());
+  EXPECT_TRUE(bundle.event()[0].has_sched_switch());
+  EXPECT_FALSE(bundle.has_compact_sched());
+
+  // 5 sched_waking events, encoded in columns:
+  const auto& compact_events = bundle.compact_events();
+  ASSERT_EQ(1u, compact_events.event().size());
+  const auto& columns = compact_events.event()[0];
+  EXPECT_EQ(columns.id(),
+            static_cast<uint32_t>(
+                protos::pbzero::FtraceEvent::kSchedWakingFieldNumber));
+  ASSERT_EQ(5u, columns.timestamp().size());
+  EXPECT_EQ(columns.timestamp()[0], 701500115221756ull);
+  // The following timestamps are delta-encoded.
+  EXPECT_TRUE(WithinOneMicrosecond(
+      columns.timestamp()[0] + columns.timestamp()[1], 701500, 115327));
+  ASSERT_EQ(5u, columns.pid().size());
+  EXPECT_EQ(columns.pid()[0], 219057u);
+  ASSERT_EQ(waking->fields.size(), columns.field().size());
+
+  // 3 unique interned comm strings:
+  EXPECT_EQ(3u, compact_events.intern_table().size());
+  for (const auto& field : columns.field()) {
+    if (field.id() == protos::pbzero::SchedWakingFtraceEvent::kPidFieldNumber) {
+      ASSERT_EQ(5u, field.varint().size());
+      EXPECT_EQ(field.varint()[0], 203967u);
+    } else if (field.id() ==
+               protos::pbzero::SchedWakingFtraceEvent::kCommFieldNumber) {
+      ASSERT_EQ(5u, field.string_index().size());
+      EXPECT_EQ(compact_events.intern_table()[field.string_index()[0]],
+                "kworker/u16:17");
+      EXPECT_EQ(compact_events.intern_table()[field.string_index()[2]],
+                "kworker/u16:5");
+    }
+  }
+  EXPECT_THAT(metadata_.pids, Contains(203967));
+}
+
+// The parsers specialized for the layout of the hottest events must produce
+// the same output as the generic field by field parser.
+TEST(CpuReaderTest, SpecializedLayoutsMatchGenericParsing) {
+  const ExamplePage* test_case = &g_sched_page;
+  auto page = PageFromXxd(test_case->data);
+
+  ProtoTranslationTable* table = GetTable(test_case->name);
+  EXPECT_EQ(table->GetEvent(GroupAndName("sched", "sched_switch"))
+                ->specialized_layout,
+            SpecializedLayout::kSchedSwitch);
+  EXPECT_EQ(table->GetEvent(GroupAndName("sched", "sched_waking"))
+                ->specialized_layout,
+            SpecializedLayout::kSchedWakeup);
+
+  auto parse_page = [&page](const ProtoTranslationTable* t,
+                            std::vector<int32_t>* pids) {
+    FtraceDataSourceConfig ds_config = EmptyConfig();
+    ds_config.event_filter.AddEnabledEvent(
+        t->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+    ds_config.event_filter.AddEnabledEvent(
+        t->EventToFtraceId(GroupAndName("sched", "sched_waking")));
+
+    TraceWriterForTesting writer;
+    FtraceMetadata metadata;
+    {
+      CpuReader::Bundler bundler(
+          &writer, &metadata, /*symbolizer=*/nullptr, /*cpu=*/0,
+          /*ftrace_clock_snapshot=*/nullptr,
+          /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
+          /*compact_sched_enabled=*/false);
+      const uint8_t* parse_pos = page.get();
+      std::optional<CpuReader::PageHeader> page_header =
+          CpuReader::ParsePageHeader(&parse_pos, t->page_header_size_len());
+      EXPECT_TRUE(page_header.has_value());
+      EXPECT_LT(0u, CpuReader::ParsePagePayload(parse_pos, &page_header.value(),
+                                                t, &ds_config, &bundler,
+                                                &metadata));
+    }
+    pids->assign(metadata.pids.begin(), metadata.pids.end());
+    return writer.GetOnlyTracePacket().ftrace_events();
+  };
+
+  std::vector<int32_t> specialized_pids;
+  protos::gen::FtraceEventBundle specialized =
+      parse_page(table, &specialized_pids);
+  std::vector<int32_t> generic_pids;
+  protos::gen::FtraceEventBundle generic = parse_page(
+      GetTableWithoutSpecializedLayouts(test_case->name), &generic_pids);
+  ASSERT_EQ(specialized.event().size(), 7u);
+  EXPECT_EQ(specialized.SerializeAsString(), generic.SerializeAsString());
+  EXPECT_FALSE(specialized_pids.empty());
+  EXPECT_EQ(specialized_pids, generic_pids);
+}
+
 TEST_F(CpuReaderTableTest, ParseAllFields) {
   using FakeEventProvider =
       ProtoProvider<pbzero::FakeFtraceEvent, gen::FakeFtraceEvent>;
@@ -31,6 +31,19 @@ Field StaticField(const char* ftrace_name,
   field.proto_field_type = proto_field_type;
   return field;
 }
+
+template <size_t N>
+bool MatchesLayout(const std::vector<Field>& fields,
+                   const TranslationStrategy (&strategies)[N]) {
+  if (fields.size() != N)
+    return false;
+  for (size_t i = 0; i < N; i++) {
+    if (fields[i].strategy != strategies[i])
+      return false;
+  }
+  return true;
+}
+
 }  // namespace
 
 std::vector<Field> GetStaticCommonFieldsInfo() {
@@ -116,4 +129,16 @@ bool SetTranslationStrategy(FtraceFieldType ftrace,
   return true;
 }
 
+SpecializedLayout FindSpecializedLayout(const std::vector<Field>& fields) {
+#define PERFETTO_FTRACE_LAYOUT_MATCH(name, ...)                         \
+  {                                                                     \
+    static constexpr TranslationStrategy kStrategies[] = {__VA_ARGS__}; \
+    if (MatchesLayout(fields, kStrategies))                             \
+      return SpecializedLayout::name;                                   \
+  }
+  PERFETTO_FTRACE_SPECIALIZED_LAYOUTS(PERFETTO_FTRACE_LAYOUT_MATCH)
+#undef PERFETTO_FTRACE_LAYOUT_MATCH
+  return SpecializedLayout::kNone;
+}
+
 }  // namespace perfetto
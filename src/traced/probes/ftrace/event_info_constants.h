@@ -147,6 +147,53 @@ struct Field {
   TranslationStrategy strategy;
 };
 
+// Layouts (i.e. the TranslationStrategy of each of Event::fields, in order) of
+// the hottest events, for which CpuReader has parsers specialized at compile
+// time rather than interpreting the strategy of each field at runtime. Events
+// are matched by layout rather than by name, so that events with the same
+// layout share a parser. Events with a different layout on a given kernel
+// (e.g. older or 32-bit kernels) fall back to the generic parser.
+//
+// X(name, strategies...)
+#define PERFETTO_FTRACE_SPECIALIZED_LAYOUTS(X)                                \
+  /* sched_switch */                                                          \
+  X(kSchedSwitch, kFixedCStringToString, kPid32ToInt32, kInt32ToInt32,        \
+    kInt64ToInt64, kFixedCStringToString, kPid32ToInt32, kInt32ToInt32)       \
+  /* sched_waking, sched_wakeup, sched_wakeup_new */                          \
+  X(kSchedWakeup, kFixedCStringToString, kPid32ToInt32, kInt32ToInt32,        \
+    kInt32ToInt32)                                                            \
+  /* sched_waking, sched_wakeup, sched_wakeup_new before Linux v4.x */        \
+  X(kSchedWakeupWithSuccess, kFixedCStringToString, kPid32ToInt32,            \
+    kInt32ToInt32, kInt32ToInt32, kInt32ToInt32)                              \
+  /* sched_process_free */                                                    \
+  X(kSchedProcessFree, kFixedCStringToString, kPid32ToInt32, kInt32ToInt32)   \
+  /* sched_process_exit */                                                    \
+  X(kSchedProcessExit, kFixedCStringToString, kPid32ToInt32, kPid32ToInt32,   \
+    kInt32ToInt32)                                                            \
+  /* sched_stat_runtime */                                                    \
+  X(kSchedStatRuntime, kFixedCStringToString, kPid32ToInt32, kUint64ToUint64, \
+    kUint64ToUint64)                                                          \
+  /* sched_blocked_reason */                                                  \
+  X(kSchedBlockedReason, kPid32ToInt32, kFtraceSymAddr64ToUint64,             \
+    kBoolToUint32)                                                            \
+  /* irq_handler_entry */                                                     \
+  X(kIrqHandlerEntry, kInt32ToInt32, kDataLocToString)                        \
+  /* irq_handler_exit */                                                      \
+  X(kIrqHandlerExit, kInt32ToInt32, kInt32ToInt32)                            \
+  /* softirq_entry, softirq_exit, softirq_raise */                            \
+  X(kSoftirq, kUint32ToUint32)                                                \
+  /* cpu_idle, cpu_frequency */                                               \
+  X(kCpuIdle, kUint32ToUint32, kUint32ToUint32)                               \
+  /* workqueue_execute_start, workqueue_execute_end */                        \
+  X(kWorkqueueExecute, kFtraceSymAddr64ToUint64, kFtraceSymAddr64ToUint64)
+
+enum class SpecializedLayout : uint8_t {
+  kNone = 0,
+#define PERFETTO_FTRACE_LAYOUT_ENUM(name, ...) name,
+  PERFETTO_FTRACE_SPECIALIZED_LAYOUTS(PERFETTO_FTRACE_LAYOUT_ENUM)
+#undef PERFETTO_FTRACE_LAYOUT_ENUM
+};
+
 struct Event {
   const char* name;
   const char* group;
@@ -161,6 +208,9 @@ struct Event {
   // terminated string of unknown size. This size doesn't include the length of
   // that string.
   uint16_t size;
+
+  // Set by ProtoTranslationTable if |fields| match one of the layouts above.
+  SpecializedLayout specialized_layout = SpecializedLayout::kNone;
 };
 
 // The compile time information needed to read the common fields from
@@ -171,6 +221,10 @@ bool SetTranslationStrategy(FtraceFieldType ftrace,
                             protozero::proto_utils::ProtoSchemaType proto,
                             TranslationStrategy* out);
 
+// Returns the layout in PERFETTO_FTRACE_SPECIALIZED_LAYOUTS matching the
+// translation strategies of |fields|, or SpecializedLayout::kNone.
+SpecializedLayout FindSpecializedLayout(const std::vector<Field>& fields);
+
 }  // namespace perfetto
 
 #endif  // SRC_TRACED_PROBES_FTRACE_EVENT_INFO_CONSTANTS_H_
@@ -25,8 +25,10 @@
 #include <iterator>
 
 #include "perfetto/base/compiler.h"
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/utils.h"
 #include "src/traced/probes/ftrace/atrace_wrapper.h"
+#include "src/traced/probes/ftrace/compact_events.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/ftrace_stats.h"
 
@@ -113,6 +115,14 @@ void PERFETTO_NO_INLINE InsertEvent(const char* group,
   dst->insert(GroupAndName(group, name));
 }
 
+// Returns the time elapsed since |*lap_start_ns| and restarts the lap.
+uint64_t LapNs(int64_t* lap_start_ns) {
+  int64_t now_ns = base::GetBootTimeNs().count();
+  uint64_t lap_ns = static_cast<uint64_t>(now_ns - *lap_start_ns);
+  *lap_start_ns = now_ns;
+  return lap_ns;
+}
+
 }  // namespace
 
 std::set<GroupAndName> FtraceConfigMuxer::GetFtraceEvents(
@@ -534,6 +544,29 @@ EventFilter FtraceConfigMuxer::BuildSyscallFilter(
   return output;
 }
 
+EventFilter FtraceConfigMuxer::BuildCompactEventsFilter(
+    const EventFilter& ftrace_filter,
+    const FtraceConfig& request) {
+  EventFilter output;
+  for (const std::string& config_value : request.compact_events()) {
+    std::string group;
+    std::string name;
+    std::tie(group, name) = EventToStringGroupAndName(config_value);
+    const Event* event = group.empty()
+                             ? table_->GetEventByName(name)
+                             : table_->GetEvent(GroupAndName(group, name));
+    if (!event || !ftrace_filter.IsEventEnabled(event->ftrace_event_id))
+      continue;
+    if (!IsCompactEncodable(*event)) {
+      PERFETTO_DLOG("%s can't be recorded in the compact encoding",
+                    config_value.c_str());
+      continue;
+    }
+    output.AddEnabledEvent(event->ftrace_event_id);
+  }
+  return output;
+}
+
 bool FtraceConfigMuxer::SetSyscallEventFilter(
     const EventFilter& extra_syscalls) {
   EventFilter syscall_filter;
@@ -598,7 +631,14 @@ FtraceConfigMuxer::~FtraceConfigMuxer() = default;
 
 bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
                                     const FtraceConfig& request,
-                                    FtraceSetupErrors* errors) {
+                                    FtraceSetupErrors* errors,
+                                    FtraceSetupTimings* timings) {
+  FtraceSetupTimings unused_timings;
+  if (!timings)
+    timings = &unused_timings;
+  const int64_t setup_start_ns = base::GetBootTimeNs().count();
+  int64_t lap_start_ns = setup_start_ns;
+
   EventFilter filter;
   if (ds_configs_.empty()) {
     PERFETTO_DCHECK(active_configs_.empty());
@@ -625,6 +665,7 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
       ftrace_->DisableAllEvents();
       ftrace_->ClearTrace();
     }
+    timings->reset_ns = LapNs(&lap_start_ns);
 
     // Set up the rest of the tracefs state, without starting it.
     // Notes:
@@ -635,6 +676,7 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
       SetupClock(request);
     }
     SetupBufferSize(request);
+    timings->clock_and_buffer_ns = LapNs(&lap_start_ns);
   }
 
   std::set<GroupAndName> events = GetFtraceEvents(request, table_);
@@ -664,9 +706,16 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
           "bailing out.");
       return false;
     }
+    LapNs(&lap_start_ns);
     UpdateAtrace(request, errors ? &errors->atrace_errors : nullptr);
+    timings->atrace_ns = LapNs(&lap_start_ns);
   }
 
+  // The events which aren't enabled yet are enabled all at once at the end,
+  // which is much faster than enabling them one by one.
+  LapNs(&lap_start_ns);
+  std::vector<const Event*> events_to_enable;
+  std::vector<std::pair<std::string, std::string>> groups_and_names;
   for (const auto& group_and_name : events) {
     const Event* event = table_->GetOrCreateEvent(group_and_name);
     if (!event) {
@@ -695,15 +744,25 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
       filter.AddEnabledEvent(event->ftrace_event_id);
       continue;
     }
-    if (ftrace_->EnableEvent(event->group, event->name)) {
+    events_to_enable.push_back(event);
+    groups_and_names.emplace_back(event->group, event->name);
+  }
+  std::vector<bool> enabled = ftrace_->EnableEvents(groups_and_names);
+  for (size_t i = 0; i < events_to_enable.size(); ++i) {
+    const Event* event = events_to_enable[i];
+    if (enabled[i]) {
       current_state_.ftrace_events.AddEnabledEvent(event->ftrace_event_id);
       filter.AddEnabledEvent(event->ftrace_event_id);
+      timings->enabled_events++;
     } else {
-      PERFETTO_DPLOG("Failed to enable %s.", group_and_name.ToString().c_str());
+      std::string event_str =
+          GroupAndName(event->group, event->name).ToString();
+      PERFETTO_DPLOG("Failed to enable %s.", event_str.c_str());
       if (errors)
-        errors->failed_ftrace_events.push_back(group_and_name.ToString());
+        errors->failed_ftrace_events.push_back(std::move(event_str));
     }
   }
+  timings->enable_events_ns = LapNs(&lap_start_ns);
 
   EventFilter syscall_filter = BuildSyscallFilter(filter, request);
   if (!SetSyscallEventFilter(syscall_filter)) {
@@ -743,6 +802,7 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
 
   auto compact_sched =
       CreateCompactSchedConfig(request, table_->compact_sched_format());
+  EventFilter compact_events = BuildCompactEventsFilter(filter, request);
 
   std::optional<FtracePrintFilterConfig> ftrace_print_filter;
   if (request.has_print_filter()) {
@@ -756,6 +816,18 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
     }
   }
 
+  // The kernel filters apply to all the events of the tracefs instance, so they
+  // can be pushed down only while there is a single data source. CpuReader
+  // applies the same filters to the events of each data source regardless.
+  if (ds_configs_.empty()) {
+    SetupKernelFilters(request, ftrace_print_filter);
+  } else {
+    ClearKernelFilters();
+  }
+  base::FlatSet<int32_t> event_pids;
+  for (int32_t pid : request.event_pids())
+    event_pids.insert(pid);
+
   std::vector<std::string> apps(request.atrace_apps());
   std::vector<std::string> categories(request.atrace_categories());
   ds_configs_.emplace(
@@ -765,7 +837,11 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
                             std::move(apps), std::move(categories),
                             request.symbolize_ksyms(),
                             request.preserve_ftrace_buffer(),
-                            GetSyscallsReturningFds(syscalls_)));
+                            GetSyscallsReturningFds(syscalls_),
+                            request.raw_pages(), std::move(compact_events),
+                            std::move(event_pids)));
+  timings->filters_ns = LapNs(&lap_start_ns);
+  timings->total_ns = static_cast<uint64_t>(lap_start_ns - setup_start_ns);
   return true;
 }
 
@@ -823,14 +899,22 @@ bool FtraceConfigMuxer::RemoveConfig(FtraceConfigId config_id) {
   // Disable any events that are currently enabled, but are not in any configs
   // anymore.
   std::set<size_t> event_ids = current_state_.ftrace_events.GetEnabledEvents();
+  std::vector<const Event*> events_to_disable;
+  std::vector<std::pair<std::string, std::string>> groups_and_names;
   for (size_t id : event_ids) {
     if (expected_ftrace_events.IsEventEnabled(id))
       continue;
     const Event* event = table_->GetEventById(id);
     // Any event that was enabled must exist.
     PERFETTO_DCHECK(event);
-    if (ftrace_->DisableEvent(event->group, event->name))
-      current_state_.ftrace_events.DisableEvent(event->ftrace_event_id);
+    events_to_disable.push_back(event);
+    groups_and_names.emplace_back(event->group, event->name);
+  }
+  std::vector<bool> disabled = ftrace_->DisableEvents(groups_and_names);
+  for (size_t i = 0; i < events_to_disable.size(); ++i) {
+    if (disabled[i])
+      current_state_.ftrace_events.DisableEvent(
+          events_to_disable[i]->ftrace_event_id);
   }
 
   auto active_it = active_configs_.find(config_id);
@@ -848,6 +932,7 @@ bool FtraceConfigMuxer::RemoveConfig(FtraceConfigId config_id) {
   // configs around. Tear down the rest of the ftrace config only if all
   // configs are removed.
   if (ds_configs_.empty()) {
+    ClearKernelFilters();
     if (ftrace_->SetCpuBufferSizeInPages(1))
       current_state_.cpu_buffer_size_pages = 1;
     ftrace_->DisableAllEvents();
@@ -1023,4 +1108,40 @@ void FtraceConfigMuxer::DisableAtrace() {
   PERFETTO_DLOG("...done");
 }
 
+void FtraceConfigMuxer::SetupKernelFilters(
+    const FtraceConfig& request,
+    const std::optional<FtracePrintFilterConfig>& print_filter) {
+  // Failing to set up a kernel filter is not an error: the events are filtered
+  // in userspace in any case, the kernel filter only saves the buffer space.
+  if (print_filter) {
+    std::optional<std::string> kernel_filter =
+        print_filter->filter().ToKernelFilter();
+    if (kernel_filter &&
+        ftrace_->SetEventFilter("ftrace", "print", *kernel_filter)) {
+      current_state_.kernel_print_filter_on = true;
+    }
+  }
+  if (request.event_pids_size() > 0) {
+    std::set<int32_t> pids(request.event_pids().begin(),
+                           request.event_pids().end());
+    if (ftrace_->SetEventPids(pids))
+      current_state_.kernel_pid_filter_on = true;
+  }
+}
+
+void FtraceConfigMuxer::ClearKernelFilters() {
+  if (current_state_.kernel_print_filter_on) {
+    if (ftrace_->SetEventFilter("ftrace", "print", ""))
+      current_state_.kernel_print_filter_on = false;
+    else
+      PERFETTO_ELOG("Failed to clear the ftrace/print kernel filter");
+  }
+  if (current_state_.kernel_pid_filter_on) {
+    if (ftrace_->SetEventPids({}))
+      current_state_.kernel_pid_filter_on = false;
+    else
+      PERFETTO_ELOG("Failed to clear set_event_pid");
+  }
+}
+
 }  // namespace perfetto
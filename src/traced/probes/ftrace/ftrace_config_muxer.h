@@ -37,6 +37,7 @@ enum FtraceClock : int32_t;
 }  // namespace protos
 
 struct FtraceSetupErrors;
+struct FtraceSetupTimings;
 
 // State held by the muxer per data source, used to parse ftrace according to
 // that data source's config.
@@ -49,7 +50,10 @@ struct FtraceDataSourceConfig {
                          std::vector<std::string> _atrace_categories,
                          bool _symbolize_ksyms,
                          bool _preserve_ftrace_buffer,
-                         base::FlatSet<int64_t> _syscalls_returning_fd)
+                         base::FlatSet<int64_t> _syscalls_returning_fd,
+                         bool _raw_pages = false,
+                         EventFilter _compact_events = EventFilter(),
+                         base::FlatSet<int32_t> _event_pids = {})
       : event_filter(std::move(_event_filter)),
         syscall_filter(std::move(_syscall_filter)),
         compact_sched(_compact_sched),
@@ -58,7 +62,10 @@ struct FtraceDataSourceConfig {
         atrace_categories(std::move(_atrace_categories)),
         symbolize_ksyms(_symbolize_ksyms),
         preserve_ftrace_buffer(_preserve_ftrace_buffer),
-        syscalls_returning_fd(std::move(_syscalls_returning_fd)) {}
+        syscalls_returning_fd(std::move(_syscalls_returning_fd)),
+        raw_pages(_raw_pages),
+        compact_events(std::move(_compact_events)),
+        event_pids(std::move(_event_pids)) {}
   // The event filter allows to quickly check if a certain ftrace event with id
   // x is enabled for this data source.
   EventFilter event_filter;
@@ -86,6 +93,17 @@ struct FtraceDataSourceConfig {
 
   // List of syscalls monitored to return a new filedescriptor upon success
   base::FlatSet<int64_t> syscalls_returning_fd;
+
+  // Copies the ring buffer pages into the trace without parsing them.
+  const bool raw_pages;
+
+  // The enabled events (by ftrace id) to record in the compact encoding of
+  // FtraceEventBundle.compact_events.
+  EventFilter compact_events;
+
+  // If not empty, only the events emitted by these pids are recorded. See
+  // FtraceConfig.event_pids.
+  base::FlatSet<int32_t> event_pids;
 };
 
 // Ftrace is a bunch of globally modifiable persistent state.
@@ -118,10 +136,11 @@ class FtraceConfigMuxer {
   // buffer size right now. Events may be missing or there may be extra events
   // (if you enable an atrace category we try to give you the matching events).
   // If someone else is tracing we won't touch atrace (since it resets the
-  // buffer).
+  // buffer). The time spent in each step is reported in |timings|.
   bool SetupConfig(FtraceConfigId id,
                    const FtraceConfig& request,
-                   FtraceSetupErrors* = nullptr);
+                   FtraceSetupErrors* = nullptr,
+                   FtraceSetupTimings* timings = nullptr);
 
   // Activate ftrace for the given config (if not already active).
   bool ActivateConfig(FtraceConfigId);
@@ -182,6 +201,8 @@ class FtraceConfigMuxer {
     EventFilter ftrace_events;
     std::set<size_t> syscall_filter;  // syscall ids or kAllSyscallsId
     bool funcgraph_on = false;        // current_tracer == "function_graph"
+    bool kernel_print_filter_on = false;  // events/ftrace/print/filter
+    bool kernel_pid_filter_on = false;    // set_event_pid
     size_t cpu_buffer_size_pages = 0;
     protos::pbzero::FtraceClock ftrace_clock{};
     // Used only in Android for ATRACE_EVENT/os.Trace() userspace:
@@ -199,6 +220,13 @@ class FtraceConfigMuxer {
   void UpdateAtrace(const FtraceConfig& request, std::string* atrace_errors);
   void DisableAtrace();
 
+  // Pushes the print filter and the pid filter of the data source down to the
+  // kernel, where possible. See FtraceConfig.event_pids.
+  void SetupKernelFilters(
+      const FtraceConfig& request,
+      const std::optional<FtracePrintFilterConfig>& print_filter);
+  void ClearKernelFilters();
+
   // This processes the config to get the exact events.
   // group/* -> Will read the fs and add all events in group.
   // event -> Will look up the event to find the group.
@@ -217,6 +245,11 @@ class FtraceConfigMuxer {
   EventFilter BuildSyscallFilter(const EventFilter& ftrace_filter,
                                  const FtraceConfig& request);
 
+  // Returns the filter of the events of |request.compact_events()| which are
+  // enabled in |ftrace_filter| and can be recorded in the compact encoding.
+  EventFilter BuildCompactEventsFilter(const EventFilter& ftrace_filter,
+                                       const FtraceConfig& request);
+
   // Updates the ftrace syscall filters such that they satisfy all ds_configs_
   // and the extra_syscalls provided here. The filter is set to be the union of
   // all configs meaning no config will lose events, but concurrent configs can
@@ -70,6 +70,10 @@ class MockFtraceProcfs : public FtraceProcfs {
               AppendToFile,
               (const std::string& path, const std::string& str),
               (override));
+  MOCK_METHOD(std::vector<bool>,
+              AppendEachToFile,
+              (const std::string& path, const std::vector<std::string>& strs),
+              (override));
   MOCK_METHOD(char, ReadOneCharFromFile, (const std::string& path), (override));
   MOCK_METHOD(bool, ClearFile, (const std::string& path), (override));
   MOCK_METHOD(std::string,
@@ -345,6 +349,50 @@ TEST_F(FtraceConfigMuxerTest, SyscallFilterMuxing) {
   ASSERT_THAT(model.GetSyscallFilterForTesting(), UnorderedElementsAre());
 }
 
+TEST_F(FtraceConfigMuxerTest, EventPidsKernelFilter) {
+  auto fake_table = CreateFakeTable();
+  NiceMock<MockFtraceProcfs> ftrace;
+  FtraceConfigMuxer model(&ftrace, fake_table.get(), GetSyscallTable(), {});
+
+  FtraceConfig pids_config = CreateFtraceConfig({"sched/sched_switch"});
+  pids_config.add_event_pids(42);
+  pids_config.add_event_pids(1);
+  FtraceConfig other_config = CreateFtraceConfig({"sched/sched_switch"});
+
+  ON_CALL(ftrace, ReadFileIntoString("/root/current_tracer"))
+      .WillByDefault(Return("nop"));
+
+  // The only data source: the pids are pushed down to the kernel.
+  EXPECT_CALL(ftrace, ClearFile("/root/set_event_pid"));
+  EXPECT_CALL(ftrace, WriteToFile("/root/set_event_pid", "1 42"));
+  FtraceConfigId pids_id = 73;
+  ASSERT_TRUE(model.SetupConfig(pids_id, pids_config));
+  ASSERT_THAT(model.GetDataSourceConfig(pids_id)->event_pids,
+              UnorderedElementsAre(1, 42));
+  ASSERT_TRUE(testing::Mock::VerifyAndClearExpectations(&ftrace));
+
+  // A concurrent data source wants the events of all pids: the kernel filter
+  // is cleared, the events of |pids_id| are filtered in userspace only.
+  EXPECT_CALL(ftrace, ClearFile("/root/set_event_pid"));
+  EXPECT_CALL(ftrace, WriteToFile("/root/set_event_pid", _)).Times(0);
+  FtraceConfigId other_id = 74;
+  ASSERT_TRUE(model.SetupConfig(other_id, other_config));
+  ASSERT_TRUE(model.GetDataSourceConfig(other_id)->event_pids.empty());
+  ASSERT_TRUE(testing::Mock::VerifyAndClearExpectations(&ftrace));
+
+  // The kernel filter is already clear.
+  EXPECT_CALL(ftrace, ClearFile("/root/set_event_pid")).Times(0);
+  ASSERT_TRUE(model.RemoveConfig(pids_id));
+  ASSERT_TRUE(model.RemoveConfig(other_id));
+  ASSERT_TRUE(testing::Mock::VerifyAndClearExpectations(&ftrace));
+
+  // The filter is cleared again when the last data source goes away.
+  EXPECT_CALL(ftrace, WriteToFile("/root/set_event_pid", "1 42"));
+  ASSERT_TRUE(model.SetupConfig(pids_id, pids_config));
+  EXPECT_CALL(ftrace, ClearFile("/root/set_event_pid"));
+  ASSERT_TRUE(model.RemoveConfig(pids_id));
+}
+
 TEST_F(FtraceConfigMuxerTest, AddGenericEvent) {
   auto mock_table = GetMockTable();
   MockFtraceProcfs ftrace;
@@ -1136,6 +1184,48 @@ TEST_F(FtraceConfigMuxerTest, FallbackOnSetEvent) {
   ASSERT_TRUE(model.RemoveConfig(id));
 }
 
+// Tests that the events are enabled and disabled all at once through
+// "set_event" when possible, rather than through their xxx/enable files.
+TEST_F(FtraceConfigMuxerTest, BatchedSetEvent) {
+  NiceMock<MockFtraceProcfs> ftrace;
+  FtraceConfig config =
+      CreateFtraceConfig({"sched/sched_switch", "cgroup/cgroup_mkdir"});
+  FtraceConfigMuxer model(&ftrace, table_.get(), GetSyscallTable(), {});
+
+  ON_CALL(ftrace, ReadFileIntoString("/root/current_tracer"))
+      .WillByDefault(Return("nop"));
+  EXPECT_CALL(ftrace, AppendEachToFile("/root/set_event",
+                                       UnorderedElementsAre(
+                                           "sched:sched_switch",
+                                           "cgroup:cgroup_mkdir")))
+      .WillOnce(Return(std::vector<bool>{true, true}));
+  EXPECT_CALL(ftrace, WriteToFile("/root/events/sched/sched_switch/enable", _))
+      .Times(0);
+  EXPECT_CALL(ftrace, WriteToFile("/root/events/cgroup/cgroup_mkdir/enable", _))
+      .Times(0);
+  FtraceConfigId id = 97;
+  FtraceSetupTimings timings;
+  ASSERT_TRUE(model.SetupConfig(id, config, nullptr, &timings));
+  EXPECT_EQ(timings.enabled_events, 2u);
+  EXPECT_GT(timings.total_ns, 0u);
+
+  const FtraceDataSourceConfig* ds_config = model.GetDataSourceConfig(id);
+  ASSERT_TRUE(ds_config);
+  EXPECT_THAT(ds_config->event_filter.GetEnabledEvents(),
+              Contains(kFakeSchedSwitchEventId));
+  EXPECT_THAT(ds_config->event_filter.GetEnabledEvents(),
+              Contains(kCgroupMkdirEventId));
+
+  EXPECT_CALL(ftrace, AppendEachToFile("/root/set_event",
+                                       UnorderedElementsAre(
+                                           "!sched:sched_switch",
+                                           "!cgroup:cgroup_mkdir")))
+      .WillOnce(Return(std::vector<bool>{true, true}));
+  ASSERT_TRUE(model.RemoveConfig(id));
+  EXPECT_THAT(model.GetCentralEventFilterForTesting()->GetEnabledEvents(),
+              IsEmpty());
+}
+
 TEST_F(FtraceConfigMuxerTest, CompactSchedConfig) {
   // Set scheduling event format as validated. The pre-parsed format itself
   // doesn't need to be sensible, as the tests won't use it.
@@ -24,6 +24,11 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 
 #include "perfetto/base/build_config.h"
@@ -33,6 +38,7 @@
 #include "perfetto/ext/base/metatrace.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
 #include "src/kallsyms/kernel_symbol_map.h"
 #include "src/kallsyms/lazy_kernel_symbolizer.h"
 #include "src/traced/probes/ftrace/atrace_hal_wrapper.h"
@@ -47,6 +53,8 @@
 #include "src/traced/probes/ftrace/proto_translation_table.h"
 #include "src/traced/probes/ftrace/vendor_tracepoints.h"
 
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+
 namespace perfetto {
 namespace {
 
@@ -54,6 +62,9 @@ constexpr int kDefaultDrainPeriodMs = 100;
 constexpr int kMinDrainPeriodMs = 1;
 constexpr int kMaxDrainPeriodMs = 1000 * 60;
 
+// The kernel's default for the buffer_percent watermark, restored when done.
+constexpr uint32_t kDefaultBufferPercent = 50;
+
 // Read at most this many pages of data per cpu per read task. If we hit this
 // limit on at least one cpu, we stop and repost the read task, letting other
 // tasks get some cpu time before continuing reading.
@@ -233,6 +244,18 @@ void FtraceController::StartIfNeeded(FtraceInstanceState* instance) {
     instance->per_cpu.emplace_back(std::move(reader), period_page_quota);
   }
 
+  // Also drain the buffers as soon as they fill up past the watermark, if
+  // requested. The periodic read task below is kept as a fallback.
+  uint32_t buffer_percent = GetDrainBufferPercent();
+  if (buffer_percent > 0) {
+    if (instance->ftrace_procfs->SetBufferPercent(buffer_percent)) {
+      instance->buffer_percent = buffer_percent;
+      ArmWatermarkWatches(instance);
+    } else {
+      PERFETTO_ELOG("Failed to set buffer_percent, draining periodically");
+    }
+  }
+
   // Special case for primary instance: if not using the boot clock, take
   // manual clock snapshots so that the trace parser can do a best effort
   // conversion back to boot. This is primarily for old kernels that predate
@@ -280,6 +303,17 @@ void FtraceController::StartIfNeeded(FtraceInstanceState* instance) {
 // drain period. Therefore we introduce |per_cpu.period_page_quota|. If the
 // consumer wants to handle a high bandwidth of ftrace events, they should set
 // the config values appropriately.
+//
+// If any data source sets FtraceConfig.reader_threads, the cpus are instead
+// split across a pool of reader threads, each draining its cpus with its own
+// parsing buffer and writing into per-cpu trace writers. The main thread waits
+// for all of them before continuing, so all the other state (quotas, metadata,
+// control operations) is still only ever touched on the main thread.
+//
+// If FtraceConfig.drain_buffer_percent is set, the per-cpu buffers are also
+// polled for the kernel's buffer_percent watermark. When a cpu crosses it, the
+// cpu's quota is refilled and the read task runs straight away (see
+// OnCpuBufferWatermark()), restarting the drain period.
 void FtraceController::ReadTick(int generation) {
   metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                              metatrace::FTRACE_READ_TICK);
@@ -287,12 +321,15 @@ void FtraceController::ReadTick(int generation) {
     return;
   }
 
+  MaybeSetupReaderThreads();
+
   // Read all cpu buffers with remaining per-period quota.
   bool all_cpus_done = ReadTickForInstance(&primary_);
   for (auto& kv : secondary_instances_) {
     all_cpus_done &= ReadTickForInstance(kv.second.get());
   }
 
+  MergePerCpuMetadata();
   observer_->OnFtraceDataWrittenIntoDataSourceBuffers();
 
   // More work to do in this period.
@@ -322,6 +359,11 @@ void FtraceController::ReadTick(int generation) {
     // well.
     MaybeSnapshotFtraceClock();
 
+    // The buffers are drained: wait for them to reach the watermark again.
+    ArmWatermarkWatches(&primary_);
+    for (auto& it : secondary_instances_)
+      ArmWatermarkWatches(it.second.get());
+
     auto drain_period_ms = GetDrainPeriodMs();
     task_runner_->PostDelayedTask(
         [weak_this, generation] {
@@ -346,21 +388,22 @@ bool FtraceController::ReadTickForInstance(FtraceInstanceState* instance) {
   }
 #endif
 
-  bool all_cpus_done = true;
-  uint8_t* parsing_buf = reinterpret_cast<uint8_t*>(parsing_mem_.Get());
-  for (size_t i = 0; i < instance->per_cpu.size(); i++) {
-    size_t orig_quota = instance->per_cpu[i].period_page_quota;
+  // Can be cleared concurrently by the reader threads.
+  std::atomic<bool> all_cpus_done{true};
+  ReadCpus(instance, [instance, &all_cpus_done](size_t cpu,
+                                               uint8_t* parsing_buf) {
+    FtraceInstanceState::PerCpuState& per_cpu = instance->per_cpu[cpu];
+    size_t orig_quota = per_cpu.period_page_quota;
     if (orig_quota == 0)
-      continue;
+      return;
 
     size_t max_pages = std::min(orig_quota, kMaxPagesPerCpuPerReadTick);
-    CpuReader& cpu_reader = *instance->per_cpu[i].reader;
     size_t pages_read =
-        cpu_reader.ReadCycle(parsing_buf, kParsingBufferSizePages, max_pages,
-                             instance->started_data_sources);
+        per_cpu.reader->ReadCycle(parsing_buf, kParsingBufferSizePages,
+                                  max_pages, instance->started_data_sources);
 
     size_t new_quota = (pages_read >= orig_quota) ? 0 : orig_quota - pages_read;
-    instance->per_cpu[i].period_page_quota = new_quota;
+    per_cpu.period_page_quota = new_quota;
 
     // Reader got stopped by the cap on the number of pages (to not do too much
     // work on the shared thread at once), but can read more in this drain
@@ -371,12 +414,93 @@ bool FtraceController::ReadTickForInstance(FtraceInstanceState* instance) {
     // their quota, we will stop for the given period.
     PERFETTO_DCHECK(pages_read <= max_pages);
     if (pages_read == max_pages && new_quota > 0) {
-      all_cpus_done = false;
+      all_cpus_done.store(false, std::memory_order_relaxed);
     }
-  }
+  });
   return all_cpus_done;
 }
 
+void FtraceController::ReadCpus(
+    FtraceInstanceState* instance,
+    const std::function<void(size_t cpu, uint8_t* parsing_buf)>& read_cpu) {
+  const size_t num_cpus = instance->per_cpu.size();
+  if (!reader_pool_) {
+    uint8_t* parsing_buf = reinterpret_cast<uint8_t*>(parsing_mem_.Get());
+    for (size_t cpu = 0; cpu < num_cpus; cpu++)
+      read_cpu(cpu, parsing_buf);
+    return;
+  }
+
+  // Reader thread N handles the cpus N, N + num_threads, N + 2 * num_threads...
+  const size_t num_threads = reader_parsing_mem_.size();
+  std::mutex mutex;
+  std::condition_variable all_done;
+  size_t pending_threads = num_threads;
+  for (size_t thread = 0; thread < num_threads; thread++) {
+    uint8_t* parsing_buf =
+        reinterpret_cast<uint8_t*>(reader_parsing_mem_[thread].Get());
+    reader_pool_->PostTask([&, thread, parsing_buf] {
+      for (size_t cpu = thread; cpu < num_cpus; cpu += num_threads)
+        read_cpu(cpu, parsing_buf);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--pending_threads == 0)
+        all_done.notify_one();
+    });
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  all_done.wait(lock, [&pending_threads] { return pending_threads == 0; });
+}
+
+void FtraceController::MaybeSetupReaderThreads() {
+  uint32_t num_threads = 1;
+  for (const FtraceDataSource* data_source : data_sources_)
+    num_threads = std::max(num_threads, data_source->config().reader_threads());
+  size_t num_cpus = primary_.ftrace_procfs->NumberOfCpus();
+  num_threads = static_cast<uint32_t>(std::min<size_t>(num_threads, num_cpus));
+
+  // All the started data sources need a trace writer per cpu, as a TraceWriter
+  // can't be used concurrently.
+  auto setup_per_cpu_state = [](FtraceInstanceState* instance) {
+    bool ok = true;
+    for (FtraceDataSource* data_source : instance->started_data_sources)
+      ok &= data_source->SetupPerCpuState(instance->per_cpu.size());
+    return ok;
+  };
+  if (num_threads > 1) {
+    bool can_read_concurrently = setup_per_cpu_state(&primary_);
+    for (auto& kv : secondary_instances_)
+      can_read_concurrently &= setup_per_cpu_state(kv.second.get());
+    if (!can_read_concurrently)
+      num_threads = 1;
+  }
+
+  if (num_threads <= 1) {
+    reader_pool_.reset();
+    reader_parsing_mem_.clear();
+    return;
+  }
+  if (reader_parsing_mem_.size() == num_threads)
+    return;
+
+  PERFETTO_DLOG("Reading ftrace on %" PRIu32 " threads", num_threads);
+  reader_pool_.reset();  // Joins the threads of the previous pool, if any.
+  reader_pool_.reset(new base::ThreadPool(num_threads));
+  reader_parsing_mem_.clear();
+  for (uint32_t i = 0; i < num_threads; i++) {
+    reader_parsing_mem_.emplace_back(
+        base::PagedMemory::Allocate(base::kPageSize * kParsingBufferSizePages));
+  }
+}
+
+void FtraceController::MergePerCpuMetadata() {
+  for (FtraceDataSource* data_source : primary_.started_data_sources)
+    data_source->MergePerCpuMetadata();
+  for (auto& kv : secondary_instances_) {
+    for (FtraceDataSource* data_source : kv.second->started_data_sources)
+      data_source->MergePerCpuMetadata();
+  }
+}
+
 uint32_t FtraceController::GetDrainPeriodMs() {
   if (data_sources_.empty())
     return kDefaultDrainPeriodMs;
@@ -388,15 +512,75 @@ uint32_t FtraceController::GetDrainPeriodMs() {
   return ClampDrainPeriodMs(min_drain_period_ms);
 }
 
+uint32_t FtraceController::GetDrainBufferPercent() {
+  uint32_t min_buffer_percent = 0;
+  for (const FtraceDataSource* data_source : data_sources_) {
+    uint32_t buffer_percent = data_source->config().drain_buffer_percent();
+    if (buffer_percent > 0 &&
+        (min_buffer_percent == 0 || buffer_percent < min_buffer_percent)) {
+      min_buffer_percent = buffer_percent;
+    }
+  }
+  return std::min<uint32_t>(min_buffer_percent, 100);
+}
+
+void FtraceController::ArmWatermarkWatches(FtraceInstanceState* instance) {
+  if (!instance->buffer_percent)
+    return;
+  auto weak_this = weak_factory_.GetWeakPtr();
+  for (size_t cpu = 0; cpu < instance->per_cpu.size(); cpu++) {
+    FtraceInstanceState::PerCpuState& per_cpu = instance->per_cpu[cpu];
+    if (per_cpu.watermark_watched)
+      continue;
+    per_cpu.watermark_watched = true;
+    // |instance| outlives the watch, see DisarmWatermarkWatches().
+    task_runner_->AddFileDescriptorWatch(
+        per_cpu.reader->trace_fd(), [weak_this, instance, cpu] {
+          if (weak_this)
+            weak_this->OnCpuBufferWatermark(instance, cpu);
+        });
+  }
+}
+
+void FtraceController::DisarmWatermarkWatches(FtraceInstanceState* instance) {
+  for (FtraceInstanceState::PerCpuState& per_cpu : instance->per_cpu) {
+    if (!per_cpu.watermark_watched)
+      continue;
+    task_runner_->RemoveFileDescriptorWatch(per_cpu.reader->trace_fd());
+    per_cpu.watermark_watched = false;
+  }
+}
+
+void FtraceController::OnCpuBufferWatermark(FtraceInstanceState* instance,
+                                            size_t cpu) {
+  // The fd stays readable until the buffer is drained below the watermark.
+  // Stop watching it until the read below catches up, see ReadTick().
+  FtraceInstanceState::PerCpuState& per_cpu = instance->per_cpu[cpu];
+  task_runner_->RemoveFileDescriptorWatch(per_cpu.reader->trace_fd());
+  per_cpu.watermark_watched = false;
+
+  // The buffer is filling up: give the cpu a new quota rather than waiting for
+  // the next drain period.
+  per_cpu.period_page_quota =
+      instance->ftrace_config_muxer->GetPerCpuBufferSizePages();
+
+  // Bumping the generation cancels the pending periodic read task, ReadTick()
+  // posts the next one once done.
+  ReadTick(++generation_);
+}
+
 void FtraceController::Flush(FlushRequestID flush_id) {
   metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                              metatrace::FTRACE_CPU_FLUSH);
 
+  MaybeSetupReaderThreads();
+
   FlushForInstance(&primary_);
   for (auto& it : secondary_instances_) {
     FlushForInstance(it.second.get());
   }
 
+  MergePerCpuMetadata();
   observer_->OnFtraceDataWrittenIntoDataSourceBuffers();
 
   for (FtraceDataSource* data_source : primary_.started_data_sources) {
@@ -418,12 +602,12 @@ void FtraceController::FlushForInstance(FtraceInstanceState* instance) {
   // events.
   size_t per_cpubuf_size_pages =
       instance->ftrace_config_muxer->GetPerCpuBufferSizePages();
-  uint8_t* parsing_buf = reinterpret_cast<uint8_t*>(parsing_mem_.Get());
-  for (size_t i = 0; i < instance->per_cpu.size(); i++) {
-    instance->per_cpu[i].reader->ReadCycle(parsing_buf, kParsingBufferSizePages,
-                                           per_cpubuf_size_pages,
-                                           instance->started_data_sources);
-  }
+  ReadCpus(instance, [instance, per_cpubuf_size_pages](size_t cpu,
+                                                        uint8_t* parsing_buf) {
+    instance->per_cpu[cpu].reader->ReadCycle(
+        parsing_buf, kParsingBufferSizePages, per_cpubuf_size_pages,
+        instance->started_data_sources);
+  });
 }
 
 // We are not implicitly flushing on Stop. The tracing service is supposed to
@@ -433,6 +617,11 @@ void FtraceController::StopIfNeeded(FtraceInstanceState* instance) {
   if (!instance->started_data_sources.empty())
     return;
 
+  DisarmWatermarkWatches(instance);
+  if (instance->buffer_percent) {
+    instance->ftrace_procfs->SetBufferPercent(kDefaultBufferPercent);
+    instance->buffer_percent = 0;
+  }
   instance->per_cpu.clear();
   if (instance == &primary_) {
     cpu_zero_stats_fd_.reset();
@@ -455,6 +644,8 @@ void FtraceController::StopIfNeeded(FtraceInstanceState* instance) {
   if (parsing_mem_.IsValid()) {
     parsing_mem_.AdviseDontNeed(parsing_mem_.Get(), parsing_mem_.size());
   }
+  reader_pool_.reset();
+  reader_parsing_mem_.clear();
 }
 
 bool FtraceController::AddDataSource(FtraceDataSource* data_source) {
@@ -472,7 +663,8 @@ bool FtraceController::AddDataSource(FtraceDataSource* data_source) {
   FtraceConfigId config_id = next_cfg_id_++;
   if (!instance->ftrace_config_muxer->SetupConfig(
           config_id, data_source->config(),
-          data_source->mutable_setup_errors())) {
+          data_source->mutable_setup_errors(),
+          data_source->mutable_setup_timings())) {
     DestroyIfUnusedSeconaryInstance(instance);
     return false;
   }
@@ -497,6 +689,10 @@ bool FtraceController::StartDataSource(FtraceDataSource* data_source) {
 
   if (!instance->ftrace_config_muxer->ActivateConfig(config_id))
     return false;
+  if (data_source->parsing_config()->raw_pages) {
+    data_source->set_raw_pages_format(
+        SerializeRawPagesFormat(instance, data_source));
+  }
   instance->started_data_sources.insert(data_source);
   StartIfNeeded(instance);
 
@@ -519,6 +715,25 @@ bool FtraceController::StartDataSource(FtraceDataSource* data_source) {
   return true;
 }
 
+std::string FtraceController::SerializeRawPagesFormat(
+    FtraceInstanceState* instance,
+    FtraceDataSource* data_source) {
+  protozero::HeapBuffered<protos::pbzero::FtraceEventBundle::RawPagesFormat>
+      format;
+  format->set_header_page(instance->ftrace_procfs->ReadPageHeaderFormat());
+  const EventFilter& filter = data_source->parsing_config()->event_filter;
+  for (size_t event_id : filter.GetEnabledEvents()) {
+    const Event* event = instance->table->GetEventById(event_id);
+    if (!event)
+      continue;
+    std::string event_format =
+        instance->ftrace_procfs->ReadEventFormat(event->group, event->name);
+    if (!event_format.empty())
+      format->add_event_format(event_format);
+  }
+  return format.SerializeAsString();
+}
+
 void FtraceController::RemoveDataSource(FtraceDataSource* data_source) {
   size_t removed = data_sources_.erase(data_source);
   if (!removed)
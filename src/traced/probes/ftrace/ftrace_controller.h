@@ -20,13 +20,16 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/base/paged_memory.h"
+#include "perfetto/ext/base/threading/thread_pool.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
@@ -108,6 +111,8 @@ class FtraceController {
           : reader(std::move(_reader)), period_page_quota(_period_page_quota) {}
       std::unique_ptr<CpuReader> reader;
       size_t period_page_quota = 0;
+      // Whether the reader's fd is being polled for the buffer watermark.
+      bool watermark_watched = false;
     };
 
     FtraceInstanceState(std::unique_ptr<FtraceProcfs>,
@@ -119,6 +124,9 @@ class FtraceController {
     std::unique_ptr<FtraceConfigMuxer> ftrace_config_muxer;
     std::vector<PerCpuState> per_cpu;  // empty if no started data sources
     std::set<FtraceDataSource*> started_data_sources;
+    // The buffer_percent watermark the cpu buffers are drained at, on top of
+    // the periodic drain. 0 if draining only periodically.
+    uint32_t buffer_percent = 0;
   };
 
   FtraceInstanceState* GetInstance(const std::string& instance_name);
@@ -139,12 +147,39 @@ class FtraceController {
   void ReadTick(int generation);
   bool ReadTickForInstance(FtraceInstanceState* instance);
   uint32_t GetDrainPeriodMs();
+  uint32_t GetDrainBufferPercent();
+
+  // Watches the trace_pipe_raw of the cpus of |instance| which aren't being
+  // watched, if draining at the buffer_percent watermark.
+  void ArmWatermarkWatches(FtraceInstanceState* instance);
+  void DisarmWatermarkWatches(FtraceInstanceState* instance);
+  void OnCpuBufferWatermark(FtraceInstanceState* instance, size_t cpu);
 
   void FlushForInstance(FtraceInstanceState* instance);
 
+  // (Re)creates or destroys the threads used to read the cpu buffers, as per
+  // the FtraceConfig.reader_threads of the data sources.
+  void MaybeSetupReaderThreads();
+
+  // Calls |read_cpu| for each cpu of |instance|, passing the parsing buffer to
+  // use. The calls happen on the reader threads, if any, otherwise on the
+  // calling thread. Returns only once all the cpus have been read.
+  void ReadCpus(FtraceInstanceState* instance,
+                const std::function<void(size_t cpu, uint8_t* parsing_buf)>&
+                    read_cpu);
+
+  // Collects the metadata written by the reader threads into each started
+  // data source's metadata.
+  void MergePerCpuMetadata();
+
   void StartIfNeeded(FtraceInstanceState* instance);
   void StopIfNeeded(FtraceInstanceState* instance);
 
+  // Returns the serialized FtraceEventBundle.RawPagesFormat describing the
+  // events enabled by |data_source|, for FtraceConfig.raw_pages.
+  std::string SerializeRawPagesFormat(FtraceInstanceState* instance,
+                                      FtraceDataSource* data_source);
+
   FtraceInstanceState* GetOrCreateInstance(const std::string& instance_name);
   void DestroyIfUnusedSeconaryInstance(FtraceInstanceState* instance);
 
@@ -154,6 +189,10 @@ class FtraceController {
   base::TaskRunner* const task_runner_;
   Observer* const observer_;
   base::PagedMemory parsing_mem_;
+  // Only set if the cpu buffers are read on multiple threads. Each reader
+  // thread uses its own parsing buffer from |reader_parsing_mem_|.
+  std::unique_ptr<base::ThreadPool> reader_pool_;
+  std::vector<base::PagedMemory> reader_parsing_mem_;
   LazyKernelSymbolizer symbolizer_;
   FtraceConfigId next_cfg_id_ = 1;
   int generation_ = 0;
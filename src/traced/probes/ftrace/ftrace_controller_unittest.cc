@@ -20,6 +20,10 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <functional>
+#include <utility>
+#include <vector>
+
 #include "perfetto/ext/base/file_utils.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
@@ -213,6 +217,7 @@ class TestFtraceController : public FtraceController,
   MockTaskRunner* runner() { return runner_.get(); }
   MockFtraceProcfs* procfs() { return primary_procfs_; }
   uint32_t drain_period_ms() { return GetDrainPeriodMs(); }
+  size_t reader_threads() { return reader_parsing_mem_.size(); }
 
   std::unique_ptr<FtraceDataSource> AddFakeDataSource(const FtraceConfig& cfg) {
     std::unique_ptr<FtraceDataSource> data_source(new FtraceDataSource(
@@ -559,6 +564,96 @@ TEST(FtraceControllerTest, PeriodicDrainConfig) {
   }
 }
 
+TEST(FtraceControllerTest, ReaderThreads) {
+  auto controller = CreateTestController(true /* nice procfs */,
+                                         4 /* num cpus */);
+
+  FtraceConfig config = CreateFtraceConfig({"group/foo"});
+  config.set_reader_threads(2);
+  auto data_source = controller->AddFakeDataSource(config);
+  ASSERT_TRUE(data_source);
+  size_t writers_created = 0;
+  data_source->set_trace_writer_factory([&writers_created] {
+    writers_created++;
+    return std::unique_ptr<TraceWriter>(new TraceWriterForTesting());
+  });
+  ASSERT_TRUE(controller->StartDataSource(data_source.get()));
+
+  // The reader threads and the per-cpu writers are set up on the first read.
+  EXPECT_EQ(controller->reader_threads(), 0u);
+  controller->Flush(1);
+  EXPECT_EQ(controller->reader_threads(), 2u);
+  EXPECT_EQ(writers_created, 4u);
+  EXPECT_NE(data_source->trace_writer_for_cpu(3), nullptr);
+  EXPECT_NE(data_source->metadata_for_cpu(3), data_source->mutable_metadata());
+
+  // The metadata collected on each cpu is merged into the data source's one.
+  data_source->metadata_for_cpu(1)->AddPid(42);
+  data_source->metadata_for_cpu(3)->AddRenamePid(43);
+  controller->Flush(2);
+  EXPECT_EQ(writers_created, 4u);
+  EXPECT_THAT(data_source->mutable_metadata()->pids, ElementsAre(42));
+  EXPECT_THAT(data_source->mutable_metadata()->rename_pids, ElementsAre(43));
+  EXPECT_THAT(data_source->metadata_for_cpu(1)->pids, IsEmpty());
+
+  data_source.reset();
+  EXPECT_EQ(controller->reader_threads(), 0u);
+}
+
+TEST(FtraceControllerTest, ReaderThreadsNeedWriterFactory) {
+  auto controller = CreateTestController(true /* nice procfs */,
+                                         4 /* num cpus */);
+
+  FtraceConfig config = CreateFtraceConfig({"group/foo"});
+  config.set_reader_threads(4);
+  auto data_source = controller->AddFakeDataSource(config);
+  ASSERT_TRUE(data_source);
+  ASSERT_TRUE(controller->StartDataSource(data_source.get()));
+
+  // Without per-cpu writers the cpus are read on the main thread.
+  controller->Flush(1);
+  EXPECT_EQ(controller->reader_threads(), 0u);
+  EXPECT_EQ(data_source->metadata_for_cpu(3), data_source->mutable_metadata());
+}
+
+TEST(FtraceControllerTest, DrainOnBufferWatermark) {
+  auto controller = CreateTestController(true /* nice procfs */,
+                                         2 /* num cpus */);
+
+  FtraceConfig config = CreateFtraceConfig({"group/foo"});
+  config.set_drain_buffer_percent(25);
+  auto data_source = controller->AddFakeDataSource(config);
+  ASSERT_TRUE(data_source);
+
+  // Starting sets the watermark and polls all the cpu buffers.
+  std::vector<std::pair<int, std::function<void()>>> watches;
+  EXPECT_CALL(*controller->procfs(), WriteToFile("/root/buffer_percent", "25"));
+  EXPECT_CALL(*controller->runner(), AddFileDescriptorWatch(_, _))
+      .Times(2)
+      .WillRepeatedly(Invoke([&watches](int fd, std::function<void()> cb) {
+        watches.emplace_back(fd, std::move(cb));
+      }));
+  ASSERT_TRUE(controller->StartDataSource(data_source.get()));
+  Mock::VerifyAndClearExpectations(controller->runner());
+  Mock::VerifyAndClearExpectations(controller->procfs());
+  ASSERT_EQ(watches.size(), 2u);
+
+  // Crossing the watermark drains the buffers straight away, stops watching
+  // the cpu until then and reschedules the periodic read.
+  EXPECT_CALL(*controller->runner(),
+              RemoveFileDescriptorWatch(watches[1].first));
+  EXPECT_CALL(*controller->runner(),
+              AddFileDescriptorWatch(watches[1].first, _));
+  EXPECT_CALL(*controller->runner(), PostDelayedTask(_, _));
+  watches[1].second();
+  Mock::VerifyAndClearExpectations(controller->runner());
+
+  // Stopping restores the default watermark.
+  EXPECT_CALL(*controller->runner(), RemoveFileDescriptorWatch(_)).Times(2);
+  EXPECT_CALL(*controller->procfs(), WriteToFile("/root/buffer_percent", "50"));
+  data_source.reset();
+}
+
 TEST(FtraceMetadataTest, Clear) {
   FtraceMetadata metadata;
   metadata.inode_and_device.insert(std::make_pair(1, 1));
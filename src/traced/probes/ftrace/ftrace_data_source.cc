@@ -112,6 +112,7 @@ void FtraceDataSource::Start() {
     return;
   DumpFtraceStats(&stats_before_);
   setup_errors_ = FtraceSetupErrors();  // Dump only on START_OF_TRACE.
+  setup_timings_ = FtraceSetupTimings();
 
   if (config_.preserve_ftrace_buffer()) {
     auto stats_packet = writer_->NewTracePacket();
@@ -125,6 +126,7 @@ void FtraceDataSource::DumpFtraceStats(FtraceStats* stats) {
   if (controller_weak_)
     controller_weak_->DumpFtraceStats(this, stats);
   stats->setup_errors = std::move(setup_errors_);
+  stats->setup_timings = setup_timings_;
 }
 
 void FtraceDataSource::Flush(FlushRequestID flush_request_id,
@@ -156,10 +158,42 @@ void FtraceDataSource::OnFtraceFlushComplete(FlushRequestID flush_request_id) {
   pending_flushes_.erase(it);
   if (writer_) {
     WriteStats();
+    // The per-cpu writers are flushed first, so that their data is committed
+    // by the time the service is notified via |callback|.
+    for (auto& cpu_writer : per_cpu_writers_)
+      cpu_writer->Flush();
     writer_->Flush(std::move(callback));
   }
 }
 
+bool FtraceDataSource::SetupPerCpuState(size_t num_cpus) {
+  if (per_cpu_writers_.size() >= num_cpus)
+    return true;
+  if (!trace_writer_factory_)
+    return false;
+  while (per_cpu_writers_.size() < num_cpus)
+    per_cpu_writers_.emplace_back(trace_writer_factory_());
+  per_cpu_metadata_.resize(num_cpus);
+  per_cpu_raw_pages_format_written_.resize(num_cpus);
+  return true;
+}
+
+void FtraceDataSource::MergePerCpuMetadata() {
+  for (FtraceMetadata& cpu_metadata : per_cpu_metadata_) {
+    for (int32_t pid : cpu_metadata.pids)
+      metadata_.AddPid(pid);
+    for (int32_t pid : cpu_metadata.rename_pids)
+      metadata_.AddRenamePid(pid);
+    for (const auto& fd : cpu_metadata.fds)
+      metadata_.fds.insert(fd);
+    for (const auto& inode : cpu_metadata.inode_and_device)
+      metadata_.inode_and_device.insert(inode);
+    // The kernel symbols have already been interned on the cpu's own sequence
+    // and are not needed any further.
+    cpu_metadata.Clear();
+  }
+}
+
 void FtraceDataSource::WriteStats() {
   {
     auto before_packet = writer_->NewTracePacket();
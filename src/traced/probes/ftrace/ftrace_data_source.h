@@ -23,6 +23,7 @@
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/weak_ptr.h"
@@ -82,8 +83,54 @@ class FtraceDataSource : public ProbesDataSource {
 
   FtraceMetadata* mutable_metadata() { return &metadata_; }
   FtraceSetupErrors* mutable_setup_errors() { return &setup_errors_; }
+  FtraceSetupTimings* mutable_setup_timings() { return &setup_timings_; }
   TraceWriter* trace_writer() { return writer_.get(); }
 
+  // Used to create the per-cpu trace writers when the cpu buffers are read on
+  // multiple threads (FtraceConfig.reader_threads). Set by ProbesProducer.
+  using TraceWriterFactory = std::function<std::unique_ptr<TraceWriter>()>;
+  void set_trace_writer_factory(TraceWriterFactory factory) {
+    trace_writer_factory_ = std::move(factory);
+  }
+
+  // Creates a trace writer and a metadata instance for each of the |num_cpus|,
+  // so that each cpu can be parsed on a different thread. Returns false if
+  // this data source can't write concurrently (no writer factory was set).
+  // Must be called on the main thread.
+  bool SetupPerCpuState(size_t num_cpus);
+
+  // Moves the metadata collected on the per-cpu instances into the shared one
+  // returned by mutable_metadata(). Must be called on the main thread, after
+  // the reader threads are done.
+  void MergePerCpuMetadata();
+
+  // The writer and metadata to use when parsing the data of |cpu|. These are
+  // the shared ones unless SetupPerCpuState() was called.
+  TraceWriter* trace_writer_for_cpu(size_t cpu) {
+    return cpu < per_cpu_writers_.size() ? per_cpu_writers_[cpu].get()
+                                         : writer_.get();
+  }
+  FtraceMetadata* metadata_for_cpu(size_t cpu) {
+    return cpu < per_cpu_metadata_.size() ? &per_cpu_metadata_[cpu]
+                                          : &metadata_;
+  }
+
+  // The serialized FtraceEventBundle.RawPagesFormat, if FtraceConfig.raw_pages
+  // is set. Set by FtraceController when the data source is started.
+  void set_raw_pages_format(std::string format) {
+    raw_pages_format_ = std::move(format);
+  }
+  const std::string& raw_pages_format() const { return raw_pages_format_; }
+
+  // Returns true the first time it's called for the writer of |cpu|, i.e. if
+  // the raw pages format must be written before the pages of |cpu|.
+  bool ShouldWriteRawPagesFormat(size_t cpu) {
+    uint8_t* written = cpu < per_cpu_raw_pages_format_written_.size()
+                           ? &per_cpu_raw_pages_format_written_[cpu]
+                           : &raw_pages_format_written_;
+    return !std::exchange(*written, 1);
+  }
+
  private:
   // Hands out internal pointers to callbacks.
   FtraceDataSource(const FtraceDataSource&) = delete;
@@ -98,6 +145,7 @@ class FtraceDataSource : public ProbesDataSource {
   FtraceMetadata metadata_;
   FtraceStats stats_before_{};
   FtraceSetupErrors setup_errors_{};
+  FtraceSetupTimings setup_timings_{};
   std::map<FlushRequestID, std::function<void()>> pending_flushes_;
 
   // -- Fields initialized by the Initialize() call:
@@ -108,6 +156,16 @@ class FtraceDataSource : public ProbesDataSource {
   // configuration. Not the raw FtraceConfig proto (held by |config_|).
   const FtraceDataSourceConfig* parsing_config_;
   // -- End of fields set by Initialize().
+
+  TraceWriterFactory trace_writer_factory_;
+  // Empty unless SetupPerCpuState() is called, indexed by cpu.
+  std::vector<std::unique_ptr<TraceWriter>> per_cpu_writers_;
+  std::vector<FtraceMetadata> per_cpu_metadata_;
+
+  std::string raw_pages_format_;
+  uint8_t raw_pages_format_written_ = 0;
+  // Not a std::vector<bool>, as each cpu can be written on a different thread.
+  std::vector<uint8_t> per_cpu_raw_pages_format_written_;
 };
 
 }  // namespace perfetto
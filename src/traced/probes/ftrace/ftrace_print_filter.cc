@@ -65,6 +65,16 @@ bool AtraceMessageMatches(const std::string& before_pid_part,
   return PrefixMatches(after_pid_prefix, s.data(), s.size());
 }
 
+// Returns true if |str| can be used verbatim in a glob of a tracefs filter
+// expression, i.e. it has no wildcards or characters that need escaping.
+bool IsKernelGlobLiteral(const std::string& str) {
+  for (char c : str) {
+    if (!isprint(static_cast<unsigned char>(c)) || strchr("*?[]\\\"", c))
+      return false;
+  }
+  return true;
+}
+
 }  // namespace
 
 // static
@@ -107,6 +117,34 @@ bool FtracePrintFilter::IsAllowed(const char* start, size_t size) const {
   return true;
 }
 
+std::optional<std::string> FtracePrintFilter::ToKernelFilter() const {
+  // The expression is built from the last rule backwards: |expr| allows the
+  // strings which don't match any of the rules before it, std::nullopt meaning
+  // all of them.
+  std::optional<std::string> expr;
+  for (auto it = rules_.rbegin(); it != rules_.rend(); ++it) {
+    const Rule& rule = *it;
+    // Atrace messages are matched on their type only, which is a superset of
+    // the strings matched by the rule: good enough for allowing, but not for
+    // denying.
+    bool exact = rule.type == Rule::Type::kPrefixMatch;
+    const std::string& literal = exact ? rule.prefix : rule.before_pid_part;
+    if (!IsKernelGlobLiteral(literal)) {
+      if (rule.allow)
+        expr = std::nullopt;
+      continue;
+    }
+    std::string match = "buf ~ \"" + literal + (exact ? "*\"" : "|*\"");
+    if (rule.allow) {
+      if (expr)
+        expr = "(" + match + " || " + *expr + ")";
+    } else if (exact) {
+      expr = expr ? "(!(" + match + ") && " + *expr + ")" : "!(" + match + ")";
+    }
+  }
+  return expr;
+}
+
 // static
 std::optional<FtracePrintFilterConfig> FtracePrintFilterConfig::Create(
     const protos::gen::FtraceConfig::PrintFilter& config,
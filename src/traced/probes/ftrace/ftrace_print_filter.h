@@ -43,6 +43,13 @@ class FtracePrintFilter {
   // first '\0' byte, whichever comes first.
   bool IsAllowed(const char* start, size_t size) const;
 
+  // Returns a tracefs filter expression for the "buf" field of "ftrace/print",
+  // which allows (at least) all the strings allowed by this filter. Returns
+  // std::nullopt if there's no such expression more selective than allowing
+  // everything. The kernel can't match all the rules exactly, so the events it
+  // lets through still need to be checked with IsAllowed().
+  std::optional<std::string> ToKernelFilter() const;
+
  private:
   struct Rule {
     enum class Type {
@@ -67,6 +74,7 @@ class FtracePrintFilterConfig {
       ProtoTranslationTable* table);
 
   uint32_t event_id() const { return event_id_; }
+  const FtracePrintFilter& filter() const { return filter_; }
 
   // Returns true if the "ftrace/print" event (encoded from `start` to `end`)
   // should be allowed.
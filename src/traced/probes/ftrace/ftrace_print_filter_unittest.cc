@@ -222,5 +222,80 @@ TEST(FtracePrintFilterTest, AtraceRuleMatches) {
   EXPECT_FALSE(filter.IsAllowed("C|111111|mycounter...", 21));
 }
 
+TEST(FtracePrintFilterTest, KernelFilterEmptyConfig) {
+  FtraceConfig::PrintFilter conf;
+  FtracePrintFilter filter(conf);
+
+  EXPECT_EQ(filter.ToKernelFilter(), std::nullopt);
+}
+
+TEST(FtracePrintFilterTest, KernelFilterAllowThenDenyAll) {
+  FtraceConfig::PrintFilter conf;
+  {
+    auto* rule = conf.add_rules();
+    rule->set_prefix("word");
+    rule->set_allow(true);
+  }
+  {
+    auto* rule = conf.add_rules();
+    auto* atrace = rule->mutable_atrace_msg();
+    atrace->set_type("B");
+    atrace->set_prefix("slice");
+    rule->set_allow(true);
+  }
+  {
+    auto* rule = conf.add_rules();
+    rule->set_prefix("");
+    rule->set_allow(false);
+  }
+  FtracePrintFilter filter(conf);
+
+  EXPECT_EQ(filter.ToKernelFilter(),
+            "(buf ~ \"word*\" || (buf ~ \"B|*\" || !(buf ~ \"*\")))");
+}
+
+TEST(FtracePrintFilterTest, KernelFilterDenyThenAllowAll) {
+  FtraceConfig::PrintFilter conf;
+  {
+    auto* rule = conf.add_rules();
+    rule->set_prefix("noisy");
+    rule->set_allow(false);
+  }
+  {
+    // Can't be matched exactly by the kernel: ignored.
+    auto* rule = conf.add_rules();
+    auto* atrace = rule->mutable_atrace_msg();
+    atrace->set_type("C");
+    atrace->set_prefix("mycounter");
+    rule->set_allow(false);
+  }
+  FtracePrintFilter filter(conf);
+
+  EXPECT_EQ(filter.ToKernelFilter(), "!(buf ~ \"noisy*\")");
+}
+
+TEST(FtracePrintFilterTest, KernelFilterAllowEverything) {
+  FtraceConfig::PrintFilter conf;
+  {
+    auto* rule = conf.add_rules();
+    rule->set_prefix("noisy");
+    rule->set_allow(true);
+  }
+  {
+    // A glob character: allows everything in the kernel.
+    auto* rule = conf.add_rules();
+    rule->set_prefix("a*b");
+    rule->set_allow(true);
+  }
+  {
+    auto* rule = conf.add_rules();
+    rule->set_prefix("");
+    rule->set_allow(false);
+  }
+  FtracePrintFilter filter(conf);
+
+  EXPECT_EQ(filter.ToKernelFilter(), std::nullopt);
+}
+
 }  // namespace
 }  // namespace perfetto
@@ -132,6 +132,30 @@ bool FtraceProcfs::SetSyscallFilter(const std::set<size_t>& filter) {
   return true;
 }
 
+bool FtraceProcfs::SetEventFilter(const std::string& group,
+                                  const std::string& name,
+                                  const std::string& filter) {
+  std::string path = root_ + "events/" + group + "/" + name + "/filter";
+  if (!WriteToFile(path, filter.empty() ? "0" : filter)) {
+    PERFETTO_ELOG("Failed to write file: %s", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool FtraceProcfs::SetEventPids(const std::set<int32_t>& pids) {
+  // Writes without O_TRUNC add to the current set of pids.
+  std::string path = root_ + "set_event_pid";
+  if (!ClearFile(path))
+    return false;
+  if (pids.empty())
+    return true;
+  std::vector<std::string> parts;
+  for (int32_t pid : pids)
+    parts.push_back(std::to_string(pid));
+  return WriteToFile(path, base::Join(parts, " "));
+}
+
 bool FtraceProcfs::EnableEvent(const std::string& group,
                                const std::string& name) {
   std::string path = root_ + "events/" + group + "/" + name + "/enable";
@@ -162,6 +186,54 @@ bool FtraceProcfs::DisableEvent(const std::string& group,
   return ret;
 }
 
+std::vector<bool> FtraceProcfs::EnableEvents(
+    const std::vector<std::pair<std::string, std::string>>& events) {
+  std::vector<std::string> set_event_strs;
+  set_event_strs.reserve(events.size());
+  for (const auto& group_and_name : events) {
+    MaybeSetUpEventTriggers(group_and_name.first, group_and_name.second);
+    set_event_strs.push_back(group_and_name.first + ":" +
+                             group_and_name.second);
+  }
+
+  std::vector<bool> enabled =
+      AppendEachToFile(root_ + "set_event", set_event_strs);
+  enabled.resize(events.size(), false);
+  for (size_t i = 0; i < events.size(); ++i) {
+    if (enabled[i])
+      continue;
+    std::string path = root_ + "events/" + events[i].first + "/" +
+                       events[i].second + "/enable";
+    enabled[i] = WriteToFile(path, "1") ||
+                 AppendToFile(root_ + "set_event", set_event_strs[i]);
+  }
+  return enabled;
+}
+
+std::vector<bool> FtraceProcfs::DisableEvents(
+    const std::vector<std::pair<std::string, std::string>>& events) {
+  std::vector<std::string> set_event_strs;
+  set_event_strs.reserve(events.size());
+  for (const auto& group_and_name : events) {
+    set_event_strs.push_back("!" + group_and_name.first + ":" +
+                             group_and_name.second);
+  }
+
+  std::vector<bool> disabled =
+      AppendEachToFile(root_ + "set_event", set_event_strs);
+  disabled.resize(events.size(), false);
+  for (size_t i = 0; i < events.size(); ++i) {
+    if (!disabled[i]) {
+      std::string path = root_ + "events/" + events[i].first + "/" +
+                         events[i].second + "/enable";
+      disabled[i] = WriteToFile(path, "0") ||
+                    AppendToFile(root_ + "set_event", set_event_strs[i]);
+    }
+    MaybeTearDownEventTriggers(events[i].first, events[i].second);
+  }
+  return disabled;
+}
+
 bool FtraceProcfs::IsEventAccessible(const std::string& group,
                                      const std::string& name) {
   std::string path = root_ + "events/" + group + "/" + name + "/enable";
@@ -423,6 +495,11 @@ bool FtraceProcfs::SetCpuBufferSizeInPages(size_t pages) {
   return WriteNumberToFile(path, pages * (base::kPageSize / 1024ul));
 }
 
+bool FtraceProcfs::SetBufferPercent(uint32_t percent) {
+  std::string path = root_ + "buffer_percent";
+  return WriteNumberToFile(path, percent);
+}
+
 bool FtraceProcfs::GetTracingOn() {
   std::string path = root_ + "tracing_on";
   char tracing_on = ReadOneCharFromFile(path);
@@ -532,6 +609,23 @@ bool FtraceProcfs::AppendToFile(const std::string& path,
   return WriteFileInternal(path, str, O_WRONLY | O_APPEND);
 }
 
+std::vector<bool> FtraceProcfs::AppendEachToFile(
+    const std::string& path,
+    const std::vector<std::string>& strs) {
+  std::vector<bool> written;
+  if (strs.empty())
+    return written;
+  base::ScopedFile fd = base::OpenFile(path, O_WRONLY | O_APPEND);
+  if (!fd)
+    return written;
+  written.reserve(strs.size());
+  for (const std::string& str : strs) {
+    ssize_t res = base::WriteAll(fd.get(), str.c_str(), str.length());
+    written.push_back(res == static_cast<ssize_t>(str.length()));
+  }
+  return written;
+}
+
 base::ScopedFile FtraceProcfs::OpenPipeForCpu(size_t cpu) {
   std::string path =
       root_ + "per_cpu/cpu" + std::to_string(cpu) + "/trace_pipe_raw";
@@ -46,12 +46,33 @@ class FtraceProcfs {
   // Set the filter for syscall events. If empty, clear the filter.
   bool SetSyscallFilter(const std::set<size_t>& filter);
 
+  // Set the filter expression for the event with the given |group| and |name|.
+  // If empty, clear the filter.
+  bool SetEventFilter(const std::string& group,
+                      const std::string& name,
+                      const std::string& filter);
+
+  // Only record the events of the tasks in |pids|. If empty, clear the filter.
+  bool SetEventPids(const std::set<int32_t>& pids);
+
   // Enable the event under with the given |group| and |name|.
   bool EnableEvent(const std::string& group, const std::string& name);
 
   // Disable the event under with the given |group| and |name|.
   bool DisableEvent(const std::string& group, const std::string& name);
 
+  // Like EnableEvent() for each of the (group, name) |events|, but they are
+  // all written to set_event through a single file descriptor instead of
+  // opening the enable file of each event, which is much faster when there
+  // are many events. The events which can't be enabled this way fall back to
+  // EnableEvent(). Returns whether each event was enabled.
+  std::vector<bool> EnableEvents(
+      const std::vector<std::pair<std::string, std::string>>& events);
+
+  // Like EnableEvents(), for DisableEvent().
+  std::vector<bool> DisableEvents(
+      const std::vector<std::pair<std::string, std::string>>& events);
+
   // Returns true if the event under the given |group| and |name| exists and its
   // enable file is writeable.
   bool IsEventAccessible(const std::string& group, const std::string& name);
@@ -120,6 +141,10 @@ class FtraceProcfs {
   // by the number of CPUs.
   bool SetCpuBufferSizeInPages(size_t pages);
 
+  // Sets how full (in percent) a per-cpu buffer must be before a poll() on its
+  // trace_pipe_raw reports it as readable. The kernel default is 50.
+  bool SetBufferPercent(uint32_t percent);
+
   // Returns the number of CPUs.
   // This will match the number of tracing/per_cpu/cpuXX directories.
   size_t virtual NumberOfCpus() const;
@@ -175,6 +200,13 @@ class FtraceProcfs {
   // virtual and protected for testing.
   virtual bool WriteToFile(const std::string& path, const std::string& str);
   virtual bool AppendToFile(const std::string& path, const std::string& str);
+  // Opens |path| once in append mode and writes each of |strs| with its own
+  // write(), since the kernel applies a single command per write to most
+  // tracefs files. Returns whether each write succeeded, or an empty vector
+  // if |path| can't be opened.
+  virtual std::vector<bool> AppendEachToFile(
+      const std::string& path,
+      const std::vector<std::string>& strs);
   virtual bool ClearFile(const std::string& path);
   virtual bool IsFileWriteable(const std::string& path);
   virtual char ReadOneCharFromFile(const std::string& path);
@@ -32,6 +32,22 @@ void FtraceStats::Write(protos::pbzero::FtraceStats* writer) const {
     writer->add_unknown_ftrace_events(err);
   for (const std::string& err : setup_errors.failed_ftrace_events)
     writer->add_failed_ftrace_events(err);
+  if (setup_timings.total_ns)
+    setup_timings.Write(writer->set_setup_timings());
+}
+
+void FtraceSetupTimings::Write(
+    protos::pbzero::FtraceSetupTimings* writer) const {
+  if (reset_ns)
+    writer->set_reset_ns(reset_ns);
+  if (clock_and_buffer_ns)
+    writer->set_clock_and_buffer_ns(clock_and_buffer_ns);
+  if (atrace_ns)
+    writer->set_atrace_ns(atrace_ns);
+  writer->set_enable_events_ns(enable_events_ns);
+  writer->set_enabled_events(enabled_events);
+  writer->set_filters_ns(filters_ns);
+  writer->set_total_ns(total_ns);
 }
 
 void FtraceCpuStats::Write(protos::pbzero::FtraceCpuStats* writer) const {
@@ -27,6 +27,7 @@ namespace protos {
 namespace pbzero {
 class FtraceStats;
 class FtraceCpuStats;
+class FtraceSetupTimings;
 }  // namespace pbzero
 }  // namespace protos
 
@@ -50,9 +51,24 @@ struct FtraceSetupErrors {
   std::vector<std::string> failed_ftrace_events;
 };
 
+// Filled by FtraceConfigMuxer::SetupConfig, see FtraceSetupTimings in
+// ftrace_stats.proto.
+struct FtraceSetupTimings {
+  uint64_t reset_ns = 0;
+  uint64_t clock_and_buffer_ns = 0;
+  uint64_t atrace_ns = 0;
+  uint64_t enable_events_ns = 0;
+  uint32_t enabled_events = 0;
+  uint64_t filters_ns = 0;
+  uint64_t total_ns = 0;
+
+  void Write(protos::pbzero::FtraceSetupTimings*) const;
+};
+
 struct FtraceStats {
   std::vector<FtraceCpuStats> cpu_stats;
   FtraceSetupErrors setup_errors;
+  FtraceSetupTimings setup_timings;
   uint32_t kernel_symbols_parsed = 0;
   uint32_t kernel_symbols_mem_kb = 0;
 
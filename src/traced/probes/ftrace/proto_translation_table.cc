@@ -486,6 +486,7 @@ std::unique_ptr<ProtoTranslationTable> ProtoTranslationTable::Create(
         MergeFields(ftrace_event.fields, &event.fields, event.name);
 
     event.size = std::max<uint16_t>(fields_end, common_fields_end);
+    event.specialized_layout = FindSpecializedLayout(event.fields);
   }
 
   events.erase(std::remove_if(events.begin(), events.end(),
@@ -145,6 +145,13 @@ class ProtoTranslationTable {
   }
 
   const std::deque<Event>& events() { return events_; }
+
+  // Makes CpuReader parse all events field by field, ignoring their
+  // Event::specialized_layout. For comparing the two in tests and benchmarks.
+  void ClearSpecializedLayoutsForTesting() {
+    for (Event& event : events_)
+      event.specialized_layout = SpecializedLayout::kNone;
+  }
   const FtracePageHeaderSpec& ftrace_page_header_spec() const {
     return ftrace_page_header_spec_;
   }
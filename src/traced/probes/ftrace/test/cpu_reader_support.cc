@@ -30,27 +30,44 @@ namespace {
 
 std::map<std::string, std::unique_ptr<ProtoTranslationTable>>* g_tables;
 
-}  // namespace
+std::unique_ptr<ProtoTranslationTable> CreateTable(const std::string& name) {
+  std::string path = "src/traced/probes/ftrace/test/data/" + name + "/";
+  struct stat st;
+  if (lstat(path.c_str(), &st) == -1 && errno == ENOENT) {
+    // For OSS fuzz, which does not run in the correct cwd.
+    path = base::GetTestDataPath(path);
+  }
+  FtraceProcfs ftrace(path);
+  return ProtoTranslationTable::Create(&ftrace, GetStaticEventInfo(),
+                                       GetStaticCommonFieldsInfo());
+}
 
-ProtoTranslationTable* GetTable(const std::string& name) {
+ProtoTranslationTable* GetOrCreateTable(const std::string& name,
+                                        bool specialized_layouts) {
   if (!g_tables)
     g_tables =
         new std::map<std::string, std::unique_ptr<ProtoTranslationTable>>();
-  if (!g_tables->count(name)) {
-    std::string path = "src/traced/probes/ftrace/test/data/" + name + "/";
-    struct stat st;
-    if (lstat(path.c_str(), &st) == -1 && errno == ENOENT) {
-      // For OSS fuzz, which does not run in the correct cwd.
-      path = base::GetTestDataPath(path);
-    }
-    FtraceProcfs ftrace(path);
-    auto table = ProtoTranslationTable::Create(&ftrace, GetStaticEventInfo(),
-                                               GetStaticCommonFieldsInfo());
+  const std::string key = specialized_layouts ? name : name + "#generic";
+  if (!g_tables->count(key)) {
+    auto table = CreateTable(name);
     if (!table)
       return nullptr;
-    g_tables->emplace(name, std::move(table));
+    if (!specialized_layouts)
+      table->ClearSpecializedLayoutsForTesting();
+    g_tables->emplace(key, std::move(table));
   }
-  return g_tables->at(name).get();
+  return g_tables->at(key).get();
+}
+
+}  // namespace
+
+ProtoTranslationTable* GetTable(const std::string& name) {
+  return GetOrCreateTable(name, /*specialized_layouts=*/true);
+}
+
+ProtoTranslationTable* GetTableWithoutSpecializedLayouts(
+    const std::string& name) {
+  return GetOrCreateTable(name, /*specialized_layouts=*/false);
 }
 
 std::unique_ptr<uint8_t[]> PageFromXxd(const std::string& text) {
@@ -36,6 +36,11 @@ struct ExamplePage {
 // directory |name|. Caches the table for subsequent lookups.
 ProtoTranslationTable* GetTable(const std::string& name);
 
+// Same as GetTable(), but without the specialized parsers for the events
+// (i.e. ProtoTranslationTable::ClearSpecializedLayoutsForTesting()).
+ProtoTranslationTable* GetTableWithoutSpecializedLayouts(
+    const std::string& name);
+
 // Convert xxd output into binary data.
 std::unique_ptr<uint8_t[]> PageFromXxd(const std::string& text);
 
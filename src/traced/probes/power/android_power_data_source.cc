@@ -94,18 +94,20 @@ struct AndroidPowerDataSource::DynamicLibLoader {
     return rail_descriptors;
   }
 
-  std::vector<android_internal::RailEnergyData> GetRailEnergyData() {
+  // The Get*() methods called on every poll fill |out|, rather than returning
+  // a new vector, so that its memory is reused across polls.
+  void GetRailEnergyData(std::vector<android_internal::RailEnergyData>* out) {
+    out->clear();
     if (!get_rail_energy_data_)
-      return std::vector<android_internal::RailEnergyData>();
+      return;
 
-    std::vector<android_internal::RailEnergyData> energy_data(kMaxNumRails);
-    size_t num_rails = energy_data.size();
-    if (!get_rail_energy_data_(&energy_data[0], &num_rails)) {
+    out->resize(kMaxNumRails);
+    size_t num_rails = out->size();
+    if (!get_rail_energy_data_(out->data(), &num_rails)) {
       PERFETTO_ELOG("Failed to retrieve rail energy data.");
       num_rails = 0;
     }
-    energy_data.resize(num_rails);
-    return energy_data;
+    out->resize(num_rails);
   }
 
   std::vector<android_internal::EnergyConsumerInfo> GetEnergyConsumerInfo() {
@@ -123,19 +125,19 @@ struct AndroidPowerDataSource::DynamicLibLoader {
     return consumers;
   }
 
-  std::vector<android_internal::EnergyEstimationBreakdown> GetEnergyConsumed() {
+  void GetEnergyConsumed(
+      std::vector<android_internal::EnergyEstimationBreakdown>* out) {
+    out->clear();
     if (!get_energy_consumed_)
-      return std::vector<android_internal::EnergyEstimationBreakdown>();
+      return;
 
-    std::vector<android_internal::EnergyEstimationBreakdown> energy_breakdown(
-        kMaxNumPowerEntities);
-    size_t num_power_entities = energy_breakdown.size();
-    if (!get_energy_consumed_(&energy_breakdown[0], &num_power_entities)) {
+    out->resize(kMaxNumPowerEntities);
+    size_t num_power_entities = out->size();
+    if (!get_energy_consumed_(out->data(), &num_power_entities)) {
       PERFETTO_ELOG("Failed to retrieve energy estimation breakdown.");
       num_power_entities = 0;
     }
-    energy_breakdown.resize(num_power_entities);
-    return energy_breakdown;
+    out->resize(num_power_entities);
   }
 
   std::vector<android_internal::PowerEntityState> GetPowerEntityStates() {
@@ -153,20 +155,19 @@ struct AndroidPowerDataSource::DynamicLibLoader {
     return entity;
   }
 
-  std::vector<android_internal::PowerEntityStateResidency>
-  GetPowerEntityStateResidency() {
+  void GetPowerEntityStateResidency(
+      std::vector<android_internal::PowerEntityStateResidency>* out) {
+    out->clear();
     if (!get_power_entity_state_residency_)
-      return std::vector<android_internal::PowerEntityStateResidency>();
+      return;
 
-    std::vector<android_internal::PowerEntityStateResidency> entity(
-        kMaxNumPowerEntities);
-    size_t num_power_entities = entity.size();
-    if (!get_power_entity_state_residency_(&entity[0], &num_power_entities)) {
+    out->resize(kMaxNumPowerEntities);
+    size_t num_power_entities = out->size();
+    if (!get_power_entity_state_residency_(out->data(), &num_power_entities)) {
       PERFETTO_ELOG("Failed to retrieve power entities.");
       num_power_entities = 0;
     }
-    entity.resize(num_power_entities);
-    return entity;
+    out->resize(num_power_entities);
   }
 };
 
@@ -187,6 +188,7 @@ AndroidPowerDataSource::AndroidPowerDataSource(
       pcfg.collect_energy_estimation_breakdown();
   entity_state_residency_collection_enabled_ =
       pcfg.collect_entity_state_residency();
+  only_emit_changes_ = pcfg.only_emit_changes();
 
   if (poll_interval_ms_ == 0)
     poll_interval_ms_ = kDefaultPollIntervalMs;
@@ -258,9 +260,8 @@ void AndroidPowerDataSource::WriteBatteryCounters() {
   if (counters_enabled_.none())
     return;
 
-  auto packet = writer_->NewTracePacket();
-  packet->set_timestamp(static_cast<uint64_t>(base::GetBootTimeNs().count()));
-  auto* counters_proto = packet->set_battery();
+  TraceWriter::TracePacketHandle packet;
+  protos::pbzero::BatteryCounters* counters_proto = nullptr;
 
   for (size_t i = 0; i < counters_enabled_.size(); i++) {
     if (!counters_enabled_.test(i))
@@ -269,6 +270,20 @@ void AndroidPowerDataSource::WriteBatteryCounters() {
     auto value = lib_->GetCounter(counter);
     if (!value.has_value())
       continue;
+    if (only_emit_changes_) {
+      if (last_battery_counters_[i] == value)
+        continue;
+      last_battery_counters_[i] = value;
+    }
+
+    // Lazily add the packet, so that no empty packet is written if no
+    // counter changed.
+    if (!packet) {
+      packet = writer_->NewTracePacket();
+      packet->set_timestamp(
+          static_cast<uint64_t>(base::GetBootTimeNs().count()));
+      counters_proto = packet->set_battery();
+    }
 
     switch (counter) {
       case android_internal::BatteryCounter::kUnspecified:
@@ -321,7 +336,17 @@ void AndroidPowerDataSource::WritePowerRailsData() {
     }
   }
 
-  for (const auto& energy_data : lib_->GetRailEnergyData()) {
+  lib_->GetRailEnergyData(&rail_energy_data_);
+  for (const auto& energy_data : rail_energy_data_) {
+    if (only_emit_changes_) {
+      auto it_and_inserted =
+          last_rail_energy_.Insert(energy_data.index, energy_data.energy);
+      if (!it_and_inserted.second) {
+        if (*it_and_inserted.first == energy_data.energy)
+          continue;
+        *it_and_inserted.first = energy_data.energy;
+      }
+    }
     auto* data = rails_proto->add_energy_data();
     data->set_index(energy_data.index);
     data->set_timestamp_ms(energy_data.timestamp);
@@ -353,8 +378,8 @@ void AndroidPowerDataSource::WriteEnergyEstimationBreakdown() {
     }
   }
 
-  auto energy_breakdowns = lib_->GetEnergyConsumed();
-  for (const auto& breakdown : energy_breakdowns) {
+  lib_->GetEnergyConsumed(&energy_breakdowns_);
+  for (const auto& breakdown : energy_breakdowns_) {
     if (breakdown.uid == android_internal::ALL_UIDS_FOR_CONSUMER) {
       // Finalize packet before calling NewTracePacket.
       if (packet) {
@@ -407,7 +432,22 @@ void AndroidPowerDataSource::WriteEntityStateResidency() {
     }
   }
 
-  for (const auto& residency_data : lib_->GetPowerEntityStateResidency()) {
+  lib_->GetPowerEntityStateResidency(&residencies_);
+  for (const auto& residency_data : residencies_) {
+    if (only_emit_changes_) {
+      auto entity_id = static_cast<uint32_t>(residency_data.entity_id);
+      auto state_id = static_cast<uint32_t>(residency_data.state_id);
+      uint64_t key = (static_cast<uint64_t>(entity_id) << 32) | state_id;
+      std::pair<uint64_t, uint64_t> value{
+          residency_data.total_time_in_state_ms,
+          residency_data.total_state_entry_count};
+      auto it_and_inserted = last_residencies_.Insert(key, value);
+      if (!it_and_inserted.second) {
+        if (*it_and_inserted.first == value)
+          continue;
+        *it_and_inserted.first = value;
+      }
+    }
     auto* data = outer_proto->add_residency();
     data->set_entity_index(residency_data.entity_id);
     data->set_state_index(residency_data.state_id);
@@ -424,6 +464,11 @@ void AndroidPowerDataSource::Flush(FlushRequestID,
 
 void AndroidPowerDataSource::ClearIncrementalState() {
   should_emit_descriptors_ = true;
+  // With |only_emit_changes_|, also write all the values again, so that the
+  // trace is self-contained from here on.
+  last_battery_counters_.fill(std::nullopt);
+  last_rail_energy_.Clear();
+  last_residencies_.Clear();
 }
 
 }  // namespace perfetto
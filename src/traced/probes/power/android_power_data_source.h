@@ -17,9 +17,14 @@
 #ifndef SRC_TRACED_PROBES_POWER_ANDROID_POWER_DATA_SOURCE_H_
 #define SRC_TRACED_PROBES_POWER_ANDROID_POWER_DATA_SOURCE_H_
 
+#include <array>
 #include <bitset>
 #include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
 
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/tracing/core/data_source_config.h"
@@ -27,6 +32,12 @@
 
 namespace perfetto {
 
+namespace android_internal {
+struct EnergyEstimationBreakdown;
+struct PowerEntityStateResidency;
+struct RailEnergyData;
+}  // namespace android_internal
+
 class TraceWriter;
 namespace base {
 class TaskRunner;
@@ -74,6 +85,21 @@ class AndroidPowerDataSource : public ProbesDataSource {
   uint32_t poll_interval_ms_ = 0;
   bool should_emit_descriptors_ = true;
 
+  // If set, battery counters, rail energies and entity state residencies are
+  // only written when they changed since they were last written. The last
+  // written values are forgotten when the incremental state is cleared.
+  bool only_emit_changes_ = false;
+  std::array<std::optional<int64_t>, 8> last_battery_counters_;
+  base::FlatHashMap<uint32_t, uint64_t> last_rail_energy_;
+  // Keyed by entity id << 32 | state id. The value is the time in state and
+  // the entry count.
+  base::FlatHashMap<uint64_t, std::pair<uint64_t, uint64_t>> last_residencies_;
+
+  // Reused across polls to avoid reallocating them every time.
+  std::vector<android_internal::RailEnergyData> rail_energy_data_;
+  std::vector<android_internal::EnergyEstimationBreakdown> energy_breakdowns_;
+  std::vector<android_internal::PowerEntityStateResidency> residencies_;
+
   base::TaskRunner* const task_runner_;
   std::unique_ptr<TraceWriter> writer_;
   std::unique_ptr<DynamicLibLoader> lib_;
@@ -17,7 +17,9 @@
 #include "src/traced/probes/power/linux_power_sysfs_data_source.h"
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <optional>
 
 #include "perfetto/base/logging.h"
@@ -26,6 +28,7 @@
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
 #include "perfetto/tracing/core/data_source_config.h"
@@ -38,12 +41,14 @@ namespace perfetto {
 namespace {
 constexpr uint32_t kDefaultPollIntervalMs = 1000;
 
-std::optional<int64_t> ReadFileAsInt64(std::string path) {
-  std::string buf;
-  if (!base::ReadFile(path, &buf))
-    return std::nullopt;
-  return base::StringToInt64(base::StripSuffix(buf, "\n"));
-}
+// Must match the order of BatteryInfo::Attribute.
+constexpr const char* kAttributeFiles[] = {
+    "charge_now",  "energy_now",  "voltage_now",
+    "capacity",    "current_now", "current_avg",
+};
+static_assert(base::ArraySize(kAttributeFiles) ==
+                  LinuxPowerSysfsDataSource::BatteryInfo::kNumAttributes,
+              "kAttributeFiles out of sync with BatteryInfo::Attribute");
 }  // namespace
 
 LinuxPowerSysfsDataSource::BatteryInfo::BatteryInfo(
@@ -68,6 +73,15 @@ LinuxPowerSysfsDataSource::BatteryInfo::BatteryInfo(
         base::StripSuffix(buf, "\n") != "1")
       continue;
     sysfs_battery_subdirs_.push_back(ent->d_name);
+
+    // Keep the attribute files open, so that every poll costs a single pread()
+    // per attribute rather than an open()/read()/close() and a path lookup.
+    // Attributes that the battery doesn't report are not retried.
+    attribute_fds_.emplace_back();
+    for (size_t i = 0; i < kNumAttributes; i++) {
+      attribute_fds_.back()[i] = base::OpenFile(
+          dir_name + "/" + kAttributeFiles[i], O_RDONLY | O_CLOEXEC);
+    }
   }
 }
 LinuxPowerSysfsDataSource::BatteryInfo::~BatteryInfo() = default;
@@ -79,46 +93,52 @@ size_t LinuxPowerSysfsDataSource::BatteryInfo::num_batteries() const {
 std::optional<int64_t>
 LinuxPowerSysfsDataSource::BatteryInfo::GetChargeCounterUah(
     size_t battery_idx) {
-  PERFETTO_CHECK(battery_idx < sysfs_battery_subdirs_.size());
-  return ReadFileAsInt64(power_supply_dir_path_ + "/" +
-                         sysfs_battery_subdirs_[battery_idx] + "/charge_now");
+  return ReadAttribute(battery_idx, kChargeNow);
 }
 
 std::optional<int64_t>
 LinuxPowerSysfsDataSource::BatteryInfo::GetEnergyCounterUah(
     size_t battery_idx) {
-  PERFETTO_CHECK(battery_idx < sysfs_battery_subdirs_.size());
-  return ReadFileAsInt64(power_supply_dir_path_ + "/" +
-                         sysfs_battery_subdirs_[battery_idx] + "/energy_now");
+  return ReadAttribute(battery_idx, kEnergyNow);
 }
 
 std::optional<int64_t> LinuxPowerSysfsDataSource::BatteryInfo::GetVoltageUv(
     size_t battery_idx) {
-  PERFETTO_CHECK(battery_idx < sysfs_battery_subdirs_.size());
-  return ReadFileAsInt64(power_supply_dir_path_ + "/" +
-                         sysfs_battery_subdirs_[battery_idx] + "/voltage_now");
+  return ReadAttribute(battery_idx, kVoltageNow);
 }
 
 std::optional<int64_t>
 LinuxPowerSysfsDataSource::BatteryInfo::GetCapacityPercent(size_t battery_idx) {
-  PERFETTO_CHECK(battery_idx < sysfs_battery_subdirs_.size());
-  return ReadFileAsInt64(power_supply_dir_path_ + "/" +
-                         sysfs_battery_subdirs_[battery_idx] + "/capacity");
+  return ReadAttribute(battery_idx, kCapacity);
 }
 
 std::optional<int64_t> LinuxPowerSysfsDataSource::BatteryInfo::GetCurrentNowUa(
     size_t battery_idx) {
-  PERFETTO_CHECK(battery_idx < sysfs_battery_subdirs_.size());
-  return ReadFileAsInt64(power_supply_dir_path_ + "/" +
-                         sysfs_battery_subdirs_[battery_idx] + "/current_now");
+  return ReadAttribute(battery_idx, kCurrentNow);
 }
 
 std::optional<int64_t>
 LinuxPowerSysfsDataSource::BatteryInfo::GetAverageCurrentUa(
     size_t battery_idx) {
-  PERFETTO_CHECK(battery_idx < sysfs_battery_subdirs_.size());
-  return ReadFileAsInt64(power_supply_dir_path_ + "/" +
-                         sysfs_battery_subdirs_[battery_idx] + "/current_avg");
+  return ReadAttribute(battery_idx, kCurrentAvg);
+}
+
+std::optional<int64_t> LinuxPowerSysfsDataSource::BatteryInfo::ReadAttribute(
+    size_t battery_idx,
+    Attribute attribute) {
+  PERFETTO_CHECK(battery_idx < attribute_fds_.size());
+  base::ScopedFile& fd = attribute_fds_[battery_idx][attribute];
+  if (!fd)
+    return std::nullopt;
+  // sysfs regenerates the content of the file on every read from offset 0.
+  char buf[32];
+  ssize_t rsize = PERFETTO_EINTR(pread(*fd, buf, sizeof(buf) - 1, 0));
+  if (rsize <= 0)
+    return std::nullopt;
+  if (buf[rsize - 1] == '\n')
+    rsize--;
+  buf[rsize] = '\0';
+  return base::CStringToInt64(buf);
 }
 
 std::string LinuxPowerSysfsDataSource::BatteryInfo::GetBatteryName(
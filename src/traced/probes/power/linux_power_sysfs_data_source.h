@@ -17,8 +17,12 @@
 #ifndef SRC_TRACED_PROBES_POWER_LINUX_POWER_SYSFS_DATA_SOURCE_H_
 #define SRC_TRACED_PROBES_POWER_LINUX_POWER_SYSFS_DATA_SOURCE_H_
 
+#include <array>
 #include <optional>
+#include <string>
+#include <vector>
 
+#include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/tracing/core/data_source_config.h"
 #include "src/traced/probes/probes_data_source.h"
@@ -35,6 +39,16 @@ class LinuxPowerSysfsDataSource : public ProbesDataSource {
  public:
   class BatteryInfo {
    public:
+    enum Attribute {
+      kChargeNow = 0,
+      kEnergyNow,
+      kVoltageNow,
+      kCapacity,
+      kCurrentNow,
+      kCurrentAvg,
+      kNumAttributes,
+    };
+
     explicit BatteryInfo(
         const char* power_supply_dir_path = "/sys/class/power_supply");
     ~BatteryInfo();
@@ -63,10 +77,15 @@ class LinuxPowerSysfsDataSource : public ProbesDataSource {
     size_t num_batteries() const;
 
    private:
+    std::optional<int64_t> ReadAttribute(size_t battery_idx, Attribute);
+
     std::string power_supply_dir_path_;
     // The subdirectories that contain info of a battery power supply, e.g.
     // BAT0.
     std::vector<std::string> sysfs_battery_subdirs_;
+    // The open attribute files of each battery, indexed by Attribute. Files
+    // that don't exist are left invalid.
+    std::vector<std::array<base::ScopedFile, kNumAttributes>> attribute_fds_;
   };
   static const ProbesDataSource::Descriptor descriptor;
 
@@ -15,6 +15,11 @@
  */
 
 #include "src/traced/probes/power/linux_power_sysfs_data_source.h"
+
+#include <fcntl.h>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
 #include "src/base/test/tmp_dir_tree.h"
 #include "test/gtest_and_gmock.h"
 
@@ -140,5 +145,27 @@ TEST(LinuxPowerSysfsDataSourceTest, EnergyVoltageNow) {
   EXPECT_EQ(*battery_info_->GetVoltageUv(0), 17356000);
 }
 
+TEST(LinuxPowerSysfsDataSourceTest, RereadsChangedValues) {
+  base::TmpDirTree tmpdir;
+  std::unique_ptr<LinuxPowerSysfsDataSource::BatteryInfo> battery_info_;
+
+  tmpdir.AddDir("BAT0");
+  tmpdir.AddFile("BAT0/type", "Battery\n");
+  tmpdir.AddFile("BAT0/present", "1\n");
+  tmpdir.AddFile("BAT0/capacity", "95\n");  // 95 percent.
+
+  battery_info_.reset(
+      new LinuxPowerSysfsDataSource::BatteryInfo(tmpdir.path().c_str()));
+  EXPECT_EQ(*battery_info_->GetCapacityPercent(0), 95);
+
+  // The attribute files are kept open: a new value must still be picked up.
+  base::ScopedFile fd(base::OpenFile(tmpdir.AbsolutePath("BAT0/capacity"),
+                                     O_WRONLY | O_TRUNC));
+  ASSERT_TRUE(fd);
+  ASSERT_EQ(base::WriteAll(*fd, "9\n", 2), 2);
+  EXPECT_EQ(*battery_info_->GetCapacityPercent(0), 9);
+  EXPECT_EQ(*battery_info_->GetCapacityPercent(0), 9);
+}
+
 }  // namespace
 }  // namespace perfetto
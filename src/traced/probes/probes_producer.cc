@@ -142,6 +142,9 @@ ProbesProducer::CreateDSInstance<FtraceDataSource>(
   std::unique_ptr<FtraceDataSource> data_source(new FtraceDataSource(
       ftrace_->GetWeakPtr(), session_id, std::move(ftrace_config),
       endpoint_->CreateTraceWriter(buffer_id)));
+  data_source->set_trace_writer_factory([this, buffer_id] {
+    return endpoint_->CreateTraceWriter(buffer_id);
+  });
   if (!ftrace_->AddDataSource(data_source.get())) {
     PERFETTO_ELOG("Failed to setup ftrace");
     return nullptr;
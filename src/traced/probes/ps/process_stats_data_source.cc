@@ -16,11 +16,14 @@
 
 #include "src/traced/probes/ps/process_stats_data_source.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
 
 #include <algorithm>
 #include <array>
+#include <condition_variable>
+#include <mutex>
 
 #include "perfetto/base/task_runner.h"
 #include "perfetto/base/time.h"
@@ -30,6 +33,7 @@
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/threading/thread_pool.h"
 #include "perfetto/tracing/core/data_source_config.h"
 
 #include "protos/perfetto/config/process_stats/process_stats_config.pbzero.h"
@@ -60,6 +64,11 @@
 namespace perfetto {
 namespace {
 
+// Below this many processes, reading their procfs files on the scan threads
+// costs more in thread hops than it saves.
+constexpr size_t kMinPidsForParallelScan = 512;
+constexpr uint32_t kScanThreads = 4;
+
 int32_t ReadNextNumericDir(DIR* dirp) {
   while (struct dirent* dir_ent = readdir(dirp)) {
     if (dir_ent->d_type != DT_DIR)
@@ -117,6 +126,40 @@ inline uint32_t ToUInt32(const char* str) {
   return static_cast<uint32_t>(strtoul(str, nullptr, 10));
 }
 
+// Parses the start time out of /proc/pid/stat, and hashes it together with
+// the virtual and resident memory sizes (which are also the first two fields
+// of /proc/pid/statm). Returns false if |proc_stat| is malformed.
+bool ParseProcStat(const std::string& proc_stat,
+                   uint64_t* start_time,
+                   uint64_t* mem_fingerprint) {
+  // The comm (2nd field) can contain spaces and parentheses, the fields after
+  // it start after the last ')'.
+  size_t comm_end = proc_stat.rfind(')');
+  if (comm_end == std::string::npos)
+    return false;
+  base::StringSplitter ss(proc_stat.substr(comm_end + 1), ' ');
+  // Fields are numbered from 1 in proc(5), |state| is the 3rd one.
+  for (uint32_t field = 3; field < 22; field++) {
+    if (!ss.Next())
+      return false;
+  }
+  if (!ss.Next())
+    return false;
+  std::optional<uint64_t> starttime = base::CStringToUInt64(ss.cur_token());
+  if (!starttime)
+    return false;
+  base::Hasher hasher;
+  hasher.Update(*starttime);
+  for (int i = 0; i < 2; i++) {  // vsize, rss
+    if (!ss.Next())
+      return false;
+    hasher.Update(ss.cur_token(), ss.cur_token_size());
+  }
+  *start_time = *starttime;
+  *mem_fingerprint = hasher.digest();
+  return true;
+}
+
 }  // namespace
 
 // static
@@ -161,6 +204,8 @@ ProcessStatsDataSource::ProcessStatsDataSource(
     process_stats_cache_ttl_ticks_ =
         std::max(proc_stats_ttl_ms / poll_period_ms_, 1u);
   }
+
+  proc_dir_fd_.reset(open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
 }
 
 ProcessStatsDataSource::~ProcessStatsDataSource() = default;
@@ -388,12 +433,18 @@ base::ScopedDir ProcessStatsDataSource::OpenProcDir() {
   return proc_dir;
 }
 
+// Can be called on the |scan_pool_| threads.
 std::string ProcessStatsDataSource::ReadProcPidFile(int32_t pid,
                                                     const std::string& file) {
-  base::StackString<128> path("/proc/%" PRId32 "/%s", pid, file.c_str());
+  // Opening relative to /proc saves resolving it again for every file.
+  base::StackString<128> path("%" PRId32 "/%s", pid, file.c_str());
+  base::ScopedFile fd(
+      openat(*proc_dir_fd_, path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (!fd)
+    return "";
   std::string contents;
   contents.reserve(4096);
-  if (!base::ReadFile(path.c_str(), &contents))
+  if (!base::ReadFileDescriptor(*fd, &contents))
     return "";
   return contents;
 }
@@ -481,37 +532,56 @@ void ProcessStatsDataSource::WriteAllProcessStats() {
   base::ScopedDir proc_dir = OpenProcDir();
   if (!proc_dir)
     return;
-  base::FlatSet<int32_t> pids;
+  std::vector<ProcStatsSample> samples;
   while (int32_t pid = ReadNextNumericDir(*proc_dir)) {
-    cur_ps_stats_process_ = nullptr;
-
     uint32_t pid_u = static_cast<uint32_t>(pid);
     if (skip_stats_for_pids_.size() > pid_u && skip_stats_for_pids_[pid_u])
       continue;
+    samples.emplace_back();
+    ProcStatsSample& sample = samples.back();
+    sample.pid = pid;
+    auto it = process_stats_cache_.find(pid);
+    if (it != process_stats_cache_.end())
+      sample.cached_mem_fingerprint = it->second.mem_fingerprint;
+  }
+  ReadProcStatsSamples(&samples);
 
-    std::string proc_status = ReadProcPidFile(pid, "status");
-    if (proc_status.empty())
-      continue;
+  base::FlatSet<int32_t> pids;
+  for (const ProcStatsSample& sample : samples) {
+    int32_t pid = sample.pid;
+    cur_ps_stats_process_ = nullptr;
 
-    if (scan_smaps_rollup_) {
-      std::string proc_smaps_rollup = ReadProcPidFile(pid, "smaps_rollup");
-      proc_status.append(proc_smaps_rollup);
+    auto it = process_stats_cache_.find(pid);
+    if (it != process_stats_cache_.end() && it->second.start_time &&
+        sample.start_time && it->second.start_time != sample.start_time) {
+      // The pid has been reused by another process since the last poll. Forget
+      // what we know about the old one, including its process tree entry.
+      process_stats_cache_.erase(it);
+      seen_pids_.erase(pid);
     }
 
-    if (!WriteMemCounters(pid, proc_status)) {
-      // If WriteMemCounters() fails the pid is very likely a kernel thread
-      // that has a valid /proc/[pid]/status but no memory values. In this
-      // case avoid keep polling it over and over.
-      if (skip_stats_for_pids_.size() <= pid_u)
-        skip_stats_for_pids_.resize(pid_u + 1);
-      skip_stats_for_pids_[pid_u] = true;
-      continue;
+    if (!sample.mem_unchanged) {
+      if (sample.status.empty())
+        continue;
+
+      if (!WriteMemCounters(pid, sample.status)) {
+        // If WriteMemCounters() fails the pid is very likely a kernel thread
+        // that has a valid /proc/[pid]/status but no memory values. In this
+        // case avoid keep polling it over and over.
+        uint32_t pid_u = static_cast<uint32_t>(pid);
+        if (skip_stats_for_pids_.size() <= pid_u)
+          skip_stats_for_pids_.resize(pid_u + 1);
+        skip_stats_for_pids_[pid_u] = true;
+        continue;
+      }
     }
 
-    std::string oom_score_adj = ReadProcPidFile(pid, "oom_score_adj");
-    if (!oom_score_adj.empty()) {
-      CachedProcessStats& cached = process_stats_cache_[pid];
-      int32_t counter = ToInt32(oom_score_adj);
+    CachedProcessStats& cached = process_stats_cache_[pid];
+    cached.start_time = sample.start_time;
+    cached.mem_fingerprint = sample.mem_fingerprint;
+
+    if (!sample.oom_score_adj.empty()) {
+      int32_t counter = ToInt32(sample.oom_score_adj);
       if (counter != cached.oom_score_adj) {
         GetOrCreateStatsProcess(pid)->set_oom_score_adj(counter);
         cached.oom_score_adj = counter;
@@ -530,6 +600,60 @@ void ProcessStatsDataSource::WriteAllProcessStats() {
   WriteProcessTree(pids);
 }
 
+void ProcessStatsDataSource::ReadProcStatsSamples(
+    std::vector<ProcStatsSample>* samples) {
+  if (samples->size() < kMinPidsForParallelScan) {
+    for (ProcStatsSample& sample : *samples)
+      ReadProcStatsSample(&sample);
+    return;
+  }
+
+  if (!scan_pool_)
+    scan_pool_.reset(new base::ThreadPool(kScanThreads));
+
+  // Each thread reads a contiguous chunk of |samples|, the results are then
+  // written out in pid order on the calling thread.
+  std::mutex mutex;
+  std::condition_variable done_cv;
+  uint32_t pending_chunks = kScanThreads;
+  size_t chunk_size = (samples->size() + kScanThreads - 1) / kScanThreads;
+  for (uint32_t i = 0; i < kScanThreads; i++) {
+    size_t begin = std::min(i * chunk_size, samples->size());
+    size_t end = std::min(begin + chunk_size, samples->size());
+    scan_pool_->PostTask([this, samples, begin, end, &mutex, &done_cv,
+                          &pending_chunks] {
+      for (size_t j = begin; j < end; j++)
+        ReadProcStatsSample(&(*samples)[j]);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--pending_chunks == 0)
+        done_cv.notify_one();
+    });
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  done_cv.wait(lock, [&pending_chunks] { return pending_chunks == 0; });
+}
+
+// Can be called on the |scan_pool_| threads, so must only touch |sample|.
+void ProcessStatsDataSource::ReadProcStatsSample(ProcStatsSample* sample) {
+  int32_t pid = sample->pid;
+  std::string proc_stat = ReadProcPidFile(pid, "stat");
+  if (!proc_stat.empty() &&
+      ParseProcStat(proc_stat, &sample->start_time, &sample->mem_fingerprint)) {
+    sample->mem_unchanged =
+        sample->mem_fingerprint == sample->cached_mem_fingerprint;
+  }
+
+  if (!sample->mem_unchanged) {
+    sample->status = ReadProcPidFile(pid, "status");
+    if (sample->status.empty())
+      return;
+    if (scan_smaps_rollup_)
+      sample->status.append(ReadProcPidFile(pid, "smaps_rollup"));
+  }
+
+  sample->oom_score_adj = ReadProcPidFile(pid, "oom_score_adj");
+}
+
 // Returns true if the stats for the given |pid| have been written, false it
 // it failed (e.g., |pid| was a kernel thread and, as such, didn't report any
 // memory counters).
@@ -20,6 +20,7 @@
 #include <functional>
 #include <limits>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -36,7 +37,8 @@ namespace perfetto {
 
 namespace base {
 class TaskRunner;
-}
+class ThreadPool;
+}  // namespace base
 
 namespace protos {
 namespace pbzero {
@@ -92,6 +94,31 @@ class ProcessStatsDataSource : public ProbesDataSource {
     uint32_t smr_pss_shmem_kb = std::numeric_limits<uint32_t>::max();
     // file descriptors
     base::FlatSet<uint64_t> seen_fds;
+    // From /proc/pid/stat, see |ProcStatsSample|. Zero if not known.
+    uint64_t start_time = 0;
+    uint64_t mem_fingerprint = 0;
+  };
+
+  // The procfs contents read for one process in a WriteAllProcessStats() poll.
+  // These are read before any of them is written out, possibly on the
+  // |scan_pool_| threads.
+  struct ProcStatsSample {
+    int32_t pid = 0;
+    // Copied from |process_stats_cache_| before the read, so that the scan
+    // threads don't need to access it.
+    uint64_t cached_mem_fingerprint = 0;
+
+    // Start time and a hash of the memory sizes in /proc/pid/stat (the ones
+    // in /proc/pid/statm). If the fingerprint matches the cached one, the
+    // memory counters are assumed to be unchanged and the (much more costly)
+    // status and smaps_rollup files are not read.
+    uint64_t start_time = 0;
+    uint64_t mem_fingerprint = 0;
+    bool mem_unchanged = false;
+
+    // /proc/pid/status, followed by /proc/pid/smaps_rollup if enabled.
+    std::string status;
+    std::string oom_score_adj;
   };
 
   // Common functions.
@@ -115,6 +142,8 @@ class ProcessStatsDataSource : public ProbesDataSource {
   // Functions for periodically sampling process stats/counters.
   static void Tick(base::WeakPtr<ProcessStatsDataSource>);
   void WriteAllProcessStats();
+  void ReadProcStatsSamples(std::vector<ProcStatsSample>*);
+  void ReadProcStatsSample(ProcStatsSample*);
   bool WriteMemCounters(int32_t pid, const std::string& proc_status);
   void WriteFds(int32_t pid);
   void WriteSingleFd(int32_t pid, uint64_t fd);
@@ -177,6 +206,13 @@ class ProcessStatsDataSource : public ProbesDataSource {
   protos::pbzero::ProcessStats_Process* cur_ps_stats_process_ = nullptr;
   std::vector<bool> skip_stats_for_pids_;
 
+  // Reads the procfs files of the processes in parallel, when there are
+  // enough of them to be worth it. Created on first use.
+  std::unique_ptr<base::ThreadPool> scan_pool_;
+
+  // /proc, which ReadProcPidFile() opens the files relative to.
+  base::ScopedFile proc_dir_fd_;
+
   // Cached process stats per process. Cleared every |cache_ttl_ticks_| *
   // |poll_period_ms_| ms.
   uint32_t process_stats_cache_ttl_ticks_ = 0;
@@ -361,6 +361,10 @@ TEST_F(ProcessStatsDataSourceTest, ProcessStats) {
       .WillRepeatedly(
           Invoke([&fake_proc_path] { return fake_proc_path.c_str(); }));
 
+  // Without /proc/pid/stat the counters are re-read on every poll.
+  EXPECT_CALL(*data_source, ReadProcPidFile(_, "stat"))
+      .WillRepeatedly(Return(""));
+
   const int kNumIters = 4;
   int iter = 0;
   for (int pid : kPids) {
@@ -450,6 +454,10 @@ TEST_F(ProcessStatsDataSourceTest, CacheProcessStats) {
     return base::ScopedDir(opendir(fake_proc.path().c_str()));
   }));
 
+  // Without /proc/pid/stat the counters are re-read on every poll.
+  EXPECT_CALL(*data_source, ReadProcPidFile(_, "stat"))
+      .WillRepeatedly(Return(""));
+
   const int kNumIters = 4;
   int iter = 0;
   EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "status"))
@@ -495,6 +503,153 @@ TEST_F(ProcessStatsDataSourceTest, CacheProcessStats) {
   base::Rmdir(path.ToStdString());
 }
 
+TEST_F(ProcessStatsDataSourceTest, SkipUnchangedProcessStats) {
+  DataSourceConfig ds_config;
+  ProcessStatsConfig cfg;
+  cfg.set_proc_stats_poll_ms(100);
+  cfg.set_proc_stats_cache_ttl_ms(10000);
+  cfg.add_quirks(ProcessStatsConfig::DISABLE_ON_DEMAND);
+  ds_config.set_process_stats_config_raw(cfg.SerializeAsString());
+  auto data_source = GetProcessStatsDataSource(ds_config);
+
+  // Populate a fake /proc/ directory.
+  auto fake_proc = base::TempDir::Create();
+  const int kPid = 1;
+
+  base::StackString<256> path("%s/%d", fake_proc.path().c_str(), kPid);
+  mkdir(path.c_str(), 0755);
+
+  auto checkpoint = task_runner_.CreateCheckpoint("all_done");
+
+  EXPECT_CALL(*data_source, OpenProcDir()).WillRepeatedly(Invoke([&fake_proc] {
+    return base::ScopedDir(opendir(fake_proc.path().c_str()));
+  }));
+
+  // The rss in /proc/pid/stat only changes on the third poll.
+  const int kNumIters = 3;
+  int iter = 0;
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "stat"))
+      .WillRepeatedly(Invoke([&iter](int32_t, const std::string&) {
+        base::StackString<1024> ret(
+            "1 (my proc) S 0 1 1 0 -1 4194560 0 0 0 0 %d 0 0 0 20 0 1 0 "
+            "1234 4096000 %d 18446744073709551615\n",
+            iter, iter < 2 ? 100 : 200);
+        return ret.ToStdString();
+      }));
+  // Only read when the stat fingerprint changed.
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "status"))
+      .Times(2)
+      .WillRepeatedly(Invoke([&iter](int32_t, const std::string&) {
+        base::StackString<1024> ret(
+            "Name:	pid_10\nVmSize:	 4000 kB\nVmRSS:\t%d  kB\n",
+            iter < 2 ? 400 : 800);
+        return ret.ToStdString();
+      }));
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "oom_score_adj"))
+      .WillRepeatedly(Invoke([checkpoint, &iter](int32_t, const std::string&) {
+        if (++iter == kNumIters)
+          checkpoint();
+        return "0";
+      }));
+
+  data_source->Start();
+  task_runner_.RunUntilCheckpoint("all_done");
+  data_source->Flush(1 /* FlushRequestId */, []() {});
+
+  std::vector<protos::gen::ProcessStats::Process> processes;
+  auto trace = writer_raw_->GetAllTracePackets();
+  for (const auto& packet : trace) {
+    for (const auto& process : packet.process_stats().processes()) {
+      processes.push_back(process);
+    }
+  }
+  // Nothing is written for the second poll, and only the rss for the third.
+  ASSERT_EQ(processes.size(), 2u);
+  EXPECT_EQ(processes[0].vm_size_kb(), 4000u);
+  EXPECT_EQ(processes[0].vm_rss_kb(), 400u);
+  EXPECT_FALSE(processes[1].has_vm_size_kb());
+  EXPECT_EQ(processes[1].vm_rss_kb(), 800u);
+
+  // Cleanup |fake_proc|. TempDir checks that the directory is empty.
+  base::Rmdir(path.ToStdString());
+}
+
+TEST_F(ProcessStatsDataSourceTest, RescanReusedPid) {
+  DataSourceConfig ds_config;
+  ProcessStatsConfig cfg;
+  cfg.set_proc_stats_poll_ms(100);
+  cfg.set_proc_stats_cache_ttl_ms(10000);
+  cfg.add_quirks(ProcessStatsConfig::DISABLE_ON_DEMAND);
+  ds_config.set_process_stats_config_raw(cfg.SerializeAsString());
+  auto data_source = GetProcessStatsDataSource(ds_config);
+
+  // Populate a fake /proc/ directory.
+  auto fake_proc = base::TempDir::Create();
+  const int kPid = 42;
+
+  base::StackString<256> path("%s/%d", fake_proc.path().c_str(), kPid);
+  mkdir(path.c_str(), 0755);
+
+  auto checkpoint = task_runner_.CreateCheckpoint("all_done");
+
+  EXPECT_CALL(*data_source, OpenProcDir()).WillRepeatedly(Invoke([&fake_proc] {
+    return base::ScopedDir(opendir(fake_proc.path().c_str()));
+  }));
+
+  // A different process, with a later start time, gets the same pid (and the
+  // same memory sizes) on the second poll.
+  const int kNumIters = 2;
+  int iter = 0;
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "stat"))
+      .WillRepeatedly(Invoke([&iter](int32_t, const std::string&) {
+        base::StackString<1024> ret(
+            "42 (proc) S 0 1 1 0 -1 4194560 0 0 0 0 0 0 0 0 20 0 1 0 "
+            "%d 4096000 100 18446744073709551615\n",
+            1000 + iter);
+        return ret.ToStdString();
+      }));
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "status"))
+      .WillRepeatedly(Invoke([&iter](int32_t, const std::string&) {
+        base::StackString<1024> ret(
+            "Name: proc_%d\nTgid:\t42\nPid:   42\nPPid:  1\nUid:  0\n"
+            "VmSize:	 4000 kB\nVmRSS:\t400  kB\n",
+            iter);
+        return ret.ToStdString();
+      }));
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "cmdline"))
+      .WillRepeatedly(Return(""));
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "oom_score_adj"))
+      .WillRepeatedly(Invoke([checkpoint, &iter](int32_t, const std::string&) {
+        if (++iter == kNumIters)
+          checkpoint();
+        return "0";
+      }));
+
+  data_source->Start();
+  task_runner_.RunUntilCheckpoint("all_done");
+  data_source->Flush(1 /* FlushRequestId */, []() {});
+
+  std::vector<protos::gen::ProcessStats::Process> stats;
+  std::vector<protos::gen::ProcessTree::Process> tree;
+  auto trace = writer_raw_->GetAllTracePackets();
+  for (const auto& packet : trace) {
+    for (const auto& process : packet.process_stats().processes())
+      stats.push_back(process);
+    for (const auto& process : packet.process_tree().processes())
+      tree.push_back(process);
+  }
+  // Both the counters and the process tree entry are written again for the
+  // new process.
+  ASSERT_EQ(stats.size(), 2u);
+  EXPECT_EQ(stats[1].vm_rss_kb(), 400u);
+  ASSERT_EQ(tree.size(), 2u);
+  EXPECT_THAT(tree[0].cmdline(), ElementsAre("proc_1"));
+  EXPECT_THAT(tree[1].cmdline(), ElementsAre("proc_2"));
+
+  // Cleanup |fake_proc|. TempDir checks that the directory is empty.
+  base::Rmdir(path.ToStdString());
+}
+
 TEST_F(ProcessStatsDataSourceTest, NamespacedProcess) {
   auto data_source = GetProcessStatsDataSource(DataSourceConfig());
   EXPECT_CALL(*data_source, ReadProcPidFile(42, "status"))
@@ -562,6 +717,10 @@ TEST_F(ProcessStatsDataSourceTest, ScanSmapsRollupIsOn) {
       .WillRepeatedly(
           Invoke([&fake_proc_path] { return fake_proc_path.c_str(); }));
 
+  // Without /proc/pid/stat the counters are re-read on every poll.
+  EXPECT_CALL(*data_source, ReadProcPidFile(_, "stat"))
+      .WillRepeatedly(Return(""));
+
   const int kNumIters = 4;
   int iter = 0;
   for (int pid : kPids) {
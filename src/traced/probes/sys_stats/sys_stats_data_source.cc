@@ -17,6 +17,7 @@
 #include "src/traced/probes/sys_stats/sys_stats_data_source.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -28,6 +29,7 @@
 #include "perfetto/base/task_runner.h"
 #include "perfetto/base/time.h"
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/metatrace.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_splitter.h"
@@ -47,6 +49,27 @@ using protos::pbzero::SysStatsConfig;
 namespace {
 constexpr size_t kReadBufSize = 1024 * 16;
 
+// Kinds of counters in |last_reported_|, combined with the id of the counter
+// (cpu, irq, device name...) to form its key.
+constexpr uint32_t kCpuTimes = 1;
+constexpr uint32_t kIrqTotal = 2;
+constexpr uint32_t kIrq = 3;
+constexpr uint32_t kSoftirqTotal = 4;
+constexpr uint32_t kSoftirq = 5;
+constexpr uint32_t kForks = 6;
+constexpr uint32_t kDevfreq = 7;
+constexpr uint32_t kCpufreq = 8;
+constexpr uint32_t kBuddyInfo = 9;
+
+// Fingerprint of the values of a counter made of several values.
+template <typename T>
+uint64_t HashValues(const T& values) {
+  base::Hasher hasher;
+  hasher.Update(reinterpret_cast<const char*>(values.data()),
+                values.size() * sizeof(values[0]));
+  return hasher.digest();
+}
+
 base::ScopedFile OpenReadOnly(const char* path) {
   base::ScopedFile fd(base::OpenFile(path, O_RDONLY));
   if (!fd)
@@ -54,6 +77,38 @@ base::ScopedFile OpenReadOnly(const char* path) {
   return fd;
 }
 
+// Calls |fn(key, value)| for each line of |buf| that looks like
+// "<key><key_separator> <value>...", e.g. "MemTotal:  3744240 kB". This is a
+// single pass over |buf|: line and key ends are found with memchr(), which libc
+// vectorizes, and values are parsed in place.
+template <typename Fn>
+void ForEachKeyValueLine(const char* buf,
+                         size_t size,
+                         char key_separator,
+                         Fn fn) {
+  const char* const end = buf + size;
+  for (const char* line = buf; line < end;) {
+    const char* line_end = static_cast<const char*>(
+        memchr(line, '\n', static_cast<size_t>(end - line)));
+    if (!line_end)
+      line_end = end;
+    const char* key_end = static_cast<const char*>(
+        memchr(line, key_separator, static_cast<size_t>(line_end - line)));
+    if (key_end) {
+      const char* p = key_end + 1;
+      while (p < line_end && *p == ' ')
+        p++;
+      const char* digits = p;
+      uint64_t value = 0;
+      for (; p < line_end && *p >= '0' && *p <= '9'; p++)
+        value = value * 10 + static_cast<uint64_t>(*p - '0');
+      if (p != digits)
+        fn(base::StringView(line, static_cast<size_t>(key_end - line)), value);
+    }
+    line = line_end + 1;
+  }
+}
+
 uint32_t ClampTo10Ms(uint32_t period_ms, const char* counter_name) {
   if (period_ms > 0 && period_ms < 10) {
     PERFETTO_ILOG("%s %" PRIu32
@@ -118,7 +173,7 @@ SysStatsDataSource::SysStatsDataSource(
   for (size_t i = 0; i < base::ArraySize(kMeminfoKeys); i++) {
     const auto& k = kMeminfoKeys[i];
     if (meminfo_counters_enabled[static_cast<size_t>(k.id)])
-      meminfo_counters_.emplace(k.str, k.id);
+      meminfo_counters_.Insert(base::StringView(k.str), k.id);
   }
 
   constexpr size_t kMaxVmstatEnum = protos::pbzero::VmstatCounters_MAX;
@@ -136,7 +191,7 @@ SysStatsDataSource::SysStatsDataSource(
   for (size_t i = 0; i < base::ArraySize(kVmstatKeys); i++) {
     const auto& k = kVmstatKeys[i];
     if (vmstat_counters_enabled[static_cast<size_t>(k.id)])
-      vmstat_counters_.emplace(k.str, k.id);
+      vmstat_counters_.Insert(base::StringView(k.str), k.id);
   }
 
   if (!cfg.has_stat_counters())
@@ -181,6 +236,15 @@ SysStatsDataSource::SysStatsDataSource(
   cpufreq_ticks_ = ticks[4];
   buddyinfo_ticks_ = ticks[5];
   diskstat_ticks_ = ticks[6];
+
+  if (cfg.counters_cache_ttl_ms() > 0) {
+    counters_cache_ttl_ticks_ =
+        std::max(cfg.counters_cache_ttl_ms() / tick_period_ms_, 1u);
+    meminfo_last_values_.resize(kMaxMeminfoEnum + 1,
+                                std::numeric_limits<uint64_t>::max());
+    vmstat_last_values_.resize(kMaxVmstatEnum + 1,
+                               std::numeric_limits<uint64_t>::max());
+  }
 }
 
 void SysStatsDataSource::Start() {
@@ -200,43 +264,71 @@ void SysStatsDataSource::Tick(base::WeakPtr<SysStatsDataSource> weak_this) {
       static_cast<uint32_t>(base::GetWallTimeMs().count() % period_ms);
   thiz.task_runner_->PostDelayedTask(
       std::bind(&SysStatsDataSource::Tick, weak_this), delay_ms);
-  thiz.ReadSysStats();
+  thiz.ReadSysStats(/*all_counters=*/false);
 }
 
 SysStatsDataSource::~SysStatsDataSource() = default;
 
-void SysStatsDataSource::ReadSysStats() {
+void SysStatsDataSource::ReadSysStats(bool all_counters) {
   PERFETTO_METATRACE_SCOPED(TAG_PROC_POLLERS, READ_SYS_STATS);
   auto packet = writer_->NewTracePacket();
 
   packet->set_timestamp(static_cast<uint64_t>(base::GetBootTimeNs().count()));
   auto* sys_stats = packet->set_sys_stats();
 
-  if (meminfo_ticks_ && tick_ % meminfo_ticks_ == 0)
+  if (counters_cache_ttl_ticks_ &&
+      (all_counters || tick_ % counters_cache_ttl_ticks_ == 0)) {
+    std::fill(meminfo_last_values_.begin(), meminfo_last_values_.end(),
+              std::numeric_limits<uint64_t>::max());
+    std::fill(vmstat_last_values_.begin(), vmstat_last_values_.end(),
+              std::numeric_limits<uint64_t>::max());
+    last_reported_.Clear();
+  }
+
+  auto is_due = [this, all_counters](uint32_t ticks) {
+    return ticks && (all_counters || tick_ % ticks == 0);
+  };
+
+  if (is_due(meminfo_ticks_))
     ReadMeminfo(sys_stats);
 
-  if (vmstat_ticks_ && tick_ % vmstat_ticks_ == 0)
+  if (is_due(vmstat_ticks_))
     ReadVmstat(sys_stats);
 
-  if (stat_ticks_ && tick_ % stat_ticks_ == 0)
+  if (is_due(stat_ticks_))
     ReadStat(sys_stats);
 
-  if (devfreq_ticks_ && tick_ % devfreq_ticks_ == 0)
+  if (is_due(devfreq_ticks_))
     ReadDevfreq(sys_stats);
 
-  if (cpufreq_ticks_ && tick_ % cpufreq_ticks_ == 0)
+  if (is_due(cpufreq_ticks_))
     ReadCpufreq(sys_stats);
 
-  if (buddyinfo_ticks_ && tick_ % buddyinfo_ticks_ == 0)
+  if (is_due(buddyinfo_ticks_))
     ReadBuddyInfo(sys_stats);
 
-  if (diskstat_ticks_ && tick_ % diskstat_ticks_ == 0)
+  // Disk stats are turned into rates between consecutive samples by trace
+  // processor, so they are never skipped and not worth re-reading here.
+  if (diskstat_ticks_ && !all_counters && tick_ % diskstat_ticks_ == 0)
     ReadDiskStat(sys_stats);
 
   sys_stats->set_collection_end_timestamp(
       static_cast<uint64_t>(base::GetBootTimeNs().count()));
 
-  tick_++;
+  if (!all_counters)
+    tick_++;
+}
+
+bool SysStatsDataSource::CounterChanged(uint64_t key, uint64_t value) {
+  if (!counters_cache_ttl_ticks_)
+    return true;
+  auto it_and_inserted = last_reported_.Insert(key, value);
+  if (it_and_inserted.second)
+    return true;
+  if (*it_and_inserted.first == value)
+    return false;
+  *it_and_inserted.first = value;
+  return true;
 }
 
 void SysStatsDataSource::ReadDiskStat(protos::pbzero::SysStats* sys_stats) {
@@ -299,22 +391,35 @@ void SysStatsDataSource::ReadBuddyInfo(protos::pbzero::SysStats* sys_stats) {
   }
 
   char* buf = static_cast<char*>(read_buf_.Get());
+  std::string node;
+  std::string zone;
+  std::vector<uint32_t> order_pages;
   for (base::StringSplitter lines(buf, rsize, '\n'); lines.Next();) {
     uint32_t index = 0;
-    auto* buddy_info = sys_stats->add_buddy_info();
+    node.clear();
+    zone.clear();
+    order_pages.clear();
     for (base::StringSplitter words(&lines, ' '); words.Next();) {
       if (index == 1) {
-        std::string token = words.cur_token();
-        token = token.substr(0, token.find(","));
-        buddy_info->set_node(token);
+        node = words.cur_token();
+        node = node.substr(0, node.find(","));
       } else if (index == 3) {
-        buddy_info->set_zone(words.cur_token());
+        zone = words.cur_token();
       } else if (index > 3) {
-        buddy_info->add_order_pages(
+        order_pages.push_back(
             static_cast<uint32_t>(strtoul(words.cur_token(), nullptr, 0)));
       }
       index++;
     }
+    if (!CounterChanged(base::Hasher::Combine(kBuddyInfo, node, zone),
+                        HashValues(order_pages))) {
+      continue;
+    }
+    auto* buddy_info = sys_stats->add_buddy_info();
+    buddy_info->set_node(node);
+    buddy_info->set_zone(zone);
+    for (uint32_t pages : order_pages)
+      buddy_info->add_order_pages(pages);
   }
 }
 
@@ -328,6 +433,8 @@ void SysStatsDataSource::ReadDevfreq(protos::pbzero::SysStats* sys_stats) {
       const char* name = dir_ent->d_name;
       const char* file_content = ReadDevfreqCurFreq(name);
       auto value = static_cast<uint64_t>(strtoll(file_content, nullptr, 10));
+      if (!CounterChanged(base::Hasher::Combine(kDevfreq, name), value))
+        continue;
       auto* devfreq = sys_stats->add_devfreq();
       devfreq->set_key(name);
       devfreq->set_value(value);
@@ -338,6 +445,9 @@ void SysStatsDataSource::ReadDevfreq(protos::pbzero::SysStats* sys_stats) {
 void SysStatsDataSource::ReadCpufreq(protos::pbzero::SysStats* sys_stats) {
   const auto& cpufreq = cpu_freq_info_->ReadCpuCurrFreq();
 
+  // The frequencies are indexed by cpu, so they are reported all together.
+  if (!CounterChanged(kCpufreq, HashValues(cpufreq)))
+    return;
   for (const auto& c : cpufreq)
     sys_stats->add_cpufreq_khz(c);
 }
@@ -358,11 +468,16 @@ const char* SysStatsDataSource::ReadDevfreqCurFreq(
   const char* freq_file_name = "cur_freq";
   base::StackString<256> cur_freq_path("%s/%s/%s", devfreq_base_path,
                                        deviceName.c_str(), freq_file_name);
-  base::ScopedFile fd = OpenReadOnly(cur_freq_path.c_str());
-  if (!fd && !devfreq_error_logged_) {
-    devfreq_error_logged_ = true;
-    PERFETTO_PLOG("Failed to open %s", cur_freq_path.c_str());
-    return "";
+  // The file is kept open and re-read from the start on every poll. It's
+  // reopened if a read fails, e.g. if the device went away.
+  base::ScopedFile& fd = devfreq_fds_[deviceName];
+  if (!fd) {
+    fd = OpenReadOnly(cur_freq_path.c_str());
+    if (!fd && !devfreq_error_logged_) {
+      devfreq_error_logged_ = true;
+      PERFETTO_PLOG("Failed to open %s", cur_freq_path.c_str());
+      return "";
+    }
   }
   size_t rsize = ReadFile(&fd, cur_freq_path.c_str());
   if (!rsize)
@@ -374,46 +489,48 @@ void SysStatsDataSource::ReadMeminfo(protos::pbzero::SysStats* sys_stats) {
   size_t rsize = ReadFile(&meminfo_fd_, "/proc/meminfo");
   if (!rsize)
     return;
-  char* buf = static_cast<char*>(read_buf_.Get());
-  for (base::StringSplitter lines(buf, rsize, '\n'); lines.Next();) {
-    base::StringSplitter words(&lines, ' ');
-    if (!words.Next())
-      continue;
-    // Extract the meminfo key, dropping trailing ':' (e.g., "MemTotal: NN KB").
-    words.cur_token()[words.cur_token_size() - 1] = '\0';
-    auto it = meminfo_counters_.find(words.cur_token());
-    if (it == meminfo_counters_.end())
-      continue;
-    int counter_id = it->second;
-    if (!words.Next())
-      continue;
-    auto value = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+  const char* buf = static_cast<const char*>(read_buf_.Get());
+  auto on_counter = [this, sys_stats](base::StringView key, uint64_t value) {
+    int* counter_id = meminfo_counters_.Find(key);
+    if (!counter_id)
+      return;
+    if (counters_cache_ttl_ticks_) {
+      uint64_t& last_value =
+          meminfo_last_values_[static_cast<size_t>(*counter_id)];
+      if (last_value == value)
+        return;
+      last_value = value;
+    }
     auto* meminfo = sys_stats->add_meminfo();
-    meminfo->set_key(static_cast<protos::pbzero::MeminfoCounters>(counter_id));
+    meminfo->set_key(static_cast<protos::pbzero::MeminfoCounters>(*counter_id));
     meminfo->set_value(value);
-  }
+  };
+  // Lines look like "MemTotal:  3744240 kB".
+  ForEachKeyValueLine(buf, rsize - 1, ':', on_counter);
 }
 
 void SysStatsDataSource::ReadVmstat(protos::pbzero::SysStats* sys_stats) {
   size_t rsize = ReadFile(&vmstat_fd_, "/proc/vmstat");
   if (!rsize)
     return;
-  char* buf = static_cast<char*>(read_buf_.Get());
-  for (base::StringSplitter lines(buf, rsize, '\n'); lines.Next();) {
-    base::StringSplitter words(&lines, ' ');
-    if (!words.Next())
-      continue;
-    auto it = vmstat_counters_.find(words.cur_token());
-    if (it == vmstat_counters_.end())
-      continue;
-    int counter_id = it->second;
-    if (!words.Next())
-      continue;
-    auto value = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+  const char* buf = static_cast<const char*>(read_buf_.Get());
+  auto on_counter = [this, sys_stats](base::StringView key, uint64_t value) {
+    int* counter_id = vmstat_counters_.Find(key);
+    if (!counter_id)
+      return;
+    if (counters_cache_ttl_ticks_) {
+      uint64_t& last_value =
+          vmstat_last_values_[static_cast<size_t>(*counter_id)];
+      if (last_value == value)
+        return;
+      last_value = value;
+    }
     auto* vmstat = sys_stats->add_vmstat();
-    vmstat->set_key(static_cast<protos::pbzero::VmstatCounters>(counter_id));
+    vmstat->set_key(static_cast<protos::pbzero::VmstatCounters>(*counter_id));
     vmstat->set_value(value);
-  }
+  };
+  // Lines look like "nr_free_pages 16449".
+  ForEachKeyValueLine(buf, rsize - 1, ' ', on_counter);
 }
 
 void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
@@ -435,6 +552,10 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
         cpu_times[i] =
             static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
       }
+      if (!CounterChanged(base::Hasher::Combine(kCpuTimes, cpu_id),
+                          HashValues(cpu_times))) {
+        continue;
+      }
       auto* cpu_stat = sys_stats->add_cpu_stat();
       cpu_stat->set_cpu_id(static_cast<uint32_t>(cpu_id));
       cpu_stat->set_user_ns(cpu_times[0] * ns_per_user_hz_);
@@ -451,8 +572,9 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
       for (size_t i = 0; words.Next(); i++) {
         auto v = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
         if (i == 0) {
-          sys_stats->set_num_irq_total(v);
-        } else if (v > 0) {
+          if (CounterChanged(kIrqTotal, v))
+            sys_stats->set_num_irq_total(v);
+        } else if (v > 0 && CounterChanged(base::Hasher::Combine(kIrq, i), v)) {
           auto* irq_stat = sys_stats->add_num_irq();
           irq_stat->set_irq(static_cast<int32_t>(i - 1));
           irq_stat->set_count(v);
@@ -466,8 +588,9 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
       for (size_t i = 0; words.Next(); i++) {
         auto v = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
         if (i == 0) {
-          sys_stats->set_num_softirq_total(v);
-        } else {
+          if (CounterChanged(kSoftirqTotal, v))
+            sys_stats->set_num_softirq_total(v);
+        } else if (CounterChanged(base::Hasher::Combine(kSoftirq, i), v)) {
           auto* softirq_stat = sys_stats->add_num_softirq();
           softirq_stat->set_irq(static_cast<int32_t>(i - 1));
           softirq_stat->set_count(v);
@@ -478,8 +601,9 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
     else if ((stat_enabled_fields_ & (1 << SysStatsConfig::STAT_FORK_COUNT)) &&
              !strcmp(words.cur_token(), "processes")) {
       if (words.Next()) {
-        sys_stats->set_num_forks(
-            static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10)));
+        auto v = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+        if (CounterChanged(kForks, v))
+          sys_stats->set_num_forks(v);
       }
     }
 
@@ -491,6 +615,12 @@ base::WeakPtr<SysStatsDataSource> SysStatsDataSource::GetWeakPtr() const {
 }
 
 void SysStatsDataSource::Flush(FlushRequestID, std::function<void()> callback) {
+  // When only changed counters are reported, the last values of some counters
+  // could be arbitrarily far back in the buffer, or already overwritten if it
+  // is a ring buffer. Report all of them, so that the trace (or the clone of
+  // the session that the flush is for) is complete from here.
+  if (counters_cache_ttl_ticks_)
+    ReadSysStats(/*all_counters=*/true);
   writer_->Flush(callback);
 }
 
@@ -17,14 +17,15 @@
 #ifndef SRC_TRACED_PROBES_SYS_STATS_SYS_STATS_DATA_SOURCE_H_
 #define SRC_TRACED_PROBES_SYS_STATS_SYS_STATS_DATA_SOURCE_H_
 
-#include <string.h>
-
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
@@ -71,17 +72,17 @@ class SysStatsDataSource : public ProbesDataSource {
   virtual const char* ReadDevfreqCurFreq(const std::string& name);
 
  private:
-  struct CStrCmp {
-    bool operator()(const char* a, const char* b) const {
-      return strcmp(a, b) < 0;
-    }
-  };
-
   static void Tick(base::WeakPtr<SysStatsDataSource>);
 
   SysStatsDataSource(const SysStatsDataSource&) = delete;
   SysStatsDataSource& operator=(const SysStatsDataSource&) = delete;
-  void ReadSysStats();  // Virtual for testing.
+  // Reads the counters due at the current tick, or all the configured ones if
+  // |all_counters| is true, and writes them into a new packet.
+  void ReadSysStats(bool all_counters);
+  // Whether the counter identified by |key| should be reported: always if
+  // |counters_cache_ttl_ticks_| is not set, otherwise only if |value| changed
+  // since it was last reported.
+  bool CounterChanged(uint64_t key, uint64_t value);
   void ReadMeminfo(protos::pbzero::SysStats* sys_stats);
   void ReadVmstat(protos::pbzero::SysStats* sys_stats);
   void ReadStat(protos::pbzero::SysStats* sys_stats);
@@ -100,8 +101,19 @@ class SysStatsDataSource : public ProbesDataSource {
   base::ScopedFile diskstat_fd_;
   base::PagedMemory read_buf_;
   TraceWriter::TracePacketHandle cur_packet_;
-  std::map<const char*, int, CStrCmp> meminfo_counters_;
-  std::map<const char*, int, CStrCmp> vmstat_counters_;
+  base::FlatHashMap<base::StringView, int> meminfo_counters_;
+  base::FlatHashMap<base::StringView, int> vmstat_counters_;
+  // Kept open across polls, see ReadDevfreqCurFreq().
+  std::map<std::string, base::ScopedFile> devfreq_fds_;
+
+  // Last reported value of each counter, indexed by counter id, if
+  // |counters_cache_ttl_ticks_| is set. Reset every that many ticks.
+  std::vector<uint64_t> meminfo_last_values_;
+  std::vector<uint64_t> vmstat_last_values_;
+  // Same for the other counters, but keyed by a hash of their kind and id.
+  // Counters made of several values store a hash of the values.
+  base::FlatHashMap<uint64_t, uint64_t> last_reported_;
+  uint32_t counters_cache_ttl_ticks_ = 0;
   uint64_t ns_per_user_hz_ = 0;
   uint32_t tick_ = 0;
   uint32_t tick_period_ms_ = 0;
@@ -333,6 +333,73 @@ TEST_F(SysStatsDataSourceTest, MeminfoAll) {
   EXPECT_GE(sys_stats.meminfo_size(), 10);
 }
 
+TEST_F(SysStatsDataSourceTest, MeminfoOnlyChanged) {
+  using C = protos::gen::MeminfoCounters;
+  DataSourceConfig config;
+  protos::gen::SysStatsConfig sys_cfg;
+  sys_cfg.set_meminfo_period_ms(10);
+  sys_cfg.add_meminfo_counters(C::MEMINFO_MEM_TOTAL);
+  sys_cfg.add_meminfo_counters(C::MEMINFO_MEM_FREE);
+  sys_cfg.set_counters_cache_ttl_ms(10000);
+  config.set_sys_stats_config_raw(sys_cfg.SerializeAsString());
+  auto data_source = GetSysStatsDataSource(config);
+
+  auto checkpoint = task_runner_.CreateCheckpoint("two_ticks");
+  std::function<void()> poller = [&] {
+    if (data_source->tick_for_testing() >= 2)
+      checkpoint();
+    else
+      task_runner_.PostDelayedTask(poller, 1);
+  };
+  poller();
+  task_runner_.RunUntilCheckpoint("two_ticks");
+
+  // The mock /proc/meminfo doesn't change, so the second poll reports nothing.
+  auto packets = writer_raw_->GetAllTracePackets();
+  ASSERT_GE(packets.size(), 2u);
+  EXPECT_EQ(packets[0].sys_stats().meminfo_size(), 2);
+  EXPECT_EQ(packets[1].sys_stats().meminfo_size(), 0);
+}
+
+TEST_F(SysStatsDataSourceTest, StatOnlyChanged) {
+  DataSourceConfig config;
+  protos::gen::SysStatsConfig sys_cfg;
+  sys_cfg.set_stat_period_ms(10);
+  sys_cfg.set_counters_cache_ttl_ms(10000);
+  config.set_sys_stats_config_raw(sys_cfg.SerializeAsString());
+  auto data_source = GetSysStatsDataSource(config);
+
+  auto checkpoint = task_runner_.CreateCheckpoint("two_ticks");
+  std::function<void()> poller = [&] {
+    if (data_source->tick_for_testing() >= 2)
+      checkpoint();
+    else
+      task_runner_.PostDelayedTask(poller, 1);
+  };
+  poller();
+  task_runner_.RunUntilCheckpoint("two_ticks");
+
+  // The mock /proc/stat doesn't change, so the second poll reports nothing.
+  auto packets = writer_raw_->GetAllTracePackets();
+  ASSERT_GE(packets.size(), 2u);
+  EXPECT_EQ(packets[0].sys_stats().cpu_stat_size(), 8);
+  EXPECT_EQ(packets[0].sys_stats().num_irq_size(), 102);
+  EXPECT_EQ(packets[0].sys_stats().num_forks(), 243320u);
+  EXPECT_EQ(packets[1].sys_stats().cpu_stat_size(), 0);
+  EXPECT_EQ(packets[1].sys_stats().num_irq_size(), 0);
+  EXPECT_EQ(packets[1].sys_stats().num_softirq_size(), 0);
+  EXPECT_FALSE(packets[1].sys_stats().has_num_forks());
+
+  // A flush reports all the counters again, e.g. for a clone of the session.
+  data_source->Flush(1, [] {});
+  packets = writer_raw_->GetAllTracePackets();
+  const auto& flushed = packets.back().sys_stats();
+  EXPECT_EQ(flushed.cpu_stat_size(), 8);
+  EXPECT_EQ(flushed.num_irq_size(), 102);
+  EXPECT_EQ(flushed.num_softirq_size(), 10);
+  EXPECT_EQ(flushed.num_forks(), 243320u);
+}
+
 TEST_F(SysStatsDataSourceTest, Vmstat) {
   using C = protos::gen::VmstatCounters;
   DataSourceConfig config;
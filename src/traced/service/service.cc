@@ -16,6 +16,7 @@
 
 #include <stdio.h>
 #include <algorithm>
+#include <optional>
 
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/getopt.h"
@@ -89,6 +90,12 @@ Usage: %s [option] ...
 Options and arguments
     --background : Exits immediately and continues running in the background
     --version : print the version number and exit.
+    --compression-threads <n> : compress the traces written into files on up
+        to <n> threads instead of on the service thread.
+    --async-file-writes : write the traces written into files on a dedicated
+        thread instead of on the service thread.
+    --read-buffers-threads <n> : read up to <n> buffers of the traces written
+        into files concurrently instead of one after the other.
     --set-socket-permissions <permissions> : sets group ownership and permission
         mode bits of the producer and consumer sockets.
         <permissions> format: <prod_group>:<prod_mode>:<cons_group>:<cons_mode>,
@@ -112,13 +119,24 @@ int PERFETTO_EXPORT_ENTRYPOINT ServiceMain(int argc, char** argv) {
     OPT_VERSION = 1000,
     OPT_SET_SOCKET_PERMISSIONS = 1001,
     OPT_BACKGROUND,
+    OPT_COMPRESSION_THREADS,
+    OPT_ASYNC_FILE_WRITES,
+    OPT_READ_BUFFERS_THREADS,
   };
 
   bool background = false;
+  uint32_t compression_thread_count = 0;
+  bool async_file_writes = false;
+  uint32_t read_buffers_thread_count = 0;
 
   static const option long_options[] = {
       {"background", no_argument, nullptr, OPT_BACKGROUND},
       {"version", no_argument, nullptr, OPT_VERSION},
+      {"compression-threads", required_argument, nullptr,
+       OPT_COMPRESSION_THREADS},
+      {"async-file-writes", no_argument, nullptr, OPT_ASYNC_FILE_WRITES},
+      {"read-buffers-threads", required_argument, nullptr,
+       OPT_READ_BUFFERS_THREADS},
       {"set-socket-permissions", required_argument, nullptr,
        OPT_SET_SOCKET_PERMISSIONS},
       {nullptr, 0, nullptr, 0}};
@@ -137,6 +155,27 @@ int PERFETTO_EXPORT_ENTRYPOINT ServiceMain(int argc, char** argv) {
       case OPT_VERSION:
         printf("%s\n", base::GetVersionString());
         return 0;
+      case OPT_COMPRESSION_THREADS: {
+        std::optional<uint32_t> count = base::StringToUInt32(optarg);
+        if (!count) {
+          PrintUsage(argv[0]);
+          return 1;
+        }
+        compression_thread_count = *count;
+        break;
+      }
+      case OPT_ASYNC_FILE_WRITES:
+        async_file_writes = true;
+        break;
+      case OPT_READ_BUFFERS_THREADS: {
+        std::optional<uint32_t> count = base::StringToUInt32(optarg);
+        if (!count) {
+          PrintUsage(argv[0]);
+          return 1;
+        }
+        read_buffers_thread_count = *count;
+        break;
+      }
       case OPT_SET_SOCKET_PERMISSIONS: {
         // Check that the socket permission argument is well formed.
         auto parts = base::SplitString(std::string(optarg), ":");
@@ -165,7 +204,11 @@ int PERFETTO_EXPORT_ENTRYPOINT ServiceMain(int argc, char** argv) {
   TracingService::InitOpts init_opts = {};
 #if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
   init_opts.compressor_fn = &ZlibCompressFn;
+  init_opts.fast_compressor_fn = &ZlibFastCompressFn;
 #endif
+  init_opts.compression_thread_count = compression_thread_count;
+  init_opts.async_write_into_file = async_file_writes;
+  init_opts.read_buffers_thread_count = read_buffers_thread_count;
   svc = ServiceIPCHost::CreateInstance(&task_runner, init_opts);
 
   // When built as part of the Android tree, the two socket are created and
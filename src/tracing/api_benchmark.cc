@@ -12,6 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stdlib.h>
+
+#include <string_view>
+
 #include <benchmark/benchmark.h>
 
 #include "perfetto/tracing.h"
@@ -25,6 +29,54 @@ PERFETTO_TRACK_EVENT_STATIC_STORAGE();
 
 namespace {
 
+// Heap allocations made by the current thread while |g_count_allocations| is
+// set. Used to check that trace points don't allocate.
+thread_local bool g_count_allocations = false;
+thread_local uint64_t g_allocation_count = 0;
+
+class ScopedAllocationCounter {
+ public:
+  ScopedAllocationCounter() {
+    g_allocation_count = 0;
+    g_count_allocations = true;
+  }
+  ~ScopedAllocationCounter() { g_count_allocations = false; }
+
+  uint64_t count() const { return g_allocation_count; }
+};
+
+}  // namespace
+
+void* operator new(size_t size) {
+  if (g_count_allocations)
+    g_allocation_count++;
+  void* ptr = malloc(size ? size : 1);
+  PERFETTO_CHECK(ptr);
+  return ptr;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+namespace {
+
 class BenchmarkDataSource : public perfetto::DataSource<BenchmarkDataSource> {
  public:
   void OnSetup(const SetupArgs&) override {}
@@ -142,8 +194,73 @@ static void BM_TracingTrackEventBasic(benchmark::State& state) {
 static void BM_TracingTrackEventDebugAnnotations(benchmark::State& state) {
   auto tracing_session = StartTracing("track_event");
 
+  {
+    ScopedAllocationCounter allocations;
+    while (state.KeepRunning()) {
+      TRACE_EVENT_BEGIN("benchmark", "Event", "value", 42);
+      benchmark::ClobberMemory();
+    }
+    state.counters["Allocations"] =
+        benchmark::Counter(static_cast<double>(allocations.count()),
+                           benchmark::Counter::kAvgIterations);
+  }
+
+  tracing_session->StopBlocking();
+  PERFETTO_CHECK(!tracing_session->ReadTraceBlocking().empty());
+}
+
+static void BM_TracingTrackEventNestedDebugAnnotations(
+    benchmark::State& state) {
+  auto tracing_session = StartTracing("track_event");
+  const std::string str_value = "std::string value";
+  const std::string_view str_view_value = "std::string_view value";
+
+  {
+    ScopedAllocationCounter allocations;
+    while (state.KeepRunning()) {
+      TRACE_EVENT_BEGIN("benchmark", "Event", "int", 42, "string", str_value,
+                        "dict", [&](perfetto::TracedValue context) {
+                          auto dict = std::move(context).WriteDictionary();
+                          dict.Add("string_view", str_view_value);
+                          dict.Add("double", 4.2);
+                          auto array = dict.AddArray("array");
+                          array.Append(1u);
+                          array.Append("literal");
+                          array.Append(perfetto::DynamicString(str_value));
+                        });
+      benchmark::ClobberMemory();
+    }
+    state.counters["Allocations"] =
+        benchmark::Counter(static_cast<double>(allocations.count()),
+                           benchmark::Counter::kAvgIterations);
+  }
+
+  tracing_session->StopBlocking();
+  PERFETTO_CHECK(!tracing_session->ReadTraceBlocking().empty());
+}
+
+// Counterpart of BM_Shlib_TeManyExtras in src/shared_lib/test/benchmark.cc.
+static void BM_TracingTrackEventManyExtras(benchmark::State& state) {
+  auto tracing_session = StartTracing("track_event");
+
+  while (state.KeepRunning()) {
+    TRACE_EVENT_BEGIN("benchmark", "Event", "value", 42u, "string", "value",
+                      "double", 4.2, perfetto::Flow::ProcessScoped(1));
+    benchmark::ClobberMemory();
+  }
+
+  tracing_session->StopBlocking();
+  PERFETTO_CHECK(!tracing_session->ReadTraceBlocking().empty());
+}
+
+// Counterpart of BM_Shlib_TeDynamicCategory in
+// src/shared_lib/test/benchmark.cc.
+static void BM_TracingTrackEventDynamicCategory(benchmark::State& state) {
+  auto tracing_session = StartTracing("track_event");
+  perfetto::DynamicCategory category{"dynamic"};
+
   while (state.KeepRunning()) {
-    TRACE_EVENT_BEGIN("benchmark", "Event", "value", 42);
+    TRACE_EVENT_BEGIN(category, "Event");
     benchmark::ClobberMemory();
   }
 
@@ -174,5 +291,8 @@ BENCHMARK(BM_TracingDataSourceLambda);
 BENCHMARK(BM_TracingDataSourceLambdaDifferentPacketSize)->Range(1, 1000);
 BENCHMARK(BM_TracingTrackEventBasic);
 BENCHMARK(BM_TracingTrackEventDebugAnnotations);
+BENCHMARK(BM_TracingTrackEventNestedDebugAnnotations);
+BENCHMARK(BM_TracingTrackEventManyExtras);
+BENCHMARK(BM_TracingTrackEventDynamicCategory);
 BENCHMARK(BM_TracingTrackEventDisabled);
 BENCHMARK(BM_TracingTrackEventLambda);
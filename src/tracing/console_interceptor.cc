@@ -29,6 +29,7 @@
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/tracing/internal/track_event_internal.h"
+#include "src/tracing/core/async_file_writer.h"
 
 #include "protos/perfetto/common/interceptor_descriptor.gen.h"
 #include "protos/perfetto/config/data_source_config.gen.h"
@@ -55,6 +56,9 @@ namespace {
 
 int g_output_fd_for_testing;
 
+// Bounds the memory used for output queued with ConsoleConfig.async_output.
+constexpr size_t kMaxAsyncPendingBytes = 4 * 1024 * 1024;
+
 // Google Turbo colormap.
 constexpr std::array<ConsoleColor, 16> kTurboColors = {{
     ConsoleColor{0x30, 0x12, 0x3b},
@@ -140,6 +144,7 @@ ConsoleInterceptor::ThreadLocalState::ThreadLocalState(
     start_time_ns = self->start_time_ns_;
     use_colors = self->use_colors_;
     fd = self->fd_;
+    async_writer = self->async_writer_;
   }
 }
 
@@ -286,13 +291,26 @@ void ConsoleInterceptor::OnSetup(const SetupArgs& args) {
   }
   fd_ = fd;
   use_colors_ = use_colors;
+  if (config.async_output()) {
+    async_writer_ = std::make_shared<AsyncFileWriter>(
+        fd, AsyncFileWriter::OverflowPolicy::kDrop, kMaxAsyncPendingBytes);
+  }
 }
 
 void ConsoleInterceptor::OnStart(const StartArgs&) {
   start_time_ns_ = internal::TrackEventInternal::GetTimeNs();
 }
 
-void ConsoleInterceptor::OnStop(const StopArgs&) {}
+void ConsoleInterceptor::OnStop(const StopArgs&) {
+  if (!async_writer_)
+    return;
+  async_writer_->Drain();
+  if (uint64_t dropped_bytes = async_writer_->dropped_bytes()) {
+    std::string message = "[" + std::to_string(dropped_bytes) +
+                          " bytes of console output dropped]\n";
+    base::WriteAll(fd_, message.data(), message.size());
+  }
+}
 
 // static
 void ConsoleInterceptor::OnTracePacket(InterceptorContext context) {
@@ -326,7 +344,23 @@ void ConsoleInterceptor::Printf(InterceptorContext& context,
 
   // In case of buffer overflow, flush to the fd and write the latest message to
   // it directly instead.
-  if (remaining <= 0 || written > remaining) {
+  if ((remaining <= 0 || written > remaining) && tls.async_writer) {
+    // Writing directly would reorder the message with the queued ones.
+    Flush(context);
+    va_list args;
+    va_start(args, format);
+    int size = vsnprintf(nullptr, 0, format, args);
+    va_end(args);
+    if (size > 0) {
+      std::vector<uint8_t> message(static_cast<size_t>(size) + 1);
+      va_start(args, format);
+      vsnprintf(reinterpret_cast<char*>(message.data()), message.size(),
+                format, args);
+      va_end(args);
+      message.pop_back();  // The null terminator.
+      tls.async_writer->Write(std::move(message));
+    }
+  } else if (remaining <= 0 || written > remaining) {
     FILE* output = (tls.fd == STDOUT_FILENO) ? stdout : stderr;
     if (g_output_fd_for_testing) {
       output = fdopen(dup(g_output_fd_for_testing), "w");
@@ -347,6 +381,13 @@ void ConsoleInterceptor::Printf(InterceptorContext& context,
 // static
 void ConsoleInterceptor::Flush(InterceptorContext& context) {
   auto& tls = context.GetThreadLocalState();
+  if (tls.async_writer) {
+    const char* data = &tls.message_buffer[0];
+    tls.async_writer->Write(
+        std::vector<uint8_t>(data, data + tls.buffer_pos));
+    tls.buffer_pos = 0;
+    return;
+  }
   ssize_t res = base::WriteAll(tls.fd, &tls.message_buffer[0], tls.buffer_pos);
   PERFETTO_DCHECK(res == static_cast<ssize_t>(tls.buffer_pos));
   tls.buffer_pos = 0;
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/async_file_writer.h"
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+
+namespace perfetto {
+
+AsyncFileWriter::AsyncFileWriter(int fd,
+                                 OverflowPolicy overflow_policy,
+                                 size_t max_pending_bytes)
+    : fd_(fd),
+      overflow_policy_(overflow_policy),
+      max_pending_bytes_(max_pending_bytes),
+      thread_(&AsyncFileWriter::RunThreadLoop, this) {}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void AsyncFileWriter::Write(std::vector<uint8_t> data) {
+  if (data.empty())
+    return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (overflow_policy_ == OverflowPolicy::kDrop) {
+    if (pending_bytes_ + data.size() > max_pending_bytes_) {
+      dropped_bytes_.fetch_add(data.size(), std::memory_order_relaxed);
+      return;
+    }
+  } else {
+    cv_.wait(lock, [this] { return pending_bytes_ <= max_pending_bytes_; });
+  }
+  pending_bytes_ += data.size();
+  pending_.emplace_back(std::move(data));
+  cv_.notify_all();
+}
+
+bool AsyncFileWriter::Drain() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return pending_.empty() && !writing_; });
+  }
+  if (failed())
+    return false;
+  return base::FlushFile(fd_);
+}
+
+void AsyncFileWriter::RunThreadLoop() {
+  for (;;) {
+    std::vector<uint8_t> data;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return quit_ || !pending_.empty(); });
+      // Even when quitting, write everything which was queued.
+      if (pending_.empty())
+        return;
+      data = std::move(pending_.front());
+      pending_.pop_front();
+      writing_ = true;
+    }
+
+    if (!failed()) {
+      ssize_t wr_size = base::WriteAll(fd_, data.data(), data.size());
+      if (wr_size != static_cast<ssize_t>(data.size())) {
+        PERFETTO_PLOG("write() failed");
+        failed_.store(true, std::memory_order_relaxed);
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_bytes_ -= data.size();
+      writing_ = false;
+    }
+    cv_.notify_all();
+  }
+}
+
+}  // namespace perfetto
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACING_CORE_ASYNC_FILE_WRITER_H_
+#define SRC_TRACING_CORE_ASYNC_FILE_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace perfetto {
+
+// Writes data into a file on a dedicated thread, so that slow storage doesn't
+// block the thread producing the data. Writes happen in the order they are
+// queued. Used by the tracing service for write_into_file sessions and by the
+// ConsoleInterceptor.
+//
+// The file descriptor is not owned and must outlive the writer.
+class AsyncFileWriter {
+ public:
+  // Write() blocks while more than this many bytes are queued, bounding the
+  // memory used when the storage can't keep up.
+  static constexpr size_t kMaxPendingBytes = 32 * 1024 * 1024;
+
+  // What Write() does when more than |max_pending_bytes| are queued.
+  enum class OverflowPolicy {
+    // Wait for the queued data to be written.
+    kBlock,
+    // Drop the data (see dropped_bytes()), so Write() never blocks.
+    kDrop,
+  };
+
+  explicit AsyncFileWriter(
+      int fd,
+      OverflowPolicy overflow_policy = OverflowPolicy::kBlock,
+      size_t max_pending_bytes = kMaxPendingBytes);
+
+  // Writes all the queued data before returning.
+  ~AsyncFileWriter();
+
+  // Queues |data| to be written after the data previously queued.
+  void Write(std::vector<uint8_t> data);
+
+  // Blocks until all the queued data is written and flushes the file. Returns
+  // false if any write failed.
+  bool Drain();
+
+  // Whether a write failed. Data queued after a failure is dropped.
+  bool failed() const { return failed_.load(std::memory_order_relaxed); }
+
+  // The number of bytes dropped by Write() with OverflowPolicy::kDrop.
+  uint64_t dropped_bytes() const {
+    return dropped_bytes_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  AsyncFileWriter(const AsyncFileWriter&) = delete;
+  AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+  void RunThreadLoop();
+
+  const int fd_;
+  const OverflowPolicy overflow_policy_;
+  const size_t max_pending_bytes_;
+  std::atomic<bool> failed_{false};
+  std::atomic<uint64_t> dropped_bytes_{0};
+
+  // Start of mutex protected members.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::vector<uint8_t>> pending_;
+  size_t pending_bytes_ = 0;
+  bool writing_ = false;
+  bool quit_ = false;
+  // End of mutex protected members.
+
+  std::thread thread_;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACING_CORE_ASYNC_FILE_WRITER_H_
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/async_file_writer.h"
+
+#include <string>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+std::vector<uint8_t> ToBytes(const std::string& str) {
+  return std::vector<uint8_t>(str.begin(), str.end());
+}
+
+TEST(AsyncFileWriterTest, WritesInOrder) {
+  base::TempFile tmp_file = base::TempFile::Create();
+  std::string expected;
+  {
+    AsyncFileWriter writer(tmp_file.fd());
+    for (int i = 0; i < 1000; i++) {
+      std::string chunk = std::to_string(i) + ",";
+      expected += chunk;
+      writer.Write(ToBytes(chunk));
+    }
+    ASSERT_TRUE(writer.Drain());
+
+    std::string contents;
+    ASSERT_TRUE(base::ReadFile(tmp_file.path(), &contents));
+    EXPECT_EQ(contents, expected);
+
+    writer.Write(ToBytes("last"));
+    expected += "last";
+  }
+
+  // Destroying the writer writes the pending data.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path(), &contents));
+  EXPECT_EQ(contents, expected);
+}
+
+TEST(AsyncFileWriterTest, ReportsFailures) {
+  base::TempFile tmp_file = base::TempFile::Create();
+  // A read-only descriptor of the file makes all writes fail.
+  base::ScopedFile read_only = base::OpenFile(tmp_file.path(), O_RDONLY);
+  ASSERT_TRUE(read_only);
+
+  AsyncFileWriter writer(*read_only);
+  writer.Write(ToBytes("data"));
+  EXPECT_FALSE(writer.Drain());
+  EXPECT_TRUE(writer.failed());
+}
+
+TEST(AsyncFileWriterTest, DropsOnOverflow) {
+  base::TempFile tmp_file = base::TempFile::Create();
+  AsyncFileWriter writer(tmp_file.fd(),
+                         AsyncFileWriter::OverflowPolicy::kDrop,
+                         /*max_pending_bytes=*/16);
+  // Writes which exceed the limit on their own are always dropped.
+  writer.Write(ToBytes("this is more than 16 bytes"));
+  EXPECT_EQ(writer.dropped_bytes(), 26u);
+
+  writer.Write(ToBytes("fits"));
+  ASSERT_TRUE(writer.Drain());
+  EXPECT_EQ(writer.dropped_bytes(), 26u);
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path(), &contents));
+  EXPECT_EQ(contents, "fits");
+}
+
+}  // namespace
+}  // namespace perfetto
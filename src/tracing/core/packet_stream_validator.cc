@@ -18,6 +18,7 @@
 
 #include <stddef.h>
 
+#include <algorithm>
 #include <cinttypes>
 
 #include "perfetto/base/logging.h"
@@ -32,7 +33,7 @@ namespace {
 
 using protozero::proto_utils::ProtoWireType;
 
-const uint32_t kReservedFieldIds[] = {
+constexpr uint32_t kReservedFieldIds[] = {
     protos::pbzero::TracePacket::kTrustedUidFieldNumber,
     protos::pbzero::TracePacket::kTrustedPacketSequenceIdFieldNumber,
     protos::pbzero::TracePacket::kTraceConfigFieldNumber,
@@ -42,11 +43,29 @@ const uint32_t kReservedFieldIds[] = {
     protos::pbzero::TracePacket::kTrustedPidFieldNumber,
 };
 
+// Bitmap of the reserved field ids, which are all small.
+constexpr uint32_t kReservedFieldIdsBitmapSize = 128;
+struct ReservedFieldIdsBitmap {
+  constexpr ReservedFieldIdsBitmap() {
+    for (uint32_t field_id : kReservedFieldIds)
+      words[field_id / 64] |= 1ull << (field_id % 64);
+  }
+  uint64_t words[kReservedFieldIdsBitmapSize / 64]{};
+};
+constexpr ReservedFieldIdsBitmap kReservedFieldIdsBitmap;
+
+bool IsReservedFieldId(uint32_t field_id) {
+  return field_id < kReservedFieldIdsBitmapSize &&
+         (kReservedFieldIdsBitmap.words[field_id / 64] >> (field_id % 64)) & 1;
+}
+
+}  // namespace
+
 // This translation unit is quite subtle and perf-sensitive. Remember to check
 // BM_PacketStreamValidator in perfetto_benchmarks when making changes.
 
-// Checks that a packet, spread over several slices, is well-formed and doesn't
-// contain reserved top-level fields.
+// Checks that a packet, spread over several fragments, is well-formed and
+// doesn't contain reserved top-level fields.
 // The checking logic is based on a state-machine that skips the fields' payload
 // and operates as follows:
 //              +-------------------------------+ <-------------------------+
@@ -65,131 +84,179 @@ const uint32_t kReservedFieldIds[] = {
 //                      +----------------+     +-----------------+          |
 //                               |                                          |
 //                               +------------------------------------------+
-class ProtoFieldParserFSM {
- public:
-  // This method effectively continuously parses varints (either for the field
-  // preamble or the payload or the submessage length) and tells the caller
-  // (the Validate() method) how many bytes to skip until the next field.
-  size_t Push(uint8_t octet) {
-    varint_ |= static_cast<uint64_t>(octet & 0x7F) << varint_shift_;
-    if (octet & 0x80) {
-      varint_shift_ += 7;
-      if (varint_shift_ >= 64) {
-        // Do not invoke UB on next call.
-        varint_shift_ = 0;
-        state_ = kInvalidVarInt;
+// ParseWholeFields() is the fast path of the state machine, which goes
+// through a whole field at a time. Only the fields whose preamble, value or
+// length is split across two fragments (or is invalid) go through the state
+// machine one byte at a time.
+
+size_t PacketStreamValidator::PushVarInt(uint64_t varint) {
+  switch (state_) {
+    case kFieldPreamble: {
+      uint64_t field_type = varint & 7;  // 7 = 0..0111
+      auto field_id = static_cast<uint32_t>(varint >> 3);
+      // Check if the field id is reserved, go into an error state if it is.
+      if (PERFETTO_UNLIKELY(IsReservedFieldId(field_id))) {
+        state_ = kWroteReservedField;
+        return 0;
+      }
+      // The field type is legit, now check it's well formed and within
+      // boundaries.
+      if (field_type == static_cast<uint64_t>(ProtoWireType::kVarInt)) {
+        state_ = kVarIntValue;
+      } else if (field_type == static_cast<uint64_t>(ProtoWireType::kFixed32)) {
+        return 4;
+      } else if (field_type == static_cast<uint64_t>(ProtoWireType::kFixed64)) {
+        return 8;
+      } else if (field_type ==
+                 static_cast<uint64_t>(ProtoWireType::kLengthDelimited)) {
+        state_ = kLenDelimitedLen;
+      } else {
+        state_ = kUnknownFieldType;
       }
       return 0;
     }
-    uint64_t varint = varint_;
-    varint_ = 0;
-    varint_shift_ = 0;
-
-    switch (state_) {
-      case kFieldPreamble: {
-        uint64_t field_type = varint & 7;  // 7 = 0..0111
-        auto field_id = static_cast<uint32_t>(varint >> 3);
-        // Check if the field id is reserved, go into an error state if it is.
-        for (size_t i = 0; i < base::ArraySize(kReservedFieldIds); ++i) {
-          if (field_id == kReservedFieldIds[i]) {
-            state_ = kWroteReservedField;
-            return 0;
-          }
-        }
-        // The field type is legit, now check it's well formed and within
-        // boundaries.
-        if (field_type == static_cast<uint64_t>(ProtoWireType::kVarInt)) {
-          state_ = kVarIntValue;
-        } else if (field_type ==
-                   static_cast<uint64_t>(ProtoWireType::kFixed32)) {
-          return 4;
-        } else if (field_type ==
-                   static_cast<uint64_t>(ProtoWireType::kFixed64)) {
-          return 8;
-        } else if (field_type ==
-                   static_cast<uint64_t>(ProtoWireType::kLengthDelimited)) {
-          state_ = kLenDelimitedLen;
-        } else {
-          state_ = kUnknownFieldType;
-        }
-        return 0;
-      }
 
-      case kVarIntValue: {
-        // Consume the int field payload and go back to the next field.
-        state_ = kFieldPreamble;
+    case kVarIntValue: {
+      // Consume the int field payload and go back to the next field.
+      state_ = kFieldPreamble;
+      return 0;
+    }
+
+    case kLenDelimitedLen: {
+      if (varint > protozero::proto_utils::kMaxMessageLength) {
+        state_ = kMessageTooBig;
         return 0;
       }
+      state_ = kFieldPreamble;
+      return static_cast<size_t>(varint);
+    }
 
-      case kLenDelimitedLen: {
-        if (varint > protozero::proto_utils::kMaxMessageLength) {
+    case kWroteReservedField:
+    case kUnknownFieldType:
+    case kMessageTooBig:
+    case kInvalidVarInt:
+      // Persistent error states.
+      return 0;
+
+  }          // switch(state_)
+  return 0;  // To keep GCC happy.
+}
+
+size_t PacketStreamValidator::PushVarIntByte(uint8_t octet) {
+  varint_ |= static_cast<uint64_t>(octet & 0x7F) << varint_shift_;
+  if (octet & 0x80) {
+    varint_shift_ += 7;
+    if (varint_shift_ >= 64) {
+      // Do not invoke UB on next call.
+      varint_shift_ = 0;
+      state_ = kInvalidVarInt;
+    }
+    return 0;
+  }
+  uint64_t varint = varint_;
+  varint_ = 0;
+  varint_shift_ = 0;
+  return PushVarInt(varint);
+}
+
+const uint8_t* PacketStreamValidator::ParseWholeFields(const uint8_t* ptr,
+                                                       const uint8_t* end) {
+  PERFETTO_DCHECK(at_field_boundary());
+  using protozero::proto_utils::ParseVarInt;
+  while (ptr < end) {
+    uint64_t preamble = 0;
+    const uint8_t* pos = ParseVarInt(ptr, end, &preamble);
+    if (PERFETTO_UNLIKELY(pos == ptr))
+      return ptr;
+    if (PERFETTO_UNLIKELY(IsReservedFieldId(static_cast<uint32_t>(
+            preamble >> 3)))) {
+      state_ = kWroteReservedField;
+      return ptr;
+    }
+    uint64_t payload_size = 0;
+    switch (static_cast<ProtoWireType>(preamble & 7)) {
+      case ProtoWireType::kVarInt: {
+        uint64_t value = 0;
+        const uint8_t* value_end = ParseVarInt(pos, end, &value);
+        if (PERFETTO_UNLIKELY(value_end == pos))
+          return ptr;
+        ptr = value_end;
+        continue;
+      }
+      case ProtoWireType::kFixed32:
+        payload_size = 4;
+        break;
+      case ProtoWireType::kFixed64:
+        payload_size = 8;
+        break;
+      case ProtoWireType::kLengthDelimited: {
+        const uint8_t* len_end = ParseVarInt(pos, end, &payload_size);
+        if (PERFETTO_UNLIKELY(len_end == pos))
+          return ptr;
+        if (PERFETTO_UNLIKELY(payload_size >
+                              protozero::proto_utils::kMaxMessageLength)) {
           state_ = kMessageTooBig;
-          return 0;
+          return ptr;
         }
-        state_ = kFieldPreamble;
-        return static_cast<size_t>(varint);
+        pos = len_end;
+        break;
       }
+      default:
+        state_ = kUnknownFieldType;
+        return ptr;
+    }
+    if (PERFETTO_UNLIKELY(payload_size > static_cast<size_t>(end - pos))) {
+      // The payload continues in the next fragment.
+      skip_bytes_ = static_cast<size_t>(payload_size) -
+                    static_cast<size_t>(end - pos);
+      return end;
+    }
+    ptr = pos + payload_size;
+  }
+  return ptr;
+}
 
-      case kWroteReservedField:
-      case kUnknownFieldType:
-      case kMessageTooBig:
-      case kInvalidVarInt:
-        // Persistent error states.
-        return 0;
-
-    }          // switch(state_)
-    return 0;  // To keep GCC happy.
+void PacketStreamValidator::ProcessFragment(const uint8_t* data, size_t size) {
+  const uint8_t* ptr = data;
+  const uint8_t* const end = data + size;
+  while (ptr < end && !failed()) {
+    if (skip_bytes_ > 0) {
+      size_t skip = std::min(skip_bytes_, static_cast<size_t>(end - ptr));
+      ptr += skip;
+      skip_bytes_ -= skip;
+      continue;
+    }
+    if (at_field_boundary()) {
+      ptr = ParseWholeFields(ptr, end);
+      if (ptr == end || failed())
+        break;
+    }
+    // Only fields whose header is split across two fragments (or invalid
+    // varints) get here.
+    skip_bytes_ = PushVarIntByte(*ptr++);
   }
+}
 
-  // Queried at the end of the all payload. A message is well-formed only
-  // if the FSM is back to the state where it should parse the next field and
-  // hasn't started parsing any preamble.
-  bool valid() const { return state_ == kFieldPreamble && varint_shift_ == 0; }
-  int state() const { return static_cast<int>(state_); }
-
- private:
-  enum State {
-    kFieldPreamble = 0,  // Parsing the varint for the field preamble.
-    kVarIntValue,        // Parsing the varint value for the field payload.
-    kLenDelimitedLen,    // Parsing the length of the length-delimited field.
-
-    // Error states:
-    kWroteReservedField,  // Tried to set a reserved field id.
-    kUnknownFieldType,    // Encountered an invalid field type.
-    kMessageTooBig,       // Size of the length delimited message was too big.
-    kInvalidVarInt,       // VarInt larger than 64 bits.
-  };
-
-  State state_ = kFieldPreamble;
-  uint64_t varint_ = 0;
-  uint32_t varint_shift_ = 0;
-};
+bool PacketStreamValidator::Finish() const {
+  // A packet is well-formed only if the state machine is back to the state
+  // where it should parse the next field and hasn't started parsing any
+  // preamble.
+  if (at_field_boundary())
+    return true;
 
-}  // namespace
+  PERFETTO_DLOG("Packet validation error (state %d, skip = %zu)",
+                static_cast<int>(state_), skip_bytes_);
+  return false;
+}
 
 // static
 bool PacketStreamValidator::Validate(const Slices& slices) {
-  ProtoFieldParserFSM parser;
-  size_t skip_bytes = 0;
+  PacketStreamValidator validator;
   for (const Slice& slice : slices) {
-    for (size_t i = 0; i < slice.size;) {
-      const size_t skip_bytes_cur_slice = std::min(skip_bytes, slice.size - i);
-      if (skip_bytes_cur_slice > 0) {
-        i += skip_bytes_cur_slice;
-        skip_bytes -= skip_bytes_cur_slice;
-      } else {
-        uint8_t octet = *(reinterpret_cast<const uint8_t*>(slice.start) + i);
-        skip_bytes = parser.Push(octet);
-        i++;
-      }
-    }
+    validator.ProcessFragment(static_cast<const uint8_t*>(slice.start),
+                              slice.size);
   }
-  if (skip_bytes == 0 && parser.valid())
-    return true;
-
-  PERFETTO_DLOG("Packet validation error (state %d, skip = %zu)",
-                parser.state(), skip_bytes);
-  return false;
+  return validator.Finish();
 }
 
 }  // namespace perfetto
@@ -17,6 +17,9 @@
 #ifndef SRC_TRACING_CORE_PACKET_STREAM_VALIDATOR_H_
 #define SRC_TRACING_CORE_PACKET_STREAM_VALIDATOR_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "perfetto/ext/tracing/core/slice.h"
 
 namespace perfetto {
@@ -30,11 +33,71 @@ namespace perfetto {
 //
 // Note that we only validate top-level fields in the trace proto; sub-messages
 // are simply skipped.
+//
+// A packet can be validated in one go with Validate(), or fragment by
+// fragment, while its fragments are being gathered (see TraceBuffer):
+//   PacketStreamValidator validator;
+//   validator.ProcessFragment(frag1, frag1_size);
+//   validator.ProcessFragment(frag2, frag2_size);
+//   bool valid = validator.Finish();
+// Either way each byte of the packet is looked at only once.
 class PacketStreamValidator {
  public:
-  PacketStreamValidator() = delete;
+  PacketStreamValidator() = default;
+
+  // Continues the validation of the current packet with its next fragment.
+  void ProcessFragment(const uint8_t* data, size_t size);
+
+  // Returns true if the fragments passed to ProcessFragment() since the last
+  // Reset() form a well-formed packet.
+  bool Finish() const;
+
+  // Starts the validation of a new packet.
+  void Reset() { *this = PacketStreamValidator(); }
 
   static bool Validate(const Slices&);
+
+ private:
+  enum State : uint8_t {
+    kFieldPreamble = 0,  // Parsing the varint for the field preamble.
+    kVarIntValue,        // Parsing the varint value for the field payload.
+    kLenDelimitedLen,    // Parsing the length of the length-delimited field.
+
+    // Error states:
+    kWroteReservedField,  // Tried to set a reserved field id.
+    kUnknownFieldType,    // Encountered an invalid field type.
+    kMessageTooBig,       // Size of the length delimited message was too big.
+    kInvalidVarInt,       // VarInt larger than 64 bits.
+  };
+
+  bool failed() const { return state_ >= kWroteReservedField; }
+  bool at_field_boundary() const {
+    return state_ == kFieldPreamble && varint_shift_ == 0 && skip_bytes_ == 0;
+  }
+
+  // Goes through the fields which are entirely within [ptr, end). Returns the
+  // start of the first field which isn't, or |end|. The payload of the last
+  // field can continue in the next fragment.
+  const uint8_t* ParseWholeFields(const uint8_t* ptr, const uint8_t* end);
+
+  // Consumes a whole varint and returns how many bytes of payload should be
+  // skipped before the next varint.
+  size_t PushVarInt(uint64_t varint);
+
+  // Consumes one byte of a varint which spans over several fragments, or which
+  // is invalid.
+  size_t PushVarIntByte(uint8_t octet);
+
+  State state_ = kFieldPreamble;
+
+  // The bytes of the current field which are still to be skipped, when its
+  // payload continues in the next fragment.
+  size_t skip_bytes_ = 0;
+
+  // The varint which is being parsed byte by byte, when it continues in the
+  // next fragment.
+  uint64_t varint_ = 0;
+  uint32_t varint_shift_ = 0;
 };
 
 }  // namespace perfetto
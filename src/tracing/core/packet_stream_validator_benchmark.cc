@@ -49,12 +49,13 @@ static void BM_PacketStreamValidator(benchmark::State& state) {
   std::vector<uint8_t> buf = packet.SerializeAsArray();
 
   // Append 10 packets like the one above, splitting each packet into slices
-  // of 512B each.
+  // of state.range(0) bytes each (0 = a single slice per packet).
   Slices slices;
-  static constexpr size_t kSliceSize = 512;
+  const size_t max_slice_size =
+      state.range(0) ? static_cast<size_t>(state.range(0)) : buf.size();
   for (size_t num_packets = 0; num_packets < 10; num_packets++) {
-    for (size_t pos = 0; pos < buf.size(); pos += kSliceSize) {
-      size_t slice_size = std::min(kSliceSize, buf.size() - pos);
+    for (size_t pos = 0; pos < buf.size(); pos += max_slice_size) {
+      size_t slice_size = std::min(max_slice_size, buf.size() - pos);
       Slice slice = Slice::Allocate(slice_size);
       memcpy(slice.own_data(), &buf[pos], slice_size);
       slices.emplace_back(std::move(slice));
@@ -70,4 +71,4 @@ static void BM_PacketStreamValidator(benchmark::State& state) {
 
 }  // namespace
 
-BENCHMARK(BM_PacketStreamValidator);
+BENCHMARK(BM_PacketStreamValidator)->Arg(0)->Arg(512);
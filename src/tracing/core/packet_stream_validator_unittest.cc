@@ -129,6 +129,29 @@ TEST(PacketStreamValidatorTest, FragmentedPacket) {
   }
 }
 
+TEST(PacketStreamValidatorTest, ProcessFragmentOneByteAtATime) {
+  protos::gen::TracePacket proto;
+  proto.mutable_for_testing()->set_str("string field");
+  proto.set_timestamp(1000ull * 1000 * 1000 * 3600);
+  proto.mutable_ftrace_events()->set_cpu(0);
+  auto* ft = proto.mutable_ftrace_events()->add_event();
+  ft->set_pid(42);
+  ft->mutable_sched_switch()->set_prev_comm("tom");
+  std::string ser_buf = proto.SerializeAsString();
+
+  PacketStreamValidator validator;
+  for (size_t i = 0; i < ser_buf.size(); i++)
+    validator.ProcessFragment(reinterpret_cast<const uint8_t*>(&ser_buf[i]), 1);
+  EXPECT_TRUE(validator.Finish());
+
+  proto.set_trusted_uid(123);
+  ser_buf = proto.SerializeAsString();
+  validator.Reset();
+  for (size_t i = 0; i < ser_buf.size(); i++)
+    validator.ProcessFragment(reinterpret_cast<const uint8_t*>(&ser_buf[i]), 1);
+  EXPECT_FALSE(validator.Finish());
+}
+
 TEST(PacketStreamValidatorTest, FragmentedPacketWithUid) {
   protos::gen::TracePacket proto;
   proto.mutable_for_testing()->set_str("string field");
@@ -47,6 +47,22 @@ MaybeUnboundBufferID MakeTargetBufferIdForReservation(uint16_t reservation_id) {
 bool IsReservationTargetBufferId(MaybeUnboundBufferID buffer_id) {
   return (buffer_id >> 16) > 0;
 }
+
+// Wraps the callbacks in |callbacks| (if any) into a single std::function and
+// clears the list.
+std::function<void()> TakeFlushCallbacks(
+    std::vector<std::function<void()>>* callbacks) {
+  if (callbacks->empty())
+    return std::function<void()>();
+
+  std::vector<std::function<void()>> taken_callbacks;
+  taken_callbacks.swap(*callbacks);
+  // Capture the callback list into the lambda by copy.
+  return [taken_callbacks]() {
+    for (auto& callback : taken_callbacks)
+      callback();
+  };
+}
 }  // namespace
 
 // static
@@ -105,10 +121,19 @@ Chunk SharedMemoryArbiterImpl::GetNewChunk(
   static const int kFlushCommitsAfterEveryNStalls = 2;
   static const int kAssertAtNStalls = 200;
 
+  // Fastpath: acquire a free chunk without taking |lock_|, which is heavily
+  // contended when many threads write at the same time. This is safe because
+  // SharedMemoryABI chunk and page state transitions are atomic (the service
+  // frees chunks concurrently anyway). Skip it when a synchronous commit might
+  // be due, see |should_commit_synchronously| below.
+  if (bytes_pending_commit_.load(std::memory_order_relaxed) <
+      shmem_abi_.size() / 2) {
+    Chunk chunk = TryAcquireFreeChunk(header);
+    if (chunk.is_valid())
+      return chunk;
+  }
+
   for (;;) {
-    // TODO(primiano): Probably this lock is not really required and this code
-    // could be rewritten leveraging only the Try* atomic operations in
-    // SharedMemoryABI. But let's not be too adventurous for the moment.
     {
       std::unique_lock<std::mutex> scoped_lock(lock_);
 
@@ -136,50 +161,31 @@ Chunk SharedMemoryArbiterImpl::GetNewChunk(
       bool should_commit_synchronously =
           task_runner_runs_on_current_thread &&
           buffer_exhausted_policy == BufferExhaustedPolicy::kStall &&
-          commit_data_req_ && bytes_pending_commit_ >= shmem_abi_.size() / 2;
-
-      const size_t initial_page_idx = page_idx_;
-      for (size_t i = 0; i < shmem_abi_.num_pages(); i++) {
-        page_idx_ = (initial_page_idx + i) % shmem_abi_.num_pages();
-        bool is_new_page = false;
-
-        // TODO(primiano): make the page layout dynamic.
-        auto layout = SharedMemoryArbiterImpl::default_page_layout;
-
-        if (shmem_abi_.is_page_free(page_idx_)) {
-          // TODO(primiano): Use the |size_hint| here to decide the layout.
-          is_new_page = shmem_abi_.TryPartitionPage(page_idx_, layout);
-        }
-        uint32_t free_chunks;
-        if (is_new_page) {
-          free_chunks = (1 << SharedMemoryABI::kNumChunksForLayout[layout]) - 1;
-        } else {
-          free_chunks = shmem_abi_.GetFreeChunks(page_idx_);
+          commit_data_req_ &&
+          bytes_pending_commit_.load(std::memory_order_relaxed) >=
+              shmem_abi_.size() / 2;
+
+      Chunk chunk = TryAcquireFreeChunk(header);
+      if (chunk.is_valid()) {
+        if (stall_count > kLogAfterNStalls) {
+          PERFETTO_LOG("Recovered from stall after %d iterations",
+                       stall_count);
         }
 
-        for (uint32_t chunk_idx = 0; free_chunks;
-             chunk_idx++, free_chunks >>= 1) {
-          if (!(free_chunks & 1))
-            continue;
-          // We found a free chunk.
-          Chunk chunk = shmem_abi_.TryAcquireChunkForWriting(
-              page_idx_, chunk_idx, &header);
-          if (!chunk.is_valid())
-            continue;
-          if (stall_count > kLogAfterNStalls) {
-            PERFETTO_LOG("Recovered from stall after %d iterations",
-                         stall_count);
-          }
-
-          if (should_commit_synchronously) {
-            // We can't flush while holding the lock.
-            scoped_lock.unlock();
-            FlushPendingCommitDataRequests();
-            return chunk;
-          } else {
-            return chunk;
-          }
+        if (should_commit_synchronously) {
+          // We can't flush while holding the lock.
+          scoped_lock.unlock();
+          FlushPendingCommitDataRequests();
         }
+        return chunk;
+      }
+
+      // The SMB is exhausted. Keep track of it so that the service can report
+      // it in TraceStats, see CommitDataRequest.smb_stalls.
+      if (buffer_exhausted_policy == BufferExhaustedPolicy::kDrop) {
+        smb_drops_++;
+      } else if (stall_count == 0) {
+        smb_stalls_++;
       }
     }  // scoped_lock
 
@@ -231,6 +237,46 @@ Chunk SharedMemoryArbiterImpl::GetNewChunk(
   }
 }
 
+Chunk SharedMemoryArbiterImpl::TryAcquireFreeChunk(
+    const SharedMemoryABI::ChunkHeader& header) {
+  const size_t num_pages = shmem_abi_.num_pages();
+  const size_t initial_page_idx = page_idx_.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < num_pages; i++) {
+    const size_t page_idx = (initial_page_idx + i) % num_pages;
+    bool is_new_page = false;
+
+    // TODO(primiano): make the page layout dynamic.
+    auto layout = SharedMemoryArbiterImpl::default_page_layout;
+
+    if (shmem_abi_.is_page_free(page_idx)) {
+      // TODO(primiano): Use the |size_hint| here to decide the layout.
+      is_new_page = shmem_abi_.TryPartitionPage(page_idx, layout);
+    }
+    uint32_t free_chunks;
+    if (is_new_page) {
+      free_chunks = (1 << SharedMemoryABI::kNumChunksForLayout[layout]) - 1;
+    } else {
+      free_chunks = shmem_abi_.GetFreeChunks(page_idx);
+    }
+
+    for (uint32_t chunk_idx = 0; free_chunks; chunk_idx++, free_chunks >>= 1) {
+      if (!(free_chunks & 1))
+        continue;
+      // We found a free chunk. Acquiring it can still fail if another thread
+      // got it first.
+      Chunk chunk =
+          shmem_abi_.TryAcquireChunkForWriting(page_idx, chunk_idx, &header);
+      if (!chunk.is_valid())
+        continue;
+      page_idx_.store(page_idx, std::memory_order_relaxed);
+      return chunk;
+    }
+  }
+  page_idx_.store((initial_page_idx + num_pages - 1) % num_pages,
+                  std::memory_order_relaxed);
+  return Chunk();
+}
+
 void SharedMemoryArbiterImpl::ReturnCompletedChunk(
     Chunk chunk,
     MaybeUnboundBufferID target_buffer,
@@ -279,7 +325,7 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
     if (chunk.is_valid()) {
       PERFETTO_DCHECK(chunk.writer_id() == writer_id);
       uint8_t chunk_idx = chunk.chunk_idx();
-      bytes_pending_commit_ += chunk.size();
+      bytes_pending_commit_.fetch_add(chunk.size(), std::memory_order_relaxed);
       size_t page_idx;
 
       ctm = commit_data_req_->add_chunks_to_move();
@@ -363,7 +409,9 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
     // service will not know of the patch and won't be able to reconstruct the
     // trace.
     if (fully_bound_ &&
-        (last_patch_req || bytes_pending_commit_ >= shmem_abi_.size() / 2)) {
+        (last_patch_req || bytes_pending_commit_.load(
+                               std::memory_order_relaxed) >=
+                               shmem_abi_.size() / 2)) {
       weak_this = weak_ptr_factory_.GetWeakPtr();
       task_runner_to_post_delayed_callback_on = task_runner_;
       flush_delay_ms = 0;
@@ -507,14 +555,31 @@ void SharedMemoryArbiterImpl::FlushPendingCommitDataRequests(
     // May be called by TraceWriterImpl on any thread.
     base::TaskRunner* task_runner = task_runner_;
     if (!task_runner->RunsTasksOnCurrentThread()) {
+      // Coalesce the flushes requested by other threads (e.g. several
+      // TraceWriters flushing at the same time) into a single posted task,
+      // and thus a single CommitData IPC that acks all their callbacks.
+      if (callback)
+        posted_flush_callbacks_.push_back(std::move(callback));
+      if (flush_task_posted_)
+        return;
+      flush_task_posted_ = true;
+
       // We shouldn't post a task while holding a lock. |task_runner| remains
       // valid after unlocking, because |task_runner_| is never reset.
       scoped_lock.unlock();
 
       auto weak_this = weak_ptr_factory_.GetWeakPtr();
-      task_runner->PostTask([weak_this, callback] {
-        if (weak_this)
-          weak_this->FlushPendingCommitDataRequests(std::move(callback));
+      task_runner->PostTask([weak_this] {
+        if (!weak_this)
+          return;
+        std::function<void()> posted_callbacks;
+        {
+          std::lock_guard<std::mutex> lock(weak_this->lock_);
+          weak_this->flush_task_posted_ = false;
+          posted_callbacks =
+              TakeFlushCallbacks(&weak_this->posted_flush_callbacks_);
+        }
+        weak_this->FlushPendingCommitDataRequests(std::move(posted_callbacks));
       });
       return;
     }
@@ -562,8 +627,13 @@ void SharedMemoryArbiterImpl::FlushPendingCommitDataRequests(
         }
       }
 
+      if (smb_stalls_)
+        commit_data_req_->set_smb_stalls(smb_stalls_);
+      if (smb_drops_)
+        commit_data_req_->set_smb_drops(smb_drops_);
+
       req = std::move(commit_data_req_);
-      bytes_pending_commit_ = 0;
+      bytes_pending_commit_.store(0, std::memory_order_relaxed);
     }
   }  // scoped_lock
 
@@ -751,16 +821,7 @@ void SharedMemoryArbiterImpl::BindStartupTargetBufferImpl(
 
 std::function<void()>
 SharedMemoryArbiterImpl::TakePendingFlushCallbacksLocked() {
-  if (pending_flush_callbacks_.empty())
-    return std::function<void()>();
-
-  std::vector<std::function<void()>> pending_flush_callbacks;
-  pending_flush_callbacks.swap(pending_flush_callbacks_);
-  // Capture the callback list into the lambda by copy.
-  return [pending_flush_callbacks]() {
-    for (auto& callback : pending_flush_callbacks)
-      callback();
-  };
+  return TakeFlushCallbacks(&pending_flush_callbacks_);
 }
 
 void SharedMemoryArbiterImpl::NotifyFlushComplete(FlushRequestID req_id) {
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
@@ -235,6 +236,13 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
       MaybeUnboundBufferID target_buffer,
       BufferExhaustedPolicy);
 
+  // Scans the pages of the SMB, starting from |page_idx_|, for a free chunk
+  // and acquires it for writing. Returns an invalid chunk if there are none.
+  // This relies only on the atomic operations of SharedMemoryABI and can be
+  // called without holding |lock_|.
+  SharedMemoryABI::Chunk TryAcquireFreeChunk(
+      const SharedMemoryABI::ChunkHeader&);
+
   // Called by the TraceWriter destructor.
   void ReleaseWriterID(WriterID);
 
@@ -269,9 +277,16 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
 
   base::TaskRunner* task_runner_ = nullptr;
   SharedMemoryABI shmem_abi_;
-  size_t page_idx_ = 0;
   std::unique_ptr<CommitDataRequest> commit_data_req_;
-  size_t bytes_pending_commit_ = 0;  // SUM(chunk.size() : commit_data_req_).
+
+  // SUM(chunk.size() : commit_data_req_). Written only while holding |lock_|,
+  // but GetNewChunk() reads it also without holding it.
+  std::atomic<size_t> bytes_pending_commit_{0};
+
+  // The page where the next GetNewChunk() starts looking for free chunks. This
+  // is only a hint, it is read and written also without holding |lock_|.
+  std::atomic<size_t> page_idx_{0};
+
   IdAllocator<WriterID> active_writer_ids_;
   bool did_shutdown_ = false;
 
@@ -297,6 +312,12 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   // reservation was unbound.
   std::vector<std::function<void()>> pending_flush_callbacks_;
 
+  // Callbacks for flush requests issued on other threads than |task_runner_|,
+  // waiting for the posted flush task. Only one such task is posted at a time
+  // (|flush_task_posted_|): it commits on behalf of all of them.
+  std::vector<std::function<void()>> posted_flush_callbacks_;
+  bool flush_task_posted_ = false;
+
   // See SharedMemoryArbiter::SetBatchCommitsDuration.
   uint32_t batch_commits_duration_ms_ = 0;
 
@@ -315,6 +336,12 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   // batching period.
   bool delayed_flush_scheduled_ = false;
 
+  // Number of times GetNewChunk() found the SMB exhausted, for kStall and
+  // kDrop writers respectively. A stall is counted once, regardless of how many
+  // times the writer retries before getting a chunk.
+  uint64_t smb_stalls_ = 0;
+  uint64_t smb_drops_ = 0;
+
   // Stores target buffer reservations for writers created via
   // CreateStartupTraceWriter(). A bound reservation sets
   // TargetBufferReservation::resolved to true and is associated with the actual
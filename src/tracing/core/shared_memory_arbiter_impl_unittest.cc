@@ -17,6 +17,10 @@
 #include "src/tracing/core/shared_memory_arbiter_impl.h"
 
 #include <bitset>
+#include <set>
+#include <thread>
+#include <vector>
+
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "perfetto/ext/tracing/core/commit_data_request.h"
@@ -362,6 +366,71 @@ TEST_P(SharedMemoryArbiterImplTest, BufferExhaustedPolicyDrop) {
   ASSERT_TRUE(chunks[0].is_valid());
 }
 
+// Multiple threads acquiring chunks concurrently (which can happen without
+// holding the arbiter lock) must never be handed out the same chunk.
+TEST_P(SharedMemoryArbiterImplTest, ConcurrentGetNewChunk) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv14);
+  static constexpr size_t kNumThreads = 7;
+  static constexpr size_t kChunksPerThread = kNumPages * 14 / kNumThreads;
+  std::vector<SharedMemoryABI::Chunk> chunks[kNumThreads];
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([this, &chunks, t] {
+      for (size_t i = 0; i < kChunksPerThread; i++) {
+        chunks[t].push_back(
+            arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDrop));
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  std::set<uint8_t*> chunk_begins;
+  for (size_t t = 0; t < kNumThreads; t++) {
+    for (const auto& chunk : chunks[t]) {
+      ASSERT_TRUE(chunk.is_valid());
+      EXPECT_TRUE(chunk_begins.insert(chunk.begin()).second);
+    }
+  }
+  EXPECT_EQ(kNumPages * 14, chunk_begins.size());
+
+  // The SMB is now exhausted.
+  EXPECT_FALSE(
+      arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDrop).is_valid());
+}
+
+// Flushes requested by other threads before the posted flush task runs are
+// coalesced into a single CommitData that acks all of them.
+TEST_P(SharedMemoryArbiterImplTest, CoalesceFlushesFromOtherThreads) {
+  SharedMemoryABI::Chunk chunk =
+      arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDefault);
+  ASSERT_TRUE(chunk.is_valid());
+  arbiter_->SetBatchCommitsDuration(UINT32_MAX);
+  PatchList ignored;
+  arbiter_->ReturnCompletedChunk(std::move(chunk), 1, &ignored);
+
+  static constexpr size_t kNumThreads = 4;
+  std::vector<size_t> flushed;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([this, &flushed, t] {
+      arbiter_->FlushPendingCommitDataRequests(
+          [&flushed, t] { flushed.push_back(t); });
+    });
+    threads.back().join();
+  }
+
+  EXPECT_CALL(mock_producer_endpoint_, CommitData(_, _))
+      .WillOnce(Invoke([](const CommitDataRequest& req,
+                          MockProducerEndpoint::CommitDataCallback callback) {
+        EXPECT_EQ(1, req.chunks_to_move_size());
+        callback();
+      }));
+  task_runner_->RunUntilIdle();
+  EXPECT_THAT(flushed, testing::ElementsAre(0u, 1u, 2u, 3u));
+}
+
 TEST_P(SharedMemoryArbiterImplTest, CreateUnboundAndBind) {
   auto checkpoint_writer = task_runner_->CreateCheckpoint("writer_registered");
   auto checkpoint_flush = task_runner_->CreateCheckpoint("flush_completed");
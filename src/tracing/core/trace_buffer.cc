@@ -16,7 +16,9 @@
 
 #include "src/tracing/core/trace_buffer.h"
 
+#include <algorithm>
 #include <limits>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/utils.h"
@@ -60,7 +62,21 @@ TraceBuffer::TraceBuffer(OverwritePolicy pol) : overwrite_policy_(pol) {
                 "ChunkRecord out of sync with the layout of SharedMemoryABI");
 }
 
-TraceBuffer::~TraceBuffer() = default;
+TraceBuffer::~TraceBuffer() {
+  // The clones still sharing pages with this buffer need their own copy now.
+  std::vector<TraceBuffer*> clones = std::move(cow_clones_);
+  cow_clones_.clear();
+  for (TraceBuffer* clone : clones) {
+    clone->CopyPagesFromSource(0, size_);
+    clone->cow_source_ = nullptr;
+  }
+  if (cow_source_) {
+    auto& source_clones = cow_source_->cow_clones_;
+    source_clones.erase(
+        std::remove(source_clones.begin(), source_clones.end(), this),
+        source_clones.end());
+  }
+}
 
 bool TraceBuffer::Initialize(size_t size) {
   static_assert(
@@ -69,7 +85,8 @@ bool TraceBuffer::Initialize(size_t size) {
   auto max_size = std::numeric_limits<decltype(ChunkMeta::record_off)>::max();
   PERFETTO_CHECK(size <= static_cast<size_t>(max_size));
   data_ = base::PagedMemory::Allocate(
-      size, base::PagedMemory::kMayFail | base::PagedMemory::kDontCommit);
+      size, base::PagedMemory::kMayFail | base::PagedMemory::kDontCommit |
+                base::PagedMemory::kHugePages);
   if (!data_.IsValid()) {
     PERFETTO_ELOG("Trace buffer allocation failed (size: %zu)", size);
     return false;
@@ -79,7 +96,6 @@ bool TraceBuffer::Initialize(size_t size) {
   max_chunk_size_ = std::min(size, ChunkRecord::kMaxSize);
   wptr_ = begin();
   index_.clear();
-  last_chunk_id_written_.clear();
   read_iter_ = GetReadIterForSequence(index_.end());
   return true;
 }
@@ -142,9 +158,12 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // before receiving commit requests for them from the producer. Note that the
   // service may scrape and thus override chunks in arbitrary order since the
   // chunks aren't ordered in the SMB.
-  const auto it = index_.find(key);
-  if (PERFETTO_UNLIKELY(it != index_.end())) {
-    ChunkMeta* record_meta = &it->second;
+  const ProducerAndWriterID producer_and_writer_id =
+      MkProducerAndWriterID(producer_id_trusted, writer_id);
+  auto seq_it = index_.find(producer_and_writer_id);
+  ChunkMeta* record_meta =
+      seq_it != index_.end() ? seq_it->second.Find(chunk_id) : nullptr;
+  if (PERFETTO_UNLIKELY(record_meta)) {
     ChunkRecord* prev = GetChunkRecordAt(begin() + record_meta->record_off);
 
     // Verify that the old chunk's metadata corresponds to the new one.
@@ -176,13 +195,11 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
     // chunk N after having read from chunk N+1, thereby violating sequential
     // read of packets. This shouldn't happen if the producer is well-behaved,
     // because it shouldn't start chunk N+1 before completing chunk N.
-    ChunkMeta::Key subsequent_key = key;
     static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                   "ChunkID wraps");
-    subsequent_key.chunk_id++;
-    const auto subsequent_it = index_.find(subsequent_key);
-    if (subsequent_it != index_.end() &&
-        subsequent_it->second.num_fragments_read > 0) {
+    const ChunkMeta* subsequent_meta =
+        seq_it->second.Find(static_cast<ChunkID>(chunk_id + 1));
+    if (subsequent_meta && subsequent_meta->num_fragments_read > 0) {
       stats_.set_abi_violations(stats_.abi_violations() + 1);
       PERFETTO_DCHECK(suppress_client_dchecks_for_testing_);
       return;
@@ -261,11 +278,15 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   stats_.set_chunks_written(stats_.chunks_written() + 1);
   stats_.set_bytes_written(stats_.bytes_written() + record_size);
 
+  // DeleteNextChunksFor() never removes sequences from the index, so |seq_it|
+  // is still valid here.
+  if (seq_it == index_.end())
+    seq_it = index_.emplace(producer_and_writer_id, ChunkSequence()).first;
+  ChunkSequence& sequence = seq_it->second;
   uint32_t chunk_off = GetOffset(GetChunkRecordAt(wptr_));
-  auto it_and_inserted = index_.emplace(
-      key, ChunkMeta(chunk_off, num_fragments, chunk_complete, chunk_flags,
-                     producer_uid_trusted, producer_pid_trusted));
-  PERFETTO_DCHECK(it_and_inserted.second);
+  sequence.Insert(ChunkMeta(chunk_id, chunk_off, num_fragments, chunk_complete,
+                            chunk_flags, producer_uid_trusted,
+                            producer_pid_trusted));
   TRACE_BUFFER_DLOG("  copying @ [%" PRIdPTR " - %" PRIdPTR "] %zu", wptr_ - begin(),
                     uintptr_t(wptr_ - begin()) + record_size, record_size);
   WriteChunkRecord(wptr_, record, src, size);
@@ -290,8 +311,7 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // last_chunk_id shouldn't be updated even though it's larger (e.g. |chunk_id|
   // = kMaxChunkId and |last_chunk_id| = 1; chunk_id - last_chunk_id =
   // kMaxChunkId - 1).
-  auto producer_and_writer_id = std::make_pair(producer_id_trusted, writer_id);
-  ChunkID& last_chunk_id = last_chunk_id_written_[producer_and_writer_id];
+  ChunkID& last_chunk_id = sequence.last_chunk_id_written;
   static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                 "This code assumes that ChunkID wraps at kMaxChunkID");
   if (chunk_id - last_chunk_id < kMaxChunkID / 2) {
@@ -316,7 +336,7 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
   TRACE_BUFFER_DLOG("Delete [%zu %zu]", wptr_ - begin(), search_end - begin());
   DcheckIsAlignedAndWithinBounds(wptr_);
   PERFETTO_DCHECK(search_end <= end());
-  std::vector<ChunkMap::iterator> index_delete;
+  std::vector<std::pair<ChunkSequence*, ChunkID>> index_delete;
   uint64_t chunks_overwritten = stats_.chunks_overwritten();
   uint64_t bytes_overwritten = stats_.bytes_overwritten();
   uint64_t padding_bytes_cleared = stats_.padding_bytes_cleared();
@@ -342,17 +362,20 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
     // records are not part of the index).
     if (PERFETTO_LIKELY(!next_chunk.is_padding)) {
       ChunkMeta::Key key(next_chunk);
-      auto it = index_.find(key);
+      auto seq_it = index_.find(
+          MkProducerAndWriterID(key.producer_id, key.writer_id));
+      const ChunkMeta* meta = seq_it != index_.end()
+                                  ? seq_it->second.Find(key.chunk_id)
+                                  : nullptr;
       bool will_remove = false;
-      if (PERFETTO_LIKELY(it != index_.end())) {
-        const ChunkMeta& meta = it->second;
-        if (PERFETTO_UNLIKELY(meta.num_fragments_read < meta.num_fragments)) {
+      if (PERFETTO_LIKELY(meta)) {
+        if (PERFETTO_UNLIKELY(meta->num_fragments_read < meta->num_fragments)) {
           if (overwrite_policy_ == kDiscard)
             return -1;
           chunks_overwritten++;
           bytes_overwritten += next_chunk.size;
         }
-        index_delete.push_back(it);
+        index_delete.emplace_back(&seq_it->second, key.chunk_id);
         will_remove = true;
       }
       TRACE_BUFFER_DLOG(
@@ -375,8 +398,8 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
   }
 
   // Remove from the index.
-  for (auto it : index_delete) {
-    index_.erase(it);
+  for (const auto& seq_and_chunk_id : index_delete) {
+    seq_and_chunk_id.first->Erase(seq_and_chunk_id.second);
   }
   stats_.set_chunks_overwritten(chunks_overwritten);
   stats_.set_bytes_overwritten(bytes_overwritten);
@@ -405,12 +428,14 @@ bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
                                         bool other_patches_pending) {
   PERFETTO_CHECK(!read_only_);
   ChunkMeta::Key key(producer_id, writer_id, chunk_id);
-  auto it = index_.find(key);
-  if (it == index_.end()) {
+  auto seq_it = index_.find(MkProducerAndWriterID(producer_id, writer_id));
+  ChunkMeta* chunk_meta_ptr =
+      seq_it != index_.end() ? seq_it->second.Find(chunk_id) : nullptr;
+  if (!chunk_meta_ptr) {
     stats_.set_patches_failed(stats_.patches_failed() + 1);
     return false;
   }
-  ChunkMeta& chunk_meta = it->second;
+  ChunkMeta& chunk_meta = *chunk_meta_ptr;
 
   // Check that the index is consistent with the actual ProducerID/WriterID
   // stored in the ChunkRecord.
@@ -443,6 +468,7 @@ bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
       return false;
     }
 
+    CopyPagesToClones(ptr, Patch::kSize);
     memcpy(ptr, &patches[i].data[0], Patch::kSize);
   }
   TRACE_BUFFER_DLOG("Chunk raw (after patch): %s",
@@ -464,42 +490,20 @@ void TraceBuffer::BeginRead() {
 }
 
 TraceBuffer::SequenceIterator TraceBuffer::GetReadIterForSequence(
-    ChunkMap::iterator seq_begin) {
+    ChunkMap::iterator seq) {
   SequenceIterator iter;
-  iter.seq_begin = seq_begin;
-  if (seq_begin == index_.end()) {
-    iter.cur = iter.seq_end = index_.end();
+  iter.seq = seq;
+  if (seq == index_.end())
     return iter;
-  }
 
-#if PERFETTO_DCHECK_IS_ON()
-  // Either |seq_begin| is == index_.begin() or the item immediately before must
-  // belong to a different {ProducerID, WriterID} sequence.
-  if (seq_begin != index_.begin() && seq_begin != index_.end()) {
-    auto prev_it = seq_begin;
-    prev_it--;
-    PERFETTO_DCHECK(
-        seq_begin == index_.begin() ||
-        std::tie(prev_it->first.producer_id, prev_it->first.writer_id) <
-            std::tie(seq_begin->first.producer_id, seq_begin->first.writer_id));
-  }
-#endif
+  ChunkSequence& sequence = seq->second;
+  iter.seq_begin = sequence.begin();
+  iter.seq_end = sequence.end();
 
-  // Find the first entry that has a greater {ProducerID, WriterID} (or just
-  // index_.end() if we reached the end).
-  ChunkMeta::Key key = seq_begin->first;  // Deliberate copy.
-  key.chunk_id = kMaxChunkID;
-  iter.seq_end = index_.upper_bound(key);
-  PERFETTO_DCHECK(iter.seq_begin != iter.seq_end);
-
-  // Now find the first entry between [seq_begin, seq_end) that is
-  // > last_chunk_id_written_. This is where we the sequence will start (see
-  // notes about wrapping of IDs in the header).
-  auto producer_and_writer_id = std::make_pair(key.producer_id, key.writer_id);
-  PERFETTO_DCHECK(last_chunk_id_written_.count(producer_and_writer_id));
-  iter.wrapping_id = last_chunk_id_written_[producer_and_writer_id];
-  key.chunk_id = iter.wrapping_id;
-  iter.cur = index_.upper_bound(key);
+  // Now find the first chunk that is > last_chunk_id_written. This is where
+  // the sequence will start (see notes about wrapping of IDs in the header).
+  iter.wrapping_id = sequence.last_chunk_id_written;
+  iter.cur = sequence.UpperBound(iter.wrapping_id);
   if (iter.cur == iter.seq_end)
     iter.cur = iter.seq_begin;
   return iter;
@@ -508,33 +512,88 @@ TraceBuffer::SequenceIterator TraceBuffer::GetReadIterForSequence(
 void TraceBuffer::SequenceIterator::MoveNext() {
   // Stop iterating when we reach the end of the sequence.
   // Note: |seq_begin| might be == |seq_end|.
-  if (cur == seq_end || cur->first.chunk_id == wrapping_id) {
+  if (cur == seq_end || cur->chunk_id == wrapping_id) {
     cur = seq_end;
     return;
   }
 
   // If the current chunk wasn't completed yet, we shouldn't advance past it as
   // it may be rewritten with additional packets.
-  if (!cur->second.is_complete()) {
+  if (!cur->is_complete()) {
     cur = seq_end;
     return;
   }
 
-  ChunkID last_chunk_id = cur->first.chunk_id;
+  ChunkID last_chunk_id = cur->chunk_id;
   if (++cur == seq_end)
     cur = seq_begin;
 
   // There may be a missing chunk in the sequence of chunks, in which case the
   // next chunk's ID won't follow the last one's. If so, skip the rest of the
   // sequence. We'll return to it later once the hole is filled.
-  if (last_chunk_id + 1 != cur->first.chunk_id)
+  if (last_chunk_id + 1 != cur->chunk_id)
     cur = seq_end;
 }
 
+TraceBuffer::ChunkMeta* TraceBuffer::ChunkSequence::Find(ChunkID chunk_id) {
+  // Most lookups are for the oldest chunk (when overwriting) or the newest one
+  // (when re-committing or patching), check those before bisecting.
+  if (empty())
+    return nullptr;
+  if (begin()->chunk_id == chunk_id)
+    return begin();
+  if ((end() - 1)->chunk_id == chunk_id)
+    return end() - 1;
+  ChunkMeta* it = std::lower_bound(
+      begin(), end(), chunk_id,
+      [](const ChunkMeta& meta, ChunkID id) { return meta.chunk_id < id; });
+  return it != end() && it->chunk_id == chunk_id ? it : nullptr;
+}
+
+TraceBuffer::ChunkMeta* TraceBuffer::ChunkSequence::UpperBound(
+    ChunkID chunk_id) {
+  if (empty() || (end() - 1)->chunk_id <= chunk_id)
+    return end();
+  return std::upper_bound(
+      begin(), end(), chunk_id,
+      [](ChunkID id, const ChunkMeta& meta) { return id < meta.chunk_id; });
+}
+
+TraceBuffer::ChunkMeta* TraceBuffer::ChunkSequence::Insert(
+    const ChunkMeta& chunk_meta) {
+  if (PERFETTO_LIKELY(empty() || (end() - 1)->chunk_id < chunk_meta.chunk_id)) {
+    chunks_.push_back(chunk_meta);
+    return &chunks_.back();
+  }
+  ChunkMeta* pos = UpperBound(chunk_meta.chunk_id);
+  PERFETTO_DCHECK(pos == begin() || (pos - 1)->chunk_id != chunk_meta.chunk_id);
+  auto it = chunks_.insert(chunks_.begin() + (pos - chunks_.data()), chunk_meta);
+  return &*it;
+}
+
+void TraceBuffer::ChunkSequence::Erase(ChunkID chunk_id) {
+  ChunkMeta* chunk_meta = Find(chunk_id);
+  PERFETTO_DCHECK(chunk_meta);
+  if (PERFETTO_UNLIKELY(chunk_meta != begin())) {
+    chunks_.erase(chunks_.begin() + (chunk_meta - chunks_.data()));
+    return;
+  }
+  first_++;
+  if (first_ == chunks_.size()) {
+    chunks_.clear();
+    first_ = 0;
+  } else if (first_ >= chunks_.size() / 2) {
+    chunks_.erase(chunks_.begin(),
+                  chunks_.begin() + static_cast<ptrdiff_t>(first_));
+    first_ = 0;
+  }
+}
+
 bool TraceBuffer::ReadNextTracePacket(
     TracePacket* packet,
     PacketSequenceProperties* sequence_properties,
-    bool* previous_packet_on_sequence_dropped) {
+    bool* previous_packet_on_sequence_dropped,
+    bool* packet_is_valid) {
   // Note: MoveNext() moves only within the next chunk within the same
   // {ProducerID, WriterID} sequence. Here we want to:
   // - return the next patched+complete packet in the current sequence, if any.
@@ -560,15 +619,17 @@ bool TraceBuffer::ReadNextTracePacket(
       // We ran out of chunks in the current {ProducerID, WriterID} sequence or
       // we just reached the index_.end().
 
-      if (PERFETTO_UNLIKELY(read_iter_.seq_end == index_.end()))
+      if (PERFETTO_UNLIKELY(read_iter_.seq == index_.end()))
         return false;
 
       // We reached the end of sequence, move to the next one.
-      // Note: ++read_iter_.seq_end might become index_.end(), but
-      // GetReadIterForSequence() knows how to deal with that.
-      read_iter_ = GetReadIterForSequence(read_iter_.seq_end);
-      PERFETTO_DCHECK(read_iter_.is_valid() && read_iter_.cur != index_.end());
+      // Note: ++read_iter_.seq might become index_.end(), but
+      // GetReadIterForSequence() knows how to deal with that. Sequences whose
+      // chunks have all been overwritten have no chunks, skip them too.
+      read_iter_ = GetReadIterForSequence(std::next(read_iter_.seq));
       previous_packet_dropped = true;
+      if (!read_iter_.is_valid())
+        continue;
     }
 
     ChunkMeta* chunk_meta = &*read_iter_;
@@ -580,10 +641,12 @@ bool TraceBuffer::ReadNextTracePacket(
       continue;
     }
 
-    const ProducerID trusted_producer_id = read_iter_.producer_id();
-    const WriterID writer_id = read_iter_.writer_id();
     const ProducerAndWriterID producer_and_writer_id =
-        MkProducerAndWriterID(trusted_producer_id, writer_id);
+        read_iter_.producer_and_writer_id();
+    ProducerID trusted_producer_id;
+    WriterID writer_id;
+    GetProducerAndWriterID(producer_and_writer_id, &trusted_producer_id,
+                           &writer_id);
     const uid_t trusted_uid = chunk_meta->trusted_uid;
     const pid_t trusted_pid = chunk_meta->trusted_pid;
 
@@ -663,6 +726,8 @@ bool TraceBuffer::ReadNextTracePacket(
           *sequence_properties = {trusted_producer_id, trusted_uid, trusted_pid,
                                   writer_id};
           *previous_packet_on_sequence_dropped = previous_packet_dropped;
+          if (packet_is_valid)
+            *packet_is_valid = packet_validator_.Finish();
           return true;
         } else if (result == ReadPacketResult::kFailedEmptyPacket) {
           // We can ignore and skip empty packets.
@@ -689,6 +754,8 @@ bool TraceBuffer::ReadNextTracePacket(
         *sequence_properties = {trusted_producer_id, trusted_uid, trusted_pid,
                                 writer_id};
         *previous_packet_on_sequence_dropped = previous_packet_dropped;
+        if (packet_is_valid)
+          *packet_is_valid = packet_validator_.Finish();
         return true;
       }
 
@@ -728,8 +795,7 @@ TraceBuffer::ReadAheadResult TraceBuffer::ReadAhead(TracePacket* packet) {
   SequenceIterator it = read_iter_;
   for (it.MoveNext(); it.is_valid(); it.MoveNext(), next_chunk_id++) {
     // We should stay within the same sequence while iterating here.
-    PERFETTO_DCHECK(it.producer_id() == read_iter_.producer_id() &&
-                    it.writer_id() == read_iter_.writer_id());
+    PERFETTO_DCHECK(it.seq == read_iter_.seq);
 
     TRACE_BUFFER_DLOG("   expected chunk ID: %u, actual ID: %u", next_chunk_id,
                       it.chunk_id());
@@ -778,7 +844,7 @@ TraceBuffer::ReadAheadResult TraceBuffer::ReadAhead(TracePacket* packet) {
         // In the unlikely case of a corrupted packet (corrupted or empty
         // fragment), invalidate the all stitching and move on to the next chunk
         // in the same sequence, if any.
-        auto pw_id = MkProducerAndWriterID(it.producer_id(), it.writer_id());
+        auto pw_id = it.producer_and_writer_id();
         packet_corruption |=
             ReadNextPacketInChunk(pw_id, &*read_iter_, packet) ==
             ReadPacketResult::kFailedInvalidPacket;
@@ -807,8 +873,7 @@ TraceBuffer::ReadPacketResult TraceBuffer::ReadNextPacketInChunk(
   PERFETTO_DCHECK(chunk_meta->num_fragments_read < chunk_meta->num_fragments);
   PERFETTO_DCHECK(!(chunk_meta->flags & kChunkNeedsPatching));
 
-  const uint8_t* record_begin = begin() + chunk_meta->record_off;
-  DcheckIsAlignedAndWithinBounds(record_begin);
+  const uint8_t* record_begin = GetChunkRecordForRead(chunk_meta->record_off);
   auto* chunk_record = reinterpret_cast<const ChunkRecord*>(record_begin);
   const uint8_t* record_end = record_begin + chunk_record->size;
   const uint8_t* packets_begin = record_begin + sizeof(ChunkRecord);
@@ -886,8 +951,15 @@ TraceBuffer::ReadPacketResult TraceBuffer::ReadNextPacketInChunk(
   if (PERFETTO_UNLIKELY(packet_size == 0))
     return ReadPacketResult::kFailedEmptyPacket;
 
-  if (PERFETTO_LIKELY(packet))
+  if (PERFETTO_LIKELY(packet)) {
+    // Validates the packet as its fragments are appended, so that readers
+    // don't have to go through all of them again once the packet is complete.
+    if (packet->slices().empty())
+      packet_validator_.Reset();
+    packet_validator_.ProcessFragment(packet_data,
+                                      static_cast<size_t>(packet_size));
     packet->AddSlice(packet_data, static_cast<size_t>(packet_size));
+  }
 
   return ReadPacketResult::kSucceeded;
 }
@@ -899,14 +971,14 @@ void TraceBuffer::DiscardWrite() {
   TRACE_BUFFER_DLOG("  discarding write");
 }
 
-std::unique_ptr<TraceBuffer> TraceBuffer::CloneReadOnly() const {
+std::unique_ptr<TraceBuffer> TraceBuffer::CloneReadOnly() {
   std::unique_ptr<TraceBuffer> buf(new TraceBuffer(CloneCtor(), *this));
   if (!buf->data_.IsValid())
     return nullptr;  // PagedMemory::Allocate() failed. We are out of memory.
   return buf;
 }
 
-TraceBuffer::TraceBuffer(CloneCtor, const TraceBuffer& src)
+TraceBuffer::TraceBuffer(CloneCtor, TraceBuffer& src)
     : overwrite_policy_(src.overwrite_policy_),
       read_only_(true),
       discard_writes_(src.discard_writes_) {
@@ -915,10 +987,6 @@ TraceBuffer::TraceBuffer(CloneCtor, const TraceBuffer& src)
 
   // The assignments below must be done after Initialize().
 
-  data_.EnsureCommitted(data_.size());
-  memcpy(data_.Get(), src.data_.Get(), src.data_.size());
-  last_chunk_id_written_ = src.last_chunk_id_written_;
-
   stats_ = src.stats_;
   stats_.set_bytes_read(0);
   stats_.set_chunks_read(0);
@@ -928,12 +996,108 @@ TraceBuffer::TraceBuffer(CloneCtor, const TraceBuffer& src)
   // Copy the index of chunk metadata and reset the read states.
   index_ = ChunkMap(src.index_);
   for (auto& kv : index_) {
-    ChunkMeta& chunk_meta = kv.second;
-    chunk_meta.num_fragments_read = 0;
-    chunk_meta.cur_fragment_offset = 0;
-    chunk_meta.set_last_read_packet_skipped(false);
+    for (ChunkMeta& chunk_meta : kv.second) {
+      chunk_meta.num_fragments_read = 0;
+      chunk_meta.cur_fragment_offset = 0;
+      chunk_meta.set_last_read_packet_skipped(false);
+    }
   }
   read_iter_ = SequenceIterator();
+
+  // Rather than copying |src.data_|, share the pages which hold chunks with
+  // |src|. They are copied only before |src| overwrites them.
+  static_assert(kCowPageSize % sizeof(ChunkRecord) == 0,
+                "ChunkRecord(s) must not straddle copy-on-write pages");
+  cow_pages_.resize((size_ + kCowPageSize - 1) / kCowPageSize, kCowPageUnused);
+  for (const auto& kv : index_) {
+    for (const ChunkMeta& chunk_meta : kv.second) {
+      const uint32_t record_off = chunk_meta.record_off;
+      const size_t record_size =
+          reinterpret_cast<const ChunkRecord*>(
+              src.GetChunkRecordForRead(record_off))
+              ->size;
+      const size_t first_page = record_off / kCowPageSize;
+      const size_t last_page = (record_off + record_size - 1) / kCowPageSize;
+      for (size_t page = first_page; page <= last_page; page++) {
+        if (cow_pages_[page] == kCowPageUnused) {
+          cow_pages_[page] = kCowPageShared;
+          cow_num_shared_pages_++;
+        }
+      }
+    }
+  }
+  if (cow_num_shared_pages_ == 0)
+    return;
+
+  if (src.cow_source_) {
+    // |src| is itself a clone, and its pages can still be in its own source.
+    // Don't chain clones, copy the pages straight away instead.
+    for (size_t page = 0; page < cow_pages_.size(); page++) {
+      if (cow_pages_[page] != kCowPageShared)
+        continue;
+      const size_t off = page * kCowPageSize;
+      const size_t len = std::min(kCowPageSize, size_ - off);
+      src.CopyPagesFromSource(off, len);
+      data_.EnsureCommitted(off + len);
+      memcpy(begin() + off, src.begin() + off, len);
+      cow_pages_[page] = kCowPageCopied;
+    }
+    cow_num_shared_pages_ = 0;
+    return;
+  }
+
+  cow_source_ = &src;
+  src.cow_clones_.push_back(this);
+}
+
+void TraceBuffer::CopyPagesFromSource(size_t offset, size_t size) {
+  if (!cow_source_ || size == 0)
+    return;
+  const size_t first_page = offset / kCowPageSize;
+  const size_t last_page = (offset + size - 1) / kCowPageSize;
+  for (size_t page = first_page; page <= last_page; page++) {
+    if (cow_pages_[page] != kCowPageShared)
+      continue;
+    const size_t off = page * kCowPageSize;
+    const size_t len = std::min(kCowPageSize, size_ - off);
+    cow_source_->data_.EnsureCommitted(off + len);
+    data_.EnsureCommitted(off + len);
+    memcpy(begin() + off, cow_source_->begin() + off, len);
+    cow_pages_[page] = kCowPageCopied;
+    cow_num_shared_pages_--;
+  }
+
+  if (cow_num_shared_pages_ == 0) {
+    auto& source_clones = cow_source_->cow_clones_;
+    source_clones.erase(
+        std::remove(source_clones.begin(), source_clones.end(), this),
+        source_clones.end());
+    cow_source_ = nullptr;
+  }
+}
+
+const uint8_t* TraceBuffer::GetChunkRecordForRead(uint32_t record_off) {
+  uint8_t* ptr = begin() + record_off;
+  DcheckIsAlignedAndWithinBounds(ptr);
+  if (PERFETTO_LIKELY(!cow_source_))
+    return ptr;
+
+  // The ChunkRecord header is always within one page. If all the pages of the
+  // chunk are still shared, read it from the source. Otherwise copy the pages
+  // which are still shared, so that the chunk is contiguous in |data_|.
+  const uint8_t* src_ptr = cow_source_->begin() + record_off;
+  const size_t first_page = record_off / kCowPageSize;
+  const bool header_shared = cow_pages_[first_page] == kCowPageShared;
+  const size_t record_size =
+      reinterpret_cast<const ChunkRecord*>(header_shared ? src_ptr : ptr)->size;
+  const size_t last_page = (record_off + record_size - 1) / kCowPageSize;
+  bool all_shared = true;
+  for (size_t page = first_page; page <= last_page && all_shared; page++)
+    all_shared = cow_pages_[page] == kCowPageShared;
+  if (all_shared)
+    return src_ptr;
+  CopyPagesFromSource(record_off, record_size);
+  return ptr;
 }
 
 }  // namespace perfetto
@@ -24,6 +24,7 @@
 #include <limits>
 #include <map>
 #include <tuple>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/flat_hash_map.h"
@@ -34,6 +35,7 @@
 #include "perfetto/ext/tracing/core/slice.h"
 #include "perfetto/ext/tracing/core/trace_stats.h"
 #include "src/tracing/core/histogram.h"
+#include "src/tracing/core/packet_stream_validator.h"
 
 namespace perfetto {
 
@@ -113,7 +115,9 @@ class TracePacket;
 //
 // However, in order to keep some operations (patching and reading) fast, a
 // lookaside index is maintained (in |index_|), keeping each chunk in the buffer
-// indexed by their {ProducerID, WriterID, ChunkID} tuple.
+// indexed by their {ProducerID, WriterID, ChunkID} tuple. The index holds one
+// ChunkSequence per {ProducerID, WriterID}, with a flat array of the chunk
+// metadata sorted by ChunkID.
 //
 // Patching data out-of-band
 // -------------------------
@@ -272,15 +276,24 @@ class TraceBuffer {
   //   P1, P4, P7, P2, P3, P5, P8, P9, P6
   // But the following is guaranteed to NOT happen:
   //   P1, P5, P7, P4 (P4 cannot come after P5)
+  //
+  // The packet is checked with PacketStreamValidator while its fragments are
+  // gathered. If |packet_is_valid| is not null, it's set to the result.
   bool ReadNextTracePacket(TracePacket*,
                            PacketSequenceProperties* sequence_properties,
-                           bool* previous_packet_on_sequence_dropped);
+                           bool* previous_packet_on_sequence_dropped,
+                           bool* packet_is_valid = nullptr);
 
   // Creates a read-only clone of the trace buffer. The read iterators of the
   // new buffer will be reset, as if no Read() had been called. Calls to
   // CopyChunkUntrusted() and TryPatchChunkContents() on the returned cloned
   // TraceBuffer will CHECK().
-  std::unique_ptr<TraceBuffer> CloneReadOnly() const;
+  // The clone is copy-on-write: it shares the memory of this buffer and copies
+  // a page only before this buffer overwrites it (or is destroyed). Hence the
+  // packets read from the clone can point into the memory of this buffer and,
+  // like all packets read from a TraceBuffer, are valid only until the next
+  // write into it.
+  std::unique_ptr<TraceBuffer> CloneReadOnly();
 
   void set_read_only() { read_only_ = true; }
   const WriterStatsMap& writer_stats() const { return writer_stats_; }
@@ -407,13 +420,15 @@ class TraceBuffer {
       kLastReadPacketSkipped = 1 << 1
     };
 
-    ChunkMeta(uint32_t _record_off,
+    ChunkMeta(ChunkID _chunk_id,
+              uint32_t _record_off,
               uint16_t _num_fragments,
               bool complete,
               uint8_t _flags,
               uid_t _trusted_uid,
               pid_t _trusted_pid)
-        : record_off{_record_off},
+        : chunk_id{_chunk_id},
+          record_off{_record_off},
           trusted_uid{_trusted_uid},
           trusted_pid(_trusted_pid),
           flags{_flags},
@@ -423,6 +438,7 @@ class TraceBuffer {
     }
 
     ChunkMeta(const ChunkMeta&) noexcept = default;
+    ChunkMeta& operator=(const ChunkMeta&) = default;
 
     bool is_complete() const { return index_flags & kComplete; }
 
@@ -446,9 +462,12 @@ class TraceBuffer {
       }
     }
 
-    const uint32_t record_off;  // Offset of ChunkRecord within |data_|.
-    const uid_t trusted_uid;    // uid of the producer.
-    const pid_t trusted_pid;    // pid of the producer.
+    // These are never changed once the chunk is indexed. They are not const
+    // only because ChunkSequence moves ChunkMeta(s) around.
+    ChunkID chunk_id;      // Matches |chunk_record->chunk_id|.
+    uint32_t record_off;   // Offset of ChunkRecord within |data_|.
+    uid_t trusted_uid;     // uid of the producer.
+    pid_t trusted_pid;     // pid of the producer.
 
     // Flags set by TraceBuffer to track the state of the chunk in the index.
     uint8_t index_flags = 0;
@@ -469,12 +488,59 @@ class TraceBuffer {
     uint16_t cur_fragment_offset = 0;
   };
 
-  using ChunkMap = std::map<ChunkMeta::Key, ChunkMeta>;
+  // The chunks of a {ProducerID, WriterID} sequence, sorted by ChunkID (not
+  // taking wrapping into account, SequenceIterator deals with that).
+  // Chunks are almost always added with increasing ChunkIDs and deleted in the
+  // same order, as the write pointer wraps over the buffer. Hence the entries
+  // are kept in a flat vector, with the deleted entries at its front being
+  // just skipped (|first|) and compacted away only once they make up half of
+  // the vector. Deletions from the middle, e.g. in the case of chunks committed
+  // out of order, are rare and just erase the entry.
+  class ChunkSequence {
+   public:
+    ChunkMeta* begin() { return chunks_.data() + first_; }
+    ChunkMeta* end() { return chunks_.data() + chunks_.size(); }
+    const ChunkMeta* begin() const { return chunks_.data() + first_; }
+    const ChunkMeta* end() const { return chunks_.data() + chunks_.size(); }
+    size_t size() const { return chunks_.size() - first_; }
+    bool empty() const { return size() == 0; }
+
+    // Returns nullptr if there is no chunk with the given ID.
+    ChunkMeta* Find(ChunkID);
+
+    // Returns the first chunk with an ID > the given one, or end().
+    ChunkMeta* UpperBound(ChunkID);
+
+    // Adds a chunk, which must not be in the sequence already. Invalidates all
+    // the pointers into the sequence.
+    ChunkMeta* Insert(const ChunkMeta&);
+
+    // Removes the chunk with the given ID, which must be in the sequence.
+    // Invalidates all the pointers into the sequence.
+    void Erase(ChunkID);
+
+    // The highest ChunkID written for this sequence, taking into account a
+    // potential overflow of ChunkIDs. In the case of overflow, stores the
+    // highest ChunkID written since the overflow. This is kept also when all
+    // the chunks of the sequence have been deleted.
+    ChunkID last_chunk_id_written = 0;
+
+   private:
+    std::vector<ChunkMeta> chunks_;
+    size_t first_ = 0;  // Num. of deleted entries at the front of |chunks_|.
+  };
+
+  // Sequences are sorted by {ProducerID, WriterID}, see MkProducerAndWriterID.
+  //
+  // TODO(primiano): should clean up sequences from this map. Right now it grows
+  // without bounds (although realistically is not a problem unless we have too
+  // many producers/writers within the same trace session).
+  using ChunkMap = std::map<ProducerAndWriterID, ChunkSequence>;
 
-  // Allows to iterate over a sub-sequence of |index_| for all keys belonging to
-  // the same {ProducerID,WriterID}. Furthermore takes into account the wrapping
-  // of ChunkID. Instances are valid only as long as the |index_| is not altered
-  // (can be used safely only between adjacent ReadNextTracePacket() calls).
+  // Allows to iterate over the ChunkSequence of a {ProducerID,WriterID} in
+  // |index_|. Furthermore takes into account the wrapping of ChunkID. Instances
+  // are valid only as long as the |index_| is not altered (can be used safely
+  // only between adjacent ReadNextTracePacket() calls).
   // The order of the iteration will proceed in the following order:
   // |wrapping_id| + 1 -> |seq_end|, |seq_begin| -> |wrapping_id|.
   // Practical example:
@@ -485,38 +551,51 @@ class TraceBuffer {
   //   through a CopyChunkUntrusted()).
   // The resulting iteration order will be: c5, c6, c7, c0, c1, c2, c3, c4.
   struct SequenceIterator {
-    // Points to the 1st key (the one with the numerically min ChunkID).
-    ChunkMap::iterator seq_begin;
+    // The sequence being iterated, or |index_|.end().
+    ChunkMap::iterator seq;
 
-    // Points one past the last key (the one with the numerically max ChunkID).
-    ChunkMap::iterator seq_end;
+    // Points to the 1st chunk (the one with the numerically min ChunkID).
+    ChunkMeta* seq_begin = nullptr;
 
-    // Current iterator, always >= seq_begin && <= seq_end.
-    ChunkMap::iterator cur;
+    // Points one past the last chunk (the one with the numerically max
+    // ChunkID).
+    ChunkMeta* seq_end = nullptr;
+
+    // Current chunk, always >= seq_begin && <= seq_end.
+    ChunkMeta* cur = nullptr;
 
     // The latest ChunkID written. Determines the start/end of the sequence.
-    ChunkID wrapping_id;
+    ChunkID wrapping_id = 0;
 
     bool is_valid() const { return cur != seq_end; }
 
-    ProducerID producer_id() const {
+    ProducerAndWriterID producer_and_writer_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.producer_id;
+      return seq->first;
+    }
+
+    ProducerID producer_id() const {
+      ProducerID p;
+      WriterID w;
+      GetProducerAndWriterID(producer_and_writer_id(), &p, &w);
+      return p;
     }
 
     WriterID writer_id() const {
-      PERFETTO_DCHECK(is_valid());
-      return cur->first.writer_id;
+      ProducerID p;
+      WriterID w;
+      GetProducerAndWriterID(producer_and_writer_id(), &p, &w);
+      return w;
     }
 
     ChunkID chunk_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.chunk_id;
+      return cur->chunk_id;
     }
 
     ChunkMeta& operator*() {
       PERFETTO_DCHECK(is_valid());
-      return cur->second;
+      return *cur;
     }
 
     // Moves |cur| to the next chunk in the index.
@@ -546,18 +625,15 @@ class TraceBuffer {
   // Not using the implicit copy ctor to avoid unintended copies.
   // This tagged ctor should be used only for Clone().
   struct CloneCtor {};
-  TraceBuffer(CloneCtor, const TraceBuffer&);
+  TraceBuffer(CloneCtor, TraceBuffer&);
 
   bool Initialize(size_t size);
 
-  // Returns an object that allows to iterate over chunks in the |index_| that
-  // have the same {ProducerID, WriterID} of
-  // |seq_begin.first.{producer,writer}_id|. |seq_begin| must be an iterator to
-  // the first entry in the |index_| that has a different {ProducerID, WriterID}
-  // from the previous one. It is valid for |seq_begin| to be == index_.end()
-  // (i.e. if the index is empty). The iteration takes care of ChunkID wrapping,
-  // by using |last_chunk_id_|.
-  SequenceIterator GetReadIterForSequence(ChunkMap::iterator seq_begin);
+  // Returns an object that allows to iterate over the chunks of the sequence
+  // |seq|. It is valid for |seq| to be == index_.end() (i.e. if the index is
+  // empty) and for the sequence to have no chunks. The iteration takes care of
+  // ChunkID wrapping, by using |last_chunk_id_written|.
+  SequenceIterator GetReadIterForSequence(ChunkMap::iterator seq);
 
   // Used as a last resort when a buffer corruption is detected.
   void ClearContentsAndResetRWCursors();
@@ -620,6 +696,24 @@ class TraceBuffer {
 
   void DiscardWrite();
 
+  // Must be called before writing into [ptr, ptr + size) of |data_|. Gives
+  // a private copy of the pages in the range to the clones still sharing them.
+  void CopyPagesToClones(const uint8_t* ptr, size_t size) {
+    if (PERFETTO_LIKELY(cow_clones_.empty()))
+      return;
+    for (TraceBuffer* clone : std::vector<TraceBuffer*>(cow_clones_))
+      clone->CopyPagesFromSource(static_cast<size_t>(ptr - begin()), size);
+  }
+
+  // Only for clones. Copies the pages in [offset, offset + size) which are
+  // still shared from |cow_source_|. Detaches from |cow_source_| once no
+  // pages are shared anymore.
+  void CopyPagesFromSource(size_t offset, size_t size);
+
+  // Returns a pointer to the ChunkRecord at |record_off|, for reading it. For
+  // clones this can point into the memory of |cow_source_|.
+  const uint8_t* GetChunkRecordForRead(uint32_t record_off);
+
   // |src| can be nullptr (in which case |size| must be ==
   // record.size - sizeof(ChunkRecord)), for the case of writing a padding
   // record. |wptr_| is NOT advanced by this function, the caller must do that.
@@ -643,6 +737,7 @@ class TraceBuffer {
 
     // Deliberately not a *D*CHECK.
     PERFETTO_CHECK(wptr + sizeof(record) + size <= end());
+    CopyPagesToClones(wptr, record.size);
     memcpy(wptr, &record, sizeof(record));
     if (PERFETTO_LIKELY(src)) {
       // If the producer modifies the data in the shared memory buffer while we
@@ -687,6 +782,10 @@ class TraceBuffer {
   // It becomes invalid after any call to methods that alters the |index_|.
   SequenceIterator read_iter_;
 
+  // Validates the packet returned by ReadNextTracePacket() fragment by
+  // fragment, as ReadNextPacketInChunk() appends them.
+  PacketStreamValidator packet_validator_;
+
   // See comments at the top of the file.
   OverwritePolicy overwrite_policy_ = kOverwrite;
 
@@ -698,15 +797,6 @@ class TraceBuffer {
   // a write fails because it would overwrite unread chunks.
   bool discard_writes_ = false;
 
-  // Keeps track of the highest ChunkID written for a given sequence, taking
-  // into account a potential overflow of ChunkIDs. In the case of overflow,
-  // stores the highest ChunkID written since the overflow.
-  //
-  // TODO(primiano): should clean up keys from this map. Right now it grows
-  // without bounds (although realistically is not a problem unless we have too
-  // many producers/writers within the same trace session).
-  std::map<std::pair<ProducerID, WriterID>, ChunkID> last_chunk_id_written_;
-
   // Statistics about buffer usage.
   TraceStats::BufferStats stats_;
 
@@ -722,6 +812,24 @@ class TraceBuffer {
   bool changed_since_last_read_ = false;
 #endif
 
+  // Copy-on-write state of clones (see CloneReadOnly()). |data_| is split in
+  // pages of kCowPageSize. The pages holding the chunks in the |index_| of a
+  // clone start as kCowPageShared, i.e. their contents are still in the
+  // |data_| of |cow_source_|, and become kCowPageCopied before |cow_source_|
+  // overwrites them. The other pages are never read.
+  static constexpr size_t kCowPageSize = 4096;
+  enum CowPageState : uint8_t {
+    kCowPageUnused = 0,
+    kCowPageShared,
+    kCowPageCopied,
+  };
+  TraceBuffer* cow_source_ = nullptr;
+  std::vector<CowPageState> cow_pages_;
+  size_t cow_num_shared_pages_ = 0;
+
+  // The clones sharing pages of this buffer.
+  std::vector<TraceBuffer*> cow_clones_;
+
   // When true disable some DCHECKs that have been put in place to detect
   // bugs in the producers. This is for tests that feed malicious inputs and
   // hence mimic a buggy producer.
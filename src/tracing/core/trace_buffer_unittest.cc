@@ -26,6 +26,7 @@
 #include "perfetto/ext/tracing/core/shared_memory_abi.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
 #include "perfetto/protozero/proto_utils.h"
+#include "src/tracing/core/packet_stream_validator.h"
 #include "src/tracing/core/trace_buffer.h"
 #include "src/tracing/test/fake_packet.h"
 #include "test/gtest_and_gmock.h"
@@ -127,9 +128,8 @@ class TraceBufferTest : public testing::Test {
   }
 
   SequenceIterator GetReadIterForSequence(ProducerID p, WriterID w) {
-    TraceBuffer::ChunkMeta::Key key(p, w, 0);
     return trace_buffer_->GetReadIterForSequence(
-        trace_buffer_->index_.lower_bound(key));
+        trace_buffer_->index_.lower_bound(MkProducerAndWriterID(p, w)));
   }
 
   void SuppressClientDchecksForTesting() {
@@ -138,9 +138,13 @@ class TraceBufferTest : public testing::Test {
 
   std::vector<ChunkMetaKey> GetIndex() {
     std::vector<ChunkMetaKey> keys;
-    keys.reserve(trace_buffer_->index_.size());
-    for (const auto& it : trace_buffer_->index_)
-      keys.push_back(it.first);
+    for (const auto& it : trace_buffer_->index_) {
+      ProducerID p;
+      WriterID w;
+      GetProducerAndWriterID(it.first, &p, &w);
+      for (const auto& chunk_meta : it.second)
+        keys.emplace_back(p, w, chunk_meta.chunk_id);
+    }
     return keys;
   }
 
@@ -468,6 +472,54 @@ TEST_F(TraceBufferTest, ReadWrite_PaddingAtEndUpdatesIndexMisaligned) {
   ASSERT_THAT(ReadPacket(), IsEmpty());
 }
 
+// Tests that the index stays consistent when chunks committed out of order are
+// overwritten (hence removed from the middle of their sequence) and when all
+// the chunks of a sequence are overwritten.
+TEST_F(TraceBufferTest, ReadWrite_OverwriteOutOfOrderChunksUpdatesIndex) {
+  ResetBuffer(4096);
+
+  // [c1][c0][x0][c2][c3][c4][c5][c6], where x0 is the only chunk of another
+  // sequence.
+  ASSERT_EQ(512u, CreateChunk(ProducerID(1), WriterID(2), ChunkID(1))
+                      .AddPacket(512 - 16, 'b')
+                      .CopyIntoTraceBuffer());
+  ASSERT_EQ(512u, CreateChunk(ProducerID(1), WriterID(2), ChunkID(0))
+                      .AddPacket(512 - 16, 'a')
+                      .CopyIntoTraceBuffer());
+  ASSERT_EQ(512u, CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+                      .AddPacket(512 - 16, 'x')
+                      .CopyIntoTraceBuffer());
+  for (char i = 2; i < 7; i++) {
+    ASSERT_EQ(512u, CreateChunk(ProducerID(1), WriterID(2), ChunkID(i))
+                        .AddPacket(512 - 16, 'a' + i)
+                        .CopyIntoTraceBuffer());
+  }
+  ASSERT_THAT(GetIndex(),
+              ElementsAre(ChunkMetaKey(1, 1, 0), ChunkMetaKey(1, 2, 0),
+                          ChunkMetaKey(1, 2, 1), ChunkMetaKey(1, 2, 2),
+                          ChunkMetaKey(1, 2, 3), ChunkMetaKey(1, 2, 4),
+                          ChunkMetaKey(1, 2, 5), ChunkMetaKey(1, 2, 6)));
+
+  // [c7][c8][c9][c2][c3][c4][c5][c6]: overwrites c1 first, then c0 and x0.
+  for (char i = 7; i < 10; i++) {
+    ASSERT_EQ(512u, CreateChunk(ProducerID(1), WriterID(2), ChunkID(i))
+                        .AddPacket(512 - 16, 'a' + i)
+                        .CopyIntoTraceBuffer());
+  }
+  ASSERT_THAT(GetIndex(),
+              ElementsAre(ChunkMetaKey(1, 2, 2), ChunkMetaKey(1, 2, 3),
+                          ChunkMetaKey(1, 2, 4), ChunkMetaKey(1, 2, 5),
+                          ChunkMetaKey(1, 2, 6), ChunkMetaKey(1, 2, 7),
+                          ChunkMetaKey(1, 2, 8), ChunkMetaKey(1, 2, 9)));
+
+  trace_buffer()->BeginRead();
+  for (char i = 2; i < 10; i++) {
+    ASSERT_THAT(ReadPacket(),
+                ElementsAre(FakePacketFragment(512 - 16, 'a' + i)));
+  }
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+}
+
 // Verify that empty packets are skipped.
 TEST_F(TraceBufferTest, ReadWrite_EmptyPacket) {
   ResetBuffer(4096);
@@ -513,6 +565,41 @@ TEST_F(TraceBufferTest, Fragments_Simple) {
   ASSERT_THAT(ReadPacket(), IsEmpty());
 }
 
+// The packets are validated while their fragments are read, the same way
+// PacketStreamValidator::Validate() does on the whole packet.
+TEST_F(TraceBufferTest, Fragments_ValidatedWhileRead) {
+  ResetBuffer(4096);
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+      .AddPacket({0x03, 0x48, 0x96, 0x01})  // Field 9: varint 150.
+      .AddPacket({0x03, 0x4a, 0x04, 'a'})   // Field 9: 4 bytes, continues...
+      .SetFlags(kContOnNextChunk)
+      .CopyIntoTraceBuffer();
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(1))
+      .AddPacket({0x03, 'b', 'c', 'd'})  // ...on this chunk.
+      .AddPacket({0x02, 0x18, 0x2a})     // trusted_uid, which is reserved.
+      .AddPacket({0x01, 0x48})           // Field 9 without its value.
+      .SetFlags(kContFromPrevChunk)
+      .CopyIntoTraceBuffer();
+
+  trace_buffer()->BeginRead();
+  std::vector<bool> valid;
+  for (;;) {
+    TracePacket packet;
+    TraceBuffer::PacketSequenceProperties sequence_properties{};
+    bool previous_packet_dropped = false;
+    bool packet_is_valid = false;
+    if (!trace_buffer()->ReadNextTracePacket(&packet, &sequence_properties,
+                                             &previous_packet_dropped,
+                                             &packet_is_valid)) {
+      break;
+    }
+    ASSERT_EQ(packet_is_valid,
+              PacketStreamValidator::Validate(packet.slices()));
+    valid.push_back(packet_is_valid);
+  }
+  ASSERT_THAT(valid, ElementsAre(true, true, false, false));
+}
+
 TEST_F(TraceBufferTest, Fragments_EdgeCases) {
   ResetBuffer(4096);
   CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
@@ -1929,4 +2016,80 @@ TEST_F(TraceBufferTest, Clone_WithPatches) {
   ASSERT_THAT(ReadPacket(snap), IsEmpty());
 }
 
+// The clone must keep the contents at the time of cloning, even if the source
+// buffer overwrites them later. Chunks of 3072 bytes are used so that some
+// of them straddle the pages shared between the two buffers.
+TEST_F(TraceBufferTest, Clone_SourceOverwrittenAfterClone) {
+  ResetBuffer(4096 * 4);
+  for (char i = 0; i < 5; i++) {
+    ASSERT_EQ(3072u, CreateChunk(ProducerID(1), WriterID(1), ChunkID(i))
+                         .AddPacket(3072 - 16, 'a' + i)
+                         .CopyIntoTraceBuffer());
+  }
+  std::unique_ptr<TraceBuffer> snap = trace_buffer()->CloneReadOnly();
+
+  // Read the first chunk before the source overwrites it, and the others
+  // after.
+  snap->BeginRead();
+  ASSERT_THAT(ReadPacket(snap),
+              ElementsAre(FakePacketFragment(3072 - 16, 'a')));
+  for (char i = 0; i < 5; i++) {
+    ASSERT_EQ(3072u, CreateChunk(ProducerID(2), WriterID(1), ChunkID(i))
+                         .AddPacket(3072 - 16, 'v' + i)
+                         .CopyIntoTraceBuffer());
+  }
+  for (char i = 1; i < 5; i++) {
+    ASSERT_THAT(ReadPacket(snap),
+                ElementsAre(FakePacketFragment(3072 - 16, 'a' + i)));
+  }
+  ASSERT_THAT(ReadPacket(snap), IsEmpty());
+
+  trace_buffer()->BeginRead();
+  for (char i = 0; i < 5; i++) {
+    ASSERT_THAT(ReadPacket(),
+                ElementsAre(FakePacketFragment(3072 - 16, 'v' + i)));
+  }
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+}
+
+TEST_F(TraceBufferTest, Clone_PatchedAfterClone) {
+  ResetBuffer(4096);
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+      .AddPacket(9, 'b')
+      .ClearBytes(5, 4)  // 5 := 4th payload byte. Byte 0 is the varint header.
+      .CopyIntoTraceBuffer();
+  std::unique_ptr<TraceBuffer> snap = trace_buffer()->CloneReadOnly();
+  ASSERT_TRUE(TryPatchChunkContents(ProducerID(1), WriterID(1), ChunkID(0),
+                                    {{5, {{'Y', 'M', 'C', 'A'}}}}));
+
+  snap->BeginRead();
+  ASSERT_THAT(ReadPacket(snap),
+              ElementsAre(FakePacketFragment("b00-\0\0\0\0", 8)));
+  ASSERT_THAT(ReadPacket(snap), IsEmpty());
+
+  trace_buffer()->BeginRead();
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment("b00-YMCA", 8)));
+}
+
+TEST_F(TraceBufferTest, Clone_SourceDestroyedBeforeRead) {
+  ResetBuffer(4096 * 2);
+  for (char i = 0; i < 3; i++) {
+    ASSERT_EQ(2048u, CreateChunk(ProducerID(1), WriterID(1), ChunkID(i))
+                         .AddPacket(2048 - 16, 'a' + i)
+                         .CopyIntoTraceBuffer());
+  }
+  std::unique_ptr<TraceBuffer> snap = trace_buffer()->CloneReadOnly();
+  std::unique_ptr<TraceBuffer> snap2 = snap->CloneReadOnly();
+  ResetBuffer(4096);
+
+  for (const std::unique_ptr<TraceBuffer>* buf : {&snap, &snap2}) {
+    (*buf)->BeginRead();
+    for (char i = 0; i < 3; i++) {
+      ASSERT_THAT(ReadPacket(*buf),
+                  ElementsAre(FakePacketFragment(2048 - 16, 'a' + i)));
+    }
+    ASSERT_THAT(ReadPacket(*buf), IsEmpty());
+  }
+}
+
 }  // namespace perfetto
@@ -24,6 +24,7 @@
 #include <limits>
 #include <optional>
 #include <regex>
+#include <thread>
 #include <unordered_set>
 #include "perfetto/base/time.h"
 
@@ -77,7 +78,6 @@
 #include "src/android_stats/statsd_logging_helper.h"
 #include "src/protozero/filtering/message_filter.h"
 #include "src/protozero/filtering/string_filter.h"
-#include "src/tracing/core/packet_stream_validator.h"
 #include "src/tracing/core/shared_memory_arbiter_impl.h"
 #include "src/tracing/core/trace_buffer.h"
 
@@ -318,6 +318,48 @@ std::optional<protozero::StringFilter::Policy> ConvertPolicy(
   return std::nullopt;
 }
 
+// A packet read by ReadTraceBuffer(), before its trusted fields are appended.
+struct ReadPacket {
+  TracePacket packet;
+  TraceBuffer::PacketSequenceProperties sequence_properties{};
+  bool previous_packet_dropped = false;
+};
+
+struct TraceBufferReadResult {
+  std::vector<ReadPacket> packets;
+  size_t bytes = 0;  // SUM(packet.size() for each packet in |packets|).
+  uint64_t invalid_packets = 0;
+  bool did_hit_threshold = false;
+};
+
+// Reads and validates the packets of |tbuf| until their cumulative size
+// exceeds |threshold| or the buffer is empty. Doesn't touch any state of the
+// service, so different buffers can be read concurrently.
+void ReadTraceBuffer(TraceBuffer* tbuf,
+                     size_t threshold,
+                     TraceBufferReadResult* result) {
+  tbuf->BeginRead();
+  while (!result->did_hit_threshold) {
+    ReadPacket read_packet;
+    bool packet_is_valid = false;
+    if (!tbuf->ReadNextTracePacket(&read_packet.packet,
+                                   &read_packet.sequence_properties,
+                                   &read_packet.previous_packet_dropped,
+                                   &packet_is_valid)) {
+      break;
+    }
+    PERFETTO_DCHECK(read_packet.packet.size() > 0);
+    if (!packet_is_valid) {
+      result->invalid_packets++;
+      PERFETTO_DLOG("Dropping invalid packet");
+      continue;
+    }
+    result->bytes += read_packet.packet.size();
+    result->did_hit_threshold = result->bytes >= threshold;
+    result->packets.emplace_back(std::move(read_packet));
+  }
+}
+
 }  // namespace
 
 // static
@@ -885,6 +927,10 @@ base::Status TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
       }
     }
     tracing_session->write_into_file = std::move(fd);
+    if (init_opts_.async_write_into_file) {
+      tracing_session->async_file_writer =
+          std::make_unique<AsyncFileWriter>(*tracing_session->write_into_file);
+    }
     uint32_t write_period_ms = cfg.file_write_period_ms();
     if (write_period_ms == 0)
       write_period_ms = kDefaultWriteIntoFilePeriodMs;
@@ -896,12 +942,17 @@ base::Status TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
   }
 
   if (!cfg.compress_from_cli() &&
-      cfg.compression_type() == TraceConfig::COMPRESSION_TYPE_DEFLATE) {
-    if (init_opts_.compressor_fn) {
-      tracing_session->compress_deflate = true;
-    } else {
+      (cfg.compression_type() == TraceConfig::COMPRESSION_TYPE_DEFLATE ||
+       cfg.compression_type() == TraceConfig::COMPRESSION_TYPE_DEFLATE_FAST)) {
+    tracing_session->compressor_fn = init_opts_.compressor_fn;
+    if (cfg.compression_type() ==
+            TraceConfig::COMPRESSION_TYPE_DEFLATE_FAST &&
+        init_opts_.fast_compressor_fn) {
+      tracing_session->compressor_fn = init_opts_.fast_compressor_fn;
+    }
+    if (!tracing_session->compressor_fn) {
       PERFETTO_LOG(
-          "COMPRESSION_TYPE_DEFLATE is not supported in the current build "
+          "Deflate compression is not supported in the current build "
           "configuration. Skipping compression");
     }
   }
@@ -1189,6 +1240,7 @@ base::Status TracingServiceImpl::StartTracing(TracingSessionID tsid) {
   }
 
   tracing_session->state = TracingSession::STARTED;
+  tracing_session->start_tracing_ns = base::GetBootTimeNs().count();
 
   // We store the start of trace snapshot separately as it's important to make
   // sure we can interpret all the data in the trace and storing it in the ring
@@ -1320,6 +1372,7 @@ void TracingServiceImpl::StartDataSourceInstance(
     tracing_session->consumer_maybe_null->OnDataSourceInstanceStateChange(
         *producer, *instance);
   }
+  instance->start_requested_ns = base::GetBootTimeNs().count();
   producer->StartDataSource(instance->instance_id, instance->config);
 
   // If all data sources are started, notify the consumer.
@@ -1440,6 +1493,7 @@ void TracingServiceImpl::NotifyDataSourceStarted(
     }
 
     instance->state = DataSourceInstance::STARTED;
+    instance->start_acked_ns = base::GetBootTimeNs().count();
 
     ProducerEndpointImpl* producer = GetProducer(producer_id);
     PERFETTO_DCHECK(producer);
@@ -2189,18 +2243,49 @@ bool TracingServiceImpl::ReadBuffersIntoFile(TracingSessionID tsid) {
   // ReadBuffersIntoConsumer, but that's not currently possible.
   // ReadBuffersIntoFile has to read the whole available data before returning,
   // to support the disable_immediately=true code paths.
+  //
+  // If compression is on a thread pool, read as many chunks as there are
+  // threads and compress them together: compression is by far the most
+  // expensive step and each chunk is compressed independently of the others.
+  const size_t chunks_per_iteration =
+      tracing_session->compressor_fn && init_opts_.compression_thread_count > 1
+          ? init_opts_.compression_thread_count
+          : 1;
   bool has_more = true;
   bool stop_writing_into_file = false;
   do {
-    std::vector<TracePacket> packets =
-        ReadBuffers(tracing_session, kWriteIntoFileChunkSize, &has_more);
+    if (chunks_per_iteration == 1) {
+      std::vector<TracePacket> packets =
+          ReadBuffers(tracing_session, kWriteIntoFileChunkSize, &has_more);
+      stop_writing_into_file =
+          WriteIntoFile(tracing_session, std::move(packets));
+      continue;
+    }
 
-    stop_writing_into_file = WriteIntoFile(tracing_session, std::move(packets));
+    std::vector<std::vector<TracePacket>> batches;
+    while (has_more && batches.size() < chunks_per_iteration) {
+      batches.emplace_back(ReadBuffers(tracing_session,
+                                       kWriteIntoFileChunkSize, &has_more,
+                                       /*compress=*/false));
+    }
+    CompressPacketBatches(tracing_session, &batches);
+    for (auto& packets : batches) {
+      stop_writing_into_file =
+          WriteIntoFile(tracing_session, std::move(packets));
+      if (stop_writing_into_file)
+        break;
+    }
   } while (has_more && !stop_writing_into_file);
 
   if (stop_writing_into_file || tracing_session->write_period_ms == 0) {
     // Ensure all data was written to the file before we close it.
-    base::FlushFile(tracing_session->write_into_file.get());
+    if (tracing_session->async_file_writer) {
+      if (!tracing_session->async_file_writer->Drain())
+        PERFETTO_ELOG("Failed to write the trace file");
+      tracing_session->async_file_writer.reset();
+    } else {
+      base::FlushFile(tracing_session->write_into_file.get());
+    }
     tracing_session->write_into_file.reset();
     tracing_session->write_period_ms = 0;
     if (tracing_session->state == TracingSession::STARTED)
@@ -2256,8 +2341,10 @@ bool TracingServiceImpl::IsWaitingForTrigger(TracingSession* tracing_session) {
 std::vector<TracePacket> TracingServiceImpl::ReadBuffers(
     TracingSession* tracing_session,
     size_t threshold,
-    bool* has_more) {
+    bool* has_more,
+    bool compress) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
+  PERFETTO_METATRACE_SCOPED(TAG_TRACE_SERVICE, TRACE_SERVICE_READ_BUFFERS);
   PERFETTO_DCHECK(tracing_session);
   *has_more = false;
 
@@ -2301,72 +2388,106 @@ std::vector<TracePacket> TracingServiceImpl::ReadBuffers(
     packets_bytes += packet.size();
   }
 
-  bool did_hit_threshold = false;
-
-  for (size_t buf_idx = 0;
-       buf_idx < tracing_session->num_buffers() && !did_hit_threshold;
+  std::vector<TraceBuffer*> tbufs;
+  tbufs.reserve(tracing_session->num_buffers());
+  for (size_t buf_idx = 0; buf_idx < tracing_session->num_buffers();
        buf_idx++) {
     auto tbuf_iter = buffers_.find(tracing_session->buffers_index[buf_idx]);
     if (tbuf_iter == buffers_.end()) {
       PERFETTO_DFATAL("Buffer not found.");
       continue;
     }
-    TraceBuffer& tbuf = *tbuf_iter->second;
-    tbuf.BeginRead();
-    while (!did_hit_threshold) {
-      TracePacket packet;
-      TraceBuffer::PacketSequenceProperties sequence_properties{};
-      bool previous_packet_dropped;
-      if (!tbuf.ReadNextTracePacket(&packet, &sequence_properties,
-                                    &previous_packet_dropped)) {
-        break;
-      }
-      PERFETTO_DCHECK(sequence_properties.producer_id_trusted != 0);
-      PERFETTO_DCHECK(sequence_properties.writer_id != 0);
-      PERFETTO_DCHECK(sequence_properties.producer_uid_trusted != kInvalidUid);
-      // Not checking sequence_properties.producer_pid_trusted: it is
-      // base::kInvalidPid if the platform doesn't support it.
-
-      PERFETTO_DCHECK(packet.size() > 0);
-      if (!PacketStreamValidator::Validate(packet.slices())) {
-        tracing_session->invalid_packets++;
-        PERFETTO_DLOG("Dropping invalid packet");
-        continue;
-      }
+    tbufs.push_back(tbuf_iter->second.get());
+  }
+
+  // Reading is dominated by copying and validating the packets, so the
+  // buffers can be read concurrently and merged here. Only big reads, like the
+  // ones of ReadBuffersIntoFile(), are worth starting threads for. Each of
+  // the buffers read concurrently can read up to the remaining |threshold|,
+  // so the returned size is bounded by the number of threads times
+  // |threshold|.
+  const size_t max_concurrent_reads =
+      init_opts_.read_buffers_thread_count > 1 &&
+              threshold >= kWriteIntoFileChunkSize
+          ? init_opts_.read_buffers_thread_count
+          : 1;
 
-      // Append a slice with the trusted field data. This can't be spoofed
-      // because above we validated that the existing slices don't contain any
-      // trusted fields. For added safety we append instead of prepending
-      // because according to protobuf semantics, if the same field is
-      // encountered multiple times the last instance takes priority. Note that
-      // truncated packets are also rejected, so the producer can't give us a
-      // partial packet (e.g., a truncated string) which only becomes valid when
-      // the trusted data is appended here.
-      Slice slice = Slice::Allocate(32);
-      protozero::StaticBuffered<protos::pbzero::TracePacket> trusted_packet(
-          slice.own_data(), slice.size);
-      trusted_packet->set_trusted_uid(
-          static_cast<int32_t>(sequence_properties.producer_uid_trusted));
-      trusted_packet->set_trusted_packet_sequence_id(
-          tracing_session->GetPacketSequenceID(
-              sequence_properties.producer_id_trusted,
-              sequence_properties.writer_id));
-      if (sequence_properties.producer_pid_trusted != base::kInvalidPid) {
-        // Not supported on all platforms.
-        trusted_packet->set_trusted_pid(
-            static_cast<int32_t>(sequence_properties.producer_pid_trusted));
+  bool did_hit_threshold = false;
+  std::vector<TraceBufferReadResult> results;
+  for (size_t i = 0; i < tbufs.size() && !did_hit_threshold;) {
+    const size_t remaining =
+        threshold > packets_bytes ? threshold - packets_bytes : 0;
+    const size_t num_reads = std::min(max_concurrent_reads, tbufs.size() - i);
+    results.clear();
+    results.resize(num_reads);
+    {
+      // The first buffer is read on this thread.
+      std::vector<std::thread> threads;
+      threads.reserve(num_reads - 1);
+      for (size_t j = 1; j < num_reads; j++) {
+        TraceBuffer* tbuf = tbufs[i + j];
+        TraceBufferReadResult* result = &results[j];
+        threads.emplace_back([tbuf, remaining, result] {
+          ReadTraceBuffer(tbuf, remaining, result);
+        });
       }
-      if (previous_packet_dropped)
-        trusted_packet->set_previous_packet_dropped(previous_packet_dropped);
-      slice.size = trusted_packet.Finalize();
-      packet.AddSlice(std::move(slice));
-
-      // Append the packet (inclusive of the trusted uid) to |packets|.
-      packets_bytes += packet.size();
-      did_hit_threshold = packets_bytes >= threshold;
-      packets.emplace_back(std::move(packet));
-    }  // for(packets...)
-  }    // for(buffers...)
+      ReadTraceBuffer(tbufs[i], remaining, &results[0]);
+      for (std::thread& thread : threads)
+        thread.join();
+    }
+    i += num_reads;
+
+    for (TraceBufferReadResult& result : results) {
+      tracing_session->invalid_packets += result.invalid_packets;
+      did_hit_threshold |= result.did_hit_threshold;
+      for (ReadPacket& read_packet : result.packets) {
+        TracePacket& packet = read_packet.packet;
+        const TraceBuffer::PacketSequenceProperties& sequence_properties =
+            read_packet.sequence_properties;
+        PERFETTO_DCHECK(sequence_properties.producer_id_trusted != 0);
+        PERFETTO_DCHECK(sequence_properties.writer_id != 0);
+        PERFETTO_DCHECK(sequence_properties.producer_uid_trusted !=
+                        kInvalidUid);
+        // Not checking sequence_properties.producer_pid_trusted: it is
+        // base::kInvalidPid if the platform doesn't support it.
+
+        // Append a slice with the trusted field data. This can't be spoofed
+        // because ReadTraceBuffer() validated that the existing slices don't
+        // contain any trusted fields. For added safety we append instead of
+        // prepending because according to protobuf semantics, if the same
+        // field is encountered multiple times the last instance takes
+        // priority. Note that truncated packets are also rejected, so the
+        // producer can't give us a partial packet (e.g., a truncated string)
+        // which only becomes valid when the trusted data is appended here.
+        Slice slice = Slice::Allocate(32);
+        protozero::StaticBuffered<protos::pbzero::TracePacket> trusted_packet(
+            slice.own_data(), slice.size);
+        trusted_packet->set_trusted_uid(
+            static_cast<int32_t>(sequence_properties.producer_uid_trusted));
+        trusted_packet->set_trusted_packet_sequence_id(
+            tracing_session->GetPacketSequenceID(
+                sequence_properties.producer_id_trusted,
+                sequence_properties.writer_id));
+        if (sequence_properties.producer_pid_trusted != base::kInvalidPid) {
+          // Not supported on all platforms.
+          trusted_packet->set_trusted_pid(
+              static_cast<int32_t>(sequence_properties.producer_pid_trusted));
+        }
+        if (read_packet.previous_packet_dropped) {
+          trusted_packet->set_previous_packet_dropped(
+              read_packet.previous_packet_dropped);
+        }
+        slice.size = trusted_packet.Finalize();
+        packet.AddSlice(std::move(slice));
+
+        // Append the packet (inclusive of the trusted uid) to |packets|.
+        packets_bytes += packet.size();
+        packets.emplace_back(std::move(packet));
+      }  // for(packets...)
+    }
+    // The packets grew by their trusted slices while being merged.
+    did_hit_threshold |= packets_bytes >= threshold;
+  }  // for(buffers...)
 
   *has_more = did_hit_threshold;
 
@@ -2398,7 +2519,8 @@ std::vector<TracePacket> TracingServiceImpl::ReadBuffers(
 
   MaybeFilterPackets(tracing_session, &packets);
 
-  MaybeCompressPackets(tracing_session, &packets);
+  if (compress)
+    MaybeCompressPackets(tracing_session, &packets);
 
   if (!*has_more) {
     // We've observed some extremely high memory usage by scudo after
@@ -2421,6 +2543,7 @@ void TracingServiceImpl::MaybeFilterPackets(TracingSession* tracing_session,
   if (!tracing_session->trace_filter) {
     return;
   }
+  PERFETTO_METATRACE_SCOPED(TAG_TRACE_SERVICE, TRACE_SERVICE_FILTER_PACKETS);
   protozero::MessageFilter& trace_filter = *tracing_session->trace_filter;
   // The filter root should be reset from protos.Trace to protos.TracePacket
   // by the earlier call to SetFilterRoot() in EnableTracing().
@@ -2459,11 +2582,33 @@ void TracingServiceImpl::MaybeFilterPackets(TracingSession* tracing_session,
 void TracingServiceImpl::MaybeCompressPackets(
     TracingSession* tracing_session,
     std::vector<TracePacket>* packets) {
-  if (!tracing_session->compress_deflate) {
+  if (!tracing_session->compressor_fn) {
     return;
   }
 
-  init_opts_.compressor_fn(packets);
+  PERFETTO_METATRACE_SCOPED(TAG_TRACE_SERVICE, TRACE_SERVICE_COMPRESS_PACKETS);
+  tracing_session->compressor_fn(packets);
+}
+
+void TracingServiceImpl::CompressPacketBatches(
+    TracingSession* tracing_session,
+    std::vector<std::vector<TracePacket>>* batches) {
+  InitOpts::CompressorFn compressor_fn = tracing_session->compressor_fn;
+  if (!compressor_fn)
+    return;
+  PERFETTO_METATRACE_SCOPED(TAG_TRACE_SERVICE, TRACE_SERVICE_COMPRESS_PACKETS);
+
+  // The first batch is compressed on this thread.
+  std::vector<std::thread> threads;
+  threads.reserve(batches->size());
+  for (size_t i = 1; i < batches->size(); ++i) {
+    std::vector<TracePacket>* packets = &(*batches)[i];
+    threads.emplace_back([compressor_fn, packets] { compressor_fn(packets); });
+  }
+  if (!batches->empty())
+    compressor_fn(&(*batches)[0]);
+  for (std::thread& thread : threads)
+    thread.join();
 }
 
 bool TracingServiceImpl::WriteIntoFile(TracingSession* tracing_session,
@@ -2517,6 +2662,27 @@ bool TracingServiceImpl::WriteIntoFile(TracingSession* tracing_session,
 
   uint64_t total_wr_size = 0;
 
+  // The packets point into the trace buffers, which can be overwritten as
+  // soon as we return: copy them for the writer thread.
+  if (AsyncFileWriter* writer = tracing_session->async_file_writer.get()) {
+    if (writer->failed()) {
+      stop_writing_into_file = true;
+      num_iovecs = 0;
+    }
+    size_t data_size = 0;
+    for (size_t i = 0; i < num_iovecs; i++)
+      data_size += iovecs[i].iov_len;
+    std::vector<uint8_t> data;
+    data.reserve(data_size);
+    for (size_t i = 0; i < num_iovecs; i++) {
+      const auto* start = static_cast<const uint8_t*>(iovecs[i].iov_base);
+      data.insert(data.end(), start, start + iovecs[i].iov_len);
+    }
+    total_wr_size = data.size();
+    writer->Write(std::move(data));
+    num_iovecs = 0;
+  }
+
   // writev() can take at most IOV_MAX entries per call. Batch them.
   constexpr size_t kIOVMax = IOV_MAX;
   for (size_t i = 0; i < num_iovecs; i += kIOVMax) {
@@ -2917,13 +3083,29 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
     return;
   }
 
+  TraceBuffer* buf = GetTargetBufferForChunk(producer, writer_id, buffer_id);
+  if (!buf)
+    return;
+
+  buf->CopyChunkUntrusted(producer_id_trusted, producer_uid_trusted,
+                          producer_pid_trusted, writer_id, chunk_id,
+                          num_fragments, chunk_flags, chunk_complete, src,
+                          size);
+}
+
+TraceBuffer* TracingServiceImpl::GetTargetBufferForChunk(
+    ProducerEndpointImpl* producer,
+    WriterID writer_id,
+    BufferID buffer_id) {
+  PERFETTO_DCHECK_THREAD(thread_checker_);
+
   TraceBuffer* buf = GetBufferByID(buffer_id);
   if (!buf) {
     PERFETTO_DLOG("Could not find target buffer %" PRIu16
                   " for producer %" PRIu16,
-                  buffer_id, producer_id_trusted);
+                  buffer_id, producer->id_);
     chunks_discarded_++;
-    return;
+    return nullptr;
   }
 
   // Verify that the producer is actually allowed to write into the target
@@ -2933,10 +3115,10 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
   if (!producer->is_allowed_target_buffer(buffer_id)) {
     PERFETTO_ELOG("Producer %" PRIu16
                   " tried to write into forbidden target buffer %" PRIu16,
-                  producer_id_trusted, buffer_id);
+                  producer->id_, buffer_id);
     PERFETTO_DFATAL("Forbidden target buffer");
     chunks_discarded_++;
-    return;
+    return nullptr;
   }
 
   // If the writer was registered by the producer, it should only write into the
@@ -2947,17 +3129,12 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
     PERFETTO_ELOG("Writer %" PRIu16 " of producer %" PRIu16
                   " was registered to write into target buffer %" PRIu16
                   ", but tried to write into buffer %" PRIu16,
-                  writer_id, producer_id_trusted, *associated_buffer,
-                  buffer_id);
+                  writer_id, producer->id_, *associated_buffer, buffer_id);
     PERFETTO_DFATAL("Wrong target buffer");
     chunks_discarded_++;
-    return;
+    return nullptr;
   }
-
-  buf->CopyChunkUntrusted(producer_id_trusted, producer_uid_trusted,
-                          producer_pid_trusted, writer_id, chunk_id,
-                          num_fragments, chunk_flags, chunk_complete, src,
-                          size);
+  return buf;
 }
 
 void TracingServiceImpl::ApplyChunkPatches(
@@ -3386,6 +3563,46 @@ TraceStats TracingServiceImpl::GetTraceStats(TracingSession* tracing_session) {
     *trace_stats.add_buffer_stats() = buf->stats();
   }  // for (buf in session).
 
+  // Report the SMB usage of each producer involved in the session, once per
+  // producer regardless of the number of its data source instances.
+  auto& ds_instances = tracing_session->data_source_instances;
+  for (auto it = ds_instances.begin(); it != ds_instances.end();
+       it = ds_instances.upper_bound(it->first)) {
+    ProducerEndpointImpl* producer = GetProducer(it->first);
+    if (!producer || !producer->shared_memory_)
+      continue;
+    auto* prod_stats = trace_stats.add_producer_stats();
+    prod_stats->set_producer_name(producer->name_);
+    prod_stats->set_shmem_size(producer->shmem_abi_.size());
+    prod_stats->set_shmem_page_size(producer->shmem_abi_.page_size());
+    prod_stats->set_chunks_committed(producer->chunks_committed_);
+    prod_stats->set_bytes_committed(producer->bytes_committed_);
+    prod_stats->set_peak_bytes_per_commit(producer->peak_bytes_per_commit_);
+    if (producer->smb_stalls_)
+      prod_stats->set_smb_stalls(producer->smb_stalls_);
+    if (producer->smb_drops_)
+      prod_stats->set_smb_drops(producer->smb_drops_);
+  }
+
+  // Report how long each data source instance took to start, to tell apart
+  // the ones that delay the all_data_sources_started event.
+  for (const auto& kv : ds_instances) {
+    const DataSourceInstance& instance = kv.second;
+    if (!instance.start_requested_ns)
+      continue;
+    auto* ds_stats = trace_stats.add_data_source_stats();
+    ds_stats->set_data_source_name(instance.data_source_name);
+    ProducerEndpointImpl* producer = GetProducer(kv.first);
+    if (producer)
+      ds_stats->set_producer_name(producer->name_);
+    ds_stats->set_start_request_delay_ns(static_cast<uint64_t>(
+        instance.start_requested_ns - tracing_session->start_tracing_ns));
+    if (instance.start_acked_ns) {
+      ds_stats->set_start_ack_latency_ns(static_cast<uint64_t>(
+          instance.start_acked_ns - instance.start_requested_ns));
+    }
+  }
+
   if (!tracing_session->config.builtin_data_sources()
            .disable_chunk_usage_histograms()) {
     // Emit chunk usage stats broken down by sequence ID (i.e. by trace-writer).
@@ -3511,9 +3728,11 @@ void TracingServiceImpl::EmitLifecycleEvents(
       std::pair<int64_t /* ts */, std::vector<uint8_t> /* serialized packet */>;
 
   std::vector<TimestampedPacket> timestamped_packets;
+  // Reused for all the packets, to avoid allocating for each of them.
+  protozero::HeapBuffered<protos::pbzero::TracePacket> packet;
   for (auto& event : tracing_session->lifecycle_events) {
     for (int64_t ts : event.timestamps) {
-      protozero::HeapBuffered<protos::pbzero::TracePacket> packet;
+      packet.Reset();
       packet->set_timestamp(static_cast<uint64_t>(ts));
       packet->set_trusted_uid(static_cast<int32_t>(uid_));
       packet->set_trusted_packet_sequence_id(kServicePacketSequenceID);
@@ -3543,10 +3762,11 @@ void TracingServiceImpl::MaybeEmitReceivedTriggers(
     std::vector<TracePacket>* packets) {
   PERFETTO_DCHECK(tracing_session->num_triggers_emitted_into_trace <=
                   tracing_session->received_triggers.size());
+  protozero::HeapBuffered<protos::pbzero::TracePacket> packet;
   for (size_t i = tracing_session->num_triggers_emitted_into_trace;
        i < tracing_session->received_triggers.size(); ++i) {
     const auto& info = tracing_session->received_triggers[i];
-    protozero::HeapBuffered<protos::pbzero::TracePacket> packet;
+    packet.Reset();
     auto* trigger = packet->set_trigger();
     trigger->set_trigger_name(info.trigger_name);
     trigger->set_producer_name(info.producer_name);
@@ -3793,7 +4013,7 @@ base::Status TracingServiceImpl::DoCloneSession(ConsumerEndpointImpl* consumer,
   cloned_session->flushes_requested = src->flushes_requested;
   cloned_session->flushes_succeeded = src->flushes_succeeded;
   cloned_session->flushes_failed = src->flushes_failed;
-  cloned_session->compress_deflate = src->compress_deflate;
+  cloned_session->compressor_fn = src->compressor_fn;
   if (src->trace_filter) {
     // Copy the trace filter.
     cloned_session->trace_filter.reset(
@@ -4228,6 +4448,7 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
     PERFETTO_METATRACE_COUNTER(TAG_TRACE_SERVICE, TRACE_SERVICE_COMMIT_DATA,
                                EncodeCommitDataRequest(id_, req_untrusted));
   }
+  PERFETTO_METATRACE_SCOPED(TAG_TRACE_SERVICE, TRACE_SERVICE_COMMIT);
 
   if (!shared_memory_) {
     PERFETTO_DLOG(
@@ -4235,6 +4456,10 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
     return;
   }
   PERFETTO_DCHECK(shmem_abi_.is_valid());
+  TraceBuffer* target_buf = nullptr;
+  WriterID target_writer_id = 0;
+  BufferID target_buffer_id = 0;
+  uint64_t commit_bytes = 0;
   for (const auto& entry : req_untrusted.chunks_to_move()) {
     const uint32_t page_idx = entry.page();
     if (page_idx >= shmem_abi_.num_pages())
@@ -4263,6 +4488,8 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
                     entry.page(), entry.chunk());
       continue;
     }
+    chunks_committed_++;
+    commit_bytes += chunk.size();
 
     // TryAcquireChunkForReading() has load-acquire semantics. Once acquired,
     // the ABI contract expects the producer to not touch the chunk anymore
@@ -4277,10 +4504,21 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
     uint16_t num_fragments = packets.count;
     uint8_t chunk_flags = packets.flags;
 
-    service_->CopyProducerPageIntoLogBuffer(
-        id_, uid_, pid_, writer_id, chunk_id, buffer_id, num_fragments,
-        chunk_flags,
-        /*chunk_complete=*/true, chunk.payload_begin(), chunk.payload_size());
+    // Commits usually move many chunks of the same writer into the same
+    // buffer: only look up and validate the target buffer when they change.
+    if (!target_buf || writer_id != target_writer_id ||
+        buffer_id != target_buffer_id) {
+      target_buf =
+          service_->GetTargetBufferForChunk(this, writer_id, buffer_id);
+      target_writer_id = writer_id;
+      target_buffer_id = buffer_id;
+    }
+    if (target_buf) {
+      target_buf->CopyChunkUntrusted(
+          id_, uid_, pid_, writer_id, chunk_id, num_fragments, chunk_flags,
+          /*chunk_complete=*/true, chunk.payload_begin(),
+          chunk.payload_size());
+    }
 
     if (!commit_data_over_ipc) {
       // This one has release-store semantics.
@@ -4288,6 +4526,13 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
     }
   }  // for(chunks_to_move)
 
+  bytes_committed_ += commit_bytes;
+  peak_bytes_per_commit_ = std::max(peak_bytes_per_commit_, commit_bytes);
+  if (req_untrusted.has_smb_stalls())
+    smb_stalls_ = req_untrusted.smb_stalls();
+  if (req_untrusted.has_smb_drops())
+    smb_drops_ = req_untrusted.smb_drops();
+
   service_->ApplyChunkPatches(id_, req_untrusted.chunks_to_patch());
 
   if (req_untrusted.flush_request_id()) {
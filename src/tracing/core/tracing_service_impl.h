@@ -46,6 +46,7 @@
 #include "perfetto/tracing/core/forward_decls.h"
 #include "perfetto/tracing/core/trace_config.h"
 #include "src/android_stats/perfetto_atoms.h"
+#include "src/tracing/core/async_file_writer.h"
 #include "src/tracing/core/id_allocator.h"
 
 namespace protozero {
@@ -194,6 +195,15 @@ class TracingServiceImpl : public TracingService {
     // before use.
     std::map<WriterID, BufferID> writers_;
 
+    // SMB usage stats, reported in TraceStats.producer_stats. The stalls and
+    // drops counters are untrusted and just mirror what the producer reported
+    // in its last CommitDataRequest.
+    uint64_t chunks_committed_ = 0;
+    uint64_t bytes_committed_ = 0;
+    uint64_t peak_bytes_per_commit_ = 0;
+    uint64_t smb_stalls_ = 0;
+    uint64_t smb_drops_ = 0;
+
     // This is used only in in-process configurations.
     // SharedMemoryArbiterImpl methods themselves are thread-safe.
     std::unique_ptr<SharedMemoryArbiterImpl> inproc_shmem_arbiter_;
@@ -288,6 +298,12 @@ class TracingServiceImpl : public TracingService {
                                      bool chunk_complete,
                                      const uint8_t* src,
                                      size_t size);
+  // Returns the buffer into which |producer| can copy the chunks of
+  // |writer_id| targeting |buffer_id|. Returns nullptr, counting the chunk as
+  // discarded, if the buffer doesn't exist or the producer can't write to it.
+  TraceBuffer* GetTargetBufferForChunk(ProducerEndpointImpl* producer,
+                                       WriterID writer_id,
+                                       BufferID buffer_id);
   void ApplyChunkPatches(ProducerID,
                          const std::vector<CommitDataRequest::ChunkToPatch>&);
   void NotifyFlushDoneForProducer(ProducerID, FlushRequestID);
@@ -419,6 +435,11 @@ class TracingServiceImpl : public TracingService {
       STOPPED
     };
     DataSourceInstanceState state = CONFIGURED;
+
+    // Boot time of the start request sent to the producer and of its ack, in
+    // nanoseconds. Reported in TraceStats.data_source_stats. 0 until set.
+    int64_t start_requested_ns = 0;
+    int64_t start_acked_ns = 0;
   };
 
   struct PendingFlush {
@@ -571,8 +592,9 @@ class TracingServiceImpl : public TracingService {
     // Whether we put the system info into the trace output yet.
     bool did_emit_system_info = false;
 
-    // Whether we should compress TracePackets after reading them.
-    bool compress_deflate = false;
+    // The function compressing TracePackets after reading them, if the
+    // trace should be compressed.
+    InitOpts::CompressorFn compressor_fn = nullptr;
 
     // The number of received triggers we've emitted into the trace output.
     size_t num_triggers_emitted_into_trace = 0;
@@ -585,6 +607,9 @@ class TracingServiceImpl : public TracingService {
     uint64_t flushes_succeeded = 0;
     uint64_t flushes_failed = 0;
 
+    // Boot time of the StartTracing() call, in nanoseconds.
+    int64_t start_tracing_ns = 0;
+
     // Outcome of the final Flush() done by FlushAndDisableTracing().
     protos::gen::TraceStats_FinalFlushOutcome final_flush_outcome{};
 
@@ -640,6 +665,10 @@ class TracingServiceImpl : public TracingService {
     uint32_t write_period_ms = 0;
     uint64_t max_file_size_bytes = 0;
     uint64_t bytes_written_into_file = 0;
+    // If set, writes into |write_into_file| go through this writer thread
+    // rather than being done on the service thread. Declared after
+    // |write_into_file| so that it's destroyed before the file is closed.
+    std::unique_ptr<AsyncFileWriter> async_file_writer;
 
     // Periodic task for snapshotting service events (e.g. clocks, sync markers
     // etc)
@@ -746,9 +775,13 @@ class TracingServiceImpl : public TracingService {
   // The function stops when the cumulative size of the return packets exceeds
   // `threshold` (so it's not a strict upper bound) and sets `*has_more` to
   // true, or when there are no more packets (and sets `*has_more` to false).
+  //
+  // If `compress` is false, the packets are returned uncompressed even if the
+  // session has compression enabled (see CompressPacketBatches()).
   std::vector<TracePacket> ReadBuffers(TracingSession* tracing_session,
                                        size_t threshold,
-                                       bool* has_more);
+                                       bool* has_more,
+                                       bool compress = true);
 
   // If `*tracing_session` has a filter, applies it to `*packets`. Doesn't
   // change the number of `*packets`, only their content.
@@ -759,6 +792,11 @@ class TracingServiceImpl : public TracingService {
   void MaybeCompressPackets(TracingSession* tracing_session,
                             std::vector<TracePacket>* packets);
 
+  // Compresses each of `*batches` like MaybeCompressPackets(), each on its
+  // own thread.
+  void CompressPacketBatches(TracingSession* tracing_session,
+                             std::vector<std::vector<TracePacket>>* batches);
+
   // If `*tracing_session` is configured to write into a file, writes `packets`
   // into the file.
   //
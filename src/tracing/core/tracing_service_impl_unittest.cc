@@ -2000,6 +2000,60 @@ TEST_F(TracingServiceImplTest, CompressionReadIpc) {
                   Property(&protos::gen::TestEvent::str, Eq("payload-2")))));
 }
 
+TEST_F(TracingServiceImplTest, FastCompression) {
+  TracingService::InitOpts init_opts;
+  init_opts.compressor_fn = ZlibCompressFn;
+  init_opts.fast_compressor_fn = ZlibFastCompressFn;
+  InitializeSvcWithOpts(init_opts);
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_compression_type(
+      TraceConfig::COMPRESSION_TYPE_DEFLATE_FAST);
+  consumer->EnableTracing(trace_config);
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload-1");
+  }
+
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  std::vector<protos::gen::TracePacket> compressed_packets =
+      consumer->ReadBuffers();
+  EXPECT_THAT(compressed_packets, Not(IsEmpty()));
+  EXPECT_THAT(compressed_packets,
+              Each(Property(&protos::gen::TracePacket::compressed_packets,
+                            Not(IsEmpty()))));
+  std::vector<protos::gen::TracePacket> decompressed_packets =
+      DecompressTrace(compressed_packets);
+  EXPECT_THAT(decompressed_packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("payload-1")))));
+}
+
 TEST_F(TracingServiceImplTest, CompressionWriteIntoFile) {
   TracingService::InitOpts init_opts;
   init_opts.compressor_fn = ZlibCompressFn;
@@ -2065,6 +2119,144 @@ TEST_F(TracingServiceImplTest, CompressionWriteIntoFile) {
                   Property(&protos::gen::TestEvent::str, Eq("payload-2")))));
 }
 
+TEST_F(TracingServiceImplTest, CompressionWriteIntoFileOnThreads) {
+  TracingService::InitOpts init_opts;
+  init_opts.compressor_fn = ZlibCompressFn;
+  init_opts.compression_thread_count = 4;
+  InitializeSvcWithOpts(init_opts);
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_write_into_file(true);
+  trace_config.set_compression_type(TraceConfig::COMPRESSION_TYPE_DEFLATE);
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload-1");
+  }
+  {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload-2");
+  }
+
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  // Verify the contents of the file.
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+  protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+  EXPECT_THAT(trace.packet(), Not(IsEmpty()));
+  EXPECT_THAT(trace.packet(),
+              Each(Property(&protos::gen::TracePacket::compressed_packets,
+                            Not(IsEmpty()))));
+  std::vector<protos::gen::TracePacket> decompressed_packets =
+      DecompressTrace(trace.packet());
+  EXPECT_THAT(decompressed_packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("payload-1")))));
+  EXPECT_THAT(decompressed_packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("payload-2")))));
+}
+
+TEST_F(TracingServiceImplTest, ReadBuffersIntoFileOnThreads) {
+  TracingService::InitOpts init_opts;
+  init_opts.read_buffers_thread_count = 4;
+  InitializeSvcWithOpts(init_opts);
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source_1");
+  producer->RegisterDataSource("data_source_2");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config_1 = trace_config.add_data_sources()->mutable_config();
+  ds_config_1->set_name("data_source_1");
+  ds_config_1->set_target_buffer(0);
+  auto* ds_config_2 = trace_config.add_data_sources()->mutable_config();
+  ds_config_2->set_name("data_source_2");
+  ds_config_2->set_target_buffer(1);
+  trace_config.set_write_into_file(true);
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source_1");
+  producer->WaitForDataSourceSetup("data_source_2");
+  producer->WaitForDataSourceStart("data_source_1");
+  producer->WaitForDataSourceStart("data_source_2");
+
+  static constexpr int kNumPackets = 100;
+  std::unique_ptr<TraceWriter> writer_1 =
+      producer->CreateTraceWriter("data_source_1");
+  std::unique_ptr<TraceWriter> writer_2 =
+      producer->CreateTraceWriter("data_source_2");
+  for (int i = 0; i < kNumPackets; i++) {
+    writer_1->NewTracePacket()->set_for_testing()->set_str(
+        "buf1-" + std::to_string(i));
+    writer_2->NewTracePacket()->set_for_testing()->set_str(
+        "buf2-" + std::to_string(i));
+  }
+  writer_1->Flush();
+  writer_2->Flush();
+  writer_1.reset();
+  writer_2.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source_1");
+  producer->WaitForDataSourceStop("data_source_2");
+  consumer->WaitForTracingDisabled();
+
+  // The packets of each buffer are in order, and the buffers are one after
+  // the other like when they are read on the service thread.
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+  protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+  std::vector<std::string> payloads;
+  for (const auto& packet : trace.packet()) {
+    if (packet.has_for_testing())
+      payloads.push_back(packet.for_testing().str());
+  }
+  std::vector<std::string> expected;
+  for (int i = 0; i < kNumPackets; i++)
+    expected.push_back("buf1-" + std::to_string(i));
+  for (int i = 0; i < kNumPackets; i++)
+    expected.push_back("buf2-" + std::to_string(i));
+  EXPECT_THAT(payloads, ElementsAreArray(expected));
+}
+
 TEST_F(TracingServiceImplTest, CloneSessionWithCompression) {
   TracingService::InitOpts init_opts;
   init_opts.compressor_fn = ZlibCompressFn;
@@ -2218,6 +2410,88 @@ TEST_F(TracingServiceImplTest, WriteIntoFileAndStopOnMaxSize) {
   }
 }
 
+TEST_F(TracingServiceImplTest, AsyncWriteIntoFileAndStopOnMaxSize) {
+  TracingService::InitOpts init_opts;
+  init_opts.async_write_into_file = true;
+  InitializeSvcWithOpts(init_opts);
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(100000);  // 100s
+  const uint64_t kMaxFileSize = 1024;
+  trace_config.set_max_file_size_bytes(kMaxFileSize);
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  // The preamble packets are:
+  // Trace start clock snapshot
+  // Trace most recent clock snapshot
+  // Trace synchronisation
+  // TraceUuid
+  // Config
+  // SystemInfo
+  // Tracing started (TracingServiceEvent)
+  // All data source started (TracingServiceEvent)
+  // Tracing disabled (TracingServiceEvent)
+  static const int kNumPreamblePackets = 9;
+  static const int kNumTestPackets = 9;
+  static const char kPayload[] = "1234567890abcdef-";
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  // Tracing service will emit a preamble of packets (a synchronization section,
+  // followed by a tracing config packet). The preamble and these test packets
+  // should fit within kMaxFileSize.
+  for (int i = 0; i < kNumTestPackets; i++) {
+    auto tp = writer->NewTracePacket();
+    std::string payload(kPayload);
+    payload.append(std::to_string(i));
+    tp->set_for_testing()->set_str(payload.c_str(), payload.size());
+  }
+
+  // Finally add a packet that overflows kMaxFileSize. This should cause the
+  // implicit stop of the trace and should *not* be written in the trace.
+  {
+    auto tp = writer->NewTracePacket();
+    char big_payload[kMaxFileSize] = "BIG!";
+    tp->set_for_testing()->set_str(big_payload, sizeof(big_payload));
+  }
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  // Verify the contents of the file.
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+  protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+
+  ASSERT_EQ(trace.packet_size(), kNumPreamblePackets + kNumTestPackets);
+  for (size_t i = 0; i < kNumTestPackets; i++) {
+    const protos::gen::TracePacket& tp =
+        trace.packet()[kNumPreamblePackets + i];
+    ASSERT_EQ(kPayload + std::to_string(i++), tp.for_testing().str());
+  }
+}
+
 TEST_F(TracingServiceImplTest, WriteIntoFileWithPath) {
   auto tmp_file = base::TempFile::Create();
   // Deletes the file (the service would refuse to overwrite an existing file)
@@ -3762,6 +4036,113 @@ TEST_F(TracingServiceImplTest, TraceWriterStats) {
   }
 }
 
+TEST_F(TracingServiceImplTest, ProducerSmbStats) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  // Not involved in the trace session: must not show up in the stats.
+  std::unique_ptr<MockProducer> producer2 = CreateMockProducer();
+  producer2->Connect(svc.get(), "mock_producer2");
+  producer2->RegisterDataSource("data_source2");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(128);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+
+  consumer->EnableTracing(trace_config);
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  // Flush after each packet to commit one chunk at a time.
+  for (int i = 0; i < 5; i++) {
+    writer->NewTracePacket()->set_for_testing()->set_str("payload");
+    writer->Flush();
+  }
+
+  consumer->GetTraceStats();
+  TraceStats stats = consumer->WaitForTraceStats(true);
+  ASSERT_EQ(stats.producer_stats().size(), 1u);
+  const auto& prod_stats = stats.producer_stats()[0];
+  EXPECT_EQ(prod_stats.producer_name(), "mock_producer");
+  EXPECT_GT(prod_stats.shmem_size(), 0u);
+  EXPECT_GT(prod_stats.shmem_page_size(), 0u);
+  EXPECT_EQ(prod_stats.chunks_committed(), 5u);
+  EXPECT_GT(prod_stats.peak_bytes_per_commit(), 0u);
+  EXPECT_EQ(prod_stats.bytes_committed(),
+            5 * prod_stats.peak_bytes_per_commit());
+  EXPECT_FALSE(prod_stats.has_smb_stalls());
+  EXPECT_FALSE(prod_stats.has_smb_drops());
+
+  writer.reset();
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+}
+
+TEST_F(TracingServiceImplTest, DataSourceStartLatencyStats) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("ds_will_ack", /*ack_stop=*/false,
+                               /*ack_start=*/true);
+  producer->RegisterDataSource("ds_wont_ack");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(128);
+  trace_config.add_data_sources()->mutable_config()->set_name("ds_will_ack");
+  trace_config.add_data_sources()->mutable_config()->set_name("ds_wont_ack");
+  trace_config.set_deferred_start(true);
+
+  consumer->EnableTracing(trace_config);
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("ds_will_ack");
+  producer->WaitForDataSourceSetup("ds_wont_ack");
+  DataSourceInstanceID id = producer->GetDataSourceInstanceId("ds_will_ack");
+
+  // Not started yet: no stats.
+  consumer->GetTraceStats();
+  EXPECT_EQ(consumer->WaitForTraceStats(true).data_source_stats().size(), 0u);
+
+  consumer->StartTracing();
+  producer->WaitForDataSourceStart("ds_will_ack");
+  producer->WaitForDataSourceStart("ds_wont_ack");
+
+  // The ack latency is reported only once the ack is received.
+  consumer->GetTraceStats();
+  TraceStats stats = consumer->WaitForTraceStats(true);
+  ASSERT_EQ(stats.data_source_stats().size(), 2u);
+  for (const auto& ds_stats : stats.data_source_stats()) {
+    EXPECT_EQ(ds_stats.producer_name(), "mock_producer");
+    EXPECT_TRUE(ds_stats.has_start_request_delay_ns());
+    EXPECT_FALSE(ds_stats.has_start_ack_latency_ns());
+  }
+
+  producer->endpoint()->NotifyDataSourceStarted(id);
+
+  consumer->GetTraceStats();
+  stats = consumer->WaitForTraceStats(true);
+  ASSERT_EQ(stats.data_source_stats().size(), 2u);
+  for (const auto& ds_stats : stats.data_source_stats()) {
+    EXPECT_EQ(ds_stats.has_start_ack_latency_ns(),
+              ds_stats.data_source_name() == "ds_will_ack");
+  }
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("ds_will_ack");
+  producer->WaitForDataSourceStop("ds_wont_ack");
+  consumer->WaitForTracingDisabled();
+}
+
 TEST_F(TracingServiceImplTest, ObserveEventsDataSourceInstances) {
   std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
   consumer->Connect(svc.get());
@@ -58,7 +58,7 @@ Slice PreambleToSlice(const Preamble& preamble) {
 // testing.
 class ZlibPacketCompressor {
  public:
-  ZlibPacketCompressor();
+  explicit ZlibPacketCompressor(int level);
   ~ZlibPacketCompressor();
 
   // Can be called multiple times, before Finish() is called.
@@ -80,9 +80,9 @@ class ZlibPacketCompressor {
   std::unique_ptr<uint8_t[]> cur_slice_;
 };
 
-ZlibPacketCompressor::ZlibPacketCompressor() {
+ZlibPacketCompressor::ZlibPacketCompressor(int level) {
   memset(&stream_, 0, sizeof(stream_));
-  int status = deflateInit(&stream_, 6);
+  int status = deflateInit(&stream_, level);
   PERFETTO_CHECK(status == Z_OK);
 }
 
@@ -151,14 +151,12 @@ void ZlibPacketCompressor::PushCurSlice() {
   }
 }
 
-}  // namespace
-
-void ZlibCompressFn(std::vector<TracePacket>* packets) {
+void CompressPackets(std::vector<TracePacket>* packets, int level) {
   if (packets->empty()) {
     return;
   }
 
-  ZlibPacketCompressor stream;
+  ZlibPacketCompressor stream(level);
 
   for (const TracePacket& packet : *packets) {
     stream.PushPacket(packet);
@@ -170,4 +168,14 @@ void ZlibCompressFn(std::vector<TracePacket>* packets) {
   packets->push_back(std::move(packet));
 }
 
+}  // namespace
+
+void ZlibCompressFn(std::vector<TracePacket>* packets) {
+  CompressPackets(packets, 6);
+}
+
+void ZlibFastCompressFn(std::vector<TracePacket>* packets) {
+  CompressPackets(packets, Z_BEST_SPEED);
+}
+
 }  // namespace perfetto
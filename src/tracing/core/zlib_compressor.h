@@ -28,6 +28,9 @@ static constexpr size_t kZlibCompressSliceSize = 128 * 1024 - 512;
 
 void ZlibCompressFn(std::vector<TracePacket>*);
 
+// Like ZlibCompressFn, but compresses at the fastest zlib level.
+void ZlibFastCompressFn(std::vector<TracePacket>*);
+
 }  // namespace perfetto
 
 #endif  // SRC_TRACING_CORE_ZLIB_COMPRESSOR_H_
@@ -29,6 +29,7 @@
 namespace perfetto {
 namespace {
 
+using ::testing::AllOf;
 using ::testing::Each;
 using ::testing::ElementsAre;
 using ::testing::Field;
@@ -146,6 +147,35 @@ TEST(ZlibCompressFnTest, End2EndCompressAndDecompress) {
                            Property(&protos::gen::TestEvent::str, "def"))));
 }
 
+TEST(ZlibCompressFnTest, FastCompressAndDecompress) {
+  std::vector<TracePacket> packets;
+  for (int i = 0; i < 100; i++) {
+    packets.push_back(CreateTracePacket([](protos::gen::TracePacket* msg) {
+      auto* for_testing = msg->mutable_for_testing();
+      for_testing->set_str("abcdefghijklmnopqrstuvwxyz");
+    }));
+  }
+  size_t uncompressed_size = 0;
+  for (const TracePacket& packet : packets)
+    uncompressed_size += packet.size();
+
+  ZlibFastCompressFn(&packets);
+
+  ASSERT_THAT(packets, SizeIs(1));
+  EXPECT_LT(packets[0].size(), uncompressed_size);
+  protos::gen::TracePacket compressed_packet_proto;
+  ASSERT_TRUE(compressed_packet_proto.ParseFromString(
+      packets[0].GetRawBytesForTesting()));
+  protos::gen::Trace subtrace;
+  ASSERT_TRUE(subtrace.ParseFromString(
+      Decompress(compressed_packet_proto.compressed_packets())));
+  EXPECT_THAT(subtrace.packet(),
+              AllOf(SizeIs(100),
+                    Each(Property(&protos::gen::TracePacket::for_testing,
+                                  Property(&protos::gen::TestEvent::str,
+                                           "abcdefghijklmnopqrstuvwxyz")))));
+}
+
 TEST(ZlibCompressFnTest, MaxSliceSize) {
   std::vector<TracePacket> packets;
 
@@ -56,6 +56,7 @@ EventContext::~EventContext() {
 protos::pbzero::DebugAnnotation* EventContext::AddDebugAnnotation(
     const char* name) {
   auto annotation = event()->add_debug_annotations();
+  annotation->set_compact_size_field(true);
   annotation->set_name_iid(
       internal::InternedDebugAnnotationName::Get(this, name));
   return annotation;
@@ -64,7 +65,8 @@ protos::pbzero::DebugAnnotation* EventContext::AddDebugAnnotation(
 protos::pbzero::DebugAnnotation* EventContext::AddDebugAnnotation(
     ::perfetto::DynamicString name) {
   auto annotation = event()->add_debug_annotations();
-  annotation->set_name(name.value);
+  annotation->set_compact_size_field(true);
+  annotation->set_name(name.value, name.length);
   return annotation;
 }
 
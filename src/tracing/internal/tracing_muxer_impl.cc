@@ -62,6 +62,10 @@ namespace {
 
 using RegisteredDataSource = TracingMuxerImpl::RegisteredDataSource;
 
+// Default for TracingInitArgs::shmem_batch_commits_duration_ms with the
+// in-process backend.
+constexpr uint32_t kInProcessBatchCommitsDurationMs = 10;
+
 // A task runner which prevents calls to DataSource::Trace() while an operation
 // is in progress. Used to guard against unexpected re-entrancy where the
 // user-provided task runner implementation tries to enter a trace point under
@@ -303,6 +307,16 @@ void TracingMuxerImpl::ProducerImpl::Flush(
   if (muxer_) {
     for (size_t i = 0; i < instance_count; i++) {
       DataSourceInstanceID ds_id = instances[i];
+      // If the data source is still handling an earlier flush asynchronously,
+      // don't ask it to flush again: this flush will complete together with
+      // the earlier one (see NotifyFlushForDataSourceDone()). This avoids
+      // piling up flushes on slow data sources, e.g. when a periodic flush
+      // and a consumer flush happen at the same time.
+      if (IsFlushPending(ds_id)) {
+        pending_flushes_[flush_id].insert(ds_id);
+        all_handled = false;
+        continue;
+      }
       bool handled = muxer_->FlushDataSource_AsyncBegin(backend_id_, ds_id,
                                                         flush_id, flush_flags);
       if (!handled) {
@@ -368,13 +382,13 @@ void TracingMuxerImpl::ProducerImpl::NotifyFlushForDataSourceDone(
     return;
   }
 
-  {
-    auto it = pending_flushes_.find(flush_id);
-    if (it == pending_flushes_.end()) {
-      return;
-    }
-    std::set<DataSourceInstanceID>& ds_ids = it->second;
-    ds_ids.erase(ds_id);
+  if (pending_flushes_.find(flush_id) == pending_flushes_.end()) {
+    return;
+  }
+  // The data source might have been asked to flush only once on behalf of
+  // several flush requests, see Flush().
+  for (auto& id_and_ds_ids : pending_flushes_) {
+    id_and_ds_ids.second.erase(ds_id);
   }
 
   std::optional<DataSourceInstanceID> biggest_flush_id;
@@ -392,6 +406,15 @@ void TracingMuxerImpl::ProducerImpl::NotifyFlushForDataSourceDone(
   }
 }
 
+bool TracingMuxerImpl::ProducerImpl::IsFlushPending(
+    DataSourceInstanceID ds_id) const {
+  for (const auto& id_and_ds_ids : pending_flushes_) {
+    if (id_and_ds_ids.second.count(ds_id))
+      return true;
+  }
+  return false;
+}
+
 // ----- End of TracingMuxerImpl::ProducerImpl methods.
 
 // ----- Begin of TracingMuxerImpl::ConsumerImpl
@@ -956,8 +979,15 @@ void TracingMuxerImpl::AddProducerBackend(TracingProducerBackend* backend,
   rb.backend = backend;
   rb.id = backend_id;
   rb.type = type;
+  // The in-process service runs on the muxer thread, so every commit sent to
+  // it right away costs a wakeup (and a context switch) of that thread. Batch
+  // the commits by default: unlike with the system backend, no data can be
+  // lost by holding them back, as the service can't outlive the producer.
+  uint32_t batch_commits_duration_ms = args.shmem_batch_commits_duration_ms;
+  if (type == kInProcessBackend && batch_commits_duration_ms == 0)
+    batch_commits_duration_ms = kInProcessBatchCommitsDurationMs;
   rb.producer.reset(
-      new ProducerImpl(this, backend_id, args.shmem_batch_commits_duration_ms));
+      new ProducerImpl(this, backend_id, batch_commits_duration_ms));
   rb.producer_conn_args.producer = rb.producer.get();
   rb.producer_conn_args.producer_name = platform_->GetCurrentProcessName();
   rb.producer_conn_args.task_runner = task_runner_.get();
@@ -2397,9 +2427,23 @@ TracingMuxerImpl::CreateStartupTracingSession(
         PERFETTO_DLOG("Reconnecting backend %zu for startup tracing",
                       backend_id);
         backend.producer_conn_args.use_producer_provided_smb = true;
+        uint32_t shmem_size_hint_bytes =
+            backend.producer_conn_args.shmem_size_hint_bytes;
+        if (opts.shmem_size_hint_kb) {
+          backend.producer_conn_args.shmem_size_hint_bytes =
+              opts.shmem_size_hint_kb * 1024;
+        }
         backend.producer->service_->Disconnect();  // Causes a reconnect.
         PERFETTO_DCHECK(backend.producer->service_ &&
                         backend.producer->service_->MaybeSharedMemoryArbiter());
+        // Later reconnections use the regular size again.
+        backend.producer_conn_args.shmem_size_hint_bytes =
+            shmem_size_hint_bytes;
+      } else if (opts.shmem_size_hint_kb) {
+        PERFETTO_DLOG(
+            "Backend %zu already has a shared memory buffer, ignoring the "
+            "startup tracing shmem_size_hint_kb",
+            backend_id);
       }
 
       RegisteredStartupSession session;
@@ -237,6 +237,8 @@ class TracingMuxerImpl : public TracingMuxer {
     bool SweepDeadServices();
     void SendOnConnectTriggers();
     void NotifyFlushForDataSourceDone(DataSourceInstanceID, FlushRequestID);
+    // Returns true if |ds_id| is still handling a flush asynchronously.
+    bool IsFlushPending(DataSourceInstanceID ds_id) const;
 
     PERFETTO_THREAD_CHECKER(thread_checker_)
     TracingMuxerImpl* muxer_;
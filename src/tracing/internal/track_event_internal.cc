@@ -518,6 +518,85 @@ void TrackEventInternal::WriteEventName(perfetto::DynamicString event_name,
   }
 }
 
+// static
+bool TrackEventInternal::ShouldRecordEvent(
+    TrackEventSamplingState* sampling,
+    const Category& category,
+    size_t category_index,
+    perfetto::protos::pbzero::TrackEvent::Type type,
+    bool on_current_thread_track) {
+  // The slices on the track of the current thread are nested, so the end of
+  // the innermost one is the next end.
+  bool is_nested_slice =
+      on_current_thread_track &&
+      (type == perfetto::protos::pbzero::TrackEvent::TYPE_SLICE_BEGIN ||
+       type == perfetto::protos::pbzero::TrackEvent::TYPE_SLICE_END);
+  if (is_nested_slice &&
+      type == perfetto::protos::pbzero::TrackEvent::TYPE_SLICE_END) {
+    // Slices begun before the session started are always ended.
+    if (sampling->recorded_slices.empty())
+      return true;
+    bool recorded = sampling->recorded_slices.back();
+    sampling->recorded_slices.pop_back();
+    return recorded;
+  }
+
+  double rate = 1;
+  if (!sampling->category_rates.empty()) {
+    double* cached_rate = nullptr;
+    if (category_index != TrackEventCategoryRegistry::kDynamicCategoryIndex) {
+      if (category_index >= sampling->static_category_rates.size())
+        sampling->static_category_rates.resize(category_index + 1, -1);
+      cached_rate = &sampling->static_category_rates[category_index];
+    }
+    if (cached_rate && *cached_rate >= 0) {
+      rate = *cached_rate;
+    } else {
+      for (const auto& pattern_and_rate : sampling->category_rates) {
+        bool matches = false;
+        category.ForEachGroupMember(
+            [&](const char* member_name, size_t name_size) {
+              matches = NameMatchesPattern(pattern_and_rate.first,
+                                           std::string(member_name, name_size),
+                                           MatchType::kPattern);
+              return !matches;
+            });
+        if (matches) {
+          rate = pattern_and_rate.second;
+          break;
+        }
+      }
+      if (cached_rate)
+        *cached_rate = rate;
+    }
+  }
+
+  bool record = true;
+  if (rate < 1) {
+    auto value = sampling->rnd_engine() - std::minstd_rand::min();
+    record = static_cast<double>(value) <
+             rate * static_cast<double>(std::minstd_rand::max() -
+                                        std::minstd_rand::min());
+  }
+
+  // Only the sampled events count towards the rate limit.
+  if (record && sampling->max_events_per_second > 0) {
+    uint64_t now_ns = GetTimeNs();
+    if (now_ns - sampling->rate_limit_window_start_ns >= 1000000000ull) {
+      sampling->rate_limit_window_start_ns = now_ns;
+      sampling->rate_limit_window_events = 0;
+    }
+    record = sampling->rate_limit_window_events <
+             sampling->max_events_per_second;
+    if (record)
+      sampling->rate_limit_window_events++;
+  }
+
+  if (is_nested_slice)
+    sampling->recorded_slices.push_back(record);
+  return record;
+}
+
 // static
 EventContext TrackEventInternal::WriteEvent(
     TraceWriterBase* trace_writer,
@@ -547,16 +626,34 @@ EventContext TrackEventInternal::WriteEvent(
 
   // We assume that |category| points to the string with static lifetime.
   // This means we can use their addresses as interning keys.
-  // TODO(skyostil): Intern categories at compile time.
+  // Interning ids are assigned per sequence, so the category_iids fields can't
+  // be encoded at compile time. Instead, they are encoded the first time the
+  // category is used on the sequence and cached in the incremental state.
   if (category && type != protos::pbzero::TrackEvent::TYPE_SLICE_END &&
       type != protos::pbzero::TrackEvent::TYPE_COUNTER) {
-    category->ForEachGroupMember(
-        [&](const char* member_name, size_t name_size) {
-          size_t category_iid =
-              InternedEventCategory::Get(&ctx, member_name, name_size);
-          track_event->add_category_iids(category_iid);
-          return true;
-        });
+    // Categories are elements of the registry array, so adjacent categories
+    // map to different entries.
+    auto& encoded = incr_state->encoded_category_iids
+        [(reinterpret_cast<uintptr_t>(category) / sizeof(Category)) %
+         TrackEventIncrementalState::kNumEncodedCategoryIids];
+    if (PERFETTO_UNLIKELY(encoded.category != category)) {
+      using protozero::proto_utils::WriteVarInt;
+      static constexpr uint32_t kCategoryIidsTag =
+          protozero::proto_utils::MakeTagVarInt(static_cast<uint32_t>(
+              protos::pbzero::TrackEvent::kCategoryIidsFieldNumber));
+      uint8_t* ptr = encoded.data;
+      category->ForEachGroupMember(
+          [&](const char* member_name, size_t name_size) {
+            size_t category_iid =
+                InternedEventCategory::Get(&ctx, member_name, name_size);
+            ptr = WriteVarInt(kCategoryIidsTag, ptr);
+            ptr = WriteVarInt(category_iid, ptr);
+            return true;
+          });
+      encoded.size = static_cast<uint8_t>(ptr - encoded.data);
+      encoded.category = category;
+    }
+    track_event->AppendRawProtoBytes(encoded.data, encoded.size);
   }
   return ctx;
 }
@@ -566,6 +663,7 @@ protos::pbzero::DebugAnnotation* TrackEventInternal::AddDebugAnnotation(
     perfetto::EventContext* event_ctx,
     const char* name) {
   auto annotation = event_ctx->event()->add_debug_annotations();
+  annotation->set_compact_size_field(true);
   annotation->set_name_iid(InternedDebugAnnotationName::Get(event_ctx, name));
   return annotation;
 }
@@ -575,7 +673,8 @@ protos::pbzero::DebugAnnotation* TrackEventInternal::AddDebugAnnotation(
     perfetto::EventContext* event_ctx,
     perfetto::DynamicString name) {
   auto annotation = event_ctx->event()->add_debug_annotations();
-  annotation->set_name(name.value);
+  annotation->set_compact_size_field(true);
+  annotation->set_name(name.value, name.length);
   return annotation;
 }
 
@@ -27,6 +27,7 @@ void InternedEventCategory::Add(protos::pbzero::InternedData* interned_data,
                                 const char* value,
                                 size_t length) {
   auto category = interned_data->add_event_categories();
+  category->set_compact_size_field(true);
   category->set_iid(iid);
   category->set_name(value, length);
 }
@@ -38,6 +39,7 @@ void InternedEventName::Add(protos::pbzero::InternedData* interned_data,
                             size_t iid,
                             const char* value) {
   auto name = interned_data->add_event_names();
+  name->set_compact_size_field(true);
   name->set_iid(iid);
   name->set_name(value);
 }
@@ -50,6 +52,7 @@ void InternedDebugAnnotationName::Add(
     size_t iid,
     const char* value) {
   auto name = interned_data->add_debug_annotation_names();
+  name->set_compact_size_field(true);
   name->set_iid(iid);
   name->set_name(value);
 }
@@ -63,6 +66,7 @@ void InternedDebugAnnotationValueTypeName::Add(
     size_t iid,
     const char* value) {
   auto name = interned_data->add_debug_annotation_value_type_names();
+  name->set_compact_size_field(true);
   name->set_iid(iid);
   name->set_name(value);
 }
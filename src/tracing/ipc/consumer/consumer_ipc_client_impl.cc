@@ -25,9 +25,14 @@
 #include "perfetto/ext/tracing/core/consumer.h"
 #include "perfetto/ext/tracing/core/observable_events.h"
 #include "perfetto/ext/tracing/core/trace_stats.h"
+#include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/tracing/core/trace_config.h"
 #include "perfetto/tracing/core/tracing_service_state.h"
 
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include "src/tracing/ipc/posix_shared_memory.h"
+#endif
+
 // TODO(fmayer): Add a test to check to what happens when ConsumerIPCClientImpl
 // gets destroyed w.r.t. the Consumer pointer. Also think to lifetime of the
 // Consumer* during the callbacks.
@@ -38,19 +43,24 @@ namespace perfetto {
 std::unique_ptr<TracingService::ConsumerEndpoint> ConsumerIPCClient::Connect(
     const char* service_sock_name,
     Consumer* consumer,
-    base::TaskRunner* task_runner) {
+    base::TaskRunner* task_runner,
+    bool read_buffers_via_shared_memory) {
   return std::unique_ptr<TracingService::ConsumerEndpoint>(
-      new ConsumerIPCClientImpl(service_sock_name, consumer, task_runner));
+      new ConsumerIPCClientImpl(service_sock_name, consumer, task_runner,
+                                read_buffers_via_shared_memory));
 }
 
-ConsumerIPCClientImpl::ConsumerIPCClientImpl(const char* service_sock_name,
-                                             Consumer* consumer,
-                                             base::TaskRunner* task_runner)
+ConsumerIPCClientImpl::ConsumerIPCClientImpl(
+    const char* service_sock_name,
+    Consumer* consumer,
+    base::TaskRunner* task_runner,
+    bool read_buffers_via_shared_memory)
     : consumer_(consumer),
       ipc_channel_(
           ipc::Client::CreateInstance({service_sock_name, /*sock_retry=*/false},
                                       task_runner)),
       consumer_port_(this /* event_listener */),
+      read_buffers_via_shared_memory_(read_buffers_via_shared_memory),
       weak_ptr_factory_(this) {
   ipc_channel_->BindService(consumer_port_.GetWeakPtr());
 }
@@ -166,8 +176,10 @@ void ConsumerIPCClientImpl::ReadBuffers() {
       [this](ipc::AsyncResult<protos::gen::ReadBuffersResponse> response) {
         OnReadBuffersResponse(std::move(response));
       });
-  consumer_port_.ReadBuffers(protos::gen::ReadBuffersRequest(),
-                             std::move(async_response));
+  protos::gen::ReadBuffersRequest req;
+  if (read_buffers_via_shared_memory_)
+    req.set_use_shared_memory(true);
+  consumer_port_.ReadBuffers(req, std::move(async_response));
 }
 
 void ConsumerIPCClientImpl::OnReadBuffersResponse(
@@ -176,6 +188,10 @@ void ConsumerIPCClientImpl::OnReadBuffersResponse(
     PERFETTO_DLOG("ReadBuffers() failed");
     return;
   }
+  if (response->has_shared_memory_size()) {
+    OnReadBuffersSharedMemoryResponse(std::move(response));
+    return;
+  }
   std::vector<TracePacket> trace_packets;
   for (auto& resp_slice : response->slices()) {
     const std::string& slice_data = resp_slice.data();
@@ -189,6 +205,39 @@ void ConsumerIPCClientImpl::OnReadBuffersResponse(
     consumer_->OnTraceData(std::move(trace_packets), response.has_more());
 }
 
+void ConsumerIPCClientImpl::OnReadBuffersSharedMemoryResponse(
+    ipc::AsyncResult<protos::gen::ReadBuffersResponse> response) {
+  std::vector<TracePacket> trace_packets;
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  // The region only lives until the end of this function: the packets point
+  // into it and are consumed synchronously by OnTraceData(), as it happens
+  // with the packets passed by an in-process service.
+  std::unique_ptr<PosixSharedMemory> shm;
+  const size_t shm_size = static_cast<size_t>(response->shared_memory_size());
+  base::ScopedFile shm_fd = ipc_channel_->TakeReceivedFD();
+  if (shm_size > 0) {
+    if (shm_fd) {
+      shm = PosixSharedMemory::AttachToFd(std::move(shm_fd),
+                                          /*require_seals_if_supported=*/false);
+    }
+    if (!shm || shm->size() < shm_size) {
+      PERFETTO_ELOG("Failed to map the ReadBuffers() shared memory");
+    } else {
+      protozero::ProtoDecoder decoder(shm->start(), shm_size);
+      for (auto field = decoder.ReadField(); field.valid();
+           field = decoder.ReadField()) {
+        if (field.id() != TracePacket::kPacketFieldNumber)
+          continue;
+        trace_packets.emplace_back();
+        trace_packets.back().AddSlice(field.data(), field.size());
+      }
+    }
+  }
+#endif
+  if (!trace_packets.empty() || !response.has_more())
+    consumer_->OnTraceData(std::move(trace_packets), response.has_more());
+}
+
 void ConsumerIPCClientImpl::OnEnableTracingResponse(
     ipc::AsyncResult<protos::gen::EnableTracingResponse> response) {
   std::string error;
@@ -54,7 +54,8 @@ class ConsumerIPCClientImpl : public TracingService::ConsumerEndpoint,
  public:
   ConsumerIPCClientImpl(const char* service_sock_name,
                         Consumer*,
-                        base::TaskRunner*);
+                        base::TaskRunner*,
+                        bool read_buffers_via_shared_memory = false);
   ~ConsumerIPCClientImpl() override;
 
   // TracingService::ConsumerEndpoint implementation.
@@ -95,6 +96,8 @@ class ConsumerIPCClientImpl : public TracingService::ConsumerEndpoint,
 
   void OnReadBuffersResponse(
       ipc::AsyncResult<protos::gen::ReadBuffersResponse>);
+  void OnReadBuffersSharedMemoryResponse(
+      ipc::AsyncResult<protos::gen::ReadBuffersResponse>);
   void OnEnableTracingResponse(
       ipc::AsyncResult<protos::gen::EnableTracingResponse>);
   void OnQueryServiceStateResponse(
@@ -113,6 +116,9 @@ class ConsumerIPCClientImpl : public TracingService::ConsumerEndpoint,
 
   bool connected_ = false;
 
+  // Whether ReadBuffers() asks the service to use shared memory.
+  const bool read_buffers_via_shared_memory_;
+
   PendingQueryServiceRequests pending_query_svc_reqs_;
 
   // When a packet is too big to fit into a ReadBuffersResponse IPC, the service
@@ -16,11 +16,16 @@
 
 #include "src/tracing/ipc/service/consumer_ipc_service.h"
 
+#include <string.h>
+
+#include <algorithm>
 #include <cinttypes>
+#include <tuple>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/ipc/basic_types.h"
 #include "perfetto/ext/ipc/host.h"
 #include "perfetto/ext/tracing/core/shared_memory_abi.h"
@@ -32,6 +37,10 @@
 #include "perfetto/tracing/core/tracing_service_capabilities.h"
 #include "perfetto/tracing/core/tracing_service_state.h"
 
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include "src/tracing/ipc/posix_shared_memory.h"
+#endif
+
 namespace perfetto {
 
 ConsumerIPCService::ConsumerIPCService(TracingService* core_service)
@@ -105,10 +114,15 @@ void ConsumerIPCService::DisableTracing(
 }
 
 // Called by the IPC layer.
-void ConsumerIPCService::ReadBuffers(const protos::gen::ReadBuffersRequest&,
+void ConsumerIPCService::ReadBuffers(const protos::gen::ReadBuffersRequest& req,
                                      DeferredReadBuffersResponse resp) {
   RemoteConsumer* remote_consumer = GetConsumerForCurrentRequest();
   remote_consumer->read_buffers_response = std::move(resp);
+  remote_consumer->read_buffers_use_shared_memory = req.use_shared_memory();
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  remote_consumer->read_buffers_shm.reset();
+#endif
+  remote_consumer->read_buffers_shm_used = 0;
   remote_consumer->service_endpoint->ReadBuffers();
 }
 
@@ -381,6 +395,11 @@ void ConsumerIPCService::RemoteConsumer::OnTraceData(
   if (!read_buffers_response.IsBound())
     return;
 
+  if (read_buffers_use_shared_memory &&
+      WriteTraceDataIntoSharedMemory(&trace_packets, has_more)) {
+    return;
+  }
+
   auto result = ipc::AsyncResult<protos::gen::ReadBuffersResponse>::Create();
 
   // A TracePacket might be too big to fit into a single IPC message (max
@@ -427,6 +446,71 @@ void ConsumerIPCService::RemoteConsumer::OnTraceData(
   send_ipc_reply(has_more);
 }
 
+bool ConsumerIPCService::RemoteConsumer::WriteTraceDataIntoSharedMemory(
+    std::vector<TracePacket>* trace_packets,
+    bool has_more) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  base::ignore_result(trace_packets);
+  base::ignore_result(has_more);
+  return false;
+#else
+  // The packets are copied once, straight into a memfd which the client maps,
+  // rather than into the IPC frames and through the socket. The replies are
+  // batched into regions of kReadBuffersShmSize: the pages which are not
+  // written are never allocated, so the size of the region is only a bound on
+  // the number of replies.
+  static constexpr size_t kReadBuffersShmSize = 4 * 1024 * 1024;
+
+  for (TracePacket& trace_packet : *trace_packets) {
+    char* preamble;
+    size_t preamble_size;
+    std::tie(preamble, preamble_size) = trace_packet.GetProtoPreamble();
+    const size_t packet_size = preamble_size + trace_packet.size();
+
+    if (read_buffers_shm &&
+        read_buffers_shm_used + packet_size > read_buffers_shm->size()) {
+      SendSharedMemoryReply(/*has_more=*/true);
+    }
+    if (!read_buffers_shm) {
+      read_buffers_shm = PosixSharedMemory::Create(
+          std::max(kReadBuffersShmSize, base::AlignUp<4096>(packet_size)));
+      read_buffers_shm_used = 0;
+    }
+
+    uint8_t* wptr =
+        static_cast<uint8_t*>(read_buffers_shm->start()) + read_buffers_shm_used;
+    memcpy(wptr, preamble, preamble_size);
+    wptr += preamble_size;
+    for (const Slice& slice : trace_packet.slices()) {
+      memcpy(wptr, slice.start, slice.size);
+      wptr += slice.size;
+    }
+    read_buffers_shm_used += packet_size;
+  }
+
+  if (!has_more)
+    SendSharedMemoryReply(/*has_more=*/false);
+  return true;
+#endif
+}
+
+void ConsumerIPCService::RemoteConsumer::SendSharedMemoryReply(bool has_more) {
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  auto result = ipc::AsyncResult<protos::gen::ReadBuffersResponse>::Create();
+  result->set_shared_memory_size(read_buffers_shm_used);
+  result.set_has_more(has_more);
+  // The reply, and the fd with it, is sent synchronously by Resolve(), so the
+  // region can be unmapped and closed right after.
+  if (read_buffers_shm)
+    result.set_fd(read_buffers_shm->fd());
+  read_buffers_response.Resolve(std::move(result));
+  read_buffers_shm.reset();
+  read_buffers_shm_used = 0;
+#else
+  base::ignore_result(has_more);
+#endif
+}
+
 void ConsumerIPCService::RemoteConsumer::OnDetach(bool success) {
   if (!success) {
     std::move(detach_response).Reject();
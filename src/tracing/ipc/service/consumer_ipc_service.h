@@ -22,6 +22,7 @@
 #include <memory>
 #include <string>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/ipc/basic_types.h"
 #include "perfetto/ext/tracing/core/consumer.h"
@@ -35,6 +36,8 @@ namespace ipc {
 class Host;
 }  // namespace ipc
 
+class PosixSharedMemory;
+
 // Implements the Consumer port of the IPC service. This class proxies requests
 // and responses between the core service logic (|svc_|) and remote Consumer(s)
 // on the IPC socket, through the methods overriddden from ConsumerPort.
@@ -98,6 +101,13 @@ class ConsumerIPCService : public protos::gen::ConsumerPort {
 
     void CloseObserveEventsResponseStream();
 
+    // Copies |trace_packets| into |read_buffers_shm|, sending the region to
+    // the client whenever it's full or there is no more data. Returns false
+    // if shared memory is not supported.
+    bool WriteTraceDataIntoSharedMemory(std::vector<TracePacket>*,
+                                        bool has_more);
+    void SendSharedMemoryReply(bool has_more);
+
     // The interface obtained from the core service business logic through
     // TracingService::ConnectConsumer(this). This allows to invoke methods for
     // a specific Consumer on the Service business logic.
@@ -107,6 +117,17 @@ class ConsumerIPCService : public protos::gen::ConsumerPort {
     // allows to stream trace packets back to the client.
     DeferredReadBuffersResponse read_buffers_response;
 
+    // Set when the client asked to receive the packets of ReadBuffers()
+    // through shared memory (ReadBuffersRequest.use_shared_memory).
+    bool read_buffers_use_shared_memory = false;
+
+    // The shared memory region being filled for the next ReadBuffers() reply,
+    // and the number of bytes written into it so far.
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+    std::unique_ptr<PosixSharedMemory> read_buffers_shm;
+#endif
+    size_t read_buffers_shm_used = 0;
+
     // After EnableTracing() is invoked, this binds the async callback that
     // allows to send the OnTracingDisabled notification.
     DeferredEnableTracingResponse enable_tracing_response;
@@ -16,6 +16,7 @@
 
 #include <fcntl.h>
 
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <fstream>
@@ -1744,6 +1745,36 @@ TEST_P(PerfettoApiTest, TrackEventDynamicCategories) {
   EXPECT_THAT(trace, HasSubstr("EventInSecondStaticallyNamedDynamicCategory"));
 }
 
+TEST_P(PerfettoApiTest, TrackEventDisabledDynamicCategoryEnabledLater) {
+  // Session #1 doesn't enable the "dynamic" category, so it's remembered as
+  // disabled.
+  auto* tracing_session = NewTraceWithCategories({"foo"});
+  tracing_session->get()->StartBlocking();
+  perfetto::DynamicCategory dynamic{"dynamic"};
+  for (int i = 0; i < 3; i++) {
+    TRACE_EVENT_BEGIN(dynamic, "EventWhileDisabled");
+    TRACE_EVENT_END(dynamic);
+  }
+  EXPECT_FALSE(TRACE_EVENT_CATEGORY_ENABLED(dynamic));
+
+  // Starting session #2, which enables it, must not keep it disabled.
+  auto* tracing_session2 = NewTraceWithCategories({"dynamic"});
+  tracing_session2->get()->StartBlocking();
+  EXPECT_TRUE(TRACE_EVENT_CATEGORY_ENABLED(dynamic));
+  TRACE_EVENT_BEGIN(dynamic, "EventWhileEnabled");
+  TRACE_EVENT_END(dynamic);
+
+  std::vector<char> raw_trace = StopSessionAndReturnBytes(tracing_session);
+  std::string trace(raw_trace.data(), raw_trace.size());
+  EXPECT_THAT(trace, Not(HasSubstr("EventWhileDisabled")));
+  EXPECT_THAT(trace, Not(HasSubstr("EventWhileEnabled")));
+
+  raw_trace = StopSessionAndReturnBytes(tracing_session2);
+  trace = std::string(raw_trace.data(), raw_trace.size());
+  EXPECT_THAT(trace, Not(HasSubstr("EventWhileDisabled")));
+  EXPECT_THAT(trace, HasSubstr("EventWhileEnabled"));
+}
+
 TEST_P(PerfettoApiTest, TrackEventConcurrentSessions) {
   // Check that categories that are enabled and disabled in two parallel tracing
   // sessions don't interfere.
@@ -2914,6 +2945,52 @@ TEST_P(PerfettoApiTest, TrackEventTypedArgsWithInterningByValue) {
   EXPECT_THAT(log_messages, ElementsAre("This above all:"));
 }
 
+struct InternedLogMessageBodyPointer
+    : public perfetto::TrackEventInternedDataIndex<
+          InternedLogMessageBodyPointer,
+          perfetto::protos::pbzero::InternedData::kLogMessageBodyFieldNumber,
+          const char*,
+          perfetto::PointerInternedDataTraits> {
+  static void Add(perfetto::protos::pbzero::InternedData* interned_data,
+                  size_t iid,
+                  const char* value) {
+    auto l = interned_data->add_log_message_body();
+    l->set_iid(iid);
+    l->set_body(value);
+  }
+};
+
+TEST_P(PerfettoApiTest, TrackEventTypedArgsWithInterningByPointer) {
+  // Create a new trace session.
+  auto* tracing_session = NewTraceWithCategories({"foo"});
+  tracing_session->get()->StartBlocking();
+
+  // Intern enough values to make the index grow a few times.
+  static constexpr size_t kNumBodies = 200;
+  std::vector<std::string> bodies;
+  for (size_t i = 0; i < kNumBodies; i++)
+    bodies.push_back("Body " + std::to_string(i));
+
+  TRACE_EVENT_BEGIN("foo", "EventWithState", [&](perfetto::EventContext ctx) {
+    std::vector<size_t> iids;
+    for (const auto& body : bodies) {
+      size_t iid = InternedLogMessageBodyPointer::Get(&ctx, body.c_str());
+      EXPECT_EQ(iids.size() + 1, iid);
+      iids.push_back(iid);
+    }
+    for (size_t i = 0; i < kNumBodies; i++) {
+      EXPECT_EQ(iids[i],
+                InternedLogMessageBodyPointer::Get(&ctx, bodies[i].c_str()));
+    }
+    ctx.event()->set_log_message()->set_body_iid(iids[0]);
+  });
+  TRACE_EVENT_END("foo");
+
+  tracing_session->get()->StopBlocking();
+  auto log_messages = ReadLogMessagesFromTrace(tracing_session->get());
+  EXPECT_THAT(log_messages, ElementsAre("Body 0"));
+}
+
 struct InternedLogMessageBodyHashed
     : public perfetto::TrackEventInternedDataIndex<
           InternedLogMessageBodyHashed,
@@ -3562,6 +3639,54 @@ TEST_P(PerfettoApiTest, FilterDynamicEventName) {
   }
 }
 
+TEST_P(PerfettoApiTest, TrackEventCategorySampling) {
+  perfetto::protos::gen::TrackEventConfig te_cfg;
+  auto* never = te_cfg.add_category_sampling();
+  never->set_category("foo");
+  never->set_rate(0);
+  auto* always = te_cfg.add_category_sampling();
+  always->set_category("b*");
+  always->set_rate(1);
+  auto* tracing_session =
+      NewTraceWithCategories({"foo", "bar", "test"}, te_cfg);
+  tracing_session->get()->StartBlocking();
+
+  {
+    TRACE_EVENT("bar", "Outer");
+    {
+      TRACE_EVENT("foo", "Sampled");
+      TRACE_EVENT_INSTANT("foo", "SampledInstant");
+      TRACE_EVENT_INSTANT("test", "Instant");
+    }
+    TRACE_EVENT_INSTANT("bar", "OtherInstant");
+  }
+
+  // The end of the "foo" slice is dropped along with its begin.
+  auto slices = StopSessionAndReadSlicesFromTrace(tracing_session);
+  EXPECT_THAT(slices, ElementsAre("B:bar.Outer", "I:test.Instant",
+                                  "I:bar.OtherInstant", "E"));
+}
+
+TEST_P(PerfettoApiTest, TrackEventRateLimit) {
+  perfetto::protos::gen::TrackEventConfig te_cfg;
+  te_cfg.set_max_events_per_second_per_thread(3);
+  auto* tracing_session = NewTraceWithCategories({"test"}, te_cfg);
+  tracing_session->get()->StartBlocking();
+
+  {
+    TRACE_EVENT("test", "Slice1");
+    TRACE_EVENT_INSTANT("test", "Instant1");
+    TRACE_EVENT_INSTANT("test", "Instant2");
+    // Over the limit, but the end of Slice1 is still recorded.
+    TRACE_EVENT_INSTANT("test", "Instant3");
+    TRACE_EVENT("test", "Slice2");
+  }
+
+  auto slices = StopSessionAndReadSlicesFromTrace(tracing_session);
+  EXPECT_THAT(slices, ElementsAre("B:test.Slice1", "I:test.Instant1",
+                                  "I:test.Instant2", "E"));
+}
+
 TEST_P(PerfettoApiTest, TrackEventArgumentsNotEvaluatedWhenDisabled) {
   // Create a new trace session.
   auto* tracing_session = NewTraceWithCategories({"foo"});
@@ -4317,6 +4442,54 @@ TEST_P(PerfettoApiTest, OnFlushAsync) {
           Property(&perfetto::protos::gen::TestEvent::str, "on-flush"))));
 }
 
+TEST_P(PerfettoApiTest, OnFlushAsyncCoalescesFlushes) {
+  auto* data_source = &data_sources_["my_data_source"];
+
+  // Setup the trace config.
+  perfetto::TraceConfig cfg;
+  cfg.add_buffers()->set_size_kb(1024);
+  auto* ds_cfg = cfg.add_data_sources()->mutable_config();
+  ds_cfg->set_name("my_data_source");
+
+  // Create a new trace session.
+  auto* tracing_session = NewTrace(cfg);
+
+  tracing_session->get()->StartBlocking();
+
+  std::atomic<int> num_flushes{0};
+  data_source->handle_flush_asynchronously = true;
+  data_source->on_flush_callback = [&](perfetto::FlushFlags) {
+    num_flushes++;
+  };
+
+  WaitableTestEvent first_flush_done;
+  tracing_session->get()->Flush([&](bool success) {
+    EXPECT_TRUE(success);
+    first_flush_done.Notify();
+  });
+  data_source->on_flush.Wait();
+
+  // Flush again while the data source is still handling the first flush. The
+  // data source shouldn't be asked to flush again.
+  WaitableTestEvent second_flush_done;
+  tracing_session->get()->Flush([&](bool success) {
+    EXPECT_TRUE(success);
+    second_flush_done.Notify();
+  });
+  perfetto::test::SyncProducers();
+  EXPECT_EQ(num_flushes, 1);
+  EXPECT_FALSE(first_flush_done.notified());
+  EXPECT_FALSE(second_flush_done.notified());
+
+  // Finishing the first flush completes both.
+  data_source->async_flush_closure();
+  first_flush_done.Wait();
+  second_flush_done.Wait();
+  EXPECT_EQ(num_flushes, 1);
+
+  tracing_session->get()->StopBlocking();
+}
+
 // Regression test for b/139110180. Checks that GetDataSourceLocked() can be
 // called from OnStart() and OnStop() callbacks without deadlocking.
 TEST_P(PerfettoApiTest, GetDataSourceLockedFromCallbacks) {
@@ -6140,6 +6313,27 @@ TEST_P(PerfettoStartupTracingApiTest, WithProducerProvidedSmb) {
   EXPECT_THAT(slices, ElementsAre("B:test.Event", "E"));
 }
 
+TEST_P(PerfettoStartupTracingApiTest, LargerProducerProvidedSmb) {
+  ASSERT_FALSE(perfetto::test::TracingMuxerImplInternalsForTest::
+                   DoesSystemBackendHaveSMB());
+  // Write more than fits in a default sized SMB before the session is
+  // started. None of it should be dropped with a large enough SMB.
+  SetupStartupTracingOpts opts;
+  opts.shmem_size_hint_kb = 4096;
+  SetupStartupTracing({}, std::move(opts));
+  constexpr int kNumEvents = 30000;
+  for (int i = 0; i < kNumEvents; i++) {
+    TRACE_EVENT_INSTANT("test", "StartupEvent");
+  }
+
+  auto* tracing_session = NewTraceWithCategories({"test"});
+  tracing_session->get()->StartBlocking();
+
+  auto slices = StopSessionAndReadSlicesFromTrace(tracing_session);
+  EXPECT_EQ(std::count(slices.begin(), slices.end(), "I:test.StartupEvent"),
+            kNumEvents);
+}
+
 TEST_P(PerfettoStartupTracingApiTest, DontTraceBeforeStartupSetup) {
   // This event should not be recorded.
   TRACE_EVENT_BEGIN("test", "EventBeforeStartupTrace");
@@ -393,6 +393,84 @@ TEST_F(TracingIntegrationTest, ValidErrorOnDisconnection) {
 }
 
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+TEST_F(TracingIntegrationTest, ReadBuffersViaSharedMemory) {
+  // Replace the consumer with one that reads through shared memory.
+  consumer_endpoint_ = ConsumerIPCClient::Connect(
+      kConsumerSock.name(), &consumer_, task_runner_.get(),
+      /*read_buffers_via_shared_memory=*/true);
+  auto on_consumer_connect =
+      task_runner_->CreateCheckpoint("on_consumer_connect");
+  EXPECT_CALL(consumer_, OnConnect()).WillOnce(Invoke(on_consumer_connect));
+  task_runner_->RunUntilCheckpoint("on_consumer_connect");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096 * 10);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("perfetto.test");
+  ds_config->set_target_buffer(0);
+  consumer_endpoint_->EnableTracing(trace_config);
+
+  BufferID global_buf_id = 0;
+  auto on_create_ds_instance =
+      task_runner_->CreateCheckpoint("on_create_ds_instance");
+  EXPECT_CALL(producer_, OnTracingSetup());
+  EXPECT_CALL(producer_, SetupDataSource(_, _));
+  EXPECT_CALL(producer_, StartDataSource(_, _))
+      .WillOnce(Invoke([on_create_ds_instance, &global_buf_id](
+                           DataSourceInstanceID, const DataSourceConfig& cfg) {
+        global_buf_id = static_cast<BufferID>(cfg.target_buffer());
+        on_create_ds_instance();
+      }));
+  task_runner_->RunUntilCheckpoint("on_create_ds_instance");
+
+  // Write enough data to need more than one shared memory region. Flush
+  // periodically, so that the writer never runs out of SMB chunks.
+  std::unique_ptr<TraceWriter> writer =
+      producer_endpoint_->CreateTraceWriter(global_buf_id);
+  ASSERT_TRUE(writer);
+  const size_t kNumPackets = 6000;
+  const std::string kPayload(1024, 'x');
+  for (size_t i = 0; i < kNumPackets; i++) {
+    writer->NewTracePacket()->set_for_testing()->set_str(
+        std::to_string(i) + kPayload);
+    if (i % 100 == 99 || i == kNumPackets - 1) {
+      std::string checkpoint = "on_data_committed_" + std::to_string(i);
+      writer->Flush(task_runner_->CreateCheckpoint(checkpoint));
+      task_runner_->RunUntilCheckpoint(checkpoint);
+    }
+  }
+
+  consumer_endpoint_->ReadBuffers();
+  size_t num_pack_rx = 0;
+  auto all_packets_rx = task_runner_->CreateCheckpoint("all_packets_rx");
+  EXPECT_CALL(consumer_, OnTracePackets(_, _))
+      .WillRepeatedly(
+          Invoke([&num_pack_rx, &kPayload, all_packets_rx](
+                     std::vector<TracePacket>* packets, bool has_more) {
+            for (auto& encoded_packet : *packets) {
+              protos::gen::TracePacket packet;
+              ASSERT_TRUE(packet.ParseFromString(
+                  encoded_packet.GetRawBytesForTesting()));
+              if (packet.has_for_testing()) {
+                EXPECT_EQ(packet.for_testing().str(),
+                          std::to_string(num_pack_rx++) + kPayload);
+              }
+            }
+            if (!has_more)
+              all_packets_rx();
+          }));
+  task_runner_->RunUntilCheckpoint("all_packets_rx");
+  ASSERT_EQ(kNumPackets, num_pack_rx);
+
+  consumer_endpoint_->DisableTracing();
+  auto on_tracing_disabled =
+      task_runner_->CreateCheckpoint("on_tracing_disabled");
+  EXPECT_CALL(producer_, StopDataSource(_));
+  EXPECT_CALL(consumer_, OnTracingDisabled(_))
+      .WillOnce(InvokeWithoutArgs(on_tracing_disabled));
+  task_runner_->RunUntilCheckpoint("on_tracing_disabled");
+}
+
 TEST_F(TracingIntegrationTest, WriteIntoFile) {
   // Start tracing.
   TraceConfig trace_config;
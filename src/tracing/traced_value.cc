@@ -152,7 +152,7 @@ TracedValue TracedDictionary::AddItem(DynamicString key) {
   PERFETTO_DCHECK(checked_scope_.is_active());
   protos::pbzero::DebugAnnotation* item =
       message_->BeginNestedMessage<protos::pbzero::DebugAnnotation>(field_id_);
-  item->set_name(key.value);
+  item->set_name(key.value, key.length);
   return TracedValue(item, event_context_, &checked_scope_);
 }
 
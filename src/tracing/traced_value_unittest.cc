@@ -475,6 +475,7 @@ TEST(TracedValueTest, PrimitiveTypesSupport) {
   EXPECT_EQ("true", TracedValueToString(true));
   EXPECT_EQ("foo", TracedValueToString("foo"));
   EXPECT_EQ("bar", TracedValueToString(std::string("bar")));
+  EXPECT_EQ("baz", TracedValueToString(std::string_view("bazqux", 3)));
 }
 
 TEST(TracedValueTest, UniquePtrSupport) {
@@ -525,6 +526,14 @@ TEST(TracedValueTest, WriteWithFallback) {
   EXPECT_EQ("1", ToStringWithFallback(1, "fallback"));
   EXPECT_EQ("true", ToStringWithFallback(true, "fallback"));
   EXPECT_EQ("fallback", ToStringWithFallback(NonSupportedType(), "fallback"));
+
+  // String literal fallbacks.
+  protozero::HeapBuffered<protos::pbzero::DebugAnnotation> message;
+  WriteIntoTracedValueWithFallback(
+      internal::CreateTracedValueFromProto(message.get()), NonSupportedType(),
+      "literal");
+  EXPECT_EQ("literal",
+            internal::DebugAnnotationToString(message.SerializeAsString()));
 }
 
 TEST(TracedValueTest, ConstAndNotConstSupport) {
@@ -605,6 +614,13 @@ TEST(TracedValueTest, DictionaryKeys) {
               std::string key = "dynamic";
               dict.Add(DynamicString{key}, 1);
             }));
+
+  // Only the first |length| characters of dynamic keys are used.
+  EXPECT_EQ("{dynamic:1}", TracedValueToString([&](TracedValue context) {
+              auto dict = std::move(context).WriteDictionary();
+              std::string key = "dynamic_key";
+              dict.Add(DynamicString{key.data(), 7}, 1);
+            }));
 }
 
 TEST(TracedValueTest, EmptyDict) {
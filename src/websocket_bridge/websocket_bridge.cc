@@ -32,59 +32,26 @@ namespace {
 
 constexpr int kWebsocketPort = 8037;
 
-struct Endpoint {
-  const char* uri;
-  const char* endpoint;
-  base::SockFamily family;
-};
-
-class WSBridge : public base::HttpRequestHandler,
-                 public base::UnixSocket::EventListener {
- public:
-  void Main(int argc, char** argv);
-
-  // base::HttpRequestHandler implementation.
-  void OnHttpRequest(const base::HttpRequest&) override;
-  void OnWebsocketMessage(const base::WebsocketMessage&) override;
-  void OnHttpConnectionClosed(base::HttpServerConnection*) override;
-
-  // base::UnixSocket::EventListener implementation.
-  void OnNewIncomingConnection(base::UnixSocket*,
-                               std::unique_ptr<base::UnixSocket>) override;
-  void OnConnect(base::UnixSocket*, bool) override;
-  void OnDisconnect(base::UnixSocket*) override;
-  void OnDataAvailable(base::UnixSocket* self) override;
-
- private:
-  base::HttpServerConnection* GetWebsocket(base::UnixSocket*);
-
-  base::UnixTaskRunner task_runner_;
-  std::vector<Endpoint> endpoints_;
-  std::map<base::HttpServerConnection*, std::unique_ptr<base::UnixSocket>>
-      conns_;
-};
-
-void WSBridge::Main(int, char**) {
-#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
-  // On Windows traced used a TCP socket.
-  const auto kTracedFamily = base::SockFamily::kInet;
-#else
-  const auto kTracedFamily = base::SockFamily::kUnix;
-#endif
-  endpoints_.push_back({"/traced", GetConsumerSocket(), kTracedFamily});
-  endpoints_.push_back({"/adb", "127.0.0.1:5037", base::SockFamily::kInet});
-
-  base::HttpServer srv(&task_runner_, this);
-  srv.AddAllowedOrigin("http://localhost:10000");
-  srv.AddAllowedOrigin("http://127.0.0.1:10000");
-  srv.AddAllowedOrigin("https://ui.perfetto.dev");
+}  // namespace
 
-  srv.Start(kWebsocketPort);
-  PERFETTO_LOG("[WSBridge] Listening on 127.0.0.1:%d", kWebsocketPort);
-  task_runner_.Run();
+WebsocketBridge::WebsocketBridge(base::TaskRunner* task_runner,
+                                 std::vector<Endpoint> endpoints)
+    : task_runner_(task_runner),
+      endpoints_(std::move(endpoints)),
+      rx_buf_(new char[kMaxForwardSize]) {}
+
+WebsocketBridge::~WebsocketBridge() = default;
+
+void WebsocketBridge::Start(int port,
+                            const std::vector<std::string>& allowed_origins) {
+  srv_.reset(new base::HttpServer(task_runner_, this));
+  for (const std::string& origin : allowed_origins)
+    srv_->AddAllowedOrigin(origin);
+  srv_->Start(port);
+  PERFETTO_LOG("[WSBridge] Listening on 127.0.0.1:%d", port);
 }
 
-void WSBridge::OnHttpRequest(const base::HttpRequest& req) {
+void WebsocketBridge::OnHttpRequest(const base::HttpRequest& req) {
   for (const auto& ep : endpoints_) {
     if (req.uri != ep.uri || !req.is_websocket_handshake)
       continue;
@@ -111,7 +78,7 @@ void WSBridge::OnHttpRequest(const base::HttpRequest& req) {
 
     PERFETTO_DLOG("[WSBridge] Connected to %s", ep.endpoint);
     conns_[req.conn] = base::UnixSocket::AdoptConnected(
-        sock_raw.ReleaseFd(), this, &task_runner_, ep.family,
+        sock_raw.ReleaseFd(), this, task_runner_, ep.family,
         base::SockType::kStream);
 
     req.conn->UpgradeToWebsocket(req);
@@ -121,7 +88,7 @@ void WSBridge::OnHttpRequest(const base::HttpRequest& req) {
 }
 
 // Called when an inbound websocket message is received from the browser.
-void WSBridge::OnWebsocketMessage(const base::WebsocketMessage& msg) {
+void WebsocketBridge::OnWebsocketMessage(const base::WebsocketMessage& msg) {
   auto it = conns_.find(msg.conn);
   PERFETTO_CHECK(it != conns_.end());
   // Pass through the websocket message onto the endpoint TCP socket.
@@ -130,23 +97,34 @@ void WSBridge::OnWebsocketMessage(const base::WebsocketMessage& msg) {
 }
 
 // Called when a TCP message is received from the endpoint.
-void WSBridge::OnDataAvailable(base::UnixSocket* sock) {
+void WebsocketBridge::OnDataAvailable(base::UnixSocket* sock) {
   base::HttpServerConnection* websocket = GetWebsocket(sock);
   PERFETTO_CHECK(websocket);
 
-  char buf[8192];
-  auto rsize = sock->Receive(buf, sizeof(buf));
-  if (rsize > 0) {
-    websocket->SendWebsocketMessage(buf, static_cast<size_t>(rsize));
-  } else {
-    // Connection closed or errored.
+  // Drain the socket into one websocket message rather than forwarding each
+  // read on its own: when the endpoint writes in small chunks, this avoids
+  // sending many small frames (and as many syscalls) to the browser.
+  size_t rx_size = 0;
+  while (rx_size < kMaxForwardSize) {
+    size_t rsize =
+        sock->Receive(rx_buf_.get() + rx_size, kMaxForwardSize - rx_size);
+    if (rsize == 0)
+      break;
+    rx_size += rsize;
+  }
+  if (rx_size > 0)
+    websocket->SendWebsocketMessage(rx_buf_.get(), rx_size);
+
+  // Receive() returns 0 both when there is no more data to read and when the
+  // connection is closed or errored.
+  if (!sock->is_connected()) {
     sock->Shutdown(/*notify=*/true);  // Will trigger OnDisconnect().
     websocket->Close();
   }
 }
 
 // Called when the browser terminates the websocket connection.
-void WSBridge::OnHttpConnectionClosed(base::HttpServerConnection* websocket) {
+void WebsocketBridge::OnHttpConnectionClosed(base::HttpServerConnection* websocket) {
   PERFETTO_DLOG("[WSBridge] Websocket connection closed");
   auto it = conns_.find(websocket);
   if (it == conns_.end())
@@ -156,7 +134,7 @@ void WSBridge::OnHttpConnectionClosed(base::HttpServerConnection* websocket) {
   conns_.erase(websocket);
 }
 
-void WSBridge::OnDisconnect(base::UnixSocket* sock) {
+void WebsocketBridge::OnDisconnect(base::UnixSocket* sock) {
   base::HttpServerConnection* websocket = GetWebsocket(sock);
   if (!websocket)
     return;
@@ -166,7 +144,7 @@ void WSBridge::OnDisconnect(base::UnixSocket* sock) {
   PERFETTO_DLOG("[WSBridge] Socket connection closed");
 }
 
-base::HttpServerConnection* WSBridge::GetWebsocket(base::UnixSocket* sock) {
+base::HttpServerConnection* WebsocketBridge::GetWebsocket(base::UnixSocket* sock) {
   for (const auto& it : conns_) {
     if (it.second.get() == sock) {
       return it.first;
@@ -175,15 +153,29 @@ base::HttpServerConnection* WSBridge::GetWebsocket(base::UnixSocket* sock) {
   return nullptr;
 }
 
-void WSBridge::OnConnect(base::UnixSocket*, bool) {}
-void WSBridge::OnNewIncomingConnection(base::UnixSocket*,
-                                       std::unique_ptr<base::UnixSocket>) {}
-
-}  // namespace
+void WebsocketBridge::OnConnect(base::UnixSocket*, bool) {}
+void WebsocketBridge::OnNewIncomingConnection(
+    base::UnixSocket*,
+    std::unique_ptr<base::UnixSocket>) {}
 
-int PERFETTO_EXPORT_ENTRYPOINT WebsocketBridgeMain(int argc, char** argv) {
-  perfetto::WSBridge ws_bridge;
-  ws_bridge.Main(argc, argv);
+int PERFETTO_EXPORT_ENTRYPOINT WebsocketBridgeMain(int, char**) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  // On Windows traced used a TCP socket.
+  const auto kTracedFamily = base::SockFamily::kInet;
+#else
+  const auto kTracedFamily = base::SockFamily::kUnix;
+#endif
+  base::UnixTaskRunner task_runner;
+  WebsocketBridge ws_bridge(
+      &task_runner,
+      {
+          {"/traced", GetConsumerSocket(), kTracedFamily},
+          {"/adb", "127.0.0.1:5037", base::SockFamily::kInet},
+      });
+  ws_bridge.Start(kWebsocketPort, {"http://localhost:10000",
+                                   "http://127.0.0.1:10000",
+                                   "https://ui.perfetto.dev"});
+  task_runner.Run();
   return 0;
 }
 
@@ -17,10 +17,75 @@
 #ifndef SRC_WEBSOCKET_BRIDGE_WEBSOCKET_BRIDGE_H_
 #define SRC_WEBSOCKET_BRIDGE_WEBSOCKET_BRIDGE_H_
 
+#include <stddef.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "perfetto/base/compiler.h"
+#include "perfetto/ext/base/http/http_server.h"
+#include "perfetto/ext/base/unix_socket.h"
 
 namespace perfetto {
+
+namespace base {
+class TaskRunner;
+}  // namespace base
+
+// Relays the websocket connections of the UI to local TCP/UNIX sockets (e.g.
+// traced and adb), one socket connection per websocket.
+class WebsocketBridge : public base::HttpRequestHandler,
+                        public base::UnixSocket::EventListener {
+ public:
+  struct Endpoint {
+    const char* uri;
+    const char* endpoint;
+    base::SockFamily family;
+  };
+
+  // The data received from an endpoint is forwarded to the websocket in
+  // messages of up to this size.
+  static constexpr size_t kMaxForwardSize = 1024 * 1024;
+
+  WebsocketBridge(base::TaskRunner*, std::vector<Endpoint>);
+  ~WebsocketBridge() override;
+
+  // Starts listening for websocket connections on |port|. Only the given
+  // origins are allowed to connect.
+  void Start(int port, const std::vector<std::string>& allowed_origins);
+
+  // base::HttpRequestHandler implementation.
+  void OnHttpRequest(const base::HttpRequest&) override;
+  void OnWebsocketMessage(const base::WebsocketMessage&) override;
+  void OnHttpConnectionClosed(base::HttpServerConnection*) override;
+
+  // base::UnixSocket::EventListener implementation.
+  void OnNewIncomingConnection(base::UnixSocket*,
+                               std::unique_ptr<base::UnixSocket>) override;
+  void OnConnect(base::UnixSocket*, bool) override;
+  void OnDisconnect(base::UnixSocket*) override;
+  void OnDataAvailable(base::UnixSocket* self) override;
+
+ private:
+  base::HttpServerConnection* GetWebsocket(base::UnixSocket*);
+
+  base::TaskRunner* const task_runner_;
+  const std::vector<Endpoint> endpoints_;
+  std::map<base::HttpServerConnection*, std::unique_ptr<base::UnixSocket>>
+      conns_;
+
+  // Reused by all the connections to receive the data of the endpoints.
+  std::unique_ptr<char[]> rx_buf_;
+
+  // Declared last so that it's destroyed first: closing its connections
+  // calls back into OnHttpConnectionClosed().
+  std::unique_ptr<base::HttpServer> srv_;
+};
+
 int WebsocketBridgeMain(int argc, char** argv);
-}
+
+}  // namespace perfetto
 
 #endif  // SRC_WEBSOCKET_BRIDGE_WEBSOCKET_BRIDGE_H_
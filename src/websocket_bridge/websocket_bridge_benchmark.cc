@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the sustained throughput of the websocket bridge when an endpoint
+// streams data to the UI, as when live-streaming a trace.
+
+#include <sys/socket.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/thread_task_runner.h"
+#include "perfetto/ext/base/unix_socket.h"
+#include "src/websocket_bridge/websocket_bridge.h"
+
+namespace perfetto {
+namespace {
+
+constexpr int kBridgePort = 5131;
+constexpr char kEndpointAddr[] = "127.0.0.1:5132";
+constexpr char kOrigin[] = "http://localhost:10000";
+
+// Bytes received by the client in each iteration.
+constexpr size_t kBytesPerIteration = 16 * 1024 * 1024;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Accepts one connection and writes |chunk_size| bytes at a time into it until
+// the bridge disconnects.
+void RunEndpoint(base::UnixSocketRaw listen_sock, size_t chunk_size) {
+  base::ScopedSocketHandle fd(accept(listen_sock.fd(), nullptr, nullptr));
+  PERFETTO_CHECK(fd);
+  base::UnixSocketRaw sock(std::move(fd), base::SockFamily::kInet,
+                           base::SockType::kStream);
+  sock.SetBlocking(true);
+  std::vector<char> chunk(chunk_size, 'x');
+  while (sock.Send(chunk.data(), chunk.size()) > 0) {
+  }
+}
+
+// Connects to the bridge and upgrades the connection to a websocket. Returns
+// false if the handshake failed.
+bool ConnectWebsocket(base::UnixSocketRaw* sock) {
+  *sock = base::UnixSocketRaw::CreateMayFail(base::SockFamily::kInet,
+                                             base::SockType::kStream);
+  sock->SetBlocking(true);
+  if (!sock->Connect("127.0.0.1:" + std::to_string(kBridgePort)))
+    return false;
+  sock->SendStr(
+      "GET /endpoint HTTP/1.1\r\n"
+      "Origin: " +
+      std::string(kOrigin) +
+      "\r\n"
+      "Connection: upgrade\r\n"
+      "Upgrade: websocket\r\n"
+      "Sec-WebSocket-Version: 13\r\n"
+      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+      "\r\n");
+
+  // Read the response headers one byte at a time, so that no websocket frame
+  // is consumed.
+  std::string resp;
+  char c;
+  while (resp.find("\r\n\r\n") == std::string::npos) {
+    if (sock->Receive(&c, 1) != 1)
+      return false;
+    resp.push_back(c);
+  }
+  return resp.find("101 Switching Protocols") != std::string::npos;
+}
+
+}  // namespace
+
+static void BM_WebsocketBridgeForward(benchmark::State& state) {
+  auto chunk_size = static_cast<size_t>(state.range(0));
+
+  base::UnixSocketRaw listen_sock = base::UnixSocketRaw::CreateMayFail(
+      base::SockFamily::kInet, base::SockType::kStream);
+  if (!listen_sock || !listen_sock.Bind(kEndpointAddr) ||
+      !listen_sock.Listen()) {
+    state.SkipWithError("Could not listen on the endpoint address");
+    return;
+  }
+  std::thread endpoint(RunEndpoint, std::move(listen_sock), chunk_size);
+
+  base::ThreadTaskRunner bridge_thread =
+      base::ThreadTaskRunner::CreateAndStart("ws_bridge");
+  std::unique_ptr<WebsocketBridge> bridge;
+  bridge_thread.PostTaskAndWaitForTesting([&] {
+    bridge.reset(new WebsocketBridge(
+        bridge_thread.get(),
+        {{"/endpoint", kEndpointAddr, base::SockFamily::kInet}}));
+    bridge->Start(kBridgePort, {kOrigin});
+  });
+
+  base::UnixSocketRaw client;
+  if (!ConnectWebsocket(&client)) {
+    state.SkipWithError("Websocket handshake failed");
+    // Unblock the endpoint thread, which is still waiting for a connection.
+    base::UnixSocketRaw unblock = base::UnixSocketRaw::CreateMayFail(
+        base::SockFamily::kInet, base::SockType::kStream);
+    unblock.Connect(kEndpointAddr);
+  } else {
+    std::vector<char> buf(1024 * 1024);
+    for (auto _ : state) {
+      size_t received = 0;
+      while (received < kBytesPerIteration) {
+        ssize_t rsize = client.Receive(buf.data(), buf.size());
+        if (rsize <= 0) {
+          state.SkipWithError("Websocket closed");
+          break;
+        }
+        received += static_cast<size_t>(rsize);
+      }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                            static_cast<int64_t>(kBytesPerIteration));
+  }
+
+  // Closing the websocket makes the bridge disconnect from the endpoint, which
+  // stops the endpoint thread.
+  client.Shutdown();
+  bridge_thread.PostTaskAndWaitForTesting([&] { bridge.reset(); });
+  endpoint.join();
+}
+
+// Small chunks stress the coalescing of the data into websocket messages,
+// large ones the copies.
+BENCHMARK(BM_WebsocketBridgeForward)
+    ->Apply([](benchmark::internal::Benchmark* b) {
+      b->Arg(4096);
+      if (!IsBenchmarkFunctionalOnly())
+        b->Arg(256 * 1024);
+    })
+    ->UseRealTime();
+
+}  // namespace perfetto
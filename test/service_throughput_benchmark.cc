@@ -0,0 +1,396 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the scalability of the tracing service with many producers, each
+// writing from several threads into several buffers, while a consumer drains
+// the buffers into a file with write_into_file.
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/time.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "perfetto/ext/base/thread_task_runner.h"
+#include "perfetto/ext/tracing/core/producer.h"
+#include "perfetto/ext/tracing/core/trace_writer.h"
+#include "perfetto/ext/tracing/ipc/producer_ipc_client.h"
+#include "perfetto/tracing/core/data_source_config.h"
+#include "perfetto/tracing/core/data_source_descriptor.h"
+#include "perfetto/tracing/core/trace_config.h"
+#include "src/base/test/test_task_runner.h"
+#include "test/test_helper.h"
+
+#include "protos/perfetto/common/trace_stats.gen.h"
+#include "protos/perfetto/trace/test_event.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+
+namespace {
+
+constexpr char kDataSourceName[] = "perfetto.benchmark.ServiceThroughput";
+
+// Each writer writes about this many bytes of payload before committing.
+constexpr uint32_t kBatchBytes = 64 * 1024;
+constexpr uint32_t kMaxPacketBytes = 64 * 1024;
+constexpr uint32_t kFileWritePeriodMs = 100;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+enum class PacketSizeDistribution : int64_t {
+  // All the packets have the mean size.
+  kFixed = 0,
+  // Uniform between 1 byte and twice the mean size.
+  kUniform = 1,
+  // Mostly small packets with a long tail of big ones, like most real data
+  // sources.
+  kExponential = 2,
+};
+
+class PacketSizeSampler {
+ public:
+  PacketSizeSampler(PacketSizeDistribution distribution,
+                    uint32_t mean_bytes,
+                    uint32_t seed)
+      : distribution_(distribution),
+        mean_bytes_(mean_bytes),
+        rnd_engine_(seed),
+        uniform_(1, 2 * mean_bytes - 1),
+        exponential_(1.0 / static_cast<double>(mean_bytes)) {}
+
+  uint32_t Next() {
+    switch (distribution_) {
+      case PacketSizeDistribution::kFixed:
+        return mean_bytes_;
+      case PacketSizeDistribution::kUniform:
+        return uniform_(rnd_engine_);
+      case PacketSizeDistribution::kExponential:
+        return std::clamp(static_cast<uint32_t>(exponential_(rnd_engine_)), 1u,
+                          kMaxPacketBytes);
+    }
+    PERFETTO_FATAL("For GCC");
+  }
+
+ private:
+  PacketSizeDistribution distribution_;
+  uint32_t mean_bytes_;
+  std::minstd_rand0 rnd_engine_;
+  std::uniform_int_distribution<uint32_t> uniform_;
+  std::exponential_distribution<double> exponential_;
+};
+
+// A thread writing into one buffer with its own TraceWriter.
+class WriterThread {
+ public:
+  WriterThread(TracingService::ProducerEndpoint* endpoint,
+               BufferID target_buffer,
+               PacketSizeSampler sampler)
+      : runner_(base::ThreadTaskRunner::CreateAndStart("perfetto.bench.wr")),
+        sampler_(std::move(sampler)) {
+    runner_.PostTaskAndWaitForTesting([this, endpoint, target_buffer] {
+      writer_ = endpoint->CreateTraceWriter(target_buffer);
+    });
+  }
+
+  ~WriterThread() {
+    runner_.PostTaskAndWaitForTesting([this] { writer_.reset(); });
+  }
+
+  // Writes |packet_count| packets and commits them. |on_committed| is called
+  // on the producer thread once the service has acknowledged the commit.
+  void WriteBatch(uint32_t packet_count, std::function<void()> on_committed) {
+    runner_.PostTask([this, packet_count, on_committed] {
+      static const std::string kPayload(kMaxPacketBytes, '.');
+      for (uint32_t i = 0; i < packet_count; i++) {
+        uint32_t size = sampler_.Next();
+        auto packet = writer_->NewTracePacket();
+        packet->set_for_testing()->set_str(kPayload.data(), size);
+        bytes_written_ += size;
+      }
+      int64_t start_ns = base::GetWallTimeNs().count();
+      writer_->Flush([this, start_ns, on_committed] {
+        commit_latencies_ns_.push_back(base::GetWallTimeNs().count() -
+                                       start_ns);
+        on_committed();
+      });
+    });
+  }
+
+  // Only valid once all the WriteBatch() calls have been committed.
+  const std::vector<int64_t>& commit_latencies_ns() const {
+    return commit_latencies_ns_;
+  }
+  uint64_t bytes_written() const { return bytes_written_; }
+
+ private:
+  base::ThreadTaskRunner runner_;  // Keep first.
+
+  PacketSizeSampler sampler_;
+  std::unique_ptr<TraceWriter> writer_;
+  uint64_t bytes_written_ = 0;
+  std::vector<int64_t> commit_latencies_ns_;
+};
+
+// A producer with one data source instance per buffer of the session and
+// several writer threads spread over these instances.
+class ThroughputProducer : public Producer {
+ public:
+  ThroughputProducer(uint32_t num_buffers, std::function<void()> on_started)
+      : runner_(base::ThreadTaskRunner::CreateAndStart("perfetto.bench.prd")),
+        num_buffers_(num_buffers),
+        on_started_(std::move(on_started)) {}
+
+  ~ThroughputProducer() override {
+    writers_.clear();
+    runner_.PostTaskAndWaitForTesting([this] { endpoint_.reset(); });
+  }
+
+  // |on_connect| is called once the service has seen the data source.
+  void Connect(const std::string& name, std::function<void()> on_connect) {
+    runner_.PostTaskAndWaitForTesting([this, name, on_connect] {
+      on_connect_ = on_connect;
+      endpoint_ = ProducerIPCClient::Connect(
+          TestHelper::GetDefaultModeProducerSocketName(), this, name,
+          runner_.get());
+    });
+  }
+
+  // Must be called after |on_started| has been called.
+  void CreateWriters(uint32_t num_writers,
+                     PacketSizeDistribution distribution,
+                     uint32_t mean_packet_bytes) {
+    for (uint32_t i = 0; i < num_writers; i++) {
+      BufferID target_buffer = target_buffers_[i % target_buffers_.size()];
+      PacketSizeSampler sampler(distribution, mean_packet_bytes,
+                                static_cast<uint32_t>(writers_.size() + 1));
+      writers_.emplace_back(
+          new WriterThread(endpoint_.get(), target_buffer, std::move(sampler)));
+    }
+  }
+
+  const std::vector<std::unique_ptr<WriterThread>>& writers() const {
+    return writers_;
+  }
+
+  // Producer implementation.
+  void OnConnect() override {
+    DataSourceDescriptor descriptor;
+    descriptor.set_name(kDataSourceName);
+    endpoint_->RegisterDataSource(descriptor);
+    endpoint_->Sync(on_connect_);
+  }
+  void OnDisconnect() override {
+    PERFETTO_FATAL("Producer unexpectedly disconnected from the service");
+  }
+  void OnTracingSetup() override {}
+  void SetupDataSource(DataSourceInstanceID, const DataSourceConfig&) override {
+  }
+  void StartDataSource(DataSourceInstanceID,
+                       const DataSourceConfig& config) override {
+    target_buffers_.push_back(static_cast<BufferID>(config.target_buffer()));
+    if (target_buffers_.size() == num_buffers_)
+      on_started_();
+  }
+  void StopDataSource(DataSourceInstanceID) override {}
+  // The writers commit their data after each batch, there is nothing left to
+  // flush.
+  void Flush(FlushRequestID flush_request_id,
+             const DataSourceInstanceID*,
+             size_t,
+             FlushFlags) override {
+    endpoint_->NotifyFlushComplete(flush_request_id);
+  }
+  void ClearIncrementalState(const DataSourceInstanceID*, size_t) override {}
+
+ private:
+  base::ThreadTaskRunner runner_;  // Keep first.
+
+  uint32_t num_buffers_ = 0;
+  std::function<void()> on_started_;
+  std::function<void()> on_connect_;
+  std::vector<BufferID> target_buffers_;
+  std::unique_ptr<TracingService::ProducerEndpoint> endpoint_;
+  std::vector<std::unique_ptr<WriterThread>> writers_;
+};
+
+double Percentile(const std::vector<int64_t>& sorted, double percentile) {
+  if (sorted.empty())
+    return 0;
+  auto index = static_cast<size_t>(percentile / 100.0 *
+                                   static_cast<double>(sorted.size() - 1));
+  return static_cast<double>(sorted[index]);
+}
+
+void BenchmarkServiceThroughput(benchmark::State& state) {
+  auto num_producers = static_cast<uint32_t>(state.range(0));
+  auto threads_per_producer = static_cast<uint32_t>(state.range(1));
+  auto num_buffers = static_cast<uint32_t>(state.range(2));
+  auto distribution = static_cast<PacketSizeDistribution>(state.range(3));
+  auto mean_packet_bytes = static_cast<uint32_t>(state.range(4));
+  uint32_t packets_per_batch = std::max(1u, kBatchBytes / mean_packet_bytes);
+  uint32_t buffer_size_kb = IsBenchmarkFunctionalOnly() ? 256 : 8 * 1024;
+
+  base::TestTaskRunner task_runner;
+  TestHelper helper(&task_runner);
+  helper.StartServiceIfRequired();
+  helper.ConnectConsumer();
+  helper.WaitForConsumerConnect();
+
+  std::vector<std::unique_ptr<ThroughputProducer>> producers;
+  for (uint32_t i = 0; i < num_producers; i++) {
+    std::string suffix = std::to_string(i);
+    auto on_started =
+        helper.WrapTask(helper.CreateCheckpoint("bench.started." + suffix));
+    producers.emplace_back(new ThroughputProducer(num_buffers, on_started));
+    auto on_connect =
+        helper.WrapTask(helper.CreateCheckpoint("bench.connect." + suffix));
+    producers.back()->Connect("perfetto.bench." + suffix, on_connect);
+    helper.RunUntilCheckpoint("bench.connect." + suffix);
+  }
+
+  TraceConfig trace_config;
+  for (uint32_t i = 0; i < num_buffers; i++) {
+    trace_config.add_buffers()->set_size_kb(buffer_size_kb);
+    auto* ds_config = trace_config.add_data_sources()->mutable_config();
+    ds_config->set_name(kDataSourceName);
+    ds_config->set_target_buffer(i);
+  }
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(kFileWritePeriodMs);
+
+  // Only the cost of writing the file matters, not its contents.
+  helper.StartTracing(trace_config,
+                      base::TempFile::CreateUnlinked().ReleaseFD());
+  for (uint32_t i = 0; i < num_producers; i++) {
+    helper.RunUntilCheckpoint("bench.started." + std::to_string(i));
+    producers[i]->CreateWriters(threads_per_producer, distribution,
+                                mean_packet_bytes);
+  }
+  uint32_t num_writers = num_producers * threads_per_producer;
+
+  uint64_t wall_start_ns = static_cast<uint64_t>(base::GetWallTimeNs().count());
+  uint64_t service_start_ns =
+      helper.service_thread()->GetThreadCPUTimeNsForTesting();
+  uint64_t iterations = 0;
+  for (auto _ : state) {
+    // Every writer writes and commits one batch per iteration.
+    std::string cname = "bench.committed." + std::to_string(iterations++);
+    auto on_all_committed = helper.WrapTask(helper.CreateCheckpoint(cname));
+    auto pending = std::make_shared<std::atomic<uint32_t>>(num_writers);
+    auto on_committed = [pending, on_all_committed] {
+      if (pending->fetch_sub(1) == 1)
+        on_all_committed();
+    };
+    for (const auto& producer : producers) {
+      for (const auto& writer : producer->writers())
+        writer->WriteBatch(packets_per_batch, on_committed);
+    }
+    helper.RunUntilCheckpoint(cname);
+  }
+  uint64_t service_ns =
+      helper.service_thread()->GetThreadCPUTimeNsForTesting() -
+      service_start_ns;
+  uint64_t wall_ns =
+      static_cast<uint64_t>(base::GetWallTimeNs().count()) - wall_start_ns;
+
+  // Make sure that all the committed chunks reached the buffers before looking
+  // at what was read and dropped.
+  helper.FlushAndWait(kDefaultTestTimeoutMs);
+  TraceStats stats = helper.QueryTraceStatsAndWait();
+  helper.DisableTracing();
+  helper.WaitForTracingDisabled();
+
+  uint64_t bytes_written = 0;
+  std::vector<int64_t> latencies_ns;
+  for (const auto& producer : producers) {
+    for (const auto& writer : producer->writers()) {
+      bytes_written += writer->bytes_written();
+      latencies_ns.insert(latencies_ns.end(),
+                          writer->commit_latencies_ns().begin(),
+                          writer->commit_latencies_ns().end());
+    }
+  }
+  std::sort(latencies_ns.begin(), latencies_ns.end());
+
+  uint64_t bytes_read = 0;
+  uint64_t chunks_dropped = stats.chunks_discarded();
+  for (const auto& buf_stats : stats.buffer_stats()) {
+    bytes_read += buf_stats.bytes_read();
+    chunks_dropped += buf_stats.chunks_overwritten() +
+                      buf_stats.chunks_discarded() +
+                      buf_stats.abi_violations();
+  }
+
+  double wall_s = static_cast<double>(wall_ns) / 1e9;
+  state.counters["Ser CPU"] = benchmark::Counter(
+      100.0 * static_cast<double>(service_ns) / static_cast<double>(wall_ns));
+  state.counters["Commit p50 us"] = Percentile(latencies_ns, 50) / 1000;
+  state.counters["Commit p90 us"] = Percentile(latencies_ns, 90) / 1000;
+  state.counters["Commit p99 us"] = Percentile(latencies_ns, 99) / 1000;
+  state.counters["Dropped chunks"] = static_cast<double>(chunks_dropped);
+  state.counters["Read MB/s"] =
+      static_cast<double>(bytes_read) / 1024 / 1024 / wall_s;
+  state.SetBytesProcessed(static_cast<int64_t>(bytes_written));
+
+  producers.clear();
+}
+
+// Args: producers, threads per producer, buffers, packet size distribution,
+// mean packet size.
+void ServiceThroughputArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Args({2, 2, 2, static_cast<int64_t>(PacketSizeDistribution::kUniform),
+             256});
+    return;
+  }
+  const PacketSizeDistribution kDistributions[] = {
+      PacketSizeDistribution::kFixed,
+      PacketSizeDistribution::kUniform,
+      PacketSizeDistribution::kExponential,
+  };
+  for (int64_t producers = 1; producers <= 16; producers *= 4) {
+    for (int64_t threads = 1; threads <= 8; threads *= 2) {
+      for (int64_t buffers = 1; buffers <= 4; buffers *= 4) {
+        for (PacketSizeDistribution distribution : kDistributions) {
+          for (int64_t bytes = 64; bytes <= 4096; bytes *= 8) {
+            b->Args({producers, threads, buffers,
+                     static_cast<int64_t>(distribution), bytes});
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+static void BM_ServiceThroughput(benchmark::State& state) {
+  BenchmarkServiceThroughput(state);
+}
+
+BENCHMARK(BM_ServiceThroughput)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime()
+    ->ArgNames({"producers", "threads", "buffers", "dist", "bytes"})
+    ->Apply(ServiceThroughputArgs);
+
+}  // namespace perfetto
@@ -23,6 +23,7 @@
 #include "perfetto/ext/tracing/ipc/default_socket.h"
 #include "perfetto/tracing/core/tracing_service_state.h"
 
+#include "protos/perfetto/common/trace_stats.gen.h"
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
 
 namespace perfetto {
@@ -297,6 +298,20 @@ TracingServiceState TestHelper::QueryServiceStateAndWait() {
   return res;
 }
 
+TraceStats TestHelper::QueryTraceStatsAndWait() {
+  TraceStats res;
+  static int n = 0;
+  std::string checkpoint_name = "query_trace_stats_" + std::to_string(n++);
+  auto checkpoint = CreateCheckpoint(checkpoint_name);
+  on_trace_stats_callback_ = [&checkpoint, &res](const TraceStats& stats) {
+    res = stats;
+    checkpoint();
+  };
+  endpoint_->GetTraceStats();
+  RunUntilCheckpoint(checkpoint_name);
+  return res;
+}
+
 std::function<void()> TestHelper::WrapTask(
     const std::function<void()>& function) {
   return [this, function] { task_runner_->PostTask(function); };
@@ -312,7 +327,10 @@ void TestHelper::OnAttach(bool success, const TraceConfig&) {
     std::move(on_attach_callback_)(success);
 }
 
-void TestHelper::OnTraceStats(bool, const TraceStats&) {}
+void TestHelper::OnTraceStats(bool, const TraceStats& stats) {
+  if (on_trace_stats_callback_)
+    std::move(on_trace_stats_callback_)(stats);
+}
 
 void TestHelper::OnObservableEvents(const ObservableEvents&) {}
 
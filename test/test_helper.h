@@ -335,6 +335,7 @@ class TestHelper : public Consumer {
                        uint32_t timeout_ms = kDefaultTestTimeoutMs);
   void SyncAndWaitProducer(size_t idx = 0);
   TracingServiceState QueryServiceStateAndWait();
+  TraceStats QueryTraceStatsAndWait();
 
   std::string AddID(const std::string& checkpoint) {
     return checkpoint + "." + std::to_string(instance_num_);
@@ -382,6 +383,7 @@ class TestHelper : public Consumer {
   std::function<void()> on_stop_tracing_callback_;
   std::function<void()> on_detach_callback_;
   std::function<void(bool)> on_attach_callback_;
+  std::function<void(const TraceStats&)> on_trace_stats_callback_;
 
   std::vector<protos::gen::TracePacket> full_trace_;
   std::vector<protos::gen::TracePacket> trace_;
@@ -154,6 +154,51 @@ class Parsing(TestSuite):
         """,
         out=Path('sched_waking_instants_compact_sched.out'))
 
+  # Decoding of the columnar FtraceEventBundle.compact_events encoding back into
+  # regular ftrace events.
+  def test_irq_slices_compact_events(self):
+    return DiffTestBlueprint(
+        trace=TextProto(r"""
+        packet {
+          ftrace_events {
+            cpu: 0
+            compact_events {
+              intern_table: "timer"
+              intern_table: "mmc"
+              event {
+                id: 36
+                timestamp: 100001000000
+                timestamp: 2000000
+                pid: 10
+                pid: 10
+                field { id: 1 varint: 27 varint: 40 }
+                field { id: 2 string_index: 0 string_index: 1 }
+                field { id: 3 varint: 0 varint: 0 }
+              }
+              event {
+                id: 37
+                timestamp: 100001500000
+                timestamp: 2000000
+                pid: 10
+                pid: 10
+                field { id: 1 varint: 27 varint: 40 }
+                field { id: 2 varint: 1 varint: 1 }
+              }
+            }
+          }
+        }
+        """),
+        query="""
+        SELECT ts, dur, name
+        FROM slice
+        ORDER BY ts;
+        """,
+        out=Csv("""
+        "ts","dur","name"
+        100001000000,500000,"IRQ (timer)"
+        100003000000,500000,"IRQ (mmc)"
+        """))
+
   # Mm Event
   def test_mm_event(self):
     return DiffTestBlueprint(
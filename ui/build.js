@@ -85,7 +85,7 @@ const cfg = {
   startHttpServer: false,
   httpServerListenHost: '127.0.0.1',
   httpServerListenPort: 10000,
-  wasmModules: ['trace_processor', 'traceconv'],
+  wasmModules: ['trace_processor', 'trace_processor_threads', 'traceconv'],
   crossOriginIsolation: false,
   testFilter: '',
   noOverrideGnArgs: false,
@@ -454,10 +454,17 @@ function buildWasm(skipWasmBuild) {
     addTask(exec, [pjoin(ROOT_DIR, 'tools/ninja'), ninjaArgs]);
   }
 
-  const wasmOutDir = pjoin(cfg.outDir, 'wasm');
   for (const wasmMod of cfg.wasmModules) {
-    // The .wasm file goes directly into the dist dir (also .map in debug)
-    for (const ext of ['.wasm'].concat(cfg.debug ? ['.wasm.map'] : [])) {
+    // Modules using wasm threads are built by their own toolchain (see
+    // gn/wasm_vars.gni).
+    const threads = wasmMod.endsWith('_threads');
+    const wasmOutDir = pjoin(cfg.outDir, threads ? 'wasm_threads' : 'wasm');
+    // The .wasm file goes directly into the dist dir (also .map in debug).
+    // With threads, the pthreads (web workers) also need the .worker.js and
+    // the unbundled .js, which they load by themselves.
+    const distExts = ['.wasm'].concat(cfg.debug ? ['.wasm.map'] : []);
+    if (threads) distExts.push('.worker.js', '.js');
+    for (const ext of distExts) {
       const src = `${wasmOutDir}/${wasmMod}${ext}`;
       addTask(cp, [src, pjoin(cfg.outDistDir, wasmMod + ext)]);
     }
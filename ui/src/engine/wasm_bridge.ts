@@ -15,6 +15,7 @@
 import {defer} from '../base/deferred';
 import {assertExists, assertTrue} from '../base/logging';
 import initTraceProcessor from '../gen/trace_processor';
+import initTraceProcessorThreads from '../gen/trace_processor_threads';
 
 // The Initialize() call will allocate a buffer of REQ_BUF_SIZE bytes which
 // will be used to copy the input request data. This is to avoid passing the
@@ -23,6 +24,21 @@ import initTraceProcessor from '../gen/trace_processor';
 // HEAPU8[reqBufferAddr, +REQ_BUFFER_SIZE].
 const REQ_BUF_SIZE = 32 * 1024 * 1024;
 
+// The memory of the wasm threads module. It is created here because a shared
+// memory can't be detached when it grows, so HEAPU8 is not refreshed when the
+// growth happens on another thread. Keep in sync with wasm.gni.
+const WASM_PAGE_SIZE = 64 * 1024;
+const INITIAL_MEMORY = 32 * 1024 * 1024;
+const MAXIMUM_MEMORY = 2 * 1024 * 1024 * 1024;
+
+// The wasm threads module can only be used if SharedArrayBuffer is available,
+// which requires the page to be cross-origin isolated (i.e. served with the
+// Cross-Origin-Opener-Policy and Cross-Origin-Embedder-Policy headers).
+function wasmThreadsSupported(): boolean {
+  return typeof SharedArrayBuffer !== 'undefined' &&
+      self.crossOriginIsolated === true;
+}
+
 // The end-to-end interaction between JS and Wasm is as follows:
 // - [JS] Inbound data received by the worker (onmessage() in engine/index.ts).
 //   - [JS] onRpcDataReceived() (this file)
@@ -38,6 +54,7 @@ export class WasmBridge {
 
   private aborted: boolean;
   private connection: initTraceProcessor.Module;
+  private memory?: WebAssembly.Memory;
   private reqBufferAddr = 0;
   private lastStderr: string[] = [];
   private messagePort?: MessagePort;
@@ -45,12 +62,27 @@ export class WasmBridge {
   constructor() {
     this.aborted = false;
     const deferredRuntimeInitialized = defer<void>();
-    this.connection = initTraceProcessor({
+    const moduleArgs = {
       locateFile: (s: string) => s,
       print: (line: string) => console.log(line),
       printErr: (line: string) => this.appendAndLogErr(line),
       onRuntimeInitialized: () => deferredRuntimeInitialized.resolve(),
-    });
+    };
+    if (wasmThreadsSupported()) {
+      this.memory = new WebAssembly.Memory({
+        initial: INITIAL_MEMORY / WASM_PAGE_SIZE,
+        maximum: MAXIMUM_MEMORY / WASM_PAGE_SIZE,
+        shared: true,
+      });
+      // The pthreads (web workers) load the module from the unbundled script.
+      this.connection = initTraceProcessorThreads({
+        ...moduleArgs,
+        wasmMemory: this.memory,
+        mainScriptUrlOrBlob: 'trace_processor_threads.js',
+      });
+    } else {
+      this.connection = initTraceProcessor(moduleArgs);
+    }
     this.whenInitialized = deferredRuntimeInitialized.then(() => {
       const fn = this.connection.addFunction(this.onReply.bind(this), 'vii');
       this.reqBufferAddr = this.connection.ccall(
@@ -83,7 +115,7 @@ export class WasmBridge {
     while (wrSize < data.length) {
       const sliceLen = Math.min(data.length - wrSize, REQ_BUF_SIZE);
       const dataSlice = data.subarray(wrSize, wrSize + sliceLen);
-      this.connection.HEAPU8.set(dataSlice, this.reqBufferAddr);
+      this.heapU8().set(dataSlice, this.reqBufferAddr);
       wrSize += sliceLen;
       try {
         this.connection.ccall(
@@ -107,10 +139,19 @@ export class WasmBridge {
   // This function is bound and passed to Initialize and is called by the C++
   // code while in the ccall(trace_processor_on_rpc_request).
   private onReply(heapPtr: number, size: number) {
-    const data = this.connection.HEAPU8.slice(heapPtr, heapPtr + size);
+    const data = this.heapU8().slice(heapPtr, heapPtr + size);
     assertExists(this.messagePort).postMessage(data, [data.buffer]);
   }
 
+  private heapU8(): Uint8Array {
+    if (this.memory === undefined) {
+      return this.connection.HEAPU8;
+    }
+    // The buffer of a shared memory is replaced (rather than detached) when
+    // the memory grows, so a new view is needed every time.
+    return new Uint8Array(this.memory.buffer);
+  }
+
   private appendAndLogErr(line: string) {
     console.warn(line);
     // Keep the last N lines in the |lastStderr| buffer.